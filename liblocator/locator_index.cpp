@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+#include "locator_index.h"
+
+namespace facebook {
+
+namespace {
+
+template <class T>
+void append(std::string& out, T value) {
+  out.append((const char*)&value, sizeof(value));
+}
+
+// Gives up on finding a seed for a bucket after this many tries; with two
+// descriptors per bucket on average, that never happens in practice.
+constexpr uint32_t max_seed = 1 << 24;
+
+}
+
+std::string LocatorHashIndex::build(
+    const std::vector<std::pair<std::string, Locator>>& classes) {
+  uint32_t nslots = classes.size();
+  uint32_t nbuckets = nslots == 0 ? 0 : (nslots + 1) / 2;
+
+  std::unordered_set<std::string> seen;
+  std::vector<std::vector<uint32_t>> buckets(nbuckets);
+  for (uint32_t i = 0; i < nslots; i++) {
+    const auto& descriptor = classes[i].first;
+    if (descriptor.empty() || descriptor[0] == '[') {
+      throw std::runtime_error("not a class descriptor: " + descriptor);
+    }
+    if (!seen.insert(descriptor).second) {
+      throw std::runtime_error("class listed twice: " + descriptor);
+    }
+    buckets[hash(descriptor.c_str(), 0) % nbuckets].push_back(i);
+  }
+
+  // Place the biggest buckets first, while most slots are still free.
+  std::vector<uint32_t> order(nbuckets);
+  for (uint32_t b = 0; b < nbuckets; b++) {
+    order[b] = b;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  const uint32_t unused = 0xFFFFFFFF;
+  std::vector<uint32_t> seeds(nbuckets, 0);
+  std::vector<uint32_t> slot_to_class(nslots, unused);
+  std::vector<uint32_t> bucket_slots;
+  for (auto b : order) {
+    const auto& bucket = buckets[b];
+    if (bucket.empty()) {
+      break;
+    }
+    uint32_t seed = 1;
+    for (; seed < max_seed; seed++) {
+      bucket_slots.clear();
+      bool fits = true;
+      for (auto i : bucket) {
+        uint32_t slot = hash(classes[i].first.c_str(), seed) % nslots;
+        if (slot_to_class[slot] != unused ||
+            std::find(bucket_slots.begin(), bucket_slots.end(), slot) !=
+                bucket_slots.end()) {
+          fits = false;
+          break;
+        }
+        bucket_slots.push_back(slot);
+      }
+      if (fits) {
+        break;
+      }
+    }
+    if (seed == max_seed) {
+      throw std::runtime_error("could not build the locator hash index");
+    }
+    seeds[b] = seed;
+    for (size_t j = 0; j < bucket.size(); j++) {
+      slot_to_class[bucket_slots[j]] = bucket[j];
+    }
+  }
+
+  std::string out;
+  append(out, magic);
+  append(out, version);
+  append(out, nslots);
+  append(out, nbuckets);
+  for (auto seed : seeds) {
+    append(out, seed);
+  }
+  uint32_t descriptor_off = 0;
+  for (auto i : slot_to_class) {
+    const auto& locator = classes[i].second;
+    append(out, descriptor_off);
+    append(out, uint32_t(locator.clsnr));
+    append(out, uint16_t(locator.dexnr));
+    append(out, uint16_t(locator.strnr));
+    descriptor_off += classes[i].first.size() + 1;
+  }
+  for (auto i : slot_to_class) {
+    out.append(classes[i].first.c_str(), classes[i].first.size() + 1);
+  }
+  return out;
+}
+
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "locator.h"
+
+#ifndef LOCATOR_INDEX_NO_BUILDER
+#include <string>
+#include <utility>
+#include <vector>
+#endif
+
+namespace facebook {
+
+//
+// A locator hash index maps class descriptors straight to their locators,
+// for class loaders that would rather not find and decode the locator string
+// in front of each descriptor on every class load.
+//
+// The index is a minimal perfect hash over the descriptors, built with the
+// hash-and-displace scheme: each descriptor is first hashed into one of a
+// number of buckets, and each bucket has a seed that was chosen at build time
+// so that hashing the descriptors of the bucket with it sends them to slots
+// no other descriptor uses. A lookup is two hashes of the descriptor and one
+// string compare, to reject descriptors that are not in the index.
+//
+// The format, all little-endian:
+//
+//   u32 magic, u32 version, u32 number of slots, u32 number of buckets
+//   u32 seeds[number of buckets]
+//   slots[number of slots]: u32 descriptor offset, u32 clsnr, u16 dexnr,
+//     u16 strnr
+//   the descriptors, each NUL-terminated; offsets are relative to the first
+//
+// Like the locator strings, the index is built by redex and read on the
+// device, so the lookup side needs nothing but this header.
+//
+class LocatorHashIndex {
+ public:
+  constexpr static const uint32_t magic = 0x5844494c; // "LIDX"
+  constexpr static const uint32_t version = 1;
+
+  // Points into data, which must outlive the index. Check valid() before
+  // looking anything up.
+  inline LocatorHashIndex(const void* data, size_t size) noexcept;
+
+  bool valid() const noexcept { return m_valid; }
+  uint32_t size() const noexcept { return m_nslots; }
+
+  // Returns the locator of the class, or (0, 0, 0) if it is not in the index.
+  // As with decodeGlobalClassIndex, array descriptors are looked up by their
+  // element type.
+  inline Locator lookup(const char* descriptor) const noexcept;
+
+  static inline uint32_t hash(const char* descriptor, uint32_t seed) noexcept;
+
+#ifndef LOCATOR_INDEX_NO_BUILDER
+  // Serializes an index of these classes. Throws if there are duplicates.
+  static std::string build(
+      const std::vector<std::pair<std::string, Locator>>& classes);
+#endif
+
+ private:
+  struct Slot {
+    uint32_t descriptor_off;
+    uint32_t clsnr;
+    uint16_t dexnr;
+    uint16_t strnr;
+  };
+
+  constexpr static const size_t header_size = 4 * sizeof(uint32_t);
+
+  bool m_valid{false};
+  uint32_t m_nslots{0};
+  uint32_t m_nbuckets{0};
+  const uint32_t* m_seeds{nullptr};
+  const Slot* m_slots{nullptr};
+  const char* m_descriptors{nullptr};
+  size_t m_descriptors_size{0};
+};
+
+LocatorHashIndex::LocatorHashIndex(const void* data, size_t size) noexcept {
+  if (size < header_size) {
+    return;
+  }
+  const uint32_t* header = (const uint32_t*)data;
+  if (header[0] != magic || header[1] != version) {
+    return;
+  }
+  m_nslots = header[2];
+  m_nbuckets = header[3];
+  uint64_t tables_size = header_size + uint64_t(m_nbuckets) * sizeof(uint32_t) +
+                         uint64_t(m_nslots) * sizeof(Slot);
+  if ((m_nslots != 0 && m_nbuckets == 0) || tables_size > size) {
+    return;
+  }
+  m_seeds = header + 4;
+  m_slots = (const Slot*)(m_seeds + m_nbuckets);
+  m_descriptors = (const char*)(m_slots + m_nslots);
+  m_descriptors_size = size - tables_size;
+  m_valid = true;
+}
+
+uint32_t LocatorHashIndex::hash(const char* descriptor,
+                                uint32_t seed) noexcept {
+  // FNV-1a, followed by the finalizer of MurmurHash3 so the seed gets mixed
+  // into all the bits.
+  uint32_t h = 2166136261u ^ seed;
+  for (const uint8_t* p = (const uint8_t*)descriptor; *p; ++p) {
+    h = (h ^ *p) * 16777619u;
+  }
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+Locator LocatorHashIndex::lookup(const char* descriptor) const noexcept {
+  if (!m_valid || m_nslots == 0) {
+    return Locator(0, 0, 0);
+  }
+  while (*descriptor == '[') {
+    ++descriptor;
+  }
+  uint32_t bucket = hash(descriptor, 0) % m_nbuckets;
+  const Slot& slot = m_slots[hash(descriptor, m_seeds[bucket]) % m_nslots];
+  if (slot.descriptor_off >= m_descriptors_size) {
+    return Locator(0, 0, 0);
+  }
+  const char* candidate = m_descriptors + slot.descriptor_off;
+  size_t max_len = m_descriptors_size - slot.descriptor_off;
+  size_t len = strlen(descriptor);
+  if (len >= max_len || memcmp(candidate, descriptor, len + 1) != 0) {
+    return Locator(0, 0, 0);
+  }
+  return Locator(slot.strnr, slot.dexnr, slot.clsnr);
+}
+
+} // namespace facebook
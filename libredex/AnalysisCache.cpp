@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AnalysisCache.h"
+
+#include "HierarchyIndex.h"
+#include "MethodOverrideGraph.h"
+#include "TypeSystem.h"
+
+std::shared_ptr<const TypeSystem> TypeSystemAnalysis::run(const Scope& scope) {
+  return std::make_shared<const TypeSystem>(scope);
+}
+
+std::shared_ptr<const ClassHierarchy> ClassHierarchyAnalysis::run(
+    const Scope& scope) {
+  return std::make_shared<const ClassHierarchy>(build_type_hierarchy(scope));
+}
+
+std::shared_ptr<const HierarchyIndex> HierarchyIndexAnalysis::run(
+    const Scope& scope) {
+  return std::make_shared<const HierarchyIndex>(scope);
+}
+
+std::shared_ptr<const method_override_graph::Graph>
+MethodOverrideGraphAnalysis::run(const Scope& scope) {
+  return method_override_graph::build_graph(scope);
+}
+
+void AnalysisCache::invalidate(const PreservedAnalyses& preserved) {
+  for (auto it = m_results.begin(); it != m_results.end();) {
+    if (preserved.is_preserved(it->first)) {
+      ++it;
+    } else {
+      it = m_results.erase(it);
+    }
+  }
+}
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+
+class HierarchyIndex;
+class TypeSystem;
+
+namespace method_override_graph {
+class Graph;
+} // namespace method_override_graph
+
+/*
+ * The whole-program analyses that the PassManager caches for the passes, so
+ * that they are only recomputed after a pass that may have invalidated them.
+ * An analysis is a type with a `Result` type and a static
+ *
+ *   std::shared_ptr<const Result> run(const Scope&);
+ *
+ * Results are computed on the scope of all the stores, as returned by
+ * build_class_scope(); passes that work on a different scope must not use the
+ * cache.
+ */
+struct TypeSystemAnalysis {
+  using Result = TypeSystem;
+  static std::shared_ptr<const Result> run(const Scope&);
+};
+
+struct ClassHierarchyAnalysis {
+  using Result = ClassHierarchy;
+  static std::shared_ptr<const Result> run(const Scope&);
+};
+
+struct HierarchyIndexAnalysis {
+  using Result = HierarchyIndex;
+  static std::shared_ptr<const Result> run(const Scope&);
+};
+
+struct MethodOverrideGraphAnalysis {
+  using Result = method_override_graph::Graph;
+  static std::shared_ptr<const Result> run(const Scope&);
+};
+
+/*
+ * The analyses that a pass leaves valid, in the style of LLVM's new pass
+ * manager. Passes that don't change the class hierarchy, nor add, remove or
+ * rename methods or fields, can preserve all the analyses above; passes that
+ * only edit method bodies are the typical case.
+ */
+class PreservedAnalyses {
+ public:
+  static PreservedAnalyses none() { return PreservedAnalyses(); }
+
+  static PreservedAnalyses all() {
+    PreservedAnalyses preserved;
+    preserved.m_all = true;
+    return preserved;
+  }
+
+  template <class Analysis>
+  PreservedAnalyses& preserve() {
+    m_preserved.emplace(typeid(Analysis));
+    return *this;
+  }
+
+  template <class Analysis>
+  bool is_preserved() const {
+    return is_preserved(typeid(Analysis));
+  }
+
+  bool is_preserved(std::type_index analysis) const {
+    return m_all || m_preserved.count(analysis) != 0;
+  }
+
+ private:
+  bool m_all{false};
+  std::unordered_set<std::type_index> m_preserved;
+};
+
+/*
+ * Not thread-safe: passes should fetch the results they need before fanning
+ * out. References to results stay valid until the end of the current pass.
+ */
+class AnalysisCache {
+ public:
+  template <class Analysis>
+  const typename Analysis::Result& get(const Scope& scope) {
+    return *get_shared<Analysis>(scope);
+  }
+
+  /*
+   * For results that need to outlive the current pass.
+   */
+  template <class Analysis>
+  std::shared_ptr<const typename Analysis::Result> get_shared(
+      const Scope& scope) {
+    using Result = typename Analysis::Result;
+    std::type_index key(typeid(Analysis));
+    auto it = m_results.find(key);
+    if (it != m_results.end()) {
+      ++m_hits;
+      return std::static_pointer_cast<const Result>(it->second);
+    }
+    ++m_misses;
+    std::shared_ptr<const Result> result = Analysis::run(scope);
+    m_results.emplace(key, result);
+    return result;
+  }
+
+  template <class Analysis>
+  bool is_cached() const {
+    return m_results.count(typeid(Analysis)) != 0;
+  }
+
+  // Drops every result that is not in `preserved`.
+  void invalidate(const PreservedAnalyses& preserved);
+
+  void clear() { m_results.clear(); }
+
+  size_t hits() const { return m_hits; }
+
+  size_t misses() const { return m_misses; }
+
+  void reset_stats() { m_hits = m_misses = 0; }
+
+ private:
+  std::unordered_map<std::type_index, std::shared_ptr<const void>> m_results;
+  size_t m_hits{0};
+  size_t m_misses{0};
+};
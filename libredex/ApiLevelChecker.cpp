@@ -6,10 +6,28 @@
  */
 
 #include "ApiLevelChecker.h"
+
+#include <algorithm>
+#include <unordered_map>
+
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace api {
 
+namespace {
+
+// An outer class has one '$' less in its simple name than its inner classes.
+size_t nesting_depth(const DexClass* cls) {
+  const std::string& name = cls->get_deobfuscated_name();
+  auto slash_idx = name.find_last_of('/');
+  auto simple_begin =
+      slash_idx == std::string::npos ? name.begin() : name.begin() + slash_idx;
+  return std::count(simple_begin, name.end(), '$');
+}
+
+} // namespace
+
 // These initial values are bogus until `init()` is called. We can't initialize
 // these values until g_redex exists and the classes have been loaded from the
 // dex file
@@ -39,7 +57,7 @@ void LevelChecker::init(int32_t min_level, const Scope& scope) {
             "unused (okay) or been deleted (not okay)\n");
   }
 
-  walk::parallel::classes(scope, init_class);
+  init_classes(scope);
   walk::parallel::methods(scope, init_method);
 }
 
@@ -48,13 +66,7 @@ int32_t LevelChecker::get_method_level(DexMethod* method) {
   int32_t method_level = method->rstate.get_api_level();
   if (method_level == -1) {
     // must have been created later on by Redex
-    DexClass* cls = type_class(method->get_class());
-    int32_t class_level = cls->rstate.get_api_level();
-    if (class_level == -1) {
-      // must have been created later on by Redex
-      init_class(cls);
-    }
-
+    get_class_level(type_class(method->get_class()));
     init_method(method);
     method_level = method->rstate.get_api_level();
   }
@@ -62,16 +74,85 @@ int32_t LevelChecker::get_method_level(DexMethod* method) {
   return method_level;
 }
 
-void LevelChecker::init_class(DexClass* clazz) {
-  for (DexClass* cls = clazz; cls != nullptr; cls = get_outer_class(cls)) {
+int32_t LevelChecker::get_class_level(DexClass* cls) {
+  always_assert_log(s_has_been_init, "must call init first");
+  int32_t class_level = cls->rstate.get_api_level();
+  if (class_level == -1) {
+    // must have been created later on by Redex
+    init_class(cls);
+    class_level = cls->rstate.get_api_level();
+  }
+  return class_level;
+}
+
+int32_t LevelChecker::compute_class_level(const DexClass* clazz) {
+  for (const DexClass* cls = clazz; cls != nullptr;
+       cls = get_outer_class(cls)) {
     int32_t class_level = get_level(cls);
     if (class_level != -1) {
-      clazz->rstate.set_api_level(class_level);
-      return;
+      return class_level;
     }
   }
+  return s_min_level;
+}
+
+void LevelChecker::init_class(DexClass* clazz) {
+  clazz->rstate.set_api_level(compute_class_level(clazz));
+}
+
+/*
+ * Walking the outer classes of each class on its own looks up the same outer
+ * classes by name once for each of their inner classes. Instead, the classes
+ * are initialized in order of nesting depth, so that an unannotated inner
+ * class takes the level its outer class got just before. Each depth is done in
+ * parallel.
+ */
+void LevelChecker::init_classes(const Scope& scope) {
+  std::unordered_map<const DexClass*, size_t> indices;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    indices.emplace(scope[i], i);
+  }
+  std::vector<size_t> depths(scope.size());
+  std::vector<DexClass*> outers(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    depths[i] = nesting_depth(scope[i]);
+    outers[i] = depths[i] == 0 ? nullptr : get_outer_class(scope[i]);
+  });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
 
-  clazz->rstate.set_api_level(s_min_level);
+  std::vector<std::vector<size_t>> by_depth;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    if (by_depth.size() <= depths[i]) {
+      by_depth.resize(depths[i] + 1);
+    }
+    by_depth[depths[i]].push_back(i);
+  }
+  for (const auto& same_depth : by_depth) {
+    auto depth_wq = workqueue_foreach<size_t>([&](size_t i) {
+      DexClass* cls = scope[i];
+      int32_t class_level = get_level(cls);
+      DexClass* outer = outers[i];
+      if (class_level == -1 && outer == nullptr) {
+        class_level = s_min_level;
+      } else if (class_level == -1) {
+        auto it = indices.find(outer);
+        if (it != indices.end() && depths[it->second] < depths[i]) {
+          class_level = outer->rstate.get_api_level();
+        } else {
+          // The outer class is not in the scope, or not initialized yet.
+          class_level = compute_class_level(outer);
+        }
+      }
+      cls->rstate.set_api_level(class_level);
+    });
+    for (auto i : same_depth) {
+      depth_wq.add_item(i);
+    }
+    depth_wq.run_all();
+  }
 }
 
 void LevelChecker::init_method(DexMethod* method) {
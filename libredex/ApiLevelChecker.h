@@ -52,6 +52,13 @@ class LevelChecker {
    */
   static int32_t get_method_level(DexMethod* method);
 
+  /**
+   * The level that the methods of this class without annotations of their own
+   * get: the level of its own annotation, or else of its closest annotated
+   * outer class, or else s_min_level.
+   */
+  static int32_t get_class_level(DexClass* cls);
+
   /**
    * Return the minimum api level of the entire app. This is the lowest value
    * that `get_method_level` or `get_level` could return. Members with no
@@ -92,7 +99,9 @@ class LevelChecker {
 
  private:
   static DexClass* get_outer_class(const DexClass* cls);
+  static int32_t compute_class_level(const DexClass* clazz);
   static void init_class(DexClass* clazz);
+  static void init_classes(const Scope& scope);
   static void init_method(DexMethod* method);
 
   /**
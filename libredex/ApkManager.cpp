@@ -7,10 +7,22 @@
 
 #include "ApkManager.h"
 
+#include <algorithm>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <zlib.h>
+
+#include "Debug.h"
+#include "ThreadPool.h"
 
 namespace {
 
@@ -22,6 +34,246 @@ void check_directory(std::string& dir) {
   }
 }
 
+// Zip record signatures and sizes; see the .ZIP File Format Specification.
+constexpr uint32_t kLocalFileSignature = 0x04034b50;
+constexpr uint32_t kCentralDirSignature = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirSignature = 0x06054b50;
+constexpr uint16_t kMethodStored = 0;
+constexpr uint16_t kMethodDeflated = 8;
+// 1980-01-01 00:00, so that the APK only depends on the contents of the files.
+constexpr uint16_t kDosTime = 0;
+constexpr uint16_t kDosDate = (1 << 5) | 1;
+
+struct ZipEntry {
+  std::string name;
+  std::string data;
+  uint32_t crc{0};
+  uint32_t size{0};
+  uint32_t compressed_size{0};
+  uint16_t method{kMethodStored};
+  uint32_t offset{0};
+  bool ready{false};
+  std::exception_ptr error;
+};
+
+void put16(std::string& out, uint16_t v) {
+  out.push_back(v & 0xff);
+  out.push_back(v >> 8);
+}
+
+void put32(std::string& out, uint32_t v) {
+  put16(out, v & 0xffff);
+  put16(out, v >> 16);
+}
+
+// The parts of a local file header and of a central directory entry that are
+// the same.
+void put_entry_fields(std::string& out, const ZipEntry& e) {
+  put16(out, e.method == kMethodDeflated ? 20 : 10); // version needed
+  put16(out, 0); // flags
+  put16(out, e.method);
+  put16(out, kDosTime);
+  put16(out, kDosDate);
+  put32(out, e.crc);
+  put32(out, e.compressed_size);
+  put32(out, e.size);
+  put16(out, e.name.size());
+  put16(out, 0); // extra field length
+}
+
+void read_and_compress(const std::string& path,
+                       bool store,
+                       int level,
+                       ZipEntry& e) {
+  std::ifstream in(path, std::ios::binary);
+  always_assert_log(in, "Could not read %s", path.c_str());
+  std::string contents((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+  always_assert_log(contents.size() < 0xffffffff,
+                    "%s is too big for a zip without zip64", path.c_str());
+  e.size = contents.size();
+  e.crc = crc32(0, (const Bytef*)contents.data(), contents.size());
+  if (!store && !contents.empty()) {
+    z_stream stream{};
+    always_assert(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                               Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string compressed(deflateBound(&stream, contents.size()), '\0');
+    stream.next_in = (Bytef*)contents.data();
+    stream.avail_in = contents.size();
+    stream.next_out = (Bytef*)&compressed[0];
+    stream.avail_out = compressed.size();
+    always_assert(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (compressed.size() < contents.size()) {
+      e.method = kMethodDeflated;
+      e.data = std::move(compressed);
+      e.compressed_size = e.data.size();
+      return;
+    }
+  }
+  e.method = kMethodStored;
+  e.data = std::move(contents);
+  e.compressed_size = e.data.size();
+}
+
+}
+
+bool ApkManager::is_precompressed(const std::string& entry) {
+  // The extensions that aapt does not compress, plus the xz-compressed
+  // secondary dexes that redex writes.
+  static const char* extensions[] = {
+      ".jpg", ".jpeg", ".png", ".gif", ".wav", ".mp2", ".mp3", ".ogg", ".aac",
+      ".mpg", ".mpeg", ".mid", ".midi", ".smf", ".jet", ".rtttl", ".imy",
+      ".xmf", ".mp4", ".m4a", ".m4v", ".3gp", ".3gpp", ".3g2", ".3gpp2",
+      ".amr", ".awb", ".wma", ".wmv", ".webm", ".mkv", ".xz"};
+  for (const char* ext : extensions) {
+    if (boost::algorithm::iends_with(entry, ext)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ApkManager::write_apk(const std::string& apk_path,
+                             const ApkWriteOptions& options) const {
+  namespace fs = boost::filesystem;
+  std::vector<ZipEntry> entries;
+  fs::path root(m_apk_dir);
+  for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+    if (fs::is_regular_file(it->path())) {
+      ZipEntry e;
+      e.name = it->path().string().substr(root.string().size() + 1);
+      entries.push_back(std::move(e));
+    }
+  }
+  std::sort(
+      entries.begin(), entries.end(),
+      [](const ZipEntry& a, const ZipEntry& b) { return a.name < b.name; });
+  always_assert_log(entries.size() < 0xffff,
+                    "Too many entries for a zip without zip64");
+
+  FILE* out = fopen(apk_path.c_str(), "wb");
+  always_assert_log(out != nullptr, "Could not create %s", apk_path.c_str());
+
+  // The workers compress the entries in path order, but only up to `window`
+  // entries ahead of the one being written out, which bounds the memory.
+  size_t num_threads = options.num_threads;
+  if (num_threads == 0) {
+    num_threads = redex_parallel::default_num_threads();
+  }
+  const size_t window = 4 * num_threads;
+  std::mutex mutex;
+  std::condition_variable entry_ready;
+  std::condition_variable entry_written;
+  size_t next = 0;
+  size_t written = 0;
+  auto worker = [&]() {
+    while (true) {
+      size_t i;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        entry_written.wait(lock, [&] {
+          return next >= entries.size() || next < written + window;
+        });
+        if (next >= entries.size()) {
+          return;
+        }
+        i = next++;
+      }
+      auto& e = entries[i];
+      try {
+        read_and_compress((root / e.name).string(),
+                          options.stored_entries.count(e.name) ||
+                              is_precompressed(e.name),
+                          options.compression_level, e);
+      } catch (...) {
+        e.error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      e.ready = true;
+      entry_ready.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back(worker);
+  }
+
+  uint64_t offset = 0;
+  std::string buf;
+  try {
+    for (auto& e : entries) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        entry_ready.wait(lock, [&] { return e.ready; });
+      }
+      if (e.error) {
+        std::rethrow_exception(e.error);
+      }
+      always_assert_log(offset < 0xffffffff,
+                        "%s is too big for a zip without zip64",
+                        apk_path.c_str());
+      e.offset = offset;
+      buf.clear();
+      put32(buf, kLocalFileSignature);
+      put_entry_fields(buf, e);
+      buf += e.name;
+      always_assert(fwrite(buf.data(), 1, buf.size(), out) == buf.size());
+      always_assert(fwrite(e.data.data(), 1, e.data.size(), out) ==
+                    e.data.size());
+      offset += buf.size() + e.data.size();
+      // Only the sizes are needed for the central directory.
+      std::string().swap(e.data);
+      std::lock_guard<std::mutex> lock(mutex);
+      written++;
+      entry_written.notify_all();
+    }
+  } catch (...) {
+    {
+      // Let the workers run out of entries.
+      std::lock_guard<std::mutex> lock(mutex);
+      next = entries.size();
+    }
+    entry_written.notify_all();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    fclose(out);
+    throw;
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  uint64_t central_dir_offset = offset;
+  buf.clear();
+  for (const auto& e : entries) {
+    put32(buf, kCentralDirSignature);
+    put16(buf, 20); // version made by
+    put_entry_fields(buf, e);
+    put16(buf, 0); // comment length
+    put16(buf, 0); // disk number
+    put16(buf, 0); // internal attributes
+    put32(buf, 0); // external attributes
+    put32(buf, e.offset);
+    buf += e.name;
+  }
+  always_assert_log(central_dir_offset + buf.size() < 0xffffffff,
+                    "%s is too big for a zip without zip64",
+                    apk_path.c_str());
+  uint32_t central_dir_size = buf.size();
+  put32(buf, kEndOfCentralDirSignature);
+  put16(buf, 0); // disk number
+  put16(buf, 0); // disk with the central directory
+  put16(buf, entries.size());
+  put16(buf, entries.size());
+  put32(buf, central_dir_size);
+  put32(buf, central_dir_offset);
+  put16(buf, 0); // comment length
+  always_assert(fwrite(buf.data(), 1, buf.size(), out) == buf.size());
+  always_assert_log(fclose(out) == 0, "Could not write %s", apk_path.c_str());
+  return entries.size();
 }
 
 std::shared_ptr<FILE*> ApkManager::new_asset_file(const char* filename) {
@@ -8,9 +8,21 @@
 #pragma once
 
 #include <string>
+#include <unordered_set>
 #include <vector>
 #include <memory>
 
+struct ApkWriteOptions {
+  // Paths in the APK of the entries to store without compression, such as
+  // the ones that were stored in the input APK. Files that are compressed
+  // already (see ApkManager::is_precompressed), and files that deflate does
+  // not shrink, are stored as well.
+  std::unordered_set<std::string> stored_entries;
+  int compression_level{9};
+  // 0 means one per core.
+  size_t num_threads{0};
+};
+
 class ApkManager {
  public:
    ApkManager(std::string&& apk_dir)
@@ -28,6 +40,18 @@ class ApkManager {
 
    std::shared_ptr<FILE*> new_asset_file(const char* filename);
 
+   /**
+    * Zips up the unpacked APK into `apk_path`, and returns the number of
+    * entries. The entries are compressed in parallel and written out in path
+    * order as soon as they are ready, so only a few of them are in memory at
+    * any time. The result is neither aligned nor signed: it still goes through
+    * zipalign and the signer, like the APK that redex.py zips up.
+    */
+   size_t write_apk(const std::string& apk_path,
+                    const ApkWriteOptions& options) const;
+
+   static bool is_precompressed(const std::string& entry);
+
  private:
    std::vector<std::shared_ptr<FILE*>> m_files;
    std::string m_apk_dir;
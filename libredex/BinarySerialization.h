@@ -5,11 +5,17 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#pragma once
+
 #include <boost/bimap/bimap.hpp>
 #include <boost/bimap/unordered_set_of.hpp>
+#include <functional>
 #include <limits>
 #include <ostream>
+#include <string>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "Debug.h"
 
@@ -113,4 +119,100 @@ class GraphWriter {
   SuccessorFunction m_successors;
 };
 
+/*
+ * The version of the files written by IndexedGraphWriter.
+ */
+constexpr uint32_t INDEXED_GRAPH_VERSION = 2;
+
+/*
+ * Serialize a graph in a form that can be mmapped and queried without being
+ * parsed first. After the header, the file has
+ *
+ *   <nodes count><edges count><string table size>
+ *   <node table>: for each node, the offset and the size of its label in the
+ *     string table, and its kind, as a u8 followed by three bytes of padding
+ *   <edge offsets>: nodes count + 1 u32s; the neighbors of node n are the
+ *     edges in [offset n, offset n+1)
+ *   <edges>: the IDs of the neighbors of all the nodes
+ *   <string table>: the labels of all the nodes
+ *
+ * All the numbers are u32s unless noted otherwise, so everything up to the
+ * string table is 4-byte aligned.
+ */
+template <class Node, class NodeHash = std::hash<Node>>
+class IndexedGraphWriter {
+  using SuccessorFunction = std::function<std::vector<Node>(const Node&)>;
+  using NodeLabeler =
+      std::function<std::pair<uint8_t, std::string>(const Node&)>;
+
+ public:
+  /*
+   * node_labeler returns the kind and the label of each node.
+   */
+  IndexedGraphWriter(NodeLabeler node_labeler, SuccessorFunction successors)
+      : m_node_labeler(node_labeler), m_successors(successors) {}
+
+  template <class NodeContainer>
+  void write(std::ostream& os, const NodeContainer& nodes) {
+    // Number the nodes breadth-first, and get the neighbors of each node only
+    // once.
+    std::unordered_map<Node, uint32_t, NodeHash> ids;
+    std::vector<Node> nodes_by_id;
+    std::vector<std::vector<Node>> succs_by_id;
+    auto number = [&](const Node& node) {
+      if (ids.emplace(node, nodes_by_id.size()).second) {
+        nodes_by_id.push_back(node);
+      }
+    };
+    for (const auto& node : nodes) {
+      number(node);
+    }
+    for (size_t i = 0; i < nodes_by_id.size(); ++i) {
+      auto succs = m_successors(nodes_by_id[i]);
+      for (const auto& succ : succs) {
+        number(succ);
+      }
+      succs_by_id.push_back(std::move(succs));
+    }
+    always_assert(nodes_by_id.size() <= std::numeric_limits<uint32_t>::max());
+
+    std::vector<uint32_t> edge_offsets{0};
+    std::vector<uint32_t> edges;
+    std::vector<std::pair<uint8_t, std::string>> labels;
+    uint64_t string_table_size = 0;
+    for (size_t i = 0; i < nodes_by_id.size(); ++i) {
+      for (const auto& succ : succs_by_id[i]) {
+        edges.push_back(ids.at(succ));
+      }
+      edge_offsets.push_back(edges.size());
+      labels.push_back(m_node_labeler(nodes_by_id[i]));
+      string_table_size += labels.back().second.size();
+    }
+    always_assert(edges.size() <= std::numeric_limits<uint32_t>::max());
+    always_assert(string_table_size <= std::numeric_limits<uint32_t>::max());
+
+    binary_serialization::write<uint32_t>(os, nodes_by_id.size());
+    binary_serialization::write<uint32_t>(os, edges.size());
+    binary_serialization::write<uint32_t>(os, string_table_size);
+    uint32_t label_offset = 0;
+    for (const auto& label : labels) {
+      binary_serialization::write<uint32_t>(os, label_offset);
+      binary_serialization::write<uint32_t>(os, label.second.size());
+      binary_serialization::write<uint8_t>(os, label.first);
+      os.write("\0\0\0", 3);
+      label_offset += label.second.size();
+    }
+    os.write((const char*)edge_offsets.data(),
+             edge_offsets.size() * sizeof(uint32_t));
+    os.write((const char*)edges.data(), edges.size() * sizeof(uint32_t));
+    for (const auto& label : labels) {
+      os << label.second;
+    }
+  }
+
+ private:
+  NodeLabeler m_node_labeler;
+  SuccessorFunction m_successors;
+};
+
 } // namespace binary_serialization
@@ -8,6 +8,7 @@
 #include "CFGInliner.h"
 
 #include <memory>
+#include <unordered_map>
 
 #include "IRList.h"
 #include "IROpcode.h"
@@ -47,7 +48,6 @@ void CFGInliner::inline_cfg(ControlFlowGraph* caller,
 
   DexPosition* callsite_dbg_pos = get_dbg_pos(callsite);
   if (callsite_dbg_pos) {
-    set_dbg_pos_parents(&callee, callsite_dbg_pos);
     // ensure that the caller's code after the inlined method retain their
     // original position
     const auto& first = after_callee->begin();
@@ -62,7 +62,7 @@ void CFGInliner::inline_cfg(ControlFlowGraph* caller,
   // make sure the callee's registers don't overlap with the caller's
   auto callee_regs_size = callee.get_registers_size();
   auto caller_regs_size = caller->get_registers_size();
-  remap_registers(&callee, caller_regs_size);
+  relocate_callee(&callee, caller_regs_size, callsite_dbg_pos);
 
   move_arg_regs(&callee, callsite->insn);
   const cfg::InstructionIterator& move_res = caller->move_result_of(callsite);
@@ -98,6 +98,44 @@ void CFGInliner::inline_cfg(ControlFlowGraph* caller,
   TRACE(CFG, 3, "final %s", SHOW(*caller));
 }
 
+void CFGInliner::inline_cfgs(
+    ControlFlowGraph* caller,
+    const std::vector<std::pair<IRInstruction*, const ControlFlowGraph*>>&
+        callsites) {
+  std::unordered_map<const IRInstruction*, const ControlFlowGraph*> callee_of;
+  for (const auto& callsite : callsites) {
+    auto inserted = callee_of.emplace(callsite.first, callsite.second).second;
+    always_assert_log(inserted, "Duplicate callsite %s", SHOW(callsite.first));
+  }
+
+  // The callsites and their blocks, in the order of the walk.
+  std::vector<std::pair<IRInstruction*, BlockId>> found;
+  found.reserve(callsites.size());
+  for (const auto& entry : caller->m_blocks) {
+    for (const auto& mie : ir_list::InstructionIterable(*entry.second)) {
+      if (callee_of.count(mie.insn)) {
+        found.emplace_back(mie.insn, entry.first);
+      }
+    }
+  }
+  always_assert_log(found.size() == callsites.size(),
+                    "Callsite not found in %s", SHOW(*caller));
+
+  // Inlining at a callsite moves what follows it into other blocks, so going
+  // backwards leaves the callsites still to inline in the blocks they were
+  // found in, until a merge deletes one. A block id is then only a hint, as
+  // find_insn searches the whole caller when the block doesn't have the
+  // callsite.
+  for (auto it = found.rbegin(); it != found.rend(); ++it) {
+    Block* hint = caller->m_blocks.count(it->second)
+                      ? caller->m_blocks.at(it->second)
+                      : nullptr;
+    auto callsite = caller->find_insn(it->first, hint);
+    always_assert(!callsite.is_end());
+    inline_cfg(caller, callsite, *callee_of.at(it->first));
+  }
+}
+
 /*
  * If it isn't already, make `it` the last instruction of its block
  * return the block that should be run after the callee
@@ -121,17 +159,28 @@ Block* CFGInliner::maybe_split_block(ControlFlowGraph* caller,
 }
 
 /*
- * Change the register numbers to not overlap with caller.
+ * Change the register numbers to not overlap with caller, and attach the
+ * callee's positions to the callsite's.
  */
-void CFGInliner::remap_registers(cfg::ControlFlowGraph* callee,
-                                 uint16_t caller_regs_size) {
-  for (auto& mie : cfg::InstructionIterable(*callee)) {
-    auto insn = mie.insn;
-    for (uint16_t i = 0; i < insn->srcs_size(); ++i) {
-      insn->set_src(i, insn->src(i) + caller_regs_size);
-    }
-    if (insn->dests_size()) {
-      insn->set_dest(insn->dest() + caller_regs_size);
+void CFGInliner::relocate_callee(cfg::ControlFlowGraph* callee,
+                                 uint16_t caller_regs_size,
+                                 DexPosition* callsite_dbg_pos) {
+  for (const auto& entry : callee->m_blocks) {
+    for (auto& mie : *entry.second) {
+      if (mie.type == MFLOW_OPCODE) {
+        auto insn = mie.insn;
+        for (uint16_t i = 0; i < insn->srcs_size(); ++i) {
+          insn->set_src(i, insn->src(i) + caller_regs_size);
+        }
+        if (insn->dests_size()) {
+          insn->set_dest(insn->dest() + caller_regs_size);
+        }
+      } else if (mie.type == MFLOW_POSITION && callsite_dbg_pos != nullptr &&
+                 mie.pos->parent == nullptr) {
+        // Don't overwrite existing parent pointers because those are probably
+        // methods that were inlined into callee before
+        mie.pos->parent = callsite_dbg_pos;
+      }
     }
   }
 }
@@ -143,10 +192,10 @@ void CFGInliner::steal_contents(ControlFlowGraph* caller,
                                 Block* callsite,
                                 ControlFlowGraph* callee) {
   always_assert(!caller->m_blocks.empty());
-  for (auto& entry : callee->m_blocks) {
+  for (const auto& entry : callee->m_blocks) {
     Block* b = entry.second;
     b->m_parent = caller;
-    size_t id = caller->m_blocks.rbegin()->first + 1;
+    size_t id = caller->m_blocks.id_bound();
     b->m_id = id;
     caller->m_blocks.emplace(id, b);
   }
@@ -346,20 +395,6 @@ void CFGInliner::add_callee_throws_to_caller(
   }
 }
 
-void CFGInliner::set_dbg_pos_parents(ControlFlowGraph* callee,
-                                     DexPosition* callsite_dbg_pos) {
-  for (auto& entry : callee->m_blocks) {
-    Block* b = entry.second;
-    for (auto& mie : *b) {
-      // Don't overwrite existing parent pointers because those are probably
-      // methods that were inlined into callee before
-      if (mie.type == MFLOW_POSITION && mie.pos->parent == nullptr) {
-        mie.pos->parent = callsite_dbg_pos;
-      }
-    }
-  }
-}
-
 /*
  * Return the equivalent move opcode for the given return opcode
  */
@@ -10,6 +10,8 @@
 #include "ControlFlow.h"
 
 #include <boost/optional.hpp>
+#include <utility>
+#include <vector>
 
 namespace cfg {
 
@@ -22,6 +24,16 @@ class CFGInliner {
                          const cfg::InstructionIterator& callsite,
                          const ControlFlowGraph& callee);
 
+  /*
+   * Same as calling inline_cfg on each (callsite, callee) pair in turn, but
+   * the callsites are found with a single walk over the caller instead of one
+   * walk each. The callsites must be distinct instructions of the caller.
+   */
+  static void inline_cfgs(
+      ControlFlowGraph* caller,
+      const std::vector<std::pair<IRInstruction*, const ControlFlowGraph*>>&
+          callsites);
+
  private:
   /*
    * If it isn't already, make `it` the last instruction of its block
@@ -30,10 +42,13 @@ class CFGInliner {
                                   const InstructionIterator& it);
 
   /*
-   * Change the register numbers to not overlap with caller.
+   * Change the register numbers to not overlap with caller, and set the
+   * parent pointers of the positions in `callee` to `callsite_dbg_pos`, if
+   * any, in a single walk over the copy of the callee.
    */
-  static void remap_registers(ControlFlowGraph* callee,
-                              uint16_t caller_regs_size);
+  static void relocate_callee(ControlFlowGraph* callee,
+                              uint16_t caller_regs_size,
+                              DexPosition* callsite_dbg_pos);
 
   /*
    * Move ownership of blocks and edges from callee to caller
@@ -88,12 +103,6 @@ class CFGInliner {
       const std::vector<Block*>& callee_blocks,
       const std::vector<Edge*>& caller_catches);
 
-  /*
-   * Set the parent pointers of the positions in `callee` to `callsite_dbg_pos`
-   */
-  static void set_dbg_pos_parents(ControlFlowGraph* callee,
-                                  DexPosition* callsite_dbg_pos);
-
   /*
    * Return the equivalent move opcode for the given return opcode
    */
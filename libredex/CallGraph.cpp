@@ -7,8 +7,13 @@
 
 #include "CallGraph.h"
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -30,8 +35,8 @@ class SingleCalleeStrategy final : public BuildStrategy {
     for (auto& mie : InstructionIterable(code)) {
       auto insn = mie.insn;
       if (is_invoke(insn->opcode())) {
-        auto callee = resolve_method(
-            insn->get_method(), opcode_to_search(insn), m_resolved_refs);
+        auto callee = resolve_method_cached(insn->get_method(),
+                                            opcode_to_search(insn));
         if (callee == nullptr || is_definitely_virtual(callee)) {
           continue;
         }
@@ -61,7 +66,6 @@ class SingleCalleeStrategy final : public BuildStrategy {
 
   const Scope& m_scope;
   std::unordered_set<DexMethod*> m_non_virtual;
-  mutable MethodRefCache m_resolved_refs;
 };
 
 } // namespace
@@ -69,56 +73,270 @@ class SingleCalleeStrategy final : public BuildStrategy {
 namespace call_graph {
 
 Graph single_callee_graph(const Scope& scope) {
-  return Graph(SingleCalleeStrategy(scope));
+  return build_graph_in_parallel(scope, SingleCalleeStrategy(scope));
 }
 
 Edge::Edge(DexMethod* caller, DexMethod* callee, IRList::iterator invoke_it)
     : m_caller(caller), m_callee(callee), m_invoke_it(invoke_it) {}
 
-Graph::Graph(const BuildStrategy& strat) {
+Graph::Graph(const BuildStrategy& strat)
+    : Graph(strat.get_roots(),
+            [&strat](const DexMethod* m) { return strat.get_callsites(m); }) {}
+
+Graph::Graph(const std::vector<DexMethod*>& roots,
+             const CallSitesFn& callsites) {
+  auto storage = std::make_shared<Storage>();
+  auto& nodes = storage->nodes;
+  auto& edges = storage->edges;
+  nodes.emplace_back(Node(nullptr, 0));
+  auto node_id = [&](DexMethod* m) {
+    auto it = storage->node_ids.emplace(m, nodes.size()).first;
+    if (it->second == nodes.size()) {
+      nodes.emplace_back(Node(m, it->second));
+    }
+    return it->second;
+  };
+
   // Add edges from the single "ghost" entry node to all the "real" entry
   // nodes in the graph.
-  auto roots = strat.get_roots();
   for (DexMethod* root : roots) {
-    auto edge = std::make_shared<Edge>(nullptr, root, IRList::iterator());
-    m_entry.m_successors.emplace_back(edge);
-    make_node(root).m_predecessors.emplace_back(edge);
+    node_id(root);
+    edges.emplace_back(nullptr, root, IRList::iterator());
   }
 
-  // Obtain the callsites of each method recursively, building the graph in the
-  // process.
+  // Obtain the callsites of each method recursively, collecting the edges in
+  // the process.
   std::unordered_set<const DexMethod*> visited;
   std::function<void(DexMethod*)> visit = [&](auto* caller) {
-    if (visited.count(caller) != 0) {
+    if (!visited.emplace(caller).second) {
       return;
     }
-    visited.emplace(caller);
-    for (const auto& callsite : strat.get_callsites(caller)) {
-      this->add_edge(caller, callsite.callee, callsite.invoke);
+    node_id(caller);
+    for (const auto& callsite : callsites(caller)) {
+      node_id(callsite.callee);
+      edges.emplace_back(caller, callsite.callee, callsite.invoke);
       visit(callsite.callee);
     }
   };
-
   for (DexMethod* root : roots) {
     visit(root);
   }
+
+  // Freeze the edges into the successor and predecessor arrays.
+  auto id_of = [&](DexMethod* m) {
+    return m == nullptr ? 0 : storage->node_ids.at(m);
+  };
+  std::vector<uint32_t> succ_offsets(nodes.size() + 1, 0);
+  std::vector<uint32_t> pred_offsets(nodes.size() + 1, 0);
+  for (const auto& edge : edges) {
+    ++succ_offsets[id_of(edge.caller()) + 1];
+    ++pred_offsets[id_of(edge.callee()) + 1];
+  }
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    succ_offsets[i + 1] += succ_offsets[i];
+    pred_offsets[i + 1] += pred_offsets[i];
+  }
+  storage->successors.resize(edges.size());
+  storage->predecessors.resize(edges.size());
+  auto succ_fill = succ_offsets;
+  auto pred_fill = pred_offsets;
+  for (const auto& edge : edges) {
+    storage->successors[succ_fill[id_of(edge.caller())]++] = &edge;
+    storage->predecessors[pred_fill[id_of(edge.callee())]++] = &edge;
+  }
+  const auto* succs = storage->successors.data();
+  const auto* preds = storage->predecessors.data();
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    nodes[i].m_successors =
+        Edges(succs + succ_offsets[i], succs + succ_offsets[i + 1]);
+    nodes[i].m_predecessors =
+        Edges(preds + pred_offsets[i], preds + pred_offsets[i + 1]);
+  }
+  m_storage = std::move(storage);
 }
 
-Node& Graph::make_node(DexMethod* m) {
-  auto it = m_nodes.find(m);
-  if (it != m_nodes.end()) {
-    return it->second;
+Graph build_graph_in_parallel(const Scope& scope,
+                              const BuildStrategy& strat,
+                              size_t num_threads) {
+  // Every method gets its own slot, so that the workers never write to the
+  // same buffer.
+  std::unordered_map<const DexMethod*, size_t> slots;
+  walk::code(scope, [&](DexMethod* method, IRCode&) {
+    slots.emplace(method, slots.size());
+  });
+  std::vector<CallSites> callsites(slots.size());
+  walk::parallel::code(
+      scope,
+      [&](DexMethod* method, IRCode&) {
+        callsites[slots.at(method)] = strat.get_callsites(method);
+      },
+      num_threads);
+  return Graph(strat.get_roots(), [&](const DexMethod* m) {
+    auto it = slots.find(m);
+    return it == slots.end() ? CallSites() : std::move(callsites[it->second]);
+  });
+}
+
+Sccs::Sccs(const Graph& graph) : m_graph(graph) {
+  // Tarjan's algorithm, with an explicit stack of frames so that long call
+  // chains can't overflow the native stack. Components are completed callees
+  // first, which is the bottom-up order we number them in.
+  constexpr uint32_t kUnvisited = std::numeric_limits<uint32_t>::max();
+  constexpr SccId kNone = std::numeric_limits<SccId>::max();
+  size_t num_nodes = graph.num_nodes();
+  std::vector<uint32_t> index(num_nodes, kUnvisited);
+  std::vector<uint32_t> lowlink(num_nodes, 0);
+  std::vector<bool> on_stack(num_nodes, false);
+  std::vector<uint32_t> stack;
+  struct Frame {
+    uint32_t node;
+    uint32_t next_edge;
+  };
+  std::vector<Frame> frames;
+  uint32_t next_index = 0;
+  m_scc_of.assign(num_nodes, kNone);
+  m_member_offsets.push_back(0);
+
+  auto discover = [&](uint32_t node) {
+    index[node] = lowlink[node] = next_index++;
+    stack.push_back(node);
+    on_stack[node] = true;
+    frames.push_back(Frame{node, 0});
+  };
+  // Node 0 is the ghost entry.
+  for (uint32_t start = 1; start < num_nodes; ++start) {
+    if (index[start] != kUnvisited) {
+      continue;
+    }
+    discover(start);
+    while (!frames.empty()) {
+      auto node = frames.back().node;
+      const auto& callees = graph.node_at(node).callees();
+      if (frames.back().next_edge < callees.size()) {
+        auto callee =
+            graph.node(callees[frames.back().next_edge++]->callee()).id();
+        if (index[callee] == kUnvisited) {
+          discover(callee);
+        } else if (on_stack[callee]) {
+          lowlink[node] = std::min(lowlink[node], index[callee]);
+        }
+        continue;
+      }
+      frames.pop_back();
+      if (!frames.empty()) {
+        auto parent = frames.back().node;
+        lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+      }
+      if (lowlink[node] != index[node]) {
+        continue;
+      }
+      SccId id = m_member_offsets.size() - 1;
+      uint32_t member;
+      do {
+        member = stack.back();
+        stack.pop_back();
+        on_stack[member] = false;
+        m_scc_of[member] = id;
+        m_members.push_back(graph.node_at(member).method());
+      } while (member != node);
+      m_member_offsets.push_back(m_members.size());
+    }
+  }
+
+  // Condense the edges.
+  std::vector<std::vector<SccId>> callers(size());
+  m_callee_offsets.push_back(0);
+  m_recursive.assign(size(), false);
+  for (SccId id = 0; id < size(); ++id) {
+    auto begin = m_callees.size();
+    for (auto* method : members(id)) {
+      for (const auto& edge : graph.node(method).callees()) {
+        auto callee_scc = scc_of(edge->callee());
+        if (callee_scc == id) {
+          m_recursive[id] = true;
+        } else {
+          m_callees.push_back(callee_scc);
+        }
+      }
+    }
+    std::sort(m_callees.begin() + begin, m_callees.end());
+    m_callees.erase(std::unique(m_callees.begin() + begin, m_callees.end()),
+                    m_callees.end());
+    for (auto it = m_callees.begin() + begin; it != m_callees.end(); ++it) {
+      callers[*it].push_back(id);
+    }
+    m_callee_offsets.push_back(m_callees.size());
+  }
+  m_caller_offsets.push_back(0);
+  for (const auto& scc_callers : callers) {
+    // Callers are added in increasing order, so these are sorted already.
+    m_callers.insert(m_callers.end(), scc_callers.begin(), scc_callers.end());
+    m_caller_offsets.push_back(m_callers.size());
+  }
+}
+
+namespace {
+
+/*
+ * Calls `fn` on each component once the components returned by
+ * `dependencies` are done; `dependents` is the inverse relation.
+ */
+template <typename Dependencies, typename Dependents>
+void parallel_walk(const Sccs& sccs,
+                   const std::function<void(Sccs::SccId)>& fn,
+                   size_t num_threads,
+                   const Dependencies& dependencies,
+                   const Dependents& dependents) {
+  using SccId = Sccs::SccId;
+  std::unique_ptr<std::atomic<uint32_t>[]> pending(
+      new std::atomic<uint32_t>[sccs.size()]);
+  for (SccId id = 0; id < sccs.size(); ++id) {
+    pending[id] = dependencies(id).size();
   }
-  m_nodes.emplace(m, Node(m));
-  return m_nodes.at(m);
+  // Components are pushed as soon as their last dependency is done, which
+  // the work-stealing scheduler waits for.
+  using WQ = WorkQueue<SccId, std::nullptr_t, std::nullptr_t>;
+  WQ wq(
+      [&](WorkerState<SccId, std::nullptr_t, std::nullptr_t>* state,
+          SccId id) {
+        fn(id);
+        for (auto dependent : dependents(id)) {
+          if (pending[dependent].fetch_sub(1) == 1) {
+            state->push_task(dependent);
+          }
+        }
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      num_threads,
+      WorkQueueScheduler::WorkStealing);
+  for (SccId id = 0; id < sccs.size(); ++id) {
+    if (dependencies(id).empty()) {
+      wq.add_item(id);
+    }
+  }
+  wq.run_all();
+}
+
+} // namespace
+
+void parallel_bottom_up(const Sccs& sccs,
+                        const std::function<void(Sccs::SccId)>& fn,
+                        size_t num_threads) {
+  parallel_walk(
+      sccs, fn, num_threads,
+      [&](Sccs::SccId id) { return sccs.callee_sccs(id); },
+      [&](Sccs::SccId id) { return sccs.caller_sccs(id); });
 }
 
-void Graph::add_edge(DexMethod* caller,
-                     DexMethod* callee,
-                     IRList::iterator invoke_it) {
-  auto edge = std::make_shared<Edge>(caller, callee, invoke_it);
-  make_node(caller).m_successors.emplace_back(edge);
-  make_node(callee).m_predecessors.emplace_back(edge);
+void parallel_top_down(const Sccs& sccs,
+                       const std::function<void(Sccs::SccId)>& fn,
+                       size_t num_threads) {
+  parallel_walk(
+      sccs, fn, num_threads,
+      [&](Sccs::SccId id) { return sccs.caller_sccs(id); },
+      [&](Sccs::SccId id) { return sccs.callee_sccs(id); });
 }
 
 } // namespace call_graph
@@ -8,12 +8,17 @@
 #pragma once
 
 #include <boost/functional/hash.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <functional>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "DexClass.h"
 #include "IRCode.h"
 #include "MonotonicFixpointIterator.h"
 #include "Resolver.h"
+#include "Walkers.h"
 
 /*
  * Call graph representation that implements the standard graph interface
@@ -75,19 +80,47 @@ class Edge {
   IRList::iterator m_invoke_it;
 };
 
-using Edges = std::vector<std::shared_ptr<Edge>>;
+using EdgeId = const Edge*;
+
+/*
+ * A contiguous range of edges, pointing into the storage of a Graph. Ranges
+ * are cheap to copy, and stay valid as long as some copy of the Graph is
+ * alive.
+ */
+class Edges {
+ public:
+  using iterator = const EdgeId*;
+  using const_iterator = iterator;
+  using value_type = EdgeId;
+
+  Edges() = default;
+  Edges(iterator begin, iterator end) : m_begin(begin), m_end(end) {}
+
+  iterator begin() const { return m_begin; }
+  iterator end() const { return m_end; }
+  size_t size() const { return m_end - m_begin; }
+  bool empty() const { return m_begin == m_end; }
+  EdgeId operator[](size_t i) const { return m_begin[i]; }
+
+ private:
+  iterator m_begin{nullptr};
+  iterator m_end{nullptr};
+};
 
 class Node {
  public:
-  /* implicit */
-  Node(DexMethod* m) : m_method(m) {}
   DexMethod* method() const { return m_method; }
+  // Nodes are numbered densely from 0, which is the ghost entry node.
+  uint32_t id() const { return m_id; }
   bool operator==(const Node& that) const { return method() == that.method(); }
   const Edges& callers() const { return m_predecessors; }
   const Edges& callees() const { return m_successors; }
 
  private:
+  Node(DexMethod* m, uint32_t id) : m_method(m), m_id(id) {}
+
   DexMethod* m_method;
+  uint32_t m_id;
   Edges m_predecessors;
   Edges m_successors;
 
@@ -102,40 +135,150 @@ inline size_t hash_value(const Node& node) {
 
 namespace call_graph {
 
+/*
+ * The graph is immutable once built. Its edges are stored in compressed sparse
+ * row form: all the edges live in one array, ordered by caller, and each node
+ * refers to a contiguous slice of the arrays of outgoing and incoming edges,
+ * in the order the callsites were discovered. Copies of a graph share the
+ * same storage.
+ */
 class Graph final {
  public:
   Graph(const BuildStrategy&);
 
-  const Node& entry() const { return m_entry; }
+  const Node& entry() const { return m_storage->nodes[0]; }
 
   bool has_node(const DexMethod* m) const {
-    return m_nodes.count(const_cast<DexMethod*>(m)) != 0;
+    return m_storage->node_ids.count(m) != 0;
   }
 
   const Node& node(const DexMethod* m) const {
     if (m == nullptr) {
-      return m_entry;
+      return entry();
     }
-    return m_nodes.at(const_cast<DexMethod*>(m));
+    return m_storage->nodes[m_storage->node_ids.at(m)];
   }
 
+  const Node& node_at(uint32_t id) const { return m_storage->nodes.at(id); }
+
+  // Including the ghost entry node.
+  size_t num_nodes() const { return m_storage->nodes.size(); }
+
+  // Including the edges from the ghost entry node to the roots.
+  size_t num_edges() const { return m_storage->edges.size(); }
+
  private:
-  Node& make_node(DexMethod*);
+  using CallSitesFn = std::function<CallSites(const DexMethod*)>;
+
+  Graph(const std::vector<DexMethod*>& roots, const CallSitesFn& callsites);
+
+  struct Storage {
+    std::vector<Node> nodes;
+    std::unordered_map<const DexMethod*, uint32_t> node_ids;
+    std::vector<Edge> edges;
+    std::vector<EdgeId> successors;
+    std::vector<EdgeId> predecessors;
+  };
+
+  std::shared_ptr<const Storage> m_storage;
+
+  friend Graph build_graph_in_parallel(const Scope&,
+                                       const BuildStrategy&,
+                                       size_t);
+};
+
+/*
+ * Builds the same graph as Graph(strategy), but first collects the callsites
+ * of all the methods of `scope` that have code, in parallel. The strategy's
+ * get_callsites() must be thread-safe, and is never called on methods without
+ * code or outside of `scope`: those have no outgoing edges.
+ */
+Graph build_graph_in_parallel(
+    const Scope&,
+    const BuildStrategy&,
+    size_t num_threads = walk::parallel::default_num_threads());
+
+/*
+ * The strongly connected components of a call graph, numbered bottom-up: the
+ * callees of the methods of a component are either in that same component or
+ * in components with smaller ids. The ghost entry node is in no component.
+ */
+class Sccs final {
+ public:
+  using SccId = uint32_t;
+  using Members = boost::iterator_range<DexMethod* const*>;
+  using SccIds = boost::iterator_range<const SccId*>;
+
+  explicit Sccs(const Graph&);
+
+  size_t size() const { return m_member_offsets.size() - 1; }
+
+  Members members(SccId id) const {
+    return Members(m_members.data() + m_member_offsets.at(id),
+                   m_members.data() + m_member_offsets.at(id + 1));
+  }
+
+  SccId scc_of(const DexMethod* m) const {
+    return m_scc_of.at(m_graph.node(m).id());
+  }
 
-  void add_edge(DexMethod* caller,
-                DexMethod* callee,
-                IRList::iterator invoke_it);
+  // The other components that the methods of `id` call into, without
+  // duplicates.
+  SccIds callee_sccs(SccId id) const {
+    return SccIds(m_callees.data() + m_callee_offsets.at(id),
+                  m_callees.data() + m_callee_offsets.at(id + 1));
+  }
+
+  // The other components whose methods call into `id`, without duplicates.
+  SccIds caller_sccs(SccId id) const {
+    return SccIds(m_callers.data() + m_caller_offsets.at(id),
+                  m_callers.data() + m_caller_offsets.at(id + 1));
+  }
 
-  Node m_entry = Node(nullptr);
-  std::unordered_map<DexMethod*, Node, boost::hash<Node>> m_nodes;
+  // Whether the component has more than one method, or a method calling
+  // itself.
+  bool is_recursive(SccId id) const { return m_recursive.at(id); }
+
+ private:
+  Graph m_graph;
+  std::vector<SccId> m_scc_of;
+  std::vector<uint32_t> m_member_offsets;
+  std::vector<DexMethod*> m_members;
+  std::vector<uint32_t> m_callee_offsets;
+  std::vector<SccId> m_callees;
+  std::vector<uint32_t> m_caller_offsets;
+  std::vector<SccId> m_callers;
+  std::vector<bool> m_recursive;
 };
 
+/*
+ * Calls `fn` once on every component of `sccs`, on a pool of `num_threads`
+ * workers. A component is only started after the components it calls into
+ * are done, so that summary-based analyses can read the summaries of the
+ * callees outside of the component without further synchronization.
+ * Components that don't depend on each other are processed concurrently.
+ */
+void parallel_bottom_up(
+    const Sccs& sccs,
+    const std::function<void(Sccs::SccId)>& fn,
+    size_t num_threads = walk::parallel::default_num_threads());
+
+/*
+ * The same, in the other direction: a component is only started after the
+ * components that call into it are done, for analyses that propagate facts
+ * from callers to callees.
+ */
+void parallel_top_down(
+    const Sccs& sccs,
+    const std::function<void(Sccs::SccId)>& fn,
+    size_t num_threads = walk::parallel::default_num_threads());
+
 // A static-method-only API for use with the monotonic fixpoint iterator.
 class GraphInterface {
  public:
   using Graph = call_graph::Graph;
   using NodeId = DexMethod*;
-  using EdgeId = std::shared_ptr<Edge>;
+  using EdgeId = call_graph::EdgeId;
 
   static const NodeId entry(const Graph& graph) {
     return graph.entry().method();
@@ -10,6 +10,7 @@
 #include "DexUtil.h"
 #include "Timer.h"
 #include "Resolver.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -91,6 +92,53 @@ void gather_intf_extenders(const Scope& scope,
   }
 }
 
+/*
+ * Builds a hierarchy from edges that `for_each_edge(cls, add)` reports as
+ * add(parent, child), with a null child only making sure that `parent` has an
+ * entry. Every thread owns the parents that hash to it, so the per-thread
+ * hierarchies never share a key and can be merged without looking inside.
+ */
+template <typename EdgeFn>
+ClassHierarchy build_hierarchy_in_parallel(
+    const std::vector<const DexClass*>& classes, const EdgeFn& for_each_edge) {
+  const size_t num_shards = redex_parallel::default_num_threads();
+  std::vector<ClassHierarchy> shards(num_shards);
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t shard) {
+        auto& hierarchy = shards[shard];
+        std::hash<const DexType*> hash;
+        for (const auto* cls : classes) {
+          for_each_edge(cls, [&](const DexType* parent, const DexType* child) {
+            if (hash(parent) % num_shards != shard) {
+              return;
+            }
+            auto& children = hierarchy[parent];
+            if (child != nullptr) {
+              children.insert(child);
+            }
+          });
+        }
+      },
+      num_shards);
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    wq.add_item(shard);
+  }
+  wq.run_all();
+
+  size_t size = 0;
+  for (const auto& shard : shards) {
+    size += shard.size();
+  }
+  ClassHierarchy hierarchy;
+  hierarchy.reserve(size);
+  for (auto& shard : shards) {
+    for (auto& entry : shard) {
+      hierarchy.emplace(entry.first, std::move(entry.second));
+    }
+  }
+  return hierarchy;
+}
+
 void build_interface_map(InterfaceMap& interfaces,
                          const ClassHierarchy& hierarchy,
                          const DexClass* current,
@@ -116,6 +164,78 @@ ClassHierarchy build_type_hierarchy(const Scope& scope) {
   return hierarchy;
 }
 
+template <typename BuildFn>
+std::shared_ptr<const ClassHierarchy> TypeHierarchyCache::get(
+    Entry& entry, const Scope& scope, const BuildFn& build) {
+  std::vector<ClassState> state;
+  state.reserve(scope.size());
+  for (const auto* cls : scope) {
+    state.emplace_back(cls, cls->get_super_class(), cls->get_interfaces(),
+                       cls->get_access());
+  }
+  size_t num_classes = 0;
+  g_redex->walk_type_class(
+      [&](const DexType*, const DexClass*) { ++num_classes; });
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  if (entry.hierarchy == nullptr || entry.num_classes != num_classes ||
+      entry.scope != state) {
+    entry.hierarchy = std::make_shared<const ClassHierarchy>(build());
+    entry.scope = std::move(state);
+    entry.num_classes = num_classes;
+  }
+  return entry.hierarchy;
+}
+
+std::shared_ptr<const ClassHierarchy> TypeHierarchyCache::type_hierarchy(
+    const Scope& scope) {
+  return get(m_type_hierarchy, scope, [&scope] {
+    Timer t("Build type hierarchy");
+    std::vector<const DexClass*> classes;
+    for (const auto* cls : scope) {
+      if (!is_interface(cls)) {
+        classes.push_back(cls);
+      }
+    }
+    g_redex->walk_type_class([&](const DexType*, const DexClass* cls) {
+      if (cls->is_external() && !is_interface(cls)) {
+        classes.push_back(cls);
+      }
+    });
+    return build_hierarchy_in_parallel(classes, [](const DexClass* cls,
+                                                   const auto& add) {
+      const auto* type = cls->get_type();
+      add(type, nullptr);
+      const auto* super = cls->get_super_class();
+      if (super != nullptr) {
+        add(super, type);
+      } else {
+        always_assert_log(type == get_object_type(), SHOW(type));
+      }
+    });
+  });
+}
+
+std::shared_ptr<const ClassHierarchy>
+TypeHierarchyCache::extends_or_implements_hierarchy(const Scope& scope) {
+  return get(m_extends_or_implements, scope, [&scope] {
+    Timer t("Build extends or implements hierarchy");
+    std::vector<const DexClass*> classes(scope.begin(), scope.end());
+    return build_hierarchy_in_parallel(classes, [](const DexClass* cls,
+                                                   const auto& add) {
+      const auto* type = cls->get_type();
+      add(type, nullptr);
+      const auto* super = cls->get_super_class();
+      if (super != nullptr) {
+        add(super, type);
+      }
+      for (const auto& impl : cls->get_interfaces()->get_type_list()) {
+        add(impl, type);
+      }
+    });
+  });
+}
+
 InterfaceMap build_interface_map(const ClassHierarchy& hierarchy) {
   InterfaceMap interfaces;
   // build the type hierarchy
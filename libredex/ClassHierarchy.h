@@ -8,7 +8,10 @@
 #pragma once
 
 #include "DexClass.h"
+#include <memory>
+#include <mutex>
 #include <set>
+#include <tuple>
 #include <unordered_map>
 
 using TypeSet = std::set<const DexType*, dextypes_comparator>;
@@ -27,6 +30,52 @@ using ClassHierarchy = std::unordered_map<const DexType*, TypeSet>;
  */
 ClassHierarchy build_type_hierarchy(const Scope& scope);
 
+/**
+ * Builds the hierarchies that the frontend and the passes keep asking for, and
+ * hands out the same copy for as long as it is up to date. An entry is reused
+ * only while the scope it was built from is the same list of classes, with the
+ * same superclasses, interfaces and access flags, and no class has been added
+ * to the RedexContext since. A pass that adds, removes or reparents classes
+ * thus makes the next lookup rebuild the entry; holders of the old one keep it
+ * alive. Entries are built on all threads.
+ *
+ * See RedexContext::type_hierarchy_cache().
+ */
+class TypeHierarchyCache {
+ public:
+  /**
+   * Same as build_type_hierarchy(scope).
+   */
+  std::shared_ptr<const ClassHierarchy> type_hierarchy(const Scope& scope);
+
+  /**
+   * Maps every superclass and interface of a class in `scope` to the classes
+   * that extend or implement it directly, as ProGuard's extends clause does
+   * not tell them apart. Every class in `scope` has an entry.
+   */
+  std::shared_ptr<const ClassHierarchy> extends_or_implements_hierarchy(
+      const Scope& scope);
+
+ private:
+  using ClassState = std::
+      tuple<const DexClass*, const DexType*, const DexTypeList*, DexAccessFlags>;
+
+  struct Entry {
+    std::vector<ClassState> scope;
+    size_t num_classes{0};
+    std::shared_ptr<const ClassHierarchy> hierarchy;
+  };
+
+  template <typename BuildFn>
+  std::shared_ptr<const ClassHierarchy> get(Entry& entry,
+                                            const Scope& scope,
+                                            const BuildFn& build);
+
+  std::mutex m_lock;
+  Entry m_type_hierarchy;
+  Entry m_extends_or_implements;
+};
+
 /**
  * Return the direct children of a type.
  */
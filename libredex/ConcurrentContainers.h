@@ -10,6 +10,9 @@
 #include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -374,6 +377,349 @@ class ConcurrentSet final
 
 namespace cc_impl {
 
+template <typename Slot, typename Map>
+class SharedConcurrentMapIterator;
+
+inline bool is_prime(size_t n) {
+  if (n < 2) {
+    return false;
+  }
+  for (size_t d = 2; d * d <= n; ++d) {
+    if (n % d == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace cc_impl
+
+/*
+ * A concurrent map for read-mostly workloads, e.g. interning tables and caches
+ * that are filled once and then queried from every thread.
+ *
+ * It is sharded like ConcurrentMap, with two differences:
+ *  - Every slot is guarded by a reader/writer lock, so that concurrent `at()`,
+ *    `get()` and `count()` calls on the same slot don't serialize.
+ *  - The number of slots is picked at construction time. By default it is the
+ *    smallest prime that is at least four times the number of hardware
+ *    threads (and no less than 31), so that contention doesn't grow with the
+ *    machine.
+ *
+ * The thread-safety guarantees are the same as for ConcurrentMap.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class SharedConcurrentMap final {
+  using Map = std::unordered_map<Key, Value, Hash, Equal>;
+
+  struct Slot {
+    // pthread_rwlock-backed in libstdc++, and a good deal cheaper to acquire
+    // than boost::shared_mutex.
+    mutable std::shared_timed_mutex lock;
+    Map map;
+  };
+
+ public:
+  using iterator = cc_impl::SharedConcurrentMapIterator<Slot, Map>;
+  using const_iterator =
+      cc_impl::SharedConcurrentMapIterator<const Slot, const Map>;
+
+  static size_t default_n_slots() {
+    size_t n = std::max<size_t>(31, 4 * boost::thread::hardware_concurrency());
+    while (!cc_impl::is_prime(n)) {
+      ++n;
+    }
+    return n;
+  }
+
+  explicit SharedConcurrentMap(size_t n_slots = default_n_slots())
+      : m_n_slots(n_slots), m_slots(new Slot[n_slots]) {
+    always_assert(n_slots > 0);
+  }
+
+  SharedConcurrentMap(const SharedConcurrentMap& other)
+      : m_n_slots(other.m_n_slots), m_slots(new Slot[other.m_n_slots]) {
+    for (size_t i = 0; i < m_n_slots; ++i) {
+      m_slots[i].map = other.m_slots[i].map;
+    }
+  }
+
+  SharedConcurrentMap(SharedConcurrentMap&& other)
+      : m_n_slots(other.m_n_slots), m_slots(new Slot[other.m_n_slots]) {
+    for (size_t i = 0; i < m_n_slots; ++i) {
+      m_slots[i].map = std::move(other.m_slots[i].map);
+    }
+  }
+
+  size_t n_slots() const { return m_n_slots; }
+
+  /*
+   * Using iterators or accessor functions while the container is concurrently
+   * modified will result in undefined behavior.
+   */
+
+  iterator begin() { return iterator(m_slots.get(), m_n_slots, 0); }
+
+  iterator end() { return iterator(m_slots.get(), m_n_slots); }
+
+  const_iterator begin() const {
+    return const_iterator(m_slots.get(), m_n_slots, 0);
+  }
+
+  const_iterator end() const { return const_iterator(m_slots.get(), m_n_slots); }
+
+  const_iterator cbegin() const { return begin(); }
+
+  const_iterator cend() const { return end(); }
+
+  iterator find(const Key& key) {
+    size_t slot = slot_of(key);
+    auto it = m_slots[slot].map.find(key);
+    if (it == m_slots[slot].map.end()) {
+      return end();
+    }
+    return iterator(m_slots.get(), m_n_slots, slot, it);
+  }
+
+  const_iterator find(const Key& key) const {
+    size_t slot = slot_of(key);
+    auto it = m_slots[slot].map.find(key);
+    if (it == m_slots[slot].map.end()) {
+      return end();
+    }
+    return const_iterator(m_slots.get(), m_n_slots, slot, it);
+  }
+
+  size_t size() const {
+    size_t s = 0;
+    for (size_t slot = 0; slot < m_n_slots; ++slot) {
+      s += m_slots[slot].map.size();
+    }
+    return s;
+  }
+
+  void reserve(size_t capacity) {
+    size_t slot_capacity = capacity / m_n_slots;
+    if (slot_capacity > 0) {
+      for (size_t i = 0; i < m_n_slots; ++i) {
+        m_slots[i].map.reserve(slot_capacity);
+      }
+    }
+  }
+
+  void clear() {
+    for (size_t slot = 0; slot < m_n_slots; ++slot) {
+      m_slots[slot].map.clear();
+    }
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  size_t count(const Key& key) const {
+    const auto& slot = m_slots[slot_of(key)];
+    std::shared_lock<std::shared_timed_mutex> lock(slot.lock);
+    return slot.map.count(key);
+  }
+
+  size_t count_unsafe(const Key& key) const {
+    return m_slots[slot_of(key)].map.count(key);
+  }
+
+  /*
+   * This operation is always thread-safe. As with ConcurrentMap, it returns a
+   * copy rather than a reference.
+   */
+  Value at(const Key& key) const {
+    const auto& slot = m_slots[slot_of(key)];
+    std::shared_lock<std::shared_timed_mutex> lock(slot.lock);
+    return slot.map.at(key);
+  }
+
+  const Value& at_unsafe(const Key& key) const {
+    return m_slots[slot_of(key)].map.at(key);
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  Value get(const Key& key, Value default_value) const {
+    const auto& slot = m_slots[slot_of(key)];
+    std::shared_lock<std::shared_timed_mutex> lock(slot.lock);
+    auto it = slot.map.find(key);
+    if (it == slot.map.end()) {
+      return default_value;
+    }
+    return it->second;
+  }
+
+  /*
+   * The Boolean return value denotes whether the insertion took place.
+   * This operation is always thread-safe.
+   */
+  bool insert(const std::pair<Key, Value>& entry) {
+    auto& slot = m_slots[slot_of(entry.first)];
+    std::unique_lock<std::shared_timed_mutex> lock(slot.lock);
+    return slot.map.insert(entry).second;
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  void insert(std::initializer_list<std::pair<Key, Value>> l) {
+    for (const auto& entry : l) {
+      insert(entry);
+    }
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  template <typename InputIt>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  void insert_or_assign(const std::pair<Key, Value>& entry) {
+    auto& slot = m_slots[slot_of(entry.first)];
+    std::unique_lock<std::shared_timed_mutex> lock(slot.lock);
+    slot.map[entry.first] = entry.second;
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    std::pair<Key, Value> entry(std::forward<Args>(args)...);
+    auto& slot = m_slots[slot_of(entry.first)];
+    std::unique_lock<std::shared_timed_mutex> lock(slot.lock);
+    return slot.map.emplace(std::move(entry)).second;
+  }
+
+  /*
+   * This operation atomically modifies an entry in the map. If the entry
+   * doesn't exist, it is created. The third argument of the updater function is
+   * a Boolean flag denoting whether the entry exists or not.
+   */
+  void update(const Key& key,
+              const std::function<void(const Key&, Value&, bool)>& updater) {
+    auto& slot = m_slots[slot_of(key)];
+    std::unique_lock<std::shared_timed_mutex> lock(slot.lock);
+    auto it = slot.map.find(key);
+    if (it == slot.map.end()) {
+      updater(key, slot.map[key], false);
+    } else {
+      updater(it->first, it->second, true);
+    }
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  size_t erase(const Key& key) {
+    auto& slot = m_slots[slot_of(key)];
+    std::unique_lock<std::shared_timed_mutex> lock(slot.lock);
+    return slot.map.erase(key);
+  }
+
+ private:
+  size_t slot_of(const Key& key) const { return Hash()(key) % m_n_slots; }
+
+  const size_t m_n_slots;
+  std::unique_ptr<Slot[]> m_slots;
+};
+
+namespace cc_impl {
+
+template <typename Slot, typename Map>
+class SharedConcurrentMapIterator final {
+ public:
+  using base_iterator = std::conditional_t<std::is_const<Map>::value,
+                                           typename Map::const_iterator,
+                                           typename Map::iterator>;
+  using difference_type = std::ptrdiff_t;
+  using value_type = typename base_iterator::value_type;
+  using pointer = typename base_iterator::pointer;
+  using reference = typename base_iterator::reference;
+  using iterator_category = std::forward_iterator_tag;
+
+  // The end iterator.
+  SharedConcurrentMapIterator(Slot* slots, size_t n_slots)
+      : m_slots(slots),
+        m_n_slots(n_slots),
+        m_slot(n_slots - 1),
+        m_position(slots[n_slots - 1].map.end()) {}
+
+  SharedConcurrentMapIterator(Slot* slots, size_t n_slots, size_t slot)
+      : SharedConcurrentMapIterator(
+            slots, n_slots, slot, slots[slot].map.begin()) {}
+
+  SharedConcurrentMapIterator(Slot* slots,
+                              size_t n_slots,
+                              size_t slot,
+                              const base_iterator& position)
+      : m_slots(slots), m_n_slots(n_slots), m_slot(slot), m_position(position) {
+    skip_empty_slots();
+  }
+
+  SharedConcurrentMapIterator& operator++() {
+    always_assert(!at_end());
+    ++m_position;
+    skip_empty_slots();
+    return *this;
+  }
+
+  SharedConcurrentMapIterator operator++(int) {
+    SharedConcurrentMapIterator retval = *this;
+    ++(*this);
+    return retval;
+  }
+
+  bool operator==(const SharedConcurrentMapIterator& other) const {
+    return m_slots == other.m_slots && m_slot == other.m_slot &&
+           m_position == other.m_position;
+  }
+
+  bool operator!=(const SharedConcurrentMapIterator& other) const {
+    return !(*this == other);
+  }
+
+  reference operator*() const {
+    always_assert(!at_end());
+    return *m_position;
+  }
+
+  pointer operator->() const {
+    always_assert(!at_end());
+    return m_position.operator->();
+  }
+
+ private:
+  bool at_end() const {
+    return m_position == m_slots[m_n_slots - 1].map.end();
+  }
+
+  void skip_empty_slots() {
+    while (m_position == m_slots[m_slot].map.end() && m_slot < m_n_slots - 1) {
+      m_position = m_slots[++m_slot].map.begin();
+    }
+  }
+
+  Slot* m_slots;
+  size_t m_n_slots;
+  size_t m_slot;
+  base_iterator m_position;
+};
+
 template <typename Container, size_t n_slots>
 class ConcurrentContainerIterator final {
  public:
@@ -7,29 +7,46 @@
 
 #include "ConfigFiles.h"
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "InstrumentProfile.h"
 
 ConfigFiles::ConfigFiles(const Json::Value& config, const std::string& outdir)
     : m_json(config),
       outdir(outdir),
-      m_proguard_map(config.get("proguard_map", "").asString()),
+      m_proguard_map(config.get("proguard_map", "").asString(),
+                     config.get("proguard_map_index", false).asBool()),
       m_coldstart_class_filename(
           config.get("coldstart_classes", "").asString()),
       m_coldstart_method_filename(
           config.get("coldstart_methods", "").asString()),
       m_profiled_methods_filename(
           config.get("profiled_methods_file", "").asString()),
+      m_method_trace_filename(
+          config.get("method_trace_file", "").asString()),
+      m_instrument_metadata_filename(
+          config.get("instrument_metadata_file", "").asString()),
+      m_instrument_profiles_dir(
+          config.get("instrument_profiles", "").asString()),
       m_printseeds(config.get("printseeds", "").asString()) {
 
   if (m_profiled_methods_filename != "") {
     load_method_to_weight();
   }
+  if (m_method_trace_filename != "") {
+    load_method_to_first_execution();
+  }
+  if (m_instrument_profiles_dir != "") {
+    load_instrument_profiles();
+  }
   load_method_sorting_whitelisted_substrings();
   uint32_t instruction_size_bitwidth_limit =
       config.get("instruction_size_bitwidth_limit", 0).asUInt();
@@ -46,7 +63,10 @@ ConfigFiles::ConfigFiles(const Json::Value& config) : ConfigFiles(config, "") {}
  * This function relies on the g_redex.
  */
 const std::unordered_set<DexType*>& ConfigFiles::get_no_optimizations_annos() {
-  if (m_no_optimizations_annos.empty()) {
+  // Most configs name none, so the flag rather than emptiness tells whether
+  // the JSON was already looked at.
+  if (!m_no_optimizations_annos_loaded) {
+    m_no_optimizations_annos_loaded = true;
     Json::Value no_optimizations_anno;
     m_json.get("no_optimizations_annotations", Json::nullValue,
                no_optimizations_anno);
@@ -65,7 +85,7 @@ const std::unordered_set<DexType*>& ConfigFiles::get_no_optimizations_annos() {
  * Read an interdex list file and return as a vector of appropriately-formatted
  * classname strings.
  */
-std::vector<std::string> ConfigFiles::load_coldstart_classes() {
+std::vector<std::string> ConfigFiles::load_coldstart_classes() const {
   const char* kClassTail = ".class";
   const size_t lentail = strlen(kClassTail);
   auto file = m_coldstart_class_filename.c_str();
@@ -162,6 +182,67 @@ void ConfigFiles::load_method_to_weight() {
   TRACE(CUSTOMSORT, 2, "Preset sort weight count=%d", count);
 }
 
+/**
+ * Read a startup method trace, with one "<method> <timestamp>" line per
+ * execution, and keep the earliest timestamp of each method.
+ */
+void ConfigFiles::load_method_to_first_execution() {
+  std::ifstream infile(m_method_trace_filename.c_str());
+  assert_log(infile, "Can't open method trace file: %s\n",
+             m_method_trace_filename.c_str());
+
+  std::string deobfuscated_name;
+  uint64_t timestamp;
+  unsigned int count = 0;
+  while (infile >> deobfuscated_name >> timestamp) {
+    auto it = m_method_to_first_execution.emplace(deobfuscated_name, timestamp)
+                  .first;
+    it->second = std::min(it->second, timestamp);
+    count++;
+  }
+
+  assert_log(count > 0, "Method trace file %s didn't contain valid entries\n",
+             m_method_trace_filename.c_str());
+  TRACE(CUSTOMSORT, 2, "Traced %u executions of %u methods", count,
+        m_method_to_first_execution.size());
+}
+
+/**
+ * Merge the profiles, one per file in the "instrument_profiles" directory, of
+ * an app instrumented with the "instrument_metadata_file". Their method
+ * weights take precedence over the ones of the "profiled_methods_file".
+ */
+void ConfigFiles::load_instrument_profiles() {
+  always_assert_log(m_instrument_metadata_filename != "",
+                    "instrument_profiles needs an instrument_metadata_file\n");
+  auto metadata =
+      instrument::InstrumentMetadata::read(m_instrument_metadata_filename);
+
+  std::vector<std::string> paths;
+  boost::system::error_code ec;
+  for (const auto& entry : boost::filesystem::directory_iterator(
+           m_instrument_profiles_dir, ec)) {
+    if (boost::filesystem::is_regular_file(entry.status())) {
+      paths.push_back(entry.path().string());
+    }
+  }
+  assert_log(!ec, "Can't list instrumentation profiles in %s\n",
+             m_instrument_profiles_dir.c_str());
+  std::sort(paths.begin(), paths.end());
+
+  auto summary = instrument::merge_profiles(metadata, paths, 0);
+  assert_log(summary.num_profiles > 0,
+             "No valid instrumentation profiles in %s\n",
+             m_instrument_profiles_dir.c_str());
+  for (const auto& p : summary.method_weights) {
+    m_method_to_weight[p.first] = std::min<uint64_t>(
+        p.second, std::numeric_limits<unsigned int>::max());
+  }
+  m_method_to_block_heat = std::move(summary.block_heat);
+  TRACE(CUSTOMSORT, 2, "Profiled weight count=%zu from %zu profiles",
+        summary.method_weights.size(), summary.num_profiles);
+}
+
 void ConfigFiles::load_method_sorting_whitelisted_substrings() {
   const auto json_cfg = get_json_config();
   Json::Value json_result;
@@ -192,6 +273,16 @@ void ConfigFiles::load_inliner_config(inliner::InlinerConfig* inliner_config) {
          inliner_config->enforce_method_size_limit);
   jw.get("use_cfg_inliner", true, inliner_config->use_cfg_inliner);
   jw.get("multiple_callers", false, inliner_config->multiple_callers);
+  jw.get("parallel", false, inliner_config->parallel);
+  jw.get("shrink_callees", false, inliner_config->shrink_callees);
+  jw.get("use_method_profiles", false, inliner_config->use_method_profiles);
+  jw.get("hot_method_weight", 1, inliner_config->hot_method_weight);
+  jw.get("hot_callee_size_factor",
+         2,
+         inliner_config->hot_callee_size_factor);
+  if (inliner_config->use_method_profiles) {
+    inliner_config->method_to_weight = &m_method_to_weight;
+  }
   jw.get("inline_small_non_deletables",
          false,
          inliner_config->inline_small_non_deletables);
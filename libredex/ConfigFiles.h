@@ -30,7 +30,7 @@ struct ConfigFiles {
   ConfigFiles(const Json::Value& config);
   ConfigFiles(const Json::Value& config, const std::string& outdir);
 
-  const std::vector<std::string>& get_coldstart_classes() {
+  const std::vector<std::string>& get_coldstart_classes() const {
     if (m_coldstart_classes.size() == 0) {
       m_coldstart_classes = load_coldstart_classes();
     }
@@ -73,6 +73,26 @@ struct ConfigFiles {
     return m_method_to_weight;
   }
 
+  /**
+   * The time at which each method first ran at startup, by fully deobfuscated
+   * name, from the "method_trace_file". Empty if there is no trace.
+   */
+  const std::unordered_map<std::string, uint64_t>&
+  get_method_to_first_execution() const {
+    return m_method_to_first_execution;
+  }
+
+  /**
+   * How often each block of a method ran, by fully deobfuscated name, from
+   * the profiles in "instrument_profiles" of an app instrumented by
+   * InstrumentPass, see InstrumentProfile.h. The blocks are numbered like in
+   * the "instrument_metadata_file".
+   */
+  const std::unordered_map<std::string, std::vector<uint64_t>>&
+  get_method_to_block_heat() const {
+    return m_method_to_block_heat;
+  }
+
   const std::unordered_set<std::string>&
   get_method_sorting_whitelisted_substrings() const {
     return m_method_sorting_whitelisted_substrings;
@@ -123,10 +143,12 @@ struct ConfigFiles {
   JsonWrapper m_json;
   std::string outdir;
 
-  std::vector<std::string> load_coldstart_classes();
+  std::vector<std::string> load_coldstart_classes() const;
   std::vector<std::string> load_coldstart_methods();
   std::unordered_map<std::string, std::vector<std::string> > load_class_lists();
   void load_method_to_weight();
+  void load_method_to_first_execution();
+  void load_instrument_profiles();
   void load_method_sorting_whitelisted_substrings();
   void load_inliner_config(inliner::InlinerConfig*);
 
@@ -135,10 +157,15 @@ struct ConfigFiles {
   std::string m_coldstart_class_filename;
   std::string m_coldstart_method_filename;
   std::string m_profiled_methods_filename;
-  std::vector<std::string> m_coldstart_classes;
+  std::string m_method_trace_filename;
+  std::string m_instrument_metadata_filename;
+  std::string m_instrument_profiles_dir;
+  mutable std::vector<std::string> m_coldstart_classes;
   std::vector<std::string> m_coldstart_methods;
   std::unordered_map<std::string, std::vector<std::string> > m_class_lists;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
+  std::unordered_map<std::string, uint64_t> m_method_to_first_execution;
+  std::unordered_map<std::string, std::vector<uint64_t>> m_method_to_block_heat;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
   std::string m_printseeds; // Filename to dump computed seeds.
 
@@ -148,6 +175,7 @@ struct ConfigFiles {
 
   // global no optimizations annotations
   std::unordered_set<DexType*> m_no_optimizations_annos;
+  bool m_no_optimizations_annos_loaded{false};
   // Global inliner config.
   std::unique_ptr<inliner::InlinerConfig> m_inliner_config{nullptr};
 };
@@ -7,7 +7,11 @@
 
 #include "Configurable.h"
 
+#include <boost/functional/hash.hpp>
+#include <cstring>
+
 #include "DexClass.h"
+#include "RedexContext.h"
 
 #define error_or_warn(error, warn, msg, ...)       \
   always_assert_log(!(error), msg, ##__VA_ARGS__); \
@@ -15,6 +19,81 @@
     fprintf(stderr, msg, ##__VA_ARGS__);           \
   }
 
+namespace {
+
+size_t hash_list(const Json::Value& list) {
+  size_t seed = list.size();
+  for (const auto& str : list) {
+    if (str.isString()) {
+      const char* chars = str.asCString();
+      boost::hash_range(seed, chars, chars + strlen(chars));
+    }
+  }
+  return seed;
+}
+
+/*
+ * Resolves a list of type names, warning or failing about the ones that don't
+ * resolve as the bindflags say. Fully resolved lists come out of and go into
+ * the RedexContext's ConfigTypeListCache.
+ */
+ConfigTypeListCache::Types resolve_types(const Json::Value& value,
+                                         Configurable::bindflags_t bindflags) {
+  auto& cache = g_redex->config_type_list_cache();
+  if (auto cached = cache.get(value)) {
+    return cached;
+  }
+  auto result = std::make_shared<std::vector<DexType*>>();
+  result->reserve(value.size());
+  bool resolved_all = true;
+  for (auto& str : value) {
+    auto type = DexType::get_type(str.asCString());
+    if (type == nullptr) {
+      error_or_warn(
+          bindflags & Configurable::bindflags::types::error_if_unresolvable,
+          bindflags & Configurable::bindflags::types::warn_if_unresolvable,
+          "\"%s\" failed to resolve to a known type\n", str.asCString());
+      resolved_all = false;
+    } else {
+      result->emplace_back(type);
+    }
+  }
+  if (resolved_all) {
+    cache.put(value, result);
+  }
+  return result;
+}
+
+} // namespace
+
+ConfigTypeListCache::Types ConfigTypeListCache::get(const Json::Value& list) {
+  auto hash = hash_list(list);
+  auto epoch = g_redex->get_rename_epoch();
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto range = m_entries.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.rename_epoch == epoch && it->second.list == list) {
+      return it->second.types;
+    }
+  }
+  return nullptr;
+}
+
+void ConfigTypeListCache::put(const Json::Value& list, Types types) {
+  auto hash = hash_list(list);
+  auto epoch = g_redex->get_rename_epoch();
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto range = m_entries.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.list == list) {
+      it->second.types = std::move(types);
+      it->second.rename_epoch = epoch;
+      return;
+    }
+  }
+  m_entries.emplace(hash, Entry{list, std::move(types), epoch});
+}
+
 void Configurable::parse_config(const JsonWrapper& json) {
   m_after_configuration = {};
   m_reflecting = false;
@@ -232,19 +311,7 @@ std::vector<DexType*> Configurable::as<std::vector<DexType*>>(
   always_assert_log(!(bindflags & ~Configurable::bindflags::types::mask),
              "Only type bindflags may be specified for a "
              "std::vector<DexType*>");
-  std::vector<DexType*> result;
-  for (auto& str : value) {
-    auto type = DexType::get_type(str.asString());
-    if (type == nullptr) {
-      error_or_warn(
-          bindflags & Configurable::bindflags::types::error_if_unresolvable,
-          bindflags & Configurable::bindflags::types::warn_if_unresolvable,
-          "\"%s\" failed to resolve to a known type\n", str.asString().c_str());
-    } else {
-      result.emplace_back(static_cast<DexType*>(type));
-    }
-  }
-  return result;
+  return *resolve_types(value, bindflags);
 }
 
 template <>
@@ -254,19 +321,8 @@ std::unordered_set<DexType*> Configurable::as<std::unordered_set<DexType*>>(
              "Only type bindflags may be specified for a "
              "std::unordered_set<DexType*>, you specified 0x%08x",
              bindflags);
-  std::unordered_set<DexType*> result;
-  for (auto& str : value) {
-    auto type = DexType::get_type(str.asString());
-    if (type == nullptr) {
-      error_or_warn(
-          bindflags & Configurable::bindflags::types::error_if_unresolvable,
-          bindflags & Configurable::bindflags::types::warn_if_unresolvable,
-          "\"%s\" failed to resolve to a known type\n", str.asString().c_str());
-    } else {
-      result.emplace(static_cast<DexType*>(type));
-    }
-  }
-  return result;
+  auto types = resolve_types(value, bindflags);
+  return std::unordered_set<DexType*>(types->begin(), types->end());
 }
 
 template <>
@@ -276,19 +332,8 @@ Configurable::as<std::unordered_set<const DexType*>>(const Json::Value& value,
   always_assert_log(!(bindflags & ~Configurable::bindflags::types::mask),
              "Only type bindflags may be specified for a "
              "std::unordered_set<DexType*>");
-  std::unordered_set<const DexType*> result;
-  for (auto& str : value) {
-    auto type = DexType::get_type(str.asString());
-    if (type == nullptr) {
-      error_or_warn(
-          bindflags & Configurable::bindflags::types::error_if_unresolvable,
-          bindflags & Configurable::bindflags::types::warn_if_unresolvable,
-          "\"%s\" failed to resolve to a known type\n", str.asString().c_str());
-    } else {
-      result.emplace(static_cast<DexType*>(type));
-    }
-  }
-  return result;
+  auto types = resolve_types(value, bindflags);
+  return std::unordered_set<const DexType*>(types->begin(), types->end());
 }
 
 template <>
@@ -11,7 +11,10 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -355,6 +358,40 @@ class Configurable {
   bool m_reflecting;
 };
 
+/**
+ * The type lists of the configs, resolved once per RedexContext. Several
+ * passes, and several runs of a pass, often bind the same blocklist of
+ * thousands of types; each distinct list is resolved to DexTypes only once and
+ * the Configurables that bind it copy the result.
+ *
+ * A list is only cached once all its types resolved, so lists that warn or
+ * fail about unresolvable types keep doing so. Renaming types moves the
+ * RedexContext's rename epoch (see RedexContext::get_rename_epoch()), after
+ * which the cached lists are resolved again.
+ */
+class ConfigTypeListCache {
+ public:
+  using Types = std::shared_ptr<const std::vector<DexType*>>;
+
+  /*
+   * The types `list` resolved to, or nullptr if it is not cached.
+   */
+  Types get(const Json::Value& list);
+
+  void put(const Json::Value& list, Types types);
+
+ private:
+  struct Entry {
+    Json::Value list;
+    Types types;
+    size_t rename_epoch;
+  };
+
+  std::mutex m_lock;
+  // Keyed by the hash of the list's strings.
+  std::unordered_multimap<size_t, Entry> m_entries;
+};
+
 // Specializations for primitives
 
 #define DEFINE_CONFIGURABLE_PRIMITIVE(type)                         \
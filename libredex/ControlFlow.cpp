@@ -620,8 +620,8 @@ void ControlFlowGraph::connect_blocks(BranchToTargets& branch_to_targets) {
     }
 
     auto next = std::next(it);
-    Block* next_b = next->second;
     if (fallthrough && next != m_blocks.end()) {
+      Block* next_b = next->second;
       TRACE(CFG, 6, "adding fallthrough goto %d -> %d", b->id(),
             next_b->id());
       add_edge(b, next_b, EDGE_GOTO);
@@ -677,8 +677,7 @@ void ControlFlowGraph::add_catch_edges(TryEnds& try_ends,
 BlockId ControlFlowGraph::next_block_id() const {
   // Choose the next largest id. Note that we can't use m_block.size() because
   // we may have deleted some blocks from the cfg.
-  const auto& rbegin = m_blocks.rbegin();
-  return (rbegin == m_blocks.rend()) ? 0 : (rbegin->first + 1);
+  return m_blocks.id_bound();
 }
 
 void ControlFlowGraph::remove_unreachable_succ_edges() {
@@ -837,7 +836,7 @@ void ControlFlowGraph::remove_empty_blocks() {
       }
 
       if (b == entry_block()) {
-        m_entry_block = succ;
+        set_entry_block(succ);
       }
     }
 
@@ -1194,7 +1193,7 @@ void ControlFlowGraph::deep_copy(ControlFlowGraph* new_cfg) const {
   cloner.fix_parent_positions();
 
   // patch the edge pointers in the blocks to their new cfg counterparts
-  for (auto& entry : new_cfg->m_blocks) {
+  for (const auto& entry : new_cfg->m_blocks) {
     Block* b = entry.second;
     for (Edge*& e : b->m_preds) {
       e = old_edge_to_new.at(e);
@@ -1215,6 +1214,7 @@ void ControlFlowGraph::deep_copy(ControlFlowGraph* new_cfg) const {
   if (this->m_exit_block != nullptr) {
     new_cfg->m_exit_block = new_cfg->m_blocks.at(this->m_exit_block->id());
   }
+  new_cfg->m_block_heat = this->m_block_heat;
 }
 
 InstructionIterator ControlFlowGraph::find_insn(IRInstruction* needle,
@@ -1253,8 +1253,12 @@ std::vector<Block*> ControlFlowGraph::order() {
   std::unordered_map<Block*, Chain*> block_to_chain;
   block_to_chain.reserve(m_blocks.size());
 
-  build_chains(&chains, &block_to_chain);
-  const auto& result = wto_chains(block_to_chain);
+  // The profile guided order makes its own fall throughs.
+  build_chains(&chains, &block_to_chain,
+               /* required_only */ !m_block_heat.empty());
+  const auto& result = m_block_heat.empty()
+                           ? wto_chains(block_to_chain)
+                           : profile_guided_order(&block_to_chain);
 
   always_assert_log(result.size() == m_blocks.size(),
                     "result has %lu blocks, m_blocks has %lu", result.size(),
@@ -1264,7 +1268,8 @@ std::vector<Block*> ControlFlowGraph::order() {
 
 void ControlFlowGraph::build_chains(
     std::vector<std::unique_ptr<Chain>>* chains,
-    std::unordered_map<Block*, Chain*>* block_to_chain) {
+    std::unordered_map<Block*, Chain*>* block_to_chain,
+    bool required_only) {
   for (const auto& entry : m_blocks) {
     Block* b = entry.second;
     if (block_to_chain->count(b) != 0) {
@@ -1287,7 +1292,8 @@ void ControlFlowGraph::build_chains(
       always_assert_log(!DEBUG || m_blocks.count(goto_block->id()) > 0,
                         "bogus block reference %d -> %d in %s",
                         goto_edge->src()->id(), goto_block->id(), SHOW(*this));
-      if (goto_block->starts_with_move_result() || goto_block->same_try(b)) {
+      if (goto_block->starts_with_move_result() ||
+          (!required_only && goto_block->same_try(b))) {
         // If the goto edge leads to a block with a move-result(-pseudo), then
         // that block must be placed immediately after this one because we can't
         // insert anything between an instruction and its move-result(-pseudo).
@@ -1372,6 +1378,116 @@ std::vector<Block*> ControlFlowGraph::wto_chains(
   return wto_order;
 }
 
+void ControlFlowGraph::set_block_heat(const std::vector<uint64_t>& heat) {
+  const auto& blocks = this->blocks();
+  always_assert_log(heat.size() == blocks.size(), "%lu heats for %lu blocks",
+                    heat.size(), blocks.size());
+  m_block_heat.clear();
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    m_block_heat.emplace(blocks[i]->id(), heat[i]);
+  }
+}
+
+// Bottom-up positioning from Pettis and Hansen's "Profile guided code
+// positioning": the chains of build_chains are joined along the hottest edges
+// first, so that these edges fall through, inverting the conditional
+// branches whose target is the hotter successor. The entry chain then comes
+// first, and the other chains follow hottest first, with the WTO order
+// breaking the ties so that the cold blocks keep their usual layout at the
+// end. Blocks that the heat doesn't know about, like the ones created since it
+// was set, are cold.
+std::vector<Block*> ControlFlowGraph::profile_guided_order(
+    std::unordered_map<Block*, Chain*>* block_to_chain) {
+  auto heat = [this](Block* b) -> uint64_t {
+    auto it = m_block_heat.find(b->id());
+    return it == m_block_heat.end() ? 0 : it->second;
+  };
+
+  // Only the gotos and the targets of if-* can become fall throughs. Without
+  // edge counts, an edge is as hot as the colder of its ends. The cold gotos
+  // within a try come last, to fall through where build_chains would have
+  // made them.
+  std::vector<std::pair<uint64_t, Edge*>> candidates;
+  for (const auto& entry : m_blocks) {
+    Block* b = entry.second;
+    for (Edge* e : b->succs()) {
+      if (e->type() != EDGE_GOTO &&
+          (e->type() != EDGE_BRANCH || e->m_case_key != boost::none)) {
+        continue;
+      }
+      auto weight = std::min(heat(b), heat(e->target()));
+      if (e->target() != entry_block() &&
+          (weight > 0 ||
+           (e->type() == EDGE_GOTO && e->target()->same_try(b)))) {
+        candidates.emplace_back(weight, e);
+      }
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const std::pair<uint64_t, Edge*>& a,
+                      const std::pair<uint64_t, Edge*>& b) {
+                     return a.first > b.first;
+                   });
+
+  for (const auto& candidate : candidates) {
+    Edge* e = candidate.second;
+    Block* src = e->src();
+    Block* target = e->target();
+    Chain* src_chain = block_to_chain->at(src);
+    Chain* target_chain = block_to_chain->at(target);
+    if (src_chain == target_chain || src_chain->back() != src ||
+        target_chain->front() != target) {
+      continue;
+    }
+    if (e->type() == EDGE_BRANCH) {
+      auto branch = src->get_conditional_branch();
+      Edge* goto_edge = get_succ_edge_of_type(src, EDGE_GOTO);
+      always_assert_log(branch != src->end() && goto_edge != nullptr,
+                        "block %d %s", src->id(), SHOW(*this));
+      branch->insn->set_opcode(
+          opcode::invert_conditional_branch(branch->insn->opcode()));
+      goto_edge->m_type = EDGE_BRANCH;
+      e->m_type = EDGE_GOTO;
+      ++m_edge_version;
+    }
+    for (Block* b : *target_chain) {
+      src_chain->push_back(b);
+      (*block_to_chain)[b] = src_chain;
+    }
+    target_chain->clear();
+  }
+
+  std::vector<Chain*> chain_order;
+  std::unordered_set<Chain*> seen;
+  for (Block* b : wto_chains(*block_to_chain)) {
+    Chain* chain = block_to_chain->at(b);
+    if (seen.insert(chain).second) {
+      chain_order.push_back(chain);
+    }
+  }
+  always_assert(!chain_order.empty() &&
+                chain_order.front()->front() == entry_block());
+  std::unordered_map<Chain*, uint64_t> chain_heat;
+  for (Chain* chain : chain_order) {
+    uint64_t max_heat = 0;
+    for (Block* b : *chain) {
+      max_heat = std::max(max_heat, heat(b));
+    }
+    chain_heat.emplace(chain, max_heat);
+  }
+  std::stable_sort(chain_order.begin() + 1, chain_order.end(),
+                   [&chain_heat](Chain* a, Chain* b) {
+                     return chain_heat.at(a) > chain_heat.at(b);
+                   });
+
+  std::vector<Block*> result;
+  result.reserve(m_blocks.size());
+  for (Chain* chain : chain_order) {
+    result.insert(result.end(), chain->begin(), chain->end());
+  }
+  return result;
+}
+
 // Add an MFLOW_TARGET at the end of each edge.
 // Insert GOTOs where necessary.
 void ControlFlowGraph::insert_branches_and_targets(
@@ -1616,8 +1732,24 @@ std::vector<Block*> ControlFlowGraph::blocks() const {
   return result;
 }
 
+ControlFlowGraph::DerivedStructures& ControlFlowGraph::derived_structures()
+    const {
+  auto version = structure_version();
+  if (m_derived == nullptr || m_derived->version != version) {
+    m_derived = std::make_unique<DerivedStructures>();
+    m_derived->version = version;
+  }
+  return *m_derived;
+}
+
 // Uses a standard depth-first search ith a side table of already-visited nodes.
 std::vector<Block*> ControlFlowGraph::blocks_post_helper(bool reverse) const {
+  auto& derived = derived_structures();
+  if (derived.postorder) {
+    const auto& postorder = *derived.postorder;
+    return reverse ? std::vector<Block*>(postorder.rbegin(), postorder.rend())
+                   : postorder;
+  }
   std::stack<Block*> stack;
   for (const auto& entry : m_blocks) {
     // include unreachable blocks too
@@ -1630,14 +1762,13 @@ std::vector<Block*> ControlFlowGraph::blocks_post_helper(bool reverse) const {
 
   std::vector<Block*> postorder;
   postorder.reserve(m_blocks.size());
-  std::unordered_set<Block*> visited;
-  visited.reserve(m_blocks.size());
+  std::vector<bool> visited(block_id_bound());
   while (!stack.empty()) {
     const auto& curr = stack.top();
-    visited.insert(curr);
+    visited[curr->id()] = true;
     bool all_succs_visited = [&] {
       for (auto const& s : curr->succs()) {
-        if (!visited.count(s->target())) {
+        if (!visited[s->target()->id()]) {
           stack.push(s->target());
           return false;
         }
@@ -1650,12 +1781,52 @@ std::vector<Block*> ControlFlowGraph::blocks_post_helper(bool reverse) const {
       stack.pop();
     }
   }
+  derived.postorder = postorder;
   if (reverse) {
     std::reverse(postorder.begin(), postorder.end());
   }
   return postorder;
 }
 
+std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>>
+ControlFlowGraph::wto() const {
+  auto& derived = derived_structures();
+  if (derived.wto == nullptr) {
+    // The same successor function as the fixpoint iterators', so that the
+    // ordering, and hence the analyses' results, are unchanged.
+    derived.wto = std::make_shared<sparta::WeakTopologicalOrdering<Block*>>(
+        entry_block(), [](Block* const& block) {
+          std::vector<Block*> succs;
+          succs.reserve(block->succs().size());
+          for (const Edge* e : block->succs()) {
+            succs.push_back(e->target());
+          }
+          return succs;
+        });
+  }
+  return derived.wto;
+}
+
+std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>>
+ControlFlowGraph::reverse_wto() const {
+  always_assert_log(exit_block() != nullptr,
+                    "Call calculate_exit_block() first");
+  auto& derived = derived_structures();
+  if (derived.reverse_wto == nullptr) {
+    derived.reverse_wto =
+        std::make_shared<sparta::WeakTopologicalOrdering<Block*>>(
+            exit_block(), [](Block* const& block) {
+              std::vector<Block*> preds;
+              preds.reserve(block->preds().size());
+              for (const Edge* e : block->preds()) {
+                preds.push_back(e->src());
+              }
+              return preds;
+            });
+  }
+  return derived.reverse_wto;
+}
+
 std::vector<Block*> ControlFlowGraph::blocks_reverse_post() const {
   return blocks_post_helper(true);
 }
@@ -1805,16 +1976,16 @@ void ControlFlowGraph::calculate_exit_block() {
       // Need to clear old exit block before recomputing the exit of a CFG
       // with multiple exit points
       remove_block(m_exit_block);
-      m_exit_block = nullptr;
+      set_exit_block(nullptr);
     }
   }
 
   ExitBlocks eb;
   eb.visit(entry_block());
   if (eb.exit_blocks.size() == 1) {
-    m_exit_block = eb.exit_blocks[0];
+    set_exit_block(eb.exit_blocks[0]);
   } else {
-    m_exit_block = create_block();
+    set_exit_block(create_block());
     for (Block* b : eb.exit_blocks) {
       add_edge(b, m_exit_block, EDGE_GHOST);
     }
@@ -2246,19 +2417,19 @@ std::ostream& ControlFlowGraph::write_dot_format(std::ostream& o) const {
 }
 
 Block* ControlFlowGraph::idom_intersect(
-    const std::unordered_map<Block*, DominatorInfo>& postorder_dominator,
+    const std::vector<DominatorInfo>& postorder_dominator,
     Block* block1,
     Block* block2) const {
   auto finger1 = block1;
   auto finger2 = block2;
   while (finger1 != finger2) {
-    while (postorder_dominator.at(finger1).postorder <
-           postorder_dominator.at(finger2).postorder) {
-      finger1 = postorder_dominator.at(finger1).dom;
+    while (postorder_dominator[finger1->id()].postorder <
+           postorder_dominator[finger2->id()].postorder) {
+      finger1 = postorder_dominator[finger1->id()].dom;
     }
-    while (postorder_dominator.at(finger2).postorder <
-           postorder_dominator.at(finger1).postorder) {
-      finger2 = postorder_dominator.at(finger2).dom;
+    while (postorder_dominator[finger2->id()].postorder <
+           postorder_dominator[finger1->id()].postorder) {
+      finger2 = postorder_dominator[finger2->id()].dom;
     }
   }
   return finger1;
@@ -2267,23 +2438,30 @@ Block* ControlFlowGraph::idom_intersect(
 // Finding immediate dominator for each blocks in ControlFlowGraph.
 // Theory from:
 //    K. D. Cooper et.al. A Simple, Fast Dominance Algorithm.
-std::unordered_map<Block*, DominatorInfo>
-ControlFlowGraph::immediate_dominators() const {
+std::vector<DominatorInfo> ControlFlowGraph::immediate_dominators() const {
+  auto& derived = derived_structures();
+  if (!derived.immediate_dominators) {
+    derived.immediate_dominators = compute_immediate_dominators();
+  }
+  return *derived.immediate_dominators;
+}
+
+std::vector<DominatorInfo> ControlFlowGraph::compute_immediate_dominators()
+    const {
   // Get postorder of blocks and create map of block to postorder number.
-  std::unordered_map<Block*, DominatorInfo> postorder_dominator;
+  std::vector<DominatorInfo> postorder_dominator(block_id_bound());
   const auto& postorder_blocks = blocks_post();
   for (size_t i = 0; i < postorder_blocks.size(); ++i) {
-    postorder_dominator[postorder_blocks[i]].postorder = i;
+    postorder_dominator[postorder_blocks[i]->id()].postorder = i;
   }
 
   // Initialize immediate dominators. Having value as nullptr means it has
   // not been processed yet.
-  for (Block* block : blocks()) {
+  for (const auto& entry : m_blocks) {
+    Block* block = entry.second;
     if (block->preds().empty()) {
       // Entry block's immediate dominator is itself.
-      postorder_dominator[block].dom = block;
-    } else {
-      postorder_dominator[block].dom = nullptr;
+      postorder_dominator[block->id()].dom = block;
     }
   }
 
@@ -2300,7 +2478,7 @@ ControlFlowGraph::immediate_dominators() const {
       Block* new_idom = nullptr;
       // Pick one random processed block as starting point.
       for (auto& pred : ordered_block->preds()) {
-        if (postorder_dominator[pred->src()].dom != nullptr) {
+        if (postorder_dominator[pred->src()->id()].dom != nullptr) {
           new_idom = pred->src();
           break;
         }
@@ -2308,12 +2486,12 @@ ControlFlowGraph::immediate_dominators() const {
       always_assert(new_idom != nullptr);
       for (auto& pred : ordered_block->preds()) {
         if (pred->src() != new_idom &&
-            postorder_dominator[pred->src()].dom != nullptr) {
+            postorder_dominator[pred->src()->id()].dom != nullptr) {
           new_idom = idom_intersect(postorder_dominator, new_idom, pred->src());
         }
       }
-      if (postorder_dominator[ordered_block].dom != new_idom) {
-        postorder_dominator[ordered_block].dom = new_idom;
+      if (postorder_dominator[ordered_block->id()].dom != new_idom) {
+        postorder_dominator[ordered_block->id()].dom = new_idom;
         changed = true;
       }
     }
@@ -2321,6 +2499,34 @@ ControlFlowGraph::immediate_dominators() const {
   return postorder_dominator;
 }
 
+BlockAdjacency ControlFlowGraph::adjacency() const {
+  BlockAdjacency adj;
+  size_t bound = block_id_bound();
+  adj.succ_offsets.assign(bound + 1, 0);
+  adj.pred_offsets.assign(bound + 1, 0);
+  for (const auto& entry : m_blocks) {
+    adj.succ_offsets[entry.first + 1] = entry.second->succs().size();
+    adj.pred_offsets[entry.first + 1] = entry.second->preds().size();
+  }
+  for (size_t i = 0; i < bound; ++i) {
+    adj.succ_offsets[i + 1] += adj.succ_offsets[i];
+    adj.pred_offsets[i + 1] += adj.pred_offsets[i];
+  }
+  adj.succ_ids.reserve(adj.succ_offsets[bound]);
+  adj.pred_ids.reserve(adj.pred_offsets[bound]);
+  for (const auto& entry : m_blocks) {
+    for (const Edge* e : entry.second->succs()) {
+      adj.succ_ids.push_back(e->target()->id());
+    }
+  }
+  for (const auto& entry : m_blocks) {
+    for (const Edge* e : entry.second->preds()) {
+      adj.pred_ids.push_back(e->src()->id());
+    }
+  }
+  return adj;
+}
+
 ControlFlowGraph::EdgeSet ControlFlowGraph::remove_succ_edges(Block* b,
                                                               bool cleanup) {
   return remove_succ_edge_if(b, [](const Edge*) { return true; }, cleanup);
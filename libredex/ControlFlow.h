@@ -9,13 +9,16 @@
 
 #include <boost/dynamic_bitset.hpp>
 #include <boost/optional/optional.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <boost/range/sub_range.hpp>
+#include <memory>
 #include <type_traits>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "IRCode.h"
+#include "WeakTopologicalOrdering.h"
 
 /**
  * A Control Flow Graph is a directed graph of Basic Blocks.
@@ -179,6 +182,166 @@ std::ostream& operator<<(std::ostream& os, const Edge& e);
 
 using BlockId = size_t;
 
+/*
+ * Blocks indexed by id: a vector with a null slot for each id whose block was
+ * removed. It keeps the interface of the std::map<BlockId, Block*> it
+ * replaced -- iteration visits (id, block) pairs in id order -- but looking a
+ * block up by id is an index instead of a tree walk. The vector never has
+ * trailing null slots, so its size is one past the largest id in use.
+ */
+class DenseBlockMap {
+ public:
+  using value_type = std::pair<BlockId, Block*>;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = DenseBlockMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = value_type;
+
+    // Lets `it->second` work even though the pairs are built on the fly.
+    struct pointer {
+      value_type pair;
+      const value_type* operator->() const { return &pair; }
+    };
+
+    const_iterator() = default;
+
+    value_type operator*() const {
+      return value_type(m_index, (*m_slots)[m_index]);
+    }
+    pointer operator->() const { return pointer{**this}; }
+
+    const_iterator& operator++() {
+      ++m_index;
+      skip_empty();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto result = *this;
+      ++(*this);
+      return result;
+    }
+
+    // An iterator stays valid while blocks are added or removed elsewhere in
+    // the map; any iterator that has run off the end equals end().
+    bool operator==(const const_iterator& that) const {
+      return at_end() == that.at_end() &&
+             (at_end() || m_index == that.m_index);
+    }
+    bool operator!=(const const_iterator& that) const {
+      return !(*this == that);
+    }
+
+   private:
+    friend class DenseBlockMap;
+    const_iterator(const std::vector<Block*>* slots, BlockId index)
+        : m_slots(slots), m_index(index) {
+      skip_empty();
+    }
+    bool at_end() const {
+      return m_slots == nullptr || m_index >= m_slots->size();
+    }
+    void skip_empty() {
+      while (m_index < m_slots->size() && (*m_slots)[m_index] == nullptr) {
+        ++m_index;
+      }
+    }
+
+    const std::vector<Block*>* m_slots{nullptr};
+    BlockId m_index{0};
+  };
+  using iterator = const_iterator;
+
+  const_iterator begin() const { return const_iterator(&m_slots, 0); }
+  const_iterator end() const {
+    return const_iterator(&m_slots, m_slots.size());
+  }
+  const_iterator find(BlockId id) const {
+    return count(id) ? const_iterator(&m_slots, id) : end();
+  }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  // One past the largest id in use.
+  BlockId id_bound() const { return m_slots.size(); }
+
+  size_t count(BlockId id) const {
+    return id < m_slots.size() && m_slots[id] != nullptr;
+  }
+  Block* at(BlockId id) const {
+    always_assert_log(count(id), "No block with id %zu", id);
+    return m_slots[id];
+  }
+
+  void emplace(BlockId id, Block* block) {
+    if (id >= m_slots.size()) {
+      m_slots.resize(id + 1, nullptr);
+    }
+    always_assert_log(m_slots[id] == nullptr, "Block id %zu is in use", id);
+    m_slots[id] = block;
+    ++m_size;
+    ++m_version;
+  }
+
+  size_t erase(BlockId id) {
+    if (!count(id)) {
+      return 0;
+    }
+    m_slots[id] = nullptr;
+    --m_size;
+    ++m_version;
+    while (!m_slots.empty() && m_slots.back() == nullptr) {
+      m_slots.pop_back();
+    }
+    return 1;
+  }
+  void clear() {
+    m_slots.clear();
+    m_size = 0;
+    ++m_version;
+  }
+  const_iterator erase(const_iterator it) {
+    BlockId id = it.m_index;
+    erase(id);
+    return const_iterator(&m_slots, id + 1);
+  }
+
+ private:
+  std::vector<Block*> m_slots;
+  size_t m_size{0};
+  // Bumped whenever a block is added or removed.
+  size_t m_version{0};
+
+ public:
+  size_t version() const { return m_version; }
+};
+
+/*
+ * A snapshot of the edges of a CFG in compressed sparse row form, indexed by
+ * block id: the successors of block `b` are
+ * succ_ids[succ_offsets[b]] .. succ_ids[succ_offsets[b + 1] - 1], and likewise
+ * for predecessors, with one entry per edge. Ids without a block have no
+ * edges. The snapshot does not follow later changes to the CFG.
+ */
+struct BlockAdjacency {
+  std::vector<uint32_t> succ_offsets;
+  std::vector<uint32_t> succ_ids;
+  std::vector<uint32_t> pred_offsets;
+  std::vector<uint32_t> pred_ids;
+
+  using Range = boost::iterator_range<const uint32_t*>;
+  Range succs(BlockId id) const {
+    return Range(succ_ids.data() + succ_offsets[id],
+                 succ_ids.data() + succ_offsets[id + 1]);
+  }
+  Range preds(BlockId id) const {
+    return Range(pred_ids.data() + pred_offsets[id],
+                 pred_ids.data() + pred_offsets[id + 1]);
+  }
+};
+
 template <bool is_const>
 class InstructionIteratorImpl;
 using InstructionIterator = InstructionIteratorImpl</* is_const */ false>;
@@ -332,8 +495,8 @@ class Block final {
 };
 
 struct DominatorInfo {
-  Block* dom;
-  size_t postorder;
+  Block* dom{nullptr};
+  size_t postorder{0};
 };
 
 class ControlFlowGraph {
@@ -385,8 +548,14 @@ class ControlFlowGraph {
 
   Block* entry_block() const { return m_entry_block; }
   Block* exit_block() const { return m_exit_block; }
-  void set_entry_block(Block* b) { m_entry_block = b; }
-  void set_exit_block(Block* b) { m_exit_block = b; }
+  void set_entry_block(Block* b) {
+    m_entry_block = b;
+    ++m_edge_version;
+  }
+  void set_exit_block(Block* b) {
+    m_exit_block = b;
+    ++m_edge_version;
+  }
 
   /*
    * If there is a single method exit point, this returns a vector holding the
@@ -417,6 +586,7 @@ class ControlFlowGraph {
   }
 
   void add_edge(Edge* e) {
+    ++m_edge_version;
     m_edges.insert(e);
     e->src()->m_succs.emplace_back(e);
     e->target()->m_preds.emplace_back(e);
@@ -647,19 +817,57 @@ class ControlFlowGraph {
   std::ostream& write_dot_format(std::ostream&) const;
 
   // Find a common dominator block that is closest to both block.
-  Block* idom_intersect(
-      const std::unordered_map<Block*, DominatorInfo>& postorder_dominator,
-      Block* block1,
-      Block* block2) const;
+  Block* idom_intersect(const std::vector<DominatorInfo>& postorder_dominator,
+                        Block* block1,
+                        Block* block2) const;
+
+  // Finding immediate dominator for each blocks in ControlFlowGraph. The
+  // result is indexed by block id; ids without a block map to a null dom.
+  std::vector<DominatorInfo> immediate_dominators() const;
+
+  /*
+   * Changes whenever a block or an edge is added or removed, or the entry or
+   * exit block is replaced. Instruction edits that leave the edges alone do
+   * not change it.
+   */
+  size_t structure_version() const {
+    return m_blocks.version() + m_edge_version;
+  }
 
-  // Finding immediate dominator for each blocks in ControlFlowGraph.
-  std::unordered_map<Block*, DominatorInfo> immediate_dominators() const;
+  /*
+   * The weak topological ordering of the blocks reachable from the entry
+   * block, following successor edges, and the one of the blocks that reach
+   * the exit block, following predecessor edges. Like the post orders and
+   * the dominators, they are computed once per structure_version() and
+   * shared by every analysis of this CFG. The fixpoint iterators pick them
+   * up through GraphInterface. Not thread-safe, like the rest of the CFG.
+   */
+  std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>> wto() const;
+  std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>> reverse_wto()
+      const;
+
+  /*
+   * Where get_liveness() of service/dataflow/Liveness.h keeps the liveness of
+   * this CFG. It is emptied along with the structures above, but the CFG
+   * does not see instruction edits, so its user has to check what it finds
+   * against the instructions itself.
+   */
+  std::shared_ptr<const void>& liveness_slot() const {
+    return derived_structures().liveness;
+  }
 
   // Do writes to this CFG propagate back to IR and Dex code?
   bool editable() const { return m_editable; }
 
   size_t num_blocks() const { return m_blocks.size(); }
 
+  // One past the largest block id, for analyses that keep per-block state in
+  // vectors indexed by id.
+  BlockId block_id_bound() const { return m_blocks.id_bound(); }
+
+  // The edges of the graph as it is now, in compressed sparse row form.
+  BlockAdjacency adjacency() const;
+
   /*
    * Traverse the graph, starting from the entry node. Return a bitset with IDs
    * of reachable blocks having 1 and IDs of unreachable blocks (or unused IDs)
@@ -730,12 +938,18 @@ class ControlFlowGraph {
   // choose an order of blocks for output
   std::vector<Block*> order();
 
+  // How hot each block is, by its position in blocks(), e.g. from the block
+  // heat of an instrumentation profile. With a heat, order() lays out the hot
+  // paths as fall throughs and the cold blocks last, see
+  // profile_guided_order.
+  void set_block_heat(const std::vector<uint64_t>& heat);
+
  private:
   using BranchToTargets =
       std::unordered_map<MethodItemEntry*, std::vector<Block*>>;
   using TryEnds = std::vector<std::pair<TryEntry*, Block*>>;
   using TryCatches = std::unordered_map<CatchEntry*, Block*>;
-  using Blocks = std::map<BlockId, Block*>;
+  using Blocks = DenseBlockMap;
   friend class InstructionIteratorImpl<false>;
   friend class InstructionIteratorImpl<true>;
   friend class CFGInliner;
@@ -769,10 +983,15 @@ class ControlFlowGraph {
 
   // helper functions
   using Chain = std::vector<Block*>;
+  // Chains the blocks that must follow their goto predecessor, and also the
+  // ones in the same try as it unless `required_only`.
   void build_chains(std::vector<std::unique_ptr<Chain>>* chains,
-                    std::unordered_map<Block*, Chain*>* block_to_chain);
+                    std::unordered_map<Block*, Chain*>* block_to_chain,
+                    bool required_only = false);
   std::vector<Block*> wto_chains(
       const std::unordered_map<Block*, Chain*>& block_to_chain);
+  std::vector<Block*> profile_guided_order(
+      std::unordered_map<Block*, Chain*>* block_to_chain);
 
   // Materialize target instructions and gotos corresponding to control-flow
   // edges. Used while turning back into a linear representation.
@@ -847,6 +1066,7 @@ class ControlFlowGraph {
                          Block* target,
                          EdgePredicate predicate,
                          bool cleanup = true) {
+    ++m_edge_version;
     auto& forward_edges = source->m_succs;
     EdgeSet to_remove;
     forward_edges.erase(
@@ -879,6 +1099,7 @@ class ControlFlowGraph {
   EdgeSet remove_pred_edge_if(Block* block,
                               EdgePredicate predicate,
                               bool cleanup = true) {
+    ++m_edge_version;
     auto& reverse_edges = block->m_preds;
 
     std::vector<Block*> source_blocks;
@@ -915,6 +1136,7 @@ class ControlFlowGraph {
   EdgeSet remove_succ_edge_if(Block* block,
                               EdgePredicate predicate,
                               bool cleanup = true) {
+    ++m_edge_version;
     auto& forward_edges = block->m_succs;
 
     std::vector<Block*> target_blocks;
@@ -973,14 +1195,32 @@ class ControlFlowGraph {
 
   std::vector<Block*> blocks_post_helper(bool reverse) const;
 
+  // What is derived from the shape of the graph, for the structure_version()
+  // it was computed at. Each part is computed on first use.
+  struct DerivedStructures {
+    size_t version;
+    boost::optional<std::vector<Block*>> postorder;
+    boost::optional<std::vector<DominatorInfo>> immediate_dominators;
+    std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>> wto;
+    std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>> reverse_wto;
+    std::shared_ptr<const void> liveness;
+  };
+  DerivedStructures& derived_structures() const;
+  std::vector<DominatorInfo> compute_immediate_dominators() const;
+
   // The memory of all blocks and edges in this graph are owned here
   Blocks m_blocks;
   EdgeSet m_edges;
+  // Bumped whenever an edge is added or removed, and whenever the entry or
+  // exit block is replaced.
+  size_t m_edge_version{0};
+  mutable std::unique_ptr<DerivedStructures> m_derived;
 
   uint16_t m_registers_size{0};
   Block* m_entry_block{nullptr};
   Block* m_exit_block{nullptr};
   bool m_editable{true};
+  std::unordered_map<BlockId, uint64_t> m_block_heat;
 };
 
 // A static-method-only API for use with the monotonic fixpoint iterator.
@@ -1004,6 +1244,23 @@ class GraphInterface {
   }
   static NodeId source(const Graph&, const EdgeId& e) { return e->src(); }
   static NodeId target(const Graph&, const EdgeId& e) { return e->target(); }
+
+  // So that every analysis of a CFG shares its weak topological orderings.
+  static std::shared_ptr<const sparta::WeakTopologicalOrdering<NodeId>> wto(
+      const Graph& graph) {
+    return graph.wto();
+  }
+  static std::shared_ptr<const sparta::WeakTopologicalOrdering<NodeId>>
+  reverse_wto(const Graph& graph) {
+    return graph.reverse_wto();
+  }
+
+  // Block ids are dense, so the fixpoint iterator keeps its states in
+  // vectors.
+  static size_t node_index(const Graph&, const NodeId& b) { return b->id(); }
+  static size_t node_index_bound(const Graph& graph) {
+    return graph.block_id_bound();
+  }
 };
 
 template <bool is_const>
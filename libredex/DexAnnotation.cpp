@@ -89,6 +89,7 @@ void DexEncodedValueAnnotation::gather_methods(
 }
 
 void DexAnnotation::gather_strings(std::vector<DexString*>& lstring) const {
+  ensure_elems();
   for (auto const& anno : m_anno_elems) {
     lstring.push_back(anno.string);
     anno.encoded_value->gather_strings(lstring);
@@ -96,6 +97,7 @@ void DexAnnotation::gather_strings(std::vector<DexString*>& lstring) const {
 }
 
 void DexAnnotation::gather_types(std::vector<DexType*>& ltype) const {
+  ensure_elems();
   ltype.push_back(m_type);
   for (auto const& anno : m_anno_elems) {
     anno.encoded_value->gather_types(ltype);
@@ -103,12 +105,14 @@ void DexAnnotation::gather_types(std::vector<DexType*>& ltype) const {
 }
 
 void DexAnnotation::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  ensure_elems();
   for (auto const& anno : m_anno_elems) {
     anno.encoded_value->gather_fields(lfield);
   }
 }
 
 void DexAnnotation::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  ensure_elems();
   for (auto const& anno : m_anno_elems) {
     anno.encoded_value->gather_methods(lmethod);
   }
@@ -479,18 +483,36 @@ DexAnnotation* DexAnnotation::get_annotation(DexIdx* idx, uint32_t anno_off) {
   uint8_t viz = *encdata++;
   always_assert_log(viz <= DAV_SYSTEM, "Invalid annotation visibility %d", viz);
   uint32_t tidx = read_uleb128(&encdata);
+  const uint8_t* elems = encdata;
   uint32_t count = read_uleb128(&encdata);
   DexType* type = idx->get_typeidx(tidx);
   always_assert_log(type != nullptr, "Invalid annotation type");
   DexAnnotation* anno = new DexAnnotation(type, (DexAnnotationVisibility)viz);
-  for (uint32_t i = 0; i < count; i++) {
-    DexAnnotationElement dae = get_annotation_element(idx, encdata);
-    anno->m_anno_elems.push_back(dae);
+  if (count > 0) {
+    // The DexLoader hands `idx` to the RedexContext, with all its refs
+    // resolved, so decoding later yields the same elements as decoding now.
+    anno->m_idx = idx;
+    anno->m_pending_elems.store(elems, std::memory_order_relaxed);
   }
   return anno;
 }
 
+void DexAnnotation::decode_pending_elems() const {
+  // Each annotation decodes at most once; threads looking at other
+  // annotations never wait on it. The refs of m_idx are all resolved, so
+  // reading them from several threads is safe.
+  std::call_once(m_decode_once, [this] {
+    const uint8_t* encdata = m_pending_elems.load(std::memory_order_relaxed);
+    uint32_t count = read_uleb128(&encdata);
+    for (uint32_t i = 0; i < count; i++) {
+      m_anno_elems.push_back(get_annotation_element(m_idx, encdata));
+    }
+    m_pending_elems.store(nullptr, std::memory_order_release);
+  });
+}
+
 void DexAnnotation::add_element(const char* key, DexEncodedValue* value) {
+  ensure_elems();
   m_anno_elems.emplace_back(DexString::make_string(key), value);
 }
 
@@ -631,8 +653,8 @@ void DexAnnotationDirectory::gather_annotations(
 void DexAnnotationDirectory::vencode(
     DexOutputIdx* dodx,
     std::vector<uint32_t>& annodirout,
-    std::map<ParamAnnotations*, uint32_t>& xrefmap,
-    std::map<DexAnnotationSet*, uint32_t>& asetmap) {
+    const std::unordered_map<ParamAnnotations*, uint32_t>& xrefmap,
+    const std::unordered_map<DexAnnotationSet*, uint32_t>& asetmap) {
   uint32_t classoff = 0;
   uint32_t cntaf = 0;
   uint32_t cntam = 0;
@@ -641,7 +663,7 @@ void DexAnnotationDirectory::vencode(
     always_assert_log(asetmap.count(m_class) != 0,
                       "Uninitialized aset %p '%s'",
                       m_class, show(m_class).c_str());
-    classoff = asetmap[m_class];
+    classoff = asetmap.at(m_class);
   }
   if (m_field) {
     cntaf = (uint32_t) m_field->size();
@@ -668,7 +690,7 @@ void DexAnnotationDirectory::vencode(
       always_assert_log(asetmap.count(das) != 0,
                         "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method) {
@@ -681,7 +703,7 @@ void DexAnnotationDirectory::vencode(
       always_assert_log(asetmap.count(das) != 0,
                         "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method_param) {
@@ -693,7 +715,7 @@ void DexAnnotationDirectory::vencode(
       annodirout.push_back(dodx->methodidx(p.first));
       always_assert_log(
           xrefmap.count(pa) != 0, "Uninitialized ParamAnnotations %p", pa);
-      annodirout.push_back(xrefmap[pa]);
+      annodirout.push_back(xrefmap.at(pa));
     }
   }
 }
@@ -704,9 +726,10 @@ void DexAnnotationSet::gather_annotations(std::vector<DexAnnotation*>& list) {
   }
 }
 
-void DexAnnotationSet::vencode(DexOutputIdx* dodx,
-                               std::vector<uint32_t>& asetout,
-                               std::map<DexAnnotation*, uint32_t>& annoout) {
+void DexAnnotationSet::vencode(
+    DexOutputIdx* dodx,
+    std::vector<uint32_t>& asetout,
+    const std::unordered_map<DexAnnotation*, uint32_t>& annoout) {
   asetout.push_back((uint32_t)m_annotations.size());
   std::sort(
       m_annotations.begin(), m_annotations.end(), type_annotation_compare);
@@ -715,7 +738,7 @@ void DexAnnotationSet::vencode(DexOutputIdx* dodx,
                       "Uninitialized annotation %p '%s', bailing\n",
                       anno,
                       show(anno).c_str());
-    asetout.push_back(annoout[anno]);
+    asetout.push_back(annoout.at(anno));
   }
 }
 
@@ -728,6 +751,7 @@ static void uleb_append(std::vector<uint8_t>& bytes, uint32_t v) {
 }
 
 void DexAnnotation::vencode(DexOutputIdx* dodx, std::vector<uint8_t>& bytes) {
+  ensure_elems();
   bytes.push_back(m_viz);
   uleb_append(bytes, dodx->typeidx(m_type));
   uleb_append(bytes, (uint32_t) m_anno_elems.size());
@@ -7,11 +7,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <boost/functional/hash.hpp>
 #include <deque>
 #include <list>
 #include <map>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "Gatherable.h"
@@ -331,13 +334,31 @@ class DexEncodedValueAnnotation : public DexEncodedValue {
 };
 
 class DexAnnotation : public Gatherable {
-  EncodedAnnotations m_anno_elems;
+  mutable EncodedAnnotations m_anno_elems;
   DexType* m_type;
   DexAnnotationVisibility m_viz;
+  // The elements of an annotation loaded from a dex are only decoded from the
+  // mapped file when they are first looked at, so that annotations that get
+  // removed before that never cost more than their type and visibility.
+  DexIdx* m_idx{nullptr};
+  mutable std::atomic<const uint8_t*> m_pending_elems{nullptr};
+  mutable std::once_flag m_decode_once;
+
+  void decode_pending_elems() const;
+  void ensure_elems() const {
+    if (m_pending_elems.load(std::memory_order_acquire) != nullptr) {
+      decode_pending_elems();
+    }
+  }
 
  public:
   DexAnnotation(DexType* type, DexAnnotationVisibility viz)
       : Gatherable(), m_type(type), m_viz(viz) {}
+  DexAnnotation(const DexAnnotation& that)
+      : Gatherable(),
+        m_anno_elems(that.anno_elems()),
+        m_type(that.m_type),
+        m_viz(that.m_viz) {}
 
   static DexAnnotation* get_annotation(DexIdx* idx, uint32_t anno_off);
   void gather_types(std::vector<DexType*>& ltype) const override;
@@ -345,7 +366,10 @@ class DexAnnotation : public Gatherable {
   void gather_methods(std::vector<DexMethodRef*>& lmethod) const override;
   void gather_strings(std::vector<DexString*>& lstring) const override;
 
-  const EncodedAnnotations& anno_elems() const { return m_anno_elems; }
+  const EncodedAnnotations& anno_elems() const {
+    ensure_elems();
+    return m_anno_elems;
+  }
   void set_type(DexType* type) { m_type = type; }
   DexType* type() const { return m_type; }
   DexAnnotationVisibility viz() const { return m_viz; }
@@ -408,7 +432,7 @@ class DexAnnotationSet : public Gatherable {
   }
   void vencode(DexOutputIdx* dodx,
                std::vector<uint32_t>& asetout,
-               std::map<DexAnnotation*, uint32_t>& annoout);
+               const std::unordered_map<DexAnnotation*, uint32_t>& annoout);
   void gather_annotations(std::vector<DexAnnotation*>& alist);
 };
 
@@ -478,8 +502,8 @@ class DexAnnotationDirectory {
   void gather_xrefs(std::vector<ParamAnnotations*>& xrefs);
   void vencode(DexOutputIdx* dodx,
                std::vector<uint32_t>& annodirout,
-               std::map<ParamAnnotations*, uint32_t>& xrefmap,
-               std::map<DexAnnotationSet*, uint32_t>& asetmap);
+               const std::unordered_map<ParamAnnotations*, uint32_t>& xrefmap,
+               const std::unordered_map<DexAnnotationSet*, uint32_t>& asetmap);
 
   friend std::string show(const DexAnnotationDirectory*);
 };
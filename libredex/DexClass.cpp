@@ -11,6 +11,7 @@
 #include "DexAccess.h"
 #include "DexDebugInstruction.h"
 #include "DexDefs.h"
+#include "DexHasher.h"
 #include "DexMemberRefs.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
@@ -29,6 +30,18 @@
 #include <unordered_map>
 
 
+const std::string& DexString::materialize() const {
+  auto fresh = new std::string(m_data, m_size);
+  std::string* expected = nullptr;
+  if (m_str.compare_exchange_strong(expected, fresh,
+                                    std::memory_order_acq_rel)) {
+    return *fresh;
+  }
+  // Another thread got there first.
+  delete fresh;
+  return *expected;
+}
+
 uint32_t DexString::length() const {
   if (is_simple()) {
     return size();
@@ -506,12 +519,34 @@ std::string DexMethod::get_fully_deobfuscated_name() const {
   return build_fully_deobfuscated_name(this);
 }
 
+uint64_t DexMethod::get_code_epoch() const {
+  static std::atomic<uint64_t> s_next_code_epoch{1};
+  if (!m_code_unchanged.load(std::memory_order_relaxed)) {
+    // The instructions of an editable CFG are not in the IR list that the
+    // hash walks.
+    bool hashable = m_code == nullptr || !m_code->editable_cfg_built();
+    size_t hash = hashable ? hashing::DexClassHasher::hash_code_of(this) : 0;
+    if (!hashable || !m_code_hashed.load(std::memory_order_relaxed) ||
+        m_code_hash.load(std::memory_order_relaxed) != hash ||
+        m_code_epoch.load(std::memory_order_relaxed) == 0) {
+      m_code_epoch.store(s_next_code_epoch.fetch_add(1),
+                         std::memory_order_relaxed);
+    }
+    m_code_hash.store(hash, std::memory_order_relaxed);
+    m_code_hashed.store(hashable, std::memory_order_relaxed);
+    m_code_unchanged.store(true, std::memory_order_relaxed);
+  }
+  return m_code_epoch.load(std::memory_order_relaxed);
+}
+
 void DexMethod::set_code(std::unique_ptr<IRCode> code) {
+  code_may_change();
   m_code = std::move(code);
 }
 
 void DexMethod::balloon() {
   redex_assert(m_code == nullptr);
+  code_may_change();
   m_code = std::make_unique<IRCode>(this);
   m_dex_code.reset();
 }
@@ -519,6 +554,7 @@ void DexMethod::balloon() {
 void DexMethod::sync() {
   redex_assert(m_dex_code == nullptr);
   m_dex_code = m_code->sync(this);
+  code_may_change();
   m_code.reset();
 }
 
@@ -631,6 +667,7 @@ void DexClass::remove_method(const DexMethod* m) {
     meths.erase(it);
   }
   redex_assert(erased);
+  g_redex->bump_member_epoch();
 }
 
 void DexMethod::become_virtual() {
@@ -656,6 +693,7 @@ void DexMethod::make_concrete(DexAccessFlags access,
                               std::unique_ptr<IRCode> dc,
                               bool is_virtual) {
   m_access = access;
+  code_may_change();
   m_code = std::move(dc);
   m_concrete = true;
   m_virtual = is_virtual;
@@ -668,6 +706,7 @@ void DexMethod::make_concrete(DexAccessFlags access, bool is_virtual) {
 void DexMethod::make_non_concrete() {
   m_access = static_cast<DexAccessFlags>(0);
   m_concrete = false;
+  code_may_change();
   m_code.reset();
   m_virtual = false;
   m_param_anno.clear();
@@ -678,7 +717,8 @@ void DexMethod::make_non_concrete() {
  */
 void DexClass::load_class_data_item(DexIdx* idx,
                                     uint32_t cdi_off,
-                                    DexEncodedValueArray* svalues) {
+                                    DexEncodedValueArray* svalues,
+                                    DeferredDexCode* deferred_code) {
   if (cdi_off == 0) return;
   const uint8_t* encd = idx->get_uleb_data(cdi_off);
   uint32_t sfield_count = read_uleb128(&encd);
@@ -722,9 +762,14 @@ void DexClass::load_class_data_item(DexIdx* idx,
     uint32_t code_off = read_uleb128(&encd);
     // Find method in method index, returns same pointer for same method.
     DexMethod* dm = static_cast<DexMethod*>(idx->get_methodidx(ndex));
-    std::unique_ptr<DexCode> dc = DexCode::get_dex_code(idx, code_off);
-    if (dc && dc->get_debug_item()) {
-      dc->get_debug_item()->bind_positions(dm, m_source_file);
+    std::unique_ptr<DexCode> dc;
+    if (deferred_code != nullptr && code_off != 0) {
+      deferred_code->emplace_back(dm, code_off);
+    } else {
+      dc = DexCode::get_dex_code(idx, code_off);
+      if (dc && dc->get_debug_item()) {
+        dc->get_debug_item()->bind_positions(dm, m_source_file);
+      }
     }
     dm->make_concrete(access_flags, std::move(dc), false);
 
@@ -742,9 +787,14 @@ void DexClass::load_class_data_item(DexIdx* idx,
     uint32_t code_off = read_uleb128(&encd);
     // Find method in method index, returns same pointer for same method.
     DexMethod* dm = static_cast<DexMethod*>(idx->get_methodidx(ndex));
-    auto dc = DexCode::get_dex_code(idx, code_off);
-    if (dc && dc->get_debug_item()) {
-      dc->get_debug_item()->bind_positions(dm, m_source_file);
+    std::unique_ptr<DexCode> dc;
+    if (deferred_code != nullptr && code_off != 0) {
+      deferred_code->emplace_back(dm, code_off);
+    } else {
+      dc = DexCode::get_dex_code(idx, code_off);
+      if (dc && dc->get_debug_item()) {
+        dc->get_debug_item()->bind_positions(dm, m_source_file);
+      }
     }
     dm->make_concrete(access_flags, std::move(dc), true);
 
@@ -757,7 +807,10 @@ void DexClass::load_class_data_item(DexIdx* idx,
   }
 }
 
-std::unique_ptr<IRCode> DexMethod::release_code() { return std::move(m_code); }
+std::unique_ptr<IRCode> DexMethod::release_code() {
+  code_may_change();
+  return std::move(m_code);
+}
 
 void DexClass::add_method(DexMethod* m) {
   always_assert_log(m->is_concrete() || m->is_external(),
@@ -769,6 +822,7 @@ void DexClass::add_method(DexMethod* m) {
   } else {
     insert_sorted(m_dmethods, m, compare_dexmethods);
   }
+  g_redex->bump_member_epoch();
 }
 
 void DexClass::add_field(DexField* f) {
@@ -782,6 +836,7 @@ void DexClass::add_field(DexField* f) {
   } else {
     insert_sorted(m_ifields, f, compare_dexfields);
   }
+  g_redex->bump_member_epoch();
 }
 
 void DexClass::remove_field(const DexField* f) {
@@ -794,6 +849,7 @@ void DexClass::remove_field(const DexField* f) {
     fields.erase(it);
   }
   redex_assert(erase);
+  g_redex->bump_member_epoch();
 }
 
 void DexClass::sort_fields() {
@@ -827,7 +883,7 @@ bool DexClass::has_class_data() const {
 }
 
 int DexClass::encode(DexOutputIdx* dodx,
-                     dexcode_to_offset& dco,
+                     const dexcode_to_offset& dco,
                      uint8_t* output) {
   if (m_sfields.size() == 0 && m_ifields.size() == 0 &&
       m_dmethods.size() == 0 && m_vmethods.size() == 0) {
@@ -876,7 +932,7 @@ int DexClass::encode(DexOutputIdx* dodx,
     encdata = write_uleb128(encdata, m->get_access());
     uint32_t code_off = 0;
     if (m->get_dex_code() != nullptr && dco.count(m->get_dex_code())) {
-      code_off = dco[m->get_dex_code()];
+      code_off = dco.at(m->get_dex_code());
     }
     encdata = write_uleb128(encdata, code_off);
   }
@@ -895,7 +951,7 @@ int DexClass::encode(DexOutputIdx* dodx,
     encdata = write_uleb128(encdata, m->get_access());
     uint32_t code_off = 0;
     if (m->get_dex_code() != nullptr && dco.count(m->get_dex_code())) {
-      code_off = dco[m->get_dex_code()];
+      code_off = dco.at(m->get_dex_code());
     }
     encdata = write_uleb128(encdata, code_off);
   }
@@ -1023,7 +1079,8 @@ DexAnnotationDirectory* DexClass::get_annotation_directory() {
 
 DexClass::DexClass(DexIdx* idx,
                    const dex_class_def* cdef,
-                   const std::string& location)
+                   const std::string& location,
+                   DeferredDexCode* deferred_code)
     : m_access_flags((DexAccessFlags)cdef->access_flags),
       m_super_class(idx->get_typeidx(cdef->super_idx)),
       m_self(idx->get_typeidx(cdef->typeidx)),
@@ -1036,7 +1093,8 @@ DexClass::DexClass(DexIdx* idx,
   load_class_annotations(idx, cdef->annotations_off);
   auto deva = std::unique_ptr<DexEncodedValueArray>(
       load_static_values(idx, cdef->static_values_off));
-  load_class_data_item(idx, cdef->class_data_offset, deva.get());
+  load_class_data_item(idx, cdef->class_data_offset, deva.get(),
+                       deferred_code);
   g_redex->publish_class(this);
 }
 
@@ -1320,6 +1378,92 @@ void IRInstruction::gather_types(std::vector<DexType*>& ltype) const {
   }
 }
 
+namespace {
+
+constexpr size_t kNumStringBuckets = 257;
+constexpr size_t kRadixSortCutoff = 32;
+
+/*
+ * The radix of `s` at `depth`. 0 is past the end of the string, the two-byte
+ * encoding of U+0000 (0xC0 0x80) goes right after it, and every other byte
+ * keeps its order.
+ */
+inline size_t string_radix(const DexString* s, size_t depth) {
+  if (depth >= s->size()) {
+    return 0;
+  }
+  uint8_t byte = s->c_str()[depth];
+  return byte == 0xc0 ? 1 : size_t(byte) + 1;
+}
+
+/*
+ * Whether the byte order of `s` agrees with compare_dexstrings, i.e. it has no
+ * overlong encodings other than 0xC0 0x80 and no four-byte sequences (which
+ * compare_dexstrings rejects).
+ */
+bool has_canonical_encoding(const DexString* s) {
+  if (s->is_simple()) {
+    return true;
+  }
+  auto p = reinterpret_cast<const uint8_t*>(s->c_str());
+  for (; *p != 0; ++p) {
+    if (*p == 0xc1 || *p >= 0xf0 || (*p == 0xc0 && p[1] != 0x80) ||
+        (*p == 0xe0 && p[1] < 0xa0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void radix_sort_dexstrings(std::vector<DexString*>::iterator begin,
+                           std::vector<DexString*>::iterator end,
+                           size_t depth,
+                           std::vector<DexString*>& scratch) {
+  size_t n = end - begin;
+  if (n < kRadixSortCutoff) {
+    // Small buckets are cheaper to finish off with comparisons.
+    std::sort(begin, end, compare_dexstrings);
+    return;
+  }
+  size_t counts[kNumStringBuckets] = {};
+  for (auto it = begin; it != end; ++it) {
+    counts[string_radix(*it, depth)]++;
+  }
+  size_t starts[kNumStringBuckets];
+  size_t offset = 0;
+  for (size_t b = 0; b < kNumStringBuckets; ++b) {
+    starts[b] = offset;
+    offset += counts[b];
+  }
+  scratch.resize(std::max(scratch.size(), n));
+  for (auto it = begin; it != end; ++it) {
+    scratch[starts[string_radix(*it, depth)]++] = *it;
+  }
+  std::copy(scratch.begin(), scratch.begin() + n, begin);
+  // Bucket 0 holds the strings that end at `depth`; there is at most one
+  // since DexStrings are unique.
+  auto bucket_begin = begin + counts[0];
+  for (size_t b = 1; b < kNumStringBuckets; ++b) {
+    auto bucket_end = bucket_begin + counts[b];
+    if (counts[b] > 1) {
+      radix_sort_dexstrings(bucket_begin, bucket_end, depth + 1, scratch);
+    }
+    bucket_begin = bucket_end;
+  }
+}
+
+} // namespace
+
+void sort_dexstrings(std::vector<DexString*>& strings) {
+  if (std::find(strings.begin(), strings.end(), nullptr) != strings.end() ||
+      !std::all_of(strings.begin(), strings.end(), has_canonical_encoding)) {
+    std::sort(strings.begin(), strings.end(), compare_dexstrings);
+    return;
+  }
+  std::vector<DexString*> scratch;
+  radix_sort_dexstrings(strings.begin(), strings.end(), 0, scratch);
+}
+
 void gather_components(std::vector<DexString*>& lstring,
                        std::vector<DexType*>& ltype,
                        std::vector<DexFieldRef*>& lfield,
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -61,17 +62,29 @@ using Scope = std::vector<DexClass*>;
 
 class DexString {
   friend struct RedexContext;
+  friend class StringInterner;
 
-  std::string m_storage;
+  // NUL-terminated MUTF-8 bytes. They live either in the string_data_item of
+  // a mapped dex file that RedexContext keeps open, or in the interner's
+  // arenas; either way they outlive this object and are never freed by it.
+  const char* m_data;
+  uint32_t m_size;
   uint32_t m_utfsize;
+  // See get_id().
+  uint32_t m_id{0};
+  // A std::string copy, only built if someone asks for str().
+  mutable std::atomic<std::string*> m_str{nullptr};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
-  DexString(std::string nstr, uint32_t utfsize) :
-    m_storage(std::move(nstr)), m_utfsize(utfsize) {
-  }
+  DexString(const char* data, uint32_t size, uint32_t utfsize)
+      : m_data(data), m_size(size), m_utfsize(utfsize) {}
+
+  ~DexString() { delete m_str.load(std::memory_order_relaxed); }
+
+  const std::string& materialize() const;
 
  public:
-  uint32_t size() const { return static_cast<uint32_t>(m_storage.size()); }
+  uint32_t size() const { return m_size; }
 
   // UTF-aware length
   uint32_t length() const;
@@ -110,8 +123,18 @@ class DexString {
     return size() == m_utfsize;
   }
 
-  const char* c_str() const { return m_storage.c_str(); }
-  const std::string& str() const { return m_storage; }
+  /*
+   * A number in [0, RedexContext::string_id_bound()) that no other DexString
+   * in this context shares, for indexing vectors and bitsets by string; see
+   * DexIdContainers.h.
+   */
+  uint32_t get_id() const { return m_id; }
+
+  const char* c_str() const { return m_data; }
+  const std::string& str() const {
+    auto str = m_str.load(std::memory_order_acquire);
+    return str != nullptr ? *str : materialize();
+  }
 
   uint32_t get_entry_size() const {
     uint32_t len = uleb128_encoding_size(m_utfsize);
@@ -169,10 +192,24 @@ struct dexstrings_comparator {
   }
 };
 
+/*
+ * Sorts `strings` into compare_dexstrings order, with an MSD radix sort over
+ * the MUTF-8 bytes instead of comparisons. MUTF-8 byte order is UTF-16 code
+ * unit order except for the two-byte encoding of U+0000, which the sort
+ * places first. Lists with non-canonical encodings fall back to std::sort.
+ */
+void sort_dexstrings(std::vector<DexString*>& strings);
+
 class DexType {
   friend struct RedexContext;
 
   DexString* m_name;
+  // The class published for this type, if any. Written once under
+  // RedexContext's type-system lock and read without it, so that
+  // type_class() never has to lock or hash.
+  std::atomic<DexClass*> m_class{nullptr};
+  // See get_id().
+  uint32_t m_id{0};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexType(DexString* dstring) {
@@ -219,6 +256,11 @@ class DexType {
   DexString* get_name() const { return m_name; }
   const char* c_str() const { return get_name()->c_str(); }
   const std::string& str() const { return get_name()->str(); }
+  /*
+   * Dense and unique among the DexTypes of this context; renaming a type
+   * keeps its id. See DexString::get_id().
+   */
+  uint32_t get_id() const { return m_id; }
   DexProto* get_non_overlapping_proto(DexString*, DexProto*);
 };
 
@@ -256,6 +298,8 @@ class DexFieldRef {
   DexFieldSpec m_spec;
   bool m_concrete;
   bool m_external;
+  // See get_id().
+  uint32_t m_id{0};
 
   ~DexFieldRef() {}
   DexFieldRef(DexType* container, DexString* name, DexType* type) {
@@ -276,6 +320,11 @@ class DexFieldRef {
    const char* c_str() const { return get_name()->c_str(); }
    const std::string& str() const { return get_name()->str(); }
    DexType* get_type() const { return m_spec.type; }
+   /*
+    * Dense and unique among the field references of this context; it
+    * survives change() and erase_field(). See DexString::get_id().
+    */
+   uint32_t get_id() const { return m_id; }
 
    void gather_types_shallow(std::vector<DexType*>& ltype) const;
    void gather_strings_shallow(std::vector<DexString*>& lstring) const;
@@ -703,6 +752,8 @@ class DexCode {
     m_insns.reset(new std::vector<DexInstruction*>());
     return *m_insns;
   }
+  // The DexCode owns the instructions, which balloon() frees as it turns
+  // them into IR.
   std::vector<DexInstruction*>& get_instructions() {
     redex_assert(m_insns);
     return *m_insns;
@@ -765,6 +816,8 @@ class DexMethodRef {
   DexMethodSpec m_spec;
   bool m_concrete;
   bool m_external;
+  // See get_id().
+  uint32_t m_id{0};
 
   ~DexMethodRef() {}
   DexMethodRef(DexType* type, DexString* name, DexProto* proto) :
@@ -783,6 +836,11 @@ class DexMethodRef {
    const char* c_str() const { return get_name()->c_str(); }
    const std::string& str() const { return get_name()->str(); }
    DexProto* get_proto() const { return m_spec.proto; }
+   /*
+    * Dense and unique among the method references of this context; it
+    * survives change() and erase_method(). See DexString::get_id().
+    */
+   uint32_t get_id() const { return m_id; }
 
    void gather_types_shallow(std::vector<DexType*>& ltype) const;
    void gather_strings_shallow(std::vector<DexString*>& lstring) const;
@@ -810,6 +868,21 @@ class DexMethod : public DexMethodRef {
   bool m_virtual;
   ParamAnnotations m_param_anno;
   std::string m_deobfuscated_name;
+  // Cleared by anything that may change the code, and set by
+  // get_code_epoch() once it has checked the code.
+  mutable std::atomic<bool> m_code_unchanged{false};
+  mutable std::atomic<uint64_t> m_code_epoch{0};
+  // The hash of the code at m_code_epoch, if it could be hashed.
+  mutable std::atomic<bool> m_code_hashed{false};
+  mutable std::atomic<size_t> m_code_hash{0};
+
+  void code_may_change() {
+    // Checked first so that methods read by many threads at once, e.g.
+    // inlining callees, do not keep bouncing the cache line around.
+    if (m_code_unchanged.load(std::memory_order_relaxed)) {
+      m_code_unchanged.store(false, std::memory_order_relaxed);
+    }
+  }
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexMethod(DexType* type, DexString* name, DexProto* proto);
@@ -921,8 +994,32 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* get_anno_set() { return m_anno; }
   const DexCode* get_dex_code() const { return m_dex_code.get(); }
   DexCode* get_dex_code() { return m_dex_code.get(); }
-  IRCode* get_code() { return m_code.get(); }
+  IRCode* get_code() {
+    code_may_change();
+    return m_code.get();
+  }
   const IRCode* get_code() const { return m_code.get(); }
+  /*
+   * A number that stays the same for as long as the code does not change.
+   * Numbers are never reused, not even by other methods, so anything derived
+   * from the code alone can be cached along with the epoch it was computed
+   * at.
+   *
+   * A non-const access to the code only marks it as possibly changed. The
+   * next call then hashes the code, and hands out a new number if the hash
+   * differs from the one at the current number. Walking the code through the
+   * non-const accessors without changing it keeps the cached results. Code
+   * in an editable CFG is not hashed, so it gets a new number each time.
+   *
+   * The contract for code that mutates: it must not change the code through
+   * an IRCode pointer it got before the epoch was last read. Such a change
+   * is only seen if the non-const get_code() or set_code() is called again
+   * before the next read. Keeping an IRCode pointer for the span of one
+   * transformation is fine, as long as nothing reads the epoch of that
+   * method in the middle of it. Reads must not race with changes to the
+   * code.
+   */
+  uint64_t get_code_epoch() const;
   std::unique_ptr<IRCode> release_code();
   bool is_virtual() const { return m_virtual; }
   DexAccessFlags get_access() const {
@@ -1043,6 +1140,9 @@ class DexMethod : public DexMethodRef {
    *
    * Most operations can and should use IRCode. Optimizations should never
    * have to call sync().
+   *
+   * balloon() frees the DexInstructions of the DexCode as it translates them,
+   * and then drops the DexCode.
    */
   void balloon();
   void sync();
@@ -1050,6 +1150,9 @@ class DexMethod : public DexMethodRef {
 
 using dexcode_to_offset = std::unordered_map<DexCode*, uint32_t>;
 
+// Methods paired with the offsets of code items not decoded yet.
+using DeferredDexCode = std::vector<std::pair<DexMethod*, uint32_t>>;
+
 class DexClass {
  private:
   DexAccessFlags m_access_flags;
@@ -1071,13 +1174,22 @@ class DexClass {
   void load_class_annotations(DexIdx* idx, uint32_t anno_off);
   void load_class_data_item(DexIdx* idx,
                             uint32_t cdi_off,
-                            DexEncodedValueArray* svalues);
+                            DexEncodedValueArray* svalues,
+                            DeferredDexCode* deferred_code);
 
   friend struct ClassCreator;
 
  public:
   ReferencedState rstate;
-  DexClass(DexIdx* idx, const dex_class_def* cdef, const std::string& location);
+  /*
+   * If `deferred_code` is non-null, methods are left without code and their
+   * code item offsets appended to it instead; the caller must decode and set
+   * them before anything else looks at the class.
+   */
+  DexClass(DexIdx* idx,
+           const dex_class_def* cdef,
+           const std::string& location,
+           DeferredDexCode* deferred_code = nullptr);
 
  public:
   const std::vector<DexMethod*>& get_dmethods() const { return m_dmethods; }
@@ -1175,6 +1287,7 @@ class DexClass {
     always_assert_log(
         !m_external, "Unexpected external class %s\n", SHOW(m_self));
     m_super_class = super_class;
+    g_redex->bump_member_epoch();
   }
 
   void combine_annotations_with(DexClass* other) {
@@ -1192,6 +1305,7 @@ class DexClass {
     always_assert_log(!m_external,
         "Unexpected external class %s\n", SHOW(m_self));
     m_interfaces = intfs;
+    g_redex->bump_member_epoch();
   }
 
   void clear_annotations() {
@@ -1201,7 +1315,9 @@ class DexClass {
   /* Encodes class_data_item, returns size in bytes.  No
    * alignment requirements on *output
    */
-  int encode(DexOutputIdx* dodx, dexcode_to_offset& dco, uint8_t* output);
+  int encode(DexOutputIdx* dodx,
+             const dexcode_to_offset& dco,
+             uint8_t* output);
 
   void gather_types(std::vector<DexType*>& ltype) const;
   void gather_strings(std::vector<DexString*>& lstring,
@@ -7,6 +7,7 @@
 
 #include "DexHasher.h"
 
+#include "ConcurrentContainers.h"
 #include "DexAccess.h"
 #include "DexClass.h"
 #include "DexUtil.h"
@@ -17,6 +18,23 @@
 
 namespace hashing {
 
+namespace {
+
+struct CachedCodeHash {
+  const IRCode* code;
+  uint64_t code_epoch;
+  size_t rename_epoch;
+  size_t code_hash;
+  size_t registers_hash;
+};
+
+ConcurrentMap<const DexMethod*, CachedCodeHash>& code_hash_cache() {
+  static auto* cache = new ConcurrentMap<const DexMethod*, CachedCodeHash>();
+  return *cache;
+}
+
+} // namespace
+
 std::string hash_to_string(size_t hash) {
   std::ostringstream result;
   result << std::hex << std::setfill('0') << std::setw(sizeof(size_t) * 2)
@@ -24,6 +42,17 @@ std::string hash_to_string(size_t hash) {
   return result.str();
 }
 
+size_t hash_dex_classes(const DexClasses& classes) {
+  size_t hash = 0;
+  for (auto cls : classes) {
+    auto class_hash = DexClassHasher(cls).run();
+    boost::hash_combine(hash, class_hash.registers_hash);
+    boost::hash_combine(hash, class_hash.code_hash);
+    boost::hash_combine(hash, class_hash.signature_hash);
+  }
+  return hash;
+}
+
 DexHash DexScopeHasher::run() {
   std::unordered_map<DexClass*, size_t> class_indices;
   walk::classes(m_scope, [&](DexClass* cls) {
@@ -33,7 +62,7 @@ DexHash DexScopeHasher::run() {
   std::vector<size_t> class_code_hashes(class_indices.size());
   std::vector<size_t> class_signature_hashes(class_indices.size());
   walk::parallel::classes(m_scope, [&](DexClass* cls) {
-    DexClassHasher class_hasher(cls);
+    DexClassHasher class_hasher(cls, m_cache_code_hashes);
     DexHash class_hash = class_hasher.run();
     auto index = class_indices.at(cls);
     class_registers_hashes.at(index) = class_hash.registers_hash;
@@ -131,6 +160,9 @@ void DexClassHasher::hash(const IRCode* c) {
   };
 
   hash(c->get_registers_size());
+  // The positions and debug opcodes are in the IR, but whether the method
+  // has debug info at all is not.
+  hash(c->get_debug_item() != nullptr);
   for (const MethodItemEntry& mie : *c) {
     hash((uint8_t)mie.type);
     switch (mie.type) {
@@ -169,6 +201,48 @@ void DexClassHasher::hash(const IRCode* c) {
   m_hash = old_hash;
 }
 
+size_t DexClassHasher::hash_code_of(const DexMethod* method) {
+  DexClassHasher hasher(nullptr);
+  hasher.hash(method->get_code());
+  size_t seed = hasher.m_code_hash;
+  boost::hash_combine(seed, hasher.m_registers_hash);
+  return seed;
+}
+
+void DexClassHasher::hash_code(const DexMethod* m) {
+  const auto* code = m->get_code();
+  if (!code) {
+    return;
+  }
+
+  // A method's share of the code and register hashes only depends on its own
+  // code, so that it can be cached.
+  CachedCodeHash entry{nullptr, 0, 0, 0, 0};
+  uint64_t code_epoch = 0;
+  auto epoch = g_redex->get_rename_epoch();
+  if (m_cache_code_hashes) {
+    code_epoch = m->get_code_epoch();
+    entry = code_hash_cache().get(m, entry);
+  }
+  if (entry.code != code || entry.code_epoch != code_epoch ||
+      entry.rename_epoch != epoch) {
+    auto old_code_hash = m_code_hash;
+    auto old_registers_hash = m_registers_hash;
+    m_code_hash = 0;
+    m_registers_hash = 0;
+    hash(code);
+    entry = CachedCodeHash{
+        code, code_epoch, epoch, m_code_hash, m_registers_hash};
+    m_code_hash = old_code_hash;
+    m_registers_hash = old_registers_hash;
+    if (m_cache_code_hashes) {
+      code_hash_cache().insert_or_assign(std::make_pair(m, entry));
+    }
+  }
+  boost::hash_combine(m_code_hash, entry.code_hash);
+  boost::hash_combine(m_registers_hash, entry.registers_hash);
+}
+
 void DexClassHasher::hash(const DexProto* p) {
   hash(p->get_rtype());
   hash(p->get_args());
@@ -189,7 +263,7 @@ void DexClassHasher::hash(const DexMethod* m) {
   hash(m->get_access());
   hash(m->get_deobfuscated_name());
   hash(m->get_param_anno());
-  hash(m->get_code());
+  hash_code(m);
 }
 
 void DexClassHasher::hash(const DexFieldRef* f) {
@@ -297,6 +371,9 @@ DexHash DexClassHasher::run() {
     hash(m_cls->get_super_class());
   }
   hash(m_cls->get_interfaces());
+  if (m_cls->get_source_file()) {
+    hash(m_cls->get_source_file());
+  }
   hash(m_cls->get_anno_set());
 
   TRACE(HASHER, 3, "[hasher] === dmethods: %zu",
@@ -29,27 +29,56 @@ namespace hashing {
 
 std::string hash_to_string(size_t hash);
 
+/*
+ * A hash of `classes`, in order, that covers everything they are written out
+ * with: if it is the same after the passes as when the classes were loaded,
+ * their dex can be copied to the output as it was.
+ */
+size_t hash_dex_classes(const DexClasses& classes);
+
 struct DexHash {
   size_t registers_hash;
   size_t code_hash;
   size_t signature_hash;
 };
 
+/*
+ * With `cache_code_hashes`, the hash of each method's code is kept from one
+ * run to the next, and is only recomputed for methods whose code may have
+ * changed in between: those whose code epoch moved (see
+ * DexMethod::get_code_epoch), and all of them once anything was renamed (see
+ * RedexContext::get_rename_epoch). Code is what dominates the cost of
+ * hashing, so hashing after a pass becomes proportional to what the pass
+ * looked at rather than to the whole scope.
+ *
+ * The cache cannot see code that is mutated through an IRCode pointer kept
+ * from before the last hash, so it is opt-in.
+ */
 class DexScopeHasher final {
  public:
-  DexScopeHasher(const Scope& scope) : m_scope(scope) {}
+  explicit DexScopeHasher(const Scope& scope, bool cache_code_hashes = false)
+      : m_scope(scope), m_cache_code_hashes(cache_code_hashes) {}
   DexHash run();
 
  private:
   const Scope& m_scope;
+  bool m_cache_code_hashes;
 };
 
 class DexClassHasher final {
  public:
-  DexClassHasher(DexClass* cls) : m_cls(cls) {}
+  explicit DexClassHasher(DexClass* cls, bool cache_code_hashes = false)
+      : m_cls(cls), m_cache_code_hashes(cache_code_hashes) {}
   DexHash run();
 
+  /*
+   * The hash of the code and registers of `method` alone, or 0 if it has no
+   * code.
+   */
+  static size_t hash_code_of(const DexMethod* method);
+
  private:
+  void hash_code(const DexMethod* m);
   void hash(const std::string& str);
   void hash(int value);
   void hash(uint64_t value);
@@ -81,6 +110,13 @@ class DexClassHasher final {
     }
   }
   template <class T>
+  void hash(const boost::iterator_range<T>& l) {
+    hash((uint64_t)l.size());
+    for (const auto& elem : l) {
+      hash(elem);
+    }
+  }
+  template <class T>
   void hash(const std::deque<T>& l) {
     hash((uint64_t)l.size());
     for (const auto& elem : l) {
@@ -96,6 +132,7 @@ class DexClassHasher final {
     }
   }
   DexClass* m_cls;
+  bool m_cache_code_hashes;
   size_t m_hash{0};
   size_t m_code_hash{0};
   size_t m_registers_hash{0};
@@ -0,0 +1,309 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ConcurrentContainers.h"
+#include "DexClass.h"
+#include "PatriciaTreeSet.h"
+#include "RedexContext.h"
+
+/**
+ * Containers keyed by the dense ids of DexString, DexType, DexFieldRef and
+ * DexMethodRef (see DexString::get_id()), for analyses that would otherwise
+ * hash pointers on every lookup.
+ *
+ * Ids are handed out per RedexContext; a container must not outlive the
+ * context whose objects it holds.
+ */
+namespace dex_ids {
+
+/*
+ * Maps an id back to its object. The DexMethod and DexField flavors are only
+ * meant for ids that were taken from definitions.
+ */
+template <typename T>
+struct Registry;
+
+template <>
+struct Registry<DexString> {
+  static DexString* get(uint32_t id) { return g_redex->string_by_id(id); }
+  static uint32_t bound() { return g_redex->string_id_bound(); }
+};
+
+template <>
+struct Registry<DexType> {
+  static DexType* get(uint32_t id) { return g_redex->type_by_id(id); }
+  static uint32_t bound() { return g_redex->type_id_bound(); }
+};
+
+template <>
+struct Registry<DexFieldRef> {
+  static DexFieldRef* get(uint32_t id) { return g_redex->field_by_id(id); }
+  static uint32_t bound() { return g_redex->field_id_bound(); }
+};
+
+template <>
+struct Registry<DexField> {
+  static DexField* get(uint32_t id) {
+    return static_cast<DexField*>(g_redex->field_by_id(id));
+  }
+  static uint32_t bound() { return g_redex->field_id_bound(); }
+};
+
+template <>
+struct Registry<DexMethodRef> {
+  static DexMethodRef* get(uint32_t id) { return g_redex->method_by_id(id); }
+  static uint32_t bound() { return g_redex->method_id_bound(); }
+};
+
+template <>
+struct Registry<DexMethod> {
+  static DexMethod* get(uint32_t id) {
+    return static_cast<DexMethod*>(g_redex->method_by_id(id));
+  }
+  static uint32_t bound() { return g_redex->method_id_bound(); }
+};
+
+} // namespace dex_ids
+
+/*
+ * A map from T* to Value stored as a vector indexed by id. Absent keys read
+ * as the default value.
+ *
+ * operator[] grows the vector as needed and is therefore not thread-safe.
+ * After reserve_all(), however, threads may write to the slots of distinct
+ * objects that existed at the time of the call concurrently.
+ */
+template <typename T, typename Value>
+class IdVector {
+ public:
+  IdVector() = default;
+  explicit IdVector(Value default_value)
+      : m_default(std::move(default_value)) {}
+
+  void reserve_all() {
+    auto bound = dex_ids::Registry<T>::bound();
+    if (m_values.size() < bound) {
+      m_values.resize(bound, m_default);
+    }
+  }
+
+  Value& operator[](const T* key) {
+    auto id = key->get_id();
+    if (id >= m_values.size()) {
+      m_values.resize(
+          std::max<size_t>(id + 1, dex_ids::Registry<T>::bound()), m_default);
+    }
+    return m_values[id];
+  }
+
+  const Value& get(const T* key) const {
+    auto id = key->get_id();
+    return id < m_values.size() ? m_values[id] : m_default;
+  }
+
+  void clear() { m_values.clear(); }
+
+ private:
+  Value m_default{};
+  std::vector<Value> m_values;
+};
+
+/*
+ * A set of T* stored as one bit per id. Iteration goes in id order, which,
+ * unlike pointer order, is the same from one run to the next.
+ */
+template <typename T>
+class IdBitset {
+ public:
+  // Returns true if `key` was not in the set yet.
+  bool insert(const T* key) {
+    auto id = key->get_id();
+    if (id / 64 >= m_words.size()) {
+      m_words.resize(id / 64 + 1);
+    }
+    auto& word = m_words[id / 64];
+    auto mask = uint64_t(1) << (id % 64);
+    bool inserted = (word & mask) == 0;
+    word |= mask;
+    return inserted;
+  }
+
+  void erase(const T* key) {
+    auto id = key->get_id();
+    if (id / 64 < m_words.size()) {
+      m_words[id / 64] &= ~(uint64_t(1) << (id % 64));
+    }
+  }
+
+  bool contains(const T* key) const {
+    auto id = key->get_id();
+    return id / 64 < m_words.size() &&
+           (m_words[id / 64] >> (id % 64) & 1) != 0;
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (auto word : m_words) {
+      n += __builtin_popcountll(word);
+    }
+    return n;
+  }
+
+  bool empty() const {
+    return std::all_of(m_words.begin(), m_words.end(),
+                       [](uint64_t word) { return word == 0; });
+  }
+
+  void union_with(const IdBitset& other) {
+    if (m_words.size() < other.m_words.size()) {
+      m_words.resize(other.m_words.size());
+    }
+    for (size_t i = 0; i < other.m_words.size(); ++i) {
+      m_words[i] |= other.m_words[i];
+    }
+  }
+
+  void intersection_with(const IdBitset& other) {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      m_words[i] &= i < other.m_words.size() ? other.m_words[i] : 0;
+    }
+  }
+
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      for (auto word = m_words[i]; word != 0; word &= word - 1) {
+        auto id = static_cast<uint32_t>(i * 64 + __builtin_ctzll(word));
+        fn(dex_ids::Registry<T>::get(id));
+      }
+    }
+  }
+
+  void clear() { m_words.clear(); }
+
+ private:
+  std::vector<uint64_t> m_words;
+};
+
+/*
+ * An IdBitset that threads may insert into concurrently without locks: an
+ * insertion is a single atomic fetch_or on the word that holds the bit. The
+ * words are allocated up front for every id handed out at construction time;
+ * the rare objects created afterwards go to a ConcurrentSet instead.
+ */
+template <typename T>
+class ConcurrentIdBitset {
+ public:
+  ConcurrentIdBitset() : ConcurrentIdBitset(dex_ids::Registry<T>::bound()) {}
+
+  explicit ConcurrentIdBitset(uint32_t capacity)
+      : m_num_words((capacity + 63) / 64),
+        m_words(new std::atomic<uint64_t>[m_num_words]) {
+    for (size_t i = 0; i < m_num_words; ++i) {
+      m_words[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns true if `key` was not in the set yet. Exactly one of several
+  // threads inserting the same key concurrently gets true.
+  bool insert(const T* key) {
+    auto id = key->get_id();
+    if (id / 64 >= m_num_words) {
+      return m_overflow.insert(key);
+    }
+    auto mask = uint64_t(1) << (id % 64);
+    return (m_words[id / 64].fetch_or(mask) & mask) == 0;
+  }
+
+  bool contains(const T* key) const {
+    auto id = key->get_id();
+    if (id / 64 >= m_num_words) {
+      return m_overflow.count(key) != 0;
+    }
+    return (m_words[id / 64].load() >> (id % 64) & 1) != 0;
+  }
+
+  // Not thread-safe with respect to concurrent insertions.
+  size_t size() const {
+    size_t n = m_overflow.size();
+    for (size_t i = 0; i < m_num_words; ++i) {
+      n += __builtin_popcountll(m_words[i].load(std::memory_order_relaxed));
+    }
+    return n;
+  }
+
+ private:
+  size_t m_num_words;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+  ConcurrentSet<const T*> m_overflow;
+};
+
+/*
+ * A sparta::PatriciaTreeSet of T* keyed by id rather than by address. Dense
+ * keys make for shallower trees, and iteration is in id order.
+ */
+template <typename T>
+class IdPatriciaTreeSet {
+ public:
+  bool empty() const { return m_set.empty(); }
+  size_t size() const { return m_set.size(); }
+
+  bool contains(const T* key) const { return m_set.contains(key->get_id()); }
+
+  IdPatriciaTreeSet& insert(const T* key) {
+    m_set.insert(key->get_id());
+    return *this;
+  }
+
+  IdPatriciaTreeSet& remove(const T* key) {
+    m_set.remove(key->get_id());
+    return *this;
+  }
+
+  IdPatriciaTreeSet& union_with(const IdPatriciaTreeSet& other) {
+    m_set.union_with(other.m_set);
+    return *this;
+  }
+
+  IdPatriciaTreeSet& intersection_with(const IdPatriciaTreeSet& other) {
+    m_set.intersection_with(other.m_set);
+    return *this;
+  }
+
+  IdPatriciaTreeSet& difference_with(const IdPatriciaTreeSet& other) {
+    m_set.difference_with(other.m_set);
+    return *this;
+  }
+
+  bool is_subset_of(const IdPatriciaTreeSet& other) const {
+    return m_set.is_subset_of(other.m_set);
+  }
+
+  bool equals(const IdPatriciaTreeSet& other) const {
+    return m_set.equals(other.m_set);
+  }
+
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    for (auto id : m_set) {
+      fn(dex_ids::Registry<T>::get(id));
+    }
+  }
+
+  const sparta::PatriciaTreeSet<uint32_t>& ids() const { return m_set; }
+
+ private:
+  sparta::PatriciaTreeSet<uint32_t> m_set;
+};
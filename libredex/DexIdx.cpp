@@ -36,6 +36,24 @@ DexIdx::~DexIdx() {
   free(m_proto_cache);
 }
 
+void DexIdx::resolve_all_refs() {
+  for (uint32_t i = 0; i < m_string_ids_size; ++i) {
+    get_stringidx(i);
+  }
+  for (uint32_t i = 0; i < m_type_ids_size; ++i) {
+    get_typeidx(i);
+  }
+  for (uint32_t i = 0; i < m_proto_ids_size; ++i) {
+    get_protoidx(i);
+  }
+  for (uint32_t i = 0; i < m_field_ids_size; ++i) {
+    get_fieldidx(i);
+  }
+  for (uint32_t i = 0; i < m_method_ids_size; ++i) {
+    get_methodidx(i);
+  }
+}
+
 DexString* DexIdx::get_stringidx_fromdex(uint32_t stridx) {
   redex_assert(stridx < m_string_ids_size);
   uint32_t stroff = m_string_ids[stridx].offset;
@@ -45,7 +63,8 @@ DexString* DexIdx::get_stringidx_fromdex(uint32_t stridx) {
   const uint8_t* dstr = m_dexbase + stroff;
   /* Strip off uleb128 size encoding */
   int utfsize = read_uleb128(&dstr);
-  return DexString::make_string((const char*)dstr, utfsize);
+  // The loader retains the mapping, so there is no need to copy the bytes.
+  return g_redex->make_string_in_place((const char*)dstr, utfsize);
 }
 
 DexType* DexIdx::get_typeidx_fromdex(uint32_t typeidx) {
@@ -134,6 +134,14 @@ class DexIdx {
 
   DexTypeList* get_type_list(uint32_t offset);
 
+  /*
+   * Looks up every string, type, field, method and proto of the dex, so that
+   * later lookups through this DexIdx find the refs as they were at load time,
+   * even after passes have renamed some of them. It also leaves the caches
+   * read-only, so the lookups are safe from several threads at once.
+   */
+  void resolve_all_refs();
+
   friend std::string show(DexIdx*);
 };
 
@@ -15,29 +15,51 @@
 #include "Walkers.h"
 #include "WorkQueue.h"
 
+#include <atomic>
 #include <exception>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
 class DexLoader {
   DexIdx* m_idx;
   const dex_class_def* m_class_defs;
-  DexClasses* m_classes;
+  DexClasses m_classes;
   boost::iostreams::mapped_file m_file;
   std::string m_dex_location;
+  // One entry per class when code decoding is deferred, otherwise empty.
+  std::vector<DeferredDexCode> m_deferred_code;
+  std::atomic<size_t> m_deferred_instructions{0};
 
  public:
   explicit DexLoader(const char* location)
       : m_idx(nullptr), m_dex_location(location) {}
   ~DexLoader() {
-    if (m_idx) delete m_idx;
-    if (m_file.is_open()) m_file.close();
+    if (m_idx) {
+      // Strings made through m_idx point into the mapping, and annotations
+      // decode their elements through m_idx when first accessed.
+      m_idx->resolve_all_refs();
+      g_redex->retain_dex_mapping(
+          std::make_unique<boost::iostreams::mapped_file>(m_file));
+      g_redex->retain_dex_idx(std::unique_ptr<DexIdx>(m_idx));
+    } else if (m_file.is_open()) {
+      m_file.close();
+    }
   }
   const dex_header* get_dex_header(const char* location);
-  DexClasses load_dex(const char* location,
-                      dex_stats_t* stats,
-                      bool support_dex_v37);
+  // Maps and validates the file, returning the number of classes to load.
+  // Each of them then needs a call to load_dex_class(), possibly in parallel.
+  // With `defer_code`, the classes are created without code; their code
+  // items are decoded later by decode_and_balloon(), straight into IRCode.
+  size_t begin_load(bool support_dex_v37, bool defer_code);
   void load_dex_class(int num);
+  const std::vector<DeferredDexCode>& get_deferred_code() const {
+    return m_deferred_code;
+  }
+  void decode_and_balloon(DexMethod* method, uint32_t code_off);
+  // Returns the loaded classes; the loader must stay alive until they have
+  // been ballooned.
+  DexClasses end_load(dex_stats_t* stats);
   void gather_input_stats(dex_stats_t* stats, const dex_header* dh);
 };
 
@@ -68,6 +90,12 @@ struct class_load_work {
   int num;
 };
 
+struct code_load_work {
+  DexLoader* dl;
+  DexMethod* method;
+  uint32_t code_off;
+};
+
 static std::vector<std::exception_ptr> class_work(class_load_work* clw) {
   try {
     clw->dl->load_dex_class(clw->num);
@@ -79,6 +107,17 @@ static std::vector<std::exception_ptr> class_work(class_load_work* clw) {
   }
 }
 
+static std::vector<std::exception_ptr> code_work(code_load_work* clw) {
+  try {
+    clw->dl->decode_and_balloon(clw->method, clw->code_off);
+    return {}; // no exception
+  } catch (const std::exception& exc) {
+    TRACE(MAIN, 1, "Worker throw the exception:%s", exc.what());
+
+    return {std::current_exception()};
+  }
+}
+
 static std::vector<std::exception_ptr> exc_reducer(
     const std::vector<std::exception_ptr>& v1,
     const std::vector<std::exception_ptr>& v2) {
@@ -108,7 +147,7 @@ void DexLoader::gather_input_stats(dex_stats_t* stats, const dex_header* dh) {
   std::set<DexTypeList*, dextypelists_comparator> type_lists;
   std::unordered_set<uint32_t> anno_offsets;
   for (uint32_t cidx = 0; cidx < dh->class_defs_size; ++cidx) {
-    auto* clz = m_classes->at(cidx);
+    auto* clz = m_classes.at(cidx);
     auto* class_def = &m_class_defs[cidx];
     auto anno_off = class_def->annotations_off;
     if (anno_off) {
@@ -281,8 +320,22 @@ void DexLoader::gather_input_stats(dex_stats_t* stats, const dex_header* dh) {
 
 void DexLoader::load_dex_class(int num) {
   const dex_class_def* cdef = m_class_defs + num;
-  DexClass* dc = new DexClass(m_idx, cdef, m_dex_location);
-  m_classes->at(num) = dc;
+  DexClass* dc =
+      new DexClass(m_idx, cdef, m_dex_location,
+                   m_deferred_code.empty() ? nullptr : &m_deferred_code[num]);
+  m_classes.at(num) = dc;
+}
+
+void DexLoader::decode_and_balloon(DexMethod* method, uint32_t code_off) {
+  auto dc = DexCode::get_dex_code(m_idx, code_off);
+  if (dc->get_debug_item()) {
+    auto cls = type_class(method->get_class());
+    dc->get_debug_item()->bind_positions(method, cls->get_source_file());
+  }
+  m_deferred_instructions.fetch_add(dc->get_instructions().size(),
+                                    std::memory_order_relaxed);
+  method->set_dex_code(std::move(dc));
+  method->balloon();
 }
 
 const dex_header* DexLoader::get_dex_header(const char* location) {
@@ -294,13 +347,11 @@ const dex_header* DexLoader::get_dex_header(const char* location) {
   return reinterpret_cast<const dex_header*>(m_file.const_data());
 }
 
-DexClasses DexLoader::load_dex(const char* location,
-                               dex_stats_t* stats,
-                               bool support_dex_v37) {
-  auto dh = get_dex_header(location);
+size_t DexLoader::begin_load(bool support_dex_v37, bool defer_code) {
+  auto dh = get_dex_header(m_dex_location.c_str());
   validate_dex_header(dh, m_file.size(), support_dex_v37);
   if (dh->class_defs_size == 0) {
-    return DexClasses(0);
+    return 0;
   }
   m_idx = new DexIdx(dh);
   auto off = (uint64_t)dh->class_defs_off;
@@ -309,30 +360,21 @@ DexClasses DexLoader::load_dex(const char* location,
   always_assert_log(limit <= m_file.size(), "invalid class_defs_size");
   m_class_defs =
       reinterpret_cast<const dex_class_def*>(m_file.const_data() + off);
-  DexClasses classes(dh->class_defs_size);
-  m_classes = &classes;
-
-  auto lwork = new class_load_work[dh->class_defs_size];
-  auto wq =
-      workqueue_mapreduce<class_load_work*, std::vector<std::exception_ptr>>(
-        class_work, exc_reducer);
-  for (uint32_t i = 0; i < dh->class_defs_size; i++) {
-    lwork[i].dl = this;
-    lwork[i].num = i;
-    wq.add_item(&lwork[i]);
+  m_classes.resize(dh->class_defs_size);
+  if (defer_code) {
+    m_deferred_code.resize(dh->class_defs_size);
   }
-  const auto exceptions = wq.run_all();
-  delete[] lwork;
+  return dh->class_defs_size;
+}
 
-  if (!exceptions.empty()) {
-    // At least one of the workers raised an exception
-    aggregate_exception ae(exceptions);
-    throw ae;
+DexClasses DexLoader::end_load(dex_stats_t* stats) {
+  auto dh = reinterpret_cast<const dex_header*>(m_file.const_data());
+  if (dh->class_defs_size != 0) {
+    gather_input_stats(stats, dh);
+    stats->num_instructions += m_deferred_instructions.load();
   }
-
-  gather_input_stats(stats, dh);
-
-  return classes;
+  m_deferred_code.clear();
+  return std::move(m_classes);
 }
 
 static void mt_balloon(DexMethod* method) { method->balloon(); }
@@ -347,6 +389,77 @@ static void balloon_all(const Scope& scope) {
   wq.run_all();
 }
 
+/*
+ * Loads the classes of all the files through a single WorkQueue, so that many
+ * small dexes keep all threads as busy as one large one.
+ *
+ * When ballooning, no method's DexCode is decoded with its class. Each one is
+ * decoded right before it is turned into IRCode instead, which avoids keeping
+ * every method's DexCode alive at once.
+ */
+static std::vector<DexClasses> load_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon,
+    bool support_dex_v37) {
+  std::vector<std::unique_ptr<DexLoader>> loaders;
+  std::vector<class_load_work> lwork;
+  for (const auto& location : locations) {
+    TRACE(MAIN, 1, "Loading classes from dex from %s", location.c_str());
+    loaders.emplace_back(std::make_unique<DexLoader>(location.c_str()));
+    auto* dl = loaders.back().get();
+    size_t num_classes = dl->begin_load(support_dex_v37, balloon);
+    for (size_t i = 0; i < num_classes; ++i) {
+      lwork.push_back(class_load_work{dl, static_cast<int>(i)});
+    }
+  }
+  {
+    auto wq =
+        workqueue_mapreduce<class_load_work*, std::vector<std::exception_ptr>>(
+            class_work, exc_reducer);
+    for (auto& work : lwork) {
+      wq.add_item(&work);
+    }
+    const auto exceptions = wq.run_all();
+    if (!exceptions.empty()) {
+      // At least one of the workers raised an exception
+      aggregate_exception ae(exceptions);
+      throw ae;
+    }
+  }
+
+  if (balloon) {
+    std::vector<code_load_work> cwork;
+    for (const auto& dl : loaders) {
+      for (const auto& deferred : dl->get_deferred_code()) {
+        for (const auto& method_and_off : deferred) {
+          cwork.push_back(code_load_work{dl.get(), method_and_off.first,
+                                         method_and_off.second});
+        }
+      }
+    }
+    auto wq =
+        workqueue_mapreduce<code_load_work*, std::vector<std::exception_ptr>>(
+            code_work, exc_reducer);
+    for (auto& work : cwork) {
+      wq.add_item(&work);
+    }
+    const auto exceptions = wq.run_all();
+    if (!exceptions.empty()) {
+      aggregate_exception ae(exceptions);
+      throw ae;
+    }
+  }
+
+  stats->resize(locations.size());
+  std::vector<DexClasses> result;
+  result.reserve(locations.size());
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    result.push_back(loaders[i]->end_load(&stats->at(i)));
+  }
+  return result;
+}
+
 DexClasses load_classes_from_dex(const char* location,
                                  bool balloon,
                                  bool support_dex_v37) {
@@ -358,13 +471,18 @@ DexClasses load_classes_from_dex(const char* location,
                                  dex_stats_t* stats,
                                  bool balloon,
                                  bool support_dex_v37) {
-  TRACE(MAIN, 1, "Loading classes from dex from %s", location);
-  DexLoader dl(location);
-  auto classes = dl.load_dex(location, stats, support_dex_v37);
-  if (balloon) {
-    balloon_all(classes);
-  }
-  return classes;
+  std::vector<dex_stats_t> all_stats;
+  auto dexen = load_dexes({location}, &all_stats, balloon, support_dex_v37);
+  *stats += all_stats[0];
+  return std::move(dexen[0]);
+}
+
+std::vector<DexClasses> load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon,
+    bool support_dex_v37) {
+  return load_dexes(locations, stats, balloon, support_dex_v37);
 }
 
 const std::string load_dex_magic_from_dex(const char* location) {
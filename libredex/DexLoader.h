@@ -12,6 +12,9 @@
 #include "DexDefs.h"
 #include "DexUtil.h"
 
+#include <string>
+#include <vector>
+
 DexClasses load_classes_from_dex(const char* location,
                                  bool balloon = true,
                                  bool support_dex_v37 = false);
@@ -19,5 +22,16 @@ DexClasses load_classes_from_dex(const char* location,
                                  dex_stats_t* stats,
                                  bool balloon = true,
                                  bool support_dex_v37 = false);
+/*
+ * Loads several dex files at once. The classes of all of them are decoded
+ * (and ballooned) by shared WorkQueues rather than one file after the other;
+ * the result and `stats` are in the order of `locations`, and each file's
+ * classes keep their order within it.
+ */
+std::vector<DexClasses> load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon = true,
+    bool support_dex_v37 = false);
 const std::string load_dex_magic_from_dex(const char* location);
 void balloon_for_test(const Scope& scope);
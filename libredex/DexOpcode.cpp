@@ -10,15 +10,35 @@
 #include "Debug.h"
 #include "Show.h"
 
+namespace {
+
+constexpr uint8_t NOT_IN_DOPS = 0xff;
+
+// The formats of the byte-sized opcodes, so that format(), which nearly every
+// DexInstruction accessor goes through while decoding, is a single load.
+struct FormatTable {
+  uint8_t formats[256]{};
+  constexpr FormatTable() {
+    for (auto& fmt : formats) {
+      fmt = NOT_IN_DOPS;
+    }
+#define OP(op, code, fmt, ...) formats[code] = FMT_##fmt;
+    DOPS
+#undef OP
+  }
+};
+
+constexpr FormatTable s_format_table;
+
+} // namespace
+
 namespace dex_opcode {
 
 OpcodeFormat format(DexOpcode opcode) {
+  if (opcode < 256 && s_format_table.formats[opcode] != NOT_IN_DOPS) {
+    return static_cast<OpcodeFormat>(s_format_table.formats[opcode]);
+  }
   switch (opcode) {
-#define OP(op, code, fmt, ...) \
-  case code:                   \
-    return FMT_##fmt;
-    DOPS
-#undef OP
   case FOPCODE_PACKED_SWITCH :
     return FMT_fopcode;
   case FOPCODE_SPARSE_SWITCH:
@@ -31,6 +51,8 @@ OpcodeFormat format(DexOpcode opcode) {
     break;
     QDOPS
 #undef OP
+  default:
+    break;
   }
   always_assert_log(false, "Unexpected opcode 0x%x", opcode);
 }
@@ -6,30 +6,21 @@
  */
 
 #include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/thread.hpp>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
 #include <exception>
-#include <fcntl.h>
 #include <fstream>
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <stdlib.h>
-#include <sys/stat.h>
 #include <unordered_set>
 
-#ifdef _MSC_VER
-// TODO: Rewrite open/write/close with C/C++ standards. But it works for now.
-#include <io.h>
-#define open _open
-#define write _write
-#define close _close
-#define fstat _fstat64i32
-#define stat _stat64i32
-#define O_CREAT _O_CREAT
-#define O_TRUNC _O_TRUNC
-#define O_WRONLY _O_WRONLY
-#endif
-
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexOutput.h"
@@ -42,6 +33,7 @@
 #include "Trace.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
+#include "locator_index.h"
 
 /*
  * For adler32...
@@ -116,6 +108,12 @@ std::vector<DexString*> GatheredTypes::keep_cls_strings_together_emitlist() {
         compare_dexstrings));
 }
 
+std::vector<DexString*> GatheredTypes::get_startup_trace_dexstring_emitlist() {
+  return get_dexstring_emitlist(CustomSort<DexString, cmp_dstring>(
+        m_startup_strings,
+        compare_dexstrings));
+}
+
 std::vector<DexMethod*> GatheredTypes::get_dexmethod_emitlist() {
   std::vector<DexMethod*> methlist;
   for (auto cls : *m_classes) {
@@ -157,6 +155,32 @@ void GatheredTypes::sort_dexmethod_emitlist_profiled_order(
                                      &m_method_sorting_whitelisted_substrings));
 }
 
+void GatheredTypes::sort_dexmethod_emitlist_startup_trace_order(
+    std::vector<DexMethod*>& lmeth) {
+  // Untraced methods keep their relative order, so that less important sort
+  // modes still apply to them.
+  auto rank = [this](const DexMethod* m) {
+    auto it = m_startup_methods.find(m);
+    return it == m_startup_methods.end() ? UINT_MAX : it->second;
+  };
+  std::stable_sort(lmeth.begin(), lmeth.end(),
+                   [&](const DexMethod* a, const DexMethod* b) {
+                     return rank(a) < rank(b);
+                   });
+}
+
+void GatheredTypes::sort_classes_startup_trace_order(
+    std::vector<DexClass*>& classes) {
+  auto rank = [this](const DexClass* cls) {
+    auto it = m_startup_classes.find(cls);
+    return it == m_startup_classes.end() ? UINT_MAX : it->second;
+  };
+  std::stable_sort(classes.begin(), classes.end(),
+                   [&](const DexClass* a, const DexClass* b) {
+                     return rank(a) < rank(b);
+                   });
+}
+
 void GatheredTypes::sort_dexmethod_emitlist_clinit_order(
     std::vector<DexMethod*>& lmeth) {
   std::stable_sort(lmeth.begin(), lmeth.end(),
@@ -181,67 +205,103 @@ DexOutputIdx* GatheredTypes::get_dodx(const uint8_t* base) {
    * dependency on ordering.
    */
   dexstring_to_idx* string = get_string_index();
-  dextype_to_idx* type = get_type_index();
-  dexproto_to_idx* proto = get_proto_index();
-  dexfield_to_idx* field = get_field_index();
-  dexmethod_to_idx* method = get_method_index();
+  dextype_to_idx* type = get_type_index(*string);
+  dexproto_to_idx* proto = get_proto_index(*type);
+  dexfield_to_idx* field = get_field_index(*string, *type);
+  dexmethod_to_idx* method = get_method_index(*string, *type, *proto);
   return new DexOutputIdx(string, type, proto, field, method, base);
 }
 
-dexstring_to_idx* GatheredTypes::get_string_index(cmp_dstring cmp) {
-  std::sort(m_lstring.begin(), m_lstring.end(), cmp);
-  dexstring_to_idx* sidx = new dexstring_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_lstring.begin(); it != m_lstring.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
-  }
-  return sidx;
+std::vector<DexString*> GatheredTypes::get_dexstring_emitlist() {
+  std::vector<DexString*> strlist(m_lstring);
+  sort_dexstrings(strlist);
+  return strlist;
 }
 
-dextype_to_idx* GatheredTypes::get_type_index(cmp_dtype cmp) {
-  std::sort(m_ltype.begin(), m_ltype.end(), cmp);
-  dextype_to_idx* sidx = new dextype_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_ltype.begin(); it != m_ltype.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
+namespace {
+
+template <typename T, typename Index>
+Index* make_index(const std::vector<T*>& sorted) {
+  auto idx = new Index();
+  idx->reserve(sorted.size());
+  uint32_t i = 0;
+  for (auto item : sorted) {
+    idx->emplace(item, i++);
   }
-  return sidx;
+  return idx;
 }
 
-dexfield_to_idx* GatheredTypes::get_field_index(cmp_dfield cmp) {
-  std::sort(m_lfield.begin(), m_lfield.end(), cmp);
-  dexfield_to_idx* sidx = new dexfield_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_lfield.begin(); it != m_lfield.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
+/*
+ * Sorts `items` on the keys computed by `key`, computing each key only once.
+ */
+template <typename T, typename KeyFn>
+void sort_by_key(std::vector<T*>& items, KeyFn key) {
+  using Key = decltype(key(items[0]));
+  std::vector<std::pair<Key, T*>> keyed;
+  keyed.reserve(items.size());
+  for (auto item : items) {
+    keyed.emplace_back(key(item), item);
+  }
+  std::sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) {
+    return a.first < b.first;
+  });
+  for (size_t i = 0; i < keyed.size(); ++i) {
+    items[i] = keyed[i].second;
   }
-  return sidx;
 }
 
-dexmethod_to_idx* GatheredTypes::get_method_index(cmp_dmethod cmp) {
-  std::sort(m_lmethod.begin(), m_lmethod.end(), cmp);
-  dexmethod_to_idx* sidx = new dexmethod_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_lmethod.begin(); it != m_lmethod.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
-  }
-  return sidx;
+} // namespace
+
+dexstring_to_idx* GatheredTypes::get_string_index() {
+  sort_dexstrings(m_lstring);
+  return make_index<DexString, dexstring_to_idx>(m_lstring);
 }
 
-dexproto_to_idx* GatheredTypes::get_proto_index(cmp_dproto cmp) {
+dextype_to_idx* GatheredTypes::get_type_index(const dexstring_to_idx& sidx) {
+  sort_by_key(m_ltype,
+              [&](const DexType* t) { return sidx.at(t->get_name()); });
+  return make_index<DexType, dextype_to_idx>(m_ltype);
+}
+
+dexfield_to_idx* GatheredTypes::get_field_index(const dexstring_to_idx& sidx,
+                                                const dextype_to_idx& tidx) {
+  sort_by_key(m_lfield, [&](const DexFieldRef* f) {
+    return std::make_tuple(tidx.at(f->get_class()),
+                           sidx.at(f->get_name()),
+                           tidx.at(f->get_type()));
+  });
+  return make_index<DexFieldRef, dexfield_to_idx>(m_lfield);
+}
+
+dexmethod_to_idx* GatheredTypes::get_method_index(
+    const dexstring_to_idx& sidx,
+    const dextype_to_idx& tidx,
+    const dexproto_to_idx& pidx) {
+  sort_by_key(m_lmethod, [&](const DexMethodRef* m) {
+    return std::make_tuple(tidx.at(m->get_class()),
+                           sidx.at(m->get_name()),
+                           pidx.at(m->get_proto()));
+  });
+  return make_index<DexMethodRef, dexmethod_to_idx>(m_lmethod);
+}
+
+dexproto_to_idx* GatheredTypes::get_proto_index(const dextype_to_idx& tidx) {
   std::vector<DexProto*> protos;
   for (auto const& m : m_lmethod) {
     protos.push_back(m->get_proto());
   }
   std::sort(protos.begin(), protos.end());
   protos.erase(std::unique(protos.begin(), protos.end()), protos.end());
-  std::sort(protos.begin(), protos.end(), cmp);
-  dexproto_to_idx* sidx = new dexproto_to_idx();
-  uint32_t idx = 0;
-  for (auto const& proto : protos) {
-    sidx->insert(std::make_pair(proto, idx++));
-  }
-  return sidx;
+  sort_by_key(protos, [&](const DexProto* p) {
+    std::vector<uint16_t> key;
+    key.reserve(p->get_args()->size() + 1);
+    key.push_back(tidx.at(p->get_rtype()));
+    for (auto arg : p->get_args()->get_type_list()) {
+      key.push_back(tidx.at(arg));
+    }
+    return key;
+  });
+  return make_index<DexProto, dexproto_to_idx>(protos);
 }
 
 void GatheredTypes::build_cls_load_map() {
@@ -326,6 +386,143 @@ void GatheredTypes::build_method_map() {
   }
 }
 
+void GatheredTypes::set_method_to_first_execution(
+    const std::unordered_map<std::string, uint64_t>&
+        method_to_first_execution) {
+  m_startup_methods.clear();
+  m_startup_classes.clear();
+  m_startup_strings.clear();
+
+  struct TracedMethod {
+    uint64_t first_execution;
+    const DexMethod* method;
+    const DexClass* cls;
+  };
+  std::vector<TracedMethod> traced;
+  for (const auto& cls : *m_classes) {
+    auto add = [&](const DexMethod* m) {
+      auto it =
+          method_to_first_execution.find(m->get_fully_deobfuscated_name());
+      if (it != method_to_first_execution.end()) {
+        traced.push_back({it->second, m, cls});
+      }
+    };
+    for (const auto& m : cls->get_dmethods()) {
+      add(m);
+    }
+    for (const auto& m : cls->get_vmethods()) {
+      add(m);
+    }
+  }
+  // Methods that first ran at the same time stay in class order.
+  std::stable_sort(traced.begin(), traced.end(),
+                   [](const TracedMethod& a, const TracedMethod& b) {
+                     return a.first_execution < b.first_execution;
+                   });
+
+  for (const auto& t : traced) {
+    add_startup_method(t.method, t.cls);
+  }
+  TRACE(CUSTOMSORT, 2,
+        "startup trace touches %u methods, %u classes and %u strings",
+        m_startup_methods.size(), m_startup_classes.size(),
+        m_startup_strings.size());
+}
+
+void GatheredTypes::set_coldstart_order(
+    const std::vector<std::string>& coldstart_classes,
+    const std::unordered_map<std::string, unsigned int>& method_to_weight) {
+  m_startup_methods.clear();
+  m_startup_classes.clear();
+  m_startup_strings.clear();
+
+  // The list has the names of the classes when InterDex ran, which later
+  // passes may have changed, so match the original names too.
+  std::unordered_map<std::string, const DexClass*> classes_by_name;
+  for (const auto& cls : *m_classes) {
+    classes_by_name.emplace(cls->get_deobfuscated_name(), cls);
+  }
+  for (const auto& cls : *m_classes) {
+    classes_by_name[cls->get_name()->str()] = cls;
+  }
+  for (const auto& name : coldstart_classes) {
+    auto it = classes_by_name.find(name);
+    if (it == classes_by_name.end()) {
+      continue;
+    }
+    auto cls = it->second;
+    add_startup_class(cls);
+    for (const auto& m : cls->get_dmethods()) {
+      add_startup_method(m, cls);
+    }
+    for (const auto& m : cls->get_vmethods()) {
+      add_startup_method(m, cls);
+    }
+  }
+
+  struct HotMethod {
+    unsigned int weight;
+    const DexMethod* method;
+    const DexClass* cls;
+  };
+  std::vector<HotMethod> hot;
+  for (const auto& cls : *m_classes) {
+    auto add = [&](DexMethod* m) {
+      auto weight = get_method_weight_if_available(m, &method_to_weight);
+      if (weight > 0 && !m_startup_methods.count(m)) {
+        hot.push_back({weight, m, cls});
+      }
+    };
+    for (const auto& m : cls->get_dmethods()) {
+      add(m);
+    }
+    for (const auto& m : cls->get_vmethods()) {
+      add(m);
+    }
+  }
+  std::stable_sort(hot.begin(), hot.end(),
+                   [](const HotMethod& a, const HotMethod& b) {
+                     return a.weight > b.weight;
+                   });
+  for (const auto& h : hot) {
+    add_startup_method(h.method, h.cls);
+  }
+  TRACE(CUSTOMSORT, 2,
+        "coldstart touches %u methods, %u classes and %u strings",
+        m_startup_methods.size(), m_startup_classes.size(),
+        m_startup_strings.size());
+}
+
+void GatheredTypes::add_startup_class(const DexClass* cls) {
+  auto add_string = [this](const DexString* s) {
+    m_startup_strings.emplace(s, m_startup_strings.size());
+  };
+  if (m_startup_classes.emplace(cls, m_startup_classes.size()).second) {
+    add_string(cls->get_name());
+    if (cls->get_source_file() != nullptr) {
+      add_string(cls->get_source_file());
+    }
+  }
+}
+
+void GatheredTypes::add_startup_method(const DexMethod* method,
+                                       const DexClass* cls) {
+  if (!m_startup_methods.emplace(method, m_startup_methods.size()).second) {
+    return;
+  }
+  add_startup_class(cls);
+  std::vector<DexString*> method_strings{method->get_name()};
+  method->gather_strings(method_strings);
+  if (method->get_dex_code() != nullptr) {
+    for (const auto& insn : method->get_dex_code()->get_instructions()) {
+      insn->gather_strings(method_strings);
+    }
+  }
+  for (const auto& s : method_strings) {
+    m_startup_strings.emplace(s, m_startup_strings.size());
+  }
+}
+
 void GatheredTypes::gather_components() {
   ::gather_components(m_lstring, m_ltype, m_lfield, m_lmethod, *m_classes);
 }
@@ -360,8 +557,26 @@ DexOutput::DexOutput(
     : m_config_files(config_files) {
   m_classes = classes;
   m_iodi_metadata = iodi_metadata;
-  m_output = (uint8_t*)malloc(k_max_dex_size);
-  memset(m_output, 0, k_max_dex_size);
+  // The output is laid out directly in a mapping of the file it will end up
+  // in, rather than in a heap buffer. The file starts out sparse and
+  // zero-filled, so only the pages that are actually written take up memory,
+  // and the kernel can write them back under memory pressure instead of
+  // holding k_max_dex_size bytes per dex in flight.
+  //
+  // The output often replaces an input dex that is still mapped (DexStrings
+  // point into it), so write a new file and rename it over the old one rather
+  // than truncating the old one in place.
+  m_tmp_filename = std::string(path) + ".tmp";
+  boost::iostreams::mapped_file_params params(m_tmp_filename);
+  params.flags = boost::iostreams::mapped_file::readwrite;
+  params.new_file_size = k_max_dex_size;
+  try {
+    m_output_file.open(params);
+  } catch (const std::exception& e) {
+    always_assert_log(false, "Error writing dex %s: %s",
+                      m_tmp_filename.c_str(), e.what());
+  }
+  m_output = (uint8_t*)m_output_file.data();
   m_offset = 0;
   m_gtypes = new GatheredTypes(classes);
   dodx = m_gtypes->get_dodx(m_output);
@@ -384,7 +599,12 @@ DexOutput::DexOutput(
 DexOutput::~DexOutput() {
   delete m_gtypes;
   delete dodx;
-  free(m_output);
+  if (m_output_file.is_open()) {
+    // write() was never called.
+    m_output_file.close();
+    boost::system::error_code ec;
+    boost::filesystem::remove(m_tmp_filename, ec);
+  }
 }
 
 void DexOutput::insert_map_item(uint16_t maptype,
@@ -480,6 +700,10 @@ void DexOutput::generate_string_data(SortMode mode) {
   } else if (mode == SortMode::CLASS_STRINGS) {
     TRACE(CUSTOMSORT, 2, "using class names pack for string pool sorting");
     string_order = m_gtypes->keep_cls_strings_together_emitlist();
+  } else if (mode == SortMode::STARTUP_TRACE_ORDER ||
+             mode == SortMode::COLDSTART_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using startup trace order for string pool sorting");
+    string_order = m_gtypes->get_startup_trace_dexstring_emitlist();
   } else {
     TRACE(CUSTOMSORT, 2, "using default string pool sorting");
     string_order = m_gtypes->get_dexstring_emitlist();
@@ -529,6 +753,9 @@ void DexOutput::generate_string_data(SortMode mode) {
     TRACE(CUSTOMSORT, 3, "str emit %s", SHOW(str));
     stringids[idx].offset = m_offset;
     str->encode(m_output + m_offset);
+    if (m_gtypes->is_startup_string(str)) {
+      m_startup_string_ranges.emplace_back(m_offset, str->get_entry_size());
+    }
     m_offset += str->get_entry_size();
     m_stats.num_strings++;
   }
@@ -744,7 +971,60 @@ void DexOutput::generate_class_data() {
   }
 }
 
-void DexOutput::generate_class_data_items() {
+namespace {
+
+/*
+ * Encodes `n` items into buffers of their own, in parallel. `encode(i, out)`
+ * writes item i to `out`, which has room for `max_size(i)` bytes, and returns
+ * the number of bytes it wrote. Items are position-independent, so the caller
+ * only has to copy the buffers into place.
+ */
+template <typename MaxSizeFn, typename EncodeFn>
+std::vector<std::vector<uint8_t>> encode_in_parallel(size_t n,
+                                                     MaxSizeFn max_size,
+                                                     EncodeFn encode) {
+  std::vector<std::vector<uint8_t>> encoded(n);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto& buffer = encoded[i];
+    // Zeroed, like the output buffer, so that padding is deterministic.
+    buffer.resize(max_size(i));
+    size_t size = encode(i, buffer.data());
+    always_assert(size <= buffer.size());
+    buffer.resize(size);
+  });
+  for (size_t i = 0; i < n; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return encoded;
+}
+
+constexpr size_t kMaxUleb128Size = 5;
+
+size_t max_code_item_size(const DexCode* code) {
+  size_t insns_size = 0;
+  for (auto const& opc : code->get_instructions()) {
+    insns_size += opc->size();
+  }
+  // The instructions, plus one code unit to pad the tries to 4 bytes.
+  size_t size = sizeof(dex_code_item) + (insns_size + 1) * sizeof(uint16_t);
+  const auto& tries = code->get_tries();
+  size += tries.size() * sizeof(dex_tries_item) + kMaxUleb128Size;
+  for (const auto& dextry : tries) {
+    size += kMaxUleb128Size + dextry->m_catches.size() * 2 * kMaxUleb128Size;
+  }
+  return size;
+}
+
+size_t max_class_data_item_size(const DexClass* cls) {
+  size_t fields = cls->get_sfields().size() + cls->get_ifields().size();
+  size_t methods = cls->get_dmethods().size() + cls->get_vmethods().size();
+  return (4 + 2 * fields + 3 * methods) * kMaxUleb128Size;
+}
+
+} // namespace
+
+void DexOutput::generate_class_data_items(SortMode mode) {
   /*
    * First generate a dexcode_to_offset needed for the encoding
    * of class_data_items
@@ -755,34 +1035,37 @@ void DexOutput::generate_class_data_items() {
     uint32_t offset = (uint32_t)(((uint8_t*)it.code_item) - m_output);
     dco[it.code] = offset;
   }
+  std::vector<DexClass*> data_classes;
   for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
     DexClass* clz = m_classes->at(i);
-    if (!clz->has_class_data()) continue;
+    if (clz->has_class_data()) {
+      data_classes.push_back(clz);
+    }
+  }
+  if (mode == SortMode::STARTUP_TRACE_ORDER ||
+      mode == SortMode::COLDSTART_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using startup trace order for class data sorting");
+    m_gtypes->sort_classes_startup_trace_order(data_classes);
+  }
+  auto encoded = encode_in_parallel(
+      data_classes.size(),
+      [&](size_t i) { return max_class_data_item_size(data_classes[i]); },
+      [&](size_t i, uint8_t* output) {
+        return data_classes[i]->encode(dodx, dco, output);
+      });
+  for (size_t i = 0; i < data_classes.size(); ++i) {
     /* No alignment constraints for this data */
-    int size = clz->encode(dodx, dco, m_output + m_offset);
-    m_cdi_offsets[clz] = m_offset;
-    m_offset += size;
+    memcpy(m_output + m_offset, encoded[i].data(), encoded[i].size());
+    m_cdi_offsets[data_classes[i]] = m_offset;
+    if (m_gtypes->is_startup_class(data_classes[i])) {
+      m_startup_class_data_ranges.emplace_back(m_offset, encoded[i].size());
+    }
+    m_offset += encoded[i].size();
   }
   insert_map_item(TYPE_CLASS_DATA_ITEM, (uint32_t)m_cdi_offsets.size(),
                   cdi_start, m_offset - cdi_start);
 }
 
-static void sync_all(const Scope& scope) {
-  constexpr bool serial = false; // for debugging
-  auto wq = workqueue_foreach<DexMethod*>([](DexMethod* m){m->sync();});
-  walk::code(scope,
-            [](DexMethod*) { return true; },
-            [&](DexMethod* m, IRCode&) {
-              if (serial) {
-                TRACE(MTRANS, 2, "Syncing %s", SHOW(m));
-                m->sync();
-              } else {
-                wq.add_item(m);
-              }
-            });
-  wq.run_all();
-}
-
 void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
   TRACE(MAIN, 2, "generate_code_items");
   /*
@@ -791,7 +1074,6 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
    */
   align_output();
   uint32_t ci_start = m_offset;
-  sync_all(*m_classes);
 
   // Get all methods.
   std::vector<DexMethod*> lmeth = m_gtypes->get_dexmethod_emitlist();
@@ -814,6 +1096,11 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
               "sorting <clinit> sections before all other bytecode");
         m_gtypes->sort_dexmethod_emitlist_clinit_order(lmeth);
         break;
+      case SortMode::STARTUP_TRACE_ORDER:
+      case SortMode::COLDSTART_ORDER:
+        TRACE(CUSTOMSORT, 2, "using startup trace order for bytecode sorting");
+        m_gtypes->sort_dexmethod_emitlist_startup_trace_order(lmeth);
+        break;
 
       case SortMode::CLASS_STRINGS:
         TRACE(CUSTOMSORT, 2,
@@ -825,6 +1112,7 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         break;
       }
   }
+  std::vector<DexMethod*> emit_meths;
   for (DexMethod* meth : lmeth) {
     if (meth->get_access() & (ACC_ABSTRACT | ACC_NATIVE)) {
       // There is no code item for ABSTRACT or NATIVE methods.
@@ -835,13 +1123,32 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
     always_assert_log(
         meth->is_concrete() && code != nullptr,
         "Undefined method in generate_code_items()\n\t prototype: %s\n", SHOW(meth));
+    emit_meths.push_back(meth);
+  }
+  auto encoded = encode_in_parallel(
+      emit_meths.size(),
+      [&](size_t i) { return max_code_item_size(emit_meths[i]->get_dex_code()); },
+      [&](size_t i, uint8_t* output) {
+        auto meth = emit_meths[i];
+        int size = meth->get_dex_code()->encode(dodx, (uint32_t*)output);
+        check_method_instruction_size_limit(m_config_files, size, SHOW(meth));
+        if (m_iodi_metadata) {
+          m_iodi_metadata->mark_callers(meth);
+        }
+        return size;
+      });
+  for (size_t i = 0; i < emit_meths.size(); ++i) {
+    DexMethod* meth = emit_meths[i];
+    DexCode* code = meth->get_dex_code();
     align_output();
-    int size = code->encode(dodx, (uint32_t*)(m_output + m_offset));
-    check_method_instruction_size_limit(m_config_files, size, SHOW(meth));
+    memcpy(m_output + m_offset, encoded[i].data(), encoded[i].size());
     m_method_bytecode_offsets.emplace_back(meth->get_name()->c_str(), m_offset);
     m_code_item_emits.emplace_back(meth, code,
                                    (dex_code_item*)(m_output + m_offset));
-    m_offset += size;
+    if (m_gtypes->is_startup_method(meth)) {
+      m_startup_code_ranges.emplace_back(m_offset, encoded[i].size());
+    }
+    m_offset += encoded[i].size();
     m_stats.num_instructions += code->get_instructions().size();
   }
   insert_map_item(TYPE_CODE_ITEM, (uint32_t)m_code_item_emits.size(), ci_start,
@@ -905,28 +1212,70 @@ static bool annotation_cmp(const DexAnnotationDirectory* a,
   return (a->viz_score() < b->viz_score());
 }
 
-void DexOutput::unique_annotations(annomap_t& annomap,
-                                   std::vector<DexAnnotation*>& annolist) {
-  int annocnt = 0;
-  uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint8_t>, uint32_t> annotation_byte_offsets;
-  for (auto anno : annolist) {
-    if (annomap.count(anno)) continue;
-    std::vector<uint8_t> annotation_bytes;
-    anno->vencode(dodx, annotation_bytes);
-    if (annotation_byte_offsets.count(annotation_bytes)) {
-      annomap[anno] = annotation_byte_offsets[annotation_bytes];
+namespace {
+
+/*
+ * Drops repeated pointers from `list`, keeping the first occurrence of each
+ * so that the emit order does not change, then encodes every remaining item
+ * in parallel. `encode(item, bytes)` must only touch `item`.
+ */
+template <typename T, typename Word, typename EncodeFn>
+std::vector<std::vector<Word>> encode_unique_in_parallel(std::vector<T*>& list,
+                                                         EncodeFn encode) {
+  std::unordered_set<T*> seen;
+  list.erase(std::remove_if(list.begin(),
+                            list.end(),
+                            [&](T* item) { return !seen.insert(item).second; }),
+             list.end());
+  std::vector<std::vector<Word>> encoded(list.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { encode(list[i], encoded[i]); });
+  for (size_t i = 0; i < list.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return encoded;
+}
+
+/*
+ * Lays out the encodings that have not been seen yet and records the offset
+ * of each item in `offsets`. Identical encodings are found by content hash
+ * and share one copy in the output.
+ */
+template <typename T, typename Word>
+uint32_t emit_unique(const std::vector<T*>& list,
+                     const std::vector<std::vector<Word>>& encoded,
+                     uint8_t* output,
+                     uint32_t& offset,
+                     std::unordered_map<T*, uint32_t>& offsets) {
+  std::unordered_map<std::vector<Word>, uint32_t, boost::hash<std::vector<Word>>>
+      content_offsets;
+  content_offsets.reserve(list.size());
+  uint32_t count = 0;
+  for (size_t i = 0; i < list.size(); ++i) {
+    const auto& bytes = encoded[i];
+    auto inserted = content_offsets.emplace(bytes, offset);
+    offsets[list[i]] = inserted.first->second;
+    if (!inserted.second) {
       continue;
     }
-    /* Insert new annotation in tracking structs */
-    annotation_byte_offsets[annotation_bytes] = m_offset;
-    annomap[anno] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* annoout = (uint8_t*)(m_output + m_offset);
-    memcpy(annoout, &annotation_bytes[0], annotation_bytes.size());
-    m_offset += annotation_bytes.size();
-    annocnt++;
+    memcpy(output + offset, bytes.data(), bytes.size() * sizeof(Word));
+    offset += bytes.size() * sizeof(Word);
+    count++;
   }
+  return count;
+}
+
+} // namespace
+
+void DexOutput::unique_annotations(annomap_t& annomap,
+                                   std::vector<DexAnnotation*>& annolist) {
+  uint32_t mentry_offset = m_offset;
+  auto encoded = encode_unique_in_parallel<DexAnnotation, uint8_t>(
+      annolist, [&](DexAnnotation* anno, std::vector<uint8_t>& bytes) {
+        anno->vencode(dodx, bytes);
+      });
+  auto annocnt = emit_unique(annolist, encoded, m_output, m_offset, annomap);
   if (annocnt) {
     insert_map_item(TYPE_ANNOTATION_ITEM, annocnt, mentry_offset,
                     m_offset - mentry_offset);
@@ -937,26 +1286,12 @@ void DexOutput::unique_annotations(annomap_t& annomap,
 void DexOutput::unique_asets(annomap_t& annomap,
                              asetmap_t& asetmap,
                              std::vector<DexAnnotationSet*>& asetlist) {
-  int asetcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> aset_offsets;
-  for (auto aset : asetlist) {
-    if (asetmap.count(aset)) continue;
-    std::vector<uint32_t> aset_bytes;
-    aset->vencode(dodx, aset_bytes, annomap);
-    if (aset_offsets.count(aset_bytes)) {
-      asetmap[aset] = aset_offsets[aset_bytes];
-      continue;
-    }
-    /* Insert new aset in tracking structs */
-    aset_offsets[aset_bytes] = m_offset;
-    asetmap[aset] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* asetout = (uint8_t*)(m_output + m_offset);
-    memcpy(asetout, &aset_bytes[0], aset_bytes.size() * sizeof(uint32_t));
-    m_offset += aset_bytes.size() * sizeof(uint32_t);
-    asetcnt++;
-  }
+  auto encoded = encode_unique_in_parallel<DexAnnotationSet, uint32_t>(
+      asetlist, [&](DexAnnotationSet* aset, std::vector<uint32_t>& bytes) {
+        aset->vencode(dodx, bytes, annomap);
+      });
+  auto asetcnt = emit_unique(asetlist, encoded, m_output, m_offset, asetmap);
   if (asetcnt) {
     insert_map_item(TYPE_ANNOTATION_SET_ITEM, asetcnt, mentry_offset,
                     m_offset - mentry_offset);
@@ -966,32 +1301,18 @@ void DexOutput::unique_asets(annomap_t& annomap,
 void DexOutput::unique_xrefs(asetmap_t& asetmap,
                              xrefmap_t& xrefmap,
                              std::vector<ParamAnnotations*>& xreflist) {
-  int xrefcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> xref_offsets;
-  for (auto xref : xreflist) {
-    if (xrefmap.count(xref)) continue;
-    std::vector<uint32_t> xref_bytes;
-    xref_bytes.push_back((unsigned int) xref->size());
-    for (auto param : *xref) {
-      DexAnnotationSet* das = param.second;
-      always_assert_log(asetmap.count(das) != 0,
-                        "Uninitialized aset %p '%s'", das, SHOW(das));
-      xref_bytes.push_back(asetmap[das]);
-    }
-    if (xref_offsets.count(xref_bytes)) {
-      xrefmap[xref] = xref_offsets[xref_bytes];
-      continue;
-    }
-    /* Insert new xref in tracking structs */
-    xref_offsets[xref_bytes] = m_offset;
-    xrefmap[xref] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* xrefout = (uint8_t*)(m_output + m_offset);
-    memcpy(xrefout, &xref_bytes[0], xref_bytes.size() * sizeof(uint32_t));
-    m_offset += xref_bytes.size() * sizeof(uint32_t);
-    xrefcnt++;
-  }
+  auto encoded = encode_unique_in_parallel<ParamAnnotations, uint32_t>(
+      xreflist, [&](ParamAnnotations* xref, std::vector<uint32_t>& bytes) {
+        bytes.push_back((unsigned int)xref->size());
+        for (auto param : *xref) {
+          DexAnnotationSet* das = param.second;
+          always_assert_log(asetmap.count(das) != 0,
+                            "Uninitialized aset %p '%s'", das, SHOW(das));
+          bytes.push_back(asetmap.at(das));
+        }
+      });
+  auto xrefcnt = emit_unique(xreflist, encoded, m_output, m_offset, xrefmap);
   if (xrefcnt) {
     insert_map_item(TYPE_ANNOTATION_SET_REF_LIST, xrefcnt, mentry_offset,
                     m_offset - mentry_offset);
@@ -1002,26 +1323,13 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
                              xrefmap_t& xrefmap,
                              adirmap_t& adirmap,
                              std::vector<DexAnnotationDirectory*>& adirlist) {
-  int adircnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> adir_offsets;
-  for (auto adir : adirlist) {
-    if (adirmap.count(adir)) continue;
-    std::vector<uint32_t> adir_bytes;
-    adir->vencode(dodx, adir_bytes, xrefmap, asetmap);
-    if (adir_offsets.count(adir_bytes)) {
-      adirmap[adir] = adir_offsets[adir_bytes];
-      continue;
-    }
-    /* Insert new adir in tracking structs */
-    adir_offsets[adir_bytes] = m_offset;
-    adirmap[adir] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* adirout = (uint8_t*)(m_output + m_offset);
-    memcpy(adirout, &adir_bytes[0], adir_bytes.size() * sizeof(uint32_t));
-    m_offset += adir_bytes.size() * sizeof(uint32_t);
-    adircnt++;
-  }
+  auto encoded = encode_unique_in_parallel<DexAnnotationDirectory, uint32_t>(
+      adirlist,
+      [&](DexAnnotationDirectory* adir, std::vector<uint32_t>& bytes) {
+        adir->vencode(dodx, bytes, xrefmap, asetmap);
+      });
+  auto adircnt = emit_unique(adirlist, encoded, m_output, m_offset, adirmap);
   if (adircnt) {
     insert_map_item(TYPE_ANNOTATIONS_DIR_ITEM, adircnt, mentry_offset,
                     m_offset - mentry_offset);
@@ -1041,7 +1349,7 @@ void DexOutput::generate_annotations() {
   int xrefsize = 0;
   int annodirsize = 0;
   int xrefcnt = 0;
-  std::map<DexAnnotationDirectory*, int> ad_to_classnum;
+  std::unordered_map<DexAnnotationDirectory*, int> ad_to_classnum;
   annomap_t annomap;
   asetmap_t asetmap;
   xrefmap_t xrefmap;
@@ -1122,23 +1430,11 @@ int emit_debug_info_for_metadata(DexOutputIdx* dodx,
   return size;
 }
 
-int emit_debug_info(
-    DexOutputIdx* dodx,
-    bool emit_positions,
-    DexDebugItem* dbg,
-    DexCode* dc,
-    dex_code_item* dci,
-    PositionMapper* pos_mapper,
-    uint8_t* output,
-    uint32_t offset,
-    uint32_t num_params,
-    std::unordered_map<DexCode*, std::vector<DebugLineItem>>* dbg_lines) {
-  // No align requirement for debug items.
-  DebugMetadata metadata =
-      calculate_debug_metadata(dbg, dc, dci, pos_mapper, num_params, dbg_lines);
-  return emit_positions
-             ? emit_debug_info_for_metadata(dodx, metadata, output, offset)
-             : 0;
+size_t max_debug_item_size(const DebugMetadata& metadata) {
+  // The opcode and up to four operands, e.g. DBG_START_LOCAL_EXTENDED.
+  constexpr size_t kMaxDebugOpSize = 1 + 4 * kMaxUleb128Size;
+  return (2 + metadata.num_params) * kMaxUleb128Size +
+         metadata.dbgops.size() * kMaxDebugOpSize + 1;
 }
 
 // Returns a DexDebugInstruction corresponding to emitting a line entry
@@ -1638,6 +1934,9 @@ void DexOutput::generate_debug_items() {
               "[IODI] WARNING: Not using IODI because no iodi metadata file was"
               " specified.\n");
     }
+    // Line numbers are handed out by the shared position mapper in emission
+    // order, so they are computed in order; only the encoding is parallel.
+    std::vector<DebugMetadata> metadata;
     for (auto& it : m_code_item_emits) {
       DexCode* dc = it.code;
       dex_code_item* dci = it.code_item;
@@ -1645,9 +1944,23 @@ void DexOutput::generate_debug_items() {
       if (dbg == nullptr) continue;
       dbgcount++;
       size_t num_params = it.method->get_proto()->get_args()->size();
-      m_offset +=
-          emit_debug_info(dodx, emit_positions, dbg, dc, dci, m_pos_mapper,
-                          m_output, m_offset, num_params, m_code_debug_lines);
+      metadata.push_back(calculate_debug_metadata(
+          dbg, dc, dci, m_pos_mapper, num_params, m_code_debug_lines));
+    }
+    if (emit_positions) {
+      auto encoded = encode_in_parallel(
+          metadata.size(),
+          [&](size_t i) { return max_debug_item_size(metadata[i]); },
+          [&](size_t i, uint8_t* output) {
+            return emit_debug_info_for_metadata(dodx, metadata[i], output, 0,
+                                                false);
+          });
+      for (size_t i = 0; i < metadata.size(); ++i) {
+        // No align requirement for debug items.
+        memcpy(m_output + m_offset, encoded[i].data(), encoded[i].size());
+        metadata[i].dci->debug_info_off = m_offset;
+        m_offset += encoded[i].size();
+      }
     }
   }
   if (emit_positions) {
@@ -1658,6 +1971,55 @@ void DexOutput::generate_debug_items() {
   m_stats.dbg_total_size += m_offset - dbg_start;
 }
 
+namespace {
+
+constexpr uint32_t kPageSize = 4096;
+
+/*
+ * Adds the pages touched by the [offset, offset + size) ranges to `pages`.
+ */
+void add_pages(const std::vector<std::pair<uint32_t, uint32_t>>& ranges,
+               std::unordered_set<uint32_t>* pages) {
+  for (const auto& range : ranges) {
+    if (range.second == 0) {
+      continue;
+    }
+    auto last = (range.first + range.second - 1) / kPageSize;
+    for (auto page = range.first / kPageSize; page <= last; ++page) {
+      pages->insert(page);
+    }
+  }
+}
+
+int count_pages(const std::vector<std::pair<uint32_t, uint32_t>>& ranges) {
+  std::unordered_set<uint32_t> pages;
+  add_pages(ranges, &pages);
+  return pages.size();
+}
+
+} // namespace
+
+void DexOutput::count_startup_pages() {
+  if (!m_gtypes->has_startup_trace()) {
+    return;
+  }
+  m_stats.num_startup_code_pages = count_pages(m_startup_code_ranges);
+  m_stats.num_startup_string_pages = count_pages(m_startup_string_ranges);
+  m_stats.num_startup_class_data_pages =
+      count_pages(m_startup_class_data_ranges);
+  std::unordered_set<uint32_t> pages;
+  add_pages(m_startup_code_ranges, &pages);
+  add_pages(m_startup_string_ranges, &pages);
+  add_pages(m_startup_class_data_ranges, &pages);
+  m_stats.num_startup_pages = pages.size();
+  TRACE(CUSTOMSORT, 1,
+        "%s: startup touches %d pages: %d of code, %d of strings, %d of class "
+        "data",
+        m_filename, m_stats.num_startup_pages, m_stats.num_startup_code_pages,
+        m_stats.num_startup_string_pages,
+        m_stats.num_startup_class_data_pages);
+}
+
 void DexOutput::generate_map() {
   align_output();
   uint32_t* mapout = (uint32_t*)(m_output + m_offset);
@@ -1704,8 +2066,28 @@ static void fix_method_jumbos(DexMethod* method, const DexOutputIdx* dodx) {
   }
 }
 
-static void fix_jumbos(DexClasses* classes, DexOutputIdx* dodx) {
-  walk::methods(*classes, [&](DexMethod* m) { fix_method_jumbos(m, dodx); });
+/*
+ * The jumbo fixup is the last change to a method's IR, so each method is
+ * synced to its DexCode right after it, in the same parallel pass.
+ */
+static void fix_jumbos_and_sync(DexClasses* classes, DexOutputIdx* dodx) {
+  constexpr bool serial = false; // for debugging
+  auto wq = workqueue_foreach<DexMethod*>([dodx](DexMethod* m) {
+    fix_method_jumbos(m, dodx);
+    m->sync();
+  });
+  walk::code(*classes,
+             [](DexMethod*) { return true; },
+             [&](DexMethod* m, IRCode&) {
+               if (serial) {
+                 TRACE(MTRANS, 2, "Syncing %s", SHOW(m));
+                 fix_method_jumbos(m, dodx);
+                 m->sync();
+               } else {
+                 wq.add_item(m);
+               }
+             });
+  wq.run_all();
 }
 
 void DexOutput::init_header_offsets(const std::string& dex_magic) {
@@ -1788,6 +2170,17 @@ void DexOutput::finalize_header() {
 
 namespace {
 
+// The symbol files get large, and are written a line at a time.
+constexpr size_t kSymbolFileBufferSize = 1 << 20;
+
+FILE* open_symbol_file(const std::string& filename) {
+  FILE* fd = fopen(filename.c_str(), "a");
+  if (fd != nullptr) {
+    setvbuf(fd, nullptr, _IOFBF, kSymbolFileBufferSize);
+  }
+  return fd;
+}
+
 void write_method_mapping(
   const std::string& filename,
   const DexOutputIdx* dodx,
@@ -1796,7 +2189,7 @@ void write_method_mapping(
   std::unordered_map<DexMethod*, uint64_t>* method_to_id
 ) {
   always_assert(!filename.empty());
-  FILE* fd = fopen(filename.c_str(), "a");
+  FILE* fd = open_symbol_file(filename);
   assert_log(fd, "Can't open method mapping file %s: %s\n",
              filename.c_str(),
              strerror(errno));
@@ -1884,7 +2277,7 @@ void write_class_mapping(
   uint8_t* dex_signature
 ) {
   always_assert(!filename.empty());
-  FILE* fd = fopen(filename.c_str(), "a");
+  FILE* fd = open_symbol_file(filename);
 
   for (uint32_t idx = 0; idx < class_defs_size; idx++) {
 
@@ -2042,22 +2435,22 @@ void write_pg_mapping(const std::string& filename, DexClasses* classes) {
     auto deobf_cls = deobf_class(cls);
     ofs << JavaNameUtil::internal_to_external(deobf_cls) << " -> "
         << JavaNameUtil::internal_to_external(cls->get_type()->c_str())
-        << ":" << std::endl;
+        << ":\n";
     for (auto field : cls->get_ifields()) {
       auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << field->c_str() << '\n';
     }
     for (auto field : cls->get_sfields()) {
       auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << field->c_str() << '\n';
     }
     for (auto meth : cls->get_dmethods()) {
       auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << meth->c_str() << '\n';
     }
     for (auto meth : cls->get_vmethods()) {
       auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << meth->c_str() << '\n';
     }
   }
 }
@@ -2068,7 +2461,7 @@ void write_bytecode_offset_mapping(
 ) {
   if (filename.empty()) { return; }
 
-  auto fd = fopen(filename.c_str(), "a");
+  auto fd = open_symbol_file(filename);
   assert_log(fd, "Can't open bytecode offset file %s: %s\n",
              filename.c_str(),
              strerror(errno));
@@ -2112,27 +2505,56 @@ void DexOutput::prepare(SortMode string_mode,
                         const std::vector<SortMode>& code_mode,
                         const ConfigFiles& conf,
                         const std::string& dex_magic) {
+  prepare_layout(string_mode, code_mode, conf, dex_magic);
+  finish_layout();
+}
 
+void DexOutput::prepare_layout(SortMode string_mode,
+                               const std::vector<SortMode>& code_mode,
+                               const ConfigFiles& conf,
+                               const std::string& dex_magic) {
   if (std::find(code_mode.begin(), code_mode.end(),
                 SortMode::METHOD_PROFILED_ORDER) != code_mode.end()) {
     m_gtypes->set_method_to_weight(conf.get_method_to_weight());
     m_gtypes->set_method_sorting_whitelisted_substrings(
         conf.get_method_sorting_whitelisted_substrings());
   }
+  // The page count estimate needs the trace whatever the sort modes are.
+  if (!conf.get_method_to_first_execution().empty()) {
+    m_gtypes->set_method_to_first_execution(
+        conf.get_method_to_first_execution());
+  }
+  bool startup_trace_order =
+      std::find(code_mode.begin(), code_mode.end(),
+                SortMode::STARTUP_TRACE_ORDER) != code_mode.end();
+  bool coldstart_order =
+      string_mode == SortMode::COLDSTART_ORDER ||
+      std::find(code_mode.begin(), code_mode.end(),
+                SortMode::COLDSTART_ORDER) != code_mode.end();
+  if (coldstart_order) {
+    m_gtypes->set_coldstart_order(conf.get_coldstart_classes(),
+                                  conf.get_method_to_weight());
+  }
 
-  fix_jumbos(m_classes, dodx);
+  fix_jumbos_and_sync(m_classes, dodx);
   init_header_offsets(dex_magic);
   generate_static_values();
   generate_typelist_data();
   generate_string_data(string_mode);
   generate_code_items(code_mode);
-  generate_class_data_items();
+  generate_class_data_items(startup_trace_order || coldstart_order
+                                ? SortMode::STARTUP_TRACE_ORDER
+                                : SortMode::DEFAULT);
   generate_type_data();
   generate_proto_data();
   generate_field_data();
   generate_method_data();
   generate_class_data();
   generate_annotations();
+  count_startup_pages();
+}
+
+void DexOutput::finish_layout() {
   generate_debug_items();
   generate_map();
   align_output();
@@ -2140,19 +2562,29 @@ void DexOutput::prepare(SortMode string_mode,
 }
 
 void DexOutput::write() {
-  struct stat st;
-  int fd = open(m_filename, O_CREAT | O_TRUNC | O_WRONLY, 0660);
-  if (fd == -1) {
-    perror("Error writing dex");
-    return;
-  }
-  ::write(fd, m_output, m_offset);
-  if (0 == fstat(fd, &st)) {
-    m_stats.num_bytes = st.st_size;
+  if (write_dex()) {
+    write_symbol_files();
   }
-  close(fd);
+}
 
-  write_symbol_files();
+bool DexOutput::write_dex() {
+  // Unmapping hands the dirty pages to the page cache; all that is left is to
+  // cut the file down to what was actually laid out.
+  m_output_file.close();
+  m_output = nullptr;
+  boost::system::error_code ec;
+  boost::filesystem::resize_file(m_tmp_filename, m_offset, ec);
+  if (ec) {
+    fprintf(stderr, "Error writing dex: %s\n", ec.message().c_str());
+    return false;
+  }
+  m_stats.num_bytes = m_offset;
+  boost::filesystem::rename(m_tmp_filename, m_filename, ec);
+  if (ec) {
+    fprintf(stderr, "Error writing dex: %s\n", ec.message().c_str());
+    return false;
+  }
+  return true;
 }
 
 class UniqueReferences {
@@ -2229,50 +2661,73 @@ static SortMode make_sort_bytecode(const std::string& sort_bytecode) {
     return SortMode::CLINIT_FIRST;
   } else if (sort_bytecode == "method_profiled_order") {
     return SortMode::METHOD_PROFILED_ORDER;
+  } else if (sort_bytecode == "startup_trace_order") {
+    return SortMode::STARTUP_TRACE_ORDER;
+  } else if (sort_bytecode == "coldstart_order") {
+    return SortMode::COLDSTART_ORDER;
   } else {
     return SortMode::DEFAULT;
   }
 }
 
-dex_stats_t write_classes_to_dex(
-    const RedexOptions& redex_options,
-    const std::string& filename,
-    DexClasses* classes,
-    LocatorIndex* locator_index,
-    bool emit_name_based_locators,
-    size_t store_number,
-    size_t dex_number,
-    const ConfigFiles& conf,
-    PositionMapper* pos_mapper,
-    std::unordered_map<DexMethod*, uint64_t>* method_to_id,
-    std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
-    IODIMetadata* iodi_metadata,
-    const std::string& dex_magic) {
+namespace {
+
+struct OutputModes {
+  SortMode string_sort_mode{SortMode::DEFAULT};
+  std::vector<SortMode> code_sort_mode;
+  bool normal_primary_dex{false};
+};
+
+OutputModes get_output_modes(const ConfigFiles& conf) {
+  OutputModes modes;
   const JsonWrapper& json_cfg = conf.get_json_config();
   auto sort_strings = json_cfg.get("string_sort_mode", std::string());
-  SortMode string_sort_mode = SortMode::DEFAULT;
   if (sort_strings == "class_strings") {
-    string_sort_mode = SortMode::CLASS_STRINGS;
+    modes.string_sort_mode = SortMode::CLASS_STRINGS;
   } else if (sort_strings == "class_order") {
-    string_sort_mode = SortMode::CLASS_ORDER;
+    modes.string_sort_mode = SortMode::CLASS_ORDER;
+  } else if (sort_strings == "startup_trace_order") {
+    modes.string_sort_mode = SortMode::STARTUP_TRACE_ORDER;
+  } else if (sort_strings == "coldstart_order") {
+    modes.string_sort_mode = SortMode::COLDSTART_ORDER;
   }
 
   auto interdex_config = json_cfg.get("InterDexPass", Json::Value());
-  auto normal_primary_dex =
+  modes.normal_primary_dex =
       interdex_config.get("normal_primary_dex", false).asBool();
   auto sort_bytecode_cfg = json_cfg.get("bytecode_sort_mode", Json::Value());
-  std::vector<SortMode> code_sort_mode;
 
   if (sort_bytecode_cfg.isString()) {
-    code_sort_mode.push_back(make_sort_bytecode(sort_bytecode_cfg.asString()));
+    modes.code_sort_mode.push_back(
+        make_sort_bytecode(sort_bytecode_cfg.asString()));
   } else if (sort_bytecode_cfg.isArray()) {
     for (auto val : sort_bytecode_cfg) {
-      code_sort_mode.push_back(make_sort_bytecode(val.asString()));
+      modes.code_sort_mode.push_back(make_sort_bytecode(val.asString()));
     }
   }
-  if (code_sort_mode.empty()) {
-    code_sort_mode.push_back(SortMode::DEFAULT);
+  if (modes.code_sort_mode.empty()) {
+    modes.code_sort_mode.push_back(SortMode::DEFAULT);
   }
+  return modes;
+}
+
+} // namespace
+
+dex_stats_t write_classes_to_dex(
+    const RedexOptions& redex_options,
+    const std::string& filename,
+    DexClasses* classes,
+    LocatorIndex* locator_index,
+    bool emit_name_based_locators,
+    size_t store_number,
+    size_t dex_number,
+    const ConfigFiles& conf,
+    PositionMapper* pos_mapper,
+    std::unordered_map<DexMethod*, uint64_t>* method_to_id,
+    std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
+    IODIMetadata* iodi_metadata,
+    const std::string& dex_magic) {
+  auto modes = get_output_modes(conf);
 
   TRACE(OPUT, 2, "[write_classes_to_dex][filename] %s", filename.c_str());
 
@@ -2280,7 +2735,7 @@ dex_stats_t write_classes_to_dex(
                              classes,
                              locator_index,
                              emit_name_based_locators,
-                             normal_primary_dex,
+                             modes.normal_primary_dex,
                              store_number,
                              dex_number,
                              redex_options.debug_info_kind,
@@ -2290,12 +2745,267 @@ dex_stats_t write_classes_to_dex(
                              method_to_id,
                              code_debug_lines);
 
-  dout.prepare(string_sort_mode, code_sort_mode, conf, dex_magic);
+  dout.prepare(modes.string_sort_mode, modes.code_sort_mode, conf, dex_magic);
   dout.write();
   dout.metrics();
   return dout.m_stats;
 }
 
+namespace {
+
+void copy_reused_dex(const DexOutputSpec& spec, const ConfigFiles& conf) {
+  TRACE(OPUT, 1, "Reusing unchanged input dex %s for %s",
+        spec.reuse_input.c_str(), spec.filename.c_str());
+  // As in DexOutput::write(), the input may be the very file being replaced.
+  auto tmp_filename = spec.filename + ".tmp";
+  boost::filesystem::copy_file(
+      spec.reuse_input, tmp_filename,
+      boost::filesystem::copy_option::overwrite_if_exists);
+  boost::filesystem::rename(tmp_filename, spec.filename);
+}
+
+/*
+ * Runs tasks on a thread of its own, one at a time and in the order they were
+ * added. add() blocks while `max_pending` tasks are waiting, so that whatever
+ * the tasks hold on to stays bounded.
+ */
+class OrderedBackgroundWriter {
+ public:
+  explicit OrderedBackgroundWriter(size_t max_pending)
+      : m_max_pending(max_pending), m_thread([this] { run(); }) {}
+
+  ~OrderedBackgroundWriter() { join(); }
+
+  void add(std::function<void()> task) {
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_changed.wait(guard, [&] { return m_tasks.size() < m_max_pending; });
+    m_tasks.push_back(std::move(task));
+    m_changed.notify_all();
+  }
+
+  /*
+   * Waits for all the tasks and rethrows the first exception that one of them
+   * threw. The tasks after a failed one are dropped.
+   */
+  void finish() {
+    join();
+    if (m_exception) {
+      std::rethrow_exception(m_exception);
+    }
+  }
+
+ private:
+  void join() {
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_done = true;
+      m_changed.notify_all();
+    }
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+  }
+
+  void run() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_changed.wait(guard, [&] { return m_done || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_changed.notify_all();
+      }
+      if (!m_exception) {
+        try {
+          task();
+        } catch (...) {
+          m_exception = std::current_exception();
+        }
+      }
+    }
+  }
+
+  size_t m_max_pending;
+  std::mutex m_lock;
+  std::condition_variable m_changed;
+  std::deque<std::function<void()>> m_tasks;
+  bool m_done{false};
+  // Only touched by m_thread until it is joined.
+  std::exception_ptr m_exception;
+  boost::thread m_thread;
+};
+
+} // namespace
+
+std::vector<dex_stats_t> write_classes_to_dexes(
+    const RedexOptions& redex_options,
+    const std::vector<DexOutputSpec>& dexes,
+    LocatorIndex* locator_index,
+    bool emit_name_based_locators,
+    const ConfigFiles& conf,
+    PositionMapper* pos_mapper,
+    std::unordered_map<DexMethod*, uint64_t>* method_to_id,
+    std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
+    IODIMetadata* iodi_metadata,
+    const std::string& dex_magic,
+    size_t num_threads) {
+  auto modes = get_output_modes(conf);
+  // Every DexOutput maps k_max_dex_size of output file, so only let the workers
+  // run this far ahead of the dex being finished.
+  const size_t max_in_flight = std::max<size_t>(1, num_threads) * 2;
+
+  struct Slot {
+    std::unique_ptr<DexOutput> output;
+    std::exception_ptr exception;
+    bool ready{false};
+  };
+  std::vector<Slot> slots(dexes.size());
+  std::mutex lock;
+  std::condition_variable changed;
+  size_t next = 0;
+  size_t num_finished = 0;
+  bool aborted = false;
+
+  auto worker = [&] {
+    while (true) {
+      size_t i;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] {
+          return aborted || next >= dexes.size() ||
+                 next < num_finished + max_in_flight;
+        });
+        if (aborted || next >= dexes.size()) {
+          return;
+        }
+        i = next++;
+      }
+      const auto& spec = dexes[i];
+      TRACE(OPUT, 2, "[write_classes_to_dexes][filename] %s",
+            spec.filename.c_str());
+      std::unique_ptr<DexOutput> output;
+      std::exception_ptr exception;
+      // Reused dexes have nothing to lay out; they are copied in order below.
+      if (spec.reuse_input.empty()) {
+        try {
+          output = std::make_unique<DexOutput>(spec.filename.c_str(),
+                                               spec.classes,
+                                               locator_index,
+                                               emit_name_based_locators,
+                                               modes.normal_primary_dex,
+                                               spec.store_number,
+                                               spec.dex_number,
+                                               redex_options.debug_info_kind,
+                                               iodi_metadata,
+                                               conf,
+                                               pos_mapper,
+                                               method_to_id,
+                                               code_debug_lines);
+          output->prepare_layout(modes.string_sort_mode, modes.code_sort_mode,
+                                 conf, dex_magic);
+        } catch (...) {
+          exception = std::current_exception();
+        }
+      }
+      std::lock_guard<std::mutex> guard(lock);
+      slots[i].output = std::move(output);
+      slots[i].exception = exception;
+      slots[i].ready = true;
+      changed.notify_all();
+    }
+  };
+
+  std::vector<boost::thread> threads;
+  for (size_t t = 0; t < std::min(std::max<size_t>(1, num_threads),
+                                  dexes.size());
+       ++t) {
+    threads.emplace_back(worker);
+  }
+
+  // The symbol files are written behind the dexes, still in dex order. Each
+  // pending DexOutput keeps its index tables alive, so this is bounded too.
+  OrderedBackgroundWriter symbol_writer(max_in_flight);
+
+  std::vector<dex_stats_t> stats;
+  std::exception_ptr exception;
+  for (size_t i = 0; i < dexes.size() && !exception; ++i) {
+    std::unique_ptr<DexOutput> output;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      changed.wait(guard, [&] { return slots[i].ready; });
+      output = std::move(slots[i].output);
+      exception = slots[i].exception;
+    }
+    if (!exception) {
+      try {
+        const auto& spec = dexes[i];
+        if (!spec.reuse_input.empty()) {
+          copy_reused_dex(spec, conf);
+          stats.push_back(spec.reuse_stats);
+          symbol_writer.add([&spec, &conf] {
+            write_pg_mapping(conf.metafile(REDEX_PG_MAPPING), spec.classes);
+          });
+        } else {
+          output->finish_layout();
+          bool written = output->write_dex();
+          output->metrics();
+          stats.push_back(output->m_stats);
+          if (written) {
+            std::shared_ptr<DexOutput> shared_output(std::move(output));
+            symbol_writer.add(
+                [shared_output] { shared_output->write_symbol_files(); });
+          }
+        }
+      } catch (...) {
+        exception = std::current_exception();
+      }
+    }
+    output.reset();
+    std::lock_guard<std::mutex> guard(lock);
+    ++num_finished;
+    aborted = exception != nullptr;
+    changed.notify_all();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+  symbol_writer.finish();
+  return stats;
+}
+
+void write_locator_hash_index(const LocatorIndex& index,
+                              const std::string& path) {
+  // The order of the classes only matters for the seeds that get picked, but
+  // the output should not depend on the order of the unordered map.
+  std::vector<const LocatorIndex::value_type*> entries;
+  entries.reserve(index.size());
+  for (const auto& pair : index) {
+    entries.push_back(&pair);
+  }
+  std::sort(entries.begin(), entries.end(), [](auto* a, auto* b) {
+    return a->first->str() < b->first->str();
+  });
+  std::vector<std::pair<std::string, Locator>> classes;
+  classes.reserve(entries.size());
+  for (auto* entry : entries) {
+    classes.emplace_back(entry->first->str(), entry->second);
+  }
+  auto data = facebook::LocatorHashIndex::build(classes);
+  std::ofstream ofs(path, std::ofstream::out | std::ofstream::binary |
+                              std::ofstream::trunc);
+  always_assert_log(ofs.is_open(), "Can not open %s", path.c_str());
+  ofs.write(data.data(), data.size());
+  TRACE(LOC, 1, "Wrote a locator hash index of %lu classes to %s",
+        classes.size(), path.c_str());
+}
+
 LocatorIndex make_locator_index(DexStoresVector& stores,
                                 bool emit_name_based_locators) {
   LocatorIndex index;
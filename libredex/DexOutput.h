@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <unordered_map>
 
 #include "ConfigFiles.h"
@@ -29,11 +30,24 @@ using LocatorIndex = std::unordered_map<DexString*, Locator>;
 LocatorIndex make_locator_index(DexStoresVector& stores,
                                 bool emit_name_based_locators);
 
+/*
+ * Writes the index as a facebook::LocatorHashIndex, which class loaders can
+ * look classes up in without decoding locator strings.
+ */
+void write_locator_hash_index(const LocatorIndex& index,
+                              const std::string& path);
+
 enum class SortMode {
   CLASS_ORDER,
   CLASS_STRINGS,
   CLINIT_FIRST,
   METHOD_PROFILED_ORDER,
+  // Whatever the startup method trace touches first comes first: see
+  // GatheredTypes::set_method_to_first_execution().
+  STARTUP_TRACE_ORDER,
+  // The same layout, with the coldstart classes and the hot methods standing
+  // in for a trace: see GatheredTypes::set_coldstart_order().
+  COLDSTART_ORDER,
   DEFAULT
 };
 
@@ -109,6 +123,42 @@ dex_stats_t write_classes_to_dex(
     IODIMetadata* iodi_metadata,
     const std::string& dex_magic);
 
+/*
+ * One dex for write_classes_to_dexes().
+ */
+struct DexOutputSpec {
+  std::string filename;
+  DexClasses* classes;
+  size_t store_number;
+  size_t dex_number;
+  // If set, `classes` are exactly the classes of this input dex, unchanged
+  // since it was loaded, and the input is copied instead of being re-encoded.
+  // Only the ProGuard mapping is written for it; the caller must not ask for
+  // symbol files that need the encoded layout.
+  std::string reuse_input{};
+  dex_stats_t reuse_stats{};
+};
+
+/*
+ * Same as calling write_classes_to_dex() on each of `dexes` in turn, but lays
+ * out up to `num_threads` of them at once. Only the debug items, whose line
+ * numbers come from the shared PositionMapper and IODI metadata, and the
+ * symbol files are emitted one dex at a time, in order, so the output is the
+ * same as the serial one.
+ */
+std::vector<dex_stats_t> write_classes_to_dexes(
+    const RedexOptions&,
+    const std::vector<DexOutputSpec>& dexes,
+    LocatorIndex* locator_index /* nullable */,
+    bool emit_name_based_locators,
+    const ConfigFiles& conf,
+    PositionMapper* line_mapper,
+    std::unordered_map<DexMethod*, uint64_t>* method_to_id,
+    std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
+    IODIMetadata* iodi_metadata,
+    const std::string& dex_magic,
+    size_t num_threads);
+
 typedef bool (*cmp_dstring)(const DexString*, const DexString*);
 typedef bool (*cmp_dtype)(const DexType*, const DexType*);
 typedef bool (*cmp_dproto)(const DexProto*, const DexProto*);
@@ -156,25 +206,43 @@ class GatheredTypes {
   std::unordered_map<const DexMethod*, unsigned int> m_methods_in_cls_order;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
+  // The ranks of the methods, classes and strings of this dex that startup
+  // touches, in the order it touches them.
+  std::unordered_map<const DexMethod*, unsigned int> m_startup_methods;
+  std::unordered_map<const DexClass*, unsigned int> m_startup_classes;
+  std::unordered_map<const DexString*, unsigned int> m_startup_strings;
 
   void gather_components();
-  dexstring_to_idx* get_string_index(cmp_dstring cmp = compare_dexstrings);
-  dextype_to_idx* get_type_index(cmp_dtype cmp = compare_dextypes);
-  dexproto_to_idx* get_proto_index(cmp_dproto cmp = compare_dexprotos);
-  dexfield_to_idx* get_field_index(cmp_dfield cmp = compare_dexfields);
-  dexmethod_to_idx* get_method_index(cmp_dmethod cmp = compare_dexmethods);
+  /*
+   * The indices are assigned in the order the dex format requires. Strings
+   * are radix sorted (see sort_dexstrings); everything else is sorted on the
+   * indices of the strings and types it refers to, which gives the same
+   * order as compare_dextypes and friends without comparing any strings.
+   */
+  dexstring_to_idx* get_string_index();
+  dextype_to_idx* get_type_index(const dexstring_to_idx& sidx);
+  dexproto_to_idx* get_proto_index(const dextype_to_idx& tidx);
+  dexfield_to_idx* get_field_index(const dexstring_to_idx& sidx,
+                                   const dextype_to_idx& tidx);
+  dexmethod_to_idx* get_method_index(const dexstring_to_idx& sidx,
+                                     const dextype_to_idx& tidx,
+                                     const dexproto_to_idx& pidx);
 
   void build_cls_load_map();
   void build_cls_map();
   void build_method_map();
+  void add_startup_class(const DexClass* cls);
+  void add_startup_method(const DexMethod* method, const DexClass* cls);
 
  public:
   GatheredTypes(DexClasses* classes);
   DexOutputIdx* get_dodx(const uint8_t* base);
-  template <class T = decltype(compare_dexstrings)>
-  std::vector<DexString*> get_dexstring_emitlist(T cmp = compare_dexstrings);
+  std::vector<DexString*> get_dexstring_emitlist();
+  template <class T>
+  std::vector<DexString*> get_dexstring_emitlist(T cmp);
   std::vector<DexString*> get_cls_order_dexstring_emitlist();
   std::vector<DexString*> keep_cls_strings_together_emitlist();
+  std::vector<DexString*> get_startup_trace_dexstring_emitlist();
   std::vector<DexMethod*> get_dexmethod_emitlist();
 
   void gather_class(int num);
@@ -183,11 +251,44 @@ class GatheredTypes {
   void sort_dexmethod_emitlist_cls_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_clinit_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_profiled_order(std::vector<DexMethod*>& lmeth);
+  void sort_dexmethod_emitlist_startup_trace_order(
+      std::vector<DexMethod*>& lmeth);
+  void sort_classes_startup_trace_order(std::vector<DexClass*>& classes);
   void set_method_sorting_whitelisted_substrings(
       const std::unordered_set<std::string>& whitelisted_substrings);
   void set_method_to_weight(
       const std::unordered_map<std::string, unsigned int>& method_to_weight);
 
+  /*
+   * Ranks the traced methods of this dex by the time they first ran, their
+   * classes by their first traced method, and the strings by the first time a
+   * traced method or its class needs them: its class name and source file,
+   * its name, and the strings of its code and annotations. Laying out items
+   * in rank order packs what startup touches into as few pages as possible.
+   */
+  void set_method_to_first_execution(
+      const std::unordered_map<std::string, uint64_t>&
+          method_to_first_execution);
+  /*
+   * Ranks the items of this dex like set_method_to_first_execution() does,
+   * as if startup ran all the methods of the coldstart classes, in the order
+   * of the list, and then the other hot methods of the profile by decreasing
+   * weight. Replaces the ranks of the trace, if any.
+   */
+  void set_coldstart_order(
+      const std::vector<std::string>& coldstart_classes,
+      const std::unordered_map<std::string, unsigned int>& method_to_weight);
+  bool has_startup_trace() const { return !m_startup_classes.empty(); }
+  bool is_startup_method(const DexMethod* method) const {
+    return m_startup_methods.count(method);
+  }
+  bool is_startup_class(const DexClass* cls) const {
+    return m_startup_classes.count(cls);
+  }
+  bool is_startup_string(const DexString* str) const {
+    return m_startup_strings.count(str);
+  }
+
   std::unordered_set<DexString*> index_type_names();
 };
 
@@ -198,10 +299,10 @@ std::vector<DexString*> GatheredTypes::get_dexstring_emitlist(T cmp) {
   return strlist;
 }
 
-typedef std::map<DexAnnotation*, uint32_t> annomap_t;
-typedef std::map<DexAnnotationSet*, uint32_t> asetmap_t;
-typedef std::map<ParamAnnotations*, uint32_t> xrefmap_t;
-typedef std::map<DexAnnotationDirectory*, uint32_t> adirmap_t;
+typedef std::unordered_map<DexAnnotation*, uint32_t> annomap_t;
+typedef std::unordered_map<DexAnnotationSet*, uint32_t> asetmap_t;
+typedef std::unordered_map<ParamAnnotations*, uint32_t> xrefmap_t;
+typedef std::unordered_map<DexAnnotationDirectory*, uint32_t> adirmap_t;
 
 struct CodeItemEmit {
   DexMethod* method;
@@ -219,6 +320,8 @@ class DexOutput {
   DexClasses* m_classes;
   DexOutputIdx* dodx;
   GatheredTypes* m_gtypes;
+  boost::iostreams::mapped_file m_output_file;
+  std::string m_tmp_filename;
   uint8_t* m_output;
   uint32_t m_offset;
   const char* m_filename;
@@ -245,6 +348,11 @@ class DexOutput {
   bool m_normal_primary_dex;
   const ConfigFiles& m_config_files;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
+  // The [offset, offset + size) ranges of the items that the startup trace
+  // touches, for the page count estimate.
+  std::vector<std::pair<uint32_t, uint32_t>> m_startup_code_ranges;
+  std::vector<std::pair<uint32_t, uint32_t>> m_startup_string_ranges;
+  std::vector<std::pair<uint32_t, uint32_t>> m_startup_class_data_ranges;
 
   void insert_map_item(uint16_t typeidx,
                        uint32_t size,
@@ -256,7 +364,9 @@ class DexOutput {
   void generate_field_data();
   void generate_method_data();
   void generate_class_data();
-  void generate_class_data_items();
+  // In STARTUP_TRACE_ORDER, the class data items of the classes that the
+  // startup trace touches come first, in the order it touches them.
+  void generate_class_data_items(SortMode mode = SortMode::DEFAULT);
 
   // Sort code according to a sequence of sorting modes, ordered by precedence.
   // e.g. passing {SortMode::CLINIT_FIRST, SortMode::CLASS_ORDER} means that
@@ -280,9 +390,10 @@ class DexOutput {
   void generate_debug_items();
   void generate_typelist_data();
   void generate_map();
+  // Estimates the number of pages that startup touches; see dex_stats_t.
+  void count_startup_pages();
   void finalize_header();
   void init_header_offsets(const std::string& dex_magic);
-  void write_symbol_files();
   void align_output() { m_offset = (m_offset + 3) & ~3; }
   void emit_locator(Locator locator);
   void emit_name_based_locators();
@@ -309,7 +420,25 @@ class DexOutput {
                const std::vector<SortMode>& code_mode,
                const ConfigFiles& conf,
                const std::string& dex_magic);
+  /*
+   * prepare() in two steps. The first touches nothing outside of this dex;
+   * the second emits the debug items, which register positions with the
+   * shared PositionMapper.
+   */
+  void prepare_layout(SortMode string_mode,
+                      const std::vector<SortMode>& code_mode,
+                      const ConfigFiles& conf,
+                      const std::string& dex_magic);
+  void finish_layout();
   void write();
+  /*
+   * write() in two steps. The symbol files go to files shared by all the dexes
+   * and fill in the shared method ids, so they must be written in dex order;
+   * the dex itself can be written independently. write_dex() returns false
+   * if the dex could not be written.
+   */
+  bool write_dex();
+  void write_symbol_files();
   void metrics();
   static void check_method_instruction_size_limit(const ConfigFiles& conf,
                                                   int size,
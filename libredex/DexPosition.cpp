@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/functional/hash.hpp>
 #include <fstream>
 #include <iostream>
 #include <json/json.h>
@@ -30,19 +31,64 @@ bool DexPosition::operator==(const DexPosition& that) const {
            *parent == *that.parent));
 }
 
+constexpr uint32_t RealPositionMapper::kNoParent;
+constexpr int64_t RealPositionMapper::kUnregistered;
+
+size_t RealPositionMapper::KeyHash::operator()(const Key& key) const {
+  size_t seed = 0;
+  boost::hash_combine(seed, key.method);
+  boost::hash_combine(seed, key.file);
+  boost::hash_combine(seed, key.line);
+  boost::hash_combine(seed, key.parent);
+  return seed;
+}
+
+uint32_t RealPositionMapper::intern(DexPosition* pos) {
+  auto it = m_interned.find(pos);
+  if (it != m_interned.end()) {
+    return it->second;
+  }
+  // Interning a parent does not register it: a parent that was never
+  // registered is still reported when the map is written.
+  uint32_t parent = pos->parent == nullptr ? kNoParent : intern(pos->parent);
+  Key key{pos->method, pos->file, pos->line, parent};
+  auto id_it = m_position_ids.find(key);
+  uint32_t id;
+  if (id_it != m_position_ids.end()) {
+    id = id_it->second;
+  } else {
+    always_assert(m_positions.size() < kNoParent);
+    id = m_positions.size();
+    m_positions.push_back(pos);
+    m_lines.push_back(kUnregistered);
+    m_position_ids.emplace(key, id);
+  }
+  m_interned.emplace(pos, id);
+  return id;
+}
+
 void RealPositionMapper::register_position(DexPosition* pos) {
-  m_pos_line_map[pos] = -1;
+  auto id = intern(pos);
+  if (m_lines[id] == kUnregistered) {
+    m_lines[id] = -1;
+  }
 }
 
 uint32_t RealPositionMapper::get_line(DexPosition* pos) {
-  return m_pos_line_map.at(pos) + 1;
+  auto line = m_lines.at(m_interned.at(pos));
+  if (line == kUnregistered) {
+    throw std::out_of_range("position was not registered");
+  }
+  return line + 1;
 }
 
 uint32_t RealPositionMapper::position_to_line(DexPosition* pos) {
-  auto idx = m_positions.size();
-  m_positions.emplace_back(pos);
-  m_pos_line_map[pos] = idx;
-  return get_line(pos);
+  auto id = intern(pos);
+  if (m_lines[id] < 0) {
+    m_lines[id] = m_emitted.size();
+    m_emitted.push_back(id);
+  }
+  return m_lines[id] + 1;
 }
 
 void RealPositionMapper::write_map() {
@@ -54,12 +100,10 @@ void RealPositionMapper::write_map() {
 void RealPositionMapper::write_map_v2() {
   // to ensure that the line numbers in the Dex are as compact as possible,
   // we put the emitted positions at the start of the list and rest at the end
-  for (auto item : m_pos_line_map) {
-    auto line = item.second;
-    if (line == -1) {
-      auto idx = m_positions.size();
-      m_positions.emplace_back(item.first);
-      m_pos_line_map[item.first] = idx;
+  for (uint32_t id = 0; id < m_lines.size(); ++id) {
+    if (m_lines[id] == -1) {
+      m_lines[id] = m_emitted.size();
+      m_emitted.push_back(id);
     }
   }
   /*
@@ -74,6 +118,13 @@ void RealPositionMapper::write_map_v2() {
    * Each member of the string pool is encoded as follows:
    * string_length (4 bytes)
    * char[string_length]
+   *
+   * Version 3 (m_compact) replaces the string pool so that a reader can find
+   * any string without walking the pool:
+   * string_pool_size (4 bytes)
+   * string_offsets[string_pool_size + 1] (4 bytes each, relative to the
+   *   start of the string data; string i ends where string i + 1 starts)
+   * string data, padded with zeroes to a multiple of 4 bytes
    */
   std::ostringstream pos_out;
   std::unordered_map<std::string, uint32_t> string_ids;
@@ -87,7 +138,8 @@ void RealPositionMapper::write_map_v2() {
     return string_ids.at(s);
   };
 
-  for (auto pos : m_positions) {
+  for (auto id : m_emitted) {
+    auto pos = m_positions[id];
     uint32_t parent_line = 0;
     try {
       parent_line = pos->parent == nullptr ? 0 : get_line(pos->parent);
@@ -118,28 +170,43 @@ void RealPositionMapper::write_map_v2() {
                     std::ofstream::out | std::ofstream::trunc);
   uint32_t magic = 0xfaceb000; // serves as endianess check
   ofs.write((const char*)&magic, sizeof(magic));
-  uint32_t version = 2;
+  uint32_t version = m_compact ? 3 : 2;
   ofs.write((const char*)&version, sizeof(version));
   uint32_t spool_count = string_pool.size();
   ofs.write((const char*)&spool_count, sizeof(spool_count));
-  for (auto s : string_pool) {
-    uint32_t ssize = s.size();
-    ofs.write((const char*)&ssize, sizeof(ssize));
-    ofs << s;
+  if (m_compact) {
+    uint32_t string_offset = 0;
+    for (const auto& s : string_pool) {
+      ofs.write((const char*)&string_offset, sizeof(string_offset));
+      string_offset += s.size();
+    }
+    ofs.write((const char*)&string_offset, sizeof(string_offset));
+    for (const auto& s : string_pool) {
+      ofs << s;
+    }
+    static const char padding[4] = {};
+    ofs.write(padding, (4 - string_offset % 4) % 4);
+  } else {
+    for (auto s : string_pool) {
+      uint32_t ssize = s.size();
+      ofs.write((const char*)&ssize, sizeof(ssize));
+      ofs << s;
+    }
   }
-  uint32_t pos_count = m_positions.size();
+  uint32_t pos_count = m_emitted.size();
   ofs.write((const char*)&pos_count, sizeof(pos_count));
   ofs << pos_out.str();
 }
 
-PositionMapper* PositionMapper::make(const std::string& map_filename_v2) {
+PositionMapper* PositionMapper::make(const std::string& map_filename_v2,
+                                     bool compact) {
   if (map_filename_v2 == "") {
     // If no path is provided for the map, just pass the original line numbers
     // through to the output. This does mean that the line numbers will be
     // incorrect for inlined code.
     return new NoopPositionMapper();
   } else {
-    return new RealPositionMapper(map_filename_v2);
+    return new RealPositionMapper(map_filename_v2, compact);
   }
 }
 
@@ -12,12 +12,14 @@
 #include <unordered_map>
 #include <vector>
 
+#include "ObjectPool.h"
+
 class DexClass;
 class DexMethod;
 class DexString;
 class DexDebugItem;
 
-struct DexPosition final {
+struct DexPosition final : PooledObject<DexPosition> {
   DexString* method{nullptr};
   DexString* file{nullptr};
   uint32_t line;
@@ -38,7 +40,12 @@ class PositionMapper {
   virtual uint32_t position_to_line(DexPosition*) = 0;
   virtual void register_position(DexPosition* pos) = 0;
   virtual void write_map() = 0;
-  static PositionMapper* make(const std::string& map_filename_v2);
+  /*
+   * With `compact`, the map is written as version 3, which can be queried
+   * straight from a mapping of the file; see write_map_v2().
+   */
+  static PositionMapper* make(const std::string& map_filename_v2,
+                              bool compact = false);
 };
 
 /*
@@ -48,16 +55,54 @@ class PositionMapper {
  * the Dex debug info indicate the line in this text file at which the real
  * position can be found.
  */
+/*
+ * Inlining leaves many DexPositions that are copies of one another: every
+ * inlined copy of a callee carries the callee's positions, with equal parents.
+ * RealPositionMapper interns positions by (method, file, line, parent), so an
+ * emitted line number and a map entry are allocated once per distinct
+ * position rather than once per DexPosition object.
+ */
 class RealPositionMapper : public PositionMapper {
+  struct Key {
+    const DexString* method;
+    const DexString* file;
+    uint32_t line;
+    // Index of the interned parent in m_positions, or kNoParent.
+    uint32_t parent;
+
+    bool operator==(const Key& that) const {
+      return method == that.method && file == that.file &&
+             line == that.line && parent == that.parent;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  static constexpr uint32_t kNoParent = 0xffffffff;
+  static constexpr int64_t kUnregistered = -2;
+
   std::string m_filename_v2;
+  bool m_compact;
+  // The interned positions, in the order of their ids.
   std::vector<DexPosition*> m_positions;
-  std::unordered_map<DexPosition*, int64_t> m_pos_line_map;
+  std::unordered_map<Key, uint32_t, KeyHash> m_position_ids;
+  std::unordered_map<const DexPosition*, uint32_t> m_interned;
+  // The line assigned to each interned position, indexed by id: -1 if it was
+  // registered but has no line yet, kUnregistered if it was only interned as
+  // the parent of another position.
+  std::vector<int64_t> m_lines;
+  // Ids of the positions that have lines, in the order of their lines.
+  std::vector<uint32_t> m_emitted;
+
+  uint32_t intern(DexPosition* pos);
+
  protected:
   uint32_t get_line(DexPosition*);
   void write_map_v2();
+
  public:
-  RealPositionMapper(const std::string& filename_v2)
-      : m_filename_v2(filename_v2) {}
+  RealPositionMapper(const std::string& filename_v2, bool compact = false)
+      : m_filename_v2(filename_v2), m_compact(compact) {}
   DexString* get_source_file(const DexClass*) override;
   uint32_t position_to_line(DexPosition*) override;
   void register_position(DexPosition* pos) override;
@@ -487,6 +487,25 @@ size_t sum_param_sizes(const IRCode* code) {
   return size;
 }
 
+bool calls_stringbuilder_tostring(const IRCode* code) {
+  auto tostring = DexMethod::get_method(
+      "Ljava/lang/StringBuilder;.toString:()Ljava/lang/String;");
+  if (tostring == nullptr) {
+    return false;
+  }
+  bool found = false;
+  editable_cfg_adapter::iterate(code, [&](const MethodItemEntry& mie) {
+    auto insn = mie.insn;
+    if (insn->opcode() == OPCODE_INVOKE_VIRTUAL &&
+        insn->get_method() == tostring) {
+      found = true;
+      return editable_cfg_adapter::LOOP_BREAK;
+    }
+    return editable_cfg_adapter::LOOP_CONTINUE;
+  });
+  return found;
+}
+
 dex_stats_t&
   operator+=(dex_stats_t& lhs, const dex_stats_t& rhs) {
   lhs.num_types += rhs.num_types;
@@ -516,6 +535,10 @@ dex_stats_t&
   lhs.dbg_total_size += rhs.dbg_total_size;
   lhs.map_list_num_strings += rhs.map_list_num_strings;
   lhs.map_list_strings_bytes += rhs.map_list_strings_bytes;
+  lhs.num_startup_code_pages += rhs.num_startup_code_pages;
+  lhs.num_startup_string_pages += rhs.num_startup_string_pages;
+  lhs.num_startup_class_data_pages += rhs.num_startup_class_data_pages;
+  lhs.num_startup_pages += rhs.num_startup_pages;
   return lhs;
 }
 
@@ -542,47 +565,61 @@ bool is_subclass(const DexType* parent, const DexType* child) {
   return false;
 }
 
-void change_visibility(DexMethod* method, DexType* scope) {
+void VisibilityChanges::insert(const VisibilityChanges& other) {
+  classes.insert(other.classes.begin(), other.classes.end());
+  fields.insert(other.fields.begin(), other.fields.end());
+  methods.insert(other.methods.begin(), other.methods.end());
+}
+
+void VisibilityChanges::apply() const {
+  for (auto cls : classes) {
+    set_public(cls);
+  }
+  for (auto field : fields) {
+    set_public(field);
+  }
+  for (auto method : methods) {
+    set_public(method);
+  }
+}
+
+VisibilityChanges get_visibility_changes(DexMethod* method, DexType* scope) {
   auto code = method->get_code();
   always_assert(code != nullptr);
 
-  editable_cfg_adapter::iterate(code, [scope](MethodItemEntry& mie) {
+  VisibilityChanges changes;
+  auto add_class = [&changes](DexClass* cls) {
+    if (cls != nullptr && !cls->is_external()) {
+      changes.classes.insert(cls);
+    }
+  };
+  editable_cfg_adapter::iterate(code, [&](MethodItemEntry& mie) {
     auto insn = mie.insn;
 
     if (insn->has_field()) {
-      auto cls = type_class(insn->get_field()->get_class());
-      if (cls != nullptr && !cls->is_external()) {
-        set_public(cls);
-      }
+      add_class(type_class(insn->get_field()->get_class()));
       auto field =
           resolve_field(insn->get_field(), is_sfield_op(insn->opcode())
               ? FieldSearch::Static : FieldSearch::Instance);
       if (field != nullptr && field->is_concrete()) {
-        set_public(field);
-        set_public(type_class(field->get_class()));
+        changes.fields.insert(field);
+        changes.classes.insert(type_class(field->get_class()));
         // FIXME no point in rewriting opcodes in the method
         insn->set_field(field);
       }
     } else if (insn->has_method()) {
-      auto cls = type_class(insn->get_method()->get_class());
-      if (cls != nullptr && !cls->is_external()) {
-        set_public(cls);
-      }
+      add_class(type_class(insn->get_method()->get_class()));
       auto current_method = resolve_method(
           insn->get_method(), opcode_to_search(insn));
       if (current_method != nullptr && current_method->is_concrete() &&
           (scope == nullptr || current_method->get_class() != scope)) {
-        set_public(current_method);
-        set_public(type_class(current_method->get_class()));
+        changes.methods.insert(current_method);
+        changes.classes.insert(type_class(current_method->get_class()));
         // FIXME no point in rewriting opcodes in the method
         insn->set_method(current_method);
       }
     } else if (insn->has_type()) {
-      auto type = insn->get_type();
-      auto cls = type_class(type);
-      if (cls != nullptr && !cls->is_external()) {
-        set_public(cls);
-      }
+      add_class(type_class(insn->get_type()));
     }
     return editable_cfg_adapter::LOOP_CONTINUE;
   });
@@ -594,11 +631,13 @@ void change_visibility(DexMethod* method, DexType* scope) {
     code->gather_catch_types(types);
   }
   for (auto type : types) {
-    auto cls = type_class(type);
-    if (cls != nullptr && !cls->is_external()) {
-      set_public(cls);
-    }
+    add_class(type_class(type));
   }
+  return changes;
+}
+
+void change_visibility(DexMethod* method, DexType* scope) {
+  get_visibility_changes(method, scope).apply();
 }
 
 // Check that visibility / accessibility changes to the current method
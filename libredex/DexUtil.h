@@ -290,6 +290,29 @@ bool is_subclass(const DexType* parent, const DexType* child);
  */
 void change_visibility(DexMethod* method, DexType* scope = nullptr);
 
+/**
+ * The members that change_visibility would make public, so that they can be
+ * gathered for many methods in parallel and then made public in one go.
+ */
+struct VisibilityChanges {
+  std::unordered_set<DexClass*> classes;
+  std::unordered_set<DexField*> fields;
+  std::unordered_set<DexMethod*> methods;
+
+  void insert(const VisibilityChanges& other);
+
+  void apply() const;
+};
+
+/**
+ * What change_visibility(method, scope) would make public. Like
+ * change_visibility, this also points the field and method references of the
+ * code at their resolved definitions; as that only touches the code of the
+ * given method, it can run for different methods in parallel.
+ */
+VisibilityChanges get_visibility_changes(DexMethod* method,
+                                         DexType* scope = nullptr);
+
 /**
  * NOTE: Only relocates the method. Doesn't check the correctness here,
  *       nor does it make sure that the members are accessible from the
@@ -426,6 +449,13 @@ void create_store(const std::string& store_name,
  */
 size_t sum_param_sizes(const IRCode*);
 
+/*
+ * Whether the code calls StringBuilder.toString(). The StringBuilder
+ * analyses only find something to do at such calls, so they check this
+ * before building a CFG and running a fixpoint.
+ */
+bool calls_stringbuilder_tostring(const IRCode* code);
+
 /**
  * Determine if the given dex item has the given annotation
  *
@@ -488,6 +518,14 @@ struct dex_stats_t {
 
   int map_list_num_strings = 0;
   int map_list_strings_bytes = 0;
+
+  // Estimated 4K pages with code items, string data and class data items
+  // that the startup method trace touches, and all of them together. Zero
+  // without a trace.
+  int num_startup_code_pages = 0;
+  int num_startup_string_pages = 0;
+  int num_startup_class_data_pages = 0;
+  int num_startup_pages = 0;
 };
 
 dex_stats_t&
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "EdgeProfile.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+#include "Debug.h"
+
+namespace instrument {
+
+namespace {
+
+struct UnionFind {
+  std::vector<uint32_t> parents;
+
+  explicit UnionFind(size_t size) : parents(size) {
+    std::iota(parents.begin(), parents.end(), 0);
+  }
+
+  uint32_t find(uint32_t n) {
+    while (parents[n] != n) {
+      parents[n] = parents[parents[n]];
+      n = parents[n];
+    }
+    return n;
+  }
+
+  // Returns false if a and b were joined already.
+  bool unite(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+      return false;
+    }
+    parents[a] = b;
+    return true;
+  }
+};
+
+} // namespace
+
+std::vector<bool> choose_counted_edges(const EdgeProfileGraph& graph) {
+  const auto& edges = graph.edges;
+  UnionFind components(graph.num_blocks + 1);
+  // The virtual edge from the exit to the entry.
+  components.unite(graph.exit(), graph.entry);
+
+  std::vector<size_t> order(edges.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return edges[a].weight > edges[b].weight;
+  });
+  std::vector<bool> counted(edges.size(), true);
+  for (auto i : order) {
+    const auto& e = edges[i];
+    always_assert(e.src <= graph.num_blocks && e.dst <= graph.num_blocks);
+    if (e.src != graph.exit() && components.unite(e.src, e.dst)) {
+      counted[i] = false;
+    }
+  }
+  return counted;
+}
+
+std::vector<uint64_t> derive_block_counts(const EdgeProfileGraph& graph,
+                                          const std::vector<bool>& counted,
+                                          std::vector<uint64_t>& edge_counts) {
+  const auto& edges = graph.edges;
+  always_assert(counted.size() == edges.size());
+  edge_counts.resize(edges.size());
+
+  // The virtual edge is the last one.
+  const size_t num_edges = edges.size() + 1;
+  auto src = [&](size_t i) {
+    return i < edges.size() ? edges[i].src : graph.exit();
+  };
+  auto dst = [&](size_t i) {
+    return i < edges.size() ? edges[i].dst : graph.entry;
+  };
+  std::vector<int64_t> counts(num_edges, 0);
+  std::vector<bool> known(num_edges, false);
+  std::vector<std::vector<size_t>> incident(graph.num_blocks + 1);
+  std::vector<size_t> num_unknown(graph.num_blocks + 1, 0);
+  for (size_t i = 0; i < num_edges; i++) {
+    if (i < edges.size() && counted[i]) {
+      counts[i] = edge_counts[i];
+      known[i] = true;
+    } else if (src(i) == dst(i)) {
+      // Flow conservation says nothing about an uncounted self-loop.
+      known[i] = true;
+    }
+    // Exceptions come into catch blocks from wherever they were thrown, not
+    // from the exit, so the edges from the exit to catch blocks (which are
+    // counted) only take part in the balance of the catch block.
+    if (i == edges.size() || src(i) != graph.exit()) {
+      incident[src(i)].push_back(i);
+    }
+    if (src(i) != dst(i)) {
+      incident[dst(i)].push_back(i);
+    }
+    if (!known[i]) {
+      num_unknown[src(i)]++;
+      num_unknown[dst(i)]++;
+    }
+  }
+
+  // Peel off the nodes with a single unknown edge, like leaves of the tree.
+  // The blocks that may throw are only used once nothing else is left, as
+  // their own balance is the one that exceptions throw off.
+  auto may_throw = [&](uint32_t n) {
+    return n < graph.may_throw.size() && graph.may_throw[n];
+  };
+  std::queue<uint32_t> work;
+  std::queue<uint32_t> throwing_work;
+  auto push = [&](uint32_t n) {
+    (may_throw(n) ? throwing_work : work).push(n);
+  };
+  for (uint32_t n = 0; n <= graph.num_blocks; n++) {
+    if (num_unknown[n] == 1) {
+      push(n);
+    }
+  }
+  while (!work.empty() || !throwing_work.empty()) {
+    auto& queue = work.empty() ? throwing_work : work;
+    auto n = queue.front();
+    queue.pop();
+    if (num_unknown[n] != 1) {
+      continue;
+    }
+    int64_t balance = 0;
+    size_t unknown = num_edges;
+    for (auto i : incident[n]) {
+      if (!known[i]) {
+        unknown = i;
+        continue;
+      }
+      if (dst(i) == n) {
+        balance += counts[i];
+      }
+      if (src(i) == n) {
+        balance -= counts[i];
+      }
+    }
+    always_assert(unknown != num_edges);
+    counts[unknown] = std::max<int64_t>(dst(unknown) == n ? -balance : balance,
+                                        0);
+    known[unknown] = true;
+    for (auto m : {src(unknown), dst(unknown)}) {
+      if (--num_unknown[m] == 1) {
+        push(m);
+      }
+    }
+  }
+
+  // Whatever is left is not connected to the entry, like unreachable blocks,
+  // and keeps a count of zero.
+  std::vector<uint64_t> block_counts(graph.num_blocks, 0);
+  for (size_t i = 0; i < num_edges; i++) {
+    if (i < edges.size()) {
+      edge_counts[i] = counts[i];
+    }
+    if (dst(i) != graph.exit()) {
+      block_counts[dst(i)] += counts[i];
+    }
+  }
+  return block_counts;
+}
+
+} // namespace instrument
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Edge profiling a la Ball and Larus ("Optimally profiling and tracing
+ * programs"): rather than counting every block, only the edges that are not
+ * on a spanning tree of the control flow graph get a counter. The count of
+ * every other edge, and so of every block, follows from flow conservation:
+ * what enters a block leaves it. A method with B blocks and E edges then
+ * needs E - B + 1 counters instead of B.
+ *
+ * To make the flow conserved, the method exit is a node of its own, that the
+ * returning and throwing blocks lead to, and a virtual edge leads from the
+ * exit back to the entry block; that edge is always on the tree, so the
+ * number of invocations comes for free. Catch blocks get a counter each, on
+ * an edge from the exit that stands for the exceptions coming in, and that
+ * the balance of the exit leaves out. Only the blocks that an exception
+ * leaves halfway do not conserve flow, so counts are derived from their
+ * balance last; counts that still come out negative are clamped.
+ *
+ * This file only knows about block numbers, so that the same code chooses the
+ * counters at instrumentation time and derives the counts from a profile.
+ */
+namespace instrument {
+
+struct ProfileEdge {
+  // Blocks are numbered from 0 to num_blocks - 1, and num_blocks stands for
+  // the method exit.
+  uint32_t src;
+  uint32_t dst;
+  // Heavier edges are put on the spanning tree first: they are the ones that
+  // are expected to be the hottest, or the most expensive to instrument.
+  uint32_t weight;
+};
+
+struct EdgeProfileGraph {
+  uint32_t num_blocks{0};
+  uint32_t entry{0};
+  // Not including the virtual edge from the exit to the entry.
+  std::vector<ProfileEdge> edges;
+  // The blocks with a throw edge, by block number. Missing ones do not throw.
+  std::vector<bool> may_throw;
+
+  uint32_t exit() const { return num_blocks; }
+};
+
+/*
+ * Returns, for each edge, whether it needs a counter: the edges that are not
+ * on a maximum spanning tree of the graph. Edges from the exit are always
+ * counted.
+ */
+std::vector<bool> choose_counted_edges(const EdgeProfileGraph& graph);
+
+/*
+ * Completes `edge_counts`, where only the counts of the counted edges are
+ * set, and returns the count of each block.
+ */
+std::vector<uint64_t> derive_block_counts(const EdgeProfileGraph& graph,
+                                          const std::vector<bool>& counted,
+                                          std::vector<uint64_t>& edge_counts);
+
+} // namespace instrument
@@ -7,6 +7,7 @@
 
 #include "FieldOpTracker.h"
 
+#include "ConcurrentContainers.h"
 #include "Resolver.h"
 #include "Walkers.h"
 
@@ -18,27 +19,41 @@ bool is_own_init(DexField* field, const DexMethod* method) {
 }
 
 FieldStatsMap analyze(const Scope& scope) {
-  FieldStatsMap field_stats;
+  ConcurrentMap<DexField*, FieldStats> concurrent_field_stats;
   // Gather the read/write counts.
-  walk::opcodes(scope, [&](const DexMethod* method, const IRInstruction* insn) {
-    auto op = insn->opcode();
-    if (!insn->has_field()) {
-      return;
-    }
-    auto field = resolve_field(insn->get_field());
-    if (field == nullptr) {
-      return;
-    }
-    if (is_sget(op) || is_iget(op)) {
-      ++field_stats[field].reads;
-      if (!is_own_init(field, method)) {
-        ++field_stats[field].reads_outside_init;
+  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
+    FieldStatsMap method_field_stats;
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      auto op = insn->opcode();
+      if (!insn->has_field()) {
+        continue;
+      }
+      auto field = resolve_field(insn->get_field());
+      if (field == nullptr) {
+        continue;
       }
-    } else if (is_sput(op) || is_iput(op)) {
-      ++field_stats[field].writes;
+      auto& stats = method_field_stats[field];
+      if (is_sget(op) || is_iget(op)) {
+        ++stats.reads;
+        if (!is_own_init(field, method)) {
+          ++stats.reads_outside_init;
+        }
+      } else if (is_sput(op) || is_iput(op)) {
+        ++stats.writes;
+        if (!is_own_init(field, method)) {
+          ++stats.writes_outside_init;
+        }
+      }
+    }
+    for (const auto& pair : method_field_stats) {
+      concurrent_field_stats.update(
+          pair.first,
+          [&](DexField*, FieldStats& stats, bool) { stats += pair.second; });
     }
   });
-  return field_stats;
+  return FieldStatsMap(concurrent_field_stats.begin(),
+                       concurrent_field_stats.end());
 }
 
 } // namespace field_op_tracker
@@ -21,10 +21,26 @@ struct FieldStats {
   size_t reads_outside_init{0};
   // Number of instructions which write a field in the entire program.
   size_t writes{0};
+  // Number of instructions which write this field outside of a <clinit> or
+  // <init>.
+  size_t writes_outside_init{0};
+
+  FieldStats& operator+=(const FieldStats& that) {
+    reads += that.reads;
+    reads_outside_init += that.reads_outside_init;
+    writes += that.writes;
+    writes_outside_init += that.writes_outside_init;
+    return *this;
+  }
 };
 
 using FieldStatsMap = std::unordered_map<DexField*, FieldStats>;
 
+/*
+ * Counts the field reads and writes of all the code in `scope`, in parallel.
+ * Each method is scanned into its own map first, so the shared map is only
+ * touched once per field per method.
+ */
 FieldStatsMap analyze(const Scope& scope);
 
 }
@@ -25,6 +25,10 @@ void InlinerConfig::bind_config() {
 void OptDecisionsConfig::bind_config() {
   bind("enable_logs", false, enable_logs,
        "Should we log Redex's optimization decisions?");
+  bind("format", "json", format,
+       "How to write the log: \"json\" for redex-opt-decisions.json, or "
+       "\"binary\" for the columnar redex-opt-decisions.bin that "
+       "`redex-tool opt-data-to-json` turns back into JSON.");
 }
 
 void IRTypeCheckerConfig::bind_config() {
@@ -47,6 +51,7 @@ void GlobalConfig::bind_config() {
   bind("emit_locator_strings", {}, bool_param);
   bind("emit_name_based_locator_strings", {}, bool_param);
   bind("record_keep_reasons", {}, bool_param);
+  bind("record_keep_reasons_only_for_whyareyoukeeping", {}, bool_param);
   bind("debug_info_kind", "", string_param);
   bind("emit_class_method_info_map", false, bool_param);
   bind("bytecode_sort_mode", {}, string_vector_param);
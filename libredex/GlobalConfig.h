@@ -44,6 +44,7 @@ struct OptDecisionsConfig : public Configurable {
   }
 
   bool enable_logs;
+  std::string format;
 };
 
 class GlobalConfig : public Configurable {
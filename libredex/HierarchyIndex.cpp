@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "HierarchyIndex.h"
+
+#include <algorithm>
+
+#include "DexAccess.h"
+#include "DexUtil.h"
+
+constexpr HierarchyIndex::Number HierarchyIndex::kNotIndexed;
+
+HierarchyIndex::HierarchyIndex(const Scope& scope) {
+  // Gather the scope and its ancestors, in discovery order so that the
+  // numbering is the same from one run to the next.
+  IdVector<DexType, Number> discovered_as(kNotIndexed);
+  std::vector<const DexType*> discovered;
+  auto discover = [&](const DexType* type) {
+    auto& slot = discovered_as[type];
+    if (slot == kNotIndexed) {
+      slot = discovered.size();
+      discovered.push_back(type);
+    }
+  };
+  for (const auto* cls : scope) {
+    discover(cls->get_type());
+  }
+  for (size_t i = 0; i < discovered.size(); ++i) {
+    const auto* cls = type_class(discovered[i]);
+    if (cls == nullptr) {
+      continue;
+    }
+    if (cls->get_super_class() != nullptr) {
+      discover(cls->get_super_class());
+    }
+    for (const auto* intf : cls->get_interfaces()->get_type_list()) {
+      discover(intf);
+    }
+  }
+
+  std::vector<std::vector<Number>> children(discovered.size());
+  std::vector<Number> roots;
+  for (Number i = 0; i < discovered.size(); ++i) {
+    const auto* cls = type_class(discovered[i]);
+    if (cls == nullptr || cls->get_super_class() == nullptr) {
+      roots.push_back(i);
+    } else {
+      children[discovered_as.get(cls->get_super_class())].push_back(i);
+    }
+  }
+
+  // Number the superclass tree in preorder. The members of a malformed,
+  // cyclic hierarchy are never reached and stay out of the index.
+  m_types.reserve(discovered.size());
+  m_last.resize(discovered.size());
+  std::vector<std::pair<Number, size_t>> stack;
+  for (auto root : roots) {
+    m_numbers[discovered[root]] = m_types.size();
+    m_types.push_back(discovered[root]);
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      const auto& succs = children[top.first];
+      if (top.second < succs.size()) {
+        auto child = succs[top.second++];
+        m_numbers[discovered[child]] = m_types.size();
+        m_types.push_back(discovered[child]);
+        stack.emplace_back(child, 0);
+      } else {
+        m_last[number(discovered[top.first])] = m_types.size() - 1;
+        stack.pop_back();
+      }
+    }
+  }
+  m_last.resize(m_types.size());
+
+  m_interface.resize(m_types.size());
+  m_concrete.resize(m_types.size());
+  m_direct_implementors.resize(m_types.size());
+  for (Number n = 0; n < m_types.size(); ++n) {
+    const auto* cls = type_class(m_types[n]);
+    if (cls == nullptr) {
+      continue;
+    }
+    m_interface[n] = is_interface(cls);
+    m_concrete[n] = !is_interface(cls) && !is_abstract(cls);
+    for (const auto* intf : cls->get_interfaces()->get_type_list()) {
+      auto i = number(intf);
+      if (i != kNotIndexed) {
+        m_direct_implementors[i].push_back(n);
+      }
+    }
+  }
+}
+
+const std::vector<HierarchyIndex::Number>& HierarchyIndex::interface_subtypes(
+    Number intf) const {
+  auto cached = m_interface_subtypes.get(intf, nullptr);
+  if (cached) {
+    return *cached;
+  }
+  auto subtypes = std::make_shared<std::vector<Number>>();
+  for (auto implementor : m_direct_implementors[intf]) {
+    for (auto n = implementor; n <= m_last[implementor]; ++n) {
+      subtypes->push_back(n);
+    }
+    if (!m_direct_implementors[implementor].empty()) {
+      const auto& indirect = interface_subtypes(implementor);
+      subtypes->insert(subtypes->end(), indirect.begin(), indirect.end());
+    }
+  }
+  std::sort(subtypes->begin(), subtypes->end());
+  subtypes->erase(std::unique(subtypes->begin(), subtypes->end()),
+                  subtypes->end());
+  // Racing threads compute the same vector; the first one wins.
+  m_interface_subtypes.emplace(intf, subtypes);
+  return *m_interface_subtypes.at(intf);
+}
+
+bool HierarchyIndex::is_subclass(const DexType* parent,
+                                 const DexType* child) const {
+  auto p = number(parent);
+  auto c = number(child);
+  if (p == kNotIndexed || c == kNotIndexed) {
+    return ::is_subclass(parent, child);
+  }
+  return p <= c && c <= m_last[p];
+}
+
+bool HierarchyIndex::check_cast(const DexType* type,
+                                const DexType* base_type) const {
+  if (type == base_type) {
+    return true;
+  }
+  auto t = number(type);
+  auto b = number(base_type);
+  if (t == kNotIndexed || b == kNotIndexed) {
+    return ::check_cast(type, base_type);
+  }
+  if (b <= t && t <= m_last[b]) {
+    return true;
+  }
+  // Whatever its class says, a type that is listed among the interfaces of
+  // others is treated as one.
+  if (m_direct_implementors[b].empty()) {
+    return false;
+  }
+  const auto& subtypes = interface_subtypes(b);
+  return std::binary_search(subtypes.begin(), subtypes.end(), t);
+}
+
+std::vector<const DexType*> HierarchyIndex::to_types(
+    const std::vector<Number>& numbers,
+    bool concrete_only,
+    bool classes_only) const {
+  std::vector<const DexType*> types;
+  for (auto n : numbers) {
+    if ((!concrete_only || m_concrete[n]) &&
+        (!classes_only || !m_interface[n])) {
+      types.push_back(m_types[n]);
+    }
+  }
+  return types;
+}
+
+std::vector<const DexType*> HierarchyIndex::get_all_children(
+    const DexType* type) const {
+  auto n = number(type);
+  if (n == kNotIndexed) {
+    return {};
+  }
+  return std::vector<const DexType*>(m_types.begin() + n + 1,
+                                     m_types.begin() + m_last[n] + 1);
+}
+
+std::vector<const DexType*> HierarchyIndex::get_all_subtypes(
+    const DexType* type) const {
+  auto n = number(type);
+  if (n == kNotIndexed) {
+    return {};
+  }
+  std::vector<Number> subtypes;
+  for (auto s = n + 1; s <= m_last[n]; ++s) {
+    subtypes.push_back(s);
+  }
+  if (!m_direct_implementors[n].empty()) {
+    const auto& implementors = interface_subtypes(n);
+    std::vector<Number> merged;
+    std::set_union(subtypes.begin(),
+                   subtypes.end(),
+                   implementors.begin(),
+                   implementors.end(),
+                   std::back_inserter(merged));
+    subtypes = std::move(merged);
+  }
+  return to_types(subtypes, /* concrete_only */ false,
+                  /* classes_only */ false);
+}
+
+std::vector<const DexType*> HierarchyIndex::get_all_implementors(
+    const DexType* intf) const {
+  auto n = number(intf);
+  if (n == kNotIndexed || m_direct_implementors[n].empty()) {
+    return {};
+  }
+  return to_types(interface_subtypes(n), /* concrete_only */ false,
+                  /* classes_only */ true);
+}
+
+std::vector<const DexType*> HierarchyIndex::get_concrete_subtypes(
+    const DexType* type) const {
+  auto n = number(type);
+  if (n == kNotIndexed) {
+    return {};
+  }
+  std::vector<const DexType*> concrete;
+  if (m_concrete[n]) {
+    concrete.push_back(type);
+  }
+  for (const auto* subtype : get_all_subtypes(type)) {
+    if (m_concrete[number(subtype)]) {
+      concrete.push_back(subtype);
+    }
+  }
+  return concrete;
+}
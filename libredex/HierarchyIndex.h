@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ConcurrentContainers.h"
+#include "DexClass.h"
+#include "DexIdContainers.h"
+
+/*
+ * A precomputed snapshot of the class hierarchy of a scope, for analyses that
+ * ask the same subtyping questions over and over, like type inference, the
+ * removal of redundant check-casts and devirtualization.
+ *
+ * The types are numbered in a depth-first preorder of the superclass tree, so
+ * that the subclasses of a class form the contiguous range of numbers that
+ * follows its own: is_subclass() is two comparisons. Interfaces can't be
+ * numbered that way; the sorted vector of the subtypes of an interface is
+ * computed on first use and cached, so that further queries are a binary
+ * search.
+ *
+ * The index covers the classes of the scope and all their ancestors,
+ * including external ones; queries about other types fall back to walking
+ * the hierarchy. Like a ClassHierarchy, the index is not updated when the
+ * hierarchy changes and must be rebuilt instead. Queries are thread-safe.
+ */
+class HierarchyIndex {
+ public:
+  explicit HierarchyIndex(const Scope& scope);
+
+  bool is_indexed(const DexType* type) const {
+    return number(type) != kNotIndexed;
+  }
+
+  size_t size() const { return m_types.size(); }
+
+  /*
+   * Same as ::is_subclass(parent, child).
+   */
+  bool is_subclass(const DexType* parent, const DexType* child) const;
+
+  /*
+   * Same as ::check_cast(type, base_type): whether `type` is `base_type`, a
+   * subclass of it or one of its implementors.
+   */
+  bool check_cast(const DexType* type, const DexType* base_type) const;
+
+  /*
+   * The strict subclasses of `type`, parents before children.
+   */
+  std::vector<const DexType*> get_all_children(const DexType* type) const;
+
+  /*
+   * The types other than `type` that can be cast to it, in preorder: its
+   * subclasses, or for an interface, the classes and interfaces that
+   * implement it, directly or not.
+   */
+  std::vector<const DexType*> get_all_subtypes(const DexType* type) const;
+
+  /*
+   * The classes of the scope or outside of it that implement `intf`,
+   * including the subclasses of its implementors.
+   */
+  std::vector<const DexType*> get_all_implementors(const DexType* intf) const;
+
+  /*
+   * `type` and the types that can be cast to it that can be instantiated,
+   * i.e. that are neither abstract nor interfaces. Types without a class
+   * don't count.
+   */
+  std::vector<const DexType*> get_concrete_subtypes(const DexType* type) const;
+
+ private:
+  using Number = uint32_t;
+  static constexpr Number kNotIndexed = UINT32_MAX;
+
+  Number number(const DexType* type) const { return m_numbers.get(type); }
+
+  // The numbers of the interface subtypes of the interface numbered `intf`,
+  // sorted.
+  const std::vector<Number>& interface_subtypes(Number intf) const;
+
+  std::vector<const DexType*> to_types(const std::vector<Number>& numbers,
+                                       bool concrete_only,
+                                       bool classes_only) const;
+
+  IdVector<DexType, Number> m_numbers{kNotIndexed};
+  // Indexed by number.
+  std::vector<const DexType*> m_types;
+  // The largest number in the subtree of a node, which is itself for leaves.
+  std::vector<Number> m_last;
+  std::vector<bool> m_interface;
+  std::vector<bool> m_concrete;
+  // For each type, the types that list it among their interfaces.
+  std::vector<std::vector<Number>> m_direct_implementors;
+  mutable ConcurrentMap<Number, std::shared_ptr<const std::vector<Number>>>
+      m_interface_subtypes;
+};
@@ -15,6 +15,7 @@
 #include "Trace.h"
 #include "Walkers.h"
 
+#include <algorithm>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
@@ -39,154 +40,26 @@ void IODIMetadata::Entry::push_back(const DexMethod* meth) {
   }
 }
 
-namespace {
-template <typename T>
-void emplace_warning_existence(T& map,
-                               const DexMethod* m,
-                               const std::string& key) {
-  if (!map.emplace(m, key).second) {
-    TRACE(IODI, 1, "[IODI] Already found method for %s in pretty map",
-          key.c_str());
-  }
-}
-} // namespace
-
-void IODIMetadata::emplace_entry(const std::string& key,
-                                 const DexMethod* method,
-                                 bool allow_collision) {
-  auto iter = m_entries.find(key);
-  auto end = m_entries.end();
-  always_assert(allow_collision || iter == end);
-  if (iter == end) {
-    TRACE(IODI, 6, "[IODI] Found 1 %s", key.c_str());
-    m_entries.emplace(key, method);
-    emplace_warning_existence(m_pretty_map, method, key);
-  } else {
-    iter->second.push_back(method);
-    emplace_warning_existence(m_pretty_map, method, key);
-  }
-}
-
-namespace {
-// Returns com.foo.Bar. for the DexClass Lcom/foo/Bar;. Note the trailing
-// '.'.
-std::string pretty_prefix_for_cls(const DexClass* cls) {
-  std::string pretty_name = JavaNameUtil::internal_to_external(cls->str());
-  // Include the . separator
-  pretty_name.push_back('.');
-  return pretty_name;
-}
-} // namespace
-
-void IODIMetadata::mark_methods(DexStoresVector& scope) {
-  // Calculates the duplicates that will appear in stack traces when using iodi.
-  // For example, if a method is overloaded or templating is being used the line
-  // emitted in the stack trace may be ambiguous (all that's emitted is the
-  // method name without any other type information). Before iodi we de-dup'd
-  // by using proguard mapping line numbers (different methods corresponded
-  // to different line numbers, so when symbolicating we would find the right
-  // method by finding the method who's line number enclose the given one),
-  // but now we emit instruction offsets, thus we can't disambiguate this way
-  // anymore. With iodi we disambiguate by emitting information about
-  // callers of any given method that may have a duplicate. On the symbolication
-  // side of things, then, we use iodi_metadata to map from
-  // (stack line, previous_method_id, previous_pc) -> method_id and
-  // (method_id, insn_offset) -> line_offset (and eventually line offset maps
-  // to (file, line number)).
-  //
-  // We do this linearly for now because otherwise we need locks
-  for (auto& store : scope) {
-    for (auto& classes : store.get_dexen()) {
-      for (auto& cls : classes) {
-        m_scope.push_back(cls);
-        auto pretty_prefix = pretty_prefix_for_cls(cls);
-        // First we need to mark all entries...
-        for (DexMethod* m : cls->get_dmethods()) {
-          emplace_entry(pretty_prefix + m->str(), m);
-        }
-        for (DexMethod* m : cls->get_vmethods()) {
-          emplace_entry(pretty_prefix + m->str(), m);
-        }
-      }
-    }
-  }
-}
-
-void IODIMetadata::mark_method_huge(const DexMethod* method, uint32_t size) {
-  m_huge_methods.insert(method);
-  TRACE(IODI, 3, "[IODI] %s is too large to benefit from IODI: %u",
-        SHOW(method), size);
-}
-
-// Returns whether we can symbolicate using IODI for the given method.
-bool IODIMetadata::can_safely_use_iodi(const DexMethod* method) const {
-  // We can use IODI if we don't have a collision, if the method isn't virtual
-  // and if it isn't too big.
-  //
-  // It turns out for some methods using IODI isn't beneficial. See
-  // comment in emit_instruction_offset_debug_info for more info.
-  if (m_huge_methods.count(method) > 0) {
-    return false;
-  }
-
-  // Eventually we can relax this constraint and calculate the subset of methods
-  // that cannot be called externally and use those for IODI as well.
-  if (m_enable_overloaded_methods) {
-    if (!method->is_virtual()) {
-      return true;
-    }
-  }
-
-  std::string pretty_name;
-  {
-    auto iter = m_pretty_map.find(method);
-    if (iter == m_pretty_map.end()) {
-      fprintf(stderr, "[IODI] Warning: didn't find %s in pretty map in %s",
-              SHOW(method), __PRETTY_FUNCTION__);
-      auto cls = type_class(method->get_class());
-      always_assert(cls);
-      pretty_name = pretty_prefix_for_cls(cls);
-      pretty_name += method->str();
-    } else {
-      pretty_name = iter->second;
-    }
-  }
-  auto iter = m_entries.find(pretty_name);
-  if (iter == m_entries.end()) {
-    fprintf(stderr,
-            "[IODI] Warning: failing to use IODI on unknown method:"
-            " %s\n",
-            pretty_name.c_str());
-    return false;
-  }
-  return !iter->second.is_duplicate();
-}
-
-namespace {
 // This class marks all callers to the callees specified in the CallerMap. That
 // is CallerMap specifies what callees we want to know the callers about and
 // then CallerMarker will go through and mark any possible caller of said
 // callees.
-struct CallerMarker {
+struct IODIMetadata::CallerMarker {
   using CallerList = std::vector<IODIMetadata::Entry::Caller>;
   // This is the same as Entry::CallerMap but with pointers to the caller
   // lists instead.
   using CallerMap = std::unordered_map<const DexMethod*, CallerList*>;
 
-  CallerMarker(CallerMap& caller_map) : caller_map(caller_map) {}
+  explicit CallerMarker(CallerMap caller_map)
+      : caller_map(std::move(caller_map)) {}
 
   boost::shared_mutex resolver_cache_mutex;
   MethodRefCache resolver_cache;
 
+  // This is safe to call in parallel because the data members mutated have
+  // mutexes.
   std::mutex caller_map_mutex;
-  CallerMap& caller_map;
-
-  void mark_callers(Scope& scope) {
-    // This is safe to do in parallel because the data members mutated have
-    // mutexes.
-    walk::parallel::methods(
-        scope, [&](DexMethod* method) { this->mark_caller(method); });
-  }
+  const CallerMap caller_map;
 
   void mark_caller(const DexMethod* caller) {
     // Pretty standard algo: walk all the insns looking for referenced methods.
@@ -284,9 +157,75 @@ struct CallerMarker {
     }
   }
 };
-} // namespace
 
-void IODIMetadata::mark_callers() {
+void IODIMetadata::emplace_entry(const Key& key,
+                                 const DexMethod* method,
+                                 bool allow_collision) {
+  auto& entries = m_entries[shard_of(key)];
+  auto iter = entries.find(key);
+  auto end = entries.end();
+  always_assert(allow_collision || iter == end);
+  if (iter == end) {
+    TRACE(IODI, 6, "[IODI] Found 1 %s", pretty_name(key).c_str());
+    entries.emplace(key, method);
+  } else {
+    iter->second.push_back(method);
+  }
+  if (!m_method_keys.insert(std::make_pair(method, key))) {
+    TRACE(IODI, 1, "[IODI] Already found method for %s in pretty map",
+          pretty_name(key).c_str());
+  }
+}
+
+std::string IODIMetadata::pretty_name(const Key& key) {
+  // Returns com.foo.Bar.baz for the method baz in Lcom/foo/Bar;.
+  std::string name = JavaNameUtil::internal_to_external(key.first->str());
+  name.push_back('.');
+  name += key.second->str();
+  return name;
+}
+
+void IODIMetadata::mark_methods(DexStoresVector& scope) {
+  // Calculates the duplicates that will appear in stack traces when using iodi.
+  // For example, if a method is overloaded or templating is being used the line
+  // emitted in the stack trace may be ambiguous (all that's emitted is the
+  // method name without any other type information). Before iodi we de-dup'd
+  // by using proguard mapping line numbers (different methods corresponded
+  // to different line numbers, so when symbolicating we would find the right
+  // method by finding the method who's line number enclose the given one),
+  // but now we emit instruction offsets, thus we can't disambiguate this way
+  // anymore. With iodi we disambiguate by emitting information about
+  // callers of any given method that may have a duplicate. On the symbolication
+  // side of things, then, we use iodi_metadata to map from
+  // (stack line, previous_method_id, previous_pc) -> method_id and
+  // (method_id, insn_offset) -> line_offset (and eventually line offset maps
+  // to (file, line number)).
+  //
+  // Methods with the same key always land in the same shard, so the shards
+  // can be filled in parallel without locks.
+  std::array<std::vector<std::pair<Key, const DexMethod*>>, kShards> shards;
+  for (auto& store : scope) {
+    for (auto& classes : store.get_dexen()) {
+      for (auto& cls : classes) {
+        for (const auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+          for (DexMethod* m : *methods) {
+            Key key(cls->get_type(), m->get_name());
+            shards[shard_of(key)].emplace_back(key, m);
+          }
+        }
+      }
+    }
+  }
+  auto wq = workqueue_foreach<size_t>([&](size_t shard) {
+    for (const auto& pair : shards[shard]) {
+      emplace_entry(pair.first, pair.second);
+    }
+  });
+  for (size_t shard = 0; shard < kShards; ++shard) {
+    wq.add_item(shard);
+  }
+  wq.run_all();
+
   // CallerMap sets up the exact set of DexMethods that we care about
   // (any entry that doesn't have any duplicates we don't care about, so
   // it won't get a slot in this map). It points to the vector of callers
@@ -295,8 +234,11 @@ void IODIMetadata::mark_callers() {
   // For now we're only supporting this form of symbolication for direct/static
   // methods only.
   CallerMarker::CallerMap caller_map;
-  for (auto& it : m_entries) {
-    if (it.second.is_duplicate()) {
+  for (auto& entries : m_entries) {
+    for (auto& it : entries) {
+      if (!it.second.is_duplicate()) {
+        continue;
+      }
       for (auto& meth_it : it.second.get_caller_map()) {
         // If we're only supporting direct methods then skip any virtual meth
         // as we don't care about it since it'll emit normal debug info.
@@ -307,9 +249,66 @@ void IODIMetadata::mark_callers() {
       }
     }
   }
+  m_caller_marker = std::make_unique<CallerMarker>(std::move(caller_map));
+}
+
+void IODIMetadata::mark_method_huge(const DexMethod* method, uint32_t size) {
+  m_huge_methods.insert(method);
+  TRACE(IODI, 3, "[IODI] %s is too large to benefit from IODI: %u",
+        SHOW(method), size);
+}
+
+// Returns whether we can symbolicate using IODI for the given method.
+bool IODIMetadata::can_safely_use_iodi(const DexMethod* method) const {
+  // We can use IODI if we don't have a collision, if the method isn't virtual
+  // and if it isn't too big.
+  //
+  // It turns out for some methods using IODI isn't beneficial. See
+  // comment in emit_instruction_offset_debug_info for more info.
+  if (m_huge_methods.count(method) > 0) {
+    return false;
+  }
+
+  // Eventually we can relax this constraint and calculate the subset of methods
+  // that cannot be called externally and use those for IODI as well.
+  if (m_enable_overloaded_methods) {
+    if (!method->is_virtual()) {
+      return true;
+    }
+  }
+
+  Key key;
+  auto key_it = m_method_keys.find(method);
+  if (key_it != m_method_keys.end()) {
+    key = key_it->second;
+  } else {
+    fprintf(stderr, "[IODI] Warning: didn't find %s in pretty map in %s",
+            SHOW(method), __PRETTY_FUNCTION__);
+    key = Key(method->get_class(), method->get_name());
+  }
+  const auto& entries = m_entries[shard_of(key)];
+  auto iter = entries.find(key);
+  if (iter == entries.end()) {
+    fprintf(stderr,
+            "[IODI] Warning: failing to use IODI on unknown method:"
+            " %s\n",
+            pretty_name(key).c_str());
+    return false;
+  }
+  return !iter->second.is_duplicate();
+}
+
+IODIMetadata::IODIMetadata(bool enable_overloaded_methods)
+    : m_enable_overloaded_methods(enable_overloaded_methods) {}
+
+IODIMetadata::~IODIMetadata() {}
 
-  CallerMarker marker(caller_map);
-  marker.mark_callers(m_scope);
+void IODIMetadata::mark_callers(const DexMethod* caller) {
+  always_assert_log(m_caller_marker, "mark_methods has not been called");
+  if (m_caller_marker->caller_map.empty()) {
+    return;
+  }
+  m_caller_marker->mark_caller(caller);
 }
 
 void IODIMetadata::write(
@@ -383,11 +382,23 @@ void IODIMetadata::write(
 
   size_t single_huge_count = 0;
 
-  for (const auto& it : m_entries) {
-    if (it.second.is_duplicate()) {
-      always_assert(it.second.size() > 1);
+  // Write the entries in name order, so that the output does not depend on
+  // how they were sharded.
+  std::vector<std::pair<std::string, const Entry*>> sorted_entries;
+  for (const auto& entries : m_entries) {
+    for (const auto& it : entries) {
+      sorted_entries.emplace_back(pretty_name(it.first), &it.second);
+    }
+  }
+  std::sort(sorted_entries.begin(), sorted_entries.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  for (const auto& it : sorted_entries) {
+    const auto& name = it.first;
+    const Entry& entry = *it.second;
+    if (entry.is_duplicate()) {
+      always_assert(entry.size() > 1);
       // Skip if this isn't a method that's safe to use IODI with.
-      const auto& caller_map = it.second.get_caller_map();
+      const auto& caller_map = entry.get_caller_map();
       size_t mids_count = caller_map.size();
       if (!can_safely_use_iodi(caller_map.begin()->first)) {
         dup_meth_count_not_emitted += mids_count;
@@ -403,12 +414,12 @@ void IODIMetadata::write(
       dup_meth_count_emitted += mids_count;
       dup_count += 1;
       always_assert_log(dup_count != 0, "Too many dups found, overflowed");
-      always_assert(it.first.size() < UINT16_MAX);
-      deh.klen = it.first.size();
+      always_assert(name.size() < UINT16_MAX);
+      deh.klen = name.size();
       always_assert(mids_count < UINT32_MAX);
       deh.count = mids_count;
       dofs.write((const char*)&deh, sizeof(DupEntryHeader));
-      dofs << it.first;
+      dofs << name;
       for (const auto& caller_it : caller_map) {
         const DexMethod* callee = caller_it.first;
         const auto dc = callee->get_dex_code();
@@ -428,16 +439,24 @@ void IODIMetadata::write(
           uint64_t method_id;
           uint16_t pc;
         } callsite;
+        // The callers are marked from parallel code item encoding, so sort
+        // them to keep the output deterministic.
+        std::vector<std::pair<uint64_t, uint32_t>> callsites;
         for (const auto& caller : caller_it.second) {
-          callsite.method_id =
-              method_to_id.at(const_cast<DexMethod*>(caller.method));
-          always_assert(caller.pc < UINT16_MAX);
-          callsite.pc = caller.pc;
+          callsites.emplace_back(
+              method_to_id.at(const_cast<DexMethod*>(caller.method)),
+              caller.pc);
+        }
+        std::sort(callsites.begin(), callsites.end());
+        for (const auto& site : callsites) {
+          callsite.method_id = site.first;
+          always_assert(site.second < UINT16_MAX);
+          callsite.pc = site.second;
           dofs.write((const char*)&callsite, sizeof(Callsite));
         }
       }
     } else {
-      if (!can_safely_use_iodi(it.second.get_method())) {
+      if (!can_safely_use_iodi(entry.get_method())) {
         // This will occur if at some point a method was marked as huge during
         // encoding.
         single_huge_count += 1;
@@ -445,12 +464,12 @@ void IODIMetadata::write(
       }
       single_count += 1;
       always_assert_log(single_count != 0, "Too many sgls found, overflowed");
-      always_assert(it.first.size() < UINT16_MAX);
-      seh.klen = it.first.size();
+      always_assert(name.size() < UINT16_MAX);
+      seh.klen = name.size();
       seh.method_id =
-          method_to_id.at(const_cast<DexMethod*>(it.second.get_method()));
+          method_to_id.at(const_cast<DexMethod*>(entry.get_method()));
       ofs.write((const char*)&seh, sizeof(SingleEntryHeader));
-      ofs << it.first;
+      ofs << name;
     }
   }
   ofs << dofs.str();
@@ -7,8 +7,12 @@
 
 #pragma once
 
+#include <array>
+#include <boost/functional/hash.hpp>
+#include <memory>
 #include <unordered_map>
 
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexStore.h"
 
@@ -95,32 +99,48 @@ class IODIMetadata {
       return m_data.method;
     }
 
-    friend struct CallerMarker;
   };
-  using EntryMap = std::unordered_map<std::string, Entry>;
-  using MethodToPrettyMap = std::unordered_map<const DexMethod*, std::string>;
+  // A method shows up in a stack trace as its class and its name, which are
+  // both interned, so the pair identifies an external name without building
+  // the string.
+  using Key = std::pair<const DexType*, const DexString*>;
+  using EntryMap = std::unordered_map<Key, Entry, boost::hash<Key>>;
+  using MethodToKeyMap = ConcurrentMap<const DexMethod*, Key>;
 
  private:
-  EntryMap m_entries;
+  // The entries are split into shards by key, so that each shard can be
+  // built by its own thread.
+  static constexpr size_t kShards = 31;
+  std::array<EntryMap, kShards> m_entries;
   // This exists for can_safely_use_iodi
-  MethodToPrettyMap m_pretty_map;
+  MethodToKeyMap m_method_keys;
   std::unordered_set<const DexMethod*> m_huge_methods;
-  Scope m_scope;
   bool m_enable_overloaded_methods;
 
+  struct CallerMarker;
+  std::unique_ptr<CallerMarker> m_caller_marker;
+
+  static size_t shard_of(const Key& key) {
+    return boost::hash<Key>()(key) % kShards;
+  }
+
   // Internal helper:
   // This will properly push_back a duplicate if method is a duplicate and
   // allow_collision is true. If allow collision is false and there is a
   // collision then will assert.
-  void emplace_entry(const std::string& key,
+  void emplace_entry(const Key& key,
                      const DexMethod* method,
                      bool allow_collision = true);
 
  public:
   // We can initialize this guy for free. If this feature is enabled then
   // invoke the methods below.
-  IODIMetadata(bool enable_overloaded_methods = false)
-      : m_enable_overloaded_methods(enable_overloaded_methods) {}
+  IODIMetadata(bool enable_overloaded_methods = false);
+  ~IODIMetadata();
+
+  // Returns the name that `key` shows up as in a stack trace, e.g.
+  // com.foo.Bar.baz.
+  static std::string pretty_name(const Key& key);
 
   // This fills the internal map of stack trace name -> method. This must be
   // called after the last pass and before anything starts to get lowered.
@@ -133,9 +153,11 @@ class IODIMetadata {
   // Returns whether we can symbolicate using IODI for the given method.
   bool can_safely_use_iodi(const DexMethod* method) const;
 
-  // This must be called after all Scopes have been marked above with
-  // mark_methods.
-  void mark_callers();
+  // Records the callsites in `caller`'s DexCode of methods whose name has
+  // duplicates. This must be called after mark_methods, once the code is
+  // synced; it is thread-safe, so that DexOutput can call it as it encodes
+  // each code item.
+  void mark_callers(const DexMethod* caller);
 
   // Write to disk, pretty usual. Does nothing if filename len is 0.
   void write(const std::string& iodi_metadata_filename,
@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include <limits>
 #include <list>
+#include <thread>
 
 #include "ControlFlow.h"
 #include "Debug.h"
@@ -404,6 +405,8 @@ void translate_dex_to_ir(
 
     insn->normalize_registers();
 
+    // Nothing refers to the DexInstruction once it is translated.
+    delete dex_insn;
     it->type = MFLOW_OPCODE;
     it->insn = insn;
     if (move_result_pseudo != nullptr) {
@@ -440,6 +443,9 @@ void balloon(DexMethod* method, IRList* ir_list) {
     bm.insert(EntryAddrBiMap::relation(mei, addr));
     TRACE(MTRANS, 5, "%08x: %s[mei %p]", addr, SHOW(insn), mei);
     addr += insn->size();
+    if (insn->opcode() == DOPCODE_NOP) {
+      delete insn;
+    }
   }
   bm.insert(EntryAddrBiMap::relation(&*ir_list->end(), addr));
 
@@ -555,6 +561,7 @@ IRList* deep_copy_ir_list(IRList* old_ir_list) {
 IRCode::IRCode(): m_ir_list(new IRList()) {}
 
 IRCode::~IRCode() {
+  // A retained CFG owns the instructions and frees them itself.
   m_ir_list->clear_and_dispose();
   delete m_ir_list;
 }
@@ -574,7 +581,7 @@ IRCode::IRCode(DexMethod* method, size_t temp_regs)
 }
 
 IRCode::IRCode(const IRCode& code) {
-  IRList* old_ir_list = code.m_ir_list;
+  IRList* old_ir_list = code.ir_list();
   m_ir_list = deep_copy_ir_list(old_ir_list);
   m_registers_size = code.m_registers_size;
   if (code.m_dbg) {
@@ -582,17 +589,41 @@ IRCode::IRCode(const IRCode& code) {
   }
 }
 
+namespace {
+
+std::atomic<bool> s_keep_editable_cfg{false};
+
+} // namespace
+
+void IRCode::set_keep_editable_cfg(bool keep) { s_keep_editable_cfg = keep; }
+
+bool IRCode::keep_editable_cfg() { return s_keep_editable_cfg; }
+
 void IRCode::build_cfg(bool editable) {
+  if (editable && m_cfg_retained.load(std::memory_order_relaxed)) {
+    m_cfg_retained.store(false, std::memory_order_relaxed);
+    return;
+  }
+  flush_retained_cfg();
   clear_cfg();
   m_cfg = std::make_unique<cfg::ControlFlowGraph>(
       m_ir_list, m_registers_size, editable);
 }
 
 void IRCode::clear_cfg() {
-  if (!m_cfg) {
+  if (!m_cfg || m_cfg_retained.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  if (m_cfg->editable() && s_keep_editable_cfg) {
+    m_cfg_retained.store(true, std::memory_order_release);
     return;
   }
 
+  linearize_cfg();
+}
+
+void IRCode::linearize_cfg() {
   if (m_cfg->editable()) {
     m_registers_size = m_cfg->get_registers_size();
     m_ir_list = m_cfg->linearize();
@@ -608,10 +639,30 @@ void IRCode::clear_cfg() {
   }
 }
 
-bool IRCode::cfg_built() const { return m_cfg != nullptr; }
+void IRCode::flush_retained_cfg() {
+  // Code is only ever mutated by one thread at a time, but several threads
+  // may read the same method (e.g. an inlining callee) concurrently; the
+  // first of them does the linearization, and the others wait for it. Only
+  // readers of this code wait, so a spin lock will do.
+  if (!m_cfg_retained.load(std::memory_order_acquire)) {
+    return;
+  }
+  while (m_flush_lock.test_and_set(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  if (m_cfg_retained.load(std::memory_order_relaxed)) {
+    linearize_cfg();
+    m_cfg_retained.store(false, std::memory_order_release);
+  }
+  m_flush_lock.clear(std::memory_order_release);
+}
+
+bool IRCode::cfg_built() const {
+  return m_cfg != nullptr && !m_cfg_retained.load(std::memory_order_acquire);
+}
 
 bool IRCode::editable_cfg_built() const {
-  return m_cfg != nullptr && m_cfg->editable();
+  return cfg_built() && m_cfg->editable();
 }
 
 namespace {
@@ -770,14 +821,14 @@ void IRCode::split_and_insert_try_regions(
 }
 
 std::unique_ptr<DexCode> IRCode::sync(const DexMethod* method) {
+  flush_retained_cfg();
   auto dex_code = std::make_unique<DexCode>();
   try {
     calculate_ins_size(method, &*dex_code);
     dex_code->set_registers_size(m_registers_size);
     dex_code->set_outs_size(calc_outs_size(this));
     dex_code->set_debug_item(std::move(m_dbg));
-    while (try_sync(dex_code.get()) == false)
-      ;
+    sync_insns(dex_code.get());
   } catch (std::exception&) {
     fprintf(stderr, "Failed to sync %s\n%s\n", SHOW(method), SHOW(this));
     throw;
@@ -785,66 +836,89 @@ std::unique_ptr<DexCode> IRCode::sync(const DexMethod* method) {
   return dex_code;
 }
 
-bool IRCode::try_sync(DexCode* code) {
-  std::unordered_map<MethodItemEntry*, uint32_t> entry_to_addr;
+namespace {
+
+// Assigns each entry the address of the next opcode at or after it, and
+// collects the targets of if-* and goto opcodes in list order. Returns the
+// size of the opcodes in code units.
+uint32_t compute_addresses(
+    IRList* ir,
+    std::unordered_map<MethodItemEntry*, uint32_t>* entry_to_addr,
+    std::vector<MethodItemEntry*>* branch_targets) {
+  entry_to_addr->clear();
+  branch_targets->clear();
   uint32_t addr = 0;
-  // Step 1, regenerate opcode list for the method, and
-  // and calculate the opcode entries address offsets.
+  for (auto& mie : *ir) {
+    (*entry_to_addr)[&mie] = addr;
+    if (mie.type == MFLOW_DEX_OPCODE) {
+      TRACE(MTRANS, 5, "Emitting mentry %p at %08x", &mie, addr);
+      addr += mie.dex_insn->size();
+    } else if (mie.type == MFLOW_TARGET &&
+               mie.target->type == BRANCH_SIMPLE &&
+               dex_opcode::is_branch(mie.target->src->dex_insn->opcode())) {
+      branch_targets->push_back(&mie);
+    }
+  }
+  return addr;
+}
+
+} // namespace
+
+uint32_t IRCode::relax_branches(
+    std::unordered_map<MethodItemEntry*, uint32_t>* entry_to_addr) {
+  std::vector<MethodItemEntry*> branch_targets;
   TRACE(MTRANS, 5, "Emitting opcodes");
-  for (auto miter = m_ir_list->begin(); miter != m_ir_list->end(); ++miter) {
-    MethodItemEntry* mentry = &*miter;
-    TRACE(MTRANS, 5, "Analyzing mentry %p", mentry);
-    entry_to_addr[mentry] = addr;
-    if (mentry->type == MFLOW_DEX_OPCODE) {
-      TRACE(MTRANS, 5, "Emitting mentry %p at %08x", mentry, addr);
-      addr += mentry->dex_insn->size();
+  uint32_t addr = compute_addresses(m_ir_list, entry_to_addr, &branch_targets);
+  // Only the branches get looked at in each round. Resizing any of them
+  // shifts the addresses after it, so the addresses are computed again after
+  // a round that resized something, until a round resizes nothing.
+  while (true) {
+    TRACE(MTRANS, 5, "Recalculating branches");
+    bool resized = false;
+    for (auto target_mie : branch_targets) {
+      MethodItemEntry* branch_op_mie = target_mie->target->src;
+      auto branch_addr = entry_to_addr->find(branch_op_mie);
+      always_assert_log(branch_addr != entry_to_addr->end(),
+                        "%s refers to nonexistent branch instruction",
+                        SHOW(*target_mie));
+      int32_t branch_offset =
+          entry_to_addr->at(target_mie) - branch_addr->second;
+      resized |= !encode_offset(m_ir_list, target_mie, branch_offset);
+    }
+    if (!resized) {
+      break;
     }
+    addr = compute_addresses(m_ir_list, entry_to_addr, &branch_targets);
   }
-  // Step 2, Branch relaxation: calculate branch offsets for if-* and goto
-  // opcodes, resizing them where necessary. Since resizing opcodes affects
-  // address offsets, we need to iterate this to a fixed point.
+  return addr;
+}
+
+void IRCode::sync_insns(DexCode* code) {
+  std::unordered_map<MethodItemEntry*, uint32_t> entry_to_addr;
+  // Step 1, calculate the opcode entries address offsets, and relax the
+  // branch offsets of if-* and goto opcodes to a fixed point.
   //
   // For instructions that use address offsets but never need resizing (i.e.
   // switch and fill-array-data opcodes), we calculate their offsets after
   // we have reached the fixed point.
-  TRACE(MTRANS, 5, "Recalculating branches");
+  uint32_t addr = relax_branches(&entry_to_addr);
+
+  // Step 2, regenerate opcode list for the method.
   std::vector<MethodItemEntry*> multi_branches;
   std::unordered_map<MethodItemEntry*, std::vector<BranchTarget*>> multis;
   std::unordered_map<BranchTarget*, uint32_t> multi_targets;
-  bool needs_resync = false;
-  for (auto miter = m_ir_list->begin(); miter != m_ir_list->end(); ++miter) {
-    MethodItemEntry* mentry = &*miter;
-    if (entry_to_addr.find(mentry) == entry_to_addr.end()) {
-      continue;
-    }
-    if (mentry->type == MFLOW_DEX_OPCODE) {
-      auto opcode = mentry->dex_insn->opcode();
-      if (dex_opcode::is_switch(opcode)) {
-        multi_branches.push_back(mentry);
-      }
-    }
-    if (mentry->type == MFLOW_TARGET) {
-      BranchTarget* bt = mentry->target;
-      if (bt->type == BRANCH_MULTI) {
-        multis[bt->src].push_back(bt);
-        multi_targets[bt] = entry_to_addr.at(mentry);
-        // We can't fix the primary switch opcodes address until we emit
-        // the fopcode, which comes later.
-      } else if (bt->type == BRANCH_SIMPLE &&
-                 dex_opcode::is_branch(bt->src->dex_insn->opcode())) {
-        MethodItemEntry* branch_op_mie = bt->src;
-        auto branch_addr = entry_to_addr.find(branch_op_mie);
-        always_assert_log(branch_addr != entry_to_addr.end(),
-                          "%s refers to nonexistent branch instruction",
-                          SHOW(*mentry));
-        int32_t branch_offset = entry_to_addr.at(mentry) - branch_addr->second;
-        needs_resync |= !encode_offset(m_ir_list, mentry, branch_offset);
-      }
+  for (auto& mie : *m_ir_list) {
+    if (mie.type == MFLOW_DEX_OPCODE &&
+        dex_opcode::is_switch(mie.dex_insn->opcode())) {
+      multi_branches.push_back(&mie);
+    } else if (mie.type == MFLOW_TARGET && mie.target->type == BRANCH_MULTI) {
+      BranchTarget* bt = mie.target;
+      multis[bt->src].push_back(bt);
+      multi_targets[bt] = entry_to_addr.at(&mie);
+      // We can't fix the primary switch opcodes address until we emit
+      // the fopcode, which comes later.
     }
   }
-  if (needs_resync) {
-    return false;
-  }
 
   size_t num_align_nops{0};
   auto& opout = code->reset_instructions();
@@ -1013,5 +1087,4 @@ bool IRCode::try_sync(DexCode* code) {
                const std::unique_ptr<DexTryItem>& b) {
               return a->m_start_addr < b->m_start_addr;
             });
-  return true;
 }
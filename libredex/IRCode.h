@@ -26,12 +26,17 @@ class ControlFlowGraph;
 // belong there... I'm going to move them out soon
 class IRCode {
  private:
-  /* try_sync() is the work-horse of sync.  It's intended such that it can fail
-   * in the event that an opcode needs to be resized.  In that instance, it
-   * changes the opcode in question, and returns false.  It's intended to be
-   * called multiple times until it returns true.
+  /* sync_insns() is the work-horse of sync. It relaxes the branches once and
+   * then encodes the instructions, payloads, debug entries and try items.
    */
-  bool try_sync(DexCode*);
+  void sync_insns(DexCode*);
+
+  /* Widens (or drops) the if-* and goto opcodes whose offsets don't fit
+   * until none need resizing, and fills in `entry_to_addr` with the final
+   * addresses. Returns the size of the opcodes in code units.
+   */
+  uint32_t relax_branches(
+      std::unordered_map<MethodItemEntry*, uint32_t>* entry_to_addr);
 
   void split_and_insert_try_regions(
       uint32_t start,
@@ -39,32 +44,50 @@ class IRCode {
       const DexCatches& catches,
       std::vector<std::unique_ptr<DexTryItem>>* tries);
 
+  // Linearizes an editable CFG that clear_cfg() kept around (see
+  // set_keep_editable_cfg), so that the IRList can be used directly. This
+  // makes the const accessors write to the code, which is safe because
+  // flush_retained_cfg serializes the readers of this code on m_flush_lock.
+  IRList* ir_list() const {
+    if (m_cfg_retained.load(std::memory_order_acquire)) {
+      const_cast<IRCode*>(this)->flush_retained_cfg();
+    }
+    return m_ir_list;
+  }
+  void flush_retained_cfg();
+  void linearize_cfg();
+
   IRList* m_ir_list;
   std::unique_ptr<cfg::ControlFlowGraph> m_cfg;
+  // Whether m_cfg is an editable CFG that clear_cfg() did not linearize yet.
+  // While set, m_cfg owns all the instructions and m_ir_list is empty.
+  std::atomic<bool> m_cfg_retained{false};
+  // Held by the thread that linearizes the retained CFG.
+  std::atomic_flag m_flush_lock = ATOMIC_FLAG_INIT;
 
   uint16_t m_registers_size{0};
   // TODO(jezng): we shouldn't be storing / exposing the DexDebugItem... just
   // exposing the param names should be enough
   std::unique_ptr<DexDebugItem> m_dbg;
 
-  IRList::iterator main_block() { return m_ir_list->main_block(); }
+  IRList::iterator main_block() { return ir_list()->main_block(); }
   IRList::iterator make_if_block(IRList::iterator cur,
                                  IRInstruction* insn,
                                  IRList::iterator* if_block) {
-    return m_ir_list->make_if_block(cur, insn, if_block);
+    return ir_list()->make_if_block(cur, insn, if_block);
   }
   IRList::iterator make_if_else_block(IRList::iterator cur,
                                       IRInstruction* insn,
                                       IRList::iterator* if_block,
                                       IRList::iterator* else_block) {
-    return m_ir_list->make_if_else_block(cur, insn, if_block, else_block);
+    return ir_list()->make_if_else_block(cur, insn, if_block, else_block);
   }
   IRList::iterator make_switch_block(
       IRList::iterator cur,
       IRInstruction* insn,
       IRList::iterator* default_block,
       std::map<SwitchIndices, IRList::iterator>& cases) {
-    return m_ir_list->make_switch_block(cur, insn, default_block, cases);
+    return ir_list()->make_switch_block(cur, insn, default_block, cases);
   }
 
   friend struct MethodCreator;
@@ -75,6 +98,12 @@ class IRCode {
   // appropriate load-param opcodes yourself. Mostly used for testing purposes.
   IRCode();
 
+  /*
+   * Construct an IRCode from the DexCode of the method. This takes the
+   * debug item of the DexCode, and deletes each of its DexInstructions as
+   * soon as translate_dex_to_ir has turned it into an IRInstruction, so the
+   * DexCode is left with dangling instruction pointers and must be dropped.
+   */
   explicit IRCode(DexMethod*);
   /*
    * Construct an IRCode for a DexMethod that has no DexCode (that is, a new
@@ -93,21 +122,31 @@ class IRCode {
   ~IRCode();
 
   bool structural_equals(const IRCode& other) {
-    return m_ir_list->structural_equals(*other.m_ir_list, std::equal_to<const IRInstruction&>());
+    return ir_list()->structural_equals(*other.ir_list(), std::equal_to<const IRInstruction&>());
   }
 
   bool structural_equals(const IRCode& other,
                          const InstructionEquality& instruction_equals) {
-    return m_ir_list->structural_equals(*other.m_ir_list, instruction_equals);
+    return ir_list()->structural_equals(*other.ir_list(), instruction_equals);
   }
 
-  uint16_t get_registers_size() const { return m_registers_size; }
+  uint16_t get_registers_size() const {
+    ir_list();
+    return m_registers_size;
+  }
 
-  void set_registers_size(uint16_t sz) { m_registers_size = sz; }
+  void set_registers_size(uint16_t sz) {
+    ir_list();
+    m_registers_size = sz;
+  }
 
-  uint16_t allocate_temp() { return m_registers_size++; }
+  uint16_t allocate_temp() {
+    ir_list();
+    return m_registers_size++;
+  }
 
   uint16_t allocate_wide_temp() {
+    ir_list();
     uint16_t new_reg = m_registers_size;
     m_registers_size += 2;
     return new_reg;
@@ -118,7 +157,7 @@ class IRCode {
    * always be at the beginning of the method.
    */
   boost::sub_range<IRList> get_param_instructions() const {
-    return m_ir_list->get_param_instructions();
+    return ir_list()->get_param_instructions();
   }
 
   void set_debug_item(std::unique_ptr<DexDebugItem> dbg) {
@@ -131,21 +170,21 @@ class IRCode {
   }
 
   void gather_catch_types(std::vector<DexType*>& ltype) const {
-    m_ir_list->gather_catch_types(ltype);
+    ir_list()->gather_catch_types(ltype);
     if (m_dbg) m_dbg->gather_types(ltype);
   }
   void gather_strings(std::vector<DexString*>& lstring) const {
-    m_ir_list->gather_strings(lstring);
+    ir_list()->gather_strings(lstring);
     if (m_dbg) m_dbg->gather_strings(lstring);
   }
   void gather_types(std::vector<DexType*>& ltype) const {
-    m_ir_list->gather_types(ltype);
+    ir_list()->gather_types(ltype);
   }
   void gather_fields(std::vector<DexFieldRef*>& lfield) const {
-    m_ir_list->gather_fields(lfield);
+    ir_list()->gather_fields(lfield);
   }
   void gather_methods(std::vector<DexMethodRef*>& lmethod) const {
-    m_ir_list->gather_methods(lmethod);
+    ir_list()->gather_methods(lmethod);
   }
 
   /* Return the control flow graph of this method as a vector of blocks. */
@@ -165,21 +204,37 @@ class IRCode {
   // if the cfg was editable, linearize it back into m_ir_list
   void clear_cfg();
 
+  // A CFG kept by clear_cfg() does not count as built: callers must go
+  // through build_cfg() again before using cfg().
   bool cfg_built() const;
   bool editable_cfg_built() const;
 
+  /*
+   * When set, clear_cfg() on an editable CFG keeps the CFG instead of
+   * linearizing it, and the next build_cfg(true) picks it up again rather
+   * than rebuilding it from scratch. This saves the linearize / rebuild round
+   * trip between consecutive CFG-based passes. The CFG is linearized on
+   * demand as soon as anything touches the IRList form of the code, e.g.
+   * iteration, sync() or build_cfg(false).
+   *
+   * Off by default; set by the PassManager from the `keep_editable_cfg`
+   * config option.
+   */
+  static void set_keep_editable_cfg(bool keep);
+  static bool keep_editable_cfg();
+
   /* Generate DexCode from IRCode */
   std::unique_ptr<DexCode> sync(const DexMethod*);
 
   /* Passes memory ownership of "from" to callee.  It will delete it. */
   void replace_opcode(IRInstruction* from, IRInstruction* to) {
-    m_ir_list->replace_opcode(from, to);
+    ir_list()->replace_opcode(from, to);
   }
 
   /* Passes memory ownership of "from" to callee.  It will delete it. */
   void replace_opcode(IRInstruction* to_delete,
                       std::vector<IRInstruction*> replacements) {
-    m_ir_list->replace_opcode(to_delete, replacements);
+    ir_list()->replace_opcode(to_delete, replacements);
   }
 
   /*
@@ -187,22 +242,22 @@ class IRCode {
    * to appease the compiler in various scenarios of unreachable code.
    */
   void replace_opcode_with_infinite_loop(IRInstruction* from) {
-    m_ir_list->replace_opcode_with_infinite_loop(from);
+    ir_list()->replace_opcode_with_infinite_loop(from);
   }
 
   /* Like replace_opcode, but both :from and :to must be branch opcodes.
    * :to will end up jumping to the same destination as :from. */
   void replace_branch(IRInstruction* from, IRInstruction* to) {
-    m_ir_list->replace_branch(from, to);
+    ir_list()->replace_branch(from, to);
   }
 
   template <class... Args>
   void push_back(Args&&... args) {
-    m_ir_list->push_back(*(new MethodItemEntry(std::forward<Args>(args)...)));
+    ir_list()->push_back(*(new MethodItemEntry(std::forward<Args>(args)...)));
   }
 
   /* Passes memory ownership of "mie" to callee. */
-  void push_back(MethodItemEntry& mie) { m_ir_list->push_back(mie); }
+  void push_back(MethodItemEntry& mie) { ir_list()->push_back(mie); }
 
   /*
    * Insert after instruction :position.
@@ -214,38 +269,38 @@ class IRCode {
    */
   void insert_after(IRInstruction* position,
                     const std::vector<IRInstruction*>& opcodes) {
-    m_ir_list->insert_after(position, opcodes);
+    ir_list()->insert_after(position, opcodes);
   }
 
   IRList::iterator insert_before(const IRList::iterator& position,
                                  MethodItemEntry& mie) {
-    return m_ir_list->insert_before(position, mie);
+    return ir_list()->insert_before(position, mie);
   }
 
   IRList::iterator insert_after(const IRList::iterator& position,
                                 MethodItemEntry& mie) {
-    return m_ir_list->insert_after(position, mie);
+    return ir_list()->insert_after(position, mie);
   }
 
   template <class... Args>
   IRList::iterator insert_before(const IRList::iterator& position,
                                  Args&&... args) {
-    return m_ir_list->insert_before(
+    return ir_list()->insert_before(
         position, *(new MethodItemEntry(std::forward<Args>(args)...)));
   }
 
   template <class... Args>
   IRList::iterator insert_after(const IRList::iterator& position,
                                 Args&&... args) {
-    always_assert(position != m_ir_list->end());
-    return m_ir_list->insert_after(
+    always_assert(position != ir_list()->end());
+    return ir_list()->insert_after(
         position, *(new MethodItemEntry(std::forward<Args>(args)...)));
   }
 
   /* DEPRECATED! Use the version below that passes in the iterator instead,
    * which is O(1) instead of O(n). */
   /* Memory ownership of "insn" passes to callee, it will delete it. */
-  void remove_opcode(IRInstruction* insn) { m_ir_list->remove_opcode(insn); }
+  void remove_opcode(IRInstruction* insn) { ir_list()->remove_opcode(insn); }
 
   /*
    * Remove the instruction that :it points to.
@@ -254,46 +309,46 @@ class IRCode {
    * remove both that instruction and the move-result-pseudo that follows.
    */
   void remove_opcode(const IRList::iterator& it) {
-    m_ir_list->remove_opcode(it);
+    ir_list()->remove_opcode(it);
   }
 
   /*
    * Returns an estimated of the number of 2-byte code units needed to encode
    * all the instructions.
    */
-  size_t sum_opcode_sizes() const { return m_ir_list->sum_opcode_sizes(); }
+  size_t sum_opcode_sizes() const { return ir_list()->sum_opcode_sizes(); }
   size_t sum_non_internal_opcode_sizes() const {
-    return m_ir_list->sum_non_internal_opcode_sizes();
+    return ir_list()->sum_non_internal_opcode_sizes();
   }
   size_t sum_dex_opcode_sizes() const {
-    return m_ir_list->sum_dex_opcode_sizes();
+    return ir_list()->sum_dex_opcode_sizes();
   }
 
   /*
    * Returns the number of instructions.
    */
-  size_t count_opcodes() const { return m_ir_list->count_opcodes(); }
-
-  void sanity_check() const { m_ir_list->sanity_check(); }
-
-  IRList::iterator begin() { return m_ir_list->begin(); }
-  IRList::iterator end() { return m_ir_list->end(); }
-  IRList::const_iterator begin() const { return m_ir_list->begin(); }
-  IRList::const_iterator end() const { return m_ir_list->end(); }
-  IRList::const_iterator cbegin() const { return m_ir_list->cbegin(); }
-  IRList::const_iterator cend() const { return m_ir_list->cend(); }
-  IRList::reverse_iterator rbegin() { return m_ir_list->rbegin(); }
-  IRList::reverse_iterator rend() { return m_ir_list->rend(); }
-  IRList::const_reverse_iterator rbegin() const { return m_ir_list->rbegin(); }
-  IRList::const_reverse_iterator rend() const { return m_ir_list->rend(); }
-
-  IRList::iterator erase(IRList::iterator it) { return m_ir_list->erase(it); }
+  size_t count_opcodes() const { return ir_list()->count_opcodes(); }
+
+  void sanity_check() const { ir_list()->sanity_check(); }
+
+  IRList::iterator begin() { return ir_list()->begin(); }
+  IRList::iterator end() { return ir_list()->end(); }
+  IRList::const_iterator begin() const { return ir_list()->begin(); }
+  IRList::const_iterator end() const { return ir_list()->end(); }
+  IRList::const_iterator cbegin() const { return ir_list()->cbegin(); }
+  IRList::const_iterator cend() const { return ir_list()->cend(); }
+  IRList::reverse_iterator rbegin() { return ir_list()->rbegin(); }
+  IRList::reverse_iterator rend() { return ir_list()->rend(); }
+  IRList::const_reverse_iterator rbegin() const { return ir_list()->rbegin(); }
+  IRList::const_reverse_iterator rend() const { return ir_list()->rend(); }
+
+  IRList::iterator erase(IRList::iterator it) { return ir_list()->erase(it); }
   IRList::iterator erase_and_dispose(IRList::iterator it) {
-    return m_ir_list->erase_and_dispose(it);
+    return ir_list()->erase_and_dispose(it);
   }
 
   IRList::iterator iterator_to(MethodItemEntry& mie) {
-    return m_ir_list->iterator_to(mie);
+    return ir_list()->iterator_to(mie);
   }
 
   friend std::string show(const IRCode*);
@@ -7,6 +7,9 @@
 
 #include "IRInstruction.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "DexClass.h"
 #include "DexUtil.h"
 
@@ -23,7 +26,52 @@ DexOpcode convert_3to2addr(DexOpcode op) {
 }
 
 IRInstruction::IRInstruction(IROpcode op) : m_opcode(op) {
-  m_srcs.resize(opcode_impl::min_srcs_size(op));
+  resize_srcs(opcode_impl::min_srcs_size(op));
+}
+
+IRInstruction::IRInstruction(const IRInstruction& that)
+    : m_opcode(that.m_opcode), m_dest(that.m_dest), m_literal(that.m_literal) {
+  resize_srcs(that.m_num_srcs);
+  std::copy(that.srcs_data(), that.srcs_data() + m_num_srcs, srcs_data());
+}
+
+IRInstruction& IRInstruction::operator=(const IRInstruction& that) {
+  if (this != &that) {
+    m_opcode = that.m_opcode;
+    m_dest = that.m_dest;
+    m_literal = that.m_literal;
+    resize_srcs(that.m_num_srcs);
+    std::copy(that.srcs_data(), that.srcs_data() + m_num_srcs, srcs_data());
+  }
+  return *this;
+}
+
+IRInstruction::~IRInstruction() {
+  if (!srcs_inline()) {
+    delete[] m_heap_srcs;
+  }
+}
+
+void IRInstruction::resize_srcs(size_t count) {
+  always_assert(count <= std::numeric_limits<uint16_t>::max());
+  if (count == m_num_srcs) {
+    return;
+  }
+  uint16_t buf[kMaxInlineSrcs];
+  uint16_t* dst = count <= kMaxInlineSrcs ? buf : new uint16_t[count];
+  size_t kept = std::min<size_t>(count, m_num_srcs);
+  const uint16_t* old = srcs_data();
+  std::copy(old, old + kept, dst);
+  std::fill(dst + kept, dst + count, 0);
+  if (!srcs_inline()) {
+    delete[] m_heap_srcs;
+  }
+  m_num_srcs = count;
+  if (count <= kMaxInlineSrcs) {
+    std::copy(buf, buf + count, m_inline_srcs);
+  } else {
+    m_heap_srcs = dst;
+  }
 }
 
 // Structural equality of opcodes except branches offsets are ignored
@@ -31,7 +79,7 @@ IRInstruction::IRInstruction(IROpcode op) : m_opcode(op) {
 bool IRInstruction::operator==(const IRInstruction& that) const {
   return m_opcode == that.m_opcode &&
     m_string == that.m_string && // just test one member of the union
-    m_srcs == that.m_srcs &&
+    srcs() == that.srcs() &&
     m_dest == that.m_dest &&
     m_literal == that.m_literal;
 }
@@ -209,7 +257,8 @@ void IRInstruction::denormalize_registers() {
       }
     }
     if (has_wide) {
-      m_srcs = srcs;
+      resize_srcs(srcs.size());
+      std::copy(srcs.begin(), srcs.end(), srcs_data());
     }
   }
 }
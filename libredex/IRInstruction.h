@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <boost/range/iterator_range.hpp>
+
 #include "DexInstruction.h"
+#include "ObjectPool.h"
 #include "Show.h"
 
 /*
@@ -109,9 +112,12 @@
  *   B2: <catches exceptions from B1>
  *     invoke-static {v0} LQux;.a(LFoo;)V
  */
-class IRInstruction final {
+class IRInstruction final : public PooledObject<IRInstruction> {
  public:
   explicit IRInstruction(IROpcode op);
+  IRInstruction(const IRInstruction& that);
+  IRInstruction& operator=(const IRInstruction& that);
+  ~IRInstruction();
 
   /*
    * Ensures that wide registers only have their first register referenced
@@ -155,7 +161,7 @@ class IRInstruction final {
    */
   size_t dests_size() const { return opcode_impl::dests_size(m_opcode); }
 
-  size_t srcs_size() const { return m_srcs.size(); }
+  size_t srcs_size() const { return m_num_srcs; }
 
   bool has_move_result_pseudo() const {
     return opcode_impl::has_move_result_pseudo(m_opcode);
@@ -202,9 +208,16 @@ class IRInstruction final {
     always_assert_log(dests_size(), "No dest for %s", SHOW(m_opcode));
     return m_dest;
   }
-  uint16_t src(size_t i) const { return m_srcs.at(i); }
-  const std::vector<uint16_t>& srcs() const { return m_srcs; }
-  uint16_t arg_word_count() const { return m_srcs.size(); }
+  uint16_t src(size_t i) const {
+    always_assert(i < m_num_srcs);
+    return srcs_data()[i];
+  }
+  // A view of the sources; it is invalidated by any change to their count.
+  using SrcsRange = boost::iterator_range<const uint16_t*>;
+  SrcsRange srcs() const {
+    return SrcsRange(srcs_data(), srcs_data() + m_num_srcs);
+  }
+  uint16_t arg_word_count() const { return m_num_srcs; }
 
   /*
    * Setters for logical parts of the instruction.
@@ -219,11 +232,12 @@ class IRInstruction final {
     return this;
   }
   IRInstruction* set_src(size_t i, uint16_t vreg) {
-    m_srcs.at(i) = vreg;
+    always_assert(i < m_num_srcs);
+    srcs_data()[i] = vreg;
     return this;
   }
   IRInstruction* set_arg_word_count(uint16_t count) {
-    m_srcs.resize(count);
+    resize_srcs(count);
     return this;
   }
 
@@ -321,9 +335,25 @@ class IRInstruction final {
   uint64_t hash() const;
 
  private:
+  bool srcs_inline() const { return m_num_srcs <= kMaxInlineSrcs; }
+  const uint16_t* srcs_data() const {
+    return srcs_inline() ? m_inline_srcs : m_heap_srcs;
+  }
+  uint16_t* srcs_data() { return srcs_inline() ? m_inline_srcs : m_heap_srcs; }
+  // Keeps the first min(old, new) sources and zeroes the rest.
+  void resize_srcs(size_t count);
+
+  // Only invokes and filled-new-array can have more sources than this; the
+  // inline buffer takes no more room than the pointer it shares space with.
+  static constexpr size_t kMaxInlineSrcs = sizeof(uint64_t) / sizeof(uint16_t);
+
   IROpcode m_opcode;
-  std::vector<uint16_t> m_srcs;
+  uint16_t m_num_srcs{0};
   uint16_t m_dest{0};
+  union {
+    uint16_t m_inline_srcs[kMaxInlineSrcs];
+    uint16_t* m_heap_srcs;
+  };
   union {
     // Zero-initialize this union with the uint64_t member instead of a
     // pointer-type member so that it works properly even on 32-bit machines
@@ -14,6 +14,7 @@
 #include "DexClass.h"
 #include "DexDebugInstruction.h"
 #include "IRInstruction.h"
+#include "ObjectPool.h"
 
 struct MethodItemEntry;
 
@@ -24,7 +25,7 @@ enum TryEntryType {
 
 std::string show(TryEntryType t);
 
-struct TryEntry {
+struct TryEntry : PooledObject<TryEntry> {
   TryEntryType type;
   MethodItemEntry* catch_start;
   TryEntry(TryEntryType type, MethodItemEntry* catch_start)
@@ -33,7 +34,7 @@ struct TryEntry {
   }
 };
 
-struct CatchEntry {
+struct CatchEntry : PooledObject<CatchEntry> {
   DexType* catch_type;
   MethodItemEntry* next; // always null for catchall
   CatchEntry(DexType* catch_type) : catch_type(catch_type), next(nullptr) {}
@@ -62,7 +63,7 @@ enum BranchTargetType {
   BRANCH_MULTI = 1,
 };
 
-struct BranchTarget {
+struct BranchTarget : PooledObject<BranchTarget> {
   BranchTargetType type;
   MethodItemEntry* src;
 
@@ -109,7 +110,7 @@ enum MethodItemType {
   MFLOW_FALLTHROUGH,
 };
 
-struct MethodItemEntry {
+struct MethodItemEntry : PooledObject<MethodItemEntry> {
   boost::intrusive::list_member_hook<> list_hook_;
   MethodItemType type;
 
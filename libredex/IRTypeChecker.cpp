@@ -324,18 +324,20 @@ void IRTypeChecker::run() {
   // We then infer types for all the registers used in the method.
   code->build_cfg(/* editable */ false);
   const cfg::ControlFlowGraph& cfg = code->cfg();
-  m_type_inference = std::make_unique<TypeInference>(cfg);
+  // The instructions are checked in order, so that lazy environments replay
+  // each block once.
+  m_type_inference =
+      std::make_unique<TypeInference>(cfg, /* lazy_environments */ true);
   m_type_inference->run(m_dex_method);
 
   // Finally, we use the inferred types to type-check each instruction in the
   // method. We stop at the first type error encountered.
-  auto& type_envs = m_type_inference->get_type_environments();
   for (const MethodItemEntry& mie : InstructionIterable(code)) {
     IRInstruction* insn = mie.insn;
     try {
-      auto it = type_envs.find(insn);
-      always_assert(it != type_envs.end());
-      check_instruction(insn, &it->second);
+      auto env = m_type_inference->get_type_environment(insn);
+      always_assert(env);
+      check_instruction(insn, &*env);
     } catch (const TypeCheckingException& e) {
       m_good = false;
       std::ostringstream out;
@@ -888,27 +890,25 @@ void IRTypeChecker::check_instruction(IRInstruction* insn,
 
 IRType IRTypeChecker::get_type(IRInstruction* insn, uint16_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->get_type_environments();
-  auto it = type_envs.find(insn);
-  if (it == type_envs.end()) {
+  auto env = m_type_inference->get_type_environment(insn);
+  if (!env) {
     // The instruction doesn't belong to this method. We treat this as
     // unreachable code and return BOTTOM.
     return BOTTOM;
   }
-  return it->second.get_type(reg).element();
+  return env->get_type(reg).element();
 }
 
 const DexType* IRTypeChecker::get_dex_type(IRInstruction* insn,
                                            uint16_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->get_type_environments();
-  auto it = type_envs.find(insn);
-  if (it == type_envs.end()) {
+  auto env = m_type_inference->get_type_environment(insn);
+  if (!env) {
     // The instruction doesn't belong to this method. We treat this as
     // unreachable code and return BOTTOM.
     return nullptr;
   }
-  return *it->second.get_dex_type(reg);
+  return *env->get_dex_type(reg);
 }
 
 std::ostream& operator<<(std::ostream& output, const IRTypeChecker& checker) {
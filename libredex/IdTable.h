@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Debug.h"
+
+/**
+ * Hands out dense 32-bit ids and maps them back to the objects that hold
+ * them. This is what lets RedexContext number every DexString, DexType,
+ * DexFieldRef and DexMethodRef as it creates them.
+ *
+ * Slots live in fixed-size chunks that are allocated on first use and never
+ * move, so lookups take no lock and publishing distinct ids is safe from any
+ * thread.
+ */
+template <typename T>
+class IdTable {
+ public:
+  IdTable() : m_chunks(new std::atomic<Chunk*>[kMaxChunks]()) {}
+
+  ~IdTable() {
+    for (size_t i = 0; i < kMaxChunks; ++i) {
+      delete[] m_chunks[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  IdTable(const IdTable&) = delete;
+  IdTable& operator=(const IdTable&) = delete;
+
+  uint32_t allocate_id() {
+    auto id = m_next_id.fetch_add(1, std::memory_order_relaxed);
+    always_assert_log(id < kMaxChunks * kChunkSize, "Ran out of dense ids");
+    return static_cast<uint32_t>(id);
+  }
+
+  /*
+   * Makes get(id) return `value`. Publishing the same pair more than once is
+   * harmless.
+   */
+  void publish(uint32_t id, T* value) {
+    slot(id).store(value, std::memory_order_release);
+  }
+
+  /*
+   * Returns nullptr for ids that were allocated but never published, e.g.
+   * because the object that got them lost a creation race.
+   */
+  T* get(uint32_t id) const {
+    if (id >= bound()) {
+      return nullptr;
+    }
+    auto chunk = m_chunks[id >> kChunkBits].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      return nullptr;
+    }
+    return chunk[id & (kChunkSize - 1)].load(std::memory_order_acquire);
+  }
+
+  /*
+   * One more than the largest id handed out so far; the size that a vector
+   * needs to be indexed by any of them.
+   */
+  uint32_t bound() const {
+    return static_cast<uint32_t>(m_next_id.load(std::memory_order_relaxed));
+  }
+
+ private:
+  using Chunk = std::atomic<T*>;
+
+  static constexpr size_t kChunkBits = 16;
+  static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+  static constexpr size_t kMaxChunks = size_t(1) << (32 - kChunkBits);
+
+  std::atomic<T*>& slot(uint32_t id) {
+    auto& entry = m_chunks[id >> kChunkBits];
+    auto chunk = entry.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      auto fresh = new Chunk[kChunkSize]();
+      if (entry.compare_exchange_strong(chunk, fresh,
+                                        std::memory_order_acq_rel)) {
+        chunk = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    return chunk[id & (kChunkSize - 1)];
+  }
+
+  std::unique_ptr<std::atomic<Chunk*>[]> m_chunks;
+  std::atomic<uint64_t> m_next_id{0};
+};
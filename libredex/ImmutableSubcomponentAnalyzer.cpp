@@ -66,13 +66,18 @@ namespace isa_impl {
 
 // The base abstract domain is the flat lattice (aka the lattice of constants)
 // over access paths.
+//
+// The environments hold, join and copy these values for every instruction, so
+// a path is shared between all the copies that have not been extended. Paths
+// that come from the same copy compare equal without looking at the getters.
 class AbstractAccessPath final : public AbstractValue<AbstractAccessPath> {
  public:
   AbstractAccessPath() = default;
 
-  explicit AbstractAccessPath(const AccessPath& path) : m_path(path) {}
+  explicit AbstractAccessPath(const AccessPath& path)
+      : m_path(std::make_shared<const AccessPath>(path)) {}
 
-  void clear() override { m_path.m_getters.clear(); }
+  void clear() override { m_path.reset(); }
 
   AbstractValueKind kind() const override { return AbstractValueKind::Value; }
 
@@ -81,7 +86,11 @@ class AbstractAccessPath final : public AbstractValue<AbstractAccessPath> {
   }
 
   bool equals(const AbstractAccessPath& other) const override {
-    return m_path == other.m_path;
+    if (m_path == other.m_path) {
+      return true;
+    }
+    return m_path != nullptr && other.m_path != nullptr &&
+           *m_path == *other.m_path;
   }
 
   AbstractValueKind join_with(const AbstractAccessPath& other) override {
@@ -108,12 +117,19 @@ class AbstractAccessPath final : public AbstractValue<AbstractAccessPath> {
     return meet_with(other);
   }
 
-  AccessPath access_path() const { return m_path; }
+  const AccessPath& access_path() const {
+    always_assert(m_path != nullptr);
+    return *m_path;
+  }
 
-  void append(DexMethodRef* getter) { m_path.m_getters.push_back(getter); }
+  void append(DexMethodRef* getter) {
+    auto path = std::make_shared<AccessPath>(access_path());
+    path->m_getters.push_back(getter);
+    m_path = std::move(path);
+  }
 
  private:
-  AccessPath m_path;
+  std::shared_ptr<const AccessPath> m_path;
 };
 
 class AbstractAccessPathDomain final
@@ -142,6 +158,12 @@ class AbstractAccessPathDomain final
                ? boost::optional<AccessPath>(get_value()->access_path())
                : boost::none;
   }
+
+  // Like access_path(), without copying the path.
+  const AccessPath* access_path_or_null() const {
+    return (kind() == AbstractValueKind::Value) ? &get_value()->access_path()
+                                                : nullptr;
+  }
 };
 
 using namespace std::placeholders;
@@ -299,12 +321,10 @@ class Analyzer final : public BaseIRAnalyzer<AbstractAccessPathEnvironment> {
     std::set<size_t> res;
     auto& bindings = env.bindings();
     for (auto it = bindings.begin(); it != bindings.end(); ++it) {
-      auto domain = it->second;
-      if (domain.access_path()) {
-        auto path = *domain.access_path();
-        if (path_to_find == path && it->first != RESULT_REGISTER) {
-          res.emplace(it->first);
-        }
+      auto path = it->second.access_path_or_null();
+      if (path != nullptr && *path == path_to_find &&
+          it->first != RESULT_REGISTER) {
+        res.emplace(it->first);
       }
     }
     return res;
@@ -317,8 +337,15 @@ class Analyzer final : public BaseIRAnalyzer<AbstractAccessPathEnvironment> {
     if (it == m_environments.end()) {
       return {};
     }
-    auto env = it->second;
-    return find_access_path_registers(env, path);
+    return find_access_path_registers(it->second, path);
+  }
+
+  BindingSnapshot get_access_path_bindings(IRInstruction* insn) const {
+    auto it = m_environments.find(insn);
+    if (it == m_environments.end()) {
+      return {};
+    }
+    return get_known_access_path_bindings(it->second);
   }
 
   void populate_environments() {
@@ -336,17 +363,14 @@ class Analyzer final : public BaseIRAnalyzer<AbstractAccessPathEnvironment> {
   }
 
   BindingSnapshot get_known_access_path_bindings(
-      const AbstractAccessPathEnvironment& env) {
+      const AbstractAccessPathEnvironment& env) const {
     BindingSnapshot ret;
     if (env.kind() == AbstractValueKind::Value) {
-      auto bindings = env.bindings();
+      auto& bindings = env.bindings();
       for (auto it = bindings.begin(); it != bindings.end(); ++it) {
-        auto domain = it->second;
-        if (domain.access_path()) {
-          auto path = *domain.access_path();
-          if (it->first != RESULT_REGISTER) {
-            ret.emplace(it->first, path);
-          }
+        auto path = it->second.access_path_or_null();
+        if (path != nullptr && it->first != RESULT_REGISTER) {
+          ret.emplace(it->first, *path);
         }
       }
     }
@@ -462,6 +486,14 @@ std::set<size_t> ImmutableSubcomponentAnalyzer::find_access_path_registers(
   return m_analyzer->find_access_path_registers(insn, path);
 }
 
+BindingSnapshot ImmutableSubcomponentAnalyzer::get_access_path_bindings(
+    IRInstruction* insn) const {
+  if (m_analyzer == nullptr) {
+    return {};
+  }
+  return m_analyzer->get_access_path_bindings(insn);
+}
+
 std::unordered_map<cfg::BlockId, BlockStateSnapshot> ImmutableSubcomponentAnalyzer::get_block_state_snapshot() const {
   if (m_analyzer == nullptr) {
     return {{}};
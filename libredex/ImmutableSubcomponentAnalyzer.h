@@ -115,7 +115,7 @@ class AccessPath final {
 
   size_t parameter() const { return m_parameter; }
 
-  std::vector<DexMethodRef*> getters() const { return m_getters; }
+  const std::vector<DexMethodRef*>& getters() const { return m_getters; }
 
   DexField* field() const { return m_field; }
 
@@ -184,6 +184,13 @@ class ImmutableSubcomponentAnalyzer final {
     IRInstruction* insn,
     const AccessPath& path) const;
 
+  /*
+   * Returns all the registers that hold a known access path in the entry state
+   * of the given instruction, along with their paths. Looking up many
+   * registers of an instruction this way takes a single lookup.
+   */
+  BindingSnapshot get_access_path_bindings(IRInstruction* insn) const;
+
   std::unordered_map<cfg::BlockId, BlockStateSnapshot> get_block_state_snapshot() const;
 
  private:
@@ -0,0 +1,242 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "IndexedGraph.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#include "BinarySerialization.h"
+#include "Debug.h"
+
+namespace binary_serialization {
+
+namespace {
+
+uint32_t read_u32(const char* data, size_t idx) {
+  uint32_t value;
+  memcpy(&value, data + idx * sizeof(uint32_t), sizeof(value));
+  return value;
+}
+
+} // namespace
+
+constexpr uint32_t IndexedGraph::NONE;
+
+IndexedGraph::IndexedGraph(const char* data, size_t size) {
+  constexpr size_t header_size = 5 * sizeof(uint32_t);
+  always_assert_log(size >= header_size, "Truncated graph header");
+  always_assert_log(read_u32(data, 0) == 0xfaceb000, "Magic number mismatch");
+  always_assert_log(read_u32(data, 1) == INDEXED_GRAPH_VERSION,
+                    "Expected an indexed graph, version %u, got version %u",
+                    INDEXED_GRAPH_VERSION, read_u32(data, 1));
+  m_nodes_count = read_u32(data, 2);
+  m_edges_count = read_u32(data, 3);
+  uint64_t string_table_size = read_u32(data, 4);
+  uint64_t expected_size = header_size +
+                           uint64_t(m_nodes_count) * sizeof(NodeEntry) +
+                           (uint64_t(m_nodes_count) + 1) * sizeof(uint32_t) +
+                           uint64_t(m_edges_count) * sizeof(uint32_t) +
+                           string_table_size;
+  always_assert_log(size == expected_size,
+                    "Graph of %u nodes and %u edges should be %lu bytes, "
+                    "not %lu",
+                    m_nodes_count, m_edges_count, expected_size, size);
+  m_node_table = (const NodeEntry*)(data + header_size);
+  m_edge_offsets = (const uint32_t*)(m_node_table + m_nodes_count);
+  m_edges = m_edge_offsets + m_nodes_count + 1;
+  m_string_table = (const char*)(m_edges + m_edges_count);
+  always_assert_log(m_edge_offsets[m_nodes_count] == m_edges_count,
+                    "Edge offsets don't match the edges count");
+}
+
+std::unique_ptr<IndexedGraph> IndexedGraph::open(const std::string& path) {
+  auto file = std::make_unique<boost::iostreams::mapped_file_source>();
+  file->open(path);
+  always_assert_log(file->is_open(), "Can not open %s", path.c_str());
+  auto graph = std::make_unique<IndexedGraph>(file->data(), file->size());
+  graph->m_file = std::move(file);
+  return graph;
+}
+
+std::string IndexedGraph::label(uint32_t node) const {
+  const auto& entry = m_node_table[node];
+  return std::string(m_string_table + entry.label_offset, entry.label_size);
+}
+
+IndexedGraph::Range IndexedGraph::predecessors(uint32_t node) const {
+  if (m_pred_offsets.empty()) {
+    m_pred_offsets.assign(m_nodes_count + 1, 0);
+    for (uint32_t i = 0; i < m_edges_count; ++i) {
+      ++m_pred_offsets[m_edges[i] + 1];
+    }
+    for (uint32_t i = 0; i < m_nodes_count; ++i) {
+      m_pred_offsets[i + 1] += m_pred_offsets[i];
+    }
+    m_preds.resize(m_edges_count);
+    std::vector<uint32_t> next(m_pred_offsets.begin(),
+                               m_pred_offsets.end() - 1);
+    for (uint32_t i = 0; i < m_nodes_count; ++i) {
+      for (auto succ : successors(i)) {
+        m_preds[next[succ]++] = i;
+      }
+    }
+  }
+  return {m_preds.data() + m_pred_offsets[node],
+          m_preds.data() + m_pred_offsets[node + 1]};
+}
+
+std::vector<uint32_t> IndexedGraph::find(const std::string& label) const {
+  std::vector<uint32_t> result;
+  for (uint32_t i = 0; i < m_nodes_count; ++i) {
+    const auto& entry = m_node_table[i];
+    if (entry.label_size == label.size() &&
+        memcmp(m_string_table + entry.label_offset, label.data(),
+               label.size()) == 0) {
+      result.push_back(i);
+    }
+  }
+  return result;
+}
+
+namespace {
+
+IndexedGraph::Range neighbors(const IndexedGraph& graph,
+                              uint32_t node,
+                              Direction direction) {
+  return direction == Direction::SUCCESSORS ? graph.successors(node)
+                                            : graph.predecessors(node);
+}
+
+Direction reverse(Direction direction) {
+  return direction == Direction::SUCCESSORS ? Direction::PREDECESSORS
+                                            : Direction::SUCCESSORS;
+}
+
+} // namespace
+
+std::vector<uint32_t> shortest_path(
+    const IndexedGraph& graph,
+    uint32_t from,
+    Direction direction,
+    const std::function<bool(uint32_t)>& is_target) {
+  std::vector<uint32_t> parents(graph.size(), IndexedGraph::NONE);
+  std::deque<uint32_t> queue{from};
+  parents[from] = from;
+  while (!queue.empty()) {
+    auto node = queue.front();
+    queue.pop_front();
+    if (is_target(node)) {
+      std::vector<uint32_t> path{node};
+      while (node != from) {
+        node = parents[node];
+        path.push_back(node);
+      }
+      std::reverse(path.begin(), path.end());
+      return path;
+    }
+    for (auto next : neighbors(graph, node, direction)) {
+      if (parents[next] == IndexedGraph::NONE) {
+        parents[next] = node;
+        queue.push_back(next);
+      }
+    }
+  }
+  return {};
+}
+
+/*
+ * This is the iterative algorithm from "A Simple, Fast Dominance Algorithm"
+ * by Cooper, Harvey and Kennedy.
+ */
+std::vector<uint32_t> immediate_dominators(const IndexedGraph& graph,
+                                           const std::vector<uint32_t>& roots,
+                                           Direction direction) {
+  const uint32_t virtual_root = graph.size();
+  std::vector<bool> is_root(graph.size());
+  for (auto root : roots) {
+    is_root[root] = true;
+  }
+  auto for_each_next = [&](uint32_t node, const auto& fn) {
+    if (node == virtual_root) {
+      for (auto root : roots) {
+        fn(root);
+      }
+      return;
+    }
+    for (auto next : neighbors(graph, node, direction)) {
+      fn(next);
+    }
+  };
+
+  // Number the nodes in postorder, without recursing.
+  std::vector<uint32_t> postorder_idx(graph.size() + 1, IndexedGraph::NONE);
+  std::vector<uint32_t> postorder;
+  std::vector<bool> visited(graph.size() + 1);
+  std::vector<std::pair<uint32_t, std::vector<uint32_t>>> stack;
+  auto push = [&](uint32_t node) {
+    visited[node] = true;
+    std::vector<uint32_t> nexts;
+    for_each_next(node, [&](uint32_t next) { nexts.push_back(next); });
+    stack.emplace_back(node, std::move(nexts));
+  };
+  push(virtual_root);
+  while (!stack.empty()) {
+    auto& nexts = stack.back().second;
+    if (nexts.empty()) {
+      auto node = stack.back().first;
+      postorder_idx[node] = postorder.size();
+      postorder.push_back(node);
+      stack.pop_back();
+      continue;
+    }
+    auto next = nexts.back();
+    nexts.pop_back();
+    if (!visited[next]) {
+      push(next);
+    }
+  }
+
+  std::vector<uint32_t> idoms(graph.size() + 1, IndexedGraph::NONE);
+  idoms[virtual_root] = virtual_root;
+  auto intersect = [&](uint32_t a, uint32_t b) {
+    while (a != b) {
+      while (postorder_idx[a] < postorder_idx[b]) {
+        a = idoms[a];
+      }
+      while (postorder_idx[b] < postorder_idx[a]) {
+        b = idoms[b];
+      }
+    }
+    return a;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    // In reverse postorder, skipping the virtual root, which comes last.
+    for (size_t i = postorder.size() - 1; i-- > 0;) {
+      auto node = postorder[i];
+      auto new_idom = is_root[node] ? virtual_root : IndexedGraph::NONE;
+      for (auto prev : neighbors(graph, node, reverse(direction))) {
+        if (idoms[prev] == IndexedGraph::NONE) {
+          continue;
+        }
+        new_idom =
+            new_idom == IndexedGraph::NONE ? prev : intersect(prev, new_idom);
+      }
+      if (idoms[node] != new_idom) {
+        idoms[node] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  idoms.pop_back();
+  return idoms;
+}
+
+} // namespace binary_serialization
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Reads the graphs that binary_serialization::IndexedGraphWriter writes, in
+ * place: the node table, the edges and the labels are used right where they
+ * are in the file, so opening even a graph with millions of nodes takes no
+ * time.
+ */
+namespace binary_serialization {
+
+class IndexedGraph {
+ public:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  struct Range {
+    const uint32_t* b;
+    const uint32_t* e;
+    const uint32_t* begin() const { return b; }
+    const uint32_t* end() const { return e; }
+    size_t size() const { return e - b; }
+  };
+
+  /*
+   * The data, which starts with the header, has to outlive the graph.
+   */
+  IndexedGraph(const char* data, size_t size);
+
+  /*
+   * Maps the file for as long as the graph lives.
+   */
+  static std::unique_ptr<IndexedGraph> open(const std::string& path);
+
+  uint32_t size() const { return m_nodes_count; }
+  uint32_t edges_size() const { return m_edges_count; }
+
+  uint8_t kind(uint32_t node) const { return m_node_table[node].kind; }
+  std::string label(uint32_t node) const;
+
+  Range successors(uint32_t node) const {
+    return {m_edges + m_edge_offsets[node], m_edges + m_edge_offsets[node + 1]};
+  }
+
+  /*
+   * The nodes with an edge to this one. The reversed edges are computed the
+   * first time this is called.
+   */
+  Range predecessors(uint32_t node) const;
+
+  /*
+   * All the nodes with this label.
+   */
+  std::vector<uint32_t> find(const std::string& label) const;
+
+ private:
+  struct NodeEntry {
+    uint32_t label_offset;
+    uint32_t label_size;
+    uint8_t kind;
+    uint8_t padding[3];
+  };
+
+  std::unique_ptr<boost::iostreams::mapped_file_source> m_file;
+  uint32_t m_nodes_count;
+  uint32_t m_edges_count;
+  const NodeEntry* m_node_table;
+  const uint32_t* m_edge_offsets;
+  const uint32_t* m_edges;
+  const char* m_string_table;
+  mutable std::vector<uint32_t> m_pred_offsets;
+  mutable std::vector<uint32_t> m_preds;
+};
+
+enum class Direction {
+  // Along the edges of the graph.
+  SUCCESSORS,
+  // Against the edges of the graph.
+  PREDECESSORS,
+};
+
+/*
+ * Returns one of the shortest paths that start at the node and end at a node
+ * for which is_target returns true, or an empty path if there is none.
+ */
+std::vector<uint32_t> shortest_path(
+    const IndexedGraph& graph,
+    uint32_t from,
+    Direction direction,
+    const std::function<bool(uint32_t)>& is_target);
+
+/*
+ * Returns the immediate dominator of each node in the graph, walking from the
+ * roots in the given direction. The roots are dominated by a virtual node
+ * with the ID graph.size(). The nodes that can't be reached from them get
+ * IndexedGraph::NONE.
+ */
+std::vector<uint32_t> immediate_dominators(const IndexedGraph& graph,
+                                           const std::vector<uint32_t>& roots,
+                                           Direction direction);
+
+} // namespace binary_serialization
@@ -19,6 +19,7 @@
 #include "Transform.h"
 #include "UnknownVirtuals.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 using namespace opt_metadata;
 
@@ -127,6 +128,10 @@ MultiMethodInliner::MultiMethodInliner(
 }
 
 void MultiMethodInliner::inline_methods() {
+  if (m_config.parallel) {
+    inline_methods_in_parallel();
+    return;
+  }
   // we want to inline bottom up, so as a first step we identify all the
   // top level callers, then we recurse into all inlinable callees until we
   // hit a leaf and we start inlining from there
@@ -177,6 +182,144 @@ void MultiMethodInliner::caller_inline(
   inline_callees(caller, nonrecursive_callees);
 }
 
+void MultiMethodInliner::plan_caller_inline(
+    DexMethod* caller,
+    const std::vector<DexMethod*>& callees,
+    sparta::PatriciaTreeSet<DexMethod*> call_stack,
+    std::unordered_set<DexMethod*>* visited,
+    std::vector<std::pair<DexMethod*, std::vector<DexMethod*>>>* plan) {
+  if (visited->count(caller)) {
+    return;
+  }
+  visited->emplace(caller);
+  call_stack.insert(caller);
+
+  std::vector<DexMethod*> nonrecursive_callees;
+  nonrecursive_callees.reserve(callees.size());
+  for (auto callee : callees) {
+    if (call_stack.contains(callee)) {
+      info.recursive++;
+      continue;
+    }
+    auto maybe_caller = caller_callee.find(callee);
+    if (maybe_caller != caller_callee.end()) {
+      plan_caller_inline(
+          callee, maybe_caller->second, call_stack, visited, plan);
+    }
+    nonrecursive_callees.push_back(callee);
+  }
+  plan->emplace_back(caller, std::move(nonrecursive_callees));
+}
+
+void MultiMethodInliner::inline_methods_in_parallel(size_t num_threads) {
+  // Walk the callers in the same order as inline_methods(), so that the same
+  // recursive calls are ignored. What's left is acyclic: a caller only waits
+  // for the callees that are callers themselves, and those come first in the
+  // plan.
+  std::vector<std::pair<DexMethod*, std::vector<DexMethod*>>> plan;
+  std::unordered_set<DexMethod*> visited;
+  for (auto& it : caller_callee) {
+    if (callee_caller.find(it.first) != callee_caller.end()) continue;
+    plan_caller_inline(it.first, it.second, {}, &visited, &plan);
+  }
+
+  std::unordered_map<const DexMethod*, size_t> plan_index;
+  for (size_t i = 0; i < plan.size(); ++i) {
+    plan_index.emplace(plan[i].first, i);
+  }
+  std::vector<std::vector<size_t>> waiting_callers(plan.size());
+  std::unique_ptr<std::atomic<size_t>[]> pending(
+      new std::atomic<size_t>[plan.size()]);
+  for (size_t i = 0; i < plan.size(); ++i) {
+    std::unordered_set<size_t> deps;
+    for (auto callee : plan[i].second) {
+      auto it = plan_index.find(callee);
+      if (it != plan_index.end()) {
+        always_assert(it->second < i);
+        deps.insert(it->second);
+      }
+    }
+    pending[i] = deps.size();
+    for (auto dep : deps) {
+      waiting_callers[dep].push_back(i);
+    }
+  }
+
+  // Callees get read by all their callers at once, so their CFGs can't be
+  // built on demand.
+  std::vector<IRCode*> need_deconstruct;
+  if (m_config.use_cfg_inliner) {
+    std::unordered_set<IRCode*> codes;
+    for (const auto& pair : plan) {
+      codes.insert(pair.first->get_code());
+      for (auto callee : pair.second) {
+        codes.insert(callee->get_code());
+      }
+    }
+    for (auto code : codes) {
+      if (!code->editable_cfg_built()) {
+        need_deconstruct.push_back(code);
+      }
+    }
+    auto wq = workqueue_foreach<IRCode*>(
+        [](IRCode* code) { code->build_cfg(/* editable */ true); },
+        num_threads);
+    for (auto code : need_deconstruct) {
+      wq.add_item(code);
+    }
+    wq.run_all();
+  }
+
+  m_delayed_visibility_changes =
+      std::make_unique<std::vector<std::pair<DexMethod*, DexType*>>>();
+  using WQ = WorkQueue<size_t, std::nullptr_t, std::nullptr_t>;
+  WQ wq(
+      [&](WorkerState<size_t, std::nullptr_t, std::nullptr_t>* state,
+          size_t i) {
+        auto caller = plan[i].first;
+        TraceContext context(caller->get_deobfuscated_name());
+        std::vector<DexMethod*> callees;
+        for (auto callee : plan[i].second) {
+          if (should_inline(caller, callee)) {
+            callees.push_back(callee);
+          }
+        }
+        inline_callees(caller, callees);
+        for (auto waiting : waiting_callers[i]) {
+          if (pending[waiting].fetch_sub(1) == 1) {
+            state->push_task(waiting);
+          }
+        }
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      num_threads,
+      WorkQueueScheduler::WorkStealing);
+  for (size_t i = 0; i < plan.size(); ++i) {
+    if (pending[i] == 0) {
+      wq.add_item(i);
+    }
+  }
+  wq.run_all();
+
+  auto visibility_changes = std::move(m_delayed_visibility_changes);
+  std::sort(visibility_changes->begin(), visibility_changes->end());
+  visibility_changes->erase(
+      std::unique(visibility_changes->begin(), visibility_changes->end()),
+      visibility_changes->end());
+  for (const auto& pair : *visibility_changes) {
+    change_visibility(pair.first, pair.second);
+  }
+
+  auto clear_wq = workqueue_foreach<IRCode*>(
+      [](IRCode* code) { code->clear_cfg(); }, num_threads);
+  for (auto code : need_deconstruct) {
+    clear_wq.add_item(code);
+  }
+  clear_wq.run_all();
+}
+
 void MultiMethodInliner::inline_callees(
     DexMethod* caller, const std::vector<DexMethod*>& callees) {
   size_t found = 0;
@@ -252,48 +395,75 @@ void MultiMethodInliner::inline_inlinables(
     }
   }
 
+  auto record_inlined = [&](DexMethod* callee_method) {
+    info.calls_inlined++;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_delayed_visibility_changes) {
+      m_delayed_visibility_changes->emplace_back(callee_method,
+                                                 caller_method->get_class());
+    } else {
+      TRACE(MMINL, 6, "checking visibility usage of members in %s",
+            SHOW(callee_method));
+      change_visibility(callee_method, caller_method->get_class());
+    }
+    inlined.insert(callee_method);
+  };
+
+  // With the CFG inliner, the callsites are gathered and then all inlined at
+  // once. Those that are no longer in the caller's CFG are skipped.
+  std::unordered_set<const IRInstruction*> in_cfg;
+  std::vector<std::pair<DexMethod*, IRInstruction*>> cfg_callsites;
+  if (m_config.use_cfg_inliner) {
+    for (const auto& mie : cfg::InstructionIterable(caller->cfg())) {
+      in_cfg.insert(mie.insn);
+    }
+  }
+
   // attempt to inline all inlinable candidates
   size_t estimated_insn_size = caller->editable_cfg_built()
                                    ? caller->cfg().sum_opcode_sizes()
                                    : caller->sum_opcode_sizes();
   for (auto inlinable : inlinables) {
     auto callee_method = inlinable.first;
-    auto callee = callee_method->get_code();
+    // Only read, so that the summary of the callee stays valid.
+    const IRCode* callee =
+        static_cast<const DexMethod*>(callee_method)->get_code();
     auto callsite = inlinable.second;
 
     if (!is_inlinable(caller_method, callee_method, callsite->insn,
                       estimated_insn_size)) {
       continue;
     }
+    auto callee_code_units = get_callee_summary(callee_method)->code_units;
 
     TRACE(MMINL, 4, "inline %s (%d) in %s (%d)", SHOW(callee),
           caller->get_registers_size(), SHOW(caller),
           callee->get_registers_size());
 
     if (m_config.use_cfg_inliner) {
-      bool success = inliner::inline_with_cfg(caller_method, callee_method,
-                                              callsite->insn);
-      if (!success) {
+      if (!in_cfg.count(callsite->insn)) {
+        // The callsite pointer is stale: its block was deleted since the
+        // callsite was found.
         continue;
       }
+      cfg_callsites.emplace_back(callee_method, callsite->insn);
     } else {
       // Logging before the call to inline_method to get the most relevant line
       // number near callsite before callsite gets replaced. Should be ok as
       // inline_method does not fail to inline.
       log_opt(INLINED, caller_method, callsite->insn);
 
-      inliner::inline_method(caller, callee, callsite);
+      inliner::inline_method(caller, callee_method->get_code(), callsite);
+      TRACE(INL, 2, "caller: %s\tcallee: %s", SHOW(caller), SHOW(callee));
     }
-    TRACE(INL, 2, "caller: %s\tcallee: %s", SHOW(caller), SHOW(callee));
-    estimated_insn_size += callee->editable_cfg_built()
-                               ? callee->cfg().sum_opcode_sizes()
-                               : callee->sum_opcode_sizes();
-
-    TRACE(MMINL, 6, "checking visibility usage of members in %s",
-          SHOW(callee));
-    change_visibility(callee_method, caller_method->get_class());
-    info.calls_inlined++;
-    inlined.insert(callee_method);
+    estimated_insn_size += callee_code_units;
+    record_inlined(callee_method);
+  }
+
+  if (!cfg_callsites.empty()) {
+    inliner::inline_with_cfg(caller_method, cfg_callsites);
+    TRACE(INL, 2, "caller: %s after inlining %zu callsites", SHOW(caller),
+          cfg_callsites.size());
   }
 
   for (IRCode* code : need_deconstruct) {
@@ -371,6 +541,7 @@ bool MultiMethodInliner::is_inlinable(DexMethod* caller,
 
   // Only now, when we'll indicating that the method inlinable, we'll record the
   // fact that we'll have to make some methods static.
+  std::lock_guard<std::mutex> lock(m_mutex);
   std::copy(make_static.begin(), make_static.end(),
             std::inserter(m_make_static, m_make_static.end()));
   return true;
@@ -403,9 +574,7 @@ bool MultiMethodInliner::is_estimate_over_max(uint64_t estimated_caller_size,
   // INSTRUCTION_BUFFER is added because the final method size is often larger
   // than our estimate -- during the sync phase, we may have to pick larger
   // branch opcodes to encode large jumps.
-  const IRCode* code = callee->get_code();
-  auto callee_size = code->editable_cfg_built() ? code->cfg().sum_opcode_sizes()
-                                                : code->sum_opcode_sizes();
+  auto callee_size = get_callee_summary(callee)->code_units;
   if (estimated_caller_size + callee_size > max - INSTRUCTION_BUFFER) {
     info.caller_too_large++;
     return true;
@@ -438,10 +607,27 @@ bool MultiMethodInliner::caller_too_large(DexType* caller_type,
 }
 
 bool MultiMethodInliner::should_inline(const DexMethod* caller,
-                                       const DexMethod* callee) const {
+                                       const DexMethod* callee) {
   if (callee->rstate.force_inline()) {
     return true;
   }
+  auto heat = get_heat(caller);
+  if (heat == Heat::Cold && too_large_for_cold_caller(callee)) {
+    info.cold_caller++;
+    log_nopt(INL_COLD_CALLER, callee);
+    return false;
+  }
+  if (heat == Heat::Hot) {
+    if (too_many_callers(callee, m_config.hot_callee_size_factor)) {
+      log_nopt(INL_TOO_MANY_CALLERS, callee);
+      return false;
+    }
+    if (too_many_callers(callee)) {
+      // Only inlined because the caller is hot.
+      info.hot_caller++;
+    }
+    return true;
+  }
   if (too_many_callers(callee)) {
     log_nopt(INL_TOO_MANY_CALLERS, callee);
     return false;
@@ -449,6 +635,30 @@ bool MultiMethodInliner::should_inline(const DexMethod* caller,
   return true;
 }
 
+MultiMethodInliner::Heat MultiMethodInliner::get_heat(
+    const DexMethod* method) const {
+  if (!m_config.use_method_profiles || m_config.method_to_weight == nullptr ||
+      m_config.method_to_weight->empty()) {
+    return Heat::Warm;
+  }
+  auto weight = get_method_weight_if_available(const_cast<DexMethod*>(method),
+                                               m_config.method_to_weight);
+  if (weight == 0) {
+    return Heat::Cold;
+  }
+  return weight >= m_config.hot_method_weight ? Heat::Hot : Heat::Warm;
+}
+
+bool MultiMethodInliner::too_large_for_cold_caller(const DexMethod* callee) {
+  // A callee with a single caller goes away once inlined.
+  if (!root(callee) && callee_caller.at(callee).size() == 1) {
+    return false;
+  }
+  // Otherwise only a callee as small as the invoke it replaces and its
+  // move-result doesn't grow the caller.
+  return get_callee_summary(callee)->important_opcodes > CODE_SIZE_ANY_CALLERS;
+}
+
 /*
  * Ignore internal opcodes because they do not take up any space in the final
  * dex file. Ignore move opcodes with the hope that RegAlloc will eliminate
@@ -466,23 +676,17 @@ static size_t count_important_opcodes(const IRCode* code) {
   return count;
 }
 
-bool MultiMethodInliner::too_many_callers(const DexMethod* callee) const {
+bool MultiMethodInliner::too_many_callers(const DexMethod* callee,
+                                          size_t size_factor) {
   const auto& callers = callee_caller.at(callee);
   auto caller_count = callers.size();
   always_assert(caller_count > 0);
 
-  auto opcode_counts_it = m_opcode_counts.find(callee);
-  size_t code_size;
-  if (opcode_counts_it != m_opcode_counts.end()) {
-    code_size = opcode_counts_it->second;
-  } else {
-    m_opcode_counts[callee] = code_size =
-        count_important_opcodes(callee->get_code());
-  }
+  size_t code_size = get_callee_summary(callee)->important_opcodes;
 
   if (root(callee)) {
     if (m_config.inline_small_non_deletables) {
-      return code_size > CODE_SIZE_ANY_CALLERS;
+      return code_size > CODE_SIZE_ANY_CALLERS * size_factor;
     } else {
       return true;
     }
@@ -492,34 +696,36 @@ bool MultiMethodInliner::too_many_callers(const DexMethod* callee) const {
     return false;
   }
 
-  auto callers_in_same_class_it = m_callers_in_same_class.find(callee);
   bool have_all_callers_same_class;
-  if (callers_in_same_class_it != m_callers_in_same_class.end()) {
-    have_all_callers_same_class = callers_in_same_class_it->second;
-  } else {
-    auto callee_class = callee->get_class();
-    have_all_callers_same_class = true;
-    for (auto caller : callers) {
-      if (caller->get_class() != callee_class) {
-        have_all_callers_same_class = false;
-        break;
-      }
-    }
-    m_callers_in_same_class.emplace(callee, have_all_callers_same_class);
-  }
+  m_callers_in_same_class.update(
+      callee, [&](const DexMethod*, bool& same_class, bool exists) {
+        if (!exists) {
+          auto callee_class = callee->get_class();
+          same_class = true;
+          for (auto caller : callers) {
+            if (caller->get_class() != callee_class) {
+              same_class = false;
+              break;
+            }
+          }
+        }
+        have_all_callers_same_class = same_class;
+      });
 
   unsigned long locality_advantage = have_all_callers_same_class ? 2 : 0;
   if (m_config.multiple_callers) {
     switch (caller_count) {
     case 2:
-      return code_size > CODE_SIZE_2_CALLERS + locality_advantage;
+      return code_size >
+             (CODE_SIZE_2_CALLERS + locality_advantage) * size_factor;
     case 3:
-      return code_size > CODE_SIZE_3_CALLERS + locality_advantage;
+      return code_size >
+             (CODE_SIZE_3_CALLERS + locality_advantage) * size_factor;
     default:
       break;
     }
   }
-  return code_size > CODE_SIZE_ANY_CALLERS + locality_advantage;
+  return code_size > (CODE_SIZE_ANY_CALLERS + locality_advantage) * size_factor;
 }
 
 bool MultiMethodInliner::caller_is_blacklisted(const DexMethod* caller) {
@@ -536,20 +742,7 @@ bool MultiMethodInliner::caller_is_blacklisted(const DexMethod* caller) {
  * in which case we cannot inline.
  */
 bool MultiMethodInliner::has_external_catch(const DexMethod* callee) {
-  const IRCode* code = callee->get_code();
-  std::vector<DexType*> types;
-  if (code->editable_cfg_built()) {
-    code->cfg().gather_catch_types(types);
-  } else {
-    code->gather_catch_types(types);
-  }
-  for (auto type : types) {
-    auto cls = type_class(type);
-    if (cls != nullptr && cls->is_external() && !is_public(cls)) {
-      return true;
-    }
-  }
-  return false;
+  return get_callee_summary(callee)->has_external_catch;
 }
 
 /**
@@ -560,51 +753,65 @@ bool MultiMethodInliner::cannot_inline_opcodes(
     const DexMethod* callee,
     const IRInstruction* invk_insn,
     std::vector<DexMethod*>* make_static) {
+  auto summary = get_callee_summary(callee);
+  const auto& check = caller->get_class() == callee->get_class()
+                          ? summary->same_class_check
+                          : summary->other_class_check;
+  if (invk_insn) {
+    if (check.nopt) {
+      log_nopt(*check.nopt, caller, invk_insn);
+    }
+    if (check.multiple_returns) {
+      log_nopt(INL_MULTIPLE_RETURNS, callee);
+    }
+  }
+  if (check.blocked) {
+    return true;
+  }
+  make_static->insert(
+      make_static->end(), check.make_static.begin(), check.make_static.end());
+  return false;
+}
+
+MultiMethodInliner::OpcodeCheck MultiMethodInliner::check_opcodes(
+    const DexMethod* callee, bool same_class) {
+  OpcodeCheck check;
   int ret_count = 0;
-  bool can_inline = true;
   editable_cfg_adapter::iterate(
       callee->get_code(), [&](const MethodItemEntry& mie) {
         auto insn = mie.insn;
-        if (create_vmethod(insn, callee, caller, make_static)) {
-          if (invk_insn) {
-            log_nopt(INL_CREATE_VMETH, caller, invk_insn);
-          }
-          can_inline = false;
+        if (create_vmethod(insn, same_class, &check.make_static)) {
+          check.nopt = INL_CREATE_VMETH;
+          check.blocked = true;
           return editable_cfg_adapter::LOOP_BREAK;
         }
         // if the caller and callee are in the same class, we don't have to
         // worry about invoke supers, or unknown virtuals -- private / protected
         // methods will remain accessible
-        if (caller->get_class() != callee->get_class()) {
+        if (!same_class) {
           if (nonrelocatable_invoke_super(insn)) {
-            if (invk_insn) {
-              log_nopt(INL_HAS_INVOKE_SUPER, caller, invk_insn);
-            }
-            can_inline = false;
+            check.nopt = INL_HAS_INVOKE_SUPER;
+            check.blocked = true;
             return editable_cfg_adapter::LOOP_BREAK;
           }
           if (unknown_virtual(insn)) {
-            if (invk_insn) {
-              log_nopt(INL_UNKNOWN_VIRTUAL, caller, invk_insn);
-            }
-            can_inline = false;
+            check.nopt = INL_UNKNOWN_VIRTUAL;
+            check.blocked = true;
             return editable_cfg_adapter::LOOP_BREAK;
           }
           if (unknown_field(insn)) {
-            if (invk_insn) {
-              log_nopt(INL_UNKNOWN_FIELD, caller, invk_insn);
-            }
-            can_inline = false;
+            check.nopt = INL_UNKNOWN_FIELD;
+            check.blocked = true;
             return editable_cfg_adapter::LOOP_BREAK;
           }
           if (check_android_os_version(insn)) {
-            can_inline = false;
+            check.blocked = true;
             return editable_cfg_adapter::LOOP_BREAK;
           }
         }
         if (!m_config.throws_inline && insn->opcode() == OPCODE_THROW) {
           info.throws++;
-          can_inline = false;
+          check.blocked = true;
           return editable_cfg_adapter::LOOP_BREAK;
         }
         if (is_return(insn->opcode())) {
@@ -621,12 +828,10 @@ bool MultiMethodInliner::cannot_inline_opcodes(
   // The CFG inliner can handle multiple return callees.
   if (ret_count > 1 && !m_config.use_cfg_inliner) {
     info.multi_ret++;
-    if (invk_insn) {
-      log_nopt(INL_MULTIPLE_RETURNS, callee);
-    }
-    can_inline = false;
+    check.multiple_returns = true;
+    check.blocked = true;
   }
-  return !can_inline;
+  return check;
 }
 
 /**
@@ -637,8 +842,7 @@ bool MultiMethodInliner::cannot_inline_opcodes(
  * This step would not be needed if we changed all private instance to static.
  */
 bool MultiMethodInliner::create_vmethod(IRInstruction* insn,
-                                        const DexMethod* callee,
-                                        const DexMethod* caller,
+                                        bool same_class,
                                         std::vector<DexMethod*>* make_static) {
   auto opcode = insn->opcode();
   if (opcode == OPCODE_INVOKE_DIRECT) {
@@ -648,7 +852,7 @@ bool MultiMethodInliner::create_vmethod(IRInstruction* insn,
       return true;
     }
     always_assert(method->is_def());
-    if (caller->get_class() == callee->get_class()) {
+    if (same_class) {
       // No need to give up here, or make it static. Visibility is just fine.
       return false;
     }
@@ -767,52 +971,80 @@ bool MultiMethodInliner::check_android_os_version(IRInstruction* insn) {
 
 bool MultiMethodInliner::cross_store_reference(const DexMethod* callee) {
   size_t store_idx = xstores.get_store_idx(callee->get_class());
-  bool has_cross_store_ref = false;
-  editable_cfg_adapter::iterate(
-      callee->get_code(), [&](const MethodItemEntry& mie) {
-        auto insn = mie.insn;
-        if (insn->has_type()) {
-          if (xstores.illegal_ref(store_idx, insn->get_type())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-        } else if (insn->has_method()) {
-          auto meth = insn->get_method();
-          if (xstores.illegal_ref(store_idx, meth->get_class())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-          auto proto = meth->get_proto();
-          if (xstores.illegal_ref(store_idx, proto->get_rtype())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-          auto args = proto->get_args();
-          if (args == nullptr) {
-            return editable_cfg_adapter::LOOP_CONTINUE;
-          }
-          for (const auto& arg : args->get_type_list()) {
-            if (xstores.illegal_ref(store_idx, arg)) {
-              info.cross_store++;
-              has_cross_store_ref = true;
-              return editable_cfg_adapter::LOOP_BREAK;
-            }
-          }
-        } else if (insn->has_field()) {
-          auto field = insn->get_field();
-          if (xstores.illegal_ref(store_idx, field->get_class()) ||
-              xstores.illegal_ref(store_idx, field->get_type())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
+  for (auto type : get_callee_summary(callee)->referenced_types) {
+    if (xstores.illegal_ref(store_idx, type)) {
+      info.cross_store++;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<const MultiMethodInliner::CalleeSummary>
+MultiMethodInliner::get_callee_summary(const DexMethod* callee) {
+  auto code_epoch = callee->get_code_epoch();
+  auto cached = m_callee_summaries.get(callee, nullptr);
+  if (cached && cached->code_epoch == code_epoch) {
+    return cached;
+  }
+
+  auto summary = std::make_shared<CalleeSummary>();
+  summary->code_epoch = code_epoch;
+  const IRCode* code = callee->get_code();
+  summary->code_units = code->editable_cfg_built()
+                            ? code->cfg().sum_opcode_sizes()
+                            : code->sum_opcode_sizes();
+  summary->important_opcodes = count_important_opcodes(code);
+
+  std::unordered_set<const DexType*> referenced_types;
+  editable_cfg_adapter::iterate(code, [&](const MethodItemEntry& mie) {
+    auto insn = mie.insn;
+    if (insn->has_type()) {
+      referenced_types.insert(insn->get_type());
+    } else if (insn->has_method()) {
+      auto meth = insn->get_method();
+      referenced_types.insert(meth->get_class());
+      auto proto = meth->get_proto();
+      referenced_types.insert(proto->get_rtype());
+      auto args = proto->get_args();
+      if (args != nullptr) {
+        for (const auto& arg : args->get_type_list()) {
+          referenced_types.insert(arg);
         }
-        return editable_cfg_adapter::LOOP_CONTINUE;
-      });
-  return has_cross_store_ref;
+      }
+    } else if (insn->has_field()) {
+      auto field = insn->get_field();
+      referenced_types.insert(field->get_class());
+      referenced_types.insert(field->get_type());
+    }
+    return editable_cfg_adapter::LOOP_CONTINUE;
+  });
+  summary->referenced_types.assign(referenced_types.begin(),
+                                   referenced_types.end());
+
+  std::vector<DexType*> catch_types;
+  if (code->editable_cfg_built()) {
+    code->cfg().gather_catch_types(catch_types);
+  } else {
+    code->gather_catch_types(catch_types);
+  }
+  for (auto type : catch_types) {
+    auto cls = type_class(type);
+    if (cls != nullptr && cls->is_external() && !is_public(cls)) {
+      summary->has_external_catch = true;
+      break;
+    }
+  }
+
+  summary->same_class_check = check_opcodes(callee, /* same_class */ true);
+  summary->other_class_check = check_opcodes(callee, /* same_class */ false);
+
+  m_callee_summaries.update(
+      callee,
+      [&](const DexMethod*,
+          std::shared_ptr<const CalleeSummary>& entry,
+          bool /* exists */) { entry = summary; });
+  return summary;
 }
 
 void MultiMethodInliner::invoke_direct_to_static() {
@@ -1289,11 +1521,31 @@ bool inline_with_cfg(DexMethod* caller_method,
   // inline_cfg does not fail to inline.
   log_opt(INLINED, caller_method, callsite);
 
-  auto callee_code = callee_method->get_code();
+  const IRCode* callee_code =
+      static_cast<const DexMethod*>(callee_method)->get_code();
   always_assert(callee_code->editable_cfg_built());
   cfg::CFGInliner::inline_cfg(&caller_cfg, callsite_it, callee_code->cfg());
 
   return true;
 }
 
+void inline_with_cfg(
+    DexMethod* caller_method,
+    const std::vector<std::pair<DexMethod*, IRInstruction*>>& callsites) {
+  auto caller_code = caller_method->get_code();
+  always_assert(caller_code->editable_cfg_built());
+  std::vector<std::pair<IRInstruction*, const cfg::ControlFlowGraph*>>
+      cfg_callsites;
+  cfg_callsites.reserve(callsites.size());
+  for (const auto& callsite : callsites) {
+    // Logged while the caller still has all its callsites.
+    log_opt(INLINED, caller_method, callsite.second);
+    const IRCode* callee_code =
+        static_cast<const DexMethod*>(callsite.first)->get_code();
+    always_assert(callee_code->editable_cfg_built());
+    cfg_callsites.emplace_back(callsite.second, &callee_code->cfg());
+  }
+  cfg::CFGInliner::inline_cfgs(&caller_code->cfg(), cfg_callsites);
+}
+
 } // namespace inliner
@@ -7,16 +7,22 @@
 
 #pragma once
 
+#include <atomic>
+#include <boost/optional.hpp>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <set>
 #include <vector>
 
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexStore.h"
 #include "IRCode.h"
+#include "OptDataDefs.h"
 #include "PatriciaTreeSet.h"
 #include "Resolver.h"
+#include "Walkers.h"
 
 namespace inliner {
 
@@ -55,6 +61,14 @@ bool inline_with_cfg(DexMethod* caller_method,
                      DexMethod* callee_method,
                      IRInstruction* callsite);
 
+/*
+ * Inline each callee at its callsite in a single pass over the caller's
+ * editable CFG. Unlike above, all the callsites must be in the CFG.
+ */
+void inline_with_cfg(
+    DexMethod* caller_method,
+    const std::vector<std::pair<DexMethod*, IRInstruction*>>& callsites);
+
 } // namespace inliner
 
 /**
@@ -74,6 +88,7 @@ enum MultiMethodInlinerMode {
  * Not all methods may be inlined both for restriction on the caller or the
  * callee.
  * Perform inlining bottom up.
+ * With InlinerConfig::parallel, the resolver must be thread-safe.
  */
 class MultiMethodInliner {
  public:
@@ -95,10 +110,21 @@ class MultiMethodInliner {
   }
 
   /**
-   * attempt inlining for all candidates.
+   * attempt inlining for all candidates, in parallel if the config says so.
    */
   void inline_methods();
 
+  /**
+   * Same as inline_methods(), but the callers are inlined into concurrently,
+   * each as soon as the callees it inlines are done. The callees are picked
+   * and the recursive calls broken exactly as inline_methods() does, so the
+   * same calls get inlined. The changes of visibility that inlining requires
+   * are however made at the end, and in the meantime each callee keeps its
+   * member references unresolved.
+   */
+  void inline_methods_in_parallel(
+      size_t num_threads = walk::parallel::default_num_threads());
+
   /**
    * Return the count of unique inlined methods.
    */
@@ -129,6 +155,15 @@ class MultiMethodInliner {
                     const IRInstruction* insn,
                     size_t estimated_insn_size);
 
+  /**
+   * The size of the callee's code in 16-bit code units, from the same cached
+   * summary that is_inlinable() uses. Thread-safe, as long as the code of the
+   * callee doesn't change at the same time.
+   */
+  size_t get_callee_code_units(const DexMethod* callee) {
+    return get_callee_summary(callee)->code_units;
+  }
+
  private:
   /**
    * Inline all callees into caller.
@@ -140,6 +175,18 @@ class MultiMethodInliner {
                      sparta::PatriciaTreeSet<DexMethod*> call_stack,
                      std::unordered_set<DexMethod*>* visited);
 
+  /**
+   * Same traversal as caller_inline, but instead of inlining, records the
+   * callers in the order they would be inlined into, along with the callees
+   * left once the recursive calls are dropped.
+   */
+  void plan_caller_inline(
+      DexMethod* caller,
+      const std::vector<DexMethod*>& callees,
+      sparta::PatriciaTreeSet<DexMethod*> call_stack,
+      std::unordered_set<DexMethod*>* visited,
+      std::vector<std::pair<DexMethod*, std::vector<DexMethod*>>>* plan);
+
   void inline_inlinables(
       DexMethod* caller,
       const std::vector<std::pair<DexMethod*, IRList::iterator>>& inlinables);
@@ -170,14 +217,27 @@ class MultiMethodInliner {
                              const IRInstruction* invk_insn,
                              std::vector<DexMethod*>* make_static);
 
+  /**
+   * The outcome of the opcode checks above, which only depends on whether the
+   * caller is in the same class as the callee.
+   */
+  struct OpcodeCheck {
+    bool blocked{false};
+    // What to log for the call sites, if anything.
+    boost::optional<NoptReason> nopt;
+    bool multiple_returns{false};
+    std::vector<DexMethod*> make_static;
+  };
+
+  OpcodeCheck check_opcodes(const DexMethod* callee, bool same_class);
+
   /**
    * Return true if inlining would require a method called from the callee
    * (candidate) to turn into a virtual method (e.g. private to public).
    * When returning false, a method might have been added to make_static.
    */
   bool create_vmethod(IRInstruction* insn,
-                      const DexMethod* callee,
-                      const DexMethod* caller,
+                      bool same_class,
                       std::vector<DexMethod*>* make_static);
 
   /**
@@ -244,13 +304,54 @@ class MultiMethodInliner {
    * a call to `inline_methods()`, but not if `inline_callees()` is invoked
    * directly.
    */
-  bool should_inline(const DexMethod* caller, const DexMethod* callee) const;
+  bool should_inline(const DexMethod* caller, const DexMethod* callee);
 
   /**
    * We want to avoid inlining a large method with many callers as that would
-   * bloat the bytecode.
+   * bloat the bytecode. The size limits are multiplied by size_factor.
+   */
+  bool too_many_callers(const DexMethod* callee, size_t size_factor = 1);
+
+  enum class Heat { Cold, Warm, Hot };
+
+  /**
+   * How hot a method is according to the method profile of
+   * InlinerConfig::use_method_profiles. Without a profile, all methods are
+   * warm.
    */
-  bool too_many_callers(const DexMethod* callee) const;
+  Heat get_heat(const DexMethod* method) const;
+
+  /**
+   * Return true if inlining the callee into a cold caller would make the app
+   * larger: the callee is kept, and its code is larger than the call.
+   */
+  bool too_large_for_cold_caller(const DexMethod* callee);
+
+  /**
+   * What the checks above need to know about a callee's code, scanned once
+   * for as long as the code doesn't change.
+   */
+  struct CalleeSummary {
+    uint64_t code_epoch;
+    // The size of the code in 16-bit code units.
+    size_t code_units{0};
+    // The instructions that take up space in the output, see
+    // count_important_opcodes().
+    size_t important_opcodes{0};
+    // The types of the classes, methods and fields the code refers to, for
+    // the cross-store checks.
+    std::vector<const DexType*> referenced_types;
+    bool has_external_catch{false};
+    OpcodeCheck same_class_check;
+    OpcodeCheck other_class_check;
+  };
+
+  /**
+   * Thread-safe, as long as the code of the callee doesn't change at the same
+   * time.
+   */
+  std::shared_ptr<const CalleeSummary> get_callee_summary(
+      const DexMethod* callee);
 
   /**
    * Staticize required methods (stored in `m_make_static`) and update
@@ -288,36 +389,49 @@ class MultiMethodInliner {
   std::map<DexMethod*, std::vector<DexMethod*>, dexmethods_comparator>
       caller_callee;
 
-  // Cache of the opcode counts of each method after all its eligible callsites
-  // have been inlined.
-  mutable std::unordered_map<const DexMethod*, size_t> m_opcode_counts;
+  // The summaries of the callees, along with the code epoch they were taken
+  // at. Queried once all the eligible callsites of a callee have been
+  // inlined.
+  ConcurrentMap<const DexMethod*, std::shared_ptr<const CalleeSummary>>
+      m_callee_summaries;
 
   // Cache of whether all callers of a callee are in the same class.
-  mutable std::unordered_map<const DexMethod*, bool> m_callers_in_same_class;
+  ConcurrentMap<const DexMethod*, bool> m_callers_in_same_class;
+
+  // Guards `inlined`, `m_make_static` and `m_delayed_visibility_changes`.
+  std::mutex m_mutex;
+
+  // While inlining in parallel, the callees and the classes of the callers
+  // they were inlined into, for change_visibility().
+  std::unique_ptr<std::vector<std::pair<DexMethod*, DexType*>>>
+      m_delayed_visibility_changes;
 
  private:
   /**
-   * Info about inlining.
+   * Info about inlining, updated concurrently by
+   * inline_methods_in_parallel().
    */
   struct InliningInfo {
-    size_t calls_inlined{0};
-    size_t recursive{0};
-    size_t not_found{0};
-    size_t blacklisted{0};
-    size_t throws{0};
-    size_t multi_ret{0};
-    size_t need_vmethod{0};
-    size_t invoke_super{0};
-    size_t write_over_ins{0};
-    size_t escaped_virtual{0};
-    size_t known_public_methods{0};
-    size_t unresolved_methods{0};
-    size_t non_pub_virtual{0};
-    size_t escaped_field{0};
-    size_t non_pub_field{0};
-    size_t non_pub_ctor{0};
-    size_t cross_store{0};
-    size_t caller_too_large{0};
+    std::atomic<size_t> calls_inlined{0};
+    std::atomic<size_t> recursive{0};
+    std::atomic<size_t> not_found{0};
+    std::atomic<size_t> blacklisted{0};
+    std::atomic<size_t> throws{0};
+    std::atomic<size_t> multi_ret{0};
+    std::atomic<size_t> need_vmethod{0};
+    std::atomic<size_t> invoke_super{0};
+    std::atomic<size_t> write_over_ins{0};
+    std::atomic<size_t> escaped_virtual{0};
+    std::atomic<size_t> known_public_methods{0};
+    std::atomic<size_t> unresolved_methods{0};
+    std::atomic<size_t> non_pub_virtual{0};
+    std::atomic<size_t> escaped_field{0};
+    std::atomic<size_t> non_pub_field{0};
+    std::atomic<size_t> non_pub_ctor{0};
+    std::atomic<size_t> cross_store{0};
+    std::atomic<size_t> caller_too_large{0};
+    std::atomic<size_t> cold_caller{0};
+    std::atomic<size_t> hot_caller{0};
   };
   InliningInfo info;
 
@@ -22,6 +22,22 @@ struct InlinerConfig {
   bool multiple_callers{false};
   bool inline_small_non_deletables{false};
   bool use_cfg_inliner{false};
+  // Inline into the callers whose callees are all done concurrently. The
+  // result doesn't depend on the number of threads.
+  bool parallel{false};
+  // Run constant propagation, copy propagation and local DCE on the
+  // candidates before inlining them.
+  bool shrink_callees{false};
+  // Let the method profile guide inlining: callees may be
+  // hot_callee_size_factor times as large when inlined into callers at least
+  // hot_method_weight heavy, and the callers the profile doesn't list are cold
+  // and only get the inlinings that don't make the app larger.
+  bool use_method_profiles{false};
+  size_t hot_method_weight{1};
+  size_t hot_callee_size_factor{2};
+  // The profile, from ConfigFiles::get_method_to_weight.
+  const std::unordered_map<std::string, unsigned int>* method_to_weight{
+      nullptr};
   std::unordered_set<DexType*> whitelist_no_method_limit;
   // We will populate the information to rstate of classes and methods.
   std::unordered_set<DexType*> m_no_inline_annos;
@@ -409,7 +409,15 @@ static void lower_simple_instruction(DexMethod*,
   }
 }
 
-Stats lower(DexMethod* method, bool lower_with_cfg) {
+static const std::vector<uint64_t>* get_block_heat(
+    const BlockHeat& block_heat, const DexMethod* method) {
+  auto it = block_heat.find(method->get_fully_deobfuscated_name());
+  return it == block_heat.end() ? nullptr : &it->second;
+}
+
+Stats lower(DexMethod* method,
+            bool lower_with_cfg,
+            const BlockHeat* block_heat) {
   Stats stats;
   auto* code = method->get_code();
   always_assert(code != nullptr);
@@ -419,26 +427,36 @@ Stats lower(DexMethod* method, bool lower_with_cfg) {
   // avoid this bug, we use the CFG to remove empty blocks.
   if (lower_with_cfg) {
     code->build_cfg(/* editable */ true);
+    auto heat = block_heat == nullptr
+                    ? nullptr
+                    : get_block_heat(*block_heat, method);
+    if (heat != nullptr) {
+      if (heat->size() == code->cfg().blocks().size()) {
+        code->cfg().set_block_heat(*heat);
+        ++stats.profile_guided_layouts;
+      } else {
+        ++stats.block_heat_mismatches;
+      }
+    }
     code->clear_cfg();
   }
 
   // Check the load-param opcodes make sense before removing them
   check_load_params(method);
 
+  // Lower everything in a single pass over the method. The switch opcodes
+  // depend on case keys that may only show up after the switch itself, so
+  // they are picked once the pass is done.
   std::unordered_map<MethodItemEntry*, std::vector<int32_t>> case_keys;
-  for (const MethodItemEntry& it : *code) {
-    if (it.type == MFLOW_TARGET) {
-      BranchTarget* bt = it.target;
+  std::vector<MethodItemEntry*> switches;
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type == MFLOW_TARGET) {
+      BranchTarget* bt = it->target;
       if (bt->type == BRANCH_MULTI) {
         case_keys[bt->src].push_back(bt->case_key);
       }
+      continue;
     }
-  }
-  for (auto& entry : case_keys) {
-    std::sort(entry.second.begin(), entry.second.end());
-  }
-
-  for (auto it = code->begin(); it != code->end(); ++it) {
     if (it->type != MFLOW_OPCODE) {
       continue;
     }
@@ -448,7 +466,12 @@ Stats lower(DexMethod* method, bool lower_with_cfg) {
 
     if (opcode::is_load_param(op)) {
       code->remove_opcode(it);
-    } else if (op == OPCODE_CHECK_CAST) {
+      continue;
+    }
+    // Each lowering replaces the instruction in place, and may then move `it`
+    // on to its move-result-pseudo.
+    auto lowered = it;
+    if (op == OPCODE_CHECK_CAST) {
       stats.move_for_check_cast += lower_check_cast(method, code, &it);
     } else if (op == OPCODE_FILL_ARRAY_DATA) {
       lower_fill_array_data(method, code, it);
@@ -458,35 +481,39 @@ Stats lower(DexMethod* method, bool lower_with_cfg) {
       lower_simple_instruction(method, code, &it);
     }
 
-    // Overwrite the switch dex opcode with the correct type, depending on how
-    // its cases are laid out.
     if (op == OPCODE_SWITCH) {
-      const auto& keys = case_keys.at(&*it);
-      DexOpcode dop = sufficiently_sparse(keys) ? DOPCODE_SPARSE_SWITCH
-                                                : DOPCODE_PACKED_SWITCH;
-      it->dex_insn->set_opcode(dop);
+      switches.push_back(&*lowered);
+    } else {
+      stats.to_2addr += try_2addr_conversion(&*lowered);
     }
   }
-  for (auto it = code->begin(); it != code->end(); ++it) {
-    always_assert(it->type != MFLOW_OPCODE);
-    if (it->type != MFLOW_DEX_OPCODE) {
-      continue;
-    }
-    stats.to_2addr += try_2addr_conversion(&*it);
+
+  // Overwrite the switch dex opcode with the correct type, depending on how
+  // its cases are laid out.
+  for (auto* mie : switches) {
+    auto& keys = case_keys.at(mie);
+    std::sort(keys.begin(), keys.end());
+    DexOpcode dop = sufficiently_sparse(keys) ? DOPCODE_SPARSE_SWITCH
+                                              : DOPCODE_PACKED_SWITCH;
+    mie->dex_insn->set_opcode(dop);
   }
   return stats;
 }
 
-Stats run(DexStoresVector& stores, bool lower_with_cfg) {
+Stats run(DexStoresVector& stores,
+          bool lower_with_cfg,
+          const BlockHeat* block_heat) {
   auto scope = build_class_scope(stores);
-  return walk::parallel::reduce_methods<Stats>(
+  // Lowering time is roughly linear in the size of a method, and a handful of
+  // huge methods would otherwise run last on a single thread.
+  return walk::parallel::reduce_methods_by_cost<Stats>(
       scope,
-      [lower_with_cfg](DexMethod* m) {
+      [lower_with_cfg, block_heat](DexMethod* m) {
         Stats stats;
         if (m->get_code() == nullptr) {
           return stats;
         }
-        stats.accumulate(lower(m, lower_with_cfg));
+        stats.accumulate(lower(m, lower_with_cfg, block_heat));
         return stats;
       },
       [](Stats a, Stats b) {
@@ -16,12 +16,20 @@ namespace instruction_lowering {
 struct Stats {
   size_t to_2addr{0};
   size_t move_for_check_cast{0};
+  size_t profile_guided_layouts{0};
+  size_t block_heat_mismatches{0};
   void accumulate(const Stats& that) {
     to_2addr += that.to_2addr;
     move_for_check_cast += that.move_for_check_cast;
+    profile_guided_layouts += that.profile_guided_layouts;
+    block_heat_mismatches += that.block_heat_mismatches;
   }
 };
 
+// The heat of the blocks of each method, by fully deobfuscated name, as in
+// ConfigFiles::get_method_to_block_heat.
+using BlockHeat = std::unordered_map<std::string, std::vector<uint64_t>>;
+
 /*
  * Convert IRInstructions to DexInstructions while doing the following:
  *
@@ -31,10 +39,18 @@ struct Stats {
  *     have different src and dest registers.
  *   - Record the number of instructions converted to /2ddr form, also the
  *     number of move instruction inserted because of check-cast.
+ *
+ * When lowering with the CFG, the blocks of the methods in `block_heat` are
+ * laid out by their heat, see ControlFlowGraph::set_block_heat. The heat of a
+ * method whose number of blocks changed since it was profiled is ignored.
  */
-Stats lower(DexMethod*, bool lower_with_cfg = false);
+Stats lower(DexMethod*,
+            bool lower_with_cfg = false,
+            const BlockHeat* block_heat = nullptr);
 
-Stats run(DexStoresVector&, bool lower_with_cfg = false);
+Stats run(DexStoresVector&,
+          bool lower_with_cfg = false,
+          const BlockHeat* block_heat = nullptr);
 
 namespace impl {
 
@@ -0,0 +1,334 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InstrumentProfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+#include "BinarySerialization.h"
+#include "Debug.h"
+#include "Trace.h"
+#include "WorkQueue.h"
+
+namespace instrument {
+
+namespace {
+
+constexpr uint32_t MAGIC = 0xfaceb000;
+constexpr uint32_t BLOCKS_PER_VECTOR = 15;
+
+bool read_file(const std::string& path, std::string& data) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(in),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+void write_u32(std::ostream& os, uint32_t value) {
+  binary_serialization::write(os, value);
+}
+
+uint32_t read_u32(const char* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+class MetadataReader {
+ public:
+  MetadataReader(const std::string& data, const std::string& path)
+      : m_data(data), m_path(path) {}
+
+  uint32_t u32() {
+    check(sizeof(uint32_t));
+    auto value = read_u32(m_data.data() + m_pos);
+    m_pos += sizeof(uint32_t);
+    return value;
+  }
+
+  std::string str() {
+    auto size = u32();
+    check(size);
+    auto value = m_data.substr(m_pos, size);
+    m_pos += size;
+    return value;
+  }
+
+  bool at_end() const { return m_pos == m_data.size(); }
+
+ private:
+  void check(size_t size) const {
+    always_assert_log(m_pos + size <= m_data.size(),
+                      "Truncated instrumentation metadata %s",
+                      m_path.c_str());
+  }
+
+  const std::string& m_data;
+  const std::string& m_path;
+  size_t m_pos{0};
+};
+
+// The expanded counters of the metadata: one per bit with BLOCK_BITS.
+size_t num_totals(const InstrumentMetadata& metadata) {
+  return metadata.kind == ProfileKind::BLOCK_BITS
+             ? size_t(metadata.num_counters) * BLOCKS_PER_VECTOR
+             : metadata.num_counters;
+}
+
+struct Totals {
+  std::vector<uint64_t> counts;
+  size_t num_profiles{0};
+  size_t num_rejected{0};
+};
+
+void add_profile(const InstrumentMetadata& metadata,
+                 const std::string& path,
+                 Totals& totals) {
+  std::string data;
+  constexpr size_t header_size = 3 * sizeof(uint32_t);
+  const size_t expected_size =
+      header_size + size_t(metadata.num_counters) * sizeof(uint32_t);
+  if (!read_file(path, data) || data.size() != expected_size ||
+      read_u32(data.data()) != MAGIC ||
+      read_u32(data.data() + 4) != PROFILE_VERSION ||
+      read_u32(data.data() + 8) != metadata.num_counters) {
+    TRACE(INSTRUMENT, 1, "Rejecting profile %s", path.c_str());
+    ++totals.num_rejected;
+    return;
+  }
+  const char* counters = data.data() + header_size;
+  auto& counts = totals.counts;
+  for (size_t i = 0; i < metadata.num_counters; ++i) {
+    auto value = read_u32(counters + i * sizeof(uint32_t));
+    if (metadata.kind != ProfileKind::BLOCK_BITS) {
+      counts[i] += value;
+      continue;
+    }
+    // The top bit of the vectors only marks their continuation.
+    for (uint32_t b = 0; b < BLOCKS_PER_VECTOR; ++b) {
+      counts[i * BLOCKS_PER_VECTOR + b] += (value >> b) & 1;
+    }
+  }
+  ++totals.num_profiles;
+}
+
+void summarize_method(const InstrumentMetadata& metadata,
+                      const MethodMetadata& method,
+                      const std::vector<uint64_t>& counts,
+                      ProfileSummary& summary) {
+  std::vector<uint64_t> heat;
+  uint64_t weight = 0;
+  switch (metadata.kind) {
+  case ProfileKind::METHOD_COUNTS:
+    weight = method.num_counters > 0 ? counts[method.first_counter] : 0;
+    break;
+  case ProfileKind::BLOCK_BITS: {
+    auto first = counts.begin() + method.first_counter * BLOCKS_PER_VECTOR;
+    heat.assign(first, first + method.graph.num_blocks);
+    for (auto h : heat) {
+      weight = std::max(weight, h);
+    }
+    break;
+  }
+  case ProfileKind::EDGE_COUNTS: {
+    const auto& graph = method.graph;
+    std::vector<uint64_t> edge_counts(graph.edges.size(), 0);
+    size_t counter = method.first_counter;
+    for (size_t i = 0; i < edge_counts.size(); ++i) {
+      if (method.counted[i]) {
+        edge_counts[i] = counts[counter++];
+      }
+    }
+    heat = derive_block_counts(graph, method.counted, edge_counts);
+    // The calls are what comes into the entry block other than through the
+    // edges of the method.
+    if (graph.num_blocks > 0) {
+      uint64_t looped = 0;
+      for (size_t i = 0; i < edge_counts.size(); ++i) {
+        if (graph.edges[i].dst == graph.entry) {
+          looped += edge_counts[i];
+        }
+      }
+      weight = heat[graph.entry] - std::min(looped, heat[graph.entry]);
+    }
+    break;
+  }
+  }
+  if (weight > 0) {
+    summary.method_weights[method.name] = weight;
+  }
+  if (std::any_of(heat.begin(), heat.end(), [](uint64_t h) { return h > 0; })) {
+    summary.block_heat[method.name] = std::move(heat);
+  }
+}
+
+} // namespace
+
+void InstrumentMetadata::write(std::ostream& os) const {
+  binary_serialization::write_header(os, METADATA_VERSION);
+  write_u32(os, static_cast<uint32_t>(kind));
+  write_u32(os, num_counters);
+  always_assert(methods.size() <= std::numeric_limits<uint32_t>::max());
+  write_u32(os, methods.size());
+  for (const auto& method : methods) {
+    always_assert(method.name.size() <= std::numeric_limits<uint32_t>::max());
+    always_assert(uint64_t(method.first_counter) + method.num_counters <=
+                  num_counters);
+    write_u32(os, method.name.size());
+    os << method.name;
+    write_u32(os, method.first_counter);
+    write_u32(os, method.num_counters);
+    write_u32(os, method.graph.num_blocks);
+    if (kind != ProfileKind::EDGE_COUNTS) {
+      continue;
+    }
+    const auto& graph = method.graph;
+    always_assert(method.counted.size() == graph.edges.size());
+    write_u32(os, graph.entry);
+    write_u32(os, graph.edges.size());
+    for (size_t i = 0; i < graph.edges.size(); ++i) {
+      write_u32(os, graph.edges[i].src);
+      write_u32(os, graph.edges[i].dst);
+      write_u32(os, method.counted[i]);
+    }
+    std::vector<uint32_t> throwing;
+    for (uint32_t n = 0; n < graph.may_throw.size(); ++n) {
+      if (graph.may_throw[n]) {
+        throwing.push_back(n);
+      }
+    }
+    binary_serialization::write_array(os, throwing);
+  }
+}
+
+InstrumentMetadata InstrumentMetadata::read(const std::string& path) {
+  std::string data;
+  always_assert_log(read_file(path, data), "Can't open %s", path.c_str());
+  MetadataReader in(data, path);
+  always_assert_log(in.u32() == MAGIC, "Magic number mismatch in %s",
+                    path.c_str());
+  auto version = in.u32();
+  always_assert_log(version == METADATA_VERSION,
+                    "Expected instrumentation metadata version %u, got %u",
+                    METADATA_VERSION, version);
+
+  InstrumentMetadata metadata;
+  auto kind = in.u32();
+  always_assert_log(kind <= static_cast<uint32_t>(ProfileKind::EDGE_COUNTS),
+                    "Unknown profile kind %u in %s", kind, path.c_str());
+  metadata.kind = static_cast<ProfileKind>(kind);
+  metadata.num_counters = in.u32();
+  metadata.methods.resize(in.u32());
+  for (auto& method : metadata.methods) {
+    method.name = in.str();
+    method.first_counter = in.u32();
+    method.num_counters = in.u32();
+    method.graph.num_blocks = in.u32();
+    always_assert_log(uint64_t(method.first_counter) + method.num_counters <=
+                          metadata.num_counters,
+                      "Counters of %s out of range in %s", method.name.c_str(),
+                      path.c_str());
+    switch (metadata.kind) {
+    case ProfileKind::METHOD_COUNTS:
+      break;
+    case ProfileKind::BLOCK_BITS:
+      always_assert_log(
+          method.graph.num_blocks <= method.num_counters * BLOCKS_PER_VECTOR,
+          "Blocks of %s out of range in %s", method.name.c_str(),
+          path.c_str());
+      break;
+    case ProfileKind::EDGE_COUNTS: {
+      auto& graph = method.graph;
+      graph.entry = in.u32();
+      graph.edges.resize(in.u32());
+      method.counted.resize(graph.edges.size());
+      uint32_t num_counted = 0;
+      for (size_t i = 0; i < graph.edges.size(); ++i) {
+        auto& e = graph.edges[i];
+        e.src = in.u32();
+        e.dst = in.u32();
+        e.weight = 0;
+        method.counted[i] = in.u32() != 0;
+        num_counted += method.counted[i];
+        always_assert_log(e.src <= graph.num_blocks &&
+                              e.dst <= graph.num_blocks,
+                          "Edge of %s out of range in %s",
+                          method.name.c_str(), path.c_str());
+      }
+      always_assert_log(num_counted == method.num_counters,
+                        "%s has %u counted edges but %u counters in %s",
+                        method.name.c_str(), num_counted, method.num_counters,
+                        path.c_str());
+      graph.may_throw.resize(graph.num_blocks, false);
+      for (auto n = in.u32(); n > 0; --n) {
+        auto block = in.u32();
+        always_assert_log(block < graph.num_blocks,
+                          "Throwing block of %s out of range in %s",
+                          method.name.c_str(), path.c_str());
+        graph.may_throw[block] = true;
+      }
+      break;
+    }
+    }
+  }
+  always_assert_log(in.at_end(), "Trailing data in %s", path.c_str());
+  return metadata;
+}
+
+ProfileSummary merge_profiles(const InstrumentMetadata& metadata,
+                              const std::vector<std::string>& profile_paths,
+                              unsigned int num_threads) {
+  if (num_threads == 0) {
+    num_threads = redex_parallel::default_num_threads();
+  }
+  std::vector<std::unique_ptr<Totals>> per_thread;
+  auto wq = WorkQueue<const std::string*, Totals*, std::nullptr_t>(
+      [&](WorkerState<const std::string*, Totals*, std::nullptr_t>* state,
+          const std::string* path) {
+        add_profile(metadata, *path, *state->get_data());
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; }, // reducer
+      [&](unsigned int /*thread_index*/) { // data initializer
+        per_thread.emplace_back(std::make_unique<Totals>());
+        per_thread.back()->counts.resize(num_totals(metadata), 0);
+        return per_thread.back().get();
+      },
+      num_threads);
+  for (const auto& path : profile_paths) {
+    wq.add_item(&path);
+  }
+  wq.run_all();
+
+  ProfileSummary summary;
+  std::vector<uint64_t> counts(num_totals(metadata), 0);
+  for (const auto& totals : per_thread) {
+    for (size_t i = 0; i < counts.size(); ++i) {
+      counts[i] += totals->counts[i];
+    }
+    summary.num_profiles += totals->num_profiles;
+    summary.num_rejected += totals->num_rejected;
+  }
+  for (const auto& method : metadata.methods) {
+    summarize_method(metadata, method, counts, summary);
+  }
+  TRACE(INSTRUMENT, 1,
+        "Merged %zu profiles (%zu rejected): %zu methods ran, %zu with blocks",
+        summary.num_profiles, summary.num_rejected,
+        summary.method_weights.size(), summary.block_heat.size());
+  return summary;
+}
+
+} // namespace instrument
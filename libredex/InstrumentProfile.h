@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "EdgeProfile.h"
+
+/*
+ * The binary side of InstrumentPass: the metadata that says which counters
+ * belong to which method, and the merging of the profiles that instrumented
+ * apps collect on devices into method weights and block heat.
+ *
+ * A profile is the values of all the counters of one run, as u32s in counter
+ * order: the uploader untangles the sharded arrays, see
+ * do_simple_method_tracing in Instrument.cpp. After the header of
+ * binary_serialization::write_header, a profile has
+ *
+ *   <counters count><counter 0><counter 1>...
+ *
+ * and the counters count has to be the one of the metadata.
+ */
+namespace instrument {
+
+constexpr uint32_t METADATA_VERSION = 1;
+constexpr uint32_t PROFILE_VERSION = 1;
+
+enum class ProfileKind : uint32_t {
+  // simple_method_tracing: the first counter of a method is its number of
+  // calls.
+  METHOD_COUNTS = 0,
+  // basic_block_tracing: each counter is a bit vector of 15 blocks, where
+  // bit b of counter c is set when block 15 * c + b ran.
+  BLOCK_BITS = 1,
+  // basic_block_edge_counting: the counters count the edges of
+  // EdgeProfile.h.
+  EDGE_COUNTS = 2,
+};
+
+struct MethodMetadata {
+  // The fully deobfuscated name, as in ConfigFiles::get_method_to_weight.
+  std::string name;
+  uint32_t first_counter{0};
+  uint32_t num_counters{0};
+  // Only num_blocks is set for BLOCK_BITS, and nothing for METHOD_COUNTS.
+  EdgeProfileGraph graph;
+  // EDGE_COUNTS: the edges that have the counters, in order.
+  std::vector<bool> counted;
+};
+
+/*
+ * After the header of binary_serialization::write_header, the metadata has
+ *
+ *   <kind><counters count><methods count>
+ *
+ * and then for each method
+ *
+ *   <name size><name><first counter><counters count><blocks count>
+ *
+ * followed, for EDGE_COUNTS only, by
+ *
+ *   <entry><edges count><src><dst><counted>...<throwing count><block>...
+ *
+ * where all the numbers are u32s.
+ */
+struct InstrumentMetadata {
+  ProfileKind kind{ProfileKind::METHOD_COUNTS};
+  uint32_t num_counters{0};
+  std::vector<MethodMetadata> methods;
+
+  void write(std::ostream& os) const;
+  static InstrumentMetadata read(const std::string& path);
+};
+
+struct ProfileSummary {
+  size_t num_profiles{0};
+  // Profiles that could not be read, or that don't match the metadata.
+  size_t num_rejected{0};
+  // For each method that ran, its number of calls, or with BLOCK_BITS the
+  // number of profiles that its most covered block ran in.
+  std::unordered_map<std::string, uint64_t> method_weights;
+  // For each method with blocks that ran, how often each block ran, or with
+  // BLOCK_BITS in how many profiles.
+  std::unordered_map<std::string, std::vector<uint64_t>> block_heat;
+};
+
+/*
+ * Sums up the profiles on `num_threads` threads, 0 for one per core, each
+ * with counters of its own, and derives the summary from the total.
+ */
+ProfileSummary merge_profiles(const InstrumentMetadata& metadata,
+                              const std::vector<std::string>& profile_paths,
+                              unsigned int num_threads);
+
+} // namespace instrument
@@ -7,7 +7,10 @@
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
+#include <atomic>
 #include <cstdint>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <zlib.h>
 
@@ -23,6 +26,7 @@
 #include "JarLoader.h"
 #include "Trace.h"
 #include "Util.h"
+#include "WorkQueue.h"
 
 /******************
  * Begin Class Loading code.
@@ -368,10 +372,8 @@ void read_dup_class_whitelist(const JsonWrapper& json_cfg) {
   TRACE(MAIN, 1, "}");
 }
 
-static bool parse_class(uint8_t* buffer,
-                        Scope* classes,
-                        attribute_hook_t attr_hook,
-                        const std::string& jar_location = "") {
+// Reads everything up to and including the constant pool.
+static bool parse_class_header(uint8_t*& buffer, std::vector<cp_entry>& cpool) {
   uint32_t magic = read32(buffer);
   uint16_t vminor DEBUG_ONLY = read16(buffer);
   uint16_t vmajor DEBUG_ONLY = read16(buffer);
@@ -380,7 +382,6 @@ static bool parse_class(uint8_t* buffer,
     fprintf(stderr, "Bad class magic %08x, Bailing\n", magic);
     return false;
   }
-  std::vector<cp_entry> cpool;
   cpool.resize(cp_count);
   /* The zero'th entry is always empty.  Java is annoying. */
   for (int i=1; i<cp_count; i++) {
@@ -392,6 +393,28 @@ static bool parse_class(uint8_t* buffer,
       i++;
     }
   }
+  return true;
+}
+
+// Returns the type a class file defines, without creating the class.
+static DexType* parse_class_type(uint8_t* buffer) {
+  std::vector<cp_entry> cpool;
+  if (!parse_class_header(buffer, cpool)) {
+    return nullptr;
+  }
+  read16(buffer); // access flags
+  uint16_t clazz = read16(buffer);
+  return make_dextype_from_cref(cpool, clazz);
+}
+
+static bool parse_class(uint8_t* buffer,
+                        Scope* classes,
+                        attribute_hook_t attr_hook,
+                        const std::string& jar_location = "") {
+  std::vector<cp_entry> cpool;
+  if (!parse_class_header(buffer, cpool)) {
+    return false;
+  }
   uint16_t aflags = read16(buffer);
   uint16_t clazz = read16(buffer);
   uint16_t super = read16(buffer);
@@ -769,90 +792,199 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
   return true;
 }
 
-static const int kStartBufferSize = 128 * 1024;
-
-static bool process_jar_entries(const char* location,
-                                std::vector<jar_entry>& files,
-                                const uint8_t* mapping,
-                                Scope* classes,
-                                attribute_hook_t attr_hook) {
-  ssize_t bufsize = kStartBufferSize;
-  uint8_t *outbuffer = (uint8_t*)malloc(bufsize);
-  static char classEndString[] = ".class";
-  static size_t classEndStringLen = strlen(classEndString);
-  init_basic_types();
-  for (auto &file : files) {
-    if (file.cd_entry.ucomp_size == 0)
-      continue;
-    if (file.cd_entry.fname_len < (classEndStringLen  + 1))
-      continue;
-
-    // Skip non-class files
-    uint8_t *endcomp = file.filename +
-      (file.cd_entry.fname_len - classEndStringLen);
-    if (memcmp(endcomp, classEndString, classEndStringLen) != 0)
-      continue;
-
-    // Resize output if necessary.
-    if (bufsize < file.cd_entry.ucomp_size) {
-      while(bufsize < file.cd_entry.ucomp_size)
-        bufsize *= 2;
-      free(outbuffer);
-      outbuffer = (uint8_t*)malloc(bufsize);
-    }
+namespace {
 
-    if (!decompress_class(file, mapping, outbuffer, bufsize)) {
-      free(outbuffer);
-      return false;
-    }
+struct jar_file {
+  std::string location;
+  boost::iostreams::mapped_file file;
+  std::vector<jar_entry> entries;
+};
 
-    if (!parse_class(outbuffer, classes, attr_hook, location)) {
-      free(outbuffer);
-      return false;
-    }
-  }
-  free(outbuffer);
-  return true;
-}
+struct class_file {
+  const jar_file* jar;
+  jar_entry* entry;
+  DexType* type{nullptr};
+  // Whether this is the first definition of `type` on the classpath.
+  bool first{false};
+  DexClass* cls{nullptr};
+};
 
-static bool process_jar(const char* location,
-                        const uint8_t* mapping,
-                        ssize_t size,
-                        Scope* classes,
-                        attribute_hook_t attr_hook) {
-  pk_cdir_end pce;
-  std::vector<jar_entry> files;
-  if (!find_central_directory(mapping, size, pce))
+bool is_class_entry(const jar_entry& file) {
+  static const char classEndString[] = ".class";
+  static const size_t classEndStringLen = strlen(classEndString);
+  if (file.cd_entry.ucomp_size == 0)
     return false;
-  if (!validate_pce(pce, size))
+  if (file.cd_entry.fname_len < (classEndStringLen + 1))
     return false;
-  if (!get_jar_entries(mapping, pce, files))
+  const uint8_t* endcomp =
+      file.filename + (file.cd_entry.fname_len - classEndStringLen);
+  return memcmp(endcomp, classEndString, classEndStringLen) == 0;
+}
+
+bool open_jar(jar_file& jar) {
+  try {
+    jar.file.open(jar.location, boost::iostreams::mapped_file::readonly);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "error: cannot open jar file: %s\n", jar.location.c_str());
     return false;
-  if (!process_jar_entries(location, files, mapping, classes, attr_hook)) {
+  }
+  auto mapping = reinterpret_cast<const uint8_t*>(jar.file.const_data());
+  ssize_t size = jar.file.size();
+  pk_cdir_end pce;
+  if (!find_central_directory(mapping, size, pce) ||
+      !validate_pce(pce, size) ||
+      !get_jar_entries(mapping, pce, jar.entries)) {
+    fprintf(stderr, "error: cannot process jar: %s\n", jar.location.c_str());
     return false;
   }
   return true;
 }
 
-bool load_jar_file(const char* location,
-                   Scope* classes,
-                   attribute_hook_t attr_hook) {
-  boost::iostreams::mapped_file file;
-  try {
-    file.open(location, boost::iostreams::mapped_file::readonly);
-  } catch (const std::exception& e) {
-    fprintf(stderr, "error: cannot open jar file: %s\n", location);
+// Inflates into a buffer owned by the calling thread, which is valid until
+// the thread's next call.
+uint8_t* inflate_class(class_file& cf) {
+  thread_local std::vector<uint8_t> buffer;
+  if (buffer.size() < cf.entry->cd_entry.ucomp_size) {
+    buffer.resize(cf.entry->cd_entry.ucomp_size);
+  }
+  auto mapping = reinterpret_cast<const uint8_t*>(cf.jar->file.const_data());
+  if (!decompress_class(*cf.entry, mapping, buffer.data(), buffer.size())) {
+    return nullptr;
+  }
+  return buffer.data();
+}
+
+} // namespace
+
+/*
+ * Loading goes in three steps, so that it can be spread over all threads
+ * without giving up on the first class on the classpath winning:
+ *  - every jar's central directory is read, in parallel;
+ *  - every class file is inflated just far enough to find the type it
+ *    defines, in parallel; then, in classpath order, the first definition of
+ *    each type is picked;
+ *  - the picked class files are inflated again and turned into DexClasses,
+ *    in parallel.
+ * Inflating twice is cheaper than holding every inflated class file alive
+ * between the steps.
+ */
+bool load_jar_files(const std::vector<std::string>& locations,
+                    Scope* classes,
+                    attribute_hook_t attr_hook) {
+  init_basic_types();
+
+  std::vector<jar_file> jars(locations.size());
+  std::atomic<bool> ok{true};
+  {
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      jars[i].location = locations[i];
+      if (!open_jar(jars[i])) {
+        ok = false;
+      }
+    });
+    for (size_t i = 0; i < jars.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+  if (!ok) {
     return false;
   }
 
-  auto mapping = reinterpret_cast<const uint8_t*>(file.const_data());
-  if (!process_jar(location, mapping, file.size(), classes, attr_hook)) {
-    fprintf(stderr, "error: cannot process jar: %s\n", location);
+  std::vector<class_file> class_files;
+  for (auto& jar : jars) {
+    for (auto& entry : jar.entries) {
+      if (is_class_entry(entry)) {
+        class_files.push_back(class_file{&jar, &entry});
+      }
+    }
+  }
+
+  {
+    auto wq = workqueue_foreach<class_file*>([&](class_file* cf) {
+      auto buffer = inflate_class(*cf);
+      cf->type = buffer != nullptr ? parse_class_type(buffer) : nullptr;
+      if (cf->type == nullptr) {
+        ok = false;
+      }
+    });
+    for (auto& cf : class_files) {
+      wq.add_item(&cf);
+    }
+    wq.run_all();
+  }
+  if (!ok) {
+    return false;
+  }
+
+  std::unordered_map<const DexType*, const class_file*> first_definition;
+  for (auto& cf : class_files) {
+    auto inserted = first_definition.emplace(cf.type, &cf);
+    if (inserted.second) {
+      cf.first = true;
+    } else {
+      // Two external classes in .jar file has the same name
+      // Just issue an warning for now
+      TRACE(MAIN, 1,
+            "Warning: Found a duplicate class '%s' in two .jar files:\n "
+            "  Current: '%s'\n"
+            "  Previous: '%s'",
+            SHOW(cf.type), cf.jar->location.c_str(),
+            inserted.first->second->jar->location.c_str());
+    }
+  }
+
+  // Hooks are not expected to be thread-safe.
+  std::mutex hook_lock;
+  attribute_hook_t locked_hook = nullptr;
+  if (attr_hook != nullptr) {
+    locked_hook = [&](boost::variant<DexField*, DexMethod*> field_or_method,
+                      const char* attribute_name,
+                      uint8_t* attribute_pointer) {
+      std::lock_guard<std::mutex> lock(hook_lock);
+      attr_hook(field_or_method, attribute_name, attribute_pointer);
+    };
+  }
+  {
+    auto wq = workqueue_foreach<class_file*>([&](class_file* cf) {
+      auto buffer = inflate_class(*cf);
+      Scope created;
+      if (buffer == nullptr ||
+          !parse_class(buffer, &created, locked_hook, cf->jar->location)) {
+        ok = false;
+        return;
+      }
+      if (!created.empty()) {
+        cf->cls = created[0];
+      }
+    });
+    for (auto& cf : class_files) {
+      if (cf.first) {
+        wq.add_item(&cf);
+      }
+    }
+    wq.run_all();
+  }
+  if (!ok) {
     return false;
   }
+
+  if (classes != nullptr) {
+    for (const auto& cf : class_files) {
+      if (cf.cls != nullptr) {
+        classes->push_back(cf.cls);
+      }
+    }
+  }
   return true;
 }
 
+bool load_jar_file(const char* location,
+                   Scope* classes,
+                   attribute_hook_t attr_hook) {
+  return load_jar_files({location}, classes, attr_hook);
+}
+
 //#define LOCAL_MAIN
 #ifdef LOCAL_MAIN
 int main(int argc, char *argv[]) {
@@ -15,6 +15,8 @@ class DexMethod;
 #include "ConfigFiles.h"
 
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace JarLoaderUtil {
 uint32_t read32(uint8_t*& buffer);
@@ -30,6 +32,16 @@ bool load_jar_file(const char* location,
                    Scope* classes = nullptr,
                    attribute_hook_t = nullptr);
 
+/*
+ * Loads several jars at once, inflating and parsing their class files on all
+ * threads. As when loading them one by one in order, the first definition of
+ * a class on the classpath wins, and `classes` receives the new classes in
+ * classpath order. `attr_hook` is never called concurrently.
+ */
+bool load_jar_files(const std::vector<std::string>& locations,
+                    Scope* classes = nullptr,
+                    attribute_hook_t = nullptr);
+
 void read_dup_class_whitelist(const JsonWrapper& json_cfg);
 
 bool load_class_file(const std::string& filename, Scope* classes = nullptr);
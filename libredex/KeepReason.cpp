@@ -45,4 +45,23 @@ size_t hash_value(const Reason& reason) {
   return seed;
 }
 
+const Reason* ReasonStore::intern(const Reason& reason) {
+  auto interned = m_reasons.get(&reason, nullptr);
+  if (interned != nullptr) {
+    return interned;
+  }
+  std::lock_guard<std::mutex> guard(m_lock);
+  // Another thread may have interned it since we looked.
+  interned = m_reasons.get(&reason, nullptr);
+  if (interned != nullptr) {
+    return interned;
+  }
+  auto copy = new (m_arena.allocate(sizeof(Reason), alignof(Reason)))
+      Reason(reason);
+  copy->id = m_size.load(std::memory_order_relaxed);
+  m_reasons.emplace(copy, copy);
+  m_size.store(copy->id + 1, std::memory_order_relaxed);
+  return copy;
+}
+
 } // namespace keep_reason
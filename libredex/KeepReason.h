@@ -7,11 +7,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <boost/functional/hash.hpp>
+#include <mutex>
 #include <ostream>
 #include <unordered_set>
 
+#include "ConcurrentContainers.h"
 #include "Debug.h"
+#include "StringInterner.h"
 
 class DexMethod;
 
@@ -38,6 +42,9 @@ enum KeepReasonType {
 
 struct Reason {
   KeepReasonType type;
+  // The dense id that the ReasonStore which interned this reason gave it.
+  // Not part of the identity of the reason.
+  uint32_t id{0};
   union {
     const redex::KeepSpec* keep_rule{nullptr};
     const DexMethod* method;
@@ -80,4 +87,34 @@ struct ReasonPtrEqual {
 using ReasonPtrSet =
     std::unordered_set<const Reason*, ReasonPtrHash, ReasonPtrEqual>;
 
+/*
+ * Interns Reasons, so that each distinct reason exists once however many
+ * objects are kept for it.
+ *
+ * Looking up a reason that was interned already doesn't allocate. New
+ * reasons are copied into an arena that lives as long as the store, and get
+ * the next dense id.
+ */
+class ReasonStore {
+ public:
+  template <class... Args>
+  const Reason* make(Args&&... args) {
+    return intern(Reason(std::forward<Args>(args)...));
+  }
+
+  const Reason* intern(const Reason& reason);
+
+  size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+  size_t bytes_reserved() const { return m_arena.bytes_reserved(); }
+
+ private:
+  ConcurrentMap<const Reason*, const Reason*, ReasonPtrHash, ReasonPtrEqual>
+      m_reasons;
+  // Guards the arena and the insertions into m_reasons.
+  std::mutex m_lock;
+  string_interner_impl::Arena m_arena;
+  std::atomic<size_t> m_size{0};
+};
+
 } // namespace keep_reason
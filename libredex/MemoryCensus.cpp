@@ -0,0 +1,306 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MemoryCensus.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "DexAnnotation.h"
+#include "DexDebugInstruction.h"
+#include "DexInstruction.h"
+#include "DexPosition.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "RedexContext.h"
+
+namespace {
+
+// What a heap block of `n` bytes really costs, assuming the 16-byte size
+// classes that both glibc malloc and jemalloc use for small objects.
+size_t heap(size_t n) { return n == 0 ? 0 : (n + 15) / 16 * 16; }
+
+// The bookkeeping of one node of a std::map or std::set, on top of its value.
+constexpr size_t kTreeNodeOverhead = 32;
+
+template <typename T>
+size_t vector_bytes(const std::vector<T>& v) {
+  return heap(v.capacity() * sizeof(T));
+}
+
+size_t string_bytes(const std::string& s) {
+  // The small-string buffer lives in the std::string itself.
+  return s.capacity() > 15 ? heap(s.capacity() + 1) : 0;
+}
+
+class Walker {
+ public:
+  explicit Walker(MemoryCensus* census) : m_census(census) {}
+
+  void walk_class(const DexClass* cls) {
+    m_census->add("classes", 1,
+                  heap(sizeof(DexClass)) + vector_bytes(cls->get_dmethods()) +
+                      vector_bytes(cls->get_vmethods()) +
+                      vector_bytes(cls->get_sfields()) +
+                      vector_bytes(cls->get_ifields()) +
+                      string_bytes(cls->get_deobfuscated_name()));
+    walk_anno_set(cls->get_anno_set());
+    for (auto* field : cls->get_sfields()) {
+      walk_field(field);
+    }
+    for (auto* field : cls->get_ifields()) {
+      walk_field(field);
+    }
+    for (auto* method : cls->get_dmethods()) {
+      walk_method(method);
+    }
+    for (auto* method : cls->get_vmethods()) {
+      walk_method(method);
+    }
+  }
+
+ private:
+  void walk_field(const DexField* field) {
+    m_census->add("fields", 1,
+                  heap(sizeof(DexField)) +
+                      string_bytes(field->get_deobfuscated_name()));
+    walk_anno_set(field->get_anno_set());
+    walk_encoded_value(field->get_static_value());
+  }
+
+  void walk_method(const DexMethod* method) {
+    m_census->add("methods", 1,
+                  heap(sizeof(DexMethod)) +
+                      string_bytes(method->get_deobfuscated_name()));
+    walk_anno_set(method->get_anno_set());
+    if (auto* param_anno = method->get_param_anno()) {
+      m_census->add("annotations.param_maps", param_anno->size(),
+                    param_anno->size() *
+                        heap(kTreeNodeOverhead +
+                             sizeof(ParamAnnotations::value_type)));
+      for (const auto& p : *param_anno) {
+        walk_anno_set(p.second);
+      }
+    }
+    if (auto* dex_code = method->get_dex_code()) {
+      m_census->add("dex_code", 1, heap(sizeof(DexCode)));
+      walk_debug_item(dex_code->get_debug_item());
+    }
+    if (auto* code = method->get_code()) {
+      walk_code(code);
+    }
+  }
+
+  void walk_code(const IRCode* code) {
+    m_census->add("ir_code", 1, heap(sizeof(IRCode)) + heap(sizeof(IRList)));
+    walk_debug_item(code->get_debug_item());
+    if (code->cfg_built()) {
+      const auto& cfg = code->cfg();
+      size_t edges = 0;
+      for (auto* block : cfg.blocks()) {
+        edges += block->succs().size();
+        walk_entries(static_cast<const cfg::Block*>(block)->begin(),
+                     static_cast<const cfg::Block*>(block)->end());
+      }
+      m_census->add("cfg.graphs", 1, heap(sizeof(cfg::ControlFlowGraph)));
+      m_census->add("cfg.blocks", cfg.num_blocks(),
+                    cfg.num_blocks() *
+                        (heap(sizeof(cfg::Block)) + kTreeNodeOverhead));
+      // Each edge is a heap object listed by both of its ends and by the
+      // graph's edge set.
+      m_census->add("cfg.edges", edges,
+                    edges * (heap(sizeof(cfg::Edge)) + 2 * sizeof(void*) +
+                             kTreeNodeOverhead));
+    }
+    if (!code->editable_cfg_built()) {
+      walk_entries(code->begin(), code->end());
+    }
+  }
+
+  void walk_entries(IRList::const_iterator begin, IRList::const_iterator end) {
+    size_t entries = 0;
+    for (auto it = begin; it != end; ++it) {
+      ++entries;
+      switch (it->type) {
+      case MFLOW_OPCODE: {
+        auto* insn = it->insn;
+        size_t bytes = sizeof(IRInstruction);
+        if (insn->srcs_size() > sizeof(uint64_t) / sizeof(uint16_t)) {
+          bytes += heap(insn->srcs_size() * sizeof(uint16_t));
+        }
+        m_census->add("ir_instructions", 1, bytes);
+        if (insn->has_data()) {
+          m_census->add("ir_instructions.data", 1,
+                        heap(sizeof(DexOpcodeData)) +
+                            heap(insn->get_data()->data_size() *
+                                 sizeof(uint16_t)));
+        }
+        break;
+      }
+      case MFLOW_DEX_OPCODE:
+        m_census->add("dex_instructions", 1, heap(sizeof(DexInstruction)));
+        break;
+      case MFLOW_TRY:
+        m_census->add("try_catch_targets", 1, sizeof(TryEntry));
+        break;
+      case MFLOW_CATCH:
+        m_census->add("try_catch_targets", 1, sizeof(CatchEntry));
+        break;
+      case MFLOW_TARGET:
+        m_census->add("try_catch_targets", 1, sizeof(BranchTarget));
+        break;
+      case MFLOW_DEBUG:
+        m_census->add("debug_instructions", 1,
+                      heap(sizeof(DexDebugInstruction)));
+        break;
+      case MFLOW_POSITION:
+        m_census->add("positions", 1, sizeof(DexPosition));
+        break;
+      case MFLOW_FALLTHROUGH:
+        break;
+      }
+    }
+    m_census->add("method_item_entries", entries,
+                  entries * sizeof(MethodItemEntry));
+  }
+
+  void walk_debug_item(const DexDebugItem* dbg) {
+    if (dbg == nullptr) {
+      return;
+    }
+    auto& entries = const_cast<DexDebugItem*>(dbg)->get_entries();
+    m_census->add("debug_items", 1,
+                  heap(sizeof(DexDebugItem)) + vector_bytes(entries));
+    for (const auto& entry : entries) {
+      if (entry.type == DexDebugEntryType::Position) {
+        m_census->add("positions", 1, sizeof(DexPosition));
+      } else {
+        m_census->add("debug_instructions", 1,
+                      heap(sizeof(DexDebugInstruction)));
+      }
+    }
+  }
+
+  void walk_anno_set(const DexAnnotationSet* aset) {
+    if (aset == nullptr) {
+      return;
+    }
+    m_census->add("annotations.sets", 1,
+                  heap(sizeof(DexAnnotationSet)) +
+                      vector_bytes(aset->get_annotations()));
+    for (const auto* anno : aset->get_annotations()) {
+      m_census->add("annotations", 1,
+                    heap(sizeof(DexAnnotation)) +
+                        vector_bytes(anno->anno_elems()));
+      walk_elements(anno->anno_elems());
+    }
+  }
+
+  void walk_elements(const EncodedAnnotations& elems) {
+    for (const auto& elem : elems) {
+      walk_encoded_value(elem.encoded_value);
+    }
+  }
+
+  void walk_encoded_value(const DexEncodedValue* value) {
+    if (value == nullptr) {
+      return;
+    }
+    // All the scalar kinds fit in the base class plus a pointer or two.
+    m_census->add("annotations.values", 1,
+                  heap(sizeof(DexEncodedValueArray)));
+    switch (value->evtype()) {
+    case DEVT_ARRAY: {
+      auto* evalues =
+          static_cast<const DexEncodedValueArray*>(value)->evalues();
+      m_census->add("annotations.values", 0,
+                    heap(sizeof(*evalues)) +
+                        heap(evalues->size() * sizeof(DexEncodedValue*)));
+      for (const auto* ev : *evalues) {
+        walk_encoded_value(ev);
+      }
+      break;
+    }
+    case DEVT_ANNOTATION: {
+      auto* elems =
+          static_cast<const DexEncodedValueAnnotation*>(value)->annotations();
+      m_census->add("annotations.values", 0,
+                    heap(sizeof(*elems)) + vector_bytes(*elems));
+      walk_elements(*elems);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  MemoryCensus* m_census;
+};
+
+} // namespace
+
+MemoryCensus MemoryCensus::take(const Scope& scope) {
+  MemoryCensus census;
+  census.add("scope", 1, vector_bytes(scope));
+  Walker walker(&census);
+  for (const auto* cls : scope) {
+    walker.walk_class(cls);
+  }
+
+  // Everything interned, whether or not a class in the scope still uses it.
+  // Method and field definitions are already charged above, so only the
+  // references beyond those are charged here.
+  auto strings = g_redex->get_string_interning_stats();
+  census.add("context.strings", strings.strings,
+             strings.arena_bytes_reserved +
+                 strings.table_capacity * 2 * sizeof(void*));
+  census.add("context.types", g_redex->type_id_bound(),
+             g_redex->type_id_bound() *
+                 (heap(sizeof(DexType)) + 2 * sizeof(void*)));
+  const auto& defs = census.categories();
+  auto unseen = [&](const char* name, size_t bound) {
+    auto it = defs.find(name);
+    size_t seen = it == defs.end() ? 0 : it->second.count;
+    return bound > seen ? bound - seen : 0;
+  };
+  auto field_refs = unseen("fields", g_redex->field_id_bound());
+  auto method_refs = unseen("methods", g_redex->method_id_bound());
+  census.add("context.field_refs", field_refs,
+             field_refs * (heap(sizeof(DexField)) + 2 * sizeof(void*)));
+  census.add("context.method_refs", method_refs,
+             method_refs * (heap(sizeof(DexMethod)) + 2 * sizeof(void*)));
+  return census;
+}
+
+size_t MemoryCensus::total_bytes() const {
+  size_t total = 0;
+  for (const auto& p : m_categories) {
+    total += p.second.bytes;
+  }
+  return total;
+}
+
+void MemoryCensus::print(std::ostream& out) const {
+  std::vector<std::pair<std::string, Category>> sorted(m_categories.begin(),
+                                                       m_categories.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.second.bytes > b.second.bytes;
+                   });
+  auto total = total_bytes();
+  for (const auto& p : sorted) {
+    out << std::setw(28) << std::left << p.first << std::right
+        << std::setw(12) << p.second.count << std::setw(12)
+        << p.second.bytes / 1024 << " KiB" << std::setw(7) << std::fixed
+        << std::setprecision(1)
+        << (total == 0 ? 0.0 : 100.0 * p.second.bytes / total) << "%\n";
+  }
+  out << std::setw(28) << std::left << "total" << std::right << std::setw(24)
+      << total / 1024 << " KiB\n";
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "DexClass.h"
+
+/**
+ * An estimate of the heap held by the IR and dex object model, broken down by
+ * kind of object, for finding out which data structures a big run's memory
+ * goes to.
+ *
+ * The census walks the scope and everything in RedexContext. Each object is
+ * charged its own size plus the malloc- or pool-level rounding it is likely
+ * to pay, and each container the capacity it holds; nodes of node-based
+ * containers are charged a fixed overhead. Shared objects, like the
+ * DexTypeLists of protos, are charged once, through RedexContext.
+ *
+ * It is not free: expect a pass over every instruction and annotation. The
+ * walk reads code through IRCode's usual accessors, which linearizes CFGs
+ * that keep_editable_cfg held on to.
+ */
+class MemoryCensus {
+ public:
+  struct Category {
+    size_t count{0};
+    size_t bytes{0};
+  };
+
+  static MemoryCensus take(const Scope& scope);
+
+  const std::map<std::string, Category>& categories() const {
+    return m_categories;
+  }
+  size_t total_bytes() const;
+
+  /*
+   * One line per category, largest first.
+   */
+  void print(std::ostream& out) const;
+
+  // Used while walking.
+  void add(const std::string& category, size_t count, size_t bytes) {
+    auto& c = m_categories[category];
+    c.count += count;
+    c.bytes += bytes;
+  }
+
+ private:
+  std::map<std::string, Category> m_categories;
+};
@@ -7,6 +7,7 @@
 
 #include "MethodOverrideGraph.h"
 
+#include <algorithm>
 #include <boost/range/adaptor/map.hpp>
 
 #include "BinarySerialization.h"
@@ -15,7 +16,7 @@
 #include "Timer.h"
 #include "Walkers.h"
 
-using namespace method_override_graph;
+namespace method_override_graph {
 
 namespace {
 
@@ -71,20 +72,58 @@ void unify_signature_maps(const SignatureMap& to_add, SignatureMap* target) {
       to_add);
 }
 
+using Edges = std::vector<std::pair<const DexMethod*, const DexMethod*>>;
+
+} // namespace
+
+/*
+ * The edges found by the analysis of a class are recorded with the class,
+ * and only added to the graph at the end. Two threads may race to analyze the
+ * same class, but they find the same edges, and only one of them gets to
+ * record them.
+ */
 class GraphBuilder {
  public:
   explicit GraphBuilder(const Scope& scope) : m_scope(scope) {}
 
   std::unique_ptr<Graph> run() {
-    m_graph = std::make_unique<Graph>();
-    walk::parallel::classes(m_scope, [&](const DexClass* cls) {
-      if (is_interface(cls)) {
-        analyze_interface(cls);
-      } else {
-        analyze_non_interface(cls);
+    walk::parallel::classes(m_scope,
+                            [&](const DexClass* cls) { analyze(cls); });
+    auto graph = std::make_unique<Graph>();
+    for (const auto& pair : m_class_edges) {
+      for (const auto& edge : pair.second) {
+        graph->add_edge(edge.first, edge.second);
       }
-    });
-    return std::move(m_graph);
+    }
+    return graph;
+  }
+
+  void analyze(const DexClass* cls) {
+    if (is_interface(cls)) {
+      analyze_interface(cls);
+    } else {
+      analyze_non_interface(cls);
+    }
+  }
+
+  const ConcurrentMap<const DexClass*, Edges>& class_edges() const {
+    return m_class_edges;
+  }
+
+  /*
+   * Drops what is cached about `cls`, and returns the edges its analysis had
+   * found. Not thread-safe.
+   */
+  Edges forget(const DexClass* cls) {
+    m_class_signature_maps.erase(cls);
+    m_interface_signature_maps.erase(cls);
+    auto it = m_class_edges.find(cls);
+    if (it == m_class_edges.end()) {
+      return Edges();
+    }
+    auto edges = std::move(it->second);
+    m_class_edges.erase(cls);
+    return edges;
   }
 
  private:
@@ -109,11 +148,12 @@ class GraphBuilder {
                          &class_signatures.unimplemented);
 
     // Mark all overriding methods as reachable via their parent method ref.
+    Edges edges;
     for (auto* method : cls->get_vmethods()) {
       auto overridden_set = class_signatures.implemented.at(method->get_name())
                                 .at(method->get_proto());
       for (auto overridden : overridden_set) {
-        m_graph->add_edge(overridden, method);
+        edges.emplace_back(overridden, method);
       }
       // Replace the overridden methods by the overriding ones.
       update_signature_map(
@@ -132,7 +172,7 @@ class GraphBuilder {
             class_signatures.unimplemented.at(implementation->get_name())
                 .at(implementation->get_proto());
         for (auto unimplemented : unimplemented_set) {
-          m_graph->add_edge(unimplemented, implementation);
+          edges.emplace_back(unimplemented, implementation);
         }
         // Remove the method from the set of unimplemented interface methods.
         update_signature_map(
@@ -140,7 +180,9 @@ class GraphBuilder {
       }
     }
 
-    m_class_signature_maps.emplace(cls, class_signatures);
+    if (m_class_signature_maps.emplace(cls, class_signatures)) {
+      m_class_edges.emplace(cls, std::move(edges));
+    }
     return class_signatures;
   }
 
@@ -151,6 +193,7 @@ class GraphBuilder {
     }
 
     SignatureMap interface_signatures = unify_super_interface_signatures(cls);
+    Edges edges;
     for (auto* method : cls->get_vmethods()) {
       auto overridden_set =
           interface_signatures.at(method->get_name()).at(method->get_proto());
@@ -172,12 +215,14 @@ class GraphBuilder {
       // to find them. This design reduces the number of edges necessary for
       // building the graph.
       for (auto overridden : overridden_set) {
-        m_graph->add_edge(overridden, method);
+        edges.emplace_back(overridden, method);
       }
       update_signature_map(method, MethodSet{method}, &interface_signatures);
     }
 
-    m_interface_signature_maps.emplace(cls, interface_signatures);
+    if (m_interface_signature_maps.emplace(cls, interface_signatures)) {
+      m_class_edges.emplace(cls, std::move(edges));
+    }
     return interface_signatures;
   }
 
@@ -193,16 +238,12 @@ class GraphBuilder {
     return super_interface_signatures;
   }
 
-  std::unique_ptr<Graph> m_graph;
   ClassSignatureMaps m_class_signature_maps;
   InterfaceSignatureMaps m_interface_signature_maps;
+  ConcurrentMap<const DexClass*, Edges> m_class_edges;
   const Scope& m_scope;
 };
 
-} // namespace
-
-namespace method_override_graph {
-
 Node Graph::empty_node;
 
 const Node& Graph::get_node(const DexMethod* method) const {
@@ -220,6 +261,18 @@ void Graph::add_edge(const DexMethod* overridden, const DexMethod* overriding) {
                  });
 }
 
+void Graph::remove_edge(const DexMethod* overridden,
+                        const DexMethod* overriding) {
+  auto it = m_nodes.find(overridden);
+  if (it == m_nodes.end()) {
+    return;
+  }
+  it->second.children.erase(overriding);
+  if (it->second.children.empty()) {
+    m_nodes.erase(overridden);
+  }
+}
+
 void Graph::dump(std::ostream& os) const {
   namespace bs = binary_serialization;
   bs::write_header(os, /* version */ 1);
@@ -243,6 +296,191 @@ std::unique_ptr<const Graph> build_graph(const Scope& scope) {
   return GraphBuilder(scope).run();
 }
 
+IncrementalGraph::IncrementalGraph(const Scope& scope)
+    : m_builder(std::make_unique<GraphBuilder>(scope)) {
+  Timer t("Building incremental method override graph");
+  m_graph = m_builder->run();
+  for (const auto& pair : m_builder->class_edges()) {
+    index_class(pair.first);
+    for (const auto& edge : pair.second) {
+      ++m_edge_counts[edge];
+    }
+  }
+}
+
+IncrementalGraph::~IncrementalGraph() {}
+
+void IncrementalGraph::add_method(const DexMethod* method) {
+  if (method->is_virtual()) {
+    update(type_class(method->get_class()));
+  }
+}
+
+void IncrementalGraph::remove_method(const DexMethod* method) {
+  if (method->is_virtual()) {
+    update(type_class(method->get_class()));
+  }
+}
+
+void IncrementalGraph::update_virtual_status(const DexMethod* method) {
+  update(type_class(method->get_class()));
+}
+
+void IncrementalGraph::move_class(const DexClass* cls) { update(cls); }
+
+void IncrementalGraph::index_class(const DexClass* cls) {
+  auto& parents = m_parents[cls];
+  for (auto* parent : parents) {
+    auto& siblings = m_subtypes[parent];
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), cls),
+                   siblings.end());
+  }
+  parents.clear();
+  auto add_parent = [&](const DexType* type) {
+    auto parent = type_class(type);
+    if (parent != nullptr) {
+      parents.push_back(parent);
+      m_subtypes[parent].push_back(cls);
+    }
+  };
+  if (cls->get_super_class() != nullptr) {
+    add_parent(cls->get_super_class());
+  }
+  for (auto* intf : cls->get_interfaces()->get_type_list()) {
+    add_parent(intf);
+  }
+}
+
+void IncrementalGraph::add_class_edges(const DexClass* cls) {
+  auto it = m_builder->class_edges().find(cls);
+  if (it == m_builder->class_edges().end()) {
+    return;
+  }
+  for (const auto& edge : it->second) {
+    if (m_edge_counts[edge]++ == 0) {
+      m_graph->add_edge(edge.first, edge.second);
+    }
+  }
+}
+
+void IncrementalGraph::update(const DexClass* cls) {
+  if (cls == nullptr) {
+    return;
+  }
+  // The edges that a class finds only depend on its ancestors, so the classes
+  // to re-analyze are `cls` and everything below it.
+  index_class(cls);
+  std::vector<const DexClass*> affected{cls};
+  std::unordered_set<const DexClass*> seen{cls};
+  for (size_t i = 0; i < affected.size(); ++i) {
+    auto it = m_subtypes.find(affected[i]);
+    if (it == m_subtypes.end()) {
+      continue;
+    }
+    for (auto* subtype : it->second) {
+      if (seen.emplace(subtype).second) {
+        affected.push_back(subtype);
+      }
+    }
+  }
+  for (auto* affected_cls : affected) {
+    for (const auto& edge : m_builder->forget(affected_cls)) {
+      auto it = m_edge_counts.find(edge);
+      always_assert(it != m_edge_counts.end());
+      if (--it->second == 0) {
+        m_edge_counts.erase(it);
+        m_graph->remove_edge(edge.first, edge.second);
+      }
+    }
+  }
+
+  // A moved class may have ancestors that were never analyzed.
+  std::vector<const DexClass*> fresh;
+  std::vector<const DexClass*> to_visit{cls};
+  std::unordered_set<const DexClass*> visited;
+  while (!to_visit.empty()) {
+    auto* current = to_visit.back();
+    to_visit.pop_back();
+    if (!visited.emplace(current).second) {
+      continue;
+    }
+    for (auto* parent : m_parents.at(current)) {
+      if (m_parents.count(parent) == 0) {
+        index_class(parent);
+        fresh.push_back(parent);
+        to_visit.push_back(parent);
+      }
+    }
+  }
+
+  for (auto* affected_cls : affected) {
+    m_builder->analyze(affected_cls);
+  }
+  for (auto* fresh_cls : fresh) {
+    add_class_edges(fresh_cls);
+  }
+  for (auto* affected_cls : affected) {
+    add_class_edges(affected_cls);
+  }
+}
+
+CompactGraph::CompactGraph(const Graph& graph) {
+  auto id_of = [&](const DexMethod* method) {
+    auto it = m_ids.emplace(method, m_methods.size()).first;
+    if (it->second == m_methods.size()) {
+      m_methods.push_back(method);
+    }
+    return it->second;
+  };
+  std::vector<std::vector<MethodId>> children;
+  for (const auto& pair : graph.nodes()) {
+    auto parent = id_of(pair.first);
+    std::vector<MethodId> ids;
+    for (auto* child : pair.second.children) {
+      ids.push_back(id_of(child));
+    }
+    std::sort(ids.begin(), ids.end());
+    if (children.size() < m_methods.size()) {
+      children.resize(m_methods.size());
+    }
+    children[parent] = std::move(ids);
+  }
+  children.resize(m_methods.size());
+  m_offsets.reserve(m_methods.size() + 1);
+  m_offsets.push_back(0);
+  for (const auto& ids : children) {
+    m_children.insert(m_children.end(), ids.begin(), ids.end());
+    m_offsets.push_back(m_children.size());
+  }
+}
+
+std::unordered_set<const DexMethod*> get_overriding_methods(
+    const CompactGraph& graph, const DexMethod* method) {
+  std::unordered_set<const DexMethod*> overrides;
+  if (!graph.has_method(method)) {
+    return overrides;
+  }
+  std::vector<bool> visited(graph.size(), false);
+  std::vector<CompactGraph::MethodId> stack{graph.id(method)};
+  visited[stack.back()] = true;
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+    for (auto child : graph.children(current)) {
+      if (visited[child]) {
+        continue;
+      }
+      visited[child] = true;
+      auto* child_method = graph.method(child);
+      if (!is_interface(type_class(child_method->get_class()))) {
+        overrides.emplace(child_method);
+      }
+      stack.push_back(child);
+    }
+  }
+  return overrides;
+}
+
 std::unordered_set<const DexMethod*> get_overriding_methods(
     const Graph& graph, const DexMethod* method) {
   std::unordered_set<const DexMethod*> overrides;
@@ -7,6 +7,12 @@
 
 #pragma once
 
+#include <boost/functional/hash.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexStore.h"
@@ -19,6 +25,8 @@
 namespace method_override_graph {
 
 class Graph;
+class GraphBuilder;
+class CompactGraph;
 
 /*
  * Returns all the methods that override :method. The set does *not* include
@@ -27,6 +35,9 @@ class Graph;
 std::unordered_set<const DexMethod*> get_overriding_methods(
     const Graph& graph, const DexMethod* method);
 
+std::unordered_set<const DexMethod*> get_overriding_methods(
+    const CompactGraph& graph, const DexMethod* method);
+
 /*
  * Slow-ish; users should build the graph once and cache it somewhere.
  */
@@ -48,6 +59,9 @@ class Graph {
 
   void add_edge(const DexMethod* overridden, const DexMethod* overriding);
 
+  // Not thread-safe. Nodes that are left without children are dropped.
+  void remove_edge(const DexMethod* overridden, const DexMethod* overriding);
+
   void dump(std::ostream&) const;
 
  private:
@@ -55,4 +69,88 @@ class Graph {
   ConcurrentMap<const DexMethod*, Node> m_nodes;
 };
 
+/*
+ * A Graph that is kept up to date as the class hierarchy changes, so that it
+ * can be carried across passes instead of being rebuilt from scratch.
+ *
+ * Every edge is attributed to the class whose analysis found it, and the
+ * signature maps of the analysis are kept around. An update only re-analyzes
+ * the changed class and the classes that inherit from it, directly or through
+ * interfaces, which is only a small part of the hierarchy for most changes.
+ *
+ * The update methods must be called *after* the corresponding change has been
+ * made to the classes. They are not thread-safe.
+ */
+class IncrementalGraph final {
+ public:
+  explicit IncrementalGraph(const Scope&);
+  ~IncrementalGraph();
+
+  const Graph& graph() const { return *m_graph; }
+
+  void add_method(const DexMethod*);
+
+  // The method must still refer to the class it was removed from.
+  void remove_method(const DexMethod*);
+
+  // After a method was made virtual or non-virtual and moved to the matching
+  // list of methods of its class.
+  void update_virtual_status(const DexMethod*);
+
+  // After a class changed its superclass or interfaces, or was added to the
+  // hierarchy.
+  void move_class(const DexClass*);
+
+ private:
+  using Edge = std::pair<const DexMethod*, const DexMethod*>;
+
+  void update(const DexClass*);
+  void index_class(const DexClass*);
+  void add_class_edges(const DexClass*);
+
+  std::unique_ptr<GraphBuilder> m_builder;
+  std::unique_ptr<Graph> m_graph;
+  // The number of classes that found each edge.
+  std::unordered_map<Edge, uint32_t, boost::hash<Edge>> m_edge_counts;
+  // The direct superclass and interfaces of each analyzed class, and the
+  // other way around.
+  std::unordered_map<const DexClass*, std::vector<const DexClass*>> m_parents;
+  std::unordered_map<const DexClass*, std::vector<const DexClass*>>
+      m_subtypes;
+};
+
+/*
+ * An immutable snapshot of a Graph with the methods numbered densely, and the
+ * children of all the nodes laid out in a single array. This is much smaller
+ * than the hash sets of the Graph, and faster to traverse.
+ */
+class CompactGraph final {
+ public:
+  using MethodId = uint32_t;
+  using Children = boost::iterator_range<const MethodId*>;
+
+  explicit CompactGraph(const Graph&);
+
+  size_t size() const { return m_methods.size(); }
+
+  bool has_method(const DexMethod* method) const {
+    return m_ids.count(method) != 0;
+  }
+
+  MethodId id(const DexMethod* method) const { return m_ids.at(method); }
+
+  const DexMethod* method(MethodId id) const { return m_methods.at(id); }
+
+  Children children(MethodId id) const {
+    return Children(m_children.data() + m_offsets.at(id),
+                    m_children.data() + m_offsets.at(id + 1));
+  }
+
+ private:
+  std::vector<const DexMethod*> m_methods;
+  std::unordered_map<const DexMethod*, MethodId> m_ids;
+  std::vector<uint32_t> m_offsets;
+  std::vector<MethodId> m_children;
+};
+
 } // namespace method_override_graph
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodTimings.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "ControlFlow.h"
+#include "DexClass.h"
+#include "IRCode.h"
+
+namespace method_timings {
+
+namespace impl {
+std::atomic<bool> s_enabled{false};
+} // namespace impl
+
+namespace {
+
+struct Entry {
+  int64_t ns;
+  MethodTiming timing;
+};
+
+bool faster(const Entry& a, const Entry& b) { return a.ns > b.ns; }
+
+std::mutex s_lock;
+size_t s_top_n{0};
+// A min-heap on the time, so that the fastest of the kept methods is the one
+// that a slower method replaces.
+std::vector<Entry> s_slowest;
+// The time of the fastest kept method once there are s_top_n of them, so
+// that most methods are turned away without taking the lock.
+std::atomic<int64_t> s_threshold_ns{0};
+
+size_t count_insns(const DexMethod* method) {
+  auto code = method->get_code();
+  if (code == nullptr) {
+    return 0;
+  }
+  return code->editable_cfg_built() ? code->cfg().num_opcodes()
+                                    : code->count_opcodes();
+}
+
+} // namespace
+
+void set_enabled(bool enabled, size_t top_n) {
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    s_top_n = top_n;
+    s_slowest.clear();
+    s_threshold_ns = 0;
+  }
+  impl::s_enabled = enabled && top_n > 0;
+}
+
+void reset() {
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_slowest.clear();
+  s_threshold_ns = 0;
+}
+
+std::vector<MethodTiming> get_slowest() {
+  std::vector<Entry> entries;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    entries = s_slowest;
+  }
+  std::sort(entries.begin(), entries.end(), faster);
+  std::vector<MethodTiming> result;
+  result.reserve(entries.size());
+  for (auto& entry : entries) {
+    result.push_back(std::move(entry.timing));
+  }
+  return result;
+}
+
+void Timer::end() {
+  int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - m_start)
+                   .count();
+  if (ns <= s_threshold_ns.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Entry entry{ns, {m_method->get_fully_deobfuscated_name(), ns / 1e9,
+                   count_insns(m_method)}};
+  std::lock_guard<std::mutex> guard(s_lock);
+  if (s_slowest.size() == s_top_n) {
+    if (ns <= s_slowest.front().ns) {
+      return;
+    }
+    std::pop_heap(s_slowest.begin(), s_slowest.end(), faster);
+    s_slowest.back() = std::move(entry);
+  } else {
+    s_slowest.push_back(std::move(entry));
+  }
+  std::push_heap(s_slowest.begin(), s_slowest.end(), faster);
+  if (s_slowest.size() == s_top_n) {
+    s_threshold_ns = s_slowest.front().ns;
+  }
+}
+
+} // namespace method_timings
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class DexMethod;
+
+/**
+ * Keeps the slowest methods that the parallel walkers visited, to find the
+ * single huge methods that make a pass slow.
+ *
+ * walk::parallel::code and walk::parallel::reduce_methods, and their by-cost
+ * variants, time each method they call their walker on with a
+ * method_timings::Timer. When timing is disabled a timer costs one relaxed
+ * atomic load. PassManager resets the timings before each pass and records
+ * the slowest methods of the pass in its PassInfo.
+ */
+namespace method_timings {
+
+namespace impl {
+extern std::atomic<bool> s_enabled;
+} // namespace impl
+
+inline bool is_enabled() {
+  return impl::s_enabled.load(std::memory_order_relaxed);
+}
+
+/*
+ * Keeps the `top_n` slowest methods from now on, or stops timing them.
+ */
+void set_enabled(bool enabled, size_t top_n = 20);
+
+struct MethodTiming {
+  std::string method;
+  double seconds;
+  // The instructions of the method after the walker ran on it.
+  size_t num_insns;
+};
+
+/*
+ * Forgets the methods timed so far.
+ */
+void reset();
+
+/*
+ * The slowest methods timed since the last reset, slowest first. A method
+ * that was walked several times shows up once for each time.
+ */
+std::vector<MethodTiming> get_slowest();
+
+class Timer {
+ public:
+  explicit Timer(const DexMethod* method) {
+    if (is_enabled()) {
+      m_method = method;
+      m_start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~Timer() {
+    if (m_method != nullptr) {
+      end();
+    }
+  }
+
+  Timer(const Timer&) = delete;
+  Timer& operator=(const Timer&) = delete;
+
+ private:
+  void end();
+
+  const DexMethod* m_method{nullptr};
+  std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace method_timings
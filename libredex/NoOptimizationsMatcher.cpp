@@ -13,12 +13,21 @@ namespace redex {
 void process_no_optimizations_rules(
     const std::unordered_set<DexType*>& no_optimizations_annos,
     const Scope& scope) {
-  auto match = m::any_annos<DexMethod>(
-      m::as_type<DexAnnotation>(m::in<DexType>(no_optimizations_annos)));
-
+  if (no_optimizations_annos.empty()) {
+    return;
+  }
+  // Only the annotation types are compared, so this doesn't decode any
+  // annotation elements.
   walk::parallel::methods(scope, [&](DexMethod* method) {
-    if (match.matches(method)) {
-      method->rstate.set_no_optimizations();
+    auto anno_set = method->get_anno_set();
+    if (anno_set == nullptr) {
+      return;
+    }
+    for (const auto anno : anno_set->get_annotations()) {
+      if (no_optimizations_annos.count(anno->type())) {
+        method->rstate.set_no_optimizations();
+        return;
+      }
     }
   });
 }
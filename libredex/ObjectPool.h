@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * A free-list allocator for objects of a single type, meant to back the
+ * class-specific operator new/delete of the IR's most numerous objects (see
+ * PooledObject below).
+ *
+ * Blocks are carved out of large chunks, so objects allocated together sit
+ * together in memory, and reusing a freed block costs a couple of pointer
+ * moves instead of a malloc/free pair. Each thread keeps its own free list,
+ * so neither allocating nor freeing takes a lock in the common case. A block
+ * freed on another thread than the one that allocated it simply joins the
+ * freeing thread's list. Surplus blocks, and the free list of an exiting
+ * thread, go back to a shared list in batches.
+ *
+ * Chunks are never returned to the system. That is the trade-off for not
+ * tracking which chunk a block came from; the memory gets reused by the next
+ * method that is ballooned or inlined.
+ *
+ * Building with REDEX_DISABLE_OBJECT_POOLS makes every allocation go straight
+ * to the global operator new, so that ASAN and valgrind see each object.
+ */
+template <typename T>
+class ObjectPool {
+ public:
+  static void* allocate() {
+    auto& cache = t_cache;
+    if (cache.head == nullptr) {
+      refill(cache);
+    }
+    Node* node = cache.head;
+    cache.head = node->next;
+    --cache.count;
+    return node;
+  }
+
+  static void deallocate(void* p) {
+    auto& cache = t_cache;
+    Node* node = static_cast<Node*>(p);
+    if (cache.dead) {
+      // This thread's cache is gone; hand the block straight back.
+      std::lock_guard<std::mutex> lock(shared().mutex);
+      node->next = nullptr;
+      shared().batches.push_back(Batch{node, 1});
+      return;
+    }
+    if (cache.head == nullptr) {
+      touch_reaper();
+    }
+    node->next = cache.head;
+    cache.head = node;
+    if (++cache.count >= 2 * kBatchSize) {
+      release(cache, kBatchSize);
+    }
+  }
+
+ private:
+  struct Node {
+    Node* next;
+  };
+
+  // Every block must be able to hold a Node once it is freed, and must start
+  // on a boundary suitable for T.
+  static constexpr size_t kBlockSize =
+      (std::max(sizeof(T), sizeof(Node)) + alignof(T) - 1) / alignof(T) *
+      alignof(T);
+  static constexpr size_t kBatchSize = 256;
+
+  struct Batch {
+    Node* head;
+    size_t count;
+  };
+
+  struct Shared {
+    std::mutex mutex;
+    std::vector<Batch> batches;
+  };
+
+  static Shared& shared() {
+    // Leaked on purpose: threads may still free blocks while static
+    // destructors run.
+    static Shared* shared = new Shared();
+    return *shared;
+  }
+
+  // Trivially destructible, so that it stays usable while other thread-local
+  // destructors run; the Reaper returns its blocks when the thread exits.
+  struct LocalCache {
+    Node* head;
+    size_t count;
+    bool dead;
+  };
+  static thread_local LocalCache t_cache;
+
+  struct Reaper {
+    ~Reaper() {
+      auto& cache = t_cache;
+      if (cache.head != nullptr) {
+        release(cache, cache.count);
+      }
+      cache.dead = true;
+    }
+  };
+
+  static void touch_reaper() {
+    static thread_local Reaper reaper;
+    (void)reaper;
+  }
+
+  static void refill(LocalCache& cache) {
+    auto& s = shared();
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      if (!s.batches.empty()) {
+        cache.head = s.batches.back().head;
+        cache.count = s.batches.back().count;
+        s.batches.pop_back();
+      }
+    }
+    if (cache.head == nullptr) {
+      // Chunks are never freed, so over-allocate and align by hand rather
+      // than rely on the global operator new honoring alignof(T).
+      auto raw = reinterpret_cast<uintptr_t>(
+          ::operator new(kBlockSize * kBatchSize + alignof(T) - 1));
+      char* chunk = reinterpret_cast<char*>((raw + alignof(T) - 1) /
+                                            alignof(T) * alignof(T));
+      for (size_t i = kBatchSize; i-- > 0;) {
+        Node* node = reinterpret_cast<Node*>(chunk + i * kBlockSize);
+        node->next = cache.head;
+        cache.head = node;
+      }
+      cache.count = kBatchSize;
+    }
+    if (!cache.dead) {
+      touch_reaper();
+    }
+  }
+
+  // Moves the first `n` blocks of the free list to the shared list.
+  static void release(LocalCache& cache, size_t n) {
+    Batch batch{cache.head, n};
+    Node* last = cache.head;
+    for (size_t i = 1; i < n; ++i) {
+      last = last->next;
+    }
+    cache.head = last->next;
+    last->next = nullptr;
+    cache.count -= n;
+    auto& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.batches.push_back(batch);
+  }
+};
+
+template <typename T>
+thread_local typename ObjectPool<T>::LocalCache ObjectPool<T>::t_cache{};
+
+/**
+ * Inheriting from PooledObject<T> makes `new T` and `delete` draw from
+ * ObjectPool<T>. Allocations of any other size, e.g. for a subclass of T,
+ * are passed on to the global operators.
+ */
+template <typename T>
+struct PooledObject {
+  static void* operator new(size_t size) {
+#ifndef REDEX_DISABLE_OBJECT_POOLS
+    if (size == sizeof(T)) {
+      return ObjectPool<T>::allocate();
+    }
+#endif
+    return ::operator new(size);
+  }
+
+  static void operator delete(void* p, size_t size) {
+    if (p == nullptr) {
+      return;
+    }
+#ifndef REDEX_DISABLE_OBJECT_POOLS
+    if (size == sizeof(T)) {
+      ObjectPool<T>::deallocate(p);
+      return;
+    }
+#endif
+    ::operator delete(p);
+  }
+};
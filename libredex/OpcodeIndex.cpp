@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "OpcodeIndex.h"
+
+#include "DexInstruction.h"
+#include "Walkers.h"
+
+namespace opcode_index {
+
+namespace {
+
+OpcodeGroups groups_in(const IRCode& code) {
+  OpcodeGroups groups = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    groups |= group_of(mie.insn->opcode());
+  }
+  return groups;
+}
+
+} // namespace
+
+OpcodeGroups group_of(IROpcode op) {
+  if (is_invoke(op)) {
+    return INVOKE;
+  } else if (is_iget(op)) {
+    return IGET;
+  } else if (is_iput(op)) {
+    return IPUT;
+  } else if (is_sget(op)) {
+    return SGET;
+  } else if (is_sput(op)) {
+    return SPUT;
+  }
+  switch (op) {
+  case OPCODE_CONST_STRING:
+    return CONST_STRING;
+  case OPCODE_CONST_CLASS:
+    return CONST_CLASS;
+  case OPCODE_NEW_INSTANCE:
+    return NEW_INSTANCE;
+  default:
+    return 0;
+  }
+}
+
+OpcodeIndex::OpcodeIndex(const Scope& scope) {
+  walk::code(scope, [&](DexMethod* method, IRCode&) {
+    m_ids.emplace(method, m_methods.size());
+    m_methods.push_back(method);
+  });
+  // Each method only writes its own byte.
+  m_groups.resize(m_methods.size());
+  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
+    m_groups[m_ids.at(method)] = groups_in(code);
+  });
+}
+
+OpcodeGroups OpcodeIndex::groups(const DexMethod* method) const {
+  auto it = m_ids.find(method);
+  return it == m_ids.end() ? 0 : m_groups[it->second];
+}
+
+void OpcodeIndex::refresh(DexMethod* method) {
+  auto it = m_ids.find(method);
+  always_assert_log(it != m_ids.end(), "%s was not indexed", SHOW(method));
+  auto* code = method->get_code();
+  m_groups[it->second] = code == nullptr ? 0 : groups_in(*code);
+}
+
+std::vector<DexMethod*> OpcodeIndex::methods_with(OpcodeGroups groups) const {
+  std::vector<DexMethod*> methods;
+  for (size_t i = 0; i < m_methods.size(); ++i) {
+    if (m_groups[i] & groups) {
+      methods.push_back(m_methods[i]);
+    }
+  }
+  return methods;
+}
+
+} // namespace opcode_index
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+#include "IRCode.h"
+#include "IROpcode.h"
+
+namespace opcode_index {
+
+/*
+ * The kinds of instructions that passes commonly go looking for. They form a
+ * bit set, so that a query can ask for several at once.
+ */
+enum OpcodeGroup : uint8_t {
+  INVOKE = 1 << 0,
+  IGET = 1 << 1,
+  IPUT = 1 << 2,
+  SGET = 1 << 3,
+  SPUT = 1 << 4,
+  CONST_STRING = 1 << 5,
+  CONST_CLASS = 1 << 6,
+  NEW_INSTANCE = 1 << 7,
+};
+using OpcodeGroups = uint8_t;
+
+constexpr OpcodeGroups FIELD_OPS = IGET | IPUT | SGET | SPUT;
+
+/*
+ * The group `op` belongs to, or 0 if none.
+ */
+OpcodeGroups group_of(IROpcode op);
+
+/*
+ * Records which OpcodeGroups occur in the code of every method of a scope.
+ * A pass that looks for, say, sgets only has to walk the instructions of the
+ * methods that have any, rather than those of every method.
+ *
+ * The index is built in parallel, and holds one byte per method rather than
+ * instruction pointers, so it stays valid across edits that only move or
+ * remove instructions. A pass that may add instructions of a group to a
+ * method calls refresh() on it; refresh() may run concurrently for different
+ * methods.
+ */
+class OpcodeIndex {
+ public:
+  explicit OpcodeIndex(const Scope& scope);
+
+  /*
+   * The groups found in `method`'s code when it was last indexed; 0 for
+   * methods without code or outside the scope.
+   */
+  OpcodeGroups groups(const DexMethod* method) const;
+
+  void refresh(DexMethod* method);
+
+  /*
+   * The methods whose code has an instruction of any of `groups`, in scope
+   * order.
+   */
+  std::vector<DexMethod*> methods_with(OpcodeGroups groups) const;
+
+  /*
+   * Calls `walker(method, IRList::iterator)` on each instruction of `groups` in
+   * the code of the methods that have any, in scope order.
+   */
+  template <typename Walker>
+  void sites(OpcodeGroups groups, const Walker& walker) const {
+    for (auto* method : methods_with(groups)) {
+      auto ii = InstructionIterable(method->get_code());
+      for (auto it = ii.begin(); it != ii.end(); ++it) {
+        if (group_of(it->insn->opcode()) & groups) {
+          walker(method, it.unwrap());
+        }
+      }
+    }
+  }
+
+ private:
+  // The methods of the scope that have code, with their groups at the same
+  // index.
+  std::vector<DexMethod*> m_methods;
+  std::vector<OpcodeGroups> m_groups;
+  std::unordered_map<const DexMethod*, size_t> m_ids;
+};
+
+} // namespace opcode_index
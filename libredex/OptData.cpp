@@ -14,10 +14,12 @@
 #include <fstream>
 #include <json/json.h>
 #include <mutex>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <utility>
 
+#include "BinarySerialization.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "EditableCfgAdapter.h"
@@ -26,6 +28,8 @@
 #include "Resolver.h"
 #include "Trace.h"
 
+namespace bs = binary_serialization;
+
 namespace {
 
 /**
@@ -95,6 +99,163 @@ std::string get_deobfuscated_name(const DexMethod* method) {
   always_assert_log(!name.empty(), "A method is always named\n");
   return name;
 }
+
+// The logs of the calling thread; see OptDataMapper::get_cls_opt_data().
+thread_local opt_metadata::ClassOptDataMap* t_cls_opt_map{nullptr};
+
+template <class T>
+void append(const std::vector<T>& from, std::vector<T>* to) {
+  to->insert(to->end(), from.begin(), from.end());
+}
+
+constexpr uint32_t OPT_DATA_VERSION = 1;
+
+/*
+ * Writes the columns of OptDataTables, and remembers the strings they refer
+ * to. The string table goes before the columns in the file, so that a reader
+ * can resolve the strings as it goes.
+ */
+class ColumnWriter {
+ public:
+  template <class V>
+  void write(const std::vector<V>& column) {
+    bs::write_array(m_columns, column);
+  }
+
+  void write(const std::vector<std::string>& column) {
+    std::vector<uint32_t> ids;
+    ids.reserve(column.size());
+    for (const auto& str : column) {
+      auto emplaced = m_string_ids.emplace(str, m_strings.size());
+      if (emplaced.second) {
+        m_strings.push_back(&emplaced.first->first);
+      }
+      ids.push_back(emplaced.first->second);
+    }
+    bs::write_array(m_columns, ids);
+  }
+
+  void finish(std::ostream& os) {
+    bs::write_header(os, OPT_DATA_VERSION);
+    std::vector<uint32_t> sizes;
+    sizes.reserve(m_strings.size());
+    for (const auto* str : m_strings) {
+      sizes.push_back(str->size());
+    }
+    bs::write_array(os, sizes);
+    for (const auto* str : m_strings) {
+      os.write(str->data(), str->size());
+    }
+    // Not m_columns.rdbuf(): an ostringstream's buffer can't be read from.
+    auto columns = m_columns.str();
+    os.write(columns.data(), columns.size());
+  }
+
+ private:
+  std::ostringstream m_columns;
+  std::unordered_map<std::string, uint32_t> m_string_ids;
+  std::vector<const std::string*> m_strings;
+};
+
+class ColumnReader {
+ public:
+  explicit ColumnReader(std::istream& is) : m_is(is) {
+    auto magic = read<uint32_t>();
+    auto version = read<uint32_t>();
+    always_assert_log(magic == 0xfaceb000, "Not a binary opt data file\n");
+    always_assert_log(version == OPT_DATA_VERSION,
+                      "Unsupported opt data version %u\n", version);
+    auto sizes = read_column<uint32_t>();
+    m_strings.reserve(sizes.size());
+    for (auto size : sizes) {
+      std::string str(size, '\0');
+      m_is.read(&str[0], size);
+      m_strings.push_back(std::move(str));
+    }
+    always_assert_log(m_is.good(), "Truncated opt data file\n");
+  }
+
+  template <class V>
+  V read() {
+    V value;
+    m_is.read(reinterpret_cast<char*>(&value), sizeof(value));
+    always_assert_log(m_is.good(), "Truncated opt data file\n");
+    return value;
+  }
+
+  template <class V>
+  std::vector<V> read_column() {
+    auto size = read<uint32_t>();
+    std::vector<V> column(size);
+    m_is.read(reinterpret_cast<char*>(column.data()), size * sizeof(V));
+    always_assert_log(m_is.good() || size == 0, "Truncated opt data file\n");
+    return column;
+  }
+
+  std::vector<std::string> read_strings() {
+    std::vector<std::string> column;
+    for (auto id : read_column<uint32_t>()) {
+      always_assert_log(id < m_strings.size(), "Bad string id %u\n", id);
+      column.push_back(m_strings[id]);
+    }
+    return column;
+  }
+
+ private:
+  std::istream& m_is;
+  std::vector<std::string> m_strings;
+};
+
+void write_messages(const opt_metadata::OptDataTables::Messages& messages,
+                    ColumnWriter* writer) {
+  writer->write(messages.reason_codes);
+  writer->write(messages.messages);
+}
+
+void write_reasons(const opt_metadata::OptDataTables::Reasons& reasons,
+                   ColumnWriter* writer) {
+  writer->write(reasons.ids);
+  writer->write(reasons.reason_idxs);
+  writer->write(reasons.reason_codes);
+}
+
+void read_messages(ColumnReader* reader,
+                   opt_metadata::OptDataTables::Messages* messages) {
+  messages->reason_codes = reader->read_column<uint32_t>();
+  messages->messages = reader->read_strings();
+}
+
+void read_reasons(ColumnReader* reader,
+                  opt_metadata::OptDataTables::Reasons* reasons) {
+  reasons->ids = reader->read_column<uint32_t>();
+  reasons->reason_idxs = reader->read_column<uint32_t>();
+  reasons->reason_codes = reader->read_column<uint32_t>();
+}
+
+Json::Value messages_to_json(
+    const opt_metadata::OptDataTables::Messages& messages) {
+  Json::Value arr;
+  for (size_t i = 0; i < messages.messages.size(); ++i) {
+    Json::Value msg_pair;
+    msg_pair["reason_code"] = (int)messages.reason_codes[i];
+    msg_pair["message"] = messages.messages[i];
+    arr.append(msg_pair);
+  }
+  return arr;
+}
+
+Json::Value reasons_to_json(
+    const opt_metadata::OptDataTables::Reasons& reasons) {
+  Json::Value arr;
+  for (size_t i = 0; i < reasons.ids.size(); ++i) {
+    Json::Value opt_data;
+    opt_data["reason_idx"] = reasons.reason_idxs[i];
+    opt_data["id"] = reasons.ids[i];
+    opt_data["reason_code"] = (int)reasons.reason_codes[i];
+    arr.append(opt_data);
+  }
+  return arr;
+}
 } // namespace
 
 namespace opt_metadata {
@@ -127,6 +288,105 @@ void log_nopt(NoptReason nopt, const DexClass* cls) {
   OptDataMapper::get_instance().log_nopt(nopt, cls);
 }
 
+Json::Value OptDataTables::to_json() const {
+  Json::Value top;
+  top["opt_messages"] = messages_to_json(opt_messages);
+  top["nopt_messages"] = messages_to_json(nopt_messages);
+
+  Json::Value cls_arr;
+  for (size_t i = 0; i < classes.names.size(); ++i) {
+    Json::Value cls_data;
+    cls_data["id"] = (uint)i;
+    cls_data["package"] = classes.packages[i];
+    cls_data["source_file"] = classes.source_files[i];
+    cls_data["name"] = classes.names[i];
+    cls_arr.append(cls_data);
+  }
+  Json::Value meth_arr;
+  for (size_t i = 0; i < methods.signatures.size(); ++i) {
+    Json::Value meth_data;
+    meth_data["id"] = (uint)i;
+    meth_data["cls_id"] = methods.cls_ids[i];
+    meth_data["has_line_num"] = (int)methods.has_line_nums[i];
+    meth_data["line_num"] = methods.line_nums[i];
+    meth_data["signature"] = methods.signatures[i];
+    meth_data["code_size"] = methods.code_sizes[i];
+    meth_arr.append(meth_data);
+  }
+  Json::Value insn_arr;
+  for (size_t i = 0; i < instructions.instructions.size(); ++i) {
+    Json::Value insn_data;
+    insn_data["id"] = (uint)i;
+    insn_data["meth_id"] = instructions.meth_ids[i];
+    insn_data["has_line_num"] = (int)instructions.has_line_nums[i];
+    insn_data["line_num"] = instructions.line_nums[i];
+    insn_data["instruction"] = instructions.instructions[i];
+    insn_arr.append(insn_data);
+  }
+
+  top["classes"] = cls_arr;
+  top["methods"] = meth_arr;
+  top["instructions"] = insn_arr;
+  top["instruction_opts"] = reasons_to_json(instruction_opts);
+  top["method_opts"] = reasons_to_json(method_opts);
+  top["class_opts"] = reasons_to_json(class_opts);
+  top["instruction_nopts"] = reasons_to_json(instruction_nopts);
+  top["method_nopts"] = reasons_to_json(method_nopts);
+  top["class_nopts"] = reasons_to_json(class_nopts);
+  return top;
+}
+
+void OptDataTables::write_binary(std::ostream& os) const {
+  ColumnWriter writer;
+  write_messages(opt_messages, &writer);
+  write_messages(nopt_messages, &writer);
+  writer.write(classes.packages);
+  writer.write(classes.source_files);
+  writer.write(classes.names);
+  writer.write(methods.cls_ids);
+  writer.write(methods.has_line_nums);
+  writer.write(methods.line_nums);
+  writer.write(methods.signatures);
+  writer.write(methods.code_sizes);
+  writer.write(instructions.meth_ids);
+  writer.write(instructions.has_line_nums);
+  writer.write(instructions.line_nums);
+  writer.write(instructions.instructions);
+  write_reasons(class_opts, &writer);
+  write_reasons(method_opts, &writer);
+  write_reasons(instruction_opts, &writer);
+  write_reasons(class_nopts, &writer);
+  write_reasons(method_nopts, &writer);
+  write_reasons(instruction_nopts, &writer);
+  writer.finish(os);
+}
+
+OptDataTables OptDataTables::read_binary(std::istream& is) {
+  ColumnReader reader(is);
+  OptDataTables tables;
+  read_messages(&reader, &tables.opt_messages);
+  read_messages(&reader, &tables.nopt_messages);
+  tables.classes.packages = reader.read_strings();
+  tables.classes.source_files = reader.read_strings();
+  tables.classes.names = reader.read_strings();
+  tables.methods.cls_ids = reader.read_column<uint32_t>();
+  tables.methods.has_line_nums = reader.read_column<uint8_t>();
+  tables.methods.line_nums = reader.read_column<uint32_t>();
+  tables.methods.signatures = reader.read_strings();
+  tables.methods.code_sizes = reader.read_column<uint32_t>();
+  tables.instructions.meth_ids = reader.read_column<uint32_t>();
+  tables.instructions.has_line_nums = reader.read_column<uint8_t>();
+  tables.instructions.line_nums = reader.read_column<uint32_t>();
+  tables.instructions.instructions = reader.read_strings();
+  read_reasons(&reader, &tables.class_opts);
+  read_reasons(&reader, &tables.method_opts);
+  read_reasons(&reader, &tables.instruction_opts);
+  read_reasons(&reader, &tables.class_nopts);
+  read_reasons(&reader, &tables.method_nopts);
+  read_reasons(&reader, &tables.instruction_nopts);
+  return tables;
+}
+
 InsnOptData::InsnOptData(const DexMethod* method, const IRInstruction* insn)
     : m_method(method) {
   m_insn_orig = SHOW(insn);
@@ -171,23 +431,64 @@ std::shared_ptr<MethodOptData> ClassOptData::get_meth_opt_data(
 
 std::shared_ptr<ClassOptData> OptDataMapper::get_cls_opt_data(
     DexType* cls_type) {
+  auto& local = t_cls_opt_map;
+  if (local == nullptr) {
+    auto log = std::make_unique<ClassOptDataMap>();
+    local = log.get();
+    std::lock_guard<std::mutex> guard(m_thread_logs_lock);
+    m_thread_logs.push_back(std::move(log));
+  }
   auto cls = type_class(cls_type);
-  const auto& kv_pair = m_cls_opt_map.find(cls);
-  if (kv_pair == m_cls_opt_map.end()) {
+  const auto& kv_pair = local->find(cls);
+  if (kv_pair == local->end()) {
     auto cls_opt_data = std::make_shared<ClassOptData>(cls);
-    m_cls_opt_map.emplace(cls, cls_opt_data);
+    local->emplace(cls, cls_opt_data);
     return cls_opt_data;
   }
   return kv_pair->second;
 }
 
+void OptDataMapper::merge_thread_logs() {
+  std::lock_guard<std::mutex> guard(m_thread_logs_lock);
+  for (auto& log : m_thread_logs) {
+    for (auto& cls_pair : *log) {
+      auto emplaced = m_cls_opt_map.emplace(cls_pair);
+      if (emplaced.second) {
+        continue;
+      }
+      auto& cls_opt_data = *emplaced.first->second;
+      append(cls_pair.second->m_opts, &cls_opt_data.m_opts);
+      append(cls_pair.second->m_nopts, &cls_opt_data.m_nopts);
+      for (auto& meth_pair : cls_pair.second->m_meth_opt_map) {
+        auto meth_emplaced = cls_opt_data.m_meth_opt_map.emplace(meth_pair);
+        if (meth_emplaced.second) {
+          continue;
+        }
+        auto& meth_opt_data = *meth_emplaced.first->second;
+        append(meth_pair.second->m_opts, &meth_opt_data.m_opts);
+        append(meth_pair.second->m_nopts, &meth_opt_data.m_nopts);
+        for (auto& insn_pair : meth_pair.second->m_insn_opt_map) {
+          auto insn_emplaced = meth_opt_data.m_insn_opt_map.emplace(insn_pair);
+          if (insn_emplaced.second) {
+            continue;
+          }
+          auto& insn_opt_data = *insn_emplaced.first->second;
+          append(insn_pair.second->m_opts, &insn_opt_data.m_opts);
+          append(insn_pair.second->m_nopts, &insn_opt_data.m_nopts);
+        }
+      }
+    }
+    // The thread keeps logging into its map, if it logs anything more.
+    log->clear();
+  }
+}
+
 void OptDataMapper::log_opt(OptReason opt,
                             const DexMethod* method,
                             const IRInstruction* insn) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
   always_assert_log(method != nullptr, "Can't log null method\n");
   always_assert_log(insn != nullptr, "Can't log null instruction\n");
   auto cls_opt_data = get_cls_opt_data(method->get_class());
@@ -199,10 +500,9 @@ void OptDataMapper::log_opt(OptReason opt,
 void OptDataMapper::log_nopt(NoptReason nopt,
                              const DexMethod* method,
                              const IRInstruction* insn) {
-   if (!m_logs_enabled) {
-     return;
-   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
+  if (!m_logs_enabled) {
+    return;
+  }
   always_assert_log(method != nullptr, "Can't log null method\n");
   always_assert_log(insn != nullptr, "Can't log null instruction\n");
   auto cls_opt_data = get_cls_opt_data(method->get_class());
@@ -215,7 +515,6 @@ void OptDataMapper::log_opt(OptReason opt, const DexMethod* method) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
   always_assert_log(method != nullptr, "Can't log null method\n");
   auto cls_opt_data = get_cls_opt_data(method->get_class());
   auto meth_opt_data = cls_opt_data->get_meth_opt_data(method);
@@ -226,7 +525,6 @@ void OptDataMapper::log_nopt(NoptReason nopt, const DexMethod* method) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
   always_assert_log(method != nullptr, "Can't log null method\n");
   auto cls_opt_data = get_cls_opt_data(method->get_class());
   auto meth_opt_data = cls_opt_data->get_meth_opt_data(method);
@@ -237,7 +535,6 @@ void OptDataMapper::log_opt(OptReason opt, const DexClass* cls) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
   always_assert_log(cls != nullptr, "Can't log null class\n");
   auto cls_opt_data = get_cls_opt_data(cls->get_type());
   cls_opt_data->m_opts.emplace_back(opt);
@@ -247,88 +544,52 @@ void OptDataMapper::log_nopt(NoptReason nopt, const DexClass* cls) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
   always_assert_log(cls != nullptr, "Can't log null class\n");
   auto cls_opt_data = get_cls_opt_data(cls->get_type());
   cls_opt_data->m_nopts.emplace_back(nopt);
 }
 
-Json::Value OptDataMapper::serialize_sql() {
-  constexpr const char* CLASS_OPTS = "class_opts";
-  constexpr const char* METHOD_OPTS = "method_opts";
-  constexpr const char* INSTRUCTION_OPTS = "instruction_opts";
-  constexpr const char* CLASS_NOPTS = "class_nopts";
-  constexpr const char* METHOD_NOPTS = "method_nopts";
-  constexpr const char* INSTRUCTION_NOPTS = "instruction_nopts";
-  constexpr const char* INSTRUCTIONS = "instructions";
-  constexpr const char* METHODS = "methods";
-  constexpr const char* CLASSES = "classes";
-  constexpr const char* OPT_MESSAGES = "opt_messages";
-  constexpr const char* NOPT_MESSAGES = "nopt_messages";
-  Json::Value top;
+Json::Value OptDataMapper::serialize_sql() { return build_tables().to_json(); }
+
+void OptDataMapper::serialize_binary(std::ostream& os) {
+  build_tables().write_binary(os);
+}
 
-  Json::Value opt_msg_arr;
-  Json::Value nopt_msg_arr;
-  serialize_messages_helper(m_opt_msg_map, &opt_msg_arr);
-  serialize_messages_helper(m_nopt_msg_map, &nopt_msg_arr);
-  top[OPT_MESSAGES] = opt_msg_arr;
-  top[NOPT_MESSAGES] = nopt_msg_arr;
+OptDataTables OptDataMapper::build_tables() {
+  merge_thread_logs();
+  OptDataTables tables;
+  serialize_messages_helper(m_opt_msg_map, &tables.opt_messages);
+  serialize_messages_helper(m_nopt_msg_map, &tables.nopt_messages);
 
   size_t cls_id{0};
   size_t meth_id{0};
   size_t insn_id{0};
-  Json::Value cls_arr;
-  Json::Value cls_opt_arr;
-  Json::Value cls_nopt_arr;
-  Json::Value meth_arr;
-  Json::Value meth_opt_arr;
-  Json::Value meth_nopt_arr;
-  Json::Value insn_arr;
-  Json::Value insn_opt_arr;
-  Json::Value insn_nopt_arr;
-
   for (const auto& cls_pair : m_cls_opt_map) {
     auto cls_opt_data = cls_pair.second;
-    serialize_class(cls_opt_data, cls_id, &cls_arr, &cls_opt_arr,
-                    &cls_nopt_arr);
+    serialize_class(cls_opt_data, cls_id, &tables);
 
     for (const auto& meth_pair : cls_opt_data->m_meth_opt_map) {
       auto meth_opt_data = meth_pair.second;
-      serialize_method(meth_opt_data, cls_id, meth_id, &meth_arr, &meth_opt_arr,
-                       &meth_nopt_arr);
+      serialize_method(meth_opt_data, cls_id, meth_id, &tables);
 
       for (const auto& insn_pair : meth_opt_data->m_insn_opt_map) {
         auto insn_opt_data = insn_pair.second;
-        serialize_insn(insn_opt_data, meth_id, insn_id, &insn_arr,
-                       &insn_opt_arr, &insn_nopt_arr);
+        serialize_insn(insn_opt_data, meth_id, insn_id, &tables);
         insn_id++;
       }
       meth_id++;
     }
     cls_id++;
   }
-
-  top[CLASSES] = cls_arr;
-  top[METHODS] = meth_arr;
-  top[INSTRUCTIONS] = insn_arr;
-  top[INSTRUCTION_OPTS] = insn_opt_arr;
-  top[METHOD_OPTS] = meth_opt_arr;
-  top[CLASS_OPTS] = cls_opt_arr;
-  top[INSTRUCTION_NOPTS] = insn_nopt_arr;
-  top[METHOD_NOPTS] = meth_nopt_arr;
-  top[CLASS_NOPTS] = cls_nopt_arr;
-  return top;
+  return tables;
 }
 
 void OptDataMapper::serialize_messages_helper(
-    const std::unordered_map<int, std::string>& msg_map, Json::Value* arr) {
+    const std::unordered_map<int, std::string>& msg_map,
+    OptDataTables::Messages* messages) {
   for (const auto& reason_msg_pair : msg_map) {
-    auto reason = reason_msg_pair.first;
-    const auto& message = reason_msg_pair.second;
-    Json::Value msg_pair;
-    msg_pair["reason_code"] = reason;
-    msg_pair["message"] = std::move(message);
-    arr->append(msg_pair);
+    messages->reason_codes.push_back(reason_msg_pair.first);
+    messages->messages.push_back(reason_msg_pair.second);
   }
 }
 
@@ -336,82 +597,69 @@ void OptDataMapper::serialize_opt_nopt_helper(
     const std::vector<OptReason>& opts,
     const std::vector<NoptReason>& nopts,
     size_t id,
-    Json::Value* opt_arr,
-    Json::Value* nopt_arr) {
+    OptDataTables::Reasons* opt_rows,
+    OptDataTables::Reasons* nopt_rows) {
   for (size_t i = 0; i < opts.size(); ++i) {
     verify_opt(opts.at(i));
-    Json::Value opt_data;
-    opt_data["reason_idx"] = (uint)i;
-    opt_data["id"] = (uint)id;
-    opt_data["reason_code"] = opts.at(i);
-    opt_arr->append(opt_data);
+    opt_rows->reason_idxs.push_back(i);
+    opt_rows->ids.push_back(id);
+    opt_rows->reason_codes.push_back(opts.at(i));
   }
   for (size_t i = 0; i < nopts.size(); ++i) {
     verify_nopt(nopts.at(i));
-    Json::Value nopt_data;
-    nopt_data["reason_idx"] = (uint)i;
-    nopt_data["id"] = (uint)id;
-    nopt_data["reason_code"] = nopts.at(i);
-    nopt_arr->append(nopt_data);
+    nopt_rows->reason_idxs.push_back(i);
+    nopt_rows->ids.push_back(id);
+    nopt_rows->reason_codes.push_back(nopts.at(i));
   }
 }
 
 void OptDataMapper::serialize_class(std::shared_ptr<ClassOptData> cls_opt_data,
                                     size_t cls_id,
-                                    Json::Value* arr,
-                                    Json::Value* opt_arr,
-                                    Json::Value* nopt_arr) {
-  const auto& name = get_deobfuscated_name_substr(cls_opt_data->m_cls);
-  Json::Value cls_data;
-  cls_data["id"] = (uint)cls_id;
-  cls_data["package"] = cls_opt_data->m_package;
-  cls_data["source_file"] =
-      cls_opt_data->m_has_srcfile ? cls_opt_data->m_filename : "";
-  cls_data["name"] = name.c_str();
-  arr->append(cls_data);
+                                    OptDataTables* tables) {
+  auto& classes = tables->classes;
+  always_assert(classes.names.size() == cls_id);
+  classes.packages.push_back(cls_opt_data->m_package);
+  classes.source_files.push_back(
+      cls_opt_data->m_has_srcfile ? cls_opt_data->m_filename : "");
+  classes.names.push_back(get_deobfuscated_name_substr(cls_opt_data->m_cls));
   serialize_opt_nopt_helper(cls_opt_data->m_opts, cls_opt_data->m_nopts, cls_id,
-                            opt_arr, nopt_arr);
+                            &tables->class_opts, &tables->class_nopts);
 }
 
 void OptDataMapper::serialize_method(
     std::shared_ptr<MethodOptData> meth_opt_data,
     size_t cls_id,
     size_t meth_id,
-    Json::Value* arr,
-    Json::Value* opt_arr,
-    Json::Value* nopt_arr) {
+    OptDataTables* tables) {
   const auto& method = meth_opt_data->m_method;
-  Json::Value meth_data;
-  meth_data["id"] = (uint)meth_id;
-  meth_data["cls_id"] = (uint)cls_id;
-  meth_data["has_line_num"] = meth_opt_data->m_has_line_num ? 1 : 0;
-  meth_data["line_num"] = (uint)meth_opt_data->m_line_num;
-  meth_data["signature"] = get_deobfuscated_name(method);
-  meth_data["code_size"] =
-      (uint)(method->get_code() ? method->get_code()->sum_opcode_sizes() : 0);
-  arr->append(meth_data);
+  auto& methods = tables->methods;
+  always_assert(methods.signatures.size() == meth_id);
+  methods.cls_ids.push_back(cls_id);
+  methods.has_line_nums.push_back(meth_opt_data->m_has_line_num ? 1 : 0);
+  methods.line_nums.push_back(meth_opt_data->m_line_num);
+  methods.signatures.push_back(get_deobfuscated_name(method));
+  methods.code_sizes.push_back(
+      method->get_code() ? method->get_code()->sum_opcode_sizes() : 0);
   serialize_opt_nopt_helper(meth_opt_data->m_opts, meth_opt_data->m_nopts,
-                            meth_id, opt_arr, nopt_arr);
+                            meth_id, &tables->method_opts,
+                            &tables->method_nopts);
 }
 
 void OptDataMapper::serialize_insn(std::shared_ptr<InsnOptData> insn_opt_data,
                                    size_t meth_id,
                                    size_t insn_id,
-                                   Json::Value* arr,
-                                   Json::Value* opt_arr,
-                                   Json::Value* nopt_arr) {
-  Json::Value insn_data;
-  insn_data["id"] = (uint)insn_id;
-  insn_data["meth_id"] = (uint)meth_id;
-  insn_data["has_line_num"] = insn_opt_data->m_has_line_num ? 1 : 0;
-  insn_data["line_num"] = (uint)insn_opt_data->m_line_num;
-  insn_data["instruction"] = insn_opt_data->m_insn_orig;
-
+                                   OptDataTables* tables) {
+  auto& instructions = tables->instructions;
+  always_assert(instructions.instructions.size() == insn_id);
+  instructions.meth_ids.push_back(meth_id);
+  instructions.has_line_nums.push_back(insn_opt_data->m_has_line_num ? 1 : 0);
+  instructions.line_nums.push_back(insn_opt_data->m_line_num);
   // TODO In case of invokes, we want to show the deobfuscated name for clarity,
   // if possible.
-  arr->append(insn_data);
+  instructions.instructions.push_back(insn_opt_data->m_insn_orig);
   serialize_opt_nopt_helper(insn_opt_data->m_opts, insn_opt_data->m_nopts,
-                            insn_id, opt_arr, nopt_arr);
+                            insn_id, &tables->instruction_opts,
+                            &tables->instruction_nopts);
 }
 
 /**
@@ -453,7 +701,9 @@ void OptDataMapper::init_nopt_messages() {
       {INL_MULTIPLE_RETURNS,
        "Didn''t inline: callee has multiple return points"},
       {INL_TOO_MANY_CALLERS,
-       "Didn''t inline: this method has too many callers"}};
+       "Didn''t inline: this method has too many callers"},
+      {INL_COLD_CALLER,
+       "Didn''t inline: the caller is cold and the callee is too large"}};
   m_nopt_msg_map = std::move(nopt_msg_map);
 }
 
@@ -468,6 +718,4 @@ void OptDataMapper::verify_nopt(NoptReason reason) {
                     "Message not found for reason %s\n",
                     reason);
 }
-
-std::mutex OptDataMapper::s_opt_log_mutex;
 } // namespace opt_metadata
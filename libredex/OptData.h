@@ -7,11 +7,14 @@
 
 #pragma once
 
+#include <istream>
 #include <json/json.h>
 #include <memory>
 #include <mutex>
+#include <ostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "DexClass.h"
 #include "IRInstruction.h"
@@ -125,13 +128,78 @@ class ClassOptData {
       m_meth_opt_map;
 };
 
+using ClassOptDataMap =
+    std::unordered_map<const DexClass*, std::shared_ptr<ClassOptData>>;
+
+/**
+ * The tables described in OptDataMapper::serialize_sql(), one vector per
+ * column. Ids are row indices.
+ *
+ * Besides the JSON form, the tables can be written in a compact columnar
+ * binary form: after a binary_serialization header, a table of all the
+ * distinct strings, then every column as a u32 length followed by its
+ * values, with strings as indices into the string table.
+ */
+struct OptDataTables {
+  struct Messages {
+    std::vector<uint32_t> reason_codes;
+    std::vector<std::string> messages;
+  };
+
+  struct Classes {
+    std::vector<std::string> packages;
+    std::vector<std::string> source_files;
+    std::vector<std::string> names;
+  };
+
+  struct Methods {
+    std::vector<uint32_t> cls_ids;
+    std::vector<uint8_t> has_line_nums;
+    std::vector<uint32_t> line_nums;
+    std::vector<std::string> signatures;
+    std::vector<uint32_t> code_sizes;
+  };
+
+  struct Instructions {
+    std::vector<uint32_t> meth_ids;
+    std::vector<uint8_t> has_line_nums;
+    std::vector<uint32_t> line_nums;
+    std::vector<std::string> instructions;
+  };
+
+  struct Reasons {
+    std::vector<uint32_t> ids;
+    std::vector<uint32_t> reason_idxs;
+    std::vector<uint32_t> reason_codes;
+  };
+
+  Messages opt_messages;
+  Messages nopt_messages;
+  Classes classes;
+  Methods methods;
+  Instructions instructions;
+  Reasons class_opts;
+  Reasons method_opts;
+  Reasons instruction_opts;
+  Reasons class_nopts;
+  Reasons method_nopts;
+  Reasons instruction_nopts;
+
+  Json::Value to_json() const;
+
+  void write_binary(std::ostream& os) const;
+  static OptDataTables read_binary(std::istream& is);
+};
+
 /**
  * Records and expresses optimization data.
+ *
+ * Each thread logs into a map of its own without taking a lock. The maps
+ * are merged when the data is serialized, which must not happen while
+ * anything is still logging.
  */
 class OptDataMapper {
  public:
-  static std::mutex s_opt_log_mutex;
-
   static OptDataMapper& get_instance() {
     static OptDataMapper instance;
     return instance;
@@ -174,10 +242,20 @@ class OptDataMapper {
    */
   Json::Value serialize_sql();
 
+  /**
+   * Writes the same tables as serialize_sql() in the columnar binary form of
+   * OptDataTables.
+   */
+  void serialize_binary(std::ostream& os);
+
+  OptDataTables build_tables();
+
  private:
   bool m_logs_enabled{false};
-  std::unordered_map<const DexClass*, std::shared_ptr<ClassOptData>>
-      m_cls_opt_map;
+  // The merged logs of all the threads; see merge_thread_logs().
+  ClassOptDataMap m_cls_opt_map;
+  std::mutex m_thread_logs_lock;
+  std::vector<std::unique_ptr<ClassOptDataMap>> m_thread_logs;
   std::unordered_map<int /*OptReason*/, std::string> m_opt_msg_map;
   std::unordered_map<int /*NoptReason*/, std::string> m_nopt_msg_map;
 
@@ -187,58 +265,57 @@ class OptDataMapper {
   }
 
   /**
-   * Finds and returns a ClassOptData for the given class type. If the
-   * ClassOptData doesn't yet exist, construct it and return.
+   * Finds and returns the calling thread's ClassOptData for the given class
+   * type. If the ClassOptData doesn't yet exist, construct it and return.
    */
   std::shared_ptr<ClassOptData> get_cls_opt_data(DexType* cls_type);
 
   /**
-   * For the table {msg_type}_messages, append each row as an entry to arr.
+   * Moves the logs of all the threads into m_cls_opt_map.
+   */
+  void merge_thread_logs();
+
+  /**
+   * For the table {msg_type}_messages, append each row.
    */
   void serialize_messages_helper(
-      const std::unordered_map<int, std::string>& msg_map, Json::Value* arr);
+      const std::unordered_map<int, std::string>& msg_map,
+      OptDataTables::Messages* messages);
 
   /**
-   * For the tables {level}_opts and {level}_nopts, append each row as an
-   * entry in the corresponding json arr.
+   * For the tables {level}_opts and {level}_nopts, append each row.
    */
   void serialize_opt_nopt_helper(const std::vector<OptReason>& opts,
                                  const std::vector<NoptReason>& nopts,
                                  size_t id,
-                                 Json::Value* opt_arr,
-                                 Json::Value* nopt_arr);
+                                 OptDataTables::Reasons* opt_rows,
+                                 OptDataTables::Reasons* nopt_rows);
 
   /**
-   * For the table 'classes', append class info to arr. Append cls opt info to
-   * opt/nopt arrs.
+   * For the table 'classes', append class info. Append cls opt info to
+   * opt/nopt rows.
    */
   void serialize_class(std::shared_ptr<ClassOptData> cls_opt_data,
                        size_t cls_id,
-                       Json::Value* arr,
-                       Json::Value* opt_arr,
-                       Json::Value* nopt_arr);
+                       OptDataTables* tables);
 
   /**
-   * For the table 'methods', append method info to arr. Append meth opt info to
-   * opt/nopt arrs.
+   * For the table 'methods', append method info. Append meth opt info to
+   * opt/nopt rows.
    */
   void serialize_method(std::shared_ptr<MethodOptData> meth_opt_data,
                         size_t cls_id,
                         size_t meth_id,
-                        Json::Value* arr,
-                        Json::Value* opt_arr,
-                        Json::Value* nopt_arr);
+                        OptDataTables* tables);
 
   /**
-   * For the table 'instructions', append instruction info to arr. Append insn
-   * opt info to opt/nopt arrs.
+   * For the table 'instructions', append instruction info. Append insn opt
+   * info to opt/nopt rows.
    */
   void serialize_insn(std::shared_ptr<InsnOptData> insn_opt_data,
                       size_t meth_id,
                       size_t insn_id,
-                      Json::Value* arr,
-                      Json::Value* opt_arr,
-                      Json::Value* nopt_arr);
+                      OptDataTables* tables);
 
   /**
    * NOTE: Register an opt/non-opt message to the corresponding init_ function.
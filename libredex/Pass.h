@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 
+#include "AnalysisCache.h"
 #include "ConfigFiles.h"
 #include "Configurable.h"
 #include "DexStore.h"
@@ -49,6 +50,26 @@ class Pass : public Configurable {
                         ConfigFiles& conf,
                         PassManager& mgr) = 0;
 
+  /**
+   * The analyses of the PassManager's AnalysisCache that are still valid
+   * after run_pass. Be conservative: a stale analysis is a miscompilation
+   * waiting to happen.
+   */
+  virtual PreservedAnalyses get_preserved_analyses() const {
+    return PreservedAnalyses::none();
+  }
+
+  /**
+   * A store-local pass only looks at and changes the classes of the stores
+   * that it is given, and gives the same result when it runs on each store
+   * on its own as when it runs on all of them. It must not keep state in the
+   * Pass between calls of run_pass, nor use the AnalysisCache or set_metric,
+   * since PassManager runs it on the stores concurrently, each with a
+   * DexStoresVector of just that store. Passes that change the bodies of
+   * methods one at a time usually are.
+   */
+  virtual bool is_store_local() const { return false; }
+
  private:
   std::string m_name;
 };
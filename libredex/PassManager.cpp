@@ -7,10 +7,21 @@
 
 #include "PassManager.h"
 
+#include <atomic>
 #include <boost/filesystem.hpp>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
 #include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <unordered_set>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
 #include "ApiLevelChecker.h"
 #include "ApkManager.h"
 #include "CommandProfiling.h"
@@ -24,16 +35,76 @@
 #include "IRTypeChecker.h"
 #include "InstructionLowering.h"
 #include "JemallocUtil.h"
+#include "MemoryCensus.h"
+#include "MethodTimings.h"
 #include "OptData.h"
 #include "PrintSeeds.h"
 #include "ProguardPrintConfiguration.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
+#include "Resolver.h"
+#include "ThreadPool.h"
 #include "Timer.h"
 #include "Walkers.h"
 
 namespace {
 
+uint64_t peak_rss_kb() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+uint64_t current_rss_kb() {
+#if defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+  return 0;
+#endif
+}
+
+// The CPU time of the process so far, over all of its threads.
+double cpu_seconds() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+  return 0;
+#endif
+}
+
+PassManager::MemoryStats memory_before() {
+  PassManager::MemoryStats stats;
+  stats.peak_rss_before = peak_rss_kb();
+  stats.allocated_before = jemalloc_util::get_allocated_bytes() / 1024;
+  return stats;
+}
+
+void memory_after(PassManager::MemoryStats* stats) {
+  stats->peak_rss_after = peak_rss_kb();
+  stats->rss_after = current_rss_kb();
+  stats->allocated_after = jemalloc_util::get_allocated_bytes() / 1024;
+}
+
 const std::string PASS_ORDER_KEY = "pass_order";
 
 std::string get_apk_dir(const Json::Value& config) {
@@ -42,6 +113,111 @@ std::string get_apk_dir(const Json::Value& config) {
   return apkdir;
 }
 
+using CodeHashes = std::unordered_map<const DexMethod*, size_t>;
+
+// The hash of the code of each method that has code. Code that is kept in an
+// editable CFG isn't in the hash, so it is always taken to have changed.
+CodeHashes hash_code(const Scope& scope) {
+  std::vector<const DexMethod*> methods;
+  walk::methods(scope, [&methods](DexMethod* method) {
+    if (const_cast<const DexMethod*>(method)->get_code() != nullptr) {
+      methods.push_back(method);
+    }
+  });
+  std::vector<size_t> hashes(methods.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t index) {
+    auto method = methods[index];
+    auto code = method->get_code();
+    hashes[index] = code->editable_cfg_built()
+                        ? method->get_code_epoch()
+                        : hashing::DexClassHasher::hash_code_of(method);
+  });
+  for (size_t index = 0; index < methods.size(); ++index) {
+    wq.add_item(index);
+  }
+  wq.run_all();
+  CodeHashes result;
+  for (size_t index = 0; index < methods.size(); ++index) {
+    result.emplace(methods[index], hashes[index]);
+  }
+  return result;
+}
+
+// The methods of `after` that aren't in `before` with the same hash.
+std::unordered_set<const DexMethodRef*> changed_methods(
+    const CodeHashes& before, const CodeHashes& after) {
+  std::unordered_set<const DexMethodRef*> changed;
+  for (const auto& pair : after) {
+    auto it = before.find(pair.first);
+    if (it == before.end() || it->second != pair.second) {
+      changed.insert(pair.first);
+    }
+  }
+  return changed;
+}
+
+// The `changed` methods and the methods that call them.
+std::unordered_set<const DexMethodRef*> changed_and_callers(
+    const Scope& scope,
+    const std::unordered_set<const DexMethodRef*>& changed) {
+  ConcurrentSet<const DexMethodRef*> callers;
+  walk::parallel::opcodes(
+      scope, [](DexMethod*) { return true; },
+      [&](DexMethod* method, IRInstruction* insn) {
+        if (insn->has_method() && changed.count(insn->get_method())) {
+          callers.insert(method);
+        }
+      });
+  std::unordered_set<const DexMethodRef*> result(changed);
+  result.insert(callers.begin(), callers.end());
+  return result;
+}
+
+/*
+ * Makes the calling thread and the threads of the pool allocate from `arena`
+ * until release(), which then hands the pages that have been freed in the
+ * arena back to the OS. See "pass_arenas".
+ */
+class ScopedPassArena {
+ public:
+  explicit ScopedPassArena(boost::optional<unsigned> arena) : m_arena(arena) {
+    if (m_arena) {
+      unsigned index = *m_arena;
+      on_all_threads([index] { jemalloc_util::bind_thread_to_arena(index); });
+    }
+  }
+
+  ~ScopedPassArena() { release(); }
+
+  // Returns how many KiB the purge gave back.
+  uint64_t release() {
+    if (!m_arena) {
+      return 0;
+    }
+    on_all_threads(jemalloc_util::unbind_thread_from_arena);
+    auto resident_before = jemalloc_util::get_resident_bytes();
+    jemalloc_util::purge_arena(*m_arena);
+    auto resident_after = jemalloc_util::get_resident_bytes();
+    m_arena = boost::none;
+    return resident_before > resident_after
+               ? (resident_before - resident_after) / 1024
+               : 0;
+  }
+
+ private:
+  static void on_all_threads(const std::function<void()>& fn) {
+    fn();
+    auto pool = ThreadPool::get_instance();
+    if (pool != nullptr && !ThreadPool::on_pool_thread()) {
+      // Threads that miss out keep their own arena, which is merely less
+      // effective.
+      pool->try_run(pool->size(), [&fn](size_t) { fn(); });
+    }
+  }
+
+  boost::optional<unsigned> m_arena;
+};
+
 } // namespace
 
 std::unique_ptr<redex::ProguardConfiguration> empty_pg_config() {
@@ -112,13 +288,61 @@ void PassManager::init(const Json::Value& config) {
     m_pass_info[i].metrics[PASS_ORDER_KEY] = i;
     m_pass_info[i].config = JsonWrapper(config[pass->name()]);
   }
+
+  const auto& limits = config["pass_memory_limits"];
+  m_default_peak_rss_limit =
+      limits.get("max_peak_rss_mb", 0).asUInt64() * 1024;
+  const auto& per_pass = limits["per_pass_max_peak_rss_mb"];
+  for (const auto& name : per_pass.getMemberNames()) {
+    m_peak_rss_limits[name] = per_pass[name].asUInt64() * 1024;
+  }
+
+  m_parallel_store_local_passes =
+      config.get("parallel_store_local_passes", true).asBool();
+
+  for (const auto& name : config["pass_arenas"]) {
+    m_arena_passes.insert(name.asString());
+  }
+
+  size_t fixpoints_end = 0;
+  for (const auto& group : config["pass_fixpoints"]) {
+    const auto& names = group["passes"];
+    always_assert_log(names.size() > 0, "A pass fixpoint needs passes");
+    FixpointGroup fixpoint{0, 0, group.get("max_iterations", 4).asUInt()};
+    for (size_t begin = fixpoints_end;
+         begin + names.size() <= m_activated_passes.size();
+         ++begin) {
+      size_t matched = 0;
+      while (matched < names.size() &&
+             m_activated_passes[begin + matched]->name() ==
+                 names[(Json::ArrayIndex)matched].asString()) {
+        ++matched;
+      }
+      if (matched == names.size()) {
+        fixpoint.begin = begin;
+        fixpoint.end = begin + matched;
+        break;
+      }
+    }
+    always_assert_log(fixpoint.end > 0,
+                      "The passes of pass fixpoint %s don't follow each other "
+                      "in the pass list after the previous fixpoint",
+                      group["passes"].toStyledString().c_str());
+    fixpoints_end = fixpoint.end;
+    m_fixpoints.push_back(fixpoint);
+  }
+
+  const auto& timings = config["method_timings"];
+  if (timings.get("enabled", false).asBool()) {
+    method_timings::set_enabled(true, timings.get("top_n", 20).asUInt());
+  }
 }
 
 hashing::DexHash PassManager::run_hasher(const char* pass_name,
                                          const Scope& scope) {
   TRACE(PM, 2, "Running hasher...");
   Timer t("Hasher");
-  hashing::DexScopeHasher hasher(scope);
+  hashing::DexScopeHasher hasher(scope, m_hasher_caches_code_hashes);
   auto hash = hasher.run();
   if (pass_name) {
     // log metric value in a way that fits into JSON number value
@@ -140,26 +364,79 @@ hashing::DexHash PassManager::run_hasher(const char* pass_name,
 
 void PassManager::run_type_checker(const Scope& scope,
                                    bool verify_moves,
-                                   bool check_no_overwrite_this) {
+                                   bool check_no_overwrite_this,
+                                   bool skip_unchanged) {
   TRACE(PM, 1, "Running IRTypeChecker...");
-  Timer t("IRTypeChecker");
-  walk::parallel::methods(scope, [=](DexMethod* dex_method) {
-    IRTypeChecker checker(dex_method);
-    if (verify_moves) {
-      checker.verify_moves();
-    }
-    if (check_no_overwrite_this) {
-      checker.check_no_overwrite_this();
-    }
-    checker.run();
-    if (checker.fail()) {
-      std::string msg = checker.what();
-      fprintf(stderr, "ABORT! Inconsistency found in Dex code for %s.\n %s\n",
-              SHOW(dex_method), msg.c_str());
-      fprintf(stderr, "Code:\n%s\n", SHOW(dex_method->get_code()));
-      exit(EXIT_FAILURE);
+  Timer t(m_current_pass_info == nullptr
+              ? "IRTypeChecker"
+              : "IRTypeChecker (" + m_current_pass_info->name + ")");
+  auto start = std::chrono::steady_clock::now();
+  auto rename_epoch = g_redex->get_rename_epoch();
+  auto unchanged = [&](const DexMethod* method) {
+    if (!skip_unchanged) {
+      return false;
     }
-  });
+    // No code epoch is ever 0.
+    auto checked = m_type_checked_code.get(
+        method, TypeCheckedCode{0, 0, DexAccessFlags(0), false, false});
+    return checked.code_epoch == method->get_code_epoch() &&
+           checked.rename_epoch == rename_epoch &&
+           checked.access == method->get_access() &&
+           (checked.verify_moves || !verify_moves) &&
+           (checked.check_no_overwrite_this || !check_no_overwrite_this);
+  };
+
+  std::atomic<size_t> num_checked{0};
+  std::atomic<size_t> num_skipped{0};
+  walk::parallel::code_by_cost(
+      scope,
+      [&](DexMethod* dex_method) {
+        if (unchanged(dex_method)) {
+          ++num_skipped;
+          return false;
+        }
+        return true;
+      },
+      [&](DexMethod* dex_method, IRCode&) {
+        IRTypeChecker checker(dex_method);
+        if (verify_moves) {
+          checker.verify_moves();
+        }
+        if (check_no_overwrite_this) {
+          checker.check_no_overwrite_this();
+        }
+        checker.run();
+        if (checker.fail()) {
+          std::string msg = checker.what();
+          fprintf(stderr,
+                  "ABORT! Inconsistency found in Dex code for %s.\n %s\n",
+                  SHOW(dex_method), msg.c_str());
+          fprintf(stderr, "Code:\n%s\n", SHOW(dex_method->get_code()));
+          exit(EXIT_FAILURE);
+        }
+        ++num_checked;
+        // Read after the checker is done with the code, so that its own
+        // accesses don't count as changes.
+        const DexMethod* checked = dex_method;
+        m_type_checked_code.insert_or_assign(std::make_pair(
+            checked,
+            TypeCheckedCode{checked->get_code_epoch(), rename_epoch,
+                            checked->get_access(), verify_moves,
+                            check_no_overwrite_this}));
+      },
+      walk::parallel::default_num_threads(),
+      // Skipped methods cost next to nothing.
+      [&](DexMethod* dex_method) {
+        return unchanged(dex_method) ? 0 : walk::code_size_cost(dex_method);
+      });
+
+  if (m_current_pass_info != nullptr) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    set_metric("~type~checker~ms~", static_cast<int>(elapsed.count()));
+    set_metric("~type~checker~checked~methods~", num_checked);
+    set_metric("~type~checker~skipped~methods~", num_skipped);
+  }
 }
 
 void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
@@ -211,14 +488,24 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
     TRACE(PM, 1, "Evaluating %s...", pass->name().c_str());
     Timer t(pass->name() + " (eval)");
     m_current_pass_info = &m_pass_info[i];
+    auto& memory = m_current_pass_info->eval_memory;
+    memory = memory_before();
     pass->eval_pass(stores, conf, *this);
+    memory_after(&memory);
+    record_memory_metrics("~memory~eval~", memory);
+    check_memory_limit(pass, "eval", memory);
     m_current_pass_info = nullptr;
   }
 
+  IRCode::set_keep_editable_cfg(
+      conf.get_json_config().get("keep_editable_cfg", false));
+
   // Retrieve the hasher's settings.
   const Json::Value& hasher_args = conf.get_json_config()["hasher"];
   bool run_hasher_after_each_pass =
       hasher_args.get("run_after_each_pass", true).asBool();
+  m_hasher_caches_code_hashes =
+      hasher_args.get("cache_code_hashes", false).asBool();
 
   // Retrieve the type checker's settings.
   const Json::Value& type_checker_args =
@@ -228,18 +515,46 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
   bool verify_moves = type_checker_args.get("verify_moves", true).asBool();
   bool check_no_overwrite_this =
       type_checker_args.get("check_no_overwrite_this", false).asBool();
+  // Only between passes: the check before the output always covers
+  // everything.
+  bool skip_unchanged_methods =
+      type_checker_args.get("skip_unchanged_methods", true).asBool();
   std::unordered_set<std::string> type_checker_trigger_passes;
 
   for (auto& trigger_pass : type_checker_args["run_after_passes"]) {
     type_checker_trigger_passes.insert(trigger_pass.asString());
   }
 
+  // Retrieve the memory census's settings.
+  const Json::Value& census_args = conf.get_json_config()["memory_census"];
+  bool run_census_after_each_pass =
+      census_args.get("run_after_each_pass", false).asBool();
+  std::unordered_set<std::string> census_trigger_passes;
+  for (auto& trigger_pass : census_args["run_after_passes"]) {
+    census_trigger_passes.insert(trigger_pass.asString());
+  }
+  if (census_args.get("run_before_passes", false).asBool()) {
+    run_memory_census("(initial)", scope);
+  }
+
   if (run_hasher_after_each_pass) {
     m_initial_hash =
         boost::optional<hashing::DexHash>(this->run_hasher(nullptr, scope));
   }
 
+  // The fixpoint group that is running, see "pass_fixpoints".
+  auto next_fixpoint = m_fixpoints.begin();
+  const FixpointGroup* fixpoint = nullptr;
+  size_t fixpoint_iterations = 0;
+  CodeHashes fixpoint_hashes;
+
   for (size_t i = 0; i < m_activated_passes.size(); ++i) {
+    if (fixpoint == nullptr && next_fixpoint != m_fixpoints.end() &&
+        next_fixpoint->begin == i) {
+      fixpoint = &*next_fixpoint++;
+      fixpoint_iterations = 0;
+      fixpoint_hashes = hash_code(build_class_scope(it));
+    }
     Pass* pass = m_activated_passes[i];
     TRACE(PM, 1, "Running %s...", pass->name().c_str());
     Timer t(pass->name() + " (run)");
@@ -251,14 +566,62 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
               ? boost::make_optional(m_profiler_info->command)
               : boost::none);
       jemalloc_util::ScopedProfiling malloc_prof(m_malloc_profile_pass == pass);
-      pass->run_pass(stores, conf, *this);
+      auto& memory = m_current_pass_info->run_memory;
+      memory = memory_before();
+      m_analysis_cache.reset_stats();
+      method_timings::reset();
+      auto wall_start = std::chrono::steady_clock::now();
+      auto cpu_start = cpu_seconds();
+      boost::optional<unsigned> arena;
+      if (m_arena_passes.count(pass->name())) {
+        if (!m_pass_arena) {
+          unsigned index;
+          if (jemalloc_util::create_arena(&index)) {
+            m_pass_arena = index;
+          }
+        }
+        arena = m_pass_arena;
+      }
+      {
+        ScopedPassArena pass_arena(arena);
+        run_pass_on_stores(pass, stores, conf);
+        if (arena) {
+          set_metric("~memory~arena~purged~kb~", pass_arena.release());
+        }
+      }
+      // For the benchmarks, see tools/bench/redex_bench.py.
+      set_metric("~timing~run~cpu~ms~",
+                 std::lround((cpu_seconds() - cpu_start) * 1000));
+      set_metric("~timing~run~wall~ms~",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - wall_start)
+                     .count());
+      memory_after(&memory);
+      if (method_timings::is_enabled()) {
+        m_current_pass_info->slowest_methods = method_timings::get_slowest();
+      }
+    }
+    auto preserved = pass->get_preserved_analyses();
+    m_analysis_cache.invalidate(preserved);
+    if (!preserved.is_preserved<ResolverCache>()) {
+      g_redex->resolver_cache().invalidate();
+    }
+    if (m_analysis_cache.hits() + m_analysis_cache.misses() > 0) {
+      set_metric("~analysis~cache~hits~", m_analysis_cache.hits());
+      set_metric("~analysis~cache~misses~", m_analysis_cache.misses());
     }
 
+    record_string_interning_metrics();
+    record_memory_metrics("~memory~run~", m_current_pass_info->run_memory);
+    check_memory_limit(pass, "run", m_current_pass_info->run_memory);
+
     bool run_hasher = run_hasher_after_each_pass;
     bool run_type_checker = run_type_checker_after_each_pass ||
                             type_checker_trigger_passes.count(pass->name()) > 0;
+    bool run_census = run_census_after_each_pass ||
+                      census_trigger_passes.count(pass->name()) > 0;
 
-    if (run_hasher || run_type_checker) {
+    if (run_hasher || run_type_checker || run_census) {
       scope = build_class_scope(it);
       if (run_hasher) {
         m_current_pass_info->hash = boost::optional<hashing::DexHash>(
@@ -268,7 +631,33 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
         // It's OK to overwrite the `this` register if we are not yet at the
         // output phase -- the register allocator can fix it up later.
         this->run_type_checker(scope, verify_moves,
-                               /* check_no_overwrite_this */ false);
+                               /* check_no_overwrite_this */ false,
+                               skip_unchanged_methods);
+      }
+      if (run_census) {
+        run_memory_census(m_current_pass_info->name, scope);
+      }
+    }
+
+    if (fixpoint != nullptr && i + 1 == fixpoint->end) {
+      auto hashes = hash_code(build_class_scope(it));
+      auto changed = changed_methods(fixpoint_hashes, hashes);
+      ++fixpoint_iterations;
+      set_metric("~fixpoint~iterations~", fixpoint_iterations);
+      incr_metric("~fixpoint~changed~methods~", changed.size());
+      TRACE(PM, 1, "Pass fixpoint iteration %zu changed %zu methods",
+            fixpoint_iterations, changed.size());
+      if (changed.empty() ||
+          fixpoint_iterations >= fixpoint->max_iterations) {
+        fixpoint = nullptr;
+        m_revisit.reset();
+      } else {
+        m_revisit = std::make_unique<std::unordered_set<const DexMethodRef*>>(
+            changed_and_callers(build_class_scope(it), changed));
+        fixpoint_hashes = std::move(hashes);
+        // Wraps around to 0 for a group at the start, and the loop's
+        // increment brings it back.
+        i = fixpoint->begin - 1;
       }
     }
     m_current_pass_info = nullptr;
@@ -289,6 +678,63 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
   }
 }
 
+void PassManager::record_memory_metrics(const std::string& prefix,
+                                        const MemoryStats& stats) {
+  set_metric(prefix + "peak~rss~kb~", stats.peak_rss_after);
+  set_metric(prefix + "peak~rss~delta~kb~",
+             stats.peak_rss_after - stats.peak_rss_before);
+  set_metric(prefix + "rss~kb~", stats.rss_after);
+  set_metric(prefix + "allocated~kb~", stats.allocated_after);
+  set_metric(prefix + "allocated~delta~kb~",
+             int64_t(stats.allocated_after) - int64_t(stats.allocated_before));
+}
+
+void PassManager::check_memory_limit(const Pass* pass,
+                                     const char* phase,
+                                     const MemoryStats& stats) const {
+  auto it = m_peak_rss_limits.find(pass->name());
+  uint64_t limit =
+      it != m_peak_rss_limits.end() ? it->second : m_default_peak_rss_limit;
+  if (limit == 0 || stats.peak_rss_after <= limit) {
+    return;
+  }
+  fprintf(stderr,
+          "ABORT! Peak RSS reached %" PRIu64 " MiB after %s of %s, over the "
+          "limit of %" PRIu64 " MiB (the pass itself raised it by %" PRIu64
+          " MiB).\n",
+          stats.peak_rss_after / 1024, phase, pass->name().c_str(),
+          limit / 1024, (stats.peak_rss_after - stats.peak_rss_before) / 1024);
+  exit(EXIT_FAILURE);
+}
+
+void PassManager::record_string_interning_metrics() {
+  const auto stats = g_redex->get_string_interning_stats();
+  set_metric("~strings~interned~", stats.strings);
+  set_metric("~strings~lost~races~", stats.lost_races);
+  set_metric("~strings~in~place~", stats.in_place);
+  set_metric("~strings~arenas~", stats.arenas);
+  set_metric("~strings~arena~kb~reserved~", stats.arena_bytes_reserved / 1024);
+  set_metric("~strings~arena~kb~used~", stats.arena_bytes_used / 1024);
+  set_metric("~strings~table~capacity~", stats.table_capacity);
+}
+
+void PassManager::run_memory_census(const std::string& label,
+                                    const Scope& scope) {
+  Timer t("Memory census");
+  auto census = MemoryCensus::take(scope);
+  std::ostringstream out;
+  census.print(out);
+  fprintf(stderr, "Memory census after %s:\n%s", label.c_str(),
+          out.str().c_str());
+  if (m_current_pass_info == nullptr) {
+    return;
+  }
+  for (const auto& p : census.categories()) {
+    set_metric("~census~" + p.first + "~kb~", p.second.bytes / 1024);
+  }
+  set_metric("~census~total~kb~", census.total_bytes() / 1024);
+}
+
 void PassManager::activate_pass(const char* name, const Json::Value& conf) {
   std::string name_str(name);
 
@@ -316,17 +762,46 @@ Pass* PassManager::find_pass(const std::string& pass_name) const {
   return pass_it != m_activated_passes.end() ? *pass_it : nullptr;
 }
 
+void PassManager::run_pass_on_stores(Pass* pass,
+                                     DexStoresVector& stores,
+                                     ConfigFiles& conf) {
+  if (!pass->is_store_local() || !m_parallel_store_local_passes ||
+      stores.size() < 2) {
+    pass->run_pass(stores, conf, *this);
+    return;
+  }
+  // Each store goes into a DexStoresVector of its own for the time of the
+  // pass, and back in the same order after.
+  std::vector<DexStoresVector> split(stores.size());
+  for (size_t i = 0; i < stores.size(); ++i) {
+    split[i].push_back(std::move(stores[i]));
+  }
+  auto wq = workqueue_foreach<DexStoresVector*>(
+      [&](DexStoresVector* store) { pass->run_pass(*store, conf, *this); },
+      std::min<size_t>(split.size(), redex_parallel::default_num_threads()));
+  for (auto& store : split) {
+    wq.add_item(&store);
+  }
+  wq.run_all();
+  for (size_t i = 0; i < stores.size(); ++i) {
+    stores[i] = std::move(split[i][0]);
+  }
+}
+
 void PassManager::incr_metric(const std::string& key, int value) {
   always_assert_log(m_current_pass_info != nullptr, "No current pass!");
+  std::lock_guard<std::mutex> guard(m_metrics_lock);
   (m_current_pass_info->metrics)[key] += value;
 }
 
 void PassManager::set_metric(const std::string& key, int value) {
   always_assert_log(m_current_pass_info != nullptr, "No current pass!");
+  std::lock_guard<std::mutex> guard(m_metrics_lock);
   (m_current_pass_info->metrics)[key] = value;
 }
 
 int PassManager::get_metric(const std::string& key) {
+  std::lock_guard<std::mutex> guard(m_metrics_lock);
   return (m_current_pass_info->metrics)[key];
 }
 
@@ -8,15 +8,20 @@
 #pragma once
 
 #include "ApkManager.h"
+#include "ConcurrentContainers.h"
+#include "DexClass.h"
 #include "DexHasher.h"
+#include "MethodTimings.h"
 #include "Pass.h"
 #include "ProguardConfiguration.h"
 #include "RedexOptions.h"
 
 #include <boost/optional.hpp>
 #include <json/json.h>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -31,6 +36,16 @@ class PassManager {
               const Json::Value& config = Json::Value(Json::objectValue),
               const RedexOptions& options = RedexOptions{});
 
+  // Process memory around one phase (eval or run) of a pass. Sizes are in
+  // KiB; allocated_* stay 0 when not running under jemalloc.
+  struct MemoryStats {
+    uint64_t peak_rss_before{0};
+    uint64_t peak_rss_after{0};
+    uint64_t rss_after{0};
+    uint64_t allocated_before{0};
+    uint64_t allocated_after{0};
+  };
+
   struct PassInfo {
     const Pass* pass;
     size_t order; // zero-based
@@ -40,6 +55,10 @@ class PassManager {
     std::unordered_map<std::string, int> metrics;
     JsonWrapper config;
     boost::optional<hashing::DexHash> hash;
+    MemoryStats eval_memory;
+    MemoryStats run_memory;
+    // The slowest methods of the run of the pass, with "method_timings".
+    std::vector<method_timings::MethodTiming> slowest_methods;
   };
 
   void run_passes(DexStoresVector&, ConfigFiles&);
@@ -72,18 +91,77 @@ class PassManager {
 
   bool regalloc_has_run() { return m_regalloc_has_run; }
 
+  /*
+   * Takes a MemoryCensus of `scope`, prints it to stderr under `label`, and
+   * records the KiB per category as metrics of the current pass, if any.
+   * run_passes() calls this after the passes named in the "memory_census"
+   * config; passes may also call it directly.
+   */
+  void run_memory_census(const std::string& label, const Scope& scope);
+
+  /*
+   * Whole-program analyses shared between passes. After each pass, the
+   * results that the pass doesn't preserve are dropped.
+   */
+  AnalysisCache& analysis_cache() { return m_analysis_cache; }
+
+  /*
+   * When a "pass_fixpoints" group of passes runs again because the previous
+   * run changed some code, whether `method` has to be looked at again: its
+   * code changed in the previous run, or the code of a method that it calls
+   * did. Passes that change methods one at a time, based on what they and
+   * their callees do, may skip the others. Always true outside of such
+   * reruns.
+   */
+  bool needs_revisit(const DexMethod* method) const {
+    return m_revisit == nullptr || m_revisit->count(method) != 0;
+  }
+
  private:
+  // A run of consecutive passes [begin, end) of m_activated_passes that is
+  // repeated until it doesn't change any code, up to max_iterations times.
+  struct FixpointGroup {
+    size_t begin;
+    size_t end;
+    size_t max_iterations;
+  };
+
   void activate_pass(const char* name, const Json::Value& cfg);
 
   Pass* find_pass(const std::string& pass_name) const;
 
   void init(const Json::Value& config);
 
+  // Runs `pass` on all the stores, or on each store on its own and
+  // concurrently if the pass is store-local.
+  void run_pass_on_stores(Pass* pass,
+                          DexStoresVector& stores,
+                          ConfigFiles& conf);
+
   hashing::DexHash run_hasher(const char* name, const Scope& scope);
 
-  static void run_type_checker(const Scope& scope,
-                               bool verify_moves,
-                               bool check_no_overwrite_this);
+  // Snapshot of the string table's size and arena usage for the current pass.
+  void record_string_interning_metrics();
+
+  // Records `stats` as metrics of the current pass under `prefix`, and aborts
+  // if the peak RSS went past the limit configured for `pass`.
+  void record_memory_metrics(const std::string& prefix,
+                             const MemoryStats& stats);
+  void check_memory_limit(const Pass* pass,
+                          const char* phase,
+                          const MemoryStats& stats) const;
+
+  /*
+   * Type checks the code in `scope` and aborts on the first error. With
+   * `skip_unchanged`, methods whose code epoch, signature and access flags
+   * are the same as when they last passed at least as many checks are not
+   * checked again. When run for a pass, the time taken and the numbers of
+   * checked and skipped methods become metrics of that pass.
+   */
+  void run_type_checker(const Scope& scope,
+                        bool verify_moves,
+                        bool check_no_overwrite_this,
+                        bool skip_unchanged = false);
 
   ApkManager m_apk_mgr;
   std::vector<Pass*> m_registered_passes;
@@ -92,6 +170,17 @@ class PassManager {
   // Per-pass information and metrics
   std::vector<PassManager::PassInfo> m_pass_info;
   PassInfo* m_current_pass_info;
+  // Store-local passes update their metrics from several threads.
+  std::mutex m_metrics_lock;
+  // From the "parallel_store_local_passes" config.
+  bool m_parallel_store_local_passes{true};
+  // The passes of the "pass_arenas" config, and the jemalloc arena they all
+  // run in once one has been created.
+  std::unordered_set<std::string> m_arena_passes;
+  boost::optional<unsigned> m_pass_arena;
+  // From the "pass_fixpoints" config, ordered by their begin.
+  std::vector<FixpointGroup> m_fixpoints;
+  std::unique_ptr<std::unordered_set<const DexMethodRef*>> m_revisit;
 
   std::unique_ptr<redex::ProguardConfiguration> m_pg_config;
   const RedexOptions m_redex_options;
@@ -107,5 +196,23 @@ class PassManager {
 
   boost::optional<ProfilerInfo> m_profiler_info;
   Pass* m_malloc_profile_pass{nullptr};
+
+  // Peak RSS limits in KiB from the "pass_memory_limits" config; 0 means no
+  // limit.
+  uint64_t m_default_peak_rss_limit{0};
+  std::unordered_map<std::string, uint64_t> m_peak_rss_limits;
   boost::optional<hashing::DexHash> m_initial_hash;
+  // From the "hasher" config; see hashing::DexScopeHasher.
+  bool m_hasher_caches_code_hashes{false};
+  AnalysisCache m_analysis_cache;
+
+  // What the last successful type check of a method saw.
+  struct TypeCheckedCode {
+    uint64_t code_epoch;
+    size_t rename_epoch;
+    DexAccessFlags access;
+    bool verify_moves;
+    bool check_no_overwrite_this;
+  };
+  ConcurrentMap<const DexMethod*, TypeCheckedCode> m_type_checked_code;
 };
@@ -57,6 +57,19 @@ boost::optional<PointsToVariable> PointsToVariable::from_s_expr(
   return {PointsToVariable(id)};
 }
 
+void PointsToVariable::to_binary(PointsToBinaryWriter* writer) const {
+  writer->write_int(m_id);
+}
+
+boost::optional<PointsToVariable> PointsToVariable::from_binary(
+    PointsToBinaryReader* reader) {
+  int64_t id;
+  if (!reader->read_int(&id)) {
+    return {};
+  }
+  return {PointsToVariable(static_cast<int32_t>(id))};
+}
+
 size_t hash_value(const PointsToVariable& v) {
   boost::hash<int32_t> hasher;
   return hasher(v.m_id);
@@ -186,6 +199,44 @@ boost::optional<DexMethodRef*> s_expr_to_dex_method(const s_expr& e) {
                            DexTypeList::make_type_list(std::move(types))))};
 }
 
+void dex_method_to_binary(DexMethodRef* dex_method,
+                          PointsToBinaryWriter* writer) {
+  DexProto* proto = dex_method->get_proto();
+  const auto& args = proto->get_args()->get_type_list();
+  writer->write_string(dex_method->get_class()->get_name()->str());
+  writer->write_string(dex_method->get_name()->str());
+  writer->write_string(proto->get_rtype()->get_name()->str());
+  writer->write_uint(args.size());
+  for (DexType* arg : args) {
+    writer->write_string(arg->get_name()->str());
+  }
+}
+
+boost::optional<DexMethodRef*> binary_to_dex_method(
+    PointsToBinaryReader* reader) {
+  std::string type_str;
+  std::string name_str;
+  std::string rtype_str;
+  uint64_t num_args;
+  if (!reader->read_string(&type_str) || !reader->read_string(&name_str) ||
+      !reader->read_string(&rtype_str) || !reader->read_uint(&num_args)) {
+    return {};
+  }
+  std::deque<DexType*> types;
+  for (uint64_t arg = 0; arg < num_args; ++arg) {
+    std::string arg_str;
+    if (!reader->read_string(&arg_str)) {
+      return {};
+    }
+    types.push_back(DexType::make_type(arg_str.c_str()));
+  }
+  return {DexMethod::make_method(
+      DexType::make_type(type_str.c_str()),
+      DexString::make_string(name_str),
+      DexProto::make_proto(DexType::make_type(rtype_str.c_str()),
+                           DexTypeList::make_type_list(std::move(types))))};
+}
+
 } // namespace pts_impl
 
 s_expr PointsToOperation::to_s_expr() const {
@@ -325,6 +376,133 @@ boost::optional<PointsToOperation> PointsToOperation::from_s_expr(
   }
 }
 
+void PointsToOperation::to_binary(PointsToBinaryWriter* writer) const {
+  using namespace pts_impl;
+  writer->write_uint(kind);
+  switch (kind) {
+  case PTS_CONST_STRING: {
+    writer->write_string(dex_string->str());
+    break;
+  }
+  case PTS_CONST_CLASS:
+  case PTS_NEW_OBJECT:
+  case PTS_CHECK_CAST: {
+    writer->write_string(dex_type->get_name()->str());
+    break;
+  }
+  case PTS_GET_EXCEPTION:
+  case PTS_GET_CLASS:
+  case PTS_RETURN:
+  case PTS_DISJUNCTION: {
+    break;
+  }
+  case PTS_LOAD_PARAM: {
+    writer->write_uint(parameter);
+    break;
+  }
+  case PTS_IGET:
+  case PTS_SGET:
+  case PTS_IPUT:
+  case PTS_SPUT: {
+    writer->write_string(dex_field->get_class()->get_name()->str());
+    writer->write_string(dex_field->get_name()->str());
+    writer->write_string(dex_field->get_type()->get_name()->str());
+    break;
+  }
+  case PTS_IGET_SPECIAL:
+  case PTS_IPUT_SPECIAL: {
+    writer->write_uint(special_edge);
+    break;
+  }
+  case PTS_INVOKE_VIRTUAL:
+  case PTS_INVOKE_SUPER:
+  case PTS_INVOKE_DIRECT:
+  case PTS_INVOKE_INTERFACE:
+  case PTS_INVOKE_STATIC: {
+    dex_method_to_binary(dex_method, writer);
+    break;
+  }
+  }
+}
+
+boost::optional<PointsToOperation> PointsToOperation::from_binary(
+    PointsToBinaryReader* reader) {
+  using namespace pts_impl;
+  uint64_t op_kind_id;
+  if (!reader->read_uint(&op_kind_id) || op_kind_id > PTS_DISJUNCTION) {
+    return {};
+  }
+  auto op_kind = static_cast<PointsToOperationKind>(op_kind_id);
+  switch (op_kind) {
+  case PTS_CONST_STRING: {
+    std::string dex_string_str;
+    if (!reader->read_string(&dex_string_str)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, DexString::make_string(dex_string_str))};
+  }
+  case PTS_CONST_CLASS:
+  case PTS_NEW_OBJECT:
+  case PTS_CHECK_CAST: {
+    std::string dex_type_str;
+    if (!reader->read_string(&dex_type_str)) {
+      return {};
+    }
+    return {
+        PointsToOperation(op_kind, DexType::make_type(dex_type_str.c_str()))};
+  }
+  case PTS_GET_EXCEPTION:
+  case PTS_GET_CLASS:
+  case PTS_RETURN:
+  case PTS_DISJUNCTION: {
+    return {PointsToOperation(op_kind)};
+  }
+  case PTS_LOAD_PARAM: {
+    uint64_t parameter;
+    if (!reader->read_uint(&parameter)) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, static_cast<size_t>(parameter))};
+  }
+  case PTS_IGET:
+  case PTS_SGET:
+  case PTS_IPUT:
+  case PTS_SPUT: {
+    std::string container_str;
+    std::string name_str;
+    std::string type_str;
+    if (!reader->read_string(&container_str) ||
+        !reader->read_string(&name_str) || !reader->read_string(&type_str)) {
+      return {};
+    }
+    return {PointsToOperation(
+        op_kind,
+        DexField::make_field(DexType::make_type(container_str.c_str()),
+                             DexString::make_string(name_str),
+                             DexType::make_type(type_str.c_str())))};
+  }
+  case PTS_IGET_SPECIAL:
+  case PTS_IPUT_SPECIAL: {
+    uint64_t edge;
+    if (!reader->read_uint(&edge) || edge != PTS_ARRAY_ELEMENT) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, PTS_ARRAY_ELEMENT)};
+  }
+  case PTS_INVOKE_VIRTUAL:
+  case PTS_INVOKE_SUPER:
+  case PTS_INVOKE_DIRECT:
+  case PTS_INVOKE_INTERFACE:
+  case PTS_INVOKE_STATIC: {
+    auto dex_method_opt = binary_to_dex_method(reader);
+    if (!dex_method_opt) {
+      return {};
+    }
+    return {PointsToOperation(op_kind, *dex_method_opt)};
+  }
+  }
+}
+
 namespace pts_impl {
 
 // A wrapper for a set of variables. We use this structure for the generation of
@@ -516,6 +694,37 @@ boost::optional<PointsToAction> PointsToAction::from_s_expr(const s_expr& e) {
   return {PointsToAction(*operation_opt, arguments)};
 }
 
+void PointsToAction::to_binary(PointsToBinaryWriter* writer) const {
+  m_operation.to_binary(writer);
+  writer->write_uint(m_arguments.size());
+  for (const auto& arg : m_arguments) {
+    writer->write_int(arg.first);
+    arg.second.to_binary(writer);
+  }
+}
+
+boost::optional<PointsToAction> PointsToAction::from_binary(
+    PointsToBinaryReader* reader) {
+  auto operation_opt = PointsToOperation::from_binary(reader);
+  uint64_t num_args;
+  if (!operation_opt || !reader->read_uint(&num_args)) {
+    return {};
+  }
+  std::vector<std::pair<int32_t, PointsToVariable>> arguments;
+  for (uint64_t i = 0; i < num_args; ++i) {
+    int64_t arg;
+    if (!reader->read_int(&arg)) {
+      return {};
+    }
+    auto var_opt = PointsToVariable::from_binary(reader);
+    if (!var_opt) {
+      return {};
+    }
+    arguments.push_back({static_cast<int32_t>(arg), *var_opt});
+  }
+  return {PointsToAction(*operation_opt, arguments)};
+}
+
 namespace pts_impl {
 
 std::string special_edge_to_string(SpecialPointsToEdge e) {
@@ -1516,6 +1725,161 @@ boost::optional<PointsToMethodSemantics> PointsToMethodSemantics::from_s_expr(
   return boost::optional<PointsToMethodSemantics>(semantics);
 }
 
+void PointsToMethodSemantics::to_binary(PointsToBinaryWriter* writer) const {
+  pts_impl::dex_method_to_binary(m_dex_method, writer);
+  writer->write_uint(m_kind);
+  writer->write_uint(m_variable_counter);
+  writer->write_uint(m_points_to_actions.size());
+  for (const auto& action : m_points_to_actions) {
+    action.to_binary(writer);
+  }
+}
+
+boost::optional<PointsToMethodSemantics> PointsToMethodSemantics::from_binary(
+    PointsToBinaryReader* reader) {
+  auto dex_method_opt = pts_impl::binary_to_dex_method(reader);
+  uint64_t kind;
+  uint64_t var_counter;
+  uint64_t num_actions;
+  if (!dex_method_opt || !reader->read_uint(&kind) || kind > PTS_STUB ||
+      !reader->read_uint(&var_counter) || !reader->read_uint(&num_actions)) {
+    return {};
+  }
+  // The number of actions only serves as a size hint, so that a corrupted
+  // count doesn't make us reserve a huge vector.
+  PointsToMethodSemantics semantics(*dex_method_opt,
+                                    static_cast<MethodKind>(kind),
+                                    var_counter,
+                                    std::min<uint64_t>(num_actions, 1024));
+  for (uint64_t i = 0; i < num_actions; ++i) {
+    auto action_opt = PointsToAction::from_binary(reader);
+    if (!action_opt) {
+      return {};
+    }
+    semantics.add(*action_opt);
+  }
+  return boost::optional<PointsToMethodSemantics>(semantics);
+}
+
+namespace {
+
+constexpr char kBinaryMagic[] = {'P', 'T', 'S', 'B', 1};
+
+} // namespace
+
+PointsToBinaryWriter::PointsToBinaryWriter(std::ostream& out) : m_out(out) {
+  m_out.write(kBinaryMagic, sizeof(kBinaryMagic));
+}
+
+void PointsToBinaryWriter::write(const PointsToMethodSemantics& semantics) {
+  semantics.to_binary(this);
+}
+
+void PointsToBinaryWriter::write_uint(uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    m_out.put(static_cast<char>(byte));
+  } while (value != 0);
+}
+
+void PointsToBinaryWriter::write_int(int64_t value) {
+  // Zigzag encoding, so that small negative numbers stay small.
+  write_uint((static_cast<uint64_t>(value) << 1) ^
+             static_cast<uint64_t>(value >> 63));
+}
+
+void PointsToBinaryWriter::write_string(const std::string& str) {
+  auto it = m_string_ids.find(str);
+  if (it != m_string_ids.end()) {
+    write_uint(it->second + 1);
+    return;
+  }
+  // A zero introduces a string that isn't in the table yet.
+  write_uint(0);
+  write_uint(str.size());
+  m_out.write(str.data(), str.size());
+  m_string_ids.emplace(str, m_string_ids.size());
+}
+
+PointsToBinaryReader::PointsToBinaryReader(std::istream& in) : m_in(in) {
+  char magic[sizeof(kBinaryMagic)];
+  m_in.read(magic, sizeof(magic));
+  always_assert_log(m_in.good() &&
+                        std::equal(magic, magic + sizeof(magic), kBinaryMagic),
+                    "Not a binary points-to semantics stream\n");
+}
+
+boost::optional<PointsToMethodSemantics> PointsToBinaryReader::read() {
+  if (m_in.peek() == std::istream::traits_type::eof()) {
+    return {};
+  }
+  auto semantics_opt = PointsToMethodSemantics::from_binary(this);
+  always_assert_log(semantics_opt, "Malformed binary points-to semantics\n");
+  return semantics_opt;
+}
+
+bool PointsToBinaryReader::read_uint(uint64_t* value) {
+  *value = 0;
+  for (size_t shift = 0; shift < 64; shift += 7) {
+    auto byte = m_in.get();
+    if (byte == std::istream::traits_type::eof()) {
+      return false;
+    }
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PointsToBinaryReader::read_int(int64_t* value) {
+  uint64_t zigzag;
+  if (!read_uint(&zigzag)) {
+    return false;
+  }
+  *value =
+      static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+  return true;
+}
+
+bool PointsToBinaryReader::read_string(std::string* str) {
+  uint64_t id;
+  if (!read_uint(&id)) {
+    return false;
+  }
+  if (id > 0) {
+    if (id > m_strings.size()) {
+      return false;
+    }
+    *str = m_strings[id - 1];
+    return true;
+  }
+  uint64_t size;
+  if (!read_uint(&size)) {
+    return false;
+  }
+  str->clear();
+  // Read in chunks, so that a corrupted size fails at the end of the stream
+  // rather than on a huge allocation.
+  char buffer[4096];
+  while (size > 0) {
+    auto chunk = std::min<uint64_t>(size, sizeof(buffer));
+    m_in.read(buffer, chunk);
+    if (static_cast<uint64_t>(m_in.gcount()) != chunk) {
+      return false;
+    }
+    str->append(buffer, chunk);
+    size -= chunk;
+  }
+  m_strings.push_back(*str);
+  return true;
+}
+
 std::ostream& operator<<(std::ostream& o, const PointsToMethodSemantics& s) {
   o << s.m_dex_method->get_class()->get_name()->str() << "#"
     << s.m_dex_method->get_name()->str() << ": "
@@ -1585,13 +1949,33 @@ void PointsToSemantics::load_stubs(const std::string& file_name) {
     auto semantics_opt = PointsToMethodSemantics::from_s_expr(expr);
     always_assert_log(
         semantics_opt, "Couldn't parse S-expression: %s\n", expr.str().c_str());
-    DexMethodRef* dex_method = semantics_opt->get_method();
-    auto it = m_method_semantics.find(dex_method);
-    if (it == m_method_semantics.end()) {
-      m_method_semantics.emplace(dex_method, *semantics_opt);
-    } else {
-      TRACE(PTA, 2, "Collision with stub for method %s", SHOW(dex_method));
-    }
+    add_stub(*semantics_opt);
+  }
+}
+
+void PointsToSemantics::load_binary_stubs(const std::string& file_name) {
+  std::ifstream file_input(file_name, std::ios::binary);
+  always_assert_log(file_input, "Couldn't open %s\n", file_name.c_str());
+  PointsToBinaryReader reader(file_input);
+  while (auto semantics_opt = reader.read()) {
+    add_stub(*semantics_opt);
+  }
+}
+
+void PointsToSemantics::write_binary(std::ostream& out) const {
+  PointsToBinaryWriter writer(out);
+  for (const auto& entry : m_method_semantics) {
+    writer.write(entry.second);
+  }
+}
+
+void PointsToSemantics::add_stub(const PointsToMethodSemantics& semantics) {
+  DexMethodRef* dex_method = semantics.get_method();
+  auto it = m_method_semantics.find(dex_method);
+  if (it == m_method_semantics.end()) {
+    m_method_semantics.emplace(dex_method, semantics);
+  } else {
+    TRACE(PTA, 2, "Collision with stub for method %s", SHOW(dex_method));
   }
 }
 
@@ -10,7 +10,9 @@
 #include <bitset>
 #include <cstdint>
 #include <initializer_list>
+#include <istream>
 #include <ostream>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -94,6 +96,53 @@
 
 // Forward declaration.
 class PointsToSemantics;
+class PointsToMethodSemantics;
+
+/*
+ * A compact binary alternative to the S-expression form of the points-to
+ * semantics, for when the semantics of a whole program are written out. All
+ * integers are LEB128 varints (zigzag-encoded when they can be negative), and
+ * each string is written out in full the first time only, after which it is
+ * referred to by its index in a string table that the reader rebuilds as it
+ * goes. A stream can thus be read one method at a time.
+ */
+class PointsToBinaryWriter final {
+ public:
+  explicit PointsToBinaryWriter(std::ostream& out);
+
+  void write(const PointsToMethodSemantics& semantics);
+
+  void write_uint(uint64_t value);
+
+  void write_int(int64_t value);
+
+  void write_string(const std::string& str);
+
+ private:
+  std::ostream& m_out;
+  std::unordered_map<std::string, uint64_t> m_string_ids;
+};
+
+class PointsToBinaryReader final {
+ public:
+  explicit PointsToBinaryReader(std::istream& in);
+
+  /*
+   * Returns the next method in the stream, or none at the end of the stream.
+   * Malformed input is a fatal error.
+   */
+  boost::optional<PointsToMethodSemantics> read();
+
+  bool read_uint(uint64_t* value);
+
+  bool read_int(int64_t* value);
+
+  bool read_string(std::string* str);
+
+ private:
+  std::istream& m_in;
+  std::vector<std::string> m_strings;
+};
 
 /*
  * A points-to variable denotes a set of abstract object instances. It is
@@ -120,6 +169,11 @@ class PointsToVariable final {
 
   static boost::optional<PointsToVariable> from_s_expr(const sparta::s_expr& e);
 
+  void to_binary(PointsToBinaryWriter* writer) const;
+
+  static boost::optional<PointsToVariable> from_binary(
+      PointsToBinaryReader* reader);
+
  private:
   static constexpr int32_t null_var_id() { return -1; }
 
@@ -296,6 +350,11 @@ struct PointsToOperation {
 
   static boost::optional<PointsToOperation> from_s_expr(
       const sparta::s_expr& e);
+
+  void to_binary(PointsToBinaryWriter* writer) const;
+
+  static boost::optional<PointsToOperation> from_binary(
+      PointsToBinaryReader* reader);
 };
 
 /*
@@ -395,6 +454,11 @@ class PointsToAction final {
 
   static boost::optional<PointsToAction> from_s_expr(const sparta::s_expr& e);
 
+  void to_binary(PointsToBinaryWriter* writer) const;
+
+  static boost::optional<PointsToAction> from_binary(
+      PointsToBinaryReader* reader);
+
  private:
   static constexpr int32_t lhs_key() { return -1; }
   static constexpr int32_t rhs_key() { return -2; }
@@ -479,6 +543,11 @@ class PointsToMethodSemantics {
   static boost::optional<PointsToMethodSemantics> from_s_expr(
       const sparta::s_expr& e);
 
+  void to_binary(PointsToBinaryWriter* writer) const;
+
+  static boost::optional<PointsToMethodSemantics> from_binary(
+      PointsToBinaryReader* reader);
+
  private:
   DexMethodRef* m_dex_method;
   MethodKind m_kind;
@@ -528,6 +597,16 @@ class PointsToSemantics final {
    */
   void load_stubs(const std::string& file_name);
 
+  /*
+   * The same, for stubs stored in the binary format of PointsToBinaryWriter.
+   */
+  void load_binary_stubs(const std::string& file_name);
+
+  /*
+   * Writes the semantics of all the methods in the binary format.
+   */
+  void write_binary(std::ostream& out) const;
+
   iterator begin() { return m_method_semantics.begin(); }
 
   iterator end() { return m_method_semantics.end(); }
@@ -544,6 +623,8 @@ class PointsToSemantics final {
 
   void generate_points_to_actions(DexMethod* dex_method);
 
+  void add_stub(const PointsToMethodSemantics& semantics);
+
   bool m_generate_stubs;
   TypeSystem m_type_system;
   PointsToSemanticsUtils m_utils;
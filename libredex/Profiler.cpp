@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <json/json.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#endif
+
+#include "Debug.h"
+#include "JemallocUtil.h"
+
+namespace profiler {
+
+namespace impl {
+std::atomic<bool> s_enabled{false};
+} // namespace impl
+
+namespace {
+
+struct Event {
+  std::string name;
+  uint64_t start_us;
+  uint64_t dur_us;
+  uint64_t cpu_us;
+  uint64_t allocated;
+};
+
+struct ThreadBuffer {
+  uint32_t tid;
+  std::vector<Event> events;
+};
+
+// Buffers outlive their threads; they are only ever appended to by the thread
+// that owns them.
+std::mutex s_buffers_lock;
+std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+
+const auto s_epoch = std::chrono::steady_clock::now();
+
+thread_local ThreadBuffer* t_buffer{nullptr};
+thread_local const Span* t_innermost{nullptr};
+thread_local uint64_t* t_allocated{nullptr};
+thread_local bool t_allocated_initialized{false};
+
+ThreadBuffer& local_buffer() {
+  if (t_buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(s_buffers_lock);
+    s_buffers.push_back(std::make_unique<ThreadBuffer>());
+    s_buffers.back()->tid = s_buffers.size() - 1;
+    t_buffer = s_buffers.back().get();
+  }
+  return *t_buffer;
+}
+
+uint64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - s_epoch)
+      .count();
+}
+
+uint64_t thread_cpu_us() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+  return 0;
+#endif
+}
+
+uint64_t thread_allocated() {
+  if (!t_allocated_initialized) {
+    t_allocated = jemalloc_util::thread_allocated_counter();
+    t_allocated_initialized = true;
+  }
+  return t_allocated != nullptr ? *t_allocated : 0;
+}
+
+} // namespace
+
+void set_enabled(bool enabled) { impl::s_enabled.store(enabled); }
+
+void Span::begin(std::string name) {
+  m_active = true;
+  m_name = std::move(name);
+  m_parent = t_innermost;
+  t_innermost = this;
+  m_start_allocated = thread_allocated();
+  m_start_cpu_us = thread_cpu_us();
+  m_start_us = now_us();
+}
+
+void Span::end() {
+  auto end_us = now_us();
+  auto end_cpu_us = thread_cpu_us();
+  auto end_allocated = thread_allocated();
+  t_innermost = m_parent;
+  local_buffer().events.push_back(Event{std::move(m_name), m_start_us,
+                                        end_us - m_start_us,
+                                        end_cpu_us - m_start_cpu_us,
+                                        end_allocated - m_start_allocated});
+}
+
+std::string current_span_name() {
+  if (t_innermost == nullptr) {
+    return "";
+  }
+  return t_innermost->m_name;
+}
+
+void write_chrome_trace(std::ostream& os) {
+  Json::Value events(Json::arrayValue);
+  std::lock_guard<std::mutex> lock(s_buffers_lock);
+  for (const auto& buffer : s_buffers) {
+    Json::Value meta;
+    meta["ph"] = "M";
+    meta["name"] = "thread_name";
+    meta["pid"] = 0;
+    meta["tid"] = buffer->tid;
+    meta["args"]["name"] =
+        buffer->tid == 0 ? "main" : "thread " + std::to_string(buffer->tid);
+    events.append(meta);
+    for (const auto& event : buffer->events) {
+      Json::Value e;
+      e["ph"] = "X";
+      e["name"] = event.name;
+      e["pid"] = 0;
+      e["tid"] = buffer->tid;
+      e["ts"] = Json::UInt64(event.start_us);
+      e["dur"] = Json::UInt64(event.dur_us);
+      e["args"]["cpu_ms"] = double(event.cpu_us) / 1000;
+      if (event.dur_us > 0) {
+        e["args"]["cpu_utilization"] = double(event.cpu_us) / event.dur_us;
+      }
+      if (event.allocated > 0) {
+        e["args"]["allocated_kb"] = Json::UInt64(event.allocated / 1024);
+      }
+      events.append(e);
+    }
+  }
+  Json::Value root;
+  root["traceEvents"] = events;
+  root["displayTimeUnit"] = "ms";
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+  writer->write(root, &os);
+}
+
+void write_chrome_trace(const std::string& path) {
+  std::ofstream os(path);
+  always_assert_log(os, "Could not open %s for writing", path.c_str());
+  write_chrome_trace(os);
+}
+
+} // namespace profiler
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * A low-overhead, hierarchical profiler.
+ *
+ * A profiler::Span covers the lifetime of a scope, like a Timer. When
+ * profiling is enabled each span records its thread, wall-clock start and
+ * duration, the CPU time its thread spent in it, and -- under jemalloc -- the
+ * bytes its thread allocated in it. Spans nest naturally per thread.
+ *
+ * Events go into per-thread buffers without any locking, so spans can stay in
+ * production code; when profiling is disabled a span costs one relaxed atomic
+ * load.
+ *
+ * The result can be written out in Chrome's trace_event format and loaded
+ * into chrome://tracing or Perfetto. Every Timer is also a span, and every
+ * WorkQueue worker records a span named after the innermost span of the
+ * thread that started the queue, so each parallel region shows how busy
+ * each thread was.
+ */
+namespace profiler {
+
+namespace impl {
+extern std::atomic<bool> s_enabled;
+} // namespace impl
+
+inline bool is_enabled() {
+  return impl::s_enabled.load(std::memory_order_relaxed);
+}
+
+void set_enabled(bool enabled);
+
+/*
+ * The name of the innermost open span on the calling thread, or the empty
+ * string.
+ */
+std::string current_span_name();
+
+/*
+ * Writes every span recorded so far as Chrome trace_event JSON. Must not be
+ * called while other threads are still opening or closing spans.
+ */
+void write_chrome_trace(std::ostream& os);
+void write_chrome_trace(const std::string& path);
+
+class Span {
+ public:
+  explicit Span(std::string name) {
+    if (is_enabled()) {
+      begin(std::move(name));
+    }
+  }
+
+  ~Span() {
+    if (m_active) {
+      end();
+    }
+  }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+ private:
+  friend std::string current_span_name();
+
+  void begin(std::string name);
+  void end();
+
+  bool m_active{false};
+  std::string m_name;
+  uint64_t m_start_us{0};
+  uint64_t m_start_cpu_us{0};
+  uint64_t m_start_allocated{0};
+  const Span* m_parent{nullptr};
+};
+
+} // namespace profiler
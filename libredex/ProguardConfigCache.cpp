@@ -0,0 +1,392 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ProguardConfigCache.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "ProguardParser.h"
+#include "Sha1.h"
+#include "Timer.h"
+#include "Trace.h"
+
+namespace redex {
+namespace proguard_parser {
+
+namespace {
+
+constexpr char kMagic[8] = {'R', 'X', 'P', 'G', 'C', 'F', 'G', '\0'};
+// Bump whenever ProguardConfiguration, the parser or this format changes.
+constexpr uint32_t kVersion = 1;
+
+class Writer {
+ public:
+  explicit Writer(std::ostream& out) : m_out(out) {}
+
+  void u32(uint32_t v) { m_out.write(reinterpret_cast<const char*>(&v), 4); }
+
+  void boolean(bool b) { u32(b ? 1 : 0); }
+
+  void flags(DexAccessFlags flags) { u32(static_cast<uint32_t>(flags)); }
+
+  void str(const std::string& s) {
+    u32(s.size());
+    m_out.write(s.data(), s.size());
+  }
+
+  template <typename Container>
+  void strs(const Container& strs) {
+    u32(strs.size());
+    for (const auto& s : strs) {
+      str(s);
+    }
+  }
+
+  void member(const MemberSpecification& spec) {
+    flags(spec.requiredSetAccessFlags);
+    flags(spec.requiredUnsetAccessFlags);
+    str(spec.annotationType);
+    str(spec.name);
+    str(spec.descriptor);
+  }
+
+  void members(const std::vector<MemberSpecification>& specs) {
+    u32(specs.size());
+    for (const auto& spec : specs) {
+      member(spec);
+    }
+  }
+
+  void keep(const KeepSpec& spec) {
+    boolean(spec.includedescriptorclasses);
+    boolean(spec.allowshrinking);
+    boolean(spec.allowoptimization);
+    boolean(spec.allowobfuscation);
+    boolean(spec.mark_classes);
+    boolean(spec.mark_conditionally);
+    const auto& cs = spec.class_spec;
+    flags(cs.setAccessFlags);
+    flags(cs.unsetAccessFlags);
+    str(cs.annotationType);
+    str(cs.className);
+    str(cs.extendsAnnotationType);
+    str(cs.extendsClassName);
+    members(cs.fieldSpecifications);
+    members(cs.methodSpecifications);
+    str(spec.source_filename);
+    u32(spec.source_line);
+  }
+
+  void keeps(const KeepSpecSet& specs) {
+    u32(specs.size());
+    for (const auto* spec : specs) {
+      keep(*spec);
+    }
+  }
+
+ private:
+  std::ostream& m_out;
+};
+
+class Reader {
+ public:
+  explicit Reader(std::istream& in) : m_in(in) {}
+
+  bool ok() const { return static_cast<bool>(m_in); }
+
+  uint32_t u32() {
+    uint32_t v = 0;
+    m_in.read(reinterpret_cast<char*>(&v), 4);
+    return v;
+  }
+
+  bool boolean() { return u32() != 0; }
+
+  DexAccessFlags flags() { return static_cast<DexAccessFlags>(u32()); }
+
+  std::string str() {
+    auto size = u32();
+    std::string s;
+    // Guard against allocating for a truncated or corrupted file.
+    if (!ok() || size > kMaxStringSize) {
+      m_in.setstate(std::ios::failbit);
+      return s;
+    }
+    s.resize(size);
+    m_in.read(&s[0], size);
+    return s;
+  }
+
+  template <typename Container>
+  void strs(Container* strs) {
+    auto size = u32();
+    for (uint32_t i = 0; i < size && ok(); ++i) {
+      strs->insert(strs->end(), str());
+    }
+  }
+
+  void members(std::vector<MemberSpecification>* specs) {
+    auto size = u32();
+    for (uint32_t i = 0; i < size && ok(); ++i) {
+      MemberSpecification spec;
+      spec.requiredSetAccessFlags = flags();
+      spec.requiredUnsetAccessFlags = flags();
+      spec.annotationType = str();
+      spec.name = str();
+      spec.descriptor = str();
+      specs->push_back(std::move(spec));
+    }
+  }
+
+  std::unique_ptr<KeepSpec> keep() {
+    auto spec = std::make_unique<KeepSpec>();
+    spec->includedescriptorclasses = boolean();
+    spec->allowshrinking = boolean();
+    spec->allowoptimization = boolean();
+    spec->allowobfuscation = boolean();
+    spec->mark_classes = boolean();
+    spec->mark_conditionally = boolean();
+    auto& cs = spec->class_spec;
+    cs.setAccessFlags = flags();
+    cs.unsetAccessFlags = flags();
+    cs.annotationType = str();
+    cs.className = str();
+    cs.extendsAnnotationType = str();
+    cs.extendsClassName = str();
+    members(&cs.fieldSpecifications);
+    members(&cs.methodSpecifications);
+    spec->source_filename = str();
+    spec->source_line = u32();
+    return spec;
+  }
+
+  void keeps(KeepSpecSet* specs) {
+    auto size = u32();
+    for (uint32_t i = 0; i < size && ok(); ++i) {
+      specs->emplace(keep());
+    }
+  }
+
+ private:
+  static constexpr uint32_t kMaxStringSize = 1 << 30;
+  std::istream& m_in;
+};
+
+std::string file_sha1(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return "";
+  }
+  Sha1Context context;
+  sha1_init(&context);
+  char buf[1 << 16];
+  while (in) {
+    in.read(buf, sizeof(buf));
+    sha1_update(&context, reinterpret_cast<unsigned char*>(buf), in.gcount());
+  }
+  unsigned char digest[20];
+  sha1_final(digest, &context);
+  std::ostringstream ss;
+  for (auto byte : digest) {
+    ss << std::hex << std::setw(2) << std::setfill('0') << unsigned(byte);
+  }
+  return ss.str();
+}
+
+std::string string_sha1(const std::string& str) {
+  Sha1Context context;
+  sha1_init(&context);
+  sha1_update(&context, reinterpret_cast<const unsigned char*>(str.data()),
+              str.size());
+  unsigned char digest[20];
+  sha1_final(digest, &context);
+  std::ostringstream ss;
+  for (auto byte : digest) {
+    ss << std::hex << std::setw(2) << std::setfill('0') << unsigned(byte);
+  }
+  return ss.str();
+}
+
+// Where parse_file() finds `filename`.
+std::string resolve(const std::string& filename,
+                    const std::string& basedirectory) {
+  if (boost::filesystem::exists(filename)) {
+    return filename;
+  }
+  return basedirectory + "/" + filename;
+}
+
+// A cache entry starts with the files its configuration was parsed from and
+// their hashes, so that a change to an included file is noticed too.
+using FileHashes = std::vector<std::pair<std::string, std::string>>;
+
+bool up_to_date(const FileHashes& files) {
+  for (const auto& file : files) {
+    if (file_sha1(file.first) != file.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+void serialize(const ProguardConfiguration& pg_config, std::ostream& out) {
+  Writer w(out);
+  out.write(kMagic, sizeof(kMagic));
+  w.u32(kVersion);
+  w.boolean(pg_config.ok);
+  w.strs(pg_config.includes);
+  w.strs(pg_config.already_included);
+  w.str(pg_config.basedirectory);
+  w.strs(pg_config.injars);
+  w.strs(pg_config.outjars);
+  w.strs(pg_config.libraryjars);
+  w.strs(pg_config.printmapping);
+  w.strs(pg_config.printconfiguration);
+  w.strs(pg_config.printseeds);
+  w.strs(pg_config.printusage);
+  w.strs(pg_config.keepdirectories);
+  w.boolean(pg_config.shrink);
+  w.boolean(pg_config.optimize);
+  w.boolean(pg_config.allowaccessmodification);
+  w.boolean(pg_config.dontobfuscate);
+  w.boolean(pg_config.dontusemixedcaseclassnames);
+  w.boolean(pg_config.dontpreverify);
+  w.boolean(pg_config.verbose);
+  w.str(pg_config.target_version);
+  w.keeps(pg_config.keep_rules);
+  w.keeps(pg_config.assumenosideeffects_rules);
+  w.keeps(pg_config.whyareyoukeeping_rules);
+  w.strs(pg_config.optimization_filters);
+  w.strs(pg_config.keepattributes);
+  w.strs(pg_config.dontwarn);
+  w.strs(pg_config.keeppackagenames);
+}
+
+bool deserialize(std::istream& in, ProguardConfiguration* pg_config) {
+  char magic[sizeof(kMagic)];
+  in.read(magic, sizeof(magic));
+  if (!in || !std::equal(magic, magic + sizeof(magic), kMagic)) {
+    return false;
+  }
+  Reader r(in);
+  if (r.u32() != kVersion) {
+    return false;
+  }
+  pg_config->ok = r.boolean();
+  r.strs(&pg_config->includes);
+  r.strs(&pg_config->already_included);
+  pg_config->basedirectory = r.str();
+  r.strs(&pg_config->injars);
+  r.strs(&pg_config->outjars);
+  r.strs(&pg_config->libraryjars);
+  r.strs(&pg_config->printmapping);
+  r.strs(&pg_config->printconfiguration);
+  r.strs(&pg_config->printseeds);
+  r.strs(&pg_config->printusage);
+  r.strs(&pg_config->keepdirectories);
+  pg_config->shrink = r.boolean();
+  pg_config->optimize = r.boolean();
+  pg_config->allowaccessmodification = r.boolean();
+  pg_config->dontobfuscate = r.boolean();
+  pg_config->dontusemixedcaseclassnames = r.boolean();
+  pg_config->dontpreverify = r.boolean();
+  pg_config->verbose = r.boolean();
+  pg_config->target_version = r.str();
+  r.keeps(&pg_config->keep_rules);
+  r.keeps(&pg_config->assumenosideeffects_rules);
+  r.keeps(&pg_config->whyareyoukeeping_rules);
+  r.strs(&pg_config->optimization_filters);
+  r.strs(&pg_config->keepattributes);
+  r.strs(&pg_config->dontwarn);
+  r.strs(&pg_config->keeppackagenames);
+  return r.ok();
+}
+
+void parse_files_cached(const std::vector<std::string>& filenames,
+                        const std::string& cache_dir,
+                        ProguardConfiguration* pg_config) {
+  Timer t("Parsed ProGuard config files");
+  // The entry is named after the top-level files; their includes are only
+  // known once they have been parsed.
+  std::string names;
+  for (const auto& filename : filenames) {
+    names += resolve(filename, pg_config->basedirectory) + '\0' +
+             file_sha1(resolve(filename, pg_config->basedirectory)) + '\0';
+  }
+  boost::filesystem::create_directories(cache_dir);
+  auto entry = (boost::filesystem::path(cache_dir) /
+                ("proguard-" + string_sha1(names) + ".bin"))
+                   .string();
+
+  {
+    std::ifstream in(entry, std::ios::binary);
+    if (in) {
+      Reader r(in);
+      FileHashes files;
+      auto size = r.u32();
+      for (uint32_t i = 0; i < size && r.ok(); ++i) {
+        auto path = r.str();
+        auto hash = r.str();
+        files.emplace_back(std::move(path), std::move(hash));
+      }
+      if (r.ok() && up_to_date(files)) {
+        // Check the whole configuration before touching `pg_config`.
+        std::string blob((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+        ProguardConfiguration cached;
+        std::istringstream check(blob);
+        if (deserialize(check, &cached)) {
+          TRACE(PGR, 1, "Loaded ProGuard configuration from %s",
+                entry.c_str());
+          std::istringstream load(blob);
+          deserialize(load, pg_config);
+          return;
+        }
+      }
+    }
+  }
+
+  for (const auto& filename : filenames) {
+    parse_file(filename, pg_config);
+  }
+  if (!pg_config->ok) {
+    return;
+  }
+
+  FileHashes files;
+  for (const auto& filename : filenames) {
+    files.emplace_back(resolve(filename, pg_config->basedirectory), "");
+  }
+  for (const auto& filename : pg_config->already_included) {
+    files.emplace_back(resolve(filename, pg_config->basedirectory), "");
+  }
+  for (auto& file : files) {
+    file.second = file_sha1(file.first);
+  }
+  // Write a copy and rename it into place, so that an interrupted run never
+  // leaves a partial entry behind.
+  auto tmp = entry + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    Writer w(out);
+    w.u32(files.size());
+    for (const auto& file : files) {
+      w.str(file.first);
+      w.str(file.second);
+    }
+    serialize(*pg_config, out);
+  }
+  boost::filesystem::rename(tmp, entry);
+}
+
+} // namespace proguard_parser
+} // namespace redex
@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "ProguardConfiguration.h"
+
+namespace redex {
+namespace proguard_parser {
+
+/*
+ * Same as calling parse_file() on each of `filenames` in order, except that
+ * the parsed configuration is kept in `cache_dir` in a binary form. When none
+ * of the files that were read last time, includes and all, has changed, the
+ * configuration is loaded from there without lexing or parsing anything.
+ */
+void parse_files_cached(const std::vector<std::string>& filenames,
+                        const std::string& cache_dir,
+                        ProguardConfiguration* pg_config);
+
+/*
+ * The binary form. deserialize() returns false, leaving `pg_config` in an
+ * unspecified state, if `in` does not hold a configuration written by this
+ * version of serialize().
+ */
+void serialize(const ProguardConfiguration& pg_config, std::ostream& out);
+bool deserialize(std::istream& in, ProguardConfiguration* pg_config);
+
+} // namespace proguard_parser
+} // namespace redex
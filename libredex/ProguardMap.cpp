@@ -7,6 +7,12 @@
 
 #include "ProguardMap.h"
 
+#include <algorithm>
+#include <atomic>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <fstream>
+
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "Timer.h"
@@ -153,8 +159,100 @@ bool is_maybe_proguard_generated_member(const std::string& s) {
 }
 } // namespace
 
-ProguardMap::ProguardMap(const std::string& filename) {
+/*
+ * The class lines of a mapped file, sorted by original and by obfuscated
+ * name. Names are kept as offsets into the file, in its dotted form.
+ */
+struct ProguardMap::Index {
+  struct Class {
+    // The class's member lines.
+    uint64_t begin;
+    uint64_t end;
+    uint64_t old_name;
+    uint64_t new_name;
+    uint32_t old_size;
+    uint32_t new_size;
+  };
+
+  boost::iostreams::mapped_file_source file;
+  std::vector<Class> classes;
+  std::vector<uint32_t> by_old_name;
+  std::vector<uint32_t> by_new_name;
+  // Tells the block caches of different maps apart.
+  uint64_t id;
+
+  std::pair<const char*, size_t> name(uint32_t i, bool obfuscated) const {
+    const auto& cls = classes[i];
+    return obfuscated ? std::make_pair(file.data() + cls.new_name,
+                                       size_t(cls.new_size))
+                      : std::make_pair(file.data() + cls.old_name,
+                                       size_t(cls.old_size));
+  }
+
+  static int compare(std::pair<const char*, size_t> a,
+                     std::pair<const char*, size_t> b) {
+    int c = memcmp(a.first, b.first, std::min(a.second, b.second));
+    if (c != 0) {
+      return c;
+    }
+    return a.second < b.second ? -1 : (a.second > b.second ? 1 : 0);
+  }
+
+  void sort() {
+    for (auto* order : {&by_old_name, &by_new_name}) {
+      bool obfuscated = order == &by_new_name;
+      order->resize(classes.size());
+      for (uint32_t i = 0; i < classes.size(); ++i) {
+        (*order)[i] = i;
+      }
+      // Stable, so that the last of several lines for one class sorts last.
+      std::stable_sort(
+          order->begin(), order->end(), [&](uint32_t a, uint32_t b) {
+            return compare(name(a, obfuscated), name(b, obfuscated)) < 0;
+          });
+    }
+  }
+
+  // Like the parsed maps, the last line for a class wins.
+  const Class* find(const std::string& descriptor, bool obfuscated) const {
+    if (descriptor.size() < 2 || descriptor.front() != 'L' ||
+        descriptor.back() != ';') {
+      return nullptr;
+    }
+    std::string dotted = descriptor.substr(1, descriptor.size() - 2);
+    std::replace(dotted.begin(), dotted.end(), '/', '.');
+    auto key = std::make_pair(dotted.data(), dotted.size());
+    const auto& order = obfuscated ? by_new_name : by_old_name;
+    auto it = std::upper_bound(
+        order.begin(), order.end(), key,
+        [&](std::pair<const char*, size_t> k, uint32_t i) {
+          return compare(k, name(i, obfuscated)) < 0;
+        });
+    if (it == order.begin() || compare(key, name(*(it - 1), obfuscated))) {
+      return nullptr;
+    }
+    return &classes[*(it - 1)];
+  }
+};
+
+namespace {
+
+std::atomic<uint64_t> s_next_index_id{1};
+
+std::string member_class(const std::string& member) {
+  auto end = member.find(";.");
+  return end == std::string::npos ? "" : member.substr(0, end + 1);
+}
+
+} // namespace
+
+ProguardMap::ProguardMap(const std::string& filename, bool use_index) {
   if (!filename.empty()) {
+    if (use_index) {
+      Timer t("Indexing proguard map");
+      index_proguard_map(filename);
+      return;
+    }
     Timer t("Parsing proguard map");
     std::ifstream fp(filename);
     always_assert_log(fp, "Can't open proguard map: %s\n", filename.c_str());
@@ -162,48 +260,193 @@ ProguardMap::ProguardMap(const std::string& filename) {
   }
 }
 
+ProguardMap::ProguardMap(std::istream& is) { parse_proguard_map(is); }
+
+ProguardMap::~ProguardMap() = default;
+
+bool ProguardMap::empty() const {
+  if (m_index) {
+    return m_index->classes.empty();
+  }
+  return m_maps.classMap.empty() && m_maps.fieldMap.empty() &&
+         m_maps.methodMap.empty();
+}
+
+void ProguardMap::index_proguard_map(const std::string& filename) {
+  m_index = std::make_unique<Index>();
+  m_index->id = s_next_index_id++;
+  auto& file = m_index->file;
+  try {
+    file.open(filename);
+  } catch (const std::exception&) {
+    always_assert_log(false, "Can't open proguard map: %s\n",
+                      filename.c_str());
+  }
+  const char* data = file.data();
+  const uint64_t size = file.size();
+  // Field lines that may hold coalesced interfaces, and their classes. They
+  // can only be parsed once every class is known.
+  std::vector<std::pair<uint64_t, uint32_t>> special_fields;
+  uint64_t pos = 0;
+  while (pos < size) {
+    auto nl = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+    uint64_t end = nl ? nl - data : size;
+    char first = data[pos];
+    if (!isspace(first) && first != '#') {
+      std::string line(data + pos, end - pos);
+      std::string classname;
+      std::string newname;
+      auto p = line.c_str();
+      if (id(p, classname) && literal(p, " -> ") && id(p, newname)) {
+        if (!m_index->classes.empty()) {
+          m_index->classes.back().end = pos;
+        }
+        auto old_name = line.find(classname);
+        auto new_name = line.find(newname, old_name + classname.size() + 4);
+        m_index->classes.push_back(Index::Class{
+            end + 1, size, pos + old_name, pos + new_name,
+            uint32_t(classname.size()), uint32_t(newname.size())});
+      }
+    } else if (!m_index->classes.empty()) {
+      // Only a member name ending in $ and 8 hex digits can be one of
+      // ProGuard's.
+      auto arrow = std::search(data + pos, data + end, " -> ", " -> " + 4);
+      if (arrow - (data + pos) > 9 && arrow[-9] == '$' &&
+          std::all_of(arrow - 8, arrow, [](char c) { return isxdigit(c); })) {
+        special_fields.emplace_back(pos, m_index->classes.size() - 1);
+      }
+    }
+    pos = end + 1;
+  }
+  m_index->sort();
+
+  for (const auto& field : special_fields) {
+    const auto& cls = m_index->classes[field.second];
+    ParseState state;
+    state.currClass = convert_type(std::string(data + cls.old_name,
+                                               cls.old_size));
+    state.currNewClass = convert_type(std::string(data + cls.new_name,
+                                                  cls.new_size));
+    auto nl = static_cast<const char*>(
+        memchr(data + field.first, '\n', size - field.first));
+    std::string line(data + field.first,
+                     (nl ? nl - data : size) - field.first);
+    Maps scratch;
+    if (parse_field(line, state, scratch, true)) {
+      m_maps.pg_coalesced_interfaces.insert(
+          scratch.pg_coalesced_interfaces.begin(),
+          scratch.pg_coalesced_interfaces.end());
+    }
+  }
+}
+
+const ProguardMap::Maps* ProguardMap::member_maps(const std::string& member,
+                                                  bool obfuscated) const {
+  if (!m_index) {
+    return &m_maps;
+  }
+  const auto* cls = m_index->find(member_class(member), obfuscated);
+  if (cls == nullptr) {
+    return nullptr;
+  }
+  struct Block {
+    uint64_t index_id{0};
+    const Index::Class* cls{nullptr};
+    Maps maps;
+  };
+  thread_local Block block;
+  if (block.index_id == m_index->id && block.cls == cls) {
+    return &block.maps;
+  }
+  block.index_id = m_index->id;
+  block.cls = cls;
+  block.maps = Maps();
+  const char* data = m_index->file.data();
+  ParseState state;
+  state.currClass = convert_type(std::string(data + cls->old_name,
+                                             cls->old_size));
+  state.currNewClass = convert_type(std::string(data + cls->new_name,
+                                                cls->new_size));
+  uint64_t pos = cls->begin;
+  while (pos < cls->end) {
+    auto nl = static_cast<const char*>(
+        memchr(data + pos, '\n', cls->end - pos));
+    uint64_t end = nl ? nl - data : cls->end;
+    std::string line(data + pos, end - pos);
+    pos = end + 1;
+    if (parse_field(line, state, block.maps, false) ||
+        parse_method(line, state, block.maps) || comment(line) ||
+        line.empty()) {
+      continue;
+    }
+    always_assert_log(false,
+                      "Bogus line encountered in proguard map: %s\n",
+                      line.c_str());
+  }
+  return &block.maps;
+}
+
 std::string ProguardMap::translate_class(const std::string& cls) const {
-  return find_or_same(cls, m_classMap);
+  if (m_index) {
+    const auto* entry = m_index->find(cls, false);
+    if (entry == nullptr) return cls;
+    return convert_type(std::string(m_index->file.data() + entry->new_name,
+                                    entry->new_size));
+  }
+  return find_or_same(cls, m_maps.classMap);
 }
 
 std::string ProguardMap::translate_field(const std::string& field) const {
-  return find_or_same(field, m_fieldMap);
+  const auto* maps = member_maps(field, false);
+  return maps ? find_or_same(field, maps->fieldMap) : field;
 }
 
 std::string ProguardMap::translate_method(const std::string& method) const {
-  return find_or_same(method, m_methodMap);
+  const auto* maps = member_maps(method, false);
+  return maps ? find_or_same(method, maps->methodMap) : method;
 }
 
 std::string ProguardMap::deobfuscate_class(const std::string& cls) const {
-  return find_or_same(cls, m_obfClassMap);
+  if (m_index) {
+    const auto* entry = m_index->find(cls, true);
+    if (entry == nullptr) return cls;
+    return convert_type(std::string(m_index->file.data() + entry->old_name,
+                                    entry->old_size));
+  }
+  return find_or_same(cls, m_maps.obfClassMap);
 }
 
 std::string ProguardMap::deobfuscate_field(const std::string& field) const {
-  return find_or_same(field, m_obfFieldMap);
+  const auto* maps = member_maps(field, true);
+  return maps ? find_or_same(field, maps->obfFieldMap) : field;
 }
 
 std::string ProguardMap::deobfuscate_method(const std::string& method) const {
-  return find_or_same(method, m_obfMethodMap);
+  const auto* maps = member_maps(method, true);
+  return maps ? find_or_same(method, maps->obfMethodMap) : method;
 }
 
 std::vector<ProguardMap::Frame> ProguardMap::deobfuscate_frame(
     DexString* method_name, uint32_t line) const {
   std::vector<Frame> frames;
-  auto ranges_it =
-      m_obfMethodLinesMap.find(pg_impl::lines_key(method_name->str()));
-  if (ranges_it != m_obfMethodLinesMap.end()) {
-    for (const auto& range : ranges_it->second) {
-      if (!range->matches(line)) {
-        continue;
+  const auto* maps = member_maps(method_name->str(), true);
+  if (maps != nullptr) {
+    auto ranges_it =
+        maps->obfMethodLinesMap.find(pg_impl::lines_key(method_name->str()));
+    if (ranges_it != maps->obfMethodLinesMap.end()) {
+      for (const auto& range : ranges_it->second) {
+        if (!range->matches(line)) {
+          continue;
+        }
+        auto new_line = line;
+        if (range->remaps_to_single_line()) {
+          new_line = range->original_start;
+        } else if (range->remaps_to_range()) {
+          new_line = range->original_start + line - range->start;
+        }
+        frames.emplace_back(DexString::make_string(range->original_name),
+                            new_line);
       }
-      auto new_line = line;
-      if (range->remaps_to_single_line()) {
-        new_line = range->original_start;
-      } else if (range->remaps_to_range()) {
-        new_line = range->original_start + line - range->start;
-      }
-      frames.emplace_back(DexString::make_string(range->original_name),
-                          new_line);
     }
   }
 
@@ -215,25 +458,36 @@ std::vector<ProguardMap::Frame> ProguardMap::deobfuscate_frame(
 
 ProguardLineRangeVector& ProguardMap::method_lines(
     const std::string& obfuscated_method) {
-  return m_obfMethodLinesMap.at(pg_impl::lines_key(obfuscated_method));
+  auto key = pg_impl::lines_key(obfuscated_method);
+  if (m_index && !m_maps.obfMethodLinesMap.count(key)) {
+    // Keep a copy that outlives the block cache.
+    const auto* maps = member_maps(obfuscated_method, true);
+    always_assert(maps != nullptr);
+    auto& lines = m_maps.obfMethodLinesMap[key];
+    for (const auto& range : maps->obfMethodLinesMap.at(key)) {
+      lines.push_back(std::make_unique<ProguardLineRange>(*range));
+    }
+  }
+  return m_maps.obfMethodLinesMap.at(key);
 }
 
 void ProguardMap::parse_proguard_map(std::istream& fp) {
   std::string line;
+  ParseState state;
   while (std::getline(fp, line)) {
-    parse_class(line);
+    parse_class(line, state, m_maps);
   }
   fp.clear();
   fp.seekg(0);
   assert_log(!fp.fail(), "Can't use ProguardMap with non-seekable stream");
   while (std::getline(fp, line)) {
-    if (parse_class(line)) {
+    if (parse_class(line, state, m_maps)) {
       continue;
     }
-    if (parse_field(line)) {
+    if (parse_field(line, state, m_maps, true)) {
       continue;
     }
-    if (parse_method(line)) {
+    if (parse_method(line, state, m_maps)) {
       continue;
     }
     if (comment(line)) {
@@ -245,21 +499,26 @@ void ProguardMap::parse_proguard_map(std::istream& fp) {
   }
 }
 
-bool ProguardMap::parse_class(const std::string& line) {
+bool ProguardMap::parse_class(const std::string& line,
+                              ParseState& state,
+                              Maps& maps) {
   std::string classname;
   std::string newname;
   auto p = line.c_str();
   if (!id(p, classname)) return false;
   if (!literal(p, " -> ")) return false;
   if (!id(p, newname)) return false;
-  m_currClass = convert_type(classname);
-  m_currNewClass = convert_type(newname);
-  m_classMap[m_currClass] = m_currNewClass;
-  m_obfClassMap[m_currNewClass] = m_currClass;
+  state.currClass = convert_type(classname);
+  state.currNewClass = convert_type(newname);
+  maps.classMap[state.currClass] = state.currNewClass;
+  maps.obfClassMap[state.currNewClass] = state.currClass;
   return true;
 }
 
-bool ProguardMap::parse_field(const std::string& line) {
+bool ProguardMap::parse_field(const std::string& line,
+                              const ParseState& state,
+                              Maps& maps,
+                              bool record_special_interfaces) const {
   std::string type;
   std::string fieldname;
   std::string newname;
@@ -274,25 +533,29 @@ bool ProguardMap::parse_field(const std::string& line) {
 
   auto ctype = convert_type(type);
   auto xtype = translate_type(ctype, *this);
-  auto pgnew = convert_field(m_currNewClass, xtype, newname);
-  auto pgold = convert_field(m_currClass, ctype, fieldname);
+  auto pgnew = convert_field(state.currNewClass, xtype, newname);
+  auto pgold = convert_field(state.currClass, ctype, fieldname);
   // Record interfaces that are coalesced by Proguard.
   if (ctype[0] == 'L' && is_maybe_proguard_generated_member(fieldname)) {
-    fprintf(stderr,
-            "Type '%s' is touched by Proguard in '%s'\n",
-            ctype.c_str(),
-            pgold.c_str());
-    m_pg_coalesced_interfaces.insert(ctype);
-  }
-  m_fieldMap[pgold] = pgnew;
-  m_obfFieldMap[pgnew] = pgold;
+    if (record_special_interfaces) {
+      fprintf(stderr,
+              "Type '%s' is touched by Proguard in '%s'\n",
+              ctype.c_str(),
+              pgold.c_str());
+    }
+    maps.pg_coalesced_interfaces.insert(ctype);
+  }
+  maps.fieldMap[pgold] = pgnew;
+  maps.obfFieldMap[pgnew] = pgold;
   return true;
 }
 
-bool ProguardMap::parse_method(const std::string& line) {
+bool ProguardMap::parse_method(const std::string& line,
+                               const ParseState& state,
+                               Maps& maps) const {
   std::string type;
   std::string methodname;
-  std::string classname = m_currClass;
+  std::string classname = state.currClass;
   std::string old_args;
   std::string new_args;
   std::string newname;
@@ -333,11 +596,13 @@ bool ProguardMap::parse_method(const std::string& line) {
   auto old_rtype = convert_type(type);
   auto new_rtype = translate_type(old_rtype, *this);
   auto pgold = convert_method(classname, old_rtype, methodname, old_args);
-  auto pgnew = convert_method(m_currNewClass, new_rtype, newname, new_args);
-  m_methodMap[pgold] = pgnew;
-  m_obfMethodMap[pgnew] = pgold;
+  auto pgnew =
+      convert_method(state.currNewClass, new_rtype, newname, new_args);
+  maps.methodMap[pgold] = pgnew;
+  maps.obfMethodMap[pgnew] = pgold;
   lines->original_name = pgold;
-  m_obfMethodLinesMap[pg_impl::lines_key(pgnew)].push_back(std::move(lines));
+  maps.obfMethodLinesMap[pg_impl::lines_key(pgnew)].push_back(
+      std::move(lines));
   return true;
 }
 
@@ -9,6 +9,7 @@
 
 #include <cstddef>
 #include <fstream>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
@@ -37,19 +38,29 @@
  * For classes, this is the full descriptor.
  * For methods, it's <class descriptor>.<name>(<args descs>)<return desc> .
  * For fields,  it's <class descriptor>.<name>:<type desc> .
+ *
+ * Mapping files of large obfuscated apps run into gigabytes, and parsing them
+ * into maps costs several times that in memory. With `use_index`, the file is
+ * mapped instead and only its class lines are indexed, sorted by original and
+ * by obfuscated name. A lookup finds the class's block of member lines through
+ * the index and parses just that block; each thread keeps the last block it
+ * parsed, so looking up the members of one class after another stays cheap.
+ * The one difference: members that the map lists as inlined from another
+ * class (e.g. "1:1:void Other.foo():5:5 -> a") are only found through the
+ * class they were inlined into.
  */
 struct ProguardMap {
   /**
    * Construct map from the given file.
    */
-  explicit ProguardMap(const std::string& filename);
+  explicit ProguardMap(const std::string& filename, bool use_index = false);
 
   /**
    * Construct map from a given stream.
    */
-  explicit ProguardMap(std::istream& is) {
-    parse_proguard_map(is);
-  }
+  explicit ProguardMap(std::istream& is);
+
+  ~ProguardMap();
 
   /**
    * Translate un-obfuscated class name to obfuscated name.
@@ -98,38 +109,58 @@ struct ProguardMap {
    */
   ProguardLineRangeVector& method_lines(const std::string& obfuscated_method);
 
-  bool empty() const { return m_classMap.empty() && m_fieldMap.empty() &&
-                              m_methodMap.empty() ; }
+  bool empty() const;
 
   bool is_special_interface(const std::string& type) const {
-    return m_pg_coalesced_interfaces.find(type) !=
-           m_pg_coalesced_interfaces.end();
+    return m_maps.pg_coalesced_interfaces.find(type) !=
+           m_maps.pg_coalesced_interfaces.end();
   }
 
  private:
+  struct Maps {
+    // Unobfuscated to obfuscated maps
+    std::unordered_map<std::string, std::string> classMap;
+    std::unordered_map<std::string, std::string> fieldMap;
+    std::unordered_map<std::string, std::string> methodMap;
+
+    // Obfuscated to unobfuscated maps from proguard
+    std::unordered_map<std::string, std::string> obfClassMap;
+    std::unordered_map<std::string, std::string> obfFieldMap;
+    std::unordered_map<std::string, std::string> obfMethodMap;
+    std::unordered_map<std::string, ProguardLineRangeVector> obfMethodLinesMap;
+
+    // Interfaces that are (most likely) coalesced by Proguard.
+    std::unordered_set<std::string> pg_coalesced_interfaces;
+  };
+
+  struct Index;
+
+  // The class a member line belongs to.
+  struct ParseState {
+    std::string currClass;
+    std::string currNewClass;
+  };
+
   void parse_proguard_map(std::istream& fp);
+  void index_proguard_map(const std::string& filename);
+
+  bool parse_class(const std::string& line, ParseState& state, Maps& maps);
+  bool parse_field(const std::string& line,
+                   const ParseState& state,
+                   Maps& maps,
+                   bool record_special_interfaces) const;
+  bool parse_method(const std::string& line,
+                    const ParseState& state,
+                    Maps& maps) const;
 
-  bool parse_class(const std::string& line);
-  bool parse_field(const std::string& line);
-  bool parse_method(const std::string& line);
+  // Which maps hold the members of the class named by `member`, obfuscated or
+  // not; nullptr if there is no such class.
+  const Maps* member_maps(const std::string& member, bool obfuscated) const;
 
  private:
-  // Unobfuscated to obfuscated maps
-  std::unordered_map<std::string, std::string> m_classMap;
-  std::unordered_map<std::string, std::string> m_fieldMap;
-  std::unordered_map<std::string, std::string> m_methodMap;
-
-  // Obfuscated to unobfuscated maps from proguard
-  std::unordered_map<std::string, std::string> m_obfClassMap;
-  std::unordered_map<std::string, std::string> m_obfFieldMap;
-  std::unordered_map<std::string, std::string> m_obfMethodMap;
-  std::unordered_map<std::string, ProguardLineRangeVector> m_obfMethodLinesMap;
-
-  // Interfaces that are (most likely) coalesced by Proguard.
-  std::unordered_set<std::string> m_pg_coalesced_interfaces;
-
-  std::string m_currClass;
-  std::string m_currNewClass;
+  // Everything when parsed; only the special interfaces when indexed.
+  Maps m_maps;
+  std::unique_ptr<Index> m_index;
 };
 
 /**
@@ -37,6 +37,29 @@ std::unique_ptr<boost::regex> make_rx(const std::string& s,
   return std::make_unique<boost::regex>(rx);
 }
 
+std::unique_ptr<proguard_parser::ClassNamePattern> make_pattern(
+    const std::string& s) {
+  if (s.empty()) return nullptr;
+  return std::make_unique<proguard_parser::ClassNamePattern>(
+      proguard_parser::convert_wildcard_type(s));
+}
+
+// Only runs the regex when the literal parts of the pattern cannot decide.
+bool match_name_rx(const std::string& name,
+                   const proguard_parser::ClassNamePattern& pattern,
+                   const boost::regex& rx) {
+  using Result = proguard_parser::ClassNamePattern::Result;
+  switch (pattern.match(name)) {
+  case Result::NO_MATCH:
+    return false;
+  case Result::MATCH:
+    return true;
+  case Result::NEEDS_REGEX:
+    return boost::regex_match(name, rx);
+  }
+  not_reached();
+}
+
 bool match_annotation_rx(const DexClass* cls, const boost::regex& annorx) {
   const auto* annos = cls->get_anno_set();
   if (!annos) return false;
@@ -58,8 +81,10 @@ struct ClassMatcher {
         unsetFlags_(ks.class_spec.unsetAccessFlags),
         m_class_name(ks.class_spec.className),
         m_cls(make_rx(ks.class_spec.className)),
+        m_cls_pattern(make_pattern(ks.class_spec.className)),
         m_anno(make_rx(ks.class_spec.annotationType, false)),
         m_extends(make_rx(ks.class_spec.extendsClassName)),
+        m_extends_pattern(make_pattern(ks.class_spec.extendsClassName)),
         m_extends_anno(make_rx(ks.class_spec.extendsAnnotationType, false)) {}
 
   bool match(const DexClass* cls) {
@@ -81,10 +106,15 @@ struct ClassMatcher {
     return match_extends(cls);
   }
 
+  // Every class whose name matches starts with this.
+  std::string class_name_prefix() const {
+    return m_cls_pattern ? m_cls_pattern->prefix() : "";
+  }
+
  private:
   bool match_name(const DexClass* cls) const {
     const auto& deob_name = cls->get_deobfuscated_name();
-    return boost::regex_match(deob_name, *m_cls);
+    return match_name_rx(deob_name, *m_cls_pattern, *m_cls);
   }
 
   bool match_access(const DexClass* cls) const {
@@ -111,7 +141,7 @@ struct ClassMatcher {
       }
     }
     const auto& deob_name = cls->get_deobfuscated_name();
-    return boost::regex_match(deob_name, *m_extends);
+    return match_name_rx(deob_name, *m_extends_pattern, *m_extends);
   }
 
   bool search_interfaces(const DexClass* cls) {
@@ -162,8 +192,10 @@ struct ClassMatcher {
   DexAccessFlags unsetFlags_;
   std::string m_class_name;
   std::unique_ptr<boost::regex> m_cls;
+  std::unique_ptr<proguard_parser::ClassNamePattern> m_cls_pattern;
   std::unique_ptr<boost::regex> m_anno;
   std::unique_ptr<boost::regex> m_extends;
+  std::unique_ptr<proguard_parser::ClassNamePattern> m_extends_pattern;
   std::unique_ptr<boost::regex> m_extends_anno;
 
   std::unordered_map<const DexClass*, bool> m_extends_result_cache;
@@ -187,26 +219,44 @@ std::string to_string(RuleType rule_type) {
 }
 
 /*
- * Build a DAG of class -> subclass and implementors. This is fairly similar to
- * build_type_hierarchy and friends, but Proguard doesn't distinguish between
- * subclasses and interface implementors, so this function combines them
- * together.
+ * The classes of a scope sorted by deobfuscated name. A keep rule only needs
+ * to look at the classes whose names start with the literal prefix of its
+ * class name pattern, and a binary search finds them, the way a walk down a
+ * package trie would.
  */
-void build_extends_or_implements_hierarchy(const Scope& scope,
-                                           ClassHierarchy* hierarchy) {
-  for (const auto& cls : scope) {
-    const auto* type = cls->get_type();
-    // ensure an entry for the DexClass is created
-    (*hierarchy)[type];
-    const auto* super = cls->get_super_class();
-    if (super != nullptr) {
-      (*hierarchy)[super].insert(type);
+class ClassNameIndex {
+ public:
+  explicit ClassNameIndex(const Scope& scope) {
+    m_entries.reserve(scope.size());
+    for (size_t i = 0; i < scope.size(); ++i) {
+      m_entries.emplace_back(&scope[i]->get_deobfuscated_name(), i);
     }
-    for (const auto& impl : cls->get_interfaces()->get_type_list()) {
-      (*hierarchy)[impl].insert(type);
+    std::sort(m_entries.begin(), m_entries.end(),
+              [](const Entry& a, const Entry& b) {
+                return *a.first < *b.first;
+              });
+  }
+
+  // Returns the scope positions of the classes whose names start with
+  // `prefix`, in scope order.
+  std::vector<size_t> with_prefix(const std::string& prefix) const {
+    auto it = std::lower_bound(
+        m_entries.begin(), m_entries.end(), prefix,
+        [](const Entry& e, const std::string& p) { return *e.first < p; });
+    std::vector<size_t> positions;
+    for (; it != m_entries.end() &&
+           it->first->compare(0, prefix.size(), prefix) == 0;
+         ++it) {
+      positions.push_back(it->second);
     }
+    std::sort(positions.begin(), positions.end());
+    return positions;
   }
-}
+
+ private:
+  using Entry = std::pair<const std::string*, size_t>;
+  std::vector<Entry> m_entries;
+};
 
 /*
  * This class contains the logic for matching against a single keep rule.
@@ -297,12 +347,20 @@ class ProguardMatcher {
                   const Scope& external_classes)
       : m_pg_map(pg_map),
         m_classes(classes),
-        m_external_classes(external_classes) {
-    build_extends_or_implements_hierarchy(m_classes, &m_hierarchy);
+        m_external_classes(external_classes),
+        m_classes_index(classes),
+        m_external_classes_index(external_classes) {
     // We need to include external classes in the hierarchy because keep rules
     // may, for instance, forbid renaming of all classes that inherit from a
     // given external class.
-    build_extends_or_implements_hierarchy(m_external_classes, &m_hierarchy);
+    Scope all_classes(m_classes);
+    all_classes.insert(all_classes.end(), m_external_classes.begin(),
+                       m_external_classes.end());
+    // Proguard doesn't distinguish between subclasses and interface
+    // implementors.
+    m_hierarchy =
+        g_redex->type_hierarchy_cache().extends_or_implements_hierarchy(
+            all_classes);
   }
 
   void process_proguard_rules(const ProguardConfiguration& pg_config);
@@ -318,7 +376,9 @@ class ProguardMatcher {
   const ProguardMap& m_pg_map;
   const Scope& m_classes;
   const Scope& m_external_classes;
-  ClassHierarchy m_hierarchy;
+  std::shared_ptr<const ClassHierarchy> m_hierarchy;
+  ClassNameIndex m_classes_index;
+  ClassNameIndex m_external_classes_index;
 };
 
 // Updates a class, field or method to add keep modifiers.
@@ -760,13 +820,22 @@ void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
     RegexMap regex_map;
     ClassMatcher class_match(*keep_rule);
 
-    for (const auto& cls : m_classes) {
-      process_single_keep(class_match, *keep_rule, cls, regex_map);
-    }
-    if (process_external) {
-      for (const auto& cls : m_external_classes) {
-        process_single_keep(class_match, *keep_rule, cls, regex_map);
+    auto process_scope = [&](const Scope& scope, const ClassNameIndex& index) {
+      auto prefix = class_match.class_name_prefix();
+      // Every class name starts with "L"; there is nothing to narrow down.
+      if (prefix.size() <= 1) {
+        for (const auto& cls : scope) {
+          process_single_keep(class_match, *keep_rule, cls, regex_map);
+        }
+        return;
       }
+      for (auto i : index.with_prefix(prefix)) {
+        process_single_keep(class_match, *keep_rule, scope[i], regex_map);
+      }
+    };
+    process_scope(m_classes, m_classes_index);
+    if (process_external) {
+      process_scope(m_external_classes, m_external_classes_index);
     }
   });
 
@@ -790,7 +859,7 @@ void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
       DexClass* super = find_single_class(extendsClassName);
       if (super != nullptr) {
         TypeSet children;
-        get_all_children(m_hierarchy, super->get_type(), children);
+        get_all_children(*m_hierarchy, super->get_type(), children);
         process_single_keep(class_match, keep_rule, super, regex_map);
         for (auto const* type : children) {
           process_single_keep(class_match, keep_rule, type_class(type),
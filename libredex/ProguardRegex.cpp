@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 
 #include "ProguardRegex.h"
@@ -172,5 +174,69 @@ std::string convert_wildcard_type(std::string typ) {
   return wildcard_descriptor;
 }
 
+namespace {
+
+// Characters that form_type_regex copies into the regex as themselves, or
+// escapes so that they match themselves.
+bool is_literal(char ch) {
+  return isalnum(static_cast<unsigned char>(ch)) ||
+         static_cast<unsigned char>(ch) >= 0x80 || ch == '_' || ch == '$' ||
+         ch == '/' || ch == ';' || ch == '-';
+}
+
+} // namespace
+
+ClassNamePattern::ClassNamePattern(const std::string& descriptor) {
+  // form_type_regex treats these two the same way.
+  const std::string& pattern = descriptor == "L*;" ? "L**;" : descriptor;
+  size_t first = 0;
+  while (first < pattern.size() && is_literal(pattern[first])) {
+    ++first;
+  }
+  size_t end = pattern.size();
+  while (end > first && is_literal(pattern[end - 1])) {
+    --end;
+  }
+  m_prefix = pattern.substr(0, first);
+  m_suffix = pattern.substr(end);
+  auto middle = pattern.substr(first, end - first);
+  if (middle.empty()) {
+    m_middle = Middle::EMPTY;
+  } else if (middle == "*") {
+    m_middle = Middle::NO_SEPARATOR;
+  } else if (middle == "**") {
+    m_middle = Middle::ANY;
+  } else {
+    m_middle = Middle::REGEX;
+  }
+}
+
+ClassNamePattern::Result ClassNamePattern::match(
+    const std::string& name) const {
+  if (name.size() < m_prefix.size() + m_suffix.size() ||
+      name.compare(0, m_prefix.size(), m_prefix) != 0 ||
+      name.compare(name.size() - m_suffix.size(), m_suffix.size(),
+                   m_suffix) != 0) {
+    return Result::NO_MATCH;
+  }
+  auto begin = name.begin() + m_prefix.size();
+  auto end = name.end() - m_suffix.size();
+  switch (m_middle) {
+  case Middle::EMPTY:
+    return begin == end ? Result::MATCH : Result::NO_MATCH;
+  case Middle::NO_SEPARATOR:
+    return std::none_of(begin, end,
+                        [](char ch) { return ch == '/' || ch == '['; })
+               ? Result::MATCH
+               : Result::NO_MATCH;
+  case Middle::ANY:
+    return std::find(begin, end, '[') == end ? Result::MATCH
+                                             : Result::NO_MATCH;
+  case Middle::REGEX:
+    return Result::NEEDS_REGEX;
+  }
+  not_reached();
+}
+
 } // namespace proguard_parser
 } // namespace redex
@@ -16,5 +16,38 @@ std::string form_member_regex(std::string proguard_regex);
 std::string form_type_regex(std::string proguard_regex);
 std::string convert_wildcard_type(std::string typ);
 
+// The literal prefix and suffix of a class name pattern, in the descriptor
+// form produced by convert_wildcard_type. Every name the pattern matches has
+// both. Patterns made of a prefix, a single * or ** and a suffix, such as
+// "Lcom/foo/*;" or "Lcom/foo/**Bar;", are decided by them alone; any other
+// pattern still needs the regex from form_type_regex, but only for names
+// that have the prefix and the suffix.
+class ClassNamePattern {
+ public:
+  enum class Result { NO_MATCH, MATCH, NEEDS_REGEX };
+
+  explicit ClassNamePattern(const std::string& descriptor);
+
+  const std::string& prefix() const { return m_prefix; }
+
+  Result match(const std::string& name) const;
+
+ private:
+  enum class Middle {
+    // The pattern is a literal.
+    EMPTY,
+    // *: anything but a package separator or an array prefix.
+    NO_SEPARATOR,
+    // **: anything but an array prefix.
+    ANY,
+    // Anything else.
+    REGEX,
+  };
+
+  std::string m_prefix;
+  std::string m_suffix;
+  Middle m_middle;
+};
+
 } // namespace proguard_parser
 } // namespace redex
@@ -8,6 +8,7 @@
 #include "Reachability.h"
 
 #include <boost/bimap/bimap.hpp>
+#include <chrono>
 #include <boost/bimap/unordered_set_of.hpp>
 #include <boost/range/adaptor/map.hpp>
 
@@ -56,6 +57,30 @@ DexMethod* resolve(const DexMethodRef* method, const DexClass* cls) {
   return nullptr;
 }
 
+bool is_whyareyoukeeping_target(const DexClass* cls) {
+  return cls->rstate.report_whyareyoukeeping();
+}
+
+bool is_whyareyoukeeping_target(const DexFieldRef* field) {
+  return field->is_def() &&
+         static_cast<const DexField*>(field)->rstate.report_whyareyoukeeping();
+}
+
+bool is_whyareyoukeeping_target(const DexMethodRef* method) {
+  return method->is_def() && static_cast<const DexMethod*>(method)
+                                 ->rstate.report_whyareyoukeeping();
+}
+
+bool is_whyareyoukeeping_target(const DexAnnotation*) { return false; }
+
+// With record_keep_reasons_only_for_whyareyoukeeping, only what retains the
+// objects that -whyareyoukeeping rules name is of interest.
+template <class Object>
+bool should_record_retainers_of(const Object* object) {
+  return !RedexContext::record_keep_reasons_only_for_whyareyoukeeping() ||
+         is_whyareyoukeeping_target(object);
+}
+
 } // namespace
 
 namespace reachability {
@@ -205,6 +230,7 @@ void RootSetMarker::mark_external_method_overriders() {
  * task queue of the current worker.
  */
 void TransitiveClosureMarker::visit(const ReachableObject& obj) {
+  ++m_worker_state->get_data()->num_visited;
   switch (obj.type) {
   case ReachableObjectType::CLASS:
     visit_cls(obj.cls);
@@ -243,10 +269,9 @@ void TransitiveClosureMarker::push(const Parent* parent, const DexClass* cls) {
     return;
   }
   record_reachability(parent, cls);
-  if (m_reachable_objects->marked(cls)) {
+  if (!m_reachable_objects->mark(cls)) {
     return;
   }
-  m_reachable_objects->mark(cls);
   m_worker_state->push_task(ReachableObject(cls));
 }
 
@@ -257,13 +282,12 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, field);
-  if (m_reachable_objects->marked(field)) {
+  if (!m_reachable_objects->mark(field)) {
     return;
   }
   if (field->is_def()) {
     gather_and_push(static_cast<const DexField*>(field));
   }
-  m_reachable_objects->mark(field);
   m_worker_state->push_task(ReachableObject(field));
 }
 
@@ -274,10 +298,9 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, method);
-  if (m_reachable_objects->marked(method)) {
+  if (!m_reachable_objects->mark(method)) {
     return;
   }
-  m_reachable_objects->mark(method);
   m_worker_state->push_task(ReachableObject(method));
 }
 
@@ -307,6 +330,32 @@ static References generic_gather(T t) {
   return refs;
 }
 
+std::shared_ptr<const References> MethodReferencesCache::code_references(
+    const DexMethod* method) {
+  auto code_epoch = method->get_code_epoch();
+  auto entry = m_previous->get(method, Entry());
+  if (entry.refs == nullptr || entry.code_epoch != code_epoch) {
+    entry = m_current->get(method, Entry());
+  }
+  if (entry.refs != nullptr && entry.code_epoch == code_epoch) {
+    ++m_hits;
+  } else {
+    ++m_misses;
+    auto refs = std::make_shared<References>();
+    if (const auto* code = method->get_code()) {
+      *refs = generic_gather(code);
+    }
+    entry = Entry{code_epoch, std::move(refs)};
+  }
+  m_current->insert_or_assign(std::make_pair(method, entry));
+  return entry.refs;
+}
+
+void MethodReferencesCache::end_generation() {
+  m_previous = std::move(m_current);
+  m_current = std::make_unique<Entries>();
+}
+
 References TransitiveClosureMarker::gather(const DexAnnotation* anno) const {
   return generic_gather(anno);
 }
@@ -319,6 +368,27 @@ References TransitiveClosureMarker::gather(const DexField* field) const {
   return generic_gather(field);
 }
 
+References TransitiveClosureMarker::gather_annotations(
+    const DexMethod* method) const {
+  References refs;
+  auto gather_set = [&](const DexAnnotationSet* anno_set) {
+    anno_set->gather_strings(refs.strings);
+    anno_set->gather_types(refs.types);
+    anno_set->gather_fields(refs.fields);
+    anno_set->gather_methods(refs.methods);
+  };
+  if (method->get_anno_set()) {
+    gather_set(method->get_anno_set());
+  }
+  auto param_anno = method->get_param_anno();
+  if (param_anno) {
+    for (auto& pair : *param_anno) {
+      gather_set(pair.second);
+    }
+  }
+  return refs;
+}
+
 void TransitiveClosureMarker::gather_and_push(DexMethod* meth) {
   auto* type = meth->get_class();
   auto* cls = type_class(type);
@@ -336,13 +406,20 @@ void TransitiveClosureMarker::gather_and_push(DexMethod* meth) {
       }
     }
   }
-  auto refs = gather(meth);
-  if (check_strings) {
-    push_typelike_strings(meth, refs.strings);
+  auto push_refs = [&](const References& refs) {
+    if (check_strings) {
+      push_typelike_strings(meth, refs.strings);
+    }
+    push(meth, refs.types.begin(), refs.types.end());
+    push(meth, refs.fields.begin(), refs.fields.end());
+    push(meth, refs.methods.begin(), refs.methods.end());
+  };
+  if (m_references_cache != nullptr) {
+    push_refs(*m_references_cache->code_references(meth));
+    push_refs(gather_annotations(meth));
+  } else {
+    push_refs(gather(meth));
   }
-  push(meth, refs.types.begin(), refs.types.end());
-  push(meth, refs.fields.begin(), refs.fields.end());
-  push(meth, refs.methods.begin(), refs.methods.end());
 }
 
 template <typename T>
@@ -475,7 +552,9 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
     int* num_ignore_check_strings,
     bool record_reachability,
     bool should_mark_all_as_seed,
-    std::unique_ptr<const mog::Graph>* out_method_override_graph) {
+    std::unique_ptr<const mog::Graph>* out_method_override_graph,
+    MarkingStats* marking_stats,
+    MethodReferencesCache* references_cache) {
   Timer t("Marking");
   auto scope = build_class_scope(stores);
   auto reachable_objects = std::make_unique<ReachableObjects>();
@@ -494,23 +573,30 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
     root_set_marker.mark(scope);
   }
 
-  size_t num_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  size_t num_threads = walk::parallel::default_num_threads();
   auto stats_arr = std::make_unique<Stats[]>(num_threads);
+  // Work stealing gives every worker its own deque of discovered objects, so
+  // pushing the neighbors of an object doesn't contend with other workers.
   MarkWorkQueue work_queue(
       [&](MarkWorkerState* worker_state, const ReachableObject& obj) {
         TransitiveClosureMarker transitive_closure_marker(
             ignore_sets, *method_override_graph, record_reachability,
-            &cond_marked, reachable_objects.get(), worker_state);
+            &cond_marked, reachable_objects.get(), worker_state,
+            references_cache);
         transitive_closure_marker.visit(obj);
         return nullptr;
       },
       [](std::nullptr_t, std::nullptr_t) { return nullptr; },
       [&stats_arr](unsigned int thread_idx) { return &stats_arr[thread_idx]; },
-      num_threads);
+      num_threads,
+      WorkQueueScheduler::WorkStealing);
   for (const auto& obj : root_set) {
     work_queue.add_item(obj);
   }
+  auto start = std::chrono::steady_clock::now();
   work_queue.run_all();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
 
   if (num_ignore_check_strings != nullptr) {
     for (size_t i = 0; i < num_threads; ++i) {
@@ -518,6 +604,16 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
     }
   }
 
+  if (marking_stats != nullptr) {
+    marking_stats->num_marked = reachable_objects->num_marked();
+    marking_stats->num_visited = 0;
+    for (size_t i = 0; i < num_threads; ++i) {
+      marking_stats->num_visited += stats_arr[i].num_visited;
+    }
+    marking_stats->seconds = elapsed.count();
+    marking_stats->num_threads = num_threads;
+  }
+
   if (out_method_override_graph) {
     *out_method_override_graph = std::move(method_override_graph);
   }
@@ -525,11 +621,53 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
   return reachable_objects;
 }
 
+std::unique_ptr<ReachableObjects> IncrementalReachability::compute(
+    const DexStoresVector& stores,
+    const IgnoreSets& ignore_sets,
+    int* num_ignore_check_strings,
+    MarkingStats* marking_stats) {
+  auto reachable_objects = compute_reachable_objects(
+      stores, ignore_sets, num_ignore_check_strings,
+      /* record_reachability */ false, /* should_mark_all_as_seed */ false,
+      /* out_method_override_graph */ nullptr, marking_stats,
+      &m_references_cache);
+  m_references_cache.end_generation();
+  if (!m_validate) {
+    return reachable_objects;
+  }
+
+  auto expected = compute_reachable_objects(stores, ignore_sets, nullptr);
+  auto check = [&](const auto* obj) {
+    always_assert_log(reachable_objects->marked(obj) == expected->marked(obj),
+                      "Incremental marking got %s wrong: expected %s\n",
+                      SHOW(obj),
+                      expected->marked(obj) ? "marked" : "unmarked");
+  };
+  for (const auto* cls : build_class_scope(stores)) {
+    check(cls);
+    for (const auto* f : cls->get_ifields()) {
+      check(f);
+    }
+    for (const auto* f : cls->get_sfields()) {
+      check(f);
+    }
+    for (const auto* m : cls->get_dmethods()) {
+      check(m);
+    }
+    for (const auto* m : cls->get_vmethods()) {
+      check(m);
+    }
+  }
+  always_assert(reachable_objects->num_marked() == expected->num_marked());
+  return reachable_objects;
+}
+
 void ReachableObjects::record_reachability(const DexMethodRef* member,
                                            const DexClass* cls) {
   // Each class member trivially retains its containing class; let's filter out
   // this uninteresting information from our diagnostics.
-  if (member->get_class() == cls->get_type()) {
+  if (member->get_class() == cls->get_type() ||
+      !should_record_retainers_of(cls)) {
     return;
   }
   m_retainers_of.update(ReachableObject(cls),
@@ -539,7 +677,8 @@ void ReachableObjects::record_reachability(const DexMethodRef* member,
 
 void ReachableObjects::record_reachability(const DexFieldRef* member,
                                            const DexClass* cls) {
-  if (member->get_class() == cls->get_type()) {
+  if (member->get_class() == cls->get_type() ||
+      !should_record_retainers_of(cls)) {
     return;
   }
   m_retainers_of.update(ReachableObject(cls),
@@ -549,7 +688,7 @@ void ReachableObjects::record_reachability(const DexFieldRef* member,
 
 template <class Object>
 void ReachableObjects::record_reachability(Object* parent, Object* object) {
-  if (parent == object) {
+  if (parent == object || !should_record_retainers_of(object)) {
     return;
   }
   m_retainers_of.update(ReachableObject(object),
@@ -559,6 +698,9 @@ void ReachableObjects::record_reachability(Object* parent, Object* object) {
 
 template <class Parent, class Object>
 void ReachableObjects::record_reachability(Parent* parent, Object* object) {
+  if (!should_record_retainers_of(object)) {
+    return;
+  }
   m_retainers_of.update(ReachableObject(object),
                         [&](const ReachableObject&, ReachableObjectSet& set,
                             bool /* exists */) { set.emplace(parent); });
@@ -567,6 +709,9 @@ void ReachableObjects::record_reachability(Parent* parent, Object* object) {
 template <class Seed>
 void ReachableObjects::record_is_seed(Seed* seed) {
   redex_assert(seed != nullptr);
+  if (!should_record_retainers_of(seed)) {
+    return;
+  }
   const auto& keep_reasons = seed->rstate.keep_reasons();
   m_retainers_of.update(
       ReachableObject(seed),
@@ -691,6 +836,26 @@ void dump_graph(std::ostream& os, const ReachableObjectGraph& retainers_of) {
   gw.write(os, boost::adaptors::keys(retainers_of));
 }
 
+void dump_indexed_graph(std::ostream& os,
+                        const ReachableObjectGraph& retainers_of) {
+  bs::write_header(os, bs::INDEXED_GRAPH_VERSION);
+  bs::IndexedGraphWriter<ReachableObject, ReachableObjectHash> gw(
+      [](const ReachableObject& obj) {
+        std::ostringstream ss;
+        ss << obj;
+        return std::make_pair(static_cast<uint8_t>(obj.type), ss.str());
+      },
+      [&](const ReachableObject& obj) -> std::vector<ReachableObject> {
+        auto it = retainers_of.find(obj);
+        if (it == retainers_of.end()) {
+          return {};
+        }
+        return std::vector<ReachableObject>(it->second.begin(),
+                                            it->second.end());
+      });
+  gw.write(os, boost::adaptors::keys(retainers_of));
+}
+
 template void TransitiveClosureMarker::push<DexClass>(const DexClass* parent,
                                                       const DexType* type);
 } // namespace reachability
@@ -7,11 +7,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "ConcurrentContainers.h"
 #include "DexClass.h"
+#include "DexIdContainers.h"
 #include "KeepReason.h"
 #include "MethodOverrideGraph.h"
 #include "Pass.h"
@@ -88,36 +91,51 @@ using ReachableObjectSet =
 using ReachableObjectGraph =
     ConcurrentMap<ReachableObject, ReachableObjectSet, ReachableObjectHash>;
 
+/*
+ * The marks are bitsets indexed by the dense ids of the types (for classes),
+ * field refs and method refs, so marking is a single atomic fetch_or and never
+ * takes a lock however many workers mark at once. They are sized for the
+ * objects that exist when the ReachableObjects is created.
+ */
 class ReachableObjects {
  public:
   const ReachableObjectGraph& retainers_of() const { return m_retainers_of; }
 
-  void mark(const DexClass* cls) { m_marked_classes.insert(cls); }
+  // The mark() methods return true if the object was not marked yet.
+  bool mark(const DexClass* cls) {
+    return m_marked_classes.insert(cls->get_type());
+  }
 
-  void mark(const DexMethodRef* method) { m_marked_methods.insert(method); }
+  bool mark(const DexMethodRef* method) {
+    return m_marked_methods.insert(method);
+  }
 
-  void mark(const DexFieldRef* field) { m_marked_fields.insert(field); }
+  bool mark(const DexFieldRef* field) { return m_marked_fields.insert(field); }
 
-  bool marked(const DexClass* cls) const { return m_marked_classes.count(cls); }
+  bool marked(const DexClass* cls) const {
+    return m_marked_classes.contains(cls->get_type());
+  }
 
   bool marked(const DexMethodRef* method) const {
-    return m_marked_methods.count(method);
+    return m_marked_methods.contains(method);
   }
 
   bool marked(const DexFieldRef* field) const {
-    return m_marked_fields.count(field);
+    return m_marked_fields.contains(field);
   }
 
-  bool marked_unsafe(const DexClass* cls) const {
-    return m_marked_classes.count_unsafe(cls);
-  }
+  // Same as marked(), which doesn't lock either.
+  bool marked_unsafe(const DexClass* cls) const { return marked(cls); }
 
   bool marked_unsafe(const DexMethodRef* method) const {
-    return m_marked_methods.count_unsafe(method);
+    return marked(method);
   }
 
-  bool marked_unsafe(const DexFieldRef* field) const {
-    return m_marked_fields.count_unsafe(field);
+  bool marked_unsafe(const DexFieldRef* field) const { return marked(field); }
+
+  size_t num_marked() const {
+    return m_marked_classes.size() + m_marked_fields.size() +
+           m_marked_methods.size();
   }
 
  private:
@@ -134,9 +152,9 @@ class ReachableObjects {
 
   void record_reachability(const DexMethodRef* member, const DexClass* cls);
 
-  ConcurrentSet<const DexClass*> m_marked_classes;
-  ConcurrentSet<const DexFieldRef*> m_marked_fields;
-  ConcurrentSet<const DexMethodRef*> m_marked_methods;
+  ConcurrentIdBitset<DexType> m_marked_classes;
+  ConcurrentIdBitset<DexFieldRef> m_marked_fields;
+  ConcurrentIdBitset<DexMethodRef> m_marked_methods;
   ReachableObjectGraph m_retainers_of;
 
   friend class RootSetMarker;
@@ -155,8 +173,63 @@ struct References {
   std::vector<DexMethodRef*> methods;
 };
 
+/*
+ * Each marking worker has its own Stats, which are only summed up once
+ * marking is done.
+ */
 struct Stats {
-  int num_ignore_check_strings;
+  int num_ignore_check_strings{0};
+  size_t num_visited{0};
+};
+
+/*
+ * How much work the transitive closure did, for the metrics of the passes
+ * that compute reachability.
+ */
+struct MarkingStats {
+  size_t num_marked{0};
+  size_t num_visited{0};
+  double seconds{0};
+  size_t num_threads{0};
+
+  // Objects visited per second of marking.
+  double throughput() const { return seconds > 0 ? num_visited / seconds : 0; }
+};
+
+/*
+ * The references found in the code of methods, kept from one marking to the
+ * next along with the code epoch they were gathered at (see
+ * DexMethod::get_code_epoch). Walking the code of every reachable method is
+ * most of the cost of marking; with this cache, a marking only walks the code
+ * that may have changed since the previous one.
+ */
+class MethodReferencesCache {
+ public:
+  MethodReferencesCache()
+      : m_previous(std::make_unique<Entries>()),
+        m_current(std::make_unique<Entries>()) {}
+
+  // What gather() finds in the code of `method`, leaving out its annotations.
+  std::shared_ptr<const References> code_references(const DexMethod* method);
+
+  // Drops the entries of the methods that were not looked up since the last
+  // call, which covers the methods that were deleted in between.
+  void end_generation();
+
+  size_t hits() const { return m_hits.load(); }
+  size_t misses() const { return m_misses.load(); }
+
+ private:
+  struct Entry {
+    uint64_t code_epoch{0};
+    std::shared_ptr<const References> refs;
+  };
+  using Entries = ConcurrentMap<const DexMethod*, Entry>;
+
+  std::unique_ptr<Entries> m_previous;
+  std::unique_ptr<Entries> m_current;
+  std::atomic<size_t> m_hits{0};
+  std::atomic<size_t> m_misses{0};
 };
 
 using MarkWorkQueue = WorkQueue<ReachableObject, Stats*>;
@@ -237,13 +310,15 @@ class TransitiveClosureMarker {
       bool record_reachability,
       ConditionallyMarked* cond_marked,
       ReachableObjects* reachable_objects,
-      MarkWorkerState* worker_state)
+      MarkWorkerState* worker_state,
+      MethodReferencesCache* references_cache = nullptr)
       : m_ignore_sets(ignore_sets),
         m_method_override_graph(method_override_graph),
         m_record_reachability(record_reachability),
         m_cond_marked(cond_marked),
         m_reachable_objects(reachable_objects),
-        m_worker_state(worker_state) {}
+        m_worker_state(worker_state),
+        m_references_cache(references_cache) {}
 
   virtual ~TransitiveClosureMarker() = default;
 
@@ -257,8 +332,13 @@ class TransitiveClosureMarker {
 
   virtual References gather(const DexAnnotation* anno) const;
 
+  // When marking with a MethodReferencesCache, the references in the code of
+  // methods come from the cache instead, and only those of their annotations
+  // from this.
   virtual References gather(const DexMethod* method) const;
 
+  virtual References gather_annotations(const DexMethod* method) const;
+
   virtual References gather(const DexField* field) const;
 
   template <class Parent>
@@ -301,6 +381,7 @@ class TransitiveClosureMarker {
   ConditionallyMarked* m_cond_marked;
   ReachableObjects* m_reachable_objects;
   MarkWorkerState* m_worker_state;
+  MethodReferencesCache* m_references_cache;
 };
 
 std::unique_ptr<ReachableObjects> compute_reachable_objects(
@@ -310,7 +391,41 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
     bool record_reachability = false,
     bool should_mark_all_as_seed = false,
     std::unique_ptr<const method_override_graph::Graph>*
-        out_method_override_graph = nullptr);
+        out_method_override_graph = nullptr,
+    MarkingStats* marking_stats = nullptr,
+    MethodReferencesCache* references_cache = nullptr);
+
+/*
+ * Computes reachability over and over as the program changes, e.g. once per
+ * run of RemoveUnreachablePass, and only walks again the code of the methods
+ * that changed in between, through a MethodReferencesCache. The closure is
+ * still recomputed from the current roots, so that references which went
+ * away between two computations are accounted for exactly, and the result is
+ * always the same as that of compute_reachable_objects().
+ *
+ * With `validate`, each computation is checked against a full one, which
+ * defeats the purpose but catches code that edits methods behind the back of
+ * their code epochs.
+ */
+class IncrementalReachability {
+ public:
+  explicit IncrementalReachability(bool validate = false)
+      : m_validate(validate) {}
+
+  std::unique_ptr<ReachableObjects> compute(
+      const DexStoresVector& stores,
+      const IgnoreSets& ignore_sets,
+      int* num_ignore_check_strings,
+      MarkingStats* marking_stats = nullptr);
+
+  const MethodReferencesCache& references_cache() const {
+    return m_references_cache;
+  }
+
+ private:
+  bool m_validate;
+  MethodReferencesCache m_references_cache;
+};
 
 void sweep(DexStoresVector& stores,
            const ReachableObjects& reachables,
@@ -330,4 +445,12 @@ ObjectCounts count_objects(const DexStoresVector& stores);
 
 void dump_graph(std::ostream& os, const ReachableObjectGraph& retainers_of);
 
+/*
+ * Like dump_graph, but in the indexed format of
+ * binary_serialization::IndexedGraphWriter, which IndexedGraph can query
+ * without loading it first. Each node points to the objects that retain it.
+ */
+void dump_indexed_graph(std::ostream& os,
+                        const ReachableObjectGraph& retainers_of);
+
 } // namespace reachability
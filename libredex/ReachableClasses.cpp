@@ -88,26 +88,29 @@ void blacklist(DexMethod* reflecting_method,
   }
 }
 
-void analyze_reflection(const Scope& scope) {
-  enum ReflectionType {
-    GET_FIELD,
-    GET_DECLARED_FIELD,
-    GET_METHOD,
-    GET_DECLARED_METHOD,
-    GET_CONSTRUCTOR,
-    GET_DECLARED_CONSTRUCTOR,
-    INT_UPDATER,
-    LONG_UPDATER,
-    REF_UPDATER,
-  };
+enum ReflectionType {
+  GET_FIELD,
+  GET_DECLARED_FIELD,
+  GET_METHOD,
+  GET_DECLARED_METHOD,
+  GET_CONSTRUCTOR,
+  GET_DECLARED_CONSTRUCTOR,
+  INT_UPDATER,
+  LONG_UPDATER,
+  REF_UPDATER,
+};
 
+const std::unordered_map<std::string,
+                         std::unordered_map<std::string, ReflectionType>>&
+reflection_methods() {
   const auto JAVA_LANG_CLASS = "Ljava/lang/Class;";
   const auto ATOMIC_INT_FIELD_UPDATER = "Ljava/util/concurrent/atomic/AtomicIntegerFieldUpdater;";
   const auto ATOMIC_LONG_FIELD_UPDATER = "Ljava/util/concurrent/atomic/AtomicLongFieldUpdater;";
   const auto ATOMIC_REF_FIELD_UPDATER = "Ljava/util/concurrent/atomic/AtomicReferenceFieldUpdater;";
 
-  const std::unordered_map<std::string,
-                           std::unordered_map<std::string, ReflectionType>>
+  static const std::unordered_map<
+      std::string,
+      std::unordered_map<std::string, ReflectionType>>
       refls = {
           {JAVA_LANG_CLASS,
            {
@@ -133,92 +136,198 @@ void analyze_reflection(const Scope& scope) {
                {"newUpdater", REF_UPDATER},
            }},
       };
+  return refls;
+}
+
+DexString* dex_string_lookup(const ReflectionAnalysis& analysis,
+                             ReflectionType refl_type,
+                             IRInstruction* insn) {
+  if (refl_type == GET_CONSTRUCTOR || refl_type == GET_DECLARED_CONSTRUCTOR) {
+    return DexString::get_string("<init>");
+  }
+  int arg_str_idx = refl_type == ReflectionType::REF_UPDATER ? 2 : 1;
+  auto arg_str = analysis.get_abstract_object(insn->src(arg_str_idx), insn);
+  if (arg_str && arg_str->obj_kind == AbstractObjectKind::STRING) {
+    return arg_str->dex_string;
+  } else {
+    return nullptr;
+  }
+}
+
+/*
+ * A member looked up through reflection, to be blacklisted.
+ */
+struct ReflectionSite {
+  DexMethod* method;
+  DexType* type;
+  DexString* name;
+  ReflectionType refl_type;
+};
+
+/*
+ * What the scan of a method's code found. Each worker fills its own, and they
+ * are concatenated once the scan is done, so that the marking -- which writes
+ * to the rstate of arbitrary classes and members -- happens on one thread.
+ */
+struct CodeReachability {
+  // Internal names of the classes loaded through Class.forName().
+  std::vector<std::string> for_name_classes;
+  std::vector<ReflectionSite> reflection_sites;
+};
+
+CodeReachability merge(CodeReachability a, CodeReachability b) {
+  if (a.for_name_classes.empty()) {
+    a.for_name_classes = std::move(b.for_name_classes);
+  } else {
+    a.for_name_classes.insert(a.for_name_classes.end(),
+                              b.for_name_classes.begin(),
+                              b.for_name_classes.end());
+  }
+  a.reflection_sites.insert(a.reflection_sites.end(),
+                            b.reflection_sites.begin(),
+                            b.reflection_sites.end());
+  return a;
+}
 
-  auto dex_string_lookup = [](const ReflectionAnalysis& analysis,
-                              ReflectionType refl_type,
-                              IRInstruction* insn) {
-    if (refl_type == GET_CONSTRUCTOR || refl_type == GET_DECLARED_CONSTRUCTOR) {
-      return DexString::get_string("<init>");
+void collect_for_name_classes(const std::vector<IRInstruction*>& insns,
+                              std::vector<std::string>* classes) {
+  auto match = std::make_tuple(
+      m::const_string(/* const-string {vX}, <any string> */),
+      m::move_result_pseudo(/* const-string {vX}, <any string> */),
+      m::invoke_static(/* invoke-static {vX}, java.lang.Class;.forName */
+                       m::opcode_method(
+                           m::named<DexMethodRef>("forName") &&
+                           m::on_class<DexMethodRef>("Ljava/lang/Class;")) &&
+                       m::has_n_args(1)));
+  std::vector<std::vector<IRInstruction*>> matches;
+  m::find_matches(insns, match, matches);
+  for (const auto& match_insns : matches) {
+    auto const_string = match_insns[0];
+    auto move_result_pseudo = match_insns[1];
+    auto invoke_static = match_insns[2];
+    // Make sure that the registers agree
+    if (move_result_pseudo->dest() == invoke_static->src(0)) {
+      auto classname = JavaNameUtil::external_to_internal(
+          const_string->get_string()->c_str());
+      TRACE(PGR,
+            4,
+            "Found Class.forName of: %s, marking %s reachable",
+            const_string->get_string()->c_str(),
+            classname.c_str());
+      classes->push_back(std::move(classname));
     }
-    int arg_str_idx = refl_type == ReflectionType::REF_UPDATER ? 2 : 1;
-    auto arg_str = analysis.get_abstract_object(insn->src(arg_str_idx), insn);
-    if (arg_str && arg_str->obj_kind == AbstractObjectKind::STRING) {
-      return arg_str->dex_string;
-    } else {
-      return (DexString*)nullptr;
+  }
+}
+
+void collect_reflection_sites(DexMethod* method,
+                              const std::vector<IRInstruction*>& insns,
+                              const reflection::SummaryMap& summaries,
+                              std::vector<ReflectionSite>* sites) {
+  const auto& refls = reflection_methods();
+  std::unique_ptr<ReflectionAnalysis> analysis = nullptr;
+  for (auto* insn : insns) {
+    if (!is_invoke(insn->opcode())) {
+      continue;
     }
-  };
 
-  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
-    std::unique_ptr<ReflectionAnalysis> analysis = nullptr;
-    for (auto& mie : InstructionIterable(code)) {
-      IRInstruction* insn = mie.insn;
-      if (!is_invoke(insn->opcode())) {
-        continue;
-      }
+    // See if it matches something in refls
+    auto& method_name = insn->get_method()->get_name()->str();
+    auto& method_class_name =
+        insn->get_method()->get_class()->get_name()->str();
+    auto method_map = refls.find(method_class_name);
+    if (method_map == refls.end()) {
+      continue;
+    }
 
-      // See if it matches something in refls
-      auto& method_name = insn->get_method()->get_name()->str();
-      auto& method_class_name =
-          insn->get_method()->get_class()->get_name()->str();
-      auto method_map = refls.find(method_class_name);
-      if (method_map == refls.end()) {
-        continue;
-      }
+    auto refl_entry = method_map->second.find(method_name);
+    if (refl_entry == method_map->second.end()) {
+      continue;
+    }
+    ReflectionType refl_type = refl_entry->second;
 
-      auto refl_entry = method_map->second.find(method_name);
-      if (refl_entry == method_map->second.end()) {
-        continue;
-      }
-      ReflectionType refl_type = refl_entry->second;
+    // Instantiating the analysis object also runs the reflection analysis
+    // on the method. So, we wait until we're sure we need it.
+    // We use a unique_ptr so that we'll still only have one per method.
+    if (!analysis) {
+      analysis = std::make_unique<ReflectionAnalysis>(method, &summaries);
+    }
 
-      // Instantiating the analysis object also runs the reflection analysis
-      // on the method. So, we wait until we're sure we need it.
-      // We use a unique_ptr so that we'll still only have one per method.
-      if (!analysis) {
-        analysis = std::make_unique<ReflectionAnalysis>(method);
-      }
+    auto arg_cls = analysis->get_abstract_object(insn->src(0), insn);
+    if (!arg_cls || arg_cls->obj_kind != AbstractObjectKind::CLASS) {
+      continue;
+    }
 
-      auto arg_cls = analysis->get_abstract_object(insn->src(0), insn);
-      if (!arg_cls || arg_cls->obj_kind != AbstractObjectKind::CLASS) {
-        continue;
-      }
+    // Deal with methods that take a varying number of arguments.
+    DexString* arg_str_value = dex_string_lookup(*analysis, refl_type, insn);
+    if (arg_str_value == nullptr) {
+      continue;
+    }
 
-      // Deal with methods that take a varying number of arguments.
-      DexString* arg_str_value = dex_string_lookup(*analysis, refl_type, insn);
-      if (arg_str_value == nullptr) {
-        continue;
-      }
+    TRACE(PGR, 4, "SRA ANALYZE: %s: type:%d %s.%s cls: %d %s %s str: %s",
+          insn->get_method()->get_name()->str().c_str(), refl_type,
+          method_class_name.c_str(), method_name.c_str(), arg_cls->obj_kind,
+          SHOW(arg_cls->dex_type), SHOW(arg_cls->dex_string),
+          SHOW(arg_str_value));
+    sites->push_back(
+        ReflectionSite{method, arg_cls->dex_type, arg_str_value, refl_type});
+  }
+}
 
-      TRACE(PGR, 4, "SRA ANALYZE: %s: type:%d %s.%s cls: %d %s %s str: %s",
-            insn->get_method()->get_name()->str().c_str(), refl_type,
-            method_class_name.c_str(), method_name.c_str(), arg_cls->obj_kind,
-            SHOW(arg_cls->dex_type), SHOW(arg_cls->dex_string),
-            SHOW(arg_str_value));
+/*
+ * Visits the instructions of every method once, for both the Class.forName()
+ * scan (`legacy_reflection_reachability`) and the reflection analysis.
+ */
+CodeReachability analyze_code_reachability(const Scope& scope,
+                                           bool find_class_for_name) {
+  // The classes and names that helper methods return to the reflection
+  // sites.
+  auto summaries = reflection::compute_summaries(scope);
+  return walk::parallel::reduce_methods_by_cost<CodeReachability>(
+      scope,
+      [&](DexMethod* method) {
+        CodeReachability result;
+        auto code = method->get_code();
+        if (code == nullptr) {
+          return result;
+        }
+        std::vector<IRInstruction*> insns;
+        for (auto& mie : InstructionIterable(code)) {
+          insns.push_back(mie.insn);
+        }
+        if (find_class_for_name) {
+          collect_for_name_classes(insns, &result.for_name_classes);
+        }
+        collect_reflection_sites(method, insns, summaries,
+                                 &result.reflection_sites);
+        return result;
+      },
+      merge);
+}
 
-      switch (refl_type) {
-      case GET_FIELD:
-        blacklist<DexField*>(method, arg_cls->dex_type, arg_str_value, false);
-        break;
-      case GET_DECLARED_FIELD:
-        blacklist<DexField*>(method, arg_cls->dex_type, arg_str_value, true);
-        break;
-      case GET_METHOD:
-      case GET_CONSTRUCTOR:
-        blacklist<DexMethod*>(method, arg_cls->dex_type, arg_str_value, false);
-        break;
-      case GET_DECLARED_METHOD:
-      case GET_DECLARED_CONSTRUCTOR:
-        blacklist<DexMethod*>(method, arg_cls->dex_type, arg_str_value, true);
-        break;
-      case INT_UPDATER:
-      case LONG_UPDATER:
-      case REF_UPDATER:
-        blacklist<DexField*>(method, arg_cls->dex_type, arg_str_value, true);
-        break;
-      }
+void blacklist_reflection_sites(const std::vector<ReflectionSite>& sites) {
+  for (const auto& site : sites) {
+    switch (site.refl_type) {
+    case GET_FIELD:
+      blacklist<DexField*>(site.method, site.type, site.name, false);
+      break;
+    case GET_DECLARED_FIELD:
+      blacklist<DexField*>(site.method, site.type, site.name, true);
+      break;
+    case GET_METHOD:
+    case GET_CONSTRUCTOR:
+      blacklist<DexMethod*>(site.method, site.type, site.name, false);
+      break;
+    case GET_DECLARED_METHOD:
+    case GET_DECLARED_CONSTRUCTOR:
+      blacklist<DexMethod*>(site.method, site.type, site.name, true);
+      break;
+    case INT_UPDATER:
+    case LONG_UPDATER:
+    case REF_UPDATER:
+      blacklist<DexField*>(site.method, site.type, site.name, true);
+      break;
     }
-  });
+  }
 }
 
 template<typename DexMember>
@@ -317,9 +426,9 @@ void mark_onclick_attributes_reachable(
   auto type_context = DexType::get_type("Landroid/content/Context;");
   always_assert(type_context != nullptr);
 
-  auto class_hierarchy = build_type_hierarchy(scope);
+  auto class_hierarchy = g_redex->type_hierarchy_cache().type_hierarchy(scope);
   TypeSet children;
-  get_all_children(class_hierarchy, type_context, children);
+  get_all_children(*class_hierarchy, type_context, children);
 
   for (const auto &t : children) {
     auto dclass = type_class(t);
@@ -653,6 +762,7 @@ void init_permanently_reachable_classes(
   bool compute_xml_reachability;
   bool legacy_reflection_reachability;
   bool analyze_native_lib_reachability;
+  std::string layout_cache_file;
 
   config.get("apk_dir", "", apk_dir);
   config.get("keep_packages", {}, reflected_package_names);
@@ -665,36 +775,12 @@ void init_permanently_reachable_classes(
   config.get("prune_unexported_components", {}, prune_unexported_components);
   config.get("analyze_native_lib_reachability", true,
              analyze_native_lib_reachability);
+  config.get("layout_cache_file", "", layout_cache_file);
 
-  if (legacy_reflection_reachability) {
-    auto match = std::make_tuple(
-        m::const_string(/* const-string {vX}, <any string> */),
-        m::move_result_pseudo(/* const-string {vX}, <any string> */),
-        m::invoke_static(/* invoke-static {vX}, java.lang.Class;.forName */
-                         m::opcode_method(
-                             m::named<DexMethodRef>("forName") &&
-                             m::on_class<DexMethodRef>("Ljava/lang/Class;")) &&
-                         m::has_n_args(1)));
-
-    walk::parallel::matching_opcodes(
-        scope,
-        match,
-        [&](const DexMethod* meth, const std::vector<IRInstruction*>& insns) {
-          auto const_string = insns[0];
-          auto move_result_pseudo = insns[1];
-          auto invoke_static = insns[2];
-          // Make sure that the registers agree
-          if (move_result_pseudo->dest() == invoke_static->src(0)) {
-            auto classname = JavaNameUtil::external_to_internal(
-                const_string->get_string()->c_str());
-            TRACE(PGR,
-                  4,
-                  "Found Class.forName of: %s, marking %s reachable",
-                  const_string->get_string()->c_str(),
-                  classname.c_str());
-            mark_reachable_by_classname(classname);
-          }
-        });
+  auto code_reachability =
+      analyze_code_reachability(scope, legacy_reflection_reachability);
+  for (auto& classname : code_reachability.for_name_classes) {
+    mark_reachable_by_classname(classname);
   }
 
   std::unordered_set<DexType*> annotation_types(
@@ -719,7 +805,13 @@ void init_permanently_reachable_classes(
       // Classes present in manifest
       analyze_reachable_from_manifest(apk_dir, prune_unexported_components);
       // Classes present in XML layouts
+      if (!layout_cache_file.empty()) {
+        load_layout_cache(layout_cache_file);
+      }
       analyze_reachable_from_xml_layouts(scope, apk_dir);
+      if (!layout_cache_file.empty()) {
+        save_layout_cache(layout_cache_file);
+      }
     }
 
     if (analyze_native_lib_reachability) {
@@ -733,7 +825,7 @@ void init_permanently_reachable_classes(
     }
   }
 
-  analyze_reflection(scope);
+  blacklist_reflection_sites(code_reachability.reflection_sites);
 
   std::unordered_set<DexClass*> reflected_package_classes;
   for (auto clazz : scope) {
@@ -7,24 +7,29 @@
 
 #include "RedexContext.h"
 
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <exception>
 #include <mutex>
 #include <regex>
 #include <unordered_set>
 
+#include "ClassHierarchy.h"
+#include "Configurable.h"
 #include "Debug.h"
 #include "DexClass.h"
+#include "DexIdx.h"
+#include "Resolver.h"
 
 RedexContext* g_redex;
 
 RedexContext::RedexContext(bool allow_class_duplicates)
-    : m_allow_class_duplicates(allow_class_duplicates) {}
+    : m_allow_class_duplicates(allow_class_duplicates),
+      m_type_hierarchy_cache(std::make_unique<TypeHierarchyCache>()),
+      m_resolver_cache(std::make_unique<ResolverCache>()),
+      m_config_type_list_cache(std::make_unique<ConfigTypeListCache>()) {}
 
 RedexContext::~RedexContext() {
-  // Delete DexStrings.
-  for (auto const& p : s_string_map) {
-    delete p.second;
-  }
+  // DexStrings are owned (and freed) by s_string_interner.
   // Delete DexTypes.  NB: This table intentionally contains aliases (multiple
   // DexStrings map to the same DexType), so we have to dedup the set of types
   // before deleting to avoid double-frees.
@@ -55,10 +60,15 @@ RedexContext::~RedexContext() {
   for (auto const& it : m_type_to_class) {
     delete it.second;
   }
+}
 
-  for (const auto& p : s_keep_reasons) {
-    delete p.second;
+void RedexContext::init_thread_pool(size_t num_threads, bool pin_threads) {
+  if (num_threads == 0) {
+    num_threads = redex_parallel::default_num_threads();
   }
+  ThreadPool::set_instance(nullptr);
+  m_thread_pool = std::make_unique<ThreadPool>(num_threads, pin_threads);
+  ThreadPool::set_instance(m_thread_pool.get());
 }
 
 /*
@@ -87,23 +97,32 @@ static StoredValue* try_insert(Key key,
 
 DexString* RedexContext::make_string(const char* nstr, uint32_t utfsize) {
   always_assert(nstr != nullptr);
-  auto rv = s_string_map.get(nstr, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  // Note that DexStrings are keyed by the c_str() of the underlying
-  // std::string. The c_str is valid until a the string is destroyed, or until a
-  // non-const function is called on the string (but note the std::string itself
-  // is const)
-  auto dexstring = new DexString(nstr, utfsize);
-  return try_insert(dexstring->c_str(), dexstring, &s_string_map);
+  return s_string_interner.make(nstr, strlen(nstr), utfsize);
+}
+
+DexString* RedexContext::make_string_in_place(const char* nstr,
+                                             uint32_t utfsize) {
+  always_assert(nstr != nullptr);
+  return s_string_interner.make(nstr, strlen(nstr), utfsize,
+                                /* in_place */ true);
+}
+
+void RedexContext::retain_dex_mapping(
+    std::unique_ptr<boost::iostreams::mapped_file> mapping) {
+  std::lock_guard<std::mutex> lock(m_dex_mappings_lock);
+  m_dex_mappings.push_back(std::move(mapping));
+}
+
+void RedexContext::retain_dex_idx(std::unique_ptr<DexIdx> idx) {
+  std::lock_guard<std::mutex> lock(m_dex_mappings_lock);
+  m_dex_idxs.push_back(std::move(idx));
 }
 
 DexString* RedexContext::get_string(const char* nstr, uint32_t utfsize) {
   if (nstr == nullptr) {
     return nullptr;
   }
-  return s_string_map.get(nstr, nullptr);
+  return s_string_interner.get(nstr, strlen(nstr));
 }
 
 DexType* RedexContext::make_type(const DexString* dstring) {
@@ -112,8 +131,11 @@ DexType* RedexContext::make_type(const DexString* dstring) {
   if (rv != nullptr) {
     return rv;
   }
-  return try_insert(dstring, new DexType(const_cast<DexString*>(dstring)),
-                    &s_type_map);
+  auto type = new DexType(const_cast<DexString*>(dstring));
+  type->m_id = m_type_ids.allocate_id();
+  rv = try_insert(dstring, type, &s_type_map);
+  m_type_ids.publish(rv->m_id, rv);
+  return rv;
 }
 
 DexType* RedexContext::get_type(const DexString* dstring) {
@@ -126,6 +148,7 @@ DexType* RedexContext::get_type(const DexString* dstring) {
 void RedexContext::set_type_name(DexType* type, DexString* new_name) {
   alias_type_name(type, new_name);
   type->m_name = new_name;
+  m_rename_epoch.fetch_add(1, std::memory_order_relaxed);
 }
 
 void RedexContext::alias_type_name(DexType* type, DexString* new_name) {
@@ -152,7 +175,10 @@ DexFieldRef* RedexContext::make_field(const DexType* container,
   auto field = new DexField(const_cast<DexType*>(container),
                             const_cast<DexString*>(name),
                             const_cast<DexType*>(type));
-  return try_insert<DexField, DexFieldRef>(r, field, &s_field_map);
+  field->m_id = m_field_ids.allocate_id();
+  rv = try_insert<DexField, DexFieldRef>(r, field, &s_field_map);
+  m_field_ids.publish(rv->m_id, rv);
+  return rv;
 }
 
 DexFieldRef* RedexContext::get_field(const DexType* container,
@@ -176,6 +202,7 @@ void RedexContext::mutate_field(DexFieldRef* field,
                                 bool rename_on_collision,
                                 bool update_deobfuscated_name) {
   std::lock_guard<std::mutex> lock(s_field_lock);
+  m_rename_epoch.fetch_add(1, std::memory_order_relaxed);
   DexFieldSpec& r = field->m_spec;
   s_field_map.erase(r);
   r.cls = ref.cls != nullptr ? ref.cls : field->m_spec.cls;
@@ -254,8 +281,12 @@ DexMethodRef* RedexContext::make_method(const DexType* type_,
   if (rv != nullptr) {
     return rv;
   }
-  return try_insert<DexMethod, DexMethodRef, DexMethod::Deleter>(
-      r, new DexMethod(type, name, proto), &s_method_map);
+  auto method = new DexMethod(type, name, proto);
+  method->m_id = m_method_ids.allocate_id();
+  rv = try_insert<DexMethod, DexMethodRef, DexMethod::Deleter>(r, method,
+                                                               &s_method_map);
+  m_method_ids.publish(rv->m_id, rv);
+  return rv;
 }
 
 DexMethodRef* RedexContext::get_method(const DexType* type,
@@ -278,6 +309,7 @@ void RedexContext::mutate_method(DexMethodRef* method,
                                  bool rename_on_collision,
                                  bool update_deobfuscated_name) {
   std::lock_guard<std::mutex> lock(s_method_lock);
+  m_rename_epoch.fetch_add(1, std::memory_order_relaxed);
   DexMethodSpec old_spec = method->m_spec;
   s_method_map.erase(method->m_spec);
 
@@ -370,6 +402,7 @@ void RedexContext::mutate_method(DexMethodRef* method,
 
 void RedexContext::publish_class(DexClass* cls) {
   std::lock_guard<std::mutex> l(m_type_system_mutex);
+  bump_member_epoch();
   const DexType* type = cls->get_type();
   if (m_type_to_class.find(type) != end(m_type_to_class)) {
     const auto& prev_loc = m_type_to_class[type]->get_location();
@@ -397,10 +430,18 @@ void RedexContext::publish_class(DexClass* cls) {
       }
     }
   }
-  m_type_to_class.emplace(type, cls);
+  if (m_type_to_class.emplace(type, cls).second) {
+    // Pairs with the acquire in type_class(), so that a reader that sees the
+    // class also sees it fully constructed.
+    const_cast<DexType*>(type)->m_class.store(cls, std::memory_order_release);
+  }
 }
 
 DexClass* RedexContext::type_class(const DexType* t) {
-  auto it = m_type_to_class.find(t);
-  return it != m_type_to_class.end() ? it->second : nullptr;
+  // Like the map lookup this replaced, a null type has no class, which
+  // walks past java.lang.Object rely on.
+  if (t == nullptr) {
+    return nullptr;
+  }
+  return t->m_class.load(std::memory_order_acquire);
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <boost/functional/hash.hpp>
 #include <cstring>
 #include <deque>
@@ -21,7 +22,16 @@
 
 #include "ConcurrentContainers.h"
 #include "DexMemberRefs.h"
+#include "IdTable.h"
 #include "KeepReason.h"
+#include "StringInterner.h"
+#include "ThreadPool.h"
+
+namespace boost {
+namespace iostreams {
+class mapped_file;
+} // namespace iostreams
+} // namespace boost
 
 class DexDebugInstruction;
 class DexString;
@@ -31,10 +41,14 @@ class DexTypeList;
 class DexProto;
 class DexMethodRef;
 class DexClass;
+class DexIdx;
 struct DexFieldSpec;
 struct DexDebugEntry;
 struct DexPosition;
 struct RedexContext;
+class ResolverCache;
+class ConfigTypeListCache;
+class TypeHierarchyCache;
 
 extern RedexContext* g_redex;
 
@@ -43,7 +57,27 @@ struct RedexContext {
   ~RedexContext();
 
   DexString* make_string(const char* nstr, uint32_t utfsize);
+  /*
+   * Like make_string(), except that a newly created DexString points at
+   * `nstr` itself instead of a copy. `nstr` must lie in a mapping passed to
+   * retain_dex_mapping().
+   */
+  DexString* make_string_in_place(const char* nstr, uint32_t utfsize);
   DexString* get_string(const char* nstr, uint32_t utfsize);
+  /*
+   * Keeps a mapped dex file open for as long as this context lives, so that
+   * DexStrings can point into its string data.
+   */
+  void retain_dex_mapping(
+      std::unique_ptr<boost::iostreams::mapped_file> mapping);
+  /*
+   * Keeps the DexIdx of a loaded dex for as long as this context lives, so
+   * that annotations can decode their elements through it on first access.
+   */
+  void retain_dex_idx(std::unique_ptr<DexIdx> idx);
+  StringInterner::Stats get_string_interning_stats() const {
+    return s_string_interner.get_stats();
+  }
 
   DexType* make_type(const DexString* dstring);
   DexType* get_type(const DexString* dstring);
@@ -61,6 +95,49 @@ struct RedexContext {
    */
   void remove_type_name(DexString* name);
 
+  /*
+   * Bumped whenever a type, field or method is renamed or moved in place.
+   * Data derived from the names of what some code references, like the
+   * code hashes that hashing::DexScopeHasher caches, is stale once it moves.
+   */
+  size_t get_rename_epoch() const {
+    return m_rename_epoch.load(std::memory_order_relaxed);
+  }
+
+  /*
+   * Bumped whenever a class gains or loses a method or field, changes its
+   * superclass or interfaces, or gets published. Resolutions of references,
+   * like those the ResolverCache memoizes, are stale once it moves. Code that
+   * edits the member lists of a class directly should bump it too.
+   */
+  size_t get_member_epoch() const {
+    return m_member_epoch.load(std::memory_order_relaxed);
+  }
+
+  void bump_member_epoch() {
+    m_member_epoch.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /*
+   * Each DexString, DexType, DexFieldRef and DexMethodRef gets a dense id
+   * from its own numbering when it is created; see DexString::get_id(). The
+   * *_by_id() lookups return nullptr for ids that are not in use, and the
+   * *_id_bound() methods give the size a vector needs to be indexed by any
+   * id handed out so far.
+   */
+  DexString* string_by_id(uint32_t id) const {
+    return s_string_interner.get_by_id(id);
+  }
+  DexType* type_by_id(uint32_t id) const { return m_type_ids.get(id); }
+  DexFieldRef* field_by_id(uint32_t id) const { return m_field_ids.get(id); }
+  DexMethodRef* method_by_id(uint32_t id) const {
+    return m_method_ids.get(id);
+  }
+  uint32_t string_id_bound() const { return s_string_interner.id_bound(); }
+  uint32_t type_id_bound() const { return m_type_ids.bound(); }
+  uint32_t field_id_bound() const { return m_field_ids.bound(); }
+  uint32_t method_id_bound() const { return m_method_ids.bound(); }
+
   DexFieldRef* make_field(const DexType* container,
                           const DexString* name,
                           const DexType* type);
@@ -98,8 +175,15 @@ struct RedexContext {
   DexDebugEntry* make_dbg_entry(DexDebugInstruction* opcode);
   DexDebugEntry* make_dbg_entry(DexPosition* pos);
 
+  /*
+   * publish_class() may be called concurrently with itself and with
+   * type_class(); the latter never takes a lock.
+   */
   void publish_class(DexClass*);
   DexClass* type_class(const DexType* t);
+  /*
+   * Not thread-safe with respect to publish_class().
+   */
   template <class TypeClassWalkerFn = void(const DexType*, const DexClass*)>
   void walk_type_class(TypeClassWalkerFn walker) {
     for (const auto& type_cls : m_type_to_class) {
@@ -116,66 +200,66 @@ struct RedexContext {
     g_redex->m_record_keep_reasons = v;
   }
 
+  /*
+   * When recording keep reasons, only record them, and the reachability
+   * edges that lead to kept objects, for the classes and members that
+   * -whyareyoukeeping rules name.
+   */
+  static bool record_keep_reasons_only_for_whyareyoukeeping() {
+    return g_redex->m_record_keep_reasons_only_for_whyareyoukeeping;
+  }
+  static void set_record_keep_reasons_only_for_whyareyoukeeping(bool v) {
+    g_redex->m_record_keep_reasons_only_for_whyareyoukeeping = v;
+  }
+
+  /*
+   * Starts the process-wide thread pool that WorkQueue::run_all() uses for
+   * the rest of this context's lifetime. num_threads == 0 means one thread
+   * per hardware thread.
+   */
+  void init_thread_pool(size_t num_threads, bool pin_threads);
+  ThreadPool* thread_pool() { return m_thread_pool.get(); }
+
+  /*
+   * Type hierarchies shared by everything that runs in this context.
+   */
+  TypeHierarchyCache& type_hierarchy_cache() {
+    return *m_type_hierarchy_cache;
+  }
+
+  /*
+   * Method and field resolutions shared by everything that runs in this
+   * context. See resolve_method_cached().
+   */
+  ResolverCache& resolver_cache() { return *m_resolver_cache; }
+
+  /*
+   * Type lists of the configs that were already resolved in this context.
+   */
+  ConfigTypeListCache& config_type_list_cache() {
+    return *m_config_type_list_cache;
+  }
+
   template <class... Args>
-  static keep_reason::Reason* make_keep_reason(Args&&... args) {
-    auto to_insert =
-        std::make_unique<keep_reason::Reason>(std::forward<Args>(args)...);
-    if (g_redex->s_keep_reasons.emplace(to_insert.get(), to_insert.get())) {
-      return to_insert.release();
-    }
-    return g_redex->s_keep_reasons.at(to_insert.get());
+  static const keep_reason::Reason* make_keep_reason(Args&&... args) {
+    return g_redex->m_keep_reasons.make(std::forward<Args>(args)...);
+  }
+
+  const keep_reason::ReasonStore& keep_reasons() const {
+    return m_keep_reasons;
   }
 
  private:
-  struct Strcmp;
-  struct TruncatedStringHash;
-
-  // We use this instead of an unordered_map-based ConcurrentMap because
-  // hashing is expensive on large strings -- it has to hash the entire key to
-  // find its bucket. An std::map (i.e. a tree) performs better with large keys
-  // in a sparse keyset because it only needs to find the first character that
-  // differs between keys when traversing the tree, meaning that it usually
-  // doesn't need to examine the entire key for insertions.
-  //
-  // We still need to do hashing in order to shard the keys across the
-  // individually-locked std::maps, but it suffices to hash a substring for this
-  // purpose.
-  template <typename Value, size_t n_slots = 31>
-  using ConcurrentLargeStringMap =
-      ConcurrentMapContainer<std::map<const char*, Value, Strcmp>,
-                             const char*,
-                             Value,
-                             TruncatedStringHash,
-                             n_slots>;
-
-  struct Strcmp {
-    bool operator()(const char* a, const char* b) const {
-      return strcmp(a, b) < 0;
-    }
-  };
-
-  // Hash an 8-byte subsequence of a given string, offset by 32 bytes from the
-  // start. Dex files tend to contain many strings with the same prefixes,
-  // because every class / method under a given package will share the same
-  // prefix. The offset ensures that we have more unique subsequences to hash.
-  //
-  // XXX(jezng): 32 was picked fairly arbitrarily; testing showed that it was
-  // definitely better than 0, but I did not test any numbers in between.
-  struct TruncatedStringHash {
-    size_t operator()(const char* s) {
-      constexpr size_t hash_prefix_len = 8;
-      constexpr size_t offset = 32;
-      size_t len = strnlen(s, offset + hash_prefix_len);
-      size_t start = std::max<int64_t>(0, int64_t(len - hash_prefix_len));
-      return boost::hash_range(s + start, s + len);
-    }
-  };
+  // See get_rename_epoch().
+  std::atomic<size_t> m_rename_epoch{0};
+  // See get_member_epoch().
+  std::atomic<size_t> m_member_epoch{0};
 
   // DexString
-  ConcurrentLargeStringMap<DexString*> s_string_map;
+  StringInterner s_string_interner;
 
-  // DexType
-  ConcurrentMap<const DexString*, DexType*> s_type_map;
+  // DexType. Almost all accesses after loading are lookups.
+  SharedConcurrentMap<const DexString*, DexType*> s_type_map;
 
   // DexFieldRef
   ConcurrentMap<DexFieldSpec, DexFieldRef*> s_field_map;
@@ -195,20 +279,34 @@ struct RedexContext {
   ConcurrentMap<DexMethodSpec, DexMethodRef*> s_method_map;
   std::mutex s_method_lock;
 
-  // Type-to-class map and class hierarchy
+  // Ids are taken before racing to insert into the maps above, so the few
+  // objects that lose a race leave holes in the numbering.
+  IdTable<DexType> m_type_ids;
+  IdTable<DexFieldRef> m_field_ids;
+  IdTable<DexMethodRef> m_method_ids;
+
+  // Type-to-class map and class hierarchy. type_class() reads
+  // DexType::m_class instead; this map is kept for iteration and ownership.
   std::mutex m_type_system_mutex;
   std::unordered_map<const DexType*, DexClass*> m_type_to_class;
 
   const std::vector<const DexType*> m_empty_types;
 
-  ConcurrentMap<keep_reason::Reason*,
-                keep_reason::Reason*,
-                keep_reason::ReasonPtrHash,
-                keep_reason::ReasonPtrEqual>
-      s_keep_reasons;
+  keep_reason::ReasonStore m_keep_reasons;
 
   bool m_record_keep_reasons{false};
+  bool m_record_keep_reasons_only_for_whyareyoukeeping{false};
   bool m_allow_class_duplicates;
+
+  std::unique_ptr<ThreadPool> m_thread_pool;
+
+  std::unique_ptr<TypeHierarchyCache> m_type_hierarchy_cache;
+  std::unique_ptr<ResolverCache> m_resolver_cache;
+  std::unique_ptr<ConfigTypeListCache> m_config_type_list_cache;
+
+  std::mutex m_dex_mappings_lock;
+  std::vector<std::unique_ptr<boost::iostreams::mapped_file>> m_dex_mappings;
+  std::vector<std::unique_ptr<DexIdx>> m_dex_idxs;
 };
 
 // One or more exceptions
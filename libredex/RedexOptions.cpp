@@ -16,6 +16,8 @@ void RedexOptions::serialize(Json::Value& entry_data) const {
   options["instrument_pass_enabled"] = instrument_pass_enabled;
   options["min_sdk"] = min_sdk;
   options["debug_info_kind"] = debug_info_kind_to_string(debug_info_kind);
+  options["thread_pool_size"] = thread_pool_size;
+  options["pin_pool_threads"] = pin_pool_threads;
 }
 
 void RedexOptions::deserialize(const Json::Value& entry_data) {
@@ -26,6 +28,8 @@ void RedexOptions::deserialize(const Json::Value& entry_data) {
   min_sdk = options_data["min_sdk"].asInt();
   debug_info_kind =
       parse_debug_info_kind(options_data["debug_info_kind"].asString());
+  thread_pool_size = options_data["thread_pool_size"].asUInt();
+  pin_pool_threads = options_data["pin_pool_threads"].asBool();
 }
 
 Architecture parse_architecture(const std::string& s) {
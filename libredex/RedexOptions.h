@@ -40,6 +40,11 @@ class RedexOptions {
   int32_t min_sdk{0};
   Architecture arch{Architecture::UNKNOWN};
   DebugInfoKind debug_info_kind{DebugInfoKind::NoCustomSymbolication};
+  // Size of the process-wide thread pool that parallel walkers and
+  // WorkQueues run on. Zero means one thread per hardware thread.
+  uint32_t thread_pool_size{0};
+  // Pin each pool thread to a CPU.
+  bool pin_pool_threads{false};
 
   /*
    * Overwriting the `this` register breaks the verifier before Android M and
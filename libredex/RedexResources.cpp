@@ -14,9 +14,12 @@
 #include <boost/regex.hpp>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <fstream>
+#include <iomanip>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -46,7 +49,9 @@
 #include <json/json.h>
 
 #include "Debug.h"
+#include "Sha1.h"
 #include "StringUtil.h"
+#include "WorkQueue.h"
 
 constexpr size_t MIN_CLASSNAME_LENGTH = 10;
 constexpr size_t MAX_CLASSNAME_LENGTH = 500;
@@ -237,28 +242,29 @@ std::unordered_set<uint32_t> extract_xml_reference_attributes(
   return result;
 }
 
+namespace {
+
 /**
  * Follows the reference links for a resource for all configurations.
  * Outputs all the nodes visited, as well as all the string values seen.
  */
-void walk_references_for_resource(
-    const android::ResTable& table,
-    uint32_t resID,
-    std::unordered_set<uint32_t>* nodes_visited,
-    std::unordered_set<std::string>* leaf_string_values) {
+template <typename GetValues, typename GetString>
+void walk_references(const GetValues& get_values,
+                     const GetString& get_string,
+                     uint32_t resID,
+                     std::unordered_set<uint32_t>* nodes_visited,
+                     std::unordered_set<std::string>* leaf_string_values) {
   if (nodes_visited->find(resID) != nodes_visited->end()) {
     return;
   }
   nodes_visited->emplace(resID);
 
-  ssize_t pkg_index = table.getResourcePackageIndex(resID);
-
-  android::Vector<android::Res_value> initial_values;
-  table.getAllValuesForResource(resID, initial_values);
+  std::vector<android::Res_value> initial_values;
+  get_values(resID, &initial_values);
 
   std::stack<android::Res_value> nodes_to_explore;
-  for (size_t index = 0; index < initial_values.size(); ++index) {
-    nodes_to_explore.push(initial_values[index]);
+  for (const auto& value : initial_values) {
+    nodes_to_explore.push(value);
   }
 
   while (!nodes_to_explore.empty()) {
@@ -266,8 +272,7 @@ void walk_references_for_resource(
     nodes_to_explore.pop();
 
     if (r.dataType == android::Res_value::TYPE_STRING) {
-      android::String8 str = table.getString8FromIndex(pkg_index, r.data);
-      leaf_string_values->insert(std::string(str.string()));
+      leaf_string_values->insert(get_string(r.data));
       continue;
     }
 
@@ -280,14 +285,51 @@ void walk_references_for_resource(
     }
 
     nodes_visited->insert(r.data);
-    android::Vector<android::Res_value> inner_values;
-    table.getAllValuesForResource(r.data, inner_values);
-    for (size_t index = 0; index < inner_values.size(); ++index) {
-      nodes_to_explore.push(inner_values[index]);
+    std::vector<android::Res_value> inner_values;
+    get_values(r.data, &inner_values);
+    for (const auto& value : inner_values) {
+      nodes_to_explore.push(value);
     }
   }
 }
 
+} // namespace
+
+void walk_references_for_resource(
+    const android::ResTable& table,
+    uint32_t resID,
+    std::unordered_set<uint32_t>* nodes_visited,
+    std::unordered_set<std::string>* leaf_string_values) {
+  ssize_t pkg_index = table.getResourcePackageIndex(resID);
+  walk_references(
+      [&](uint32_t id, std::vector<android::Res_value>* values) {
+        android::Vector<android::Res_value> table_values;
+        table.getAllValuesForResource(id, table_values);
+        for (size_t index = 0; index < table_values.size(); ++index) {
+          values->push_back(table_values[index]);
+        }
+      },
+      [&](uint32_t string_index) {
+        android::String8 str =
+            table.getString8FromIndex(pkg_index, string_index);
+        return std::string(str.string());
+      },
+      resID, nodes_visited, leaf_string_values);
+}
+
+void walk_references_for_resource(
+    const ResourceTableView& table,
+    uint32_t resID,
+    std::unordered_set<uint32_t>* nodes_visited,
+    std::unordered_set<std::string>* leaf_string_values) {
+  walk_references(
+      [&](uint32_t id, std::vector<android::Res_value>* values) {
+        table.get_all_values(id, values);
+      },
+      [&](uint32_t string_index) { return table.get_string(string_index); },
+      resID, nodes_visited, leaf_string_values);
+}
+
 /*
  * Look for <search_tag> within the descendants of the current node in the XML
  * tree.
@@ -428,14 +470,16 @@ std::string read_attribute_name_at_idx(const android::ResXMLTree& parser,
   }
 }
 
+template <typename ClassFn, typename AttributeFn>
 void extract_classes_from_layout(
-    const std::string& layout_contents,
+    const char* data,
+    size_t size,
     const std::unordered_set<std::string>& attributes_to_read,
-    std::unordered_set<std::string>& out_classes,
-    std::unordered_multimap<std::string, std::string>& out_attributes) {
+    const ClassFn& add_class,
+    const AttributeFn& add_attribute) {
 
   android::ResXMLTree parser;
-  parser.setTo(layout_contents.data(), layout_contents.size());
+  parser.setTo(data, size);
 
   android::String16 name("name");
   android::String16 klazz("class");
@@ -463,7 +507,7 @@ void extract_classes_from_layout(
       bool is_classname = converted.find('.') != std::string::npos;
       if (is_classname) {
         std::replace(converted.begin(), converted.end(), '.', '/');
-        out_classes.insert(converted);
+        add_class(std::move(converted));
       }
       if (!attributes_to_read.empty()) {
         for (size_t i = 0; i < parser.getAttributeCount(); i++) {
@@ -479,7 +523,7 @@ void extract_classes_from_layout(
             auto val = parser.getAttributeStringValue(i, &len);
             if (val != nullptr) {
               android::String16 s16(val, len);
-              out_attributes.emplace(fully_qualified, convert_from_string16(s16));
+              add_attribute(fully_qualified, convert_from_string16(s16));
             }
           }
         }
@@ -504,46 +548,147 @@ void extract_classes_from_layout(
  *   "Ljava/lang/String;"
  *
  */
-std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
-  std::unordered_set<std::string> classes;
-  char buffer[MAX_CLASSNAME_LENGTH + 2]; // +2 for the trailing ";\0"
-  const char* inptr = lib_contents.data();
-  char* outptr = buffer;
-  const char* end = inptr + lib_contents.size();
-
-  size_t length = 0;
-
+namespace {
+
+// The bytes that can start and continue a class name in a native library.
+// All classnames start with a package, which starts with a lowercase letter.
+// Some of them are preceded by an 'L' and followed by a ';' in native
+// libraries while others are not.
+struct ClassNameChars {
+  bool starts[256]{};
+  bool continues[256]{};
+
+  ClassNameChars() {
+    for (int c = 'a'; c <= 'z'; ++c) {
+      starts[c] = continues[c] = true;
+      continues[c - 'a' + 'A'] = true;
+    }
+    starts[(int)'L'] = true;
+    for (int c = '0'; c <= '9'; ++c) {
+      continues[c] = true;
+    }
+    continues[(int)'/'] = continues[(int)'_'] = continues[(int)'$'] = true;
+  }
+};
+
+void extract_classes_from_native_lib(
+    const char* inptr,
+    const char* end,
+    std::unordered_set<std::string>* classes) {
+  static const ClassNameChars chars;
+  std::string name;
+  name.reserve(MAX_CLASSNAME_LENGTH + 1); // +1 for the trailing ';'
   while (inptr < end) {
-    outptr = buffer;
-    length = 0;
-    // All classnames start with a package, which starts with a lowercase
-    // letter. Some of them are preceded by an 'L' and followed by a ';' in
-    // native libraries while others are not.
-    if ((*inptr >= 'a' && *inptr <= 'z') || *inptr == 'L') {
-
-      if (*inptr != 'L') {
-        *outptr++ = 'L';
-        length++;
-      }
+    // Most bytes of a library cannot start a name, so skip over them in a
+    // loop of table lookups.
+    while (inptr < end && !chars.starts[(uint8_t)*inptr]) {
+      ++inptr;
+    }
+    if (inptr == end) {
+      break;
+    }
+    name.clear();
+    if (*inptr != 'L') {
+      name.push_back('L');
+    }
+    auto limit = inptr + std::min<size_t>(end - inptr,
+                                          MAX_CLASSNAME_LENGTH - name.size());
+    auto name_end = inptr;
+    while (name_end < limit && chars.continues[(uint8_t)*name_end]) {
+      ++name_end;
+    }
+    name.append(inptr, name_end);
+    if (name.size() >= MIN_CLASSNAME_LENGTH) {
+      name.push_back(';');
+      classes->insert(name);
+    }
+    inptr = name_end + 1;
+  }
+}
 
-      while (( // This loop is safe since lib_contents.data() ends with a \0
-                 (*inptr >= 'a' && *inptr <= 'z') ||
-                 (*inptr >= 'A' && *inptr <= 'Z') ||
-                 (*inptr >= '0' && *inptr <= '9') ||
-                 *inptr == '/' || *inptr == '_' || *inptr == '$')
-             && length < MAX_CLASSNAME_LENGTH) {
+uint64_t read_little_endian(const uint8_t* data, size_t num_bytes) {
+  uint64_t value = 0;
+  for (size_t i = num_bytes; i > 0; --i) {
+    value = (value << 8) | data[i - 1];
+  }
+  return value;
+}
 
-        *outptr++ = *inptr++;
-        length++;
-      }
-      if (length >= MIN_CLASSNAME_LENGTH) {
-        *outptr++ = ';';
-        *outptr = '\0';
-        classes.insert(std::string(buffer));
-      }
+/*
+ * The byte ranges of the sections of an ELF library that hold the strings a
+ * JNI class name can be in: .rodata, for the names passed to FindClass and
+ * RegisterNatives, and .dynstr. Returns the whole file if it is not a
+ * little-endian ELF file whose section headers can be read.
+ */
+std::vector<std::pair<size_t, size_t>> get_native_string_ranges(
+    const uint8_t* data, size_t length) {
+  std::vector<std::pair<size_t, size_t>> whole_file{{0, length}};
+  const size_t ident_size = 16;
+  if (length < ident_size || memcmp(data, "\x7f" "ELF", 4) != 0 ||
+      data[5] != 1 /* ELFDATA2LSB */) {
+    return whole_file;
+  }
+  bool is_64 = data[4] == 2 /* ELFCLASS64 */;
+  size_t word = is_64 ? 8 : 4;
+  size_t header_size = is_64 ? 64 : 52;
+  if (length < header_size) {
+    return whole_file;
+  }
+  auto read = [&](size_t offset, size_t num_bytes) {
+    return read_little_endian(data + offset, num_bytes);
+  };
+  uint64_t section_headers = read(is_64 ? 0x28 : 0x20, word);
+  size_t section_header_size = read(is_64 ? 0x3A : 0x2E, 2);
+  size_t num_sections = read(is_64 ? 0x3C : 0x30, 2);
+  size_t names_index = read(is_64 ? 0x3E : 0x32, 2);
+  size_t min_section_header_size = is_64 ? 64 : 40;
+  if (section_header_size < min_section_header_size ||
+      names_index >= num_sections || section_headers > length ||
+      num_sections * section_header_size > length - section_headers) {
+    return whole_file;
+  }
+
+  struct Section {
+    uint64_t name;
+    uint64_t offset;
+    uint64_t size;
+  };
+  auto section_at = [&](size_t index) {
+    size_t header = section_headers + index * section_header_size;
+    return Section{read(header, 4), read(header + (is_64 ? 0x18 : 0x10), word),
+                   read(header + (is_64 ? 0x20 : 0x14), word)};
+  };
+  auto in_file = [&](const Section& section) {
+    return section.offset <= length && section.size <= length - section.offset;
+  };
+  auto names = section_at(names_index);
+  if (!in_file(names)) {
+    return whole_file;
+  }
+  auto names_begin = reinterpret_cast<const char*>(data + names.offset);
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (size_t i = 0; i < num_sections; ++i) {
+    auto section = section_at(i);
+    if (section.name >= names.size || !in_file(section)) {
+      continue;
+    }
+    auto name_begin = names_begin + section.name;
+    std::string name(name_begin,
+                     strnlen(name_begin, names.size - section.name));
+    if (boost::algorithm::starts_with(name, ".rodata") || name == ".dynstr") {
+      ranges.emplace_back(section.offset, section.offset + section.size);
     }
-    inptr++;
   }
+  return ranges;
+}
+
+} // namespace
+
+std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
+  std::unordered_set<std::string> classes;
+  extract_classes_from_native_lib(lib_contents.data(),
+                                  lib_contents.data() + lib_contents.size(),
+                                  &classes);
   return classes;
 }
 
@@ -814,16 +959,95 @@ bool is_drawable_attribute(
   return false;
 }
 
-int inline_xml_reference_attributes(
+XmlRewriteStats& XmlRewriteStats::operator+=(const XmlRewriteStats& that) {
+  files_scanned += that.files_scanned;
+  files_skipped += that.files_skipped;
+  files_rewritten += that.files_rewritten;
+  bytes_rewritten += that.bytes_rewritten;
+  values_changed += that.values_changed;
+  return *this;
+}
+
+namespace {
+
+// Whether any 4-byte aligned word of the file is one of the ids. Every
+// resource id that a binary XML file refers to, in its resource map or in an
+// attribute value, sits at such a word, so a file without any can be skipped
+// without parsing it.
+template <typename IdMap>
+bool may_reference_any(const void* data, size_t length, const IdMap& ids) {
+  auto words = static_cast<const uint32_t*>(data);
+  for (size_t i = 0; i < length / sizeof(uint32_t); ++i) {
+    uint32_t word = dtohl(words[i]);
+    if (word > PACKAGE_RESID_START && ids.count(word)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Maps the file in and, unless the prescan rules it out, lets `rewrite`
+// change a copy of its contents. The number of values `rewrite` returns to
+// have changed is recorded, and a changed copy replaces the file through a
+// rename so that a file is never left half written.
+template <typename IdMap, typename Rewrite>
+XmlRewriteStats rewrite_xml_file(const std::string& filename,
+                                 const IdMap& ids,
+                                 const Rewrite& rewrite) {
+  XmlRewriteStats stats;
+  stats.files_scanned = 1;
+  if (boost::filesystem::file_size(filename) == 0) {
+    ensure_file_contents(std::string(), filename);
+  }
+  int file_descriptor;
+  size_t length;
+  void* data = map_file(filename.c_str(), &file_descriptor, &length);
+  if (!may_reference_any(data, length, ids)) {
+    unmap_and_close(file_descriptor, data, length);
+    stats.files_skipped = 1;
+    return stats;
+  }
+  std::string file_contents(static_cast<const char*>(data), length);
+  unmap_and_close(file_descriptor, data, length);
+
+  bool made_change = false;
+  stats.values_changed = rewrite(filename, &file_contents, &made_change);
+  if (made_change) {
+    auto tmp = filename + ".tmp";
+    write_entire_file(tmp, file_contents);
+    boost::filesystem::rename(tmp, filename);
+    stats.files_rewritten = 1;
+    stats.bytes_rewritten = file_contents.size();
+  }
+  return stats;
+}
+
+template <typename Rewrite>
+XmlRewriteStats rewrite_xml_files(const std::vector<std::string>& filenames,
+                                  const Rewrite& rewrite_one) {
+  std::vector<XmlRewriteStats> results(filenames.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { results[i] = rewrite_one(filenames[i]); });
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  XmlRewriteStats stats;
+  for (const auto& result : results) {
+    stats += result;
+  }
+  return stats;
+}
+
+size_t inline_xml_reference_attributes_in(
     const std::string& filename,
+    std::string* file_contents,
+    bool* made_change,
     const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
-  int num_values_inlined = 0;
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
+  size_t num_values_inlined = 0;
 
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file_contents->data(), file_contents->size());
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -852,7 +1076,7 @@ int inline_xml_reference_attributes(
             android::Res_value new_value = p->second;
             parser.setAttribute(i, new_value);
             ++num_values_inlined;
-            made_change = true;
+            *made_change = true;
           }
         }
       }
@@ -860,25 +1084,18 @@ int inline_xml_reference_attributes(
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
-  }
-
   return num_values_inlined;
 }
 
-void remap_xml_reference_attributes(
+size_t remap_xml_reference_attributes_in(
     const std::string& filename,
+    std::string* file_contents,
+    bool* made_change,
     const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
-  if (is_raw_resource(filename)) {
-    return;
-  }
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
+  size_t num_values_remapped = 0;
 
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file_contents->data(), file_contents->size());
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -890,7 +1107,7 @@ void remap_xml_reference_attributes(
     auto id_search = kept_to_remapped_ids.find(resourceIds[i]);
     if (id_search != kept_to_remapped_ids.end()) {
       resourceIds[i] = id_search->second;
-      made_change = true;
+      *made_change = true;
     }
   }
 
@@ -909,7 +1126,8 @@ void remap_xml_reference_attributes(
             uint32_t new_value = kept_to_remapped_ids.at(outValue.data);
             if (new_value != outValue.data) {
               parser.setAttributeData(i, new_value);
-              made_change = true;
+              ++num_values_remapped;
+              *made_change = true;
             }
           }
         }
@@ -918,9 +1136,65 @@ void remap_xml_reference_attributes(
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
+  return num_values_remapped;
+}
+
+XmlRewriteStats inline_xml_reference_attributes_in_file(
+    const std::string& filename,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  return rewrite_xml_file(
+      filename, id_to_inline_value,
+      [&](const std::string& name, std::string* contents, bool* made_change) {
+        return inline_xml_reference_attributes_in(name, contents, made_change,
+                                                  id_to_inline_value);
+      });
+}
+
+XmlRewriteStats remap_xml_reference_attributes_in_file(
+    const std::string& filename,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
+  if (is_raw_resource(filename)) {
+    return XmlRewriteStats();
   }
+  return rewrite_xml_file(
+      filename, kept_to_remapped_ids,
+      [&](const std::string& name, std::string* contents, bool* made_change) {
+        return remap_xml_reference_attributes_in(name, contents, made_change,
+                                                 kept_to_remapped_ids);
+      });
+}
+
+} // namespace
+
+int inline_xml_reference_attributes(
+    const std::string& filename,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  return inline_xml_reference_attributes_in_file(filename, id_to_inline_value)
+      .values_changed;
+}
+
+XmlRewriteStats inline_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  return rewrite_xml_files(filenames, [&](const std::string& filename) {
+    return inline_xml_reference_attributes_in_file(filename,
+                                                   id_to_inline_value);
+  });
+}
+
+void remap_xml_reference_attributes(
+    const std::string& filename,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
+  remap_xml_reference_attributes_in_file(filename, kept_to_remapped_ids);
+}
+
+XmlRewriteStats remap_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
+  return rewrite_xml_files(filenames, [&](const std::string& filename) {
+    return remap_xml_reference_attributes_in_file(filename,
+                                                  kept_to_remapped_ids);
+  });
 }
 
 std::vector<std::string> find_layout_files(const std::string& apk_directory) {
@@ -950,17 +1224,97 @@ std::vector<std::string> find_layout_files(const std::string& apk_directory) {
   return layout_files;
 }
 
+namespace {
+
+struct LayoutScanResult {
+  std::vector<std::string> classes;
+  std::vector<std::pair<std::string, std::string>> attributes;
+};
+
+constexpr int kLayoutCacheVersion = 1;
+
+// Results of scanning layouts, keyed by the SHA1 of a layout's contents and the
+// attributes that were read from it. Layouts are scanned again after passes
+// rename classes, but most of them do not change.
+std::mutex s_layout_cache_lock;
+std::unordered_map<std::string, LayoutScanResult> s_layout_cache;
+
+std::string layout_cache_key(const char* data,
+                             size_t size,
+                             const std::string& attributes_key) {
+  Sha1Context context;
+  unsigned char digest[20];
+  sha1_init(&context);
+  sha1_update(&context, reinterpret_cast<const unsigned char*>(data), size);
+  sha1_final(digest, &context);
+  std::ostringstream ss;
+  for (auto byte : digest) {
+    ss << std::hex << std::setw(2) << std::setfill('0') << unsigned(byte);
+  }
+  ss << '|' << attributes_key;
+  return ss.str();
+}
+
+LayoutScanResult scan_layout(
+    const std::string& file_path,
+    const std::unordered_set<std::string>& attributes_to_read,
+    const std::string& attributes_key) {
+  LayoutScanResult result;
+  if (boost::filesystem::file_size(file_path) == 0) {
+    return result;
+  }
+  int file_descriptor;
+  size_t length;
+  auto data = static_cast<const char*>(
+      map_file(file_path.c_str(), &file_descriptor, &length));
+  auto key = layout_cache_key(data, length, attributes_key);
+  {
+    std::lock_guard<std::mutex> lock(s_layout_cache_lock);
+    auto it = s_layout_cache.find(key);
+    if (it != s_layout_cache.end()) {
+      result = it->second;
+      unmap_and_close(file_descriptor, const_cast<char*>(data), length);
+      return result;
+    }
+  }
+  extract_classes_from_layout(
+      data, length, attributes_to_read,
+      [&](std::string cls) { result.classes.push_back(std::move(cls)); },
+      [&](const std::string& attr, std::string value) {
+        result.attributes.emplace_back(attr, std::move(value));
+      });
+  unmap_and_close(file_descriptor, const_cast<char*>(data), length);
+  std::lock_guard<std::mutex> lock(s_layout_cache_lock);
+  s_layout_cache.emplace(std::move(key), result);
+  return result;
+}
+
+std::string get_attributes_key(
+    const std::unordered_set<std::string>& attributes_to_read) {
+  std::vector<std::string> attributes(attributes_to_read.begin(),
+                                      attributes_to_read.end());
+  std::sort(attributes.begin(), attributes.end());
+  return boost::algorithm::join(attributes, ",");
+}
+
+void add_scan_result(
+    const LayoutScanResult& result,
+    std::unordered_set<std::string>& out_classes,
+    std::unordered_multimap<std::string, std::string>& out_attributes) {
+  out_classes.insert(result.classes.begin(), result.classes.end());
+  out_attributes.insert(result.attributes.begin(), result.attributes.end());
+}
+
+} // namespace
+
 void collect_layout_classes_and_attributes_for_file(
     const std::string& file_path,
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
-  std::string contents = read_entire_file(file_path);
-  extract_classes_from_layout(
-    contents,
-    attributes_to_read,
-    out_classes,
-    out_attributes);
+  add_scan_result(scan_layout(file_path, attributes_to_read,
+                              get_attributes_key(attributes_to_read)),
+                  out_classes, out_attributes);
 }
 
 void collect_layout_classes_and_attributes(
@@ -969,13 +1323,83 @@ void collect_layout_classes_and_attributes(
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
   std::vector<std::string> files = find_layout_files(apk_directory);
-  for (auto layout_file : files) {
-    collect_layout_classes_and_attributes_for_file(
-      layout_file,
-      attributes_to_read,
-      out_classes,
-      out_attributes);
+  auto attributes_key = get_attributes_key(attributes_to_read);
+  std::vector<LayoutScanResult> results(files.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    results[i] = scan_layout(files[i], attributes_to_read, attributes_key);
+  });
+  for (size_t i = 0; i < files.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  for (const auto& result : results) {
+    add_scan_result(result, out_classes, out_attributes);
+  }
+}
+
+void load_layout_cache(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    return;
+  }
+  Json::Value root;
+  try {
+    in >> root;
+  } catch (const std::exception& e) {
+    fprintf(stderr, "WARNING: ignoring unreadable layout cache %s\n",
+            path.c_str());
+    return;
+  }
+  if (root.get("version", 0).asInt() != kLayoutCacheVersion) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(s_layout_cache_lock);
+  const auto& entries = root["entries"];
+  for (const auto& key : entries.getMemberNames()) {
+    const auto& entry = entries[key];
+    LayoutScanResult result;
+    for (const auto& cls : entry["classes"]) {
+      result.classes.push_back(cls.asString());
+    }
+    for (const auto& attr : entry["attributes"]) {
+      result.attributes.emplace_back(attr[0].asString(), attr[1].asString());
+    }
+    s_layout_cache.emplace(key, std::move(result));
+  }
+}
+
+void save_layout_cache(const std::string& path) {
+  Json::Value root;
+  root["version"] = kLayoutCacheVersion;
+  Json::Value entries(Json::objectValue);
+  {
+    std::lock_guard<std::mutex> lock(s_layout_cache_lock);
+    for (const auto& pair : s_layout_cache) {
+      Json::Value entry;
+      entry["classes"] = Json::arrayValue;
+      for (const auto& cls : pair.second.classes) {
+        entry["classes"].append(cls);
+      }
+      entry["attributes"] = Json::arrayValue;
+      for (const auto& attr : pair.second.attributes) {
+        Json::Value value(Json::arrayValue);
+        value.append(attr.first);
+        value.append(attr.second);
+        entry["attributes"].append(value);
+      }
+      entries[pair.first] = entry;
+    }
+  }
+  root["entries"] = entries;
+  // Write a copy and rename it into place, so that an interrupted run never
+  // leaves a partial cache behind.
+  auto tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp);
+    Json::FastWriter writer;
+    out << writer.write(root);
   }
+  boost::filesystem::rename(tmp, path);
 }
 
 std::unordered_set<std::string> get_layout_classes(const std::string& apk_directory) {
@@ -1031,11 +1455,30 @@ std::vector<std::string> find_native_library_files(const std::string& apk_direct
  */
 std::unordered_set<std::string> get_native_classes(const std::string& apk_directory) {
   std::vector<std::string> native_libs = find_native_library_files(apk_directory);
+  std::vector<std::unordered_set<std::string>> lib_classes(native_libs.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    if (boost::filesystem::file_size(native_libs[i]) == 0) {
+      return;
+    }
+    int file_descriptor;
+    size_t length;
+    void* fp = map_file(native_libs[i].c_str(), &file_descriptor, &length);
+    auto data = static_cast<const uint8_t*>(fp);
+    for (const auto& range : get_native_string_ranges(data, length)) {
+      extract_classes_from_native_lib(
+          reinterpret_cast<const char*>(data + range.first),
+          reinterpret_cast<const char*>(data + range.second),
+          &lib_classes[i]);
+    }
+    unmap_and_close(file_descriptor, fp, length);
+  });
+  for (size_t i = 0; i < native_libs.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
   std::unordered_set<std::string> all_classes;
-  for (auto native_lib : native_libs) {
-    std::string contents = read_entire_file(native_lib);
-    std::unordered_set<std::string> classes_from_layout = extract_classes_from_native_lib(contents);
-    all_classes.insert(classes_from_layout.begin(), classes_from_layout.end());
+  for (const auto& classes : lib_classes) {
+    all_classes.insert(classes.begin(), classes.end());
   }
   return all_classes;
 }
@@ -1071,6 +1514,190 @@ void unmap_and_close(int file_descriptor, void* file_pointer, size_t length) {
   close(file_descriptor);
 }
 
+namespace {
+
+// Calls `f` on each chunk between `begin` and `end` of `data`.
+template <typename F>
+void for_each_chunk(const uint8_t* data, size_t begin, size_t end, const F& f) {
+  size_t offset = begin;
+  while (offset + sizeof(android::ResChunk_header) <= end) {
+    auto chunk =
+        reinterpret_cast<const android::ResChunk_header*>(data + offset);
+    size_t size = dtohl(chunk->size);
+    always_assert_log(size >= dtohs(chunk->headerSize) &&
+                          size >= sizeof(android::ResChunk_header) &&
+                          offset + size <= end,
+                      "Malformed resource chunk at offset %zu", offset);
+    f(chunk);
+    offset += size;
+  }
+}
+
+} // namespace
+
+ResourceTableView::ResourceTableView(const std::string& path) {
+  m_data = map_file(path.c_str(), &m_file_descriptor, &m_length);
+  auto data = static_cast<const uint8_t*>(m_data);
+  auto header = reinterpret_cast<const android::ResTable_header*>(data);
+  always_assert_log(m_length >= sizeof(android::ResTable_header) &&
+                        dtohs(header->header.type) == android::RES_TABLE_TYPE,
+                    "%s is not a resource table", path.c_str());
+  size_t table_size = std::min<size_t>(dtohl(header->header.size), m_length);
+  bool found_strings = false;
+  for_each_chunk(
+      data, dtohs(header->header.headerSize), table_size,
+      [&](const android::ResChunk_header* chunk) {
+        auto type = dtohs(chunk->type);
+        if (type == android::RES_STRING_POOL_TYPE && !found_strings) {
+          always_assert(m_strings.setTo(chunk, dtohl(chunk->size)) ==
+                        android::NO_ERROR);
+          found_strings = true;
+        } else if (type == android::RES_TABLE_PACKAGE_TYPE) {
+          auto package = reinterpret_cast<const android::ResTable_package*>(
+              chunk);
+          auto& types = m_types[static_cast<uint8_t>(dtohl(package->id))];
+          auto package_data = reinterpret_cast<const uint8_t*>(chunk);
+          for_each_chunk(
+              package_data, dtohs(chunk->headerSize), dtohl(chunk->size),
+              [&](const android::ResChunk_header* child) {
+                if (dtohs(child->type) != android::RES_TABLE_TYPE_TYPE) {
+                  return;
+                }
+                auto type_chunk =
+                    reinterpret_cast<const android::ResTable_type*>(child);
+                always_assert(type_chunk->id > 0);
+                if (types.size() < type_chunk->id) {
+                  types.resize(type_chunk->id);
+                }
+                types[type_chunk->id - 1].push_back(type_chunk);
+              });
+        }
+      });
+}
+
+ResourceTableView::~ResourceTableView() {
+  // The string pool points into the mapped file.
+  m_strings.uninit();
+  unmap_and_close(m_file_descriptor, m_data, m_length);
+}
+
+const std::vector<const android::ResTable_type*>*
+ResourceTableView::get_configs(uint32_t res_id) const {
+  auto it = m_types.find(static_cast<uint8_t>(res_id >> 24));
+  if (it == m_types.end()) {
+    return nullptr;
+  }
+  size_t type_id = (res_id >> 16) & 0xFF;
+  if (type_id == 0 || type_id > it->second.size()) {
+    return nullptr;
+  }
+  return &it->second[type_id - 1];
+}
+
+namespace {
+
+// The entry of the resource in the configuration of `type`, if it has one.
+const android::ResTable_entry* get_entry(const android::ResTable_type* type,
+                                         uint32_t res_id) {
+  size_t entry_index = res_id & 0xFFFF;
+  if (entry_index >= dtohl(type->entryCount)) {
+    return nullptr;
+  }
+  auto type_data = reinterpret_cast<const uint8_t*>(type);
+  auto offsets = reinterpret_cast<const uint32_t*>(
+      type_data + dtohs(type->header.headerSize));
+  uint32_t offset = dtohl(offsets[entry_index]);
+  if (offset == android::ResTable_type::NO_ENTRY) {
+    return nullptr;
+  }
+  size_t entry_start = dtohl(type->entriesStart) + offset;
+  if (entry_start + sizeof(android::ResTable_entry) >
+      dtohl(type->header.size)) {
+    return nullptr;
+  }
+  return reinterpret_cast<const android::ResTable_entry*>(type_data +
+                                                          entry_start);
+}
+
+// Like Res_value::copyFrom_dtoh, which is inline in ResourceTypes.cpp.
+android::Res_value value_from_dtoh(const android::Res_value& src) {
+  android::Res_value value;
+  value.size = dtohs(src.size);
+  value.res0 = src.res0;
+  value.dataType = src.dataType;
+  value.data = dtohl(src.data);
+  return value;
+}
+
+} // namespace
+
+bool ResourceTableView::has_resource(uint32_t res_id) const {
+  auto configs = get_configs(res_id);
+  if (configs == nullptr) {
+    return false;
+  }
+  for (auto type : *configs) {
+    if (get_entry(type, res_id) != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ResourceTableView::get_all_values(
+    uint32_t res_id, std::vector<android::Res_value>* values) const {
+  auto configs = get_configs(res_id);
+  if (configs == nullptr) {
+    return;
+  }
+  for (auto type : *configs) {
+    auto entry = get_entry(type, res_id);
+    if (entry == nullptr) {
+      continue;
+    }
+    auto entry_data = reinterpret_cast<const uint8_t*>(entry);
+    size_t entry_size = dtohs(entry->size);
+    if ((dtohs(entry->flags) & android::ResTable_entry::FLAG_COMPLEX) == 0) {
+      values->push_back(value_from_dtoh(
+          *reinterpret_cast<const android::Res_value*>(entry_data +
+                                                       entry_size)));
+      continue;
+    }
+    // As in ResTable, the parent and the attribute names of a bag are
+    // returned as values with size 0.
+    auto bag = reinterpret_cast<const android::ResTable_map_entry*>(entry);
+    android::Res_value virtual_value;
+    virtual_value.size = 0;
+    virtual_value.res0 = 0;
+    virtual_value.dataType = android::Res_value::TYPE_REFERENCE;
+    virtual_value.data = dtohl(bag->parent.ident);
+    values->push_back(virtual_value);
+    // The bytes of the type chunk from the start of the entry.
+    size_t map_end = dtohl(type->header.size) -
+                     (entry_data - reinterpret_cast<const uint8_t*>(type));
+    size_t map_offset = entry_size;
+    uint32_t count = dtohl(bag->count);
+    for (uint32_t i = 0; i < count; ++i) {
+      if (map_offset + sizeof(android::ResTable_map) > map_end) {
+        break;
+      }
+      auto map = reinterpret_cast<const android::ResTable_map*>(entry_data +
+                                                                map_offset);
+      values->push_back(value_from_dtoh(map->value));
+      virtual_value.dataType = android::Res_value::TYPE_ATTRIBUTE;
+      virtual_value.data = dtohl(map->name.ident);
+      values->push_back(virtual_value);
+      map_offset += dtohs(map->value.size) + sizeof(android::ResTable_map) -
+                    sizeof(android::Res_value);
+    }
+  }
+}
+
+std::string ResourceTableView::get_string(uint32_t string_index) const {
+  android::String8 str = m_strings.string8ObjectAt(string_index);
+  return std::string(str.string());
+}
+
 size_t write_serialized_data(const android::Vector<char>& cVec,
                              int file_descriptor,
                              void* file_pointer,
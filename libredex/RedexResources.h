@@ -103,6 +103,28 @@ void remap_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
 
+struct XmlRewriteStats {
+  size_t files_scanned{0};
+  // Files that mention none of the ids, and so were not parsed.
+  size_t files_skipped{0};
+  size_t files_rewritten{0};
+  size_t bytes_rewritten{0};
+  // Attribute values that were inlined or remapped.
+  size_t values_changed{0};
+
+  XmlRewriteStats& operator+=(const XmlRewriteStats& that);
+};
+
+// As above, but rewrites the files in parallel. A file that does not contain
+// any of the ids is not parsed, and a changed file is replaced through a
+// rename.
+XmlRewriteStats inline_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value);
+XmlRewriteStats remap_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
+
 // Iterates through all layouts in the given directory. Adds all class names to
 // the output set, and allows for any specified attribute values to be returned
 // as well. Attribute names should specify their namespace, if any (so
@@ -120,6 +142,12 @@ void collect_layout_classes_and_attributes_for_file(
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes);
 
+// Layouts are scanned on all threads, and what was found in each is cached in
+// memory by the hash of its contents. These load and save that cache, so that
+// the next run does not parse the layouts that did not change.
+void load_layout_cache(const std::string& path);
+void save_layout_cache(const std::string& path);
+
 // Convenience method for copying values in a multimap to a set, for a
 // particular key.
 std::set<std::string> multimap_values_to_set(
@@ -156,6 +184,57 @@ void walk_references_for_resource(
     std::unordered_set<uint32_t>* nodes_visited,
     std::unordered_set<std::string>* leaf_string_values);
 
+/**
+ * A read-only view of a resources.arsc file that is mapped into memory rather
+ * than loaded into a ResTable. Building it only records where the type chunks
+ * of each package start; the entries of a resource are read straight from the
+ * mapped file through the entry offsets of each of its configurations.
+ *
+ * This is much cheaper than android::ResTable::add for the lookups Redex
+ * does on a large table, but does not resolve overlays, shared libraries or
+ * configurations.
+ */
+class ResourceTableView {
+ public:
+  explicit ResourceTableView(const std::string& path);
+  ~ResourceTableView();
+
+  ResourceTableView(const ResourceTableView&) = delete;
+  ResourceTableView& operator=(const ResourceTableView&) = delete;
+
+  // Whether any configuration defines the resource.
+  bool has_resource(uint32_t res_id) const;
+
+  // Appends the values of the resource in all its configurations, in the
+  // same way as android::ResTable::getAllValuesForResource.
+  void get_all_values(uint32_t res_id,
+                      std::vector<android::Res_value>* values) const;
+
+  // The string at the index of a TYPE_STRING value.
+  std::string get_string(uint32_t string_index) const;
+
+ private:
+  // The type chunks of a resource, one per configuration.
+  const std::vector<const android::ResTable_type*>* get_configs(
+      uint32_t res_id) const;
+
+  int m_file_descriptor;
+  void* m_data;
+  size_t m_length;
+  android::ResStringPool m_strings;
+  // Package id -> type id - 1 -> the type chunks of each configuration.
+  std::unordered_map<
+      uint8_t,
+      std::vector<std::vector<const android::ResTable_type*>>>
+      m_types;
+};
+
+void walk_references_for_resource(
+    const ResourceTableView& table,
+    uint32_t resID,
+    std::unordered_set<uint32_t>* nodes_visited,
+    std::unordered_set<std::string>* leaf_string_values);
+
 std::unordered_set<uint32_t> get_js_resources(
     const std::string& directory,
     const std::vector<std::string>& js_assets_lists,
@@ -217,7 +217,7 @@ class ReferencedState {
   // these string references, and potentially eliminate dead resource .xml files
   void set_referenced_by_resource_xml() {
     inner_struct.m_by_resources = true;
-    if (RedexContext::record_keep_reasons()) {
+    if (should_record_keep_reasons()) {
       add_keep_reason(RedexContext::make_keep_reason(keep_reason::XML));
     }
   }
@@ -257,7 +257,7 @@ class ReferencedState {
     inner_struct.m_keep = true;
     unset_allowshrinking();
     unset_allowobfuscation();
-    if (RedexContext::record_keep_reasons()) {
+    if (should_record_keep_reasons()) {
       add_keep_reason(
           RedexContext::make_keep_reason(std::forward<Args>(args)...));
     }
@@ -270,7 +270,7 @@ class ReferencedState {
   template <class... Args>
   void set_has_keep(Args&&... args) {
     inner_struct.m_keep = true;
-    if (RedexContext::record_keep_reasons()) {
+    if (should_record_keep_reasons()) {
       add_keep_reason(
           RedexContext::make_keep_reason(std::forward<Args>(args)...));
     }
@@ -336,6 +336,14 @@ class ReferencedState {
   void set_dont_inline() { inner_struct.m_dont_inline = true; }
 
  private:
+  // ProguardMatcher applies the -whyareyoukeeping rules before any others, so
+  // the objects they name are known by the time their reasons are recorded.
+  bool should_record_keep_reasons() const {
+    return RedexContext::record_keep_reasons() &&
+           (!RedexContext::record_keep_reasons_only_for_whyareyoukeeping() ||
+            report_whyareyoukeeping());
+  }
+
   void add_keep_reason(const keep_reason::Reason* reason) {
     always_assert(RedexContext::record_keep_reasons());
     std::lock_guard<std::mutex> lock(m_keep_reasons_mtx);
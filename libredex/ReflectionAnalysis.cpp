@@ -13,6 +13,7 @@
 #include <boost/optional.hpp>
 
 #include "BaseIRAnalyzer.h"
+#include "CallGraph.h"
 #include "ControlFlow.h"
 #include "DexUtil.h"
 #include "FiniteAbstractDomain.h"
@@ -21,6 +22,7 @@
 #include "IROpcode.h"
 #include "PatriciaTreeMapAbstractEnvironment.h"
 #include "ReducedProductAbstractDomain.h"
+#include "Resolver.h"
 #include "Show.h"
 
 using namespace sparta;
@@ -213,6 +215,74 @@ namespace impl {
 using register_t = ir_analyzer::register_t;
 using namespace ir_analyzer;
 
+// Whether the callers of the method can use a summary of what it returns.
+bool is_summarizable(const DexMethod* method) {
+  if (method->get_code() == nullptr) {
+    return false;
+  }
+  if (method->is_virtual() && !is_final(method)) {
+    auto cls = type_class(method->get_class());
+    if (cls == nullptr || !is_final(cls)) {
+      return false;
+    }
+  }
+  auto rtype = method->get_proto()->get_rtype();
+  return rtype == get_class_type() || rtype == get_string_type() ||
+         rtype == DexType::get_type("Ljava/lang/reflect/Field;") ||
+         rtype == DexType::get_type("Ljava/lang/reflect/Method;") ||
+         rtype == DexType::get_type("Ljava/lang/reflect/Constructor;");
+}
+
+// The method that the invoke calls, if it is the only one and may have a
+// summary.
+DexMethod* resolve_summarizable_callee(const IRInstruction* insn) {
+  if (insn->opcode() == OPCODE_INVOKE_INTERFACE) {
+    return nullptr;
+  }
+  auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+  if (callee == nullptr || !is_summarizable(callee)) {
+    return nullptr;
+  }
+  return callee;
+}
+
+// The call graph of the methods that may have a summary.
+class SummarizableCallees final : public call_graph::BuildStrategy {
+ public:
+  explicit SummarizableCallees(const Scope& scope) : m_scope(scope) {}
+
+  call_graph::CallSites get_callsites(const DexMethod* method) const override {
+    call_graph::CallSites callsites;
+    auto* code = const_cast<IRCode*>(method->get_code());
+    if (code == nullptr || !is_summarizable(method)) {
+      return callsites;
+    }
+    for (auto& mie : InstructionIterable(code)) {
+      if (!is_invoke(mie.insn->opcode())) {
+        continue;
+      }
+      auto callee = resolve_summarizable_callee(mie.insn);
+      if (callee != nullptr) {
+        callsites.emplace_back(callee, code->iterator_to(mie));
+      }
+    }
+    return callsites;
+  }
+
+  std::vector<DexMethod*> get_roots() const override {
+    std::vector<DexMethod*> roots;
+    walk::methods(m_scope, [&](DexMethod* method) {
+      if (is_summarizable(method)) {
+        roots.push_back(method);
+      }
+    });
+    return roots;
+  }
+
+ private:
+  const Scope& m_scope;
+};
+
 class AbstractObjectDomain final
     : public sparta::AbstractDomainScaffolding<AbstractObject,
                                                AbstractObjectDomain> {
@@ -278,8 +348,8 @@ class AbstractObjectEnvironment final
 
 class Analyzer final : public BaseIRAnalyzer<AbstractObjectEnvironment> {
  public:
-  explicit Analyzer(const cfg::ControlFlowGraph& cfg)
-      : BaseIRAnalyzer(cfg), m_cfg(cfg) {}
+  Analyzer(const cfg::ControlFlowGraph& cfg, const SummaryMap* summaries)
+      : BaseIRAnalyzer(cfg), m_cfg(cfg), m_summaries(summaries) {}
 
   void run(DexMethod* dex_method) {
     // We need to compute the initial environment by assigning the parameter
@@ -520,8 +590,32 @@ class Analyzer final : public BaseIRAnalyzer<AbstractObjectEnvironment> {
     return it->second.get_class_source(reg).get_constant();
   }
 
+  boost::optional<ReflectionAbstractObject> get_return_value() const {
+    auto aobj = AbstractObjectDomain::bottom();
+    auto cls_src = ClassObjectSourceDomain::bottom();
+    for (cfg::Block* block : m_cfg.blocks()) {
+      for (auto& mie : InstructionIterable(block)) {
+        if (mie.insn->opcode() != OPCODE_RETURN_OBJECT) {
+          continue;
+        }
+        const auto& env = m_environments.at(mie.insn);
+        aobj.join_with(env.get_abstract_obj(mie.insn->src(0)));
+        cls_src.join_with(env.get_class_source(mie.insn->src(0)));
+      }
+    }
+    auto obj = aobj.get_object();
+    if (!obj) {
+      return boost::none;
+    }
+    return ReflectionAbstractObject(*obj,
+                                    obj->obj_kind == AbstractObjectKind::CLASS
+                                        ? cls_src.get_constant()
+                                        : boost::none);
+  }
+
  private:
   const cfg::ControlFlowGraph& m_cfg;
+  const SummaryMap* m_summaries;
   std::unordered_map<IRInstruction*, AbstractObjectEnvironment> m_environments;
 
   void update_non_string_input(AbstractObjectEnvironment* current_state,
@@ -550,6 +644,21 @@ class Analyzer final : public BaseIRAnalyzer<AbstractObjectEnvironment> {
     if (is_void(return_type) || !is_object(return_type)) {
       return;
     }
+    if (m_summaries != nullptr) {
+      // The summaries of other components may be added concurrently, so look
+      // them up under the lock.
+      auto summarized = resolve_summarizable_callee(insn);
+      if (summarized != nullptr && m_summaries->count(summarized) != 0) {
+        auto summary = m_summaries->at(summarized);
+        current_state->set_abstract_obj(RESULT_REGISTER,
+                                        AbstractObjectDomain(summary.first));
+        current_state->set_class_source(
+            RESULT_REGISTER,
+            summary.second ? ClassObjectSourceDomain(*summary.second)
+                           : ClassObjectSourceDomain::top());
+        return;
+      }
+    }
     update_non_string_input(current_state, insn, return_type);
   }
 
@@ -765,7 +874,8 @@ class Analyzer final : public BaseIRAnalyzer<AbstractObjectEnvironment> {
 
 ReflectionAnalysis::~ReflectionAnalysis() {}
 
-ReflectionAnalysis::ReflectionAnalysis(DexMethod* dex_method)
+ReflectionAnalysis::ReflectionAnalysis(DexMethod* dex_method,
+                                       const SummaryMap* summaries)
     : m_dex_method(dex_method) {
   always_assert(dex_method != nullptr);
   IRCode* code = dex_method->get_code();
@@ -775,7 +885,7 @@ ReflectionAnalysis::ReflectionAnalysis(DexMethod* dex_method)
   code->build_cfg(/* editable */ false);
   cfg::ControlFlowGraph& cfg = code->cfg();
   cfg.calculate_exit_block();
-  m_analyzer = std::make_unique<impl::Analyzer>(cfg);
+  m_analyzer = std::make_unique<impl::Analyzer>(cfg, summaries);
   m_analyzer->run(dex_method);
 }
 
@@ -844,4 +954,32 @@ boost::optional<AbstractObject> ReflectionAnalysis::get_abstract_object(
   return m_analyzer->get_abstract_object(reg, insn);
 }
 
+boost::optional<ReflectionAbstractObject>
+ReflectionAnalysis::get_return_value() const {
+  if (m_analyzer == nullptr) {
+    return boost::none;
+  }
+  return m_analyzer->get_return_value();
+}
+
+SummaryMap compute_summaries(const Scope& scope) {
+  SummaryMap summaries;
+  auto graph = call_graph::build_graph_in_parallel(
+      scope, impl::SummarizableCallees(scope));
+  call_graph::Sccs sccs(graph);
+  call_graph::parallel_bottom_up(sccs, [&](call_graph::Sccs::SccId id) {
+    if (sccs.is_recursive(id)) {
+      return;
+    }
+    for (auto* method : sccs.members(id)) {
+      ReflectionAnalysis analysis(method, &summaries);
+      auto return_value = analysis.get_return_value();
+      if (return_value) {
+        summaries.emplace(method, *return_value);
+      }
+    }
+  });
+  return summaries;
+}
+
 } // namespace reflection
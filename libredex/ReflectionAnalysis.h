@@ -13,6 +13,7 @@
 #include <boost/optional.hpp>
 
 #include "AbstractDomain.h"
+#include "ConcurrentContainers.h"
 #include "ConstantAbstractDomain.h"
 #include "DexClass.h"
 #include "IRInstruction.h"
@@ -151,6 +152,25 @@ using ReflectionAbstractObject =
 using ReflectionSites = std::vector<
     std::pair<IRInstruction*, std::map<register_t, ReflectionAbstractObject>>>;
 
+/*
+ * The abstract object that a method returns, for the analysis of its callers.
+ */
+using SummaryMap = ConcurrentMap<const DexMethod*, ReflectionAbstractObject>;
+
+/*
+ * Summarizes the methods of the scope that return a java.lang.Class, a
+ * String, or a java.lang.reflect.Field, Method or Constructor, so that the
+ * reflective values that flow out of helper methods are not lost:
+ *
+ *   static Class<?> helper() { return Class.forName("Foo"); } --> CLASS(Foo)
+ *
+ * The methods are analyzed bottom-up along the call graph, in parallel, each
+ * one using the summaries of its callees. Only the calls that resolve to a
+ * single method are summarized, and the methods of recursive components get
+ * no summary.
+ */
+SummaryMap compute_summaries(const Scope& scope);
+
 class ReflectionAnalysis final {
  public:
   // If we don't declare a destructor for this class, a default destructor will
@@ -160,7 +180,10 @@ class ReflectionAnalysis final {
   // sra_impl::Analyzer.
   ~ReflectionAnalysis();
 
-  explicit ReflectionAnalysis(DexMethod* dex_method);
+  // The calls to methods in `summaries` (see compute_summaries) return the
+  // abstract objects of the summaries.
+  explicit ReflectionAnalysis(DexMethod* dex_method,
+                              const SummaryMap* summaries = nullptr);
 
   const ReflectionSites get_reflection_sites() const;
 
@@ -178,6 +201,12 @@ class ReflectionAnalysis final {
   boost::optional<ClassObjectSource> get_class_source(
       size_t reg, IRInstruction* insn) const;
 
+  /*
+   * The join of the abstract objects that the method returns, if it is an
+   * abstract object.
+   */
+  boost::optional<ReflectionAbstractObject> get_return_value() const;
+
  private:
   const DexMethod* m_dex_method;
   std::unique_ptr<impl::Analyzer> m_analyzer;
@@ -7,6 +7,7 @@
 
 #include "Resolver.h"
 #include "DexUtil.h"
+#include "RedexContext.h"
 
 namespace {
 
@@ -158,3 +159,50 @@ DexMethod* find_top_intf_impl(
   }
   return top_impl;
 }
+
+size_t ResolverCache::current_epoch() const {
+  // Every counter only ever goes up, so the sum moves whenever any of them
+  // does.
+  return m_epoch.load(std::memory_order_relaxed) +
+         g_redex->get_member_epoch() + g_redex->get_rename_epoch();
+}
+
+DexMethod* ResolverCache::resolve_method(DexMethodRef* method,
+                                         MethodSearch search) {
+  if (method->is_def()) {
+    return static_cast<DexMethod*>(method);
+  }
+  MethodKey key{method, search};
+  auto epoch = current_epoch();
+  auto entry = m_methods.get(key, Entry<DexMethod>());
+  if (entry.epoch == epoch) {
+    return entry.def;
+  }
+  auto def = ::resolve_method(method, search);
+  m_methods.insert_or_assign(std::make_pair(key, Entry<DexMethod>{def, epoch}));
+  return def;
+}
+
+DexField* ResolverCache::resolve_field(const DexFieldRef* field,
+                                       FieldSearch search) {
+  if (field->is_def()) {
+    return const_cast<DexField*>(static_cast<const DexField*>(field));
+  }
+  FieldKey key{field, search};
+  auto epoch = current_epoch();
+  auto entry = m_fields.get(key, Entry<DexField>());
+  if (entry.epoch == epoch) {
+    return entry.def;
+  }
+  auto def = ::resolve_field(field, search);
+  m_fields.insert_or_assign(std::make_pair(key, Entry<DexField>{def, epoch}));
+  return def;
+}
+
+DexMethod* resolve_method_cached(DexMethodRef* method, MethodSearch search) {
+  return g_redex->resolver_cache().resolve_method(method, search);
+}
+
+DexField* resolve_field_cached(const DexFieldRef* field, FieldSearch search) {
+  return g_redex->resolver_cache().resolve_field(field, search);
+}
@@ -7,10 +7,13 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRInstruction.h"
 
+#include <atomic>
+#include <boost/functional/hash.hpp>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -40,8 +43,7 @@ enum class MethodSearch {
 /**
  * Helper to map an opcode to a MethodSearch rule.
  */
-inline MethodSearch opcode_to_search(const IRInstruction* insn) {
-  auto opcode = insn->opcode();
+inline MethodSearch opcode_to_search(IROpcode opcode) {
   always_assert(is_invoke(opcode));
   switch (opcode) {
   case OPCODE_INVOKE_DIRECT:
@@ -58,6 +60,10 @@ inline MethodSearch opcode_to_search(const IRInstruction* insn) {
   }
 }
 
+inline MethodSearch opcode_to_search(const IRInstruction* insn) {
+  return opcode_to_search(insn->opcode());
+}
+
 /**
  * Given a scope defined by DexClass, a name and a proto look for a method
  * definition in scope.
@@ -200,3 +206,68 @@ inline DexField* resolve_field(const DexFieldRef* field,
   return resolve_field(
       field->get_class(), field->get_name(), field->get_type(), search);
 }
+
+/**
+ * Memoizes resolutions of method and field references for all threads. Each
+ * result is tagged with the epochs of the RedexContext it was computed in
+ * (see RedexContext::get_member_epoch()), and a result is only reused while
+ * neither epoch has moved, so classes gaining or losing members, being
+ * reparented or being renamed make it resolve again. Unresolvable references
+ * are memoized too.
+ *
+ * The PassManager invalidates the cache after each pass that doesn't preserve
+ * all the analyses, which also covers passes that edit member lists directly.
+ */
+class ResolverCache {
+ public:
+  DexMethod* resolve_method(DexMethodRef* method, MethodSearch search);
+
+  DexField* resolve_field(const DexFieldRef* field, FieldSearch search);
+
+  void invalidate() { m_epoch.fetch_add(1, std::memory_order_relaxed); }
+
+ private:
+  template <typename Ref, typename Search>
+  struct Key {
+    Ref ref;
+    Search search;
+    bool operator==(const Key& other) const {
+      return ref == other.ref && search == other.search;
+    }
+  };
+
+  template <typename Key>
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      size_t seed = 0;
+      boost::hash_combine(seed, key.ref);
+      boost::hash_combine(seed, static_cast<size_t>(key.search));
+      return seed;
+    }
+  };
+
+  template <typename Def>
+  struct Entry {
+    Def* def{nullptr};
+    size_t epoch{0};
+  };
+
+  size_t current_epoch() const;
+
+  using MethodKey = Key<DexMethodRef*, MethodSearch>;
+  using FieldKey = Key<const DexFieldRef*, FieldSearch>;
+
+  std::atomic<size_t> m_epoch{1};
+  ConcurrentMap<MethodKey, Entry<DexMethod>, KeyHash<MethodKey>> m_methods;
+  ConcurrentMap<FieldKey, Entry<DexField>, KeyHash<FieldKey>> m_fields;
+};
+
+/**
+ * Same as resolve_method(method, search) and resolve_field(field, search),
+ * memoized in the ResolverCache of the current RedexContext. Unlike a
+ * MethodRefCache, these are safe to call from any thread.
+ */
+DexMethod* resolve_method_cached(DexMethodRef* method, MethodSearch search);
+
+DexField* resolve_field_cached(const DexFieldRef* field,
+                               FieldSearch search = FieldSearch::Any);
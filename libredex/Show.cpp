@@ -7,7 +7,8 @@
 
 #include "Show.h"
 
-#include <boost/io/detail/quoted_manip.hpp>
+#include <cinttypes>
+#include <cstdio>
 
 #include "ControlFlow.h"
 #include "Creators.h"
@@ -538,54 +539,83 @@ std::string show_opcode(const DexInstruction* insn) {
   }
 }
 
-std::string show_insn(const IRInstruction* insn, bool deobfuscated) {
-  if (!insn) return "";
-  std::ostringstream ss;
-  ss << show(insn->opcode()) << " ";
+void append_number(std::string* buf, int64_t n) {
+  char digits[24];
+  int len = snprintf(digits, sizeof(digits), "%" PRId64, n);
+  buf->append(digits, len);
+}
+
+// The same escaping as boost::io::quoted.
+void append_quoted(std::string* buf, const DexString* str) {
+  buf->push_back('"');
+  if (str != nullptr) {
+    for (const char* c = str->c_str(); *c != '\0'; ++c) {
+      if (*c == '"' || *c == '\\') {
+        buf->push_back('\\');
+      }
+      buf->push_back(*c);
+    }
+  }
+  buf->push_back('"');
+}
+
+void show_insn(std::string* buf,
+               const IRInstruction* insn,
+               bool deobfuscated) {
+  if (!insn) return;
+  buf->append(show(insn->opcode()));
+  buf->push_back(' ');
   bool first = true;
   if (insn->dests_size()) {
-    ss << "v" << insn->dest();
+    buf->push_back('v');
+    append_number(buf, insn->dest());
     first = false;
   }
   for (unsigned i = 0; i < insn->srcs_size(); ++i) {
-    if (!first) ss << ", ";
-    ss << "v" << insn->src(i);
+    if (!first) buf->append(", ");
+    buf->push_back('v');
+    append_number(buf, insn->src(i));
     first = false;
   }
   if (opcode::ref(insn->opcode()) != opcode::Ref::None && !first) {
-    ss << ", ";
+    buf->append(", ");
   }
   switch (opcode::ref(insn->opcode())) {
   case opcode::Ref::None:
     break;
   case opcode::Ref::String:
-    ss << boost::io::quoted(show(insn->get_string()));
+    append_quoted(buf, insn->get_string());
     break;
   case opcode::Ref::Type:
-    ss << show(insn->get_type());
+    show_to(buf, insn->get_type());
     break;
   case opcode::Ref::Field:
     if (deobfuscated) {
-      ss << show_deobfuscated(insn->get_field());
+      buf->append(show_deobfuscated(insn->get_field()));
     } else {
-      ss << show(insn->get_field());
+      show_to(buf, insn->get_field());
     }
     break;
   case opcode::Ref::Method:
     if (deobfuscated) {
-      ss << show_deobfuscated(insn->get_method());
+      buf->append(show_deobfuscated(insn->get_method()));
     } else {
-      ss << show(insn->get_method());
+      show_to(buf, insn->get_method());
     }
     break;
   case opcode::Ref::Literal:
-    ss << insn->get_literal();
+    append_number(buf, insn->get_literal());
     break;
   case opcode::Ref::Data:
-    ss << "<data>"; // TODO: print something more informative
+    buf->append("<data>"); // TODO: print something more informative
     break;
   }
-  return ss.str();
+}
+
+std::string show_insn(const IRInstruction* insn, bool deobfuscated) {
+  std::string result;
+  show_insn(&result, insn, deobfuscated);
+  return result;
 }
 
 std::string show_helper(const DexAnnotation* anno, bool deobfuscated) {
@@ -617,14 +647,59 @@ std::ostream& operator<<(std::ostream& o, const DexType& type) {
   return o;
 }
 
+void show_to(std::string* buf, const DexString* p) {
+  if (!p) return;
+  buf->append(p->c_str(), p->size());
+}
+
+void show_to(std::string* buf, const DexType* p) {
+  if (!p) return;
+  show_to(buf, p->get_name());
+}
+
+void show_to(std::string* buf, const DexTypeList* p) {
+  if (!p) return;
+  for (auto const type : p->get_type_list()) {
+    show_to(buf, type);
+  }
+}
+
+void show_to(std::string* buf, const DexProto* p) {
+  if (!p) return;
+  buf->push_back('(');
+  show_to(buf, p->get_args());
+  buf->push_back(')');
+  show_to(buf, p->get_rtype());
+}
+
+void show_to(std::string* buf, const DexFieldRef* p) {
+  if (!p) return;
+  show_to(buf, p->get_class());
+  buf->push_back('.');
+  show_to(buf, p->get_name());
+  buf->push_back(':');
+  show_to(buf, p->get_type());
+}
+
+void show_to(std::string* buf, const DexMethodRef* p) {
+  if (!p) return;
+  show_to(buf, p->get_class());
+  buf->push_back('.');
+  show_to(buf, p->get_name());
+  buf->push_back(':');
+  show_to(buf, p->get_proto());
+}
+
+void show_to(std::string* buf, const IRInstruction* insn) {
+  show_insn(buf, insn, false);
+}
+
 // This format must match the proguard map format because it's used to look up
 // in the proguard map
 std::string show(const DexFieldRef* p) {
-  if (!p) return "";
-  string_builders::StaticStringBuilder<5> b;
-  b << show(p->get_class()) << "." << show(p->get_name()) << ":"
-    << show(p->get_type());
-  return b.str();
+  std::string result;
+  show_to(&result, p);
+  return result;
 }
 
 std::ostream& operator<<(std::ostream& o, const DexFieldRef& p) {
@@ -671,22 +746,17 @@ std::string vshow(const DexProto* p, bool include_ret_type = true) {
 // This format must match the proguard map format because it's used to look up
 // in the proguard map
 std::string show(const DexTypeList* p) {
-  if (!p) return "";
-  const auto& type_list = p->get_type_list();
-  string_builders::DynamicStringBuilder b(type_list.size());
-  for (auto const type : type_list) {
-    b << show(type);
-  }
-  return b.str();
+  std::string result;
+  show_to(&result, p);
+  return result;
 }
 
 // This format must match the proguard map format because it's used to look up
 // in the proguard map
 std::string show(const DexProto* p) {
-  if (!p) return "";
-  string_builders::StaticStringBuilder<4> b;
-  b << "(" << show(p->get_args()) << ")" << show(p->get_rtype());
-  return b.str();
+  std::string result;
+  show_to(&result, p);
+  return result;
 }
 
 std::string show(const DexCode* code) {
@@ -706,11 +776,9 @@ std::string show(const DexCode* code) {
 // This format must match the proguard map format because it's used to look up
 // in the proguard map
 std::string show(const DexMethodRef* p) {
-  if (!p) return "";
-  string_builders::StaticStringBuilder<5> b;
-  b << show(p->get_class()) << "." << show(p->get_name()) << ":"
-    << show(p->get_proto());
-  return b.str();
+  std::string result;
+  show_to(&result, p);
+  return result;
 }
 
 std::string vshow(uint32_t acc, bool is_method) {
@@ -1125,7 +1193,7 @@ std::string show(DexIdx* p) {
   return ss.str();
 }
 
-std::string show(const IRCode* mt) { return show(mt->m_ir_list); }
+std::string show(const IRCode* mt) { return show(mt->ir_list()); }
 
 std::string show(const ir_list::InstructionIterable& it) {
   std::ostringstream ss;
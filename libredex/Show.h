@@ -11,6 +11,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 /*
  * Stringification functions for core types.  Definitions are in DexClass.cpp
@@ -135,6 +136,51 @@ std::string show_deobfuscated(const DexType*);
 // SHOW(x) is syntax sugar for show(x).c_str()
 #define SHOW(...) show(__VA_ARGS__).c_str()
 
+/*
+ * Append the same text as show() to `buf`, without going through a
+ * std::ostringstream or building any temporary strings. A caller that
+ * formats many objects can reuse one buffer and clear() it in between, which
+ * keeps its capacity, so that formatting stops allocating after the first few
+ * objects.
+ */
+void show_to(std::string* buf, const DexString*);
+void show_to(std::string* buf, const DexType*);
+void show_to(std::string* buf, const DexTypeList*);
+void show_to(std::string* buf, const DexProto*);
+void show_to(std::string* buf, const DexFieldRef*);
+void show_to(std::string* buf, const DexMethodRef*);
+void show_to(std::string* buf, const IRInstruction*);
+
+/*
+ * A stand-in for show(t) that only formats t when it is written to a stream.
+ * TRACE already skips evaluating its arguments when its level is disabled;
+ * show_lazy() is for messages that are built up front and only maybe written
+ * out, e.g.
+ *
+ *   auto msg = show_lazy(insn);
+ *   ...
+ *   if (verbose) std::cerr << msg;
+ *
+ * Pointers are copied, any other object must outlive the adapter.
+ */
+template <typename T>
+class LazyShow {
+ public:
+  explicit LazyShow(const T& t) : m_t(t) {}
+
+  friend std::ostream& operator<<(std::ostream& o, const LazyShow& lazy) {
+    return o << show(lazy.m_t);
+  }
+
+ private:
+  std::conditional_t<std::is_pointer<T>::value, T, const T&> m_t;
+};
+
+template <typename T>
+LazyShow<T> show_lazy(const T& t) {
+  return LazyShow<T>(t);
+}
+
 std::string show_context(IRCode const*, IRInstruction const*);
 #define SHOW_CONTEXT(code, insn) (show_context(code, insn).c_str())
 
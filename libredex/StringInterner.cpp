@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "StringInterner.h"
+
+#include <cstring>
+#include <new>
+
+#include "Debug.h"
+#include "DexClass.h"
+
+namespace string_interner_impl {
+
+void* Arena::allocate(size_t size, size_t align) {
+  auto cur = reinterpret_cast<uintptr_t>(m_cur);
+  auto aligned = (cur + align - 1) & ~(uintptr_t)(align - 1);
+  if (m_cur == nullptr || aligned + size > reinterpret_cast<uintptr_t>(m_end)) {
+    size_t chunk_size = std::max(kChunkSize, size + align);
+    m_chunks.emplace_back(new char[chunk_size]);
+    m_cur = m_chunks.back().get();
+    m_end = m_cur + chunk_size;
+    m_bytes_reserved.store(
+        m_bytes_reserved.load(std::memory_order_relaxed) + chunk_size,
+        std::memory_order_relaxed);
+    cur = reinterpret_cast<uintptr_t>(m_cur);
+    aligned = (cur + align - 1) & ~(uintptr_t)(align - 1);
+  }
+  m_cur = reinterpret_cast<char*>(aligned + size);
+  m_bytes_used.store(m_bytes_used.load(std::memory_order_relaxed) + size,
+                     std::memory_order_relaxed);
+  return reinterpret_cast<void*>(aligned);
+}
+
+namespace {
+
+constexpr uint64_t kSecret0 = 0xa0761d6478bd642full;
+constexpr uint64_t kSecret1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t kSecret2 = 0x8ebc6af09c88c6e3ull;
+
+inline uint64_t fold_mul(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = static_cast<__uint128_t>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+  uint64_t ha = a >> 32, la = a & 0xffffffff;
+  uint64_t hb = b >> 32, lb = b & 0xffffffff;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  carry += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+  return lo ^ hi;
+#endif
+}
+
+inline uint64_t read64(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Reads 1 to 8 bytes.
+inline uint64_t read_partial(const char* p, size_t len) {
+  uint64_t v = 0;
+  memcpy(&v, p, len);
+  return v;
+}
+
+} // namespace
+
+uint64_t hash_bytes(const char* s, size_t len) {
+  uint64_t seed = kSecret0 ^ fold_mul(len ^ kSecret2, kSecret1);
+  const char* p = s;
+  size_t remaining = len;
+  while (remaining > 16) {
+    seed = fold_mul(read64(p) ^ kSecret1, read64(p + 8) ^ seed);
+    p += 16;
+    remaining -= 16;
+  }
+  uint64_t a = 0;
+  uint64_t b = 0;
+  if (remaining > 8) {
+    a = read64(p);
+    b = read_partial(p + 8, remaining - 8);
+  } else if (remaining > 0) {
+    a = read_partial(p, remaining);
+  }
+  return fold_mul(kSecret1 ^ len, fold_mul(a ^ kSecret1, b ^ seed));
+}
+
+} // namespace string_interner_impl
+
+using namespace string_interner_impl;
+
+namespace {
+
+std::atomic<uint64_t> s_next_interner_id{1};
+
+struct LocalArena {
+  uint64_t interner_id{0};
+  Arena* arena{nullptr};
+};
+
+thread_local LocalArena t_local_arena;
+
+constexpr size_t kInitialShardCapacity = 1024;
+
+} // namespace
+
+StringInterner::StringInterner() : m_id(s_next_interner_id.fetch_add(1)) {
+  for (auto& shard : m_shards) {
+    shard.entries.resize(kInitialShardCapacity);
+  }
+}
+
+StringInterner::~StringInterner() {
+  // The DexStrings live in the arenas, so only their destructors need to run
+  // here; the memory goes away with the arenas.
+  for_each([](DexString* s) { s->~DexString(); });
+}
+
+Arena& StringInterner::local_arena() {
+  auto& local = t_local_arena;
+  if (local.interner_id != m_id) {
+    auto arena = std::make_unique<Arena>();
+    local.arena = arena.get();
+    local.interner_id = m_id;
+    std::lock_guard<std::mutex> lock(m_arenas_lock);
+    m_arenas.push_back(std::move(arena));
+  }
+  return *local.arena;
+}
+
+DexString* StringInterner::make(const char* s,
+                                size_t len,
+                                uint32_t utfsize,
+                                bool in_place) {
+  auto hash = hash_bytes(s, len);
+  auto& shard = shard_of(hash);
+  auto existing = shard.find(hash, s, len);
+  if (existing != nullptr) {
+    return existing;
+  }
+  auto& arena = local_arena();
+  const char* data = s;
+  if (!in_place) {
+    auto copy = static_cast<char*>(arena.allocate(len + 1, 1));
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    data = copy;
+  }
+  void* mem = arena.allocate(sizeof(DexString), alignof(DexString));
+  auto fresh = new (mem) DexString(data, len, utfsize);
+  auto interned = shard.insert(hash, fresh, m_ids);
+  if (interned != fresh) {
+    // The copied bytes, if any, stay behind in the arena.
+    fresh->~DexString();
+    m_lost_races.fetch_add(1, std::memory_order_relaxed);
+  } else if (in_place) {
+    m_in_place.fetch_add(1, std::memory_order_relaxed);
+  }
+  return interned;
+}
+
+DexString* StringInterner::Shard::find_locked(uint64_t hash,
+                                              const char* s,
+                                              size_t len) const {
+  size_t mask = entries.size() - 1;
+  for (size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+    const auto& entry = entries[idx];
+    if (entry.value == nullptr) {
+      return nullptr;
+    }
+    if (entry.hash == hash && entry.value->size() == len &&
+        memcmp(entry.value->c_str(), s, len) == 0) {
+      return entry.value;
+    }
+  }
+}
+
+DexString* StringInterner::Shard::find(uint64_t hash,
+                                       const char* s,
+                                       size_t len) const {
+  std::shared_lock<std::shared_timed_mutex> guard(lock);
+  return find_locked(hash, s, len);
+}
+
+DexString* StringInterner::Shard::insert(uint64_t hash,
+                                         DexString* value,
+                                         IdTable<DexString>& ids) {
+  std::unique_lock<std::shared_timed_mutex> guard(lock);
+  auto existing = find_locked(hash, value->c_str(), value->size());
+  if (existing != nullptr) {
+    return existing;
+  }
+  if (2 * (size + 1) > entries.size()) {
+    grow();
+  }
+  size_t mask = entries.size() - 1;
+  size_t idx = hash & mask;
+  while (entries[idx].value != nullptr) {
+    idx = (idx + 1) & mask;
+  }
+  value->m_id = ids.allocate_id();
+  ids.publish(value->m_id, value);
+  entries[idx].hash = hash;
+  entries[idx].value = value;
+  ++size;
+  return value;
+}
+
+void StringInterner::Shard::grow() {
+  std::vector<Entry> old(entries.size() * 2);
+  // `entries` is now the larger, empty table.
+  old.swap(entries);
+  size_t mask = entries.size() - 1;
+  for (const auto& entry : old) {
+    if (entry.value == nullptr) {
+      continue;
+    }
+    size_t idx = entry.hash & mask;
+    while (entries[idx].value != nullptr) {
+      idx = (idx + 1) & mask;
+    }
+    entries[idx] = entry;
+  }
+}
+
+StringInterner::Stats StringInterner::get_stats() const {
+  Stats stats;
+  for (const auto& shard : m_shards) {
+    std::shared_lock<std::shared_timed_mutex> guard(shard.lock);
+    stats.strings += shard.size;
+    stats.table_capacity += shard.entries.size();
+  }
+  stats.lost_races = m_lost_races.load();
+  stats.in_place = m_in_place.load();
+  std::lock_guard<std::mutex> lock(m_arenas_lock);
+  stats.arenas = m_arenas.size();
+  for (const auto& arena : m_arenas) {
+    // Other threads may be allocating concurrently, so this is a snapshot.
+    stats.arena_bytes_reserved += arena->bytes_reserved();
+    stats.arena_bytes_used += arena->bytes_used();
+  }
+  return stats;
+}
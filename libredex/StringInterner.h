@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "IdTable.h"
+
+class DexString;
+
+namespace string_interner_impl {
+
+/*
+ * A bump allocator that is only ever used by a single thread. Memory is
+ * released all at once when the arena dies.
+ */
+class Arena {
+ public:
+  void* allocate(size_t size, size_t align);
+
+  // These may be read from other threads.
+  size_t bytes_reserved() const {
+    return m_bytes_reserved.load(std::memory_order_relaxed);
+  }
+  size_t bytes_used() const {
+    return m_bytes_used.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> m_chunks;
+  char* m_cur{nullptr};
+  char* m_end{nullptr};
+  std::atomic<size_t> m_bytes_reserved{0};
+  std::atomic<size_t> m_bytes_used{0};
+};
+
+/*
+ * A 64-bit hash over the whole string, consuming 16 bytes per round with
+ * 64x64->128-bit multiply-folds in the spirit of wyhash.
+ */
+uint64_t hash_bytes(const char* s, size_t len);
+
+} // namespace string_interner_impl
+
+/**
+ * The interning table behind DexString::make_string().
+ *
+ * DexString objects, and the bytes of strings that need copying, are
+ * placement-constructed in per-thread bump arenas instead of being
+ * individually heap-allocated, and are indexed by a sharded
+ * open-addressing hash table that stores the full 64-bit hash next to each
+ * entry. A lookup is usually one hash computation and one probe whose hash
+ * comparison filters out mismatches before any bytes are compared.
+ *
+ * Every interned string gets the next dense id (see DexString::get_id()) as
+ * it enters the table; strings that lose a creation race never get one.
+ *
+ * All operations are thread-safe except for iteration via for_each().
+ */
+class StringInterner {
+ public:
+  struct Stats {
+    size_t strings{0};
+    // Strings that we built but then threw away because another thread
+    // interned the same string first.
+    size_t lost_races{0};
+    // Strings whose bytes were not copied; see make().
+    size_t in_place{0};
+    size_t arenas{0};
+    size_t arena_bytes_reserved{0};
+    size_t arena_bytes_used{0};
+    size_t table_capacity{0};
+  };
+
+  StringInterner();
+  ~StringInterner();
+
+  StringInterner(const StringInterner&) = delete;
+  StringInterner& operator=(const StringInterner&) = delete;
+
+  DexString* get(const char* s, size_t len) const {
+    auto hash = string_interner_impl::hash_bytes(s, len);
+    return shard_of(hash).find(hash, s, len);
+  }
+
+  /*
+   * With `in_place`, a newly interned string keeps pointing at `s` instead of
+   * copying it into an arena; `s` must then be NUL-terminated and outlive the
+   * interner.
+   */
+  DexString* make(const char* s,
+                  size_t len,
+                  uint32_t utfsize,
+                  bool in_place = false);
+
+  /*
+   * Not thread-safe.
+   */
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    for (size_t i = 0; i < kNumShards; ++i) {
+      for (const auto& entry : m_shards[i].entries) {
+        if (entry.value != nullptr) {
+          fn(entry.value);
+        }
+      }
+    }
+  }
+
+  Stats get_stats() const;
+
+  DexString* get_by_id(uint32_t id) const { return m_ids.get(id); }
+  uint32_t id_bound() const { return m_ids.bound(); }
+
+ private:
+  static constexpr size_t kNumShards = 64;
+  static constexpr size_t kShardBits = 6;
+
+  struct Entry {
+    uint64_t hash{0};
+    DexString* value{nullptr};
+  };
+
+  struct Shard {
+    mutable std::shared_timed_mutex lock;
+    // Linear probing over a power-of-two table kept at most half full.
+    std::vector<Entry> entries;
+    size_t size{0};
+
+    DexString* find(uint64_t hash, const char* s, size_t len) const;
+    // Returns the entry that ends up in the table under `hash`: either
+    // `value` or a previously inserted equal string.
+    // Only a `value` that makes it into the table gets an id from `ids`.
+    DexString* insert(uint64_t hash,
+                      DexString* value,
+                      IdTable<DexString>& ids);
+
+   private:
+    DexString* find_locked(uint64_t hash, const char* s, size_t len) const;
+    void grow();
+  };
+
+  const Shard& shard_of(uint64_t hash) const {
+    // The low bits pick the probe position; use the high ones for the shard.
+    return m_shards[hash >> (64 - kShardBits)];
+  }
+  Shard& shard_of(uint64_t hash) {
+    return m_shards[hash >> (64 - kShardBits)];
+  }
+
+  string_interner_impl::Arena& local_arena();
+
+  Shard m_shards[kNumShards];
+  IdTable<DexString> m_ids;
+
+  // Distinguishes this interner from earlier ones that a thread may have
+  // cached an arena for.
+  const uint64_t m_id;
+  mutable std::mutex m_arenas_lock;
+  std::vector<std::unique_ptr<string_interner_impl::Arena>> m_arenas;
+  std::atomic<size_t> m_lost_races{0};
+  std::atomic<size_t> m_in_place{0};
+};
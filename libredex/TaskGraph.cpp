@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+#include "Debug.h"
+
+TaskGraph::TaskId TaskGraph::add(std::string name,
+                                 std::function<void()> fn,
+                                 std::vector<TaskId> deps) {
+  TaskId id = m_tasks.size();
+  for (auto dep : deps) {
+    always_assert_log(dep < id, "Task %s depends on an unknown task",
+                      name.c_str());
+    m_tasks[dep].dependents.push_back(id);
+  }
+  m_tasks.push_back(Task{std::move(name), std::move(fn), std::move(deps), {}});
+  return id;
+}
+
+void TaskGraph::run() {
+  using clock = std::chrono::steady_clock;
+  auto run_start = clock::now();
+  std::mutex lock;
+  std::condition_variable all_done;
+  std::vector<size_t> pending_deps(m_tasks.size());
+  std::vector<bool> failed(m_tasks.size(), false);
+  size_t num_done = 0;
+  std::exception_ptr first_exception;
+  std::vector<boost::thread> threads;
+
+  // Called with `lock` held.
+  std::function<void(TaskId)> start;
+  std::function<void(TaskId, bool)> finish = [&](TaskId id, bool ok) {
+    ++num_done;
+    for (auto dependent : m_tasks[id].dependents) {
+      failed[dependent] = failed[dependent] || !ok;
+      if (--pending_deps[dependent] == 0) {
+        if (failed[dependent]) {
+          finish(dependent, false);
+        } else {
+          start(dependent);
+        }
+      }
+    }
+    if (num_done == m_tasks.size()) {
+      all_done.notify_one();
+    }
+  };
+  start = [&](TaskId id) {
+    threads.emplace_back([&, id] {
+      auto& task = m_tasks[id];
+      auto task_start = clock::now();
+      bool ok = true;
+      try {
+        task.fn();
+      } catch (...) {
+        ok = false;
+        std::lock_guard<std::mutex> guard(lock);
+        if (!first_exception) {
+          first_exception = std::current_exception();
+        }
+      }
+      auto task_end = clock::now();
+      std::lock_guard<std::mutex> guard(lock);
+      task.timing.start =
+          std::chrono::duration<double>(task_start - run_start).count();
+      task.timing.duration =
+          std::chrono::duration<double>(task_end - task_start).count();
+      finish(id, ok);
+    });
+  };
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    for (TaskId id = 0; id < m_tasks.size(); ++id) {
+      m_tasks[id].timing = Timing{0, 0};
+      pending_deps[id] = m_tasks[id].deps.size();
+    }
+    for (TaskId id = 0; id < m_tasks.size(); ++id) {
+      if (pending_deps[id] == 0) {
+        start(id);
+      }
+    }
+    all_done.wait(guard, [&] { return num_done == m_tasks.size(); });
+  }
+  // Every thread has been started by now, though some may still be
+  // returning from finish().
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (first_exception) {
+    std::rethrow_exception(first_exception);
+  }
+}
+
+std::vector<TaskGraph::TaskId> TaskGraph::critical_path() const {
+  if (m_tasks.empty()) {
+    return {};
+  }
+  // Tasks are in topological order, so one forward sweep finds the longest
+  // chain ending at each task.
+  std::vector<double> length(m_tasks.size());
+  std::vector<TaskId> prev(m_tasks.size());
+  TaskId last = 0;
+  for (TaskId id = 0; id < m_tasks.size(); ++id) {
+    prev[id] = id;
+    double longest_dep = 0;
+    for (auto dep : m_tasks[id].deps) {
+      if (prev[id] == id || length[dep] > longest_dep) {
+        longest_dep = length[dep];
+        prev[id] = dep;
+      }
+    }
+    length[id] = longest_dep + m_tasks[id].timing.duration;
+    if (length[id] > length[last]) {
+      last = id;
+    }
+  }
+  std::vector<TaskId> path{last};
+  while (prev[path.back()] != path.back()) {
+    path.push_back(prev[path.back()]);
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
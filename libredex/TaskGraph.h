@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * A handful of coarse, named tasks with dependencies between them, as in the
+ * phases of the redex-all frontend. run() starts every task on a thread of
+ * its own as soon as the tasks it depends on have finished, so independent
+ * tasks overlap; tasks are free to use WorkQueues themselves.
+ *
+ * Tasks can only depend on tasks added before them, so the graph is acyclic
+ * by construction.
+ */
+class TaskGraph {
+ public:
+  using TaskId = size_t;
+
+  struct Timing {
+    // Seconds since run() was called.
+    double start;
+    double duration;
+  };
+
+  TaskId add(std::string name,
+             std::function<void()> fn,
+             std::vector<TaskId> deps = {});
+
+  /*
+   * Runs every task and waits for them. If a task throws, the tasks that
+   * depend on it are skipped, and the first exception is rethrown once all
+   * the running tasks have finished.
+   */
+  void run();
+
+  const std::string& name(TaskId id) const { return m_tasks.at(id).name; }
+
+  const Timing& timing(TaskId id) const { return m_tasks.at(id).timing; }
+
+  size_t size() const { return m_tasks.size(); }
+
+  /*
+   * The chain of dependencies with the largest total duration in the last
+   * run, first task first. This is what bounds the run's wall time.
+   */
+  std::vector<TaskId> critical_path() const;
+
+ private:
+  struct Task {
+    std::string name;
+    std::function<void()> fn;
+    std::vector<TaskId> deps;
+    std::vector<TaskId> dependents;
+    Timing timing{0, 0};
+  };
+
+  std::vector<Task> m_tasks;
+};
@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Debug.h"
+
+namespace {
+
+std::atomic<ThreadPool*> s_instance{nullptr};
+
+thread_local bool t_on_pool_thread{false};
+
+constexpr size_t kStackSize = 8 * 1024 * 1024;
+
+void pin_to_cpu(boost::thread& thread, size_t idx) {
+#ifdef __linux__
+  auto num_cpus = std::max(1u, boost::thread::hardware_concurrency());
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(idx % num_cpus, &cpus);
+  // Pinning is best-effort; e.g. a restricted cpuset will make this fail.
+  pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#else
+  (void)thread;
+  (void)idx;
+#endif
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t num_threads, bool pin_threads) {
+  always_assert(num_threads >= 1);
+  m_threads.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    boost::thread::attributes attrs;
+    attrs.set_stack_size(kStackSize);
+    m_threads.emplace_back(attrs, [this, i]() { worker_loop(i); });
+    if (pin_threads) {
+      pin_to_cpu(m_threads.back(), i);
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shutdown = true;
+  }
+  m_work_cv.notify_all();
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+  ThreadPool* self = this;
+  s_instance.compare_exchange_strong(self, nullptr);
+}
+
+bool ThreadPool::try_run(size_t n, const std::function<void(size_t)>& fn) {
+  if (n > m_threads.size() || t_on_pool_thread) {
+    return false;
+  }
+  std::unique_lock<std::mutex> job_lock(m_job_mutex, std::try_to_lock);
+  if (!job_lock.owns_lock()) {
+    return false;
+  }
+  if (n == 0) {
+    return true;
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_job = &fn;
+  m_job_size = n;
+  m_remaining = n;
+  ++m_generation;
+  m_work_cv.notify_all();
+  m_done_cv.wait(lock, [this] { return m_remaining == 0; });
+  m_job = nullptr;
+  return true;
+}
+
+void ThreadPool::worker_loop(size_t idx) {
+  t_on_pool_thread = true;
+  size_t seen_generation = 0;
+  while (true) {
+    const std::function<void(size_t)>* job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_work_cv.wait(lock, [&] {
+        return m_shutdown || m_generation != seen_generation;
+      });
+      if (m_shutdown) {
+        return;
+      }
+      seen_generation = m_generation;
+      if (idx >= m_job_size) {
+        continue;
+      }
+      job = m_job;
+    }
+    (*job)(idx);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_remaining == 0) {
+        m_done_cv.notify_one();
+      }
+    }
+  }
+}
+
+ThreadPool* ThreadPool::get_instance() { return s_instance.load(); }
+
+void ThreadPool::set_instance(ThreadPool* pool) { s_instance.store(pool); }
+
+bool ThreadPool::on_pool_thread() { return t_on_pool_thread; }
+
+namespace redex_parallel {
+
+unsigned int configured_num_threads() {
+  static const unsigned int s_num_threads = [] {
+    const char* env = getenv("REDEX_NUM_THREADS");
+    return env == nullptr ? 0u : unsigned(strtoul(env, nullptr, 10));
+  }();
+  return s_num_threads;
+}
+
+unsigned int default_num_threads() {
+  auto num_threads = configured_num_threads();
+  return num_threads > 0 ? num_threads
+                         : std::max(1u, boost::thread::hardware_concurrency());
+}
+
+} // namespace redex_parallel
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+/**
+ * A fixed set of long-lived threads that WorkQueue::run_all() borrows instead
+ * of spawning and joining fresh threads on every call.
+ *
+ * Only one job runs on the pool at a time. A job that arrives while the pool
+ * is busy, that is submitted from one of the pool's own threads (i.e. nested
+ * parallelism), or that wants more threads than the pool has, is refused;
+ * callers are expected to fall back to spawning their own threads.
+ */
+class ThreadPool {
+ public:
+  ThreadPool(size_t num_threads, bool pin_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t size() const { return m_threads.size(); }
+
+  /*
+   * Runs fn(0), ..., fn(n - 1) concurrently, each on a different pool thread,
+   * and blocks until they have all returned. Returns false without running
+   * anything if the pool can't take the job right now.
+   */
+  bool try_run(size_t n, const std::function<void(size_t)>& fn);
+
+  /*
+   * The process-wide pool, or nullptr if none has been installed.
+   */
+  static ThreadPool* get_instance();
+
+  /*
+   * Installs the process-wide pool. Passing nullptr uninstalls it. The caller
+   * keeps ownership.
+   */
+  static void set_instance(ThreadPool* pool);
+
+  static bool on_pool_thread();
+
+ private:
+  void worker_loop(size_t idx);
+
+  std::vector<boost::thread> m_threads;
+
+  // Held for the whole duration of a job; try_run() only try-locks it.
+  std::mutex m_job_mutex;
+
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  // Incremented for every job so that workers can tell a new one from the
+  // one they just finished.
+  size_t m_generation{0};
+  size_t m_job_size{0};
+  size_t m_remaining{0};
+  const std::function<void(size_t)>* m_job{nullptr};
+  bool m_shutdown{false};
+};
+
+namespace redex_parallel {
+
+/*
+ * The number of threads that the REDEX_NUM_THREADS environment variable asks
+ * for, or 0 when it isn't set. The benchmarks set it to see how the passes
+ * scale.
+ */
+unsigned int configured_num_threads();
+
+/*
+ * One thread per core, unless REDEX_NUM_THREADS says otherwise.
+ */
+unsigned int default_num_threads();
+
+} // namespace redex_parallel
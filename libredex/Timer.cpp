@@ -9,12 +9,14 @@
 
 #include "Trace.h"
 
-unsigned Timer::s_indent = 0;
+std::atomic<unsigned> Timer::s_indent{0};
 std::mutex Timer::s_lock;
 Timer::times_t Timer::s_times;
 
 Timer::Timer(const std::string& msg)
-    : m_msg(msg), m_start(std::chrono::high_resolution_clock::now()) {
+    : m_msg(msg),
+      m_start(std::chrono::high_resolution_clock::now()),
+      m_span(msg) {
   ++s_indent;
 }
 
@@ -7,12 +7,19 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "Profiler.h"
+
+/*
+ * Records the wall time of a scope for the stats JSON, and also opens a
+ * profiler::Span of the same name.
+ */
 struct Timer {
   Timer(const std::string& msg);
   ~Timer();
@@ -24,7 +31,8 @@ struct Timer {
  private:
   static std::mutex s_lock;
   static times_t s_times;
-  static unsigned s_indent;
+  static std::atomic<unsigned> s_indent;
   std::string m_msg;
   std::chrono::high_resolution_clock::time_point m_start;
+  profiler::Span m_span;
 };
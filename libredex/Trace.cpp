@@ -7,20 +7,45 @@
 
 #include "Trace.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+namespace trace_impl {
+long s_levels[N_TRACE_MODULES];
+} // namespace trace_impl
 
 namespace {
 
+/*
+ * The lines that a thread traced and that weren't written yet. Only its
+ * thread appends to it, and the flusher takes what is there, so the lock is
+ * never contended for long.
+ */
+struct ThreadBuffer {
+  std::mutex lock;
+  std::string pending;
+};
+
+// Lines are handed to the flusher as soon as this much is pending, and at
+// least every kFlushInterval otherwise.
+constexpr size_t kFlushBytes = 1 << 20;
+constexpr auto kFlushInterval = std::chrono::milliseconds(100);
+
 struct Tracer {
 
   bool m_show_timestamps{false};
@@ -33,6 +58,7 @@ struct Tracer {
     const char* envfile = getenv("TRACEFILE");
     const char* show_timestamps = getenv("SHOW_TIMESTAMPS");
     const char* show_tracemodule = getenv("SHOW_TRACEMODULE");
+    const char* trace_sync = getenv("TRACE_SYNC");
     m_method_filter = getenv("TRACE_METHOD_FILTER");
     if (!traceenv) {
       return;
@@ -50,6 +76,8 @@ struct Tracer {
     std::cerr << "TRACE_METHOD_FILTER="
               << (m_method_filter == nullptr ? "" : m_method_filter)
               << std::endl;
+    std::cerr << "TRACE_SYNC=" << (trace_sync == nullptr ? "" : trace_sync)
+              << std::endl;
 
     init_trace_modules(traceenv);
     init_trace_file(envfile);
@@ -64,18 +92,31 @@ struct Tracer {
 #define TM(x) m_module_id_name_map[static_cast<int>(x)] = #x;
     TMS
 #undef TM
+
+    // TRACE_SYNC writes each line right away, as the tracing thread, which
+    // keeps the lines in order and doesn't lose any on a crash.
+    if (!trace_sync) {
+      m_flusher = std::thread([this] { flush_loop(); });
+    }
+    for (size_t i = 0; i < N_TRACE_MODULES; ++i) {
+      trace_impl::s_levels[i] = std::max(m_level, m_traces[i]);
+    }
   }
 
   ~Tracer() {
+    if (m_flusher.joinable()) {
+      {
+        std::lock_guard<std::mutex> guard(m_flush_lock);
+        m_stop = true;
+      }
+      m_flush_cv.notify_one();
+      m_flusher.join();
+    }
     if (m_file != nullptr && m_file != stderr) {
       fclose(m_file);
     }
   }
 
-  bool traceEnabled(TraceModule module, int level) {
-    return level <= m_level || level <= m_traces[module];
-  }
-
   void trace(TraceModule module,
              int level,
              bool suppress_newline,
@@ -87,7 +128,34 @@ struct Tracer {
         return;
       }
     }
-    std::lock_guard<std::mutex> guard(TraceContext::s_trace_mutex);
+    if (!m_flusher.joinable()) {
+      std::lock_guard<std::mutex> guard(TraceContext::s_trace_mutex);
+      std::string line;
+      format_line(module, level, suppress_newline, fmt, ap, &line);
+      fwrite(line.data(), 1, line.size(), m_file);
+      fflush(m_file);
+      return;
+    }
+    auto& buffer = local_buffer();
+    size_t pending;
+    {
+      std::lock_guard<std::mutex> guard(buffer.lock);
+      format_line(module, level, suppress_newline, fmt, ap, &buffer.pending);
+      pending = buffer.pending.size();
+    }
+    if (pending >= kFlushBytes) {
+      m_flush_cv.notify_one();
+    }
+  }
+
+ private:
+  // Appends the line with its timestamp and module to `out`.
+  void format_line(TraceModule module,
+                   int level,
+                   bool suppress_newline,
+                   const char* fmt,
+                   va_list ap,
+                   std::string* out) {
     if (m_show_timestamps) {
       auto t = std::time(nullptr);
       struct tm local_tm;
@@ -98,22 +166,87 @@ struct Tracer {
 #endif
       std::array<char, 40> buf;
       std::strftime(buf.data(), sizeof(buf), "%c", &local_tm);
-      fprintf(m_file, "[%s]", buf.data());
+      out->append("[").append(buf.data()).append("]");
       if (!m_show_tracemodule) {
-        fprintf(m_file, " ");
+        out->append(" ");
       }
     }
     if (m_show_tracemodule) {
-      fprintf(m_file, "[%s:%d] ", m_module_id_name_map[module].c_str(), level);
+      out->append("[")
+          .append(m_module_id_name_map.at(module))
+          .append(":")
+          .append(std::to_string(level))
+          .append("] ");
+    }
+    // Most lines fit into the stack buffer, the others are formatted again
+    // into the string.
+    char buf[512];
+    va_list ap_copy;
+    va_copy(ap_copy, ap);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap_copy);
+    va_end(ap_copy);
+    if (len > 0 && static_cast<size_t>(len) < sizeof(buf)) {
+      out->append(buf, len);
+    } else if (len > 0) {
+      auto start = out->size();
+      out->resize(start + len + 1);
+      vsnprintf(&(*out)[start], len + 1, fmt, ap);
+      out->resize(start + len);
     }
-    vfprintf(m_file, fmt, ap);
     if (!suppress_newline) {
-      fprintf(m_file, "\n");
+      out->append("\n");
+    }
+  }
+
+  ThreadBuffer& local_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+    if (!t_buffer) {
+      t_buffer = std::make_shared<ThreadBuffer>();
+      std::lock_guard<std::mutex> guard(m_flush_lock);
+      m_buffers.push_back(t_buffer);
+    }
+    return *t_buffer;
+  }
+
+  /*
+   * Writes what the threads traced every kFlushInterval, or when a thread
+   * has a lot pending, and all of it when the tracer goes away. The buffers
+   * of the threads that exited are dropped once they are written.
+   */
+  void flush_loop() {
+    std::string lines;
+    std::unique_lock<std::mutex> lock(m_flush_lock);
+    while (true) {
+      m_flush_cv.wait_for(lock, kFlushInterval);
+      bool stop = m_stop;
+      auto buffers = m_buffers;
+      lock.unlock();
+      for (const auto& buffer : buffers) {
+        {
+          std::lock_guard<std::mutex> guard(buffer->lock);
+          lines.swap(buffer->pending);
+        }
+        fwrite(lines.data(), 1, lines.size(), m_file);
+        lines.clear();
+      }
+      fflush(m_file);
+      buffers.clear();
+      lock.lock();
+      m_buffers.erase(
+          std::remove_if(m_buffers.begin(),
+                         m_buffers.end(),
+                         [](const std::shared_ptr<ThreadBuffer>& buffer) {
+                           std::lock_guard<std::mutex> guard(buffer->lock);
+                           return buffer.use_count() == 1 &&
+                                  buffer->pending.empty();
+                         }),
+          m_buffers.end());
+      if (stop) {
+        return;
+      }
     }
-    fflush(m_file);
   }
 
- private:
   void init_trace_modules(const char* traceenv) {
     std::unordered_map<std::string, int> module_id_map;
 #define TM(x) module_id_map[#x] = x;
@@ -168,21 +301,17 @@ struct Tracer {
   FILE* m_file{nullptr};
   long m_level{0};
   std::array<long, N_TRACE_MODULES> m_traces;
+
+  std::thread m_flusher;
+  std::mutex m_flush_lock;
+  std::condition_variable m_flush_cv;
+  bool m_stop{false};
+  std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
 };
 
 static Tracer tracer;
 }
 
-#ifdef NDEBUG
-bool traceEnabled(TraceModule, int) {
-  return false;
-}
-#else
-bool traceEnabled(TraceModule module, int level) {
-  return tracer.traceEnabled(module, level);
-}
-#endif
-
 void trace(TraceModule module,
            int level,
            bool suppress_newline,
@@ -45,6 +45,7 @@
   TM(ENUM)           \
   TM(FINALINLINE)    \
   TM(HASHER)         \
+  TM(HCS)            \
   TM(HOTNESS)        \
   TM(ICONSTP)        \
   TM(IDEX)           \
@@ -95,6 +96,7 @@
   TM(RP)             \
   TM(SDIS)           \
   TM(SHORTEN)        \
+  TM(SHRINK)         \
   TM(SINK)           \
   TM(SPLIT_RES)      \
   TM(STATIC_RELO)    \
@@ -133,7 +135,26 @@ enum TraceModule : int {
       N_TRACE_MODULES,
 };
 
-bool traceEnabled(TraceModule module, int level);
+namespace trace_impl {
+// The level of each module, or the overall one if that is higher.
+extern long s_levels[N_TRACE_MODULES];
+} // namespace trace_impl
+
+#ifdef NDEBUG
+inline bool traceEnabled(TraceModule, int) { return false; }
+#else
+inline bool traceEnabled(TraceModule module, int level) {
+  return level <= trace_impl::s_levels[module];
+}
+#endif
+
+/*
+ * Unless TRACE_SYNC is set, each thread formats its lines into its own
+ * buffer, and a background thread writes them out, so that tracing threads
+ * don't wait on each other. The lines of a thread stay in order, but the
+ * lines of different threads may be interleaved out of order, and lines that
+ * weren't written yet are lost if the process crashes.
+ */
 #ifdef NDEBUG
 #define TRACE(...)
 #define TRACE_NO_LINE(...)
@@ -7,6 +7,8 @@
 
 #include "TypeInference.h"
 
+#include <algorithm>
+#include <iterator>
 #include <ostream>
 #include <sstream>
 
@@ -335,7 +337,14 @@ void TypeInference::run(bool is_static,
   }
 done:
   MonotonicFixpointIterator::run(init_state);
-  populate_type_environments();
+  m_type_envs.clear();
+  m_all_type_envs_populated = false;
+  m_replayed_blocks.clear();
+  if (m_lazy_environments) {
+    index_instructions();
+  } else {
+    populate_type_environments();
+  }
 }
 
 // This method analyzes an instruction and updates the type environment
@@ -975,11 +984,11 @@ void TypeInference::analyze_instruction(IRInstruction* insn,
 
 void TypeInference::print(std::ostream& output) const {
   for (cfg::Block* block : m_cfg.blocks()) {
+    TypeEnvironment current_state = get_entry_state_at(block);
     for (auto& mie : InstructionIterable(block)) {
       IRInstruction* insn = mie.insn;
-      auto it = m_type_envs.find(insn);
-      always_assert(it != m_type_envs.end());
-      output << SHOW(insn) << " -- " << it->second << std::endl;
+      output << SHOW(insn) << " -- " << current_state << std::endl;
+      analyze_instruction(insn, &current_state);
     }
   }
 }
@@ -1005,6 +1014,57 @@ void TypeInference::populate_type_environments() {
       analyze_instruction(insn, &current_state);
     }
   }
+  m_all_type_envs_populated = true;
+}
+
+void TypeInference::index_instructions() {
+  m_positions.clear();
+  m_positions.reserve(m_cfg.blocks().size() * 16);
+  for (cfg::Block* block : m_cfg.blocks()) {
+    uint32_t index = 0;
+    for (auto& mie : InstructionIterable(block)) {
+      m_positions.emplace(mie.insn, std::make_pair(block, index++));
+    }
+  }
+}
+
+const std::vector<TypeEnvironment>& TypeInference::replay(cfg::Block* block) {
+  // Few enough that a linear search beats anything fancier.
+  constexpr size_t kMaxReplayedBlocks = 4;
+  auto it = std::find_if(m_replayed_blocks.begin(), m_replayed_blocks.end(),
+                         [&](const auto& pair) { return pair.first == block; });
+  if (it == m_replayed_blocks.end()) {
+    std::vector<TypeEnvironment> envs;
+    TypeEnvironment current_state = get_entry_state_at(block);
+    for (auto& mie : InstructionIterable(block)) {
+      envs.push_back(current_state);
+      analyze_instruction(mie.insn, &current_state);
+    }
+    if (m_replayed_blocks.size() == kMaxReplayedBlocks) {
+      m_replayed_blocks.pop_back();
+    }
+    m_replayed_blocks.emplace(m_replayed_blocks.begin(), block,
+                              std::move(envs));
+  } else if (it != m_replayed_blocks.begin()) {
+    std::rotate(m_replayed_blocks.begin(), it, std::next(it));
+  }
+  return m_replayed_blocks.front().second;
+}
+
+boost::optional<TypeEnvironment> TypeInference::get_type_environment(
+    const IRInstruction* insn) {
+  if (!m_lazy_environments || m_all_type_envs_populated) {
+    auto it = m_type_envs.find(const_cast<IRInstruction*>(insn));
+    if (it == m_type_envs.end()) {
+      return boost::none;
+    }
+    return it->second;
+  }
+  auto it = m_positions.find(insn);
+  if (it == m_positions.end()) {
+    return boost::none;
+  }
+  return replay(it->second.first)[it->second.second];
 }
 
 } // namespace type_inference
@@ -9,6 +9,9 @@
 
 #include <boost/optional/optional_io.hpp>
 #include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "BaseIRAnalyzer.h"
 #include "DexTypeDomain.h"
@@ -176,8 +179,19 @@ class TypeEnvironment final
 class TypeInference final
     : public ir_analyzer::BaseIRAnalyzer<TypeEnvironment> {
  public:
-  TypeInference(const cfg::ControlFlowGraph& cfg)
-      : ir_analyzer::BaseIRAnalyzer<TypeEnvironment>(cfg), m_cfg(cfg) {}
+  /*
+   * With `lazy_environments`, run() only keeps the entry states of the blocks,
+   * and the environment at an instruction is recomputed when it is asked for,
+   * by replaying its block from the entry state. The replays of the last few
+   * blocks asked about are kept, so that going through the instructions in
+   * order replays each block once. This is much lighter than an environment
+   * per instruction when only some of them are looked at.
+   */
+  explicit TypeInference(const cfg::ControlFlowGraph& cfg,
+                         bool lazy_environments = false)
+      : ir_analyzer::BaseIRAnalyzer<TypeEnvironment>(cfg),
+        m_cfg(cfg),
+        m_lazy_environments(lazy_environments) {}
 
   void run(DexMethod* dex_method);
 
@@ -190,16 +204,43 @@ class TypeInference final
 
   void traceState(TypeEnvironment* state) const;
 
+  /*
+   * The environment right before `insn`, or none if `insn` is not in the CFG.
+   */
+  boost::optional<TypeEnvironment> get_type_environment(
+      const IRInstruction* insn);
+
+  /*
+   * The environments of all the instructions. With lazy environments, the
+   * first call computes them all.
+   */
   std::unordered_map<IRInstruction*, TypeEnvironment>& get_type_environments() {
+    if (m_lazy_environments && !m_all_type_envs_populated) {
+      populate_type_environments();
+    }
     return m_type_envs;
   }
 
  private:
   void populate_type_environments();
 
+  void index_instructions();
+
+  // The environments before each instruction of `block`, in order.
+  const std::vector<TypeEnvironment>& replay(cfg::Block* block);
+
   const cfg::ControlFlowGraph& m_cfg;
   std::unordered_map<IRInstruction*, TypeEnvironment> m_type_envs;
 
+  // Lazy environments only.
+  bool m_lazy_environments;
+  bool m_all_type_envs_populated{false};
+  std::unordered_map<const IRInstruction*, std::pair<cfg::Block*, uint32_t>>
+      m_positions;
+  // The most recently replayed block comes first.
+  std::vector<std::pair<cfg::Block*, std::vector<TypeEnvironment>>>
+      m_replayed_blocks;
+
   TypeDomain refine_type(const TypeDomain& type,
                          IRType expected,
                          IRType const_type,
@@ -845,15 +845,15 @@ const std::vector<std::vector<const VirtualScope*>>
         std::vector<std::vector<const VirtualScope*>>();
 
 ClassScopes::ClassScopes(const Scope& scope) {
-  m_hierarchy = build_type_hierarchy(scope);
-  m_interface_map = build_interface_map(m_hierarchy);
-  m_sig_map = build_signature_map(m_hierarchy);
+  m_hierarchy = g_redex->type_hierarchy_cache().type_hierarchy(scope);
+  m_interface_map = build_interface_map(*m_hierarchy);
+  m_sig_map = build_signature_map(*m_hierarchy);
   build_class_scopes(get_object_type());
   build_interface_scopes();
 }
 
 const ClassHierarchy& ClassScopes::get_parent_to_children() const {
-  return m_hierarchy;
+  return *m_hierarchy;
 }
 
 /**
@@ -866,8 +866,8 @@ void ClassScopes::build_class_scopes(const DexType* type) {
   always_assert(cls != nullptr || type == get_object_type());
   get_root_scopes(m_sig_map, type, m_scopes);
 
-  const auto& children_it = m_hierarchy.find(type);
-  if (children_it != m_hierarchy.end()) {
+  const auto& children_it = m_hierarchy->find(type);
+  if (children_it != m_hierarchy->end()) {
     for (const auto& child : children_it->second) {
       build_class_scopes(child);
     }
@@ -250,7 +250,7 @@ class ClassScopes {
 
   Scopes m_scopes;
   InterfaceScopes m_interface_scopes;
-  ClassHierarchy m_hierarchy;
+  std::shared_ptr<const ClassHierarchy> m_hierarchy;
   InterfaceMap m_interface_map;
   SignatureMap m_sig_map;
 
@@ -332,10 +332,10 @@ class ClassScopes {
       }
     }
     always_assert_log(
-        m_hierarchy.find(type) != m_hierarchy.end(),
+        m_hierarchy->find(type) != m_hierarchy->end(),
         "no entry in ClassHierarchy for type %s\n", SHOW(type));
     // recursively call for each child
-    for (const auto& child : m_hierarchy.at(type)) {
+    for (const auto& child : m_hierarchy->at(type)) {
       walk_virtual_scopes(child, walker);
     }
   }
@@ -365,10 +365,10 @@ class ClassScopes {
       walker(type, scopes_it->second);
     }
     always_assert_log(
-        m_hierarchy.find(type) != m_hierarchy.end(),
+        m_hierarchy->find(type) != m_hierarchy->end(),
         "no entry in ClassHierarchy for type %s\n", SHOW(type));
     // recursively call for each child
-    for (const auto& child : m_hierarchy.at(type)) {
+    for (const auto& child : m_hierarchy->at(type)) {
       walk_class_scopes(child, walker);
     }
   }
@@ -401,7 +401,7 @@ class ClassScopes {
    * such it should not exceed it.
    */
   const ClassHierarchy& get_class_hierarchy() const {
-    return m_hierarchy;
+    return *m_hierarchy;
   }
 
   /**
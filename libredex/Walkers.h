@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <numeric>
 #include <thread>
 #include <vector>
 
@@ -18,6 +19,7 @@
 #include "EditableCfgAdapter.h"
 #include "IRCode.h"
 #include "Match.h"
+#include "MethodTimings.h"
 #include "VirtualScope.h"
 #include "WorkQueue.h"
 
@@ -46,6 +48,7 @@ class walk {
   using VirtualScopeWalkerFn = const std::function<void(const VirtualScope*)>&;
   using MatchingInBlockWalkerFn = const std::function<void(
       DexMethod*, cfg::Block*, const std::vector<IRInstruction*>&)>&;
+  using MethodCostFn = const std::function<size_t(DexMethod*)>&;
 
   /**
    * Call walker on all classes in `classes`
@@ -361,7 +364,96 @@ class walk {
 
   static constexpr bool all_methods(DexMethod*) { return true; }
 
+  /*
+   * Groups `methods` for the *_by_cost parallel walkers. Methods are sorted
+   * heaviest first; any method that is at least as heavy as the batch target
+   * gets a batch of its own, and runs of lighter ones are packed together
+   * until their combined cost reaches the target. The target is chosen so
+   * that there are a few dozen batches per thread.
+   */
+  static std::vector<std::vector<DexMethod*>> partition_by_cost(
+      const std::vector<std::pair<DexMethod*, size_t>>& methods_and_costs,
+      size_t num_threads) {
+    std::vector<size_t> order(methods_and_costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return methods_and_costs[a].second > methods_and_costs[b].second;
+    });
+    size_t total_cost = 0;
+    for (const auto& p : methods_and_costs) {
+      total_cost += p.second;
+    }
+    constexpr size_t kBatchesPerThread = 32;
+    constexpr size_t kMinBatchCost = 64;
+    const size_t target = std::max(
+        kMinBatchCost, total_cost / (std::max<size_t>(num_threads, 1) *
+                                     kBatchesPerThread));
+
+    std::vector<std::vector<DexMethod*>> batches;
+    size_t batch_cost = 0;
+    for (auto idx : order) {
+      if (batches.empty() || batch_cost >= target) {
+        batches.emplace_back();
+        batch_cost = 0;
+      }
+      batches.back().push_back(methods_and_costs[idx].first);
+      // Count every method as at least one unit so that zero-cost methods
+      // still get split up eventually.
+      batch_cost += std::max<size_t>(methods_and_costs[idx].second, 1);
+    }
+    return batches;
+  }
+
+  template <class Classes>
+  static std::vector<std::vector<DexMethod*>> partition_by_cost(
+      const Classes& classes, MethodCostFn cost, size_t num_threads) {
+    std::vector<std::pair<DexMethod*, size_t>> methods_and_costs;
+    for (const auto& cls : classes) {
+      for (auto* m : cls->get_dmethods()) {
+        methods_and_costs.emplace_back(m, cost(m));
+      }
+      for (auto* m : cls->get_vmethods()) {
+        methods_and_costs.emplace_back(m, cost(m));
+      }
+    }
+    return partition_by_cost(methods_and_costs, num_threads);
+  }
+
+  /*
+   * Adds the batches so that the heaviest ones are started first (LPT
+   * scheduling). The Locking scheduler hands out each worker's queue FIFO,
+   * while under work-stealing the owner pops LIFO, so in that case we feed the
+   * queue lightest-first.
+   */
+  template <class WQ>
+  static void add_batches_heaviest_first(
+      WQ& wq, const std::vector<std::vector<DexMethod*>>& batches) {
+    if (wq.scheduler() == WorkQueueScheduler::WorkStealing) {
+      for (auto it = batches.rbegin(); it != batches.rend(); ++it) {
+        wq.add_item(&*it);
+      }
+    } else {
+      for (const auto& batch : batches) {
+        wq.add_item(&batch);
+      }
+    }
+  }
+
  public:
+  /**
+   * The default cost for the *_by_cost walkers: the size of the method's
+   * code in 16-bit code units, or zero if it has none. The code is only read,
+   * so that the method's code epoch doesn't move.
+   */
+  static size_t code_size_cost(DexMethod* m) {
+    const auto* code = static_cast<const DexMethod*>(m)->get_code();
+    if (code == nullptr) {
+      return 0;
+    }
+    return code->editable_cfg_built() ? code->cfg().sum_opcode_sizes()
+                                      : code->sum_opcode_sizes();
+  }
+
   /**
    * The parallel:: methods have very similar signatures (and names) to their
    * sequential counterparts.
@@ -418,10 +510,12 @@ class walk {
             Output out = init;
             for (auto dmethod : cls->get_dmethods()) {
               TraceContext context(dmethod->get_deobfuscated_name());
+              method_timings::Timer timer(dmethod);
               out = reducer(out, walker(dmethod));
             }
             for (auto vmethod : cls->get_vmethods()) {
               TraceContext context(vmethod->get_deobfuscated_name());
+              method_timings::Timer timer(vmethod);
               out = reducer(out, walker(vmethod));
             }
             return out;
@@ -436,6 +530,43 @@ class walk {
       return wq.run_all();
     }
 
+    /**
+     * Same as `reduce_methods()`, but the unit of parallelization is a batch
+     * of methods picked by `cost` instead of a class. Heavy methods are
+     * started first and run on their own, while light methods are batched to
+     * keep the per-task overhead down. Use this when a few huge methods would
+     * otherwise dominate the tail of the parallel phase.
+     */
+    template <class Output,
+              class Classes,
+              class MethodWalkerFn = Output(DexMethod*),
+              class OutputReducerFn = Output(Output, Output)>
+    Output static reduce_methods_by_cost(
+        const Classes& classes,
+        MethodWalkerFn walker,
+        OutputReducerFn reducer,
+        const Output& init = Output(),
+        size_t num_threads = default_num_threads(),
+        MethodCostFn cost = code_size_cost) {
+      using Batch = const std::vector<DexMethod*>*;
+      auto batches = partition_by_cost(classes, cost, num_threads);
+      auto wq = WorkQueue<Batch, std::nullptr_t, Output>(
+          [&](WorkerState<Batch, std::nullptr_t, Output>* state, Batch batch) {
+            Output out = init;
+            for (auto method : *batch) {
+              TraceContext context(method->get_deobfuscated_name());
+              method_timings::Timer timer(method);
+              out = reducer(out, walker(method));
+            }
+            return out;
+          },
+          reducer,
+          [](unsigned int) { return nullptr; },
+          num_threads);
+      add_batches_heaviest_first(wq, batches);
+      return wq.run_all();
+    }
+
     /**
      * Call `walker` on all fields in `classes` in parallel.
      */
@@ -460,7 +591,11 @@ class walk {
                      size_t num_threads = default_num_threads()) {
       auto wq = workqueue_foreach<DexClass*>(
           [&filter, &walker](DexClass* cls) {
-            walk::iterate_code(cls, filter, walker);
+            walk::iterate_code(cls, filter, [&walker](DexMethod* m,
+                                                      IRCode& code) {
+              method_timings::Timer timer(m);
+              walker(m, code);
+            });
           },
           num_threads);
       run_all(wq, classes);
@@ -476,6 +611,46 @@ class walk {
       walk::parallel::code(classes, all_methods, walker, num_threads);
     }
 
+    /**
+     * Same as `code()`, but scheduled by `cost` like
+     * `reduce_methods_by_cost()`.
+     */
+    template <class Classes>
+    static void code_by_cost(const Classes& classes,
+                             MethodFilterFn filter,
+                             CodeWalkerFn walker,
+                             size_t num_threads = default_num_threads(),
+                             MethodCostFn cost = code_size_cost) {
+      using Batch = const std::vector<DexMethod*>*;
+      auto batches = partition_by_cost(classes, cost, num_threads);
+      auto wq = workqueue_foreach<Batch>(
+          [&filter, &walker](Batch batch) {
+            for (auto method : *batch) {
+              if (!filter(method)) {
+                continue;
+              }
+              auto code = method->get_code();
+              if (code) {
+                TraceContext context(method->get_deobfuscated_name());
+                method_timings::Timer timer(method);
+                walker(method, *code);
+              }
+            }
+          },
+          num_threads);
+      add_batches_heaviest_first(wq, batches);
+      wq.run_all();
+    }
+
+    template <class Classes>
+    static void code_by_cost(const Classes& classes,
+                             CodeWalkerFn walker,
+                             size_t num_threads = default_num_threads(),
+                             MethodCostFn cost = code_size_cost) {
+      walk::parallel::code_by_cost(classes, all_methods, walker, num_threads,
+                                   cost);
+    }
+
     /**
      * Call `walker` on all opcodes (of methods approved by `filter`) in
      * `classes` in parallel.
@@ -574,9 +749,12 @@ class walk {
      * This code usually runs on a processor with Hyperthreading, where the
      * number of physical cores is half the number of logical cores. Setting
      * num_threads to that number often gets us good results, so that's the
-     * default.
+     * default, unless REDEX_NUM_THREADS says otherwise.
      */
     static unsigned int default_num_threads() {
+      if (auto configured = redex_parallel::configured_num_threads()) {
+        return configured;
+      }
       unsigned int threads = std::thread::hardware_concurrency() / 2;
       return std::max(1u, threads);
     }
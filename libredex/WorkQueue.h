@@ -8,18 +8,100 @@
 #pragma once
 
 #include "Debug.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "WorkStealingDeque.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/optional/optional.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <queue>
 #include <random>
+#include <vector>
+
+/*
+ * How a WorkQueue hands out work to its threads.
+ *
+ * Locking: every worker owns a mutex-guarded FIFO queue. An idle worker
+ *   probes the other queues once and exits if they all look empty.
+ *
+ * WorkStealing: every worker owns a lock-free Chase-Lev deque. The owner pops
+ *   LIFO (keeping recently pushed tasks cache-warm), idle workers steal FIFO
+ *   from the others. Workers park on a condition variable rather than exit
+ *   while any task is still outstanding, so tasks pushed late with
+ *   WorkerState::push_task() are still spread across all threads.
+ */
+enum class WorkQueueScheduler {
+  Locking,
+  WorkStealing,
+};
 
 namespace workqueue_impl {
 
+inline std::atomic<WorkQueueScheduler>& default_scheduler() {
+  static std::atomic<WorkQueueScheduler> scheduler{
+      WorkQueueScheduler::WorkStealing};
+  return scheduler;
+}
+
+inline std::atomic<uint64_t>& shuffle_seed() {
+  static std::atomic<uint64_t> seed{0};
+  return seed;
+}
+
+// The random source of a new queue in the shuffled mode, or null if it is
+// off. Every queue draws from its own, seeded from the global seed and the
+// number of queues created before it.
+inline std::unique_ptr<std::minstd_rand> make_shuffle_rng() {
+  static std::atomic<uint64_t> s_num_queues{0};
+  auto seed = shuffle_seed().load();
+  if (seed == 0) {
+    return nullptr;
+  }
+  return std::make_unique<std::minstd_rand>(
+      static_cast<std::minstd_rand::result_type>(seed + s_num_queues++));
+}
+
+inline unsigned int shuffled_num_threads(unsigned int num_threads,
+                                         std::minstd_rand* rng) {
+  return rng == nullptr || num_threads <= 1 ? num_threads
+                                            : 1 + (*rng)() % num_threads;
+}
+
+/*
+ * Bookkeeping shared between the workers of a WorkStealing queue.
+ */
+struct StealingSync {
+  // Tasks that have been pushed but whose mapper has not returned yet. The
+  // queue is drained exactly when this drops to zero.
+  std::atomic<size_t> pending{0};
+  std::atomic<size_t> num_parked{0};
+  // Bumped (under `mutex`) whenever a parked worker should take another look.
+  size_t epoch{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  void wake(bool all) {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      ++epoch;
+    }
+    if (all) {
+      cv.notify_all();
+    } else {
+      cv.notify_one();
+    }
+  }
+};
+
 /**
  * Creates a random ordering of which threads to visit.  This prevents threads
  * from being prematurely emptied (if everyone targets thread 0, for example)
@@ -40,6 +122,28 @@ inline std::vector<int> create_permutation(int num, unsigned int thread_idx) {
 
 } // namespace workqueue_impl
 
+/*
+ * Sets the scheduler used by WorkQueues that don't ask for one explicitly.
+ */
+inline void set_default_workqueue_scheduler(WorkQueueScheduler scheduler) {
+  workqueue_impl::default_scheduler().store(scheduler);
+}
+
+inline WorkQueueScheduler get_default_workqueue_scheduler() {
+  return workqueue_impl::default_scheduler().load();
+}
+
+/*
+ * With a nonzero seed, WorkQueues created from now on run with a random
+ * number of threads (up to the one they ask for), and hand out the items
+ * added before run_all() in a random order to random threads. Output that
+ * changes with the seed depends on the thread scheduling; redex-all uses
+ * this for --shuffle-work-seed.
+ */
+inline void set_workqueue_shuffle_seed(uint64_t seed) {
+  workqueue_impl::shuffle_seed().store(seed);
+}
+
 template <class Input,
           class Data = std::nullptr_t,
           class Output = std::nullptr_t>
@@ -57,6 +161,13 @@ class WorkerState {
    * as the latter is not thread-safe.
    */
   void push_task(Input task) {
+    if (m_sync != nullptr) {
+      push_stealable(std::move(task));
+      if (m_sync->num_parked.load() > 0) {
+        m_sync->wake(/* all */ false);
+      }
+      return;
+    }
     boost::lock_guard<boost::mutex> guard(m_queue_mtx);
     m_queue.push(task);
   }
@@ -76,9 +187,23 @@ class WorkerState {
     return boost::none;
   }
 
+  // Must only be called by the owning thread while the queue is running, or
+  // by anyone before it starts.
+  void push_stealable(Input task) {
+    m_sync->pending.fetch_add(1);
+    m_task_storage.push_back(std::move(task));
+    m_deque.push(&m_task_storage.back());
+  }
+
   size_t m_id;
   std::queue<Input> m_queue;
   boost::mutex m_queue_mtx;
+  // Only used by the WorkStealing scheduler. The deque holds pointers into
+  // m_task_storage, which is append-only while running so that elements never
+  // move under a thief.
+  workqueue_impl::StealingSync* m_sync{nullptr};
+  WorkStealingDeque<Input*> m_deque;
+  std::deque<Input> m_task_storage;
   Data m_data;
   Output m_result;
 
@@ -98,19 +223,41 @@ class WorkQueue {
 
   std::vector<std::unique_ptr<WorkerState<Input, Data, Output>>> m_states;
 
+  // Only in the shuffled mode, see set_workqueue_shuffle_seed(); the items
+  // are held back until run_all().
+  std::unique_ptr<std::minstd_rand> m_shuffle_rng;
+  std::vector<Input> m_shuffled_items;
+
   const size_t m_num_threads{1};
   size_t m_insert_idx{0};
+  WorkQueueScheduler m_scheduler;
+  // Heap-allocated so that the queue stays movable.
+  std::unique_ptr<workqueue_impl::StealingSync> m_sync;
+
+  void push_to(size_t idx, Input task) {
+    if (m_sync) {
+      m_states[idx]->push_stealable(std::move(task));
+    } else {
+      m_states[idx]->m_queue.push(task);
+    }
+  }
 
   void consume(WorkerState<Input, Data, Output>* state, Input task) {
     state->m_result = m_reducer(state->m_result, m_mapper(state, task));
   }
 
+  void run_locking(WorkerState<Input, Data, Output>* state, size_t state_idx);
+
+  void run_work_stealing(WorkerState<Input, Data, Output>* state,
+                         size_t state_idx);
+
  public:
   WorkQueue(
       Mapper mapper,
       std::function<Output(Output, Output)> reducer,
       std::function<Data(unsigned int /* thread index*/)> data_initializer,
-      unsigned int num_threads);
+      unsigned int num_threads,
+      WorkQueueScheduler scheduler = get_default_workqueue_scheduler());
 
   void add_item(Input task);
 
@@ -122,6 +269,8 @@ class WorkQueue {
     m_reducer = reducer;
   }
 
+  WorkQueueScheduler scheduler() const { return m_scheduler; }
+
   /**
    * Spawn threads and evaluate function.  This method blocks.
    */
@@ -133,12 +282,22 @@ WorkQueue<Input, Data, Output>::WorkQueue(
     WorkQueue::Mapper mapper,
     std::function<Output(Output, Output)> reducer,
     std::function<Data(unsigned int /* thread index*/)> data_initializer,
-    unsigned int num_threads)
-    : m_mapper(mapper), m_reducer(reducer), m_num_threads(num_threads) {
+    unsigned int num_threads,
+    WorkQueueScheduler scheduler)
+    : m_mapper(mapper),
+      m_reducer(reducer),
+      m_shuffle_rng(workqueue_impl::make_shuffle_rng()),
+      m_num_threads(workqueue_impl::shuffled_num_threads(
+          num_threads, m_shuffle_rng.get())),
+      m_scheduler(scheduler) {
   always_assert(num_threads >= 1);
+  if (m_scheduler == WorkQueueScheduler::WorkStealing) {
+    m_sync = std::make_unique<workqueue_impl::StealingSync>();
+  }
   for (unsigned int i = 0; i < m_num_threads; ++i) {
     m_states.emplace_back(std::make_unique<WorkerState<Input, Data, Output>>(
         i, data_initializer(i)));
+    m_states.back()->m_sync = m_sync.get();
   }
 }
 
@@ -150,7 +309,7 @@ template <class Input>
 WorkQueue<Input, std::nullptr_t /* Data */, std::nullptr_t /*Output*/>
 workqueue_foreach(const std::function<void(Input)>& func,
                   unsigned int num_threads =
-                      std::max(1u, boost::thread::hardware_concurrency())) {
+                      redex_parallel::default_num_threads()) {
   using Data = std::nullptr_t;
   using Output = std::nullptr_t;
   return WorkQueue<Input, Data, Output>(
@@ -171,8 +330,7 @@ template <class Input, class Output>
 WorkQueue<Input, std::nullptr_t /* Data */, Output> workqueue_mapreduce(
     const std::function<Output(Input)>& mapper,
     const std::function<Output(Output, Output)>& reducer,
-    unsigned int num_threads =
-        std::max(1u, boost::thread::hardware_concurrency())) {
+    unsigned int num_threads = redex_parallel::default_num_threads()) {
   using Data = std::nullptr_t;
   return WorkQueue<Input, std::nullptr_t, Output>(
       [mapper](WorkerState<Input, Data, Output>*, Input a) -> Output {
@@ -185,8 +343,12 @@ WorkQueue<Input, std::nullptr_t /* Data */, Output> workqueue_mapreduce(
 
 template <class Input, class Data, class Output>
 void WorkQueue<Input, Data, Output>::add_item(Input task) {
+  if (m_shuffle_rng) {
+    m_shuffled_items.push_back(std::move(task));
+    return;
+  }
   m_insert_idx = (m_insert_idx + 1) % m_num_threads;
-  m_states[m_insert_idx]->m_queue.push(task);
+  push_to(m_insert_idx, std::move(task));
 }
 
 /*
@@ -194,43 +356,141 @@ void WorkQueue<Input, Data, Output>::add_item(Input task) {
  * looks randomly at other queues to try and steal work.
  */
 template <class Input, class Data, class Output>
-Output WorkQueue<Input, Data, Output>::run_all(const Output& init_output) {
-  std::vector<boost::thread> all_threads;
-  auto worker = [&](WorkerState<Input, Data, Output>* state, size_t state_idx) {
-    state->m_result = init_output;
-    auto attempts =
-        workqueue_impl::create_permutation(m_num_threads, state_idx);
-    while (true) {
-      auto have_task = false;
+void WorkQueue<Input, Data, Output>::run_locking(
+    WorkerState<Input, Data, Output>* state, size_t state_idx) {
+  auto attempts = workqueue_impl::create_permutation(m_num_threads, state_idx);
+  while (true) {
+    auto have_task = false;
+    for (auto idx : attempts) {
+      auto other_state = m_states[idx].get();
+      auto task = other_state->pop_task();
+      if (task) {
+        have_task = true;
+        consume(state, *task);
+        break;
+      }
+    }
+    if (!have_task) {
+      return;
+    }
+  }
+}
+
+/*
+ * Each worker thread pops from the bottom of its own deque, and once that is
+ * empty steals from the top of the others in random order. A worker that
+ * finds nothing to steal parks until more work shows up or the last
+ * outstanding task finishes.
+ */
+template <class Input, class Data, class Output>
+void WorkQueue<Input, Data, Output>::run_work_stealing(
+    WorkerState<Input, Data, Output>* state, size_t state_idx) {
+  auto& sync = *m_sync;
+  auto attempts = workqueue_impl::create_permutation(m_num_threads, state_idx);
+  auto find_task = [&]() -> Input* {
+    Input* task = state->m_deque.pop();
+    if (task != nullptr) {
+      return task;
+    }
+    // A steal can fail spuriously when it loses a race, so go around a couple
+    // of times before concluding that there's nothing left.
+    for (size_t round = 0; round < 2; ++round) {
       for (auto idx : attempts) {
-        auto other_state = m_states[idx].get();
-        auto task = other_state->pop_task();
-        if (task) {
-          have_task = true;
-          consume(state, *task);
-          break;
+        if (static_cast<size_t>(idx) == state_idx) {
+          continue;
+        }
+        task = m_states[idx]->m_deque.steal();
+        if (task != nullptr) {
+          return task;
         }
       }
-      if (!have_task) {
-        return;
+    }
+    return nullptr;
+  };
+  auto any_stealable = [&]() {
+    for (auto& other : m_states) {
+      if (!other->m_deque.empty_approx()) {
+        return true;
       }
     }
+    return false;
   };
 
-  for (size_t i = 0; i < m_num_threads; ++i) {
-    boost::thread::attributes attrs;
-    attrs.set_stack_size(8 * 1024 * 1024);
-    all_threads.emplace_back(attrs,
-                             boost::bind<void>(worker, m_states[i].get(), i));
+  while (true) {
+    Input* task = find_task();
+    if (task != nullptr) {
+      consume(state, std::move(*task));
+      if (sync.pending.fetch_sub(1) == 1) {
+        // That was the last one; release everyone who is parked.
+        sync.wake(/* all */ true);
+        return;
+      }
+      continue;
+    }
+    if (sync.pending.load() == 0) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(sync.mutex);
+    auto epoch = sync.epoch;
+    sync.num_parked.fetch_add(1);
+    // Re-check after announcing ourselves so that a concurrent push either
+    // sees us parked or we see its task.
+    if (sync.pending.load() != 0 && !any_stealable()) {
+      // The timeout is a backstop; wakeups normally come from push_task() or
+      // from the worker that finishes the last task.
+      sync.cv.wait_for(lock, std::chrono::milliseconds(10), [&] {
+        return sync.epoch != epoch || sync.pending.load() == 0;
+      });
+    }
+    sync.num_parked.fetch_sub(1);
   }
+}
 
-  for (auto& thread : all_threads) {
-    thread.join();
+template <class Input, class Data, class Output>
+Output WorkQueue<Input, Data, Output>::run_all(const Output& init_output) {
+  if (m_shuffle_rng) {
+    std::shuffle(m_shuffled_items.begin(), m_shuffled_items.end(),
+                 *m_shuffle_rng);
+    for (auto& task : m_shuffled_items) {
+      push_to((*m_shuffle_rng)() % m_num_threads, std::move(task));
+    }
+    m_shuffled_items.clear();
+  }
+  std::vector<boost::thread> all_threads;
+  const std::string region =
+      profiler::is_enabled() ? profiler::current_span_name() + " [worker]" : "";
+  auto worker = [&](WorkerState<Input, Data, Output>* state, size_t state_idx) {
+    profiler::Span span(region);
+    state->m_result = init_output;
+    if (m_sync) {
+      run_work_stealing(state, state_idx);
+    } else {
+      run_locking(state, state_idx);
+    }
+  };
+
+  // Borrow the process-wide pool if there is one and it's free; otherwise
+  // spawn our own threads.
+  auto pool = ThreadPool::get_instance();
+  if (pool == nullptr ||
+      !pool->try_run(m_num_threads,
+                     [&](size_t i) { worker(m_states[i].get(), i); })) {
+    for (size_t i = 0; i < m_num_threads; ++i) {
+      boost::thread::attributes attrs;
+      attrs.set_stack_size(8 * 1024 * 1024);
+      all_threads.emplace_back(attrs,
+                               boost::bind<void>(worker, m_states[i].get(), i));
+    }
+
+    for (auto& thread : all_threads) {
+      thread.join();
+    }
   }
 
   Output result = init_output;
   for (auto& thread_state : m_states) {
     result = m_reducer(result, thread_state->m_result);
+    thread_state->m_task_storage.clear();
   }
   return result;
 }
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A Chase-Lev work-stealing deque, following the C11 formulation in
+ * "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê, Pop,
+ * Cohen, Zappa Nardelli; PPoPP 2013).
+ *
+ * Exactly one thread -- the owner -- may call push() and pop(); they operate
+ * LIFO on the bottom end. Any number of threads may call steal(), which takes
+ * FIFO from the top end. Neither side ever blocks.
+ *
+ * Elements are pointers so that every slot can be a plain std::atomic; callers
+ * keep the pointees alive for as long as the deque may hand them out. Buffers
+ * that are outgrown are retired rather than freed, since a concurrent thief
+ * may still be reading from them; they are released when the deque dies.
+ */
+template <typename T>
+class WorkStealingDeque {
+  static_assert(std::is_pointer<T>::value,
+                "WorkStealingDeque only holds pointers");
+
+ public:
+  explicit WorkStealingDeque(size_t log_capacity = 6) {
+    m_buffers.emplace_back(std::make_unique<Buffer>(log_capacity));
+    m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  /*
+   * Owner only.
+   */
+  void push(T item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    Buffer* buf = m_buffer.load(std::memory_order_relaxed);
+    if (b - t > buf->capacity() - 1) {
+      buf = grow(buf, t, b);
+    }
+    buf->put(b, item);
+    // The paper uses a release fence followed by a relaxed store; a release
+    // store is equivalent for our purposes and is understood by TSAN.
+    m_bottom.store(b + 1, std::memory_order_release);
+  }
+
+  /*
+   * Owner only. Returns nullptr if the deque is empty.
+   */
+  T pop() {
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* buf = m_buffer.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      // Empty.
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T item = buf->get(b);
+    if (t == b) {
+      // Last element: race against thieves for it.
+      if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  /*
+   * Any thread. Returns nullptr if the deque is empty or if another thread
+   * won the race for the top element.
+   */
+  T steal() {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    // The formal algorithm uses a consume load here; acquire is what every
+    // current compiler turns consume into anyway.
+    Buffer* buf = m_buffer.load(std::memory_order_acquire);
+    T item = buf->get(t);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  /*
+   * A racy snapshot; only meaningful as a hint.
+   */
+  size_t size_approx() const {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+  }
+
+  bool empty_approx() const { return size_approx() == 0; }
+
+ private:
+  class Buffer {
+   public:
+    explicit Buffer(size_t log_capacity)
+        : m_mask((int64_t(1) << log_capacity) - 1),
+          m_slots(new std::atomic<T>[size_t(1) << log_capacity]) {}
+
+    int64_t capacity() const { return m_mask + 1; }
+
+    T get(int64_t i) const {
+      return m_slots[i & m_mask].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, T item) {
+      m_slots[i & m_mask].store(item, std::memory_order_relaxed);
+    }
+
+    size_t log_capacity() const {
+      size_t log = 0;
+      while ((int64_t(1) << log) < capacity()) {
+        ++log;
+      }
+      return log;
+    }
+
+   private:
+    int64_t m_mask;
+    std::unique_ptr<std::atomic<T>[]> m_slots;
+  };
+
+  Buffer* grow(Buffer* old, int64_t t, int64_t b) {
+    m_buffers.emplace_back(std::make_unique<Buffer>(old->log_capacity() + 1));
+    Buffer* buf = m_buffers.back().get();
+    for (int64_t i = t; i < b; ++i) {
+      buf->put(i, old->get(i));
+    }
+    m_buffer.store(buf, std::memory_order_release);
+    return buf;
+  }
+
+  // top and bottom are written by different threads; keep them on separate
+  // cache lines.
+  static constexpr size_t kCacheLine = 64;
+  std::atomic<int64_t> m_top{0};
+  char m_pad0[kCacheLine - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> m_bottom{0};
+  char m_pad1[kCacheLine - sizeof(std::atomic<int64_t>)];
+  std::atomic<Buffer*> m_buffer{nullptr};
+  // Owner only. Holds the live buffer and every retired one.
+  std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
@@ -15,6 +15,7 @@
 #include "DexUtil.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 constexpr const char* METRIC_ANNO_KILLED = "num_anno_killed";
 constexpr const char* METRIC_ANNO_TOTAL = "num_anno_total";
@@ -38,7 +39,11 @@ AnnoKill::AnnoKill(Scope& scope,
                    const std::unordered_map<std::string, std::vector<std::string>>& class_hierarchy_keep_annos,
                    const std::unordered_map<std::string, std::vector<std::string>>& annotated_keep_annos
                    )
-  : m_scope(scope), m_only_force_kill(only_force_kill), m_kill_bad_signatures(kill_bad_signatures) {
+  : m_scope(scope),
+    m_scope_classes(scope.begin(), scope.end()),
+    m_only_force_kill(only_force_kill),
+    m_kill_bad_signatures(kill_bad_signatures),
+    m_signature_type(DexType::get_type("Ldalvik/annotation/Signature;")) {
   // Load annotations that should not be deleted.
   TRACE(ANNO, 2, "Keep annotations count %d", keep.size());
   for (const auto& anno_name : keep) {
@@ -110,196 +115,191 @@ AnnoKill::AnnoKill(Scope& scope,
 }
 
 AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
-  AnnoKill::AnnoSet all_annos;
-
-  // all used annotations
-  auto annos_in_aset = [&](DexAnnotationSet* aset) {
-    if (!aset) {
-      return;
-    }
-    for (const auto& anno : aset->get_annotations()) {
-      all_annos.insert(anno->type());
+  // The classes are looked at in parallel, each into sets of its own, which
+  // are merged once all of them are done.
+  auto for_each_class = [&](const std::function<void(size_t)>& fn) {
+    auto wq = workqueue_foreach<size_t>(fn,
+                                        walk::parallel::default_num_threads());
+    for (size_t i = 0; i < m_scope.size(); i++) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  };
+  auto merge = [](std::vector<AnnoSet>& class_annos) {
+    AnnoSet annos;
+    for (auto& cls_annos : class_annos) {
+      annos.insert(cls_annos.begin(), cls_annos.end());
     }
+    return annos;
   };
 
-  for (const auto& cls : m_scope) {
+  // all used annotations
+  std::vector<AnnoSet> class_all_annos(m_scope.size());
+  for_each_class([&](size_t i) {
+    auto& annos = class_all_annos[i];
+    auto annos_in_aset = [&](DexAnnotationSet* aset) {
+      if (!aset) {
+        return;
+      }
+      for (const auto& anno : aset->get_annotations()) {
+        annos.insert(anno->type());
+      }
+    };
+
+    auto cls = m_scope[i];
     // all annotations referenced in classes
     annos_in_aset(cls->get_anno_set());
-
     // all classes marked as annotation
     if (is_annotation(cls)) {
-      all_annos.insert(cls->get_type());
-    }
-  }
-
-  // all annotations in methods
-  walk::methods(m_scope, [&](DexMethod* method) {
-    annos_in_aset(method->get_anno_set());
-    auto param_annos = method->get_param_anno();
-    if (!param_annos) {
-      return;
-    }
-    for (auto pa : *param_annos) {
-      annos_in_aset(pa.second);
-    }
-  });
-  // all annotations in fields
-  walk::fields(m_scope,
-              [&](DexField* field) { annos_in_aset(field->get_anno_set()); });
-
-  AnnoKill::AnnoSet referenced_annos;
-
-  // mark an annotation as "unremovable" if a field is typed with that
-  // annotation
-  walk::fields(m_scope, [&](DexField* field) {
-    // don't look at fields defined on the annotation itself
-    const auto field_cls_type = field->get_class();
-    if (all_annos.count(field_cls_type) > 0) {
-      return;
-    }
-
-    const auto field_cls = type_class(field_cls_type);
-    if (field_cls != nullptr && is_annotation(field_cls)) {
-      return;
-    }
-
-    auto ftype = field->get_type();
-    if (all_annos.count(ftype) > 0) {
-      TRACE(ANNO,
-            3,
-            "Field typed with an annotation type %s.%s:%s",
-            SHOW(field->get_class()),
-            SHOW(field->get_name()),
-            SHOW(ftype));
-      referenced_annos.insert(ftype);
-    }
+      annos.insert(cls->get_type());
+    }
+    // all annotations in methods
+    walk::methods(Scope{cls}, [&](DexMethod* method) {
+      annos_in_aset(method->get_anno_set());
+      auto param_annos = method->get_param_anno();
+      if (!param_annos) {
+        return;
+      }
+      for (auto pa : *param_annos) {
+        annos_in_aset(pa.second);
+      }
+    });
+    // all annotations in fields
+    walk::fields(Scope{cls}, [&](DexField* field) {
+      annos_in_aset(field->get_anno_set());
+    });
   });
+  const auto all_annos = merge(class_all_annos);
 
-  // mark an annotation as "unremovable" if a method signature contains a type
-  // with that annotation
-  walk::methods(m_scope, [&](DexMethod* meth) {
-    // don't look at methods defined on the annotation itself
-    const auto meth_cls_type = meth->get_class();
-    if (all_annos.count(meth_cls_type) > 0) {
-      return;
-    }
-
-    const auto meth_cls = type_class(meth_cls_type);
-    if (meth_cls != nullptr && is_annotation(meth_cls)) {
+  std::vector<AnnoSet> class_referenced_annos(m_scope.size());
+  for_each_class([&](size_t i) {
+    auto cls = m_scope[i];
+    // don't look at members defined on the annotation itself
+    if (all_annos.count(cls->get_type()) > 0 || is_annotation(cls)) {
       return;
     }
+    auto& referenced_annos = class_referenced_annos[i];
 
-    const auto& has_anno = [&](DexType* type) {
-      if (all_annos.count(type) > 0) {
+    // mark an annotation as "unremovable" if a field is typed with that
+    // annotation
+    walk::fields(Scope{cls}, [&](DexField* field) {
+      auto ftype = field->get_type();
+      if (all_annos.count(ftype) > 0) {
         TRACE(ANNO,
               3,
-              "Method contains annotation type in signature %s.%s:%s",
-              SHOW(meth->get_class()),
-              SHOW(meth->get_name()),
-              SHOW(meth->get_proto()));
-        referenced_annos.insert(type);
+              "Field typed with an annotation type %s.%s:%s",
+              SHOW(field->get_class()),
+              SHOW(field->get_name()),
+              SHOW(ftype));
+        referenced_annos.insert(ftype);
       }
-    };
-
-    const auto proto = meth->get_proto();
-    has_anno(proto->get_rtype());
-    for (const auto& arg : proto->get_args()->get_type_list()) {
-      has_anno(arg);
-    }
-  });
-
-  // mark an annotation as "unremovable" if any opcode references the annotation
-  // type
-  walk::opcodes(
-      m_scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* meth, IRInstruction* insn) {
-        // don't look at methods defined on the annotation itself
-        const auto meth_cls_type = meth->get_class();
-        if (all_annos.count(meth_cls_type) > 0) {
-          return;
-        }
-        const auto meth_cls = type_class(meth_cls_type);
-        if (meth_cls != nullptr && is_annotation(meth_cls)) {
-          return;
+    });
+
+    // mark an annotation as "unremovable" if a method signature contains a
+    // type with that annotation
+    walk::methods(Scope{cls}, [&](DexMethod* meth) {
+      const auto& has_anno = [&](DexType* type) {
+        if (all_annos.count(type) > 0) {
+          TRACE(ANNO,
+                3,
+                "Method contains annotation type in signature %s.%s:%s",
+                SHOW(meth->get_class()),
+                SHOW(meth->get_name()),
+                SHOW(meth->get_proto()));
+          referenced_annos.insert(type);
         }
+      };
 
-        if (insn->has_type()) {
-          auto type = insn->get_type();
-          if (all_annos.count(type) > 0) {
-            referenced_annos.insert(type);
-            TRACE(ANNO,
-                  3,
-                  "Annotation referenced in type opcode\n\t%s.%s:%s - %s",
-                  SHOW(meth->get_class()),
-                  SHOW(meth->get_name()),
-                  SHOW(meth->get_proto()),
-                  SHOW(insn));
-          }
-        } else if (insn->has_field()) {
-          auto field = insn->get_field();
-          auto fdef = resolve_field(field,
-                                    is_sfield_op(insn->opcode())
-                                        ? FieldSearch::Static
-                                        : FieldSearch::Instance);
-          if (fdef != nullptr) field = fdef;
-
-          bool referenced = false;
-          auto owner = field->get_class();
-          if (all_annos.count(owner) > 0) {
-            referenced = true;
-            referenced_annos.insert(owner);
-          }
-          auto type = field->get_type();
-          if (all_annos.count(type) > 0) {
-            referenced = true;
-            referenced_annos.insert(type);
-          }
-          if (referenced) {
-            TRACE(ANNO,
-                  3,
-                  "Annotation referenced in field opcode\n\t%s.%s:%s - %s",
-                  SHOW(meth->get_class()),
-                  SHOW(meth->get_name()),
-                  SHOW(meth->get_proto()),
-                  SHOW(insn));
-          }
-        } else if (insn->has_method()) {
-          auto method = insn->get_method();
-          DexMethod* methdef = resolve_method(method, opcode_to_search(insn));
-          if (methdef != nullptr) method = methdef;
-
-          bool referenced = false;
-          auto owner = method->get_class();
-          if (all_annos.count(owner) > 0) {
-            referenced = true;
-            referenced_annos.insert(owner);
-          }
-          auto proto = method->get_proto();
-          auto rtype = proto->get_rtype();
-          if (all_annos.count(rtype) > 0) {
-            referenced = true;
-            referenced_annos.insert(rtype);
-          }
-          auto arg_list = proto->get_args();
-          for (const auto& arg : arg_list->get_type_list()) {
-            if (all_annos.count(arg) > 0) {
+      const auto proto = meth->get_proto();
+      has_anno(proto->get_rtype());
+      for (const auto& arg : proto->get_args()->get_type_list()) {
+        has_anno(arg);
+      }
+    });
+
+    // mark an annotation as "unremovable" if any opcode references the
+    // annotation type
+    walk::opcodes(
+        Scope{cls},
+        [](DexMethod*) { return true; },
+        [&](DexMethod* meth, IRInstruction* insn) {
+          if (insn->has_type()) {
+            auto type = insn->get_type();
+            if (all_annos.count(type) > 0) {
+              referenced_annos.insert(type);
+              TRACE(ANNO,
+                    3,
+                    "Annotation referenced in type opcode\n\t%s.%s:%s - %s",
+                    SHOW(meth->get_class()),
+                    SHOW(meth->get_name()),
+                    SHOW(meth->get_proto()),
+                    SHOW(insn));
+            }
+          } else if (insn->has_field()) {
+            auto field = insn->get_field();
+            auto fdef = resolve_field(field,
+                                      is_sfield_op(insn->opcode())
+                                          ? FieldSearch::Static
+                                          : FieldSearch::Instance);
+            if (fdef != nullptr) field = fdef;
+
+            bool referenced = false;
+            auto owner = field->get_class();
+            if (all_annos.count(owner) > 0) {
               referenced = true;
-              referenced_annos.insert(arg);
+              referenced_annos.insert(owner);
+            }
+            auto type = field->get_type();
+            if (all_annos.count(type) > 0) {
+              referenced = true;
+              referenced_annos.insert(type);
+            }
+            if (referenced) {
+              TRACE(ANNO,
+                    3,
+                    "Annotation referenced in field opcode\n\t%s.%s:%s - %s",
+                    SHOW(meth->get_class()),
+                    SHOW(meth->get_name()),
+                    SHOW(meth->get_proto()),
+                    SHOW(insn));
+            }
+          } else if (insn->has_method()) {
+            auto method = insn->get_method();
+            DexMethod* methdef = resolve_method(method, opcode_to_search(insn));
+            if (methdef != nullptr) method = methdef;
+
+            bool referenced = false;
+            auto owner = method->get_class();
+            if (all_annos.count(owner) > 0) {
+              referenced = true;
+              referenced_annos.insert(owner);
+            }
+            auto proto = method->get_proto();
+            auto rtype = proto->get_rtype();
+            if (all_annos.count(rtype) > 0) {
+              referenced = true;
+              referenced_annos.insert(rtype);
+            }
+            auto arg_list = proto->get_args();
+            for (const auto& arg : arg_list->get_type_list()) {
+              if (all_annos.count(arg) > 0) {
+                referenced = true;
+                referenced_annos.insert(arg);
+              }
+            }
+            if (referenced) {
+              TRACE(ANNO,
+                    3,
+                    "Annotation referenced in method opcode\n\t%s.%s:%s - %s",
+                    SHOW(meth->get_class()),
+                    SHOW(meth->get_name()),
+                    SHOW(meth->get_proto()),
+                    SHOW(insn));
             }
           }
-          if (referenced) {
-            TRACE(ANNO,
-                  3,
-                  "Annotation referenced in method opcode\n\t%s.%s:%s - %s",
-                  SHOW(meth->get_class()),
-                  SHOW(meth->get_name()),
-                  SHOW(meth->get_proto()),
-                  SHOW(insn));
-          }
-        }
-      });
-  return referenced_annos;
+        });
+  });
+  return merge(class_referenced_annos);
 }
 
 AnnoKill::AnnoSet AnnoKill::get_removable_annotation_instances() {
@@ -329,28 +329,65 @@ AnnoKill::AnnoSet AnnoKill::get_removable_annotation_instances() {
   return bannotations;
 }
 
-void AnnoKill::count_annotation(const DexAnnotation* da) {
-  std::string annoName(da->type()->get_name()->c_str());
+AnnoKill::AnnoKillStats& AnnoKill::AnnoKillStats::operator+=(
+    const AnnoKillStats& that) {
+  annotations += that.annotations;
+  annotations_killed += that.annotations_killed;
+  class_asets += that.class_asets;
+  class_asets_cleared += that.class_asets_cleared;
+  method_asets += that.method_asets;
+  method_asets_cleared += that.method_asets_cleared;
+  method_param_asets += that.method_param_asets;
+  method_param_asets_cleared += that.method_param_asets_cleared;
+  field_asets += that.field_asets;
+  field_asets_cleared += that.field_asets_cleared;
+  visibility_build_count += that.visibility_build_count;
+  visibility_runtime_count += that.visibility_runtime_count;
+  visibility_system_count += that.visibility_system_count;
+  signatures_killed += that.signatures_killed;
+  return *this;
+}
+
+void AnnoKill::Counts::merge(const Counts& that) {
+  stats += that.stats;
+  for (const auto& p : that.build_anno_map) {
+    build_anno_map[p.first] += p.second;
+  }
+  for (const auto& p : that.runtime_anno_map) {
+    runtime_anno_map[p.first] += p.second;
+  }
+  for (const auto& p : that.system_anno_map) {
+    system_anno_map[p.first] += p.second;
+  }
+}
+
+void AnnoKill::count_annotation(const DexAnnotation* da, Counts& counts) {
+  // The counts by name are only ever traced.
+  bool by_name = traceEnabled(ANNO, 3);
+  auto anno_name = [da]() { return da->type()->get_name()->str(); };
   if (da->system_visible()) {
-    m_system_anno_map[annoName]++;
-    m_stats.visibility_system_count++;
+    if (by_name) counts.system_anno_map[anno_name()]++;
+    counts.stats.visibility_system_count++;
   } else if (da->runtime_visible()) {
-    m_runtime_anno_map[annoName]++;
-    m_stats.visibility_runtime_count++;
+    if (by_name) counts.runtime_anno_map[anno_name()]++;
+    counts.stats.visibility_runtime_count++;
   } else if (da->build_visible()) {
-    m_build_anno_map[annoName]++;
-    m_stats.visibility_build_count++;
+    if (by_name) counts.build_anno_map[anno_name()]++;
+    counts.stats.visibility_build_count++;
   }
 }
 
-void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
-                            const AnnoKill::AnnoSet& referenced_annos,
-                            const std::unordered_set<const DexType*>& keep_annos) {
-  m_stats.annotations += aset->size();
+void AnnoKill::cleanup_aset(
+    DexAnnotationSet* aset,
+    const AnnoKill::AnnoSet& referenced_annos,
+    const std::unordered_set<const DexType*>& keep_annos,
+    Counts& counts) {
+  auto& stats = counts.stats;
+  stats.annotations += aset->size();
   auto& annos = aset->get_annotations();
   auto fn = [&](DexAnnotation* da) {
     auto anno_type = da->type();
-    count_annotation(da);
+    count_annotation(da, counts);
 
     if (referenced_annos.count(anno_type) > 0) {
       TRACE(ANNO,
@@ -386,7 +423,7 @@ void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
             "annotation: %s",
             SHOW(anno_type),
             SHOW(da));
-      m_stats.annotations_killed++;
+      stats.annotations_killed++;
       delete da;
       return true;
     }
@@ -398,21 +435,21 @@ void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
             "annotation: %s",
             SHOW(anno_type),
             SHOW(da));
-      m_stats.annotations_killed++;
+      stats.annotations_killed++;
       delete da;
       return true;
     }
 
     if (!m_only_force_kill && !da->system_visible()) {
       TRACE(ANNO, 3, "Killing annotation instance %s", SHOW(da));
-      m_stats.annotations_killed++;
+      stats.annotations_killed++;
       delete da;
       return true;
     }
 
-    if (anno_type == DexType::get_type("Ldalvik/annotation/Signature;")) {
+    if (anno_type == m_signature_type) {
       if (should_kill_bad_signature(da)) {
-        m_stats.signatures_killed++;
+        stats.signatures_killed++;
         delete da;
         return true;
       }
@@ -472,20 +509,11 @@ bool AnnoKill::should_kill_bad_signature(DexAnnotation* da) {
           auto* sigcls = type_class(sigtype);
           if (!sigcls) {
             sigtype = nullptr;
-          } else if (!sigcls->is_external()) {
-            bool found = false;
-            for (auto cls : m_scope) {
-              if (cls == sigcls) {
-                // Valid class, we're good, go to element in array
-                found = true;
-                continue;
-              }
-            }
+          } else if (!sigcls->is_external() &&
+                     m_scope_classes.count(sigcls) == 0) {
             // Could not find the (non-external) class in Scope, so set signal
             // to kill
-            if (!found) {
-              sigtype = nullptr;
-            }
+            sigtype = nullptr;
           }
         }
         if (!sigtype) {
@@ -501,46 +529,45 @@ bool AnnoKill::should_kill_bad_signature(DexAnnotation* da) {
 std::unordered_set<const DexType*> AnnoKill::build_anno_keep(DexAnnotationSet* aset) {
   std::unordered_set<const DexType*> keep_list;
   for (const auto& anno : aset->get_annotations()) {
-    auto& keeps = m_annotated_keep_annos[anno->type()];
-    keep_list.insert(keeps.begin(), keeps.end());
+    auto it = m_annotated_keep_annos.find(anno->type());
+    if (it != m_annotated_keep_annos.end()) {
+      keep_list.insert(it->second.begin(), it->second.end());
+    }
   }
   return keep_list;
 }
 
-bool AnnoKill::kill_annotations() {
-  const auto& referenced_annos = get_referenced_annos();
-  if (!m_only_force_kill) {
-    m_kill = get_removable_annotation_instances();
-  }
-
-  for (auto clazz : m_scope) {
-    DexAnnotationSet* aset = clazz->get_anno_set();
-    if (!aset) {
-      continue;
-    }
+void AnnoKill::cleanup_class(DexClass* clazz,
+                             const AnnoSet& referenced_annos,
+                             Counts& counts) {
+  auto& stats = counts.stats;
+  DexAnnotationSet* aset = clazz->get_anno_set();
+  if (aset) {
     auto keep_list = build_anno_keep(aset);
-    auto& class_hier_keep_list = m_anno_class_hierarchy_keep[clazz->get_type()];
-    keep_list.insert(class_hier_keep_list.begin(), class_hier_keep_list.end());
+    auto hier_keep = m_anno_class_hierarchy_keep.find(clazz->get_type());
+    if (hier_keep != m_anno_class_hierarchy_keep.end()) {
+      keep_list.insert(hier_keep->second.begin(), hier_keep->second.end());
+    }
 
-    m_stats.class_asets++;
-    cleanup_aset(aset, referenced_annos, keep_list);
+    stats.class_asets++;
+    cleanup_aset(aset, referenced_annos, keep_list, counts);
     if (aset->size() == 0) {
       TRACE(ANNO,
             3,
             "Clearing annotation for class %s",
             SHOW(clazz->get_type()));
       clazz->clear_annotations();
-      m_stats.class_asets_cleared++;
+      stats.class_asets_cleared++;
     }
   }
 
-  walk::methods(m_scope, [&](DexMethod* method) {
+  walk::methods(Scope{clazz}, [&](DexMethod* method) {
     // Method annotations
     auto method_aset = method->get_anno_set();
     if (method_aset) {
-      m_stats.method_asets++;
+      stats.method_asets++;
       auto keep_list = build_anno_keep(method_aset);
-      cleanup_aset(method_aset, referenced_annos, keep_list);
+      cleanup_aset(method_aset, referenced_annos, keep_list, counts);
       if (method_aset->size() == 0) {
         TRACE(ANNO,
               3,
@@ -549,14 +576,14 @@ bool AnnoKill::kill_annotations() {
               SHOW(method->get_name()),
               SHOW(method->get_proto()));
         method->clear_annotations();
-        m_stats.method_asets_cleared++;
+        stats.method_asets_cleared++;
       }
     }
 
     // Parameter annotations.
     auto param_annos = method->get_param_anno();
     if (param_annos) {
-      m_stats.method_param_asets += param_annos->size();
+      stats.method_param_asets += param_annos->size();
       bool clear_pas = true;
       for (auto pa : *param_annos) {
         auto param_aset = pa.second;
@@ -564,7 +591,7 @@ bool AnnoKill::kill_annotations() {
           continue;
         }
         auto keep_list = build_anno_keep(param_aset);
-        cleanup_aset(param_aset, referenced_annos, keep_list);
+        cleanup_aset(param_aset, referenced_annos, keep_list, counts);
         if (param_aset->size() == 0) {
           continue;
         }
@@ -577,7 +604,7 @@ bool AnnoKill::kill_annotations() {
               SHOW(method->get_class()),
               SHOW(method->get_name()),
               SHOW(method->get_proto()));
-        m_stats.method_param_asets_cleared += param_annos->size();
+        stats.method_param_asets_cleared += param_annos->size();
         for (auto pa : *param_annos) {
           delete pa.second;
         }
@@ -586,14 +613,14 @@ bool AnnoKill::kill_annotations() {
     }
   });
 
-  walk::fields(m_scope, [&](DexField* field) {
+  walk::fields(Scope{clazz}, [&](DexField* field) {
     DexAnnotationSet* aset = field->get_anno_set();
     if (!aset) {
       return;
     }
-    m_stats.field_asets++;
+    stats.field_asets++;
     auto keep_list = build_anno_keep(aset);
-    cleanup_aset(aset, referenced_annos, keep_list);
+    cleanup_aset(aset, referenced_annos, keep_list, counts);
     if (aset->size() == 0) {
       TRACE(ANNO,
             3,
@@ -602,9 +629,34 @@ bool AnnoKill::kill_annotations() {
             SHOW(field->get_name()),
             SHOW(field->get_type()));
       field->clear_annotations();
-      m_stats.field_asets_cleared++;
+      stats.field_asets_cleared++;
     }
   });
+}
+
+bool AnnoKill::kill_annotations() {
+  const auto& referenced_annos = get_referenced_annos();
+  if (!m_only_force_kill) {
+    m_kill = get_removable_annotation_instances();
+  }
+
+  // Each class, with its members, is cleaned up on its own, and counts what
+  // it did in counts of its own.
+  std::vector<Counts> class_counts(m_scope.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        cleanup_class(m_scope[i], referenced_annos, class_counts[i]);
+      },
+      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < m_scope.size(); i++) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  Counts counts;
+  for (const auto& cls_counts : class_counts) {
+    counts.merge(cls_counts);
+  }
+  m_stats += counts.stats;
 
   bool classes_removed = false;
   // We're done removing annotation instances, go ahead and remove annotation
@@ -631,15 +683,15 @@ bool AnnoKill::kill_annotations() {
                                }),
                 m_scope.end());
 
-  for (const auto& p : m_build_anno_map) {
+  for (const auto& p : counts.build_anno_map) {
     TRACE(ANNO, 3, "Build anno: %lu, %s", p.second, p.first.c_str());
   }
 
-  for (const auto& p : m_runtime_anno_map) {
+  for (const auto& p : counts.runtime_anno_map) {
     TRACE(ANNO, 3, "Runtime anno: %lu, %s", p.second, p.first.c_str());
   }
 
-  for (const auto& p : m_system_anno_map) {
+  for (const auto& p : counts.system_anno_map) {
     TRACE(ANNO, 3, "System anno: %lu, %s", p.second, p.first.c_str());
   }
 
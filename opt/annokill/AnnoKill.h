@@ -36,6 +36,8 @@ class AnnoKill {
     size_t signatures_killed;
 
     AnnoKillStats() { memset(this, 0, sizeof(AnnoKillStats)); }
+
+    AnnoKillStats& operator+=(const AnnoKillStats& that);
   };
 
   AnnoKill(Scope& scope,
@@ -63,23 +65,37 @@ class AnnoKill {
   // of annotation types to be removed.
   AnnoSet get_removable_annotation_instances();
 
-  void cleanup_aset(
-    DexAnnotationSet* aset,
-    const AnnoSet& referenced_annos,
-    const std::unordered_set<const DexType*>& keep_annos = std::unordered_set<const DexType*>{});
-  void count_annotation(const DexAnnotation* da);
+  // What cleaning up one class did. Classes are cleaned up in parallel, and
+  // their counts are merged afterwards.
+  struct Counts {
+    AnnoKillStats stats;
+    std::map<std::string, size_t> build_anno_map;
+    std::map<std::string, size_t> runtime_anno_map;
+    std::map<std::string, size_t> system_anno_map;
+
+    void merge(const Counts& that);
+  };
+
+  // Cleans up the annotations of the class and of its members.
+  void cleanup_class(DexClass* clazz,
+                     const AnnoSet& referenced_annos,
+                     Counts& counts);
+  void cleanup_aset(DexAnnotationSet* aset,
+                    const AnnoSet& referenced_annos,
+                    const std::unordered_set<const DexType*>& keep_annos,
+                    Counts& counts);
+  void count_annotation(const DexAnnotation* da, Counts& counts);
 
   Scope& m_scope;
+  std::unordered_set<const DexClass*> m_scope_classes;
   bool m_only_force_kill;
   bool m_kill_bad_signatures;
+  const DexType* m_signature_type;
   AnnoSet m_kill;
   AnnoSet m_force_kill;
   AnnoSet m_keep;
   AnnoKillStats m_stats;
 
-  std::map<std::string, size_t> m_build_anno_map;
-  std::map<std::string, size_t> m_runtime_anno_map;
-  std::map<std::string, size_t> m_system_anno_map;
   std::unordered_map<const DexType*, std::unordered_set<const DexType*>> m_anno_class_hierarchy_keep;
   std::unordered_map<const DexType*, std::unordered_set<const DexType*>> m_annotated_keep_annos;
 };
@@ -17,11 +17,15 @@
  * Each class is filled with up to a configurable number of methods; only when
  * a class is full, another one is created. Separate classes are created for
  * distinct required api levels.
+ *
+ * Besides the method weights of the cold-start profile, methods that ran
+ * according to the block heat of the "instrument_profiles" stay in place.
  */
 
 #include "ClassSplitting.h"
 
 #include <algorithm>
+#include <mutex>
 #include <vector>
 
 #include "ApiLevelChecker.h"
@@ -34,6 +38,7 @@
 #include "InterDexPass.h"
 #include "PluginRegistry.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -41,10 +46,13 @@ constexpr const char* METRIC_RELOCATION_CLASSES =
     "num_class_splitting_relocation_classes";
 constexpr const char* METRIC_RELOCATED_STATIC_METHODS =
     "num_class_splitting_relocated_static_methods";
+constexpr const char* METRIC_HOT_BY_BLOCK_HEAT =
+    "num_class_splitting_methods_hot_by_block_heat";
 
 struct ClassSplittingStats {
   size_t relocation_classes{0};
   size_t relocated_static_methods{0};
+  size_t hot_by_block_heat{0};
 };
 
 class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
@@ -56,6 +64,7 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
 
   void configure(const Scope& scope, ConfigFiles& conf) override {
     m_method_to_weight = &conf.get_method_to_weight();
+    m_method_to_block_heat = &conf.get_method_to_block_heat();
     m_method_sorting_whitelisted_substrings =
         &conf.get_method_sorting_whitelisted_substrings();
   };
@@ -102,6 +111,10 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
       if (weight > 0) {
         continue;
       }
+      if (ran_according_to_block_heat(method)) {
+        ++m_stats.hot_by_block_heat;
+        continue;
+      }
       int api_level = api::LevelChecker::get_method_level(method);
       TargetClassInfo& target_class_info = m_target_classes[api_level];
       if (target_class_info.target_cls == nullptr ||
@@ -223,18 +236,35 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
   }
 
   void cleanup(const std::vector<DexClass*>& scope) override {
-    // Here we do the actual relocation.
+    // Here we do the actual relocation. Moving the methods changes the
+    // method lists of their classes, so it happens serially; the references
+    // to a relocated method are renamed along with it and need no rewriting.
     for (auto& p : m_methods_to_relocate) {
       DexMethod* method = p.first;
       DexClass* target_cls = p.second;
       set_public(method);
       relocate_method(method, target_cls->get_type());
-      change_visibility(method);
     }
 
+    // Then what the relocated methods access is gathered in parallel, and
+    // made public in one go.
+    VisibilityChanges visibility_changes;
+    std::mutex visibility_changes_mutex;
+    auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* method) {
+      auto changes = get_visibility_changes(method);
+      std::lock_guard<std::mutex> lock(visibility_changes_mutex);
+      visibility_changes.insert(changes);
+    });
+    for (auto& p : m_methods_to_relocate) {
+      wq.add_item(p.first);
+    }
+    wq.run_all();
+    visibility_changes.apply();
+
     m_mgr.incr_metric(METRIC_RELOCATION_CLASSES, m_stats.relocation_classes);
     m_mgr.incr_metric(METRIC_RELOCATED_STATIC_METHODS,
                       m_stats.relocated_static_methods);
+    m_mgr.incr_metric(METRIC_HOT_BY_BLOCK_HEAT, m_stats.hot_by_block_heat);
 
     // Releasing memory
     m_target_classes.clear();
@@ -249,6 +279,9 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
   const std::unordered_set<std::string>*
       m_method_sorting_whitelisted_substrings{nullptr};
 
+  const std::unordered_map<std::string, std::vector<uint64_t>>*
+      m_method_to_block_heat{nullptr};
+
   struct RelocatableMethodInfo {
     DexClass* target_cls;
     int32_t api_level;
@@ -271,6 +304,19 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
   std::vector<std::pair<DexMethod*, DexClass*>> m_methods_to_relocate;
   ClassSplittingStats m_stats;
 
+  // Whether any block of the method ran in the instrumented runs. Methods
+  // that are not in the profiles are left to their weight.
+  bool ran_according_to_block_heat(const DexMethod* method) {
+    auto it =
+        m_method_to_block_heat->find(method->get_fully_deobfuscated_name());
+    if (it == m_method_to_block_heat->end()) {
+      return false;
+    }
+    const auto& heat = it->second;
+    return std::any_of(heat.begin(), heat.end(),
+                       [](uint64_t count) { return count > 0; });
+  }
+
   bool can_relocate(const DexClass* cls) {
     return !cls->get_clinit() && !cls->is_external() &&
            !cls->rstate.is_generated();
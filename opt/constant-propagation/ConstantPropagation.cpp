@@ -13,16 +13,60 @@
 
 using namespace constant_propagation;
 
+namespace {
+
+struct Stats {
+  Transform::Stats transform;
+  size_t fixpoint_iterations{0};
+  size_t max_fixpoint_iterations{0};
+  size_t methods_over_budget{0};
+  size_t methods_skipped{0};
+
+  Stats operator+(const Stats& that) const {
+    Stats result;
+    result.transform = transform + that.transform;
+    result.fixpoint_iterations =
+        fixpoint_iterations + that.fixpoint_iterations;
+    result.max_fixpoint_iterations =
+        std::max(max_fixpoint_iterations, that.max_fixpoint_iterations);
+    result.methods_over_budget =
+        methods_over_budget + that.methods_over_budget;
+    result.methods_skipped = methods_skipped + that.methods_skipped;
+    return result;
+  }
+};
+
+} // namespace
+
+bool ConstantPropagationPass::is_fixed_point(const DexMethod* method) {
+  auto fixed_point = m_fixed_points.get(method, FixedPoint());
+  return fixed_point.code_epoch == method->get_code_epoch() &&
+         fixed_point.replace_moves_with_consts ==
+             m_config.transform.replace_moves_with_consts &&
+         fixed_point.fixpoint_iteration_budget ==
+             m_config.fixpoint_iteration_budget;
+}
+
 void ConstantPropagationPass::run_pass(DexStoresVector& stores,
                                        ConfigFiles&,
                                        PassManager& mgr) {
   auto scope = build_class_scope(stores);
+  auto summarized_arrays_before =
+      ConstantPrimitiveArrayDomain::num_summarized();
 
-  auto stats = walk::parallel::reduce_methods<Transform::Stats>(
+  auto stats = walk::parallel::reduce_methods<Stats>(
       scope,
       [&](DexMethod* method) {
-        if (method->get_code() == nullptr) {
-          return Transform::Stats();
+        // Only look at the code through a const method until we know that we
+        // are going to analyze it, so that its epoch doesn't change.
+        if (static_cast<const DexMethod*>(method)->get_code() == nullptr) {
+          return Stats();
+        }
+        if (m_config.skip_unchanged_methods && is_fixed_point(method)) {
+          TRACE(CONSTP, 3, "Skipping unchanged method: %s", SHOW(method));
+          Stats stats;
+          stats.methods_skipped = 1;
+          return stats;
         }
 
         TRACE(CONSTP, 2, "Method: %s", SHOW(method));
@@ -33,23 +77,65 @@ void ConstantPropagationPass::run_pass(DexStoresVector& stores,
         TRACE(CONSTP, 5, "CFG: %s", SHOW(cfg));
         intraprocedural::FixpointIterator fp_iter(cfg,
                                                   ConstantPrimitiveAnalyzer());
+        sparta::WideningPolicy<ConstantEnvironment> policy;
+        policy.iteration_budget = m_config.fixpoint_iteration_budget;
+        fp_iter.set_widening_policy(policy);
         fp_iter.run(ConstantEnvironment());
+        const auto& fp_stats = fp_iter.get_iteration_stats();
+        TRACE(CONSTP, 3, "Fixpoint iterations: %zu (at most %u per loop)%s",
+              fp_stats.iterations, fp_stats.max_local_iterations,
+              fp_stats.budget_exhausted ? ", over budget" : "");
+        Stats stats;
+        stats.fixpoint_iterations = fp_stats.iterations;
+        stats.max_fixpoint_iterations = fp_stats.iterations;
+        stats.methods_over_budget = fp_stats.budget_exhausted ? 1 : 0;
         constant_propagation::Transform tf(m_config.transform);
-        return tf.apply(fp_iter, WholeProgramState(), &code);
+        stats.transform = tf.apply(fp_iter, WholeProgramState(), &code);
+        if (!tf.made_changes()) {
+          FixedPoint fixed_point;
+          fixed_point.code_epoch = method->get_code_epoch();
+          fixed_point.replace_moves_with_consts =
+              m_config.transform.replace_moves_with_consts;
+          fixed_point.fixpoint_iteration_budget =
+              m_config.fixpoint_iteration_budget;
+          m_fixed_points.insert_or_assign(std::make_pair(method, fixed_point));
+        }
+        return stats;
       },
 
-      [](Transform::Stats a, Transform::Stats b) { // reducer
+      [](Stats a, Stats b) { // reducer
         return a + b;
       });
 
-  mgr.incr_metric("num_branch_propagated", stats.branches_removed);
-  mgr.incr_metric("num_materialized_consts", stats.materialized_consts);
+  mgr.incr_metric("num_branch_propagated", stats.transform.branches_removed);
+  mgr.incr_metric("num_materialized_consts",
+                  stats.transform.materialized_consts);
+  mgr.incr_metric("num_fixpoint_iterations", stats.fixpoint_iterations);
+  mgr.incr_metric("max_fixpoint_iterations_per_method",
+                  stats.max_fixpoint_iterations);
+  mgr.incr_metric("num_methods_over_fixpoint_budget",
+                  stats.methods_over_budget);
+  mgr.incr_metric("num_unchanged_methods_skipped", stats.methods_skipped);
+  mgr.incr_metric("num_summarized_arrays",
+                  ConstantPrimitiveArrayDomain::num_summarized() -
+                      summarized_arrays_before);
 
-  TRACE(CONSTP, 1, "num_branch_propagated: %d", stats.branches_removed);
+  TRACE(CONSTP,
+        1,
+        "num_branch_propagated: %d",
+        stats.transform.branches_removed);
   TRACE(CONSTP,
         1,
         "num_moves_replaced_by_const_loads: %d",
-        stats.materialized_consts);
+        stats.transform.materialized_consts);
+  TRACE(CONSTP,
+        1,
+        "fixpoint iterations: %zu, at most %zu in one method, %zu methods "
+        "over budget",
+        stats.fixpoint_iterations,
+        stats.max_fixpoint_iterations,
+        stats.methods_over_budget);
+  TRACE(CONSTP, 1, "skipped %zu unchanged methods", stats.methods_skipped);
 }
 
 static ConstantPropagationPass s_pass;
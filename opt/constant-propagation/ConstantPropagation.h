@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "ConstantPropagationAnalysis.h"
 #include "ConstantPropagationTransform.h"
 #include "Pass.h"
@@ -15,6 +16,13 @@ class ConstantPropagationPass : public Pass {
  public:
   struct Config {
     constant_propagation::Transform::Config transform;
+    // The number of iterations at loop heads, per method, after which the
+    // analysis gives up on the loops it has not stabilized yet. Zero means
+    // unlimited.
+    size_t fixpoint_iteration_budget{0};
+    // Whether to skip the methods that an earlier run with the same config
+    // left unchanged, as long as their code has not changed since.
+    bool skip_unchanged_methods{true};
   };
 
   ConstantPropagationPass() : Pass("ConstantPropagationPass") {}
@@ -23,6 +31,10 @@ class ConstantPropagationPass : public Pass {
     bind("replace_moves_with_consts",
          true,
          m_config.transform.replace_moves_with_consts);
+    bind("fixpoint_iteration_budget",
+         size_t(0),
+         m_config.fixpoint_iteration_budget);
+    bind("skip_unchanged_methods", true, m_config.skip_unchanged_methods);
   }
 
   void run_pass(DexStoresVector& stores,
@@ -30,5 +42,17 @@ class ConstantPropagationPass : public Pass {
                 PassManager& mgr) override;
 
  private:
+  // A run of the pass that left a method unchanged: running it again with the
+  // same config, on the same code, would not change it either. The pass runs
+  // with the same instance each time it is listed, so this carries over.
+  struct FixedPoint {
+    uint64_t code_epoch{0};
+    bool replace_moves_with_consts;
+    size_t fixpoint_iteration_budget;
+  };
+
+  bool is_fixed_point(const DexMethod* method);
+
   Config m_config;
+  ConcurrentMap<const DexMethod*, FixedPoint> m_fixed_points;
 };
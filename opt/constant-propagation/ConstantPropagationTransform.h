@@ -46,6 +46,11 @@ class Transform final {
               const WholeProgramState&,
               IRCode*);
 
+  // Whether the last call to apply() changed the code.
+  bool made_changes() const {
+    return !m_replacements.empty() || !m_deletes.empty();
+  }
+
  private:
   /*
    * The methods in this class queue up their transformations. After they are
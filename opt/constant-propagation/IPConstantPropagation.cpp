@@ -85,7 +85,11 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(const Scope& scope) {
   auto fp_iter = std::make_unique<FixpointIterator>(cg, analyze_procedure);
   // Run the bootstrap. All field value and method return values are
   // represented by Top.
-  fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+  if (m_config.parallel_fixpoint) {
+    fp_iter->run_in_parallel();
+  } else {
+    fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+  }
   auto non_true_virtuals = devirtualize(scope);
   for (size_t i = 0; i < m_config.max_heap_analysis_iterations; ++i) {
     // Build an approximation of all the field values and method return values.
@@ -98,7 +102,12 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(const Scope& scope) {
     // Use the refined WholeProgramState to propagate more constants via
     // the stack and registers.
     fp_iter->set_whole_program_state(std::move(wps));
-    fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+    if (m_config.parallel_fixpoint) {
+      auto analyzed = fp_iter->run_in_parallel();
+      TRACE(ICONSTP, 2, "Iteration %zu analyzed %zu methods", i, analyzed);
+    } else {
+      fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+    }
   }
   compute_analysis_stats(fp_iter->get_whole_program_state());
 
@@ -183,7 +192,12 @@ void PassImpl::run_pass(DexStoresVector& stores,
   }
 
   auto scope = build_class_scope(stores);
+  auto summarized_arrays_before =
+      ConstantPrimitiveArrayDomain::num_summarized();
   run(scope);
+  mgr.incr_metric("summarized_arrays",
+                  ConstantPrimitiveArrayDomain::num_summarized() -
+                      summarized_arrays_before);
   mgr.incr_metric("branches_removed", m_transform_stats.branches_removed);
   mgr.incr_metric("materialized_consts", m_transform_stats.materialized_consts);
   mgr.incr_metric("constant_fields", m_stats.constant_fields);
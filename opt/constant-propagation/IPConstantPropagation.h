@@ -25,6 +25,10 @@ class PassImpl : public Pass {
     // Setting this to zero means that all field values and return values will
     // be treated as Top.
     uint64_t max_heap_analysis_iterations{0};
+    // Analyze independent parts of the call graph concurrently, and only
+    // analyze again the methods whose inputs changed from one refinement of
+    // the WholeProgramState to the next.
+    bool parallel_fixpoint{false};
     std::unordered_set<const DexType*> field_black_list;
 
     Transform::Config transform;
@@ -45,6 +49,7 @@ class PassImpl : public Pass {
     bind("max_heap_analysis_iterations",
          UINT64_C(0),
          m_config.max_heap_analysis_iterations);
+    bind("parallel_fixpoint", false, m_config.parallel_fixpoint);
     bind("field_black_list",
          {},
          m_config.field_black_list,
@@ -15,6 +15,11 @@ class CopyPropagationPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
+
   void bind_config() override {
     // This option can only be safely enabled in verify-none. `run_pass` will
     // override this value to false if we aren't in verify-none. Here's why:
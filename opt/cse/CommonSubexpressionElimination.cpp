@@ -59,6 +59,8 @@
 
 #include "CommonSubexpressionElimination.h"
 
+#include <atomic>
+
 #include "BaseIRAnalyzer.h"
 #include "ConstantAbstractDomain.h"
 #include "ControlFlow.h"
@@ -72,6 +74,7 @@
 #include "Resolver.h"
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 using namespace sparta;
 using namespace cse_impl;
@@ -88,9 +91,13 @@ constexpr const char* METRIC_INLINED_BARRIERS_INTO_METHODS =
     "num_inlined_barriers_into_methods";
 constexpr const char* METRIC_INLINED_BARRIERS_ITERATIONS =
     "num_inlined_barriers_iterations";
+constexpr const char* METRIC_REUSED_METHOD_BARRIERS =
+    "num_reused_method_barriers";
 constexpr const char* METRIC_MAX_VALUE_IDS = "max_value_ids";
 constexpr const char* METRIC_METHODS_USING_OTHER_TRACKED_LOCATION_BIT =
     "methods_using_other_tracked_location_bit";
+constexpr const char* METRIC_METHODS_USING_DOMINATOR_SCOPED_WALK =
+    "methods_using_dominator_scoped_walk";
 constexpr const char* METRIC_INSTR_PREFIX = "instr_";
 
 using value_id_t = uint64_t;
@@ -205,19 +212,34 @@ class CseEnvironment final
   }
 };
 
-static Barrier make_barrier(const IRInstruction* insn) {
-  Barrier b;
-  b.opcode = insn->opcode();
+static BarrierSite make_barrier_site(const IRInstruction* insn) {
+  BarrierSite site;
+  site.opcode = insn->opcode();
   if (insn->has_field()) {
-    b.field = resolve_field(insn->get_field(), is_sfield_op(insn->opcode())
-                                                   ? FieldSearch::Static
-                                                   : FieldSearch::Instance);
+    site.field = insn->get_field();
   } else if (insn->has_method()) {
-    b.method = resolve_method(insn->get_method(), opcode_to_search(insn));
+    site.method = insn->get_method();
+  }
+  return site;
+}
+
+static Barrier make_barrier(const BarrierSite& site) {
+  Barrier b;
+  b.opcode = site.opcode;
+  if (is_ifield_op(site.opcode) || is_sfield_op(site.opcode)) {
+    b.field = resolve_field(site.field, is_sfield_op(site.opcode)
+                                            ? FieldSearch::Static
+                                            : FieldSearch::Instance);
+  } else if (is_invoke(site.opcode)) {
+    b.method = resolve_method(site.method, opcode_to_search(site.opcode));
   }
   return b;
 }
 
+static Barrier make_barrier(const IRInstruction* insn) {
+  return make_barrier(make_barrier_site(insn));
+}
+
 Location get_field_location(IROpcode opcode, const DexField* field) {
   always_assert(is_ifield_op(opcode) || is_sfield_op(opcode));
   if (field != nullptr && !is_volatile(field)) {
@@ -297,39 +319,47 @@ Location get_read_location(const IRInstruction* insn) {
   }
 }
 
-bool is_barrier_relevant(
-    const Barrier& barrier,
-    const std::unordered_set<Location, LocationHasher>& read_locations) {
+bool is_barrier_relevant(const Barrier& barrier,
+                         const ReadLocations& read_locations) {
   auto location = get_written_location(barrier);
   return location == Location(GENERAL_MEMORY_BARRIER) ||
-         read_locations.count(location);
+         read_locations.locations.count(location);
 }
 
-template <class Set>
-bool are_disjoint(const Set* s, const Set* t) {
-  if (s->size() > t->size()) {
-    std::swap(s, t);
+// Whether any edge of the CFG goes back to a block that doesn't come later in
+// reverse postorder, i.e. whether the CFG has a loop.
+bool has_loops(const cfg::ControlFlowGraph& cfg) {
+  std::unordered_map<const cfg::Block*, size_t> rpo_index;
+  for (auto* block : cfg.blocks_reverse_post()) {
+    rpo_index.emplace(block, rpo_index.size());
   }
-  for (const auto& elem : *s) {
-    if (t->count(elem)) {
-      return false;
+  for (auto& p : rpo_index) {
+    for (auto* succ : p.first->succs()) {
+      auto it = rpo_index.find(succ->target());
+      if (it != rpo_index.end() && it->second <= p.second) {
+        return true;
+      }
     }
   }
-  return true;
+  return false;
 }
 
 class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
  public:
-  Analyzer(SharedState* shared_state, cfg::ControlFlowGraph& cfg)
+  Analyzer(SharedState* shared_state,
+           cfg::ControlFlowGraph& cfg,
+           bool dominator_scoped)
       : BaseIRAnalyzer(cfg), m_shared_state(shared_state) {
     std::unordered_map<Location, size_t, LocationHasher> read_location_counts;
     for (auto& mie : cfg::InstructionIterable(cfg)) {
       auto location = get_read_location(mie.insn);
       if (location != Location(GENERAL_MEMORY_BARRIER)) {
         read_location_counts[location]++;
-        m_read_locations.insert(location);
+        m_read_locations.locations.insert(location);
       }
     }
+    m_read_locations.written_ids =
+        shared_state->get_written_location_ids(m_read_locations.locations);
 
     std::unordered_map<Location, size_t, LocationHasher>
         written_location_counts;
@@ -411,7 +441,20 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
       }
     }
 
-    MonotonicFixpointIterator::run(CseEnvironment::top());
+    if (dominator_scoped) {
+      run_dominator_scoped(cfg);
+    } else {
+      MonotonicFixpointIterator::run(CseEnvironment::top());
+    }
+  }
+
+  CseEnvironment get_block_entry_state(cfg::Block* block) const {
+    if (!m_dominator_scoped) {
+      return get_entry_state_at(block);
+    }
+    auto it = m_scoped_entry_states.find(block);
+    return it == m_scoped_entry_states.end() ? CseEnvironment::bottom()
+                                             : it->second;
   }
 
   void analyze_instruction(IRInstruction* insn,
@@ -538,11 +581,58 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
 
   size_t get_value_ids_size() { return m_value_ids.size(); }
 
+  bool dominator_scoped() const { return m_dominator_scoped; }
+
   bool using_other_tracked_location_bit() {
     return m_using_other_tracked_location_bit;
   }
 
  private:
+  // Without loops, a single walk over the blocks in a topological order
+  // reaches the fixpoint. This walks the dominator tree in preorder, visiting
+  // the children of a block in reverse postorder, which is one such order.
+  // Most blocks have a single predecessor, which is then their immediate
+  // dominator, and they simply continue from the state that it was left in;
+  // as the environments are persistent maps, that's a scope that costs
+  // nothing to enter or leave. Only join points meet the states of their
+  // predecessors, which have all been visited by then.
+  void run_dominator_scoped(const cfg::ControlFlowGraph& cfg) {
+    m_dominator_scoped = true;
+    auto idoms = cfg.immediate_dominators();
+    std::unordered_map<cfg::Block*, std::vector<cfg::Block*>> children;
+    for (auto* block : cfg.blocks_reverse_post()) {
+      auto* idom = idoms[block->id()].dom;
+      if (idom != nullptr && idom != block) {
+        children[idom].push_back(block);
+      }
+    }
+
+    std::unordered_map<cfg::Block*, CseEnvironment> exit_states;
+    std::vector<cfg::Block*> stack{cfg.entry_block()};
+    while (!stack.empty()) {
+      auto* block = stack.back();
+      stack.pop_back();
+      auto entry_state = CseEnvironment::bottom();
+      if (block == cfg.entry_block()) {
+        entry_state = CseEnvironment::top();
+      }
+      for (auto* pred : block->preds()) {
+        auto it = exit_states.find(pred->src());
+        if (it != exit_states.end()) {
+          entry_state.join_with(analyze_edge(pred, it->second));
+        }
+      }
+      m_scoped_entry_states.emplace(block, entry_state);
+      analyze_node(block, &entry_state);
+      exit_states.emplace(block, std::move(entry_state));
+
+      auto it = children.find(block);
+      if (it != children.end()) {
+        stack.insert(stack.end(), it->second.rbegin(), it->second.rend());
+      }
+    }
+  }
+
   boost::optional<Location> get_clobbered_location(
       const IRInstruction* insn, CseEnvironment* current_state) const {
     DexType* exact_virtual_scope = nullptr;
@@ -761,7 +851,9 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
   }
 
   bool m_using_other_tracked_location_bit{false};
-  std::unordered_set<Location, LocationHasher> m_read_locations;
+  bool m_dominator_scoped{false};
+  std::unordered_map<cfg::Block*, CseEnvironment> m_scoped_entry_states;
+  ReadLocations m_read_locations;
   std::unordered_map<Location, value_id_t, LocationHasher> m_tracked_locations;
   SharedState* m_shared_state;
   mutable std::unordered_map<IRValue, value_id_t, IRValueHasher> m_value_ids;
@@ -775,7 +867,52 @@ namespace cse_impl {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-SharedState::SharedState() {
+LocationBitSet::LocationBitSet(std::vector<size_t> ids) {
+  std::sort(ids.begin(), ids.end());
+  for (auto id : ids) {
+    auto index = id / 64;
+    auto bit = uint64_t(1) << (id % 64);
+    if (m_words.empty() || m_words.back().first != index) {
+      m_words.emplace_back(index, bit);
+    } else {
+      m_words.back().second |= bit;
+    }
+  }
+}
+
+bool LocationBitSet::contains(size_t id) const {
+  auto index = id / 64;
+  auto it = std::lower_bound(
+      m_words.begin(), m_words.end(), index,
+      [](const std::pair<size_t, uint64_t>& word, size_t i) {
+        return word.first < i;
+      });
+  return it != m_words.end() && it->first == index &&
+         (it->second & (uint64_t(1) << (id % 64)));
+}
+
+bool LocationBitSet::intersects(const LocationBitSet& other) const {
+  auto it = m_words.begin();
+  auto other_it = other.m_words.begin();
+  while (it != m_words.end() && other_it != other.m_words.end()) {
+    if (it->first < other_it->first) {
+      ++it;
+    } else if (other_it->first < it->first) {
+      ++other_it;
+    } else if (it->second & other_it->second) {
+      return true;
+    } else {
+      ++it;
+      ++other_it;
+    }
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SharedState::SharedState(MethodBarriersCache* barriers_cache)
+    : m_barriers_cache(barriers_cache) {
   // The following methods are...
   // - static, or
   // - direct (constructors), or
@@ -979,24 +1116,53 @@ MethodBarriersStats SharedState::init_method_barriers(const Scope& scope,
 
   ConcurrentMap<const DexMethod*, std::vector<Barrier>> method_barriers;
   ConcurrentMap<const DexMethod*, const DexMethod*> waiting_for;
+  std::atomic<size_t> reused_method_barriers{0};
   // Let's initialize method_barriers, and waiting_for.
-  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    // Only look at the code through a const method until the cached barrier
+    // sites were checked, so that its epoch doesn't change.
+    auto const_method = static_cast<const DexMethod*>(method);
+    if (const_method->get_code() == nullptr) {
+      return;
+    }
     if (method->rstate.no_optimizations()) {
       waiting_for.emplace(method, nullptr);
       return;
     }
+    // Finding the barrier sites resolves all the invocations and field
+    // reads; spare that if the code didn't change since an earlier run.
+    std::shared_ptr<const std::vector<BarrierSite>> sites;
+    if (m_barriers_cache) {
+      auto cached = m_barriers_cache->get(method, CachedMethodBarriers());
+      if (cached.sites &&
+          cached.code_epoch == const_method->get_code_epoch()) {
+        sites = cached.sites;
+        reused_method_barriers++;
+      }
+    }
+    auto& code = *method->get_code();
     code.build_cfg(/* editable */ true);
+    if (!sites) {
+      auto computed = std::make_shared<std::vector<BarrierSite>>();
+      for (auto& mie : cfg::InstructionIterable(code.cfg())) {
+        auto* insn = mie.insn;
+        if (may_be_barrier(insn, nullptr /* exact_virtual_scope */)) {
+          computed->push_back(make_barrier_site(insn));
+        }
+      }
+      sites = computed;
+    }
+    if (m_barriers_cache) {
+      m_method_barrier_sites.emplace(method, sites);
+    }
     std::unordered_set<Barrier, BarrierHasher> set;
     boost::optional<const DexMethod*> wait_for_method;
-    for (auto& mie : cfg::InstructionIterable(code.cfg())) {
-      auto* insn = mie.insn;
-      if (may_be_barrier(insn, nullptr /* exact_virtual_scope */)) {
-        auto barrier = make_barrier(insn);
-        get_written_location(barrier);
-        set.insert(barrier);
-        if (is_invoke(barrier.opcode)) {
-          wait_for_method = barrier.method;
-        }
+    for (auto& site : *sites) {
+      auto barrier = make_barrier(site);
+      get_written_location(barrier);
+      set.insert(barrier);
+      if (is_invoke(barrier.opcode)) {
+        wait_for_method = barrier.method;
       }
     }
     std::vector<Barrier> barriers(set.begin(), set.end());
@@ -1010,19 +1176,21 @@ MethodBarriersStats SharedState::init_method_barriers(const Scope& scope,
   // barriers, looking into invocations. We do it incrementally,
   // each time only from methods that do not call any other methods.
   MethodBarriersStats stats;
+  stats.reused_method_barriers = reused_method_barriers;
   for (size_t iterations = 0; iterations < max_iterations; iterations++) {
     stats.inlined_barriers_iterations++;
 
     ConcurrentMap<const DexMethod*, std::vector<Barrier>>
         updated_method_barriers;
     ConcurrentMap<const DexMethod*, const DexMethod*> updated_waiting_for;
-    walk::parallel::code(scope, [&](DexMethod* method, IRCode&) {
-      auto waiting_for_it = waiting_for.find(method);
-      if (waiting_for_it == waiting_for.end()) {
-        // no invocation to inline
-        return;
-      }
-
+    // Only the methods that still have invocations to inline need to be
+    // looked at again.
+    std::vector<const DexMethod*> waiting_methods;
+    waiting_methods.reserve(waiting_for.size());
+    for (auto& p : waiting_for) {
+      waiting_methods.push_back(p.first);
+    }
+    auto wq = workqueue_foreach<const DexMethod*>([&](const DexMethod* method) {
       auto can_inline_barriers = [&](const DexMethod* other_method) {
         if (other_method == nullptr) {
           return false;
@@ -1038,7 +1206,7 @@ MethodBarriersStats SharedState::init_method_barriers(const Scope& scope,
 
       // Quick check: Are we are waiting for a method that cannot be inlined
       // (yet)?
-      auto waiting_for_method = waiting_for_it->second;
+      auto waiting_for_method = waiting_for.at_unsafe(method);
       if (!can_inline_barriers(waiting_for_method)) {
         return;
       }
@@ -1101,6 +1269,10 @@ MethodBarriersStats SharedState::init_method_barriers(const Scope& scope,
       std::vector<Barrier> vector(barriers.begin(), barriers.end());
       updated_method_barriers.emplace(method, vector);
     });
+    for (auto method : waiting_methods) {
+      wq.add_item(method);
+    }
+    wq.run_all();
 
     if (updated_method_barriers.size() == 0) {
       break;
@@ -1121,20 +1293,57 @@ MethodBarriersStats SharedState::init_method_barriers(const Scope& scope,
   }
 
   for (auto& p : method_barriers) {
-    std::unordered_set<Location, LocationHasher>& written_locations =
-        m_method_written_locations[p.first];
+    std::vector<size_t> ids;
+    ids.reserve(p.second.size());
     for (auto& barrier : p.second) {
-      written_locations.insert(get_written_location(barrier));
+      auto location = get_written_location(barrier);
+      if (location.special_location < SpecialLocations::END) {
+        ids.push_back(location.special_location);
+        continue;
+      }
+      auto id = SpecialLocations::END + m_location_ids.size();
+      ids.push_back(m_location_ids.emplace(location, id).first->second);
     }
+    m_method_written_locations.emplace(p.first, LocationBitSet(std::move(ids)));
   }
 
   return stats;
 }
 
+void SharedState::cache_method_barriers(const DexMethod* method) {
+  if (!m_barriers_cache) {
+    return;
+  }
+  auto it = m_method_barrier_sites.find(method);
+  if (it == m_method_barrier_sites.end()) {
+    return;
+  }
+  CachedMethodBarriers cached;
+  cached.code_epoch = method->get_code_epoch();
+  cached.sites = it->second;
+  m_barriers_cache->insert_or_assign(std::make_pair(method, cached));
+}
+
+LocationBitSet SharedState::get_written_location_ids(
+    const std::unordered_set<Location, LocationHasher>& locations) const {
+  std::vector<size_t> ids;
+  for (auto& location : locations) {
+    if (location.special_location < SpecialLocations::END) {
+      ids.push_back(location.special_location);
+      continue;
+    }
+    auto it = m_location_ids.find(location);
+    if (it != m_location_ids.end()) {
+      ids.push_back(it->second);
+    }
+  }
+  return LocationBitSet(std::move(ids));
+}
+
 boost::optional<Location> SharedState::get_relevant_written_location(
     const IRInstruction* insn,
     DexType* exact_virtual_scope,
-    const std::unordered_set<Location, LocationHasher>& read_locations) {
+    const ReadLocations& read_locations) {
   if (may_be_barrier(insn, exact_virtual_scope)) {
     if (is_invoke(insn->opcode())) {
       if (is_invoke_a_barrier(insn, read_locations)) {
@@ -1218,9 +1427,8 @@ bool SharedState::is_invoke_safe(const IRInstruction* insn,
   return false;
 }
 
-bool SharedState::is_invoke_a_barrier(
-    const IRInstruction* insn,
-    const std::unordered_set<Location, LocationHasher>& read_locations) {
+bool SharedState::is_invoke_a_barrier(const IRInstruction* insn,
+                                      const ReadLocations& read_locations) {
   always_assert(is_invoke(insn->opcode()));
 
   auto opcode = insn->opcode();
@@ -1243,10 +1451,10 @@ bool SharedState::is_invoke_a_barrier(
       return true;
     }
     auto& written_locations = it->second;
-    if (written_locations.count(Location(GENERAL_MEMORY_BARRIER))) {
+    if (written_locations.contains(GENERAL_MEMORY_BARRIER)) {
       return true;
     }
-    return !are_disjoint(&written_locations, &read_locations);
+    return written_locations.intersects(read_locations.written_ids);
   };
 
   auto method_ref = insn->get_method();
@@ -1305,19 +1513,29 @@ void SharedState::cleanup() {
 }
 
 CommonSubexpressionElimination::CommonSubexpressionElimination(
-    SharedState* shared_state, cfg::ControlFlowGraph& cfg)
+    SharedState* shared_state, cfg::ControlFlowGraph& cfg, Strategy strategy)
     : m_shared_state(shared_state), m_cfg(cfg) {
-  Analyzer analyzer(shared_state, cfg);
+  bool dominator_scoped = strategy == Strategy::DominatorScoped;
+  if (strategy == Strategy::Auto) {
+    dominator_scoped = !has_loops(cfg);
+  } else if (dominator_scoped) {
+    always_assert_log(!has_loops(cfg),
+                      "The dominator scoped walk needs a CFG without loops");
+  }
+  Analyzer analyzer(shared_state, cfg, dominator_scoped);
   m_stats.max_value_ids = analyzer.get_value_ids_size();
   if (analyzer.using_other_tracked_location_bit()) {
     m_stats.methods_using_other_tracked_location_bit = 1;
   }
+  if (analyzer.dominator_scoped()) {
+    m_stats.methods_using_dominator_scoped_walk = 1;
+  }
 
   // identify all instruction pairs where the result of the first instruction
   // can be forwarded to the second
 
   for (cfg::Block* block : cfg.blocks()) {
-    auto env = analyzer.get_entry_state_at(block);
+    auto env = analyzer.get_block_entry_state(block);
     for (auto& mie : InstructionIterable(block)) {
       IRInstruction* insn = mie.insn;
       analyzer.analyze_instruction(insn, &env);
@@ -1479,10 +1697,12 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
                                                   PassManager& mgr) {
   const auto scope = build_class_scope(stores);
 
-  auto shared_state = SharedState();
+  auto shared_state = SharedState(&m_barriers_cache);
   auto method_barriers_stats =
       shared_state.init_method_barriers(scope, m_max_iterations);
-  const auto stats = walk::parallel::reduce_methods<Stats>(
+  // A few huge methods tend to dominate CSE's running time, so schedule the
+  // largest ones first.
+  const auto stats = walk::parallel::reduce_methods_by_cost<Stats>(
       scope,
       [&](DexMethod* method) {
         const auto code = method->get_code();
@@ -1515,6 +1735,7 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
             code->clear_cfg();
           }
         }
+        shared_state.cache_method_barriers(method);
         return cse.get_stats();
       },
       [](Stats a, Stats b) {
@@ -1525,6 +1746,8 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
         a.max_value_ids = std::max(a.max_value_ids, b.max_value_ids);
         a.methods_using_other_tracked_location_bit +=
             b.methods_using_other_tracked_location_bit;
+        a.methods_using_dominator_scoped_walk +=
+            b.methods_using_dominator_scoped_walk;
         for (auto& p : b.eliminated_opcodes) {
           a.eliminated_opcodes[p.first] += p.second;
         }
@@ -1541,9 +1764,13 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
                   method_barriers_stats.inlined_barriers_into_methods);
   mgr.incr_metric(METRIC_INLINED_BARRIERS_ITERATIONS,
                   method_barriers_stats.inlined_barriers_iterations);
+  mgr.incr_metric(METRIC_REUSED_METHOD_BARRIERS,
+                  method_barriers_stats.reused_method_barriers);
   mgr.incr_metric(METRIC_MAX_VALUE_IDS, stats.max_value_ids);
   mgr.incr_metric(METRIC_METHODS_USING_OTHER_TRACKED_LOCATION_BIT,
                   stats.methods_using_other_tracked_location_bit);
+  mgr.incr_metric(METRIC_METHODS_USING_DOMINATOR_SCOPED_WALK,
+                  stats.methods_using_dominator_scoped_walk);
   for (auto& p : stats.eliminated_opcodes) {
     std::string name = METRIC_INSTR_PREFIX;
     name += SHOW(static_cast<IROpcode>(p.first));
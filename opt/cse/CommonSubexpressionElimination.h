@@ -21,6 +21,7 @@ struct Stats {
   size_t instructions_eliminated{0};
   size_t max_value_ids{0};
   size_t methods_using_other_tracked_location_bit{0};
+  size_t methods_using_dominator_scoped_walk{0};
   // keys are IROpcode encoded as uint16_t, to make OSS build happy
   std::unordered_map<uint16_t, size_t> eliminated_opcodes;
 };
@@ -28,6 +29,7 @@ struct Stats {
 struct MethodBarriersStats {
   size_t inlined_barriers_iterations{0};
   size_t inlined_barriers_into_methods{0};
+  size_t reused_method_barriers{0};
 };
 
 // A barrier is defined by a particular opcode, and possibly some extra data
@@ -50,6 +52,29 @@ struct BarrierHasher {
   }
 };
 
+// Where a barrier comes from: its opcode, and the field or method that the
+// instruction references, before resolution.
+struct BarrierSite {
+  IROpcode opcode;
+  union {
+    DexFieldRef* field{nullptr};
+    DexMethodRef* method;
+  };
+};
+
+// The barrier sites of a method's own instructions, which CSE remembers
+// across its runs for as long as the code they came from doesn't change (see
+// DexMethod::get_code_epoch). Only the sites are kept, as what they resolve
+// to may change in between. CSE itself never adds barriers, so the sites
+// found before it transformed the code still cover the code it leaves.
+struct CachedMethodBarriers {
+  uint64_t code_epoch{0};
+  std::shared_ptr<const std::vector<BarrierSite>> sites;
+};
+
+using MethodBarriersCache =
+    ConcurrentMap<const DexMethod*, CachedMethodBarriers>;
+
 enum SpecialLocations : size_t {
   GENERAL_MEMORY_BARRIER,
   ARRAY_COMPONENT_TYPE_INT,
@@ -101,36 +126,79 @@ struct LocationHasher {
   size_t operator()(const Location& l) const { return (size_t)l.field; }
 };
 
+// A set of location ids, as a sparse bitset: only the words that have any
+// bits set are kept, ordered by their index, so that two sets intersect iff
+// the AND of any two words with the same index is non-zero.
+class LocationBitSet {
+ public:
+  LocationBitSet() = default;
+  explicit LocationBitSet(std::vector<size_t> ids);
+  bool contains(size_t id) const;
+  bool intersects(const LocationBitSet& other) const;
+
+ private:
+  std::vector<std::pair<size_t, uint64_t>> m_words;
+};
+
+// The locations that a method reads; the ones that are written by any other
+// method are also given as a bitset of their ids.
+struct ReadLocations {
+  std::unordered_set<Location, LocationHasher> locations;
+  LocationBitSet written_ids;
+};
+
 class SharedState {
  public:
-  SharedState();
+  explicit SharedState(MethodBarriersCache* barriers_cache = nullptr);
   MethodBarriersStats init_method_barriers(const Scope&, size_t);
   boost::optional<Location> get_relevant_written_location(
       const IRInstruction* insn,
       DexType* exact_virtual_scope,
-      const std::unordered_set<Location, LocationHasher>& read_locations);
+      const ReadLocations& read_locations);
+  // Remembers the barrier sites of the method in the cache; to be called once
+  // CSE is done with its code.
+  void cache_method_barriers(const DexMethod* method);
+  LocationBitSet get_written_location_ids(
+      const std::unordered_set<Location, LocationHasher>& locations) const;
   void log_barrier(const Barrier& barrier);
   void cleanup();
 
  private:
   bool may_be_barrier(const IRInstruction* insn, DexType* exact_virtual_scope);
   bool is_invoke_safe(const IRInstruction* insn, DexType* exact_virtual_scope);
-  bool is_invoke_a_barrier(
-      const IRInstruction* insn,
-      const std::unordered_set<Location, LocationHasher>& read_locations);
+  bool is_invoke_a_barrier(const IRInstruction* insn,
+                           const ReadLocations& read_locations);
   std::unordered_set<const DexMethod*> m_safe_methods;
   std::unordered_set<DexType*> m_safe_types;
   std::unique_ptr<ConcurrentMap<Barrier, size_t, BarrierHasher>> m_barriers;
-  std::unordered_map<const DexMethod*,
-                     std::unordered_set<Location, LocationHasher>>
+  MethodBarriersCache* m_barriers_cache;
+  ConcurrentMap<const DexMethod*,
+                std::shared_ptr<const std::vector<BarrierSite>>>
+      m_method_barrier_sites;
+  // Special locations are their own ids; the written fields are numbered
+  // after them.
+  std::unordered_map<Location, size_t, LocationHasher> m_location_ids;
+  std::unordered_map<const DexMethod*, LocationBitSet>
       m_method_written_locations;
   std::unique_ptr<const method_override_graph::Graph> m_method_override_graph;
 };
 
+// How the values that are available at each block are found.
+enum class Strategy {
+  // DominatorScoped for the CFGs without loops, Fixpoint otherwise.
+  Auto,
+  // The fixpoint of the dataflow analysis.
+  Fixpoint,
+  // A single walk of the dominator tree; only for CFGs without loops, where
+  // it finds the same values as the fixpoint.
+  DominatorScoped,
+};
+
 class CommonSubexpressionElimination {
  public:
   CommonSubexpressionElimination(SharedState* shared_state,
-                                 cfg::ControlFlowGraph&);
+                                 cfg::ControlFlowGraph&,
+                                 Strategy strategy = Strategy::Auto);
 
   const Stats& get_stats() const { return m_stats; }
 
@@ -166,4 +234,6 @@ class CommonSubexpressionEliminationPass : public Pass {
  private:
   int64_t m_max_iterations;
   bool m_debug;
+  // Shared by all the runs of the pass.
+  cse_impl::MethodBarriersCache m_barriers_cache;
 };
@@ -16,6 +16,7 @@
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 #include "locator.h"
 
 namespace {
@@ -64,7 +65,7 @@ void DedupStrings::run(DexStoresVector& stores) {
   }
 
   // For each string, figure out how many times it's loaded per dex
-  ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> occurrences =
+  ConcurrentMap<DexString*, DexLoads> occurrences =
       get_occurrences(scope, methods_to_dex, perf_sensitive_methods,
                       non_load_strings);
 
@@ -231,63 +232,235 @@ void DedupStrings::gather_non_load_strings(
   strings->insert(lstring.begin(), lstring.end());
 }
 
-ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>>
+ConcurrentMap<DexString*, DedupStrings::DexLoads>
 DedupStrings::get_occurrences(
     const Scope& scope,
     const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
     const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
     std::unordered_set<const DexString*> non_load_strings[]) {
-  // For each string, figure out how many times it's loaded per dex
-  ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> occurrences;
-  ConcurrentMap<DexString*, std::unordered_set<size_t>> perf_sensitive_strings;
-  walk::parallel::code(
-      scope, [&occurrences, &perf_sensitive_strings, &methods_to_dex,
-              &perf_sensitive_methods](DexMethod* method, IRCode& code) {
-        const auto dexnr = methods_to_dex.at(method);
-        const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
-        for (auto& mie : InstructionIterable(code)) {
-          const auto insn = mie.insn;
-          if (insn->opcode() == OPCODE_CONST_STRING) {
-            const auto str = insn->get_string();
-            if (perf_sensitive) {
-              perf_sensitive_strings.update(
-                  str,
-                  [dexnr](const DexString*,
-                          std::unordered_set<size_t>& s,
-                          bool /* exists */) { s.emplace(dexnr); });
-            } else {
-              occurrences.update(str,
-                                 [dexnr](const DexString*,
-                                         std::unordered_map<size_t, size_t>& m,
-                                         bool /* exists */) { ++m[dexnr]; });
+  // For each string, figure out how many times it's loaded per dex. Each
+  // worker counts into maps of its own, one per shard of the strings, so that
+  // counting takes no locks; then each shard is merged on its own.
+  const size_t num_threads = walk::parallel::default_num_threads();
+  const size_t num_shards = num_threads;
+  auto shard_of = [num_shards](const DexString* str) {
+    return std::hash<const DexString*>()(str) % num_shards;
+  };
+  std::vector<std::vector<StringLoads>> worker_loads(
+      num_threads, std::vector<StringLoads>(num_shards));
+  auto count_loads = [&](DexMethod* method, std::vector<StringLoads>& loads) {
+    auto code = method->get_code();
+    if (code == nullptr) {
+      return;
+    }
+    const auto dexnr = methods_to_dex.at(method);
+    const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
+    for (auto& mie : InstructionIterable(code)) {
+      const auto insn = mie.insn;
+      if (insn->opcode() == OPCODE_CONST_STRING) {
+        const auto str = insn->get_string();
+        auto& shard = loads[shard_of(str)];
+        if (perf_sensitive) {
+          shard.perf_sensitive_strings[str].emplace(dexnr);
+        } else {
+          ++shard.occurrences[str][dexnr];
+        }
+      }
+    }
+  };
+  using CountState = WorkerState<DexClass*, std::nullptr_t, std::nullptr_t>;
+  auto count_wq = WorkQueue<DexClass*, std::nullptr_t, std::nullptr_t>(
+      [&](CountState* state, DexClass* cls) {
+        auto& loads = worker_loads[state->worker_id()];
+        for (auto method : cls->get_dmethods()) {
+          count_loads(method, loads);
+        }
+        for (auto method : cls->get_vmethods()) {
+          count_loads(method, loads);
+        }
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      num_threads);
+  for (auto cls : scope) {
+    count_wq.add_item(cls);
+  }
+  count_wq.run_all();
+
+  ConcurrentMap<DexString*, DexLoads> occurrences;
+  std::vector<std::unordered_map<DexString*, std::unordered_set<size_t>>>
+      perf_sensitive_strings(num_shards);
+  auto merge_wq = workqueue_foreach<size_t>(
+      [&](size_t shard) {
+        std::unordered_map<DexString*, DexLoads> merged;
+        auto& perf_sensitive = perf_sensitive_strings[shard];
+        for (auto& loads : worker_loads) {
+          for (const auto& p : loads[shard].occurrences) {
+            auto& m = merged[p.first];
+            for (const auto& q : p.second) {
+              m[q.first] += q.second;
             }
           }
+          for (const auto& p : loads[shard].perf_sensitive_strings) {
+            perf_sensitive[p.first].insert(p.second.begin(), p.second.end());
+          }
+          loads[shard] = StringLoads();
         }
-      });
+        for (auto& p : merged) {
+          occurrences.emplace(p.first, std::move(p.second));
+        }
+      },
+      num_threads);
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    merge_wq.add_item(shard);
+  }
+  merge_wq.run_all();
 
   // Also, add all the strings that occurred in perf-sensitive methods
   // to the non_load_strings datastructure, as we won't attempt to dedup them.
-  for (const auto& it : perf_sensitive_strings) {
-    const auto str = it.first;
-    TRACE(DS, 3, "[dedup strings] perf sensitive string: {%s}", SHOW(str));
-
-    const auto& dexes = it.second;
-    for (const auto dexnr : dexes) {
-      auto& strings = non_load_strings[dexnr];
-      strings.emplace(str);
+  m_stats.perf_sensitive_strings = 0;
+  for (const auto& shard : perf_sensitive_strings) {
+    for (const auto& it : shard) {
+      const auto str = it.first;
+      TRACE(DS, 3, "[dedup strings] perf sensitive string: {%s}", SHOW(str));
+
+      const auto& dexes = it.second;
+      for (const auto dexnr : dexes) {
+        auto& strings = non_load_strings[dexnr];
+        strings.emplace(str);
+      }
     }
+    m_stats.perf_sensitive_strings += shard.size();
   }
 
-  m_stats.perf_sensitive_strings = perf_sensitive_strings.size();
   m_stats.non_perf_sensitive_strings = occurrences.size();
   return occurrences;
 }
 
+DedupStrings::Evaluation DedupStrings::evaluate_string(
+    DexString* s,
+    const DexLoads& m,
+    const std::vector<DexClass*>& host_classes,
+    const std::unordered_set<size_t>* hosting_dexnrs,
+    const std::unordered_set<const DexString*> non_load_strings[]) const {
+  const auto entry_size = s->get_entry_size();
+  const auto get_size_reduction = [entry_size, non_load_strings](
+                                      DexString* str, size_t dexnr,
+                                      size_t loads) -> size_t {
+    const auto has_non_load_string = non_load_strings[dexnr].count(str) != 0;
+    if (has_non_load_string) {
+      // If there's a non-load string, there's nothing to gain
+      return 0;
+    }
+
+    size_t code_size_increase = loads * (6 /* invoke */ + 2 /* move-result */);
+    if (4 + entry_size < code_size_increase) {
+      // If the string itself is taking up less space than the code size
+      // increase we would incur when referencing the string via a
+      // referenced load method, then there's nothing to gain
+      return 0;
+    }
+
+    return 4 + entry_size - code_size_increase;
+  };
+
+  // First, we identify which dex could and should host the string in
+  // its string factory method
+  struct HostInfo {
+    size_t dexnr;
+    size_t size_reduction;
+  };
+  boost::optional<HostInfo> host_info;
+  for (size_t dexnr = 0; dexnr < host_classes.size(); ++dexnr) {
+    // We need a host class to host
+    if (!host_classes[dexnr]) {
+      TRACE(DS, 4,
+            "[dedup strings] non perf sensitive string: {%s} dex #%u has no "
+            "host",
+            SHOW(s), dexnr);
+      continue;
+    }
+
+    // There's a configurable limit of how many factory methods / hosts we
+    // can have in total
+    if (hosting_dexnrs != nullptr && hosting_dexnrs->count(dexnr) == 0 &&
+        hosting_dexnrs->size() == m_max_factory_methods) {
+      // We could try a bit harder to determine the optimal set of hosts,
+      // but the best fix in this case is probably to raise the limit
+      TRACE(DS, 4,
+            "[dedup strings] non perf sensitive string: {%s} dex #%u cannot "
+            "be used as dedup strings max factory methods limit reached",
+            SHOW(s), dexnr);
+      continue;
+    }
+
+    // So this dex could host the current string s
+    const auto mit = m.find(dexnr);
+    const auto loads = mit == m.end() ? 0 : mit->second;
+    // Figure out what the size reduction would be if this dex would *not*
+    // be hosting string s, also considering whether we'd keep around a copy
+    // of the string in this dex anyway
+    const auto size_reduction = get_size_reduction(s, dexnr, loads);
+    if (!host_info || size_reduction < host_info->size_reduction) {
+      TRACE(DS, 4,
+            "[dedup strings] non perf sensitive string: {%s} dex #%u can "
+            "host with size reduction %u",
+            SHOW(s), dexnr, size_reduction);
+      host_info = (HostInfo){dexnr, size_reduction};
+    } else {
+      TRACE(DS, 4,
+            "[dedup strings] non perf sensitive string: {%s} dex #%u won't "
+            "host due insufficient size reduction %u",
+            SHOW(s), dexnr, size_reduction);
+    }
+  }
+
+  Evaluation evaluation;
+  // We have a zero max_cost if and only if we didn't find any suitable
+  // hosting_dexnr
+  if (!host_info) {
+    return evaluation;
+  }
+  size_t hosting_dexnr = host_info->dexnr;
+  evaluation.hosting_dexnr = hosting_dexnr;
+
+  // Second, we figure out which other dexes should get their const-string
+  // instructions rewritten
+  for (const auto& q : m) {
+    const auto dexnr = q.first;
+    const auto loads = q.second;
+    if (dexnr == hosting_dexnr) {
+      continue;
+    }
+
+    const auto size_reduction = get_size_reduction(s, dexnr, loads);
+
+    if (non_load_strings[dexnr].count(s) != 0) {
+      always_assert(size_reduction == 0);
+      TRACE(DS, 4,
+            "[dedup strings] non perf sensitive string: {%s}*%u is a "
+            "non-load string in non-hosting dex #%u",
+            SHOW(s), loads, dexnr);
+      ++evaluation.excluded_duplicate_non_load_strings;
+      // No point in rewriting const-string instructions for this string
+      // in this dex as string will be referenced from this dex anyway
+      continue;
+    }
+
+    if (size_reduction > 0) {
+      evaluation.duplicate_string_loads += loads;
+      evaluation.total_size_reduction += size_reduction;
+      evaluation.dexes_to_dedup.emplace(dexnr);
+    }
+  }
+  return evaluation;
+}
+
 std::unordered_map<DexString*, DedupStrings::DedupStringInfo>
 DedupStrings::get_strings_to_dedup(
     DexClassesVector& dexen,
-    const ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>>&
-        occurrences,
+    const ConcurrentMap<DexString*, DexLoads>& occurrences,
     std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
     std::unordered_set<const DexMethod*>& perf_sensitive_methods,
     const std::unordered_set<const DexString*> non_load_strings[]) {
@@ -300,131 +473,61 @@ DedupStrings::get_strings_to_dedup(
 
   const std::vector<DexClass*> host_classes = get_host_classes(dexen);
 
-  // Do a cost/benefit analysis to figure out which strings to access via
-  // factory methods, and where to put to the factory method
-  std::vector<DexString*> strings_in_dexes[dexen.size()];
-  std::unordered_set<size_t> hosting_dexnrs;
+  // Strings loaded in only one dex are never duplicated.
+  std::vector<std::pair<DexString*, const DexLoads*>> candidates;
   for (const auto& p : occurrences) {
-    // We are going to look at the situation of a particular string here
-    const auto& m = p.second;
-    always_assert(m.size() >= 1);
-    if (m.size() == 1) continue;
-    const auto s = p.first;
-    const auto entry_size = s->get_entry_size();
-    const auto get_size_reduction = [entry_size, non_load_strings](
-                                        DexString* str, size_t dexnr,
-                                        size_t loads) -> size_t {
-      const auto has_non_load_string = non_load_strings[dexnr].count(str) != 0;
-      if (has_non_load_string) {
-        // If there's a non-load string, there's nothing to gain
-        return 0;
-      }
-
-      size_t code_size_increase =
-          loads * (6 /* invoke */ + 2 /* move-result */);
-      if (4 + entry_size < code_size_increase) {
-        // If the string itself is taking up less space than the code size
-        // increase we would incur when referencing the string via a
-        // referenced load method, then there's nothing to gain
-        return 0;
-      }
-
-      return 4 + entry_size - code_size_increase;
-    };
-
-    // First, we identify which dex could and should host the string in
-    // its string factory method
-    struct HostInfo {
-      size_t dexnr;
-      size_t size_reduction;
-    };
-    boost::optional<HostInfo> host_info;
-    for (size_t dexnr = 0; dexnr < dexen.size(); ++dexnr) {
-      // We need a host class to host
-      if (!host_classes[dexnr]) {
-        TRACE(DS, 4,
-              "[dedup strings] non perf sensitive string: {%s} dex #%u has no "
-              "host",
-              SHOW(s), dexnr);
-        continue;
-      }
+    always_assert(p.second.size() >= 1);
+    if (p.second.size() > 1) {
+      candidates.emplace_back(p.first, &p.second);
+    }
+  }
 
-      // There's a configurable limit of how many factory methods / hosts we
-      // can have in total
-      if (hosting_dexnrs.count(dexnr) == 0 &&
-          hosting_dexnrs.size() == m_max_factory_methods) {
-        // We could try a bit harder to determine the optimal set of hosts,
-        // but the best fix in this case is probably to raise the limit
-        TRACE(DS, 4,
-              "[dedup strings] non perf sensitive string: {%s} dex #%u cannot "
-              "be used as dedup strings max factory methods limit reached",
-              SHOW(s), dexnr);
-        continue;
-      }
+  // The cost/benefit analysis of each string is independent of the others',
+  // as long as the limit on the number of factory methods is not involved,
+  // so it is done in parallel first. The best host among all the dexes is
+  // also the best one among the dexes that the limit leaves, if it is one of
+  // them; otherwise the string is evaluated again below.
+  std::vector<Evaluation> evaluations(candidates.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        evaluations[i] =
+            evaluate_string(candidates[i].first, *candidates[i].second,
+                            host_classes, /* hosting_dexnrs */ nullptr,
+                            non_load_strings);
+      },
+      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
 
-      // So this dex could host the current string s
-      const auto mit = m.find(dexnr);
-      const auto loads = mit == m.end() ? 0 : mit->second;
-      // Figure out what the size reduction would be if this dex would *not*
-      // be hosting string s, also considering whether we'd keep around a copy
-      // of the string in this dex anyway
-      const auto size_reduction = get_size_reduction(s, dexnr, loads);
-      if (!host_info || size_reduction < host_info->size_reduction) {
-        TRACE(DS, 4,
-              "[dedup strings] non perf sensitive string: {%s} dex #%u can "
-              "host with size reduction %u",
-              SHOW(s), dexnr, size_reduction);
-        host_info = (HostInfo){dexnr, size_reduction};
-      } else {
-        TRACE(DS, 4,
-              "[dedup strings] non perf sensitive string: {%s} dex #%u won't "
-              "host due insufficient size reduction %u",
-              SHOW(s), dexnr, size_reduction);
-      }
+  // Figure out which strings to access via factory methods, and where to put
+  // to the factory method
+  std::vector<DexString*> strings_in_dexes[dexen.size()];
+  std::unordered_set<size_t> hosting_dexnrs;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    // We are going to look at the situation of a particular string here
+    const auto s = candidates[i].first;
+    auto& evaluation = evaluations[i];
+    if (evaluation.hosting_dexnr &&
+        hosting_dexnrs.count(*evaluation.hosting_dexnr) == 0 &&
+        hosting_dexnrs.size() == m_max_factory_methods) {
+      evaluation = evaluate_string(s, *candidates[i].second, host_classes,
+                                   &hosting_dexnrs, non_load_strings);
     }
-
-    // We have a zero max_cost if and only if we didn't find any suitable
-    // hosting_dexnr
-    if (!host_info) {
+    if (!evaluation.hosting_dexnr) {
       TRACE(DS, 3,
             "[dedup strings] non perf sensitive string: {%s} - no host",
             SHOW(s));
       continue;
     }
-    size_t hosting_dexnr = host_info->dexnr;
-
-    // Second, we figure out which other dexes should get their const-string
-    // instructions rewritten
-    size_t total_size_reduction = 0;
-    size_t duplicate_string_loads = 0;
-    std::unordered_set<size_t> dexes_to_dedup;
-    for (const auto& q : m) {
-      const auto dexnr = q.first;
-      const auto loads = q.second;
-      if (dexnr == hosting_dexnr) {
-        continue;
-      }
-
-      const auto size_reduction = get_size_reduction(s, dexnr, loads);
-
-      if (non_load_strings[dexnr].count(s) != 0) {
-        always_assert(size_reduction == 0);
-        TRACE(DS, 4,
-              "[dedup strings] non perf sensitive string: {%s}*%u is a "
-              "non-load string in non-hosting dex #%u",
-              SHOW(s), loads, dexnr);
-        ++m_stats.excluded_duplicate_non_load_strings;
-        // No point in rewriting const-string instructions for this string
-        // in this dex as string will be referenced from this dex anyway
-        continue;
-      }
-
-      if (size_reduction > 0) {
-        duplicate_string_loads += loads;
-        total_size_reduction += size_reduction;
-        dexes_to_dedup.emplace(dexnr);
-      }
-    }
+    size_t hosting_dexnr = *evaluation.hosting_dexnr;
+    m_stats.excluded_duplicate_non_load_strings +=
+        evaluation.excluded_duplicate_non_load_strings;
+    const auto entry_size = s->get_entry_size();
+    const auto total_size_reduction = evaluation.total_size_reduction;
+    const auto duplicate_string_loads = evaluation.duplicate_string_loads;
+    auto& dexes_to_dedup = evaluation.dexes_to_dedup;
 
     const auto hosting_code_size_increase =
         (4 /* switch-target-offset */ + 4 /* const-string */ + 2 /* return */);
@@ -473,22 +576,35 @@ DedupStrings::get_strings_to_dedup(
         total_size_reduction - hosting_code_size_increase);
   }
 
-  // Order strings to give more often used strings smaller indices;
-  // generate factory methods; remember details in dedup-info data structure
+  // Order strings to give more often used strings smaller indices, for each
+  // hosting dex in parallel
+  auto sort_wq = workqueue_foreach<size_t>(
+      [&](size_t dexnr) {
+        std::vector<DexString*>& strings = strings_in_dexes[dexnr];
+        std::sort(strings.begin(), strings.end(),
+                  [&strings_to_dedup](DexString* a, DexString* b) -> bool {
+                    auto a_loads =
+                        strings_to_dedup.at(a).duplicate_string_loads;
+                    auto b_loads =
+                        strings_to_dedup.at(b).duplicate_string_loads;
+                    if (a_loads != b_loads) {
+                      return a_loads > b_loads;
+                    }
+                    return dexstrings_comparator()(a, b);
+                  });
+      },
+      walk::parallel::default_num_threads());
+  for (auto dexnr : hosting_dexnrs) {
+    sort_wq.add_item(dexnr);
+  }
+  sort_wq.run_all();
+
+  // Generate factory methods; remember details in dedup-info data structure
   for (size_t dexnr = 0; dexnr < dexen.size(); ++dexnr) {
     std::vector<DexString*>& strings = strings_in_dexes[dexnr];
     if (strings.size() == 0) {
       continue;
     }
-    std::sort(strings.begin(), strings.end(),
-              [&strings_to_dedup](DexString* a, DexString* b) -> bool {
-                auto a_loads = strings_to_dedup[a].duplicate_string_loads;
-                auto b_loads = strings_to_dedup[b].duplicate_string_loads;
-                if (a_loads != b_loads) {
-                  return a_loads > b_loads;
-                }
-                return dexstrings_comparator()(a, b);
-              });
     const auto const_string_method =
         make_const_string_loader_method(host_classes[dexnr], strings);
     always_assert(strings.size() < 0xFFFFFFFF);
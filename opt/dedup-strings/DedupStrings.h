@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <boost/optional.hpp>
+
 #include "InterDexPass.h"
 #include "Pass.h"
 #include "PluginRegistry.h"
@@ -40,6 +42,25 @@ class DedupStrings {
   void run(DexStoresVector& stores);
 
  private:
+  // How many times a string is loaded in each dex, by dex number.
+  using DexLoads = std::unordered_map<size_t, size_t>;
+
+  // The loads counted by one worker, in one shard of the strings.
+  struct StringLoads {
+    std::unordered_map<DexString*, DexLoads> occurrences;
+    std::unordered_map<DexString*, std::unordered_set<size_t>>
+        perf_sensitive_strings;
+  };
+
+  // Where a string would be hosted, and what deduplicating it would save.
+  struct Evaluation {
+    boost::optional<size_t> hosting_dexnr;
+    size_t total_size_reduction{0};
+    size_t duplicate_string_loads{0};
+    size_t excluded_duplicate_non_load_strings{0};
+    std::unordered_set<size_t> dexes_to_dedup;
+  };
+
   struct DedupStringInfo {
     size_t duplicate_string_loads;
     std::unordered_set<size_t> dexes_to_dedup;
@@ -57,15 +78,22 @@ class DedupStrings {
       DexClass* host_cls, const std::vector<DexString*>& strings);
   void gather_non_load_strings(DexClasses& classes,
                                std::unordered_set<const DexString*>* strings);
-  ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> get_occurrences(
+  ConcurrentMap<DexString*, DexLoads> get_occurrences(
       const Scope& scope,
       const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
       const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
       std::unordered_set<const DexString*> non_load_strings[]);
+  // Picks the host of the string among the dexes with a host class, and, if
+  // hosting_dexnrs is given, with a factory method or room for one more.
+  Evaluation evaluate_string(
+      DexString* s,
+      const DexLoads& m,
+      const std::vector<DexClass*>& host_classes,
+      const std::unordered_set<size_t>* hosting_dexnrs,
+      const std::unordered_set<const DexString*> non_load_strings[]) const;
   std::unordered_map<DexString*, DedupStringInfo> get_strings_to_dedup(
       DexClassesVector& dexen,
-      const ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>>&
-          occurrences,
+      const ConcurrentMap<DexString*, DexLoads>& occurrences,
       std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
       std::unordered_set<const DexMethod*>& perf_sensitive_methods,
       const std::unordered_set<const DexString*> non_load_strings[]);
@@ -8,6 +8,7 @@
 #include "DedupBlocksPass.h"
 
 #include <atomic>
+#include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 #include <iterator>
 #include <mutex>
@@ -99,6 +100,34 @@ static bool same_successors(const cfg::Block* b1, const cfg::Block* b2) {
   return true;
 }
 
+// Order-insensitive, like `same_successors`: the per-edge hashes are summed.
+hash_t hash_successors(const cfg::Block* b) {
+  hash_t result = 0;
+  for (const auto& succ : b->succs()) {
+    hash_t edge_hash = 0;
+    boost::hash_combine(edge_hash, succ->target()->id());
+    boost::hash_combine(edge_hash, static_cast<int>(succ->type()));
+    result += edge_hash;
+  }
+  return result;
+}
+
+// Hashes the instructions in order, and the successors of the block.
+hash_t fingerprint(cfg::Block* b) {
+  hash_t result = 0;
+  for (auto& mie : InstructionIterable(b)) {
+    boost::hash_combine(result, mie.insn->hash());
+  }
+  boost::hash_combine(result, hash_successors(b));
+  boost::hash_combine(result, b->is_catch());
+  return result;
+}
+
+// The fingerprints of the eligible blocks of a method, computed once so that
+// neither rehashing the map nor comparing the blocks in a bucket walks the
+// instructions again.
+using BlockFingerprints = std::unordered_map<const cfg::Block*, hash_t>;
+
 struct SuccBlocksInSameGroup {
   bool operator()(const cfg::Block* a, const cfg::Block* b) const {
     return same_successors(a, b) && a->same_try(b) &&
@@ -107,18 +136,28 @@ struct SuccBlocksInSameGroup {
 };
 
 struct BlocksInSameGroup {
+  const BlockFingerprints* fingerprints{nullptr};
+
   bool operator()(cfg::Block* a, cfg::Block* b) const {
+    if (fingerprints != nullptr &&
+        fingerprints->at(a) != fingerprints->at(b)) {
+      return false;
+    }
     return SuccBlocksInSameGroup{}(a, b) && same_code(a, b);
   }
 };
 
 struct BlockHasher {
+  const BlockFingerprints* fingerprints{nullptr};
+
   hash_t operator()(cfg::Block* b) const {
-    hash_t result = 0;
-    for (auto& mie : InstructionIterable(b)) {
-      result ^= mie.insn->hash();
+    if (fingerprints != nullptr) {
+      auto it = fingerprints->find(b);
+      if (it != fingerprints->end()) {
+        return it->second;
+      }
     }
-    return result;
+    return fingerprint(b);
   }
 };
 
@@ -131,10 +170,8 @@ struct BlockCompare {
 
 struct BlockSuccHasher {
   hash_t operator()(cfg::Block* b) const {
-    hash_t result = 0;
-    for (const auto& succ : b->succs()) {
-      result ^= succ->target()->id();
-    }
+    hash_t result = hash_successors(b);
+    boost::hash_combine(result, b->is_catch());
     return result;
   }
 };
@@ -176,7 +213,8 @@ class DedupBlocksImpl {
 
   // Dedup blocks that are exactly the same
   bool dedup(DexMethod* method, cfg::ControlFlowGraph& cfg) {
-    Duplicates dups = collect_duplicates(method, cfg);
+    BlockFingerprints fingerprints;
+    Duplicates dups = collect_duplicates(method, cfg, &fingerprints);
     if (dups.size() > 0) {
       if (m_config.debug) {
         check_inits(cfg);
@@ -281,31 +319,40 @@ class DedupBlocksImpl {
   std::unordered_map<size_t, size_t> m_dup_sizes;
   std::mutex lock;
 
-  // Find blocks with the same exact code
-  Duplicates collect_duplicates(DexMethod* method, cfg::ControlFlowGraph& cfg) {
+  // Find blocks with the same exact code. The returned map refers to
+  // `fingerprints`, which must outlive it.
+  Duplicates collect_duplicates(DexMethod* method,
+                                cfg::ControlFlowGraph& cfg,
+                                BlockFingerprints* fingerprints) {
     const auto& blocks = cfg.blocks();
-    Duplicates duplicates;
-
+    std::vector<cfg::Block*> eligible_blocks;
     for (cfg::Block* block : blocks) {
       if (is_eligible(block)) {
-        // Find a group that matches this one. The key equality function of this
-        // map is actually a check that they are duplicates, not that they're
-        // the same block.
-        //
-        // For example, if Block A and Block A' are duplicates, we will
-        // populate this map as such:
-        //   * after the first iteration (inserted A)
-        //       A -> [A]
-        //   * after the second iteration (inserted A')
-        //       A -> [A, A']
-        duplicates[block].insert(block);
-        ++m_num_eligible_blocks;
+        eligible_blocks.push_back(block);
+        fingerprints->emplace(block, fingerprint(block));
       }
     }
+    Duplicates duplicates(eligible_blocks.size(), BlockHasher{fingerprints},
+                          BlocksInSameGroup{fingerprints});
+
+    for (cfg::Block* block : eligible_blocks) {
+      // Find a group that matches this one. The key equality function of this
+      // map is actually a check that they are duplicates, not that they're
+      // the same block.
+      //
+      // For example, if Block A and Block A' are duplicates, we will
+      // populate this map as such:
+      //   * after the first iteration (inserted A)
+      //       A -> [A]
+      //   * after the second iteration (inserted A')
+      //       A -> [A, A']
+      duplicates[block].insert(block);
+      ++m_num_eligible_blocks;
+    }
 
     std::unique_ptr<reaching_defs::MoveAwareFixpointIterator>
         reaching_defs_fixpoint_iter;
-    std::unique_ptr<LivenessFixpointIterator> liveness_fixpoint_iter;
+    std::shared_ptr<const LivenessFixpointIterator> liveness_fixpoint_iter;
     std::unique_ptr<type_inference::TypeInference> type_inference;
     remove_if(duplicates, [&](auto& blocks) {
       return is_singleton_or_inconsistent(
@@ -910,7 +957,7 @@ class DedupBlocksImpl {
       cfg::ControlFlowGraph& cfg,
       std::unique_ptr<reaching_defs::MoveAwareFixpointIterator>&
           reaching_defs_fixpoint_iter,
-      std::unique_ptr<LivenessFixpointIterator>& liveness_fixpoint_iter,
+      std::shared_ptr<const LivenessFixpointIterator>& liveness_fixpoint_iter,
       std::unique_ptr<type_inference::TypeInference>& type_inference) {
     if (blocks.size() <= 1) {
       return true;
@@ -950,8 +997,7 @@ class DedupBlocksImpl {
     auto& environments = type_inference->get_type_environments();
     if (!liveness_fixpoint_iter) {
       cfg.calculate_exit_block();
-      liveness_fixpoint_iter.reset(new LivenessFixpointIterator(cfg));
-      liveness_fixpoint_iter->run(LivenessDomain());
+      liveness_fixpoint_iter = get_liveness(cfg);
     }
     auto live_in_vars =
         liveness_fixpoint_iter->get_live_in_vars_at(*blocks.begin());
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ColdStartClinits.h"
+
+#include <unordered_set>
+
+#include "ConfigFiles.h"
+#include "DexUtil.h"
+#include "FinalInlineV2.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Resolver.h"
+#include "Walkers.h"
+
+namespace {
+
+// The class whose initialization `insn` triggers, if any.
+DexClass* initialized_class(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  const DexType* type = nullptr;
+  if (is_sfield_op(op)) {
+    auto field = resolve_field(insn->get_field(), FieldSearch::Static);
+    type = field != nullptr ? field->get_class()
+                            : insn->get_field()->get_class();
+  } else if (op == OPCODE_INVOKE_STATIC) {
+    auto method = resolve_method(insn->get_method(), MethodSearch::Static);
+    type = method != nullptr ? method->get_class()
+                             : insn->get_method()->get_class();
+  } else if (op == OPCODE_NEW_INSTANCE) {
+    type = insn->get_type();
+  }
+  return type != nullptr ? type_class_internal(type) : nullptr;
+}
+
+size_t count_clinit_instructions(const Scope& classes, size_t* num_clinits) {
+  size_t num_instructions = 0;
+  for (auto cls : classes) {
+    auto clinit = cls->get_clinit();
+    if (clinit != nullptr && clinit->get_code() != nullptr) {
+      ++*num_clinits;
+      num_instructions += clinit->get_code()->count_opcodes();
+    }
+  }
+  return num_instructions;
+}
+
+} // namespace
+
+namespace coldstart_clinits {
+
+InitGraph::InitGraph(const Scope& roots) {
+  std::unordered_set<const DexClass*> visited;
+  std::vector<DexClass*> worklist;
+  auto visit = [&](DexClass* cls) {
+    if (cls != nullptr && !cls->is_external() && visited.emplace(cls).second) {
+      m_classes.push_back(cls);
+      worklist.push_back(cls);
+    }
+  };
+  for (auto cls : roots) {
+    visit(cls);
+  }
+  while (!worklist.empty()) {
+    auto cls = worklist.back();
+    worklist.pop_back();
+    std::unordered_set<const DexClass*> seen{cls};
+    auto& deps = m_dependencies[cls];
+    auto add = [&](DexClass* dep) {
+      if (dep != nullptr && seen.emplace(dep).second) {
+        deps.push_back(dep);
+        visit(dep);
+      }
+    };
+    add(type_class_internal(cls->get_super_class()));
+    auto clinit = cls->get_clinit();
+    if (clinit != nullptr && clinit->get_code() != nullptr) {
+      for (const auto& mie : InstructionIterable(clinit->get_code())) {
+        add(initialized_class(mie.insn));
+      }
+    }
+    m_num_edges += deps.size();
+  }
+}
+
+const std::vector<DexClass*>& InitGraph::dependencies(
+    const DexClass* cls) const {
+  return m_dependencies.at(cls);
+}
+
+Stats simplify_clinits(const Scope& coldstart_classes) {
+  InitGraph graph(coldstart_classes);
+  Stats stats;
+  stats.num_classes = graph.classes().size();
+  stats.num_edges = graph.num_edges();
+  stats.num_instructions =
+      count_clinit_instructions(graph.classes(), &stats.num_clinits);
+  try {
+    // The graph contains the classes whose static fields the <clinit>s read.
+    // The analysis knows nothing about the fields of other classes, which
+    // only makes it more conservative.
+    final_inline::analyze_and_simplify_clinits(graph.classes());
+  } catch (final_inline::class_initialization_cycle& e) {
+    TRACE(FINALINLINE, 1, "%s", e.what());
+    stats.has_cycle = true;
+    return stats;
+  }
+  size_t num_clinits_after = 0;
+  auto num_instructions_after =
+      count_clinit_instructions(graph.classes(), &num_clinits_after);
+  stats.num_clinits_removed = stats.num_clinits - num_clinits_after;
+  stats.num_instructions_saved =
+      stats.num_instructions - num_instructions_after;
+  return stats;
+}
+
+} // namespace coldstart_clinits
+
+void ColdStartClinitPass::run_pass(DexStoresVector& stores,
+                                   ConfigFiles& conf,
+                                   PassManager& mgr) {
+  if (mgr.no_proguard_rules()) {
+    TRACE(FINALINLINE, 1,
+          "ColdStartClinitPass not run because no ProGuard configuration was "
+          "provided.");
+    return;
+  }
+  Scope coldstart_classes;
+  for (const auto& name : conf.get_coldstart_classes()) {
+    auto type = DexType::get_type(name.c_str());
+    auto cls = type != nullptr ? type_class_internal(type) : nullptr;
+    if (cls != nullptr) {
+      coldstart_classes.push_back(cls);
+    }
+  }
+  auto stats = coldstart_clinits::simplify_clinits(coldstart_classes);
+  TRACE(FINALINLINE, 1,
+        "Cold start initializes %zu classes (%zu edges) with %zu clinits of "
+        "%zu instructions; removed %zu clinits and %zu instructions",
+        stats.num_classes, stats.num_edges, stats.num_clinits,
+        stats.num_instructions, stats.num_clinits_removed,
+        stats.num_instructions_saved);
+  mgr.incr_metric("num_coldstart_classes", coldstart_classes.size());
+  mgr.incr_metric("num_initialized_classes", stats.num_classes);
+  mgr.incr_metric("num_init_edges", stats.num_edges);
+  mgr.incr_metric("num_clinits", stats.num_clinits);
+  mgr.incr_metric("num_clinits_removed", stats.num_clinits_removed);
+  mgr.incr_metric("num_clinit_instructions", stats.num_instructions);
+  mgr.incr_metric("num_clinit_instructions_saved",
+                  stats.num_instructions_saved);
+  mgr.incr_metric("has_init_cycle", stats.has_cycle);
+}
+
+static ColdStartClinitPass s_pass;
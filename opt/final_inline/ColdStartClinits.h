@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+#include "Pass.h"
+
+namespace coldstart_clinits {
+
+/*
+ * The classes that the VM initializes when the cold start classes get
+ * initialized, and why. Initializing a class first initializes its
+ * superclass, and its <clinit> initializes the classes whose static fields it
+ * accesses, whose static methods it calls and which it instantiates.
+ */
+class InitGraph {
+ public:
+  explicit InitGraph(const Scope& roots);
+
+  // The classes in the order they are first reached, roots first.
+  const Scope& classes() const { return m_classes; }
+
+  // The classes that initializing `cls` initializes directly.
+  const std::vector<DexClass*>& dependencies(const DexClass* cls) const;
+
+  size_t num_edges() const { return m_num_edges; }
+
+ private:
+  Scope m_classes;
+  std::unordered_map<const DexClass*, std::vector<DexClass*>> m_dependencies;
+  size_t m_num_edges{0};
+};
+
+struct Stats {
+  size_t num_classes{0};
+  size_t num_edges{0};
+  size_t num_clinits{0};
+  size_t num_clinits_removed{0};
+  // The instructions of the <clinit>s of the graph, before and after.
+  size_t num_instructions{0};
+  size_t num_instructions_saved{0};
+  bool has_cycle{false};
+};
+
+/*
+ * Computes the static field values that the <clinit>s of the classes of the
+ * init graph of `coldstart_classes` set, as FinalInlinePassV2 does, encodes
+ * them as the initial values of the static fields, and removes the
+ * instructions and <clinit>s that become redundant, so that cold start runs
+ * fewer of them. Nothing changes if the graph has an initialization cycle.
+ */
+Stats simplify_clinits(const Scope& coldstart_classes);
+
+} // namespace coldstart_clinits
+
+/*
+ * Reports how many <clinit> instructions cold start runs, and saves the ones
+ * that only compute constants; see coldstart_clinits::simplify_clinits().
+ */
+class ColdStartClinitPass : public Pass {
+ public:
+  ColdStartClinitPass() : Pass("ColdStartClinitPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+};
@@ -21,6 +21,7 @@
 #include "DexOutput.h"
 #include "DexUtil.h"
 #include "IRCode.h"
+#include "OpcodeIndex.h"
 #include "ReachableClasses.h"
 #include "Resolver.h"
 #include "Walkers.h"
@@ -35,6 +36,17 @@ class FinalInlineImpl {
   const Scope& m_full_scope;
   FinalInlinePass::Config& m_config;
 
+  // Built on first use, once the clinit rewrites that may delete methods are
+  // done. Shared by the sget rewrite and the field reference scan.
+  std::unique_ptr<opcode_index::OpcodeIndex> m_opcode_index;
+
+  const opcode_index::OpcodeIndex& opcode_index() {
+    if (m_opcode_index == nullptr) {
+      m_opcode_index = std::make_unique<opcode_index::OpcodeIndex>(m_full_scope);
+    }
+    return *m_opcode_index;
+  }
+
   bool is_cls_blacklisted(DexClass* clazz) {
     for (auto& type : m_config.black_list_types) {
       if (clazz->get_type() == type) {
@@ -49,10 +61,25 @@ class FinalInlineImpl {
     return false;
   }
 
-  std::unordered_set<DexField*> get_called_field_defs(const Scope& scope) {
+  std::unordered_set<DexField*> get_called_field_defs() {
     std::vector<DexFieldRef*> field_refs;
-    walk::methods(scope,
-                 [&](DexMethod* method) { method->gather_fields(field_refs); });
+    // Only field ops reference fields in code; annotations are cheap to scan
+    // in full.
+    const auto& index = opcode_index();
+    walk::methods(m_full_scope, [&](DexMethod* method) {
+      if (index.groups(method) & opcode_index::FIELD_OPS) {
+        method->gather_fields(field_refs);
+        return;
+      }
+      if (auto* anno = method->get_anno_set()) {
+        anno->gather_fields(field_refs);
+      }
+      if (auto* param_anno = method->get_param_anno()) {
+        for (const auto& pair : *param_anno) {
+          pair.second->gather_fields(field_refs);
+        }
+      }
+    });
     sort_unique(field_refs);
     /* Okay, now we have a complete list of field refs
      * for this particular dex.  Map to the def actually invoked.
@@ -67,8 +94,8 @@ class FinalInlineImpl {
   }
 
   std::unordered_set<DexField*> get_field_target(
-      const Scope& scope, const std::vector<DexField*>& fields) {
-    std::unordered_set<DexField*> field_defs = get_called_field_defs(scope);
+      const std::vector<DexField*>& fields) {
+    std::unordered_set<DexField*> field_defs = get_called_field_defs();
     std::unordered_set<DexField*> ftarget;
     for (auto field : fields) {
       if (field_defs.count(field) > 0) {
@@ -126,7 +153,7 @@ class FinalInlineImpl {
     sort_unique(smallscope);
 
     std::unordered_set<DexField*> field_target =
-        get_field_target(m_full_scope, moveable_fields);
+        get_field_target(moveable_fields);
     std::unordered_set<DexField*> dead_fields;
     for (auto field : moveable_fields) {
       if (field_target.count(field) == 0) {
@@ -241,13 +268,14 @@ class FinalInlineImpl {
       }
     }
 
+    const auto& index = opcode_index();
     return walk::parallel::reduce_methods<size_t, Scope>(
         m_full_scope,
-        [&inline_field, this](DexMethod* m) -> size_t {
-          auto* code = m->get_code();
-          if (!code) {
+        [&inline_field, &index, this](DexMethod* m) -> size_t {
+          if (!(index.groups(m) & opcode_index::SGET)) {
             return 0;
           }
+          auto* code = m->get_code();
           std::vector<IRList::iterator> rewrites;
           auto ii = InstructionIterable(code);
           for (auto it = ii.begin(); it != ii.end(); ++it) {
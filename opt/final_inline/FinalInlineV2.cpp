@@ -7,10 +7,15 @@
 
 #include "FinalInlineV2.h"
 
+#include <algorithm>
+#include <atomic>
 #include <boost/variant.hpp>
+#include <functional>
+#include <limits>
 #include <unordered_set>
 #include <vector>
 
+#include "ConcurrentContainers.h"
 #include "ConstantPropagationAnalysis.h"
 #include "ConstantPropagationTransform.h"
 #include "Debug.h"
@@ -23,6 +28,7 @@
 #include "Resolver.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 /*
  * dx-generated class initializers often use verbose bytecode sequences to
@@ -53,45 +59,85 @@ namespace {
  * Note that the class initialization graph is *not* guaranteed to be acyclic.
  * (JLS SE7 12.4.1 indicates that cycles are indeed allowed.) In that case,
  * this pass cannot safely optimize the static final constants.
+ *
+ * The classes are returned in waves: the <clinit> of a class only reads static
+ * fields of classes in earlier waves, so the classes of one wave can be
+ * analyzed in parallel once the waves before it are done.
  */
-Scope reverse_tsort_by_clinit_deps(const Scope& scope) {
-  std::unordered_set<const DexClass*> scope_set(scope.begin(), scope.end());
-  Scope result;
-  std::unordered_set<const DexClass*> visiting;
-  std::unordered_set<const DexClass*> visited;
-  std::function<void(DexClass*)> visit = [&](DexClass* cls) {
-    if (visited.count(cls) != 0 || scope_set.count(cls) == 0) {
-      return;
-    }
-    if (visiting.count(cls)) {
-      throw final_inline::class_initialization_cycle(cls);
-    }
-    visiting.emplace(cls);
-    auto clinit = cls->get_clinit();
-    if (clinit != nullptr && clinit->get_code() != nullptr) {
-      for (auto& mie : InstructionIterable(clinit->get_code())) {
-        auto insn = mie.insn;
-        if (is_sget(insn->opcode())) {
-          auto dependee_cls = type_class(insn->get_field()->get_class());
+std::vector<Scope> group_by_clinit_deps(const Scope& scope) {
+  std::unordered_map<const DexClass*, size_t> indices;
+  for (size_t i = 0; i < scope.size(); i++) {
+    indices.emplace(scope[i], i);
+  }
+  // The dependencies of all the <clinit>s are gathered once, in parallel. A
+  // field read depends on the class named by the field reference, and on the
+  // class that defines the field, which the VM initializes for the read.
+  std::vector<std::vector<size_t>> deps(scope.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        auto cls = scope[i];
+        auto clinit = cls->get_clinit();
+        if (clinit == nullptr || clinit->get_code() == nullptr) {
+          return;
+        }
+        auto add_dep = [&](const DexType* type) {
+          auto dependee_cls = type_class(type);
           if (dependee_cls == nullptr || dependee_cls == cls) {
-            continue;
+            return;
+          }
+          auto it = indices.find(dependee_cls);
+          if (it != indices.end()) {
+            deps[i].push_back(it->second);
+          }
+        };
+        for (auto& mie : InstructionIterable(clinit->get_code())) {
+          auto insn = mie.insn;
+          if (is_sget(insn->opcode())) {
+            add_dep(insn->get_field()->get_class());
+            auto field = resolve_field(insn->get_field(), FieldSearch::Static);
+            if (field != nullptr) {
+              add_dep(field->get_class());
+            }
           }
-          visit(dependee_cls);
         }
-      }
-    }
-    visiting.erase(cls);
-    result.emplace_back(cls);
-    visited.emplace(cls);
+      },
+      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < scope.size(); i++) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  constexpr size_t UNVISITED = std::numeric_limits<size_t>::max();
+  constexpr size_t VISITING = UNVISITED - 1;
+  std::vector<size_t> waves(scope.size(), UNVISITED);
+  std::vector<Scope> result;
+  std::function<size_t(size_t)> visit = [&](size_t i) {
+    if (waves[i] == VISITING) {
+      throw final_inline::class_initialization_cycle(scope[i]);
+    }
+    if (waves[i] != UNVISITED) {
+      return waves[i];
+    }
+    waves[i] = VISITING;
+    size_t wave = 0;
+    for (auto dep : deps[i]) {
+      wave = std::max(wave, visit(dep) + 1);
+    }
+    waves[i] = wave;
+    if (result.size() <= wave) {
+      result.resize(wave + 1);
+    }
+    result[wave].push_back(scope[i]);
+    return wave;
   };
-  for (DexClass* cls : scope) {
-    visit(cls);
+  for (size_t i = 0; i < scope.size(); i++) {
+    visit(i);
   }
   return result;
 }
 
 /**
- * Similar to reverse_tsort_by_clinit_deps(...), but since we are currently
+ * Similar to group_by_clinit_deps(...), but since we are currently
  * only dealing with instance field from class that only have one <init>
  * so stop when we are at a class that don't have exactly one constructor,
  * we are not dealing with them now so we won't have knowledge about their
@@ -246,6 +292,49 @@ void encode_values(DexClass* cls,
   }
 }
 
+/*
+ * Determine the values of the static fields of the class after its <clinit>,
+ * turn them into encoded values, and drop the writes they make redundant.
+ * Returns the environment at the exit of the <clinit>.
+ */
+ConstantEnvironment analyze_and_simplify_clinit(
+    DexClass* cls, const cp::WholeProgramState& wps) {
+  ConstantEnvironment env;
+  cp::set_encoded_values(cls, &env);
+  auto clinit = cls->get_clinit();
+  if (clinit == nullptr || clinit->get_code() == nullptr) {
+    return env;
+  }
+  auto* code = clinit->get_code();
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  cp::intraprocedural::FixpointIterator intra_cp(
+      cfg, CombinedAnalyzer(cls->get_type(), &wps, nullptr, nullptr));
+  intra_cp.run(env);
+  env = intra_cp.get_exit_state_at(cfg.exit_block());
+
+  // Generate the new encoded_values and re-run the analysis.
+  encode_values(cls, env.get_field_environment(),
+                gather_read_static_fields(cls));
+  auto fresh_env = ConstantEnvironment();
+  cp::set_encoded_values(cls, &fresh_env);
+  intra_cp.run(fresh_env);
+
+  // Detect any field writes made redundant by the new encoded_values and
+  // remove those sputs.
+  cp::Transform::Config transform_config;
+  transform_config.class_under_init = cls->get_type();
+  cp::Transform(transform_config).apply(intra_cp, wps, code);
+  // Delete the instructions rendered dead by the removal of those sputs.
+  LocalDcePass::run(code);
+  // If the clinit is empty now, delete it.
+  if (is_trivial_clinit(clinit)) {
+    cls->remove_method(clinit);
+  }
+  return env;
+}
+
 } // namespace
 
 namespace final_inline {
@@ -259,40 +348,22 @@ namespace final_inline {
  */
 cp::WholeProgramState analyze_and_simplify_clinits(const Scope& scope) {
   cp::WholeProgramState wps;
-  for (DexClass* cls : reverse_tsort_by_clinit_deps(scope)) {
-    ConstantEnvironment env;
-    cp::set_encoded_values(cls, &env);
-    auto clinit = cls->get_clinit();
-    if (clinit != nullptr && clinit->get_code() != nullptr) {
-      auto* code = clinit->get_code();
-      code->build_cfg(/* editable */ false);
-      auto& cfg = code->cfg();
-      cfg.calculate_exit_block();
-      cp::intraprocedural::FixpointIterator intra_cp(
-          cfg, CombinedAnalyzer(cls->get_type(), &wps, nullptr, nullptr));
-      intra_cp.run(env);
-      env = intra_cp.get_exit_state_at(cfg.exit_block());
-
-      // Generate the new encoded_values and re-run the analysis.
-      encode_values(cls, env.get_field_environment(),
-                    gather_read_static_fields(cls));
-      auto fresh_env = ConstantEnvironment();
-      cp::set_encoded_values(cls, &fresh_env);
-      intra_cp.run(fresh_env);
-
-      // Detect any field writes made redundant by the new encoded_values and
-      // remove those sputs.
-      cp::Transform::Config transform_config;
-      transform_config.class_under_init = cls->get_type();
-      cp::Transform(transform_config).apply(intra_cp, wps, code);
-      // Delete the instructions rendered dead by the removal of those sputs.
-      LocalDcePass::run(code);
-      // If the clinit is empty now, delete it.
-      if (is_trivial_clinit(clinit)) {
-        cls->remove_method(clinit);
-      }
+  for (const auto& wave : group_by_clinit_deps(scope)) {
+    // None of the classes of a wave reads the static fields of another, so
+    // the analysis of each only reads what the earlier waves put in wps.
+    std::vector<ConstantEnvironment> exit_envs(wave.size());
+    auto wq = workqueue_foreach<size_t>(
+        [&](size_t i) {
+          exit_envs[i] = analyze_and_simplify_clinit(wave[i], wps);
+        },
+        walk::parallel::default_num_threads());
+    for (size_t i = 0; i < wave.size(); i++) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    for (size_t i = 0; i < wave.size(); i++) {
+      wps.collect_static_finals(wave[i], exit_envs[i].get_field_environment());
     }
-    wps.collect_static_finals(cls, env.get_field_environment());
   }
   return wps;
 }
@@ -668,7 +739,8 @@ cp::EligibleIfields gather_ifield_candidates(
     ifields_candidates.emplace(field);
   });
 
-  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+  ConcurrentSet<DexField*> written_ifields;
+  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
     // Remove candidate field if it was written in code other than its class'
     // init function.
     for (auto& mie : InstructionIterable(code)) {
@@ -694,10 +766,13 @@ cp::EligibleIfields gather_ifield_candidates(
                           "file, for temporary solution set "
                           "\"inline_instance_field\" in \"FinalInlinePassV2\" "
                           "to be false.");
-        ifields_candidates.erase(field);
+        written_ifields.insert(field);
       }
     }
   });
+  for (DexField* field : written_ifields) {
+    ifields_candidates.erase(field);
+  }
   for (DexField* field : ifields_candidates) {
     eligible_ifields.emplace(field);
   }
@@ -714,8 +789,8 @@ size_t inline_final_gets(
     const cp::WholeProgramState& wps,
     const std::unordered_set<const DexType*>& black_list_types,
     cp::FieldType field_type) {
-  size_t inlined_count{0};
-  walk::code(scope, [&](const DexMethod* method, IRCode& code) {
+  std::atomic<size_t> inlined_count{0};
+  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
     if (field_type == cp::FieldType::STATIC && is_clinit(method)) {
       return;
     }
@@ -762,13 +837,13 @@ size_t inline_final_gets(
 // long-term fix is to clean up the proguard keep rules -- then we can just rely
 // on RMU to delete these fields.
 void aggressively_delete_static_finals(const Scope& scope) {
-  std::unordered_set<const DexField*> referenced_fields;
-  walk::opcodes(scope, [&](const DexMethod*, const IRInstruction* insn) {
+  ConcurrentSet<const DexField*> referenced_fields;
+  walk::parallel::opcodes(scope, [&](const DexMethod*, IRInstruction* insn) {
     if (!insn->has_field()) {
       return;
     }
     auto field = resolve_field(insn->get_field(), FieldSearch::Static);
-    referenced_fields.emplace(field);
+    referenced_fields.insert(field);
   });
   for (auto* cls : scope) {
     auto& sfields = cls->get_sfields();
@@ -0,0 +1,544 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "HotColdSplitting.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "Liveness.h"
+#include "PassManager.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "TypeInference.h"
+#include "UnknownVirtuals.h"
+
+using namespace hot_cold_splitting;
+
+namespace {
+
+constexpr const char* HOST_CLASS_PREFIX = "Lredex/$ColdCode";
+constexpr const char* COLD_METHOD_INFIX = "$cold$";
+
+// Whether code in another class can refer to `type` once it is made public.
+bool can_make_accessible(const DexType* type) {
+  auto elem = get_array_type_or_self(type);
+  if (is_primitive(elem)) {
+    return true;
+  }
+  auto cls = type_class(elem);
+  return cls != nullptr && (!cls->is_external() || is_public(cls));
+}
+
+void make_accessible(const DexType* type) {
+  auto cls = type_class(get_array_type_or_self(type));
+  if (cls != nullptr && !cls->is_external()) {
+    set_public(cls);
+  }
+}
+
+// Whether `insn` can move to a static method of another class, once
+// change_visibility made what it refers to public. This follows
+// gather_invoked_methods_that_prevent_relocation.
+bool can_move(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (op == OPCODE_MONITOR_ENTER || op == OPCODE_MONITOR_EXIT ||
+      op == OPCODE_MOVE_EXCEPTION || op == OPCODE_INVOKE_SUPER ||
+      opcode::is_load_param(op)) {
+    return false;
+  }
+  if (insn->has_method()) {
+    auto method = resolve_method(insn->get_method(), opcode_to_search(insn));
+    if (method == nullptr) {
+      return op == OPCODE_INVOKE_VIRTUAL &&
+             unknown_virtuals::is_method_known_to_be_public(
+                 insn->get_method());
+    }
+    if ((method->is_external() && !is_public(method)) ||
+        (op == OPCODE_INVOKE_DIRECT && !is_init(method))) {
+      return false;
+    }
+    return can_make_accessible(method->get_class()) &&
+           can_make_accessible(insn->get_method()->get_class());
+  }
+  if (insn->has_field()) {
+    auto field = resolve_field(insn->get_field(), is_sfield_op(op)
+                                                      ? FieldSearch::Static
+                                                      : FieldSearch::Instance);
+    return field != nullptr && (!field->is_external() || is_public(field)) &&
+           can_make_accessible(field->get_class()) &&
+           can_make_accessible(insn->get_field()->get_class());
+  }
+  if (insn->has_type()) {
+    return can_make_accessible(insn->get_type());
+  }
+  return true;
+}
+
+bool is_narrow(const DexType* type) {
+  return type == get_boolean_type() || type == get_byte_type() ||
+         type == get_char_type() || type == get_short_type();
+}
+
+// Whether `insn` expects one of its sources to be a boolean, a byte, a char
+// or a short, which an int parameter is not to the verifier.
+bool expects_narrow_src(const IRInstruction* insn, const DexType* rtype) {
+  auto op = insn->opcode();
+  if (is_invoke(op)) {
+    const auto& args = insn->get_method()->get_proto()->get_args();
+    for (auto type : args->get_type_list()) {
+      if (is_narrow(type)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (is_iput(op) || is_sput(op)) {
+    return is_narrow(insn->get_field()->get_type());
+  }
+  switch (op) {
+  case OPCODE_APUT_BOOLEAN:
+  case OPCODE_APUT_BYTE:
+  case OPCODE_APUT_CHAR:
+  case OPCODE_APUT_SHORT:
+    return true;
+  case OPCODE_FILLED_NEW_ARRAY:
+    return is_narrow(get_array_component_type(insn->get_type()));
+  case OPCODE_RETURN:
+    return is_narrow(rtype);
+  default:
+    return false;
+  }
+}
+
+struct Region {
+  cfg::Block* entry{nullptr};
+  // The registers that are live into the region, and their types.
+  std::vector<uint16_t> args;
+  std::vector<DexType*> arg_types;
+  size_t num_insns{0};
+};
+
+class HotColdSplitter {
+ public:
+  HotColdSplitter(DexStoresVector& stores,
+                  const BlockHeat& block_heat,
+                  const Config& config)
+      : m_dexen(stores.at(0).get_dexen()),
+        m_block_heat(block_heat),
+        m_config(config) {}
+
+  Stats run() {
+    for (size_t dex = 1; dex < m_dexen.size(); ++dex) {
+      // The host classes go to the end of the last dex, and are not split.
+      auto num_classes = m_dexen[dex].size();
+      for (size_t i = 0; i < num_classes; ++i) {
+        auto cls = m_dexen[dex][i];
+        for (auto method : cls->get_dmethods()) {
+          split(method);
+        }
+        for (auto method : cls->get_vmethods()) {
+          split(method);
+        }
+      }
+    }
+    return m_stats;
+  }
+
+ private:
+  void split(DexMethod* method) {
+    auto code = method->get_code();
+    if (code == nullptr || is_init(method) || is_clinit(method) ||
+        method->rstate.no_optimizations()) {
+      return;
+    }
+    auto it = m_block_heat.find(method->get_fully_deobfuscated_name());
+    if (it == m_block_heat.end()) {
+      return;
+    }
+    ++m_stats.num_methods_with_heat;
+
+    // The cold methods start from copies of the code as it is before the
+    // split, whose CFGs have the same blocks as the one of the method.
+    IRCode original(*code);
+    code->build_cfg(/* editable */ true);
+    auto& cfg = code->cfg();
+    auto regions = find_regions(method, cfg, it->second);
+    for (const auto& region : regions) {
+      auto cold = make_cold_method(method, original, region);
+      replace_region(method, cfg, region, cold);
+    }
+    if (!regions.empty()) {
+      cfg.remove_unreachable_blocks();
+      ++m_stats.num_split_methods;
+    }
+    code->clear_cfg();
+  }
+
+  std::vector<Region> find_regions(DexMethod* method,
+                                   cfg::ControlFlowGraph& cfg,
+                                   const std::vector<uint64_t>& heat) {
+    auto blocks = cfg.blocks();
+    if (blocks.size() != heat.size()) {
+      ++m_stats.num_heat_mismatches;
+      return {};
+    }
+    std::unordered_map<const cfg::Block*, uint64_t> block_heat;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      block_heat.emplace(blocks[i], heat[i]);
+    }
+    if (block_heat.at(cfg.entry_block()) == 0) {
+      return {};
+    }
+
+    std::vector<Region> regions;
+    std::unordered_set<const cfg::Block*> claimed;
+    std::shared_ptr<const LivenessFixpointIterator> liveness;
+    std::unique_ptr<type_inference::TypeInference> types;
+    for (auto block : blocks) {
+      if (block_heat.at(block) != 0 || block == cfg.entry_block() ||
+          block->is_catch() || claimed.count(block)) {
+        continue;
+      }
+      const auto& preds = block->preds();
+      if (std::none_of(preds.begin(), preds.end(), [&](const cfg::Edge* e) {
+            return block_heat.at(e->src()) > 0;
+          })) {
+        continue;
+      }
+      auto region_blocks = grow_region(block, block_heat);
+      if (region_blocks.empty()) {
+        ++m_stats.num_rejected_regions;
+        continue;
+      }
+      if (liveness == nullptr) {
+        // Liveness is a backwards analysis. The exit block this may add
+        // comes after the blocks that the heat is for.
+        cfg.calculate_exit_block();
+        liveness = get_liveness(cfg);
+        types = std::make_unique<type_inference::TypeInference>(
+            cfg, /* lazy_environments */ true);
+        types->run(method);
+      }
+      Region region;
+      region.entry = block;
+      if (!analyze(method, region_blocks, *liveness, *types, &region)) {
+        ++m_stats.num_rejected_regions;
+        continue;
+      }
+      claimed.insert(region_blocks.begin(), region_blocks.end());
+      regions.push_back(std::move(region));
+    }
+    return regions;
+  }
+
+  // The blocks of the single-entry tail of the CFG that starts at `entry`, or
+  // nothing if it doesn't stay cold or it is in a try.
+  static std::vector<cfg::Block*> grow_region(
+      cfg::Block* entry,
+      const std::unordered_map<const cfg::Block*, uint64_t>& block_heat) {
+    std::vector<cfg::Block*> region{entry};
+    std::unordered_set<const cfg::Block*> in_region{entry};
+    for (size_t i = 0; i < region.size(); ++i) {
+      auto block = region[i];
+      if (block_heat.at(block) != 0) {
+        return {};
+      }
+      for (auto e : block->succs()) {
+        if (e->type() == cfg::EDGE_GHOST) {
+          continue;
+        }
+        if (e->type() == cfg::EDGE_THROW || e->target() == entry) {
+          return {};
+        }
+        if (in_region.insert(e->target()).second) {
+          region.push_back(e->target());
+        }
+      }
+    }
+    for (auto block : region) {
+      if (block == entry) {
+        continue;
+      }
+      for (auto e : block->preds()) {
+        if (!in_region.count(e->src())) {
+          return {};
+        }
+      }
+    }
+    return region;
+  }
+
+  bool analyze(DexMethod* method,
+               const std::vector<cfg::Block*>& blocks,
+               const LivenessFixpointIterator& liveness,
+               type_inference::TypeInference& types,
+               Region* region) {
+    auto rtype = method->get_proto()->get_rtype();
+    auto entry = region->entry;
+    auto first = entry->get_first_insn();
+    if (first != entry->end() &&
+        (is_move_result(first->insn->opcode()) ||
+         opcode::is_move_result_pseudo(first->insn->opcode()))) {
+      return false;
+    }
+    auto live_in_domain = liveness.get_live_in_vars_at(entry);
+    const auto& live_in = live_in_domain.elements();
+    bool expects_narrow = false;
+    for (auto block : blocks) {
+      for (const auto& mie : InstructionIterable(block)) {
+        auto insn = mie.insn;
+        if (!can_move(insn)) {
+          return false;
+        }
+        // What comes in may not be initialized yet, which only the method
+        // that allocated it can see.
+        if (insn->opcode() == OPCODE_INVOKE_DIRECT &&
+            is_init(insn->get_method()) && live_in.contains(insn->src(0))) {
+          return false;
+        }
+        expects_narrow = expects_narrow || expects_narrow_src(insn, rtype);
+        ++region->num_insns;
+      }
+    }
+    if (region->num_insns < m_config.min_insns ||
+        !can_make_accessible(rtype)) {
+      return false;
+    }
+
+    auto env = types.get_entry_state_at(entry);
+    size_t arg_words = 0;
+    for (auto reg : live_in) {
+      const DexType* type = nullptr;
+      switch (env.get_type(reg).element()) {
+      case REFERENCE: {
+        auto dex_type = env.get_dex_type(reg);
+        if (dex_type) {
+          type = *dex_type;
+        }
+        break;
+      }
+      case INT:
+        // The int may be a boolean, a byte, a char or a short that the
+        // region uses as such.
+        type = expects_narrow ? nullptr : get_int_type();
+        break;
+      case FLOAT:
+        type = get_float_type();
+        break;
+      case LONG1:
+        type = get_long_type();
+        break;
+      case DOUBLE1:
+        type = get_double_type();
+        break;
+      default:
+        break;
+      }
+      if (type == nullptr || !can_make_accessible(type)) {
+        return false;
+      }
+      region->args.push_back(reg);
+      region->arg_types.push_back(const_cast<DexType*>(type));
+      arg_words += is_wide_type(type) ? 2 : 1;
+    }
+    return arg_words <= m_config.max_arg_words;
+  }
+
+  DexMethod* make_cold_method(DexMethod* method,
+                              const IRCode& original,
+                              const Region& region) {
+    auto code = std::make_unique<IRCode>(original);
+    code->build_cfg(/* editable */ true);
+    auto& cfg = code->cfg();
+    cfg::Block* region_entry = nullptr;
+    for (auto block : cfg.blocks()) {
+      if (block->id() == region.entry->id()) {
+        region_entry = block;
+      }
+    }
+    always_assert(region_entry != nullptr);
+
+    // The parameters come after the registers of the method, and are moved
+    // to the ones that the region reads them from.
+    uint16_t param = cfg.get_registers_size();
+    std::vector<IRInstruction*> insns;
+    std::vector<IRInstruction*> moves;
+    for (size_t k = 0; k < region.args.size(); ++k) {
+      auto type = region.arg_types[k];
+      auto load_param = new IRInstruction(
+          is_wide_type(type)
+              ? IOPCODE_LOAD_PARAM_WIDE
+              : is_object(type) ? IOPCODE_LOAD_PARAM_OBJECT
+                                : IOPCODE_LOAD_PARAM);
+      load_param->set_dest(param);
+      insns.push_back(load_param);
+      auto move = new IRInstruction(
+          is_wide_type(type)
+              ? OPCODE_MOVE_WIDE
+              : is_object(type) ? OPCODE_MOVE_OBJECT : OPCODE_MOVE);
+      move->set_dest(region.args[k])->set_src(0, param);
+      moves.push_back(move);
+      param += is_wide_type(type) ? 2 : 1;
+    }
+    insns.insert(insns.end(), moves.begin(), moves.end());
+    auto entry = cfg.create_block();
+    cfg.push_back(entry, insns);
+    cfg.add_edge(entry, region_entry, cfg::EDGE_GOTO);
+    cfg.set_entry_block(entry);
+    // Only the region is reachable from the new entry.
+    cfg.remove_unreachable_blocks();
+    cfg.set_registers_size(param);
+    code->clear_cfg();
+    if (code->get_debug_item() != nullptr) {
+      // For the positions.
+      code->set_debug_item(std::make_unique<DexDebugItem>());
+    }
+
+    std::deque<DexType*> args(region.arg_types.begin(),
+                              region.arg_types.end());
+    auto rtype = method->get_proto()->get_rtype();
+    auto proto = DexProto::make_proto(
+        rtype, DexTypeList::make_type_list(std::move(args)));
+    auto name =
+        DexString::make_string(method->get_name()->str() + COLD_METHOD_INFIX +
+                               std::to_string(m_stats.num_cold_methods));
+    auto host = host_class();
+    auto cold = static_cast<DexMethod*>(
+        DexMethod::make_method(host->get_type(), name, proto));
+    cold->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL,
+                        std::move(code),
+                        /* is_virtual */ false);
+    cold->set_deobfuscated_name(show(cold));
+    cold->rstate.set_generated();
+    host->add_method(cold);
+    for (auto type : region.arg_types) {
+      make_accessible(type);
+    }
+    make_accessible(rtype);
+    change_visibility(cold);
+
+    ++m_stats.num_cold_methods;
+    m_stats.num_moved_insns += region.num_insns;
+    TRACE(HCS, 3, "Moved %zu instructions of %s to %s:\n%s", region.num_insns,
+          SHOW(method), SHOW(cold), SHOW(cold->get_code()));
+    return cold;
+  }
+
+  // Calls `cold` from where the region was, and returns what it returns.
+  static void replace_region(DexMethod* method,
+                             cfg::ControlFlowGraph& cfg,
+                             const Region& region,
+                             DexMethod* cold) {
+    std::vector<IRInstruction*> insns;
+    auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+    invoke->set_method(cold)->set_arg_word_count(region.args.size());
+    for (size_t k = 0; k < region.args.size(); ++k) {
+      invoke->set_src(k, region.args[k]);
+    }
+    insns.push_back(invoke);
+    auto rtype = method->get_proto()->get_rtype();
+    if (rtype == get_void_type()) {
+      insns.push_back(new IRInstruction(OPCODE_RETURN_VOID));
+    } else {
+      bool wide = is_wide_type(rtype);
+      bool object = is_object(rtype);
+      auto result = wide ? cfg.allocate_wide_temp() : cfg.allocate_temp();
+      auto move_result = new IRInstruction(
+          wide ? OPCODE_MOVE_RESULT_WIDE
+               : object ? OPCODE_MOVE_RESULT_OBJECT : OPCODE_MOVE_RESULT);
+      move_result->set_dest(result);
+      insns.push_back(move_result);
+      auto ret = new IRInstruction(
+          wide ? OPCODE_RETURN_WIDE
+               : object ? OPCODE_RETURN_OBJECT : OPCODE_RETURN);
+      ret->set_src(0, result);
+      insns.push_back(ret);
+    }
+    auto call = cfg.create_block();
+    cfg.push_back(call, insns);
+    cfg.replace_block(region.entry, call);
+  }
+
+  DexClass* host_class() {
+    if (m_host == nullptr || m_host_size >= m_config.methods_per_host) {
+      auto type = DexType::make_type(
+          (HOST_CLASS_PREFIX + std::to_string(m_stats.num_host_classes) + ";")
+              .c_str());
+      always_assert_log(!type_class(type), "%s already exists", SHOW(type));
+      ClassCreator creator(type);
+      creator.set_super(get_object_type());
+      creator.set_access(ACC_PUBLIC | ACC_FINAL);
+      m_host = creator.create();
+      m_host->rstate.set_generated();
+      m_dexen.back().push_back(m_host);
+      m_host_size = 0;
+      ++m_stats.num_host_classes;
+    }
+    ++m_host_size;
+    return m_host;
+  }
+
+  std::vector<DexClasses>& m_dexen;
+  const BlockHeat& m_block_heat;
+  const Config& m_config;
+  Stats m_stats;
+
+  DexClass* m_host{nullptr};
+  size_t m_host_size{0};
+};
+
+} // namespace
+
+namespace hot_cold_splitting {
+
+Stats split_cold_regions(DexStoresVector& stores,
+                         const BlockHeat& block_heat,
+                         const Config& config) {
+  always_assert(!stores.empty());
+  always_assert(config.methods_per_host > 0);
+  return HotColdSplitter(stores, block_heat, config).run();
+}
+
+} // namespace hot_cold_splitting
+
+void HotColdSplittingPass::run_pass(DexStoresVector& stores,
+                                    ConfigFiles& conf,
+                                    PassManager& mgr) {
+  const auto& block_heat = conf.get_method_to_block_heat();
+  if (block_heat.empty()) {
+    TRACE(HCS, 1, "No block heat, nothing to split");
+    return;
+  }
+  auto stats =
+      hot_cold_splitting::split_cold_regions(stores, block_heat, m_config);
+  TRACE(HCS, 1,
+        "Moved %zu instructions of %zu methods to %zu cold methods in %zu "
+        "classes; %zu regions rejected, %zu of %zu methods with mismatched "
+        "heat",
+        stats.num_moved_insns, stats.num_split_methods, stats.num_cold_methods,
+        stats.num_host_classes, stats.num_rejected_regions,
+        stats.num_heat_mismatches, stats.num_methods_with_heat);
+  mgr.incr_metric("num_split_methods", stats.num_split_methods);
+  mgr.incr_metric("num_cold_methods", stats.num_cold_methods);
+  mgr.incr_metric("num_moved_insns", stats.num_moved_insns);
+  mgr.incr_metric("num_rejected_regions", stats.num_rejected_regions);
+  mgr.incr_metric("num_heat_mismatches", stats.num_heat_mismatches);
+  mgr.incr_metric("num_host_classes", stats.num_host_classes);
+}
+
+static HotColdSplittingPass s_pass;
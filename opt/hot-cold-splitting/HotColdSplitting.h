@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DexStore.h"
+#include "Pass.h"
+
+/*
+ * Moves the blocks of hot methods that never ran in the profiles out into
+ * static cold methods, so that the hot methods get smaller and the pages
+ * they are on hold more of what runs at startup.
+ *
+ * The block heat is the one of ConfigFiles::get_method_to_block_heat, indexed
+ * like the blocks of a freshly built editable CFG of the method, and the
+ * methods whose CFG doesn't have as many blocks are left alone.
+ *
+ * The cold regions are the single-entry tails of the CFG: a block that never
+ * ran but has a predecessor that did, and all the blocks that it reaches, as
+ * long as none of them ran, they are only entered from within the region,
+ * and they end the method by returning or throwing. A region is moved to a
+ * cold method that takes the registers that are live into it, and returns
+ * what the method would have returned, and the method calls it and returns
+ * the result in its place. Regions that are inside of try blocks, that enter
+ * monitors, that call super or private methods, or that take registers whose
+ * types aren't known exactly are left alone.
+ *
+ * The cold methods go to generated host classes at the end of the last dex
+ * of the root store, and since these aren't in the cold-start list InterDex
+ * places them after the startup classes: the pass is meant to run before
+ * InterDex.
+ */
+namespace hot_cold_splitting {
+
+struct Config {
+  // The fewest instructions that a region has to have to be moved.
+  size_t min_insns{8};
+  // The most argument words that a cold method may take.
+  size_t max_arg_words{8};
+  // How many cold methods go to each host class.
+  size_t methods_per_host{64};
+};
+
+struct Stats {
+  size_t num_methods_with_heat{0};
+  size_t num_heat_mismatches{0};
+  size_t num_split_methods{0};
+  size_t num_cold_methods{0};
+  size_t num_moved_insns{0};
+  size_t num_rejected_regions{0};
+  size_t num_host_classes{0};
+};
+
+using BlockHeat = std::unordered_map<std::string, std::vector<uint64_t>>;
+
+/*
+ * Splits the methods of the dexes of the root store that have block heat,
+ * except for the ones of the primary dex.
+ */
+Stats split_cold_regions(DexStoresVector& stores,
+                         const BlockHeat& block_heat,
+                         const Config& config);
+
+} // namespace hot_cold_splitting
+
+class HotColdSplittingPass : public Pass {
+ public:
+  HotColdSplittingPass() : Pass("HotColdSplittingPass") {}
+
+  void bind_config() override {
+    bind("min_insns", {8}, m_config.min_insns);
+    bind("max_arg_words", {8}, m_config.max_arg_words);
+    bind("methods_per_host", {64}, m_config.methods_per_host);
+  }
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles& conf,
+                PassManager& mgr) override;
+
+ private:
+  hot_cold_splitting::Config m_config;
+};
@@ -7,8 +7,11 @@
 
 #include "Instrument.h"
 
+#include "ControlFlow.h"
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "EdgeProfile.h"
+#include "InstrumentProfile.h"
 #include "InterDexPass.h"
 #include "InterDexPassPlugin.h"
 #include "Match.h"
@@ -18,6 +21,7 @@
 
 #include <cmath>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -637,6 +641,19 @@ void write_basic_block_index_file(
   TRACE(INSTRUMENT, 2, "Index file was written to: %s", file_name.c_str());
 } // namespace
 
+// The binary counterpart of the metadata, which the profiles of
+// InstrumentProfile.h are merged with.
+void write_binary_metadata_file(
+    const std::string& file_name,
+    const instrument::InstrumentMetadata& metadata) {
+  if (file_name.empty()) {
+    return;
+  }
+  std::ofstream ofs(file_name, std::ofstream::binary | std::ofstream::trunc);
+  metadata.write(ofs);
+  TRACE(INSTRUMENT, 2, "Binary metadata was written to: %s", file_name.c_str());
+}
+
 auto generate_sharded_analysis_methods(DexClass& cls,
                                        const std::string& method_name,
                                        const std::vector<DexFieldRef*> fields,
@@ -1025,10 +1042,59 @@ void do_simple_method_tracing(DexClass* analysis_cls,
   ofs.close();
   TRACE(INSTRUMENT, 2, "Index file was written to: %s", file_name.c_str());
 
+  instrument::InstrumentMetadata metadata;
+  metadata.kind = instrument::ProfileKind::METHOD_COUNTS;
+  metadata.num_counters = kTotalSize * options.num_stats_per_method;
+  for (size_t i = 0; i < kTotalSize; ++i) {
+    instrument::MethodMetadata m;
+    m.name = to_instrument[i]->get_fully_deobfuscated_name();
+    m.first_counter = i * options.num_stats_per_method;
+    m.num_counters = options.num_stats_per_method;
+    metadata.methods.push_back(std::move(m));
+  }
+  write_binary_metadata_file(cfg.metafile(options.binary_metadata_file_name),
+                             metadata);
+
   pm.incr_metric("Instrumented", method_id);
   pm.incr_metric("Excluded", excluded);
 }
 
+std::unordered_set<std::string> get_cold_start_classes(ConfigFiles& cfg) {
+  auto interdex_list = cfg.get_coldstart_classes();
+  std::unordered_set<std::string> cold_start_classes;
+  std::string dex_end_marker0("LDexEndMarker0;");
+  for (auto class_string : interdex_list) {
+    if (class_string == dex_end_marker0) {
+      break;
+    }
+    class_string.back() = '/';
+    cold_start_classes.insert(class_string);
+  }
+  TRACE(INSTRUMENT, 7, "Number of classes: %d", cold_start_classes.size());
+  return cold_start_classes;
+}
+
+bool is_block_instrumented(
+    const DexMethod* method,
+    const InstrumentPass::Options& options,
+    const std::unordered_set<std::string>& cold_start_classes) {
+  // Basic block tracing assumes whitelist or set of cold start classes.
+  if ((!options.whitelist.empty() && !is_included(method, options.whitelist)) ||
+      (options.only_cold_start_class &&
+       !is_included(method, cold_start_classes))) {
+    return false;
+  }
+
+  // Blacklist has priority over whitelist or cold start list.
+  if (is_included(method, options.blacklist)) {
+    TRACE(INSTRUMENT, 9, "Blacklist: excluded: %s", SHOW(method));
+    return false;
+  }
+
+  TRACE(INSTRUMENT, 9, "Whitelist: included: %s", SHOW(method));
+  return true;
+}
+
 // A simple bit-vector basic block instrumentation algorithm
 //
 //  Example) Original CFG
@@ -1068,19 +1134,11 @@ void do_basic_block_tracing(DexClass* analysis_cls,
       method_id_name_map;
   auto scope = build_class_scope(stores);
 
-  auto interdex_list = cfg.get_coldstart_classes();
-  std::unordered_set<std::string> cold_start_classes;
-  std::string dex_end_marker0("LDexEndMarker0;");
-  for (auto class_string : interdex_list) {
-    if (class_string == dex_end_marker0) {
-      break;
-    }
-    class_string.back() = '/';
-    cold_start_classes.insert(class_string);
-  }
-  TRACE(INSTRUMENT, 7, "Number of classes: %d", cold_start_classes.size());
+  auto cold_start_classes = get_cold_start_classes(cfg);
 
   std::map<size_t /* num_vectors */, int /* count */> bb_vector_stat;
+  instrument::InstrumentMetadata metadata;
+  metadata.kind = instrument::ProfileKind::BLOCK_BITS;
   walk::code(scope, [&](DexMethod* method, IRCode& code) {
     if (method == analysis_cls->get_clinit()) {
       return;
@@ -1091,30 +1149,27 @@ void do_basic_block_tracing(DexClass* analysis_cls,
       return;
     }
 
-    // Basic block tracing assumes whitelist or set of cold start classes.
-    if ((!options.whitelist.empty() &&
-         !is_included(method, options.whitelist)) ||
-        (options.only_cold_start_class &&
-         !is_included(method, cold_start_classes))) {
-      return;
-    }
-
-    // Blacklist has priority over whitelist or cold start list.
-    if (is_included(method, options.blacklist)) {
-      TRACE(INSTRUMENT, 9, "Blacklist: excluded: %s", SHOW(method));
+    if (!is_block_instrumented(method, options, cold_start_classes)) {
       return;
     }
-
-    TRACE(INSTRUMENT, 9, "Whitelist: included: %s", SHOW(method));
     all_methods++;
+    instrument::MethodMetadata m;
+    m.name = method->get_fully_deobfuscated_name();
+    m.first_counter = method_index;
     method_index = instrument_onBasicBlockBegin(
         &code, method, method_onMethodExit_map, method_index, all_bb_nums,
         all_bb_inst, all_method_inst, method_id_name_map, bb_vector_stat);
+    m.num_counters = method_index - m.first_counter;
+    m.graph.num_blocks = method_id_name_map.at(m.first_counter).second;
+    metadata.methods.push_back(std::move(m));
   });
   patch_array_size(*analysis_cls, "sBasicBlockStats", method_index);
 
   write_basic_block_index_file(cfg.metafile(options.metadata_file_name),
                                method_id_name_map);
+  metadata.num_counters = method_index;
+  write_binary_metadata_file(cfg.metafile(options.binary_metadata_file_name),
+                             metadata);
 
   double cumulative = 0.;
   TRACE(INSTRUMENT, 4, "BB vector stats:");
@@ -1131,6 +1186,231 @@ void do_basic_block_tracing(DexClass* analysis_cls,
         (all_method_inst - 1), all_bb_inst, all_methods, all_bb_nums);
 }
 
+// Returns the instructions that bump the counter `id`. Like the method stats of
+// simple method tracing, the counters are interleaved over the shards.
+std::vector<IRInstruction*> make_counter_increment(
+    cfg::ControlFlowGraph& cfg,
+    size_t id,
+    size_t num_shards,
+    const std::unordered_map<int, DexMethod*>& analysis_methods) {
+  const auto reg = cfg.allocate_temp();
+  return {(new IRInstruction(OPCODE_CONST))
+              ->set_literal(id / num_shards)
+              ->set_dest(reg),
+          (new IRInstruction(OPCODE_INVOKE_STATIC))
+              ->set_method(analysis_methods.at(id % num_shards + 1))
+              ->set_arg_word_count(1)
+              ->set_src(0, reg)};
+}
+
+// Counts the edges off a spanning tree of the CFG of the method, see
+// EdgeProfile.h. Blocks are numbered in the order of the CFG before the
+// instrumentation. The counters are placed:
+//  - Before the return or throw, on the edges to the exit.
+//  - After the move-exception, on the edges into catch blocks.
+//  - In a block of their own on the other edges, which the counter splits.
+//
+// Writes the edges of the method to both metadata, and returns the number of
+// counters, which start at `first_counter`.
+size_t instrument_edges(
+    DexMethod* method,
+    IRCode& code,
+    size_t first_counter,
+    size_t num_shards,
+    const std::unordered_map<int, DexMethod*>& analysis_methods,
+    std::ostream& ofs,
+    instrument::InstrumentMetadata& metadata) {
+  code.build_cfg(/* editable */ true);
+  auto& cfg = code.cfg();
+  const auto blocks = cfg.blocks();
+  std::unordered_map<const cfg::Block*, uint32_t> numbers;
+  for (uint32_t i = 0; i < blocks.size(); ++i) {
+    numbers.emplace(blocks[i], i);
+  }
+
+  instrument::EdgeProfileGraph graph;
+  graph.num_blocks = blocks.size();
+  graph.entry = numbers.at(cfg.entry_block());
+  graph.may_throw.resize(blocks.size(), false);
+  // The CFG edge of each profile edge, or the block to insert into for the
+  // edges from and to the exit.
+  std::vector<cfg::Edge*> cfg_edges;
+  std::vector<cfg::Block*> cfg_blocks;
+  for (cfg::Block* block : blocks) {
+    const uint32_t n = numbers.at(block);
+    for (cfg::Edge* e : block->succs()) {
+      if (e->type() == cfg::EDGE_GOTO || e->type() == cfg::EDGE_BRANCH) {
+        const uint32_t target = numbers.at(e->target());
+        // Back edges are expected to be the hottest: keep them uncounted.
+        graph.edges.push_back({n, target, target <= n ? 2u : 1u});
+        cfg_edges.push_back(e);
+        cfg_blocks.push_back(nullptr);
+      } else if (e->type() == cfg::EDGE_THROW) {
+        graph.may_throw[n] = true;
+      }
+    }
+    auto last = block->get_last_insn();
+    if (last != block->end() && (is_return(last->insn->opcode()) ||
+                                 is_throw(last->insn->opcode()))) {
+      graph.edges.push_back({n, graph.exit(), 1});
+      cfg_edges.push_back(nullptr);
+      cfg_blocks.push_back(block);
+    }
+    if (block->is_catch()) {
+      graph.edges.push_back({graph.exit(), n, 0});
+      cfg_edges.push_back(nullptr);
+      cfg_blocks.push_back(block);
+    }
+  }
+  const auto counted = instrument::choose_counted_edges(graph);
+
+  // Insertions into blocks may split them, but the part with the original
+  // beginning keeps its pointer and the edges keep theirs, so the order only
+  // matters for the exit edges: their return or throw has to be the last
+  // instruction of the block still.
+  std::ostringstream edges;
+  size_t counter = first_counter;
+  std::vector<std::pair<size_t, size_t>> catch_counters;
+  std::vector<std::pair<size_t, size_t>> edge_counters;
+  for (size_t i = 0; i < graph.edges.size(); ++i) {
+    const auto& e = graph.edges[i];
+    auto node = [&](uint32_t n) {
+      return n == graph.exit() ? std::string("x") : std::to_string(n);
+    };
+    edges << (i == 0 ? "" : " ") << node(e.src) << ">" << node(e.dst)
+          << (counted[i] ? "+" : "");
+    if (!counted[i]) {
+      continue;
+    }
+    if (e.dst == graph.exit()) {
+      auto* block = cfg_blocks[i];
+      cfg.insert_before(
+          block->to_cfg_instruction_iterator(block->get_last_insn()),
+          make_counter_increment(cfg, counter, num_shards, analysis_methods));
+    } else if (e.src == graph.exit()) {
+      catch_counters.emplace_back(i, counter);
+    } else {
+      edge_counters.emplace_back(i, counter);
+    }
+    ++counter;
+  }
+  for (const auto& p : catch_counters) {
+    auto* block = cfg_blocks[p.first];
+    auto insns =
+        make_counter_increment(cfg, p.second, num_shards, analysis_methods);
+    auto it = ir_list::InstructionIterable(block).begin();
+    auto end = ir_list::InstructionIterable(block).end();
+    while (it != end && it->insn->opcode() == OPCODE_MOVE_EXCEPTION) {
+      ++it;
+    }
+    if (it == end) {
+      cfg.push_back(block, insns);
+    } else {
+      cfg.insert_before(block->to_cfg_instruction_iterator(it), insns);
+    }
+  }
+  for (const auto& p : edge_counters) {
+    auto* e = cfg_edges[p.first];
+    auto* target = e->target();
+    auto* block = cfg.create_block();
+    cfg.push_back(block, make_counter_increment(cfg, p.second, num_shards,
+                                                analysis_methods));
+    cfg.set_edge_target(e, block);
+    cfg.add_edge(block, target, cfg::EDGE_GOTO);
+  }
+  code.clear_cfg();
+
+  std::ostringstream throwing;
+  for (uint32_t n = 0; n < graph.num_blocks; ++n) {
+    if (graph.may_throw[n]) {
+      throwing << (throwing.tellp() > 0 ? " " : "") << n;
+    }
+  }
+  ofs << "M," << method->get_deobfuscated_name() << "," << first_counter << ","
+      << graph.num_blocks << "," << graph.entry << ",\"" << edges.str()
+      << "\",\"" << throwing.str() << "\"\n";
+  TRACE(INSTRUMENT, 7, "%zu counters for %zu blocks in %s",
+        counter - first_counter, blocks.size(), SHOW(method));
+
+  instrument::MethodMetadata m;
+  m.name = method->get_fully_deobfuscated_name();
+  m.first_counter = first_counter;
+  m.num_counters = counter - first_counter;
+  m.graph = std::move(graph);
+  m.counted = counted;
+  metadata.methods.push_back(std::move(m));
+  return counter - first_counter;
+}
+
+// Edge-counting basic block instrumentation: unlike basic_block_tracing, it
+// counts how often the blocks run, and with fewer updates than there are
+// blocks, see instrument_edges. The counters are sharded over
+// `num_shards` arrays with the analysis methods of simple_method_tracing:
+// onMethodBegin1(int index) and its clones bump sMethodStats1[index] and so
+// on, and sMethodCount is patched with the number of counters.
+//
+// The metadata has a line per method with its first counter, its number of
+// blocks, its entry block, its edges, and the blocks that may throw:
+//
+//   M,Lcom/foo/Bar;.baz:()V,42,3,0,"0>1 0>2+ 1>x+ 2>x","1"
+//
+// where x is the exit, and the edges marked with + have the counters from the
+// first one on, in order. derive_block_counts in EdgeProfile.h turns their
+// counts into block counts.
+void do_basic_block_edge_counting(DexClass* analysis_cls,
+                                  DexStoresVector& stores,
+                                  ConfigFiles& cfg,
+                                  PassManager& pm,
+                                  const InstrumentPass::Options& options) {
+  const size_t NUM_SHARDS = options.num_shards;
+  const auto& array_fields = patch_sharded_arrays(analysis_cls, NUM_SHARDS);
+  always_assert(array_fields.size() == NUM_SHARDS);
+  const auto& analysis_methods = generate_sharded_analysis_methods(
+      *analysis_cls, options.analysis_method_name, array_fields, NUM_SHARDS);
+  const auto& analysis_method_map = analysis_methods.first;
+  const auto& analysis_method_names = analysis_methods.second;
+
+  const auto& file_name = cfg.metafile(options.metadata_file_name);
+  std::ofstream ofs(file_name, std::ofstream::out | std::ofstream::trunc);
+  ofs << "#,basic-block-edge-counting,1.0" << std::endl;
+
+  auto cold_start_classes = get_cold_start_classes(cfg);
+  auto scope = build_class_scope(stores);
+  size_t num_counters = 0;
+  int num_methods = 0;
+  instrument::InstrumentMetadata metadata;
+  metadata.kind = instrument::ProfileKind::EDGE_COUNTS;
+  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+    if (method == analysis_cls->get_clinit() ||
+        analysis_method_names.count(method->get_name()->str())) {
+      return;
+    }
+    if (!is_block_instrumented(method, options, cold_start_classes)) {
+      return;
+    }
+    num_counters += instrument_edges(method, code, num_counters, NUM_SHARDS,
+                                     analysis_method_map, ofs, metadata);
+    ++num_methods;
+  });
+
+  for (size_t i = 0; i < NUM_SHARDS; ++i) {
+    size_t n =
+        num_counters / NUM_SHARDS + (i < num_counters % NUM_SHARDS ? 1 : 0);
+    patch_array_size(*analysis_cls, "sMethodStats" + std::to_string(i + 1), n);
+  }
+  patch_static_field(*analysis_cls, "sMethodCount", num_counters);
+
+  ofs.close();
+  TRACE(INSTRUMENT, 2, "Index file was written to: %s", file_name.c_str());
+  metadata.num_counters = num_counters;
+  write_binary_metadata_file(cfg.metafile(options.binary_metadata_file_name),
+                             metadata);
+  TRACE(INSTRUMENT, 1, "Instrumented %d methods with %zu counters",
+        num_methods, num_counters);
+  pm.incr_metric("Instrumented", num_methods);
+  pm.incr_metric("Counters", num_counters);
+}
+
 std::unordered_set<std::string> load_blacklist_file(
     const std::string& file_name) {
   // Assume the file simply enumerates blacklisted names.
@@ -1158,6 +1438,8 @@ void InstrumentPass::bind_config() {
   bind("blacklist_file_name", "", m_options.blacklist_file_name);
   bind("metadata_file_name", "redex-instrument-metadata.txt",
        m_options.metadata_file_name);
+  bind("binary_metadata_file_name", "redex-instrument-metadata.bin",
+       m_options.binary_metadata_file_name);
   bind("num_stats_per_method", {1}, m_options.num_stats_per_method);
   bind("num_shards", {1}, m_options.num_shards);
   bind("only_cold_start_class", true, m_options.only_cold_start_class);
@@ -1233,6 +1515,9 @@ void InstrumentPass::run_pass(DexStoresVector& stores,
     do_simple_method_tracing(analysis_cls, stores, cfg, pm, m_options);
   } else if (m_options.instrumentation_strategy == "basic_block_tracing") {
     do_basic_block_tracing(analysis_cls, stores, cfg, pm, m_options);
+  } else if (m_options.instrumentation_strategy ==
+             "basic_block_edge_counting") {
+    do_basic_block_edge_counting(analysis_cls, stores, cfg, pm, m_options);
   } else {
     std::cerr << "[InstrumentPass] Unknown instrumentation strategy.\n";
   }
@@ -26,6 +26,7 @@ class InstrumentPass : public Pass {
     std::unordered_set<std::string> whitelist;
     std::string blacklist_file_name;
     std::string metadata_file_name;
+    std::string binary_metadata_file_name;
     int64_t num_stats_per_method;
     int64_t num_shards;
     bool only_cold_start_class;
@@ -7,12 +7,14 @@
 
 #pragma once
 
+#include <array>
+#include <limits>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "DexClass.h"
-#include "MutablePriorityQueue.h"
+#include "DexIdContainers.h"
+#include "IndexedPriorityQueue.h"
 
 namespace interdex {
 
@@ -26,7 +28,8 @@ namespace interdex {
 // minimization, but also causes it to use more memory and run slower.
 constexpr uint64_t INFREQUENT_REFS_COUNT = 6;
 
-using PrioritizedDexClasses = MutablePriorityQueue<DexClass*, uint64_t>;
+// Classes are identified by their index, i.e. the order of insertion.
+using PrioritizedDexClasses = IndexedPriorityQueue<uint64_t>;
 struct CrossDexRefMinimizerStats {
   uint64_t classes{0};
   uint64_t resets{0};
@@ -76,49 +79,99 @@ struct CrossDexRefMinimizerConfig {
 // reasonably large to prevent overflows. However, we don't always check for
 // overflows. In any case, all of this flows into a heuristic, so it wouldn't
 // be the end of the world if an overflow ever happens.
+//
+// All *refs that were sampled get a dense id, by which their frequency
+// counts, the classes that reference them and whether they are already
+// applied are looked up in flat vectors. Classes are likewise tracked by
+// their index.
 class CrossDexRefMinimizer {
+  using RefId = uint32_t;
+  using ClassIndex = PrioritizedDexClasses::Value;
+  static constexpr RefId NO_REF_ID = std::numeric_limits<RefId>::max();
+
   PrioritizedDexClasses m_prioritized_classes;
-  std::unordered_set<void*> m_applied_refs;
+  // Indexed by ref id.
+  std::vector<bool> m_applied_refs;
+  size_t m_num_applied_refs{0};
+  struct ClassRef {
+    RefId ref;
+    uint32_t weight;
+    // The position of the class in m_ref_classes[ref].
+    uint32_t position;
+  };
+  struct RefClass {
+    ClassIndex index;
+    // The position of the ref in the refs of the class.
+    uint32_t slot;
+  };
   struct ClassInfo {
+    DexClass* cls;
     uint32_t index;
     // This array stores (the weights of) how many of the *refs of this class
     // have only one, two, ... classes left that reference them.
     std::array<uint32_t, INFREQUENT_REFS_COUNT> infrequent_refs_weight;
-    std::vector<std::pair<void*, uint32_t>> refs;
+    std::vector<ClassRef> refs;
     uint64_t refs_weight;
     uint64_t applied_refs_weight;
     uint64_t seed_weight{0};
-    ClassInfo(uint32_t i)
-        : index(i),
+    ClassInfo(DexClass* c, uint32_t i)
+        : cls(c),
+          index(i),
           infrequent_refs_weight(),
           refs_weight(0),
           applied_refs_weight(0) {}
     uint64_t get_primary_priority_denominator() const;
     uint64_t get_priority() const;
   };
-  std::unordered_map<DexClass*, ClassInfo> m_class_infos;
-  uint32_t m_next_index{0};
-  std::unordered_map<void*, std::unordered_set<DexClass*>> m_ref_classes;
+  // Indexed by class index. The infos of erased classes stay behind with a
+  // null cls.
+  std::vector<ClassInfo> m_class_infos;
+  std::unordered_map<DexClass*, ClassIndex> m_class_indices;
+  // For each ref id, the remaining classes that have that ref, in no
+  // particular order. Together with ClassRef::position, this allows removing
+  // a class in constant time.
+  std::vector<std::vector<RefClass>> m_ref_classes;
   CrossDexRefMinimizerStats m_stats;
   const CrossDexRefMinimizerConfig m_config;
 
   struct ClassInfoDelta {
     std::array<int32_t, INFREQUENT_REFS_COUNT> infrequent_refs_weight{};
     int64_t applied_refs_weight{0};
+    bool affected{false};
   };
+  // Indexed by class index; only the entries of m_affected_classes are in
+  // use between an update and the following reprioritize().
+  std::vector<ClassInfoDelta> m_deltas;
+  std::vector<ClassIndex> m_affected_classes;
 
-  void reprioritize(
-      const std::unordered_map<DexClass*, ClassInfoDelta>& affected_classes);
+  ClassInfoDelta& delta(ClassIndex index);
+  void reprioritize();
   DexClass* worst(bool generated);
 
-  std::unordered_map<void*, size_t> m_ref_counts;
+  // Indexed by ref id.
+  std::vector<size_t> m_ref_counts;
   size_t m_max_ref_count{0};
+  IdVector<DexMethodRef, RefId> m_method_ref_ids{NO_REF_ID};
+  IdVector<DexFieldRef, RefId> m_field_ref_ids{NO_REF_ID};
+  IdVector<DexType, RefId> m_type_ref_ids{NO_REF_ID};
+  IdVector<DexString, RefId> m_string_ref_ids{NO_REF_ID};
+
+  RefId get_ref_id(const DexMethodRef* ref) const;
+  RefId get_ref_id(const DexFieldRef* ref) const;
+  RefId get_ref_id(const DexType* ref) const;
+  RefId get_ref_id(const DexString* ref) const;
+  template <typename T>
+  RefId make_ref_id(IdVector<T, RefId>& ids, const T* ref);
 
-  void gather_refs(DexClass* cls,
-                   std::vector<DexMethodRef*>& method_refs,
-                   std::vector<DexFieldRef*>& field_refs,
-                   std::vector<DexType*>& types,
-                   std::vector<DexString*>& strings);
+  struct ClassRefs {
+    std::vector<DexMethodRef*> method_refs;
+    std::vector<DexFieldRef*> field_refs;
+    std::vector<DexType*> types;
+    std::vector<DexString*> strings;
+  };
+  static ClassRefs gather_refs(DexClass* cls);
+  void sample(const ClassRefs& class_refs);
+  void insert(DexClass* cls, const ClassRefs& class_refs);
 
  public:
   CrossDexRefMinimizer(const CrossDexRefMinimizerConfig& config)
@@ -129,7 +182,11 @@ class CrossDexRefMinimizer {
   // Ignore a class reference when computing weights
   void ignore(DexClass* cls);
   void insert(DexClass* cls);
+  // Same as sampling all classes, and then inserting them in order, but
+  // the refs of the classes are gathered in parallel, and only once.
+  void insert(const std::vector<DexClass*>& classes);
   bool empty() const;
+  bool contains(DexClass* cls) const { return m_class_indices.count(cls); }
   DexClass* front() const;
   // "Worst" in the sense of having highest seed weight.
   DexClass* worst();
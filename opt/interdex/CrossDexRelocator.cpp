@@ -9,6 +9,7 @@
 #include <numeric>
 
 #include "ApiLevelChecker.h"
+#include "ConcurrentContainers.h"
 #include "Creators.h"
 #include "CrossDexRelocator.h"
 #include "DexUtil.h"
@@ -182,6 +183,88 @@ void CrossDexRelocator::relocate_methods(
   }
 }
 
+void CrossDexRelocator::compute_dominant_callers(const Scope& scope) {
+  std::unordered_map<DexMethod*, DexClass*> relocated_classes;
+  for (const auto& p : m_relocated_method_infos) {
+    relocated_classes.emplace(p.second.method, p.first);
+  }
+
+  // The weight of the calls from each class to each relocated method.
+  ConcurrentMap<DexClass*, std::unordered_map<DexClass*, uint64_t>>
+      caller_weights;
+  walk::parallel::code(scope, [&](DexMethod* caller, IRCode& code) {
+    auto caller_cls = type_class(caller->get_class());
+    if (caller_cls == nullptr) {
+      return;
+    }
+    uint64_t weight = 1;
+    if (m_config.method_to_weight != nullptr) {
+      weight += get_method_weight_if_available(caller,
+                                               m_config.method_to_weight);
+    }
+    std::unordered_map<DexClass*, uint64_t> weights;
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (!is_invoke(insn->opcode()) || !insn->get_method()->is_def()) {
+        continue;
+      }
+      auto it = relocated_classes.find(
+          static_cast<DexMethod*>(insn->get_method()));
+      if (it != relocated_classes.end()) {
+        weights[it->second] += weight;
+      }
+    }
+    for (const auto& p : weights) {
+      caller_weights.update(
+          p.first,
+          [&](DexClass*,
+              std::unordered_map<DexClass*, uint64_t>& class_weights,
+              bool /* exists */) { class_weights[caller_cls] += p.second; });
+    }
+  });
+
+  for (const auto& p : caller_weights) {
+    DexClass* dominant_caller = nullptr;
+    uint64_t dominant_weight = 0;
+    uint64_t total_weight = 0;
+    for (const auto& q : p.second) {
+      total_weight += q.second;
+      if (q.second > dominant_weight ||
+          (q.second == dominant_weight &&
+           compare_dexclasses(q.first, dominant_caller))) {
+        dominant_caller = q.first;
+        dominant_weight = q.second;
+      }
+    }
+    if (dominant_caller == p.first ||
+        dominant_weight * 100 <
+            m_config.dominant_caller_percent * total_weight) {
+      continue;
+    }
+    TRACE(IDEX, 4, "[dex ordering] %s dominates the calls to %s (%lu/%lu)",
+          SHOW(dominant_caller),
+          SHOW(m_relocated_method_infos.at(p.first).method), dominant_weight,
+          total_weight);
+    m_dominant_callers.emplace(p.first, dominant_caller);
+    m_dominated_classes[dominant_caller].push_back(p.first);
+  }
+  for (auto& p : m_dominated_classes) {
+    std::sort(p.second.begin(), p.second.end(), compare_dexclasses);
+  }
+  m_stats.relocated_methods_with_dominant_caller = m_dominant_callers.size();
+}
+
+void CrossDexRelocator::take_dominated_classes(
+    DexClass* cls, std::vector<DexClass*>* dominated_classes) {
+  auto it = m_dominated_classes.find(cls);
+  if (it == m_dominated_classes.end()) {
+    return;
+  }
+  dominated_classes->insert(dominated_classes->end(), it->second.begin(),
+                            it->second.end());
+  m_dominated_classes.erase(it);
+}
+
 void CrossDexRelocator::current_dex_overflowed() {
   m_classes_in_current_dex.clear();
   m_relocated_target_classes.clear();
@@ -262,6 +345,11 @@ void CrossDexRelocator::add_to_current_dex(DexClass* cls) {
 
   DexMethod* method = info.method;
   always_assert(method->get_class() == cls->get_type());
+  auto dominant_caller_it = m_dominant_callers.find(cls);
+  if (dominant_caller_it != m_dominant_callers.end() &&
+      m_classes_in_current_dex.count(dominant_caller_it->second)) {
+    ++m_stats.relocated_methods_placed_with_dominant_caller;
+  }
   if (m_classes_in_current_dex.count(info.source_class)) {
     // The source class of the relocated method already has been added to the
     // current dedx. We are going to move the relocated method back to
@@ -25,6 +25,8 @@ struct CrossDexRelocatorStats {
   uint64_t relocated_static_methods{0};
   uint64_t relocated_non_static_direct_methods{0};
   uint64_t relocated_virtual_methods{0};
+  uint64_t relocated_methods_with_dominant_caller{0};
+  uint64_t relocated_methods_placed_with_dominant_caller{0};
 };
 
 struct CrossDexRelocatorConfig {
@@ -32,6 +34,13 @@ struct CrossDexRelocatorConfig {
   bool relocate_non_static_direct_methods{false};
   bool relocate_virtual_methods{false};
   uint64_t max_relocated_methods_per_class{200};
+  // Whether to emit relocated methods right after the class that makes most
+  // of the calls to them, if it makes at least the given percentage. Calls
+  // weigh one, plus the profiled weight of the caller, if given.
+  bool relocate_to_dominant_caller{false};
+  uint64_t dominant_caller_percent{50};
+  const std::unordered_map<std::string, unsigned int>* method_to_weight{
+      nullptr};
 };
 
 class CrossDexRelocator {
@@ -47,6 +56,15 @@ class CrossDexRelocator {
   void relocate_methods(DexClass* cls,
                         std::vector<DexClass*>& relocated_classes);
 
+  // Find the dominant callers of the relocated methods, once all of them have
+  // been relocated.
+  void compute_dominant_callers(const Scope& scope);
+
+  // Appends the classes of the relocated methods whose dominant caller is the
+  // given class, so that they can be emitted into the same dex.
+  void take_dominated_classes(DexClass* cls,
+                              std::vector<DexClass*>* dominated_classes);
+
   // Indicate that a given class was just emitted into the current dex.
   void add_to_current_dex(DexClass* cls);
 
@@ -101,6 +119,8 @@ class CrossDexRelocator {
       m_source_class_to_relocated_method_infos_map;
   std::unordered_set<DexClass*> m_classes_in_current_dex;
   std::unordered_set<DexMethod*> m_relocated_non_static_methods;
+  std::unordered_map<DexClass*, DexClass*> m_dominant_callers;
+  std::unordered_map<DexClass*, std::vector<DexClass*>> m_dominated_classes;
   size_t m_next_method_id{0};
   CrossDexRelocatorStats m_stats;
   const CrossDexRelocatorConfig m_config;
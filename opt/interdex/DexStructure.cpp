@@ -7,6 +7,7 @@
 
 #include "DexStructure.h"
 
+#include <algorithm>
 #include <boost/algorithm/string/predicate.hpp>
 #include <vector>
 
@@ -36,6 +37,7 @@ constexpr unsigned METHOD_SIZE = 52;
 constexpr unsigned INSTANCE_FIELD_SIZE = 16;
 constexpr unsigned MAX_METHOD_REFS = (1 << 16) - 1;
 constexpr unsigned MAX_FIELD_REFS = (1 << 16) - 1;
+constexpr size_t MAX_TOP_PACKAGES = 3;
 
 bool matches_penalty(const char* str, unsigned* penalty) {
   for (auto const& pattern : PENALTY_PATTERNS) {
@@ -48,8 +50,37 @@ bool matches_penalty(const char* str, unsigned* penalty) {
 }
 
 /**
- * Estimates the linear alloc space consumed by the class at runtime.
+ * The package of the class in its original, deobfuscated form if known, e.g.
+ * "Lcom/facebook/".
  */
+std::string get_package_name(const DexClass* clazz) {
+  const auto& deobfuscated_name = clazz->get_deobfuscated_name();
+  const std::string& name = deobfuscated_name.empty()
+                                ? clazz->get_type()->get_name()->str()
+                                : deobfuscated_name;
+  auto pos = name.rfind('/');
+  return pos == std::string::npos ? "L" : name.substr(0, pos + 1);
+}
+
+/**
+ * The number of refs the dex will have once the class is added, or an upper
+ * bound of it if that is already below the limit.
+ */
+template <typename Ref>
+size_t refs_after_adding(const interdex::DexRefs<Ref>& dex_refs,
+                         const std::unordered_set<Ref*>& clazz_refs,
+                         size_t limit) {
+  size_t upper_bound = dex_refs.size() + clazz_refs.size();
+  if (upper_bound < limit) {
+    return upper_bound;
+  }
+  return dex_refs.size() + dex_refs.count_new(clazz_refs);
+}
+
+} // namespace
+
+namespace interdex {
+
 unsigned estimate_linear_alloc(const DexClass* clazz) {
   unsigned lasize = 0;
   // VTable guesstimate. Technically we could do better here, but only so much.
@@ -75,26 +106,6 @@ unsigned estimate_linear_alloc(const DexClass* clazz) {
   return lasize;
 }
 
-/**
- * Removes the elements of b from a. Runs in O(size(a)), so it works best if
- * size(a) << size(b).
- */
-template <typename T>
-std::unordered_set<T> set_difference(const std::unordered_set<T>& a,
-                                     const std::unordered_set<T>& b) {
-  std::unordered_set<T> result;
-  for (auto& v : a) {
-    if (!b.count(v)) {
-      result.emplace(v);
-    }
-  }
-  return result;
-}
-
-} // namespace
-
-namespace interdex {
-
 bool DexesStructure::add_class_to_current_dex(const MethodRefs& clazz_mrefs,
                                               const FieldRefs& clazz_frefs,
                                               const TypeRefs& clazz_trefs,
@@ -102,9 +113,11 @@ bool DexesStructure::add_class_to_current_dex(const MethodRefs& clazz_mrefs,
   always_assert_log(m_classes.count(clazz) == 0,
                     "Can't emit the same class twice!\n", SHOW(clazz));
 
+  auto before = m_current_dex.get_usage();
   if (m_current_dex.add_class_if_fits(
           clazz_mrefs, clazz_frefs, clazz_trefs, m_linear_alloc_limit,
           MAX_METHOD_REFS - m_reserve_mrefs, m_type_refs_limit, clazz)) {
+    charge_package(clazz, before);
     update_stats(clazz_mrefs, clazz_frefs, clazz);
     m_classes.emplace(clazz);
     return true;
@@ -121,8 +134,10 @@ void DexesStructure::add_class_no_checks(const MethodRefs& clazz_mrefs,
                     "Can't emit the same class twice: %s!\n", SHOW(clazz));
 
   auto laclazz = estimate_linear_alloc(clazz);
+  auto before = m_current_dex.get_usage();
   m_current_dex.add_class_no_checks(clazz_mrefs, clazz_frefs, clazz_trefs,
                                     laclazz, clazz);
+  charge_package(clazz, before);
   m_classes.emplace(clazz);
   update_stats(clazz_mrefs, clazz_frefs, clazz);
 }
@@ -152,12 +167,47 @@ DexClasses DexesStructure::end_dex(DexInfo dex_info) {
 
   m_current_dex.check_refs_count();
 
+  DexBudget budget;
+  budget.num_classes = m_current_dex.get_all_classes().size();
+  budget.used = m_current_dex.get_usage();
+  budget.limits = {{static_cast<size_t>(m_linear_alloc_limit),
+                    MAX_METHOD_REFS - m_reserve_mrefs, MAX_FIELD_REFS,
+                    static_cast<size_t>(m_type_refs_limit)}};
+  for (size_t kind = 0; kind < NUM_DEX_BUDGET_KINDS; ++kind) {
+    auto& top = budget.top_packages[kind];
+    for (const auto& p : m_current_dex_packages) {
+      if (p.second[kind] > 0) {
+        top.emplace_back(p.first, p.second[kind]);
+      }
+    }
+    std::sort(top.begin(), top.end(),
+              [](const std::pair<std::string, size_t>& a,
+                 const std::pair<std::string, size_t>& b) {
+                return a.second != b.second ? a.second > b.second
+                                            : a.first < b.first;
+              });
+    if (top.size() > MAX_TOP_PACKAGES) {
+      top.resize(MAX_TOP_PACKAGES);
+    }
+  }
+  m_dex_budgets.push_back(std::move(budget));
+  m_current_dex_packages.clear();
+
   DexClasses all_classes = m_current_dex.take_all_classes();
 
   m_current_dex = DexStructure();
   return all_classes;
 }
 
+void DexesStructure::charge_package(const DexClass* clazz,
+                                    const DexBudgetUsage& before) {
+  auto after = m_current_dex.get_usage();
+  auto& usage = m_current_dex_packages[get_package_name(clazz)];
+  for (size_t kind = 0; kind < NUM_DEX_BUDGET_KINDS; ++kind) {
+    usage[kind] += after[kind] - before[kind];
+  }
+}
+
 void DexesStructure::update_stats(const MethodRefs& clazz_mrefs,
                                   const FieldRefs& clazz_frefs,
                                   DexClass* clazz) {
@@ -189,31 +239,30 @@ bool DexStructure::add_class_if_fits(const MethodRefs& clazz_mrefs,
     return false;
   }
 
-  auto extra_mrefs = set_difference(clazz_mrefs, m_mrefs);
-  auto extra_frefs = set_difference(clazz_frefs, m_frefs);
-  auto extra_trefs = set_difference(clazz_trefs, m_trefs);
-
-  if (m_mrefs.size() + extra_mrefs.size() >= method_refs_limit) {
+  auto mrefs = refs_after_adding(m_mrefs, clazz_mrefs, method_refs_limit);
+  if (mrefs >= method_refs_limit) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
           "over the method refs limit: %d >= %d: %s",
-          m_mrefs.size() + extra_mrefs.size(), method_refs_limit, SHOW(clazz));
+          mrefs, method_refs_limit, SHOW(clazz));
     return false;
   }
 
-  if (m_frefs.size() + extra_frefs.size() >= MAX_FIELD_REFS) {
+  auto frefs = refs_after_adding(m_frefs, clazz_frefs, MAX_FIELD_REFS);
+  if (frefs >= MAX_FIELD_REFS) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
           "over the field refs limit: %d >= %d: %s",
-          m_frefs.size() + extra_frefs.size(), MAX_FIELD_REFS, SHOW(clazz));
+          frefs, MAX_FIELD_REFS, SHOW(clazz));
     return false;
   }
 
-  if (m_trefs.size() + extra_trefs.size() >= type_refs_limit) {
+  auto trefs = refs_after_adding(m_trefs, clazz_trefs, type_refs_limit);
+  if (trefs >= type_refs_limit) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
           "over the type refs limit: %d >= %d: %s",
-          m_trefs.size() + extra_trefs.size(), type_refs_limit, SHOW(clazz));
+          trefs, type_refs_limit, SHOW(clazz));
     return false;
   }
 
@@ -227,9 +276,9 @@ void DexStructure::add_class_no_checks(const MethodRefs& clazz_mrefs,
                                        unsigned laclazz,
                                        DexClass* clazz) {
   TRACE(IDEX, 7, "Adding class: %s", SHOW(clazz));
-  m_mrefs.insert(clazz_mrefs.begin(), clazz_mrefs.end());
-  m_frefs.insert(clazz_frefs.begin(), clazz_frefs.end());
-  m_trefs.insert(clazz_trefs.begin(), clazz_trefs.end());
+  m_mrefs.insert(clazz_mrefs);
+  m_frefs.insert(clazz_frefs);
+  m_trefs.insert(clazz_trefs);
   m_linear_alloc_size += laclazz;
   m_classes.push_back(clazz);
 }
@@ -246,7 +295,7 @@ void DexStructure::check_refs_count() {
   std::unordered_set<DexMethodRef*> mrefs_set(mrefs.begin(), mrefs.end());
   if (mrefs_set.size() > m_mrefs.size()) {
     for (DexMethodRef* mr : mrefs_set) {
-      if (!m_mrefs.count(mr)) {
+      if (!m_mrefs.contains(mr)) {
         TRACE(IDEX, 4, "WARNING: Could not find %s in predicted mrefs set",
               SHOW(mr));
       }
@@ -260,7 +309,7 @@ void DexStructure::check_refs_count() {
   std::unordered_set<DexFieldRef*> frefs_set(frefs.begin(), frefs.end());
   if (frefs_set.size() > m_frefs.size()) {
     for (auto* fr : frefs_set) {
-      if (!m_frefs.count(fr)) {
+      if (!m_frefs.contains(fr)) {
         TRACE(IDEX, 4, "WARNING: Could not find %s in predicted frefs set",
               SHOW(fr));
       }
@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include <array>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include "DexClass.h"
+#include "DexIdContainers.h"
 #include "Pass.h"
 #include "Util.h"
 
@@ -20,6 +24,54 @@ using MethodRefs = std::unordered_set<DexMethodRef*>;
 using FieldRefs = std::unordered_set<DexFieldRef*>;
 using TypeRefs = std::unordered_set<DexType*>;
 
+/**
+ * Estimates the linear alloc space consumed by the class at runtime.
+ */
+unsigned estimate_linear_alloc(const DexClass* clazz);
+
+/*
+ * The refs of one kind in a dex: a bitset over their dense ids, plus the
+ * running count, so that checking how many new refs a class would bring in
+ * is a lookup per ref of the class, without set unions or allocations.
+ */
+template <typename Ref>
+class DexRefs {
+ public:
+  size_t size() const { return m_size; }
+
+  bool contains(const Ref* ref) const { return m_refs.contains(ref); }
+
+  // The number of the given refs that are not in the dex yet.
+  size_t count_new(const std::unordered_set<Ref*>& refs) const {
+    size_t count = 0;
+    for (auto* ref : refs) {
+      if (!m_refs.contains(ref)) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  void insert(const std::unordered_set<Ref*>& refs) {
+    for (auto* ref : refs) {
+      if (m_refs.insert(ref)) {
+        ++m_size;
+      }
+    }
+  }
+
+  void erase(const Ref* ref) {
+    if (m_refs.contains(ref)) {
+      m_refs.erase(ref);
+      --m_size;
+    }
+  }
+
+ private:
+  IdBitset<Ref> m_refs;
+  size_t m_size{0};
+};
+
 struct DexInfo {
   bool primary{false};
   bool mixed_mode{false};
@@ -28,6 +80,32 @@ struct DexInfo {
   bool scroll{false};
 };
 
+// The limits a dex has to stay within.
+enum DexBudgetKind {
+  LINEAR_ALLOC,
+  METHOD_REFS,
+  FIELD_REFS,
+  TYPE_REFS,
+  NUM_DEX_BUDGET_KINDS,
+};
+
+using DexBudgetUsage = std::array<size_t, NUM_DEX_BUDGET_KINDS>;
+
+/*
+ * How much of its limits an emitted dex used up, and which packages used up
+ * the most of it. A package is charged for the refs that its classes were
+ * the first in the dex to bring in.
+ */
+struct DexBudget {
+  size_t num_classes{0};
+  DexBudgetUsage used{};
+  DexBudgetUsage limits{};
+  // For each kind, the biggest consumers, biggest first.
+  std::array<std::vector<std::pair<std::string, size_t>>,
+             NUM_DEX_BUDGET_KINDS>
+      top_packages;
+};
+
 class DexStructure {
  public:
   DexStructure() : m_linear_alloc_size(0) {}
@@ -44,8 +122,22 @@ class DexStructure {
    */
   DexClasses take_all_classes() { return std::move(m_classes); }
 
+  size_t get_num_mrefs() const { return m_mrefs.size(); }
+
+  size_t get_num_frefs() const { return m_frefs.size(); }
+
+  size_t get_num_trefs() const { return m_trefs.size(); }
+
+  DexBudgetUsage get_usage() const {
+    return {{m_linear_alloc_size, m_mrefs.size(), m_frefs.size(),
+             m_trefs.size()}};
+  }
+
   /**
    * Tries to add the specified class. Returns false if it doesn't fit.
+   * When the current counts plus all the refs of the class stay below the
+   * limits, the class fits whichever of its refs are new, and the refs aren't
+   * looked up one by one.
    */
   bool add_class_if_fits(const MethodRefs& clazz_mrefs,
                          const FieldRefs& clazz_frefs,
@@ -67,9 +159,9 @@ class DexStructure {
 
  private:
   size_t m_linear_alloc_size;
-  TypeRefs m_trefs;
-  MethodRefs m_mrefs;
-  FieldRefs m_frefs;
+  DexRefs<DexType> m_trefs;
+  DexRefs<DexMethodRef> m_mrefs;
+  DexRefs<DexFieldRef> m_frefs;
   std::vector<DexClass*> m_classes;
   std::vector<DexClass*> m_squashed_classes;
 };
@@ -152,7 +244,14 @@ class DexesStructure {
 
   bool has_class(DexClass* clazz) const { return m_classes.count(clazz); }
 
+  // The budgets of the dexes emitted so far, in order.
+  const std::vector<DexBudget>& get_dex_budgets() const {
+    return m_dex_budgets;
+  }
+
  private:
+  void charge_package(const DexClass* clazz, const DexBudgetUsage& before);
+
   void update_stats(const MethodRefs& clazz_mrefs,
                     const FieldRefs& clazz_frefs,
                     DexClass* clazz);
@@ -163,6 +262,10 @@ class DexesStructure {
   // All the classes that end up added in the dexes.
   std::unordered_set<DexClass*> m_classes;
 
+  // What the packages of the classes in the current dex used up.
+  std::unordered_map<std::string, DexBudgetUsage> m_current_dex_packages;
+  std::vector<DexBudget> m_dex_budgets;
+
   int64_t m_linear_alloc_limit;
   int64_t m_type_refs_limit;
   size_t m_reserve_mrefs;
@@ -178,6 +178,14 @@ void print_stats(interdex::DexesStructure* dexes_structure) {
 namespace interdex {
 
 bool InterDex::should_skip_class_due_to_plugin(DexClass* clazz) {
+  if (m_precomputed_classes.count(clazz)) {
+    if (m_skipped_classes.count(clazz)) {
+      TRACE(IDEX, 4, "IDEX: Skipping class :: %s", SHOW(clazz));
+      return true;
+    }
+    return false;
+  }
+
   for (const auto& plugin : m_plugins) {
     if (plugin->should_skip_class(clazz)) {
       TRACE(IDEX, 4, "IDEX: Skipping class :: %s", SHOW(clazz));
@@ -205,6 +213,15 @@ void InterDex::add_to_scope(DexClass* cls) {
 }
 
 bool InterDex::should_not_relocate_methods_of_class(const DexClass* clazz) {
+  if (m_precomputed_classes.count(clazz)) {
+    if (m_not_relocated_classes.count(clazz)) {
+      TRACE(IDEX, 4, "IDEX: Not relocating methods of class :: %s",
+            SHOW(clazz));
+      return true;
+    }
+    return false;
+  }
+
   for (const auto& plugin : m_plugins) {
     if (plugin->should_not_relocate_methods_of_class(clazz)) {
       TRACE(IDEX, 4, "IDEX: Not relocating methods of class :: %s",
@@ -216,6 +233,27 @@ bool InterDex::should_not_relocate_methods_of_class(const DexClass* clazz) {
   return false;
 }
 
+/*
+ * The plugins answer the per-class queries for the whole scope in one go, in
+ * parallel if they can, rather than one class at a time as the classes get
+ * packed. Classes that only appear later, e.g. the relocated or generated
+ * ones, are still asked about one at a time.
+ */
+void InterDex::precompute_plugin_queries(const Scope& scope) {
+  m_precomputed_classes.insert(scope.begin(), scope.end());
+  for (const auto& plugin : m_plugins) {
+    auto skipped = plugin->should_skip_classes(scope);
+    m_skipped_classes.insert(skipped.begin(), skipped.end());
+    auto not_relocated = plugin->should_not_relocate_methods_of_classes(scope);
+    m_not_relocated_classes.insert(not_relocated.begin(),
+                                   not_relocated.end());
+  }
+  TRACE(IDEX, 2,
+        "[plugins] %zu of %zu classes skipped, %zu with methods not relocated",
+        m_skipped_classes.size(), m_precomputed_classes.size(),
+        m_not_relocated_classes.size());
+}
+
 bool InterDex::emit_class(const DexInfo& dex_info,
                           DexClass* clazz,
                           bool check_if_skip,
@@ -663,6 +701,7 @@ void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
   }
 
   std::vector<DexClass*> classes_to_insert;
+  std::vector<DexClass*> all_relocated_classes;
   // Emit classes using some algorithm to group together classes which
   // tend to share the same refs.
   for (DexClass* cls : scope) {
@@ -688,6 +727,7 @@ void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
 
         m_cross_dex_ref_minimizer.ignore(relocated_cls);
         classes_to_insert.emplace_back(relocated_cls);
+        all_relocated_classes.emplace_back(relocated_cls);
       }
     }
 
@@ -708,16 +748,20 @@ void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
     classes_to_insert.emplace_back(cls);
   }
 
-  // Initialize ref frequency counts
-  for (DexClass* cls : classes_to_insert) {
-    m_cross_dex_ref_minimizer.sample(cls);
+  if (m_cross_dex_relocator != nullptr &&
+      m_cross_dex_relocator_config.relocate_to_dominant_caller) {
+    // The relocated methods now live in the relocated classes; so do the
+    // calls they make.
+    Scope callers_scope(scope);
+    callers_scope.insert(callers_scope.end(), all_relocated_classes.begin(),
+                         all_relocated_classes.end());
+    m_cross_dex_relocator->compute_dominant_callers(callers_scope);
   }
 
-  // Emit classes using some algorithm to group together classes which
+  // Initialize ref frequency counts, and then insert the classes, so that we
+  // can emit them using some algorithm to group together classes which
   // tend to share the same refs.
-  for (DexClass* cls : classes_to_insert) {
-    m_cross_dex_ref_minimizer.insert(cls);
-  }
+  m_cross_dex_ref_minimizer.insert(classes_to_insert);
 }
 
 void InterDex::emit_remaining_classes(const Scope& scope) {
@@ -738,10 +782,23 @@ void InterDex::emit_remaining_classes(const Scope& scope) {
   // - otherwise, pick the "best" class according to the priority scheme that
   //   prefers classes that share many applied refs and bring in few unapplied
   //   refs
+  // - relocated methods whose dominant caller was just emitted go next, so
+  //   that they end up in the dex of their caller
   bool pick_worst = true;
+  std::vector<DexClass*> dominated_classes;
   while (!m_cross_dex_ref_minimizer.empty()) {
-    DexClass* cls = pick_worst ? m_cross_dex_ref_minimizer.worst()
-                               : m_cross_dex_ref_minimizer.front();
+    DexClass* cls = nullptr;
+    while (cls == nullptr && !dominated_classes.empty()) {
+      cls = dominated_classes.back();
+      dominated_classes.pop_back();
+      if (!m_cross_dex_ref_minimizer.contains(cls)) {
+        cls = nullptr;
+      }
+    }
+    if (cls == nullptr) {
+      cls = pick_worst ? m_cross_dex_ref_minimizer.worst()
+                       : m_cross_dex_ref_minimizer.front();
+    }
     std::vector<DexClass*> erased_classes;
     bool emitted = emit_class(EMPTY_DEX_INFO, cls, /* check_if_skip */ false,
                               /* perf_sensitive */ false, &erased_classes);
@@ -755,6 +812,9 @@ void InterDex::emit_remaining_classes(const Scope& scope) {
         m_cross_dex_relocator->current_dex_overflowed();
       }
       m_cross_dex_relocator->add_to_current_dex(cls);
+      if (emitted) {
+        m_cross_dex_relocator->take_dominated_classes(cls, &dominated_classes);
+      }
     }
 
     // We can treat *refs owned by "erased classes" as effectively being emitted
@@ -780,6 +840,7 @@ void InterDex::cleanup(const Scope& final_scope) {
 
 void InterDex::run() {
   auto scope = build_class_scope(m_dexen);
+  precompute_plugin_queries(scope);
 
   std::vector<DexType*> interdex_types = get_interdex_types(scope);
 
@@ -77,6 +77,10 @@ class InterDex {
     return m_dexes_structure.get_num_scroll_dexes();
   }
 
+  const std::vector<DexBudget>& get_dex_budgets() const {
+    return m_dexes_structure.get_dex_budgets();
+  }
+
   const CrossDexRefMinimizerStats& get_cross_dex_ref_minimizer_stats() const {
     return m_cross_dex_ref_minimizer.stats();
   }
@@ -101,6 +105,7 @@ class InterDex {
 
  private:
   bool should_not_relocate_methods_of_class(const DexClass* clazz);
+  void precompute_plugin_queries(const Scope& scope);
   void add_to_scope(DexClass* cls);
   bool should_skip_class_due_to_plugin(DexClass* clazz);
   bool should_skip_class_due_to_mixed_mode(const DexInfo& dex_info,
@@ -155,6 +160,12 @@ class InterDex {
   std::vector<DexType*> m_end_markers;
   std::vector<DexType*> m_scroll_markers;
 
+  // What the plugins answered about the classes of the scope before the
+  // packing started.
+  std::unordered_set<const DexClass*> m_precomputed_classes;
+  std::unordered_set<const DexClass*> m_skipped_classes;
+  std::unordered_set<const DexClass*> m_not_relocated_classes;
+
   CrossDexRefMinimizer m_cross_dex_ref_minimizer;
   const CrossDexRelocatorConfig m_cross_dex_relocator_config;
   const Scope& m_original_scope;
@@ -10,6 +10,7 @@
 #include "ConfigFiles.h"
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "MixedModeHeat.h"
 #include "PassManager.h"
 
 namespace {
@@ -92,6 +93,67 @@ std::unordered_set<DexClass*> get_mixed_mode_classes(
   return mixed_mode_classes;
 }
 
+const char* const DEX_BUDGET_KIND_NAMES[] = {
+    "linear_alloc",
+    "method_refs",
+    "field_refs",
+    "type_refs",
+};
+
+size_t percent_of(size_t used, size_t limit) {
+  return limit == 0 ? 0 : used * 100 / limit;
+}
+
+/**
+ * For each dex, how much of each limit it uses, and which packages use the
+ * most of it. Then, how full the dexes got before the next one was
+ * started, and how much room the last one has left before another one is
+ * needed.
+ */
+void report_dex_budgets(const std::vector<interdex::DexBudget>& budgets,
+                        PassManager& mgr) {
+  using namespace interdex;
+  size_t total_pct = 0;
+  size_t max_pct = 0;
+  for (size_t i = 0; i < budgets.size(); ++i) {
+    const auto& budget = budgets[i];
+    auto prefix = METRIC_DEX_BUDGET + std::to_string(i) + "_";
+    max_pct = 0;
+    for (size_t kind = 0; kind < NUM_DEX_BUDGET_KINDS; ++kind) {
+      auto pct = percent_of(budget.used[kind], budget.limits[kind]);
+      max_pct = std::max(max_pct, pct);
+      auto kind_prefix = prefix + DEX_BUDGET_KIND_NAMES[kind];
+      mgr.set_metric(kind_prefix + "_pct", pct);
+      const auto& top = budget.top_packages[kind];
+      for (size_t j = 0; j < top.size(); ++j) {
+        mgr.set_metric(
+            kind_prefix + "_top" + std::to_string(j) + "_" + top[j].first,
+            top[j].second);
+      }
+    }
+    mgr.set_metric(prefix + "max_pct", max_pct);
+    TRACE(IDEX, 2,
+          "[dex budget] dex %zu: %zu classes, linear alloc %zu%%, method refs "
+          "%zu%%, field refs %zu%%, type refs %zu%%",
+          i, budget.num_classes,
+          percent_of(budget.used[LINEAR_ALLOC], budget.limits[LINEAR_ALLOC]),
+          percent_of(budget.used[METHOD_REFS], budget.limits[METHOD_REFS]),
+          percent_of(budget.used[FIELD_REFS], budget.limits[FIELD_REFS]),
+          percent_of(budget.used[TYPE_REFS], budget.limits[TYPE_REFS]));
+    if (i + 1 < budgets.size()) {
+      total_pct += max_pct;
+    }
+  }
+  if (budgets.empty()) {
+    return;
+  }
+  // The last dex isn't full by construction, unless it is the only one.
+  mgr.set_metric(METRIC_PACKING_EFFICIENCY,
+                 budgets.size() == 1 ? max_pct
+                                     : total_pct / (budgets.size() - 1));
+  mgr.set_metric(METRIC_LAST_DEX_HEADROOM, max_pct < 100 ? 100 - max_pct : 0);
+}
+
 /**
  * Generated stores need to be added to the root store.
  * We achieve this, by adding all the dexes from those stores after the root
@@ -121,6 +183,18 @@ void InterDexPass::bind_config() {
   bind("linear_alloc_limit", {11600 * 1024}, m_linear_alloc_limit);
   bind("scroll_classes_file", "", m_mixed_mode_classes_file);
 
+  // Without a list of mixed mode classes, the hottest non-startup classes of
+  // the per-class execution counts of an instrumented build are picked,
+  // within the given budgets. The linear alloc budget defaults to the limit.
+  bind("mixed_mode_heat_file", "", m_mixed_mode_heat_file);
+  bind("mixed_mode_heat_min_count", {1}, m_mixed_mode_heat_config.min_count);
+  bind("mixed_mode_heat_linear_alloc_budget", {0},
+       m_mixed_mode_heat_config.linear_alloc_budget);
+  bind("mixed_mode_heat_max_classes", {0},
+       m_mixed_mode_heat_config.max_classes);
+  bind("mixed_mode_heat_max_instructions", {0},
+       m_mixed_mode_heat_config.max_instructions);
+
   // Default to maximum number of type refs per dex, as allowed by Android.
   // Notes: This flag was added to work around a bug in AOSP described in
   //        https://phabricator.internmc.facebook.com/P60294798 and for this
@@ -157,6 +231,16 @@ void InterDexPass::bind_config() {
   bind("max_relocated_methods_per_class", {200},
        m_cross_dex_relocator_config.max_relocated_methods_per_class);
 
+  // Relocated methods can follow the class that calls them the most into its
+  // dex, so that hot calls don't cross dexes. With a method profile, calls
+  // from hot methods weigh more.
+  bind("minimize_cross_dex_refs_relocate_to_dominant_caller", false,
+       m_cross_dex_relocator_config.relocate_to_dominant_caller);
+  bind("minimize_cross_dex_refs_dominant_caller_percent", {50},
+       m_cross_dex_relocator_config.dominant_caller_percent);
+  bind("minimize_cross_dex_refs_use_method_to_weight", false,
+       m_use_method_to_weight);
+
   bind("can_touch_coldstart_cls", false, m_can_touch_coldstart_cls);
   bind("can_touch_coldstart_extended_cls", false,
        m_can_touch_coldstart_extended_cls);
@@ -171,9 +255,27 @@ void InterDexPass::bind_config() {
         "coldstart classes. Please set can_touch_coldstart_extended_cls "
         "to true\n");
     m_mixed_mode_dex_statuses = get_mixed_mode_dex_statuses(mixed_mode_dexes);
+    if (m_mixed_mode_heat_config.linear_alloc_budget == 0) {
+      m_mixed_mode_heat_config.linear_alloc_budget = m_linear_alloc_limit;
+    }
   });
 }
 
+std::unordered_set<DexClass*> InterDexPass::get_hot_mixed_mode_classes(
+    const Scope& scope, ConfigFiles& conf) {
+  auto heat = read_class_heat(m_mixed_mode_heat_file, scope);
+  std::unordered_set<const DexClass*> startup_classes;
+  for (const auto& name : conf.get_coldstart_classes()) {
+    auto type = DexType::get_type(name.c_str());
+    auto cls = type != nullptr ? type_class(type) : nullptr;
+    if (cls != nullptr) {
+      startup_classes.emplace(cls);
+    }
+  }
+  return select_mixed_mode_classes(heat, startup_classes,
+                                   m_mixed_mode_heat_config);
+}
+
 void InterDexPass::run_pass(DexStoresVector& stores,
                             DexClassesVector& dexen,
                             ConfigFiles& conf,
@@ -190,6 +292,11 @@ void InterDexPass::run_pass(DexStoresVector& stores,
     reserve_mrefs += plugin->reserve_mrefs();
   }
 
+  if (m_use_method_to_weight) {
+    m_cross_dex_relocator_config.method_to_weight =
+        &conf.get_method_to_weight();
+  }
+
   InterDex interdex(original_scope, dexen, mgr.apk_manager(), conf, plugins,
                     m_linear_alloc_limit, m_type_refs_limit, m_static_prune,
                     m_normal_primary_dex, m_emit_scroll_set_marker,
@@ -204,7 +311,9 @@ void InterDexPass::run_pass(DexStoresVector& stores,
     interdex.set_mixed_mode_dex_statuses(std::move(m_mixed_mode_dex_statuses));
   } else {
     auto mixed_mode_classes =
-        get_mixed_mode_classes(dexen, m_mixed_mode_classes_file);
+        m_mixed_mode_classes_file.empty() && !m_mixed_mode_heat_file.empty()
+            ? get_hot_mixed_mode_classes(original_scope, conf)
+            : get_mixed_mode_classes(dexen, m_mixed_mode_classes_file);
     if (mixed_mode_classes.size() > 0) {
       TRACE(IDEX, 3, "[mixed mode]: %d pre-computed mixed mode classes",
             mixed_mode_classes.size());
@@ -226,6 +335,7 @@ void InterDexPass::run_pass(DexStoresVector& stores,
   mgr.set_metric(METRIC_COLD_START_SET_DEX_COUNT,
                  interdex.get_num_cold_start_set_dexes());
   mgr.set_metric(METRIC_SCROLL_SET_DEX_COUNT, interdex.get_num_scroll_dexes());
+  report_dex_budgets(interdex.get_dex_budgets(), mgr);
 
   plugins.clear();
 
@@ -258,6 +368,12 @@ void InterDexPass::run_pass(DexStoresVector& stores,
                  cross_dex_relocator_stats.relocated_static_methods);
   mgr.set_metric(METRIC_RELOCATED_NON_STATIC_DIRECT_METHODS,
                  cross_dex_relocator_stats.relocated_non_static_direct_methods);
+  mgr.set_metric(
+      METRIC_RELOCATED_METHODS_WITH_DOMINANT_CALLER,
+      cross_dex_relocator_stats.relocated_methods_with_dominant_caller);
+  mgr.set_metric(
+      METRIC_RELOCATED_METHODS_PLACED_WITH_DOMINANT_CALLER,
+      cross_dex_relocator_stats.relocated_methods_placed_with_dominant_caller);
   mgr.set_metric(METRIC_RELOCATED_VIRTUAL_METHODS,
                  cross_dex_relocator_stats.relocated_virtual_methods);
 }
@@ -10,6 +10,7 @@
 #include "DexClass.h"
 #include "InterDex.h"
 #include "InterDexPassPlugin.h"
+#include "MixedModeHeat.h"
 #include "Pass.h"
 #include "PluginRegistry.h"
 
@@ -21,6 +22,10 @@ constexpr const char* METRIC_COLD_START_SET_DEX_COUNT =
     "cold_start_set_dex_count";
 constexpr const char* METRIC_SCROLL_SET_DEX_COUNT = "scroll_set_dex_count";
 
+constexpr const char* METRIC_DEX_BUDGET = "dex_budget_";
+constexpr const char* METRIC_PACKING_EFFICIENCY = "dex_packing_efficiency_pct";
+constexpr const char* METRIC_LAST_DEX_HEADROOM = "last_dex_headroom_pct";
+
 constexpr const char* METRIC_REORDER_CLASSES = "num_reorder_classes";
 constexpr const char* METRIC_REORDER_RESETS = "num_reorder_resets";
 constexpr const char* METRIC_REORDER_REPRIORITIZATIONS =
@@ -41,6 +46,10 @@ constexpr const char* METRIC_RELOCATED_NON_STATIC_DIRECT_METHODS =
     "num_relocated_non_static_direct_methods";
 constexpr const char* METRIC_RELOCATED_VIRTUAL_METHODS =
     "num_relocated_virtual_methods";
+constexpr const char* METRIC_RELOCATED_METHODS_WITH_DOMINANT_CALLER =
+    "num_relocated_methods_with_dominant_caller";
+constexpr const char* METRIC_RELOCATED_METHODS_PLACED_WITH_DOMINANT_CALLER =
+    "num_relocated_methods_placed_with_dominant_caller";
 
 class InterDexPass : public Pass {
  public:
@@ -61,6 +70,8 @@ class InterDexPass : public Pass {
   int64_t m_linear_alloc_limit;
   int64_t m_type_refs_limit;
   std::string m_mixed_mode_classes_file;
+  std::string m_mixed_mode_heat_file;
+  MixedModeHeatConfig m_mixed_mode_heat_config;
   bool m_can_touch_coldstart_cls;
   bool m_can_touch_coldstart_extended_cls;
   std::unordered_set<DexStatus, std::hash<int>> m_mixed_mode_dex_statuses;
@@ -68,6 +79,10 @@ class InterDexPass : public Pass {
   bool m_minimize_cross_dex_refs;
   CrossDexRefMinimizerConfig m_minimize_cross_dex_refs_config;
   CrossDexRelocatorConfig m_cross_dex_relocator_config;
+  bool m_use_method_to_weight;
+
+  std::unordered_set<DexClass*> get_hot_mixed_mode_classes(const Scope& scope,
+                                                           ConfigFiles& conf);
 
   virtual void run_pass(DexStoresVector&,
                         DexClassesVector&,
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <unordered_set>
 #include <vector>
 
 #include "ConfigFiles.h"
@@ -37,6 +38,35 @@ class InterDexPassPlugin {
     return false;
   }
 
+  // Batch versions of should_skip_class and
+  // should_not_relocate_methods_of_class, which the InterDex pass calls once
+  // with all the classes of the scope before it starts emitting any of them.
+  // It caches the answers and doesn't ask about those classes again, so they
+  // must not change while the dexes get packed. By default, these ask about
+  // one class at a time; plugins whose answers for different classes are
+  // independent should compute them in parallel instead.
+  virtual std::unordered_set<const DexClass*> should_skip_classes(
+      const Scope& scope) {
+    std::unordered_set<const DexClass*> classes;
+    for (const DexClass* cls : scope) {
+      if (should_skip_class(cls)) {
+        classes.emplace(cls);
+      }
+    }
+    return classes;
+  }
+
+  virtual std::unordered_set<const DexClass*>
+  should_not_relocate_methods_of_classes(const Scope& scope) {
+    std::unordered_set<const DexClass*> classes;
+    for (const DexClass* cls : scope) {
+      if (should_not_relocate_methods_of_class(cls)) {
+        classes.emplace(cls);
+      }
+    }
+    return classes;
+  }
+
   // Calculate the amount of refs that any classes from additional_classes
   // will add to the output dex (see below).
   virtual void gather_refs(const DexInfo& dex_info,
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MixedModeHeat.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "DexStructure.h"
+#include "IRCode.h"
+#include "Trace.h"
+
+namespace {
+
+size_t count_instructions(const DexClass* cls) {
+  size_t num_instructions = 0;
+  for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+    for (auto* method : *methods) {
+      if (method->get_code() != nullptr) {
+        num_instructions += method->get_code()->count_opcodes();
+      }
+    }
+  }
+  return num_instructions;
+}
+
+} // namespace
+
+namespace interdex {
+
+ClassHeat read_class_heat(const std::string& heat_file, const Scope& scope) {
+  std::ifstream input(heat_file, std::ifstream::in);
+  always_assert_log(input, "Can't open mixed mode heat file: %s\n",
+                    heat_file.c_str());
+
+  std::unordered_map<std::string, DexClass*> classes;
+  for (auto* cls : scope) {
+    classes.emplace(cls->get_name()->str(), cls);
+    classes.emplace(cls->get_deobfuscated_name(), cls);
+  }
+
+  ClassHeat heat;
+  std::string line;
+  while (std::getline(input, line)) {
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream fields(line);
+    std::string name;
+    uint64_t count;
+    if (!(fields >> name >> count)) {
+      continue;
+    }
+    auto it = classes.find(name);
+    if (it == classes.end()) {
+      TRACE(IDEX, 4, "Couldn't find DexClass for heat entry: %s",
+            name.c_str());
+      continue;
+    }
+    heat[it->second] += count;
+  }
+  return heat;
+}
+
+std::unordered_set<DexClass*> select_mixed_mode_classes(
+    const ClassHeat& heat,
+    const std::unordered_set<const DexClass*>& excluded,
+    const MixedModeHeatConfig& config) {
+  std::vector<std::pair<DexClass*, uint64_t>> candidates;
+  for (const auto& p : heat) {
+    if (p.second >= config.min_count && !excluded.count(p.first)) {
+      candidates.push_back(p);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<DexClass*, uint64_t>& a,
+               const std::pair<DexClass*, uint64_t>& b) {
+              if (a.second != b.second) {
+                return a.second > b.second;
+              }
+              return compare_dexclasses(a.first, b.first);
+            });
+
+  std::unordered_set<DexClass*> selected;
+  int64_t linear_alloc = 0;
+  size_t num_instructions = 0;
+  for (const auto& p : candidates) {
+    if (config.max_classes != 0 && selected.size() >= config.max_classes) {
+      break;
+    }
+    auto* cls = p.first;
+    int64_t cls_linear_alloc = estimate_linear_alloc(cls);
+    size_t cls_instructions = count_instructions(cls);
+    if (linear_alloc + cls_linear_alloc > config.linear_alloc_budget ||
+        (config.max_instructions != 0 &&
+         num_instructions + cls_instructions > config.max_instructions)) {
+      TRACE(IDEX, 4, "[mixed mode]: %s (%lu) doesn't fit the budget",
+            SHOW(cls), p.second);
+      continue;
+    }
+    TRACE(IDEX, 4, "[mixed mode]: Adding hot class %s (%lu)", SHOW(cls),
+          p.second);
+    linear_alloc += cls_linear_alloc;
+    num_instructions += cls_instructions;
+    selected.emplace(cls);
+  }
+  TRACE(IDEX, 2,
+        "[mixed mode]: Selected %zu of %zu hot classes, with %ld bytes of "
+        "linear alloc and %zu instructions",
+        selected.size(), candidates.size(), linear_alloc, num_instructions);
+  return selected;
+}
+
+} // namespace interdex
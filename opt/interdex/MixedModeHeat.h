@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DexClass.h"
+
+namespace interdex {
+
+// The number of times the methods of each class ran.
+using ClassHeat = std::unordered_map<DexClass*, uint64_t>;
+
+/*
+ * Reads the per-class execution counts that the instrumented build reports,
+ * one `<class name> <count>` (or `<class name>,<count>`) per line. Classes
+ * are matched by their current or their deobfuscated name; the ones that are
+ * not in the scope are ignored, and the counts of duplicates are added up.
+ */
+ClassHeat read_class_heat(const std::string& heat_file, const Scope& scope);
+
+struct MixedModeHeatConfig {
+  // Classes that ran fewer times than this are not worth precompiling.
+  uint64_t min_count{1};
+  // The linear alloc that the selected classes may take up, at most.
+  int64_t linear_alloc_budget{0};
+  // The cost of precompiling: how many classes, and how many instructions
+  // they have. 0 means no limit.
+  size_t max_classes{0};
+  size_t max_instructions{0};
+};
+
+/*
+ * Picks the classes to pack into the mixed mode dex: the hottest ones, except
+ * for the `excluded` (the startup) ones, as long as they fit the budgets.
+ * A class that doesn't fit doesn't stop smaller, colder ones from being
+ * picked.
+ */
+std::unordered_set<DexClass*> select_mixed_mode_classes(
+    const ClassHeat& heat,
+    const std::unordered_set<const DexClass*>& excluded,
+    const MixedModeHeatConfig& config);
+
+} // namespace interdex
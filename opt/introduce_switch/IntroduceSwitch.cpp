@@ -89,6 +89,10 @@ class IntroduceSwitch {
     int32_t intro_switch = 0;
     int32_t switch_cases = 0;
 
+    // The finders share one constant propagation of the CFG until a switch
+    // gets introduced.
+    std::shared_ptr<SwitchEquivFinder::FixpointIterator> fixpoint;
+
     for (cfg::Block* block : cfg.blocks()) {
       if (visited_blocks.count(block) == 0) {
         visited_blocks.insert(block);
@@ -96,8 +100,15 @@ class IntroduceSwitch {
         if (possible_start_block.first != nullptr) {
           const cfg::InstructionIterator& iter =
               block->to_cfg_instruction_iterator(block->get_last_insn());
-          SwitchEquivFinder* finder =
-              new SwitchEquivFinder(&cfg, iter, possible_start_block.second);
+          if (fixpoint == nullptr) {
+            fixpoint = std::make_shared<SwitchEquivFinder::FixpointIterator>(
+                cfg, constant_propagation::ConstantPrimitiveAnalyzer());
+            fixpoint->run(ConstantEnvironment());
+          }
+          SwitchEquivFinder* finder = new SwitchEquivFinder(
+              &cfg, iter, possible_start_block.second,
+              0 /* leaf_duplication_threshold */,
+              SwitchEquivFinder::DEFAULT_MAX_NUM_LEAVES, fixpoint);
           if (finder->success()) {
             for (const auto& b : finder->visited_blocks()) {
               visited_blocks.insert(b);
@@ -155,6 +166,7 @@ class IntroduceSwitch {
                 }
               }
               cfg.create_branch(block, new_switch, default_block, edges);
+              fixpoint = nullptr;
             }
           }
         }
@@ -173,9 +173,13 @@ ConcurrentSet<DexMethod*> get_no_implementor_abstract_methods(
 
 void LocalDce::dce(IRCode* code) {
   code->build_cfg(/* editable */ true);
-  auto& cfg = code->cfg();
+  dce(code->cfg());
+  code->clear_cfg();
+}
+
+void LocalDce::dce(cfg::ControlFlowGraph& cfg) {
   const auto& blocks = cfg.blocks_post();
-  auto regs = code->get_registers_size();
+  auto regs = cfg.get_registers_size();
   std::unordered_map<cfg::BlockId, boost::dynamic_bitset<>> liveness;
   for (cfg::Block* b : blocks) {
     liveness.emplace(b->id(), boost::dynamic_bitset<>(regs + 1));
@@ -256,8 +260,7 @@ void LocalDce::dce(IRCode* code) {
   m_stats.unreachable_instruction_count += unreachable_insn_count;
 
   TRACE(DCE, 5, "=== Post-DCE CFG ===");
-  TRACE(DCE, 5, "%s", SHOW(code->cfg()));
-  code->clear_cfg();
+  TRACE(DCE, 5, "%s", SHOW(cfg));
 }
 
 /*
@@ -333,6 +336,9 @@ void LocalDcePass::run_pass(DexStoresVector& stores,
   auto stats = walk::parallel::reduce_methods<LocalDce::Stats>(
       scope,
       [&](DexMethod* m) {
+        if (!mgr.needs_revisit(m)) {
+          return LocalDce::Stats();
+        }
         auto* code = m->get_code();
         if (code == nullptr || m->rstate.no_optimizations()) {
           return LocalDce::Stats();
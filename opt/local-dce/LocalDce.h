@@ -51,6 +51,9 @@ class LocalDce {
 
   void dce(IRCode*);
 
+  // The same, on an editable CFG that the caller has built.
+  void dce(cfg::ControlFlowGraph&);
+
  private:
   const std::unordered_set<DexMethodRef*>& m_pure_methods;
   Stats m_stats;
@@ -80,6 +83,5 @@ class LocalDcePass : public Pass {
 
   std::unordered_set<DexMethodRef*> find_no_sideeffect_methods(const Scope&);
 
- private:
   static std::unordered_set<DexMethodRef*> find_pure_methods();
 };
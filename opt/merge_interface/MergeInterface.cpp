@@ -7,7 +7,11 @@
 
 #include "MergeInterface.h"
 
+#include <boost/functional/hash.hpp>
+#include <tuple>
+
 #include "ClassHierarchy.h"
+#include "ConcurrentContainers.h"
 #include "DexAnnotation.h"
 #include "DexClass.h"
 #include "DexUtil.h"
@@ -17,6 +21,7 @@
 #include "TypeReference.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 const std::string MERGE_INTERFACE_MAP_FILENAME =
@@ -113,21 +118,25 @@ std::vector<DexClassSet> collect_can_merge(
   }
   // Remove interface if it is the type of an annotation.
   // TODO(suree404): Merge the interface even though it appears in annotation?
-  walk::annotations(scope, [&](DexAnnotation* anno) {
+  ConcurrentSet<DexType*> types_in_annos;
+  walk::parallel::annotations(scope, [&](DexAnnotation* anno) {
     std::vector<DexType*> types_in_anno;
     anno->gather_types(types_in_anno);
     for (const auto& type : types_in_anno) {
-      DexClass* type_cls = type_class(type);
-      if (type_cls == nullptr) continue;
-      for (auto it = interface_set.begin(); it != interface_set.end(); ++it) {
-        if (it->count(type_cls) > 0) {
-          it->erase(type_cls);
-          ++metric->interfaces_in_annotation;
-          break;
-        }
-      }
+      types_in_annos.insert(type);
     }
   });
+  for (const auto& type : types_in_annos) {
+    DexClass* type_cls = type_class(type);
+    if (type_cls == nullptr) continue;
+    for (auto it = interface_set.begin(); it != interface_set.end(); ++it) {
+      if (it->count(type_cls) > 0) {
+        it->erase(type_cls);
+        ++metric->interfaces_in_annotation;
+        break;
+      }
+    }
+  }
   TRACE(MEINT, 4, SHOW(interface_set));
   return interface_set;
 }
@@ -169,36 +178,60 @@ void strip_out_collision(const Scope& scope,
     mergeables.insert(i.first);
   }
 
-  std::unordered_set<DexMethodRef*> fake_sets;
-  std::unordered_set<const DexType*> to_delete;
-  const auto fake_update = [&](DexMethod* meth) {
-    DexProto* proto = meth->get_proto();
+  // The proto that each virtual method referring to a mergeable interface
+  // would get after merging, computed in parallel. Many methods share their
+  // protos, so the new protos are looked up by the old ones.
+  std::vector<DexMethod*> methods;
+  walk::methods(scope, [&](DexMethod* meth) { methods.push_back(meth); });
+  ConcurrentMap<DexProto*, DexProto*> new_protos;
+  std::vector<DexProto*> new_proto_of(methods.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    DexMethod* meth = methods[i];
     // TODO(suree404): Only eliminate true virtual.
-    if (!meth->is_virtual() ||
-        !type_reference::proto_has_reference_to(proto, mergeables)) {
+    if (!meth->is_virtual()) {
+      return;
+    }
+    DexProto* proto = meth->get_proto();
+    if (new_protos.count(proto)) {
+      new_proto_of[i] = new_protos.at(proto);
       return;
     }
-    DexProto* new_proto = type_reference::get_new_proto(proto, intf_merge_map);
+    DexProto* new_proto =
+        type_reference::proto_has_reference_to(proto, mergeables)
+            ? type_reference::get_new_proto(proto, intf_merge_map)
+            : nullptr;
+    new_protos.emplace(proto, new_proto);
+    new_proto_of[i] = new_proto;
+  });
+  for (size_t i = 0; i < methods.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  // The signatures that earlier methods of the walk will have after merging.
+  // When there is no virtual method conflict for a method, we remember its
+  // new signature to catch conflict case no matter which merger class we
+  // choose. Suppose in the example of I1, I2, and I3 above, if we chose I3 as
+  // merger, then I1 I2 will be merged, updating I1 to be I3 won't cause
+  // conflict, but A.do_something(I3) will exist after that, then updating I2
+  // to be I3 will cause conflict.
+  using Signature = std::tuple<DexType*, DexString*, DexProto*>;
+  std::unordered_set<Signature, boost::hash<Signature>> new_signatures;
+  std::unordered_set<const DexType*> to_delete;
+  for (size_t i = 0; i < methods.size(); ++i) {
+    DexProto* new_proto = new_proto_of[i];
+    if (new_proto == nullptr) {
+      continue;
+    }
+    DexMethod* meth = methods[i];
+    DexProto* proto = meth->get_proto();
     DexType* type = meth->get_class();
     DexString* name = meth->get_name();
-    DexMethodRef* existing_meth = DexMethod::get_method(type, name, new_proto);
-    if (existing_meth == nullptr) {
-      // When there is no virtual method conflict if we are merging the
-      // interfaces, then create a fake method to indicate there will be
-      // such a virtual method after merging.
-      // This is to make sure that we can catch conflict case no matter
-      // which merger class we choose. Suppose in the example of
-      // I1, I2, and I3 above, if we chose I3 as merger, then I1 I2 will be
-      // merged, updating I1 to be I3 won't cause conflict, but
-      // A.do_something(I3) will be a fake method existed, then updating I2
-      // to be I3 will cause conflict.
-      DexMethodRef* fake_new_meth =
-          DexMethod::make_method(type, name, new_proto);
-      TRACE(MEINT, 7, "Making fake method");
-      TRACE(MEINT, 7, SHOW(fake_new_meth));
-      TRACE(MEINT, 7, "");
-      fake_sets.emplace(fake_new_meth);
-      return;
+    Signature signature(type, name, new_proto);
+    if (DexMethod::get_method(type, name, new_proto) == nullptr &&
+        new_signatures.count(signature) == 0) {
+      new_signatures.emplace(signature);
+      continue;
     }
     const DexType* rtype = get_array_type_or_self(proto->get_rtype());
     if (mergeables.count(rtype) > 0) {
@@ -210,14 +243,6 @@ void strip_out_collision(const Scope& scope,
         to_delete.emplace(extracted_arg_type);
       }
     }
-  };
-
-  walk::methods(scope, fake_update);
-  for (DexMethodRef* fake_method : fake_sets) {
-    TRACE(MEINT, 7, "Erasing fake method");
-    TRACE(MEINT, 7, SHOW(fake_method));
-    TRACE(MEINT, 7, "");
-    DexMethod::erase_method(fake_method);
   }
 
   for (const DexType* to_del : to_delete) {
@@ -558,9 +583,9 @@ void update_after_merge(
     const std::unordered_map<const DexType*, DexType*>& intf_merge_map,
     const std::unordered_map<DexMethodRef*, DexMethodRef*>& old_to_new_method,
     const ClassHierarchy& ch) {
-  type_reference::update_method_signature_type_references(scope, intf_merge_map,
-                                                          ch);
-  type_reference::update_field_type_references(scope, intf_merge_map);
+  type_reference::TypeRefUpdateBatch type_ref_updates;
+  type_ref_updates.add(intf_merge_map);
+  type_ref_updates.apply(scope, ch);
   update_reference_for_code(scope, intf_merge_map, old_to_new_method);
   remove_implements(scope, intf_merge_map);
 }
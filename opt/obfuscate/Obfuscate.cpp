@@ -8,6 +8,7 @@
 #include <list>
 
 #include "ClassHierarchy.h"
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
@@ -72,27 +73,28 @@ void debug_logging(std::vector<DexClass*>& classes) {
   TRACE(OBFUSCATE, 3, "Finished applying new names to defs");
 }
 
+// The table is shared by all the threads rewriting refs. Two of them may look
+// up the same ref at once; they find the same def.
 template<typename DexMember, typename DexMemberRef, typename DexMemberSpec, typename K>
 DexMember* find_renamable_ref(DexMemberRef* ref,
-    std::unordered_map<DexMemberRef*, DexMember*>& ref_def_cache,
+    ConcurrentMap<DexMemberRef*, DexMember*>& ref_def_cache,
     DexElemManager<DexMember*, DexMemberRef*, DexMemberSpec, K>& name_mapping) {
   TRACE(OBFUSCATE, 4, "Found a ref opcode");
-  DexMember* def = nullptr;
-  auto member_itr = ref_def_cache.find(ref);
-  if (member_itr != ref_def_cache.end()) {
-    def = member_itr->second;
-  } else {
-    def = name_mapping.def_of_ref(ref);
+  if (ref_def_cache.count(ref)) {
+    return ref_def_cache.get(ref, nullptr);
   }
-  ref_def_cache[ref] = def;
+  // def_of_ref only looks up, so it is safe to call concurrently once all the
+  // names are picked.
+  DexMember* def = name_mapping.def_of_ref(ref);
+  ref_def_cache.emplace(ref, def);
   return def;
 }
 
 void update_refs(Scope& scope, DexFieldManager& field_name_mapping,
     DexMethodManager& method_name_mapping) {
-  std::unordered_map<DexFieldRef*, DexField*> f_ref_def_cache;
-  std::unordered_map<DexMethodRef*, DexMethod*> m_ref_def_cache;
-  walk::opcodes(scope,
+  ConcurrentMap<DexFieldRef*, DexField*> f_ref_def_cache;
+  ConcurrentMap<DexMethodRef*, DexMethod*> m_ref_def_cache;
+  walk::parallel::opcodes(scope,
     [&](DexMethod*, IRInstruction* instr) {
       auto op = instr->opcode();
       if (instr->has_field()) {
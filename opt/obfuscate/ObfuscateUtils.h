@@ -482,8 +482,8 @@ public:
   inline bool contains_elem(
       DexType* cls, K sig, DexString* name) {
     return elements.count(cls) > 0 &&
-      elements[cls].count(sig) > 0 &&
-      elements[cls][sig].count(name) > 0;
+      elements.at(cls).count(sig) > 0 &&
+      elements.at(cls).at(sig).count(name) > 0;
   }
 
   inline bool contains_elem(R elem) {
@@ -555,8 +555,9 @@ private:
   T find_def(R ref, DexType* cls) {
     if (cls == nullptr) return nullptr;
     if (contains_elem(cls, sig_getter_fn(ref), ref->get_name())) {
+      // Lookups only, as refs are looked up from several threads at once.
       DexNameWrapper<T>* wrap =
-        elements[cls][sig_getter_fn(ref)][ref->get_name()].get();
+        elements.at(cls).at(sig_getter_fn(ref)).at(ref->get_name()).get();
       if (wrap->is_modified())
         return wrap->get();
     }
@@ -113,7 +113,7 @@ using RefsMap =
 // const std::string prefix = __Redex__";
 const std::string prefix = "";
 
-DexString* get_name(int seed) {
+std::string make_name(int seed) {
   std::string name = prefix;
 
   const auto append = [&](int value) {
@@ -131,9 +131,32 @@ DexString* get_name(int seed) {
     seed = (seed / 52) - 1;
   }
   append(seed);
-  return DexString::make_string(name);
+  return name;
 }
 
+/*
+ * The names by seed, interned once. The renamer goes back to the seed of the
+ * parent for every subtree of the class hierarchy and tries the same seeds
+ * over and over, so most names are asked for many times.
+ */
+class NamePool {
+ public:
+  DexString* get(int seed) {
+    always_assert(seed >= 0);
+    if (static_cast<size_t>(seed) >= m_names.size()) {
+      size_t size = m_names.size();
+      m_names.resize(std::max<size_t>(seed + 1, 2 * size));
+      for (size_t i = size; i < m_names.size(); ++i) {
+        m_names[i] = DexString::make_string(make_name(i));
+      }
+    }
+    return m_names[seed];
+  }
+
+ private:
+  std::vector<DexString*> m_names;
+};
+
 struct VirtualRenamer {
   VirtualRenamer(const ClassScopes& class_scopes,
                  const RefsMap& def_refs,
@@ -150,6 +173,7 @@ struct VirtualRenamer {
  private:
   const ClassScopes& class_scopes;
   const RefsMap& def_refs;
+  mutable NamePool name_pool;
   // When avoid_stack_trace_collision is true this is used to keep a ref count
   // of a given fully qualified method name (sans parameters); i.e. the line
   // that will be printed when the method appears in a stack trace (internally
@@ -176,7 +200,10 @@ struct VirtualRenamer {
   DexString* get_unescaped_name(std::vector<const VirtualScope*> scopes,
                                 int& seed) const;
   DexString* get_unescaped_name(const VirtualScope* scope, int& seed) const;
-  bool usable_name(DexString* name, const VirtualScope* scope) const;
+  TypeSet get_hierarchy(const VirtualScope* scope) const;
+  bool usable_name(DexString* name,
+                   const VirtualScope* scope,
+                   const TypeSet& hier) const;
 };
 
 /**
@@ -254,18 +281,26 @@ int VirtualRenamer::rename_scope(const VirtualScope* scope, DexString* name) {
   return renamed;
 }
 
+/**
+ * The root of the scope and all the types below it.
+ */
+TypeSet VirtualRenamer::get_hierarchy(const VirtualScope* scope) const {
+  const auto root = scope->type;
+  TypeSet hier;
+  hier.insert(root);
+  get_all_children(class_scopes.get_class_hierarchy(), root, hier);
+  return hier;
+}
+
 /**
  * A name is usable if it does not collide with an existing
  * one in the def and ref space.
  */
 bool VirtualRenamer::usable_name(
     DexString* name,
-    const VirtualScope* scope) const {
-  const auto root = scope->type;
+    const VirtualScope* scope,
+    const TypeSet& hier) const {
   const auto proto = scope->methods[0].first->get_proto();
-  TypeSet hier;
-  hier.insert(root);
-  get_all_children(class_scopes.get_class_hierarchy(), root, hier);
   bool has_ste = stack_trace_elements != nullptr;
   for (const auto& type : hier) {
     if (DexMethod::get_method(const_cast<DexType*>(type), name, proto)
@@ -290,9 +325,10 @@ bool VirtualRenamer::usable_name(
 DexString* VirtualRenamer::get_unescaped_name(
     const VirtualScope* scope,
     int& seed) const {
-  auto name = get_name(seed++);
-  while (!usable_name(name, scope)) {
-    name = get_name(seed++);
+  const auto hier = get_hierarchy(scope);
+  auto name = name_pool.get(seed++);
+  while (!usable_name(name, scope, hier)) {
+    name = name_pool.get(seed++);
   }
   return name;
 }
@@ -305,10 +341,15 @@ DexString* VirtualRenamer::get_unescaped_name(
 DexString* VirtualRenamer::get_unescaped_name(
     std::vector<const VirtualScope*> scopes,
     int& seed) const {
+  std::vector<TypeSet> hiers;
+  hiers.reserve(scopes.size());
+  for (const auto& scope : scopes) {
+    hiers.push_back(get_hierarchy(scope));
+  }
   while (true) {
-    auto name = get_name(seed++);
-    for (const auto& scope : scopes) {
-      if (!usable_name(name, scope)) goto next_name;
+    auto name = name_pool.get(seed++);
+    for (size_t i = 0; i < scopes.size(); ++i) {
+      if (!usable_name(name, scopes[i], hiers[i])) goto next_name;
     }
     return name;
   next_name: ;
@@ -440,34 +481,53 @@ int VirtualRenamer::rename_virtual_scopes(const DexType* type, int& seed) {
  * Collect all method refs to concrete methods (definitions).
  */
 void collect_refs(Scope& scope, RefsMap& def_refs) {
-  walk::opcodes(scope, [](DexMethod*) { return true; },
-    [&](DexMethod*, IRInstruction* insn) {
-      if (!insn->has_method()) return;
-      auto callee = insn->get_method();
-      if (callee->is_concrete()) return;
-      auto cls = type_class(callee->get_class());
-      if (cls == nullptr || cls->is_external()) return;
-      DexMethod* top = nullptr;
-      if (is_interface(cls)) {
-        top = resolve_method(callee, MethodSearch::Interface);
-      } else {
-        top = find_top_impl(cls, callee->get_name(), callee->get_proto());
-        if (top == nullptr) {
-          TRACE(OBFUSCATE, 2, "Possible top miranda: %s", SHOW(callee));
-          // see if it's a virtual call to an interface miranda method
-          top = find_top_intf_impl(
-              cls, callee->get_name(), callee->get_proto());
-          if (top != nullptr) {
-            TRACE(OBFUSCATE, 2, "Top miranda: %s", SHOW(top));
-          }
-        }
-      }
-      if (top == nullptr || top == callee) return;
-      redex_assert(type_class(top->get_class()) != nullptr);
-      if (type_class(top->get_class())->is_external()) return;
-      // it's a top definition on an internal class, save it
-      def_refs[top].insert(callee);
-    });
+  // The refs are resolved in parallel, each class into a buffer of its own,
+  // and then added to the map in scope order.
+  std::vector<std::vector<std::pair<DexMethod*, DexMethodRef*>>> class_refs(
+      scope.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        walk::opcodes(Scope{scope[i]}, [](DexMethod*) { return true; },
+          [&](DexMethod*, IRInstruction* insn) {
+            if (!insn->has_method()) return;
+            auto callee = insn->get_method();
+            if (callee->is_concrete()) return;
+            auto cls = type_class(callee->get_class());
+            if (cls == nullptr || cls->is_external()) return;
+            DexMethod* top = nullptr;
+            if (is_interface(cls)) {
+              top = resolve_method(callee, MethodSearch::Interface);
+            } else {
+              top = find_top_impl(cls, callee->get_name(),
+                                  callee->get_proto());
+              if (top == nullptr) {
+                TRACE(OBFUSCATE, 2, "Possible top miranda: %s",
+                      SHOW(callee));
+                // see if it's a virtual call to an interface miranda method
+                top = find_top_intf_impl(
+                    cls, callee->get_name(), callee->get_proto());
+                if (top != nullptr) {
+                  TRACE(OBFUSCATE, 2, "Top miranda: %s", SHOW(top));
+                }
+              }
+            }
+            if (top == nullptr || top == callee) return;
+            redex_assert(type_class(top->get_class()) != nullptr);
+            if (type_class(top->get_class())->is_external()) return;
+            // it's a top definition on an internal class, save it
+            class_refs[i].emplace_back(top, callee);
+          });
+      },
+      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  for (const auto& refs : class_refs) {
+    for (const auto& ref : refs) {
+      def_refs[ref.first].insert(ref.second);
+    }
+  }
 }
 
 }
@@ -7,7 +7,9 @@
 
 #include "ObjectSensitiveDcePass.h"
 
+#include <fstream>
 #include <functional>
+#include <map>
 
 #include "ConcurrentContainers.h"
 #include "DexUtil.h"
@@ -55,8 +57,8 @@ class CallGraphStrategy final : public call_graph::BuildStrategy {
     for (auto& mie : InstructionIterable(code)) {
       auto insn = mie.insn;
       if (is_invoke(insn->opcode())) {
-        auto callee = resolve_method(insn->get_method(), opcode_to_search(insn),
-                                     m_resolved_refs);
+        auto callee = resolve_method_cached(insn->get_method(),
+                                            opcode_to_search(insn));
         if (callee == nullptr || may_be_overridden(callee)) {
           continue;
         }
@@ -88,7 +90,6 @@ class CallGraphStrategy final : public call_graph::BuildStrategy {
 
   const Scope& m_scope;
   std::unordered_set<const DexMethod*> m_non_overridden_virtuals;
-  mutable MethodRefCache m_resolved_refs;
 };
 
 static side_effects::InvokeToSummaryMap build_summary_map(
@@ -109,8 +110,24 @@ static side_effects::InvokeToSummaryMap build_summary_map(
   return invoke_to_summary_map;
 }
 
+/*
+ * Write the summaries so that they can be passed back to the pass as external
+ * summaries, e.g. when the methods are those of a library that other apps are
+ * built against.
+ */
+template <typename Map>
+static void write_summaries(const std::string& path, const Map& summaries) {
+  using Summary =
+      typename std::decay<decltype(summaries.begin()->second)>::type;
+  std::map<const DexMethodRef*, Summary, dexmethods_comparator> ordered(
+      summaries.begin(), summaries.end());
+  std::ofstream file_output(path);
+  summary_serialization::print(file_output, ordered);
+  TRACE(OSDCE, 1, "Wrote %zu summaries to %s", ordered.size(), path.c_str());
+}
+
 void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
-                                      ConfigFiles&,
+                                      ConfigFiles& conf,
                                       PassManager& mgr) {
   auto scope = build_class_scope(stores);
 
@@ -120,7 +137,8 @@ void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
     code.cfg().calculate_exit_block();
   });
 
-  auto call_graph = call_graph::Graph(CallGraphStrategy(scope));
+  auto call_graph =
+      call_graph::build_graph_in_parallel(scope, CallGraphStrategy(scope));
 
   ptrs::SummaryMap escape_summaries;
   if (m_external_escape_summaries_file) {
@@ -139,6 +157,14 @@ void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
   }
   side_effects::analyze_scope(scope, call_graph, *ptrs_fp_iter_map,
                               &effect_summaries);
+  if (!m_escape_summaries_output.empty()) {
+    write_summaries(conf.metafile(m_escape_summaries_output),
+                    escape_summaries_cmap);
+  }
+  if (!m_side_effect_summaries_output.empty()) {
+    write_summaries(conf.metafile(m_side_effect_summaries_output),
+                    effect_summaries);
+  }
 
   auto removed = walk::parallel::reduce_methods<size_t>(
       scope,
@@ -26,6 +26,13 @@ class ObjectSensitiveDcePass final : public Pass {
     bind("escape_summaries", {boost::none}, m_external_escape_summaries_file,
          "TODO: Document me!",
          Configurable::bindflags::optionals::skip_empty_string);
+    bind("side_effect_summaries_output", "",
+         m_side_effect_summaries_output,
+         "Name of a meta file to write the side effect summaries that the "
+         "pass computed to, in the format of side_effect_summaries.");
+    bind("escape_summaries_output", "", m_escape_summaries_output,
+         "Name of a meta file to write the escape summaries that the pass "
+         "computed to, in the format of escape_summaries.");
 
     if (!m_external_escape_summaries_file ||
         !m_external_side_effect_summaries_file) {
@@ -40,4 +47,6 @@ class ObjectSensitiveDcePass final : public Pass {
  private:
   boost::optional<std::string> m_external_side_effect_summaries_file;
   boost::optional<std::string> m_external_escape_summaries_file;
+  std::string m_side_effect_summaries_output;
+  std::string m_escape_summaries_output;
 };
@@ -174,27 +174,23 @@ class SummaryBuilder final {
 };
 
 /*
- * Analyze :method and insert its summary into :summary_cmap. Recursively
- * analyze the callees if necessary. This method is thread-safe.
+ * Analyze :method and insert its summary into :summary_cmap, using the
+ * summaries of its callees that are already there. The invokes of the other
+ * callees count as unknown. This method is thread-safe.
  */
-void analyze_method_recursive(const DexMethod* method,
-                              const call_graph::Graph& call_graph,
-                              const ptrs::FixpointIteratorMap& ptrs_fp_iter_map,
-                              PatriciaTreeSet<const DexMethodRef*> visiting,
-                              SummaryConcurrentMap* summary_cmap) {
-  if (summary_cmap->count(method) != 0 || visiting.contains(method) ||
-      method->get_code() == nullptr) {
+void analyze_method(const DexMethod* method,
+                    const call_graph::Graph& call_graph,
+                    const ptrs::FixpointIteratorMap& ptrs_fp_iter_map,
+                    SummaryConcurrentMap* summary_cmap) {
+  if (summary_cmap->count(method) != 0 || method->get_code() == nullptr) {
     return;
   }
-  visiting.insert(method);
 
   std::unordered_map<const IRInstruction*, Summary> invoke_to_summary_cmap;
   if (call_graph.has_node(method)) {
     const auto& callee_edges = call_graph.node(method).callees();
     for (const auto& edge : callee_edges) {
       auto* callee = edge->callee();
-      analyze_method_recursive(callee, call_graph, ptrs_fp_iter_map, visiting,
-                               summary_cmap);
       if (summary_cmap->count(callee) != 0) {
         invoke_to_summary_cmap.emplace(edge->invoke_iterator()->insn,
                                        summary_cmap->at(callee));
@@ -253,10 +249,17 @@ void analyze_scope(
     summary_cmap.insert(pair);
   }
 
-  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
-    PatriciaTreeSet<const DexMethodRef*> visiting;
-    analyze_method_recursive(method, call_graph, ptrs_fp_iter_map, visiting,
-                             &summary_cmap);
+  // Same order as local_pointers::analyze_scope().
+  call_graph::Sccs sccs(call_graph);
+  call_graph::parallel_bottom_up(sccs, [&](call_graph::Sccs::SccId id) {
+    for (const auto* method : sccs.members(id)) {
+      analyze_method(method, call_graph, ptrs_fp_iter_map, &summary_cmap);
+    }
+  });
+  walk::parallel::code(scope, [&](const DexMethod* method, IRCode&) {
+    if (!call_graph.has_node(method)) {
+      analyze_method(method, call_graph, ptrs_fp_iter_map, &summary_cmap);
+    }
   });
 
   for (auto& pair : summary_cmap) {
@@ -84,7 +84,8 @@ Summary analyze_code(const InvokeToSummaryMap& invoke_to_summary_cmap,
                      const IRCode* code);
 
 /*
- * Get the effect summary for all methods in scope.
+ * Get the effect summary for all methods in scope, bottom-up over the
+ * strongly connected components of the call graph, in parallel.
  */
 void analyze_scope(const Scope& scope,
                    const call_graph::Graph&,
@@ -703,11 +703,25 @@ class EnumTransformer final {
   EnumTransformer(const Config& config, DexStoresVector* stores)
       : m_stores(*stores), m_int_objs(0) {
     m_enum_util = std::make_unique<EnumUtil>(config);
-    for (auto it = config.candidate_enums.begin();
-         it != config.candidate_enums.end();
-         ++it) {
-      auto enum_cls = type_class(*it);
-      auto enum_attrs = optimize_enums::analyze_enum_clinit(enum_cls);
+    // The <clinit>s of the candidates do not depend on each other, so they
+    // are analyzed in parallel.
+    std::vector<DexType*> candidates(config.candidate_enums.begin(),
+                                     config.candidate_enums.end());
+    std::vector<optimize_enums::AttrMap> candidate_attrs(candidates.size());
+    auto wq = workqueue_foreach<size_t>(
+        [&](size_t i) {
+          candidate_attrs[i] =
+              optimize_enums::analyze_enum_clinit(type_class(candidates[i]));
+        },
+        walk::parallel::default_num_threads());
+    for (size_t i = 0; i < candidates.size(); i++) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+      auto enum_cls = type_class(candidates[i]);
+      auto& enum_attrs = candidate_attrs[i];
       if (enum_attrs.empty()) {
         TRACE(ENUM, 2, "\tCannot analyze enum %s : ord %lu sfields %lu",
               SHOW(enum_cls), enum_attrs.size(),
@@ -719,7 +733,7 @@ class EnumTransformer final {
       } else {
         m_int_objs = std::max<uint32_t>(m_int_objs, enum_attrs.size());
         m_enum_objs += enum_attrs.size();
-        m_enum_attrs.emplace(*it, enum_attrs);
+        m_enum_attrs.emplace(candidates[i], std::move(enum_attrs));
         clean_generated_methods_fields(enum_cls);
         opt_metadata::log_opt(ENUM_OPTIMIZED, enum_cls);
       }
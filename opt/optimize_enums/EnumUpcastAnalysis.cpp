@@ -79,7 +79,7 @@ class EnumUpcastDetector {
 
   void run(const EnumFixpointIterator& engine,
            const cfg::ControlFlowGraph& cfg,
-           ConcurrentSet<DexType*>* rejected_enums) {
+           std::unordered_set<DexType*>* rejected_enums) {
     for (const auto& block : cfg.blocks()) {
       EnumTypeEnvironment env = engine.get_entry_state_at(block);
       if (env.is_bottom()) {
@@ -98,7 +98,7 @@ class EnumUpcastDetector {
    */
   void process_instruction(const IRInstruction* insn,
                            const EnumTypeEnvironment* env,
-                           ConcurrentSet<DexType*>* rejected_enums) {
+                           std::unordered_set<DexType*>* rejected_enums) {
     switch (insn->opcode()) {
     case OPCODE_CHECK_CAST: {
       auto type = insn->get_type();
@@ -152,9 +152,10 @@ class EnumUpcastDetector {
   /**
    * Process return-object instruction when we reach the fixpoint.
    */
-  void process_return_object(const IRInstruction* insn,
-                             const EnumTypeEnvironment* env,
-                             ConcurrentSet<DexType*>* rejected_enums) const {
+  void process_return_object(
+      const IRInstruction* insn,
+      const EnumTypeEnvironment* env,
+      std::unordered_set<DexType*>* rejected_enums) const {
     DexType* return_type = m_method->get_proto()->get_rtype();
     always_assert_log(env->get(insn->src(0)).is_value(),
                       "method %s\ninsn %s %s\n", SHOW(m_method), SHOW(insn),
@@ -167,9 +168,10 @@ class EnumUpcastDetector {
    * Process iput-object and sput-object instructions when we reach the fix
    * point.
    */
-  void process_isput_object(const IRInstruction* insn,
-                            const EnumTypeEnvironment* env,
-                            ConcurrentSet<DexType*>* rejected_enums) const {
+  void process_isput_object(
+      const IRInstruction* insn,
+      const EnumTypeEnvironment* env,
+      std::unordered_set<DexType*>* rejected_enums) const {
     auto arg_reg = insn->src(0);
     DexType* field_type = insn->get_field()->get_type();
     reject_if_inconsistent(insn, env->get(arg_reg), field_type, rejected_enums,
@@ -181,7 +183,7 @@ class EnumUpcastDetector {
    */
   void process_aput_object(const IRInstruction* insn,
                            const EnumTypeEnvironment* env,
-                           ConcurrentSet<DexType*>* rejected_enums) const {
+                           std::unordered_set<DexType*>* rejected_enums) const {
     // It's possible that the array_types contains non-array types or is
     // array of primitives. Just ignore them.
     EnumTypes array_types = env->get(insn->src(1));
@@ -213,7 +215,7 @@ class EnumUpcastDetector {
   void process_direct_invocation(
       const IRInstruction* insn,
       const EnumTypeEnvironment* env,
-      ConcurrentSet<DexType*>* rejected_enums) const {
+      std::unordered_set<DexType*>* rejected_enums) const {
     always_assert(insn->opcode() == OPCODE_INVOKE_DIRECT);
     auto invoked = insn->get_method();
     auto container = invoked->get_class();
@@ -235,7 +237,7 @@ class EnumUpcastDetector {
    */
   void process_static_invocation(const IRInstruction* insn,
                                  const EnumTypeEnvironment* env,
-                                 ConcurrentSet<DexType*>* rejected_enums) {
+                                 std::unordered_set<DexType*>* rejected_enums) {
     always_assert(insn->opcode() == OPCODE_INVOKE_STATIC);
     auto method_ref = insn->get_method();
     if (method_ref == STRING_VALUEOF_METHOD) {
@@ -298,7 +300,7 @@ class EnumUpcastDetector {
   void process_virtual_invocation(
       const IRInstruction* insn,
       const EnumTypeEnvironment* env,
-      ConcurrentSet<DexType*>* rejected_enums) const {
+      std::unordered_set<DexType*>* rejected_enums) const {
     always_assert(insn->opcode() == OPCODE_INVOKE_VIRTUAL);
     const DexMethodRef* method = insn->get_method();
     const DexProto* proto = method->get_proto();
@@ -349,7 +351,7 @@ class EnumUpcastDetector {
   void process_general_invocation(
       const IRInstruction* insn,
       const EnumTypeEnvironment* env,
-      ConcurrentSet<DexType*>* rejected_enums) const {
+      std::unordered_set<DexType*>* rejected_enums) const {
     always_assert(insn->has_method());
     auto method = insn->get_method();
     auto proto = method->get_proto();
@@ -395,7 +397,7 @@ class EnumUpcastDetector {
   void reject_if_inconsistent(const IRInstruction* insn,
                               const EnumTypes& types,
                               DexType* required_type,
-                              ConcurrentSet<DexType*>* rejected_enums,
+                              std::unordered_set<DexType*>* rejected_enums,
                               Reason reason = UNKNOWN) const {
     if (is_candidate(required_type)) {
       bool need_delete = false;
@@ -417,7 +419,7 @@ class EnumUpcastDetector {
 
   void reject(const IRInstruction* insn,
               std::unordered_set<DexType*> types,
-              ConcurrentSet<DexType*>* rejected_enums,
+              std::unordered_set<DexType*>* rejected_enums,
               Reason reason = UNKNOWN) const {
     for (DexType* type : types) {
       reject(insn, type, rejected_enums, reason);
@@ -426,7 +428,7 @@ class EnumUpcastDetector {
 
   void reject(const IRInstruction* insn,
               EnumTypes types,
-              ConcurrentSet<DexType*>* rejected_enums,
+              std::unordered_set<DexType*>* rejected_enums,
               Reason reason = UNKNOWN) const {
     for (DexType* type : types.elements()) {
       reject(insn, type, rejected_enums, reason);
@@ -435,7 +437,7 @@ class EnumUpcastDetector {
 
   void reject(const IRInstruction* insn,
               DexType* type,
-              ConcurrentSet<DexType*>* rejected_enums,
+              std::unordered_set<DexType*>* rejected_enums,
               Reason reason = UNKNOWN) const {
     type = const_cast<DexType*>(get_array_type_or_self(type));
     if (m_candidate_enums->count_unsafe(type)) {
@@ -667,9 +669,15 @@ void reject_unsafe_enums(const std::vector<DexClass*>& classes,
     EnumFixpointIterator engine(code->cfg(), *config);
     engine.run(env);
 
+    // The detector rejects into a set of its own, so that the workers only
+    // take the lock of the shared set once per rejected enum.
+    std::unordered_set<DexType*> method_rejected_enums;
     EnumUpcastDetector detector(method, config);
-    detector.run(engine, code->cfg(), &rejected_enums);
+    detector.run(engine, code->cfg(), &method_rejected_enums);
     code->clear_cfg();
+    for (auto type : method_rejected_enums) {
+      rejected_enums.insert(type);
+    }
   });
 
   for (DexType* type : rejected_enums) {
@@ -7,7 +7,10 @@
 
 #include "OptimizeEnums.h"
 
+#include <atomic>
+
 #include "ClassAssemblingUtils.h"
+#include "ConcurrentContainers.h"
 #include "EnumClinitAnalysis.h"
 #include "EnumInSwitch.h"
 #include "EnumTransformer.h"
@@ -546,7 +549,8 @@ class OptimizeEnums {
       const GeneratedSwitchCases& generated_switch_cases) {
 
     namespace cp = constant_propagation;
-    walk::code(m_scope, [&](DexMethod*, IRCode& code) {
+    // Each method is analyzed and rewritten on its own.
+    walk::parallel::code(m_scope, [&](DexMethod*, IRCode& code) {
       code.build_cfg(/* editable */ true);
       auto& cfg = code.cfg();
       cfg.calculate_exit_block();
@@ -819,11 +823,11 @@ class OptimizeEnums {
     size_t num_enum_classes{0};
     size_t num_enum_objs{0};
     size_t num_int_objs{0};
-    size_t num_switch_equiv_finder_failures{0};
+    std::atomic<size_t> num_switch_equiv_finder_failures{0};
   };
   Stats m_stats;
 
-  std::unordered_set<DexField*> m_lookup_tables_replaced;
+  ConcurrentSet<DexField*> m_lookup_tables_replaced;
   const DexMethod* m_java_enum_ctor;
   const ProguardMap& m_pg_map;
 };
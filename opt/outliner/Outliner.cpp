@@ -221,4 +221,22 @@ void Outliner::run_pass(DexStoresVector& stores,
   if (outlined_throws.size() > 0) {
     build_dispatcher(stores, outlined_throws);
   }
+
+  if (m_outline_sequences) {
+    auto stats = sequence_outliner::outline_sequences(
+        stores, m_outline_primary_dex, m_sequence_config);
+    TRACE(OUTLINE, 1,
+          "Outlined %zu sequences into %zu methods, saving %zu code units; "
+          "%zu candidates from %zu repeats in %zu tokens",
+          stats.num_outlined_sequences, stats.num_outlined_methods,
+          stats.num_code_units_saved, stats.num_candidates, stats.num_repeats,
+          stats.num_tokens);
+    mgr.incr_metric("outlined_sequences", stats.num_outlined_sequences);
+    mgr.incr_metric("outlined_sequence_methods", stats.num_outlined_methods);
+    mgr.incr_metric("outlined_sequence_code_units_saved",
+                    stats.num_code_units_saved);
+    mgr.incr_metric("outlined_sequence_candidates", stats.num_candidates);
+    mgr.incr_metric("outlined_sequences_rejected_for_mrefs",
+                    stats.num_rejected_for_mrefs);
+  }
 }
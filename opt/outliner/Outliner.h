@@ -8,6 +8,7 @@
 #pragma once
 
 #include "Pass.h"
+#include "SequenceOutliner.h"
 
 class Outliner : public Pass {
  public:
@@ -18,6 +19,17 @@ class Outliner : public Pass {
     // we need to allow this to happen in some scenarios, e.g.
     // instrumentation tests, since they are single-dex affairs.
     bind("outline_primary_dex", false, m_outline_primary_dex);
+    // Outlines the instruction sequences that repeat across methods, besides
+    // the throws.
+    bind("outline_sequences", false, m_outline_sequences);
+    bind("sequence_min_insns", {4}, m_sequence_config.min_insns);
+    bind("sequence_max_insns", {32}, m_sequence_config.max_insns);
+    bind("sequence_max_arg_words", {5}, m_sequence_config.max_arg_words);
+    bind("sequence_min_benefit", {1}, m_sequence_config.min_benefit);
+    bind("sequence_reserved_mrefs", {0}, m_sequence_config.reserved_mrefs);
+    bind("sequence_max_outlined_methods",
+         {0},
+         m_sequence_config.max_outlined_methods);
   }
 
   void run_pass(DexStoresVector& stores,
@@ -26,4 +38,6 @@ class Outliner : public Pass {
 
  private:
   bool m_outline_primary_dex;
+  bool m_outline_sequences;
+  sequence_outliner::Config m_sequence_config;
 };
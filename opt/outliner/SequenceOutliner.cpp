@@ -0,0 +1,955 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SequenceOutliner.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/optional.hpp>
+
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "Liveness.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "TypeInference.h"
+
+namespace {
+
+constexpr const char* HOST_CLASS_PREFIX = "Lcom/facebook/redex/OutlinedCode";
+constexpr const char* HELPER_PREFIX = "$outlined$";
+constexpr size_t kMaxMethodRefs = 64 * 1024;
+// Roughly what a method costs besides its instructions: its method id, its
+// encoded method and its code item header, in code units.
+constexpr size_t kMethodOverhead = 16;
+// An invoke-static, in code units.
+constexpr size_t kCallSize = 3;
+// The instruction ids are below, and the separators above.
+constexpr uint32_t kFirstSeparator = 1u << 31;
+
+bool is_result(IROpcode op) {
+  return is_move_result(op) || opcode::is_move_result_pseudo(op);
+}
+
+bool is_accessible(const DexType* type) {
+  auto elem = get_array_type_or_self(type);
+  if (is_primitive(elem)) {
+    return true;
+  }
+  auto cls = type_class(elem);
+  return cls != nullptr && is_public(cls);
+}
+
+// Whether `insn` may move to a helper in another class, with respect to what
+// it refers to.
+bool can_outline(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (is_literal_const(op) || op == OPCODE_CONST_STRING || is_move(op) ||
+      is_result(op) || (op >= OPCODE_CMPL_FLOAT && op <= OPCODE_CMP_LONG) ||
+      (op >= OPCODE_NEG_INT && op <= OPCODE_USHR_INT_LIT8)) {
+    return true;
+  }
+  if (op == OPCODE_CONST_CLASS || op == OPCODE_CHECK_CAST ||
+      op == OPCODE_INSTANCE_OF) {
+    return is_accessible(insn->get_type());
+  }
+  if (is_ifield_op(op) || is_sfield_op(op)) {
+    auto field = resolve_field(insn->get_field(), is_sfield_op(op)
+                                                      ? FieldSearch::Static
+                                                      : FieldSearch::Instance);
+    return field != nullptr && is_public(field) &&
+           is_accessible(field->get_class()) &&
+           is_accessible(insn->get_field()->get_class());
+  }
+  if (op == OPCODE_INVOKE_VIRTUAL || op == OPCODE_INVOKE_STATIC ||
+      op == OPCODE_INVOKE_INTERFACE) {
+    auto method = resolve_method(insn->get_method(), opcode_to_search(insn));
+    return method != nullptr && is_public(method) &&
+           is_accessible(method->get_class()) &&
+           is_accessible(insn->get_method()->get_class());
+  }
+  return false;
+}
+
+// The type that `insn` expects its i-th source to have, when it says.
+const DexType* expected_src_type(const IRInstruction* insn, size_t i) {
+  auto op = insn->opcode();
+  if (is_invoke(op)) {
+    auto method = insn->get_method();
+    const auto& args = method->get_proto()->get_args()->get_type_list();
+    if (op == OPCODE_INVOKE_STATIC) {
+      return args.at(i);
+    }
+    return i == 0 ? method->get_class() : args.at(i - 1);
+  }
+  if (is_iget(op)) {
+    return insn->get_field()->get_class();
+  }
+  if (is_iput(op)) {
+    return i == 0 ? insn->get_field()->get_type()
+                  : insn->get_field()->get_class();
+  }
+  if (is_sput(op)) {
+    return insn->get_field()->get_type();
+  }
+  return nullptr;
+}
+
+// The type of what `primary` leaves in its result register, when it is known
+// exactly.
+const DexType* result_type(const IRInstruction* primary) {
+  auto op = primary->opcode();
+  if (is_invoke(op)) {
+    return primary->get_method()->get_proto()->get_rtype();
+  }
+  if (is_iget(op) || is_sget(op)) {
+    return primary->get_field()->get_type();
+  }
+  switch (op) {
+  case OPCODE_CHECK_CAST:
+    return primary->get_type();
+  case OPCODE_INSTANCE_OF:
+    return get_boolean_type();
+  case OPCODE_CONST_STRING:
+    return get_string_type();
+  case OPCODE_CONST_CLASS:
+    return get_class_type();
+  default:
+    return nullptr;
+  }
+}
+
+const DexType* type_of(IRType type) {
+  switch (type) {
+  case INT:
+    return get_int_type();
+  case FLOAT:
+    return get_float_type();
+  case LONG1:
+    return get_long_type();
+  case DOUBLE1:
+    return get_double_type();
+  default:
+    return nullptr;
+  }
+}
+
+// A token of the stream: an instruction that can be outlined, or nothing for
+// a separator.
+struct Token {
+  MethodItemEntry* mie;
+  cfg::Block* block;
+  uint32_t method;
+  // Whether a move-result of this instruction follows it.
+  bool followed_by_result;
+};
+
+struct MethodInfo {
+  DexMethod* method;
+  size_t dex;
+  std::shared_ptr<const LivenessFixpointIterator> liveness;
+  std::unique_ptr<type_inference::TypeInference> types;
+};
+
+// What an occurrence of a sequence looks like to the helper that replaces it.
+struct Shape {
+  // What the occurrences that can share a helper have in common.
+  std::vector<uint64_t> key;
+  // From the registers of the occurrence to the ones of the helper, where the
+  // parameters come first.
+  std::unordered_map<uint16_t, uint16_t> regs;
+  uint16_t registers_size{0};
+  // The registers of the occurrence that are passed to the helper, in order.
+  std::vector<uint16_t> args;
+  std::vector<DexType*> arg_types;
+  boost::optional<uint16_t> result;
+  DexType* result_type{nullptr};
+  size_t code_units{0};
+};
+
+struct Candidate {
+  size_t length;
+  size_t dex;
+  Shape shape;
+  std::vector<uint32_t> positions;
+  // Once selected, the shapes of the occurrences at the positions, which have
+  // the registers of each of them.
+  std::vector<Shape> occurrences;
+
+  size_t call_size() const { return kCallSize + (shape.result ? 1 : 0); }
+
+  // The code units saved by outlining `n` occurrences, or 0.
+  size_t benefit(size_t n) const {
+    if (shape.code_units <= call_size()) {
+      return 0;
+    }
+    size_t saved = n * (shape.code_units - call_size());
+    size_t cost = shape.code_units + 1 + kMethodOverhead;
+    return saved > cost ? saved - cost : 0;
+  }
+
+  // How many of the (sorted) positions can be outlined together, as
+  // occurrences of a repeat may overlap each other.
+  size_t num_disjoint_positions() const {
+    size_t n = 0;
+    size_t end = 0;
+    for (auto pos : positions) {
+      if (n == 0 || pos >= end) {
+        ++n;
+        end = pos + length;
+      }
+    }
+    return n;
+  }
+};
+
+class SequenceOutliner {
+ public:
+  SequenceOutliner(DexStoresVector& stores,
+                   bool include_primary_dex,
+                   const sequence_outliner::Config& config)
+      : m_dexen(stores.at(0).get_dexen()),
+        m_first_dex(include_primary_dex ? 0 : 1),
+        m_config(config) {}
+
+  sequence_outliner::Stats run() {
+    tokenize();
+    m_stats.num_tokens = m_stream.size();
+    if (m_stream.size() > 1) {
+      find_candidates();
+      select();
+      outline();
+    }
+    for (auto& info : m_methods) {
+      info.method->get_code()->clear_cfg();
+    }
+    return m_stats;
+  }
+
+ private:
+  void add_separator() {
+    if (!m_stream.empty() && m_stream.back() >= kFirstSeparator) {
+      return;
+    }
+    m_stream.push_back(m_next_separator++);
+    m_tokens.push_back(Token{nullptr, nullptr, 0, false});
+  }
+
+  uint32_t token_id(const IRInstruction* insn) {
+    auto key = std::make_tuple(
+        insn->opcode(), insn->srcs_size(),
+        insn->has_literal() ? insn->get_literal() : 0,
+        insn->has_type()
+            ? static_cast<const void*>(insn->get_type())
+            : insn->has_field()
+                  ? static_cast<const void*>(insn->get_field())
+                  : insn->has_method()
+                        ? static_cast<const void*>(insn->get_method())
+                        : insn->has_string()
+                              ? static_cast<const void*>(insn->get_string())
+                              : nullptr);
+    return m_token_ids.emplace(key, m_token_ids.size()).first->second;
+  }
+
+  void tokenize() {
+    for (size_t dex = m_first_dex; dex < m_dexen.size(); ++dex) {
+      for (auto cls : m_dexen[dex]) {
+        for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+          for (auto method : *methods) {
+            // The receiver of a constructor is uninitialized until the
+            // super constructor runs, and can't be passed around.
+            if (method->get_code() == nullptr || is_init(method)) {
+              continue;
+            }
+            tokenize(method, dex);
+          }
+        }
+      }
+    }
+  }
+
+  void tokenize(DexMethod* method, size_t dex) {
+    auto& code = *method->get_code();
+    code.build_cfg(/* editable */ true);
+    uint32_t index = m_methods.size();
+    m_methods.push_back(MethodInfo{method, dex, nullptr, nullptr});
+    for (auto block : code.cfg().blocks()) {
+      std::vector<MethodItemEntry*> insns;
+      for (auto& mie : InstructionIterable(block)) {
+        insns.push_back(&mie);
+      }
+      for (size_t i = 0; i < insns.size(); ++i) {
+        auto insn = insns[i]->insn;
+        if (!can_outline(insn)) {
+          add_separator();
+          continue;
+        }
+        bool followed_by_result;
+        if (i + 1 < insns.size()) {
+          followed_by_result = is_result(insns[i + 1]->insn->opcode());
+        } else {
+          auto next = block->goes_to();
+          auto first = next != nullptr ? next->get_first_insn() : block->end();
+          followed_by_result = next != nullptr && first != next->end() &&
+                               is_result(first->insn->opcode());
+        }
+        m_stream.push_back(token_id(insn));
+        m_tokens.push_back(Token{insns[i], block, index, followed_by_result});
+      }
+      add_separator();
+    }
+  }
+
+  MethodInfo& analyzed(uint32_t index) {
+    auto& info = m_methods[index];
+    if (info.liveness == nullptr) {
+      auto& cfg = info.method->get_code()->cfg();
+      cfg.calculate_exit_block();
+      info.liveness = get_liveness(cfg);
+      info.types = std::make_unique<type_inference::TypeInference>(
+          cfg, /* lazy_environments */ true);
+      info.types->run(info.method);
+    }
+    return info;
+  }
+
+  /*
+   * The shape of the sequence of `length` tokens at `pos`, or none if it
+   * can't be outlined.
+   */
+  boost::optional<Shape> analyze(uint32_t pos, size_t length) {
+    const auto& first = m_tokens[pos];
+    const auto& last = m_tokens[pos + length - 1];
+    if (is_result(first.mie->insn->opcode()) || last.followed_by_result) {
+      return boost::none;
+    }
+
+    // The widths of the registers, the live-ins in the order they are read,
+    // which live-in each register holds, if any, and what the uses of the
+    // live-ins expect them to be.
+    std::unordered_map<uint16_t, bool> wide;
+    std::vector<uint16_t> order;
+    std::vector<uint16_t> live_ins;
+    std::unordered_map<uint16_t, int> origin;
+    std::unordered_set<uint16_t> defined;
+    std::vector<std::vector<const DexType*>> expected;
+    // The exact type of what a register holds, when the instruction that
+    // wrote it says.
+    std::unordered_map<uint16_t, const DexType*> def_types;
+    auto record = [&](uint16_t reg, bool is_wide) {
+      auto it = wide.find(reg);
+      if (it == wide.end()) {
+        wide.emplace(reg, is_wide);
+        order.push_back(reg);
+        return true;
+      }
+      return it->second == is_wide;
+    };
+    const IRInstruction* prev = nullptr;
+    for (size_t i = pos; i < pos + length; ++i) {
+      auto insn = m_tokens[i].mie->insn;
+      for (size_t j = 0; j < insn->srcs_size(); ++j) {
+        auto reg = insn->src(j);
+        if (!record(reg, insn->src_is_wide(j))) {
+          return boost::none;
+        }
+        if (!defined.count(reg) && !origin.count(reg)) {
+          origin[reg] = live_ins.size();
+          live_ins.push_back(reg);
+          expected.emplace_back();
+        }
+        auto it = origin.find(reg);
+        if (it != origin.end() && it->second >= 0) {
+          if (auto type = expected_src_type(insn, j)) {
+            expected[it->second].push_back(type);
+          }
+        }
+      }
+      if (insn->dests_size()) {
+        auto reg = insn->dest();
+        if (!record(reg, insn->dest_is_wide())) {
+          return boost::none;
+        }
+        defined.emplace(reg);
+        auto op = insn->opcode();
+        if (is_move(op)) {
+          auto it = origin.find(insn->src(0));
+          origin[reg] = it != origin.end() ? it->second : -1;
+          auto dt = def_types.find(insn->src(0));
+          def_types[reg] = dt != def_types.end() ? dt->second : nullptr;
+        } else {
+          origin[reg] = -1;
+          def_types[reg] = is_result(op) && prev != nullptr
+                               ? result_type(prev)
+                               : nullptr;
+        }
+      }
+      prev = insn;
+    }
+    for (auto reg : order) {
+      if (wide.at(reg) && wide.count(reg + 1)) {
+        return boost::none;
+      }
+    }
+
+    auto& info = analyzed(first.method);
+    auto env = info.types->get_type_environment(first.mie->insn);
+    if (!env) {
+      return boost::none;
+    }
+
+    Shape shape;
+    size_t arg_words = 0;
+    for (size_t k = 0; k < live_ins.size(); ++k) {
+      auto reg = live_ins[k];
+      auto type = param_type(*env, reg, expected[k]);
+      if (type == nullptr || !is_accessible(type)) {
+        return boost::none;
+      }
+      shape.args.push_back(reg);
+      shape.arg_types.push_back(const_cast<DexType*>(type));
+      arg_words += wide.at(reg) ? 2 : 1;
+    }
+    if (arg_words > m_config.max_arg_words) {
+      return boost::none;
+    }
+
+    // The registers that the sequence writes and that are live after it.
+    auto live = info.liveness->get_live_out_vars_at(last.block);
+    for (auto it = last.block->rbegin(); it != last.block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      if (it->insn == last.mie->insn) {
+        break;
+      }
+      info.liveness->analyze_instruction(it->insn, &live);
+    }
+    for (auto reg : defined) {
+      if (!live.contains(reg)) {
+        continue;
+      }
+      if (shape.result || origin.at(reg) >= 0) {
+        // Only one value comes back, and a live-in that merely passes
+        // through would come back with the wrong type.
+        return boost::none;
+      }
+      shape.result = reg;
+    }
+    if (shape.result) {
+      const DexType* type = def_types.at(*shape.result);
+      if (type == nullptr) {
+        for (size_t i = pos; i < pos + length; ++i) {
+          info.types->analyze_instruction(m_tokens[i].mie->insn, &*env);
+        }
+        auto ir_type = env->get_type(*shape.result).element();
+        if (ir_type == REFERENCE) {
+          auto dex_type = env->get_dex_type(*shape.result);
+          type = dex_type ? *dex_type : nullptr;
+        } else {
+          type = type_of(ir_type);
+        }
+      }
+      if (type == nullptr || !is_accessible(type)) {
+        return boost::none;
+      }
+      shape.result_type = const_cast<DexType*>(type);
+    }
+
+    // The parameters take the first registers of the helper.
+    auto allocate = [&](uint16_t reg) {
+      if (shape.regs.emplace(reg, shape.registers_size).second) {
+        shape.registers_size += wide.at(reg) ? 2 : 1;
+      }
+    };
+    for (auto reg : live_ins) {
+      allocate(reg);
+    }
+    for (auto reg : order) {
+      allocate(reg);
+    }
+
+    shape.key.push_back(m_methods[first.method].dex);
+    shape.key.push_back(length);
+    for (size_t i = pos; i < pos + length; ++i) {
+      auto insn = m_tokens[i].mie->insn;
+      shape.key.push_back(m_stream[i]);
+      if (insn->dests_size()) {
+        shape.key.push_back(shape.regs.at(insn->dest()));
+      }
+      for (size_t j = 0; j < insn->srcs_size(); ++j) {
+        shape.key.push_back(shape.regs.at(insn->src(j)));
+      }
+      shape.code_units += insn->size();
+    }
+    for (auto type : shape.arg_types) {
+      shape.key.push_back(reinterpret_cast<uint64_t>(type));
+    }
+    shape.key.push_back(shape.result ? shape.regs.at(*shape.result) + 1 : 0);
+    shape.key.push_back(reinterpret_cast<uint64_t>(shape.result_type));
+    return shape;
+  }
+
+  /*
+   * The type of the parameter that live-in `reg` comes in as: one that the
+   * type of `reg` is assignable to, and that its uses in the sequence accept.
+   */
+  static const DexType* param_type(const type_inference::TypeEnvironment& env,
+                                   uint16_t reg,
+                                   const std::vector<const DexType*>& uses) {
+    switch (env.get_type(reg).element()) {
+    case REFERENCE: {
+      auto inferred = env.get_dex_type(reg);
+      if (!inferred) {
+        return nullptr;
+      }
+      // The most general of the types of the uses, if one of them is
+      // assignable to all the others.
+      const DexType* param = get_object_type();
+      for (auto type : uses) {
+        if (!is_object(type)) {
+          return nullptr;
+        }
+        if (check_cast(type, param)) {
+          param = type;
+        } else if (!check_cast(param, type)) {
+          return nullptr;
+        }
+      }
+      return check_cast(*inferred, param) ? param : nullptr;
+    }
+    case INT: {
+      // Booleans, bytes, shorts and chars are ints to the arithmetic, but
+      // not the other way around.
+      const DexType* param = get_int_type();
+      for (auto type : uses) {
+        if (!is_primitive(type) || is_wide_type(type) ||
+            type == get_float_type()) {
+          return nullptr;
+        }
+        if (type == get_int_type() || type == param) {
+          continue;
+        }
+        if (param != get_int_type()) {
+          return nullptr;
+        }
+        param = type;
+      }
+      return param;
+    }
+    case FLOAT:
+    case LONG1:
+    case DOUBLE1: {
+      auto param = type_of(env.get_type(reg).element());
+      for (auto type : uses) {
+        if (type != param) {
+          return nullptr;
+        }
+      }
+      return param;
+    }
+    default:
+      return nullptr;
+    }
+  }
+
+  void add_candidate(Shape shape, size_t length, uint32_t position) {
+    auto it = m_candidate_index.find(shape.key);
+    if (it == m_candidate_index.end()) {
+      it = m_candidate_index.emplace(shape.key, m_candidates.size()).first;
+      auto dex = shape.key[0];
+      m_candidates.push_back(
+          Candidate{length, dex, std::move(shape), {}, {}});
+    }
+    m_candidates[it->second].positions.push_back(position);
+  }
+
+  // Groups the occurrences of the repeat at sa[lb..rb] by shape, trying
+  // shorter lengths while there are no two of them to outline together.
+  void add_repeat(const std::vector<uint32_t>& sa,
+                  size_t lcp,
+                  size_t lb,
+                  size_t rb) {
+    if (lcp < m_config.min_insns) {
+      return;
+    }
+    ++m_stats.num_repeats;
+    for (size_t length = std::min(lcp, m_config.max_insns);
+         length >= m_config.min_insns; --length) {
+      std::map<std::vector<uint64_t>, std::pair<Shape, std::vector<uint32_t>>>
+          groups;
+      bool found = false;
+      for (size_t i = lb; i <= rb; ++i) {
+        auto shape = analyze(sa[i], length);
+        if (!shape) {
+          continue;
+        }
+        auto& group = groups[shape->key];
+        if (group.second.empty()) {
+          group.first = std::move(*shape);
+        }
+        group.second.push_back(sa[i]);
+        found = found || group.second.size() > 1;
+      }
+      if (!found) {
+        continue;
+      }
+      for (auto& entry : groups) {
+        for (auto position : entry.second.second) {
+          add_candidate(entry.second.first, length, position);
+        }
+      }
+      return;
+    }
+  }
+
+  void find_candidates() {
+    auto sa = sequence_outliner::build_suffix_array(m_stream);
+    auto lcp = sequence_outliner::build_lcp_array(m_stream, sa);
+    // The lcp intervals, bottom-up (Abouelhoda et al.).
+    size_t n = sa.size();
+    std::vector<std::pair<uint32_t, size_t>> stack{{0, 0}};
+    for (size_t i = 1; i <= n; ++i) {
+      uint32_t cur = i < n ? lcp[i] : 0;
+      size_t lb = i - 1;
+      while (cur < stack.back().first) {
+        auto top = stack.back();
+        stack.pop_back();
+        lb = top.second;
+        add_repeat(sa, top.first, lb, i - 1);
+      }
+      if (cur > stack.back().first) {
+        stack.emplace_back(cur, lb);
+      }
+    }
+    for (auto& candidate : m_candidates) {
+      auto& positions = candidate.positions;
+      std::sort(positions.begin(), positions.end());
+      positions.erase(std::unique(positions.begin(), positions.end()),
+                      positions.end());
+    }
+    m_stats.num_candidates = m_candidates.size();
+  }
+
+  size_t mrefs_budget(size_t dex) {
+    std::unordered_set<DexMethodRef*> mrefs;
+    for (auto cls : m_dexen[dex]) {
+      std::vector<DexMethodRef*> methods;
+      cls->gather_methods(methods);
+      mrefs.insert(methods.begin(), methods.end());
+    }
+    auto used = mrefs.size() + m_config.reserved_mrefs;
+    return used < kMaxMethodRefs ? kMaxMethodRefs - used : 0;
+  }
+
+  // Greedily picks the candidates that save the most, without overlaps.
+  void select() {
+    std::vector<size_t> order(m_candidates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<size_t> benefits;
+    for (const auto& candidate : m_candidates) {
+      benefits.push_back(
+          candidate.benefit(candidate.num_disjoint_positions()));
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      if (benefits[a] != benefits[b]) {
+        return benefits[a] > benefits[b];
+      }
+      return m_candidates[a].positions[0] < m_candidates[b].positions[0];
+    });
+
+    std::vector<bool> claimed(m_stream.size());
+    std::unordered_map<size_t, size_t> budgets;
+    for (auto index : order) {
+      if (benefits[index] < std::max<size_t>(m_config.min_benefit, 1)) {
+        break;
+      }
+      if (m_config.max_outlined_methods != 0 &&
+          m_selected.size() >= m_config.max_outlined_methods) {
+        break;
+      }
+      auto& candidate = m_candidates[index];
+      std::vector<uint32_t> positions;
+      for (auto pos : candidate.positions) {
+        if (!positions.empty() && pos < positions.back() + candidate.length) {
+          continue;
+        }
+        bool free = true;
+        for (size_t i = pos; i < pos + candidate.length && free; ++i) {
+          free = !claimed[i];
+        }
+        if (free) {
+          positions.push_back(pos);
+        }
+      }
+      if (positions.size() < 2 ||
+          candidate.benefit(positions.size()) < m_config.min_benefit) {
+        continue;
+      }
+      auto budget = budgets.find(candidate.dex);
+      if (budget == budgets.end()) {
+        budget =
+            budgets.emplace(candidate.dex, mrefs_budget(candidate.dex)).first;
+      }
+      if (budget->second == 0) {
+        ++m_stats.num_rejected_for_mrefs;
+        continue;
+      }
+      --budget->second;
+      for (auto pos : positions) {
+        std::fill(claimed.begin() + pos,
+                  claimed.begin() + pos + candidate.length, true);
+      }
+      m_stats.num_code_units_saved += candidate.benefit(positions.size());
+      for (auto pos : positions) {
+        candidate.occurrences.push_back(*analyze(pos, candidate.length));
+      }
+      candidate.positions = std::move(positions);
+      m_selected.push_back(index);
+    }
+  }
+
+  DexMethod* make_helper(const Candidate& candidate, DexClass* host) {
+    const auto& shape = candidate.shape;
+    auto code = std::make_unique<IRCode>();
+    for (size_t k = 0; k < shape.args.size(); ++k) {
+      auto type = shape.arg_types[k];
+      auto load_param = new IRInstruction(
+          is_wide_type(type)
+              ? IOPCODE_LOAD_PARAM_WIDE
+              : is_object(type) ? IOPCODE_LOAD_PARAM_OBJECT
+                                : IOPCODE_LOAD_PARAM);
+      load_param->set_dest(shape.regs.at(shape.args[k]));
+      code->push_back(load_param);
+    }
+    auto pos = candidate.positions[0];
+    for (size_t i = pos; i < pos + candidate.length; ++i) {
+      auto insn = new IRInstruction(*m_tokens[i].mie->insn);
+      if (insn->dests_size()) {
+        insn->set_dest(shape.regs.at(insn->dest()));
+      }
+      for (size_t j = 0; j < insn->srcs_size(); ++j) {
+        insn->set_src(j, shape.regs.at(insn->src(j)));
+      }
+      code->push_back(insn);
+    }
+    if (shape.result) {
+      auto type = shape.result_type;
+      auto ret = new IRInstruction(
+          is_wide_type(type)
+              ? OPCODE_RETURN_WIDE
+              : is_object(type) ? OPCODE_RETURN_OBJECT : OPCODE_RETURN);
+      ret->set_src(0, shape.regs.at(*shape.result));
+      code->push_back(ret);
+    } else {
+      code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+    }
+    code->set_registers_size(shape.registers_size);
+
+    std::deque<DexType*> args(shape.arg_types.begin(), shape.arg_types.end());
+    auto proto = DexProto::make_proto(
+        shape.result ? shape.result_type : get_void_type(),
+        DexTypeList::make_type_list(std::move(args)));
+    auto name = DexString::make_string(HELPER_PREFIX +
+                                       std::to_string(m_num_helpers++));
+    auto helper = static_cast<DexMethod*>(
+        DexMethod::make_method(host->get_type(), name, proto));
+    helper->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL,
+                          std::move(code),
+                          /* is_virtual */ false);
+    helper->set_deobfuscated_name(show(helper));
+    host->add_method(helper);
+    TRACE(OUTLINE, 3, "Outlined %zu occurrences into %s:\n%s",
+          candidate.positions.size(), SHOW(helper), SHOW(helper->get_code()));
+    return helper;
+  }
+
+  DexClass* host_class(size_t dex) {
+    auto it = m_hosts.find(dex);
+    if (it != m_hosts.end()) {
+      return it->second;
+    }
+    auto type =
+        DexType::make_type((HOST_CLASS_PREFIX + std::to_string(dex) + ";")
+                               .c_str());
+    always_assert_log(!type_class(type), "%s already exists", SHOW(type));
+    ClassCreator creator(type);
+    creator.set_super(get_object_type());
+    creator.set_access(ACC_PUBLIC | ACC_FINAL);
+    auto cls = creator.create();
+    m_dexen[dex].push_back(cls);
+    m_hosts.emplace(dex, cls);
+    return cls;
+  }
+
+  void replace(const Candidate& candidate,
+               size_t occurrence_index,
+               DexMethod* helper) {
+    auto pos = candidate.positions[occurrence_index];
+    auto& cfg = m_methods[m_tokens[pos].method].method->get_code()->cfg();
+    const auto& occurrence = candidate.occurrences[occurrence_index];
+    always_assert(occurrence.key == candidate.shape.key);
+
+    // The move-result-pseudo of the last instruction goes with it.
+    auto anchor_pos = pos + candidate.length - 1;
+    if (opcode::is_move_result_pseudo(
+            m_tokens[anchor_pos].mie->insn->opcode())) {
+      --anchor_pos;
+    }
+    for (size_t i = pos; i < pos + candidate.length; ++i) {
+      auto& token = m_tokens[i];
+      if (i == anchor_pos ||
+          opcode::is_move_result_pseudo(token.mie->insn->opcode())) {
+        continue;
+      }
+      cfg.remove_insn(token.block->to_cfg_instruction_iterator(*token.mie));
+    }
+
+    std::vector<IRInstruction*> insns;
+    auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+    invoke->set_method(helper)->set_arg_word_count(occurrence.args.size());
+    for (size_t k = 0; k < occurrence.args.size(); ++k) {
+      invoke->set_src(k, occurrence.args[k]);
+    }
+    insns.push_back(invoke);
+    if (occurrence.result) {
+      auto type = candidate.shape.result_type;
+      auto move_result = new IRInstruction(
+          is_wide_type(type)
+              ? OPCODE_MOVE_RESULT_WIDE
+              : is_object(type) ? OPCODE_MOVE_RESULT_OBJECT
+                                : OPCODE_MOVE_RESULT);
+      move_result->set_dest(*occurrence.result);
+      insns.push_back(move_result);
+    }
+    auto& anchor = m_tokens[anchor_pos];
+    cfg.replace_insns(anchor.block->to_cfg_instruction_iterator(*anchor.mie),
+                      insns);
+  }
+
+  void outline() {
+    // All the helpers are made before any occurrence goes away.
+    std::vector<std::tuple<uint32_t, size_t, size_t, DexMethod*>> sites;
+    for (auto index : m_selected) {
+      const auto& candidate = m_candidates[index];
+      auto helper = make_helper(candidate, host_class(candidate.dex));
+      for (size_t i = 0; i < candidate.positions.size(); ++i) {
+        sites.emplace_back(candidate.positions[i], index, i, helper);
+      }
+      ++m_stats.num_outlined_methods;
+      m_stats.num_outlined_sequences += candidate.positions.size();
+    }
+    // Replacing an occurrence may split its block after it, so the ones that
+    // come later in the stream are replaced first.
+    std::sort(sites.begin(), sites.end(), [](const auto& a, const auto& b) {
+      return std::get<0>(a) > std::get<0>(b);
+    });
+    for (const auto& site : sites) {
+      replace(m_candidates[std::get<1>(site)], std::get<2>(site),
+              std::get<3>(site));
+    }
+  }
+
+  std::vector<DexClasses>& m_dexen;
+  size_t m_first_dex;
+  const sequence_outliner::Config& m_config;
+  sequence_outliner::Stats m_stats;
+
+  std::vector<MethodInfo> m_methods;
+  std::vector<uint32_t> m_stream;
+  std::vector<Token> m_tokens;
+  std::map<std::tuple<IROpcode, size_t, int64_t, const void*>, uint32_t>
+      m_token_ids;
+  uint32_t m_next_separator{kFirstSeparator};
+
+  std::vector<Candidate> m_candidates;
+  std::map<std::vector<uint64_t>, size_t> m_candidate_index;
+  std::vector<size_t> m_selected;
+
+  std::unordered_map<size_t, DexClass*> m_hosts;
+  size_t m_num_helpers{0};
+};
+
+} // namespace
+
+namespace sequence_outliner {
+
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& s) {
+  size_t n = s.size();
+  std::vector<uint32_t> sa(n);
+  std::iota(sa.begin(), sa.end(), 0);
+  if (n == 0) {
+    return sa;
+  }
+  std::vector<uint64_t> rank(s.begin(), s.end());
+  std::vector<uint64_t> next(n);
+  for (size_t k = 1;; k <<= 1) {
+    // Sorts by the ranks of the prefixes of length 2k, as pairs of ranks of
+    // prefixes of length k; the ones that end early come first.
+    auto key = [&](uint32_t i) {
+      return std::make_pair(rank[i], i + k < n ? rank[i + k] + 1 : 0);
+    };
+    std::sort(sa.begin(), sa.end(),
+              [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+    next[sa[0]] = 0;
+    for (size_t i = 1; i < n; ++i) {
+      next[sa[i]] = next[sa[i - 1]] + (key(sa[i - 1]) < key(sa[i]) ? 1 : 0);
+    }
+    rank.swap(next);
+    if (rank[sa[n - 1]] == n - 1 || k >= n) {
+      break;
+    }
+  }
+  return sa;
+}
+
+std::vector<uint32_t> build_lcp_array(const std::vector<uint32_t>& s,
+                                      const std::vector<uint32_t>& sa) {
+  size_t n = s.size();
+  std::vector<uint32_t> rank(n);
+  for (size_t i = 0; i < n; ++i) {
+    rank[sa[i]] = i;
+  }
+  std::vector<uint32_t> lcp(n, 0);
+  size_t h = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (rank[i] == 0) {
+      h = 0;
+      continue;
+    }
+    size_t j = sa[rank[i] - 1];
+    while (i + h < n && j + h < n && s[i + h] == s[j + h]) {
+      ++h;
+    }
+    lcp[rank[i]] = h;
+    if (h > 0) {
+      --h;
+    }
+  }
+  return lcp;
+}
+
+Stats outline_sequences(DexStoresVector& stores,
+                        bool include_primary_dex,
+                        const Config& config) {
+  always_assert(!stores.empty());
+  always_assert(config.min_insns > 0 && config.min_insns <= config.max_insns);
+  return SequenceOutliner(stores, include_primary_dex, config).run();
+}
+
+} // namespace sequence_outliner
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "DexStore.h"
+
+/*
+ * Outlines the instruction sequences that repeat across the methods of a dex
+ * into shared static helper methods, one host class per dex.
+ *
+ * The instructions of the whole scope are turned into one stream of tokens,
+ * where a token stands for an instruction up to its registers, and the runs
+ * that can be outlined are separated by unique tokens. The repeated
+ * substrings of the stream are the intervals of its suffix array. The
+ * occurrences of a repeat are then grouped by what the register usage and
+ * the types of the values that flow in and out of them look like, since that
+ * is what the helper depends on. The groups that save the most code units are
+ * outlined first, as long as they don't overlap with the ones that already
+ * were, and the helpers fit the method refs limit of their dex.
+ *
+ * Only straight-line code is outlined: the sequences stay within a block, and
+ * they don't contain branches, returns, throws, allocations, array accesses,
+ * monitors, nor references to members that aren't public. A helper takes the
+ * registers that the sequence reads before it writes them, and returns the
+ * one register it writes that is live afterwards, if any.
+ */
+namespace sequence_outliner {
+
+struct Config {
+  // How long the outlined sequences may be, move-results included.
+  size_t min_insns{4};
+  size_t max_insns{32};
+  // The most argument words that a helper may take.
+  size_t max_arg_words{5};
+  // The code units that outlining a sequence needs to save, at least, after
+  // subtracting the calls and the helper itself.
+  size_t min_benefit{1};
+  // The method refs to leave free in each dex.
+  size_t reserved_mrefs{0};
+  // 0 means no limit.
+  size_t max_outlined_methods{0};
+};
+
+struct Stats {
+  size_t num_tokens{0};
+  size_t num_repeats{0};
+  size_t num_candidates{0};
+  size_t num_outlined_methods{0};
+  size_t num_outlined_sequences{0};
+  size_t num_code_units_saved{0};
+  size_t num_rejected_for_mrefs{0};
+};
+
+/*
+ * The suffixes of `s` in lexicographic order, by prefix doubling.
+ */
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& s);
+
+/*
+ * lcp[i] is the length of the longest common prefix of the suffixes sa[i - 1]
+ * and sa[i], and lcp[0] is 0 (Kasai et al.).
+ */
+std::vector<uint32_t> build_lcp_array(const std::vector<uint32_t>& s,
+                                      const std::vector<uint32_t>& sa);
+
+/*
+ * Outlines the classes of the dexes of the root store, except for the
+ * primary one unless `include_primary_dex`.
+ */
+Stats outline_sequences(DexStoresVector& stores,
+                        bool include_primary_dex,
+                        const Config& config);
+
+} // namespace sequence_outliner
@@ -8,6 +8,7 @@
 #include "Peephole.h"
 
 #include <algorithm>
+#include <bitset>
 #include <cmath>
 #include <numeric>
 #include <unordered_map>
@@ -241,6 +242,9 @@ struct DexPattern {
 
 struct Matcher;
 
+// The opcodes that appear in a basic block, or that a DexPattern accepts.
+using OpcodeSet = std::bitset<IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1>;
+
 struct Pattern {
   const std::string name;
   const std::vector<DexPattern> match;
@@ -269,7 +273,29 @@ struct Matcher {
   std::unordered_map<Type, DexType*, EnumClassHash> matched_types;
   std::unordered_map<Field, DexFieldRef*, EnumClassHash> matched_fields;
 
-  explicit Matcher(const Pattern& pattern) : pattern(pattern), match_index(0) {}
+  // For each 'match' pattern, the opcodes that it accepts.
+  std::vector<OpcodeSet> match_opcodes;
+
+  explicit Matcher(const Pattern& pattern) : pattern(pattern), match_index(0) {
+    for (const auto& dex_pattern : pattern.match) {
+      OpcodeSet opcodes;
+      for (auto op : dex_pattern.opcodes) {
+        opcodes.set(op);
+      }
+      match_opcodes.push_back(opcodes);
+    }
+  }
+
+  // Patterns don't span basic blocks, so this pattern can only match in a
+  // block that has an instruction for each of its 'match' patterns.
+  bool may_match(const OpcodeSet& block_opcodes) const {
+    for (const auto& opcodes : match_opcodes) {
+      if ((opcodes & block_opcodes).none()) {
+        return false;
+      }
+    }
+    return true;
+  }
 
   void reset() {
     match_index = 0;
@@ -1653,6 +1679,20 @@ class PeepholeOptimizer {
     auto code = method->get_code();
     code->build_cfg(/* editable */ false);
 
+    // Scan every block once for the opcodes it has, so that the patterns
+    // that can't match in a block don't have to look at its instructions.
+    const auto& blocks = code->cfg().blocks();
+    std::vector<OpcodeSet> block_opcodes(blocks.size());
+    auto scan_opcodes = [&](size_t b) {
+      block_opcodes[b].reset();
+      for (auto& mei : InstructionIterable(blocks[b])) {
+        block_opcodes[b].set(mei.insn->opcode());
+      }
+    };
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      scan_opcodes(b);
+    }
+
     // do optimizations one at a time
     // so they can match on the same pattern without interfering
     for (size_t i = 0; i < m_matchers.size(); ++i) {
@@ -1660,8 +1700,12 @@ class PeepholeOptimizer {
       std::vector<IRInstruction*> deletes;
       std::vector<std::pair<IRInstruction*, std::vector<IRInstruction*>>>
           inserts;
-      const auto& blocks = code->cfg().blocks();
-      for (const auto& block : blocks) {
+      std::vector<size_t> changed_blocks;
+      for (size_t b = 0; b < blocks.size(); ++b) {
+        if (!matcher.may_match(block_opcodes[b])) {
+          continue;
+        }
+        auto block = blocks[b];
         // Currently, all patterns do not span over multiple basic blocks. So
         // reset all matching states on visiting every basic block.
         matcher.reset();
@@ -1690,6 +1734,9 @@ class PeepholeOptimizer {
 
           inserts.emplace_back(mei.insn, replace);
           matcher.reset();
+          if (changed_blocks.empty() || changed_blocks.back() != b) {
+            changed_blocks.push_back(b);
+          }
         }
       }
 
@@ -1700,6 +1747,10 @@ class PeepholeOptimizer {
       for (auto& insn : deletes) {
         code->remove_opcode(insn);
       }
+      // The replacements stay in the block of the instructions they replace.
+      for (auto b : changed_blocks) {
+        scan_opcodes(b);
+      }
     }
   }
 
@@ -1754,12 +1805,16 @@ void PeepholePass::run_pass(DexStoresVector& stores,
           DexClass* cls) {
         PeepholeOptimizer* ph = state->get_data();
         for (auto dmethod : cls->get_dmethods()) {
-          TraceContext context(dmethod->get_deobfuscated_name());
-          ph->run_method(dmethod);
+          if (mgr.needs_revisit(dmethod)) {
+            TraceContext context(dmethod->get_deobfuscated_name());
+            ph->run_method(dmethod);
+          }
         }
         for (auto vmethod : cls->get_vmethods()) {
-          TraceContext context(vmethod->get_deobfuscated_name());
-          ph->run_method(vmethod);
+          if (mgr.needs_revisit(vmethod)) {
+            TraceContext context(vmethod->get_deobfuscated_name());
+            ph->run_method(vmethod);
+          }
         }
         return nullptr;
       },
@@ -1769,7 +1824,7 @@ void PeepholePass::run_pass(DexStoresVector& stores,
             mgr, config.disabled_peepholes));
         return helpers.back().get();
       },
-      std::thread::hardware_concurrency() / 2);
+      walk::parallel::default_num_threads());
   for (auto* cls : scope) {
     wq.add_item(cls);
   }
@@ -16,6 +16,11 @@ class PeepholePass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
+
   void bind_config() override {
     bind("disabled_peepholes", {}, config.disabled_peepholes);
   }
@@ -14,11 +14,13 @@
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "IRCode.h"
 #include "IRInstruction.h"
 #include "PassManager.h"
 #include "Resolver.h"
 #include "Util.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -103,197 +105,259 @@ DexMethod* bind_to_visible_ancestor(const DexClass* cls,
   return top_impl;
 }
 
-struct Rebinder {
-  Rebinder(Scope& scope, PassManager& mgr) : m_scope(scope), m_pass_mgr(mgr) {}
+template <typename T>
+struct RefStats {
+  int count = 0;
+  std::unordered_set<T> in;
+  std::unordered_set<T> out;
 
-  void rewrite_refs() {
-    walk::opcodes(m_scope,
-                  [](DexMethod*) { return true; },
-                  [&](DexMethod* m, IRInstruction* insn) {
-                    bool top_ancestor = false;
-                    switch (insn->opcode()) {
-                    case OPCODE_INVOKE_VIRTUAL:
-                      top_ancestor = true;
-                      // fallthrough
-                    case OPCODE_INVOKE_SUPER:
-                    case OPCODE_INVOKE_INTERFACE:
-                    case OPCODE_INVOKE_STATIC:
-                      rebind_method(insn, opcode_to_search(insn), top_ancestor);
-                      break;
-                    case OPCODE_SGET:
-                    case OPCODE_SGET_WIDE:
-                    case OPCODE_SGET_OBJECT:
-                    case OPCODE_SGET_BOOLEAN:
-                    case OPCODE_SGET_BYTE:
-                    case OPCODE_SGET_CHAR:
-                    case OPCODE_SGET_SHORT:
-                    case OPCODE_SPUT:
-                    case OPCODE_SPUT_WIDE:
-                    case OPCODE_SPUT_OBJECT:
-                    case OPCODE_SPUT_BOOLEAN:
-                    case OPCODE_SPUT_BYTE:
-                    case OPCODE_SPUT_CHAR:
-                    case OPCODE_SPUT_SHORT:
-                      rebind_field(insn, FieldSearch::Static);
-                      break;
-                    case OPCODE_IGET:
-                    case OPCODE_IGET_WIDE:
-                    case OPCODE_IGET_OBJECT:
-                    case OPCODE_IGET_BOOLEAN:
-                    case OPCODE_IGET_BYTE:
-                    case OPCODE_IGET_CHAR:
-                    case OPCODE_IGET_SHORT:
-                    case OPCODE_IPUT:
-                    case OPCODE_IPUT_WIDE:
-                    case OPCODE_IPUT_OBJECT:
-                    case OPCODE_IPUT_BOOLEAN:
-                    case OPCODE_IPUT_BYTE:
-                    case OPCODE_IPUT_CHAR:
-                    case OPCODE_IPUT_SHORT:
-                      rebind_field(insn, FieldSearch::Instance);
-                      break;
-                    default:
-                      break;
-                    }
-                  });
+  void insert(T tin, T tout) {
+    ++count;
+    in.emplace(tin);
+    out.emplace(tout);
   }
 
-  void print_stats() {
-    m_frefs.print("field_refs", &m_pass_mgr);
-    m_mrefs.print("method_refs", &m_pass_mgr);
-    m_array_clone_refs.print("array_clone", nullptr);
-    m_equals_refs.print("equals", nullptr);
-    m_hashCode_refs.print("hashCode", nullptr);
-    m_getClass_refs.print("getClass", nullptr);
+  void insert(T tin) { insert(tin, T()); }
+
+  void merge(const RefStats& that) {
+    count += that.count;
+    in.insert(that.in.begin(), that.in.end());
+    out.insert(that.out.begin(), that.out.end());
   }
 
- private:
-  template <typename T>
-  struct RefStats {
-    int count = 0;
-    std::unordered_set<T> in;
-    std::unordered_set<T> out;
-
-    void insert(T tin, T tout) {
-      ++count;
-      in.emplace(tin);
-      out.emplace(tout);
+  void print(const char* tag, PassManager* mgr) {
+    TRACE(BIND, 1, "%11s [call sites: %6d, old refs: %6lu, new refs: %6lu]",
+          tag, count, in.size(), out.size());
+
+    if (mgr) {
+      using std::string;
+      string tagStr{tag};
+      string count_metric = tagStr + string("_candidates");
+      string rebound_metric = tagStr + string("_rebound");
+      mgr->incr_metric(count_metric, count);
+
+      auto rebound =
+          static_cast<ssize_t>(in.size()) - static_cast<ssize_t>(out.size());
+      mgr->incr_metric(rebound_metric, rebound);
     }
+  }
+};
 
-    void insert(T tin) { insert(tin, T()); }
+/**
+ * What one worker rebound. Classes that rebound references now point into
+ * are only made public once all the workers are done, so that no worker
+ * writes access flags that another one might be reading.
+ */
+struct RebindState {
+  RefStats<DexFieldRef*> frefs;
+  RefStats<DexMethodRef*> mrefs;
+  RefStats<DexMethodRef*> array_clone_refs;
+  RefStats<DexMethodRef*> equals_refs;
+  RefStats<DexMethodRef*> hashCode_refs;
+  RefStats<DexMethodRef*> getClass_refs;
+  std::unordered_set<DexClass*> make_public;
+
+  void merge(const RebindState& that) {
+    frefs.merge(that.frefs);
+    mrefs.merge(that.mrefs);
+    array_clone_refs.merge(that.array_clone_refs);
+    equals_refs.merge(that.equals_refs);
+    hashCode_refs.merge(that.hashCode_refs);
+    getClass_refs.merge(that.getClass_refs);
+    make_public.insert(that.make_public.begin(), that.make_public.end());
+  }
+};
 
-    void print(const char* tag, PassManager* mgr) {
-      TRACE(BIND, 1, "%11s [call sites: %6d, old refs: %6lu, new refs: %6lu]",
-            tag, count, in.size(), out.size());
+struct Rebinder {
+  Rebinder(Scope& scope, PassManager& mgr) : m_scope(scope), m_pass_mgr(mgr) {}
 
-      if (mgr) {
-        using std::string;
-        string tagStr{tag};
-        string count_metric = tagStr + string("_candidates");
-        string rebound_metric = tagStr + string("_rebound");
-        mgr->incr_metric(count_metric, count);
+  void rewrite_refs() {
+    // References are resolved through the shared resolver cache, and each
+    // worker keeps its own stats, so the methods can all be rewritten in
+    // parallel.
+    auto num_threads = walk::parallel::default_num_threads();
+    std::vector<RebindState> worker_states(num_threads);
+    using State = WorkerState<DexClass*, std::nullptr_t, std::nullptr_t>;
+    auto wq = WorkQueue<DexClass*, std::nullptr_t, std::nullptr_t>(
+        [&](State* state, DexClass* cls) {
+          auto& rebind_state = worker_states[state->worker_id()];
+          walk::code(Scope{cls}, [&](DexMethod*, IRCode& code) {
+            for (auto& mie : InstructionIterable(&code)) {
+              rewrite_ref(mie.insn, rebind_state);
+            }
+          });
+          return nullptr;
+        },
+        [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+        [](unsigned int) { return nullptr; },
+        num_threads);
+    for (auto cls : m_scope) {
+      wq.add_item(cls);
+    }
+    wq.run_all();
 
-        auto rebound =
-            static_cast<ssize_t>(in.size()) - static_cast<ssize_t>(out.size());
-        mgr->incr_metric(rebound_metric, rebound);
-      }
+    for (const auto& rebind_state : worker_states) {
+      m_state.merge(rebind_state);
+    }
+    for (auto cls : m_state.make_public) {
+      set_public(cls);
     }
-  };
+  }
 
-  void rebind_method(IRInstruction* mop,
-                     MethodSearch search,
-                     bool top_ancestor) {
+  void print_stats() {
+    m_state.frefs.print("field_refs", &m_pass_mgr);
+    m_state.mrefs.print("method_refs", &m_pass_mgr);
+    m_state.array_clone_refs.print("array_clone", nullptr);
+    m_state.equals_refs.print("equals", nullptr);
+    m_state.hashCode_refs.print("hashCode", nullptr);
+    m_state.getClass_refs.print("getClass", nullptr);
+  }
+
+ private:
+  static void rewrite_ref(IRInstruction* insn, RebindState& state) {
+    bool top_ancestor = false;
+    switch (insn->opcode()) {
+    case OPCODE_INVOKE_VIRTUAL:
+      top_ancestor = true;
+      // fallthrough
+    case OPCODE_INVOKE_SUPER:
+    case OPCODE_INVOKE_INTERFACE:
+    case OPCODE_INVOKE_STATIC:
+      rebind_method(insn, opcode_to_search(insn), top_ancestor, state);
+      break;
+    case OPCODE_SGET:
+    case OPCODE_SGET_WIDE:
+    case OPCODE_SGET_OBJECT:
+    case OPCODE_SGET_BOOLEAN:
+    case OPCODE_SGET_BYTE:
+    case OPCODE_SGET_CHAR:
+    case OPCODE_SGET_SHORT:
+    case OPCODE_SPUT:
+    case OPCODE_SPUT_WIDE:
+    case OPCODE_SPUT_OBJECT:
+    case OPCODE_SPUT_BOOLEAN:
+    case OPCODE_SPUT_BYTE:
+    case OPCODE_SPUT_CHAR:
+    case OPCODE_SPUT_SHORT:
+      rebind_field(insn, FieldSearch::Static, state);
+      break;
+    case OPCODE_IGET:
+    case OPCODE_IGET_WIDE:
+    case OPCODE_IGET_OBJECT:
+    case OPCODE_IGET_BOOLEAN:
+    case OPCODE_IGET_BYTE:
+    case OPCODE_IGET_CHAR:
+    case OPCODE_IGET_SHORT:
+    case OPCODE_IPUT:
+    case OPCODE_IPUT_WIDE:
+    case OPCODE_IPUT_OBJECT:
+    case OPCODE_IPUT_BOOLEAN:
+    case OPCODE_IPUT_BYTE:
+    case OPCODE_IPUT_CHAR:
+    case OPCODE_IPUT_SHORT:
+      rebind_field(insn, FieldSearch::Instance, state);
+      break;
+    default:
+      break;
+    }
+  }
+
+  static void rebind_method(IRInstruction* mop,
+                            MethodSearch search,
+                            bool top_ancestor,
+                            RebindState& state) {
     const auto mref = mop->get_method();
     if (search == MethodSearch::Virtual && top_ancestor) {
       auto mtype = mref->get_class();
       if (is_array_clone(mref, mtype)) {
-        rebind_method_opcode(mop, mref, rebind_array_clone(mref));
+        rebind_method_opcode(mop, mref, rebind_array_clone(mref, state),
+                             state);
         return;
       }
       // leave java.lang.String alone not to interfere with OP_EXECUTE_INLINE
       // and possibly any smart handling of String
       static auto str = DexType::make_type("Ljava/lang/String;");
       if (mtype == str) return;
-      auto real_ref = rebind_object_methods(mref);
+      auto real_ref = rebind_object_methods(mref, state);
       if (real_ref) {
-        rebind_method_opcode(mop, mref, real_ref);
+        rebind_method_opcode(mop, mref, real_ref, state);
         return;
       }
       auto cls = type_class(mtype);
       real_ref =
           bind_to_visible_ancestor(cls, mref->get_name(), mref->get_proto());
-      rebind_method_opcode(mop, mref, real_ref);
+      rebind_method_opcode(mop, mref, real_ref, state);
       return;
     }
-    rebind_method_opcode(mop, mref, resolve_method(mref, search));
+    rebind_method_opcode(mop, mref, resolve_method_cached(mref, search),
+                         state);
   }
 
-  void rebind_method_opcode(IRInstruction* mop,
-                            DexMethodRef* mref,
-                            DexMethodRef* real_ref) {
+  static void rebind_method_opcode(IRInstruction* mop,
+                                   DexMethodRef* mref,
+                                   DexMethodRef* real_ref,
+                                   RebindState& state) {
     if (!real_ref || real_ref == mref || real_ref->is_external()) {
       return;
     }
     TRACE(BIND, 2, "Rebinding %s\n\t=>%s", SHOW(mref), SHOW(real_ref));
-    m_mrefs.insert(mref, real_ref);
+    state.mrefs.insert(mref, real_ref);
     mop->set_method(real_ref);
     auto cls = type_class(real_ref->get_class());
     if (cls != nullptr && !is_public(cls)) {
-      set_public(cls);
+      state.make_public.insert(cls);
     }
   }
 
-  bool is_array_clone(DexMethodRef* mref, DexType* mtype) {
+  static bool is_array_clone(DexMethodRef* mref, DexType* mtype) {
     static auto clone = DexString::make_string("clone");
     return is_array(mtype) && mref->get_name() == clone &&
            !is_primitive(get_array_type(mtype));
   }
 
-  DexMethodRef* rebind_array_clone(DexMethodRef* mref) {
+  static DexMethodRef* rebind_array_clone(DexMethodRef* mref,
+                                          RebindState& state) {
     DexMethodRef* real_ref = object_array_clone();
-    m_array_clone_refs.insert(mref, real_ref);
+    state.array_clone_refs.insert(mref, real_ref);
     return real_ref;
   }
 
-  DexMethodRef* rebind_object_methods(DexMethodRef* mref) {
+  static DexMethodRef* rebind_object_methods(DexMethodRef* mref,
+                                             RebindState& state) {
     if (is_object_equals(mref)) {
-      m_equals_refs.insert(mref);
+      state.equals_refs.insert(mref);
       return object_equals();
     } else if (is_object_hashCode(mref)) {
-      m_hashCode_refs.insert(mref);
+      state.hashCode_refs.insert(mref);
       return object_hashCode();
     } else if (is_object_getClass(mref)) {
-      m_getClass_refs.insert(mref);
+      state.getClass_refs.insert(mref);
       return object_getClass();
     }
     return nullptr;
   }
 
-  void rebind_field(IRInstruction* insn, FieldSearch field_search) {
+  static void rebind_field(IRInstruction* insn,
+                           FieldSearch field_search,
+                           RebindState& state) {
     const auto fref = insn->get_field();
-    const auto real_ref = resolve_field(fref, field_search);
+    const auto real_ref = resolve_field_cached(fref, field_search);
     if (real_ref && real_ref != fref) {
       auto cls = type_class(real_ref->get_class());
       always_assert(cls != nullptr);
       if (!is_public(cls)) {
         if (cls->is_external()) return;
-        set_public(cls);
+        state.make_public.insert(cls);
       }
       TRACE(BIND, 2, "Rebinding %s\n\t=>%s", SHOW(fref), SHOW(real_ref));
       insn->set_field(real_ref);
-      m_frefs.insert(fref, real_ref);
+      state.frefs.insert(fref, real_ref);
     }
   }
 
   Scope& m_scope;
   PassManager& m_pass_mgr;
-
-  RefStats<DexFieldRef*> m_frefs;
-  RefStats<DexMethodRef*> m_mrefs;
-  RefStats<DexMethodRef*> m_array_clone_refs;
-  RefStats<DexMethodRef*> m_equals_refs;
-  RefStats<DexMethodRef*> m_hashCode_refs;
-  RefStats<DexMethodRef*> m_getClass_refs;
+  RebindState m_state;
 };
 
 } // namespace
@@ -56,7 +56,8 @@ Stats replaced_virtual_refs(const TypeSystem& type_system, DexMethod* method) {
     auto opcode = insn->opcode();
     if (is_invoke_virtual(opcode) || opcode == OPCODE_INVOKE_INTERFACE) {
 
-      auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+      auto callee =
+          resolve_method_cached(insn->get_method(), opcode_to_search(insn));
       if (!callee) {
         continue;
       }
@@ -104,7 +105,8 @@ void ReBindVRefsPass::run_pass(DexStoresVector& stores,
                                ConfigFiles& /* conf */,
                                PassManager& mgr) {
   Scope scope = build_class_scope(stores);
-  TypeSystem type_system(scope);
+  const auto& type_system =
+      mgr.analysis_cache().get<TypeSystemAnalysis>(scope);
 
   Stats stats = walk::parallel::reduce_methods<Stats>(
       scope,
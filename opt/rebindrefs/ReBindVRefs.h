@@ -14,4 +14,9 @@ class ReBindVRefsPass : public Pass {
   ReBindVRefsPass() : Pass("ReBindVRefsPass") {}
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
 };
@@ -62,6 +62,8 @@ class ReduceArrayLiteralsPass : public Pass {
   void bind_config() override;
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_store_local() const override { return true; }
+
  private:
   size_t m_max_filled_elements;
   bool m_debug;
@@ -85,7 +85,7 @@ void ReduceGotosPass::process_code_switches(cfg::ControlFlowGraph& cfg,
     return;
   }
 
-  std::unique_ptr<LivenessFixpointIterator> liveness_iter;
+  std::shared_ptr<const LivenessFixpointIterator> liveness_iter;
 
   boost::optional<uint16_t> const_reg;
 
@@ -131,8 +131,7 @@ void ReduceGotosPass::process_code_switches(cfg::ControlFlowGraph& cfg,
       // We have exactly one relevant branch (that isn't effectively falling
       // through)
       if (!liveness_iter) {
-        liveness_iter.reset(new LivenessFixpointIterator(cfg));
-        liveness_iter->run(LivenessDomain(cfg.get_registers_size()));
+        liveness_iter = get_liveness(cfg);
       }
       auto live_out_vars = liveness_iter->get_live_out_vars_at(b);
       auto single_non_fallthrough_edge_it = std::find_if(
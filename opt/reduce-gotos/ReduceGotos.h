@@ -29,6 +29,13 @@ class ReduceGotosPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_store_local() const override { return true; }
+
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
+
   static Stats process_code(IRCode*);
   static void process_code_switches(cfg::ControlFlowGraph&, Stats&);
   static void process_code_ifs(cfg::ControlFlowGraph&, Stats&);
@@ -313,6 +313,7 @@ void Allocator::Stats::accumulate(const Allocator::Stats& that) {
   split_moves += that.split_moves;
   moves_coalesced += that.moves_coalesced;
   params_spill_early += that.params_spill_early;
+  spill_everywhere_fallbacks += that.spill_everywhere_fallbacks;
 }
 
 static bool has_2addr_form(IROpcode op) {
@@ -636,8 +637,9 @@ void Allocator::select_ranges(const IRCode* code,
       vreg_files.emplace(src, vreg_file);
     }
 
+    std::vector<reg_t> range_regs(insn->srcs().begin(), insn->srcs().end());
     reg_t range_base = find_best_range_fit(ig,
-                                           insn->srcs(),
+                                           range_regs,
                                            0,
                                            reg_transform->size,
                                            vreg_files,
@@ -1093,12 +1095,11 @@ void Allocator::allocate(DexMethod* method) {
 
     auto& cfg = code->cfg();
     cfg.calculate_exit_block();
-    LivenessFixpointIterator fixpoint_iter(cfg);
-    fixpoint_iter.run(LivenessDomain());
+    auto liveness = get_liveness(cfg);
 
     TRACE(REG, 5, "Allocating:\n%s", ::SHOW(code->cfg()));
     auto ig =
-        interference::build_graph(fixpoint_iter, code, initial_regs, range_set);
+        interference::build_graph(*liveness, code, initial_regs, range_set);
 
     // Make the `this` symreg conflict with every other one so that it never
     // gets overwritten in the method. See check_no_overwrite_this in
@@ -1114,9 +1115,10 @@ void Allocator::allocate(DexMethod* method) {
     if (first) {
       coalesce(&ig, code);
       first = false;
-      // After coalesce the live_out and live_in of blocks may change, so run
-      // LivenessFixpointIterator again.
-      fixpoint_iter.run(LivenessDomain());
+      // After coalesce the live_out and live_in of blocks may change, so get
+      // the liveness again. It is only recomputed if coalesce changed a
+      // register.
+      liveness = get_liveness(cfg);
       TRACE(REG, 5, "Post-coalesce:\n%s", ::SHOW(code->cfg()));
     } else {
       // TODO we should coalesce here too, but we'll need to avoid removing
@@ -1148,9 +1150,28 @@ void Allocator::allocate(DexMethod* method) {
     TRACE(REG, 5, "Transform after range alloc:\n%s", SHOW(reg_transform));
 
     if (!spill_plan.empty()) {
+      bool spill_everywhere = m_config.max_reiterations != 0 &&
+                              m_stats.spill_everywhere_fallbacks == 0 &&
+                              m_stats.reiteration_count >=
+                                  m_config.max_reiterations;
+      if (spill_everywhere) {
+        TRACE(REG, 3, "Out of reiterations, spilling everywhere in %s",
+              SHOW(method));
+        ++m_stats.spill_everywhere_fallbacks;
+        for (const auto& pair : ig.nodes()) {
+          const auto& node = pair.second;
+          if (!node.is_spilt() && node.max_vreg() < max_unsigned_value(16)) {
+            // Pretend that it couldn't be colored below the 16-bit limit, so
+            // that it gets spilled around every instruction that constrains
+            // it.
+            spill_plan.global_spills.emplace(pair.first,
+                                             max_unsigned_value(16));
+          }
+        }
+      }
       TRACE(REG, 5, "Spill plan:\n%s", SHOW(spill_plan));
-      if (m_config.use_splitting) {
-        calc_split_costs(fixpoint_iter, code, &split_costs);
+      if (m_config.use_splitting && !spill_everywhere) {
+        calc_split_costs(*liveness, code, &split_costs);
         find_split(ig, split_costs, &reg_transform, &spill_plan, &split_plan);
       }
       split_params(ig, spill_plan.param_spills, code);
@@ -1159,7 +1180,7 @@ void Allocator::allocate(DexMethod* method) {
       if (split_plan.split_around.size() > 0) {
         TRACE(REG, 5, "Split plan:\n%s", SHOW(split_plan));
         m_stats.split_moves +=
-            split(fixpoint_iter, split_plan, split_costs, ig, code);
+            split(*liveness, split_plan, split_costs, ig, code);
       }
 
       // Since we have inserted instructions, we need to rebuild the CFG to
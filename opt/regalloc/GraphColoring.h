@@ -83,6 +83,10 @@ class Allocator {
   struct Config {
     bool no_overwrite_this{false};
     bool use_splitting{false};
+    // After this many reiterations, spill every constrained symreg at once
+    // instead of only the ones that failed to color, so that the next
+    // iterations only have short spill ranges left to color. 0 means never.
+    size_t max_reiterations{0};
   };
 
   struct Stats {
@@ -93,6 +97,8 @@ class Allocator {
     size_t split_moves{0};
     size_t moves_coalesced{0};
     size_t params_spill_early{0};
+    // The number of methods that ran out of reiterations.
+    size_t spill_everywhere_fallbacks{0};
     size_t moves_inserted() const {
       return param_spill_moves + range_spill_moves + global_spill_moves +
              split_moves;
@@ -48,6 +48,35 @@ uint32_t edge_weight_helper(uint8_t u_width, uint8_t v_width) {
   return ((v_width - 1) >> (u_width - 1)) + 1;
 }
 
+constexpr reg_t EdgeMatrix::kMaxDenseRegs;
+
+uint8_t EdgeMatrix::get(reg_t u, reg_t v) const {
+  if (u == v) {
+    return 0;
+  }
+  OrderedPair<reg_t> pair(u, v);
+  if (pair.second < kMaxDenseRegs) {
+    auto i = index(pair.first, pair.second);
+    return i < m_entries.size() ? m_entries[i] : 0;
+  }
+  auto it = m_sparse.find(pair);
+  return it == m_sparse.end() ? 0 : it->second;
+}
+
+void EdgeMatrix::set(reg_t u, reg_t v, uint8_t flags) {
+  OrderedPair<reg_t> pair(u, v);
+  if (pair.second < kMaxDenseRegs) {
+    auto i = index(pair.first, pair.second);
+    if (i >= m_entries.size()) {
+      // Make room for all the pairs up to the larger register.
+      m_entries.resize(index(0, pair.second + 1), 0);
+    }
+    m_entries[i] |= flags;
+  } else {
+    m_sparse[pair] |= flags;
+  }
+}
+
 } // namespace impl
 
 using namespace impl;
@@ -87,7 +116,10 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   //
   // then the final state of the edge between s0 and s1 must be
   // non-coalesceable.
-  m_adj_matrix[Edge(u, v)] = m_adj_matrix[Edge(u, v)] || !can_coalesce;
+  m_edges.set(u, v,
+              can_coalesce
+                  ? EdgeMatrix::ADJACENT
+                  : EdgeMatrix::ADJACENT | EdgeMatrix::NOT_COALESCEABLE);
 }
 
 uint32_t Node::colorable_limit() const {
@@ -269,6 +301,7 @@ Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
                           reg_t initial_regs,
                           const RangeSet& range_set) {
   Graph graph;
+  graph.m_edges.reserve(code->get_registers_size());
   auto ii = InstructionIterable(code);
   for (auto it = ii.begin(); it != ii.end(); ++it) {
     GraphBuilder::update_node_constraints(it.unwrap(), range_set, &graph);
@@ -364,11 +397,8 @@ std::ostream& Graph::write_dot_format(std::ostream& o) const {
   o << "}\n";
 
   o << "containment graph {\n";
-  for (const auto& pair : m_containment_graph) {
-    auto reg1 = pair.first;
-    auto reg2 = pair.second;
-    o << reg1 << " -- " << reg2 << "\n";
-  }
+  m_edges.for_each_containment(
+      [&](reg_t reg1, reg_t reg2) { o << reg1 << " -- " << reg2 << "\n"; });
   o << "}\n";
   return o;
 }
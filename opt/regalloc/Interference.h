@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <boost/functional/hash.hpp>
 #include <boost/range/adaptor/filtered.hpp>
 #include <unordered_map>
@@ -83,6 +84,79 @@ inline size_t hash_value(const OrderedPair<T>& pair) {
   return seed;
 }
 
+/*
+ * The interference and containment edges between each pair of registers, as
+ * a triangular bit matrix indexed by register number: the pair u < v has
+ * the entry v * (v - 1) / 2 + u, so the matrix grows with the largest
+ * register without moving what it has already stored. Each entry holds four
+ * flags. Edges involving registers past kMaxDenseRegs, which would need too
+ * much memory, are kept in hash tables instead.
+ */
+class EdgeMatrix {
+ public:
+  enum Flag : uint8_t {
+    ADJACENT = 1,
+    NOT_COALESCEABLE = 2,
+    // The range of the smaller register contains the larger one, and vice
+    // versa.
+    CONTAINS_HIGHER = 4,
+    CONTAINS_LOWER = 8,
+  };
+
+  static constexpr reg_t kMaxDenseRegs = 1 << 13;
+
+  bool has(reg_t u, reg_t v, Flag flag) const { return get(u, v) & flag; }
+
+  void set(reg_t u, reg_t v, uint8_t flags);
+
+  // Makes room for the pairs of the registers below `num_regs` upfront.
+  void reserve(size_t num_regs) {
+    num_regs = std::min<size_t>(num_regs, kMaxDenseRegs);
+    m_entries.reserve(num_regs * (num_regs - 1) / 2);
+  }
+
+  // The containment flag for `u` containing `v`.
+  static Flag contains_flag(reg_t u, reg_t v) {
+    return u < v ? CONTAINS_HIGHER : CONTAINS_LOWER;
+  }
+
+  // Calls f(u, v) for each pair where u contains v.
+  template <typename F>
+  void for_each_containment(F f) const {
+    for (size_t v = 1; v * (v - 1) / 2 < m_entries.size(); ++v) {
+      for (size_t u = 0; u < v; ++u) {
+        auto flags = m_entries[v * (v - 1) / 2 + u];
+        if (flags & CONTAINS_HIGHER) {
+          f(u, v);
+        }
+        if (flags & CONTAINS_LOWER) {
+          f(v, u);
+        }
+      }
+    }
+    for (const auto& pair : m_sparse) {
+      if (pair.second & CONTAINS_HIGHER) {
+        f(pair.first.first, pair.first.second);
+      }
+      if (pair.second & CONTAINS_LOWER) {
+        f(pair.first.second, pair.first.first);
+      }
+    }
+  }
+
+ private:
+  static size_t index(reg_t lo, reg_t hi) {
+    return static_cast<size_t>(hi) * (hi - 1) / 2 + lo;
+  }
+
+  uint8_t get(reg_t u, reg_t v) const;
+
+  // Four bits would do, but a byte per entry keeps the lookups simple.
+  std::vector<uint8_t> m_entries;
+  using Pair = OrderedPair<reg_t>;
+  std::unordered_map<Pair, uint8_t, boost::hash<Pair>> m_sparse;
+};
+
 } // namespace impl
 
 class Node {
@@ -192,16 +266,15 @@ class Graph {
   }
 
   bool is_adjacent(reg_t u, reg_t v) const {
-    return m_adj_matrix.find(Edge(u, v)) != m_adj_matrix.end();
+    return m_edges.has(u, v, impl::EdgeMatrix::ADJACENT);
   }
 
   bool is_coalesceable(reg_t u, reg_t v) const {
-    return !is_adjacent(u, v) || !m_adj_matrix.at(Edge(u, v));
+    return !m_edges.has(u, v, impl::EdgeMatrix::NOT_COALESCEABLE);
   }
 
   bool has_containment_edge(reg_t u, reg_t v) const {
-    return m_containment_graph.find(ContainmentEdge(u, v)) !=
-           m_containment_graph.end();
+    return u != v && m_edges.has(u, v, impl::EdgeMatrix::contains_flag(u, v));
   }
 
   /*
@@ -235,16 +308,12 @@ class Graph {
     if (u == v) {
       return;
     }
-    m_containment_graph.emplace(ContainmentEdge(u, v));
+    m_edges.set(u, v, impl::EdgeMatrix::contains_flag(u, v));
   }
 
  private:
   std::unordered_map<reg_t, Node> m_nodes;
-  using Edge = impl::OrderedPair<reg_t>;
-  std::unordered_map<Edge, bool /* not_coalesceable */, boost::hash<Edge>>
-      m_adj_matrix;
-  std::unordered_set<ContainmentEdge, boost::hash<ContainmentEdge>>
-      m_containment_graph;
+  impl::EdgeMatrix m_edges;
   // This map contains the LivenessDomains for all instructions which could
   // potentialy take on the /range format.
   std::unordered_map<IRInstruction*, LivenessDomain> m_range_liveness;
@@ -28,12 +28,15 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
   regalloc::graph_coloring::Allocator::Config allocator_config;
   const auto& jw = mgr.get_current_pass_info()->config;
   jw.get("live_range_splitting", false, allocator_config.use_splitting);
+  jw.get("max_reiterations", size_t(0), allocator_config.max_reiterations);
   allocator_config.no_overwrite_this =
       mgr.get_redex_options().no_overwrite_this();
 
   using Output = graph_coloring::Allocator::Stats;
   auto scope = build_class_scope(stores);
-  auto stats = walk::parallel::reduce_methods<Output>(
+  // The largest methods take the longest to allocate, so they are started
+  // first to keep them from stretching the tail of the parallel phase.
+  auto stats = walk::parallel::reduce_methods_by_cost<Output>(
       scope,
       [&](DexMethod* m) { // mapper
         graph_coloring::Allocator::Stats stats;
@@ -83,12 +86,16 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
   TRACE(REG, 1, "  Total splits: %lu", stats.split_moves);
   TRACE(REG, 1, "Total coalesce count: %lu", stats.moves_coalesced);
   TRACE(REG, 1, "Total net moves: %ld", stats.net_moves());
+  TRACE(REG, 1, "Methods out of reiterations: %lu",
+        stats.spill_everywhere_fallbacks);
 
   mgr.incr_metric("param spilled too early", stats.params_spill_early);
   mgr.incr_metric("reiteration_count", stats.reiteration_count);
   mgr.incr_metric("spill_count", stats.moves_inserted());
   mgr.incr_metric("coalesce_count", stats.moves_coalesced);
   mgr.incr_metric("net_moves", stats.net_moves());
+  mgr.incr_metric("spill_everywhere_fallbacks",
+                  stats.spill_everywhere_fallbacks);
 
   mgr.record_running_regalloc();
 }
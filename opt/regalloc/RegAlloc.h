@@ -17,4 +17,9 @@ class RegAllocPass : public Pass {
   RegAllocPass() : Pass("RegAllocPass") {}
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
 };
@@ -10,12 +10,14 @@
 #include <boost/regex.hpp>
 #include <tuple>
 
+#include "ConcurrentContainers.h"
 #include "Dataflow.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "RemoveBuildersHelper.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -248,8 +250,8 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
     }
   }
 
-  std::unordered_set<DexType*> escaped_builders;
-  walk::methods(scope, [&](DexMethod* m) {
+  ConcurrentSet<DexType*> escaped_builders;
+  walk::parallel::methods(scope, [&](DexMethod* m) {
     auto builders = created_builders(m);
     for (DexType* builder : builders) {
       if (escapes_stack(builder, m)) {
@@ -265,7 +267,7 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
 
   std::unordered_set<DexType*> stack_only_builders;
   for (DexType* builder : m_builders) {
-    if (escaped_builders.find(builder) == escaped_builders.end()) {
+    if (escaped_builders.count(builder) == 0) {
       stack_only_builders.emplace(builder);
     }
   }
@@ -329,12 +331,24 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
 
   BuilderTransform b_transform(conf.get_inliner_config(), scope, stores, false);
 
+  // Find the builders that each method creates in parallel, then transform
+  // the methods one at a time in the order of the scope, as the transforms
+  // change the kept builders that later methods look at.
+  std::vector<DexMethod*> methods;
+  walk::methods(scope, [&](DexMethod* method) { methods.push_back(method); });
+  std::vector<std::vector<DexType*>> builders_created_by(methods.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { builders_created_by[i] = created_builders(methods[i]); });
+  for (size_t i = 0; i < methods.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
   // Inline non init methods.
   std::unordered_set<DexClass*> removed_builders;
-  walk::methods(scope, [&](DexMethod* method) {
-    auto builders = created_builders(method);
-
-    for (DexType* builder : builders) {
+  for (size_t i = 0; i < methods.size(); ++i) {
+    DexMethod* method = methods[i];
+    for (DexType* builder : builders_created_by[i]) {
       if (method->get_class() == builder) {
         continue;
       }
@@ -370,7 +384,7 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
         DexMethod::erase_method(method_copy);
       }
     }
-  });
+  }
 
   // No need to remove the builders here, since `RemoveUnreachable` will
   // take care of it.
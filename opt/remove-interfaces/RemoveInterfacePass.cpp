@@ -258,16 +258,14 @@ void remove_interface_references(
 
   walk::parallel::opcodes(scope, patcher);
 
-  std::unordered_map<const DexType*, DexType*> old_to_new;
+  TypeRefUpdateBatch type_ref_updates;
   for (const auto intf : interfaces) {
     auto new_type = get_replacement_type(type_system, intf, root);
-    old_to_new[intf] = const_cast<DexType*>(new_type);
+    type_ref_updates.add(intf, const_cast<DexType*>(new_type));
   }
   auto& parent_to_children =
       type_system.get_class_scopes().get_parent_to_children();
-  update_method_signature_type_references(scope, old_to_new,
-                                          parent_to_children);
-  update_field_type_references(scope, old_to_new);
+  type_ref_updates.apply(scope, parent_to_children);
 }
 
 size_t exclude_unremovables(
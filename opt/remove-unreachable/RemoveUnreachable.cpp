@@ -29,8 +29,27 @@ void RemoveUnreachablePass::run_pass(DexStoresVector& stores,
   }
   bool output_unreachable_symbols = pm.get_current_pass_info()->repeat == 0;
   int num_ignore_check_strings = 0;
-  auto reachables = reachability::compute_reachable_objects(
-      stores, m_ignore_sets, &num_ignore_check_strings);
+  reachability::MarkingStats marking_stats;
+  std::unique_ptr<reachability::ReachableObjects> reachables;
+  if (m_incremental_marking) {
+    if (!m_incremental) {
+      m_incremental = std::make_unique<reachability::IncrementalReachability>(
+          m_validate_incremental_marking);
+    }
+    auto hits_before = m_incremental->references_cache().hits();
+    auto misses_before = m_incremental->references_cache().misses();
+    reachables = m_incremental->compute(
+        stores, m_ignore_sets, &num_ignore_check_strings, &marking_stats);
+    pm.incr_metric("marking_methods_reused",
+                   m_incremental->references_cache().hits() - hits_before);
+    pm.incr_metric("marking_methods_gathered",
+                   m_incremental->references_cache().misses() - misses_before);
+  } else {
+    reachables = reachability::compute_reachable_objects(
+        stores, m_ignore_sets, &num_ignore_check_strings,
+        /* record_reachability */ false, /* should_mark_all_as_seed */ false,
+        /* out_method_override_graph */ nullptr, &marking_stats);
+  }
   reachability::ObjectCounts before = reachability::count_objects(stores);
   TRACE(RMU, 1, "before: %lu classes, %lu fields, %lu methods",
         before.num_classes, before.num_fields, before.num_methods);
@@ -40,6 +59,13 @@ void RemoveUnreachablePass::run_pass(DexStoresVector& stores,
   TRACE(RMU, 1, "after: %lu classes, %lu fields, %lu methods",
         after.num_classes, after.num_fields, after.num_methods);
   pm.incr_metric("num_ignore_check_strings", num_ignore_check_strings);
+  pm.incr_metric("marking_objects_marked", marking_stats.num_marked);
+  pm.incr_metric("marking_objects_visited", marking_stats.num_visited);
+  pm.incr_metric("marking_ms",
+                 static_cast<int>(marking_stats.seconds * 1000));
+  pm.set_metric("marking_objects_per_second",
+                static_cast<int>(marking_stats.throughput()));
+  pm.set_metric("marking_threads", marking_stats.num_threads);
   pm.incr_metric("classes_removed", before.num_classes - after.num_classes);
   pm.incr_metric("fields_removed", before.num_fields - after.num_fields);
   pm.incr_metric("methods_removed", before.num_methods - after.num_methods);
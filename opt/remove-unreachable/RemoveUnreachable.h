@@ -25,6 +25,11 @@ class RemoveUnreachablePass : public Pass {
          {},
          m_ignore_sets.system_annos);
     bind("keep_class_in_string", true, m_ignore_sets.keep_class_in_string);
+    bind("incremental_marking", false, m_incremental_marking,
+         "Reuse the references gathered from unchanged code across runs.");
+    bind("validate_incremental_marking", false,
+         m_validate_incremental_marking,
+         "Check each incremental marking against a full one.");
     after_configuration([this] {
       // To keep the backward compatability of this code, ensure that the
       // "MemberClasses" annotation is always in system_annos.
@@ -41,4 +46,8 @@ class RemoveUnreachablePass : public Pass {
 
  private:
   reachability::IgnoreSets m_ignore_sets;
+  bool m_incremental_marking;
+  bool m_validate_incremental_marking;
+  // Shared by all the runs of this pass when marking incrementally.
+  std::unique_ptr<reachability::IncrementalReachability> m_incremental;
 };
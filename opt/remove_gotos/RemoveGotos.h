@@ -15,5 +15,7 @@ class RemoveGotosPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_store_local() const override { return true; }
+
   size_t run(DexMethod*);
 };
@@ -14,6 +14,12 @@ namespace check_casts {
 
 namespace impl {
 
+bool CheckCastAnalysis::is_subtype(const DexType* type,
+                                   const DexType* base_type) const {
+  return m_index ? m_index->check_cast(type, base_type)
+                 : check_cast(type, base_type);
+}
+
 const CheckCastReplacements
 CheckCastAnalysis::collect_redundant_checks_replacement() {
   CheckCastReplacements redundant_check_casts;
@@ -25,9 +31,9 @@ CheckCastAnalysis::collect_redundant_checks_replacement() {
   auto* code = m_method->get_code();
   code->build_cfg(/* editable */ false);
   auto& cfg = code->cfg();
-  type_inference::TypeInference inference(cfg);
+  // Only the check-casts are looked at.
+  type_inference::TypeInference inference(cfg, /* lazy_environments */ true);
   inference.run(m_method);
-  auto& envs = inference.get_type_environments();
 
   for (auto& mie : InstructionIterable(code)) {
     IRInstruction* insn = mie.insn;
@@ -35,11 +41,11 @@ CheckCastAnalysis::collect_redundant_checks_replacement() {
       continue;
     }
     auto reg = insn->src(0);
-    auto& env = envs.at(insn);
+    auto env = *inference.get_type_environment(insn);
     auto type = env.get_type(reg);
     auto dex_type = env.get_dex_type(reg);
     if (type.equals(type_inference::TypeDomain(ZERO)) ||
-        (dex_type && check_cast(*dex_type, insn->get_type()))) {
+        (dex_type && is_subtype(*dex_type, insn->get_type()))) {
       auto src = insn->src(0);
       auto it = code->iterator_to(mie);
       auto dst = ir_list::move_result_pseudo_of(it)->dest();
@@ -10,6 +10,7 @@
 #include <boost/optional.hpp>
 #include <vector>
 
+#include "HierarchyIndex.h"
 #include "IRCode.h"
 
 namespace check_casts {
@@ -22,11 +23,19 @@ using CheckCastReplacements =
 class CheckCastAnalysis {
 
  public:
-  explicit CheckCastAnalysis(DexMethod* method) : m_method(method){};
+  /*
+   * Without an index, the subtyping questions walk the class hierarchy.
+   */
+  explicit CheckCastAnalysis(DexMethod* method,
+                             const HierarchyIndex* index = nullptr)
+      : m_method(method), m_index(index){};
   const CheckCastReplacements collect_redundant_checks_replacement();
 
  private:
+  bool is_subtype(const DexType* type, const DexType* base_type) const;
+
   DexMethod* m_method;
+  const HierarchyIndex* m_index;
 };
 
 } // namespace impl
@@ -7,6 +7,7 @@
 
 #include "RemoveRedundantCheckCasts.h"
 
+#include "AnalysisCache.h"
 #include "CheckCastAnalysis.h"
 #include "DexClass.h"
 #include "PassManager.h"
@@ -14,14 +15,15 @@
 
 namespace check_casts {
 
-size_t remove_redundant_check_casts(DexMethod* method) {
+size_t remove_redundant_check_casts(DexMethod* method,
+                                    const HierarchyIndex* index) {
   if (!method || !method->get_code()) {
     return 0;
   }
 
   auto* code = method->get_code();
   code->build_cfg(/* editable */ false);
-  impl::CheckCastAnalysis analysis(method);
+  impl::CheckCastAnalysis analysis(method, index);
   auto redundant_check_casts = analysis.collect_redundant_checks_replacement();
 
   for (const auto& pair : redundant_check_casts) {
@@ -42,11 +44,12 @@ void RemoveRedundantCheckCastsPass::run_pass(DexStoresVector& stores,
                                              ConfigFiles&,
                                              PassManager& mgr) {
   auto scope = build_class_scope(stores);
+  const auto& index = mgr.analysis_cache().get<HierarchyIndexAnalysis>(scope);
 
   size_t num_redundant_check_casts = walk::parallel::reduce_methods<size_t>(
       scope,
       [&](DexMethod* method) -> size_t {
-        return remove_redundant_check_casts(method);
+        return remove_redundant_check_casts(method, &index);
       },
       std::plus<size_t>());
 
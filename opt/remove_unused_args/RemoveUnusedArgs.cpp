@@ -8,7 +8,6 @@
 #include "RemoveUnusedArgs.h"
 
 #include <deque>
-#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -23,6 +22,7 @@
 #include "TypeSystem.h"
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 using namespace opt_metadata;
 
@@ -61,10 +61,11 @@ RemoveArgs::PassStats RemoveArgs::run() {
   pass_stats.method_params_removed_count =
       method_stats.method_params_removed_count;
   pass_stats.methods_updated_count = method_stats.methods_updated_count;
-  pass_stats.callsite_args_removed_count = update_callsites();
   pass_stats.method_results_removed_count =
       method_stats.method_results_removed_count;
-  pass_stats.local_dce_stats = method_stats.local_dce_stats;
+  auto code_stats = update_bodies_and_callsites();
+  pass_stats.callsite_args_removed_count = code_stats.callsite_args_removed;
+  pass_stats.local_dce_stats = code_stats.local_dce_stats;
   return pass_stats;
 }
 
@@ -174,16 +175,9 @@ std::deque<DexType*> RemoveArgs::get_live_arg_type_list(
 }
 
 /**
- * Returns true on successful update to the given method's signature, where
- * the updated args list is specified by live_args.
+ * Returns whether the black list allows changing the given method.
  */
-bool RemoveArgs::update_method_signature(
-    DexMethod* method,
-    const std::deque<uint16_t>& live_arg_idxs,
-    bool remove_result) {
-  always_assert_log(method->is_def(),
-                    "We don't treat virtuals, so methods must be defined\n");
-
+bool RemoveArgs::is_allowed(DexMethod* method) const {
   const std::string& full_name = method->get_deobfuscated_name();
   for (const auto& s : m_black_list) {
     if (full_name.find(s) != std::string::npos) {
@@ -193,42 +187,29 @@ bool RemoveArgs::update_method_signature(
       return false;
     }
   }
+  return true;
+}
 
-  auto num_orig_args = method->get_proto()->get_args()->get_type_list().size();
-  auto live_args = get_live_arg_type_list(method, live_arg_idxs);
-  auto live_args_list = DexTypeList::make_type_list(std::move(live_args));
-  DexType* rtype =
-      remove_result ? get_void_type() : method->get_proto()->get_rtype();
-  auto updated_proto = DexProto::make_proto(rtype, live_args_list);
-  always_assert(updated_proto != method->get_proto());
+/**
+ * Returns true on successful update to the given method's signature, to the
+ * name and proto of the entry.
+ */
+bool RemoveArgs::update_method_signature(DexMethod* method,
+                                         const Entry& entry) {
+  always_assert_log(method->is_def(),
+                    "We don't treat virtuals, so methods must be defined\n");
+  always_assert(entry.updated_proto != method->get_proto());
 
   auto colliding_method = DexMethod::get_method(
-      method->get_class(), method->get_name(), updated_proto);
+      method->get_class(), entry.updated_name, entry.updated_proto);
   if (colliding_method && colliding_method->is_def() &&
       is_constructor(static_cast<const DexMethod*>(colliding_method))) {
     // We can't rename constructors, so we give up on removing args.
     return false;
   }
 
-  auto name = method->get_name();
-  if (method->is_virtual()) {
-    // TODO: T31388603 -- Remove unused args for true virtuals.
-
-    // We need to worry about creating shadowing in the virtual scope ---
-    // for this particular method change, but also across all other upcoming
-    // method changes. To this end, we introduce unique names for each name and
-    // arg list to avoid any such overlaps.
-    size_t name_index = m_renamed_indices[name][live_args_list]++;
-    std::stringstream ss;
-    // This pass typically runs before the obfuscation pass, so we should not
-    // need to be concerned here about creating long method names.
-    // "uva" stands for unused virtual args
-    ss << name->str() << "$uva" << std::to_string(m_iteration) << "$"
-       << std::to_string(name_index);
-    name = DexString::make_string(ss.str());
-  }
-
-  DexMethodSpec spec(method->get_class(), name, updated_proto);
+  DexMethodSpec spec(method->get_class(), entry.updated_name,
+                     entry.updated_proto);
   method->change(spec,
                  true /* rename on collision */,
                  true /* update deobfuscated name */);
@@ -239,16 +220,13 @@ bool RemoveArgs::update_method_signature(
 }
 
 /**
- * For methods that have unused arguments, record live argument registers.
+ * For methods that have unused arguments or results, updates their signatures
+ * and records live argument registers.
  */
 RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
-  // Phase 1: Find (in parallel) all methods that we can potentially update
+  // Phase 1: Find (in parallel) all methods that we can potentially update,
+  // and what their updated protos are
 
-  struct Entry {
-    std::vector<IRInstruction*> dead_insns;
-    std::deque<uint16_t> live_arg_idxs;
-    bool remove_result;
-  };
   ConcurrentMap<DexMethod*, Entry> unordered_entries;
   walk::parallel::methods(m_scope, [&](DexMethod* method) {
     if (method->get_code() == nullptr) {
@@ -288,9 +266,22 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
       return;
     }
 
+    if (!is_allowed(method)) {
+      return;
+    }
+
+    auto live_args = get_live_arg_type_list(method, live_arg_idxs);
+    auto live_args_list = DexTypeList::make_type_list(std::move(live_args));
+    DexType* rtype = remove_result ? get_void_type() : proto->get_rtype();
+
     // Remember entry
-    unordered_entries.emplace(
-        method, (Entry){dead_insns, live_arg_idxs, remove_result});
+    Entry entry;
+    entry.dead_insns = std::move(dead_insns);
+    entry.live_arg_idxs = std::move(live_arg_idxs);
+    entry.remove_result = remove_result;
+    entry.updated_name = method->get_name();
+    entry.updated_proto = DexProto::make_proto(rtype, live_args_list);
+    unordered_entries.emplace(method, std::move(entry));
   });
 
   // Phase 2: Deterministically update proto (including (re)name as needed)
@@ -305,70 +296,117 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
               return compare_dexmethods(a.first, b.first);
             });
 
-  RemoveArgs::MethodStats method_stats;
+  // Renamed virtual methods get names that are unique for each name and arg
+  // list across all classes. Handing out the indices is cheap, so it is done
+  // in order up front; the names are then made in parallel.
+  std::vector<size_t> name_indices(ordered_entries.size());
+  std::unordered_map<DexString*, std::unordered_map<DexTypeList*, size_t>>
+      renamed_indices;
   std::vector<DexClass*> classes;
-  std::unordered_map<DexClass*, std::vector<std::pair<DexMethod*, Entry>>>
-      class_entries;
-  for (auto& p : ordered_entries) {
-    DexMethod* method = p.first;
-    const Entry& entry = p.second;
-    if (!update_method_signature(method, entry.live_arg_idxs,
-                                 entry.remove_result)) {
-      continue;
+  std::unordered_map<DexClass*, std::vector<size_t>> class_entries;
+  for (size_t i = 0; i < ordered_entries.size(); i++) {
+    DexMethod* method = ordered_entries[i].first;
+    const Entry& entry = ordered_entries[i].second;
+    if (method->is_virtual()) {
+      auto args = entry.updated_proto->get_args();
+      name_indices[i] = renamed_indices[entry.updated_name][args]++;
     }
-
-    // Remember entry for further processing, and log statistics
     DexClass* cls = type_class(method->get_class());
     classes.push_back(cls);
-    class_entries[cls].push_back(p);
-    method_stats.methods_updated_count++;
-    method_stats.method_params_removed_count += entry.dead_insns.size();
-    method_stats.method_results_removed_count += entry.remove_result ? 1 : 0;
+    class_entries[cls].push_back(i);
   }
   sort_unique(classes);
 
-  // Phase 3: Update body of updated methods (in parallel)
-
-  std::mutex local_dce_stats_mutex;
-  auto& local_dce_stats = method_stats.local_dce_stats;
-  walk::parallel::classes(classes, [&](DexClass* cls) {
-    for (auto& p : class_entries.at(cls)) {
-      DexMethod* method = p.first;
-      const Entry& entry = p.second;
-
-      if (!entry.dead_insns.empty()) {
-        // We update the method signature, so we must remove unused
-        // OPCODE_LOAD_PARAM_* to satisfy IRTypeChecker.
-        for (auto dead_insn : entry.dead_insns) {
-          method->get_code()->remove_opcode(dead_insn);
-        }
-        m_live_arg_idxs_map.emplace(method, entry.live_arg_idxs);
-      }
-
-      if (entry.remove_result) {
-        for (const auto& mie : InstructionIterable(method->get_code())) {
-          auto insn = mie.insn;
-          if (is_return_value(insn->opcode())) {
-            insn->set_opcode(OPCODE_RETURN_VOID);
-            insn->set_arg_word_count(0);
+  // Methods of different classes can never collide with each other, so the
+  // classes are updated in parallel, and the methods of each class in order.
+  std::vector<MethodStats> class_stats(classes.size());
+  std::vector<std::vector<size_t>> class_updated(classes.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t c) {
+        auto& stats = class_stats[c];
+        for (auto i : class_entries.at(classes[c])) {
+          DexMethod* method = ordered_entries[i].first;
+          Entry& entry = ordered_entries[i].second;
+          if (method->is_virtual()) {
+            // TODO: T31388603 -- Remove unused args for true virtuals.
+
+            // We need to worry about creating shadowing in the virtual scope
+            // --- for this particular method change, but also across all
+            // other upcoming method changes. To this end, we introduce unique
+            // names for each name and arg list to avoid any such overlaps.
+            std::stringstream ss;
+            // This pass typically runs before the obfuscation pass, so we
+            // should not need to be concerned here about creating long method
+            // names. "uva" stands for unused virtual args
+            ss << entry.updated_name->str() << "$uva"
+               << std::to_string(m_iteration) << "$"
+               << std::to_string(name_indices[i]);
+            entry.updated_name = DexString::make_string(ss.str());
           }
+          if (!update_method_signature(method, entry)) {
+            continue;
+          }
+          if (!entry.dead_insns.empty()) {
+            m_live_arg_idxs_map.emplace(method, entry.live_arg_idxs);
+          }
+          class_updated[c].push_back(i);
+          stats.methods_updated_count++;
+          stats.method_params_removed_count += entry.dead_insns.size();
+          stats.method_results_removed_count += entry.remove_result ? 1 : 0;
         }
+      },
+      walk::parallel::default_num_threads());
+  for (size_t c = 0; c < classes.size(); c++) {
+    wq.add_item(c);
+  }
+  wq.run_all();
 
-        std::unordered_set<DexMethodRef*> pure_methods;
-        auto local_dce = LocalDce(pure_methods);
-        local_dce.dce(method->get_code());
-        const auto& stats = local_dce.get_stats();
-        if (stats.dead_instruction_count |
-            stats.unreachable_instruction_count) {
-          std::lock_guard<std::mutex> lock(local_dce_stats_mutex);
-          local_dce_stats = add_dce_stats(local_dce_stats, stats);
-        }
-      }
+  RemoveArgs::MethodStats method_stats;
+  for (size_t c = 0; c < classes.size(); c++) {
+    const auto& stats = class_stats[c];
+    method_stats.methods_updated_count += stats.methods_updated_count;
+    method_stats.method_params_removed_count +=
+        stats.method_params_removed_count;
+    method_stats.method_results_removed_count +=
+        stats.method_results_removed_count;
+    for (auto i : class_updated[c]) {
+      m_updated_entries.emplace(std::move(ordered_entries[i]));
     }
-  });
+  }
   return method_stats;
 }
 
+/**
+ * Removes the unused param loads and results from the body of an updated
+ * method.
+ */
+LocalDce::Stats RemoveArgs::update_body(DexMethod* method,
+                                        const Entry& entry) {
+  if (!entry.dead_insns.empty()) {
+    // We update the method signature, so we must remove unused
+    // OPCODE_LOAD_PARAM_* to satisfy IRTypeChecker.
+    for (auto dead_insn : entry.dead_insns) {
+      method->get_code()->remove_opcode(dead_insn);
+    }
+  }
+
+  if (!entry.remove_result) {
+    return {0, 0};
+  }
+  for (const auto& mie : InstructionIterable(method->get_code())) {
+    auto insn = mie.insn;
+    if (is_return_value(insn->opcode())) {
+      insn->set_opcode(OPCODE_RETURN_VOID);
+      insn->set_arg_word_count(0);
+    }
+  }
+
+  std::unordered_set<DexMethodRef*> pure_methods;
+  auto local_dce = LocalDce(pure_methods);
+  local_dce.dce(method->get_code());
+  return local_dce.get_stats();
+}
+
 /**
  * Removes dead arguments from the given invoke instr if applicable.
  * Returns the number of arguments removed.
@@ -399,19 +437,24 @@ size_t RemoveArgs::update_callsite(IRInstruction* instr) {
 }
 
 /**
- * Removes unused arguments at callsites and returns the number of arguments
- * removed.
+ * Phase 3: Updates the bodies of updated methods, and removes unused arguments
+ * at callsites, all in one parallel walk.
  */
-size_t RemoveArgs::update_callsites() {
+RemoveArgs::CodeStats RemoveArgs::update_bodies_and_callsites() {
   // Walk through all methods to look for and edit callsites.
-  return walk::parallel::reduce_methods<size_t>(
+  return walk::parallel::reduce_methods<CodeStats>(
       m_scope,
-      [&](DexMethod* method) -> size_t {
+      [&](DexMethod* method) -> CodeStats {
+        CodeStats code_stats;
         auto code = method->get_code();
         if (code == nullptr) {
-          return 0;
+          return code_stats;
+        }
+        auto it = m_updated_entries.find(method);
+        if (it != m_updated_entries.end()) {
+          code_stats.local_dce_stats = update_body(method, it->second);
         }
-        size_t callsite_args_removed = 0;
+        auto& callsite_args_removed = code_stats.callsite_args_removed;
         for (const auto& mie : InstructionIterable(code)) {
           auto insn = mie.insn;
           if (is_invoke(insn->opcode())) {
@@ -422,9 +465,14 @@ size_t RemoveArgs::update_callsites() {
             }
           }
         }
-        return callsite_args_removed;
+        return code_stats;
       },
-      [](size_t a, size_t b) { return a + b; });
+      [](CodeStats a, const CodeStats& b) {
+        a.callsite_args_removed += b.callsite_args_removed;
+        a.local_dce_stats =
+            add_dce_stats(a.local_dce_stats, b.local_dce_stats);
+        return a;
+      });
 }
 
 void RemoveUnusedArgsPass::run_pass(DexStoresVector& stores,
@@ -22,6 +22,9 @@ class RemoveArgs {
     size_t method_params_removed_count{0};
     size_t method_results_removed_count{0};
     size_t methods_updated_count{0};
+  };
+  struct CodeStats {
+    size_t callsite_args_removed{0};
     LocalDce::Stats local_dce_stats{0, 0};
   };
   struct PassStats {
@@ -46,23 +49,31 @@ class RemoveArgs {
       std::vector<IRInstruction*>* dead_insns);
 
  private:
+  // A method whose signature is to be updated, and how.
+  struct Entry {
+    std::vector<IRInstruction*> dead_insns;
+    std::deque<uint16_t> live_arg_idxs;
+    bool remove_result;
+    DexString* updated_name;
+    DexProto* updated_proto;
+  };
+
   const Scope& m_scope;
   const TypeSystem m_type_system;
   ConcurrentMap<DexMethod*, std::deque<uint16_t>> m_live_arg_idxs_map;
-  std::unordered_map<DexString*, std::unordered_map<DexTypeList*, size_t>>
-      m_renamed_indices;
+  std::unordered_map<DexMethod*, Entry> m_updated_entries;
   ConcurrentSet<DexMethod*> m_result_used;
   const std::vector<std::string>& m_black_list;
   size_t m_iteration;
 
   std::deque<DexType*> get_live_arg_type_list(
       DexMethod* method, const std::deque<uint16_t>& live_arg_idxs);
-  bool update_method_signature(DexMethod* method,
-                               const std::deque<uint16_t>& live_args,
-                               bool remove_result);
+  bool is_allowed(DexMethod* method) const;
+  bool update_method_signature(DexMethod* method, const Entry& entry);
   MethodStats update_meths_with_unused_args_or_results();
+  LocalDce::Stats update_body(DexMethod* method, const Entry& entry);
   size_t update_callsite(IRInstruction* instr);
-  size_t update_callsites();
+  CodeStats update_bodies_and_callsites();
   void gather_results_used();
 };
 
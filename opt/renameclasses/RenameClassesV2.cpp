@@ -8,6 +8,7 @@
 #include "RenameClassesV2.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/regex.hpp>
 #include <map>
@@ -87,36 +88,37 @@ bool dont_rename_reason_to_metric_per_rule(DontRenameReasonCode reason) {
 }
 
 void unpackage_private(Scope &scope) {
-  walk::methods(scope,
-      [&](DexMethod *method) {
-        if (is_package_protected(method)) set_public(method);
-      });
-  walk::fields(scope,
-      [&](DexField *field) {
-        if (is_package_protected(field)) set_public(field);
-      });
-  for (auto clazz : scope) {
+  static DexType *dalvikinner =
+    DexType::get_type("Ldalvik/annotation/InnerClass;");
+
+  // Everything here only touches the class itself and its members, so the
+  // classes are done in parallel, in one sweep.
+  walk::parallel::classes(scope, [&](DexClass* clazz) {
+    const Scope classes{clazz};
+    walk::methods(classes, [](DexMethod* method) {
+      if (is_package_protected(method)) set_public(method);
+    });
+    walk::fields(classes, [](DexField* field) {
+      if (is_package_protected(field)) set_public(field);
+    });
     if (!clazz->is_external()) {
       set_public(clazz);
     }
-  }
-
-  static DexType *dalvikinner =
-    DexType::get_type("Ldalvik/annotation/InnerClass;");
 
-  walk::annotations(scope, [&](DexAnnotation* anno) {
-    if (anno->type() != dalvikinner) return;
-    auto elems = anno->anno_elems();
-    for (auto elem : elems) {
-      // Fix access flags on all @InnerClass annotations
-      if (!strcmp("accessFlags", elem.string->c_str())) {
-        always_assert(elem.encoded_value->evtype() == DEVT_INT);
-        elem.encoded_value->value(
-            (elem.encoded_value->value() & ~VISIBILITY_MASK) | ACC_PUBLIC);
-        TRACE(RENAME, 3, "Fix InnerClass accessFlags %s => %08x",
-            elem.string->c_str(), elem.encoded_value->value());
+    walk::annotations(classes, [&](DexAnnotation* anno) {
+      if (anno->type() != dalvikinner) return;
+      auto elems = anno->anno_elems();
+      for (auto elem : elems) {
+        // Fix access flags on all @InnerClass annotations
+        if (!strcmp("accessFlags", elem.string->c_str())) {
+          always_assert(elem.encoded_value->evtype() == DEVT_INT);
+          elem.encoded_value->value(
+              (elem.encoded_value->value() & ~VISIBILITY_MASK) | ACC_PUBLIC);
+          TRACE(RENAME, 3, "Fix InnerClass accessFlags %s => %08x",
+              elem.string->c_str(), elem.encoded_value->value());
+        }
       }
-    }
+    });
   });
 }
 
@@ -216,21 +218,35 @@ RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
     }
   }
 
-  walk::opcodes(scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* m, IRInstruction* insn) {
-        if (insn->has_method()) {
-          auto callee = insn->get_method();
-          if (callee == nullptr || !callee->is_concrete()) return;
-          auto callee_method_cls = callee->get_class();
-          if (refl_map.count(callee_method_cls) == 0) return;
-          std::string classname = m->get_class()->get_name()->str();
-          TRACE(RENAME, 4,
-            "Found %s with known reflection usage. marking reachable",
-            classname.c_str());
-          dont_rename_class_for_types_with_reflection.insert(classname);
-        }
-  });
+  // Each class is looked at on its own, in parallel, and only records
+  // whether its code calls into one of the types.
+  std::vector<char> uses_reflection(scope.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        walk::opcodes(
+            Scope{scope[i]}, [](DexMethod*) { return true; },
+            [&](DexMethod*, IRInstruction* insn) {
+              if (uses_reflection[i] || !insn->has_method()) return;
+              auto callee = insn->get_method();
+              if (callee == nullptr || !callee->is_concrete()) return;
+              auto callee_method_cls = callee->get_class();
+              if (refl_map.count(callee_method_cls) == 0) return;
+              uses_reflection[i] = true;
+            });
+      },
+      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  for (size_t i = 0; i < scope.size(); ++i) {
+    if (!uses_reflection[i]) continue;
+    std::string classname = scope[i]->get_name()->str();
+    TRACE(RENAME, 4,
+      "Found %s with known reflection usage. marking reachable",
+      classname.c_str());
+    dont_rename_class_for_types_with_reflection.insert(classname);
+  }
   return dont_rename_class_for_types_with_reflection;
 }
 
@@ -742,6 +758,11 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
   unpackage_private(scope);
 
   AliasMap aliases;
+  // The const-string rewrites for the force renamed classes, from both the
+  // internal and the external form of the old name to the same form of the
+  // new one. Strings that name no class aren't in it, so looking a string up
+  // is all the rewrite below has to do.
+  std::unordered_map<const DexString*, DexString*> const_string_renames;
   uint32_t sequence = 0;
   for (auto clazz : scope) {
     auto dtype = clazz->get_type();
@@ -793,6 +814,19 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
 
     auto dstring = DexString::make_string(prefixed_descriptor);
     aliases.add_class_alias(clazz, dstring);
+    if (m_force_rename_classes.count(clazz)) {
+      // get_string instead of make_string here because if the string doesn't
+      // already exist, then no const-string can name the class with it.
+      auto external_name = DexString::get_string(
+          JavaNameUtil::internal_to_external(oldname->str()));
+      if (external_name != nullptr) {
+        const_string_renames.emplace(
+            external_name,
+            DexString::make_string(
+                JavaNameUtil::internal_to_external(dstring->str())));
+      }
+      const_string_renames.emplace(oldname, dstring);
+    }
     dtype->set_name(dstring);
     std::string old_str(oldname->c_str());
     // std::string new_str(descriptor);
@@ -820,75 +854,54 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
     }
   }
 
-  /* Now rewrite all const-string strings for force renamed classes. */
-  auto match = std::make_tuple(m::const_string());
-
-  walk::matching_opcodes(
-      scope, match,
-      [&](const DexMethod*, const std::vector<IRInstruction*>& insns) {
-        IRInstruction* insn = insns[0];
-        DexString* str = insn->get_string();
-        // get_string instead of make_string here because if the string doesn't
-        // already exist, then there's no way it can match a class
-        // that was renamed
-        DexString* internal_str = DexString::get_string(
-            JavaNameUtil::external_to_internal(str->c_str()).c_str());
-        // Look up both str and intternal_str in the map; maybe str was
-        // internal to begin with?
-        DexString* alias_from = nullptr;
-        DexString* alias_to = nullptr;
-        if (aliases.has(internal_str)) {
-          alias_from = internal_str;
-          alias_to = aliases.at(internal_str);
-          // Since we matched on external form, we need to map internal alias
-          // back.
-          // make_string here because the external form of the name may not be
-          // present in the string table
-          alias_to = DexString::make_string(
-              JavaNameUtil::internal_to_external(alias_to->str()));
-        } else if (aliases.has(str)) {
-          alias_from = str;
-          alias_to = aliases.at(str);
-        }
-        if (alias_to) {
-          DexType* alias_from_type = DexType::get_type(alias_from);
-          DexClass* alias_from_cls = type_class(alias_from_type);
-          if (m_force_rename_classes.count(alias_from_cls)) {
-            mgr.incr_metric(METRIC_REWRITTEN_CONST_STRINGS, 1);
-            insn->set_string(alias_to);
-            TRACE(RENAME, 3, "Rewrote const-string \"%s\" to \"%s\"",
-                str->c_str(), alias_to->c_str());
-          }
-        }
-      });
-
-  /* Now we need to re-write the Signature annotations.  They use
-   * Strings rather than Type's, so they have to be explicitly
-   * handled.
+  /* Now rewrite all const-string strings for force renamed classes, and
+   * re-write the Signature annotations.  They use Strings rather than
+   * Type's, so they have to be explicitly handled.  Both only touch the
+   * class at hand, so this is one parallel sweep over the classes.
    */
   static DexType *dalviksig =
     DexType::get_type("Ldalvik/annotation/Signature;");
-  walk::annotations(scope, [&](DexAnnotation* anno) {
-    if (anno->type() != dalviksig) return;
-    auto elems = anno->anno_elems();
-    for (auto elem : elems) {
-      auto ev = elem.encoded_value;
-      if (ev->evtype() != DEVT_ARRAY) continue;
-      auto arrayev = static_cast<DexEncodedValueArray*>(ev);
-      auto const& evs = arrayev->evalues();
-      for (auto strev : *evs) {
-        if (strev->evtype() != DEVT_STRING) continue;
-        auto stringev = static_cast<DexEncodedValueString*>(strev);
-        DexString* old_str = stringev->string();
-        DexString* new_str = lookup_signature_annotation(aliases, old_str);
-        if (new_str != nullptr) {
-          TRACE(RENAME, 5, "Rewriting Signature from '%s' to '%s'",
-                old_str->c_str(), new_str->c_str());
-          stringev->string(new_str);
+  std::atomic<size_t> rewritten_const_strings{0};
+  walk::parallel::classes(scope, [&](DexClass* clazz) {
+    const Scope classes{clazz};
+    walk::opcodes(
+        classes, [](DexMethod*) { return true; },
+        [&](DexMethod*, IRInstruction* insn) {
+          if (insn->opcode() != OPCODE_CONST_STRING) return;
+          DexString* str = insn->get_string();
+          auto it = const_string_renames.find(str);
+          if (it == const_string_renames.end()) return;
+          rewritten_const_strings++;
+          insn->set_string(it->second);
+          TRACE(RENAME, 3, "Rewrote const-string \"%s\" to \"%s\"",
+              str->c_str(), it->second->c_str());
+        });
+
+    walk::annotations(classes, [&](DexAnnotation* anno) {
+      if (anno->type() != dalviksig) return;
+      auto elems = anno->anno_elems();
+      for (auto elem : elems) {
+        auto ev = elem.encoded_value;
+        if (ev->evtype() != DEVT_ARRAY) continue;
+        auto arrayev = static_cast<DexEncodedValueArray*>(ev);
+        auto const& evs = arrayev->evalues();
+        for (auto strev : *evs) {
+          if (strev->evtype() != DEVT_STRING) continue;
+          auto stringev = static_cast<DexEncodedValueString*>(strev);
+          DexString* old_str = stringev->string();
+          DexString* new_str = lookup_signature_annotation(aliases, old_str);
+          if (new_str != nullptr) {
+            TRACE(RENAME, 5, "Rewriting Signature from '%s' to '%s'",
+                  old_str->c_str(), new_str->c_str());
+            stringev->string(new_str);
+          }
         }
       }
-    }
+    });
   });
+  if (rewritten_const_strings > 0) {
+    mgr.incr_metric(METRIC_REWRITTEN_CONST_STRINGS, rewritten_const_strings);
+  }
 
   rename_classes_in_layouts(aliases, mgr);
 
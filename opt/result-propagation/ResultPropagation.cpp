@@ -7,9 +7,11 @@
 
 #include "ResultPropagation.h"
 
+#include <atomic>
 #include <vector>
 
 #include "BaseIRAnalyzer.h"
+#include "CallGraph.h"
 #include "ConstantAbstractDomain.h"
 #include "ControlFlow.h"
 #include "IRCode.h"
@@ -93,8 +95,7 @@ class Analyzer final : public BaseIRAnalyzer<ParamDomainEnvironment> {
  public:
   Analyzer(cfg::ControlFlowGraph& cfg,
            const ReturnParamResolver& resolver,
-           const std::unordered_map<const DexMethod*, ParamIndex>&
-               methods_which_return_parameter)
+           const ReturnParamSummaries& methods_which_return_parameter)
       : BaseIRAnalyzer(cfg),
         m_resolver(resolver),
         m_methods_which_return_parameter(methods_which_return_parameter),
@@ -234,11 +235,71 @@ class Analyzer final : public BaseIRAnalyzer<ParamDomainEnvironment> {
 
  private:
   const ReturnParamResolver& m_resolver;
-  const std::unordered_map<const DexMethod*, ParamIndex>&
-      m_methods_which_return_parameter;
+  const ReturnParamSummaries& m_methods_which_return_parameter;
   const std::unordered_map<const IRInstruction*, ParamIndex> m_load_param_map;
   mutable MethodRefCache m_resolved_refs;
 };
+
+bool may_return_parameter(const DexMethod* method) {
+  return method->get_code() != nullptr && !method->get_proto()->is_void();
+}
+
+/*
+ * The calls of this graph are the methods whose results the analysis of a
+ * method looks up: the resolved callee of each invoke, and for virtual calls
+ * all the methods that override it.
+ */
+class ReturnParamDependencies final : public call_graph::BuildStrategy {
+ public:
+  ReturnParamDependencies(const Scope& scope,
+                          const method_override_graph::Graph& graph)
+      : m_scope(scope), m_graph(graph) {}
+
+  call_graph::CallSites get_callsites(const DexMethod* method) const override {
+    call_graph::CallSites callsites;
+    if (!may_return_parameter(method)) {
+      return callsites;
+    }
+    auto* code = const_cast<IRCode*>(method->get_code());
+    MethodRefCache resolved_refs;
+    for (auto& mie : InstructionIterable(code)) {
+      const auto insn = mie.insn;
+      if (!is_invoke(insn->opcode()) ||
+          insn->get_method()->get_proto()->is_void()) {
+        continue;
+      }
+      const auto callee = resolve_method(
+          insn->get_method(), opcode_to_search(insn), resolved_refs);
+      if (callee == nullptr) {
+        continue;
+      }
+      const auto it = code->iterator_to(mie);
+      callsites.emplace_back(callee, it);
+      if (insn->opcode() == OPCODE_INVOKE_VIRTUAL ||
+          insn->opcode() == OPCODE_INVOKE_INTERFACE) {
+        for (auto* overriding :
+             method_override_graph::get_overriding_methods(m_graph, callee)) {
+          callsites.emplace_back(const_cast<DexMethod*>(overriding), it);
+        }
+      }
+    }
+    return callsites;
+  }
+
+  std::vector<DexMethod*> get_roots() const override {
+    std::vector<DexMethod*> roots;
+    walk::methods(m_scope, [&](DexMethod* method) {
+      if (may_return_parameter(method)) {
+        roots.push_back(method);
+      }
+    });
+    return roots;
+  }
+
+ private:
+  const Scope& m_scope;
+  const method_override_graph::Graph& m_graph;
+};
 } // namespace
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -258,8 +319,7 @@ const std::unordered_map<const IRInstruction*, ParamIndex> get_load_param_map(
 
 const boost::optional<ParamIndex> ReturnParamResolver::get_return_param_index(
     IRInstruction* insn,
-    const std::unordered_map<const DexMethod*, ParamIndex>&
-        methods_which_return_parameter,
+    const ReturnParamSummaries& methods_which_return_parameter,
     MethodRefCache& resolved_refs) const {
   always_assert(is_invoke(insn->opcode()));
   const auto method = insn->get_method();
@@ -285,11 +345,10 @@ const boost::optional<ParamIndex> ReturnParamResolver::get_return_param_index(
     always_assert(opcode == OPCODE_INVOKE_VIRTUAL ||
                   opcode == OPCODE_INVOKE_INTERFACE);
   } else {
-    const auto& mwrpit = methods_which_return_parameter.find(callee);
-    if (mwrpit == methods_which_return_parameter.end()) {
+    if (!methods_which_return_parameter.count(callee)) {
       return boost::none;
     }
-    param = ParamDomain(mwrpit->second);
+    param = ParamDomain(methods_which_return_parameter.at(callee));
   }
 
   if (opcode == OPCODE_INVOKE_VIRTUAL || opcode == OPCODE_INVOKE_INTERFACE) {
@@ -298,11 +357,11 @@ const boost::optional<ParamIndex> ReturnParamResolver::get_return_param_index(
     const auto overriding_methods =
         method_override_graph::get_overriding_methods(m_graph, callee);
     for (auto* overriding : overriding_methods) {
-      const auto& mwrpit = methods_which_return_parameter.find(overriding);
-      if (mwrpit == methods_which_return_parameter.end()) {
+      if (!methods_which_return_parameter.count(overriding)) {
         return boost::none;
       }
-      param.join_with(ParamDomain(mwrpit->second));
+      param.join_with(
+          ParamDomain(methods_which_return_parameter.at(overriding)));
       if (param.is_top()) {
         // Bail out early if possible; it's the common case
         return boost::none;
@@ -390,8 +449,7 @@ bool ReturnParamResolver::returns_receiver(const DexMethodRef* method) const {
 
 const boost::optional<ParamIndex> ReturnParamResolver::get_return_param_index(
     cfg::ControlFlowGraph& cfg,
-    const std::unordered_map<const DexMethod*, ParamIndex>&
-        methods_which_return_parameter) const {
+    const ReturnParamSummaries& methods_which_return_parameter) const {
   Analyzer analyzer(cfg, *this, methods_which_return_parameter);
   auto return_param_index = ParamDomain::bottom();
   // join together return values of all blocks which end with a
@@ -474,8 +532,9 @@ void ResultPropagationPass::run_pass(DexStoresVector& stores,
                                      ConfigFiles& /* conf */,
                                      PassManager& mgr) {
   const auto scope = build_class_scope(stores);
-  const auto method_override_graph = method_override_graph::build_graph(scope);
-  ReturnParamResolver resolver(*method_override_graph);
+  const auto& method_override_graph =
+      mgr.analysis_cache().get<MethodOverrideGraphAnalysis>(scope);
+  ReturnParamResolver resolver(method_override_graph);
   const auto methods_which_return_parameter =
       find_methods_which_return_parameter(mgr, scope, resolver);
 
@@ -511,9 +570,13 @@ void ResultPropagationPass::run_pass(DexStoresVector& stores,
         stats.patched_move_results, stats.unverifiable_move_results);
 }
 
-const std::unordered_map<const DexMethod*, ParamIndex>
+ReturnParamSummaries
 ResultPropagationPass::find_methods_which_return_parameter(
     PassManager& mgr, const Scope& scope, const ReturnParamResolver& resolver) {
+  const auto graph = call_graph::build_graph_in_parallel(
+      scope, ReturnParamDependencies(scope, resolver.get_graph()));
+  const call_graph::Sccs sccs(graph);
+
   walk::parallel::code(scope, [](DexMethod* method, IRCode& code) {
     const auto proto = method->get_proto();
     if (!proto->is_void()) {
@@ -522,70 +585,47 @@ ResultPropagationPass::find_methods_which_return_parameter(
     }
   });
 
-  std::unordered_map<const DexMethod*, ParamIndex>
-      methods_which_return_parameter;
-  // We iterate a few times to capture chains of method calls that all
-  // eventually return `this`.
-  // TODO(perf): Add flag to limit number of iterations
-  // TODO(perf): For each analyzed method, keep track of the reasons (a set of
-  // methods) why the call resolution gave up, and use that "dependency"
-  // information to limit what needs to be processed in subsequent iterations
-  while (true) {
-    mgr.incr_metric(METRIC_METHODS_WHICH_RETURN_PARAMETER_ITERATIONS, 1);
-    const auto next_methods_which_return_parameter =
-        walk::parallel::reduce_methods<
-            std::unordered_map<const DexMethod*, ParamIndex>>(
-            scope,
-            [&](DexMethod* method) {
-              std::unordered_map<const DexMethod*, ParamIndex> res;
-
-              const auto code = method->get_code();
-              if (code == nullptr) {
-                return res;
-              }
-              const auto proto = method->get_proto();
-              if (proto->is_void()) {
-                // void methods cannot return a parameter, skip expensive
-                // analysis
-                return res;
-              }
-
-              const auto mwrpit = methods_which_return_parameter.find(method);
-              if (mwrpit != methods_which_return_parameter.end()) {
-                // Short-circuit re-computing for perf
-                res.insert({method, mwrpit->second});
-                return res;
-              }
-
-              // TODO(T35815704): Make the cfg const
-              cfg::ControlFlowGraph& cfg = code->cfg();
-              const auto return_param_index = resolver.get_return_param_index(
-                  cfg, methods_which_return_parameter);
-              if (return_param_index) {
-                res.insert({method, *return_param_index});
-              }
-
-              return res;
-            },
-            [](std::unordered_map<const DexMethod*, ParamIndex> a,
-               std::unordered_map<const DexMethod*, ParamIndex> b) {
-              a.insert(b.begin(), b.end());
-              return a;
-            });
-
-    if (next_methods_which_return_parameter.size() ==
-        methods_which_return_parameter.size()) {
-
-      walk::parallel::code(scope, [](DexMethod* method, IRCode& code) {
-        const auto proto = method->get_proto();
-        if (!proto->is_void()) {
-          code.clear_cfg();
+  ReturnParamSummaries methods_which_return_parameter;
+  std::atomic<size_t> max_iterations{1};
+  call_graph::parallel_bottom_up(sccs, [&](call_graph::Sccs::SccId id) {
+    // The methods of a recursive component may only be found to return a
+    // parameter once others of them are, so they are analyzed again until
+    // nothing changes.
+    size_t iterations = 0;
+    bool changed;
+    do {
+      changed = false;
+      ++iterations;
+      for (auto* method : sccs.members(id)) {
+        if (!may_return_parameter(method) ||
+            methods_which_return_parameter.count(method)) {
+          continue;
         }
-      });
-      return methods_which_return_parameter;
+        // TODO(T35815704): Make the cfg const
+        cfg::ControlFlowGraph& cfg = method->get_code()->cfg();
+        const auto return_param_index = resolver.get_return_param_index(
+            cfg, methods_which_return_parameter);
+        if (return_param_index) {
+          methods_which_return_parameter.emplace(method, *return_param_index);
+          changed = sccs.is_recursive(id);
+        }
+      }
+    } while (changed);
+    auto current = max_iterations.load();
+    while (iterations > current &&
+           !max_iterations.compare_exchange_weak(current, iterations)) {
     }
-    methods_which_return_parameter = next_methods_which_return_parameter;
-  }
+  });
+  mgr.incr_metric(METRIC_METHODS_WHICH_RETURN_PARAMETER_ITERATIONS,
+                  max_iterations.load());
+
+  walk::parallel::code(scope, [](DexMethod* method, IRCode& code) {
+    const auto proto = method->get_proto();
+    if (!proto->is_void()) {
+      code.clear_cfg();
+    }
+  });
+  return methods_which_return_parameter;
 }
 
 static ResultPropagationPass s_pass;
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "MethodOverrideGraph.h"
 #include "Pass.h"
 #include "Resolver.h"
@@ -16,6 +17,12 @@
  */
 using ParamIndex = uint32_t;
 
+/*
+ * The methods which always return one of their incoming parameters, with the
+ * index of that parameter. Methods are only ever added, from any thread.
+ */
+using ReturnParamSummaries = ConcurrentMap<const DexMethod*, ParamIndex>;
+
 /*
  * A helper function that computes the mapping of load param instructions
  * to their respective indices.
@@ -53,8 +60,7 @@ class ReturnParamResolver {
    */
   const boost::optional<ParamIndex> get_return_param_index(
       IRInstruction* insn,
-      const std::unordered_map<const DexMethod*, ParamIndex>&
-          methods_which_return_parameter,
+      const ReturnParamSummaries& methods_which_return_parameter,
       MethodRefCache& resolved_refs) const;
 
   /*
@@ -63,8 +69,9 @@ class ReturnParamResolver {
    */
   const boost::optional<ParamIndex> get_return_param_index(
       cfg::ControlFlowGraph& cfg,
-      const std::unordered_map<const DexMethod*, ParamIndex>&
-          methods_which_return_parameter) const;
+      const ReturnParamSummaries& methods_which_return_parameter) const;
+
+  const method_override_graph::Graph& get_graph() const { return m_graph; }
 
  private:
   bool returns_receiver(const DexMethodRef* method) const;
@@ -97,9 +104,9 @@ class ResultPropagation {
     size_t unverifiable_move_results{0};
   };
 
-  ResultPropagation(const std::unordered_map<const DexMethod*, ParamIndex>&
-                        methods_which_return_parameter,
-                    const ReturnParamResolver& resolver)
+  ResultPropagation(
+      const ReturnParamSummaries& methods_which_return_parameter,
+      const ReturnParamResolver& resolver)
       : m_methods_which_return_parameter(methods_which_return_parameter),
         m_resolver(resolver) {}
 
@@ -111,8 +118,7 @@ class ResultPropagation {
   void patch(PassManager&, IRCode*);
 
  private:
-  const std::unordered_map<const DexMethod*, ParamIndex>&
-      m_methods_which_return_parameter;
+  const ReturnParamSummaries& m_methods_which_return_parameter;
   const ReturnParamResolver& m_resolver;
   mutable Stats m_stats;
   mutable MethodRefCache m_resolved_refs;
@@ -132,14 +138,21 @@ class ResultPropagationPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
+
  private:
   /*
-   * Via a fixed point computation that repeatedly inspects all methods,
-   * figure out all methods which return an incoming parameter, taking into
-   * account deep call chains.
+   * Figure out all methods which return an incoming parameter, taking into
+   * account deep call chains. The methods are analyzed bottom-up along the
+   * calls and overrides that their analysis depends on, in parallel, so that
+   * each method is analyzed once its callees are; only the methods of
+   * recursive components are analyzed again, until none of them changes.
    */
-  static const std::unordered_map<const DexMethod*, ParamIndex>
-  find_methods_which_return_parameter(PassManager& mgr,
-                                      const Scope& scope,
-                                      const ReturnParamResolver& resolver);
+  static ReturnParamSummaries find_methods_which_return_parameter(
+      PassManager& mgr,
+      const Scope& scope,
+      const ReturnParamResolver& resolver);
 };
@@ -0,0 +1,239 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Shrinker.h"
+
+#include <algorithm>
+
+#include "ConstantPropagationAnalysis.h"
+#include "ControlFlow.h"
+#include "DexClass.h"
+#include "IRCode.h"
+#include "ReduceGotos.h"
+#include "Trace.h"
+#include "Walkers.h"
+
+namespace {
+
+// What the editable CFG of the code would count, which has no gotos.
+size_t count_opcodes_without_gotos(const IRCode* code) {
+  size_t count = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    auto opcode = mie.insn->opcode();
+    if (!opcode::is_internal(opcode) && opcode != OPCODE_GOTO) {
+      count++;
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+namespace shrinker {
+
+Step parse_step(const std::string& name) {
+  static const std::unordered_map<std::string, Step> steps{
+      {"copy_propagation", Step::CopyPropagation},
+      {"constant_propagation", Step::ConstantPropagation},
+      {"local_dce", Step::LocalDce},
+      {"simplify_cfg", Step::SimplifyCfg},
+      {"reduce_gotos", Step::ReduceGotos},
+  };
+  auto it = steps.find(name);
+  always_assert_log(it != steps.end(), "Unknown shrinker step: %s",
+                    name.c_str());
+  return it->second;
+}
+
+Stats& Stats::operator+=(const Stats& that) {
+  methods_shrunk += that.methods_shrunk;
+  methods_without_fixpoint += that.methods_without_fixpoint;
+  rounds += that.rounds;
+  moves_eliminated += that.moves_eliminated;
+  replaced_sources += that.replaced_sources;
+  branches_removed += that.branches_removed;
+  materialized_consts += that.materialized_consts;
+  dead_instructions += that.dead_instructions;
+  unreachable_instructions += that.unreachable_instructions;
+  simplified_instructions += that.simplified_instructions;
+  reduced_gotos += that.reduced_gotos;
+  return *this;
+}
+
+void Shrinker::shrink(DexMethod* method) {
+  auto code = method->get_code();
+  // Opens, or keeps, the editable CFG session that the steps share.
+  auto editable_cfg = [code]() -> cfg::ControlFlowGraph& {
+    if (!code->editable_cfg_built()) {
+      code->build_cfg(/* editable */ true);
+    }
+    return code->cfg();
+  };
+  // The steps that work on the IR want the editable CFG linearized first.
+  auto linear_code = [code]() {
+    if (code->editable_cfg_built()) {
+      code->clear_cfg();
+    }
+  };
+
+  bool changed = true;
+  size_t rounds = 0;
+  while (changed && rounds < m_config.max_rounds) {
+    changed = false;
+    rounds++;
+    for (auto step : m_config.steps) {
+      switch (step) {
+      case Step::CopyPropagation: {
+        linear_code();
+        copy_propagation_impl::CopyPropagation copy_propagation(
+            m_config.copy_propagation);
+        auto stats = copy_propagation.run(code, method);
+        m_stats.moves_eliminated += stats.moves_eliminated;
+        m_stats.replaced_sources += stats.replaced_sources;
+        changed |= stats.moves_eliminated || stats.replaced_sources;
+        break;
+      }
+      case Step::ConstantPropagation: {
+        linear_code();
+        code->build_cfg(/* editable */ false);
+        constant_propagation::intraprocedural::FixpointIterator fp_iter(
+            code->cfg(), constant_propagation::ConstantPrimitiveAnalyzer());
+        fp_iter.run(ConstantEnvironment());
+        constant_propagation::Transform tf(m_config.constant_propagation);
+        auto stats = tf.apply(
+            fp_iter, constant_propagation::WholeProgramState(), code);
+        m_stats.branches_removed += stats.branches_removed;
+        m_stats.materialized_consts += stats.materialized_consts;
+        changed |= tf.made_changes();
+        break;
+      }
+      case Step::LocalDce: {
+        LocalDce local_dce(m_pure_methods);
+        local_dce.dce(editable_cfg());
+        const auto& stats = local_dce.get_stats();
+        m_stats.dead_instructions += stats.dead_instruction_count;
+        m_stats.unreachable_instructions +=
+            stats.unreachable_instruction_count;
+        changed |= stats.dead_instruction_count ||
+                   stats.unreachable_instruction_count;
+        break;
+      }
+      case Step::SimplifyCfg: {
+        // Building the editable CFG already simplifies it.
+        size_t before = code->editable_cfg_built()
+                            ? code->cfg().num_opcodes()
+                            : count_opcodes_without_gotos(code);
+        auto& cfg = editable_cfg();
+        cfg.simplify();
+        size_t after = cfg.num_opcodes();
+        m_stats.simplified_instructions += before - after;
+        changed |= before != after;
+        break;
+      }
+      case Step::ReduceGotos: {
+        auto& cfg = editable_cfg();
+        cfg.calculate_exit_block();
+        ReduceGotosPass::Stats stats;
+        ReduceGotosPass::process_code_switches(cfg, stats);
+        ReduceGotosPass::process_code_ifs(cfg, stats);
+        auto reduced = stats.removed_switches + stats.reduced_switches +
+                       stats.replaced_trivial_switches +
+                       stats.removed_switch_cases +
+                       stats.replaced_gotos_with_returns +
+                       stats.removed_trailing_moves +
+                       stats.inverted_conditional_branches;
+        m_stats.reduced_gotos += reduced;
+        changed |= reduced != 0;
+        break;
+      }
+      }
+    }
+  }
+  linear_code();
+  if (code->cfg_built()) {
+    code->clear_cfg();
+  }
+
+  m_stats.methods_shrunk++;
+  m_stats.rounds += rounds;
+  if (changed) {
+    TRACE(SHRINK, 3, "[shrinker] no fixpoint after %zu rounds: %s", rounds,
+          SHOW(method));
+    m_stats.methods_without_fixpoint++;
+  }
+}
+
+} // namespace shrinker
+
+void ShrinkerPass::bind_config() {
+  bind("steps",
+       {"copy_propagation", "constant_propagation", "local_dce",
+        "simplify_cfg"},
+       m_step_names);
+  bind("max_rounds", {4}, m_config.max_rounds);
+  bind("replace_moves_with_consts",
+       true,
+       m_config.constant_propagation.replace_moves_with_consts);
+  after_configuration([this] {
+    m_config.steps.clear();
+    for (const auto& name : m_step_names) {
+      m_config.steps.push_back(shrinker::parse_step(name));
+    }
+    always_assert(m_config.max_rounds > 0);
+  });
+}
+
+void ShrinkerPass::run_pass(DexStoresVector& stores,
+                            ConfigFiles& /* conf */,
+                            PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  auto config = m_config;
+  config.copy_propagation.regalloc_has_run = mgr.regalloc_has_run();
+  if (mgr.no_proguard_rules()) {
+    // Like LocalDcePass, as which methods are pure depends on them.
+    TRACE(SHRINK, 1,
+          "Not running local dce because no ProGuard configuration was "
+          "provided.");
+    config.steps.erase(std::remove(config.steps.begin(), config.steps.end(),
+                                   shrinker::Step::LocalDce),
+                       config.steps.end());
+  }
+  auto pure_methods = LocalDcePass::find_pure_methods();
+
+  auto stats = walk::parallel::reduce_methods<shrinker::Stats>(
+      scope,
+      [&](DexMethod* method) {
+        if (method->get_code() == nullptr ||
+            method->rstate.no_optimizations()) {
+          return shrinker::Stats();
+        }
+        shrinker::Shrinker shrinker(config, pure_methods);
+        shrinker.shrink(method);
+        return shrinker.get_stats();
+      },
+      [](shrinker::Stats a, const shrinker::Stats& b) {
+        a += b;
+        return a;
+      });
+
+  mgr.incr_metric("methods_shrunk", stats.methods_shrunk);
+  mgr.incr_metric("methods_without_fixpoint", stats.methods_without_fixpoint);
+  mgr.incr_metric("rounds", stats.rounds);
+  mgr.incr_metric("redundant_moves_eliminated", stats.moves_eliminated);
+  mgr.incr_metric("source_regs_replaced_with_representative",
+                  stats.replaced_sources);
+  mgr.incr_metric("num_branch_propagated", stats.branches_removed);
+  mgr.incr_metric("num_materialized_consts", stats.materialized_consts);
+  mgr.incr_metric("dead_instructions", stats.dead_instructions);
+  mgr.incr_metric("unreachable_instructions", stats.unreachable_instructions);
+  mgr.incr_metric("simplified_instructions", stats.simplified_instructions);
+  mgr.incr_metric("reduced_gotos", stats.reduced_gotos);
+  TRACE(SHRINK, 1, "[shrinker] %zu methods in %zu rounds, %zu at no fixpoint",
+        stats.methods_shrunk, stats.rounds, stats.methods_without_fixpoint);
+}
+
+static ShrinkerPass s_pass;
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "ConstantPropagationTransform.h"
+#include "CopyPropagationPass.h"
+#include "LocalDce.h"
+#include "Pass.h"
+
+/*
+ * The shrinker runs a sequence of local cleanups on one method at a time, and
+ * repeats the sequence until none of them changes the method any more. This
+ * takes one walk over the scope instead of one per cleanup pass, and each
+ * method stays in cache while all the cleanups run on it.
+ *
+ * Steps that work on an editable CFG and run one after the other share that
+ * CFG. Copy propagation and constant propagation work on the IR with a
+ * non-editable CFG. The editable CFG is only linearized before one of them
+ * runs, and once at the end.
+ */
+namespace shrinker {
+
+enum class Step {
+  CopyPropagation,
+  ConstantPropagation,
+  LocalDce,
+  SimplifyCfg,
+  ReduceGotos,
+};
+
+/*
+ * The steps by their config names: "copy_propagation",
+ * "constant_propagation", "local_dce", "simplify_cfg" and "reduce_gotos".
+ */
+Step parse_step(const std::string& name);
+
+struct Config {
+  std::vector<Step> steps{Step::CopyPropagation, Step::ConstantPropagation,
+                          Step::LocalDce, Step::SimplifyCfg};
+  // How many times the steps may be run on a method, at most, to get to a
+  // point where none of them changes it.
+  size_t max_rounds{4};
+  CopyPropagationPass::Config copy_propagation;
+  constant_propagation::Transform::Config constant_propagation;
+};
+
+struct Stats {
+  size_t methods_shrunk{0};
+  size_t methods_without_fixpoint{0};
+  size_t rounds{0};
+  size_t moves_eliminated{0};
+  size_t replaced_sources{0};
+  size_t branches_removed{0};
+  size_t materialized_consts{0};
+  size_t dead_instructions{0};
+  size_t unreachable_instructions{0};
+  size_t simplified_instructions{0};
+  size_t reduced_gotos{0};
+
+  Stats& operator+=(const Stats& that);
+};
+
+class Shrinker {
+ public:
+  Shrinker(const Config& config,
+           const std::unordered_set<DexMethodRef*>& pure_methods)
+      : m_config(config), m_pure_methods(pure_methods) {}
+
+  /*
+   * Runs the steps on the code of the method until a round of them changes
+   * nothing, or up to max_rounds times.
+   */
+  void shrink(DexMethod* method);
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  const Config& m_config;
+  const std::unordered_set<DexMethodRef*>& m_pure_methods;
+  Stats m_stats;
+};
+
+} // namespace shrinker
+
+class ShrinkerPass : public Pass {
+ public:
+  ShrinkerPass() : Pass("ShrinkerPass") {}
+
+  void bind_config() override;
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  PreservedAnalyses get_preserved_analyses() const override {
+    // Only method bodies change.
+    return PreservedAnalyses::all();
+  }
+
+ private:
+  std::vector<std::string> m_step_names;
+  shrinker::Config m_config;
+};
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -24,6 +25,7 @@
 #include "Resolver.h"
 #include "Trace.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 struct AnalysisImpl : SingleImplAnalysis {
   AnalysisImpl(const Scope& scope,
@@ -34,14 +36,34 @@ struct AnalysisImpl : SingleImplAnalysis {
   void create_single_impl(const TypeMap& single_impl,
                           const TypeSet& intfs,
                           const SingleImplConfig& config);
-  void collect_field_defs();
-  void collect_method_defs();
-  void analyze_opcodes();
+  void collect_refs();
   void escape_cross_stores();
   void remove_escaped();
 
  private:
+  /**
+   * What the fields, methods and code of one class add to the analysis.
+   * Classes are looked at in parallel, and their refs are applied in scope
+   * order so that the lists come out as a serial walk would build them.
+   */
+  struct ClassRefs {
+    std::vector<std::pair<DexType*, EscapeReason>> escapes;
+    std::vector<std::pair<DexType*, DexField*>> fielddefs;
+    std::vector<std::pair<DexType*, DexMethod*>> methoddefs;
+    std::vector<std::pair<DexType*, IRInstruction*>> typerefs;
+    std::vector<std::tuple<DexType*, DexFieldRef*, IRInstruction*>> fieldrefs;
+    std::vector<std::tuple<DexType*, DexMethodRef*, IRInstruction*>>
+        intf_methodrefs;
+    std::vector<std::tuple<DexType*, DexMethodRef*, IRInstruction*>>
+        methodrefs;
+  };
+
   DexType* get_and_check_single_impl(DexType* type);
+  DexType* get_and_check_single_impl(DexType* type, ClassRefs* refs) const;
+  void collect_field_defs(DexClass* cls, ClassRefs* refs) const;
+  void collect_method_defs(DexClass* cls, ClassRefs* refs) const;
+  void analyze_opcodes(DexClass* cls, ClassRefs* refs) const;
+  void apply_refs(const ClassRefs& refs);
   void collect_children(const TypeSet& intfs);
   void check_impl_hierarchy();
   void escape_with_clinit();
@@ -77,6 +99,25 @@ DexType* AnalysisImpl::get_and_check_single_impl(DexType* type) {
   return nullptr;
 }
 
+/**
+ * Same as above, but records the escape in `refs` instead of applying it, so
+ * that it can run while other classes are looked at.
+ */
+DexType* AnalysisImpl::get_and_check_single_impl(DexType* type,
+                                                 ClassRefs* refs) const {
+  if (exists(single_impls, type)) return type;
+  if (is_array(type)) {
+    auto array_type = get_array_type(type);
+    redex_assert(array_type);
+    const auto sit = single_impls.find(array_type);
+    if (sit != single_impls.end()) {
+      refs->escapes.emplace_back(sit->first, HAS_ARRAY_TYPE);
+      return sit->first;
+    }
+  }
+  return nullptr;
+}
+
 /**
  * Find all single implemented interfaces.
  */
@@ -287,13 +328,13 @@ void AnalysisImpl::remove_escaped() {
 /**
  * Find all fields typed with the single impl interface.
  */
-void AnalysisImpl::collect_field_defs() {
-  walk::fields(scope,
+void AnalysisImpl::collect_field_defs(DexClass* cls, ClassRefs* refs) const {
+  walk::fields(Scope{cls},
               [&](DexField* field) {
                 auto type = field->get_type();
-                auto intf = get_and_check_single_impl(type);
+                auto intf = get_and_check_single_impl(type, refs);
                 if (intf) {
-                  single_impls[intf].fielddefs.push_back(field);
+                  refs->fielddefs.emplace_back(intf, field);
                 }
               });
 }
@@ -303,18 +344,18 @@ void AnalysisImpl::collect_field_defs() {
  * Also if a method with the interface in the signature is native mark the
  * interface as "escaped".
  */
-void AnalysisImpl::collect_method_defs() {
+void AnalysisImpl::collect_method_defs(DexClass* cls, ClassRefs* refs) const {
 
   auto check_method_arg = [&](DexType* type, DexMethod* method, bool native) {
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, refs);
     if (!intf) return;
     if (native) {
-      escape_interface(intf, NATIVE_METHOD);
+      refs->escapes.emplace_back(intf, NATIVE_METHOD);
     }
-    single_impls[intf].methoddefs.insert(method);
+    refs->methoddefs.emplace_back(intf, method);
   };
 
-  walk::methods(scope,
+  walk::methods(Scope{cls},
     [&](DexMethod* method) {
       auto proto = method->get_proto();
       bool native = is_native(method);
@@ -330,12 +371,12 @@ void AnalysisImpl::collect_method_defs() {
  * Find all opcodes that reference a single implemented interface in a typeref,
  * fieldref or methodref.
  */
-void AnalysisImpl::analyze_opcodes() {
+void AnalysisImpl::analyze_opcodes(DexClass* cls, ClassRefs* refs) const {
 
   auto check_arg = [&](DexType* type, DexMethodRef* meth, IRInstruction* insn) {
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, refs);
     if (intf) {
-      single_impls[intf].methodrefs[meth].insert(insn);
+      refs->methodrefs.emplace_back(intf, meth, insn);
     }
   };
 
@@ -350,19 +391,19 @@ void AnalysisImpl::analyze_opcodes() {
   };
 
   auto check_field = [&](DexFieldRef* field, IRInstruction* insn) {
-    auto cls = field->get_class();
-    cls = get_and_check_single_impl(cls);
-    if (cls) {
-      escape_interface(cls, HAS_FIELD_REF);
+    auto field_cls = field->get_class();
+    field_cls = get_and_check_single_impl(field_cls, refs);
+    if (field_cls) {
+      refs->escapes.emplace_back(field_cls, HAS_FIELD_REF);
     }
     const auto type = field->get_type();
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, refs);
     if (intf) {
-      single_impls[intf].fieldrefs[field].push_back(insn);
+      refs->fieldrefs.emplace_back(intf, field, insn);
     }
   };
 
-  walk::opcodes(scope,
+  walk::opcodes(Scope{cls},
                [](DexMethod* method) { return true; },
                [&](DexMethod* method, IRInstruction* insn) {
                  auto op = insn->opcode();
@@ -374,9 +415,10 @@ void AnalysisImpl::analyze_opcodes() {
                  case OPCODE_NEW_INSTANCE:
                  case OPCODE_NEW_ARRAY:
                  case OPCODE_FILLED_NEW_ARRAY: {
-                   auto intf = get_and_check_single_impl(insn->get_type());
+                   auto intf =
+                       get_and_check_single_impl(insn->get_type(), refs);
                    if (intf) {
-                     single_impls[intf].typerefs.push_back(insn);
+                     refs->typerefs.emplace_back(intf, insn);
                    }
                    return;
                  }
@@ -415,16 +457,16 @@ void AnalysisImpl::analyze_opcodes() {
                    // such
                    const auto meth = insn->get_method();
                    const auto owner = meth->get_class();
-                   const auto intf = get_and_check_single_impl(owner);
+                   const auto intf = get_and_check_single_impl(owner, refs);
                    if (intf) {
                      // if the method ref is not defined on the interface itself
                      // drop the optimization
                      const auto& meths = type_class(intf)->get_vmethods();
                      if (std::find(meths.begin(), meths.end(), meth) ==
                          meths.end()) {
-                       escape_interface(intf, UNKNOWN_MREF);
+                       refs->escapes.emplace_back(intf, UNKNOWN_MREF);
                      } else {
-                       single_impls[intf].intf_methodrefs[meth].insert(insn);
+                       refs->intf_methodrefs.emplace_back(intf, meth, insn);
                      }
                    }
                    check_sig(meth, insn);
@@ -445,6 +487,58 @@ void AnalysisImpl::analyze_opcodes() {
                });
 }
 
+/**
+ * Add the refs of one class to the single impl map.
+ */
+void AnalysisImpl::apply_refs(const ClassRefs& refs) {
+  for (const auto& escape : refs.escapes) {
+    escape_interface(escape.first, escape.second);
+  }
+  for (const auto& def : refs.fielddefs) {
+    single_impls[def.first].fielddefs.push_back(def.second);
+  }
+  for (const auto& def : refs.methoddefs) {
+    single_impls[def.first].methoddefs.insert(def.second);
+  }
+  for (const auto& ref : refs.typerefs) {
+    single_impls[ref.first].typerefs.push_back(ref.second);
+  }
+  for (const auto& ref : refs.fieldrefs) {
+    single_impls[std::get<0>(ref)].fieldrefs[std::get<1>(ref)].push_back(
+        std::get<2>(ref));
+  }
+  for (const auto& ref : refs.intf_methodrefs) {
+    single_impls[std::get<0>(ref)].intf_methodrefs[std::get<1>(ref)].insert(
+        std::get<2>(ref));
+  }
+  for (const auto& ref : refs.methodrefs) {
+    single_impls[std::get<0>(ref)].methodrefs[std::get<1>(ref)].insert(
+        std::get<2>(ref));
+  }
+}
+
+/**
+ * Collect the field and method definitions and the opcodes that refer to
+ * single impl interfaces, in one parallel sweep over the classes.
+ */
+void AnalysisImpl::collect_refs() {
+  std::vector<ClassRefs> class_refs(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto cls = scope[i];
+    auto refs = &class_refs[i];
+    collect_field_defs(cls, refs);
+    collect_method_defs(cls, refs);
+    analyze_opcodes(cls, refs);
+  });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  for (const auto& refs : class_refs) {
+    apply_refs(refs);
+  }
+}
+
 /**
  * Main analysis method
  */
@@ -456,9 +550,7 @@ std::unique_ptr<SingleImplAnalysis> SingleImplAnalysis::analyze(
   std::unique_ptr<AnalysisImpl> single_impls(
       new AnalysisImpl(scope, pg_map, stores));
   single_impls->create_single_impl(single_impl, intfs, config);
-  single_impls->collect_field_defs();
-  single_impls->collect_method_defs();
-  single_impls->analyze_opcodes();
+  single_impls->collect_refs();
   single_impls->escape_cross_stores();
   single_impls->remove_escaped();
   return std::move(single_impls);
@@ -10,6 +10,7 @@
 #include "Resolver.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 /**
  * Implementation:
@@ -80,6 +81,31 @@ struct StaticCallGraph {
   }
 };
 
+/**
+ * The ids of the vertices that `method` calls, in the order of the calls. Only
+ * reads the graph, so it can run on many methods at once.
+ */
+std::vector<int> find_callees(const StaticCallGraph& graph,
+                              const DexMethod* method) {
+  std::vector<int> callee_ids;
+  const IRCode* code = method->get_code();
+  if (code == nullptr) {
+    return callee_ids;
+  }
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() != OPCODE_INVOKE_STATIC) {
+      continue;
+    }
+    DexMethod* callee =
+        resolve_method(mie.insn->get_method(), MethodSearch::Static);
+    auto it = graph.method_id_map.find(callee);
+    if (it != graph.method_id_map.end()) {
+      callee_ids.push_back(it->second);
+    }
+  }
+  return callee_ids;
+}
+
 /**
  * Build call graph for all static methods in candidate classes
  */
@@ -95,22 +121,20 @@ void build_call_graph(const std::vector<DexClass*>& candidate_classes,
   graph.callers.resize(graph.vertices.size());
   graph.callees.resize(graph.vertices.size());
 
-  for (auto& meth_id : graph.method_id_map) {
-    DexMethod* caller = meth_id.first;
-    int caller_id = meth_id.second;
-    for (const auto& mie : InstructionIterable(caller->get_code())) {
-      if (mie.insn->has_method()) {
-        if (mie.insn->opcode() != OPCODE_INVOKE_STATIC) {
-          continue;
-        }
-        DexMethod* callee =
-            resolve_method(mie.insn->get_method(), MethodSearch::Static);
-        if (graph.method_id_map.find(callee) != graph.method_id_map.end()) {
-          int callee_id = graph.method_id_map[callee];
-          graph.callers[callee_id].insert(caller_id);
-          graph.callees[caller_id].insert(callee_id);
-        }
-      }
+  std::vector<std::vector<int>> callees_of(graph.vertices.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t caller_id) {
+    callees_of[caller_id] =
+        find_callees(graph, graph.vertices[caller_id].method);
+  });
+  for (size_t caller_id = 0; caller_id < graph.vertices.size(); ++caller_id) {
+    wq.add_item(caller_id);
+  }
+  wq.run_all();
+
+  for (size_t caller_id = 0; caller_id < callees_of.size(); ++caller_id) {
+    for (int callee_id : callees_of[caller_id]) {
+      graph.callers[callee_id].insert(caller_id);
+      graph.callees[caller_id].insert(callee_id);
     }
   }
 }
@@ -145,28 +169,16 @@ void color_vertex(StaticCallGraph& graph, DexMethod* method, int color) {
 }
 
 /**
- * Color the vertices for a class
- * For private static method, should color all the caller within the class to
- * the same color
+ * The static methods in the graph that a class calls, in the order in which
+ * the class colors them.
  */
-void color_from_a_class(StaticCallGraph& graph, DexClass* cls, int color) {
-  auto process_method = [&](DexMethod* caller) {
-    IRCode* code = caller->get_code();
-    if (code == nullptr) {
-      return;
-    }
-    for (const auto& mie : InstructionIterable(code)) {
-      if (mie.insn->has_method()) {
-        if (mie.insn->opcode() != OPCODE_INVOKE_STATIC) {
-          continue;
-        }
-        DexMethod* callee =
-            resolve_method(mie.insn->get_method(), MethodSearch::Static);
-        if (graph.method_id_map.find(callee) != graph.method_id_map.end()) {
-          color_vertex(graph, callee, color);
-        }
-      }
-    }
+std::vector<int> find_callees_of_class(const StaticCallGraph& graph,
+                                       const DexClass* cls) {
+  std::vector<int> callee_ids;
+  auto process_method = [&](const DexMethod* caller) {
+    auto method_callees = find_callees(graph, caller);
+    callee_ids.insert(
+        callee_ids.end(), method_callees.begin(), method_callees.end());
   };
   for (DexMethod* method : cls->get_vmethods()) {
     process_method(method);
@@ -174,6 +186,20 @@ void color_from_a_class(StaticCallGraph& graph, DexClass* cls, int color) {
   for (DexMethod* method : cls->get_dmethods()) {
     process_method(method);
   }
+  return callee_ids;
+}
+
+/**
+ * Color the vertices for a class
+ * For private static method, should color all the caller within the class to
+ * the same color
+ */
+void color_from_a_class(StaticCallGraph& graph,
+                        const std::vector<int>& callee_ids,
+                        int color) {
+  for (int callee_id : callee_ids) {
+    color_vertex(graph, graph.vertices[callee_id], color);
+  }
 }
 
 /**
@@ -219,24 +245,40 @@ namespace static_relo_v2 {
  * and deleted.
  */
 std::vector<DexClass*> StaticReloPassV2::gen_candidates(const Scope& scope) {
-  std::vector<DexClass*> candidate_classes;
   TypeSystem typesystem(scope);
-  walk::classes(scope, [&](DexClass* cls) {
-    if (!cls->is_external() &&
-        typesystem.get_children(cls->get_type()).empty() &&
-        !is_interface(cls) && cls->get_ifields().empty() &&
-        cls->get_sfields().empty() && cls->get_vmethods().empty()) {
-      for (const auto& method : cls->get_dmethods()) {
-        if (!is_static(method) || !can_rename(method) || !can_delete(method)) {
-          return;
-        }
-        if (method->get_code() == nullptr) {
-          return;
-        }
+  auto is_candidate = [&](const DexClass* cls) {
+    if (cls->is_external() ||
+        !typesystem.get_children(cls->get_type()).empty() ||
+        is_interface(cls) || !cls->get_ifields().empty() ||
+        !cls->get_sfields().empty() || !cls->get_vmethods().empty()) {
+      return false;
+    }
+    for (const auto& method : cls->get_dmethods()) {
+      if (!is_static(method) || !can_rename(method) || !can_delete(method)) {
+        return false;
+      }
+      if (method->get_code() == nullptr) {
+        return false;
       }
-      candidate_classes.push_back(cls);
     }
-  });
+    return true;
+  };
+  // Each class is checked on its own; the candidates are then gathered in
+  // scope order so that the result doesn't depend on the scheduling.
+  std::vector<char> candidate(scope.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { candidate[i] = is_candidate(scope[i]); });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  std::vector<DexClass*> candidate_classes;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    if (candidate[i]) {
+      candidate_classes.push_back(scope[i]);
+    }
+  }
   return candidate_classes;
 }
 
@@ -246,11 +288,25 @@ int StaticReloPassV2::run_relocation(
   build_call_graph(candidate_classes, graph);
   std::unordered_set<DexClass*> set(candidate_classes.begin(),
                                     candidate_classes.end());
+  // Finding the callees of each class only reads the graph and is done in
+  // parallel. The coloring then follows the scope order, as its result
+  // depends on the order in which the classes color the vertices.
+  std::vector<std::vector<int>> callees_of(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t color) {
+    if (set.count(scope[color]) == 0) {
+      callees_of[color] = find_callees_of_class(graph, scope[color]);
+    }
+  });
+  for (size_t color = 0; color < scope.size(); color++) {
+    wq.add_item(color);
+  }
+  wq.run_all();
+
   for (size_t color = 0; color < scope.size(); color++) {
     if (set.find(scope[color]) != set.end()) {
       continue;
     }
-    color_from_a_class(graph, scope[color], color);
+    color_from_a_class(graph, callees_of[color], color);
   }
 
   return relocate_clusters(graph, scope);
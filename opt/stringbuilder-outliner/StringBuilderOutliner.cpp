@@ -14,6 +14,7 @@
 #include "Creators.h"
 #include "DexAsm.h"
 #include "DexClass.h"
+#include "DexUtil.h"
 #include "Liveness.h"
 #include "Pass.h"
 #include "Walkers.h"
@@ -199,13 +200,16 @@ void Outliner::gather_outline_candidate_typelists(
 }
 
 void Outliner::analyze(IRCode& code) {
+  // Do a quick one-pass scan to see if the method has any instructions that may
+  // be outlinable. Only build the CFG and do the more expensive fixpoint
+  // calculations if the method passes this check.
+  if (!calls_stringbuilder_tostring(&code)) {
+    return;
+  }
   code.build_cfg(/* editable */ false); // Not editable because of T42743620
   auto& cfg = code.cfg();
   cfg.calculate_exit_block();
 
-  // Do a quick one-pass scan to see if the method has any instructions that may
-  // be outlinable. Only do the more expensive fixpoint calculations if the
-  // method passes this check.
   auto tostring_instructions = find_tostring_instructions(cfg);
   if (tostring_instructions.size() == 0) {
     return;
@@ -21,6 +21,7 @@
 #include "IRCode.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 size_t Model::s_shape_count = 0;
 size_t Model::s_dex_count = 0;
@@ -685,17 +686,50 @@ void Model::shape_model() {
     mergers.emplace_back(&m_mergers[type]);
   }
 
-  for (auto merger : mergers) {
-    TRACE(TERA, 6, "Build shapes from %s", SHOW(merger->type));
-    MergerType::ShapeCollector shapes;
-    shape_merger(*merger, shapes);
-    approximate_shapes(shapes);
-    m_metric.dropped += trim_shapes(shapes, m_spec.min_count);
-    for (auto& shape_it : shapes) {
-      break_by_interface(*merger, shape_it.first, shape_it.second);
+  // The children of a merger are shaped, and the shapes broken up by
+  // interface, independently of the other mergers, so these steps run in
+  // parallel across mergers. The approximations keep stats of their own, and
+  // flattening creates the new mergers, so those steps stay serial.
+  std::vector<MergerType::ShapeCollector> shapes(mergers.size());
+  std::vector<TypeSet> excluded(mergers.size());
+  auto shape_wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        TRACE(TERA, 6, "Build shapes from %s", SHOW(mergers[i]->type));
+        shape_merger(*mergers[i], shapes[i], excluded[i]);
+      },
+      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < mergers.size(); i++) {
+    shape_wq.add_item(i);
+  }
+  shape_wq.run_all();
+
+  for (size_t i = 0; i < mergers.size(); i++) {
+    m_excluded.insert(excluded[i].begin(), excluded[i].end());
+    approximate_shapes(shapes[i]);
+    m_metric.dropped += trim_shapes(shapes[i], m_spec.min_count);
+  }
+
+  std::vector<std::pair<size_t, MergerType::ShapeCollector::iterator>>
+      shape_its;
+  for (size_t i = 0; i < mergers.size(); i++) {
+    for (auto it = shapes[i].begin(); it != shapes[i].end(); ++it) {
+      shape_its.emplace_back(i, it);
     }
+  }
+  auto intf_wq = workqueue_foreach<size_t>(
+      [&](size_t j) {
+        auto& shape_it = shape_its[j].second;
+        break_by_interface(*mergers[shape_its[j].first], shape_it->first,
+                           shape_it->second);
+      },
+      walk::parallel::default_num_threads());
+  for (size_t j = 0; j < shape_its.size(); j++) {
+    intf_wq.add_item(j);
+  }
+  intf_wq.run_all();
 
-    flatten_shapes(*merger, shapes);
+  for (size_t i = 0; i < mergers.size(); i++) {
+    flatten_shapes(*mergers[i], shapes[i]);
   }
 
   // Update excluded metrics
@@ -704,7 +738,8 @@ void Model::shape_model() {
 }
 
 void Model::shape_merger(const MergerType& merger,
-                         MergerType::ShapeCollector& shapes) {
+                         MergerType::ShapeCollector& shapes,
+                         TypeSet& excluded) const {
   // if the root has got no children there is nothing to "shape"
   const auto& children = m_hierarchy.find(merger.type);
   if (children == m_hierarchy.end()) {
@@ -717,7 +752,7 @@ void Model::shape_merger(const MergerType& merger,
       continue;
     }
     if (is_excluded(child)) {
-      m_excluded.insert(child);
+      excluded.insert(child);
       continue;
     }
     if (m_non_mergeables.count(child)) {
@@ -838,7 +873,7 @@ void Model::approximate_shapes(MergerType::ShapeCollector& shapes) {
  */
 void Model::break_by_interface(const MergerType& merger,
                                const MergerType::Shape& shape,
-                               MergerType::ShapeHierarchy& hier) {
+                               MergerType::ShapeHierarchy& hier) const {
   always_assert(!hier.types.empty());
   // group classes by interfaces implemented
   TRACE(TERA, 7, "Break up shape %s parent %s", shape.to_string().c_str(),
@@ -875,23 +910,33 @@ DexType* check_current_instance(const TypeSet& types, IRInstruction* insn) {
   return type;
 }
 
-std::unordered_map<DexType*, std::unordered_set<DexType*>> get_type_usages(
-    const TypeSet& types, const Scope& scope) {
-  std::unordered_map<DexType*, std::unordered_set<DexType*>> res;
-
-  walk::opcodes(
-      scope, [](DexMethod*) { return true; },
-      [&](DexMethod* method, IRInstruction* insn) {
-        auto current_instance = check_current_instance(types, insn);
-        if (current_instance) {
-          res[current_instance].emplace(method->get_class());
+using TypeUsages = std::unordered_map<DexType*, std::unordered_set<DexType*>>;
+
+TypeUsages get_type_usages(const TypeSet& types, const Scope& scope) {
+  // Resolving the callees is what costs, so the methods are scanned in
+  // parallel, and the usages of each method merged together after.
+  return walk::parallel::reduce_methods<TypeUsages>(
+      scope,
+      [&](DexMethod* method) {
+        TypeUsages res;
+        auto code = method->get_code();
+        if (!code) {
+          return res;
         }
+        for (const auto& mie : InstructionIterable(code)) {
+          auto insn = mie.insn;
+          auto current_instance = check_current_instance(types, insn);
+          if (current_instance) {
+            res[current_instance].emplace(method->get_class());
+          }
 
-        if (insn->has_method()) {
+          if (!insn->has_method()) {
+            continue;
+          }
           auto callee =
               resolve_method(insn->get_method(), opcode_to_search(insn));
           if (!callee) {
-            return;
+            continue;
           }
           auto proto = callee->get_proto();
           auto rtype = proto->get_rtype();
@@ -905,9 +950,14 @@ std::unordered_map<DexType*, std::unordered_set<DexType*>> get_type_usages(
             }
           }
         }
+        return res;
+      },
+      [](TypeUsages left, const TypeUsages& right) {
+        for (const auto& pair : right) {
+          left[pair.first].insert(pair.second.begin(), pair.second.end());
+        }
+        return left;
       });
-
-  return res;
 }
 
 size_t get_interdex_group(
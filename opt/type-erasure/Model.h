@@ -400,11 +400,13 @@ class Model {
 
   // make shapes out of the model classes
   void shape_model();
-  void shape_merger(const MergerType& root, MergerType::ShapeCollector& shapes);
+  void shape_merger(const MergerType& root,
+                    MergerType::ShapeCollector& shapes,
+                    TypeSet& excluded) const;
   void approximate_shapes(MergerType::ShapeCollector& shapes);
   void break_by_interface(const MergerType& merger,
                           const MergerType::Shape& shape,
-                          MergerType::ShapeHierarchy& hier);
+                          MergerType::ShapeHierarchy& hier) const;
   void flatten_shapes(const MergerType& merger,
                       MergerType::ShapeCollector& shapes);
   std::vector<TypeSet> group_per_interdex_set(const TypeSet& types);
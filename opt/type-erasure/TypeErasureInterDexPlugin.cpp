@@ -7,9 +7,11 @@
 
 #include "TypeErasureInterDexPlugin.h"
 
+#include "ConcurrentContainers.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "ModelMerger.h"
+#include "Walkers.h"
 
 namespace {
 
@@ -75,6 +77,26 @@ bool TypeErasureInterDexPlugin::should_skip_class(const DexClass* clazz) {
   return false;
 }
 
+/*
+ * The same, for all the classes at once: looking for the model roots among
+ * the superclasses doesn't change any state, so it can run in parallel.
+ */
+std::unordered_set<const DexClass*>
+TypeErasureInterDexPlugin::should_skip_classes(const Scope& scope) {
+  ConcurrentSet<const DexClass*> mergeables;
+  walk::parallel::classes(scope, [&](DexClass* clazz) {
+    if (is_mergeable(clazz)) {
+      mergeables.insert(clazz);
+    }
+  });
+  std::unordered_set<const DexClass*> classes(mergeables.begin(),
+                                              mergeables.end());
+  for (const DexClass* clazz : classes) {
+    m_mergeables_skipped.emplace(clazz->get_type());
+  }
+  return classes;
+}
+
 /*
  * Not relocating methods of all the classes that we have generated.
  */
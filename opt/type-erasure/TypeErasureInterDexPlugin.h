@@ -40,6 +40,9 @@ class TypeErasureInterDexPlugin : public interdex::InterDexPassPlugin {
 
   bool should_skip_class(const DexClass* clazz) override;
 
+  std::unordered_set<const DexClass*> should_skip_classes(
+      const Scope& scope) override;
+
   bool should_not_relocate_methods_of_class(const DexClass* clazz) override;
 
   void gather_refs(const interdex::DexInfo& dex_info,
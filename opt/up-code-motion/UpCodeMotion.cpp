@@ -30,6 +30,7 @@
 
 #include <vector>
 
+#include "BranchPrefixHoisting.h"
 #include "ControlFlow.h"
 #include "DexClass.h"
 #include "DexUtil.h"
@@ -46,6 +47,8 @@ constexpr const char* METRIC_BRANCHES_MOVED_OVER = "num_branches_moved_over";
 constexpr const char* METRIC_INVERTED_CONDITIONAL_BRANCHES =
     "num_inverted_conditional_branches";
 constexpr const char* METRIC_CLOBBERED_REGISTERS = "num_clobbered_registers";
+constexpr const char* METRIC_BRANCH_PREFIX_INSTRUCTIONS_HOISTED =
+    "num_branch_prefix_instructions_hoisted";
 
 } // namespace
 
@@ -201,14 +204,30 @@ bool UpCodeMotionPass::gather_instructions_to_insert(
   return true;
 }
 
-UpCodeMotionPass::Stats UpCodeMotionPass::process_code(bool is_static,
-                                                       DexType* declaring_type,
-                                                       DexTypeList* args,
-                                                       IRCode* code) {
-  Stats stats;
-
+UpCodeMotionPass::Stats UpCodeMotionPass::process_code(
+    bool is_static,
+    DexType* declaring_type,
+    DexTypeList* args,
+    IRCode* code,
+    bool hoist_branch_prefixes) {
   code->build_cfg(/* editable = true*/);
   auto& cfg = code->cfg();
+  size_t hoisted = 0;
+  if (hoist_branch_prefixes) {
+    hoisted = BranchPrefixHoistingPass::process_cfg(cfg);
+  }
+  Stats stats = process_cfg(is_static, declaring_type, args, cfg);
+  stats.branch_prefix_instructions_hoisted = hoisted;
+  code->clear_cfg();
+  return stats;
+}
+
+UpCodeMotionPass::Stats UpCodeMotionPass::process_cfg(
+    bool is_static,
+    DexType* declaring_type,
+    DexTypeList* args,
+    cfg::ControlFlowGraph& cfg) {
+  Stats stats;
 
   std::unique_ptr<type_inference::TypeInference> type_inference;
   std::unordered_set<cfg::Block*> blocks_to_remove;
@@ -329,7 +348,6 @@ UpCodeMotionPass::Stats UpCodeMotionPass::process_code(bool is_static,
     cfg.remove_block(b);
   }
 
-  code->clear_cfg();
   return stats;
 }
 
@@ -338,9 +356,10 @@ void UpCodeMotionPass::run_pass(DexStoresVector& stores,
                                 PassManager& mgr) {
   auto scope = build_class_scope(stores);
 
+  bool hoist_branch_prefixes = m_hoist_branch_prefixes;
   Stats stats = walk::parallel::reduce_methods<Stats>(
       scope,
-      [](DexMethod* method) -> Stats {
+      [hoist_branch_prefixes](DexMethod* method) -> Stats {
         const auto code = method->get_code();
         if (!code) {
           return Stats{};
@@ -348,7 +367,7 @@ void UpCodeMotionPass::run_pass(DexStoresVector& stores,
 
         Stats stats = UpCodeMotionPass::process_code(
             is_static(method), method->get_class(),
-            method->get_proto()->get_args(), code);
+            method->get_proto()->get_args(), code, hoist_branch_prefixes);
         if (stats.instructions_moved || stats.branches_moved_over) {
           TRACE(UCM, 3,
                 "[up code motion] Moved %u instructions over %u conditional "
@@ -367,6 +386,9 @@ void UpCodeMotionPass::run_pass(DexStoresVector& stores,
         c.inverted_conditional_branches =
             a.inverted_conditional_branches + b.inverted_conditional_branches;
         c.clobbered_registers = a.clobbered_registers + b.clobbered_registers;
+        c.branch_prefix_instructions_hoisted =
+            a.branch_prefix_instructions_hoisted +
+            b.branch_prefix_instructions_hoisted;
         return c;
       });
 
@@ -375,6 +397,10 @@ void UpCodeMotionPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_INVERTED_CONDITIONAL_BRANCHES,
                   stats.inverted_conditional_branches);
   mgr.incr_metric(METRIC_CLOBBERED_REGISTERS, stats.clobbered_registers);
+  if (hoist_branch_prefixes) {
+    mgr.incr_metric(METRIC_BRANCH_PREFIX_INSTRUCTIONS_HOISTED,
+                    stats.branch_prefix_instructions_hoisted);
+  }
   TRACE(UCM, 1,
         "[up code motion] Moved %u instructions over %u conditional branches "
         "while inverting %u conditional branches and dealing with %u clobbered "
@@ -17,18 +17,37 @@ class UpCodeMotionPass : public Pass {
     size_t branches_moved_over{0};
     size_t inverted_conditional_branches{0};
     size_t clobbered_registers{0};
+    // Only with hoist_branch_prefixes.
+    size_t branch_prefix_instructions_hoisted{0};
   };
 
   UpCodeMotionPass() : Pass("UpCodeMotionPass") {}
 
+  // With "hoist_branch_prefixes", each method first goes through
+  // BranchPrefixHoistingPass::process_cfg on the same CFG, which makes a
+  // separate BranchPrefixHoistingPass right before this one unnecessary.
+  void bind_config() override {
+    bind("hoist_branch_prefixes", false, m_hoist_branch_prefixes);
+  }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_store_local() const override { return true; }
+
   static Stats process_code(bool is_static,
                             DexType* declaring_type,
                             DexTypeList* args,
-                            IRCode*);
+                            IRCode*,
+                            bool hoist_branch_prefixes = false);
+
+  static Stats process_cfg(bool is_static,
+                           DexType* declaring_type,
+                           DexTypeList* args,
+                           cfg::ControlFlowGraph& cfg);
 
  private:
+  bool m_hoist_branch_prefixes{false};
+
   static bool gather_movable_instructions(
       cfg::Block* b, std::vector<IRInstruction*>* instructions);
   static bool gather_instructions_to_insert(
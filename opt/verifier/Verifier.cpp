@@ -19,61 +19,39 @@
 #include "IRInstruction.h"
 #include "DexUtil.h"
 #include "ReachableClasses.h"
+#include "WorkQueue.h"
 
 namespace {
 
 const std::string CLASS_DEPENDENCY_FILENAME = "redex-class-dependencies.txt";
 
-using refs_t = std::unordered_map<const DexClass*,
-                                  std::set<DexClass*, dexclasses_comparator>>;
 using class_to_store_map_t = std::unordered_map<const DexClass*, DexStore*>;
 using allowed_store_map_t = std::unordered_map<std::string, std::set<std::string>>;
 
 /**
- * Helper function that scans all the opcodes in the application and produces a map of references
- * from the class containing the opcode to the class referenced by the opcode.
- *
- * @param scope all classes we're processing
- * @param dmethod_refs [out] all refs to dmethods in the application
- * @param class_refs [out] all refs to classes in the application
- *
+ * Collects the classes referenced by the opcodes of `cls`.
  */
-void build_refs(
-    const Scope& scope,
-    refs_t& class_refs) {
+std::set<DexClass*, dexclasses_comparator> build_refs(DexClass* cls) {
   // TODO: walk through annotations
+  std::set<DexClass*, dexclasses_comparator> refs;
   walk::opcodes(
-    scope,
+    std::vector<DexClass*>{cls},
     [](const DexMethod*) { return true; },
-    [&](const DexMethod* meth, IRInstruction* insn) {
+    [&](const DexMethod*, IRInstruction* insn) {
+      DexClass* tref = nullptr;
       if (insn->has_type()) {
-        const auto tref = type_class(insn->get_type());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
-      }
-      if (insn->has_field()) {
-        const auto tref = type_class(insn->get_field()->get_class());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
-      }
-      if (insn->has_method()) {
-        // log methods class type, for virtual methods, this may not actually exist and true
-        // verification would require that the binding refers to a class that is valid.
-        const auto mref = type_class(insn->get_method()->get_class());
-        if (mref) class_refs[mref].emplace(type_class(meth->get_class()));
-
-        // don't log return type or types of parameters for now, but this is how you might do it.
-        //const auto proto = insn->get_method()->get_proto();
-        // const auto rref = type_class(proto->get_rtype());
-        // if (rref) class_refs[rref].emplace(type_class(meth->get_class()));
-        // for (const auto arg : proto->get_args()->get_type_list()) {
-        //   const auto aref = type_class(arg);
-        //   if (aref) class_refs[aref].emplace(type_class(meth->get_class()));
-        // }
-
-        return;
+        tref = type_class(insn->get_type());
+      } else if (insn->has_field()) {
+        tref = type_class(insn->get_field()->get_class());
+      } else if (insn->has_method()) {
+        // log methods class type, for virtual methods, this may not actually
+        // exist and true verification would require that the binding refers
+        // to a class that is valid.
+        tref = type_class(insn->get_method()->get_class());
       }
+      if (tref) refs.emplace(tref);
     });
+  return refs;
 }
 
 DexStore& findStore(std::string& name, DexStoresVector& stores) {
@@ -85,29 +63,42 @@ DexStore& findStore(std::string& name, DexStoresVector& stores) {
   return stores[0];
 }
 
-const std::set<std::string> getAllowedStores(DexStoresVector& stores, DexStore& store, allowed_store_map_t store_map) {
+const std::set<std::string>& getAllowedStores(DexStoresVector& stores,
+                                              DexStore& store,
+                                              allowed_store_map_t& store_map) {
   auto search = store_map.find(store.get_name());
   if (search != store_map.end()) {
     return search->second;
   }
-  store_map[store.get_name()].emplace(store.get_name());
-  store_map[store.get_name()].emplace(stores[0].get_name());
+  std::set<std::string> allowed;
+  allowed.emplace(store.get_name());
+  allowed.emplace(stores[0].get_name());
   for (auto parent : store.get_dependencies()) {
-    store_map[store.get_name()].emplace(parent);
-    for (auto grandparent : getAllowedStores(stores, findStore(parent, stores), store_map)) {
-      store_map[store.get_name()].emplace(grandparent);
+    allowed.emplace(parent);
+    for (const auto& grandparent :
+         getAllowedStores(stores, findStore(parent, stores), store_map)) {
+      allowed.emplace(grandparent);
     }
   }
-  return store_map[store.get_name()];
+  return store_map[store.get_name()] = std::move(allowed);
 }
 
-void verifyStore(DexStoresVector& stores, DexStore& store, class_to_store_map_t map, allowed_store_map_t store_map, FILE* fd) {
-  refs_t class_refs;
+/**
+ * Checks the references of each class of the store in parallel. The lines of
+ * each class are written out in scope order once all of them are done, so
+ * that the dependency file is the same from one build to the next.
+ */
+void verifyStore(DexStoresVector& stores,
+                 DexStore& store,
+                 const class_to_store_map_t& map,
+                 allowed_store_map_t& store_map,
+                 FILE* fd) {
   auto scope = build_class_scope(store.get_dexen());
-  build_refs(scope, class_refs);
-  for (auto& ref : class_refs) {
-    const auto target = ref.first;
-    for (const auto& source : ref.second) {
+  const auto& allowed_stores = getAllowedStores(stores, store, store_map);
+  std::vector<std::string> lines(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto source = scope[i];
+    for (const auto& target : build_refs(source)) {
       std::string target_store_name;
       auto find = map.find(target);
       if (find != map.end()) {
@@ -115,7 +106,6 @@ void verifyStore(DexStoresVector& stores, DexStore& store, class_to_store_map_t
       } else {
         target_store_name = "external";
       }
-      std::set<std::string> allowed_stores = getAllowedStores(stores, store, store_map);
       if (allowed_stores.find(target_store_name) == allowed_stores.end()) {
         TRACE(
           VERIFY,
@@ -126,13 +116,18 @@ void verifyStore(DexStoresVector& stores, DexStore& store, class_to_store_map_t
           target_store_name.c_str(),
           target->get_deobfuscated_name().c_str());
       }
-      if (fd != nullptr) {
-        fprintf(fd, "%s:%s->%s:%s\n",
-          store.get_name().c_str(),
-          source->get_deobfuscated_name().c_str(),
-          target_store_name.c_str(),
-          target->get_deobfuscated_name().c_str());
-      }
+      lines[i] += store.get_name() + ":" + source->get_deobfuscated_name() +
+                  "->" + target_store_name + ":" +
+                  target->get_deobfuscated_name() + "\n";
+    }
+  });
+  for (size_t i = 0; i < scope.size(); i++) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  if (fd != nullptr) {
+    for (const auto& class_lines : lines) {
+      fputs(class_lines.c_str(), fd);
     }
   }
 }
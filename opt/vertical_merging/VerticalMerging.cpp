@@ -17,6 +17,7 @@
 #include "TypeReference.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -446,16 +447,50 @@ void record_field_reference(
   });
 }
 
+struct DontMergeRecord {
+  std::unordered_map<const DexType*, DontMergeState> dont_merge_status;
+  std::unordered_set<DexMethod*> referenced_methods;
+};
+
+/**
+ * Run all the collectors on each class in one parallel sweep. Each thread
+ * records into its own DontMergeRecord, and since STRICT wins over
+ * CONDITIONAL no matter the order, the records are merged afterwards.
+ */
 void record_referenced(
     const Scope& scope,
     std::unordered_map<const DexType*, DontMergeState>* dont_merge_status,
     const std::vector<std::string>& blacklist,
     std::unordered_set<DexMethod*>* referenced_methods) {
-  record_annotation(scope, dont_merge_status);
-  record_code_reference(scope, dont_merge_status, referenced_methods);
-  record_field_reference(scope, dont_merge_status);
-  record_method_signature(scope, dont_merge_status);
-  record_black_list(scope, dont_merge_status, blacklist);
+  auto num_threads = walk::parallel::default_num_threads();
+  std::vector<DontMergeRecord> records(num_threads);
+  using Data = std::nullptr_t;
+  WorkQueue<DexClass*, Data, std::nullptr_t> wq(
+      [&](WorkerState<DexClass*, Data, std::nullptr_t>* state, DexClass* cls) {
+        auto& record = records[state->worker_id()];
+        Scope classes{cls};
+        record_annotation(classes, &record.dont_merge_status);
+        record_code_reference(classes, &record.dont_merge_status,
+                              &record.referenced_methods);
+        record_field_reference(classes, &record.dont_merge_status);
+        record_method_signature(classes, &record.dont_merge_status);
+        record_black_list(classes, &record.dont_merge_status, blacklist);
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      num_threads);
+  for (auto cls : scope) {
+    wq.add_item(cls);
+  }
+  wq.run_all();
+  for (const auto& record : records) {
+    for (const auto& pair : record.dont_merge_status) {
+      record_dont_merge_state(pair.first, pair.second, dont_merge_status);
+    }
+    referenced_methods->insert(record.referenced_methods.begin(),
+                               record.referenced_methods.end());
+  }
 }
 
 void move_fields(DexClass* from_cls, DexClass* to_cls) {
@@ -48,6 +48,7 @@
 #include "Resolver.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -353,22 +354,39 @@ void VirtualMerging::compute_mergeable_pairs_by_virtual_scopes() {
 //         is for some reason not possible, e.g. because of code size
 //         constraints. Record set of methods in each class which can be
 //         removed.
+//         A method belongs to a single virtual scope, so the scopes are
+//         merged concurrently. What each scope merged is then applied in
+//         the order of the scopes, and the visibility changes that the
+//         merged methods need are made at the end, so that all scopes see
+//         the same visibility while they check inlinability.
 void VirtualMerging::merge_methods() {
+  struct ScopeMerges {
+    VirtualMergingStats stats;
+    // Pairs of overridden and overriding methods that were merged.
+    std::vector<std::pair<DexMethod*, DexMethod*>> merged;
+  };
+  std::vector<const VirtualScope*> virtual_scopes;
   for (auto& p : m_mergeable_pairs_by_virtual_scopes) {
-    auto virtual_scope = p.first;
-    const auto& mergeable_pairs = p.second;
+    virtual_scopes.push_back(p.first);
+  }
+  std::vector<ScopeMerges> scope_merges(virtual_scopes.size());
+  auto merge_scope = [&](size_t i) {
+    const auto& mergeable_pairs =
+        m_mergeable_pairs_by_virtual_scopes.at(virtual_scopes[i]);
+    auto& stats = scope_merges[i].stats;
+    auto& merged = scope_merges[i].merged;
     for (auto& q : mergeable_pairs) {
       auto overridden_method = q.first;
       auto overriding_method = q.second;
 
-      if (overriding_method->get_code()->sum_opcode_sizes() >
+      if (m_inliner->get_callee_code_units(overriding_method) >
           m_max_overriding_method_instructions) {
         TRACE(VM,
               2,
               "[VM] %s is too large to be merged into %s",
               SHOW(overriding_method),
               SHOW(overridden_method));
-        m_stats.huge_methods++;
+        stats.huge_methods++;
         continue;
       }
       size_t estimated_insn_size =
@@ -384,7 +402,7 @@ void VirtualMerging::merge_methods() {
               "[VM] Cannot inline %s into %s",
               SHOW(overriding_method),
               SHOW(overridden_method));
-        m_stats.uninlinable_methods++;
+        stats.uninlinable_methods++;
         continue;
       }
       TRACE(VM,
@@ -406,7 +424,7 @@ void VirtualMerging::merge_methods() {
         // method body.
         // It starts out with just load-param instructions as needed, and then
         // we'll add an invoke-virtual instruction that will get inlined.
-        m_stats.unabstracted_methods++;
+        stats.unabstracted_methods++;
         overridden_method->make_concrete(
             (DexAccessFlags)(overridden_method->get_access() & !ACC_ABSTRACT),
             std::make_unique<IRCode>(),
@@ -560,7 +578,6 @@ void VirtualMerging::merge_methods() {
       overriding_method->get_code()->build_cfg(/* editable */ true);
       inliner::inline_with_cfg(overridden_method, overriding_method,
                                invoke_virtual_insn);
-      change_visibility(overriding_method, overridden_method->get_class());
       overriding_method->get_code()->clear_cfg();
 
       // Check if everything was inlined.
@@ -572,13 +589,32 @@ void VirtualMerging::merge_methods() {
 
       overridden_code->clear_cfg();
 
+      merged.emplace_back(overridden_method, overriding_method);
+      stats.removed_virtual_methods++;
+    }
+  };
+  auto wq = workqueue_foreach<size_t>(merge_scope);
+  for (size_t i = 0; i < virtual_scopes.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  for (size_t i = 0; i < virtual_scopes.size(); ++i) {
+    const auto& stats = scope_merges[i].stats;
+    m_stats.huge_methods += stats.huge_methods;
+    m_stats.uninlinable_methods += stats.uninlinable_methods;
+    m_stats.unabstracted_methods += stats.unabstracted_methods;
+    m_stats.removed_virtual_methods += stats.removed_virtual_methods;
+    auto virtual_scope_root = virtual_scopes[i]->methods.front();
+    for (const auto& pair : scope_merges[i].merged) {
+      auto overridden_method = pair.first;
+      auto overriding_method = pair.second;
+      change_visibility(overriding_method, overridden_method->get_class());
       m_virtual_methods_to_remove[type_class(overriding_method->get_class())]
           .push_back(overriding_method);
-      auto virtual_scope_root = virtual_scope->methods.front();
       always_assert(overriding_method != virtual_scope_root.first);
       m_virtual_methods_to_remap.emplace(overriding_method,
                                          virtual_scope_root.first);
-      m_stats.removed_virtual_methods++;
     }
   }
 
@@ -304,8 +304,24 @@ def zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align):
     os.remove(unaligned_apk_path)
 
 
+def write_apk_with_redex_tool(apk_writer, extracted_apk_dir, apk_path):
+    # redex-tool compresses the entries in parallel, which is much faster
+    # than zipfile for big APKs.
+    stored_entries_path = apk_path + '.stored'
+    with open(stored_entries_path, 'w') as stored_entries:
+        for archivepath, compress in per_file_compression.items():
+            if compress == zipfile.ZIP_STORED:
+                stored_entries.write(archivepath + '\n')
+    subprocess.check_call([apk_writer, 'pack-apk',
+                           '--apkdir', extracted_apk_dir,
+                           '--out', apk_path,
+                           '--stored-entries', stored_entries_path])
+    os.remove(stored_entries_path)
+
+
 def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
-                      key_alias, key_password, ignore_zipalign, page_align):
+                      key_alias, key_password, ignore_zipalign, page_align,
+                      apk_writer=None):
 
     # Remove old signature files
     for f in abs_glob(extracted_apk_dir, 'META-INF/*'):
@@ -320,17 +336,21 @@ def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
         os.remove(unaligned_apk_path)
 
     # Create new zip file
-    with zipfile.ZipFile(unaligned_apk_path, 'w') as unaligned_apk:
-        for dirpath, _dirnames, filenames in os.walk(extracted_apk_dir):
-            for filename in filenames:
-                filepath = join(dirpath, filename)
-                archivepath = filepath[len(extracted_apk_dir) + 1:]
-                try:
-                    compress = per_file_compression[archivepath]
-                except KeyError:
-                    compress = zipfile.ZIP_DEFLATED
-                unaligned_apk.write(filepath, archivepath,
-                                    compress_type=compress)
+    if apk_writer:
+        write_apk_with_redex_tool(apk_writer, extracted_apk_dir,
+                                  unaligned_apk_path)
+    else:
+        with zipfile.ZipFile(unaligned_apk_path, 'w') as unaligned_apk:
+            for dirpath, _dirnames, filenames in os.walk(extracted_apk_dir):
+                for filename in filenames:
+                    filepath = join(dirpath, filename)
+                    archivepath = filepath[len(extracted_apk_dir) + 1:]
+                    try:
+                        compress = per_file_compression[archivepath]
+                    except KeyError:
+                        compress = zipfile.ZIP_DEFLATED
+                    unaligned_apk.write(filepath, archivepath,
+                                        compress_type=compress)
 
     # Add new signature
     if sign:
@@ -465,6 +485,9 @@ Given an APK, produce a better APK!
                         help='States that this is an art only build')
     parser.add_argument('--page-align-libs', action='store_true',
                         help='Preserve 4k page alignment for uncompressed libs')
+    parser.add_argument('--apk-writer',
+                        help='Path to redex-tool, to zip up the output apk '
+                        'with its multi-threaded pack-apk tool')
 
     parser.add_argument('--side-effect-summaries',
                         help='Side effect information for external methods')
@@ -744,7 +767,8 @@ def finalize_redex(state):
 
     log('Creating output apk')
     create_output_apk(state.extracted_apk_dir, state.args.out, state.args.sign, state.args.keystore,
-                      state.args.keyalias, state.args.keypass, state.args.ignore_zipalign, state.args.page_align_libs)
+                      state.args.keyalias, state.args.keypass, state.args.ignore_zipalign, state.args.page_align_libs,
+                      state.args.apk_writer)
     log('Creating output APK finished in {:.2f} seconds'.format(
         timer() - repack_start_time))
 
@@ -7,55 +7,60 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <functional>
 #include <iostream>
 #include <sstream>
 #include <utility>
 
-#include "ConstantAbstractDomain.h"
+#include "AbstractDomain.h"
 #include "Debug.h"
-#include "PatriciaTreeMapAbstractEnvironment.h"
-#include "ReducedProductAbstractDomain.h"
+#include "PatriciaTreeMap.h"
+
+namespace constant_array_impl {
+
+template <typename Domain>
+class ArrayValue;
+
+} // namespace constant_array_impl
 
 /*
  * An abstract domain modeling an array that has a fixed, statically determined
- * size. It's a reduced product of a constant domain and a
- * PatriciaTreeMapAbstractEnvironment. It differs from a plain environment in
- * the following ways:
+ * size. It differs from a plain environment in the following ways:
  *
  *   - Reading from an out-of-bounds index returns Bottom
  *   - Assigning to an out-of-bounds index causes the array to be set to Bottom
  *   - Top represents arrays of any size. If it is Top, any attempts to update
  *     its bindings are no-ops, since we cannot determine if our array reads
  *     and writes are within its bounds.
+ *
+ * The elements are represented by a fill value, which is what all the
+ * elements of a new array start out as, and the elements that differ from it.
+ * Creating an array, or joining two arrays, thus costs time and memory
+ * proportional to the number of elements that were written, not to the
+ * length of the array. Arrays that end up with more than
+ * kMaxExplicitElements elements differing from the fill value are
+ * summarized: the fill value becomes the join of all the elements, and reads
+ * of any index return it, until more elements are written.
  */
 template <typename Domain>
 class ConstantArrayDomain final
-    : public sparta::ReducedProductAbstractDomain<
-          ConstantArrayDomain<Domain>,
-          sparta::ConstantAbstractDomain<uint32_t> /* array length */,
-          sparta::PatriciaTreeMapAbstractEnvironment<
-              uint32_t,
-              Domain> /* array values */> {
+    : public sparta::AbstractDomainScaffolding<
+          constant_array_impl::ArrayValue<Domain>,
+          ConstantArrayDomain<Domain>> {
  public:
-  using ArrayLengthDomain = sparta::ConstantAbstractDomain<uint32_t>;
-  using ArrayValuesDomain =
-      sparta::PatriciaTreeMapAbstractEnvironment<uint32_t, Domain>;
-  using SuperType =
-      sparta::ReducedProductAbstractDomain<ConstantArrayDomain<Domain>,
-                                           ArrayLengthDomain,
-                                           ArrayValuesDomain>;
-  using typename SuperType::ReducedProductAbstractDomain;
-
-  // Some older compilers complain that the class is not default constructible.
-  // We intended to use the default constructors of the base class (via the
-  // `using` declaration above), but some compilers fail to catch this. So we
-  // insert a redundant '= default'.
+  using Value = constant_array_impl::ArrayValue<Domain>;
+
+  static constexpr size_t kMaxExplicitElements = 1000;
+
+  /*
+   * The default constructor produces the Top value.
+   */
   ConstantArrayDomain() = default;
 
-  static void reduce_product(
-      std::tuple<ArrayLengthDomain, ArrayValuesDomain>& domains) {}
+  explicit ConstantArrayDomain(sparta::AbstractValueKind kind)
+      : sparta::AbstractDomainScaffolding<Value, ConstantArrayDomain>(kind) {}
 
   ~ConstantArrayDomain() override {
     // The destructor is the only method that is guaranteed to be created when
@@ -67,41 +72,23 @@ class ConstantArrayDomain final
   }
 
   ConstantArrayDomain(uint32_t length) {
-    mutate_array_length(
-        [length](ArrayLengthDomain* len) { *len = ArrayLengthDomain(length); });
-    mutate_array_values([length](ArrayValuesDomain* values) {
-      // default_value should typically be something representing zero, since
-      // Java arrays are zero-initialized.
-      for (size_t i = 0; i < length; ++i) {
-        values->set(i, Domain::default_value());
-      }
-    });
-    canonicalize();
-  }
-
-  void join_with(const ConstantArrayDomain<Domain>& other_domain) override {
-    SuperType::join_with(other_domain);
-    canonicalize();
-  }
-
-  void widen_with(const ConstantArrayDomain<Domain>& other_domain) override {
-    SuperType::widen_with(other_domain);
-    canonicalize();
+    // default_value should typically be something representing zero, since
+    // Java arrays are zero-initialized.
+    this->set_to_value(Value(length, Domain::default_value()));
   }
 
-  bool is_value() const { return !this->is_top() && !this->is_bottom(); }
-
   uint32_t length() const {
-    auto len = array_length();
-    redex_assert(len.is_value());
-    return *len.get_constant();
+    redex_assert(this->is_value());
+    return this->get_value()->length();
   }
 
-  // NOTE: This will throw if array_values() is Top.
-  const typename sparta::PatriciaTreeMapAbstractEnvironment<uint32_t,
-                                                            Domain>::MapType&
-  bindings() const {
-    return array_values().bindings();
+  /*
+   * The number of elements that are represented individually, rather than by
+   * the fill value.
+   */
+  size_t num_explicit_elements() const {
+    redex_assert(this->is_value());
+    return this->get_value()->num_explicit_elements();
   }
 
   Domain get(uint32_t idx) const {
@@ -111,75 +98,282 @@ class ConstantArrayDomain final
     if (this->is_bottom() || !(idx < this->length())) {
       return Domain::bottom();
     }
-    return array_values().get(idx);
+    return this->get_value()->get(idx);
   }
 
   ConstantArrayDomain& set(uint32_t idx, const Domain& value) {
-    if (!is_value()) {
+    if (!this->is_value()) {
       return *this;
     }
-    if (!(idx < length())) {
+    if (!(idx < length()) || value.is_bottom()) {
       this->set_to_bottom();
       return *this;
     }
-    return this->mutate_array_values(
-        [&](ArrayValuesDomain* values) { values->set(idx, value); });
+    this->get_value()->set(idx, value);
+    summarize_if_too_large();
+    return *this;
   }
 
   ConstantArrayDomain& update(uint32_t idx,
                               std::function<Domain(const Domain&)> operation) {
-    if (!is_value()) {
+    if (!this->is_value()) {
       return *this;
     }
     if (!(idx < this->length())) {
       this->set_to_bottom();
       return *this;
     }
-    this->mutate_array_values(
-        [&](ArrayValuesDomain* values) { values->update(idx, operation); });
-    return *this;
+    return set(idx, operation(this->get_value()->get(idx)));
+  }
+
+  void join_with(const ConstantArrayDomain& other) override {
+    sparta::AbstractDomainScaffolding<Value, ConstantArrayDomain>::join_with(
+        other);
+    summarize_if_too_large();
+  }
+
+  void widen_with(const ConstantArrayDomain& other) override {
+    sparta::AbstractDomainScaffolding<Value, ConstantArrayDomain>::widen_with(
+        other);
+    summarize_if_too_large();
+  }
+
+  /*
+   * The number of times an array of this domain was summarized, since the
+   * start of the process. Passes report the difference as a metric.
+   */
+  static size_t num_summarized() { return s_num_summarized.load(); }
+
+  static ConstantArrayDomain bottom() {
+    return ConstantArrayDomain(sparta::AbstractValueKind::Bottom);
+  }
+
+  static ConstantArrayDomain top() {
+    return ConstantArrayDomain(sparta::AbstractValueKind::Top);
   }
 
   std::string str() const;
 
  private:
-  // We have defined another get() method above, so this `using` declaration
-  // is necessary to make it clear that the calls in array_length() and
-  // array_values() below are referring to the superclass' implementation.
-  using SuperType::get;
+  void summarize_if_too_large() {
+    if (this->is_value() &&
+        this->get_value()->num_explicit_elements() > kMaxExplicitElements) {
+      this->get_value()->summarize();
+      ++s_num_summarized;
+    }
+  }
+
+  static std::atomic<size_t> s_num_summarized;
+};
+
+template <typename Domain>
+constexpr size_t ConstantArrayDomain<Domain>::kMaxExplicitElements;
+
+template <typename Domain>
+std::atomic<size_t> ConstantArrayDomain<Domain>::s_num_summarized{0};
+
+namespace constant_array_impl {
 
-  const ArrayLengthDomain& array_length() const {
-    return this->template get<0>();
+template <typename Domain>
+class ArrayValue final : public sparta::AbstractValue<ArrayValue<Domain>> {
+ public:
+  // Elements that are not in the map are equal to the fill value. Using
+  // Bottom, which is never stored, as the default lets the map hold any other
+  // element, Top included.
+  struct ElementInterface {
+    using type = Domain;
+
+    static type default_value() { return type::bottom(); }
+
+    static bool is_default_value(const type& x) { return x.is_bottom(); }
+
+    static bool equals(const type& x, const type& y) { return x.equals(y); }
+
+    static bool leq(const type& x, const type& y) { return x.leq(y); }
+  };
+
+  using ElementMap =
+      sparta::PatriciaTreeMap<uint32_t, Domain, ElementInterface>;
+
+  ArrayValue() = default;
+
+  ArrayValue(uint32_t length, const Domain& fill)
+      : m_has_length(true), m_length(length), m_fill(fill) {}
+
+  void clear() override {
+    m_has_length = false;
+    m_length = 0;
+    m_fill = Domain::top();
+    m_elements.clear();
+    m_num_elements = 0;
   }
 
-  const ArrayValuesDomain& array_values() const {
-    return this->template get<1>();
+  // Without a length, nothing is known about the array.
+  sparta::AbstractValueKind kind() const override {
+    return m_has_length ? sparta::AbstractValueKind::Value
+                        : sparta::AbstractValueKind::Top;
   }
 
-  ConstantArrayDomain<Domain>& mutate_array_length(
-      std::function<void(ArrayLengthDomain*)> f) {
-    this->template apply<0>(f);
-    canonicalize();
-    return *this;
+  uint32_t length() const { return m_length; }
+
+  size_t num_explicit_elements() const { return m_num_elements; }
+
+  Domain get(uint32_t idx) const {
+    auto value = m_elements.at(idx);
+    return value.is_bottom() ? m_fill : value;
   }
 
-  ConstantArrayDomain<Domain>& mutate_array_values(
-      std::function<void(ArrayValuesDomain*)> f) {
-    this->template apply<1>(f);
-    return *this;
+  void set(uint32_t idx, const Domain& value) {
+    bool was_explicit = !m_elements.at(idx).is_bottom();
+    if (value.equals(m_fill)) {
+      if (was_explicit) {
+        m_elements.insert_or_assign(idx, Domain::bottom());
+        --m_num_elements;
+      }
+      return;
+    }
+    m_elements.insert_or_assign(idx, value);
+    if (!was_explicit) {
+      ++m_num_elements;
+    }
   }
 
-  void canonicalize() {
-    // If we have an array of unknown length, we can't say anything about its
-    // values either -- we don't know if a given read or write to the array
-    // is going to throw an OOB exception.
-    if (array_length().is_top()) {
-      mutate_array_values(
-          [](ArrayValuesDomain* values) { values->set_to_top(); });
+  // Folds the explicit elements into the fill value.
+  void summarize() {
+    for (const auto& pair : m_elements) {
+      m_fill.join_with(pair.second);
     }
+    m_elements.clear();
+    m_num_elements = 0;
+  }
+
+  bool leq(const ArrayValue& other) const override {
+    return all_of_elements(
+        other, [](const Domain& x, const Domain& y) { return x.leq(y); });
+  }
+
+  bool equals(const ArrayValue& other) const override {
+    return all_of_elements(
+        other, [](const Domain& x, const Domain& y) { return x.equals(y); });
   }
+
+  sparta::AbstractValueKind join_with(const ArrayValue& other) override {
+    return join_like_operation(
+        other, [](const Domain& x, const Domain& y) { return x.join(y); });
+  }
+
+  sparta::AbstractValueKind widen_with(const ArrayValue& other) override {
+    return join_like_operation(
+        other, [](const Domain& x, const Domain& y) { return x.widening(y); });
+  }
+
+  sparta::AbstractValueKind meet_with(const ArrayValue& other) override {
+    return meet_like_operation(
+        other, [](const Domain& x, const Domain& y) { return x.meet(y); });
+  }
+
+  sparta::AbstractValueKind narrow_with(const ArrayValue& other) override {
+    return meet_like_operation(
+        other, [](const Domain& x, const Domain& y) { return x.narrowing(y); });
+  }
+
+ private:
+  using Operation = std::function<Domain(const Domain&, const Domain&)>;
+
+  // Whether `predicate` holds for each pair of elements at the same index.
+  // The fill values only need to be compared when some index is explicit in
+  // neither array.
+  template <typename Predicate>
+  bool all_of_elements(const ArrayValue& other, Predicate predicate) const {
+    if (m_length != other.m_length) {
+      return false;
+    }
+    size_t num_explicit = m_num_elements;
+    if (!m_elements.reference_equals(other.m_elements)) {
+      for (const auto& pair : m_elements) {
+        if (!predicate(pair.second, other.get(pair.first))) {
+          return false;
+        }
+      }
+      for (const auto& pair : other.m_elements) {
+        if (m_elements.at(pair.first).is_bottom()) {
+          ++num_explicit;
+          if (!predicate(m_fill, pair.second)) {
+            return false;
+          }
+        }
+      }
+    }
+    return num_explicit == m_length || predicate(m_fill, other.m_fill);
+  }
+
+  // Applies `operation` to each pair of elements at the same index. Returns
+  // false if the result has a Bottom element.
+  bool combine_with(const ArrayValue& other, const Operation& operation) {
+    Domain fill = operation(m_fill, other.m_fill);
+    if (m_elements.reference_equals(other.m_elements)) {
+      m_fill = fill;
+      return m_num_elements == m_length || !fill.is_bottom();
+    }
+    ElementMap elements;
+    size_t num_elements = 0;
+    bool has_bottom = false;
+    auto bind = [&](uint32_t idx, const Domain& value) {
+      if (value.is_bottom()) {
+        has_bottom = true;
+      } else if (!value.equals(fill)) {
+        elements.insert_or_assign(idx, value);
+        ++num_elements;
+      }
+    };
+    size_t num_explicit = m_num_elements;
+    for (const auto& pair : m_elements) {
+      bind(pair.first, operation(pair.second, other.get(pair.first)));
+    }
+    for (const auto& pair : other.m_elements) {
+      if (m_elements.at(pair.first).is_bottom()) {
+        ++num_explicit;
+        bind(pair.first, operation(m_fill, pair.second));
+      }
+    }
+    if (has_bottom || (num_explicit < m_length && fill.is_bottom())) {
+      return false;
+    }
+    m_fill = fill;
+    m_elements = elements;
+    m_num_elements = num_elements;
+    return true;
+  }
+
+  sparta::AbstractValueKind join_like_operation(const ArrayValue& other,
+                                                const Operation& operation) {
+    // Arrays of different lengths join to an array of unknown length.
+    if (m_length != other.m_length) {
+      clear();
+      return sparta::AbstractValueKind::Top;
+    }
+    combine_with(other, operation);
+    return sparta::AbstractValueKind::Value;
+  }
+
+  sparta::AbstractValueKind meet_like_operation(const ArrayValue& other,
+                                                const Operation& operation) {
+    if (m_length != other.m_length || !combine_with(other, operation)) {
+      clear();
+      return sparta::AbstractValueKind::Bottom;
+    }
+    return sparta::AbstractValueKind::Value;
+  }
+
+  bool m_has_length{false};
+  uint32_t m_length{0};
+  Domain m_fill{Domain::top()};
+  ElementMap m_elements;
+  size_t m_num_elements{0};
 };
 
+} // namespace constant_array_impl
+
 template <typename Domain>
 inline std::ostream& operator<<(std::ostream& o,
                                 const ConstantArrayDomain<Domain>& e) {
@@ -194,9 +388,8 @@ inline std::ostream& operator<<(std::ostream& o,
 
   o << "[#" << e.length() << "]";
   o << "{";
-  auto& bindings = e.bindings();
   for (size_t i = 0; i < e.length();) {
-    o << bindings.at(i);
+    o << e.get(i);
     ++i;
     if (i != e.length()) {
       o << ", ";
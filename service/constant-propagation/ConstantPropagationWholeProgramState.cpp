@@ -147,6 +147,22 @@ WholeProgramState::WholeProgramState(
   });
   analyze_clinits(scope, fp_iter, &m_field_partition);
   collect(scope, fp_iter);
+  freeze();
+}
+
+void WholeProgramState::freeze() {
+  thaw();
+  m_frozen_values.reserve(1 + m_known_fields.size() + m_known_methods.size());
+  m_frozen_values.push_back(ConstantValue::top());
+  for (auto* field : m_known_fields) {
+    m_frozen_field_slots[field] = m_frozen_values.size();
+    m_frozen_values.push_back(m_field_partition.get(field));
+  }
+  for (auto* method : m_known_methods) {
+    m_frozen_method_slots[method] = m_frozen_values.size();
+    m_frozen_values.push_back(m_method_partition.get(method));
+  }
+  m_frozen = true;
 }
 
 /*
@@ -233,6 +249,7 @@ void WholeProgramState::collect_return_values(const IRInstruction* insn,
 
 void WholeProgramState::collect_static_finals(const DexClass* cls,
                                               FieldEnvironment field_env) {
+  thaw();
   for (auto* field : cls->get_sfields()) {
     if (is_static(field) && is_final(field) && !field->is_external()) {
       m_known_fields.emplace(field);
@@ -248,6 +265,7 @@ void WholeProgramState::collect_instance_finals(
     const DexClass* cls,
     const EligibleIfields& eligible_ifields,
     FieldEnvironment field_env) {
+  thaw();
   always_assert(!cls->is_external());
   if (cls->get_ctors().size() > 1) {
     // Not dealing with instance field in class not having exact 1 constructor
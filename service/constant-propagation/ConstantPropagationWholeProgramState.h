@@ -9,6 +9,7 @@
 
 #include "CallGraph.h"
 #include "ConstantEnvironment.h"
+#include "DexIdContainers.h"
 #include "HashedAbstractPartition.h"
 #include "InstructionAnalyzer.h"
 
@@ -63,10 +64,19 @@ class WholeProgramState {
                                FieldEnvironment);
 
   void set_to_top() {
+    thaw();
     m_field_partition.set_to_top();
     m_method_partition.set_to_top();
   }
 
+  /*
+   * Copy the values of the known fields and methods to tables indexed by
+   * their ids, so that the lookups of the analyzers are array accesses
+   * instead of hashing. The constructor that analyzes a scope does this, and
+   * the collect_*() methods undo it.
+   */
+  void freeze();
+
   bool leq(const WholeProgramState& other) const {
     return m_field_partition.leq(other.m_field_partition) &&
            m_method_partition.leq(other.m_method_partition);
@@ -78,6 +88,9 @@ class WholeProgramState {
    * It will never return Bottom.
    */
   ConstantValue get_field_value(const DexField* field) const {
+    if (m_frozen) {
+      return m_frozen_values[m_frozen_field_slots.get(field)];
+    }
     if (!m_known_fields.count(field)) {
       return ConstantValue::top();
     }
@@ -91,6 +104,9 @@ class WholeProgramState {
    * throws or loops indefinitely).
    */
   ConstantValue get_return_value(const DexMethod* method) const {
+    if (m_frozen) {
+      return m_frozen_values[m_frozen_method_slots.get(method)];
+    }
     if (!m_known_methods.count(method)) {
       return ConstantValue::top();
     }
@@ -117,6 +133,13 @@ class WholeProgramState {
                              const ConstantEnvironment& env,
                              const DexMethod* method);
 
+  void thaw() {
+    m_frozen = false;
+    m_frozen_field_slots.clear();
+    m_frozen_method_slots.clear();
+    m_frozen_values.clear();
+  }
+
   // Unknown fields and methods will be treated as containing / returning Top.
   std::unordered_set<const DexField*> m_known_fields;
   std::unordered_set<const DexMethod*> m_known_methods;
@@ -142,6 +165,13 @@ class WholeProgramState {
   // Environment to Bottom.
   ConstantFieldPartition m_field_partition;
   ConstantMethodPartition m_method_partition;
+
+  // Filled by freeze(): where the value of each known field and method is in
+  // m_frozen_values. The first value is Top, for the unknown ones.
+  bool m_frozen{false};
+  IdVector<DexFieldRef, uint32_t> m_frozen_field_slots;
+  IdVector<DexMethodRef, uint32_t> m_frozen_method_slots;
+  std::vector<ConstantValue> m_frozen_values;
 };
 
 /*
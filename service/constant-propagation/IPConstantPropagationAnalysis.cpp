@@ -7,6 +7,12 @@
 
 #include "IPConstantPropagationAnalysis.h"
 
+#include <algorithm>
+#include <atomic>
+
+#include "Resolver.h"
+#include "WorkQueue.h"
+
 namespace constant_propagation {
 
 namespace interprocedural {
@@ -62,7 +68,7 @@ void FixpointIterator::analyze_node(DexMethod* const& method,
 }
 
 Domain FixpointIterator::analyze_edge(
-    const std::shared_ptr<call_graph::Edge>& edge,
+    const call_graph::EdgeId& edge,
     const Domain& exit_state_at_source) const {
   Domain entry_state_at_dest;
   auto it = edge->invoke_iterator();
@@ -78,10 +84,189 @@ Domain FixpointIterator::analyze_edge(
 
 std::unique_ptr<intraprocedural::FixpointIterator>
 FixpointIterator::get_intraprocedural_analysis(const DexMethod* method) const {
-  auto args = this->get_entry_state_at(const_cast<DexMethod*>(method));
-  return m_proc_analysis_factory(method,
-                                 this->get_whole_program_state(),
-                                 args.get(CURRENT_PARTITION_LABEL));
+  ArgumentDomain args = ArgumentDomain::bottom();
+  if (m_parallel) {
+    if (m_call_graph.has_node(method)) {
+      args = m_node_states[m_call_graph.node(method).id()].args;
+    }
+  } else {
+    args = this->get_entry_state_at(const_cast<DexMethod*>(method))
+               .get(CURRENT_PARTITION_LABEL);
+  }
+  return m_proc_analysis_factory(method, this->get_whole_program_state(),
+                                 args);
+}
+
+size_t FixpointIterator::run_in_parallel(size_t num_threads) {
+  if (m_sccs == nullptr) {
+    m_parallel = true;
+    m_sccs = std::make_unique<call_graph::Sccs>(m_call_graph);
+    m_node_states.resize(m_call_graph.num_nodes());
+    // Record what each method reads of the whole program state, the same way
+    // WholeProgramAwareAnalyzer finds it.
+    auto wq = workqueue_foreach<uint32_t>(
+        [&](uint32_t id) {
+          auto* method = m_call_graph.node_at(id).method();
+          if (method == nullptr || method->get_code() == nullptr) {
+            return;
+          }
+          auto& state = m_node_states[id];
+          for (const auto& mie : InstructionIterable(method->get_code())) {
+            auto* insn = mie.insn;
+            auto op = insn->opcode();
+            if (is_sget(op) || is_iget(op)) {
+              auto field = resolve_field(insn->get_field());
+              if (field != nullptr) {
+                state.fields.push_back(field);
+              }
+            } else if (op == OPCODE_INVOKE_DIRECT ||
+                       op == OPCODE_INVOKE_STATIC ||
+                       op == OPCODE_INVOKE_VIRTUAL) {
+              auto callee =
+                  resolve_method(insn->get_method(), opcode_to_search(insn));
+              if (callee != nullptr) {
+                state.methods.push_back(callee);
+              }
+            }
+          }
+          std::sort(state.fields.begin(), state.fields.end());
+          state.fields.erase(
+              std::unique(state.fields.begin(), state.fields.end()),
+              state.fields.end());
+          std::sort(state.methods.begin(), state.methods.end());
+          state.methods.erase(
+              std::unique(state.methods.begin(), state.methods.end()),
+              state.methods.end());
+        },
+        num_threads);
+    for (uint32_t id = 1; id < m_call_graph.num_nodes(); ++id) {
+      wq.add_item(id);
+    }
+    wq.run_all();
+  }
+
+  std::atomic<size_t> analyzed{0};
+  call_graph::parallel_top_down(
+      *m_sccs,
+      [&](call_graph::Sccs::SccId id) { analyzed += analyze_scc(id); },
+      num_threads);
+  m_analyzed_wps.reset();
+  return analyzed;
+}
+
+ArgumentDomain FixpointIterator::incoming_args(const DexMethod* method,
+                                               bool from_outside_only) const {
+  ArgumentDomain args = ArgumentDomain::bottom();
+  for (const auto& edge : m_call_graph.node(method).callers()) {
+    auto caller_id = m_call_graph.node(edge->caller()).id();
+    // The ghost entry node has no component.
+    if (from_outside_only && caller_id != 0 &&
+        m_sccs->scc_of(edge->caller()) == m_sccs->scc_of(method)) {
+      continue;
+    }
+    // The exit state of the ghost entry node is never looked at: its edges
+    // pass Top.
+    const auto& caller_state = m_node_states[caller_id];
+    args.join_with(analyze_edge(edge, caller_state.exit_state)
+                       .get(CURRENT_PARTITION_LABEL));
+  }
+  return args;
+}
+
+bool FixpointIterator::reads_changed_values(const NodeState& state) const {
+  if (m_analyzed_wps == nullptr) {
+    return false;
+  }
+  for (auto* field : state.fields) {
+    if (!m_analyzed_wps->get_field_value(field).equals(
+            m_wps->get_field_value(field))) {
+      return true;
+    }
+  }
+  for (auto* method : state.methods) {
+    if (!m_analyzed_wps->get_return_value(method).equals(
+            m_wps->get_return_value(method))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * The components that call into this one are done, so the arguments that
+ * come from outside of it are final.
+ */
+size_t FixpointIterator::analyze_scc(call_graph::Sccs::SccId id) {
+  auto members = m_sccs->members(id);
+  auto state_of = [&](const DexMethod* method) -> NodeState& {
+    return m_node_states[m_call_graph.node(method).id()];
+  };
+  auto analyze = [&](DexMethod* method, NodeState* state) {
+    Domain current_state;
+    current_state.set(CURRENT_PARTITION_LABEL, state->args);
+    analyze_node(method, &current_state);
+    state->exit_state = std::move(current_state);
+    state->analyzed = true;
+  };
+
+  if (!m_sccs->is_recursive(id)) {
+    auto* method = *members.begin();
+    auto& state = state_of(method);
+    auto args = incoming_args(method);
+    if (state.analyzed && args.equals(state.args) &&
+        !reads_changed_values(state)) {
+      return 0;
+    }
+    state.args = std::move(args);
+    analyze(method, &state);
+    return 1;
+  }
+
+  // The arguments of a recursive component are a fixpoint of its own, which
+  // has to be recomputed from scratch when anything it depends on changed.
+  bool unchanged = true;
+  for (auto* method : members) {
+    auto& state = state_of(method);
+    auto outside_args = incoming_args(method, /* from_outside_only */ true);
+    if (!state.analyzed || reads_changed_values(state) ||
+        !outside_args.equals(state.outside_args)) {
+      unchanged = false;
+    }
+    state.outside_args = std::move(outside_args);
+  }
+  if (unchanged) {
+    return 0;
+  }
+  for (auto* method : members) {
+    auto& state = state_of(method);
+    state.args = ArgumentDomain::bottom();
+    state.exit_state = Domain::bottom();
+    state.analyzed = false;
+  }
+  size_t count{0};
+  // Join first, then widen, like the default policy of the sequential
+  // iterator.
+  for (size_t iteration = 0;; ++iteration) {
+    bool changed = false;
+    for (auto* method : members) {
+      auto& state = state_of(method);
+      auto args = incoming_args(method);
+      if (state.analyzed && args.leq(state.args)) {
+        continue;
+      }
+      if (iteration == 0) {
+        state.args.join_with(args);
+      } else {
+        state.args.widen_with(args);
+      }
+      analyze(method, &state);
+      changed = true;
+      ++count;
+    }
+    if (!changed) {
+      return count;
+    }
+  }
 }
 
 } // namespace interprocedural
@@ -81,20 +81,64 @@ class FixpointIterator
   void analyze_node(DexMethod* const& method,
                     Domain* current_state) const override;
 
-  Domain analyze_edge(const std::shared_ptr<call_graph::Edge>& edge,
+  Domain analyze_edge(const call_graph::EdgeId& edge,
                       const Domain& exit_state_at_source) const override;
 
+  /*
+   * Does the same as run() from Top arguments at the roots, but analyzes the
+   * strongly connected components of the call graph top-down, concurrently
+   * when they don't depend on each other. A recursive component is iterated
+   * on its own until the arguments of its methods are stable.
+   *
+   * Each method remembers the arguments and the whole program state values
+   * it was last analyzed with, and the next call only analyzes it again if
+   * either changed. Returns the number of methods analyzed.
+   */
+  size_t run_in_parallel(
+      size_t num_threads = walk::parallel::default_num_threads());
+
   std::unique_ptr<intraprocedural::FixpointIterator>
   get_intraprocedural_analysis(const DexMethod*) const;
 
   const WholeProgramState& get_whole_program_state() const { return *m_wps; }
 
   void set_whole_program_state(std::unique_ptr<WholeProgramState> wps) {
+    if (m_parallel && m_analyzed_wps == nullptr) {
+      // Kept to tell which methods read values that changed.
+      m_analyzed_wps = std::move(m_wps);
+    }
     m_wps = std::move(wps);
   }
 
  private:
+  // What run_in_parallel() knows of a call graph node.
+  struct NodeState {
+    ArgumentDomain args{ArgumentDomain::bottom()};
+    // For the members of recursive components, the part of `args` that comes
+    // from the callers outside of the component.
+    ArgumentDomain outside_args{ArgumentDomain::bottom()};
+    Domain exit_state{Domain::bottom()};
+    bool analyzed{false};
+    // The fields and methods whose whole program values the node reads.
+    std::vector<const DexField*> fields;
+    std::vector<const DexMethod*> methods;
+  };
+
+  size_t analyze_scc(call_graph::Sccs::SccId id);
+
+  ArgumentDomain incoming_args(const DexMethod* method,
+                               bool from_outside_only = false) const;
+
+  bool reads_changed_values(const NodeState& state) const;
+
   std::unique_ptr<const WholeProgramState> m_wps;
+  // The whole program state that run_in_parallel() last ran with, when it has
+  // been replaced since.
+  std::unique_ptr<const WholeProgramState> m_analyzed_wps;
+  bool m_parallel{false};
+  std::unique_ptr<call_graph::Sccs> m_sccs;
+  // Indexed by call graph node id.
+  std::vector<NodeState> m_node_states;
   ProcedureAnalysisFactory m_proc_analysis_factory;
   call_graph::Graph m_call_graph;
 };
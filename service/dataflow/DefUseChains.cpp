@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DefUseChains.h"
+
+#include "IRCode.h"
+#include "ReachingDefinitions.h"
+
+namespace {
+
+const std::vector<def_use::Def> no_defs;
+const std::vector<def_use::Use> no_uses;
+
+// Mirrors ControlFlowGraph::primary_instruction_of_move_result(), which only
+// works on mutable graphs.
+IRInstruction* primary_instruction_of(const cfg::Block* block,
+                                      IRInstruction* previous) {
+  if (previous != nullptr) {
+    return previous;
+  }
+  const auto& preds = block->preds();
+  always_assert(preds.size() == 1);
+  auto* previous_block = preds.front()->src();
+  auto it = previous_block->get_last_insn();
+  always_assert(it != previous_block->end());
+  return it->insn;
+}
+
+} // namespace
+
+namespace def_use {
+
+DefUseChains::DefUseChains(const cfg::ControlFlowGraph& cfg) {
+  reaching_defs::FixpointIterator fixpoint_iter{cfg};
+  fixpoint_iter.run(reaching_defs::Environment());
+  for (cfg::Block* block : cfg.blocks()) {
+    reaching_defs::Environment defs_in =
+        fixpoint_iter.get_entry_state_at(block);
+    IRInstruction* previous = nullptr;
+    for (const auto& mie : InstructionIterable(block)) {
+      auto* insn = mie.insn;
+      if (insn->srcs_size() > 0) {
+        auto& operands = m_use_def[insn];
+        operands.resize(insn->srcs_size());
+        for (uint16_t i = 0; i < insn->srcs_size(); ++i) {
+          auto defs = defs_in.get(insn->src(i));
+          if (defs.is_top() || defs.is_bottom()) {
+            continue;
+          }
+          for (auto* def : defs.elements()) {
+            operands[i].push_back(def);
+            m_def_use[def].push_back(Use{insn, i});
+          }
+        }
+      }
+      if (insn->dests_size()) {
+        m_defs.push_back(insn);
+        auto* producer =
+            opcode::is_move_result_or_move_result_pseudo(insn->opcode())
+                ? primary_instruction_of(block, previous)
+                : insn;
+        m_producers.emplace(insn, producer);
+        m_produced.emplace(producer, insn);
+      }
+      fixpoint_iter.analyze_instruction(insn, &defs_in);
+      previous = insn;
+    }
+  }
+}
+
+const std::vector<Def>& DefUseChains::defs_of(const IRInstruction* insn,
+                                              uint16_t src_index) const {
+  auto it = m_use_def.find(insn);
+  if (it == m_use_def.end() || src_index >= it->second.size()) {
+    return no_defs;
+  }
+  return it->second[src_index];
+}
+
+const std::vector<Use>& DefUseChains::uses_of(const IRInstruction* def) const {
+  auto it = m_def_use.find(def);
+  return it == m_def_use.end() ? no_uses : it->second;
+}
+
+IRInstruction* DefUseChains::producer_of(const IRInstruction* def) const {
+  auto it = m_producers.find(def);
+  always_assert(it != m_producers.end());
+  return it->second;
+}
+
+Def DefUseChains::def_of(const IRInstruction* insn) const {
+  auto it = m_produced.find(insn);
+  return it == m_produced.end() ? nullptr : it->second;
+}
+
+} // namespace def_use
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "IRInstruction.h"
+
+namespace def_use {
+
+// Every IRInstruction has at most one def, so we can represent defs by
+// instructions.
+using Def = IRInstruction*;
+
+struct Use {
+  IRInstruction* insn;
+  uint16_t src_index;
+};
+
+/*
+ * The def-use and use-def chains of a method, computed from the reaching
+ * definitions of its registers.
+ *
+ * The result of an invoke or of an instruction with a move-result-pseudo is
+ * defined by the move-result that follows it. The instruction that computes
+ * the value of such a def, which we call its producer, is the one before the
+ * move-result; the producer of every other def is the def itself.
+ */
+class DefUseChains {
+ public:
+  explicit DefUseChains(const cfg::ControlFlowGraph& cfg);
+
+  // All the defs of the method, in the order of the blocks.
+  const std::vector<Def>& defs() const { return m_defs; }
+
+  // The defs that reach the operand `src_index` of `insn`. Operands of
+  // unreachable code have no reaching defs.
+  const std::vector<Def>& defs_of(const IRInstruction* insn,
+                                  uint16_t src_index) const;
+
+  // The operands that `def` reaches.
+  const std::vector<Use>& uses_of(const IRInstruction* def) const;
+
+  // The instruction that computes the value of `def`.
+  IRInstruction* producer_of(const IRInstruction* def) const;
+
+  // The def whose value `insn` computes, if any. This is the inverse of
+  // producer_of().
+  Def def_of(const IRInstruction* insn) const;
+
+ private:
+  std::vector<Def> m_defs;
+  std::unordered_map<const IRInstruction*, std::vector<std::vector<Def>>>
+      m_use_def;
+  std::unordered_map<const IRInstruction*, std::vector<Use>> m_def_use;
+  std::unordered_map<const IRInstruction*, IRInstruction*> m_producers;
+  std::unordered_map<const IRInstruction*, Def> m_produced;
+};
+
+} // namespace def_use
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Liveness.h"
+
+#include <limits>
+
+#include "IRCode.h"
+
+namespace {
+
+// Everything the liveness of a CFG depends on, besides its edges: the
+// instructions of each block, in order, and their dests and srcs. This only
+// records what the instructions contain, never where they live: an edited
+// instruction may be freed and its memory reused by a different one.
+using Registers = std::vector<uintptr_t>;
+
+constexpr uintptr_t NO_DEST = std::numeric_limits<uintptr_t>::max();
+
+Registers registers_of(const cfg::ControlFlowGraph& cfg) {
+  Registers registers;
+  for (cfg::Block* block : cfg.blocks()) {
+    registers.push_back(block->id());
+    for (const auto& mie : ir_list::InstructionIterable(block)) {
+      auto insn = mie.insn;
+      registers.push_back(static_cast<uintptr_t>(insn->opcode()));
+      registers.push_back(insn->dests_size() ? insn->dest() : NO_DEST);
+      registers.push_back(insn->srcs_size());
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        registers.push_back(insn->src(i));
+      }
+    }
+  }
+  return registers;
+}
+
+struct SharedLiveness {
+  Registers registers;
+  std::shared_ptr<const LivenessFixpointIterator> fixpoint_iter;
+};
+
+} // namespace
+
+std::shared_ptr<const LivenessFixpointIterator> get_liveness(
+    const cfg::ControlFlowGraph& cfg) {
+  auto& slot = cfg.liveness_slot();
+  auto registers = registers_of(cfg);
+  if (slot != nullptr) {
+    auto shared = std::static_pointer_cast<const SharedLiveness>(slot);
+    if (shared->registers == registers) {
+      return shared->fixpoint_iter;
+    }
+  }
+  auto fixpoint_iter = std::make_shared<LivenessFixpointIterator>(cfg);
+  fixpoint_iter->run(LivenessDomain());
+  slot = std::make_shared<const SharedLiveness>(
+      SharedLiveness{std::move(registers), fixpoint_iter});
+  return fixpoint_iter;
+}
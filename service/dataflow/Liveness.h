@@ -8,10 +8,11 @@
 #pragma once
 
 #include "BaseIRAnalyzer.h"
+#include "BitSetAbstractDomain.h"
 #include "ControlFlow.h"
-#include "PatriciaTreeSetAbstractDomain.h"
 
-using LivenessDomain = sparta::PatriciaTreeSetAbstractDomain<uint16_t>;
+// Registers are numbered densely from zero, so their sets are bit sets.
+using LivenessDomain = sparta::BitSetAbstractDomain<uint16_t>;
 
 class LivenessFixpointIterator final
     : public ir_analyzer::BaseBackwardsIRAnalyzer<LivenessDomain> {
@@ -37,3 +38,22 @@ class LivenessFixpointIterator final
     return get_entry_state_at(block);
   }
 };
+
+/*
+ * The liveness of the CFG, computed once and then shared by every analysis
+ * and transformation that asks for it until the CFG changes. Register
+ * allocation, goto reduction, block deduplication and the outliner all get
+ * theirs from here.
+ *
+ * The result is kept in the CFG. As the CFG does not track instruction edits,
+ * it comes with a record of the opcodes of every block and of the registers
+ * they define and use, and it is recomputed when these differ. The record
+ * holds no instruction addresses, so an instruction that is deleted and whose
+ * memory goes to a new one is still caught.
+ * Checking the record is one pass over the instructions, which is much
+ * cheaper than the fixpoint iteration. Like the CFG, this is not thread-safe,
+ * and the result must not be used once the CFG is gone. The exit block must
+ * have been calculated, as for a LivenessFixpointIterator of one's own.
+ */
+std::shared_ptr<const LivenessFixpointIterator> get_liveness(
+    const cfg::ControlFlowGraph& cfg);
@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "DefUseChains.h"
+#include "IRInstruction.h"
+
+namespace sparse_analysis {
+
+/*
+ * A fixpoint engine for register analyses that computes one abstract value
+ * per def, and propagates values along the def-use chains only. The value of
+ * an operand is the join of the values of the defs that reach it. When the
+ * value of a def changes, only the defs whose producers read it are
+ * reevaluated, so the cost is proportional to the number of def-use edges
+ * rather than to the number of blocks times the number of registers, as with
+ * the MonotonicFixpointIterator over register environments.
+ *
+ * The values are not refined along the branches of conditionals: this suits
+ * analyses whose values only depend on the operands of instructions, like
+ * constant propagation without branch refinement, or nullness of fresh
+ * objects.
+ *
+ * `Value` is an abstract domain. analyze_def() must be monotonic, and should
+ * return Bottom for an operand that is Bottom, i.e., that has no value yet.
+ * With domains of infinite height, set a widening delay: past that many
+ * increases of the value of a def, the engine widens instead of joining.
+ */
+template <typename Value>
+class SparseAnalyzer {
+ public:
+  explicit SparseAnalyzer(const def_use::DefUseChains& chains)
+      : m_chains(chains) {}
+
+  virtual ~SparseAnalyzer() = default;
+
+  /*
+   * The value of the def that `producer` computes, given the values of its
+   * operands. For move-results, the producer is the instruction whose result
+   * is moved.
+   */
+  virtual Value analyze_def(const IRInstruction* producer,
+                            const std::vector<Value>& srcs) const = 0;
+
+  void set_widening_delay(size_t delay) { m_widening_delay = delay; }
+
+  void run() {
+    m_values.clear();
+    std::unordered_map<const IRInstruction*, size_t> updates;
+    std::deque<def_use::Def> worklist(m_chains.defs().begin(),
+                                      m_chains.defs().end());
+    std::unordered_set<def_use::Def> queued(worklist.begin(), worklist.end());
+    for (auto* def : m_chains.defs()) {
+      m_values.emplace(def, Value::bottom());
+    }
+    while (!worklist.empty()) {
+      auto* def = worklist.front();
+      worklist.pop_front();
+      queued.erase(def);
+      auto* producer = m_chains.producer_of(def);
+      std::vector<Value> srcs;
+      srcs.reserve(producer->srcs_size());
+      for (uint16_t i = 0; i < producer->srcs_size(); ++i) {
+        srcs.push_back(get_use_value(producer, i));
+      }
+      Value new_value = analyze_def(producer, srcs);
+      Value& value = m_values.at(def);
+      if (new_value.leq(value)) {
+        continue;
+      }
+      if (m_widening_delay > 0 && ++updates[def] > m_widening_delay) {
+        value.widen_with(new_value);
+      } else {
+        value.join_with(new_value);
+      }
+      for (const auto& use : m_chains.uses_of(def)) {
+        auto* dependent = m_chains.def_of(use.insn);
+        if (dependent != nullptr && queued.insert(dependent).second) {
+          worklist.push_back(dependent);
+        }
+      }
+    }
+  }
+
+  /*
+   * The value computed for `def`, or Bottom if it is not a def of the method.
+   */
+  Value get_def_value(const IRInstruction* def) const {
+    auto it = m_values.find(def);
+    return it == m_values.end() ? Value::bottom() : it->second;
+  }
+
+  /*
+   * The value of the operand `src_index` of `insn`. This is Bottom in
+   * unreachable code.
+   */
+  Value get_use_value(const IRInstruction* insn, uint16_t src_index) const {
+    Value value = Value::bottom();
+    for (auto* def : m_chains.defs_of(insn, src_index)) {
+      value.join_with(get_def_value(def));
+    }
+    return value;
+  }
+
+ private:
+  const def_use::DefUseChains& m_chains;
+  size_t m_widening_delay{0};
+  std::unordered_map<const IRInstruction*, Value> m_values;
+};
+
+} // namespace sparse_analysis
@@ -8,7 +8,6 @@
 #include "LocalPointersAnalysis.h"
 
 #include "DexUtil.h"
-#include "PatriciaTreeSet.h"
 #include "Resolver.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
@@ -383,25 +382,23 @@ void FixpointIteratorMapDeleter::operator()(FixpointIteratorMap* map) {
   wq.run_all();
 }
 
-static void analyze_method_recursive(
-    const DexMethod* method,
-    const call_graph::Graph& call_graph,
-    sparta::PatriciaTreeSet<const DexMethodRef*> visiting,
-    FixpointIteratorMap* fp_iter_map,
-    SummaryCMap* summary_map) {
-  if (summary_map->count(method) != 0 || visiting.contains(method) ||
-      method->get_code() == nullptr) {
+/*
+ * Analyze :method with the summaries of its callees that are already in
+ * :summary_map. The invokes of the other callees are modeled conservatively.
+ */
+static void analyze_method(const DexMethod* method,
+                           const call_graph::Graph& call_graph,
+                           FixpointIteratorMap* fp_iter_map,
+                           SummaryCMap* summary_map) {
+  if (summary_map->count(method) != 0 || method->get_code() == nullptr) {
     return;
   }
-  visiting.insert(method);
 
   std::unordered_map<const IRInstruction*, EscapeSummary> invoke_to_summary_map;
   if (call_graph.has_node(method)) {
     const auto& callee_edges = call_graph.node(method).callees();
     for (const auto& edge : callee_edges) {
       auto* callee = edge->callee();
-      analyze_method_recursive(callee, call_graph, visiting, fp_iter_map,
-                               summary_map);
       if (summary_map->count(callee) != 0) {
         invoke_to_summary_map.emplace(edge->invoke_iterator()->insn,
                                       summary_map->at(callee));
@@ -428,10 +425,21 @@ FixpointIteratorMapPtr analyze_scope(const Scope& scope,
   summary_map_ptr->emplace(
       DexMethod::get_method("Ljava/lang/Object;.<init>:()V"), EscapeSummary{});
 
-  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
-    sparta::PatriciaTreeSet<const DexMethodRef*> visiting;
-    analyze_method_recursive(method, call_graph, visiting, fp_iter_map.get(),
-                             summary_map_ptr);
+  // Callees first, so that the summaries of the callees outside of the
+  // component of a method are all there when it gets analyzed. The members of
+  // a recursive component are analyzed one after the other, each with the
+  // summaries of the members before it.
+  call_graph::Sccs sccs(call_graph);
+  call_graph::parallel_bottom_up(sccs, [&](call_graph::Sccs::SccId id) {
+    for (const auto* method : sccs.members(id)) {
+      analyze_method(method, call_graph, fp_iter_map.get(), summary_map_ptr);
+    }
+  });
+  // The methods that are not in the call graph.
+  walk::parallel::code(scope, [&](const DexMethod* method, IRCode&) {
+    if (!call_graph.has_node(method)) {
+      analyze_method(method, call_graph, fp_iter_map.get(), summary_map_ptr);
+    }
   });
   return fp_iter_map;
 }
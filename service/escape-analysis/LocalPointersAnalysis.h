@@ -284,7 +284,8 @@ using SummaryCMap = ConcurrentMap<const DexMethodRef*, EscapeSummary>;
 
 /*
  * Analyze all methods in scope, making sure to analyze the callees before
- * their callers.
+ * their callers. The strongly connected components of the call graph are
+ * processed in parallel, bottom-up.
  *
  * If a non-null SummaryCMap pointer is passed in, it will get populated
  * with the escape summaries of the methods in scope.
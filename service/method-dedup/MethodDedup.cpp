@@ -7,48 +7,112 @@
 
 #include "MethodDedup.h"
 
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <map>
+#include <tuple>
+
 #include "IRCode.h"
 #include "MethodReference.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
-struct CodeAsKey {
-  IRCode* code;
-
-  explicit CodeAsKey(IRCode* c) : code(c) {}
+// Fingerprinting fewer methods than this is not worth starting workers for.
+constexpr size_t MIN_METHODS_TO_FINGERPRINT_IN_PARALLEL = 1000;
 
-  bool operator==(const CodeAsKey& other) const {
-    return code->structural_equals(*other.code);
+void hash_instruction(size_t& seed, const IRInstruction* insn) {
+  boost::hash_combine(seed, static_cast<uint16_t>(insn->opcode()));
+  for (size_t i = 0; i < insn->srcs_size(); i++) {
+    boost::hash_combine(seed, insn->src(i));
+  }
+  if (insn->dests_size()) {
+    boost::hash_combine(seed, insn->dest());
   }
-};
+  if (insn->has_literal()) {
+    boost::hash_combine(seed, insn->get_literal());
+  } else if (insn->has_string()) {
+    boost::hash_combine(seed, insn->get_string());
+  } else if (insn->has_type()) {
+    boost::hash_combine(seed, insn->get_type());
+  } else if (insn->has_field()) {
+    boost::hash_combine(seed, insn->get_field());
+  } else if (insn->has_method()) {
+    boost::hash_combine(seed, insn->get_method());
+  } else if (insn->has_data()) {
+    boost::hash_combine(seed, insn->get_data());
+  }
+}
 
-struct CodeHasher {
-  size_t operator()(const CodeAsKey& key) const {
-    size_t result = 0;
-    for (auto& mie : InstructionIterable(key.code)) {
-      result ^= mie.insn->hash();
+/*
+ * A hash of the code that all the code it is structurally equal to shares.
+ * Like IRCode::structural_equals, it skips debug info and positions. Unlike
+ * the xor of the instruction hashes, it depends on the order of the entries,
+ * so that code made of the same instructions in another order rarely ends up
+ * in the same bucket.
+ */
+size_t code_fingerprint(const IRCode* code) {
+  size_t seed = 0;
+  for (const auto& mie : *code) {
+    if (mie.type == MFLOW_DEBUG || mie.type == MFLOW_POSITION) {
+      continue;
+    }
+    boost::hash_combine(seed, static_cast<uint8_t>(mie.type));
+    if (mie.type == MFLOW_OPCODE) {
+      hash_instruction(seed, mie.insn);
+    } else if (mie.type == MFLOW_TARGET) {
+      boost::hash_combine(seed, static_cast<uint8_t>(mie.target->type));
+    } else if (mie.type == MFLOW_CATCH) {
+      boost::hash_combine(seed, mie.centry->catch_type);
     }
-    return result;
   }
-};
-
-using DuplicateMethods =
-    std::unordered_map<CodeAsKey, MethodOrderedSet, CodeHasher>;
+  return seed;
+}
 
-std::vector<MethodOrderedSet> get_duplicate_methods_simple(
-    const MethodOrderedSet& methods) {
-  DuplicateMethods duplicates;
-  for (DexMethod* method : methods) {
-    always_assert(method->get_code());
-    duplicates[CodeAsKey(method->get_code())].emplace(method);
+std::vector<size_t> get_fingerprints(const std::vector<DexMethod*>& methods) {
+  std::vector<size_t> fingerprints(methods.size());
+  auto fingerprint = [&](size_t i) {
+    const auto* code = methods[i]->get_code();
+    always_assert(code);
+    fingerprints[i] = code_fingerprint(code);
+  };
+  if (methods.size() < MIN_METHODS_TO_FINGERPRINT_IN_PARALLEL) {
+    for (size_t i = 0; i < methods.size(); i++) {
+      fingerprint(i);
+    }
+    return fingerprints;
   }
-
-  std::vector<MethodOrderedSet> result;
-  for (auto& duplicate : duplicates) {
-    result.push_back(std::move(duplicate.second));
+  auto wq = workqueue_foreach<size_t>(fingerprint,
+                                      walk::parallel::default_num_threads());
+  for (size_t i = 0; i < methods.size(); i++) {
+    wq.add_item(i);
   }
+  wq.run_all();
+  return fingerprints;
+}
 
-  return result;
+/*
+ * Split methods of the same bucket into the groups of identical code. Only
+ * methods in the same bucket are ever compared with each other.
+ */
+void split_bucket(const std::vector<DexMethod*>& bucket,
+                  std::vector<MethodOrderedSet>& result) {
+  size_t begin = result.size();
+  for (DexMethod* method : bucket) {
+    auto code = method->get_code();
+    auto it = std::find_if(
+        result.begin() + begin, result.end(),
+        [code](const MethodOrderedSet& group) {
+          return code->structural_equals(*(*group.begin())->get_code());
+        });
+    if (it == result.end()) {
+      result.emplace_back();
+      result.back().emplace(method);
+    } else {
+      it->emplace(method);
+    }
+  }
 }
 
 } // namespace
@@ -86,17 +150,28 @@ std::vector<MethodOrderedSet> group_similar_methods(
 
 std::vector<MethodOrderedSet> group_identical_methods(
     const std::vector<DexMethod*>& methods) {
-  std::vector<MethodOrderedSet> result;
-  std::vector<MethodOrderedSet> same_protos = group_similar_methods(methods);
-
-  // Find actual duplicates.
-  for (const auto& same_proto : same_protos) {
-    std::vector<MethodOrderedSet> duplicates =
-        get_duplicate_methods_simple(same_proto);
-
-    result.insert(result.end(), duplicates.begin(), duplicates.end());
+  // Bucket the methods by signature, size and fingerprint of their code, so
+  // that the code is compared in full only within buckets.
+  auto fingerprints = get_fingerprints(methods);
+  using BucketKey = std::tuple<DexProto*, size_t, size_t>;
+  std::map<BucketKey, std::vector<DexMethod*>> buckets;
+  for (size_t i = 0; i < methods.size(); i++) {
+    auto method = methods[i];
+    buckets[BucketKey(method->get_proto(),
+                      method->get_code()->sum_opcode_sizes(),
+                      fingerprints[i])]
+        .push_back(method);
   }
 
+  std::vector<MethodOrderedSet> result;
+  for (const auto& pair : buckets) {
+    split_bucket(pair.second, result);
+  }
+  // The buckets are ordered by pointers, the groups by their first method.
+  std::sort(result.begin(), result.end(),
+            [](const MethodOrderedSet& a, const MethodOrderedSet& b) {
+              return dexmethods_comparator()(*a.begin(), *b.begin());
+            });
   return result;
 }
 
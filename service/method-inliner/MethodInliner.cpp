@@ -8,22 +8,28 @@
 #include "MethodInliner.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <string>
 #include <vector>
 
 #include "ClassHierarchy.h"
+#include "ConstantPropagationAnalysis.h"
+#include "ConstantPropagationTransform.h"
+#include "CopyPropagationPass.h"
 #include "Deleter.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "Inliner.h"
+#include "LocalDce.h"
 #include "ReachableClasses.h"
 #include "Resolver.h"
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -161,11 +167,21 @@ void run_inliner(DexStoresVector& stores,
   auto methods =
       gather_non_virtual_methods(scope, inliner_config.virtual_inline);
 
+  if (inliner_config.shrink_callees) {
+    size_t removed = shrink_callees(methods);
+    TRACE(INLINE, 2, "Shrinking callees removed %ld instructions", removed);
+    mgr.incr_metric("callee_instructions_removed", removed);
+  }
+
   // keep a map from refs to defs or nullptr if no method was found
   MethodRefCache resolved_refs;
-  auto resolver = [&resolved_refs](DexMethodRef* method, MethodSearch search) {
-    return resolve_method(method, search, resolved_refs);
-  };
+  std::function<DexMethod*(DexMethodRef*, MethodSearch)> resolver =
+      [&resolved_refs](DexMethodRef* method, MethodSearch search) {
+        return resolve_method(method, search, resolved_refs);
+      };
+  if (inliner_config.parallel) {
+    resolver = resolve_method_cached;
+  }
   if (inliner_config.use_cfg_inliner) {
     walk::parallel::code(scope, [](DexMethod*, IRCode& code) {
       code.build_cfg(/* editable */ true);
@@ -187,34 +203,71 @@ void run_inliner(DexStoresVector& stores,
   size_t inlined_count = inlined.size();
   size_t deleted = delete_methods(scope, inlined, resolver);
 
-  TRACE(INLINE, 3, "recursive %ld", inliner.get_info().recursive);
-  TRACE(INLINE, 3, "blacklisted meths %ld", inliner.get_info().blacklisted);
-  TRACE(INLINE, 3, "virtualizing methods %ld",
-        inliner.get_info().need_vmethod);
-  TRACE(INLINE, 3, "invoke super %ld", inliner.get_info().invoke_super);
-  TRACE(INLINE, 3, "override inputs %ld", inliner.get_info().write_over_ins);
-  TRACE(INLINE, 3, "escaped virtual %ld", inliner.get_info().escaped_virtual);
-  TRACE(INLINE, 3, "known non public virtual %ld",
-        inliner.get_info().non_pub_virtual);
-  TRACE(INLINE, 3, "non public ctor %ld", inliner.get_info().non_pub_ctor);
-  TRACE(INLINE, 3, "unknown field %ld", inliner.get_info().escaped_field);
-  TRACE(INLINE, 3, "non public field %ld", inliner.get_info().non_pub_field);
-  TRACE(INLINE, 3, "throws %ld", inliner.get_info().throws);
-  TRACE(INLINE, 3, "multiple returns %ld", inliner.get_info().multi_ret);
-  TRACE(INLINE, 3, "references cross stores %ld",
-        inliner.get_info().cross_store);
-  TRACE(INLINE, 3, "not found %ld", inliner.get_info().not_found);
-  TRACE(INLINE, 3, "caller too large %ld",
-        inliner.get_info().caller_too_large);
+  const auto& info = inliner.get_info();
+  TRACE(INLINE, 3, "recursive %ld", info.recursive.load());
+  TRACE(INLINE, 3, "blacklisted meths %ld", info.blacklisted.load());
+  TRACE(INLINE, 3, "virtualizing methods %ld", info.need_vmethod.load());
+  TRACE(INLINE, 3, "invoke super %ld", info.invoke_super.load());
+  TRACE(INLINE, 3, "override inputs %ld", info.write_over_ins.load());
+  TRACE(INLINE, 3, "escaped virtual %ld", info.escaped_virtual.load());
+  TRACE(INLINE, 3, "known non public virtual %ld", info.non_pub_virtual.load());
+  TRACE(INLINE, 3, "non public ctor %ld", info.non_pub_ctor.load());
+  TRACE(INLINE, 3, "unknown field %ld", info.escaped_field.load());
+  TRACE(INLINE, 3, "non public field %ld", info.non_pub_field.load());
+  TRACE(INLINE, 3, "throws %ld", info.throws.load());
+  TRACE(INLINE, 3, "multiple returns %ld", info.multi_ret.load());
+  TRACE(INLINE, 3, "references cross stores %ld", info.cross_store.load());
+  TRACE(INLINE, 3, "not found %ld", info.not_found.load());
+  TRACE(INLINE, 3, "caller too large %ld", info.caller_too_large.load());
+  TRACE(INLINE, 3, "cold caller %ld", info.cold_caller.load());
+  TRACE(INLINE, 3, "inlined into hot caller %ld", info.hot_caller.load());
   TRACE(INLINE, 1,
         "%ld inlined calls over %ld methods and %ld methods removed",
-        inliner.get_info().calls_inlined, inlined_count, deleted);
+        info.calls_inlined.load(), inlined_count, deleted);
 
-  mgr.incr_metric("calls_inlined", inliner.get_info().calls_inlined);
+  mgr.incr_metric("calls_inlined", info.calls_inlined);
   mgr.incr_metric("methods_removed", deleted);
-  mgr.incr_metric("escaped_virtual", inliner.get_info().escaped_virtual);
-  mgr.incr_metric("unresolved_methods", inliner.get_info().unresolved_methods);
-  mgr.incr_metric("known_public_methods",
-                  inliner.get_info().known_public_methods);
+  mgr.incr_metric("escaped_virtual", info.escaped_virtual);
+  mgr.incr_metric("unresolved_methods", info.unresolved_methods);
+  mgr.incr_metric("known_public_methods", info.known_public_methods);
+  mgr.incr_metric("calls_not_inlined_into_cold_callers", info.cold_caller);
+  mgr.incr_metric("calls_inlined_into_hot_callers", info.hot_caller);
+}
+
+size_t shrink_callees(const std::unordered_set<DexMethod*>& callees) {
+  namespace cp = constant_propagation;
+  std::vector<DexMethod*> methods;
+  for (auto method : callees) {
+    if (method->get_code() != nullptr &&
+        !method->rstate.no_optimizations()) {
+      methods.push_back(method);
+    }
+  }
+  std::atomic<size_t> removed{0};
+  auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* method) {
+    auto code = method->get_code();
+    auto before = code->count_opcodes();
+    {
+      code->build_cfg(/* editable */ false);
+      cp::intraprocedural::FixpointIterator fp_iter(
+          code->cfg(), cp::ConstantPrimitiveAnalyzer());
+      fp_iter.run(ConstantEnvironment());
+      cp::Transform::Config config;
+      cp::Transform(config).apply(fp_iter, cp::WholeProgramState(), code);
+    }
+    CopyPropagationPass::Config config;
+    copy_propagation_impl::CopyPropagation(config).run(code, method);
+    std::unordered_set<DexMethodRef*> pure_methods;
+    LocalDce(pure_methods).dce(code);
+    auto after = code->count_opcodes();
+    if (after < before) {
+      removed += before - after;
+    }
+  });
+  for (auto method : methods) {
+    wq.add_item(method);
+  }
+  wq.run_all();
+  return removed;
 }
 } // namespace inliner
@@ -18,4 +18,11 @@ void run_inliner(DexStoresVector& stores,
                  PassManager& mgr,
                  const InlinerConfig& inliner_config,
                  bool intra_dex = false);
+
+/**
+ * Simplify the candidates in parallel before inlining them, so that their
+ * callers get smaller copies, and the size heuristics see what would actually
+ * get inlined. Returns the number of instructions removed.
+ */
+size_t shrink_callees(const std::unordered_set<DexMethod*>& callees);
 } // namespace inliner
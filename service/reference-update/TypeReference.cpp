@@ -519,7 +519,9 @@ DexTypeList* drop_and_make(const DexTypeList* list, size_t num_types_to_drop) {
   return DexTypeList::make_type_list(std::move(dropped));
 }
 
-void update_method_signature_type_references(
+namespace {
+
+void update_method_signatures(
     const Scope& scope,
     const std::unordered_map<const DexType*, DexType*>& old_to_new,
     const ClassHierarchy& ch,
@@ -587,25 +589,9 @@ void update_method_signature_type_references(
     auto& group = key_and_group.second;
     update_vmethods_group_one_type_ref(group, ch);
   }
-
-  // Ensure that no method references left that still refer old types.
-  walk::parallel::code(scope, [&old_to_new](DexMethod*, IRCode& code) {
-    for (auto& mie : InstructionIterable(code)) {
-      auto insn = mie.insn;
-      if (insn->has_method()) {
-        auto proto = insn->get_method()->get_proto();
-        auto new_proto = get_new_proto(proto, old_to_new);
-        always_assert_log(
-            proto == new_proto,
-            "Find old type in method reference %s, please make sure that "
-            "ReBindRefsPass is enabled before the crashed pass.\n",
-            SHOW(insn));
-      }
-    }
-  });
 }
 
-void update_field_type_references(
+void update_field_types(
     const Scope& scope,
     const std::unordered_map<const DexType*, DexType*>& old_to_new) {
   TRACE(REFU, 4, " updating field refs");
@@ -624,11 +610,29 @@ void update_field_type_references(
     TRACE(REFU, 9, " updating field ref to %s", SHOW(type));
   };
   walk::parallel::fields(scope, update_field);
+}
 
-  walk::parallel::code(scope, [&old_to_new](DexMethod*, IRCode& code) {
+/**
+ * Ensure that no method or field references are left in the code that still
+ * refer to the old types.
+ */
+void check_code_refs(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new,
+    bool check_methods,
+    bool check_fields) {
+  walk::parallel::code(scope, [&](DexMethod*, IRCode& code) {
     for (auto& mie : InstructionIterable(code)) {
       auto insn = mie.insn;
-      if (insn->has_field()) {
+      if (check_methods && insn->has_method()) {
+        auto proto = insn->get_method()->get_proto();
+        auto new_proto = type_reference::get_new_proto(proto, old_to_new);
+        always_assert_log(
+            proto == new_proto,
+            "Find old type in method reference %s, please make sure that "
+            "ReBindRefsPass is enabled before the crashed pass.\n",
+            SHOW(insn));
+      } else if (check_fields && insn->has_field()) {
         const auto ref_type = insn->get_field()->get_type();
         const auto type = get_array_type_or_self(ref_type);
         always_assert_log(
@@ -641,4 +645,69 @@ void update_field_type_references(
   });
 }
 
+} // namespace
+
+void update_method_signature_type_references(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new,
+    const ClassHierarchy& ch,
+    boost::optional<std::unordered_map<DexMethod*, std::string>&>
+        method_debug_map) {
+  update_method_signatures(scope, old_to_new, ch, method_debug_map);
+  check_code_refs(scope, old_to_new, /* check_methods */ true,
+                  /* check_fields */ false);
+}
+
+void update_field_type_references(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new) {
+  update_field_types(scope, old_to_new);
+  check_code_refs(scope, old_to_new, /* check_methods */ false,
+                  /* check_fields */ true);
+}
+
+void TypeRefUpdateBatch::add(const DexType* old_type, DexType* new_type) {
+  always_assert_log(old_type != new_type, "Mapping %s to itself",
+                    SHOW(old_type));
+  always_assert_log(m_old_to_new.count(old_type) == 0,
+                    "Type %s is already mapped to %s", SHOW(old_type),
+                    SHOW(m_old_to_new.at(old_type)));
+  auto it = m_old_to_new.find(new_type);
+  if (it != m_old_to_new.end()) {
+    new_type = it->second;
+    always_assert_log(new_type != old_type, "Mapping %s in a cycle",
+                      SHOW(old_type));
+  }
+  // Types that were mapped to the old type before now map to the new one.
+  for (auto& pair : m_old_to_new) {
+    if (pair.second == old_type) {
+      pair.second = new_type;
+    }
+  }
+  m_old_to_new.emplace(old_type, new_type);
+}
+
+void TypeRefUpdateBatch::add(
+    const std::unordered_map<const DexType*, DexType*>& old_to_new) {
+  for (const auto& pair : old_to_new) {
+    add(pair.first, pair.second);
+  }
+}
+
+void TypeRefUpdateBatch::apply(
+    const Scope& scope,
+    const ClassHierarchy& ch,
+    boost::optional<std::unordered_map<DexMethod*, std::string>&>
+        method_debug_map) {
+  if (m_old_to_new.empty()) {
+    return;
+  }
+  TRACE(REFU, 4, " applying %zu type ref updates", m_old_to_new.size());
+  update_method_signatures(scope, m_old_to_new, ch, method_debug_map);
+  update_field_types(scope, m_old_to_new);
+  check_code_refs(scope, m_old_to_new, /* check_methods */ true,
+                  /* check_fields */ true);
+  m_old_to_new.clear();
+}
+
 } // namespace type_reference
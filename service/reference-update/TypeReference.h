@@ -116,4 +116,38 @@ void update_field_type_references(
     const Scope& scope,
     const std::unordered_map<const DexType*, DexType*>& old_to_new);
 
+/**
+ * Collect old to new type mappings and apply them together. The method
+ * signatures and the field types are updated like the two functions above do,
+ * but the code in the scope is checked for references to the old types in one
+ * sweep, instead of once per function and once per mapping.
+ *
+ * Adding a mapping from a type that others are already mapped to makes them
+ * map to its new type instead: after add(A, B) and add(B, C), both A and B
+ * map to C.
+ */
+class TypeRefUpdateBatch final {
+ public:
+  void add(const DexType* old_type, DexType* new_type);
+
+  void add(const std::unordered_map<const DexType*, DexType*>& old_to_new);
+
+  bool empty() const { return m_old_to_new.empty(); }
+
+  const std::unordered_map<const DexType*, DexType*>& get_old_to_new() const {
+    return m_old_to_new;
+  }
+
+  /**
+   * Update all the references to the old types, then clear the batch.
+   */
+  void apply(const Scope& scope,
+             const ClassHierarchy& ch,
+             boost::optional<std::unordered_map<DexMethod*, std::string>&>
+                 method_debug_map = boost::none);
+
+ private:
+  std::unordered_map<const DexType*, DexType*> m_old_to_new;
+};
+
 } // namespace type_reference
@@ -260,6 +260,12 @@ DexMethod* create_simple_switch_dispatch(
   return materialize_dispatch(orig_method, mc);
 }
 
+/**
+ * Create a switch dispatch that calls into `num_switch_needed` leaf
+ * dispatches. The top level switch has a single case per leaf dispatch, which
+ * matches all the indices of that leaf, so its size doesn't grow with the
+ * number of targets.
+ */
 dispatch::DispatchMethod create_two_level_switch_dispatch(
     const size_t num_switch_needed,
     const dispatch::Spec& spec,
@@ -275,125 +281,58 @@ dispatch::DispatchMethod create_two_level_switch_dispatch(
   std::vector<Location> args = get_args_from(orig_method, mc);
 
   mb->iget(spec.type_tag_field, self_loc, type_tag_loc);
-  auto cases = get_switch_cases(indices_to_callee);
+
+  // Split the targets into consecutive groups, one per leaf dispatch.
+  size_t max_num_leaf_switch = indices_to_callee.size() / num_switch_needed + 1;
+  std::vector<std::map<SwitchIndices, DexMethod*>> leaves;
+  std::map<SwitchIndices, MethodBlock*> cases;
+  std::vector<SwitchIndices> leaf_indices;
+  for (auto& it : indices_to_callee) {
+    if (leaves.empty() || leaves.back().size() == max_num_leaf_switch) {
+      leaves.emplace_back();
+      leaf_indices.emplace_back();
+    }
+    leaves.back().emplace(it.first, it.second);
+    leaf_indices.back().insert(it.first.begin(), it.first.end());
+  }
+  for (const auto& indices : leaf_indices) {
+    cases[indices] = nullptr;
+  }
 
   // default case and return
   auto def_block = mb->switch_op(type_tag_loc, cases);
   handle_default_block(spec, indices_to_callee, args, mc, ret_loc, def_block);
   mb->ret(spec.proto->get_rtype(), ret_loc);
 
-  size_t max_num_leaf_switch = cases.size() / num_switch_needed + 1;
-  std::map<SwitchIndices, DexMethod*> sub_indices_to_callee;
   std::vector<DexMethod*> sub_dispatches;
-  size_t dispatch_index = 0;
-  size_t case_index = 0;
-  size_t subcase_count = 0;
-  for (auto& case_it : cases) {
-    sub_indices_to_callee[case_it.first] = indices_to_callee.at(case_it.first);
-    subcase_count++;
-
-    if (subcase_count == max_num_leaf_switch ||
-        case_index == cases.size() - 1) {
-      auto sub_name = spec.name + "$" + std::to_string(dispatch_index);
-      auto new_arg_list =
-          prepend_and_make(spec.proto->get_args(), spec.owner_type);
-      auto static_dispatch_proto =
-          DexProto::make_proto(spec.proto->get_rtype(), new_arg_list);
-      dispatch::Spec sub_spec{spec.owner_type,
-                              dispatch::Type::VIRTUAL,
-                              sub_name,
-                              static_dispatch_proto,
-                              spec.access_flags | ACC_STATIC,
-                              spec.type_tag_field,
-                              nullptr, // overridden_method,
-                              spec.keep_debug_info};
-      auto sub_dispatch =
-          create_simple_switch_dispatch(sub_spec, sub_indices_to_callee);
-      sub_indices_to_callee.clear();
-
-      auto case_block = case_it.second;
-      always_assert(case_block != nullptr);
-      // check-cast and call
-      emit_check_cast(spec, args, sub_dispatch, case_block);
-      invoke_static(spec, args, ret_loc, sub_dispatch, case_block);
-
-      sub_dispatches.push_back(sub_dispatch);
-      dispatch_index++;
-      subcase_count = 0;
-    }
+  for (size_t dispatch_index = 0; dispatch_index < leaves.size();
+       ++dispatch_index) {
+    auto sub_name = spec.name + "$" + std::to_string(dispatch_index);
+    auto new_arg_list =
+        prepend_and_make(spec.proto->get_args(), spec.owner_type);
+    auto static_dispatch_proto =
+        DexProto::make_proto(spec.proto->get_rtype(), new_arg_list);
+    dispatch::Spec sub_spec{spec.owner_type,
+                            dispatch::Type::VIRTUAL,
+                            sub_name,
+                            static_dispatch_proto,
+                            spec.access_flags | ACC_STATIC,
+                            spec.type_tag_field,
+                            nullptr, // overridden_method,
+                            spec.keep_debug_info};
+    auto sub_dispatch =
+        create_simple_switch_dispatch(sub_spec, leaves[dispatch_index]);
+
+    auto case_block = cases.at(leaf_indices[dispatch_index]);
+    always_assert(case_block != nullptr);
+    // check-cast and call
+    emit_check_cast(spec, args, sub_dispatch, case_block);
+    invoke_static(spec, args, ret_loc, sub_dispatch, case_block);
 
-    case_index++;
+    sub_dispatches.push_back(sub_dispatch);
   }
 
   auto dispatch_meth = materialize_dispatch(orig_method, mc);
-
-  /////////////////////////////////////////////////////////////////////////////
-  // Remove unwanted gotos.
-  //
-  // Creator produces a complete switch statement with all cases ending with a
-  // goto to the end of the switch statement. This is not the intended control
-  // flow here. We need to remove the unwanted gotos to enable fall-throughs to
-  // the case that we call the second level dispatch.
-  //
-  // An example dispatch before removing unwanted gotos:
-  // [0x3a7f260] OPCODE: IOPCODE_LOAD_PARAM_OBJECT v2
-  // [0x3a7eb60] OPCODE: IGET v2, LDummyShape;.$t:I
-  // [0x3a64c60] OPCODE: IOPCODE_MOVE_RESULT_PSEUDO v0
-  // [0x37c5300] OPCODE: PACKED_SWITCH v0
-  // [0x37e0590] OPCODE: INVOKE_SUPER v2, LBase;.doStuff:()I
-  // [0x3a71590] OPCODE: MOVE_RESULT v1
-  // [0x3a18460] TARGET: SIMPLE 0x37c3f10
-  // [0x3a2a4a0] TARGET: SIMPLE 0x3a66c90
-  // [0x3a6ac90] TARGET: SIMPLE 0x3a4a310
-  // [0x3a32920] TARGET: SIMPLE 0x3918fe0
-  // [0x348d3a0] OPCODE: RETURN v1
-  // [0x3806200] TARGET: MULTI 0 0x37c5300
-  // [0x37c3f10] OPCODE: GOTO
-  // [0x37dd7b0] TARGET: MULTI 1 0x37c5300
-  // [0x3a4bd30] OPCODE: INVOKE_STATIC v2, dispatch$0:(LDummyShape;)I
-  // [0x37a8c90] OPCODE: MOVE_RESULT v1
-  // [0x3a66c90] OPCODE: GOTO
-  // [0x37bda90] TARGET: MULTI 2 0x37c5300
-  // [0x3a4a310] OPCODE: GOTO
-  // [0x3a65ef0] TARGET: MULTI 3 0x37c5300
-  // [0x3815180] OPCODE: INVOKE_STATIC v2, dispatch$1:(LDummyShape;)I
-  // [0x37c84d0] OPCODE: MOVE_RESULT v1
-  // [0x3918fe0] OPCODE: GOTO
-  //
-  // After removing gotos:
-  // [0x3a7f260] OPCODE: IOPCODE_LOAD_PARAM_OBJECT v2
-  // [0x3a7eb60] OPCODE: IGET v2, LDummyShape;.$t:I
-  // [0x3a64c60] OPCODE: IOPCODE_MOVE_RESULT_PSEUDO v0
-  // [0x37c5300] OPCODE: PACKED_SWITCH v0
-  // [0x37e0590] OPCODE: INVOKE_SUPER v2, LBase;.doStuff:()I
-  // [0x3a71590] OPCODE: MOVE_RESULT v1
-  // [0x3a2a4a0] TARGET: SIMPLE 0x3a66c90
-  // [0x3a32920] TARGET: SIMPLE 0x3918fe0
-  // [0x348d3a0] OPCODE: RETURN v1
-  // [0x3806200] TARGET: MULTI 0 0x37c5300
-  // [0x37dd7b0] TARGET: MULTI 1 0x37c5300
-  // [0x3a4bd30] OPCODE: INVOKE_STATIC v2, dispatch$0:(LDummyShape;)I
-  // [0x37a8c90] OPCODE: MOVE_RESULT v1
-  // [0x3a66c90] OPCODE: GOTO
-  // [0x37bda90] TARGET: MULTI 2 0x37c5300
-  // [0x3a65ef0] TARGET: MULTI 3 0x37c5300
-  // [0x3815180] OPCODE: INVOKE_STATIC v2, dispatch$1:(LDummyShape;)I
-  // [0x37c84d0] OPCODE: MOVE_RESULT v1
-  // [0x3918fe0] OPCODE: GOTO
-  /////////////////////////////////////////////////////////////////////////////
-  std::vector<IRList::iterator> to_delete;
-  auto code = dispatch_meth->get_code();
-  for (auto it = code->begin(); it != code->end(); ++it) {
-    if (it->type == MFLOW_OPCODE && is_goto(it->insn->opcode()) &&
-        std::prev(it)->type == MFLOW_TARGET) {
-      to_delete.emplace_back(it);
-    }
-  }
-
-  for (const auto& it : to_delete) {
-    code->remove_opcode(it);
-  }
-
   TRACE(SDIS, 9, "dispatch: split dispatch %s\n%s", SHOW(dispatch_meth),
         SHOW(dispatch_meth->get_code()));
   dispatch::DispatchMethod dispatch_method{dispatch_meth, sub_dispatches};
@@ -107,11 +107,15 @@ SwitchEquivFinder::SwitchEquivFinder(
     cfg::ControlFlowGraph* cfg,
     const cfg::InstructionIterator& root_branch,
     uint16_t switching_reg,
-    uint32_t leaf_duplication_threshold)
+    uint32_t leaf_duplication_threshold,
+    size_t max_num_leaves,
+    std::shared_ptr<FixpointIterator> fixpoint)
     : m_cfg(cfg),
       m_root_branch(root_branch),
       m_switching_reg(switching_reg),
-      m_leaf_duplication_threshold(leaf_duplication_threshold) {
+      m_leaf_duplication_threshold(leaf_duplication_threshold),
+      m_max_num_leaves(max_num_leaves),
+      m_fixpoint(std::move(fixpoint)) {
 
   {
     // make sure the input is well-formed
@@ -160,6 +164,11 @@ std::vector<cfg::Edge*> SwitchEquivFinder::find_leaves() {
 
       if (is_leaf(m_cfg, next, m_switching_reg)) {
         leaves.push_back(succ);
+        if (leaves.size() > m_max_num_leaves) {
+          TRACE(SWITCH_EQUIV, 2, "Failure Reason: More than %zu leaves",
+                m_max_num_leaves);
+          return false;
+        }
         const auto& pair = m_extra_loads.emplace(next, loads);
         bool already_there = !pair.second;
         if (already_there) {
@@ -394,9 +403,15 @@ void SwitchEquivFinder::normalize_extra_loads(
 void SwitchEquivFinder::find_case_keys(const std::vector<cfg::Edge*>& leaves) {
   // We use the fixpoint iterator to infer the values of registers at different
   // points in the program. Especially `m_switching_reg`.
-  cp::intraprocedural::FixpointIterator fixpoint(
-      *m_cfg, cp::ConstantPrimitiveAnalyzer());
-  fixpoint.run(ConstantEnvironment());
+  if (m_fixpoint == nullptr) {
+    m_fixpoint = std::make_shared<FixpointIterator>(
+        *m_cfg, cp::ConstantPrimitiveAnalyzer());
+    m_fixpoint->run(ConstantEnvironment());
+  }
+  const auto& fixpoint = *m_fixpoint;
+  // A switch block is the source of all its leaves, so only get its exit
+  // state once.
+  std::unordered_map<cfg::Block*, ConstantEnvironment> exit_states;
 
   // return true on success
   // return false on failure (there was a conflicting entry already in the map)
@@ -415,12 +430,17 @@ void SwitchEquivFinder::find_case_keys(const std::vector<cfg::Edge*>& leaves) {
 
   // returns the value of `m_switching_reg` if the leaf is reached via this edge
   const auto& get_case_key =
-      [this, &fixpoint](cfg::Edge* edge_to_leaf) -> boost::optional<int32_t> {
+      [this, &fixpoint, &exit_states](
+          cfg::Edge* edge_to_leaf) -> boost::optional<int32_t> {
     // Get the inferred value of m_switching_reg at the end of `edge_to_leaf`
     // but before the beginning of the leaf block because we would lose the
     // information by merging all the incoming edges.
-    auto env = fixpoint.get_exit_state_at(edge_to_leaf->src());
-    env = fixpoint.analyze_edge(edge_to_leaf, env);
+    auto src = edge_to_leaf->src();
+    auto it = exit_states.find(src);
+    if (it == exit_states.end()) {
+      it = exit_states.emplace(src, fixpoint.get_exit_state_at(src)).first;
+    }
+    auto env = fixpoint.analyze_edge(edge_to_leaf, it->second);
     const auto& case_key = env.get<SignedConstantDomain>(m_switching_reg);
     if (case_key.is_top() || case_key.get_constant() == boost::none) {
       // boost::none represents the fallthrough block
@@ -9,8 +9,10 @@
 
 #include <boost/optional.hpp>
 #include <map>
+#include <memory>
 #include <unordered_set>
 
+#include "ConstantPropagationAnalysis.h"
 #include "ControlFlow.h"
 
 /**
@@ -25,12 +27,25 @@ class SwitchEquivFinder final {
   using InstructionSet = std::map<uint16_t, IRInstruction*>;
   using ExtraLoads = std::unordered_map<cfg::Block*, InstructionSet>;
 
+  using FixpointIterator =
+      constant_propagation::intraprocedural::FixpointIterator;
+
+  // Past this many leaves the finder gives up rather than spending time on a
+  // huge if-else tree.
+  static constexpr size_t DEFAULT_MAX_NUM_LEAVES = 10000;
+
   static bool has_src(IRInstruction* insn, uint16_t reg);
 
+  // If given, `fixpoint` must have been run with a ConstantPrimitiveAnalyzer
+  // on `cfg` as it is now. Callers that look for several switches in the same
+  // CFG can share it until they change the CFG, instead of each finder running
+  // constant propagation over the whole method again.
   SwitchEquivFinder(cfg::ControlFlowGraph* cfg,
                     const cfg::InstructionIterator& root_branch,
                     uint16_t switching_reg,
-                    uint32_t leaf_duplication_threshold = 0);
+                    uint32_t leaf_duplication_threshold = 0,
+                    size_t max_num_leaves = DEFAULT_MAX_NUM_LEAVES,
+                    std::shared_ptr<FixpointIterator> fixpoint = nullptr);
 
   SwitchEquivFinder() = delete;
   SwitchEquivFinder(const SwitchEquivFinder&) = delete;
@@ -73,6 +88,10 @@ class SwitchEquivFinder final {
   // opcodes the SwitchEquivFinder may duplicate that block. If this flag is
   // zero, the SwitchEquivFinder will not edit the CFG.
   uint32_t m_leaf_duplication_threshold{0};
+  // The finder fails once it has found more leaves than this.
+  size_t m_max_num_leaves;
+  // Constant propagation over `m_cfg`, run lazily unless it was given.
+  std::shared_ptr<FixpointIterator> m_fixpoint;
   // If a switch equivalent cannot be found starting from `m_root_branch` this
   // flag will be false, otherwise true.
   bool m_success{false};
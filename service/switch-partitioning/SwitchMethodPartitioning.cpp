@@ -8,6 +8,7 @@
 #include "SwitchMethodPartitioning.h"
 
 #include <queue>
+#include <unordered_set>
 
 #include "ConstantPropagationAnalysis.h"
 #include "ControlFlow.h"
@@ -138,7 +139,11 @@ boost::optional<uint16_t> SwitchMethodPartitioning::compute_prologue_blocks(
   // blocks and stopping before we reach a leaf.
   boost::optional<uint16_t> determining_reg;
   std::queue<cfg::Block*> to_visit;
+  // Blocks of the tree can be reached through several of their parents.
+  // Visiting them more than once would blow up on large trees.
+  std::unordered_set<cfg::Block*> visited;
   to_visit.push(m_prologue_blocks.back());
+  visited.insert(m_prologue_blocks.back());
   while (!to_visit.empty()) {
     auto b = to_visit.front();
     to_visit.pop();
@@ -162,7 +167,9 @@ boost::optional<uint16_t> SwitchMethodPartitioning::compute_prologue_blocks(
         }
       }
       for (auto succ : b->succs()) {
-        to_visit.push(succ->target());
+        if (visited.insert(succ->target()).second) {
+          to_visit.push(succ->target());
+        }
       }
 
       // Make sure all blocks agree on which register is the determiner
@@ -200,10 +207,11 @@ SwitchMethodPartitioning::SwitchMethodPartitioning(IRCode* code,
 
   // Find all the outgoing edges from the prologue blocks
   std::vector<cfg::Edge*> cases;
+  std::unordered_set<const cfg::Block*> prologue_blocks(
+      m_prologue_blocks.begin(), m_prologue_blocks.end());
   for (const cfg::Block* prologue : m_prologue_blocks) {
     for (cfg::Edge* e : prologue->succs()) {
-      if (std::find(m_prologue_blocks.begin(), m_prologue_blocks.end(),
-                    e->target()) == m_prologue_blocks.end()) {
+      if (prologue_blocks.count(e->target()) == 0) {
         cases.push_back(e);
       }
     }
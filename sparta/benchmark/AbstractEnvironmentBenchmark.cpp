@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "ConstantAbstractDomain.h"
+#include "FlatAbstractEnvironment.h"
+#include "HashedAbstractEnvironment.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+
+using namespace sparta;
+
+/*
+ * The same operations on the environment implementations, at the sizes of
+ * register environments.
+ */
+
+namespace {
+
+using Value = ConstantAbstractDomain<int>;
+using Hashed = HashedAbstractEnvironment<uint32_t, Value>;
+using Flat = FlatAbstractEnvironment<uint32_t, Value>;
+using PatriciaTree = PatriciaTreeMapAbstractEnvironment<uint32_t, Value>;
+
+std::vector<uint32_t> random_variables(size_t n, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<uint32_t> dist(0, 2 * n);
+  std::vector<uint32_t> variables(n);
+  for (auto& v : variables) {
+    v = dist(gen);
+  }
+  return variables;
+}
+
+template <typename Environment>
+Environment random_environment(size_t n, uint32_t seed) {
+  Environment env;
+  for (auto v : random_variables(n, seed)) {
+    env.set(v, Value(v % 3));
+  }
+  return env;
+}
+
+template <typename Environment>
+void BM_EnvironmentSet(benchmark::State& state) {
+  auto variables = random_variables(state.range(0), 1);
+  for (auto _ : state) {
+    Environment env;
+    for (auto v : variables) {
+      env.set(v, Value(v % 3));
+    }
+    benchmark::DoNotOptimize(env);
+  }
+  state.SetItemsProcessed(state.iterations() * variables.size());
+}
+
+template <typename Environment>
+void BM_EnvironmentGet(benchmark::State& state) {
+  auto env = random_environment<Environment>(state.range(0), 1);
+  auto variables = random_variables(state.range(0), 2);
+  for (auto _ : state) {
+    for (auto v : variables) {
+      benchmark::DoNotOptimize(env.get(v));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * variables.size());
+}
+
+template <typename Environment>
+void BM_EnvironmentJoin(benchmark::State& state) {
+  auto e1 = random_environment<Environment>(state.range(0), 1);
+  auto e2 = random_environment<Environment>(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(e1.join(e2));
+  }
+}
+
+template <typename Environment>
+void BM_EnvironmentLeq(benchmark::State& state) {
+  auto e1 = random_environment<Environment>(state.range(0), 1);
+  auto e2 = e1.join(random_environment<Environment>(state.range(0), 2));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(e1.leq(e2));
+  }
+}
+
+#define BENCHMARK_ENVIRONMENTS(BM)                                  \
+  BENCHMARK_TEMPLATE(BM, Hashed)->RangeMultiplier(4)->Range(4, 1024); \
+  BENCHMARK_TEMPLATE(BM, Flat)->RangeMultiplier(4)->Range(4, 1024);   \
+  BENCHMARK_TEMPLATE(BM, PatriciaTree)->RangeMultiplier(4)->Range(4, 1024)
+
+} // namespace
+
+BENCHMARK_ENVIRONMENTS(BM_EnvironmentSet);
+BENCHMARK_ENVIRONMENTS(BM_EnvironmentGet);
+BENCHMARK_ENVIRONMENTS(BM_EnvironmentJoin);
+BENCHMARK_ENVIRONMENTS(BM_EnvironmentLeq);
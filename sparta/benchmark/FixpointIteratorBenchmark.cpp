@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "ConstantAbstractDomain.h"
+#include "MonotonicFixpointIterator.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+#include "WeakTopologicalOrdering.h"
+
+using namespace sparta;
+
+namespace {
+
+/*
+ * A graph over the integers 0 to size() - 1, with 0 as its entry.
+ */
+class Graph {
+ public:
+  using Edge = std::pair<uint32_t, uint32_t>;
+
+  uint32_t add_node() {
+    m_succs.emplace_back();
+    m_preds.emplace_back();
+    return m_succs.size() - 1;
+  }
+
+  void add_edge(uint32_t src, uint32_t dst) {
+    m_succs[src].emplace_back(src, dst);
+    m_preds[dst].emplace_back(src, dst);
+  }
+
+  size_t size() const { return m_succs.size(); }
+
+  const std::vector<Edge>& succs(uint32_t n) const { return m_succs[n]; }
+
+  const std::vector<Edge>& preds(uint32_t n) const { return m_preds[n]; }
+
+ private:
+  std::vector<std::vector<Edge>> m_succs;
+  std::vector<std::vector<Edge>> m_preds;
+};
+
+struct GraphInterface {
+  using Graph = ::Graph;
+  using NodeId = uint32_t;
+  using EdgeId = Graph::Edge;
+
+  static NodeId entry(const Graph&) { return 0; }
+  // Copies, like the IR CFG's interface.
+  static std::vector<EdgeId> predecessors(const Graph& g, NodeId n) {
+    return g.preds(n);
+  }
+  static std::vector<EdgeId> successors(const Graph& g, NodeId n) {
+    return g.succs(n);
+  }
+  static NodeId source(const Graph&, const EdgeId& e) { return e.first; }
+  static NodeId target(const Graph&, const EdgeId& e) { return e.second; }
+};
+
+// The same graph, with the states of the iterator kept in vectors.
+struct DenseGraphInterface : public GraphInterface {
+  static size_t node_index(const Graph&, NodeId n) { return n; }
+  static size_t node_index_bound(const Graph& g) { return g.size(); }
+};
+
+/*
+ * Graph shapes. The `structured` shape mimics the control flow of methods:
+ * sequences of straight-line code, conditionals and loops, nested at random.
+ */
+
+Graph chain(size_t n) {
+  Graph g;
+  uint32_t last = g.add_node();
+  for (size_t i = 1; i < n; ++i) {
+    uint32_t node = g.add_node();
+    g.add_edge(last, node);
+    last = node;
+  }
+  return g;
+}
+
+Graph nested_loops(size_t depth) {
+  Graph g;
+  std::vector<uint32_t> heads;
+  uint32_t last = g.add_node();
+  for (size_t i = 0; i < depth; ++i) {
+    uint32_t head = g.add_node();
+    g.add_edge(last, head);
+    heads.push_back(head);
+    last = head;
+  }
+  for (auto it = heads.rbegin(); it != heads.rend(); ++it) {
+    uint32_t latch = g.add_node();
+    g.add_edge(last, latch);
+    g.add_edge(latch, *it);
+    last = latch;
+  }
+  uint32_t exit = g.add_node();
+  g.add_edge(heads.front(), exit);
+  return g;
+}
+
+// Appends a random structured region to `from`, and returns its last node.
+uint32_t structured_region(Graph* g,
+                           uint32_t from,
+                           size_t budget,
+                           std::mt19937* gen) {
+  uint32_t last = from;
+  while (g->size() < budget) {
+    switch ((*gen)() % 6) {
+    case 0:
+    case 1:
+    case 2: {
+      uint32_t node = g->add_node();
+      g->add_edge(last, node);
+      last = node;
+      break;
+    }
+    case 3: {
+      // if-then-else
+      uint32_t cond = g->add_node();
+      g->add_edge(last, cond);
+      uint32_t then_end = structured_region(
+          g, cond, std::min(budget, g->size() + 1 + (*gen)() % 8), gen);
+      uint32_t else_end = structured_region(
+          g, cond, std::min(budget, g->size() + 1 + (*gen)() % 8), gen);
+      uint32_t join = g->add_node();
+      g->add_edge(then_end, join);
+      g->add_edge(else_end, join);
+      last = join;
+      break;
+    }
+    case 4: {
+      // while loop
+      uint32_t head = g->add_node();
+      g->add_edge(last, head);
+      uint32_t body_end = structured_region(
+          g, head, std::min(budget, g->size() + 1 + (*gen)() % 16), gen);
+      g->add_edge(body_end, head);
+      last = g->add_node();
+      g->add_edge(head, last);
+      break;
+    }
+    default:
+      return last;
+    }
+  }
+  return last;
+}
+
+Graph structured(size_t n) {
+  Graph g;
+  std::mt19937 gen(n);
+  uint32_t last = g.add_node();
+  while (g.size() < n) {
+    last = structured_region(&g, last, n, &gen);
+  }
+  return g;
+}
+
+Graph make_graph(int shape, size_t n) {
+  switch (shape) {
+  case 0:
+    return chain(n);
+  case 1:
+    return nested_loops(n / 2);
+  default:
+    return structured(n);
+  }
+}
+
+std::vector<uint32_t> successor_nodes(const Graph& g, uint32_t n) {
+  std::vector<uint32_t> nodes;
+  for (const auto& e : g.succs(n)) {
+    nodes.push_back(e.second);
+  }
+  return nodes;
+}
+
+/*
+ * A constant propagation over 16 variables, where every node increments one
+ * of them modulo 4, so that the loops take a few iterations to stabilize.
+ */
+using Environment =
+    PatriciaTreeMapAbstractEnvironment<uint32_t, ConstantAbstractDomain<int>>;
+
+template <typename Interface>
+class Analysis final
+    : public MonotonicFixpointIterator<Interface, Environment> {
+ public:
+  explicit Analysis(const Graph& g)
+      : MonotonicFixpointIterator<Interface, Environment>(g, g.size()) {}
+
+  void analyze_node(const uint32_t& node, Environment* env) const override {
+    uint32_t var = node % 16;
+    env->update(var, [](const ConstantAbstractDomain<int>& value) {
+      if (!value.is_value()) {
+        return value;
+      }
+      return ConstantAbstractDomain<int>((*value.get_constant() + 1) % 4);
+    });
+  }
+
+  Environment analyze_edge(const Graph::Edge&,
+                           const Environment& env) const override {
+    return env;
+  }
+};
+
+Environment initial_environment() {
+  Environment env;
+  for (uint32_t var = 0; var < 16; ++var) {
+    env.set(var, ConstantAbstractDomain<int>(0));
+  }
+  return env;
+}
+
+void BM_WtoConstruction(benchmark::State& state) {
+  auto g = make_graph(state.range(0), state.range(1));
+  for (auto _ : state) {
+    WeakTopologicalOrdering<uint32_t> wto(
+        0, [&g](const uint32_t& n) { return successor_nodes(g, n); });
+    benchmark::DoNotOptimize(wto);
+  }
+  state.SetItemsProcessed(state.iterations() * g.size());
+}
+
+template <typename Interface>
+void BM_FixpointIteration(benchmark::State& state) {
+  auto g = make_graph(state.range(0), state.range(1));
+  auto init = initial_environment();
+  for (auto _ : state) {
+    Analysis<Interface> analysis(g);
+    analysis.run(init);
+    benchmark::DoNotOptimize(analysis.get_exit_state_at(g.size() - 1));
+  }
+  state.SetItemsProcessed(state.iterations() * g.size());
+}
+
+// Shapes: 0 is a chain, 1 nested loops, 2 a structured method.
+void graph_arguments(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"shape", "nodes"});
+  for (int shape = 0; shape <= 2; ++shape) {
+    for (int nodes : {16, 256, 4096}) {
+      // Iterating over nested loops is quadratic in their depth, and no real
+      // method nests thousands of loops.
+      if (shape == 1 && nodes > 256) {
+        continue;
+      }
+      b->Args({shape, nodes});
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_WtoConstruction)->Apply(graph_arguments);
+BENCHMARK_TEMPLATE(BM_FixpointIteration, GraphInterface)
+    ->Apply(graph_arguments);
+BENCHMARK_TEMPLATE(BM_FixpointIteration, DenseGraphInterface)
+    ->Apply(graph_arguments);
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "ConstantAbstractDomain.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+#include "PatriciaTreeSet.h"
+
+using namespace sparta;
+
+namespace {
+
+using Set = PatriciaTreeSet<uint32_t>;
+using Environment =
+    PatriciaTreeMapAbstractEnvironment<uint32_t, ConstantAbstractDomain<int>>;
+
+// Random elements drawn from a universe four times as large as the sets, so
+// that two sets overlap without being equal.
+std::vector<uint32_t> random_elements(size_t n, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<uint32_t> dist(0, 4 * n);
+  std::vector<uint32_t> elements(n);
+  for (auto& e : elements) {
+    e = dist(gen);
+  }
+  return elements;
+}
+
+Set random_set(size_t n, uint32_t seed) {
+  auto elements = random_elements(n, seed);
+  return Set(elements.begin(), elements.end());
+}
+
+Environment random_environment(size_t n, uint32_t seed) {
+  Environment env;
+  for (auto e : random_elements(n, seed)) {
+    env.set(e, ConstantAbstractDomain<int>(e % 3));
+  }
+  return env;
+}
+
+void BM_PatriciaTreeSetInsert(benchmark::State& state) {
+  auto elements = random_elements(state.range(0), 1);
+  for (auto _ : state) {
+    Set s;
+    for (auto e : elements) {
+      s.insert(e);
+    }
+    benchmark::DoNotOptimize(s);
+  }
+  state.SetItemsProcessed(state.iterations() * elements.size());
+}
+
+void BM_PatriciaTreeSetUnion(benchmark::State& state) {
+  auto s1 = random_set(state.range(0), 1);
+  auto s2 = random_set(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(s1.get_union_with(s2));
+  }
+}
+
+void BM_PatriciaTreeSetIntersection(benchmark::State& state) {
+  auto s1 = random_set(state.range(0), 1);
+  auto s2 = random_set(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(s1.get_intersection_with(s2));
+  }
+}
+
+void BM_PatriciaTreeSetIsSubsetOf(benchmark::State& state) {
+  auto s1 = random_set(state.range(0), 1);
+  // A superset that shares no structure with s1, so that the comparison
+  // cannot short-circuit on physical equality.
+  auto s2 = random_set(state.range(0), 1);
+  s2.insert(4 * state.range(0) + 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(s1.is_subset_of(s2));
+  }
+}
+
+void BM_PatriciaTreeMapEnvironmentSet(benchmark::State& state) {
+  auto elements = random_elements(state.range(0), 1);
+  for (auto _ : state) {
+    Environment env;
+    for (auto e : elements) {
+      env.set(e, ConstantAbstractDomain<int>(e % 3));
+    }
+    benchmark::DoNotOptimize(env);
+  }
+  state.SetItemsProcessed(state.iterations() * elements.size());
+}
+
+void BM_PatriciaTreeMapEnvironmentJoin(benchmark::State& state) {
+  auto e1 = random_environment(state.range(0), 1);
+  auto e2 = random_environment(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(e1.join(e2));
+  }
+}
+
+void BM_PatriciaTreeMapEnvironmentLeq(benchmark::State& state) {
+  auto e1 = random_environment(state.range(0), 1);
+  auto e2 = e1.join(random_environment(state.range(0), 2));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(e1.leq(e2));
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_PatriciaTreeSetInsert)->RangeMultiplier(8)->Range(8, 32768);
+BENCHMARK(BM_PatriciaTreeSetUnion)->RangeMultiplier(8)->Range(8, 32768);
+BENCHMARK(BM_PatriciaTreeSetIntersection)->RangeMultiplier(8)->Range(8, 32768);
+BENCHMARK(BM_PatriciaTreeSetIsSubsetOf)->RangeMultiplier(8)->Range(8, 32768);
+BENCHMARK(BM_PatriciaTreeMapEnvironmentSet)
+    ->RangeMultiplier(8)
+    ->Range(8, 32768);
+BENCHMARK(BM_PatriciaTreeMapEnvironmentJoin)
+    ->RangeMultiplier(8)
+    ->Range(8, 32768);
+BENCHMARK(BM_PatriciaTreeMapEnvironmentLeq)
+    ->RangeMultiplier(8)
+    ->Range(8, 32768);
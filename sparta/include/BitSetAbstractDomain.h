@@ -0,0 +1,357 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include "PowersetAbstractDomain.h"
+
+namespace sparta {
+
+template <typename Element>
+class BitSetAbstractDomain;
+
+namespace bsad_impl {
+
+/*
+ * A set of unsigned integers, represented as a vector of 64-bit words where
+ * the bit `e % 64` of the word `e / 64` tells whether `e` is in the set. The
+ * vector grows as needed, and the words past its end are implicitly zero. The
+ * set operations work a word at a time, in loops that compilers vectorize.
+ * Elements are enumerated in increasing order.
+ */
+template <typename Element>
+class BitSet final {
+ public:
+  using Word = uint64_t;
+  static constexpr size_t kWordBits = 64;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Element;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Element*;
+    using reference = const Element&;
+
+    const_iterator() = default;
+
+    reference operator*() const { return m_element; }
+
+    pointer operator->() const { return &m_element; }
+
+    const_iterator& operator++() {
+      m_bits &= m_bits - 1;
+      skip_empty_words();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator copy(*this);
+      ++(*this);
+      return copy;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return m_word == other.m_word && m_bits == other.m_bits;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    const_iterator(const std::vector<Word>* words, size_t word)
+        : m_words(words), m_word(word) {
+      if (m_word < m_words->size()) {
+        m_bits = (*m_words)[m_word];
+        skip_empty_words();
+      }
+    }
+
+    void skip_empty_words() {
+      while (m_bits == 0) {
+        if (++m_word >= m_words->size()) {
+          m_word = m_words->size();
+          return;
+        }
+        m_bits = (*m_words)[m_word];
+      }
+      m_element = static_cast<Element>(m_word * kWordBits +
+                                       __builtin_ctzll(m_bits));
+    }
+
+    const std::vector<Word>* m_words{nullptr};
+    size_t m_word{0};
+    // The bits of the current word that are still to be enumerated.
+    Word m_bits{0};
+    Element m_element{0};
+
+    friend class BitSet;
+  };
+
+  using iterator = const_iterator;
+
+  BitSet() = default;
+
+  BitSet(std::initializer_list<Element> l) {
+    for (Element e : l) {
+      insert(e);
+    }
+  }
+
+  const_iterator begin() const { return const_iterator(&m_words, 0); }
+
+  const_iterator end() const {
+    return const_iterator(&m_words, m_words.size());
+  }
+
+  bool empty() const {
+    return std::all_of(
+        m_words.begin(), m_words.end(), [](Word w) { return w == 0; });
+  }
+
+  size_t size() const {
+    size_t count = 0;
+    for (Word w : m_words) {
+      count += __builtin_popcountll(w);
+    }
+    return count;
+  }
+
+  bool contains(Element e) const {
+    size_t word = static_cast<size_t>(e) / kWordBits;
+    return word < m_words.size() && (m_words[word] & mask(e)) != 0;
+  }
+
+  BitSet& insert(Element e) {
+    size_t word = static_cast<size_t>(e) / kWordBits;
+    if (word >= m_words.size()) {
+      m_words.resize(word + 1, 0);
+    }
+    m_words[word] |= mask(e);
+    return *this;
+  }
+
+  BitSet& remove(Element e) {
+    size_t word = static_cast<size_t>(e) / kWordBits;
+    if (word < m_words.size()) {
+      m_words[word] &= ~mask(e);
+    }
+    return *this;
+  }
+
+  void clear() { m_words.clear(); }
+
+  bool is_subset_of(const BitSet& other) const {
+    size_t common = std::min(m_words.size(), other.m_words.size());
+    Word extra = 0;
+    for (size_t i = 0; i < common; ++i) {
+      extra |= m_words[i] & ~other.m_words[i];
+    }
+    for (size_t i = common; i < m_words.size(); ++i) {
+      extra |= m_words[i];
+    }
+    return extra == 0;
+  }
+
+  bool equals(const BitSet& other) const {
+    size_t common = std::min(m_words.size(), other.m_words.size());
+    Word diff = 0;
+    for (size_t i = 0; i < common; ++i) {
+      diff |= m_words[i] ^ other.m_words[i];
+    }
+    const auto& longer =
+        m_words.size() > other.m_words.size() ? m_words : other.m_words;
+    for (size_t i = common; i < longer.size(); ++i) {
+      diff |= longer[i];
+    }
+    return diff == 0;
+  }
+
+  BitSet& union_with(const BitSet& other) {
+    if (other.m_words.size() > m_words.size()) {
+      m_words.resize(other.m_words.size(), 0);
+    }
+    for (size_t i = 0; i < other.m_words.size(); ++i) {
+      m_words[i] |= other.m_words[i];
+    }
+    return *this;
+  }
+
+  BitSet& intersection_with(const BitSet& other) {
+    if (m_words.size() > other.m_words.size()) {
+      m_words.resize(other.m_words.size());
+    }
+    for (size_t i = 0; i < m_words.size(); ++i) {
+      m_words[i] &= other.m_words[i];
+    }
+    return *this;
+  }
+
+  BitSet& difference_with(const BitSet& other) {
+    size_t common = std::min(m_words.size(), other.m_words.size());
+    for (size_t i = 0; i < common; ++i) {
+      m_words[i] &= ~other.m_words[i];
+    }
+    return *this;
+  }
+
+  friend std::ostream& operator<<(std::ostream& o, const BitSet& s) {
+    o << "{";
+    for (auto it = s.begin(); it != s.end(); ++it) {
+      if (it != s.begin()) {
+        o << ", ";
+      }
+      o << *it;
+    }
+    o << "}";
+    return o;
+  }
+
+ private:
+  static Word mask(Element e) {
+    return Word(1) << (static_cast<size_t>(e) % kWordBits);
+  }
+
+  std::vector<Word> m_words;
+};
+
+template <typename Element>
+constexpr size_t BitSet<Element>::kWordBits;
+
+/*
+ * An abstract value from a powerset is implemented as a bit set.
+ */
+template <typename Element>
+class SetValue final : public PowersetImplementation<Element,
+                                                     const BitSet<Element>&,
+                                                     SetValue<Element>> {
+ public:
+  SetValue() = default;
+
+  SetValue(const Element& e) { m_set.insert(e); }
+
+  SetValue(std::initializer_list<Element> l) : m_set(l) {}
+
+  const BitSet<Element>& elements() const override { return m_set; }
+
+  size_t size() const override { return m_set.size(); }
+
+  bool contains(const Element& e) const override { return m_set.contains(e); }
+
+  void add(const Element& e) override { m_set.insert(e); }
+
+  void remove(const Element& e) override { m_set.remove(e); }
+
+  void clear() override { m_set.clear(); }
+
+  AbstractValueKind kind() const override { return AbstractValueKind::Value; }
+
+  bool leq(const SetValue& other) const override {
+    return m_set.is_subset_of(other.m_set);
+  }
+
+  bool equals(const SetValue& other) const override {
+    return m_set.equals(other.m_set);
+  }
+
+  AbstractValueKind join_with(const SetValue& other) override {
+    m_set.union_with(other.m_set);
+    return AbstractValueKind::Value;
+  }
+
+  AbstractValueKind meet_with(const SetValue& other) override {
+    m_set.intersection_with(other.m_set);
+    return AbstractValueKind::Value;
+  }
+
+  friend std::ostream& operator<<(std::ostream& o, const SetValue& value) {
+    o << "[#" << value.size() << "]";
+    o << value.m_set;
+    return o;
+  }
+
+ private:
+  BitSet<Element> m_set;
+
+  template <typename T>
+  friend class sparta::BitSetAbstractDomain;
+};
+
+} // namespace bsad_impl
+
+/*
+ * An implementation of powerset abstract domains using bit sets. This
+ * implementation is meant for sets of small unsigned integers drawn from a
+ * dense universe, like the registers of a method: the memory used by a set is
+ * proportional to its largest element, not to its size, but the lattice
+ * operations are a few machine instructions per 64 elements.
+ *
+ * Sample usage:
+ *
+ *  using Registers = BitSetAbstractDomain<uint16_t>;
+ *
+ *  Registers live;
+ *  live.add(3);
+ *  ...
+ *  for (uint16_t reg : live.elements()) {
+ *    ...
+ *  }
+ *
+ */
+template <typename Element>
+class BitSetAbstractDomain final
+    : public PowersetAbstractDomain<Element,
+                                    bsad_impl::SetValue<Element>,
+                                    const bsad_impl::BitSet<Element>&,
+                                    BitSetAbstractDomain<Element>> {
+ public:
+  using Value = bsad_impl::SetValue<Element>;
+
+  static_assert(std::is_integral<Element>::value &&
+                    std::is_unsigned<Element>::value,
+                "BitSetAbstractDomain only handles unsigned integers");
+
+  BitSetAbstractDomain()
+      : PowersetAbstractDomain<Element,
+                               Value,
+                               const bsad_impl::BitSet<Element>&,
+                               BitSetAbstractDomain>() {}
+
+  BitSetAbstractDomain(AbstractValueKind kind)
+      : PowersetAbstractDomain<Element,
+                               Value,
+                               const bsad_impl::BitSet<Element>&,
+                               BitSetAbstractDomain>(kind) {}
+
+  explicit BitSetAbstractDomain(const Element& e) {
+    this->set_to_value(Value(e));
+  }
+
+  explicit BitSetAbstractDomain(std::initializer_list<Element> l) {
+    this->set_to_value(Value(l));
+  }
+
+  static BitSetAbstractDomain bottom() {
+    return BitSetAbstractDomain(AbstractValueKind::Bottom);
+  }
+
+  static BitSetAbstractDomain top() {
+    return BitSetAbstractDomain(AbstractValueKind::Top);
+  }
+};
+
+} // namespace sparta
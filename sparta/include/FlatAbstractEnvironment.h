@@ -0,0 +1,440 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "AbstractDomain.h"
+
+namespace sparta {
+
+namespace fae_impl {
+
+template <typename Variable, typename Domain, typename VariableLess>
+class MapValue;
+
+} // namespace fae_impl
+
+/*
+ * An abstract environment with the same semantics as HashedAbstractEnvironment
+ * (variables that are not bound are implicitly bound to Top, and binding a
+ * variable to _|_ sets the whole environment to _|_), which stores its
+ * bindings in two sorted arrays, one for the variables and one for their
+ * values, instead of a hashtable.
+ *
+ * This is meant for the small environments of intraprocedural analyses, like
+ * register environments, which rarely hold more than a few dozen bindings.
+ * There, a lookup is a branchless scan of a contiguous array of keys, which
+ * compilers vectorize for integral variables, the lattice operations are
+ * linear merges of the sorted arrays, and copying an environment is two
+ * allocations, whatever its size. Lookups fall back to a binary search past
+ * kScanThreshold bindings, but insertions stay linear, so this does not scale
+ * to large environments.
+ */
+template <typename Variable,
+          typename Domain,
+          typename VariableLess = std::less<Variable>>
+class FlatAbstractEnvironment final
+    : public AbstractDomainScaffolding<
+          fae_impl::MapValue<Variable, Domain, VariableLess>,
+          FlatAbstractEnvironment<Variable, Domain, VariableLess>> {
+ public:
+  using Value = fae_impl::MapValue<Variable, Domain, VariableLess>;
+
+  /*
+   * The default constructor produces the Top value.
+   */
+  FlatAbstractEnvironment()
+      : AbstractDomainScaffolding<Value, FlatAbstractEnvironment>() {}
+
+  FlatAbstractEnvironment(AbstractValueKind kind)
+      : AbstractDomainScaffolding<Value, FlatAbstractEnvironment>(kind) {}
+
+  FlatAbstractEnvironment(
+      std::initializer_list<std::pair<Variable, Domain>> l) {
+    for (const auto& p : l) {
+      if (p.second.is_bottom()) {
+        this->set_to_bottom();
+        return;
+      }
+      this->get_value()->insert_binding(p.first, p.second);
+    }
+    this->normalize();
+  }
+
+  bool is_value() const { return this->kind() == AbstractValueKind::Value; }
+
+  size_t size() const {
+    RUNTIME_CHECK(this->kind() == AbstractValueKind::Value,
+                  invalid_abstract_value()
+                      << expected_kind(AbstractValueKind::Value)
+                      << actual_kind(this->kind()));
+    return this->get_value()->m_variables.size();
+  }
+
+  /*
+   * The bound variables in increasing order, and their values at the same
+   * indices.
+   */
+  const std::vector<Variable>& variables() const {
+    RUNTIME_CHECK(this->kind() == AbstractValueKind::Value,
+                  invalid_abstract_value()
+                      << expected_kind(AbstractValueKind::Value)
+                      << actual_kind(this->kind()));
+    return this->get_value()->m_variables;
+  }
+
+  const std::vector<Domain>& values() const {
+    RUNTIME_CHECK(this->kind() == AbstractValueKind::Value,
+                  invalid_abstract_value()
+                      << expected_kind(AbstractValueKind::Value)
+                      << actual_kind(this->kind()));
+    return this->get_value()->m_values;
+  }
+
+  Domain get(const Variable& variable) const {
+    if (this->is_bottom()) {
+      return Domain::bottom();
+    }
+    const Domain* value = this->get_value()->find(variable);
+    return value == nullptr ? Domain::top() : *value;
+  }
+
+  FlatAbstractEnvironment& set(const Variable& variable, const Domain& value) {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    if (value.is_bottom()) {
+      this->set_to_bottom();
+      return *this;
+    }
+    this->get_value()->insert_binding(variable, value);
+    this->normalize();
+    return *this;
+  }
+
+  FlatAbstractEnvironment& update(const Variable& variable,
+                                  std::function<void(Domain*)> operation) {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    auto* map = this->get_value();
+    size_t i = map->lower_bound(variable);
+    if (i == map->m_variables.size() ||
+        VariableLess()(variable, map->m_variables[i])) {
+      // This means it's an implicit binding (variable, Top). We explicitly
+      // construct the Top value in order to apply the operation.
+      map->m_variables.insert(map->m_variables.begin() + i, variable);
+      map->m_values.insert(map->m_values.begin() + i, Domain::top());
+    }
+    Domain* value = &map->m_values[i];
+    operation(value);
+    // We normalize the abstract environment after the operation has been
+    // completed.
+    if (value->is_bottom()) {
+      this->set_to_bottom();
+      return *this;
+    }
+    if (value->is_top()) {
+      map->erase_at(i);
+    }
+    this->normalize();
+    return *this;
+  }
+
+  static FlatAbstractEnvironment bottom() {
+    return FlatAbstractEnvironment(AbstractValueKind::Bottom);
+  }
+
+  static FlatAbstractEnvironment top() {
+    return FlatAbstractEnvironment(AbstractValueKind::Top);
+  }
+};
+
+} // namespace sparta
+
+template <typename Variable, typename Domain, typename VariableLess>
+inline std::ostream& operator<<(
+    std::ostream& o,
+    const typename sparta::
+        FlatAbstractEnvironment<Variable, Domain, VariableLess>& e) {
+  using namespace sparta;
+  switch (e.kind()) {
+  case AbstractValueKind::Bottom: {
+    o << "_|_";
+    break;
+  }
+  case AbstractValueKind::Top: {
+    o << "T";
+    break;
+  }
+  case AbstractValueKind::Value: {
+    o << "[#" << e.size() << "]";
+    o << "{";
+    const auto& variables = e.variables();
+    const auto& values = e.values();
+    for (size_t i = 0; i < variables.size(); ++i) {
+      if (i > 0) {
+        o << ", ";
+      }
+      o << variables[i] << " -> " << values[i];
+    }
+    o << "}";
+    break;
+  }
+  }
+  return o;
+}
+
+namespace sparta {
+
+namespace fae_impl {
+
+/*
+ * The definition of an element of a flat abstract environment. The variables
+ * are kept sorted and unique in `m_variables`, and `m_values[i]` is the value
+ * of `m_variables[i]`. As in HashedAbstractEnvironment, bindings to Top are
+ * not stored and bindings to Bottom never occur.
+ */
+template <typename Variable, typename Domain, typename VariableLess>
+class MapValue final
+    : public AbstractValue<MapValue<Variable, Domain, VariableLess>> {
+ public:
+  // Up to this many bindings, a lookup scans all the variables.
+  static constexpr size_t kScanThreshold = 64;
+
+  MapValue() = default;
+
+  MapValue(const Variable& variable, const Domain& value) {
+    insert_binding(variable, value);
+  }
+
+  void clear() override {
+    m_variables.clear();
+    m_values.clear();
+  }
+
+  AbstractValueKind kind() const override {
+    // If the map is empty, then all variables are implicitly bound to Top,
+    // i.e., the abstract environment itself is Top.
+    return m_variables.empty() ? AbstractValueKind::Top
+                               : AbstractValueKind::Value;
+  }
+
+  bool leq(const MapValue& other) const override {
+    if (other.m_variables.size() > m_variables.size()) {
+      // In this case, there is a variable bound to a non-Top value in 'other'
+      // that is not defined in 'this' (and is therefore implicitly bound to
+      // Top).
+      return false;
+    }
+    // Every variable of 'other' must be bound in 'this' to a smaller value.
+    // The variables of 'this' that 'other' does not bind are below Top.
+    size_t i = 0;
+    for (size_t j = 0; j < other.m_variables.size(); ++j) {
+      while (i < m_variables.size() &&
+             VariableLess()(m_variables[i], other.m_variables[j])) {
+        ++i;
+      }
+      if (i == m_variables.size() ||
+          VariableLess()(other.m_variables[j], m_variables[i])) {
+        return false;
+      }
+      if (!m_values[i].leq(other.m_values[j])) {
+        return false;
+      }
+      ++i;
+    }
+    return true;
+  }
+
+  bool equals(const MapValue& other) const override {
+    if (m_variables.size() != other.m_variables.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < m_variables.size(); ++i) {
+      if (VariableLess()(m_variables[i], other.m_variables[i]) ||
+          VariableLess()(other.m_variables[i], m_variables[i]) ||
+          !m_values[i].equals(other.m_values[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  AbstractValueKind join_with(const MapValue& other) override {
+    return join_like_operation(
+        other, [](Domain* x, const Domain& y) { x->join_with(y); });
+  }
+
+  AbstractValueKind widen_with(const MapValue& other) override {
+    return join_like_operation(
+        other, [](Domain* x, const Domain& y) { x->widen_with(y); });
+  }
+
+  AbstractValueKind meet_with(const MapValue& other) override {
+    return meet_like_operation(
+        other, [](Domain* x, const Domain& y) { x->meet_with(y); });
+  }
+
+  AbstractValueKind narrow_with(const MapValue& other) override {
+    return meet_like_operation(
+        other, [](Domain* x, const Domain& y) { x->narrow_with(y); });
+  }
+
+ private:
+  /*
+   * The index of the first variable that is not less than `variable`. On
+   * small environments, this counts the smaller variables instead of
+   * searching, which has no data-dependent branch.
+   */
+  size_t lower_bound(const Variable& variable) const {
+    if (m_variables.size() > kScanThreshold) {
+      return std::lower_bound(m_variables.begin(),
+                              m_variables.end(),
+                              variable,
+                              VariableLess()) -
+             m_variables.begin();
+    }
+    VariableLess less;
+    size_t count = 0;
+    for (const auto& v : m_variables) {
+      count += less(v, variable) ? 1 : 0;
+    }
+    return count;
+  }
+
+  const Domain* find(const Variable& variable) const {
+    size_t i = lower_bound(variable);
+    if (i == m_variables.size() || VariableLess()(variable, m_variables[i])) {
+      return nullptr;
+    }
+    return &m_values[i];
+  }
+
+  void erase_at(size_t i) {
+    m_variables.erase(m_variables.begin() + i);
+    m_values.erase(m_values.begin() + i);
+  }
+
+  void insert_binding(const Variable& variable, const Domain& value) {
+    // The Bottom value is handled in FlatAbstractEnvironment and should never
+    // occur here.
+    RUNTIME_CHECK(!value.is_bottom(), internal_error());
+    size_t i = lower_bound(variable);
+    bool found =
+        i < m_variables.size() && !VariableLess()(variable, m_variables[i]);
+    if (value.is_top()) {
+      // Bindings with the Top value are not explicitly represented.
+      if (found) {
+        erase_at(i);
+      }
+    } else if (found) {
+      m_values[i] = value;
+    } else {
+      m_variables.insert(m_variables.begin() + i, variable);
+      m_values.insert(m_values.begin() + i, value);
+    }
+  }
+
+  AbstractValueKind join_like_operation(
+      const MapValue& other,
+      std::function<void(Domain*, const Domain&)> operation) {
+    // Only the variables bound on both sides survive, and the result is
+    // compacted in place.
+    size_t out = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < m_variables.size(); ++i) {
+      while (j < other.m_variables.size() &&
+             VariableLess()(other.m_variables[j], m_variables[i])) {
+        ++j;
+      }
+      if (j == other.m_variables.size() ||
+          VariableLess()(m_variables[i], other.m_variables[j])) {
+        // The other value is Top, we just drop the binding.
+        continue;
+      }
+      // We compute the join-like combination of the values.
+      operation(&m_values[i], other.m_values[j]);
+      if (m_values[i].is_top()) {
+        continue;
+      }
+      if (out != i) {
+        m_variables[out] = std::move(m_variables[i]);
+        m_values[out] = std::move(m_values[i]);
+      }
+      ++out;
+    }
+    m_variables.erase(m_variables.begin() + out, m_variables.end());
+    m_values.erase(m_values.begin() + out, m_values.end());
+    return kind();
+  }
+
+  AbstractValueKind meet_like_operation(
+      const MapValue& other,
+      std::function<void(Domain*, const Domain&)> operation) {
+    // The union of the bindings is merged into fresh arrays.
+    std::vector<Variable> variables;
+    std::vector<Domain> values;
+    variables.reserve(m_variables.size() + other.m_variables.size());
+    values.reserve(m_variables.size() + other.m_variables.size());
+    size_t i = 0;
+    size_t j = 0;
+    VariableLess less;
+    while (i < m_variables.size() || j < other.m_variables.size()) {
+      if (j == other.m_variables.size() ||
+          (i < m_variables.size() &&
+           less(m_variables[i], other.m_variables[j]))) {
+        variables.push_back(std::move(m_variables[i]));
+        values.push_back(std::move(m_values[i]));
+        ++i;
+      } else if (i == m_variables.size() ||
+                 less(other.m_variables[j], m_variables[i])) {
+        // The value is Top, we just insert the other value (Top is the
+        // identity for meet-like operations).
+        variables.push_back(other.m_variables[j]);
+        values.push_back(other.m_values[j]);
+        ++j;
+      } else {
+        // We compute the meet-like combination of the values.
+        operation(&m_values[i], other.m_values[j]);
+        if (m_values[i].is_bottom()) {
+          // If the result is Bottom, the entire environment becomes Bottom.
+          clear();
+          return AbstractValueKind::Bottom;
+        }
+        variables.push_back(std::move(m_variables[i]));
+        values.push_back(std::move(m_values[i]));
+        ++i;
+        ++j;
+      }
+    }
+    m_variables = std::move(variables);
+    m_values = std::move(values);
+    return kind();
+  }
+
+  std::vector<Variable> m_variables;
+  std::vector<Domain> m_values;
+
+  template <typename T1, typename T2, typename T3>
+  friend class sparta::FlatAbstractEnvironment;
+};
+
+template <typename Variable, typename Domain, typename VariableLess>
+constexpr size_t MapValue<Variable, Domain, VariableLess>::kScanThreshold;
+
+} // namespace fae_impl
+
+} // namespace sparta
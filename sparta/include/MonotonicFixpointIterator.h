@@ -10,16 +10,238 @@
 #include <algorithm>
 #include <cstddef>
 #include <functional>
+#include <memory>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 #include "AbstractDomain.h"
 #include "FixpointIterator.h"
 #include "WeakTopologicalOrdering.h"
 
 namespace sparta {
 
+template <typename GraphInterface,
+          typename Domain,
+          typename NodeHash = std::hash<typename GraphInterface::NodeId>>
+class MonotonicFixpointIterator;
+
+template <typename GraphInterface,
+          typename Domain,
+          typename NodeHash = std::hash<typename GraphInterface::NodeId>>
+class ParallelMonotonicFixpointIterator;
+
+namespace fp_impl {
+
+template <typename... T>
+struct make_void {
+  using type = void;
+};
+
+/*
+ * A graph interface may number its nodes densely by providing
+ *
+ *   static size_t node_index(const Graph&, const NodeId&);
+ *   static size_t node_index_bound(const Graph&);
+ *
+ * where every index is smaller than the bound. The fixpoint iterator then
+ * keeps its per-node state in vectors instead of hash tables.
+ */
+template <typename GraphInterface, typename = void>
+struct has_dense_node_index : std::false_type {};
+
+template <typename GraphInterface>
+struct has_dense_node_index<
+    GraphInterface,
+    typename make_void<
+        decltype(GraphInterface::node_index(
+            std::declval<const typename GraphInterface::Graph&>(),
+            std::declval<const typename GraphInterface::NodeId&>())),
+        decltype(GraphInterface::node_index_bound(
+            std::declval<const typename GraphInterface::Graph&>()))>::type>
+    : std::true_type {};
+
+/*
+ * The table of per-node values used by the fixpoint iterator. Looking up an
+ * absent node with operator[] adds a default-constructed value. References
+ * stay valid until the next call to clear().
+ */
+template <typename GraphInterface,
+          typename Value,
+          typename NodeHash,
+          bool Dense = has_dense_node_index<GraphInterface>::value>
+class NodeTable final {
+ public:
+  using Graph = typename GraphInterface::Graph;
+  using NodeId = typename GraphInterface::NodeId;
+
+  NodeTable(const Graph&, size_t size_hint) : m_values(size_hint) {}
+
+  const Value* find(const NodeId& node) const {
+    auto it = m_values.find(node);
+    return it == m_values.end() ? nullptr : &it->second;
+  }
+
+  Value& operator[](const NodeId& node) {
+    // Lookups of present nodes go through find(), which is safe to call from
+    // several threads at once.
+    auto it = m_values.find(node);
+    return it != m_values.end() ? it->second : m_values[node];
+  }
+
+  void erase(const NodeId& node) { m_values.erase(node); }
+
+  void clear() { m_values.clear(); }
+
+ private:
+  std::unordered_map<NodeId, Value, NodeHash> m_values;
+};
+
+template <typename GraphInterface, typename Value, typename NodeHash>
+class NodeTable<GraphInterface, Value, NodeHash, /* Dense */ true> final {
+ public:
+  using Graph = typename GraphInterface::Graph;
+  using NodeId = typename GraphInterface::NodeId;
+
+  NodeTable(const Graph& graph, size_t) : m_graph(graph) { clear(); }
+
+  const Value* find(const NodeId& node) const {
+    auto index = GraphInterface::node_index(m_graph, node);
+    if (index >= m_slots.size() || !m_slots[index] ||
+        !(m_slots[index]->first == node)) {
+      return nullptr;
+    }
+    return &m_slots[index]->second;
+  }
+
+  Value& operator[](const NodeId& node) {
+    auto index = GraphInterface::node_index(m_graph, node);
+    if (index >= m_slots.size()) {
+      // Only if the graph grew after the last clear(); stay correct anyway.
+      m_slots.resize(index + 1);
+    }
+    auto& slot = m_slots[index];
+    // Indices may be reused by nodes created after the iteration.
+    if (!slot || !(slot->first == node)) {
+      slot.emplace(node, Value());
+    }
+    return slot->second;
+  }
+
+  void erase(const NodeId& node) {
+    if (find(node) != nullptr) {
+      m_slots[GraphInterface::node_index(m_graph, node)] = boost::none;
+    }
+  }
+
+  // Sizes the table for the graph as it is now, so that operator[] never
+  // reallocates until the next clear().
+  void clear() {
+    m_slots.clear();
+    m_slots.resize(GraphInterface::node_index_bound(m_graph));
+  }
+
+ private:
+  const Graph& m_graph;
+  std::vector<boost::optional<std::pair<NodeId, Value>>> m_slots;
+};
+
+/*
+ * A graph interface may also hand out a weak topological ordering of the
+ * graph that it computed before, so that the analyses of the same graph
+ * share it, by providing
+ *
+ *   static std::shared_ptr<const WeakTopologicalOrdering<NodeId, NodeHash>>
+ *   wto(const Graph&);
+ *
+ * It must be the ordering that the iterator would build itself: from the
+ * entry node, with the successors in the order given by successors().
+ */
+template <typename GraphInterface, typename NodeHash, typename = void>
+struct WtoProvider {
+  using NodeId = typename GraphInterface::NodeId;
+
+  static std::shared_ptr<const WeakTopologicalOrdering<NodeId, NodeHash>> get(
+      const typename GraphInterface::Graph& graph) {
+    return std::make_shared<WeakTopologicalOrdering<NodeId, NodeHash>>(
+        GraphInterface::entry(graph), [&graph](const NodeId& x) {
+          const auto& succ_edges = GraphInterface::successors(graph, x);
+          std::vector<NodeId> succ_nodes;
+          std::transform(succ_edges.begin(),
+                         succ_edges.end(),
+                         std::back_inserter(succ_nodes),
+                         std::bind(&GraphInterface::target,
+                                   std::ref(graph),
+                                   std::placeholders::_1));
+          return succ_nodes;
+        });
+  }
+};
+
+template <typename GraphInterface, typename NodeHash>
+struct WtoProvider<
+    GraphInterface,
+    NodeHash,
+    typename std::enable_if<std::is_convertible<
+        decltype(GraphInterface::wto(
+            std::declval<const typename GraphInterface::Graph&>())),
+        std::shared_ptr<const WeakTopologicalOrdering<
+            typename GraphInterface::NodeId,
+            NodeHash>>>::value>::type> {
+  static std::shared_ptr<
+      const WeakTopologicalOrdering<typename GraphInterface::NodeId, NodeHash>>
+  get(const typename GraphInterface::Graph& graph) {
+    return GraphInterface::wto(graph);
+  }
+};
+
+} // namespace fp_impl
+
+/*
+ * How the default extrapolation of MonotonicFixpointIterator accelerates the
+ * convergence at the heads of the SCCs, and how much iterating it may do.
+ */
+template <typename Domain>
+struct WideningPolicy {
+  // The number of iterations at a head that use the join, before widening
+  // kicks in. Delaying the widening often buys precision on loops whose
+  // first few iterations are special.
+  uint32_t widening_delay{1};
+
+  // An increasing chain of elements of the domain. Instead of widening, the
+  // state at a head jumps to the first threshold above the join of the old
+  // and new states, so that bounds like the size of an array survive the
+  // widening. The widening is only used past the last threshold.
+  std::vector<Domain> thresholds;
+
+  // The number of iterations at the SCC heads over a whole run, past which
+  // the state at a head that has not stabilized yet is set to Top, which
+  // ends its iteration at once. Zero means unlimited. With the parallel
+  // iterator, each worker has its own budget.
+  size_t iteration_budget{0};
+};
+
+/*
+ * How much iterating a run of the fixpoint iterator took: the number of
+ * iterations at all the SCC heads, and the most that any single local
+ * stabilization loop took.
+ */
+struct FixpointIterationStats {
+  size_t iterations{0};
+  uint32_t max_local_iterations{0};
+  bool budget_exhausted{false};
+
+  void merge(const FixpointIterationStats& other) {
+    iterations += other.iterations;
+    max_local_iterations =
+        std::max(max_local_iterations, other.max_local_iterations);
+    budget_exhausted = budget_exhausted || other.budget_exhausted;
+  }
+};
+
 /*
  * This data structure contains the current state of the fixpoint iteration,
  * which is provided to the user when an extrapolation step is executed, so as
@@ -29,47 +251,45 @@ namespace sparta {
  * analyzed in the current local stabilization loop (please see Bourdoncle's
  * paper for more details on the recursive iteration strategy).
  */
-template <typename NodeId, typename Domain, typename NodeHash>
+template <typename GraphInterface, typename Domain, typename NodeHash>
 class MonotonicFixpointIteratorContext final {
  public:
+  using Graph = typename GraphInterface::Graph;
+  using NodeId = typename GraphInterface::NodeId;
+
   MonotonicFixpointIteratorContext() = delete;
   MonotonicFixpointIteratorContext(const MonotonicFixpointIteratorContext&) =
       delete;
 
   uint32_t get_local_iterations_for(const NodeId& node) const {
-    auto it = m_local_iterations.find(node);
-    if (it == m_local_iterations.end()) {
-      return 0;
-    }
-    return it->second;
+    auto* count = m_local_iterations.find(node);
+    return count == nullptr ? 0 : *count;
   }
 
   uint32_t get_global_iterations_for(const NodeId& node) const {
-    auto it = m_global_iterations.find(node);
-    if (it == m_global_iterations.end()) {
-      return 0;
-    }
-    return it->second;
+    auto* count = m_global_iterations.find(node);
+    return count == nullptr ? 0 : *count;
   }
 
+  const FixpointIterationStats& get_stats() const { return m_stats; }
+
  private:
-  explicit MonotonicFixpointIteratorContext(const Domain& init)
-      : m_init(init) {}
+  using IterationCounts = fp_impl::NodeTable<GraphInterface, uint32_t, NodeHash>;
 
-  const Domain& get_initial_value() const { return m_init; }
+  MonotonicFixpointIteratorContext(const Graph& graph, const Domain& init)
+      : m_init(init),
+        m_global_iterations(graph, /* size_hint */ 4),
+        m_local_iterations(graph, /* size_hint */ 4) {}
 
-  void increase_iteration_count(
-      const NodeId& node,
-      std::unordered_map<NodeId, uint32_t, NodeHash>* table) {
-    auto insertion = table->insert({node, 1});
-    if (insertion.second == false) {
-      ++insertion.first->second;
-    }
-  }
+  const Domain& get_initial_value() const { return m_init; }
 
   void increase_iteration_count_for(const NodeId& node) {
-    increase_iteration_count(node, &m_local_iterations);
-    increase_iteration_count(node, &m_global_iterations);
+    // Absent counts are value-initialized to zero.
+    auto local = ++m_local_iterations[node];
+    ++m_global_iterations[node];
+    ++m_stats.iterations;
+    m_stats.max_local_iterations =
+        std::max(m_stats.max_local_iterations, local);
   }
 
   void reset_local_iteration_count_for(const NodeId& node) {
@@ -77,11 +297,14 @@ class MonotonicFixpointIteratorContext final {
   }
 
   const Domain& m_init;
-  std::unordered_map<NodeId, uint32_t, NodeHash> m_global_iterations;
-  std::unordered_map<NodeId, uint32_t, NodeHash> m_local_iterations;
+  IterationCounts m_global_iterations;
+  IterationCounts m_local_iterations;
+  FixpointIterationStats m_stats;
 
   template <typename T1, typename T2, typename T3>
   friend class MonotonicFixpointIterator;
+  template <typename T1, typename T2, typename T3>
+  friend class ParallelMonotonicFixpointIterator;
 };
 
 /*
@@ -94,38 +317,38 @@ class MonotonicFixpointIteratorContext final {
  *   F. Bourdoncle. Efficient chaotic iteration strategies with widenings.
  *   In Formal Methods in Programming and Their Applications, pp 128-141.
  */
-template <typename GraphInterface,
-          typename Domain,
-          typename NodeHash = std::hash<typename GraphInterface::NodeId>>
+template <typename GraphInterface, typename Domain, typename NodeHash>
 class MonotonicFixpointIterator
     : public FixpointIterator<GraphInterface, Domain> {
  public:
   using Graph = typename GraphInterface::Graph;
   using NodeId = typename GraphInterface::NodeId;
   using EdgeId = typename GraphInterface::EdgeId;
-  using Context = MonotonicFixpointIteratorContext<NodeId, Domain, NodeHash>;
+  using Context =
+      MonotonicFixpointIteratorContext<GraphInterface, Domain, NodeHash>;
 
   /*
    * When the number of nodes in the CFG is known, it's better to provide it to
    * the constructor, so as to prevent unnecessary resizing of the underlying
-   * hashtables during the iteration.
+   * hashtables during the iteration. Graph interfaces that number their nodes
+   * densely (see fp_impl::has_dense_node_index) get vectors instead, and the
+   * hint is ignored.
+   *
+   * With `entry_states_at_heads_only`, the entry states of the nodes that are
+   * not heads of a component of the weak topological ordering are dropped as
+   * soon as the nodes are analyzed, which roughly halves the memory held by
+   * the iterator. get_entry_state_at() then recomputes them from the exit
+   * states of the predecessors, so this suits analyses that only ask for
+   * each entry state once.
    */
-  MonotonicFixpointIterator(const Graph& graph, size_t cfg_size_hint = 4)
+  MonotonicFixpointIterator(const Graph& graph,
+                            size_t cfg_size_hint = 4,
+                            bool entry_states_at_heads_only = false)
       : m_graph(graph),
-        m_wto(GraphInterface::entry(graph),
-              [=, &graph](const NodeId& x) {
-                const auto& succ_edges = GraphInterface::successors(graph, x);
-                std::vector<NodeId> succ_nodes;
-                std::transform(succ_edges.begin(),
-                               succ_edges.end(),
-                               std::back_inserter(succ_nodes),
-                               std::bind(&GraphInterface::target,
-                                         std::ref(graph),
-                                         std::placeholders::_1));
-                return succ_nodes;
-              }),
-        m_entry_states(cfg_size_hint),
-        m_exit_states(cfg_size_hint) {}
+        m_wto(fp_impl::WtoProvider<GraphInterface, NodeHash>::get(graph)),
+        m_entry_states(graph, cfg_size_hint),
+        m_exit_states(graph, cfg_size_hint),
+        m_entry_states_at_heads_only(entry_states_at_heads_only) {}
 
   /*
    * This method is invoked on the head of an SCC at each iteration, whenever
@@ -134,19 +357,45 @@ class MonotonicFixpointIterator
    * often. However, the order and frequency at which it is performed may have a
    * very significant impact on the precision of the final result. This method
    * gives the user a way to parameterize the application of the widening
-   * operator. A default widening strategy is provided, which applies the join
-   * at the first iteration and then the widening at all subsequent iterations
-   * until the limit is reached.
+   * operator. A default widening strategy is provided, which follows the
+   * WideningPolicy: by default, it applies the join at the first iteration
+   * and then the widening at all subsequent iterations until the limit is
+   * reached.
    */
   virtual void extrapolate(const Context& context,
                            const NodeId& node,
                            Domain* current_state,
                            const Domain& new_state) const {
-    if (context.get_local_iterations_for(node) == 0) {
+    if (context.get_local_iterations_for(node) < m_policy.widening_delay) {
       current_state->join_with(new_state);
-    } else {
-      current_state->widen_with(new_state);
+      return;
+    }
+    if (!m_policy.thresholds.empty()) {
+      Domain joined = current_state->join(new_state);
+      for (const auto& threshold : m_policy.thresholds) {
+        if (joined.leq(threshold)) {
+          *current_state = threshold;
+          return;
+        }
+      }
     }
+    current_state->widen_with(new_state);
+  }
+
+  void set_widening_policy(WideningPolicy<Domain> policy) {
+    m_policy = std::move(policy);
+  }
+
+  const WideningPolicy<Domain>& get_widening_policy() const {
+    return m_policy;
+  }
+
+  /*
+   * The iteration counts of the last run, so that clients can spot the
+   * graphs on which the analysis struggles to converge.
+   */
+  const FixpointIterationStats& get_iteration_stats() const {
+    return m_stats;
   }
 
   /*
@@ -157,25 +406,37 @@ class MonotonicFixpointIterator
    */
   void run(const Domain& init) {
     clear();
-    Context context(init);
-    for (const WtoComponent<NodeId>& component : m_wto) {
+    if (m_entry_states_at_heads_only) {
+      m_init = init;
+    }
+    Context context(m_graph, init);
+    for (const WtoComponent<NodeId>& component : *m_wto) {
       analyze_component(&context, component);
     }
+    m_stats = context.get_stats();
   }
 
   /*
    * Returns the invariant computed by the fixpoint iterator at a node entry.
    */
   Domain get_entry_state_at(const NodeId& node) const {
-    auto it = m_entry_states.find(node);
-    return (it == m_entry_states.end()) ? Domain::bottom() : it->second;
+    auto* state = m_entry_states.find(node);
+    if (state != nullptr) {
+      return *state;
+    }
+    if (m_entry_states_at_heads_only && m_exit_states.find(node) != nullptr) {
+      Domain entry_state;
+      compute_entry_state(m_init, node, &entry_state);
+      return entry_state;
+    }
+    return Domain::bottom();
   }
 
   /*
    * Returns the invariant computed by the fixpoint iterator at a node exit.
    */
   Domain get_exit_state_at(const NodeId& node) const {
-    auto it = m_exit_states.find(node);
+    auto* state = m_exit_states.find(node);
     // It's impossible to get rid of this condition by initializing all exit
     // states to _|_ prior to starting the fixpoint iteration. The reason is
     // that we only have a partial view of the control-flow graph, i.e., all
@@ -190,21 +451,22 @@ class MonotonicFixpointIterator
     // When computing the entry state of A, we perform the join of the exit
     // states of all its predecessors, which include U. Since U is invisible to
     // the fixpoint iterator, there is no way to initialize its exit state.
-    return (it == m_exit_states.end()) ? Domain::bottom() : it->second;
+    return state == nullptr ? Domain::bottom() : *state;
   }
 
  private:
   void clear() {
     m_entry_states.clear();
     m_exit_states.clear();
+    m_stats = FixpointIterationStats();
   }
 
-  void compute_entry_state(Context* context,
+  void compute_entry_state(const Domain& init,
                            const NodeId& node,
-                           Domain* placeholder) {
+                           Domain* placeholder) const {
     placeholder->set_to_bottom();
     if (node == GraphInterface::entry(m_graph)) {
-      placeholder->join_with(context->get_initial_value());
+      placeholder->join_with(init);
     }
     for (EdgeId edge : GraphInterface::predecessors(m_graph, node)) {
       placeholder->join_with(this->analyze_edge(
@@ -215,13 +477,21 @@ class MonotonicFixpointIterator
   void analyze_component(Context* context,
                          const WtoComponent<NodeId>& component) {
     if (component.is_vertex()) {
-      analyze_vertex(context, component.head_node());
+      analyze_vertex(context, component.head_node(), /* is_head */ false);
     } else {
       analyze_scc(context, component);
     }
   }
 
-  void analyze_vertex(Context* context, const NodeId& node) {
+  void analyze_vertex(Context* context, const NodeId& node, bool is_head) {
+    if (m_entry_states_at_heads_only && !is_head) {
+      Domain entry_state;
+      compute_entry_state(context->get_initial_value(), node, &entry_state);
+      Domain& exit_state = m_exit_states[node];
+      exit_state = std::move(entry_state);
+      this->analyze_node(node, &exit_state);
+      return;
+    }
     Domain& entry_state = m_entry_states[node];
     // We should be careful not to access m_exit_states[node] before computing
     // the entry state, as this may silently initialize it with an unwanted
@@ -231,7 +501,7 @@ class MonotonicFixpointIterator
     // iteration is not a viable option, since the control-flow graph may
     // contain unreachable nodes pointing to reachable ones (see the
     // documentation of `get_exit_state_at`).
-    compute_entry_state(context, node, &entry_state);
+    compute_entry_state(context->get_initial_value(), node, &entry_state);
     Domain& exit_state = m_exit_states[node];
     exit_state = entry_state;
     this->analyze_node(node, &exit_state);
@@ -242,17 +512,29 @@ class MonotonicFixpointIterator
     bool iterate = true;
     for (context->reset_local_iteration_count_for(head); iterate;
          context->increase_iteration_count_for(head)) {
-      analyze_vertex(context, head);
+      if (context->get_local_iterations_for(head) == 0) {
+        analyze_vertex(context, head, /* is_head */ true);
+      } else {
+        // The entry state of the head was extrapolated at the end of the
+        // previous iteration, from the same exit states of its predecessors
+        // that it would be recomputed from here. Recomputing it would throw
+        // the extrapolation away, and with it the widening. Keeping it is
+        // sound, since the extrapolation is above the recomputed state: the
+        // states at the head only grow until they reach a post-fixpoint.
+        Domain& exit_state = m_exit_states[head];
+        exit_state = m_entry_states[head];
+        this->analyze_node(head, &exit_state);
+      }
       for (const auto& component : scc) {
         analyze_component(context, component);
       }
       // The current state of the iteration is represented by a pointer to the
-      // slot associated with the head node in the hash table of entry states.
-      // The state is updated in place within the hash table via side effects,
+      // slot associated with the head node in the table of entry states.
+      // The state is updated in place within the table via side effects,
       // which avoids costly copies and allocations.
       Domain* current_state = &m_entry_states[head];
       Domain new_state;
-      compute_entry_state(context, head, &new_state);
+      compute_entry_state(context->get_initial_value(), head, &new_state);
       if (new_state.leq(*current_state)) {
         // At this point we know that the monotonic iteration sequence has
         // converged and current_state is a post-fixpoint. However, since all
@@ -264,16 +546,32 @@ class MonotonicFixpointIterator
         // it's better to use it as the final result of the iteration sequence.
         *current_state = std::move(new_state);
         iterate = false;
+      } else if (m_policy.iteration_budget != 0 &&
+                 context->m_stats.iterations >= m_policy.iteration_budget) {
+        // Top is a post-fixpoint, so the next iteration is the last one, and
+        // it refines Top as above.
+        context->m_stats.budget_exhausted = true;
+        current_state->set_to_top();
       } else {
         extrapolate(*context, head, current_state, new_state);
       }
     }
   }
 
+  using StateTable = fp_impl::NodeTable<GraphInterface, Domain, NodeHash>;
+
   const Graph& m_graph;
-  WeakTopologicalOrdering<NodeId, NodeHash> m_wto;
-  std::unordered_map<NodeId, Domain, NodeHash> m_entry_states;
-  std::unordered_map<NodeId, Domain, NodeHash> m_exit_states;
+  std::shared_ptr<const WeakTopologicalOrdering<NodeId, NodeHash>> m_wto;
+  StateTable m_entry_states;
+  StateTable m_exit_states;
+  const bool m_entry_states_at_heads_only;
+  // Only kept with m_entry_states_at_heads_only.
+  Domain m_init;
+  WideningPolicy<Domain> m_policy;
+  FixpointIterationStats m_stats;
+
+  template <typename T1, typename T2, typename T3>
+  friend class ParallelMonotonicFixpointIterator;
 };
 
 /*
@@ -316,6 +614,28 @@ class BackwardsFixpointIterationAdaptor {
   static NodeId target(const Graph& graph, const EdgeId& edge) {
     return GraphInterface::source(graph, edge);
   }
+
+  // Only available if the original CFG provides them.
+  template <typename GI = GraphInterface>
+  static auto wto(const Graph& graph) -> decltype(GI::reverse_wto(graph)) {
+    return GI::reverse_wto(graph);
+  }
+  template <typename GI = GraphInterface>
+  static auto reverse_wto(const Graph& graph) -> decltype(GI::wto(graph)) {
+    return GI::wto(graph);
+  }
+
+  // Only available if the original CFG numbers its nodes densely.
+  template <typename GI = GraphInterface>
+  static auto node_index(const Graph& graph, const NodeId& node)
+      -> decltype(GI::node_index(graph, node)) {
+    return GI::node_index(graph, node);
+  }
+  template <typename GI = GraphInterface>
+  static auto node_index_bound(const Graph& graph)
+      -> decltype(GI::node_index_bound(graph)) {
+    return GI::node_index_bound(graph);
+  }
 };
 
 } // namespace sparta
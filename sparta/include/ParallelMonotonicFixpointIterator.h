@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "MonotonicFixpointIterator.h"
+#include "WeakTopologicalOrdering.h"
+
+namespace sparta {
+
+/*
+ * A MonotonicFixpointIterator that analyzes independent components of the
+ * weak topological ordering at the same time, on a pool of threads.
+ *
+ * The toplevel components of the WTO form a DAG: a component depends on the
+ * components that hold the predecessors of its nodes. A component is handed
+ * to a worker as soon as all the components it depends on are done, and
+ * each component is iterated to its local fixpoint by a single worker, with
+ * the usual recursive strategy. Since a component only ever reads the final
+ * exit states of the components it depends on, the results are exactly
+ * those of the sequential iterator, whatever the schedule.
+ *
+ * This pays off on graphs with many components side by side, like the call
+ * graphs of interprocedural analyses, where every SCC is a component. The
+ * node and edge transformers, as well as extrapolate(), are called
+ * concurrently and must be thread-safe. Each worker has its own context, so
+ * the iteration counts that extrapolate() sees are those of the current
+ * component.
+ */
+template <typename GraphInterface, typename Domain, typename NodeHash>
+class ParallelMonotonicFixpointIterator
+    : public MonotonicFixpointIterator<GraphInterface, Domain, NodeHash> {
+ public:
+  using Base = MonotonicFixpointIterator<GraphInterface, Domain, NodeHash>;
+  using Graph = typename GraphInterface::Graph;
+  using NodeId = typename GraphInterface::NodeId;
+  using Context = typename Base::Context;
+
+  /*
+   * With `num_threads` at zero, uses as many threads as there are cores.
+   */
+  explicit ParallelMonotonicFixpointIterator(
+      const Graph& graph,
+      size_t num_threads = 0,
+      size_t cfg_size_hint = 4,
+      bool entry_states_at_heads_only = false)
+      : Base(graph, cfg_size_hint, entry_states_at_heads_only),
+        m_num_threads(num_threads != 0
+                          ? num_threads
+                          : std::max(1u, std::thread::hardware_concurrency())) {
+  }
+
+  /*
+   * Same as MonotonicFixpointIterator::run(). If a transformer throws, no new
+   * component is started, and the first exception is rethrown once the
+   * running ones are done.
+   */
+  void run(const Domain& init) {
+    this->clear();
+    if (this->m_entry_states_at_heads_only) {
+      this->m_init = init;
+    }
+    std::vector<const WtoComponent<NodeId>*> components;
+    for (const auto& component : *this->m_wto) {
+      components.push_back(&component);
+    }
+    if (m_num_threads == 1 || components.size() <= 1) {
+      Context context(this->m_graph, init);
+      for (const auto* component : components) {
+        this->analyze_component(&context, *component);
+      }
+      this->m_stats = context.get_stats();
+      return;
+    }
+
+    // Every state the workers touch is created up front, so that the tables
+    // are only read concurrently. An exit state of _|_ is the same as none.
+    std::unordered_map<NodeId, size_t, NodeHash> component_of;
+    for (size_t i = 0; i < components.size(); ++i) {
+      visit_nodes(*components[i], [&](const NodeId& node, bool is_head) {
+        component_of.emplace(node, i);
+        this->m_exit_states[node] = Domain::bottom();
+        if (is_head || !this->m_entry_states_at_heads_only) {
+          this->m_entry_states[node];
+        }
+      });
+    }
+
+    std::vector<std::vector<size_t>> dependents(components.size());
+    std::vector<size_t> pending(components.size(), 0);
+    for (size_t i = 0; i < components.size(); ++i) {
+      std::vector<size_t> deps;
+      visit_nodes(*components[i], [&](const NodeId& node, bool) {
+        for (const auto& edge :
+             GraphInterface::predecessors(this->m_graph, node)) {
+          auto it = component_of.find(
+              GraphInterface::source(this->m_graph, edge));
+          // Unreachable predecessors belong to no component.
+          if (it != component_of.end() && it->second != i) {
+            deps.push_back(it->second);
+          }
+        }
+      });
+      std::sort(deps.begin(), deps.end());
+      deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+      pending[i] = deps.size();
+      for (auto dep : deps) {
+        dependents[dep].push_back(i);
+      }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready_or_done;
+    std::deque<size_t> ready;
+    size_t remaining = components.size();
+    std::exception_ptr failure;
+    for (size_t i = 0; i < components.size(); ++i) {
+      if (pending[i] == 0) {
+        ready.push_back(i);
+      }
+    }
+
+    auto worker = [&]() {
+      Context context(this->m_graph, init);
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        ready_or_done.wait(lock, [&] {
+          return !ready.empty() || remaining == 0 || failure;
+        });
+        if (remaining == 0 || failure) {
+          this->m_stats.merge(context.get_stats());
+          return;
+        }
+        size_t i = ready.front();
+        ready.pop_front();
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+          this->analyze_component(&context, *components[i]);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        lock.lock();
+        if (error) {
+          if (!failure) {
+            failure = error;
+          }
+          this->m_stats.merge(context.get_stats());
+          ready_or_done.notify_all();
+          return;
+        }
+        --remaining;
+        for (auto dependent : dependents[i]) {
+          if (--pending[dependent] == 0) {
+            ready.push_back(dependent);
+          }
+        }
+        ready_or_done.notify_all();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    size_t num_threads = std::min(m_num_threads, components.size());
+    for (size_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+  }
+
+ private:
+  static void visit_nodes(
+      const WtoComponent<NodeId>& component,
+      const std::function<void(const NodeId&, bool)>& visitor) {
+    if (component.is_vertex()) {
+      visitor(component.head_node(), /* is_head */ false);
+      return;
+    }
+    visitor(component.head_node(), /* is_head */ true);
+    for (const auto& subcomponent : component) {
+      visit_nodes(subcomponent, visitor);
+    }
+  }
+
+  const size_t m_num_threads;
+};
+
+} // namespace sparta
@@ -18,7 +18,10 @@
 #include <type_traits>
 #include <utility>
 
+#include <boost/functional/hash.hpp>
+
 #include "AbstractDomain.h"
+#include "PatriciaTreeNode.h"
 #include "PatriciaTreeUtil.h"
 
 // Forward declarations
@@ -57,51 +60,51 @@ using MappingFunction = std::function<Value(const Value&)>;
 template <typename IntegerType, typename Value>
 inline const typename Value::type* find_value(
     IntegerType key,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree);
 
 template <typename IntegerType, typename Value>
-inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1,
-                const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree2);
+inline bool leq(const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree1,
+                const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree2);
 
 template <typename IntegerType, typename Value>
 inline bool equals(
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree2);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree1,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree2);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
     const CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> update(
     const CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> map(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> map(
     const MappingFunction<typename Value::type>& f,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> erase_all_matching(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> erase_all_matching(
     IntegerType key_mask,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> merge(
     const CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& t);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> intersect(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t);
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& t);
 
 template <typename T>
 T snd(const T&, const T& second) {
@@ -379,7 +382,7 @@ class PatriciaTreeMap final {
     return x;
   }
 
-  std::shared_ptr<ptmap_impl::PatriciaTree<IntegerType, Value>> m_tree;
+  pt_util::NodePtr<ptmap_impl::PatriciaTree<IntegerType, Value>> m_tree;
 
   template <typename T, typename VT, typename V>
   friend std::ostream& ::operator<<(std::ostream&,
@@ -415,7 +418,7 @@ namespace ptmap_impl {
 using namespace pt_util;
 
 template <typename IntegerType, typename Value>
-class PatriciaTree {
+class PatriciaTree : public RefCountedNode {
  public:
   // A Patricia tree is an immutable structure.
   PatriciaTree& operator=(const PatriciaTree& other) = delete;
@@ -439,32 +442,34 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType, Value> {
   PatriciaTreeBranch(
       IntegerType prefix,
       IntegerType branching_bit,
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& left_tree,
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& right_tree)
+      const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& left_tree,
+      const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& right_tree)
       : m_prefix(prefix),
         m_stacking_bit(branching_bit),
         m_left_tree(left_tree),
         m_right_tree(right_tree) {}
 
+  ~PatriciaTreeBranch() override;
+
   bool is_leaf() const override { return false; }
 
   IntegerType prefix() const { return m_prefix; }
 
   IntegerType branching_bit() const { return m_stacking_bit; }
 
-  const std::shared_ptr<PatriciaTree<IntegerType, Value>>& left_tree() const {
+  const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& left_tree() const {
     return m_left_tree;
   }
 
-  const std::shared_ptr<PatriciaTree<IntegerType, Value>>& right_tree() const {
+  const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& right_tree() const {
     return m_right_tree;
   }
 
  private:
   IntegerType m_prefix;
   IntegerType m_stacking_bit;
-  std::shared_ptr<PatriciaTree<IntegerType, Value>> m_left_tree;
-  std::shared_ptr<PatriciaTree<IntegerType, Value>> m_right_tree;
+  pt_util::NodePtr<PatriciaTree<IntegerType, Value>> m_left_tree;
+  pt_util::NodePtr<PatriciaTree<IntegerType, Value>> m_right_tree;
 };
 
 template <typename IntegerType, typename Value>
@@ -475,6 +480,8 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType, Value> {
   explicit PatriciaTreeLeaf(IntegerType key, const mapped_type& value)
       : m_pair(key, value) {}
 
+  ~PatriciaTreeLeaf() override;
+
   bool is_leaf() const override { return true; }
 
   const IntegerType& key() const { return m_pair.first; }
@@ -488,18 +495,124 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType, Value> {
   friend class ptmap_impl::PatriciaTreeIterator;
 };
 
+// Hash-consed nodes are looked up by their own fields and the addresses of
+// their children, which are hash-consed already. Abstract values have no hash
+// function, so leaves are hashed by key only and told apart by
+// Value::equals().
+template <typename IntegerType, typename Value>
+struct HashConsHash {
+  size_t operator()(const PatriciaTree<IntegerType, Value>* tree) const {
+    size_t seed = 0;
+    if (tree->is_leaf()) {
+      boost::hash_combine(
+          seed,
+          static_cast<const PatriciaTreeLeaf<IntegerType, Value>*>(tree)
+              ->key());
+      return seed;
+    }
+    const auto* branch =
+        static_cast<const PatriciaTreeBranch<IntegerType, Value>*>(tree);
+    boost::hash_combine(seed, branch->prefix());
+    boost::hash_combine(seed, branch->branching_bit());
+    boost::hash_combine(seed, branch->left_tree().get());
+    boost::hash_combine(seed, branch->right_tree().get());
+    return seed;
+  }
+};
+
+template <typename IntegerType, typename Value>
+struct HashConsEqual {
+  bool operator()(const PatriciaTree<IntegerType, Value>* tree1,
+                  const PatriciaTree<IntegerType, Value>* tree2) const {
+    if (tree1->is_leaf() != tree2->is_leaf()) {
+      return false;
+    }
+    if (tree1->is_leaf()) {
+      const auto* leaf1 =
+          static_cast<const PatriciaTreeLeaf<IntegerType, Value>*>(tree1);
+      const auto* leaf2 =
+          static_cast<const PatriciaTreeLeaf<IntegerType, Value>*>(tree2);
+      return leaf1->key() == leaf2->key() &&
+             Value::equals(leaf1->value(), leaf2->value());
+    }
+    const auto* branch1 =
+        static_cast<const PatriciaTreeBranch<IntegerType, Value>*>(tree1);
+    const auto* branch2 =
+        static_cast<const PatriciaTreeBranch<IntegerType, Value>*>(tree2);
+    return branch1->prefix() == branch2->prefix() &&
+           branch1->branching_bit() == branch2->branching_bit() &&
+           branch1->left_tree() == branch2->left_tree() &&
+           branch1->right_tree() == branch2->right_tree();
+  }
+};
+
+template <typename IntegerType, typename Value>
+using HashConsTableFor = HashConsTable<PatriciaTree<IntegerType, Value>,
+                                       HashConsHash<IntegerType, Value>,
+                                       HashConsEqual<IntegerType, Value>>;
+
+template <typename IntegerType, typename Value>
+using MemoFor = OperationMemo<PatriciaTree<IntegerType, Value>>;
+
+// The operations that are memoized on hash-consed trees. Joins and meets
+// are not: their combining functions are arbitrary closures.
+enum MemoizedOperation { kLeq };
+
+template <typename IntegerType, typename Value>
+PatriciaTreeBranch<IntegerType, Value>::~PatriciaTreeBranch() {
+  if (this->is_hash_consed()) {
+    HashConsTableFor<IntegerType, Value>::instance().erase(this);
+  }
+}
+
+template <typename IntegerType, typename Value>
+PatriciaTreeLeaf<IntegerType, Value>::~PatriciaTreeLeaf() {
+  if (this->is_hash_consed()) {
+    HashConsTableFor<IntegerType, Value>::instance().erase(this);
+  }
+}
+
+// The nodes of Patricia trees are built by the two functions below, which
+// hash-cons them inside a HashConsedPatriciaTrees scope.
+template <typename IntegerType, typename Value>
+pt_util::NodePtr<PatriciaTree<IntegerType, Value>> make_leaf_node(
+    IntegerType key, const typename Value::type& value) {
+  pt_util::NodePtr<PatriciaTree<IntegerType, Value>> leaf =
+      pt_util::make_node<PatriciaTreeLeaf<IntegerType, Value>>(key, value);
+  if (!HashConsedPatriciaTrees::active()) {
+    return leaf;
+  }
+  return HashConsTableFor<IntegerType, Value>::instance().intern(leaf);
+}
+
+template <typename IntegerType, typename Value>
+pt_util::NodePtr<PatriciaTree<IntegerType, Value>> make_branch_node(
+    IntegerType prefix,
+    IntegerType branching_bit,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& left_tree,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& right_tree) {
+  pt_util::NodePtr<PatriciaTree<IntegerType, Value>> branch =
+      pt_util::make_node<PatriciaTreeBranch<IntegerType, Value>>(
+          prefix, branching_bit, left_tree, right_tree);
+  if (!HashConsedPatriciaTrees::active() || !left_tree->is_hash_consed() ||
+      !right_tree->is_hash_consed()) {
+    return branch;
+  }
+  return HashConsTableFor<IntegerType, Value>::instance().intern(branch);
+}
+
 template <typename IntegerType, typename Value>
-std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
+pt_util::NodePtr<PatriciaTree<IntegerType, Value>> join(
     IntegerType prefix0,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree0,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree0,
     IntegerType prefix1,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return make_branch_node<IntegerType, Value>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return make_branch_node<IntegerType, Value>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -507,18 +620,18 @@ std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
 // This function is used to prevent the creation of branch nodes with only one
 // child.
 template <typename IntegerType, typename Value>
-std::shared_ptr<PatriciaTree<IntegerType, Value>> make_branch(
+pt_util::NodePtr<PatriciaTree<IntegerType, Value>> make_branch(
     IntegerType prefix,
     IntegerType branching_bit,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& left_tree,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& right_tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& left_tree,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& right_tree) {
   if (left_tree == nullptr) {
     return right_tree;
   }
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+  return make_branch_node<IntegerType, Value>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
@@ -527,20 +640,20 @@ std::shared_ptr<PatriciaTree<IntegerType, Value>> make_branch(
 template <typename IntegerType, typename Value>
 inline const typename Value::type* find_value(
     IntegerType key,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
     if (key == leaf->key()) {
       return &leaf->value();
     }
     return nullptr;
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
   if (is_zero_bit(key, branch->branching_bit())) {
     return find_value(key, branch->left_tree());
   } else {
@@ -549,33 +662,23 @@ inline const typename Value::type* find_value(
 }
 
 template <typename IntegerType, typename Value>
-inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-                const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
-  if (s == t) {
-    // This condition allows the leq operation to run in sublinear time when
-    // comparing Patricia trees that share some structure.
-    return true;
-  }
-  if (s == nullptr) {
-    return !Value::default_value().is_top();
-  }
-  if (t == nullptr) {
-    return Value::default_value().is_top();
-  }
+inline bool leq_nodes(
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& t) {
   if (s->is_leaf()) {
     if (t->is_branch()) {
       return !Value::default_value().is_top();
     }
     const auto& s_leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
     const auto& t_leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     return s_leaf->key() == t_leaf->key() &&
            Value::leq(s_leaf->value(), t_leaf->value());
   }
   if (t->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     auto* s_value = find_value(leaf->key(), s);
     if (s_value == nullptr) {
       return Value::leq(Value::default_value(), leaf->value());
@@ -583,9 +686,9 @@ inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
     return Value::leq(*s_value, leaf->value());
   }
   const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
   const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -605,12 +708,33 @@ inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
   return !Value::default_value().is_top();
 }
 
+template <typename IntegerType, typename Value>
+inline bool leq(const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& s,
+                const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& t) {
+  if (s == t) {
+    // This condition allows the leq operation to run in sublinear time when
+    // comparing Patricia trees that share some structure.
+    return true;
+  }
+  if (s == nullptr) {
+    return !Value::default_value().is_top();
+  }
+  if (t == nullptr) {
+    return Value::default_value().is_top();
+  }
+  using Memo = MemoFor<IntegerType, Value>;
+  if (Memo::applies(s, t)) {
+    return Memo::local().memoize(kLeq, s, t, [&] { return leq_nodes(s, t); });
+  }
+  return leq_nodes(s, t);
+}
+
 // A Patricia tree is a canonical representation of the set of keys it contains.
 // Hence, set equality is equivalent to structural equality of Patricia trees.
 template <typename IntegerType, typename Value>
 inline bool equals(
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree2) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree1,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree2) {
   if (tree1 == tree2) {
     // This conditions allows the equality test to run in sublinear time when
     // comparing Patricia trees that share some structure.
@@ -622,14 +746,18 @@ inline bool equals(
   if (tree2 == nullptr) {
     return false;
   }
+  if (tree1->is_hash_consed() && tree2->is_hash_consed()) {
+    // Distinct hash-consed trees are never equal.
+    return false;
+  }
   if (tree1->is_leaf()) {
     if (tree2->is_branch()) {
       return false;
     }
     const auto& leaf1 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree1);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree1);
     const auto& leaf2 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree2);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree2);
     return leaf1->key() == leaf2->key() &&
            Value::equals(leaf1->value(), leaf2->value());
   }
@@ -637,9 +765,9 @@ inline bool equals(
     return false;
   }
   const auto& branch1 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree1);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree1);
   const auto& branch2 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree2);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree2);
   return branch1->prefix() == branch2->prefix() &&
          branch1->branching_bit() == branch2->branching_bit() &&
          equals(branch1->left_tree(), branch2->left_tree()) &&
@@ -650,17 +778,17 @@ inline bool equals(
 // value with combine(bound_value, :value). Note that the existing value is
 // always the first parameter to :combine and the new value is the second.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> update(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
   if (tree == nullptr) {
     return combine_new_leaf<IntegerType, Value>(combine, key, value);
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
     if (key == leaf->key()) {
       return combine_leaf(combine, value, leaf);
     }
@@ -671,7 +799,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
     return join<IntegerType, Value>(key, new_leaf, leaf->key(), leaf);
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
   if (match_prefix(key, branch->prefix(), branch->branching_bit())) {
     if (is_zero_bit(key, branch->branching_bit())) {
       auto new_left_tree = update(combine, key, value, branch->left_tree());
@@ -702,20 +830,20 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
 
 // Maps all entries with non-default values, applying a given function.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> map(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> map(
     const MappingFunction<typename Value::type>& f,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
     auto new_value = f(leaf->value());
     return combine_leaf(ptmap_impl::snd<typename Value::type>, new_value, leaf);
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
   auto new_left_tree = map(f, branch->left_tree());
   auto new_right_tree = map(f, branch->right_tree());
   if (new_left_tree == branch->left_tree() &&
@@ -730,22 +858,22 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> map(
 
 // Erases all entries where keys and :key_mask share common bits.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> erase_all_matching(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> erase_all_matching(
     IntegerType key_mask,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
     if (key_mask & leaf->key()) {
       return nullptr;
     }
     return tree;
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
   if (key_mask & branch->prefix()) {
     return nullptr;
   }
@@ -767,10 +895,10 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> erase_all_matching(
 // We keep the notations of the paper so as to make the implementation easier
 // to follow.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> merge(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& t) {
   if (s == t) {
     // This conditional is what allows the union operation to complete in
     // sublinear time when the operands share some structure.
@@ -784,18 +912,18 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
   }
   if (s->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
     return update(combine, leaf->key(), leaf->value(), t);
   }
   if (t->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     return update(combine, leaf->key(), leaf->value(), s);
   }
   const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
   const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -814,7 +942,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return make_branch_node<IntegerType, Value>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -824,14 +952,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_branch_node<IntegerType, Value>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(combine, s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_branch_node<IntegerType, Value>(
           p, m, s0, new_right);
     }
   }
@@ -842,14 +970,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_branch_node<IntegerType, Value>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(combine, s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_branch_node<IntegerType, Value>(
           q, n, t0, new_right);
     }
   }
@@ -859,37 +987,36 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
 
 // Combine :value with the value in :leaf.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_leaf(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> combine_leaf(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     const typename Value::type& value,
-    const std::shared_ptr<PatriciaTreeLeaf<IntegerType, Value>>& leaf) {
+    PatriciaTreeLeaf<IntegerType, Value>* leaf) {
   auto combined_value = combine(leaf->value(), value);
   if (Value::is_default_value(combined_value)) {
     return nullptr;
   }
   if (!Value::equals(combined_value, leaf->value())) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
-        leaf->key(), combined_value);
+    return make_leaf_node<IntegerType, Value>(leaf->key(), combined_value);
   }
   return leaf;
 }
 
 // Create a new leaf with a Top value and combine :value into it.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value) {
-  auto new_leaf = std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
+  auto new_leaf = pt_util::make_node<PatriciaTreeLeaf<IntegerType, Value>>(
       key, Value::default_value());
-  return combine_leaf(combine, value, new_leaf);
+  return combine_leaf(combine, value, new_leaf.get());
 }
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
+inline pt_util::NodePtr<PatriciaTree<IntegerType, Value>> intersect(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& t) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
@@ -900,7 +1027,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
   }
   if (s->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
     auto* value = find_value(leaf->key(), t);
     if (value == nullptr) {
       return nullptr;
@@ -909,7 +1036,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
   }
   if (t->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     auto* value = find_value(leaf->key(), s);
     if (value == nullptr) {
       return nullptr;
@@ -917,9 +1044,9 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
     return combine_leaf(combine, *value, leaf);
   }
   const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
   const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -981,7 +1108,7 @@ class PatriciaTreeIterator final {
   PatriciaTreeIterator() {}
 
   explicit PatriciaTreeIterator(
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+      const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
     if (tree == nullptr) {
       return;
     }
@@ -1032,24 +1159,24 @@ class PatriciaTreeIterator final {
  private:
   // The argument is never null.
   void go_to_next_leaf(
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+      const pt_util::NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
     auto t = tree;
     // We go to the leftmost leaf, storing the branches that we're traversing
     // on the stack. By definition of a Patricia tree, a branch node always
     // has two children, hence the leftmost leaf always exists.
     while (t->is_branch()) {
       auto branch =
-          std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+          pt_util::node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
       m_stack.push(branch);
       t = branch->left_tree();
       // A branch node always has two children.
       RUNTIME_CHECK(t != nullptr, internal_error());
     }
-    m_leaf = std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+    m_leaf = pt_util::node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
   }
 
-  std::stack<std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>>> m_stack;
-  std::shared_ptr<PatriciaTreeLeaf<IntegerType, Value>> m_leaf;
+  std::stack<pt_util::NodePtr<PatriciaTreeBranch<IntegerType, Value>>> m_stack;
+  pt_util::NodePtr<PatriciaTreeLeaf<IntegerType, Value>> m_leaf;
 };
 
 } // namespace ptmap_impl
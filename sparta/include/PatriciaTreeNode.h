@@ -0,0 +1,550 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace sparta {
+
+/*
+ * While an object of this class is alive on a thread, the Patricia tree nodes
+ * that the thread creates update their reference counts with plain loads and
+ * stores instead of atomic read-modify-writes, for as long as they live.
+ *
+ * This is only safe for analyses that never let those nodes escape the
+ * thread: no set, map or abstract environment built inside the scope may be
+ * copied, assigned or destroyed by another thread, even after the scope ends.
+ * Nodes built outside the scope, including those shared by trees built inside
+ * it, keep their atomic counts.
+ */
+class ThreadConfinedPatriciaTrees final {
+ public:
+  ThreadConfinedPatriciaTrees() { ++depth(); }
+  ~ThreadConfinedPatriciaTrees() { --depth(); }
+
+  ThreadConfinedPatriciaTrees(const ThreadConfinedPatriciaTrees&) = delete;
+  ThreadConfinedPatriciaTrees& operator=(const ThreadConfinedPatriciaTrees&) =
+      delete;
+
+  static bool active() { return depth() > 0; }
+
+ private:
+  static size_t& depth() {
+    static thread_local size_t depth = 0;
+    return depth;
+  }
+};
+
+/*
+ * While an object of this class is alive on a thread, the Patricia trees that
+ * the thread builds are hash-consed: structurally equal subtrees are the same
+ * node, process-wide. Comparing two hash-consed trees for equality is then a
+ * pointer comparison, and unions, intersections, differences and inclusion
+ * tests over them are memoized in a bounded per-thread table, which is
+ * emptied when the outermost scope ends.
+ *
+ * Only trees built entirely inside such scopes get these benefits; a node is
+ * hash-consed only if its children are. Building a node costs a lookup in a
+ * locked table, so this pays off for fixpoint iterations that compare and
+ * join the same environments over and over.
+ */
+class HashConsedPatriciaTrees final {
+ public:
+  HashConsedPatriciaTrees() { ++local().depth; }
+  ~HashConsedPatriciaTrees() {
+    auto& state = local();
+    if (--state.depth == 0) {
+      for (auto& clear : state.memo_clearers) {
+        clear();
+      }
+    }
+  }
+
+  HashConsedPatriciaTrees(const HashConsedPatriciaTrees&) = delete;
+  HashConsedPatriciaTrees& operator=(const HashConsedPatriciaTrees&) = delete;
+
+  static bool active() { return local().depth > 0; }
+
+  // Registers a function that empties one of this thread's memo tables.
+  static void on_scope_exit(std::function<void()> clear) {
+    local().memo_clearers.push_back(std::move(clear));
+  }
+
+ private:
+  struct State {
+    size_t depth{0};
+    std::vector<std::function<void()>> memo_clearers;
+  };
+
+  static State& local() {
+    static thread_local State state;
+    return state;
+  }
+};
+
+namespace pt_util {
+
+/*
+ * Per-thread caches of freed tree nodes, one per 16-byte size class. Nodes
+ * are allocated one by one with the global operator new, so a node freed on
+ * another thread than the one that created it simply goes to that thread's
+ * cache, and caches beyond a fixed size spill back to the global allocator.
+ *
+ * Building with SPARTA_DISABLE_NODE_POOLS sends every node straight to the
+ * global operators, so that ASAN and valgrind track each of them.
+ */
+class NodeAllocator final {
+ public:
+  static void* allocate(size_t size) {
+#ifndef SPARTA_DISABLE_NODE_POOLS
+    if (size <= kMaxPooledSize) {
+      auto& cache = t_cache();
+      auto& list = cache.lists[size_class(size)];
+      if (list.head != nullptr) {
+        FreeNode* node = list.head;
+        list.head = node->next;
+        --list.count;
+        return node;
+      }
+      if (!cache.dead) {
+        cache.touch();
+      }
+      return ::operator new(class_size(size_class(size)));
+    }
+#endif
+    return ::operator new(size);
+  }
+
+  static void deallocate(void* p, size_t size) {
+#ifndef SPARTA_DISABLE_NODE_POOLS
+    if (size <= kMaxPooledSize) {
+      auto& cache = t_cache();
+      auto& list = cache.lists[size_class(size)];
+      if (!cache.dead && list.count < kMaxCachedPerClass) {
+        auto node = static_cast<FreeNode*>(p);
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+        cache.touch();
+        return;
+      }
+    }
+#endif
+    ::operator delete(p);
+  }
+
+ private:
+  static constexpr size_t kGranularity = 16;
+  static constexpr size_t kMaxPooledSize = 256;
+  static constexpr size_t kNumClasses = kMaxPooledSize / kGranularity;
+  static constexpr size_t kMaxCachedPerClass = 4096;
+
+  static size_t size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / kGranularity;
+  }
+  static size_t class_size(size_t cls) { return (cls + 1) * kGranularity; }
+
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  struct FreeList {
+    FreeNode* head;
+    size_t count;
+  };
+
+  // Trivially destructible, so that it stays usable while other thread-local
+  // destructors run; the Reaper empties it when the thread exits.
+  struct Cache {
+    FreeList lists[kNumClasses];
+    bool dead;
+
+    void touch() {
+      static thread_local Reaper reaper;
+      (void)reaper;
+    }
+  };
+
+  struct Reaper {
+    ~Reaper() {
+      auto& cache = t_cache();
+      for (auto& list : cache.lists) {
+        while (list.head != nullptr) {
+          FreeNode* next = list.head->next;
+          ::operator delete(list.head);
+          list.head = next;
+        }
+        list.count = 0;
+      }
+      cache.dead = true;
+    }
+  };
+
+  static Cache& t_cache() {
+    static thread_local Cache cache{};
+    return cache;
+  }
+};
+
+/*
+ * The base of every Patricia tree node: an intrusive reference count, plus
+ * class-specific allocation through NodeAllocator.
+ */
+class RefCountedNode {
+ public:
+  RefCountedNode() : m_confined(ThreadConfinedPatriciaTrees::active()) {}
+
+  RefCountedNode(const RefCountedNode&) = delete;
+  RefCountedNode& operator=(const RefCountedNode&) = delete;
+
+  static void* operator new(size_t size) {
+    return NodeAllocator::allocate(size);
+  }
+
+  static void operator delete(void* p, size_t size) {
+    NodeAllocator::deallocate(p, size);
+  }
+
+  void add_ref() const {
+    if (m_confined) {
+      m_refs.store(m_refs.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+    } else {
+      m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns true if that was the last reference.
+  bool release_ref() const {
+    if (m_hash_consed) {
+      // HashConsTable::intern() must see the count drop to zero.
+      return m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+    auto refs = m_refs.load(std::memory_order_acquire);
+    if (refs == 1) {
+      // We hold the only reference, so nobody can be taking another one.
+      return true;
+    }
+    if (m_confined) {
+      m_refs.store(refs - 1, std::memory_order_relaxed);
+      return false;
+    }
+    return m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  // Fails if the node is already on its way to being destroyed.
+  bool try_add_ref() const {
+    auto refs = m_refs.load(std::memory_order_relaxed);
+    while (refs != 0) {
+      if (m_refs.compare_exchange_weak(refs, refs + 1,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool is_hash_consed() const { return m_hash_consed; }
+
+  // Only before the node is published: it may be reached from any thread
+  // afterwards, so it also stops being thread-confined.
+  void mark_hash_consed() {
+    m_hash_consed = true;
+    m_confined = false;
+  }
+
+ private:
+  mutable std::atomic<uint32_t> m_refs{0};
+  bool m_confined;
+  bool m_hash_consed{false};
+};
+
+/*
+ * A smart pointer to a tree node, with the part of the std::shared_ptr
+ * interface that the trees use. The count lives in the node, so a NodePtr
+ * can be rebuilt from a raw pointer at any time.
+ */
+template <typename T>
+class NodePtr final {
+ public:
+  NodePtr() = default;
+  NodePtr(std::nullptr_t) {}
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+  NodePtr(U* p) : m_ptr(p) {
+    if (m_ptr != nullptr) {
+      m_ptr->add_ref();
+    }
+  }
+
+  NodePtr(const NodePtr& other) : NodePtr(other.m_ptr) {}
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+  NodePtr(const NodePtr<U>& other) : NodePtr(other.get()) {}
+
+  NodePtr(NodePtr&& other) noexcept : m_ptr(other.m_ptr) {
+    other.m_ptr = nullptr;
+  }
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+  NodePtr(NodePtr<U>&& other) noexcept : m_ptr(other.release()) {}
+
+  ~NodePtr() { reset(); }
+
+  NodePtr& operator=(const NodePtr& other) {
+    NodePtr(other).swap(*this);
+    return *this;
+  }
+
+  NodePtr& operator=(NodePtr&& other) noexcept {
+    NodePtr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  NodePtr& operator=(std::nullptr_t) {
+    reset();
+    return *this;
+  }
+
+  void reset() {
+    if (m_ptr != nullptr && m_ptr->release_ref()) {
+      delete m_ptr;
+    }
+    m_ptr = nullptr;
+  }
+
+  void swap(NodePtr& other) noexcept { std::swap(m_ptr, other.m_ptr); }
+
+  T* get() const { return m_ptr; }
+  T* operator->() const { return m_ptr; }
+  T& operator*() const { return *m_ptr; }
+  explicit operator bool() const { return m_ptr != nullptr; }
+
+  // Takes over a reference that the caller already holds.
+  static NodePtr adopt(T* p) {
+    NodePtr ptr;
+    ptr.m_ptr = p;
+    return ptr;
+  }
+
+  // Gives up ownership without touching the count.
+  T* release() {
+    T* p = m_ptr;
+    m_ptr = nullptr;
+    return p;
+  }
+
+  friend bool operator==(const NodePtr& a, const NodePtr& b) {
+    return a.m_ptr == b.m_ptr;
+  }
+  friend bool operator!=(const NodePtr& a, const NodePtr& b) {
+    return a.m_ptr != b.m_ptr;
+  }
+  friend bool operator==(const NodePtr& a, std::nullptr_t) {
+    return a.m_ptr == nullptr;
+  }
+  friend bool operator!=(const NodePtr& a, std::nullptr_t) {
+    return a.m_ptr != nullptr;
+  }
+  friend bool operator==(std::nullptr_t, const NodePtr& b) {
+    return b.m_ptr == nullptr;
+  }
+  friend bool operator!=(std::nullptr_t, const NodePtr& b) {
+    return b.m_ptr != nullptr;
+  }
+
+ private:
+  T* m_ptr{nullptr};
+};
+
+template <typename T, typename... Args>
+NodePtr<T> make_node(Args&&... args) {
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "Tree nodes cannot be over-aligned");
+  return NodePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+/*
+ * The process-wide table of hash-consed nodes of one type. It only holds weak
+ * references: a node takes itself out when it dies. `Hash` and `Equal` look
+ * at a node's own fields and at the addresses of its children, which are
+ * hash-consed already.
+ */
+template <typename Node, typename Hash, typename Equal>
+class HashConsTable final {
+ public:
+  static HashConsTable& instance() {
+    // Leaked on purpose: nodes may die while static destructors run.
+    static auto* table = new HashConsTable();
+    return *table;
+  }
+
+  // Returns the hash-consed node equal to `node`. If there is none yet,
+  // `node` becomes it.
+  NodePtr<Node> intern(const NodePtr<Node>& node) {
+    auto& shard = m_shards[Hash()(node.get()) % kNumShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.nodes.find(node.get());
+    if (it != shard.nodes.end()) {
+      if ((*it)->try_add_ref()) {
+        return NodePtr<Node>::adopt(*it);
+      }
+      // That node is about to be destroyed; take its place.
+      shard.nodes.erase(it);
+    }
+    node->mark_hash_consed();
+    shard.nodes.insert(node.get());
+    return node;
+  }
+
+  void erase(const Node* node) {
+    auto& shard = m_shards[Hash()(node) % kNumShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.nodes.find(const_cast<Node*>(node));
+    if (it != shard.nodes.end() && *it == node) {
+      shard.nodes.erase(it);
+    }
+  }
+
+ private:
+  static constexpr size_t kNumShards = 16;
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_set<Node*, Hash, Equal> nodes;
+  };
+
+  Shard m_shards[kNumShards];
+};
+
+/*
+ * A bounded, direct-mapped, per-thread cache of the results of binary
+ * operations on hash-consed trees, keyed by operand addresses. Entries hold
+ * on to their operands, so that an address is never reused while it is in
+ * the cache. Emptied when the outermost HashConsedPatriciaTrees scope ends.
+ */
+template <typename Tree>
+class OperationMemo final {
+ public:
+  static OperationMemo& local() {
+    static thread_local OperationMemo memo;
+    return memo;
+  }
+
+  // Whether to consult the memo for an operation on `a` and `b`.
+  static bool applies(const NodePtr<Tree>& a, const NodePtr<Tree>& b) {
+    return a->is_hash_consed() && b->is_hash_consed() &&
+           HashConsedPatriciaTrees::active();
+  }
+
+  // Returns the memoized result of `compute()`, which is either a tree or a
+  // predicate on `a` and `b`.
+  template <typename Compute>
+  auto memoize(int op,
+               const NodePtr<Tree>& a,
+               const NodePtr<Tree>& b,
+               const Compute& compute) -> decltype(compute()) {
+    decltype(compute()) result;
+    if (find(op, a.get(), b.get(), &result)) {
+      return result;
+    }
+    result = compute();
+    store(op, a, b, result);
+    return result;
+  }
+
+  void clear() {
+    for (auto& entry : m_entries) {
+      entry = Entry();
+    }
+  }
+
+ private:
+  static constexpr size_t kNumEntries = 1024;
+
+  struct Entry {
+    int op{-1};
+    NodePtr<Tree> a;
+    NodePtr<Tree> b;
+    NodePtr<Tree> result;
+  };
+
+  OperationMemo() {
+    HashConsedPatriciaTrees::on_scope_exit([this] { clear(); });
+  }
+
+  bool find(int op, const Tree* a, const Tree* b, NodePtr<Tree>* result) {
+    const auto& entry = m_entries[slot(op, a, b)];
+    if (entry.op != op || entry.a.get() != a || entry.b.get() != b) {
+      return false;
+    }
+    *result = entry.result;
+    return true;
+  }
+
+  void store(int op,
+             const NodePtr<Tree>& a,
+             const NodePtr<Tree>& b,
+             const NodePtr<Tree>& result) {
+    auto& entry = m_entries[slot(op, a.get(), b.get())];
+    entry.op = op;
+    entry.a = a;
+    entry.b = b;
+    entry.result = result;
+  }
+
+  // For predicates; `true` is represented by a non-null result.
+  bool find(int op, const Tree* a, const Tree* b, bool* result) {
+    NodePtr<Tree> r;
+    if (!find(op, a, b, &r)) {
+      return false;
+    }
+    *result = r != nullptr;
+    return true;
+  }
+
+  void store(int op,
+             const NodePtr<Tree>& a,
+             const NodePtr<Tree>& b,
+             bool result) {
+    store(op, a, b, result ? a : NodePtr<Tree>());
+  }
+
+  static size_t slot(int op, const Tree* a, const Tree* b) {
+    auto x = reinterpret_cast<uintptr_t>(a) >> 4;
+    auto y = reinterpret_cast<uintptr_t>(b) >> 4;
+    return (x * 31 + y * 17 + static_cast<size_t>(op)) % kNumEntries;
+  }
+
+  Entry m_entries[kNumEntries];
+};
+
+/*
+ * Downcasts without touching the reference count; the result is only valid
+ * for as long as `p` holds on to the node.
+ */
+template <typename T, typename U>
+T* node_cast(const NodePtr<U>& p) {
+  return static_cast<T*>(p.get());
+}
+
+} // namespace pt_util
+
+} // namespace sparta
@@ -22,6 +22,7 @@
 #include <boost/functional/hash.hpp>
 
 #include "Exceptions.h"
+#include "PatriciaTreeNode.h"
 #include "PatriciaTreeUtil.h"
 
 namespace sparta {
@@ -40,44 +41,44 @@ class PatriciaTreeIterator;
 
 template <typename IntegerType>
 inline bool contains(IntegerType key,
-                     const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+                     const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
 inline bool is_subset_of(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree2);
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree1,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree2);
 
 template <typename IntegerType>
-inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-                   const std::shared_ptr<PatriciaTree<IntegerType>>& tree2);
+inline bool equals(const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree1,
+                   const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree2);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> insert(
+    IntegerType key, const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> remove(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> remove(
+    IntegerType key, const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> filter(
     const std::function<bool(IntegerType)>& predicate,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t);
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> merge(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t);
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> intersect(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t);
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> diff(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t);
 
 } // namespace pt_impl
 
@@ -97,7 +98,8 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
  * by the program. This effectively achieves a form of incremental hash-consing.
  * Note that it's not perfect, since identical trees that are independently
  * constructed are not equated, but it's a lot more efficient than regular
- * hash-consing. This data structure doesn't just reduce the memory footprint of
+ * hash-consing. Regular hash-consing is available for the trees built inside
+ * a HashConsedPatriciaTrees scope (see PatriciaTreeNode.h). This data structure doesn't just reduce the memory footprint of
  * sets, it also significantly speeds up certain operations. Whenever two sets
  * represented as Patricia trees share some structure, their union and
  * intersection can often be computed in sublinear time.
@@ -309,7 +311,7 @@ class PatriciaTreeSet final {
     return x;
   }
 
-  std::shared_ptr<pt_impl::PatriciaTree<IntegerType>> m_tree;
+  pt_util::NodePtr<pt_impl::PatriciaTree<IntegerType>> m_tree;
 
   template <typename T>
   friend class pt_impl::PatriciaTreeIterator;
@@ -320,7 +322,7 @@ namespace pt_impl {
 using namespace pt_util;
 
 template <typename IntegerType>
-class PatriciaTree {
+class PatriciaTree : public RefCountedNode {
  public:
   // A Patricia tree is an immutable structure.
   PatriciaTree& operator=(const PatriciaTree& other) = delete;
@@ -358,8 +360,8 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType> {
  public:
   PatriciaTreeBranch(IntegerType prefix,
                      IntegerType branching_bit,
-                     std::shared_ptr<PatriciaTree<IntegerType>> left_tree,
-                     std::shared_ptr<PatriciaTree<IntegerType>> right_tree)
+                     pt_util::NodePtr<PatriciaTree<IntegerType>> left_tree,
+                     pt_util::NodePtr<PatriciaTree<IntegerType>> right_tree)
       : m_prefix(prefix),
         m_branching_bit(branching_bit),
         m_left_tree(left_tree),
@@ -372,25 +374,27 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType> {
     this->set_hash(seed);
   }
 
+  ~PatriciaTreeBranch() override;
+
   bool is_leaf() const override { return false; }
 
   IntegerType prefix() const { return m_prefix; }
 
   IntegerType branching_bit() const { return m_branching_bit; }
 
-  const std::shared_ptr<PatriciaTree<IntegerType>>& left_tree() const {
+  const pt_util::NodePtr<PatriciaTree<IntegerType>>& left_tree() const {
     return m_left_tree;
   }
 
-  const std::shared_ptr<PatriciaTree<IntegerType>>& right_tree() const {
+  const pt_util::NodePtr<PatriciaTree<IntegerType>>& right_tree() const {
     return m_right_tree;
   }
 
  private:
   IntegerType m_prefix;
   IntegerType m_branching_bit;
-  std::shared_ptr<PatriciaTree<IntegerType>> m_left_tree;
-  std::shared_ptr<PatriciaTree<IntegerType>> m_right_tree;
+  pt_util::NodePtr<PatriciaTree<IntegerType>> m_left_tree;
+  pt_util::NodePtr<PatriciaTree<IntegerType>> m_right_tree;
 };
 
 template <typename IntegerType>
@@ -401,6 +405,8 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType> {
     this->set_hash(hasher(key));
   }
 
+  ~PatriciaTreeLeaf() override;
+
   bool is_leaf() const override { return true; }
 
   const IntegerType& key() const { return m_key; }
@@ -409,53 +415,135 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType> {
   IntegerType m_key;
 };
 
+// Hash-consed nodes are looked up by their own fields and the addresses of
+// their children, which are hash-consed already.
+template <typename IntegerType>
+struct HashConsHash {
+  size_t operator()(const PatriciaTree<IntegerType>* tree) const {
+    return tree->hash();
+  }
+};
+
+template <typename IntegerType>
+struct HashConsEqual {
+  bool operator()(const PatriciaTree<IntegerType>* tree1,
+                  const PatriciaTree<IntegerType>* tree2) const {
+    if (tree1->is_leaf() != tree2->is_leaf()) {
+      return false;
+    }
+    if (tree1->is_leaf()) {
+      return static_cast<const PatriciaTreeLeaf<IntegerType>*>(tree1)->key() ==
+             static_cast<const PatriciaTreeLeaf<IntegerType>*>(tree2)->key();
+    }
+    const auto* branch1 =
+        static_cast<const PatriciaTreeBranch<IntegerType>*>(tree1);
+    const auto* branch2 =
+        static_cast<const PatriciaTreeBranch<IntegerType>*>(tree2);
+    return branch1->prefix() == branch2->prefix() &&
+           branch1->branching_bit() == branch2->branching_bit() &&
+           branch1->left_tree() == branch2->left_tree() &&
+           branch1->right_tree() == branch2->right_tree();
+  }
+};
+
+template <typename IntegerType>
+using HashConsTableFor = HashConsTable<PatriciaTree<IntegerType>,
+                                       HashConsHash<IntegerType>,
+                                       HashConsEqual<IntegerType>>;
+
+template <typename IntegerType>
+using MemoFor = OperationMemo<PatriciaTree<IntegerType>>;
+
+// The binary operations that are memoized on hash-consed trees.
+enum MemoizedOperation { kMerge, kIntersect, kDiff, kIsSubsetOf };
+
+template <typename IntegerType>
+PatriciaTreeBranch<IntegerType>::~PatriciaTreeBranch() {
+  if (this->is_hash_consed()) {
+    HashConsTableFor<IntegerType>::instance().erase(this);
+  }
+}
+
+template <typename IntegerType>
+PatriciaTreeLeaf<IntegerType>::~PatriciaTreeLeaf() {
+  if (this->is_hash_consed()) {
+    HashConsTableFor<IntegerType>::instance().erase(this);
+  }
+}
+
+// All the nodes of Patricia trees are built by the two functions below, which
+// hash-cons them inside a HashConsedPatriciaTrees scope.
+template <typename IntegerType>
+pt_util::NodePtr<PatriciaTree<IntegerType>> make_leaf_node(IntegerType key) {
+  pt_util::NodePtr<PatriciaTree<IntegerType>> leaf =
+      pt_util::make_node<PatriciaTreeLeaf<IntegerType>>(key);
+  if (!HashConsedPatriciaTrees::active()) {
+    return leaf;
+  }
+  return HashConsTableFor<IntegerType>::instance().intern(leaf);
+}
+
 template <typename IntegerType>
-std::shared_ptr<PatriciaTreeBranch<IntegerType>> join(
+pt_util::NodePtr<PatriciaTree<IntegerType>> make_branch_node(
+    IntegerType prefix,
+    IntegerType branching_bit,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& left_tree,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& right_tree) {
+  pt_util::NodePtr<PatriciaTree<IntegerType>> branch =
+      pt_util::make_node<PatriciaTreeBranch<IntegerType>>(
+          prefix, branching_bit, left_tree, right_tree);
+  if (!HashConsedPatriciaTrees::active() || !left_tree->is_hash_consed() ||
+      !right_tree->is_hash_consed()) {
+    return branch;
+  }
+  return HashConsTableFor<IntegerType>::instance().intern(branch);
+}
+
+template <typename IntegerType>
+pt_util::NodePtr<PatriciaTree<IntegerType>> join(
     IntegerType prefix0,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree0,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree0,
     IntegerType prefix1,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree1) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
-        mask(prefix0, m), m, tree0, tree1);
+    return make_branch_node<IntegerType>(mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
-        mask(prefix0, m), m, tree1, tree0);
+    return make_branch_node<IntegerType>(mask(prefix0, m), m, tree1, tree0);
   }
 }
 
 // This function is used by remove() to prevent the creation of branch nodes
 // with only one child.
 template <typename IntegerType>
-std::shared_ptr<PatriciaTree<IntegerType>> make_branch(
+pt_util::NodePtr<PatriciaTree<IntegerType>> make_branch(
     IntegerType prefix,
     IntegerType branching_bit,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& left_tree,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& right_tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& left_tree,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& right_tree) {
   if (left_tree == nullptr) {
     return right_tree;
   }
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+  return make_branch_node<IntegerType>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
 template <typename IntegerType>
 inline bool contains(IntegerType key,
-                     const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+                     const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
     return false;
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     return key == leaf->key();
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   if (is_zero_bit(key, branch->branching_bit())) {
     return contains(key, branch->left_tree());
   } else {
@@ -464,32 +552,21 @@ inline bool contains(IntegerType key,
 }
 
 template <typename IntegerType>
-inline bool is_subset_of(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree2) {
-  if (tree1 == tree2) {
-    // This conditions allows the inclusion test to run in sublinear time
-    // when comparing Patricia trees that share some structure.
-    return true;
-  }
-  if (tree1 == nullptr) {
-    return true;
-  }
-  if (tree2 == nullptr) {
-    return false;
-  }
+inline bool is_subset_of_nodes(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree1,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree2) {
   if (tree1->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
     return contains(leaf->key(), tree2);
   }
   if (tree2->is_leaf()) {
     return false;
   }
   const auto& branch1 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree1);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree1);
   const auto& branch2 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree2);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree2);
   if (branch1->prefix() == branch2->prefix() &&
       branch1->branching_bit() == branch2->branching_bit()) {
     return is_subset_of(branch1->left_tree(), branch2->left_tree()) &&
@@ -509,11 +586,35 @@ inline bool is_subset_of(
   return false;
 }
 
+template <typename IntegerType>
+inline bool is_subset_of(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree1,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree2) {
+  if (tree1 == tree2) {
+    // This conditions allows the inclusion test to run in sublinear time
+    // when comparing Patricia trees that share some structure.
+    return true;
+  }
+  if (tree1 == nullptr) {
+    return true;
+  }
+  if (tree2 == nullptr) {
+    return false;
+  }
+  if (MemoFor<IntegerType>::applies(tree1, tree2)) {
+    return MemoFor<IntegerType>::local().memoize(
+        kIsSubsetOf, tree1, tree2, [&] {
+          return is_subset_of_nodes(tree1, tree2);
+        });
+  }
+  return is_subset_of_nodes(tree1, tree2);
+}
+
 // A Patricia tree is a canonical representation of the set of keys it contains.
 // Hence, set equality is equivalent to structural equality of Patricia trees.
 template <typename IntegerType>
-inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-                   const std::shared_ptr<PatriciaTree<IntegerType>>& tree2) {
+inline bool equals(const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree1,
+                   const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree2) {
   if (tree1 == tree2) {
     // This conditions allows the equality test to run in sublinear time
     // when comparing Patricia trees that share some structure.
@@ -525,6 +626,10 @@ inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
   if (tree2 == nullptr) {
     return false;
   }
+  if (tree1->is_hash_consed() && tree2->is_hash_consed()) {
+    // Distinct hash-consed trees are never equal.
+    return false;
+  }
   // Since the hash codes are readily available (they're computed when the trees
   // are constructed), we can use them to cut short the equality test.
   if (tree1->hash() != tree2->hash()) {
@@ -535,18 +640,18 @@ inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
       return false;
     }
     const auto& leaf1 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
     const auto& leaf2 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree2);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree2);
     return leaf1->key() == leaf2->key();
   }
   if (tree2->is_leaf()) {
     return false;
   }
   const auto& branch1 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree1);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree1);
   const auto& branch2 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree2);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree2);
   return branch1->prefix() == branch2->prefix() &&
          branch1->branching_bit() == branch2->branching_bit() &&
          equals(branch1->left_tree(), branch2->left_tree()) &&
@@ -554,32 +659,32 @@ inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> insert(
+    IntegerType key, const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType>>(key);
+    return make_leaf_node<IntegerType>(key);
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     if (key == leaf->key()) {
       return leaf;
     }
     return join<IntegerType>(
         key,
-        std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+        make_leaf_node<IntegerType>(key),
         leaf->key(),
         leaf);
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   if (match_prefix(key, branch->prefix(), branch->branching_bit())) {
     if (is_zero_bit(key, branch->branching_bit())) {
       auto new_left_tree = insert(key, branch->left_tree());
       if (new_left_tree == branch->left_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           new_left_tree,
@@ -589,7 +694,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
       if (new_right_tree == branch->right_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           branch->left_tree(),
@@ -597,27 +702,27 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     }
   }
   return join<IntegerType>(key,
-                           std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+                           make_leaf_node<IntegerType>(key),
                            branch->prefix(),
                            branch);
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> remove(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> remove(
+    IntegerType key, const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     if (key == leaf->key()) {
       return nullptr;
     }
     return leaf;
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   if (match_prefix(key, branch->prefix(), branch->branching_bit())) {
     if (is_zero_bit(key, branch->branching_bit())) {
       auto new_left_tree = remove(key, branch->left_tree());
@@ -643,19 +748,19 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> remove(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> filter(
     const std::function<bool(IntegerType key)>& predicate,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     return predicate(leaf->key()) ? leaf : nullptr;
   }
   const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   auto new_left_tree = filter(predicate, branch->left_tree());
   auto new_right_tree = filter(predicate, branch->right_tree());
   if (new_left_tree == branch->left_tree() &&
@@ -672,37 +777,26 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
 // We keep the notations of the paper so as to make the implementation easier
 // to follow.
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
-  if (s == t) {
-    // This conditional is what allows the union operation to complete in
-    // sublinear time when the operands share some structure.
-    return s;
-  }
-  if (s == nullptr) {
-    return t;
-  }
-  if (t == nullptr) {
-    return s;
-  }
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> merge_nodes(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t) {
   // We need to check whether t is a leaf before we do the same for s.
   // Otherwise, if s and t are both leaves, we would end up inserting s into t.
   // This would violate the assumptions required by `reference_equals()`.
   if (t->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(t);
     return insert(leaf->key(), s);
   }
   if (s->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(s);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(s);
     return insert(leaf->key(), t);
   }
   const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(s);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(s);
   const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -721,7 +815,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return make_branch_node<IntegerType>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -731,14 +825,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           p, m, s0, new_right);
     }
   }
@@ -749,14 +843,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           q, n, t0, new_right);
     }
   }
@@ -765,31 +859,45 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> merge(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s == t) {
-    // This conditional is what allows the intersection operation to complete in
+    // This conditional is what allows the union operation to complete in
     // sublinear time when the operands share some structure.
     return s;
   }
-  if (s == nullptr || t == nullptr) {
-    return nullptr;
+  if (s == nullptr) {
+    return t;
+  }
+  if (t == nullptr) {
+    return s;
+  }
+  if (MemoFor<IntegerType>::applies(s, t)) {
+    return MemoFor<IntegerType>::local().memoize(
+        kMerge, s, t, [&] { return merge_nodes(s, t); });
   }
+  return merge_nodes(s, t);
+}
+
+template <typename IntegerType>
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> intersect_nodes(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(s);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(s);
     return contains(leaf->key(), t) ? leaf : nullptr;
   }
   if (t->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(t);
     return contains(leaf->key(), s) ? leaf : nullptr;
   }
   const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(s);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(s);
   const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -816,34 +924,42 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> intersect(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
-    return nullptr;
+    return s;
   }
-  if (s == nullptr) {
+  if (s == nullptr || t == nullptr) {
     return nullptr;
   }
-  if (t == nullptr) {
-    return s;
+  if (MemoFor<IntegerType>::applies(s, t)) {
+    return MemoFor<IntegerType>::local().memoize(
+        kIntersect, s, t, [&] { return intersect_nodes(s, t); });
   }
+  return intersect_nodes(s, t);
+}
+
+template <typename IntegerType>
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> diff_nodes(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(s);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(s);
     return contains(leaf->key(), t) ? nullptr : leaf;
   }
   if (t->is_leaf()) {
     const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+        pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(t);
     return remove(leaf->key(), s);
   }
   const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(s);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(s);
   const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+      pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -877,6 +993,28 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
   return s;
 }
 
+template <typename IntegerType>
+inline pt_util::NodePtr<PatriciaTree<IntegerType>> diff(
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& s,
+    const pt_util::NodePtr<PatriciaTree<IntegerType>>& t) {
+  if (s == t) {
+    // This conditional is what allows the intersection operation to complete in
+    // sublinear time when the operands share some structure.
+    return nullptr;
+  }
+  if (s == nullptr) {
+    return nullptr;
+  }
+  if (t == nullptr) {
+    return s;
+  }
+  if (MemoFor<IntegerType>::applies(s, t)) {
+    return MemoFor<IntegerType>::local().memoize(
+        kDiff, s, t, [&] { return diff_nodes(s, t); });
+  }
+  return diff_nodes(s, t);
+}
+
 // The iterator basically performs a post-order traversal of the tree, pausing
 // at each leaf.
 template <typename Element>
@@ -894,7 +1032,7 @@ class PatriciaTreeIterator final {
   PatriciaTreeIterator() {}
 
   explicit PatriciaTreeIterator(
-      const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+      const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree) {
     if (tree == nullptr) {
       return;
     }
@@ -940,24 +1078,24 @@ class PatriciaTreeIterator final {
 
  private:
   // The argument is never null.
-  void go_to_next_leaf(const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+  void go_to_next_leaf(const pt_util::NodePtr<PatriciaTree<IntegerType>>& tree) {
     auto t = tree;
     // We go to the leftmost leaf, storing the branches that we're traversing
     // on the stack. By definition of a Patricia tree, a branch node always
     // has two children, hence the leftmost leaf always exists.
     while (t->is_branch()) {
       auto branch =
-          std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+          pt_util::node_cast<PatriciaTreeBranch<IntegerType>>(t);
       m_stack.push(branch);
       t = branch->left_tree();
       // A branch node always has two children.
       RUNTIME_CHECK(t != nullptr, internal_error());
     }
-    m_leaf = std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+    m_leaf = pt_util::node_cast<PatriciaTreeLeaf<IntegerType>>(t);
   }
 
-  std::stack<std::shared_ptr<PatriciaTreeBranch<IntegerType>>> m_stack;
-  std::shared_ptr<PatriciaTreeLeaf<IntegerType>> m_leaf;
+  std::stack<pt_util::NodePtr<PatriciaTreeBranch<IntegerType>>> m_stack;
+  pt_util::NodePtr<PatriciaTreeLeaf<IntegerType>> m_leaf;
 };
 
 } // namespace pt_impl
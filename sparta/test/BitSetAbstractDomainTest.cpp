@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BitSetAbstractDomain.h"
+
+#include <cstdint>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "AbstractDomainPropertyTest.h"
+
+using namespace sparta;
+
+using Domain = BitSetAbstractDomain<uint16_t>;
+
+INSTANTIATE_TYPED_TEST_CASE_P(BitSetAbstractDomain,
+                              AbstractDomainPropertyTest,
+                              Domain);
+
+template <>
+std::vector<Domain> AbstractDomainPropertyTest<Domain>::non_extremal_values() {
+  Domain empty;
+  Domain e1({1, 2, 3});
+  Domain e2({2, 300});
+  return {empty, e1, e2};
+}
+
+namespace {
+
+std::vector<uint16_t> to_vector(const Domain& d) {
+  return std::vector<uint16_t>(d.elements().begin(), d.elements().end());
+}
+
+} // namespace
+
+TEST(BitSetAbstractDomainTest, latticeOperations) {
+  Domain e1(1);
+  Domain e2({1, 2, 3});
+  Domain e3({2, 3, 200});
+
+  EXPECT_THAT(to_vector(e1), ::testing::ElementsAre(1));
+  EXPECT_THAT(to_vector(e3), ::testing::ElementsAre(2, 3, 200));
+  EXPECT_EQ(3, e3.size());
+
+  EXPECT_TRUE(e1.leq(e2));
+  EXPECT_FALSE(e1.leq(e3));
+  EXPECT_FALSE(e3.leq(e2));
+  EXPECT_TRUE(e2.equals(Domain({3, 2, 1})));
+  EXPECT_FALSE(e2.equals(e3));
+
+  EXPECT_THAT(to_vector(e2.join(e3)), ::testing::ElementsAre(1, 2, 3, 200));
+  EXPECT_THAT(to_vector(e3.join(e2)), ::testing::ElementsAre(1, 2, 3, 200));
+  EXPECT_THAT(to_vector(e2.meet(e3)), ::testing::ElementsAre(2, 3));
+  EXPECT_THAT(to_vector(e3.meet(e2)), ::testing::ElementsAre(2, 3));
+  EXPECT_TRUE(e2.join(Domain::top()).is_top());
+  EXPECT_TRUE(e2.meet(Domain::bottom()).is_bottom());
+  EXPECT_TRUE(e2.widening(e3).equals(e2.join(e3)));
+  EXPECT_TRUE(e2.narrowing(e3).equals(e2.meet(e3)));
+
+  // Sets that only differ by trailing empty words are equal.
+  Domain e4({2, 3, 200});
+  e4.remove(200);
+  EXPECT_TRUE(e4.equals(Domain({2, 3})));
+  EXPECT_TRUE(Domain({2, 3}).equals(e4));
+  EXPECT_TRUE(e4.leq(Domain({2, 3})));
+  EXPECT_EQ(2, e4.size());
+
+  std::ostringstream out;
+  out << e3;
+  EXPECT_EQ("[#3]{2, 3, 200}", out.str());
+}
+
+TEST(BitSetAbstractDomainTest, agreesWithStdSet) {
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<uint16_t> element(0, 700);
+  auto random_pair = [&]() {
+    Domain d;
+    std::set<uint16_t> s;
+    for (int i = 0; i < 50; ++i) {
+      auto e = element(gen);
+      d.add(e);
+      s.insert(e);
+    }
+    return std::make_pair(d, s);
+  };
+  for (int round = 0; round < 50; ++round) {
+    auto a = random_pair();
+    auto b = random_pair();
+    EXPECT_THAT(to_vector(a.first), ::testing::ElementsAreArray(a.second));
+
+    std::set<uint16_t> join(a.second);
+    join.insert(b.second.begin(), b.second.end());
+    EXPECT_THAT(to_vector(a.first.join(b.first)),
+                ::testing::ElementsAreArray(join));
+
+    std::set<uint16_t> meet;
+    for (auto e : a.second) {
+      if (b.second.count(e)) {
+        meet.insert(e);
+      }
+    }
+    EXPECT_THAT(to_vector(a.first.meet(b.first)),
+                ::testing::ElementsAreArray(meet));
+    EXPECT_TRUE(a.first.meet(b.first).leq(a.first));
+    EXPECT_TRUE(a.first.leq(a.first.join(b.first)));
+    EXPECT_EQ(meet.size() == a.second.size(), a.first.leq(b.first));
+
+    for (auto e : b.second) {
+      a.first.remove(e);
+      a.second.erase(e);
+    }
+    EXPECT_THAT(to_vector(a.first), ::testing::ElementsAreArray(a.second));
+    EXPECT_EQ(a.second.size(), a.first.size());
+    for (uint16_t e = 0; e <= 700; ++e) {
+      EXPECT_EQ(a.second.count(e) == 1, a.first.contains(e));
+    }
+  }
+}
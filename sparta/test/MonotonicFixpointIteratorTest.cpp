@@ -99,6 +99,8 @@ class Program final {
 
   void set_exit(const std::string& exit) { m_exit = ControlPoint(exit); }
 
+  size_t size() const { return m_statements.size(); }
+
  private:
   // In gtest, FAIL (or any ASSERT_* statement) can only be called from within a
   // function that returns void.
@@ -142,19 +144,45 @@ class ProgramInterface {
   static NodeId target(const Graph&, const EdgeId& e) { return e->second; }
 };
 
+// The nodes of the test programs are labeled 1 to n.
+class DenseProgramInterface : public ProgramInterface {
+ public:
+  static size_t node_index(const Graph&, const NodeId& node) {
+    return std::stoul(node.label);
+  }
+  static size_t node_index_bound(const Graph& graph) {
+    return graph.size() + 1;
+  }
+};
+
+static_assert(!fp_impl::has_dense_node_index<ProgramInterface>::value, "");
+static_assert(fp_impl::has_dense_node_index<DenseProgramInterface>::value,
+              "");
+static_assert(fp_impl::has_dense_node_index<
+                  BackwardsFixpointIterationAdaptor<DenseProgramInterface>>::value,
+              "");
+
 /*
  * The abstract domain for liveness is just the powerset domain of variables.
  */
 using LivenessDomain = HashedSetAbstractDomain<std::string>;
 
-class FixpointEngine final
+template <typename Interface>
+class LivenessFixpointEngine final
     : public MonotonicFixpointIterator<
-          BackwardsFixpointIterationAdaptor<ProgramInterface>,
+          BackwardsFixpointIterationAdaptor<Interface>,
           LivenessDomain,
           boost::hash<ControlPoint>> {
  public:
-  explicit FixpointEngine(const Program& program)
-      : MonotonicFixpointIterator(program), m_program(program) {}
+  using EdgeId = typename Interface::EdgeId;
+
+  explicit LivenessFixpointEngine(const Program& program,
+                                  bool entry_states_at_heads_only = false)
+      : MonotonicFixpointIterator<BackwardsFixpointIterationAdaptor<Interface>,
+                                  LivenessDomain,
+                                  boost::hash<ControlPoint>>(
+            program, /* cfg_size_hint */ 4, entry_states_at_heads_only),
+        m_program(program) {}
 
   void analyze_node(const ControlPoint& node,
                     LivenessDomain* current_state) const override {
@@ -175,19 +203,21 @@ class FixpointEngine final
     // Since we performed a backward analysis by reversing the control-flow
     // graph, the set of live variables before executing a node is given by
     // the exit state at the node.
-    return get_exit_state_at(ControlPoint(node));
+    return this->get_exit_state_at(ControlPoint(node));
   }
 
   LivenessDomain get_live_out_vars_at(const std::string& node) {
     // Similarly, the set of live variables after executing a node is given by
     // the entry state at the node.
-    return get_entry_state_at(ControlPoint(node));
+    return this->get_entry_state_at(ControlPoint(node));
   }
 
  private:
   const Program& m_program;
 };
 
+using FixpointEngine = LivenessFixpointEngine<ProgramInterface>;
+
 class MonotonicFixpointIteratorTest : public ::testing::Test {
  protected:
   MonotonicFixpointIteratorTest() : m_program1("1"), m_program2("1") {}
@@ -360,3 +390,234 @@ TEST_F(MonotonicFixpointIteratorTest, program2) {
   ASSERT_TRUE(fp.get_live_in_vars_at("7").is_bottom());
   ASSERT_TRUE(fp.get_live_out_vars_at("7").is_bottom());
 }
+
+TEST_F(MonotonicFixpointIteratorTest, denseStatesAndHeadsOnly) {
+  for (const Program* program : {&this->m_program1, &this->m_program2}) {
+    FixpointEngine reference(*program);
+    reference.run(LivenessDomain());
+    LivenessFixpointEngine<DenseProgramInterface> dense(*program);
+    dense.run(LivenessDomain());
+    FixpointEngine heads_only(*program, /* entry_states_at_heads_only */ true);
+    heads_only.run(LivenessDomain());
+    LivenessFixpointEngine<DenseProgramInterface> dense_heads_only(
+        *program, /* entry_states_at_heads_only */ true);
+    dense_heads_only.run(LivenessDomain());
+
+    for (size_t i = 1; i <= program->size(); ++i) {
+      auto node = std::to_string(i);
+      auto in = reference.get_live_in_vars_at(node);
+      auto out = reference.get_live_out_vars_at(node);
+      EXPECT_TRUE(dense.get_live_in_vars_at(node).equals(in)) << node;
+      EXPECT_TRUE(dense.get_live_out_vars_at(node).equals(out)) << node;
+      EXPECT_TRUE(heads_only.get_live_in_vars_at(node).equals(in)) << node;
+      EXPECT_TRUE(heads_only.get_live_out_vars_at(node).equals(out)) << node;
+      EXPECT_TRUE(dense_heads_only.get_live_in_vars_at(node).equals(in))
+          << node;
+      EXPECT_TRUE(dense_heads_only.get_live_out_vars_at(node).equals(out))
+          << node;
+    }
+  }
+}
+
+/*
+ * A forward analysis that collects the values of a loop counter:
+ *
+ *  1: i = 0;
+ *  2: while (i < 100) {
+ *  3:   i = i + 1;
+ *     }
+ *  4: return;
+ *
+ * where node 3 applies the loop guard to its entry state, and node 5, which
+ * only appears in the nested loops below, adds 200 to the values under 50.
+ */
+using CounterDomain = HashedSetAbstractDomain<int>;
+
+class CounterFixpointEngine final
+    : public MonotonicFixpointIterator<ProgramInterface,
+                                       CounterDomain,
+                                       boost::hash<ControlPoint>> {
+ public:
+  explicit CounterFixpointEngine(const Program& program)
+      : MonotonicFixpointIterator(program) {}
+
+  void analyze_node(const ControlPoint& node,
+                    CounterDomain* current_state) const override {
+    if (node.label == "1") {
+      *current_state = CounterDomain(0);
+    } else if ((node.label == "3" || node.label == "5") &&
+               current_state->is_value()) {
+      CounterDomain next;
+      for (int i : current_state->elements()) {
+        if (node.label == "3" && i < 100) {
+          next.add(i + 1);
+        } else if (node.label == "5" && i < 50) {
+          next.add(i + 200);
+        }
+      }
+      *current_state = next;
+    }
+  }
+
+  CounterDomain analyze_edge(
+      const EdgeId&, const CounterDomain& exit_state_at_source) const override {
+    return exit_state_at_source;
+  }
+};
+
+CounterDomain counter_values(int from, int to) {
+  CounterDomain values;
+  for (int i = from; i <= to; ++i) {
+    values.add(i);
+  }
+  return values;
+}
+
+/*
+ * The least fixpoint of the equations of the engine, by a round-robin
+ * iteration over all the nodes, without any extrapolation. The values stay
+ * within a finite set, so this terminates.
+ */
+std::unordered_map<std::string, CounterDomain> round_robin_entry_states(
+    const Program& program,
+    const CounterFixpointEngine& engine,
+    const std::vector<std::string>& nodes) {
+  std::unordered_map<std::string, CounterDomain> entry_states;
+  std::unordered_map<std::string, CounterDomain> exit_states;
+  for (const auto& node : nodes) {
+    entry_states[node] = CounterDomain::bottom();
+    exit_states[node] = CounterDomain::bottom();
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& node : nodes) {
+      ControlPoint cp(node);
+      auto entry_state = node == nodes.front() ? CounterDomain()
+                                               : CounterDomain::bottom();
+      for (const auto& edge : program.predecessors(cp)) {
+        entry_state.join_with(
+            engine.analyze_edge(edge, exit_states.at(edge->first.label)));
+      }
+      auto exit_state = entry_state;
+      engine.analyze_node(cp, &exit_state);
+      if (!entry_state.equals(entry_states.at(node)) ||
+          !exit_state.equals(exit_states.at(node))) {
+        changed = true;
+        entry_states[node] = std::move(entry_state);
+        exit_states[node] = std::move(exit_state);
+      }
+    }
+  }
+  return entry_states;
+}
+
+/*
+ * The entry state of a loop head depends on its back edges. Past the first
+ * iteration, the iterator keeps the extrapolated state at the head instead
+ * of recomputing it from the predecessors, and must still reach the same
+ * fixpoint.
+ */
+TEST(MonotonicFixpointIteratorHeadTest, headStatesReachTheLeastFixpoint) {
+  Program loop("1");
+  for (const auto& node : {"1", "2", "3", "4"}) {
+    loop.add(node, Statement());
+  }
+  loop.add_edge("1", "2");
+  loop.add_edge("2", "3");
+  loop.add_edge("3", "2");
+  loop.add_edge("2", "4");
+
+  CounterFixpointEngine loop_engine(loop);
+  loop_engine.run(CounterDomain());
+  EXPECT_TRUE(loop_engine.get_entry_state_at(ControlPoint("2"))
+                  .equals(counter_values(0, 100)));
+  auto expected =
+      round_robin_entry_states(loop, loop_engine, {"1", "2", "3", "4"});
+  for (const auto& entry : expected) {
+    EXPECT_TRUE(loop_engine.get_entry_state_at(ControlPoint(entry.first))
+                    .equals(entry.second))
+        << "at " << entry.first;
+  }
+
+  // The counting loop, with head 4, nested in a loop with head 2 whose back
+  // edge comes from 5.
+  Program nested("1");
+  for (const auto& node : {"1", "2", "3", "4", "5", "6"}) {
+    nested.add(node, Statement());
+  }
+  nested.add_edge("1", "2");
+  nested.add_edge("2", "4");
+  nested.add_edge("4", "3");
+  nested.add_edge("3", "4");
+  nested.add_edge("4", "5");
+  nested.add_edge("5", "2");
+  nested.add_edge("2", "6");
+
+  CounterFixpointEngine nested_engine(nested);
+  nested_engine.run(CounterDomain());
+  auto outer_values = counter_values(200, 249);
+  outer_values.add(0);
+  EXPECT_TRUE(nested_engine.get_entry_state_at(ControlPoint("2"))
+                  .equals(outer_values));
+  auto inner_values = counter_values(0, 100);
+  inner_values.join_with(counter_values(200, 249));
+  EXPECT_TRUE(nested_engine.get_entry_state_at(ControlPoint("4"))
+                  .equals(inner_values));
+  expected = round_robin_entry_states(nested, nested_engine,
+                                      {"1", "2", "3", "4", "5", "6"});
+  for (const auto& entry : expected) {
+    EXPECT_TRUE(nested_engine.get_entry_state_at(ControlPoint(entry.first))
+                    .equals(entry.second))
+        << "at " << entry.first;
+  }
+}
+
+TEST(MonotonicFixpointIteratorPolicyTest, widening) {
+  Program program("1");
+  for (const auto& node : {"1", "2", "3", "4"}) {
+    program.add(node, Statement());
+  }
+  program.add_edge("1", "2");
+  program.add_edge("2", "3");
+  program.add_edge("3", "2");
+  program.add_edge("2", "4");
+  ControlPoint head("2");
+
+  // The powerset domain widens by joining, so this takes a hundred
+  // iterations.
+  CounterFixpointEngine plain(program);
+  plain.run(CounterDomain());
+  EXPECT_TRUE(plain.get_entry_state_at(head).equals(counter_values(0, 100)));
+  EXPECT_EQ(101, plain.get_iteration_stats().iterations);
+  EXPECT_EQ(101, plain.get_iteration_stats().max_local_iterations);
+  EXPECT_FALSE(plain.get_iteration_stats().budget_exhausted);
+
+  // The thresholds jump over the intermediate states, and the final
+  // refinement step recovers the exact result.
+  CounterFixpointEngine thresholds(program);
+  WideningPolicy<CounterDomain> policy;
+  policy.thresholds = {counter_values(0, 9), counter_values(0, 1000)};
+  thresholds.set_widening_policy(policy);
+  thresholds.run(CounterDomain());
+  EXPECT_TRUE(
+      thresholds.get_entry_state_at(head).equals(counter_values(0, 100)));
+  EXPECT_EQ(4, thresholds.get_iteration_stats().iterations);
+
+  // Past the budget, the head falls to Top.
+  CounterFixpointEngine budget(program);
+  policy = WideningPolicy<CounterDomain>();
+  policy.iteration_budget = 10;
+  budget.set_widening_policy(policy);
+  budget.run(CounterDomain());
+  EXPECT_TRUE(budget.get_entry_state_at(head).is_top());
+  EXPECT_TRUE(budget.get_exit_state_at(ControlPoint("4")).is_top());
+  EXPECT_EQ(12, budget.get_iteration_stats().iterations);
+  EXPECT_TRUE(budget.get_iteration_stats().budget_exhausted);
+
+  // Running again resets the counts.
+  budget.set_widening_policy(WideningPolicy<CounterDomain>());
+  budget.run(CounterDomain());
+  EXPECT_EQ(101, budget.get_iteration_stats().iterations);
+  EXPECT_FALSE(budget.get_iteration_stats().budget_exhausted);
+}
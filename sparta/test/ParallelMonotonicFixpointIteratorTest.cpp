@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ParallelMonotonicFixpointIterator.h"
+
+#include <cstdint>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "HashedSetAbstractDomain.h"
+
+using namespace sparta;
+
+/*
+ * A graph over integers, with the edges given as pairs of nodes.
+ */
+struct SimpleGraph {
+  using Edge = std::pair<uint32_t, uint32_t>;
+
+  void add_edge(uint32_t src, uint32_t dst) {
+    succs[src].emplace_back(src, dst);
+    preds[dst].emplace_back(src, dst);
+  }
+
+  uint32_t entry{0};
+  std::unordered_map<uint32_t, std::vector<Edge>> succs;
+  std::unordered_map<uint32_t, std::vector<Edge>> preds;
+};
+
+struct SimpleGraphInterface {
+  using Graph = SimpleGraph;
+  using NodeId = uint32_t;
+  using EdgeId = SimpleGraph::Edge;
+
+  static NodeId entry(const Graph& graph) { return graph.entry; }
+  static std::vector<EdgeId> predecessors(const Graph& graph,
+                                          const NodeId& node) {
+    auto it = graph.preds.find(node);
+    return it == graph.preds.end() ? std::vector<EdgeId>() : it->second;
+  }
+  static std::vector<EdgeId> successors(const Graph& graph,
+                                        const NodeId& node) {
+    auto it = graph.succs.find(node);
+    return it == graph.succs.end() ? std::vector<EdgeId>() : it->second;
+  }
+  static NodeId source(const Graph&, const EdgeId& e) { return e.first; }
+  static NodeId target(const Graph&, const EdgeId& e) { return e.second; }
+};
+
+// The set of nodes on some path from the entry, inclusive.
+using Reached = HashedSetAbstractDomain<uint32_t>;
+
+template <typename Base>
+class ReachingAnalysis final : public Base {
+ public:
+  template <typename... Args>
+  explicit ReachingAnalysis(Args&&... args)
+      : Base(std::forward<Args>(args)...) {}
+
+  void analyze_node(const uint32_t& node, Reached* state) const override {
+    if (node == m_throw_at) {
+      throw std::runtime_error("analysis failure");
+    }
+    state->add(node);
+  }
+
+  Reached analyze_edge(const SimpleGraph::Edge&,
+                       const Reached& state) const override {
+    return state;
+  }
+
+  uint32_t m_throw_at{UINT32_MAX};
+};
+
+using SequentialAnalysis = ReachingAnalysis<
+    MonotonicFixpointIterator<SimpleGraphInterface, Reached>>;
+using ParallelAnalysis = ReachingAnalysis<
+    ParallelMonotonicFixpointIterator<SimpleGraphInterface, Reached>>;
+
+/*
+ * The entry fans out to many independent chains and loops, which all meet
+ * again at a join node:
+ *
+ *   0 -> 100k+1 -> 100k+2 -> 100k+3 -> 1, with a back edge 100k+3 -> 100k+1
+ *        for odd k.
+ */
+SimpleGraph make_fan_graph(uint32_t width) {
+  SimpleGraph graph;
+  for (uint32_t k = 1; k <= width; ++k) {
+    uint32_t base = 100 * k;
+    graph.add_edge(0, base + 1);
+    graph.add_edge(base + 1, base + 2);
+    graph.add_edge(base + 2, base + 3);
+    if (k % 2 == 1) {
+      graph.add_edge(base + 3, base + 1);
+    }
+    graph.add_edge(base + 3, 1);
+  }
+  graph.add_edge(1, 2);
+  return graph;
+}
+
+TEST(ParallelMonotonicFixpointIteratorTest, sameResultsAsSequential) {
+  auto graph = make_fan_graph(50);
+  SequentialAnalysis sequential(graph);
+  sequential.run(Reached());
+  for (size_t threads : {1, 2, 4, 8}) {
+    for (bool heads_only : {false, true}) {
+      ParallelAnalysis parallel(graph, threads, /* cfg_size_hint */ 4,
+                                heads_only);
+      parallel.run(Reached());
+      for (uint32_t node : {0u, 1u, 2u, 101u, 103u, 202u, 5003u}) {
+        EXPECT_TRUE(parallel.get_entry_state_at(node).equals(
+            sequential.get_entry_state_at(node)))
+            << node;
+        EXPECT_TRUE(parallel.get_exit_state_at(node).equals(
+            sequential.get_exit_state_at(node)))
+            << node;
+      }
+      EXPECT_EQ(parallel.get_exit_state_at(2).size(), 3 + 3 * 50);
+      EXPECT_THAT(parallel.get_exit_state_at(103).elements(),
+                  ::testing::UnorderedElementsAre(0, 101, 102, 103));
+      EXPECT_TRUE(parallel.get_exit_state_at(12345).is_bottom());
+    }
+  }
+}
+
+TEST(ParallelMonotonicFixpointIteratorTest, rethrowsFailures) {
+  auto graph = make_fan_graph(20);
+  ParallelAnalysis parallel(graph, /* num_threads */ 4);
+  parallel.m_throw_at = 702;
+  EXPECT_THROW(parallel.run(Reached()), std::runtime_error);
+}
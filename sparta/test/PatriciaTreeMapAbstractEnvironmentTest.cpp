@@ -280,3 +280,19 @@ TEST_F(PatriciaTreeMapAbstractEnvironmentTest, prettyPrinting) {
   out << e.bindings();
   EXPECT_EQ("{a -> [#1]{A}}", out.str());
 }
+
+TEST_F(PatriciaTreeMapAbstractEnvironmentTest, hashConsedEnvironments) {
+  HashConsedPatriciaTrees hash_consed;
+  for (size_t k = 0; k < 10; ++k) {
+    Environment e1 = generate_random_environment();
+    Environment e2 = generate_random_environment();
+    Environment joined = e1.join(e2);
+    EXPECT_TRUE(e1.leq(joined));
+    EXPECT_TRUE(e2.leq(joined));
+    // Memoized, so asked again gets the same answer.
+    EXPECT_TRUE(e1.leq(joined));
+    EXPECT_EQ(joined.leq(e1), hae_from_ptae(joined).leq(hae_from_ptae(e1)));
+    EXPECT_EQ(joined.leq(e1), joined.leq(e1));
+    EXPECT_TRUE(e1.join(e2).equals(joined));
+  }
+}
@@ -114,3 +114,21 @@ TEST(PatriciaTreeMapTest, mapOfUnsignedInt64) {
     EXPECT_EQ(it->second, e.second);
   }
 }
+
+TEST(PatriciaTreeMapTest, hashConsedTrees) {
+  HashConsedPatriciaTrees hash_consed;
+  pt_map m1, m2;
+  for (uint32_t k = 0; k < 100; ++k) {
+    m1.insert_or_assign(k, k % 7 + 1);
+  }
+  for (uint32_t k = 100; k-- > 0;) {
+    m2.insert_or_assign(k, k % 7 + 1);
+  }
+  EXPECT_TRUE(m1.reference_equals(m2));
+  m2.insert_or_assign(5, 42);
+  EXPECT_FALSE(m1.equals(m2));
+  m2.insert_or_assign(5, 5 % 7 + 1);
+  EXPECT_TRUE(m1.reference_equals(m2));
+  m2.insert_or_assign(3, 0);
+  EXPECT_FALSE(m1.equals(m2));
+}
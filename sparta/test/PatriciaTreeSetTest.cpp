@@ -12,6 +12,7 @@
 #include <random>
 #include <set>
 #include <sstream>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -309,3 +310,96 @@ TEST_F(PatriciaTreeSetTest, setOfUnsignedInt64) {
     EXPECT_EQ(1, values.count(x));
   }
 }
+
+TEST_F(PatriciaTreeSetTest, threadConfinedTrees) {
+  // Built normally, and then shared by trees built in confined mode.
+  pt_set shared = this->generate_random_set();
+  auto shared_elems = std::vector<uint32_t>(shared.begin(), shared.end());
+  {
+    ThreadConfinedPatriciaTrees confined;
+    for (size_t k = 0; k < 10; ++k) {
+      pt_set s = this->generate_random_set();
+      auto elems = std::vector<uint32_t>(s.begin(), s.end());
+      pt_set u = s.get_union_with(shared);
+      EXPECT_THAT(u, ::testing::UnorderedElementsAreArray(
+                         get_union(elems, shared_elems)));
+      pt_set i = u;
+      i.intersection_with(s);
+      EXPECT_TRUE(i.equals(s));
+      u.clear();
+    }
+  }
+  EXPECT_THAT(shared, ::testing::UnorderedElementsAreArray(shared_elems));
+
+  // Nodes built outside confined mode may be shared across threads.
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&shared, &shared_elems] {
+      for (size_t k = 0; k < 100; ++k) {
+        pt_set copy = shared;
+        copy.insert(k);
+        EXPECT_TRUE(copy.contains(k));
+        EXPECT_TRUE(shared.is_subset_of(copy));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(shared, ::testing::UnorderedElementsAreArray(shared_elems));
+}
+
+TEST_F(PatriciaTreeSetTest, hashConsedTrees) {
+  pt_set outside = this->generate_random_set();
+  auto elems = std::vector<uint32_t>(outside.begin(), outside.end());
+  {
+    HashConsedPatriciaTrees hash_consed;
+    // Equal trees built in different ways are the same tree.
+    pt_set forward, backward;
+    for (auto it = elems.begin(); it != elems.end(); ++it) {
+      forward.insert(*it);
+    }
+    for (auto it = elems.rbegin(); it != elems.rend(); ++it) {
+      backward.insert(*it);
+    }
+    EXPECT_TRUE(forward.reference_equals(backward));
+    EXPECT_TRUE(forward.equals(outside));
+    EXPECT_FALSE(forward.reference_equals(outside));
+
+    pt_set other;
+    for (size_t k = 0; k < 50; ++k) {
+      other.insert(k);
+    }
+    EXPECT_TRUE(forward.get_union_with(other).reference_equals(
+        other.get_union_with(backward)));
+    EXPECT_TRUE(forward.get_union_with(other).reference_equals(
+        forward.get_union_with(other)));
+    EXPECT_TRUE(forward.get_intersection_with(other).reference_equals(
+        backward.get_intersection_with(other)));
+    EXPECT_TRUE(forward.get_difference_with(other).is_subset_of(backward));
+    EXPECT_TRUE(other.is_subset_of(forward.get_union_with(other)));
+
+    // Trees built on other threads are hash-consed with these.
+    std::vector<std::thread> threads;
+    std::vector<pt_set> results(4);
+    for (size_t t = 0; t < 4; ++t) {
+      threads.emplace_back([&elems, &results, t] {
+        HashConsedPatriciaTrees scope;
+        for (auto e : elems) {
+          results[t].insert(e);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (const auto& s : results) {
+      EXPECT_TRUE(s.reference_equals(forward));
+    }
+  }
+  // Outside the scope, trees are built as usual.
+  pt_set s1 = pt_set{1, 2, 3};
+  pt_set s2 = pt_set{3, 2, 1};
+  EXPECT_TRUE(s1.equals(s2));
+  EXPECT_FALSE(s1.reference_equals(s2));
+}
@@ -158,6 +158,10 @@ TEST(ImmutableSubcomponentAnalyzerTest, findAccessPaths) {
         auto reg = analyzer.find_access_path_registers(insn, p);
         ASSERT_EQ(reg.size(), 1);
         ASSERT_EQ(*reg.begin(), 0);
+
+        auto bindings = analyzer.get_access_path_bindings(insn);
+        EXPECT_EQ(bindings.at(0), p);
+        EXPECT_EQ(bindings.at(1).to_string(), "p1.getA()");
       }
     }
   }
@@ -375,5 +375,18 @@ TEST(PointsToSemanticsTest, semanticActionGeneration) {
   }
   EXPECT_THAT(deserialization, ::testing::ContainerEq(method_semantics));
 
+  // Testing the binary serialization.
+  std::stringstream binary_serialization;
+  pt_semantics.write_binary(binary_serialization);
+  PointsToBinaryReader reader(binary_serialization);
+  std::set<std::string> binary_deserialization;
+  while (auto semantics_opt = reader.read()) {
+    std::ostringstream out;
+    out << *semantics_opt;
+    binary_deserialization.insert(out.str());
+  }
+  EXPECT_THAT(binary_deserialization,
+              ::testing::ContainerEq(method_semantics));
+
   delete g_redex;
 }
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AnalysisCache.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+namespace {
+
+// Counts how often it is computed.
+struct CountingAnalysis {
+  using Result = size_t;
+  static size_t runs;
+  static std::shared_ptr<const Result> run(const Scope& scope) {
+    ++runs;
+    return std::make_shared<const Result>(scope.size());
+  }
+};
+
+size_t CountingAnalysis::runs = 0;
+
+struct OtherAnalysis {
+  using Result = int;
+  static std::shared_ptr<const Result> run(const Scope&) {
+    return std::make_shared<const Result>(42);
+  }
+};
+
+} // namespace
+
+struct AnalysisCacheTest : public RedexTest {
+  AnalysisCacheTest() { CountingAnalysis::runs = 0; }
+};
+
+TEST_F(AnalysisCacheTest, reusesResultsUntilInvalidated) {
+  Scope scope;
+  AnalysisCache cache;
+  EXPECT_EQ(cache.get<CountingAnalysis>(scope), 0);
+  EXPECT_EQ(cache.get<CountingAnalysis>(scope), 0);
+  EXPECT_EQ(CountingAnalysis::runs, 1);
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+
+  cache.invalidate(PreservedAnalyses::all());
+  EXPECT_TRUE(cache.is_cached<CountingAnalysis>());
+
+  cache.invalidate(PreservedAnalyses::none());
+  EXPECT_FALSE(cache.is_cached<CountingAnalysis>());
+  cache.get<CountingAnalysis>(scope);
+  EXPECT_EQ(CountingAnalysis::runs, 2);
+}
+
+TEST_F(AnalysisCacheTest, invalidatesWhatIsNotPreserved) {
+  Scope scope;
+  AnalysisCache cache;
+  cache.get<CountingAnalysis>(scope);
+  EXPECT_EQ(cache.get<OtherAnalysis>(scope), 42);
+
+  cache.invalidate(PreservedAnalyses().preserve<OtherAnalysis>());
+  EXPECT_FALSE(cache.is_cached<CountingAnalysis>());
+  EXPECT_TRUE(cache.is_cached<OtherAnalysis>());
+}
+
+TEST_F(AnalysisCacheTest, sharedResultsOutliveInvalidation) {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  Scope scope{creator.create()};
+
+  AnalysisCache cache;
+  auto hierarchy = cache.get_shared<ClassHierarchyAnalysis>(scope);
+  cache.invalidate(PreservedAnalyses::none());
+  EXPECT_EQ(hierarchy->at(get_object_type()).count(scope[0]->get_type()), 1);
+  EXPECT_NE(&cache.get<ClassHierarchyAnalysis>(scope), hierarchy.get());
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ApiLevelChecker.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+namespace {
+
+DexClass* create_class(const char* name, int32_t api_level = -1) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  auto cls = creator.create();
+  if (api_level != -1) {
+    auto value = DexEncodedValue::zero_for_type(get_int_type());
+    value->value(api_level);
+    auto anno = new DexAnnotation(
+        DexType::make_type("Landroid/annotation/TargetApi;"), DAV_BUILD);
+    anno->add_element("value", value);
+    auto anno_set = new DexAnnotationSet();
+    anno_set->add_annotation(anno);
+    cls->attach_annotation_set(anno_set);
+  }
+  return cls;
+}
+
+} // namespace
+
+struct ApiLevelCheckerTest : public RedexTest {};
+
+TEST_F(ApiLevelCheckerTest, innerClassesTakeTheLevelOfTheirOuterClass) {
+  auto outer = create_class("LOuter;", 21);
+  auto inner = create_class("LOuter$Inner;");
+  auto inner_inner = create_class("LOuter$Inner$1;");
+  auto annotated_inner = create_class("LOuter$Inner$2;", 24);
+  auto annotated_inner_inner = create_class("LOuter$Inner$2$1;");
+  auto plain = create_class("Lcom/foo$/Plain;");
+  Scope scope{annotated_inner_inner, inner_inner, annotated_inner,
+              inner,                 outer,       plain};
+  api::LevelChecker::init(15, scope);
+
+  EXPECT_EQ(api::LevelChecker::get_class_level(outer), 21);
+  EXPECT_EQ(api::LevelChecker::get_class_level(inner), 21);
+  EXPECT_EQ(api::LevelChecker::get_class_level(inner_inner), 21);
+  EXPECT_EQ(api::LevelChecker::get_class_level(annotated_inner), 24);
+  EXPECT_EQ(api::LevelChecker::get_class_level(annotated_inner_inner), 24);
+  EXPECT_EQ(api::LevelChecker::get_class_level(plain), 15);
+
+  // The outer class need not be in the scope.
+  auto lone_inner = create_class("LOuter$Lone;");
+  api::LevelChecker::init(15, {lone_inner});
+  EXPECT_EQ(api::LevelChecker::get_class_level(lone_inner), 21);
+}
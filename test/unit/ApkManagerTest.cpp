@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ApkManager.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+#include <random>
+#include <zlib.h>
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+struct Entry {
+  uint16_t method;
+  std::string contents;
+};
+
+uint32_t get32(const std::string& data, size_t off) {
+  return (uint8_t)data[off] | (uint8_t)data[off + 1] << 8 |
+         (uint8_t)data[off + 2] << 16 | (uint32_t)(uint8_t)data[off + 3] << 24;
+}
+
+uint16_t get16(const std::string& data, size_t off) {
+  return (uint8_t)data[off] | (uint8_t)data[off + 1] << 8;
+}
+
+// Reads the entries back through the central directory, and checks their
+// CRCs on the way.
+std::map<std::string, Entry> read_zip(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  size_t eocd = data.size() - 22;
+  EXPECT_EQ(get32(data, eocd), 0x06054b50);
+  size_t count = get16(data, eocd + 10);
+  size_t cd = get32(data, eocd + 16);
+  std::map<std::string, Entry> entries;
+  for (size_t i = 0; i < count; i++) {
+    EXPECT_EQ(get32(data, cd), 0x02014b50);
+    uint16_t method = get16(data, cd + 10);
+    uint32_t crc = get32(data, cd + 16);
+    uint32_t comp_size = get32(data, cd + 20);
+    uint32_t size = get32(data, cd + 24);
+    uint16_t name_len = get16(data, cd + 28);
+    uint32_t local = get32(data, cd + 42);
+    std::string name = data.substr(cd + 46, name_len);
+    cd += 46 + name_len;
+
+    EXPECT_EQ(get32(data, local), 0x04034b50);
+    size_t start = local + 30 + get16(data, local + 26);
+    std::string contents(size, '\0');
+    if (method == 8) {
+      z_stream stream{};
+      inflateInit2(&stream, -MAX_WBITS);
+      stream.next_in = (Bytef*)&data[start];
+      stream.avail_in = comp_size;
+      stream.next_out = (Bytef*)&contents[0];
+      stream.avail_out = size;
+      EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+      inflateEnd(&stream);
+    } else {
+      EXPECT_EQ(comp_size, size);
+      contents = data.substr(start, size);
+    }
+    EXPECT_EQ(crc32(0, (const Bytef*)contents.data(), contents.size()), crc);
+    entries[name] = Entry{method, contents};
+  }
+  return entries;
+}
+
+void write_file(const fs::path& path, const std::string& contents) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path.string(), std::ios::binary) << contents;
+}
+
+} // namespace
+
+TEST(ApkManagerTest, writeApk) {
+  auto tmpdir = fs::temp_directory_path() / fs::unique_path("apk-%%%%%%");
+  auto apk_dir = tmpdir / "apk";
+  std::string dex(100000, 'x');
+  std::mt19937 gen(42);
+  std::string random;
+  for (int i = 0; i < 1000; i++) {
+    random.push_back((char)gen());
+  }
+  write_file(apk_dir / "classes.dex", dex);
+  write_file(apk_dir / "resources.arsc", dex);
+  write_file(apk_dir / "res/drawable/icon.png", dex);
+  write_file(apk_dir / "assets/random.bin", random);
+  write_file(apk_dir / "assets/empty", "");
+  for (int i = 0; i < 50; i++) {
+    write_file(apk_dir / "res/raw" / ("f" + std::to_string(i)),
+               std::string(i * 100, 'a' + i % 26));
+  }
+
+  ApkWriteOptions options;
+  options.stored_entries.insert("resources.arsc");
+  options.num_threads = 3;
+  auto apk = (tmpdir / "out.apk").string();
+  ApkManager mgr(std::string(apk_dir.string()));
+  EXPECT_EQ(mgr.write_apk(apk, options), 55);
+
+  auto entries = read_zip(apk);
+  ASSERT_EQ(entries.size(), 55);
+  EXPECT_EQ(entries["classes.dex"].method, 8);
+  EXPECT_EQ(entries["classes.dex"].contents, dex);
+  EXPECT_EQ(entries["resources.arsc"].method, 0);
+  EXPECT_EQ(entries["resources.arsc"].contents, dex);
+  EXPECT_EQ(entries["res/drawable/icon.png"].method, 0);
+  EXPECT_EQ(entries["assets/empty"].method, 0);
+  EXPECT_EQ(entries["assets/empty"].contents, "");
+  for (int i = 0; i < 50; i++) {
+    EXPECT_EQ(entries["res/raw/f" + std::to_string(i)].contents,
+              std::string(i * 100, 'a' + i % 26));
+  }
+  // Incompressible contents are stored rather than deflated.
+  EXPECT_EQ(entries["assets/random.bin"].method, 0);
+  EXPECT_EQ(entries["assets/random.bin"].contents, random);
+
+  fs::remove_all(tmpdir);
+}
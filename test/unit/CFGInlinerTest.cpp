@@ -766,3 +766,65 @@ TEST(CFGInliner, try_catch_callee_has_chain) {
   )";
   test_inliner(caller_str, callee_str, expected_str);
 }
+
+TEST(CFGInliner, batch) {
+  g_redex = new RedexContext();
+
+  auto caller_code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (invoke-static (v0) "LCls;.foo:(I)V")
+      (invoke-static (v0) "LCls;.bar:(I)V")
+      (return-void)
+    )
+  )");
+  caller_code->build_cfg(true);
+  auto& caller = caller_code->cfg();
+  auto foo_code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (const v1 1)
+      (return-void)
+    )
+  )");
+  foo_code->build_cfg(true);
+  auto bar_code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (const v1 2)
+      (return-void)
+    )
+  )");
+  bar_code->build_cfg(true);
+
+  std::vector<IRInstruction*> invokes;
+  for (const auto& mie : cfg::InstructionIterable(caller)) {
+    if (is_invoke(mie.insn->opcode())) {
+      invokes.push_back(mie.insn);
+    }
+  }
+  ASSERT_EQ(invokes.size(), 2);
+  cfg::CFGInliner::inline_cfgs(
+      &caller,
+      {{invokes[0], &foo_code->cfg()}, {invokes[1], &bar_code->cfg()}});
+
+  // The last callsite is inlined first, so its callee gets the lower
+  // registers.
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (move v3 v0)
+      (const v4 1)
+      (move v1 v0)
+      (const v2 2)
+      (return-void)
+    )
+  )");
+  const std::string& final_cfg = show(caller);
+  caller_code->clear_cfg();
+  EXPECT_EQ(assembler::to_string(expected_code.get()),
+            assembler::to_string(caller_code.get()))
+      << final_cfg;
+
+  delete g_redex;
+}
@@ -0,0 +1,296 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CallGraph.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <mutex>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Walkers.h"
+
+namespace {
+
+/*
+ * Every resolved invoke is an edge, and the roots are given explicitly.
+ */
+class TestStrategy final : public call_graph::BuildStrategy {
+ public:
+  explicit TestStrategy(std::vector<DexMethod*> roots) : m_roots(roots) {}
+
+  std::vector<DexMethod*> get_roots() const override { return m_roots; }
+
+  call_graph::CallSites get_callsites(const DexMethod* method) const override {
+    call_graph::CallSites callsites;
+    auto* code = const_cast<IRCode*>(method->get_code());
+    if (code == nullptr) {
+      return callsites;
+    }
+    for (auto& mie : InstructionIterable(code)) {
+      if (is_invoke(mie.insn->opcode())) {
+        auto callee =
+            resolve_method(mie.insn->get_method(), MethodSearch::Static);
+        if (callee != nullptr) {
+          callsites.emplace_back(callee, code->iterator_to(mie));
+        }
+      }
+    }
+    return callsites;
+  }
+
+ private:
+  std::vector<DexMethod*> m_roots;
+};
+
+std::vector<DexMethod*> callees(const call_graph::Graph& graph,
+                                const DexMethod* method) {
+  std::vector<DexMethod*> result;
+  for (const auto& edge : graph.node(method).callees()) {
+    result.push_back(edge->callee());
+  }
+  return result;
+}
+
+std::vector<DexMethod*> callers(const call_graph::Graph& graph,
+                                const DexMethod* method) {
+  std::vector<DexMethod*> result;
+  for (const auto& edge : graph.node(method).callers()) {
+    result.push_back(edge->caller());
+  }
+  return result;
+}
+
+} // namespace
+
+class CallGraphTest : public RedexTest {
+ public:
+  CallGraphTest() {
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    m_a = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.a:()V"
+       (
+        (invoke-static () "LFoo;.b:()V")
+        (invoke-static () "LFoo;.c:()V")
+        (invoke-static () "LFoo;.b:()V")
+        (return-void)
+       )
+      )
+    )");
+    m_b = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.b:()V"
+       (
+        (invoke-static () "LFoo;.c:()V")
+        (return-void)
+       )
+      )
+    )");
+    m_c = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.c:()V"
+       (
+        (invoke-static () "LFoo;.a:()V")
+        (return-void)
+       )
+      )
+    )");
+    // Not reachable from the root.
+    m_d = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.d:()V"
+       (
+        (invoke-static () "LFoo;.a:()V")
+        (return-void)
+       )
+      )
+    )");
+    for (auto* m : {m_a, m_b, m_c, m_d}) {
+      creator.add_method(m);
+    }
+    m_scope.push_back(creator.create());
+  }
+
+  Scope m_scope;
+  DexMethod* m_a;
+  DexMethod* m_b;
+  DexMethod* m_c;
+  DexMethod* m_d;
+};
+
+TEST_F(CallGraphTest, csrLayout) {
+  call_graph::Graph graph(TestStrategy({m_a}));
+
+  EXPECT_EQ(graph.num_nodes(), 4);
+  EXPECT_EQ(graph.num_edges(), 6);
+  EXPECT_FALSE(graph.has_node(m_d));
+  EXPECT_FALSE(graph.has_node(nullptr));
+
+  EXPECT_EQ(callees(graph, nullptr), std::vector<DexMethod*>({m_a}));
+  EXPECT_EQ(callees(graph, m_a), std::vector<DexMethod*>({m_b, m_c, m_b}));
+  EXPECT_EQ(callees(graph, m_b), std::vector<DexMethod*>({m_c}));
+  EXPECT_EQ(callers(graph, m_a), std::vector<DexMethod*>({nullptr, m_c}));
+  // The callsites are visited depth first, so b's call is found before a's.
+  EXPECT_EQ(callers(graph, m_c), std::vector<DexMethod*>({m_b, m_a}));
+
+  // Node ids are dense, with the ghost entry first.
+  EXPECT_EQ(graph.entry().id(), 0);
+  for (uint32_t id = 0; id < graph.num_nodes(); ++id) {
+    EXPECT_EQ(graph.node_at(id).id(), id);
+  }
+
+  // The edges of a node are contiguous.
+  const auto& a_callees = graph.node(m_a).callees();
+  EXPECT_EQ(a_callees.end() - a_callees.begin(), 3);
+  EXPECT_EQ(a_callees[0]->invoke_iterator()->insn->get_method(), m_b);
+
+  // Copies share the storage.
+  auto copy = graph;
+  EXPECT_EQ(&copy.node(m_a), &graph.node(m_a));
+}
+
+TEST_F(CallGraphTest, parallelBuildMatchesSerialBuild) {
+  TestStrategy strategy({m_a});
+  call_graph::Graph serial(strategy);
+  for (size_t num_threads : {1, 2, 4}) {
+    auto parallel =
+        call_graph::build_graph_in_parallel(m_scope, strategy, num_threads);
+    ASSERT_EQ(parallel.num_nodes(), serial.num_nodes());
+    ASSERT_EQ(parallel.num_edges(), serial.num_edges());
+    EXPECT_FALSE(parallel.has_node(m_d));
+    for (const DexMethod* m : {(DexMethod*)nullptr, m_a, m_b, m_c}) {
+      EXPECT_EQ(parallel.node(m).id(), serial.node(m).id());
+      EXPECT_EQ(callees(parallel, m), callees(serial, m));
+      EXPECT_EQ(callers(parallel, m), callers(serial, m));
+    }
+  }
+}
+
+TEST_F(CallGraphTest, graphInterface) {
+  call_graph::Graph graph(TestStrategy({m_a}));
+  using GI = call_graph::GraphInterface;
+  EXPECT_EQ(GI::entry(graph), nullptr);
+  auto succs = GI::successors(graph, m_a);
+  ASSERT_EQ(succs.size(), 3);
+  EXPECT_EQ(GI::source(graph, succs[0]), m_a);
+  EXPECT_EQ(GI::target(graph, succs[1]), m_c);
+  EXPECT_EQ(GI::predecessors(graph, m_b).size(), 2);
+}
+
+TEST_F(CallGraphTest, sccs) {
+  ClassCreator creator(DexType::make_type("LBar;"));
+  creator.set_super(get_object_type());
+  auto r = assembler::method_from_string(R"(
+    (method (public static) "LBar;.r:()V"
+     (
+      (invoke-static () "LBar;.x:()V")
+      (invoke-static () "LBar;.y:()V")
+      (invoke-static () "LFoo;.a:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto x = assembler::method_from_string(R"(
+    (method (public static) "LBar;.x:()V"
+     (
+      (invoke-static () "LBar;.z:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto y = assembler::method_from_string(R"(
+    (method (public static) "LBar;.y:()V"
+     (
+      (invoke-static () "LBar;.z:()V")
+      (invoke-static () "LFoo;.b:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto z = assembler::method_from_string(R"(
+    (method (public static) "LBar;.z:()V"
+     (
+      (invoke-static () "LBar;.z:()V")
+      (return-void)
+     )
+    )
+  )");
+  for (auto* m : {r, x, y, z}) {
+    creator.add_method(m);
+  }
+  m_scope.push_back(creator.create());
+
+  call_graph::Graph graph(TestStrategy({r}));
+  call_graph::Sccs sccs(graph);
+
+  // {a, b, c}, {z}, {x}, {y}, {r}
+  ASSERT_EQ(sccs.size(), 5);
+  auto abc = sccs.scc_of(m_a);
+  EXPECT_EQ(sccs.scc_of(m_b), abc);
+  EXPECT_EQ(sccs.scc_of(m_c), abc);
+  EXPECT_EQ(sccs.members(abc).size(), 3);
+  EXPECT_TRUE(sccs.is_recursive(abc));
+  EXPECT_TRUE(sccs.is_recursive(sccs.scc_of(z)));
+  EXPECT_FALSE(sccs.is_recursive(sccs.scc_of(x)));
+  EXPECT_EQ(sccs.scc_of(r), sccs.size() - 1);
+
+  // Bottom-up numbering.
+  for (call_graph::Sccs::SccId id = 0; id < sccs.size(); ++id) {
+    for (auto callee : sccs.callee_sccs(id)) {
+      EXPECT_LT(callee, id);
+    }
+  }
+  std::vector<call_graph::Sccs::SccId> y_callees(
+      sccs.callee_sccs(sccs.scc_of(y)).begin(),
+      sccs.callee_sccs(sccs.scc_of(y)).end());
+  std::sort(y_callees.begin(), y_callees.end());
+  EXPECT_EQ(y_callees,
+            std::vector<call_graph::Sccs::SccId>(
+                {std::min(abc, sccs.scc_of(z)), std::max(abc, sccs.scc_of(z))}));
+  EXPECT_EQ(sccs.caller_sccs(sccs.scc_of(z)).size(), 2);
+
+  for (size_t num_threads : {1, 2, 4}) {
+    std::mutex mutex;
+    std::vector<call_graph::Sccs::SccId> order;
+    call_graph::parallel_bottom_up(
+        sccs,
+        [&](call_graph::Sccs::SccId id) {
+          std::lock_guard<std::mutex> lock(mutex);
+          order.push_back(id);
+        },
+        num_threads);
+    ASSERT_EQ(order.size(), sccs.size());
+    std::vector<size_t> position(sccs.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      position[order[i]] = i;
+    }
+    for (call_graph::Sccs::SccId id = 0; id < sccs.size(); ++id) {
+      for (auto callee : sccs.callee_sccs(id)) {
+        EXPECT_LT(position[callee], position[id]);
+      }
+    }
+
+    order.clear();
+    call_graph::parallel_top_down(
+        sccs,
+        [&](call_graph::Sccs::SccId id) {
+          std::lock_guard<std::mutex> lock(mutex);
+          order.push_back(id);
+        },
+        num_threads);
+    ASSERT_EQ(order.size(), sccs.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      position[order[i]] = i;
+    }
+    for (call_graph::Sccs::SccId id = 0; id < sccs.size(); ++id) {
+      for (auto callee : sccs.callee_sccs(id)) {
+        EXPECT_GT(position[callee], position[id]);
+      }
+    }
+  }
+}
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ColdStartClinits.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace coldstart_clinits;
+
+class ColdStartClinitsTest : public RedexTest {
+ protected:
+  DexClass* make_class(const char* name,
+                       const char* clinit,
+                       DexType* super = get_object_type()) {
+    ClassCreator creator(DexType::make_type(name));
+    creator.set_super(super);
+    auto field = static_cast<DexField*>(
+        DexField::make_field(std::string(name) + ".f:I"));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL,
+                         DexEncodedValue::zero_for_type(get_int_type()));
+    creator.add_field(field);
+    if (clinit != nullptr) {
+      creator.add_method(assembler::method_from_string(clinit));
+    }
+    return creator.create();
+  }
+};
+
+TEST_F(ColdStartClinitsTest, graphFollowsInitializationTriggers) {
+  auto b = make_class("LB;", nullptr);
+  auto c = make_class("LC;", nullptr, b->get_type());
+  auto d = make_class("LD;", nullptr);
+  auto a = make_class("LA;", R"(
+    (method (public static) "LA;.<clinit>:()V"
+     (
+      (sget "LC;.f:I")
+      (move-result-pseudo v0)
+      (sput v0 "LA;.f:I")
+      (return-void)
+     )
+    )
+  )");
+  // Not reached from a.
+  make_class("LE;", nullptr, d->get_type());
+
+  InitGraph graph({a});
+  // The field of c is declared by c itself, and initializing c initializes b.
+  EXPECT_EQ(graph.classes(), Scope({a, c, b}));
+  EXPECT_EQ(graph.dependencies(a), std::vector<DexClass*>({c}));
+  EXPECT_EQ(graph.dependencies(c), std::vector<DexClass*>({b}));
+  EXPECT_TRUE(graph.dependencies(b).empty());
+  EXPECT_EQ(graph.num_edges(), 2);
+}
+
+TEST_F(ColdStartClinitsTest, constantClinitsAreRemoved) {
+  auto b = make_class("LB;", R"(
+    (method (public static) "LB;.<clinit>:()V"
+     (
+      (const v0 42)
+      (sput v0 "LB;.f:I")
+      (return-void)
+     )
+    )
+  )");
+  auto a = make_class("LA;", R"(
+    (method (public static) "LA;.<clinit>:()V"
+     (
+      (sget "LB;.f:I")
+      (move-result-pseudo v0)
+      (add-int/lit8 v0 v0 1)
+      (sput v0 "LA;.f:I")
+      (return-void)
+     )
+    )
+  )");
+  // Not a cold start class, and left alone.
+  auto c = make_class("LC;", R"(
+    (method (public static) "LC;.<clinit>:()V"
+     (
+      (const v0 1)
+      (sput v0 "LC;.f:I")
+      (return-void)
+     )
+    )
+  )");
+
+  auto stats = simplify_clinits({a});
+  EXPECT_FALSE(stats.has_cycle);
+  EXPECT_EQ(stats.num_classes, 2);
+  EXPECT_EQ(stats.num_clinits, 2);
+  EXPECT_EQ(stats.num_clinits_removed, 2);
+  EXPECT_EQ(stats.num_instructions, 7);
+  EXPECT_EQ(stats.num_instructions_saved, 7);
+  EXPECT_EQ(a->get_clinit(), nullptr);
+  EXPECT_EQ(b->get_clinit(), nullptr);
+  EXPECT_EQ(a->get_sfields()[0]->get_static_value()->value(), 43);
+  EXPECT_NE(c->get_clinit(), nullptr);
+}
+
+TEST_F(ColdStartClinitsTest, cyclesAreLeftAlone) {
+  auto a = make_class("LA;", R"(
+    (method (public static) "LA;.<clinit>:()V"
+     (
+      (sget "LB;.f:I")
+      (move-result-pseudo v0)
+      (sput v0 "LA;.f:I")
+      (return-void)
+     )
+    )
+  )");
+  auto b = make_class("LB;", R"(
+    (method (public static) "LB;.<clinit>:()V"
+     (
+      (sget "LA;.f:I")
+      (move-result-pseudo v0)
+      (sput v0 "LB;.f:I")
+      (return-void)
+     )
+    )
+  )");
+
+  auto stats = simplify_clinits({a});
+  EXPECT_TRUE(stats.has_cycle);
+  EXPECT_EQ(stats.num_clinits, 2);
+  EXPECT_EQ(stats.num_instructions, 6);
+  EXPECT_EQ(stats.num_instructions_saved, 0);
+  EXPECT_NE(a->get_clinit(), nullptr);
+  EXPECT_NE(b->get_clinit(), nullptr);
+}
@@ -1267,3 +1267,132 @@ TEST_F(CommonSubexpressionEliminationTest, array_length) {
   )";
   test(Scope{type_class(get_object_type())}, code_str, expected_str, 1);
 }
+
+TEST_F(CommonSubexpressionEliminationTest, location_bit_sets) {
+  cse_impl::LocationBitSet empty;
+  cse_impl::LocationBitSet a({3, 70, 200});
+  cse_impl::LocationBitSet b({4, 71, 201});
+  cse_impl::LocationBitSet c({1000, 200});
+  EXPECT_TRUE(a.contains(70));
+  EXPECT_FALSE(a.contains(71));
+  EXPECT_FALSE(empty.contains(0));
+  EXPECT_FALSE(a.intersects(b));
+  EXPECT_FALSE(a.intersects(empty));
+  EXPECT_TRUE(a.intersects(c));
+  EXPECT_TRUE(c.intersects(a));
+}
+
+TEST_F(CommonSubexpressionEliminationTest, method_barriers_are_reused) {
+  ClassCreator creator(DexType::make_type("LTest7;"));
+  creator.set_super(get_object_type());
+
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LTest7;.test7:()V"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (sput v0 "LFoo;.s:I")
+      (return-void)
+    )
+  )"));
+  creator.add_method(method);
+  Scope scope{type_class(get_object_type()), creator.create()};
+
+  cse_impl::MethodBarriersCache cache;
+  auto init_method_barriers = [&]() {
+    cse_impl::SharedState shared_state(&cache);
+    auto stats = shared_state.init_method_barriers(scope, 10);
+    method->get_code()->clear_cfg();
+    shared_state.cache_method_barriers(method);
+    return stats.reused_method_barriers;
+  };
+  EXPECT_EQ(init_method_barriers(), 0);
+  EXPECT_EQ(init_method_barriers(), 1);
+
+  // Mutable access that leaves the code as it was keeps the cached barriers,
+  // and a change through it invalidates them.
+  method->get_code();
+  EXPECT_EQ(init_method_barriers(), 1);
+  method->get_code()->push_back(new IRInstruction(OPCODE_NOP));
+  EXPECT_EQ(init_method_barriers(), 0);
+  EXPECT_EQ(init_method_barriers(), 1);
+
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (sput v0 "LFoo;.t:I")
+      (return-void)
+    )
+  )"));
+  EXPECT_EQ(init_method_barriers(), 0);
+  EXPECT_EQ(init_method_barriers(), 1);
+}
+
+namespace {
+
+cse_impl::Stats run_cse(IRCode* code, cse_impl::Strategy strategy) {
+  auto field_s = static_cast<DexField*>(DexField::make_field("LFoo;.s:I"));
+  field_s->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+  code->build_cfg(/* editable */ true);
+  cse_impl::SharedState shared_state;
+  shared_state.init_method_barriers(Scope{type_class(get_object_type())}, 10);
+  cse_impl::CommonSubexpressionElimination cse(&shared_state, code->cfg(),
+                                               strategy);
+  cse.patch(/* is_static */ true, nullptr, DexTypeList::make_type_list({}));
+  code->clear_cfg();
+  return cse.get_stats();
+}
+
+} // namespace
+
+TEST_F(CommonSubexpressionEliminationTest, dominator_scoped_walk) {
+  // The read on one side of the branch is redundant, but not the one after
+  // the join, as the other side writes the field.
+  auto code_str = R"(
+    (
+      (sget "LFoo;.s:I")
+      (move-result-pseudo v0)
+      (if-eqz v0 :else)
+      (sget "LFoo;.s:I")
+      (move-result-pseudo v1)
+      (goto :join)
+      (:else)
+      (sput v0 "LFoo;.s:I")
+      (:join)
+      (sget "LFoo;.s:I")
+      (move-result-pseudo v2)
+      (return-void)
+    )
+  )";
+  auto fixpoint_code = assembler::ircode_from_string(code_str);
+  auto fixpoint_stats =
+      run_cse(fixpoint_code.get(), cse_impl::Strategy::Fixpoint);
+  EXPECT_EQ(fixpoint_stats.methods_using_dominator_scoped_walk, 0);
+
+  auto scoped_code = assembler::ircode_from_string(code_str);
+  auto scoped_stats = run_cse(scoped_code.get(), cse_impl::Strategy::Auto);
+  EXPECT_EQ(scoped_stats.methods_using_dominator_scoped_walk, 1);
+  EXPECT_EQ(scoped_stats.instructions_eliminated, 1);
+  EXPECT_EQ(scoped_stats.instructions_eliminated,
+            fixpoint_stats.instructions_eliminated);
+  EXPECT_EQ(assembler::to_s_expr(scoped_code.get()),
+            assembler::to_s_expr(fixpoint_code.get()));
+}
+
+TEST_F(CommonSubexpressionEliminationTest, loops_use_the_fixpoint) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (:loop)
+      (sget "LFoo;.s:I")
+      (move-result-pseudo v1)
+      (add-int v0 v0 v1)
+      (if-eqz v0 :loop)
+      (return-void)
+    )
+  )");
+  auto stats = run_cse(code.get(), cse_impl::Strategy::Auto);
+  EXPECT_EQ(stats.methods_using_dominator_scoped_walk, 0);
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ConcurrentContainers.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+//==========
+// Compares ConcurrentMap (exclusive slot locks, fixed slot count) against
+// SharedConcurrentMap (reader/writer slot locks, slot count scaled to the
+// machine) under read-heavy and write-heavy mixes.
+//==========
+
+constexpr size_t NUM_KEYS = 100'000;
+constexpr size_t OPS_PER_THREAD = 1'000'000;
+
+template <class Map>
+double run_mix(Map& map, size_t num_threads, unsigned write_percent) {
+  for (size_t k = 0; k < NUM_KEYS; ++k) {
+    map.insert({k, k});
+  }
+  std::atomic<size_t> sink{0};
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 gen(t);
+      std::uniform_int_distribution<size_t> key_dist(0, NUM_KEYS - 1);
+      std::uniform_int_distribution<unsigned> op_dist(0, 99);
+      size_t local = 0;
+      for (size_t i = 0; i < OPS_PER_THREAD; ++i) {
+        auto key = key_dist(gen);
+        if (op_dist(gen) < write_percent) {
+          map.insert_or_assign({key, i});
+        } else {
+          local += map.get(key, 0);
+        }
+      }
+      sink += local;
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void compare(size_t num_threads, unsigned write_percent) {
+  ConcurrentMap<size_t, size_t> exclusive;
+  SharedConcurrentMap<size_t, size_t> shared;
+  double exclusive_ms = run_mix(exclusive, num_threads, write_percent);
+  double shared_ms = run_mix(shared, num_threads, write_percent);
+  printf("%2zu threads, %3u%% writes: ConcurrentMap %8.1f ms, "
+         "SharedConcurrentMap (%zu slots) %8.1f ms, speedup %.2fx\n",
+         num_threads, write_percent, exclusive_ms, shared.n_slots(), shared_ms,
+         exclusive_ms / shared_ms);
+}
+
+int main() {
+  size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned write_percent : {0u, 1u, 10u, 50u}) {
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+      compare(threads, write_percent);
+    }
+  }
+}
@@ -232,3 +232,72 @@ TEST_F(ConcurrentContainersTest, concurrentMapTest) {
   map.clear();
   EXPECT_EQ(0, map.size());
 }
+
+TEST_F(ConcurrentContainersTest, sharedConcurrentMapTest) {
+  SharedConcurrentMap<std::string, uint32_t> map;
+  EXPECT_GE(map.n_slots(), 31);
+
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      std::string s = std::to_string(sample[i]);
+      map.insert({s, sample[i]});
+      EXPECT_EQ(1, map.count(s));
+      EXPECT_EQ(sample[i], map.at(s));
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), map.size());
+  for (uint32_t x : m_data) {
+    std::string s = std::to_string(x);
+    EXPECT_EQ(1, map.count(s));
+    EXPECT_EQ(x, map.get(s, 0));
+    auto it = map.find(s);
+    EXPECT_NE(map.end(), it);
+    EXPECT_EQ(s, it->first);
+    EXPECT_EQ(x, it->second);
+  }
+  size_t iterated = 0;
+  for (const auto& p : map) {
+    EXPECT_EQ(std::to_string(p.second), p.first);
+    ++iterated;
+  }
+  EXPECT_EQ(map.size(), iterated);
+
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      std::string s = std::to_string(sample[i]);
+      map.update(s, [](const std::string&, uint32_t& value, bool key_exists) {
+        EXPECT_TRUE(key_exists);
+        ++value;
+      });
+    }
+  });
+
+  auto copy = map;
+
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      map.erase(std::to_string(sample[i]));
+    }
+  });
+  EXPECT_EQ(0, map.size());
+  EXPECT_EQ(map.begin(), map.end());
+  for (uint32_t x : m_data) {
+    std::string s = std::to_string(x);
+    EXPECT_EQ(0, map.count(s));
+    EXPECT_EQ(map.end(), map.find(s));
+    EXPECT_EQ(7, map.get(s, 7));
+  }
+
+  // Check that copy is unchanged.
+  EXPECT_EQ(m_data_set.size(), copy.size());
+  auto moved = std::move(copy);
+  EXPECT_EQ(m_data_set.size(), moved.size());
+
+  SharedConcurrentMap<std::string, uint32_t> small(/* n_slots */ 3);
+  small.insert({{"a", 1}, {"b", 2}, {"c", 3}});
+  EXPECT_EQ(3, small.size());
+  small.insert_or_assign({"a", 4});
+  EXPECT_EQ(4, small.at("a"));
+  small.clear();
+  EXPECT_EQ(0, small.size());
+}
@@ -283,6 +283,38 @@ TEST(Configurable, TypesBindFlags) {
   }
 }
 
+TEST(Configurable, TypeListsAreResolvedOnce) {
+  g_redex = new RedexContext();
+  auto type1 = DexType::make_type("Ltype1;");
+  Json::Value json;
+  json["types_param"].append("Ltype1;");
+  json["types_param"].append("Ltype2;");
+
+  // Lists with unresolvable types are not cached.
+  TypesBindFlags c;
+  c.parse_config(JsonWrapper(json));
+  EXPECT_EQ(std::unordered_set<DexType*>({type1}), c.m_types_param);
+  auto& cache = g_redex->config_type_list_cache();
+  EXPECT_EQ(nullptr, cache.get(json["types_param"]));
+
+  auto type2 = DexType::make_type("Ltype2;");
+  c.parse_config(JsonWrapper(json));
+  EXPECT_EQ(std::unordered_set<DexType*>({type1, type2}), c.m_types_param);
+  auto cached = cache.get(json["types_param"]);
+  ASSERT_NE(nullptr, cached);
+  EXPECT_EQ(std::vector<DexType*>({type1, type2}), *cached);
+
+  // Another Configurable binding the same list gets the cached types.
+  TypesBindFlags other;
+  other.parse_config(JsonWrapper(json));
+  EXPECT_EQ(c.m_types_param, other.m_types_param);
+  EXPECT_EQ(cached, cache.get(json["types_param"]));
+
+  // Renaming a type invalidates the resolved lists.
+  type2->set_name(DexString::make_string("Ltype3;"));
+  EXPECT_EQ(nullptr, cache.get(json["types_param"]));
+}
+
 struct MethodsBindFlags : public Base {
   MethodsBindFlags(bindflags_t bindflags = 0) { m_bindflags = bindflags; }
   void bind_config() override {
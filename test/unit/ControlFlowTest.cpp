@@ -248,12 +248,12 @@ TEST(ControlFlow, findImmediateDominator) {
     cfg.add_edge(b4, b5, EDGE_GOTO);
     cfg.add_edge(b2, b5, EDGE_GOTO);
     auto idom = cfg.immediate_dominators();
-    EXPECT_EQ(idom[b0].dom, b0);
-    EXPECT_EQ(idom[b1].dom, b0);
-    EXPECT_EQ(idom[b3].dom, b0);
-    EXPECT_EQ(idom[b2].dom, b1);
-    EXPECT_EQ(idom[b4].dom, b3);
-    EXPECT_EQ(idom[b5].dom, b0);
+    EXPECT_EQ(idom[b0->id()].dom, b0);
+    EXPECT_EQ(idom[b1->id()].dom, b0);
+    EXPECT_EQ(idom[b3->id()].dom, b0);
+    EXPECT_EQ(idom[b2->id()].dom, b1);
+    EXPECT_EQ(idom[b4->id()].dom, b3);
+    EXPECT_EQ(idom[b5->id()].dom, b0);
   }
   {
     //                 +---------+
@@ -285,15 +285,50 @@ TEST(ControlFlow, findImmediateDominator) {
     cfg.add_edge(b4, b5, EDGE_GOTO);
     cfg.add_edge(b2, b5, EDGE_GOTO);
     auto idom = cfg.immediate_dominators();
-    EXPECT_EQ(idom[b0].dom, b0);
-    EXPECT_EQ(idom[b1].dom, b0);
-    EXPECT_EQ(idom[b3].dom, b1);
-    EXPECT_EQ(idom[b2].dom, b1);
-    EXPECT_EQ(idom[b4].dom, b3);
-    EXPECT_EQ(idom[b5].dom, b1);
+    EXPECT_EQ(idom[b0->id()].dom, b0);
+    EXPECT_EQ(idom[b1->id()].dom, b0);
+    EXPECT_EQ(idom[b3->id()].dom, b1);
+    EXPECT_EQ(idom[b2->id()].dom, b1);
+    EXPECT_EQ(idom[b4->id()].dom, b3);
+    EXPECT_EQ(idom[b5->id()].dom, b1);
   }
 }
 
+TEST(ControlFlow, adjacencyAndIdsAfterRemoval) {
+  ControlFlowGraph cfg;
+  auto b0 = cfg.create_block();
+  auto b1 = cfg.create_block();
+  auto b2 = cfg.create_block();
+  auto b3 = cfg.create_block();
+  cfg.set_entry_block(b0);
+  cfg.add_edge(b0, b1, EDGE_GOTO);
+  cfg.add_edge(b0, b2, EDGE_BRANCH);
+  cfg.add_edge(b1, b3, EDGE_GOTO);
+  cfg.add_edge(b2, b3, EDGE_GOTO);
+  EXPECT_EQ(cfg.block_id_bound(), 4);
+
+  cfg.remove_block(b1);
+  // The removed id stays unused, and new blocks are numbered past the
+  // largest id still in use.
+  EXPECT_EQ(cfg.num_blocks(), 3);
+  EXPECT_EQ(cfg.block_id_bound(), 4);
+  std::vector<Block*> blocks = cfg.blocks();
+  EXPECT_EQ(blocks, std::vector<Block*>({b0, b2, b3}));
+
+  auto adj = cfg.adjacency();
+  auto ids = [](BlockAdjacency::Range range) {
+    return std::vector<uint32_t>(range.begin(), range.end());
+  };
+  EXPECT_EQ(ids(adj.succs(b0->id())), std::vector<uint32_t>({2}));
+  EXPECT_TRUE(adj.succs(1).empty());
+  EXPECT_TRUE(adj.preds(1).empty());
+  EXPECT_EQ(ids(adj.preds(b3->id())), std::vector<uint32_t>({2}));
+
+  cfg.remove_block(b3);
+  EXPECT_EQ(cfg.block_id_bound(), 3);
+  EXPECT_EQ(cfg.create_block()->id(), 3);
+}
+
 TEST(ControlFlow, iterate1) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -2107,3 +2142,122 @@ TEST(ControlFlow, replace_if_with_return) {
   EXPECT_EQ(assembler::to_string(expected.get()),
             assembler::to_string(code.get()));
 }
+
+TEST(ControlFlow, derivedStructuresFollowMutations) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (if-eqz v0 :b)
+      (const v0 1)
+      (:b)
+      (return-void)
+    )
+)");
+
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  auto version = cfg.structure_version();
+  auto wto = cfg.wto();
+  auto rpo = cfg.blocks_reverse_post();
+  auto doms = cfg.immediate_dominators();
+
+  // Nothing is recomputed while the graph keeps its shape.
+  EXPECT_EQ(wto, cfg.wto());
+  EXPECT_EQ(rpo, cfg.blocks_reverse_post());
+  EXPECT_EQ(doms.size(), cfg.immediate_dominators().size());
+  EXPECT_EQ(version, cfg.structure_version());
+
+  auto* block = cfg.create_block();
+  EXPECT_NE(version, cfg.structure_version());
+  version = cfg.structure_version();
+  cfg.add_edge(cfg.entry_block(), block, cfg::EDGE_GOTO);
+  EXPECT_NE(version, cfg.structure_version());
+
+  auto new_wto = cfg.wto();
+  EXPECT_NE(wto, new_wto);
+  EXPECT_EQ(new_wto, cfg.wto());
+  auto new_rpo = cfg.blocks_reverse_post();
+  EXPECT_EQ(rpo.size() + 1, new_rpo.size());
+  EXPECT_EQ(doms.size() + 1, cfg.immediate_dominators().size());
+
+  // The entry block can't keep two gotos.
+  cfg.remove_block(block);
+  EXPECT_EQ(rpo.size(), cfg.blocks_reverse_post().size());
+  code->clear_cfg();
+}
+
+TEST(ControlFlow, blockHeatMakesTheHotPathFallThrough) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-gtz v0 :hot)
+
+      (const v1 1)
+      (return v1)
+
+      (:hot)
+      (const v2 2)
+      (return v2)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  code->cfg().set_block_heat({10, 0, 10});
+  code->clear_cfg();
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-lez v0 :cold)
+
+      (const v2 2)
+      (return v2)
+
+      (:cold)
+      (const v1 1)
+      (return v1)
+    )
+  )");
+  EXPECT_EQ(assembler::to_string(expected.get()),
+            assembler::to_string(code.get()));
+}
+
+TEST(ControlFlow, blockHeatReorderedBlocksKeepTheirSuccessors) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-gtz v0 :hot)
+
+      (const v1 1)
+
+      (:join)
+      (return v1)
+
+      (:hot)
+      (const v1 2)
+      (goto :join)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  code->cfg().set_block_heat({10, 0, 10, 10});
+  code->clear_cfg();
+
+  // The hot block falls through to the join, in place of the cold block,
+  // which now needs a goto.
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-lez v0 :cold)
+
+      (const v1 2)
+
+      (:join)
+      (return v1)
+
+      (:cold)
+      (const v1 1)
+      (goto :join)
+    )
+  )");
+  EXPECT_EQ(assembler::to_string(expected.get()),
+            assembler::to_string(code.get()));
+}
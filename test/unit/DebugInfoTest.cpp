@@ -84,3 +84,35 @@ TEST(DexPositionTest, consecutiveIdenticalPositions) {
 
   delete g_redex;
 }
+
+TEST(DexPositionTest, positionMapperInternsPositions) {
+  g_redex = new RedexContext();
+
+  auto method_name = DexString::make_string("LFoo;.bar:()V");
+  auto file_name = DexString::make_string("Foo.java");
+  RealPositionMapper mapper("");
+
+  // Two inlined copies of the same callee position, under equal callsites.
+  DexPosition callsite1(method_name, file_name, 10);
+  DexPosition callsite2(method_name, file_name, 10);
+  DexPosition inlined1(method_name, file_name, 20);
+  inlined1.parent = &callsite1;
+  DexPosition inlined2(method_name, file_name, 20);
+  inlined2.parent = &callsite2;
+  // Same line, but inlined elsewhere.
+  DexPosition callsite3(method_name, file_name, 11);
+  DexPosition inlined3(method_name, file_name, 20);
+  inlined3.parent = &callsite3;
+
+  for (auto* pos : {&callsite1, &callsite2, &callsite3, &inlined1, &inlined2,
+                    &inlined3}) {
+    mapper.register_position(pos);
+  }
+  auto line1 = mapper.position_to_line(&inlined1);
+  EXPECT_EQ(line1, mapper.position_to_line(&inlined2));
+  EXPECT_NE(line1, mapper.position_to_line(&inlined3));
+  EXPECT_EQ(mapper.position_to_line(&callsite1),
+            mapper.position_to_line(&callsite2));
+
+  delete g_redex;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DedupStrings.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+namespace {
+
+constexpr const char* kLongString =
+    "a string that is long enough to be worth deduplicating";
+
+DexClass* make_class(const std::string& name, const std::string& code) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(get_object_type());
+  creator.set_access(ACC_PUBLIC);
+  creator.add_method(assembler::method_from_string(
+      "(method (public static) \"" + name + ".f:()Ljava/lang/String;\" (" +
+      code + "))"));
+  return creator.create();
+}
+
+// A class whose method returns the long string.
+DexClass* make_loading_class(const std::string& name) {
+  return make_class(name,
+                    std::string("(const-string \"") + kLongString +
+                        "\") (move-result-pseudo-object v0) "
+                        "(return-object v0)");
+}
+
+} // namespace
+
+class DedupStringsTest : public RedexTest {};
+
+TEST_F(DedupStringsTest, stringsLoadedInSeveralDexesAreHostedOnce) {
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(
+      {make_class("LPrimary;", "(const v0 0) (return-object v0)")});
+  auto a = make_loading_class("LA;");
+  store.add_classes({a});
+  auto b = make_loading_class("LB;");
+  store.add_classes({b});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  DedupStrings dedup_strings(/* max_factory_methods */ 10,
+                             /* use_method_to_weight */ false,
+                             {});
+  dedup_strings.run(stores);
+  const auto& stats = dedup_strings.get_stats();
+  EXPECT_EQ(stats.perf_sensitive_strings, 0);
+  EXPECT_EQ(stats.non_perf_sensitive_strings, 1);
+  EXPECT_EQ(stats.duplicate_strings, 1);
+  EXPECT_EQ(stats.duplicate_string_loads, 1);
+  EXPECT_EQ(stats.factory_methods, 1);
+
+  // The first secondary dex hosts the string, and the second one loads it
+  // from there.
+  ASSERT_EQ(a->get_dmethods().size(), 2);
+  auto factory_method = a->get_dmethods()[0]->get_name()->str() == "f"
+                            ? a->get_dmethods()[1]
+                            : a->get_dmethods()[0];
+  EXPECT_EQ(factory_method->get_name()->str(), "$const$string");
+  auto expected = assembler::ircode_from_string(
+      "((const v1 0) (invoke-static (v1) \"" + show(factory_method) +
+      "\") (move-result-object v0) (return-object v0))");
+  EXPECT_EQ(assembler::to_s_expr(b->get_dmethods()[0]->get_code()),
+            assembler::to_s_expr(expected.get()));
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexHasher.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+struct DexHasherTest : public RedexTest {};
+
+namespace {
+
+hashing::DexHash hash_scope(const Scope& scope, bool cache) {
+  return hashing::DexScopeHasher(scope, cache).run();
+}
+
+void expect_same(const hashing::DexHash& a, const hashing::DexHash& b) {
+  EXPECT_EQ(a.code_hash, b.code_hash);
+  EXPECT_EQ(a.registers_hash, b.registers_hash);
+  EXPECT_EQ(a.signature_hash, b.signature_hash);
+}
+
+} // namespace
+
+TEST_F(DexHasherTest, cachedCodeHashesFollowChanges) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()I"
+      (
+        (const v0 1)
+        (return v0)
+      )
+    )
+  )");
+  auto callee = DexMethod::make_method("LFoo;.baz:()V");
+  Scope scope{assembler::class_with_methods("LFoo;", {method})};
+
+  auto initial = hash_scope(scope, /* cache */ true);
+  expect_same(initial, hash_scope(scope, /* cache */ false));
+  expect_same(initial, hash_scope(scope, /* cache */ true));
+
+  // Editing the code goes through the non-const accessor.
+  method->get_code()->push_back(
+      (new IRInstruction(OPCODE_INVOKE_STATIC))->set_method(callee));
+  auto edited = hash_scope(scope, /* cache */ true);
+  EXPECT_NE(initial.code_hash, edited.code_hash);
+  expect_same(edited, hash_scope(scope, /* cache */ false));
+
+  // Renaming something the code references changes the code hash too.
+  DexMethodSpec spec;
+  spec.name = DexString::make_string("qux");
+  callee->change(spec, /* rename_on_collision */ false,
+                 /* update_deobfuscated_name */ false);
+  auto renamed = hash_scope(scope, /* cache */ true);
+  EXPECT_NE(edited.code_hash, renamed.code_hash);
+  expect_same(renamed, hash_scope(scope, /* cache */ false));
+}
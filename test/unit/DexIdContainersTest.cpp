@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexIdContainers.h"
+#include "RedexTest.h"
+
+struct DexIdContainersTest : public RedexTest {};
+
+TEST_F(DexIdContainersTest, idsAreDenseAndStable) {
+  auto string_bound = g_redex->string_id_bound();
+  auto type_bound = g_redex->type_id_bound();
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+  EXPECT_EQ(a, DexType::make_type("LA;"));
+  EXPECT_EQ(a->get_id(), type_bound);
+  EXPECT_EQ(b->get_id(), type_bound + 1);
+  EXPECT_EQ(g_redex->type_id_bound(), type_bound + 2);
+  EXPECT_EQ(g_redex->type_by_id(a->get_id()), a);
+  EXPECT_EQ(g_redex->type_by_id(b->get_id()), b);
+  EXPECT_EQ(g_redex->type_by_id(type_bound + 2), nullptr);
+
+  EXPECT_EQ(a->get_name()->get_id(), string_bound);
+  EXPECT_EQ(g_redex->string_by_id(string_bound), a->get_name());
+
+  // Renaming keeps the id.
+  a->set_name(DexString::make_string("LC;"));
+  EXPECT_EQ(g_redex->type_by_id(a->get_id()), a);
+
+  auto f = DexField::make_field("LB;.f:I");
+  auto m = DexMethod::make_method("LB;.m:()V");
+  EXPECT_EQ(g_redex->field_by_id(f->get_id()), f);
+  EXPECT_EQ(g_redex->method_by_id(m->get_id()), m);
+  EXPECT_EQ(DexMethod::make_method("LB;.m:()V")->get_id(), m->get_id());
+}
+
+TEST_F(DexIdContainersTest, containers) {
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+  auto c = DexType::make_type("LC;");
+
+  IdVector<DexType, int> vec(-1);
+  EXPECT_EQ(vec.get(a), -1);
+  vec[b] = 2;
+  vec.reserve_all();
+  vec[c] = 3;
+  EXPECT_EQ(vec.get(a), -1);
+  EXPECT_EQ(vec.get(b), 2);
+  EXPECT_EQ(vec.get(c), 3);
+
+  IdBitset<DexType> bits;
+  EXPECT_TRUE(bits.empty());
+  EXPECT_TRUE(bits.insert(c));
+  EXPECT_TRUE(bits.insert(a));
+  EXPECT_FALSE(bits.insert(a));
+  EXPECT_TRUE(bits.contains(a));
+  EXPECT_FALSE(bits.contains(b));
+  EXPECT_EQ(bits.size(), 2);
+  std::vector<const DexType*> order;
+  bits.for_each([&](const DexType* t) { order.push_back(t); });
+  EXPECT_EQ(order, (std::vector<const DexType*>{a, c}));
+  IdBitset<DexType> other;
+  other.insert(b);
+  other.insert(c);
+  bits.intersection_with(other);
+  EXPECT_EQ(bits.size(), 1);
+  EXPECT_TRUE(bits.contains(c));
+  bits.erase(c);
+  EXPECT_TRUE(bits.empty());
+
+  ConcurrentIdBitset<DexType> marks;
+  auto late = DexType::make_type("LLate;");
+  EXPECT_TRUE(marks.insert(a));
+  EXPECT_FALSE(marks.insert(a));
+  // Types created after the bitset still work.
+  EXPECT_TRUE(marks.insert(late));
+  EXPECT_FALSE(marks.insert(late));
+  EXPECT_TRUE(marks.contains(late));
+  EXPECT_FALSE(marks.contains(b));
+  EXPECT_EQ(marks.size(), 2);
+
+  IdPatriciaTreeSet<DexType> s1, s2;
+  s1.insert(a).insert(b);
+  s2.insert(b).insert(c);
+  EXPECT_TRUE(s1.contains(a));
+  EXPECT_FALSE(s1.contains(c));
+  auto u = s1;
+  u.union_with(s2);
+  EXPECT_EQ(u.size(), 3);
+  EXPECT_TRUE(s1.is_subset_of(u));
+  s1.intersection_with(s2);
+  order.clear();
+  s1.for_each([&](const DexType* t) { order.push_back(t); });
+  EXPECT_EQ(order, std::vector<const DexType*>{b});
+}
@@ -6,8 +6,17 @@
  */
 
 #include "DexOutput.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <gtest/gtest.h>
 #include <json/json.h>
+#include <sstream>
+
+#include "DexPosition.h"
+#include "IRAssembler.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
 
 TEST(DexOutput, checkMethodInstructionSizeLimit) {
 
@@ -24,3 +33,233 @@ TEST(DexOutput, checkMethodInstructionSizeLimit) {
       DexOutput::check_method_instruction_size_limit(conf, 65537, "method"),
       RedexException);
 }
+
+namespace {
+
+// 32 classes with one method each, of about 1K of code and 2K of strings.
+DexStoresVector make_stores_with_strings() {
+  DexStoresVector stores;
+  stores.emplace_back("classes");
+  DexClasses classes;
+  for (int i = 0; i < 32; ++i) {
+    auto cls_name = "LBar" + std::to_string(i) + ";";
+    std::string body;
+    for (int j = 0; j < 250; ++j) {
+      body += "(const-string \"string_" + std::to_string(i) + "_" +
+              std::to_string(j) + "\")\n(move-result-pseudo-object v0)\n";
+    }
+    auto method = assembler::method_from_string(
+        "(method (public static) \"" + cls_name + ".foo:()V\"\n(\n" + body +
+        "(return-void)\n))");
+    method->set_deobfuscated_name(show(method));
+    classes.push_back(assembler::class_with_methods(cls_name, {method}));
+  }
+  stores[0].add_classes(std::move(classes));
+  instruction_lowering::run(stores);
+  return stores;
+}
+
+// Writing a dex syncs the code of its methods into dex code and drops their
+// IR. This turns the dex code back into lowered IR, so that the classes can
+// be written again.
+void reload_code(DexStoresVector& stores) {
+  for (auto& dex : stores[0].get_dexen()) {
+    for (auto cls : dex) {
+      for (auto method : cls->get_dmethods()) {
+        if (method->get_dex_code() != nullptr) {
+          method->balloon();
+        }
+      }
+    }
+  }
+  instruction_lowering::run(stores);
+}
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+} // namespace
+
+TEST(DexOutput, parallelOutputMatchesSerial) {
+  namespace fs = boost::filesystem;
+  g_redex = new RedexContext();
+
+  DexStoresVector stores;
+  stores.emplace_back("classes");
+  DexClasses classes;
+  for (int i = 0; i < 4; ++i) {
+    auto cls_name = "LFoo" + std::to_string(i) + ";";
+    auto method = assembler::method_from_string(
+        "(method (public static) \"" + cls_name + ".bar:()V\"\n"
+        "  (\n"
+        "    (.pos:dbg_0 \"" + cls_name + ".bar:()V\" \"Foo.java\" 10)\n"
+        "    (const v0 0)\n"
+        "    (.pos:dbg_1 \"" + cls_name + ".bar:()V\" \"Foo.java\" 11)\n"
+        "    (return-void)\n"
+        "  )\n"
+        ")");
+    classes.push_back(assembler::class_with_methods(cls_name, {method}));
+  }
+  stores[0].add_classes(classes);
+  instruction_lowering::run(stores);
+
+  auto tmpdir = fs::temp_directory_path() / fs::unique_path("dex-out-%%%%%%");
+  auto write_all = [&](const std::string& subdir, bool parallel) {
+    auto dir = tmpdir / subdir;
+    fs::create_directories(dir / "meta");
+    Json::Value json_cfg;
+    ConfigFiles conf(json_cfg, dir.string());
+    std::unique_ptr<PositionMapper> pos_mapper(
+        PositionMapper::make((dir / "map").string()));
+    RedexOptions redex_options;
+    std::vector<DexOutputSpec> dexes;
+    auto& dexen = stores[0].get_dexen();
+    for (size_t i = 0; i < dexen.size(); ++i) {
+      dexes.push_back(DexOutputSpec{
+          (dir / ("classes" + std::to_string(i) + ".dex")).string(),
+          &dexen[i], 0, i});
+    }
+    if (parallel) {
+      write_classes_to_dexes(redex_options, dexes, nullptr, false, conf,
+                             pos_mapper.get(), nullptr, nullptr, nullptr,
+                             DEX_HEADER_DEXMAGIC_V35, 2);
+    } else {
+      for (const auto& dex : dexes) {
+        write_classes_to_dex(redex_options, dex.filename, dex.classes, nullptr,
+                             false, dex.store_number, dex.dex_number, conf,
+                             pos_mapper.get(), nullptr, nullptr, nullptr,
+                             DEX_HEADER_DEXMAGIC_V35);
+      }
+    }
+    pos_mapper->write_map();
+    return dexes;
+  };
+  // Put every class in its own dex.
+  stores[0].get_dexen().clear();
+  for (auto* cls : classes) {
+    stores[0].get_dexen().push_back({cls});
+  }
+
+  auto serial = write_all("serial", false);
+  reload_code(stores);
+  auto parallel = write_all("parallel", true);
+  ASSERT_EQ(serial.size(), parallel.size());
+  for (size_t i = 0; i < serial.size(); ++i) {
+    auto expected = read_file(serial[i].filename);
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(expected, read_file(parallel[i].filename)) << i;
+  }
+  EXPECT_EQ(read_file((tmpdir / "serial" / "map").string()),
+            read_file((tmpdir / "parallel" / "map").string()));
+
+  fs::remove_all(tmpdir);
+  delete g_redex;
+}
+
+TEST(DexOutput, startupTraceLayoutTouchesFewerPages) {
+  namespace fs = boost::filesystem;
+  g_redex = new RedexContext();
+
+  // Startup runs every fourth method, last ones first.
+  DexStoresVector stores = make_stores_with_strings();
+  auto tmpdir = fs::temp_directory_path() / fs::unique_path("dex-out-%%%%%%");
+  fs::create_directories(tmpdir / "meta");
+  auto trace_path = (tmpdir / "trace.txt").string();
+  std::ofstream trace(trace_path);
+  for (int i = 0; i < 32; i += 4) {
+    auto method = stores[0].get_dexen()[0][i]->get_dmethods()[0];
+    trace << show(method) << " " << 1000 - i << "\n";
+    // Later executions don't matter.
+    trace << show(method) << " " << 2000 << "\n";
+  }
+  trace.close();
+
+  auto write = [&](const std::string& name, bool startup_trace_order) {
+    Json::Value json_cfg;
+    json_cfg["method_trace_file"] = trace_path;
+    if (startup_trace_order) {
+      json_cfg["bytecode_sort_mode"] = "startup_trace_order";
+      json_cfg["string_sort_mode"] = "startup_trace_order";
+    }
+    ConfigFiles conf(json_cfg, tmpdir.string());
+    EXPECT_EQ(conf.get_method_to_first_execution().size(), 8);
+    std::unique_ptr<PositionMapper> pos_mapper(
+        PositionMapper::make((tmpdir / (name + ".map")).string()));
+    RedexOptions redex_options;
+    return write_classes_to_dex(
+        redex_options, (tmpdir / (name + ".dex")).string(),
+        &stores[0].get_dexen()[0], nullptr, false, 0, 0, conf,
+        pos_mapper.get(), nullptr, nullptr, nullptr, DEX_HEADER_DEXMAGIC_V35);
+  };
+  auto by_class = write("by_class", false);
+  reload_code(stores);
+  auto by_trace = write("by_trace", true);
+
+  // The traced code is 8K, in 2 or 3 pages, instead of 1K on each page.
+  EXPECT_GE(by_class.num_startup_code_pages, 7);
+  EXPECT_LE(by_trace.num_startup_code_pages, 3);
+  EXPECT_LT(by_trace.num_startup_string_pages,
+            by_class.num_startup_string_pages);
+  EXPECT_LT(by_trace.num_startup_pages, by_class.num_startup_pages);
+  EXPECT_GT(by_trace.num_startup_class_data_pages, 0);
+
+  fs::remove_all(tmpdir);
+  delete g_redex;
+}
+
+TEST(DexOutput, coldstartLayoutTouchesFewerPages) {
+  namespace fs = boost::filesystem;
+  g_redex = new RedexContext();
+
+  // Every fourth class is a coldstart class, last ones first. The trace of
+  // their methods is only there for the page estimate of the default layout.
+  DexStoresVector stores = make_stores_with_strings();
+  auto tmpdir = fs::temp_directory_path() / fs::unique_path("dex-out-%%%%%%");
+  fs::create_directories(tmpdir / "meta");
+  auto coldstart_path = (tmpdir / "coldstart.txt").string();
+  auto trace_path = (tmpdir / "trace.txt").string();
+  std::ofstream coldstart(coldstart_path);
+  std::ofstream trace(trace_path);
+  for (int i = 28; i >= 0; i -= 4) {
+    coldstart << "Bar" << i << ".class\n";
+    auto method = stores[0].get_dexen()[0][i]->get_dmethods()[0];
+    trace << show(method) << " " << 100 - i << "\n";
+  }
+  coldstart.close();
+  trace.close();
+
+  auto write = [&](const std::string& name, bool coldstart_order) {
+    Json::Value json_cfg;
+    json_cfg["coldstart_classes"] = coldstart_path;
+    json_cfg["method_trace_file"] = trace_path;
+    if (coldstart_order) {
+      json_cfg["bytecode_sort_mode"] = "coldstart_order";
+      json_cfg["string_sort_mode"] = "coldstart_order";
+    }
+    ConfigFiles conf(json_cfg, tmpdir.string());
+    EXPECT_EQ(conf.get_coldstart_classes().size(), 8);
+    std::unique_ptr<PositionMapper> pos_mapper(
+        PositionMapper::make((tmpdir / (name + ".map")).string()));
+    RedexOptions redex_options;
+    return write_classes_to_dex(
+        redex_options, (tmpdir / (name + ".dex")).string(),
+        &stores[0].get_dexen()[0], nullptr, false, 0, 0, conf,
+        pos_mapper.get(), nullptr, nullptr, nullptr, DEX_HEADER_DEXMAGIC_V35);
+  };
+  auto by_class = write("by_class", false);
+  reload_code(stores);
+  auto by_coldstart = write("by_coldstart", true);
+
+  EXPECT_GE(by_class.num_startup_code_pages, 7);
+  EXPECT_LE(by_coldstart.num_startup_code_pages, 3);
+  EXPECT_LT(by_coldstart.num_startup_string_pages,
+            by_class.num_startup_string_pages);
+  EXPECT_LT(by_coldstart.num_startup_pages, by_class.num_startup_pages);
+
+  fs::remove_all(tmpdir);
+  delete g_redex;
+}
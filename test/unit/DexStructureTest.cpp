@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DexStructure.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+using namespace interdex;
+
+namespace {
+
+DexClass* make_class(const char* name) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  return creator.create();
+}
+
+DexMethodRef* make_method_ref(const char* name) {
+  return DexMethod::make_method(name);
+}
+
+constexpr size_t kNoLimit = 1 << 16;
+
+} // namespace
+
+class DexStructureTest : public RedexTest {};
+
+TEST_F(DexStructureTest, sharedRefsAreCountedOnce) {
+  auto a_m = make_method_ref("LX;.a:()V");
+  auto b_m = make_method_ref("LX;.b:()V");
+  auto c_m = make_method_ref("LX;.c:()V");
+  auto x_t = DexType::make_type("LX;");
+
+  DexStructure dex;
+  EXPECT_TRUE(dex.add_class_if_fits({a_m, b_m}, {}, {x_t}, kNoLimit, kNoLimit,
+                                    kNoLimit, make_class("LA;")));
+  EXPECT_EQ(dex.get_num_mrefs(), 2);
+  EXPECT_EQ(dex.get_num_trefs(), 1);
+
+  // Only c is new. The upper bound 4 isn't below the limit, so the new refs
+  // are counted exactly: 3 < 4.
+  EXPECT_TRUE(dex.add_class_if_fits({b_m, c_m}, {}, {x_t}, kNoLimit,
+                                    /* method_refs_limit */ 4, kNoLimit,
+                                    make_class("LB;")));
+  EXPECT_EQ(dex.get_num_mrefs(), 3);
+  EXPECT_EQ(dex.get_num_trefs(), 1);
+  EXPECT_EQ(dex.get_all_classes().size(), 2);
+}
+
+TEST_F(DexStructureTest, classesThatDontFitAreRejected) {
+  auto a_m = make_method_ref("LY;.a:()V");
+  auto b_m = make_method_ref("LY;.b:()V");
+  auto y_t = DexType::make_type("LY;");
+  auto z_t = DexType::make_type("LZ;");
+
+  DexStructure dex;
+  EXPECT_TRUE(dex.add_class_if_fits({a_m}, {}, {y_t}, kNoLimit, kNoLimit,
+                                    kNoLimit, make_class("LC;")));
+  // One new method ref: 2 >= 2.
+  EXPECT_FALSE(dex.add_class_if_fits({a_m, b_m}, {}, {}, kNoLimit,
+                                     /* method_refs_limit */ 2, kNoLimit,
+                                     make_class("LD;")));
+  // One new type ref: 2 >= 2.
+  EXPECT_FALSE(dex.add_class_if_fits({}, {}, {y_t, z_t}, kNoLimit, kNoLimit,
+                                     /* type_refs_limit */ 2,
+                                     make_class("LE;")));
+  EXPECT_EQ(dex.get_num_mrefs(), 1);
+  EXPECT_EQ(dex.get_num_trefs(), 1);
+  EXPECT_EQ(dex.get_all_classes().size(), 1);
+
+  // No linear alloc room left at all.
+  EXPECT_FALSE(dex.add_class_if_fits({}, {}, {}, /* linear_alloc_limit */ 0,
+                                     kNoLimit, kNoLimit, make_class("LF;")));
+}
+
+TEST_F(DexStructureTest, budgetsAreChargedToPackages) {
+  auto a_m = make_method_ref("LW;.a:()V");
+  auto b_m = make_method_ref("LW;.b:()V");
+  auto c_m = make_method_ref("LW;.c:()V");
+
+  DexesStructure dexes;
+  dexes.set_linear_alloc_limit(kNoLimit);
+  dexes.set_type_refs_limit(kNoLimit);
+  dexes.set_reserve_mrefs(0);
+  auto foo_a = make_class("Lcom/foo/A;");
+  auto foo_b = make_class("Lcom/foo/B;");
+  auto bar_c = make_class("Lcom/bar/C;");
+  EXPECT_TRUE(dexes.add_class_to_current_dex({a_m, b_m}, {}, {}, foo_a));
+  EXPECT_TRUE(dexes.add_class_to_current_dex({b_m}, {}, {}, foo_b));
+  EXPECT_TRUE(dexes.add_class_to_current_dex({b_m, c_m}, {}, {}, bar_c));
+  dexes.end_dex(DexInfo());
+
+  ASSERT_EQ(dexes.get_dex_budgets().size(), 1);
+  const auto& budget = dexes.get_dex_budgets()[0];
+  EXPECT_EQ(budget.num_classes, 3);
+  EXPECT_EQ(budget.used[METHOD_REFS], 3);
+  EXPECT_EQ(budget.limits[METHOD_REFS], (1 << 16) - 1);
+  EXPECT_EQ(budget.used[LINEAR_ALLOC],
+            estimate_linear_alloc(foo_a) + estimate_linear_alloc(foo_b) +
+                estimate_linear_alloc(bar_c));
+  // The shared ref is charged to the package that brought it in first.
+  using Usage = std::vector<std::pair<std::string, size_t>>;
+  EXPECT_EQ(budget.top_packages[METHOD_REFS],
+            Usage({{"Lcom/foo/", 2}, {"Lcom/bar/", 1}}));
+  EXPECT_EQ(budget.top_packages[LINEAR_ALLOC][0].first, "Lcom/foo/");
+}
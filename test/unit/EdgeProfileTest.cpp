@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "EdgeProfile.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+
+using namespace instrument;
+
+namespace {
+
+// A loop that runs 10 times, in a method called 3 times:
+//
+//   0 -> 1 -> 2 -> 1
+//             2 -> 3 -> exit
+EdgeProfileGraph make_loop() {
+  EdgeProfileGraph graph;
+  graph.num_blocks = 4;
+  graph.entry = 0;
+  graph.edges = {{0, 1, 1}, {1, 2, 1}, {2, 1, 2}, {2, 3, 1}, {3, 4, 1}};
+  return graph;
+}
+
+const std::vector<uint64_t> loop_edge_counts = {3, 33, 30, 3, 3};
+
+} // namespace
+
+TEST(EdgeProfileTest, countsEdgesOffTheSpanningTree) {
+  auto graph = make_loop();
+  auto counted = choose_counted_edges(graph);
+  // 5 edges, plus the virtual one, over 5 nodes: 2 counters.
+  EXPECT_EQ(std::count(counted.begin(), counted.end(), true), 2);
+  // The back edge is the heaviest, so it goes on the tree.
+  EXPECT_FALSE(counted[2]);
+}
+
+TEST(EdgeProfileTest, derivesAllCountsFromTheCounters) {
+  auto graph = make_loop();
+  auto counted = choose_counted_edges(graph);
+  std::vector<uint64_t> edge_counts(graph.edges.size(), 0);
+  for (size_t i = 0; i < edge_counts.size(); i++) {
+    if (counted[i]) {
+      edge_counts[i] = loop_edge_counts[i];
+    }
+  }
+  auto block_counts = derive_block_counts(graph, counted, edge_counts);
+  EXPECT_EQ(edge_counts, loop_edge_counts);
+  EXPECT_EQ(block_counts, std::vector<uint64_t>({3, 33, 33, 3}));
+}
+
+TEST(EdgeProfileTest, catchBlocksAreEnteredThroughCountedEdges) {
+  // Block 1 may throw into the catch block 2:
+  //
+  //   0 -> 1 -> exit
+  //   exit -> 2 -> exit
+  EdgeProfileGraph graph;
+  graph.num_blocks = 3;
+  graph.edges = {{0, 1, 1}, {1, 3, 1}, {3, 2, 1}, {2, 3, 1}};
+  graph.may_throw = {false, true, false};
+  auto counted = choose_counted_edges(graph);
+  EXPECT_TRUE(counted[2]);
+
+  // Called 5 times, and 2 of them threw and were caught.
+  std::vector<uint64_t> edge_counts(graph.edges.size(), 0);
+  for (size_t i = 0; i < edge_counts.size(); i++) {
+    if (counted[i]) {
+      edge_counts[i] = std::vector<uint64_t>({5, 3, 2, 2})[i];
+    }
+  }
+  auto block_counts = derive_block_counts(graph, counted, edge_counts);
+  EXPECT_EQ(block_counts[2], 2);
+  EXPECT_EQ(block_counts[1], 5);
+}
@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <string>
 #include <gtest/gtest.h>
 
@@ -18,3 +20,71 @@ TEST(ExtractNativeTest, empty) {
   auto overset = extract_classes_from_native_lib(over);
   EXPECT_EQ(overset.size(), 2);
 }
+
+namespace {
+
+void append_le(std::string* out, uint64_t value, size_t num_bytes) {
+  for (size_t i = 0; i < num_bytes; ++i) {
+    out->push_back((char)(value >> (8 * i)));
+  }
+}
+
+// A 64-bit ELF file with a .rodata and a .text section.
+std::string make_elf(const std::string& rodata, const std::string& text) {
+  const std::string names = std::string("\0.rodata\0.text\0.shstrtab\0", 25);
+  std::string contents(64, '\0');
+  size_t rodata_offset = contents.size();
+  contents += rodata;
+  size_t text_offset = contents.size();
+  contents += text;
+  size_t names_offset = contents.size();
+  contents += names;
+  size_t section_headers = contents.size();
+  auto add_section = [&](uint32_t name, uint64_t offset, uint64_t size) {
+    append_le(&contents, name, 4);
+    append_le(&contents, 1 /* SHT_PROGBITS */, 4);
+    append_le(&contents, 0, 16); // flags, address
+    append_le(&contents, offset, 8);
+    append_le(&contents, size, 8);
+    append_le(&contents, 0, 24); // link, info, alignment, entry size
+  };
+  add_section(0, 0, 0);
+  add_section(1, rodata_offset, rodata.size());
+  add_section(9, text_offset, text.size());
+  add_section(15, names_offset, names.size());
+
+  contents.replace(0, 6, "\x7f" "ELF\x02\x01");
+  std::string header_end;
+  append_le(&header_end, section_headers, 8);
+  contents.replace(0x28, 8, header_end);
+  header_end.clear();
+  append_le(&header_end, 64, 2); // section header size
+  append_le(&header_end, 4, 2); // number of sections
+  append_le(&header_end, 3, 2); // index of the section names
+  contents.replace(0x3A, 6, header_end);
+  return contents;
+}
+
+} // namespace
+
+TEST(ExtractNativeTest, onlyScansStringSections) {
+  auto apk_dir = boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("native-%%%%%%%%");
+  auto lib_dir = apk_dir / "lib" / "armeabi-v7a";
+  boost::filesystem::create_directories(lib_dir);
+  {
+    std::ofstream out((lib_dir / "libfoo.so").string(), std::ios::binary);
+    out << make_elf(std::string("com/foo/InRodata\0", 17),
+                    std::string("com/foo/InText\0", 15));
+  }
+  {
+    std::ofstream out((lib_dir / "libbar.so").string(), std::ios::binary);
+    out << "not an elf file Lcom/bar/NotElf;";
+  }
+
+  auto classes = get_native_classes(apk_dir.string());
+  EXPECT_EQ(classes.count("Lcom/foo/InRodata;"), 1);
+  EXPECT_EQ(classes.count("Lcom/foo/InText;"), 0);
+  EXPECT_EQ(classes.count("Lcom/bar/NotElf;"), 1);
+  boost::filesystem::remove_all(apk_dir);
+}
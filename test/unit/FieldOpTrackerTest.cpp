@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FieldOpTracker.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+struct FieldOpTrackerTest : public RedexTest {};
+
+TEST_F(FieldOpTrackerTest, countsReadsAndWrites) {
+  auto f = static_cast<DexField*>(DexField::make_field("LFoo;.f:I"));
+  f->make_concrete(ACC_PUBLIC | ACC_STATIC);
+  auto g = static_cast<DexField*>(DexField::make_field("LFoo;.g:I"));
+  g->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+  ClassCreator foo_creator(DexType::make_type("LFoo;"));
+  foo_creator.set_super(get_object_type());
+  foo_creator.add_field(f);
+  foo_creator.add_field(g);
+  foo_creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.<clinit>:()V"
+     ((const v0 1)
+      (sput v0 "LFoo;.f:I")
+      (sget "LFoo;.f:I")
+      (move-result-pseudo v1)
+      (return-void)))
+  )"));
+
+  ClassCreator bar_creator(DexType::make_type("LBar;"));
+  bar_creator.set_super(get_object_type());
+  for (const auto& name : {"a", "b"}) {
+    bar_creator.add_method(assembler::method_from_string(
+        std::string("(method (public static) \"LBar;.") + name +
+        ":()V\" ((sget \"LFoo;.f:I\") (move-result-pseudo v0)"
+        " (sput v0 \"LFoo;.g:I\") (return-void)))"));
+  }
+
+  Scope scope{foo_creator.create(), bar_creator.create()};
+  auto field_stats = field_op_tracker::analyze(scope);
+
+  ASSERT_EQ(field_stats.size(), 2);
+  const auto& f_stats = field_stats.at(f);
+  EXPECT_EQ(f_stats.reads, 3);
+  EXPECT_EQ(f_stats.reads_outside_init, 2);
+  EXPECT_EQ(f_stats.writes, 1);
+  EXPECT_EQ(f_stats.writes_outside_init, 0);
+  const auto& g_stats = field_stats.at(g);
+  EXPECT_EQ(g_stats.reads, 0);
+  EXPECT_EQ(g_stats.writes, 2);
+  EXPECT_EQ(g_stats.writes_outside_init, 2);
+}
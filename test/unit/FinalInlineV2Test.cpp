@@ -142,3 +142,59 @@ TEST_F(FinalInlineTest, dominatedSget) {
   EXPECT_EQ(field_bar->get_static_value()->value(), 0);
   EXPECT_EQ(field_baz->get_static_value()->value(), 1);
 }
+
+TEST_F(FinalInlineTest, clinitsReadingEachOtherInWaves) {
+  // LGen0; sets its field, and each next class sets its own one from it.
+  Scope scope;
+  std::vector<DexField*> fields;
+  for (int i = 0; i < 4; i++) {
+    auto name = "LGen" + std::to_string(i) + ";";
+    auto field = static_cast<DexField*>(DexField::make_field(name + ".f:I"));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL,
+                         DexEncodedValue::zero_for_type(get_int_type()));
+    ClassCreator creator(DexType::make_type(name.c_str()));
+    creator.set_super(get_object_type());
+    creator.add_field(field);
+    std::string body = i == 0 ? "(const v0 1)"
+                              : "(sget \"LGen" + std::to_string(i - 1) +
+                                    ";.f:I\") (move-result-pseudo v0) "
+                                    "(add-int/lit8 v0 v0 1)";
+    creator.add_method(assembler::method_from_string(
+        "(method (public static) \"" + name + ".<clinit>:()V\" (" + body +
+        " (sput v0 \"" + name + ".f:I\") (return-void)))"));
+    // The dependents come first in the scope.
+    scope.insert(scope.begin(), creator.create());
+    fields.push_back(field);
+  }
+
+  FinalInlinePassV2::run(scope);
+
+  for (size_t i = 0; i < fields.size(); i++) {
+    EXPECT_EQ(fields[i]->get_static_value()->value(), i + 1);
+  }
+}
+
+TEST_F(FinalInlineTest, clinitCycle) {
+  Scope scope;
+  for (auto pair : {std::make_pair("LCycleA;", "LCycleB;"),
+                    std::make_pair("LCycleB;", "LCycleA;")}) {
+    std::string name = pair.first;
+    std::string other = pair.second;
+    auto field = static_cast<DexField*>(DexField::make_field(name + ".f:I"));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL,
+                         DexEncodedValue::zero_for_type(get_int_type()));
+    ClassCreator creator(DexType::make_type(name.c_str()));
+    creator.set_super(get_object_type());
+    creator.add_field(field);
+    creator.add_method(assembler::method_from_string(
+        "(method (public static) \"" + name + ".<clinit>:()V\" ((sget \"" +
+        other + ".f:I\") (move-result-pseudo v0) (sput v0 \"" + name +
+        ".f:I\") (return-void)))"));
+    scope.push_back(creator.create());
+  }
+
+  EXPECT_EQ(FinalInlinePassV2::run(scope), 0);
+  for (auto cls : scope) {
+    EXPECT_NE(cls->get_clinit(), nullptr);
+  }
+}
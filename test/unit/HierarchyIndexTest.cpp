@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "HierarchyIndex.h"
+
+#include <gtest/gtest.h>
+
+#include "DexUtil.h"
+#include "RedexTest.h"
+#include "ScopeHelper.h"
+
+/**
+ * interface I {}
+ *   interface J extends I {}
+ * class A implements J {}
+ *   class B extends A {}
+ * abstract class D implements I {}
+ *   class E extends D {}
+ * class F extends U {}, where U has no class and is implemented by G
+ */
+class HierarchyIndexTest : public RedexTest {
+ public:
+  HierarchyIndexTest() {
+    scope = create_empty_scope();
+    auto obj_t = get_object_type();
+    for (auto name : {"LI;", "LJ;", "LA;", "LB;", "LD;", "LE;", "LF;", "LG;",
+                      "LU;"}) {
+      types.push_back(DexType::make_type(name));
+    }
+    i_t = types[0];
+    j_t = types[1];
+    a_t = types[2];
+    b_t = types[3];
+    d_t = types[4];
+    e_t = types[5];
+    f_t = types[6];
+    g_t = types[7];
+    u_t = types[8];
+    types.push_back(obj_t);
+    types.push_back(DexType::make_type("[LA;"));
+    scope.push_back(create_internal_class(
+        i_t, obj_t, {}, ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT));
+    scope.push_back(create_internal_class(
+        j_t, obj_t, {i_t}, ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT));
+    scope.push_back(create_internal_class(a_t, obj_t, {j_t}));
+    scope.push_back(create_internal_class(b_t, a_t, {}));
+    scope.push_back(
+        create_internal_class(d_t, obj_t, {i_t}, ACC_PUBLIC | ACC_ABSTRACT));
+    scope.push_back(create_internal_class(e_t, d_t, {}));
+    scope.push_back(create_internal_class(f_t, u_t, {}));
+    scope.push_back(create_internal_class(g_t, obj_t, {u_t}));
+  }
+
+  Scope scope;
+  std::vector<DexType*> types;
+  DexType* i_t;
+  DexType* j_t;
+  DexType* a_t;
+  DexType* b_t;
+  DexType* d_t;
+  DexType* e_t;
+  DexType* f_t;
+  DexType* g_t;
+  DexType* u_t;
+};
+
+TEST_F(HierarchyIndexTest, sameAnswersAsWalkingTheHierarchy) {
+  HierarchyIndex index(scope);
+  for (auto* type : types) {
+    for (auto* base : types) {
+      EXPECT_EQ(index.is_subclass(base, type), is_subclass(base, type))
+          << show(base) << " " << show(type);
+      EXPECT_EQ(index.check_cast(type, base), check_cast(type, base))
+          << show(type) << " " << show(base);
+    }
+  }
+  EXPECT_TRUE(index.is_indexed(get_object_type()));
+  EXPECT_TRUE(index.is_indexed(u_t));
+  EXPECT_FALSE(index.is_indexed(DexType::make_type("[LA;")));
+}
+
+TEST_F(HierarchyIndexTest, subtypes) {
+  HierarchyIndex index(scope);
+  using Types = std::vector<const DexType*>;
+  EXPECT_EQ(index.get_all_children(a_t), Types({b_t}));
+  EXPECT_EQ(index.get_all_children(d_t), Types({e_t}));
+  EXPECT_EQ(index.get_all_children(u_t), Types({f_t}));
+  EXPECT_TRUE(index.get_all_children(i_t).empty());
+
+  auto sorted = [](Types types) {
+    std::sort(types.begin(), types.end(), compare_dextypes);
+    return types;
+  };
+  EXPECT_EQ(sorted(index.get_all_subtypes(i_t)),
+            sorted({j_t, a_t, b_t, d_t, e_t}));
+  EXPECT_EQ(sorted(index.get_all_implementors(i_t)),
+            sorted({a_t, b_t, d_t, e_t}));
+  EXPECT_EQ(sorted(index.get_all_implementors(j_t)), sorted({a_t, b_t}));
+  EXPECT_EQ(sorted(index.get_concrete_subtypes(i_t)), sorted({a_t, b_t, e_t}));
+  EXPECT_EQ(sorted(index.get_concrete_subtypes(d_t)), Types({e_t}));
+  // U has no class, but G implements it and F extends it.
+  EXPECT_EQ(sorted(index.get_all_subtypes(u_t)), sorted({f_t, g_t}));
+}
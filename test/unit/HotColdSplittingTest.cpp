@@ -0,0 +1,207 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "HotColdSplitting.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace hot_cold_splitting;
+
+namespace {
+
+// The class of `method`, with a static log:(I)V for it to call.
+DexClass* make_class(const std::string& method) {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.set_access(ACC_PUBLIC);
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.log:(I)V"
+      ((load-param v0) (return-void)))
+  )"));
+  creator.add_method(assembler::method_from_string(method));
+  return creator.create();
+}
+
+DexStoresVector make_stores(DexClass* cls) {
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({});
+  store.add_classes({cls});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+DexMethod* find_method(const DexClass* cls, const std::string& name) {
+  for (auto method : cls->get_dmethods()) {
+    if (method->get_name()->str() == name) {
+      return method;
+    }
+  }
+  return nullptr;
+}
+
+bool calls(const DexMethod* method, const std::string& callee) {
+  for (const auto& mie : InstructionIterable(method->get_code())) {
+    if (mie.insn->has_method() && show(mie.insn->get_method()) == callee) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Config test_config() {
+  Config config;
+  config.min_insns = 3;
+  return config;
+}
+
+} // namespace
+
+class HotColdSplittingTest : public RedexTest {};
+
+TEST_F(HotColdSplittingTest, coldTailIsMovedOut) {
+  auto cls = make_class(R"(
+    (method (public static) "LFoo;.f:(II)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (if-eqz v0 :cold)
+        (return v0)
+
+        (:cold)
+        (mul-int v2 v1 v1)
+        (add-int/lit8 v2 v2 3)
+        (invoke-static (v2) "LFoo;.log:(I)V")
+        (return v2)
+      )
+    )
+  )");
+  auto stores = make_stores(cls);
+  auto f = find_method(cls, "f");
+  ASSERT_NE(f, nullptr);
+  BlockHeat heat{{f->get_fully_deobfuscated_name(), {5, 5, 0}}};
+
+  auto stats = split_cold_regions(stores, heat, test_config());
+  EXPECT_EQ(stats.num_methods_with_heat, 1);
+  EXPECT_EQ(stats.num_split_methods, 1);
+  EXPECT_EQ(stats.num_cold_methods, 1);
+  EXPECT_EQ(stats.num_moved_insns, 4);
+  EXPECT_EQ(stats.num_host_classes, 1);
+
+  // The host class comes after the class in the last dex, and the cold
+  // method takes the live-in v1.
+  const auto& dex = stores[0].get_dexen().back();
+  ASSERT_EQ(dex.size(), 2);
+  auto host = dex[1];
+  ASSERT_EQ(host->get_dmethods().size(), 1);
+  auto cold = host->get_dmethods()[0];
+  EXPECT_EQ(show(cold), "Lredex/$ColdCode0;.f$cold$0:(I)I");
+  EXPECT_TRUE(is_static(cold) && is_public(cold));
+  EXPECT_TRUE(calls(f, show(cold)));
+  EXPECT_FALSE(calls(f, "LFoo;.log:(I)V"));
+  EXPECT_TRUE(calls(cold, "LFoo;.log:(I)V"));
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v3)
+      (move v1 v3)
+      (mul-int v2 v1 v1)
+      (add-int/lit8 v2 v2 3)
+      (invoke-static (v2) "LFoo;.log:(I)V")
+      (return v2)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(cold->get_code()),
+            assembler::to_s_expr(expected.get()));
+}
+
+TEST_F(HotColdSplittingTest, coldBlocksThatJoinHotCodeStay) {
+  auto cls = make_class(R"(
+    (method (public static) "LFoo;.g:(II)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (if-eqz v0 :cold)
+
+        (:join)
+        (return v0)
+
+        (:cold)
+        (mul-int v0 v1 v1)
+        (add-int/lit8 v0 v0 3)
+        (invoke-static (v0) "LFoo;.log:(I)V")
+        (goto :join)
+      )
+    )
+  )");
+  auto stores = make_stores(cls);
+  auto g = find_method(cls, "g");
+  ASSERT_NE(g, nullptr);
+  BlockHeat heat{{g->get_fully_deobfuscated_name(), {5, 5, 0}}};
+
+  auto stats = split_cold_regions(stores, heat, test_config());
+  EXPECT_EQ(stats.num_rejected_regions, 1);
+  EXPECT_EQ(stats.num_cold_methods, 0);
+  EXPECT_EQ(stats.num_host_classes, 0);
+  EXPECT_TRUE(calls(g, "LFoo;.log:(I)V"));
+}
+
+TEST_F(HotColdSplittingTest, coldMethodTakesOnlyTheLiveIns) {
+  auto cls = make_class(R"(
+    (method (public static) "LFoo;.h:(III)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (load-param v2)
+        (add-int v3 v1 v2)
+        (if-eqz v0 :cold)
+        (return v3)
+
+        (:cold)
+        (mul-int v4 v2 v0)
+        (add-int/lit8 v4 v4 3)
+        (invoke-static (v4) "LFoo;.log:(I)V")
+        (return v4)
+      )
+    )
+  )");
+  auto stores = make_stores(cls);
+  auto h = find_method(cls, "h");
+  ASSERT_NE(h, nullptr);
+  BlockHeat heat{{h->get_fully_deobfuscated_name(), {5, 5, 0}}};
+
+  auto stats = split_cold_regions(stores, heat, test_config());
+  EXPECT_EQ(stats.num_cold_methods, 1);
+
+  // v1 and v3 are live in the hot code only, and v4 is defined in the cold
+  // region.
+  auto host = stores[0].get_dexen().back().back();
+  ASSERT_EQ(host->get_dmethods().size(), 1);
+  auto cold = host->get_dmethods()[0];
+  EXPECT_EQ(show(cold), "Lredex/$ColdCode0;.h$cold$0:(II)I");
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v5)
+      (load-param v6)
+      (move v0 v5)
+      (move v2 v6)
+      (mul-int v4 v2 v0)
+      (add-int/lit8 v4 v4 3)
+      (invoke-static (v4) "LFoo;.log:(I)V")
+      (return v4)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(cold->get_code()),
+            assembler::to_s_expr(expected.get()));
+}
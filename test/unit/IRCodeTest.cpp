@@ -6,7 +6,9 @@
  */
 
 #include <gtest/gtest.h>
+#include <thread>
 
+#include "ControlFlow.h"
 #include "DexAsm.h"
 #include "InstructionLowering.h"
 #include "IRAssembler.h"
@@ -119,6 +121,38 @@ TEST_F(IRCodeTest, useless_if) {
   EXPECT_EQ(DOPCODE_CONST_4, (*it)->opcode());
 }
 
+TEST_F(IRCodeTest, far_branches) {
+  // An if-* and a goto that jump over more code units than a 16-bit offset
+  // can hold.
+  std::string body = "(const v0 0) (if-eqz v0 :far) (goto :far)";
+  for (size_t i = 0; i < 12000; ++i) {
+    body += " (const v1 100000)";
+  }
+  auto method = assembler::method_from_string(
+      "(method (public) \"LBaz;.bar:()V\" (" + body +
+      " (:far) (return-void)))");
+
+  auto code = method->get_code();
+  instruction_lowering::lower(method);
+  auto dex_code = code->sync(method);
+
+  const auto& insns = dex_code->get_instructions();
+  ASSERT_EQ(12005, insns.size());
+  auto it = insns.begin();
+  EXPECT_EQ(DOPCODE_CONST_4, (*it)->opcode());
+  // The if-eqz is inverted to skip over a goto/32 to its target.
+  ++it;
+  EXPECT_EQ(DOPCODE_IF_NEZ, (*it)->opcode());
+  EXPECT_EQ(2 + 3, (*it)->offset());
+  ++it;
+  EXPECT_EQ(DOPCODE_GOTO_32, (*it)->opcode());
+  EXPECT_EQ(3 + 3 + 12000 * 3, (*it)->offset());
+  ++it;
+  EXPECT_EQ(DOPCODE_GOTO_32, (*it)->opcode());
+  EXPECT_EQ(3 + 12000 * 3, (*it)->offset());
+  EXPECT_EQ(DOPCODE_RETURN_VOID, insns.back()->opcode());
+}
+
 TEST_F(IRCodeTest, try_region) {
   auto method = static_cast<DexMethod*>(
       DexMethod::make_method("Lfoo;", "tryRegionTest", "V", {}));
@@ -154,3 +188,89 @@ TEST_F(IRCodeTest, try_region) {
   EXPECT_EQ(split, second->m_start_addr);
   EXPECT_EQ(num * op->size() - split, second->m_insn_count);
 }
+
+TEST_F(IRCodeTest, keep_editable_cfg) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :true)
+      (const v1 1)
+      (return v1)
+      (:true)
+      (const v1 2)
+      (return v1)
+    )
+  )");
+  IRCode::set_keep_editable_cfg(true);
+
+  code->build_cfg(/* editable */ true);
+  auto* cfg = &code->cfg();
+  cfg->set_registers_size(5);
+  code->clear_cfg();
+  EXPECT_FALSE(code->cfg_built());
+
+  // The next editable CFG is the same one, not a rebuilt copy.
+  code->build_cfg(/* editable */ true);
+  EXPECT_TRUE(code->editable_cfg_built());
+  EXPECT_EQ(cfg, &code->cfg());
+  code->clear_cfg();
+
+  // Looking at the instruction list linearizes the kept CFG.
+  EXPECT_EQ(5, code->get_registers_size());
+  EXPECT_EQ(5, code->count_opcodes());
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :true)
+      (const v1 1)
+      (return v1)
+      (:true)
+      (const v1 2)
+      (return v1)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected.get()));
+
+  IRCode::set_keep_editable_cfg(false);
+}
+
+TEST_F(IRCodeTest, kept_editable_cfg_is_linearized_once) {
+  IRCode::set_keep_editable_cfg(true);
+  std::vector<std::unique_ptr<IRCode>> codes;
+  for (size_t i = 0; i < 16; ++i) {
+    codes.push_back(assembler::ircode_from_string(R"(
+      (
+        (load-param v0)
+        (if-eqz v0 :true)
+        (const v1 1)
+        (return v1)
+        (:true)
+        (const v1 2)
+        (return v1)
+      )
+    )"));
+    codes.back()->build_cfg(/* editable */ true);
+    codes.back()->clear_cfg();
+  }
+  IRCode::set_keep_editable_cfg(false);
+
+  // Readers of the same code take turns to linearize it.
+  std::vector<std::thread> readers;
+  std::atomic<size_t> num_opcodes{0};
+  for (size_t i = 0; i < 4; ++i) {
+    readers.emplace_back([&]() {
+      for (const auto& code : codes) {
+        const IRCode* const_code = code.get();
+        num_opcodes += const_code->count_opcodes();
+      }
+    });
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(4 * 16 * 5, num_opcodes.load());
+  for (const auto& code : codes) {
+    EXPECT_FALSE(code->cfg_built());
+  }
+}
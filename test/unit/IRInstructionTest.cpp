@@ -95,7 +95,8 @@ TEST(IRInstruction, RoundTrip) {
     }
 
     method->set_dex_code(std::make_unique<DexCode>());
-    method->get_dex_code()->get_instructions().push_back(insn);
+    // Ballooning frees the instructions of the dex code.
+    method->get_dex_code()->get_instructions().push_back(insn->clone());
     method->get_dex_code()->set_registers_size(0xff);
     method->balloon();
     instruction_lowering::lower(method);
@@ -419,3 +420,34 @@ TEST(IRInstruction, InvokeSourceIsWideComplex2) {
 
   delete g_redex;
 }
+
+TEST(IRInstruction, SrcsSpillToHeapAndBack) {
+  g_redex = new RedexContext();
+
+  IRInstruction* insn = new IRInstruction(OPCODE_INVOKE_STATIC);
+  insn->set_arg_word_count(3);
+  for (size_t i = 0; i < 3; ++i) {
+    insn->set_src(i, i + 10);
+  }
+  // Growing past the inline buffer keeps the existing sources and zeroes the
+  // new ones.
+  insn->set_arg_word_count(7);
+  EXPECT_EQ(std::vector<uint16_t>(insn->srcs().begin(), insn->srcs().end()),
+            std::vector<uint16_t>({10, 11, 12, 0, 0, 0, 0}));
+  insn->set_src(6, 16);
+
+  IRInstruction copy(*insn);
+  EXPECT_EQ(copy, *insn);
+  insn->set_arg_word_count(2);
+  EXPECT_EQ(std::vector<uint16_t>(insn->srcs().begin(), insn->srcs().end()),
+            std::vector<uint16_t>({10, 11}));
+  EXPECT_NE(copy, *insn);
+  EXPECT_EQ(copy.src(6), 16);
+
+  copy = *insn;
+  EXPECT_EQ(copy, *insn);
+  EXPECT_EQ(copy.srcs_size(), 2);
+
+  delete insn;
+  delete g_redex;
+}
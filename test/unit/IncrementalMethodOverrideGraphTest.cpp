@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodOverrideGraph.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+namespace mog = method_override_graph;
+
+namespace {
+
+DexMethod* make_virtual(const char* name) {
+  auto method = static_cast<DexMethod*>(DexMethod::make_method(name));
+  method->make_concrete(ACC_PUBLIC, /* is_virtual */ true);
+  return method;
+}
+
+DexClass* make_class(const char* name,
+                     DexType* super,
+                     std::vector<DexMethod*> methods,
+                     bool interface = false) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(super);
+  if (interface) {
+    creator.set_access(ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT);
+  }
+  for (auto* method : methods) {
+    creator.add_method(method);
+  }
+  return creator.create();
+}
+
+using Edges = std::set<std::pair<const DexMethod*, const DexMethod*>>;
+
+Edges edges_of(const mog::Graph& graph) {
+  Edges edges;
+  for (const auto& pair : graph.nodes()) {
+    for (auto* child : pair.second.children) {
+      edges.emplace(pair.first, child);
+    }
+  }
+  return edges;
+}
+
+} // namespace
+
+struct IncrementalMethodOverrideGraphTest : public RedexTest {
+ public:
+  IncrementalMethodOverrideGraphTest() {
+    m_i_m = make_virtual("LI;.m:()V");
+    m_a_m = make_virtual("LA;.m:()V");
+    m_b_m = make_virtual("LB;.m:()V");
+    m_i = make_class("LI;", get_object_type(), {m_i_m}, /* interface */ true);
+    m_a = make_class("LA;", get_object_type(), {m_a_m});
+    m_a->set_interfaces(DexTypeList::make_type_list({m_i->get_type()}));
+    m_b = make_class("LB;", m_a->get_type(), {m_b_m});
+    m_scope = {m_i, m_a, m_b};
+  }
+
+  // The incremental graph must always agree with a graph built from scratch.
+  void expect_up_to_date(const mog::IncrementalGraph& graph) {
+    EXPECT_EQ(edges_of(graph.graph()), edges_of(*mog::build_graph(m_scope)));
+  }
+
+  Scope m_scope;
+  DexClass* m_i;
+  DexClass* m_a;
+  DexClass* m_b;
+  DexMethod* m_i_m;
+  DexMethod* m_a_m;
+  DexMethod* m_b_m;
+};
+
+TEST_F(IncrementalMethodOverrideGraphTest, addAndRemoveMethods) {
+  mog::IncrementalGraph graph(m_scope);
+  expect_up_to_date(graph);
+  EXPECT_EQ(edges_of(graph.graph()),
+            Edges({{m_i_m, m_a_m}, {m_a_m, m_b_m}}));
+
+  // Without A.m, B.m overrides nothing but implements I.m.
+  m_a->remove_method(m_a_m);
+  graph.remove_method(m_a_m);
+  expect_up_to_date(graph);
+  EXPECT_EQ(edges_of(graph.graph()), Edges({{m_i_m, m_b_m}}));
+
+  m_a->add_method(m_a_m);
+  graph.add_method(m_a_m);
+  expect_up_to_date(graph);
+  EXPECT_EQ(edges_of(graph.graph()),
+            Edges({{m_i_m, m_a_m}, {m_a_m, m_b_m}}));
+}
+
+TEST_F(IncrementalMethodOverrideGraphTest, changeVirtualStatus) {
+  mog::IncrementalGraph graph(m_scope);
+  m_b->remove_method(m_b_m);
+  m_b_m->set_virtual(false);
+  m_b->add_method(m_b_m);
+  graph.update_virtual_status(m_b_m);
+  expect_up_to_date(graph);
+  EXPECT_EQ(edges_of(graph.graph()), Edges({{m_i_m, m_a_m}}));
+}
+
+TEST_F(IncrementalMethodOverrideGraphTest, moveClasses) {
+  mog::IncrementalGraph graph(m_scope);
+
+  // A new class under B.
+  auto c_m = make_virtual("LC;.m:()V");
+  auto c = make_class("LC;", m_b->get_type(), {c_m});
+  m_scope.push_back(c);
+  graph.move_class(c);
+  expect_up_to_date(graph);
+  EXPECT_EQ(get_overriding_methods(graph.graph(), m_a_m).size(), 2);
+
+  // B no longer extends A, so neither B.m nor C.m override A.m.
+  m_b->set_super_class(get_object_type());
+  graph.move_class(m_b);
+  expect_up_to_date(graph);
+  EXPECT_EQ(edges_of(graph.graph()),
+            Edges({{m_i_m, m_a_m}, {m_b_m, c_m}}));
+}
+
+TEST_F(IncrementalMethodOverrideGraphTest, compactGraph) {
+  auto graph = mog::build_graph(m_scope);
+  mog::CompactGraph compact(*graph);
+  EXPECT_EQ(compact.size(), 3);
+  for (auto* method : {m_i_m, m_a_m, m_b_m}) {
+    EXPECT_EQ(mog::get_overriding_methods(compact, method),
+              mog::get_overriding_methods(*graph, method));
+  }
+  EXPECT_EQ(mog::get_overriding_methods(compact, m_i_m),
+            std::unordered_set<const DexMethod*>({m_a_m, m_b_m}));
+  EXPECT_EQ(compact.children(compact.id(m_b_m)).size(), 0);
+}
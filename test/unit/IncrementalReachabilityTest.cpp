@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Reachability.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+namespace {
+
+DexClass* make_class(const char* name, std::vector<DexMethod*> methods) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  for (auto* method : methods) {
+    creator.add_method(method);
+  }
+  return creator.create();
+}
+
+} // namespace
+
+class IncrementalReachabilityTest : public RedexTest {
+ public:
+  IncrementalReachabilityTest() {
+    m_main = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.main:()V"
+       (
+        (invoke-static () "LBar;.b:()V")
+        (return-void)
+       )
+      )
+    )");
+    m_b = assembler::method_from_string(R"(
+      (method (public static) "LBar;.b:()V"
+       (
+        (invoke-static () "LBaz;.c:()V")
+        (return-void)
+       )
+      )
+    )");
+    m_c = assembler::method_from_string(R"(
+      (method (public static) "LBaz;.c:()V"
+       (
+        (return-void)
+       )
+      )
+    )");
+    m_foo = make_class("LFoo;", {m_main});
+    m_bar = make_class("LBar;", {m_b});
+    m_baz = make_class("LBaz;", {m_c});
+    m_foo->rstate.set_root();
+    m_main->rstate.set_root();
+
+    DexStore store("classes");
+    store.add_classes({m_foo, m_bar, m_baz});
+    m_stores.emplace_back(std::move(store));
+  }
+
+  DexStoresVector m_stores;
+  reachability::IgnoreSets m_ignore_sets;
+  DexMethod* m_main;
+  DexMethod* m_b;
+  DexMethod* m_c;
+  DexClass* m_foo;
+  DexClass* m_bar;
+  DexClass* m_baz;
+};
+
+TEST_F(IncrementalReachabilityTest, onlyChangedCodeIsGatheredAgain) {
+  reachability::IncrementalReachability incremental(/* validate */ true);
+  const auto& cache = incremental.references_cache();
+
+  auto reachables =
+      incremental.compute(m_stores, m_ignore_sets, /* num_ignore */ nullptr);
+  for (const DexMethod* m : {m_main, m_b, m_c}) {
+    EXPECT_TRUE(reachables->marked(m));
+  }
+  EXPECT_TRUE(reachables->marked(m_baz));
+  EXPECT_EQ(cache.misses(), 3);
+  EXPECT_EQ(cache.hits(), 0);
+
+  // Nothing changed.
+  reachables =
+      incremental.compute(m_stores, m_ignore_sets, /* num_ignore */ nullptr);
+  EXPECT_TRUE(reachables->marked(m_c));
+  EXPECT_EQ(cache.misses(), 3);
+  EXPECT_EQ(cache.hits(), 3);
+
+  // Bar.b no longer calls Baz.c, which becomes unreachable.
+  m_b->set_code(assembler::ircode_from_string("((return-void))"));
+  reachables =
+      incremental.compute(m_stores, m_ignore_sets, /* num_ignore */ nullptr);
+  EXPECT_TRUE(reachables->marked(m_b));
+  EXPECT_FALSE(reachables->marked(m_c));
+  EXPECT_FALSE(reachables->marked(m_baz));
+  EXPECT_EQ(cache.misses(), 4);
+  EXPECT_EQ(cache.hits(), 4);
+}
+
+TEST_F(IncrementalReachabilityTest, codeEpochs) {
+  const DexMethod* main = m_main;
+  auto epoch = main->get_code_epoch();
+  EXPECT_EQ(main->get_code_epoch(), epoch);
+  main->get_code();
+  EXPECT_EQ(main->get_code_epoch(), epoch);
+  // Mutable access alone doesn't change the code.
+  m_main->get_code();
+  EXPECT_EQ(main->get_code_epoch(), epoch);
+  m_main->get_code()->push_back(new IRInstruction(OPCODE_NOP));
+  auto next = main->get_code_epoch();
+  EXPECT_NE(next, epoch);
+  // Nor does putting the code back as it was bring the old epoch back.
+  m_main->set_code(assembler::ircode_from_string(R"(
+    (
+     (invoke-static () "LBar;.b:()V")
+     (return-void)
+    )
+  )"));
+  EXPECT_NE(main->get_code_epoch(), epoch);
+  next = main->get_code_epoch();
+  // Epochs are never handed out twice, whatever the method.
+  EXPECT_NE(static_cast<const DexMethod*>(m_b)->get_code_epoch(), next);
+}
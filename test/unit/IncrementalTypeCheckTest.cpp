@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+
+namespace {
+
+class NoopPass : public Pass {
+ public:
+  explicit NoopPass(const char* name) : Pass(name) {}
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {}
+};
+
+// Changes the code of one method, and gets mutable access to the code of
+// another without changing it.
+class TouchPass : public Pass {
+ public:
+  TouchPass(DexMethod* changed, DexMethod* touched)
+      : Pass("TouchPass"), m_changed(changed), m_touched(touched) {}
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {
+    auto code = m_changed->get_code();
+    code->insert_before(code->begin(), new IRInstruction(OPCODE_NOP));
+    m_touched->get_code();
+  }
+
+ private:
+  DexMethod* m_changed;
+  DexMethod* m_touched;
+};
+
+} // namespace
+
+struct IncrementalTypeCheckTest : public RedexTest {};
+
+TEST_F(IncrementalTypeCheckTest, onlyChangedMethodsAreCheckedAgain) {
+  auto a = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.a:()I"
+     (
+      (const v0 1)
+      (return v0)
+     )
+    )
+  )");
+  auto b = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.b:()V"
+     (
+      (return-void)
+     )
+    )
+  )");
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(a);
+  creator.add_method(b);
+  DexStore store("classes");
+  store.add_classes({creator.create()});
+  std::vector<DexStore> stores;
+  stores.emplace_back(std::move(store));
+
+  NoopPass first("FirstPass");
+  TouchPass touch(b, a);
+  NoopPass last("LastPass");
+  PassManager manager({&first, &touch, &last});
+  Json::Value json;
+  json["ir_type_checker"]["run_after_each_pass"] = true;
+  ConfigFiles config(json);
+  manager.run_passes(stores, config);
+
+  const auto& infos = manager.get_pass_info();
+  ASSERT_EQ(infos.size(), 3);
+  auto metric = [&](size_t pass, const char* name) {
+    return infos[pass].metrics.at(name);
+  };
+  EXPECT_EQ(metric(0, "~type~checker~checked~methods~"), 2);
+  EXPECT_EQ(metric(0, "~type~checker~skipped~methods~"), 0);
+  EXPECT_EQ(metric(1, "~type~checker~checked~methods~"), 1);
+  EXPECT_EQ(metric(1, "~type~checker~skipped~methods~"), 1);
+  EXPECT_EQ(metric(2, "~type~checker~checked~methods~"), 0);
+  EXPECT_EQ(metric(2, "~type~checker~skipped~methods~"), 2);
+}
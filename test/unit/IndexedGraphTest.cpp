@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "IndexedGraph.h"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <sstream>
+
+#include "BinarySerialization.h"
+
+namespace bs = binary_serialization;
+
+namespace {
+
+// Node 0 is the root, and node 5 has no edges:
+//
+//   0 -> 1 -> 3 -> 4
+//   0 -> 2 -> 3
+std::string write_graph() {
+  std::map<uint32_t, std::vector<uint32_t>> succs{
+      {0, {1, 2}}, {1, {3}}, {2, {3}}, {3, {4}}};
+  bs::IndexedGraphWriter<uint32_t> gw(
+      [](uint32_t node) {
+        return std::make_pair(uint8_t(node == 0 ? 4 : 1),
+                              "node" + std::to_string(node));
+      },
+      [&](uint32_t node) {
+        auto it = succs.find(node);
+        return it == succs.end() ? std::vector<uint32_t>() : it->second;
+      });
+  std::ostringstream os;
+  bs::write_header(os, bs::INDEXED_GRAPH_VERSION);
+  gw.write(os, std::vector<uint32_t>{0, 1, 2, 3, 4, 5});
+  return os.str();
+}
+
+std::vector<uint32_t> to_vector(const bs::IndexedGraph::Range& range) {
+  return std::vector<uint32_t>(range.begin(), range.end());
+}
+
+} // namespace
+
+TEST(IndexedGraphTest, nodesAndEdgesRoundTrip) {
+  auto data = write_graph();
+  bs::IndexedGraph graph(data.data(), data.size());
+
+  EXPECT_EQ(graph.size(), 6);
+  EXPECT_EQ(graph.edges_size(), 5);
+  EXPECT_EQ(graph.label(3), "node3");
+  EXPECT_EQ(graph.kind(0), 4);
+  EXPECT_EQ(graph.kind(5), 1);
+  EXPECT_EQ(to_vector(graph.successors(0)), std::vector<uint32_t>({1, 2}));
+  EXPECT_TRUE(to_vector(graph.successors(5)).empty());
+  EXPECT_EQ(to_vector(graph.predecessors(3)), std::vector<uint32_t>({1, 2}));
+  EXPECT_TRUE(to_vector(graph.predecessors(0)).empty());
+  EXPECT_EQ(graph.find("node4"), std::vector<uint32_t>({4}));
+  EXPECT_TRUE(graph.find("node").empty());
+}
+
+TEST(IndexedGraphTest, shortestPathAgainstEdges) {
+  auto data = write_graph();
+  bs::IndexedGraph graph(data.data(), data.size());
+
+  auto path = bs::shortest_path(graph, 4, bs::Direction::PREDECESSORS,
+                                [&](uint32_t n) { return graph.kind(n) == 4; });
+  ASSERT_EQ(path.size(), 4);
+  EXPECT_EQ(path.front(), 4);
+  EXPECT_EQ(path[1], 3);
+  EXPECT_EQ(path.back(), 0);
+
+  EXPECT_TRUE(bs::shortest_path(graph, 5, bs::Direction::PREDECESSORS,
+                                [&](uint32_t n) { return graph.kind(n) == 4; })
+                  .empty());
+}
+
+TEST(IndexedGraphTest, immediateDominators) {
+  auto data = write_graph();
+  bs::IndexedGraph graph(data.data(), data.size());
+
+  auto idoms = bs::immediate_dominators(graph, {0}, bs::Direction::SUCCESSORS);
+  ASSERT_EQ(idoms.size(), 6);
+  EXPECT_EQ(idoms[0], graph.size());
+  EXPECT_EQ(idoms[1], 0);
+  EXPECT_EQ(idoms[2], 0);
+  // Both 1 and 2 lead to 3.
+  EXPECT_EQ(idoms[3], 0);
+  EXPECT_EQ(idoms[4], 3);
+  EXPECT_EQ(idoms[5], bs::IndexedGraph::NONE);
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "IndexedPriorityQueue.h"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+
+TEST(IndexedPriorityQueueTest, basicOperations) {
+  IndexedPriorityQueue<uint64_t> queue;
+  EXPECT_TRUE(queue.empty());
+  queue.insert(3, 30);
+  queue.insert(0, 50);
+  queue.insert(7, 10);
+  EXPECT_EQ(queue.size(), 3);
+  EXPECT_EQ(queue.front(), 0);
+  EXPECT_TRUE(queue.contains(7));
+  EXPECT_FALSE(queue.contains(1));
+
+  queue.update_priority(7, 60);
+  EXPECT_EQ(queue.front(), 7);
+  EXPECT_EQ(queue.get_priority(7), 60);
+  queue.update_priority(7, 20);
+  EXPECT_EQ(queue.front(), 0);
+
+  queue.erase(0);
+  EXPECT_FALSE(queue.contains(0));
+  EXPECT_EQ(queue.front(), 3);
+  queue.erase(3);
+  EXPECT_EQ(queue.front(), 7);
+  queue.erase(7);
+  EXPECT_TRUE(queue.empty());
+
+  queue.insert(0, 1);
+  queue.clear();
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.contains(0));
+}
+
+TEST(IndexedPriorityQueueTest, agreesWithOrderedMap) {
+  std::mt19937 gen(42);
+  const uint32_t num_values = 200;
+  IndexedPriorityQueue<uint64_t> queue;
+  // Priorities are kept unique by using the value as the low bits.
+  std::map<uint64_t, uint32_t> expected;
+  std::vector<uint64_t> priorities(num_values);
+  auto make_priority = [&](uint32_t value) {
+    return (static_cast<uint64_t>(gen() % 1000) << 8) | value;
+  };
+  for (uint32_t value = 0; value < num_values; ++value) {
+    priorities[value] = make_priority(value);
+    queue.insert(value, priorities[value]);
+    expected.emplace(priorities[value], value);
+  }
+  for (size_t i = 0; i < 2000; ++i) {
+    uint32_t value = gen() % num_values;
+    if (queue.contains(value)) {
+      expected.erase(priorities[value]);
+      if (gen() % 4 == 0) {
+        queue.erase(value);
+      } else {
+        priorities[value] = make_priority(value);
+        queue.update_priority(value, priorities[value]);
+        expected.emplace(priorities[value], value);
+      }
+    } else {
+      priorities[value] = make_priority(value);
+      queue.insert(value, priorities[value]);
+      expected.emplace(priorities[value], value);
+    }
+    ASSERT_EQ(queue.size(), expected.size());
+    if (!expected.empty()) {
+      ASSERT_EQ(queue.front(), expected.rbegin()->second);
+    }
+  }
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexInstruction.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "InstructionLowering.h"
+#include "RedexTest.h"
+
+class InstructionLoweringTest : public RedexTest {};
+
+/*
+ * Lowering a division or a remainder folds its move-result-pseudo into it,
+ * and the folded instruction is still converted to its /2addr form.
+ */
+TEST_F(InstructionLoweringTest, divisionsAndRemaindersBecome2addr) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(II)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (div-int v0 v1)
+        (move-result-pseudo v0)
+        (rem-int v0 v1)
+        (move-result-pseudo v0)
+        (return v0)
+      )
+    )
+  )");
+
+  auto stats = instruction_lowering::lower(method);
+  EXPECT_EQ(2, stats.to_2addr);
+
+  std::vector<DexOpcode> opcodes;
+  for (const auto& mie : *method->get_code()) {
+    if (mie.type == MFLOW_DEX_OPCODE) {
+      opcodes.push_back(mie.dex_insn->opcode());
+    }
+  }
+  EXPECT_EQ(std::vector<DexOpcode>({DOPCODE_DIV_INT_2ADDR,
+                                    DOPCODE_REM_INT_2ADDR, DOPCODE_RETURN}),
+            opcodes);
+}
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InstrumentProfile.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "BinarySerialization.h"
+
+using namespace instrument;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+class InstrumentProfileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    m_dir = fs::temp_directory_path() / fs::unique_path("profile-%%%%%%");
+    fs::create_directories(m_dir);
+  }
+
+  void TearDown() override { fs::remove_all(m_dir); }
+
+  std::string write_metadata(const InstrumentMetadata& metadata) {
+    auto path = (m_dir / "metadata.bin").string();
+    std::ofstream ofs(path, std::ofstream::binary);
+    metadata.write(ofs);
+    return path;
+  }
+
+  std::string write_profile(const std::vector<uint32_t>& counters) {
+    auto path = (m_dir / ("p" + std::to_string(m_profiles.size()))).string();
+    std::ofstream ofs(path, std::ofstream::binary);
+    binary_serialization::write_header(ofs, PROFILE_VERSION);
+    binary_serialization::write_array(ofs, counters);
+    m_profiles.push_back(path);
+    return path;
+  }
+
+  fs::path m_dir;
+  std::vector<std::string> m_profiles;
+};
+
+} // namespace
+
+TEST_F(InstrumentProfileTest, methodCounts) {
+  InstrumentMetadata metadata;
+  metadata.kind = ProfileKind::METHOD_COUNTS;
+  metadata.num_counters = 4;
+  metadata.methods.resize(2);
+  metadata.methods[0].name = "LFoo;.a:()V";
+  metadata.methods[0].first_counter = 0;
+  metadata.methods[0].num_counters = 2;
+  metadata.methods[1].name = "LFoo;.b:()V";
+  metadata.methods[1].first_counter = 2;
+  metadata.methods[1].num_counters = 2;
+  auto read = InstrumentMetadata::read(write_metadata(metadata));
+  ASSERT_EQ(read.methods.size(), 2);
+  EXPECT_EQ(read.methods[1].name, "LFoo;.b:()V");
+  EXPECT_EQ(read.methods[1].first_counter, 2);
+
+  for (uint32_t i = 0; i < 100; ++i) {
+    write_profile({i, 7, 0, 7});
+  }
+  // Doesn't match the metadata.
+  write_profile({1, 2, 3});
+  auto summary = merge_profiles(read, m_profiles, 4);
+  EXPECT_EQ(summary.num_profiles, 100);
+  EXPECT_EQ(summary.num_rejected, 1);
+  EXPECT_EQ(summary.method_weights.size(), 1);
+  EXPECT_EQ(summary.method_weights.at("LFoo;.a:()V"), 4950);
+  EXPECT_TRUE(summary.block_heat.empty());
+}
+
+TEST_F(InstrumentProfileTest, blockBits) {
+  InstrumentMetadata metadata;
+  metadata.kind = ProfileKind::BLOCK_BITS;
+  metadata.num_counters = 3;
+  metadata.methods.resize(1);
+  metadata.methods[0].name = "LFoo;.a:()V";
+  metadata.methods[0].first_counter = 1;
+  metadata.methods[0].num_counters = 2;
+  metadata.methods[0].graph.num_blocks = 17;
+  auto read = InstrumentMetadata::read(write_metadata(metadata));
+
+  // Blocks 0 and 16 ran in both profiles, block 1 in one.
+  write_profile({0, 0x8001, 0x2});
+  write_profile({0, 0x8003, 0x2});
+  auto summary = merge_profiles(read, m_profiles, 2);
+  const auto& heat = summary.block_heat.at("LFoo;.a:()V");
+  ASSERT_EQ(heat.size(), 17);
+  EXPECT_EQ(heat[0], 2);
+  EXPECT_EQ(heat[1], 1);
+  EXPECT_EQ(heat[2], 0);
+  EXPECT_EQ(heat[16], 2);
+  EXPECT_EQ(summary.method_weights.at("LFoo;.a:()V"), 2);
+}
+
+TEST_F(InstrumentProfileTest, edgeCounts) {
+  // The loop of EdgeProfileTest: 0 -> 1 -> 2 -> 1, 2 -> 3 -> exit.
+  MethodMetadata method;
+  method.name = "LFoo;.loop:()V";
+  method.graph.num_blocks = 4;
+  method.graph.edges = {{0, 1, 1}, {1, 2, 1}, {2, 1, 2}, {2, 3, 1}, {3, 4, 1}};
+  method.graph.may_throw = {false, false, true, false};
+  method.counted = choose_counted_edges(method.graph);
+  method.num_counters =
+      std::count(method.counted.begin(), method.counted.end(), true);
+  InstrumentMetadata metadata;
+  metadata.kind = ProfileKind::EDGE_COUNTS;
+  metadata.num_counters = method.num_counters;
+  metadata.methods.push_back(method);
+  auto read = InstrumentMetadata::read(write_metadata(metadata));
+  EXPECT_EQ(read.methods[0].counted, method.counted);
+  EXPECT_EQ(read.methods[0].graph.may_throw, method.graph.may_throw);
+
+  // Two profiles of 3 and 1 calls, with 10 iterations each.
+  const std::vector<uint32_t> edge_counts[] = {{3, 33, 30, 3, 3},
+                                               {1, 11, 10, 1, 1}};
+  for (const auto& counts : edge_counts) {
+    std::vector<uint32_t> counters;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      if (method.counted[i]) {
+        counters.push_back(counts[i]);
+      }
+    }
+    write_profile(counters);
+  }
+  auto summary = merge_profiles(read, m_profiles, 0);
+  EXPECT_EQ(summary.block_heat.at("LFoo;.loop:()V"),
+            std::vector<uint64_t>({4, 44, 44, 4}));
+  EXPECT_EQ(summary.method_weights.at("LFoo;.loop:()V"), 4);
+}
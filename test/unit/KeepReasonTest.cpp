@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "KeepReason.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+struct KeepReasonTest : public RedexTest {};
+
+TEST_F(KeepReasonTest, reasonStoreInterns) {
+  auto m1 = static_cast<DexMethod*>(DexMethod::make_method("LFoo;.a:()V"));
+  auto m2 = static_cast<DexMethod*>(DexMethod::make_method("LFoo;.b:()V"));
+
+  keep_reason::ReasonStore store;
+  auto xml = store.make(keep_reason::XML);
+  auto refl1 = store.make(keep_reason::REFLECTION, m1);
+  auto refl2 = store.make(keep_reason::REFLECTION, m2);
+  EXPECT_EQ(store.make(keep_reason::XML), xml);
+  EXPECT_EQ(store.make(keep_reason::REFLECTION, m1), refl1);
+  EXPECT_NE(refl1, refl2);
+  EXPECT_EQ(store.size(), 3);
+
+  EXPECT_EQ(xml->id, 0);
+  EXPECT_EQ(refl1->id, 1);
+  EXPECT_EQ(refl2->id, 2);
+  EXPECT_EQ(refl2->method, m2);
+}
+
+TEST_F(KeepReasonTest, onlyForWhyAreYouKeeping) {
+  ClassCreator a_creator(DexType::make_type("LA;"));
+  a_creator.set_super(get_object_type());
+  auto a = a_creator.create();
+  ClassCreator b_creator(DexType::make_type("LB;"));
+  b_creator.set_super(get_object_type());
+  auto b = b_creator.create();
+
+  RedexContext::set_record_keep_reasons(true);
+  RedexContext::set_record_keep_reasons_only_for_whyareyoukeeping(true);
+  a->rstate.set_whyareyoukeeping();
+  a->rstate.set_root(keep_reason::MANIFEST);
+  b->rstate.set_root(keep_reason::MANIFEST);
+  EXPECT_EQ(a->rstate.keep_reasons().size(), 1);
+  EXPECT_TRUE(b->rstate.keep_reasons().empty());
+  EXPECT_FALSE(b->rstate.can_delete());
+
+  RedexContext::set_record_keep_reasons_only_for_whyareyoukeeping(false);
+  b->rstate.set_root(keep_reason::MANIFEST);
+  ASSERT_EQ(b->rstate.keep_reasons().size(), 1);
+  EXPECT_EQ(*b->rstate.keep_reasons().begin(),
+            *a->rstate.keep_reasons().begin());
+  EXPECT_EQ(g_redex->keep_reasons().size(), 1);
+}
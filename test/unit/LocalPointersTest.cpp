@@ -10,8 +10,11 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "Creators.h"
+#include "DexUtil.h"
 #include "IRAssembler.h"
 #include "RedexTest.h"
+#include "Resolver.h"
 #include "Show.h"
 
 namespace ptrs = local_pointers;
@@ -397,3 +400,100 @@ TEST_F(LocalPointersTest, returnEscapedValue) {
     EXPECT_TRUE(exit_env.may_have_escaped(invoke_insn));
   }
 }
+
+namespace {
+
+// Every resolved invoke is an edge, and every method is a root.
+class AllMethodsStrategy final : public call_graph::BuildStrategy {
+ public:
+  explicit AllMethodsStrategy(std::vector<DexMethod*> methods)
+      : m_methods(methods) {}
+
+  std::vector<DexMethod*> get_roots() const override { return m_methods; }
+
+  call_graph::CallSites get_callsites(const DexMethod* method) const override {
+    call_graph::CallSites callsites;
+    auto* code = const_cast<IRCode*>(method->get_code());
+    for (auto& mie : InstructionIterable(code)) {
+      if (is_invoke(mie.insn->opcode())) {
+        auto callee =
+            resolve_method(mie.insn->get_method(), MethodSearch::Static);
+        if (callee != nullptr) {
+          callsites.emplace_back(callee, code->iterator_to(mie));
+        }
+      }
+    }
+    return callsites;
+  }
+
+ private:
+  std::vector<DexMethod*> m_methods;
+};
+
+} // namespace
+
+TEST_F(LocalPointersTest, analyzeScopeBottomUp) {
+  auto make = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.make:()LFoo;"
+     (
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  auto wrap = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.wrap:()LFoo;"
+     (
+      (invoke-static () "LFoo;.make:()LFoo;")
+      (move-result-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  auto ping = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.ping:(LFoo;)V"
+     (
+      (load-param-object v0)
+      (invoke-static (v0) "LFoo;.pong:(LFoo;)V")
+      (return-void)
+     )
+    )
+  )");
+  auto pong = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.pong:(LFoo;)V"
+     (
+      (load-param-object v0)
+      (invoke-static (v0) "LFoo;.ping:(LFoo;)V")
+      (return-void)
+     )
+    )
+  )");
+  std::vector<DexMethod*> methods{make, wrap, ping, pong};
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  for (auto* method : methods) {
+    creator.add_method(method);
+    method->get_code()->build_cfg(/* editable */ false);
+    method->get_code()->cfg().calculate_exit_block();
+  }
+  Scope scope{creator.create()};
+
+  AllMethodsStrategy strategy(methods);
+  call_graph::Graph graph(strategy);
+  ptrs::SummaryCMap summaries;
+  auto fp_iter_map = ptrs::analyze_scope(scope, graph, &summaries);
+  for (auto* method : methods) {
+    EXPECT_EQ(fp_iter_map->count(method), 1) << show(method);
+  }
+
+  // The callee was summarized before its caller.
+  EXPECT_EQ(summaries.at(make).returned_parameters,
+            ptrs::ParamSet(ptrs::FRESH_RETURN));
+  EXPECT_EQ(summaries.at(wrap).returned_parameters,
+            ptrs::ParamSet(ptrs::FRESH_RETURN));
+  // Within the cycle, the first method to be analyzed knows nothing of the
+  // other one, so its parameter escapes, and then so does the other's.
+  EXPECT_THAT(summaries.at(ping).escaping_parameters, UnorderedElementsAre(0));
+  EXPECT_THAT(summaries.at(pong).escaping_parameters, UnorderedElementsAre(0));
+}
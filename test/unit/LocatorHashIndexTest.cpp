@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "locator_index.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using facebook::Locator;
+using facebook::LocatorHashIndex;
+
+namespace {
+
+std::vector<std::pair<std::string, Locator>> make_classes(size_t count) {
+  std::vector<std::pair<std::string, Locator>> classes;
+  for (size_t i = 0; i < count; i++) {
+    classes.emplace_back("Lcom/foo/Class" + std::to_string(i) + ";",
+                         Locator::make(i % 3, 1 + i % 7, i));
+  }
+  return classes;
+}
+
+} // namespace
+
+TEST(LocatorHashIndexTest, findsEveryClass) {
+  auto classes = make_classes(5000);
+  auto data = LocatorHashIndex::build(classes);
+  LocatorHashIndex index(data.data(), data.size());
+  ASSERT_TRUE(index.valid());
+  EXPECT_EQ(index.size(), classes.size());
+  for (const auto& pair : classes) {
+    auto locator = index.lookup(pair.first.c_str());
+    EXPECT_EQ(locator.strnr, pair.second.strnr) << pair.first;
+    EXPECT_EQ(locator.dexnr, pair.second.dexnr) << pair.first;
+    EXPECT_EQ(locator.clsnr, pair.second.clsnr) << pair.first;
+  }
+  // Arrays are found by their element type.
+  EXPECT_EQ(index.lookup("[[Lcom/foo/Class42;").clsnr, 42);
+}
+
+TEST(LocatorHashIndexTest, missingClassesGetTheSystemLocator) {
+  auto data = LocatorHashIndex::build(make_classes(100));
+  LocatorHashIndex index(data.data(), data.size());
+  ASSERT_TRUE(index.valid());
+  for (const char* descriptor :
+       {"Ljava/lang/Object;", "Lcom/foo/Class100;", "Lcom/foo/Class1", ""}) {
+    auto locator = index.lookup(descriptor);
+    EXPECT_EQ(locator.dexnr, 0) << descriptor;
+    EXPECT_EQ(locator.clsnr, 0) << descriptor;
+  }
+}
+
+TEST(LocatorHashIndexTest, emptyAndInvalidIndices) {
+  auto data = LocatorHashIndex::build({});
+  LocatorHashIndex empty(data.data(), data.size());
+  ASSERT_TRUE(empty.valid());
+  EXPECT_EQ(empty.lookup("LFoo;").dexnr, 0);
+
+  data = LocatorHashIndex::build(make_classes(10));
+  EXPECT_FALSE(LocatorHashIndex(data.data(), 8).valid());
+  data[0] = 'X';
+  EXPECT_FALSE(LocatorHashIndex(data.data(), data.size()).valid());
+
+  auto duplicates = make_classes(2);
+  duplicates.push_back(duplicates[0]);
+  EXPECT_THROW(LocatorHashIndex::build(duplicates), std::runtime_error);
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "ControlFlow.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "MemoryCensus.h"
+#include "RedexTest.h"
+
+struct MemoryCensusTest : public RedexTest {};
+
+namespace {
+
+size_t count_of(const MemoryCensus& census, const std::string& name) {
+  auto it = census.categories().find(name);
+  return it == census.categories().end() ? 0 : it->second.count;
+}
+
+} // namespace
+
+TEST_F(MemoryCensusTest, countsCodeAndPositions) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)I"
+      (
+        (load-param v0)
+        (.pos "LFoo;.bar:(I)I" "Foo.java" 12)
+        (if-eqz v0 :label)
+        (const v0 1)
+        (:label)
+        (return v0)
+      )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {method})};
+
+  auto census = MemoryCensus::take(scope);
+  EXPECT_EQ(count_of(census, "classes"), 1);
+  EXPECT_EQ(count_of(census, "methods"), 1);
+  EXPECT_EQ(count_of(census, "ir_code"), 1);
+  EXPECT_EQ(count_of(census, "ir_instructions"), 4);
+  EXPECT_EQ(count_of(census, "positions"), 1);
+  EXPECT_EQ(count_of(census, "try_catch_targets"), 1);
+  EXPECT_GT(count_of(census, "context.strings"), 0);
+  EXPECT_EQ(count_of(census, "cfg.blocks"), 0);
+  EXPECT_GT(census.total_bytes(), 0);
+
+  // With an editable CFG, the same instructions are found in the blocks.
+  method->get_code()->build_cfg(/* editable */ true);
+  auto with_cfg = MemoryCensus::take(scope);
+  EXPECT_EQ(count_of(with_cfg, "ir_instructions"), 4);
+  EXPECT_GT(count_of(with_cfg, "cfg.blocks"), 0);
+  EXPECT_GT(count_of(with_cfg, "cfg.edges"), 0);
+  method->get_code()->clear_cfg();
+
+  std::ostringstream out;
+  census.print(out);
+  EXPECT_NE(out.str().find("ir_instructions"), std::string::npos);
+  EXPECT_NE(out.str().find("total"), std::string::npos);
+}
@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodDedup.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class MethodDedupTest : public RedexTest {};
+
+namespace {
+
+DexMethod* make_method(const std::string& name, const std::string& body) {
+  return assembler::method_from_string("(method (public static) \"LFoo;." +
+                                       name + ":(I)I\" (" + body + "))");
+}
+
+} // namespace
+
+TEST_F(MethodDedupTest, groupIdenticalMethods) {
+  std::string body = R"(
+    (load-param v0)
+    (add-int/lit8 v0 v0 1)
+    (mul-int/lit8 v0 v0 2)
+    (return v0)
+  )";
+  // The same instructions, in another order.
+  std::string reordered = R"(
+    (load-param v0)
+    (mul-int/lit8 v0 v0 2)
+    (add-int/lit8 v0 v0 1)
+    (return v0)
+  )";
+  auto a = make_method("a", body);
+  auto b = make_method("b", body);
+  auto c = make_method("c", reordered);
+  auto d = make_method("d", body);
+
+  auto groups = method_dedup::group_identical_methods({d, c, b, a});
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_EQ(groups[0], MethodOrderedSet({a, b, d}));
+  EXPECT_EQ(groups[1], MethodOrderedSet({c}));
+
+  EXPECT_TRUE(method_dedup::are_methods_identical({a, b, d}));
+  EXPECT_FALSE(method_dedup::are_methods_identical({a, c}));
+}
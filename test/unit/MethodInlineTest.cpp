@@ -14,6 +14,7 @@
 #include "IRAssembler.h"
 #include "IRCode.h"
 #include "Inliner.h"
+#include "MethodInliner.h"
 #include "RedexTest.h"
 
 struct MethodInlineTest : public RedexTest {};
@@ -253,3 +254,208 @@ TEST_F(MethodInlineTest, test_intra_dex_inlining) {
     EXPECT_EQ(inlined.count(method), 1);
   }
 }
+
+TEST_F(MethodInlineTest, parallelInliningMatchesSequentialInlining) {
+  // Zero threads stands for the sequential inliner.
+  std::vector<std::string> results;
+  for (size_t num_threads : {0, 1, 2, 4}) {
+    auto name = "LFoo" + std::to_string(num_threads) + ";";
+    auto cls = create_a_class(name.c_str());
+    DexStoresVector stores;
+    DexStore store("root");
+    store.add_classes({cls});
+    stores.push_back(std::move(store));
+
+    auto leaf1 = make_a_method(cls, "leaf1", 1);
+    auto leaf2 = make_a_method(cls, "leaf2", 2);
+    auto mid1 = make_a_method_calls_others(cls, "mid1", {leaf1, leaf2});
+    auto mid2 = make_a_method_calls_others(cls, "mid2", {leaf2});
+    auto top = make_a_method_calls_others(cls, "top", {mid1, mid2, mid1});
+    std::unordered_set<DexMethod*> candidates{leaf1, leaf2, mid1, mid2};
+
+    auto scope = build_class_scope(stores);
+    api::LevelChecker::init(0, scope);
+    inliner::InlinerConfig inliner_config;
+    inliner_config.multiple_callers = true;
+    inliner_config.populate(scope);
+    {
+      MultiMethodInliner inliner(
+          scope, stores, candidates, resolve_method_cached, inliner_config);
+      if (num_threads == 0) {
+        inliner.inline_methods();
+      } else {
+        inliner.inline_methods_in_parallel(num_threads);
+      }
+      EXPECT_EQ(inliner.get_inlined(), candidates);
+    }
+    results.push_back(assembler::to_string(top->get_code()));
+  }
+  for (const auto& result : results) {
+    EXPECT_EQ(result, results[0]);
+  }
+  EXPECT_EQ(results[0].find("invoke"), std::string::npos);
+}
+
+TEST_F(MethodInlineTest, calleeSummaryDependsOnCallerClass) {
+  auto callee = assembler::method_from_string(R"(
+    (method (private) "LA;.callee:()V"
+     (
+      (load-param-object v0)
+      (invoke-super (v0) "Ljava/lang/Object;.hashCode:()I")
+      (return-void)
+     )
+    )
+  )");
+  auto same_class_caller = assembler::method_from_string(R"(
+    (method (public) "LA;.caller:()V"
+     (
+      (load-param-object v0)
+      (invoke-direct (v0) "LA;.callee:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto other_class_caller = assembler::method_from_string(R"(
+    (method (public static) "LB;.caller:(LA;)V"
+     (
+      (load-param-object v0)
+      (invoke-direct (v0) "LA;.callee:()V")
+      (return-void)
+     )
+    )
+  )");
+  ClassCreator a_creator(DexType::make_type("LA;"));
+  a_creator.set_super(get_object_type());
+  a_creator.add_method(callee);
+  a_creator.add_method(same_class_caller);
+  ClassCreator b_creator(DexType::make_type("LB;"));
+  b_creator.set_super(get_object_type());
+  b_creator.add_method(other_class_caller);
+
+  DexStoresVector stores;
+  DexStore store("root");
+  store.add_classes({a_creator.create(), b_creator.create()});
+  stores.push_back(std::move(store));
+  auto scope = build_class_scope(stores);
+  api::LevelChecker::init(0, scope);
+  inliner::InlinerConfig inliner_config;
+  inliner_config.populate(scope);
+  MultiMethodInliner inliner(
+      scope, stores, {callee}, resolve_method_cached, inliner_config);
+
+  // The invoke-super can't be moved out of A.
+  EXPECT_FALSE(inliner.is_inlinable(other_class_caller, callee, nullptr, 0));
+  EXPECT_TRUE(inliner.is_inlinable(same_class_caller, callee, nullptr, 0));
+  inliner.inline_callees(other_class_caller, {callee});
+  inliner.inline_callees(same_class_caller, {callee});
+  EXPECT_EQ(inliner.get_inlined(), std::unordered_set<DexMethod*>({callee}));
+
+  // Changing the callee invalidates its summary.
+  auto code = callee->get_code();
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type == MFLOW_OPCODE && it->insn->opcode() == OPCODE_INVOKE_SUPER) {
+      code->remove_opcode(it);
+      break;
+    }
+  }
+  EXPECT_TRUE(inliner.is_inlinable(other_class_caller, callee, nullptr, 0));
+}
+
+TEST_F(MethodInlineTest, shrinkCallees) {
+  auto callee = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.callee:()I"
+     (
+      (const v0 0)
+      (if-nez v0 :dead)
+      (const v1 1)
+      (move v2 v1)
+      (return v2)
+      (:dead)
+      (const v1 2)
+      (return v1)
+     )
+    )
+  )");
+  EXPECT_EQ(inliner::shrink_callees({callee}), 5);
+  // A constant and the return are all that's left.
+  auto code = callee->get_code();
+  EXPECT_EQ(code->count_opcodes(), 2);
+  for (const auto& mie : InstructionIterable(code)) {
+    EXPECT_FALSE(is_conditional_branch(mie.insn->opcode()));
+  }
+}
+
+TEST_F(MethodInlineTest, profileGuidedInlining) {
+  auto callee = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.callee:()V"
+     (
+      (const v0 0)
+      (const v1 1)
+      (const v2 2)
+      (return-void)
+     )
+    )
+  )");
+  auto hot_caller = assembler::method_from_string(R"(
+    (method (public static) "LBar;.hot:()V"
+     (
+      (invoke-static () "LFoo;.callee:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto cold_caller = assembler::method_from_string(R"(
+    (method (public static) "LBar;.cold:()V"
+     (
+      (invoke-static () "LFoo;.callee:()V")
+      (return-void)
+     )
+    )
+  )");
+  ClassCreator foo_creator(DexType::make_type("LFoo;"));
+  foo_creator.set_super(get_object_type());
+  foo_creator.add_method(callee);
+  ClassCreator bar_creator(DexType::make_type("LBar;"));
+  bar_creator.set_super(get_object_type());
+  bar_creator.add_method(hot_caller);
+  bar_creator.add_method(cold_caller);
+
+  DexStoresVector stores;
+  DexStore store("root");
+  store.add_classes({foo_creator.create(), bar_creator.create()});
+  stores.push_back(std::move(store));
+  auto scope = build_class_scope(stores);
+  api::LevelChecker::init(0, scope);
+
+  auto has_invoke = [](DexMethod* method) {
+    return assembler::to_string(method->get_code()).find("invoke") !=
+           std::string::npos;
+  };
+  // Without a profile, the callee is too large for two callers.
+  {
+    inliner::InlinerConfig inliner_config;
+    inliner_config.populate(scope);
+    MultiMethodInliner inliner(
+        scope, stores, {callee}, resolve_method_cached, inliner_config);
+    inliner.inline_methods();
+    EXPECT_TRUE(has_invoke(hot_caller));
+    EXPECT_TRUE(has_invoke(cold_caller));
+  }
+
+  std::unordered_map<std::string, unsigned int> method_to_weight{
+      {hot_caller->get_fully_deobfuscated_name(), 10},
+      {callee->get_fully_deobfuscated_name(), 10}};
+  inliner::InlinerConfig inliner_config;
+  inliner_config.use_method_profiles = true;
+  inliner_config.hot_method_weight = 5;
+  inliner_config.hot_callee_size_factor = 2;
+  inliner_config.method_to_weight = &method_to_weight;
+  inliner_config.populate(scope);
+  MultiMethodInliner inliner(
+      scope, stores, {callee}, resolve_method_cached, inliner_config);
+  inliner.inline_methods();
+  EXPECT_FALSE(has_invoke(hot_caller));
+  EXPECT_TRUE(has_invoke(cold_caller));
+  EXPECT_EQ(inliner.get_info().hot_caller.load(), 1);
+  EXPECT_EQ(inliner.get_info().cold_caller.load(), 1);
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodTimings.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Walkers.h"
+
+namespace {
+
+class MethodTimingsTest : public RedexTest {
+ protected:
+  void SetUp() override {
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    for (const auto& name : {"a", "b", "c"}) {
+      creator.add_method(assembler::method_from_string(
+          std::string("(method (public static) \"LFoo;.") + name +
+          ":()V\" ((const v0 0) (return-void)))"));
+    }
+    m_scope.push_back(creator.create());
+  }
+
+  void TearDown() override { method_timings::set_enabled(false); }
+
+  // Method c takes the longest and a the least.
+  static void sleep_by_name(DexMethod* method) {
+    auto name = method->get_name()->str();
+    int ms = name == "c" ? 60 : name == "b" ? 30 : 1;
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+
+  Scope m_scope;
+};
+
+} // namespace
+
+TEST_F(MethodTimingsTest, disabledByDefault) {
+  walk::parallel::code(m_scope,
+                       [](DexMethod* m, IRCode&) { sleep_by_name(m); });
+  EXPECT_TRUE(method_timings::get_slowest().empty());
+}
+
+TEST_F(MethodTimingsTest, keepsTheSlowestMethods) {
+  method_timings::set_enabled(true, 2);
+  walk::parallel::code(m_scope,
+                       [](DexMethod* m, IRCode&) { sleep_by_name(m); });
+  auto slowest = method_timings::get_slowest();
+  ASSERT_EQ(slowest.size(), 2);
+  EXPECT_EQ(slowest[0].method, "LFoo;.c:()V");
+  EXPECT_EQ(slowest[1].method, "LFoo;.b:()V");
+  EXPECT_GE(slowest[0].seconds, 0.06);
+  EXPECT_GE(slowest[0].seconds, slowest[1].seconds);
+  EXPECT_EQ(slowest[0].num_insns, 2);
+
+  method_timings::reset();
+  walk::parallel::reduce_methods<int>(
+      m_scope,
+      [](DexMethod* m) {
+        sleep_by_name(m);
+        return 1;
+      },
+      [](int a, int b) { return a + b; });
+  slowest = method_timings::get_slowest();
+  ASSERT_EQ(slowest.size(), 2);
+  EXPECT_EQ(slowest[0].method, "LFoo;.c:()V");
+}
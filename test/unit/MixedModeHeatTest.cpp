@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MixedModeHeat.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexStructure.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace interdex;
+
+namespace {
+
+DexClass* make_class(const char* name, const char* method = nullptr) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  if (method != nullptr) {
+    creator.add_method(assembler::method_from_string(method));
+  }
+  return creator.create();
+}
+
+constexpr int64_t kNoLimit = 1 << 30;
+
+} // namespace
+
+class MixedModeHeatTest : public RedexTest {};
+
+TEST_F(MixedModeHeatTest, heatFileIsMatchedAgainstTheScope) {
+  auto a = make_class("LA;");
+  auto b = make_class("LB;");
+  b->set_deobfuscated_name("Lcom/foo/B;");
+
+  auto heat_file = std::string(::testing::TempDir()) + "/heat.txt";
+  {
+    std::ofstream out(heat_file);
+    out << "LA; 10\n"
+        << "Lcom/foo/B;,7\n"
+        << "LNotInScope; 100\n"
+        << "LA; 5\n"
+        << "garbage\n";
+  }
+  auto heat = read_class_heat(heat_file, {a, b});
+  EXPECT_EQ(heat.size(), 2);
+  EXPECT_EQ(heat.at(a), 15);
+  EXPECT_EQ(heat.at(b), 7);
+}
+
+TEST_F(MixedModeHeatTest, hottestNonStartupClassesAreSelected) {
+  auto startup = make_class("LStartup;");
+  auto hot = make_class("LHot;");
+  auto warm = make_class("LWarm;");
+  auto cold = make_class("LCold;");
+
+  ClassHeat heat{{startup, 1000}, {hot, 100}, {warm, 10}, {cold, 1}};
+  MixedModeHeatConfig config;
+  config.min_count = 5;
+  config.linear_alloc_budget = kNoLimit;
+  EXPECT_EQ(select_mixed_mode_classes(heat, {startup}, config),
+            std::unordered_set<DexClass*>({hot, warm}));
+
+  config.max_classes = 1;
+  EXPECT_EQ(select_mixed_mode_classes(heat, {startup}, config),
+            std::unordered_set<DexClass*>({hot}));
+}
+
+TEST_F(MixedModeHeatTest, classesThatDontFitTheBudgetAreSkipped) {
+  auto big = make_class("LBig;", R"(
+    (method (public static) "LBig;.foo:()V"
+     (
+      (const v0 0)
+      (const v1 1)
+      (return-void)
+     )
+    )
+  )");
+  auto small = make_class("LSmall;");
+  auto smaller = make_class("LSmaller;");
+
+  ClassHeat heat{{big, 100}, {small, 10}, {smaller, 1}};
+  MixedModeHeatConfig config;
+  config.linear_alloc_budget = kNoLimit;
+  // Big has all the instructions. Without room for them, it is skipped, but
+  // the colder classes are still picked.
+  config.max_instructions = 3;
+  EXPECT_EQ(select_mixed_mode_classes(heat, {}, config),
+            std::unordered_set<DexClass*>({big, small, smaller}));
+  config.max_instructions = 2;
+  EXPECT_EQ(select_mixed_mode_classes(heat, {}, config),
+            std::unordered_set<DexClass*>({small, smaller}));
+
+  // Room for the linear alloc of one of the classes only; the hottest that
+  // fits is picked.
+  config.max_instructions = 0;
+  config.linear_alloc_budget = estimate_linear_alloc(small);
+  EXPECT_EQ(select_mixed_mode_classes(heat, {}, config),
+            std::unordered_set<DexClass*>({small}));
+}
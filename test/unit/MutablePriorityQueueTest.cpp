@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MutablePriorityQueue.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+TEST(MutablePriorityQueueTest, heapAgreesWithOrderedMap) {
+  std::mt19937 gen(42);
+  const uint32_t num_values = 200;
+  MutablePriorityQueue<std::string, uint64_t> map_queue;
+  MutablePriorityQueue<std::string, uint64_t, std::less<uint64_t>,
+                       MutablePriorityQueueStorage::DaryHeap>
+      heap_queue;
+  // Priorities are kept unique by using the value as the low bits.
+  std::vector<bool> present(num_values, false);
+  auto make_priority = [&](uint32_t value) {
+    return (static_cast<uint64_t>(gen() % 1000) << 8) | value;
+  };
+  for (size_t i = 0; i < 5000; ++i) {
+    uint32_t value = gen() % num_values;
+    auto name = std::to_string(value);
+    if (present[value]) {
+      if (gen() % 4 == 0) {
+        map_queue.erase(name);
+        heap_queue.erase(name);
+        present[value] = false;
+      } else {
+        auto priority = make_priority(value);
+        map_queue.update_priority(name, priority);
+        heap_queue.update_priority(name, priority);
+      }
+    } else {
+      auto priority = make_priority(value);
+      map_queue.insert(name, priority);
+      heap_queue.insert(name, priority);
+      present[value] = true;
+    }
+    ASSERT_EQ(map_queue.empty(), heap_queue.empty());
+    if (!map_queue.empty()) {
+      ASSERT_EQ(map_queue.front(), heap_queue.front());
+    }
+  }
+
+  while (!map_queue.empty()) {
+    auto front = map_queue.front();
+    ASSERT_EQ(heap_queue.front(), front);
+    map_queue.erase(front);
+    heap_queue.erase(front);
+  }
+  EXPECT_TRUE(heap_queue.empty());
+}
+
+TEST(MutablePriorityQueueTest, heapHonorsTheComparison) {
+  MutablePriorityQueue<int, int, std::greater<int>,
+                       MutablePriorityQueueStorage::DaryHeap>
+      queue;
+  for (int i = 0; i < 10; ++i) {
+    queue.insert(i, 10 - i);
+  }
+  // With std::greater, the lowest priority comes first.
+  EXPECT_EQ(queue.front(), 9);
+  queue.update_priority(3, 0);
+  EXPECT_EQ(queue.front(), 3);
+  queue.clear();
+  EXPECT_TRUE(queue.empty());
+}
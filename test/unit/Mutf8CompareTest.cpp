@@ -5,8 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <memory>
 #include <gtest/gtest.h>
+#include <vector>
 
 #include "DexClass.h"
 
@@ -18,3 +20,39 @@ TEST(Mutf8CompareTest, empty) {
   EXPECT_FALSE(compare_dexstrings(s2, s1));
   delete g_redex;
 }
+
+TEST(Mutf8CompareTest, radixSortMatchesCompare) {
+  g_redex = new RedexContext();
+  std::vector<DexString*> strings;
+  const char* suffixes[] = {"",
+                            "a",
+                            "b",
+                            ";",
+                            "\300\200",
+                            "\302\200",
+                            "\337\277",
+                            "\340\240\200",
+                            "\355\240\200\355\260\200",
+                            "\356\200\200",
+                            "\357\277\277"};
+  // Enough strings sharing prefixes that the radix sort recurses past its
+  // cutoff on every level.
+  for (const char* prefix : {"", "Lcom/foo/", "Lcom/foo/Bar", "\300\200"}) {
+    for (const char* s1 : suffixes) {
+      for (const char* s2 : suffixes) {
+        auto str = std::string(prefix) + s1 + s2;
+        strings.push_back(DexString::make_string(str));
+      }
+    }
+  }
+  std::sort(strings.begin(), strings.end());
+  strings.erase(std::unique(strings.begin(), strings.end()), strings.end());
+
+  auto expected = strings;
+  std::sort(expected.begin(), expected.end(), compare_dexstrings);
+  auto actual = strings;
+  std::reverse(actual.begin(), actual.end());
+  sort_dexstrings(actual);
+  EXPECT_EQ(expected, actual);
+  delete g_redex;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "NoOptimizationsMatcher.h"
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "Creators.h"
+#include "DexAnnotation.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+struct NoOptimizationsMatcherTest : public RedexTest {};
+
+TEST_F(NoOptimizationsMatcherTest, marksAnnotatedMethods) {
+  auto anno_type = DexType::make_type("LDoNotOptimize;");
+  auto annotated =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo;.annotated:()V"));
+  auto anno_set = new DexAnnotationSet();
+  anno_set->add_annotation(new DexAnnotation(anno_type, DAV_BUILD));
+  annotated->attach_annotation_set(anno_set);
+  annotated->make_concrete(ACC_PUBLIC | ACC_STATIC,
+                           assembler::ircode_from_string("((return-void))"),
+                           false);
+  auto plain = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.plain:()V" ((return-void)))
+  )");
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(annotated);
+  creator.add_method(plain);
+  Scope scope{creator.create()};
+
+  Json::Value json;
+  json["no_optimizations_annotations"].append("LDoNotOptimize;");
+  ConfigFiles conf(json);
+  const auto& annos = conf.get_no_optimizations_annos();
+  EXPECT_EQ(annos, std::unordered_set<DexType*>{anno_type});
+  // Looked up once.
+  EXPECT_EQ(&conf.get_no_optimizations_annos(), &annos);
+
+  redex::process_no_optimizations_rules(annos, scope);
+  EXPECT_TRUE(annotated->rstate.no_optimizations());
+  EXPECT_FALSE(plain->rstate.no_optimizations());
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ObjectPool.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+struct Small : PooledObject<Small> {
+  explicit Small(int value) : value(value) {}
+  int value;
+};
+
+struct alignas(32) Aligned : PooledObject<Aligned> {
+  char data[40];
+};
+
+struct Derived : Small {
+  Derived() : Small(0) {}
+  char extra[64];
+};
+
+} // namespace
+
+TEST(ObjectPoolTest, reusesFreedBlocks) {
+  auto* a = new Small(1);
+  delete a;
+  auto* b = new Small(2);
+  // The block just freed is at the head of this thread's free list.
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(b->value, 2);
+  delete b;
+}
+
+TEST(ObjectPoolTest, blocksAreDistinctAndAligned) {
+  std::vector<Aligned*> objects;
+  std::unordered_set<Aligned*> unique;
+  for (size_t i = 0; i < 1000; ++i) {
+    objects.push_back(new Aligned());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(objects.back()) % 32, 0);
+    unique.insert(objects.back());
+  }
+  EXPECT_EQ(unique.size(), objects.size());
+  for (auto* object : objects) {
+    delete object;
+  }
+}
+
+TEST(ObjectPoolTest, subclassesUseGlobalAllocator) {
+  Small* d = new Derived();
+  delete static_cast<Derived*>(d);
+}
+
+TEST(ObjectPoolTest, freeOnAnotherThread) {
+  std::vector<Small*> objects;
+  for (int i = 0; i < 5000; ++i) {
+    objects.push_back(new Small(i));
+  }
+  // Blocks freed on a thread that then exits go back to the shared list, and
+  // are handed out again here.
+  std::thread t([&] {
+    for (auto* object : objects) {
+      delete object;
+    }
+  });
+  t.join();
+  std::unordered_set<Small*> freed(objects.begin(), objects.end());
+  objects.clear();
+  size_t reused = 0;
+  for (int i = 0; i < 5000; ++i) {
+    objects.push_back(new Small(i));
+    reused += freed.count(objects.back());
+  }
+  EXPECT_GT(reused, 0);
+  for (auto* object : objects) {
+    delete object;
+  }
+}
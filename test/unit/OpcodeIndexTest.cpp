@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "OpcodeIndex.h"
+#include "RedexTest.h"
+
+using namespace opcode_index;
+
+struct OpcodeIndexTest : public RedexTest {};
+
+TEST_F(OpcodeIndexTest, groupsPerMethod) {
+  auto with_sget = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.a:()I"
+      (
+        (sget "LFoo;.x:I")
+        (move-result-pseudo v0)
+        (return v0)
+      )
+    )
+  )");
+  auto with_string_and_invoke = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.b:()V"
+      (
+        (const-string "hello")
+        (move-result-pseudo-object v0)
+        (invoke-static (v0) "LFoo;.c:(Ljava/lang/String;)V")
+        (return-void)
+      )
+    )
+  )");
+  auto plain = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.c:(Ljava/lang/String;)V"
+      (
+        (return-void)
+      )
+    )
+  )");
+  Scope scope{assembler::class_with_methods(
+      "LFoo;", {with_sget, with_string_and_invoke, plain})};
+
+  OpcodeIndex index(scope);
+  EXPECT_EQ(SGET, index.groups(with_sget));
+  EXPECT_EQ(CONST_STRING | INVOKE, index.groups(with_string_and_invoke));
+  EXPECT_EQ(0, index.groups(plain));
+
+  EXPECT_EQ(std::vector<DexMethod*>{with_sget}, index.methods_with(FIELD_OPS));
+  EXPECT_EQ(std::vector<DexMethod*>{with_string_and_invoke},
+            index.methods_with(INVOKE | NEW_INSTANCE));
+
+  size_t num_sites = 0;
+  index.sites(CONST_STRING | INVOKE, [&](DexMethod* method, IRList::iterator) {
+    EXPECT_EQ(with_string_and_invoke, method);
+    ++num_sites;
+  });
+  EXPECT_EQ(2, num_sites);
+
+  plain->get_code()->push_back(
+      (new IRInstruction(OPCODE_NEW_INSTANCE))
+          ->set_type(DexType::make_type("LFoo;")));
+  index.refresh(plain);
+  EXPECT_EQ(NEW_INSTANCE, index.groups(plain));
+}
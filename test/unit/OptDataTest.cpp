@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "OptData.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+#include "WorkQueue.h"
+
+using namespace opt_metadata;
+
+class OptDataTest : public RedexTest {};
+
+TEST_F(OptDataTest, logsFromManyThreads) {
+  constexpr size_t NUM_METHODS = 64;
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  std::vector<DexMethod*> methods;
+  for (size_t i = 0; i < NUM_METHODS; ++i) {
+    auto method = assembler::method_from_string(
+        "(method (public static) \"LFoo;.m" + std::to_string(i) +
+        ":()V\" ((const v0 0) (return-void)))");
+    creator.add_method(method);
+    methods.push_back(method);
+  }
+  auto cls = creator.create();
+
+  auto& mapper = OptDataMapper::get_instance();
+  mapper.enable_logs();
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto method = methods[i];
+    auto insn = method->get_code()->begin()->insn;
+    mapper.log_opt(INLINED, method);
+    mapper.log_nopt(INL_TOO_BIG, method, insn);
+    mapper.log_opt(INLINED, cls);
+  });
+  for (size_t i = 0; i < NUM_METHODS; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  auto tables = mapper.build_tables();
+  EXPECT_EQ(tables.classes.names.size(), 1);
+  EXPECT_EQ(tables.class_opts.ids.size(), NUM_METHODS);
+  EXPECT_EQ(tables.methods.signatures.size(), NUM_METHODS);
+  EXPECT_EQ(tables.method_opts.ids.size(), NUM_METHODS);
+  EXPECT_EQ(tables.instructions.instructions.size(), NUM_METHODS);
+  EXPECT_EQ(tables.instruction_nopts.ids.size(), NUM_METHODS);
+  // The opts of the class are numbered in order, whichever thread logged them.
+  std::vector<uint32_t> idxs = tables.class_opts.reason_idxs;
+  std::sort(idxs.begin(), idxs.end());
+  for (size_t i = 0; i < NUM_METHODS; ++i) {
+    EXPECT_EQ(idxs[i], i);
+  }
+
+  // The binary form reads back into the same tables.
+  std::stringstream ss;
+  tables.write_binary(ss);
+  auto read = OptDataTables::read_binary(ss);
+  EXPECT_EQ(read.to_json(), tables.to_json());
+  EXPECT_EQ(read.to_json(), mapper.serialize_sql());
+}
+
+TEST_F(OptDataTest, binaryFileRoundTrip) {
+  namespace fs = boost::filesystem;
+  OptDataTables tables;
+  tables.opt_messages.reason_codes = {INLINED};
+  tables.opt_messages.messages = {"inlined"};
+  tables.nopt_messages.reason_codes = {INL_TOO_BIG};
+  tables.nopt_messages.messages = {"too big"};
+  tables.classes.packages = {"com.foo"};
+  tables.classes.source_files = {"Foo.java"};
+  tables.classes.names = {"Foo"};
+  tables.methods.cls_ids = {0, 0};
+  tables.methods.has_line_nums = {1, 0};
+  tables.methods.line_nums = {12, 0};
+  tables.methods.signatures = {"Lcom/foo/Foo;.a:()V", "Lcom/foo/Foo;.b:()V"};
+  tables.methods.code_sizes = {4, 8};
+  tables.instructions.meth_ids = {1};
+  tables.instructions.has_line_nums = {1};
+  tables.instructions.line_nums = {20};
+  tables.instructions.instructions = {"INVOKE_STATIC Lcom/foo/Foo;.a:()V"};
+  tables.class_opts.ids = {0};
+  tables.class_opts.reason_idxs = {0};
+  tables.class_opts.reason_codes = {INLINED};
+  tables.method_opts.ids = {0, 1};
+  tables.method_opts.reason_idxs = {0, 0};
+  tables.method_opts.reason_codes = {INLINED, INLINED};
+  tables.instruction_nopts.ids = {0};
+  tables.instruction_nopts.reason_idxs = {0};
+  tables.instruction_nopts.reason_codes = {INL_TOO_BIG};
+
+  // A file stream reads back everything that was written, past the strings.
+  auto path = fs::temp_directory_path() / fs::unique_path("opt-data-%%%%%%");
+  {
+    std::ofstream out(path.string(), std::ios::binary);
+    tables.write_binary(out);
+  }
+  std::ifstream in(path.string(), std::ios::binary);
+  auto read = OptDataTables::read_binary(in);
+  in.close();
+  fs::remove(path);
+  EXPECT_EQ(read.to_json(), tables.to_json());
+  EXPECT_EQ(read.methods.code_sizes, tables.methods.code_sizes);
+  EXPECT_EQ(read.instruction_nopts.reason_codes,
+            tables.instruction_nopts.reason_codes);
+}
@@ -210,6 +210,58 @@ TEST(OptimizeEnums, if_chain) {
   delete g_redex;
 }
 
+TEST(OptimizeEnums, if_chain_over_leaf_budget) {
+  g_redex = new RedexContext();
+  setup();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (sget-object "LFoo;.table:[LBar;")
+      (move-result-pseudo v0)
+      (const v1 0)
+      (invoke-virtual (v1) "LEnum;.ordinal:()I")
+      (move-result v1)
+      (aget v0 v1)
+      (move-result-pseudo v0)
+      (const v2 0)
+      (if-eq v2 v0 :case0)
+
+      (const v2 1)
+      (if-eq v2 v0 :case1)
+
+      (return v0)
+
+      (:case0)
+      (return v0)
+
+      (:case1)
+      (return v1)
+    )
+)");
+
+  code->build_cfg();
+  const auto& results = find_enums(&code->cfg());
+  EXPECT_EQ(1, results.size());
+  const auto& info = results[0];
+  // The chain has three leaves, including the fallthrough.
+  SwitchEquivFinder over_budget(&info.branch->cfg(), *info.branch, *info.reg,
+                                0 /* leaf_duplication_threshold */,
+                                2 /* max_num_leaves */);
+  EXPECT_FALSE(over_budget.success());
+
+  // A shared constant propagation gives the same cases.
+  auto fixpoint = std::make_shared<SwitchEquivFinder::FixpointIterator>(
+      info.branch->cfg(), constant_propagation::ConstantPrimitiveAnalyzer());
+  fixpoint->run(ConstantEnvironment());
+  SwitchEquivFinder within_budget(&info.branch->cfg(), *info.branch, *info.reg,
+                                  0 /* leaf_duplication_threshold */,
+                                  3 /* max_num_leaves */, fixpoint);
+  ASSERT_TRUE(within_budget.success());
+  EXPECT_EQ(3, within_budget.key_to_case().size());
+  code->clear_cfg();
+  delete g_redex;
+}
+
 TEST(OptimizeEnums, extra_loads_intersect) {
   g_redex = new RedexContext();
   setup();
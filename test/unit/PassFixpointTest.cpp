@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+
+namespace {
+
+// Bumps the constant of `m_method` in its first `num_changes` runs, and
+// remembers which of `m_watched` it would have looked at in each run.
+class ChangingPass : public Pass {
+ public:
+  ChangingPass(DexMethod* method,
+               std::vector<DexMethod*> watched,
+               size_t num_changes)
+      : Pass("ChangingPass"),
+        m_method(method),
+        m_watched(std::move(watched)),
+        m_num_changes(num_changes) {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager& mgr) override {
+    std::vector<std::string> revisited;
+    for (auto method : m_watched) {
+      if (mgr.needs_revisit(method)) {
+        revisited.push_back(method->get_name()->str());
+      }
+    }
+    runs.push_back(revisited);
+    if (m_num_changes > 0) {
+      --m_num_changes;
+      for (const auto& mie : InstructionIterable(m_method->get_code())) {
+        if (mie.insn->opcode() == OPCODE_CONST) {
+          mie.insn->set_literal(mie.insn->get_literal() + 1);
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<std::string>> runs;
+
+ private:
+  DexMethod* m_method;
+  std::vector<DexMethod*> m_watched;
+  size_t m_num_changes;
+};
+
+class NoopPass : public Pass {
+ public:
+  explicit NoopPass(const char* name) : Pass(name) {}
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {
+    ++num_runs;
+  }
+  size_t num_runs{0};
+};
+
+} // namespace
+
+struct PassFixpointTest : public RedexTest {
+  void SetUp() override {
+    m_a = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.a:()I"
+       ((const v0 1) (return v0)))
+    )");
+    m_b = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.b:()I"
+       ((invoke-static () "LFoo;.a:()I") (move-result v0) (return v0)))
+    )");
+    m_c = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.c:()V"
+       ((return-void)))
+    )");
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    creator.add_method(m_a);
+    creator.add_method(m_b);
+    creator.add_method(m_c);
+    DexStore store("classes");
+    store.add_classes({creator.create()});
+    m_stores.emplace_back(std::move(store));
+  }
+
+  DexMethod* m_a;
+  DexMethod* m_b;
+  DexMethod* m_c;
+  std::vector<DexStore> m_stores;
+};
+
+TEST_F(PassFixpointTest, repeatsUntilNothingChanges) {
+  NoopPass before("BeforePass");
+  ChangingPass changing(m_a, {m_a, m_b, m_c}, 2);
+  NoopPass after("AfterPass");
+  Json::Value json;
+  json["pass_fixpoints"][0]["passes"].append("ChangingPass");
+  json["pass_fixpoints"][0]["passes"].append("AfterPass");
+  PassManager manager({&before, &changing, &after}, json);
+  ConfigFiles config(json);
+  manager.run_passes(m_stores, config);
+
+  // Two runs that change a, and one that doesn't.
+  EXPECT_EQ(before.num_runs, 1);
+  EXPECT_EQ(after.num_runs, 3);
+  ASSERT_EQ(changing.runs.size(), 3);
+  EXPECT_EQ(changing.runs[0], std::vector<std::string>({"a", "b", "c"}));
+  // Only a and its caller b are looked at again.
+  EXPECT_EQ(changing.runs[1], std::vector<std::string>({"a", "b"}));
+  EXPECT_EQ(changing.runs[2], std::vector<std::string>({"a", "b"}));
+  const auto& metrics = manager.get_pass_info()[2].metrics;
+  EXPECT_EQ(metrics.at("~fixpoint~iterations~"), 3);
+  EXPECT_EQ(metrics.at("~fixpoint~changed~methods~"), 2);
+}
+
+TEST_F(PassFixpointTest, stopsAtTheMaximum) {
+  ChangingPass changing(m_a, {m_a}, 10);
+  Json::Value json;
+  json["pass_fixpoints"][0]["passes"].append("ChangingPass");
+  json["pass_fixpoints"][0]["max_iterations"] = 3;
+  PassManager manager({&changing}, json);
+  ConfigFiles config(json);
+  manager.run_passes(m_stores, config);
+
+  EXPECT_EQ(changing.runs.size(), 3);
+}
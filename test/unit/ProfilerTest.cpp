@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Profiler.h"
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <set>
+#include <sstream>
+
+#include "Timer.h"
+#include "WorkQueue.h"
+
+namespace {
+
+Json::Value parse_trace() {
+  std::ostringstream os;
+  profiler::write_chrome_trace(os);
+  Json::Value root;
+  std::istringstream is(os.str());
+  is >> root;
+  return root;
+}
+
+std::multiset<std::string> span_names(const Json::Value& root) {
+  std::multiset<std::string> names;
+  for (const auto& e : root["traceEvents"]) {
+    if (e["ph"].asString() == "X") {
+      names.insert(e["name"].asString());
+    }
+  }
+  return names;
+}
+
+} // namespace
+
+TEST(ProfilerTest, disabledSpansRecordNothing) {
+  profiler::set_enabled(false);
+  {
+    profiler::Span span("not recorded");
+    EXPECT_EQ("", profiler::current_span_name());
+  }
+  EXPECT_EQ(0, span_names(parse_trace()).count("not recorded"));
+}
+
+TEST(ProfilerTest, nestedSpansAndWorkers) {
+  profiler::set_enabled(true);
+  {
+    Timer t("outer");
+    EXPECT_EQ("outer", profiler::current_span_name());
+    {
+      profiler::Span inner("inner");
+      EXPECT_EQ("inner", profiler::current_span_name());
+      auto wq = workqueue_foreach<int>([](int) {}, 2);
+      wq.add_item(1);
+      wq.add_item(2);
+      wq.run_all();
+    }
+    EXPECT_EQ("outer", profiler::current_span_name());
+  }
+  profiler::set_enabled(false);
+
+  auto root = parse_trace();
+  auto names = span_names(root);
+  EXPECT_EQ(1, names.count("outer"));
+  EXPECT_EQ(1, names.count("inner"));
+  EXPECT_EQ(2, names.count("inner [worker]"));
+
+  for (const auto& e : root["traceEvents"]) {
+    if (e["ph"].asString() != "X") {
+      continue;
+    }
+    EXPECT_TRUE(e.isMember("ts"));
+    EXPECT_TRUE(e.isMember("dur"));
+    EXPECT_TRUE(e.isMember("tid"));
+    EXPECT_TRUE(e["args"].isMember("cpu_ms"));
+  }
+}
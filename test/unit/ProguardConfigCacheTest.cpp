@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+
+#include "ProguardConfigCache.h"
+#include "ProguardConfiguration.h"
+#include "ProguardParser.h"
+#include "ProguardPrintConfiguration.h"
+
+using namespace redex;
+
+namespace {
+
+const char* const kConfig = R"(
+-basedirectory /tmp
+-libraryjars android.jar
+-dontobfuscate
+-keepattributes *Annotation*
+-keep,allowobfuscation public class com.foo.** extends com.foo.Base {
+  @com.foo.Keep <fields>;
+  public static void main(java.lang.String[]);
+}
+-keepclasseswithmembers class * {
+  native <methods>;
+}
+-assumenosideeffects class android.util.Log {
+  public static int d(...);
+}
+)";
+
+std::string show_rules(const KeepSpecSet& rules) {
+  std::string result;
+  for (const auto* rule : rules) {
+    result += show_keep(*rule) + "@" + rule->source_filename + ":" +
+              std::to_string(rule->source_line) + "\n";
+  }
+  return result;
+}
+
+void expect_same(const ProguardConfiguration& a,
+                 const ProguardConfiguration& b) {
+  EXPECT_EQ(a.ok, b.ok);
+  EXPECT_EQ(a.basedirectory, b.basedirectory);
+  EXPECT_EQ(a.libraryjars, b.libraryjars);
+  EXPECT_EQ(a.dontobfuscate, b.dontobfuscate);
+  EXPECT_EQ(a.keepattributes, b.keepattributes);
+  EXPECT_EQ(a.already_included, b.already_included);
+  EXPECT_EQ(a.keep_rules.size(), b.keep_rules.size());
+  EXPECT_EQ(show_rules(a.keep_rules), show_rules(b.keep_rules));
+  EXPECT_EQ(show_rules(a.assumenosideeffects_rules),
+            show_rules(b.assumenosideeffects_rules));
+}
+
+} // namespace
+
+TEST(ProguardConfigCacheTest, roundTrip) {
+  ProguardConfiguration config;
+  std::istringstream in(kConfig);
+  proguard_parser::parse(in, &config, "test.pro");
+  ASSERT_TRUE(config.ok);
+
+  std::stringstream ss;
+  proguard_parser::serialize(config, ss);
+  ProguardConfiguration loaded;
+  ASSERT_TRUE(proguard_parser::deserialize(ss, &loaded));
+  expect_same(config, loaded);
+}
+
+TEST(ProguardConfigCacheTest, rejectsGarbage) {
+  std::stringstream ss("not a configuration");
+  ProguardConfiguration loaded;
+  EXPECT_FALSE(proguard_parser::deserialize(ss, &loaded));
+
+  ProguardConfiguration config;
+  std::istringstream in(kConfig);
+  proguard_parser::parse(in, &config);
+  std::stringstream full;
+  proguard_parser::serialize(config, full);
+  std::stringstream truncated(full.str().substr(0, full.str().size() / 2));
+  ProguardConfiguration partial;
+  EXPECT_FALSE(proguard_parser::deserialize(truncated, &partial));
+}
+
+TEST(ProguardConfigCacheTest, cachedFilesAndIncludes) {
+  namespace fs = boost::filesystem;
+  auto dir = fs::temp_directory_path() / fs::unique_path("pg-cache-%%%%%%%%");
+  fs::create_directories(dir);
+  auto main_pro = (dir / "main.pro").string();
+  auto included_pro = (dir / "included.pro").string();
+  {
+    std::ofstream out(main_pro);
+    out << kConfig << "-include " << included_pro << "\n";
+  }
+  {
+    std::ofstream out(included_pro);
+    out << "-keep class com.bar.Bar\n";
+  }
+  auto cache_dir = (dir / "cache").string();
+
+  ProguardConfiguration parsed;
+  proguard_parser::parse_file(main_pro, &parsed);
+  ASSERT_TRUE(parsed.ok);
+
+  // The first run parses and stores, the second one loads.
+  for (int i = 0; i < 2; ++i) {
+    ProguardConfiguration config;
+    proguard_parser::parse_files_cached({main_pro}, cache_dir, &config);
+    expect_same(parsed, config);
+  }
+
+  // Changing an included file is noticed.
+  {
+    std::ofstream out(included_pro);
+    out << "-keep class com.bar.Baz\n";
+  }
+  ProguardConfiguration changed;
+  proguard_parser::parse_file(main_pro, &changed);
+  ProguardConfiguration config;
+  proguard_parser::parse_files_cached({main_pro}, cache_dir, &config);
+  expect_same(changed, config);
+
+  fs::remove_all(dir);
+}
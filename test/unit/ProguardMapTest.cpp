@@ -7,6 +7,8 @@
 
 #include "ProguardMap.h"
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <sstream>
@@ -54,6 +56,50 @@ TEST(ProguardMapTest, empty) {
   EXPECT_EQ(false, pm.is_special_interface("Lcom/not/Found;"));
 }
 
+TEST(ProguardMapTest, Indexed) {
+  namespace fs = boost::filesystem;
+  auto path = fs::temp_directory_path() / fs::unique_path("pg-map-%%%%%%%%");
+  {
+    std::ofstream out(path.string());
+    out << "# compiler: R8\n"
+           "com.foo.bar -> A:\n"
+           "    int do1 -> a\n"
+           "    3:3:void <init>() -> <init>\n"
+           "    8:929:java.util.ArrayList getCopy() -> a\n"
+           "android.support.v4.app.Fragment -> android.support.v4.app.Fragment:\n"
+           "    android.support.v4.util.SimpleArrayMap sClassMap -> sClassMap\n"
+           "    1:10:com.foo.bar stuff(com.foo.bar,com.foo.bar) -> x\n"
+           "android.support.v4.util.SimpleArrayMap -> android.support.v4.b.b:\n"
+           "com.instagram.react.IgNetworkingModule -> "
+           "com.instagram.react.IgNetworkingModule:\n"
+           "    a_vcard.android.syncml.pim.VBuilder mExecutorSupplier$7ec36e13 "
+           "-> b\n";
+  }
+  ProguardMap pm(path.string(), /* use_index */ true);
+  EXPECT_FALSE(pm.empty());
+  EXPECT_EQ("LA;", pm.translate_class("Lcom/foo/bar;"));
+  EXPECT_EQ("Lcom/foo/bar;", pm.deobfuscate_class("LA;"));
+  EXPECT_EQ("Lcom/not/Found;", pm.translate_class("Lcom/not/Found;"));
+  EXPECT_EQ("LA;.a:I", pm.translate_field("Lcom/foo/bar;.do1:I"));
+  EXPECT_EQ("Lcom/foo/bar;.do1:I", pm.deobfuscate_field("LA;.a:I"));
+  EXPECT_EQ("LA;.<init>:()V", pm.translate_method("Lcom/foo/bar;.<init>:()V"));
+  EXPECT_EQ("Lcom/foo/bar;.getCopy:()Ljava/util/ArrayList;",
+            pm.deobfuscate_method("LA;.a:()Ljava/util/ArrayList;"));
+  EXPECT_EQ(
+      "Landroid/support/v4/app/Fragment;.sClassMap:Landroid/support/v4/b/b;",
+      pm.translate_field("Landroid/support/v4/app/Fragment;.sClassMap:Landroid/"
+                         "support/v4/util/SimpleArrayMap;"));
+  EXPECT_EQ("Landroid/support/v4/app/Fragment;.x:(LA;LA;)LA;",
+            pm.translate_method("Landroid/support/v4/app/Fragment;.stuff:(Lcom/"
+                                "foo/bar;Lcom/foo/bar;)Lcom/foo/bar;"));
+  EXPECT_THAT(pm.method_lines("LA;.<init>:()V"),
+              UnorderedElementsAre(Pointee(
+                  ProguardLineRange(3, 3, 0, 0, "Lcom/foo/bar;.<init>:()V"))));
+  EXPECT_TRUE(pm.is_special_interface("La_vcard/android/syncml/pim/VBuilder;"));
+  EXPECT_FALSE(pm.is_special_interface("Lcom/not/Found;"));
+  fs::remove(path);
+}
+
 TEST(ProguardMapTest, HandlesGeneratedComments) {
   std::stringstream ss(
       "# compiler: R8\n"
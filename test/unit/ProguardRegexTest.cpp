@@ -270,3 +270,38 @@ TEST(ProguardRegexTest, types) {
     EXPECT_EQ("Lalpha/**/beta;", descriptor);
   }
 }
+
+TEST(ProguardRegexTest, class_name_patterns) {
+  using Result = proguard_parser::ClassNamePattern::Result;
+  {
+    proguard_parser::ClassNamePattern pattern("Lcom/foo/*;");
+    EXPECT_EQ("Lcom/foo/", pattern.prefix());
+    EXPECT_EQ(Result::MATCH, pattern.match("Lcom/foo/Bar;"));
+    EXPECT_EQ(Result::NO_MATCH, pattern.match("Lcom/foo/bar/Baz;"));
+    EXPECT_EQ(Result::NO_MATCH, pattern.match("Lcom/bar/Baz;"));
+  }
+  {
+    proguard_parser::ClassNamePattern pattern("Lcom/foo/**Bar;");
+    EXPECT_EQ(Result::MATCH, pattern.match("Lcom/foo/Bar;"));
+    EXPECT_EQ(Result::MATCH, pattern.match("Lcom/foo/baz/QuxBar;"));
+    EXPECT_EQ(Result::NO_MATCH, pattern.match("Lcom/foo/Baz;"));
+    // The prefix and the suffix must not overlap.
+    EXPECT_EQ(Result::NO_MATCH, pattern.match("Lcom/foo/ar;"));
+  }
+  {
+    // Same as L**;
+    proguard_parser::ClassNamePattern pattern("L*;");
+    EXPECT_EQ(Result::MATCH, pattern.match("Lcom/foo/Bar;"));
+  }
+  {
+    proguard_parser::ClassNamePattern pattern("Lcom/foo/Bar;");
+    EXPECT_EQ(Result::MATCH, pattern.match("Lcom/foo/Bar;"));
+    EXPECT_EQ(Result::NO_MATCH, pattern.match("Lcom/foo/BarBar;"));
+  }
+  {
+    proguard_parser::ClassNamePattern pattern("Lcom/*/Ba?;");
+    EXPECT_EQ("Lcom/", pattern.prefix());
+    EXPECT_EQ(Result::NEEDS_REGEX, pattern.match("Lcom/foo/Bar;"));
+    EXPECT_EQ(Result::NO_MATCH, pattern.match("Lorg/foo/Bar;"));
+  }
+}
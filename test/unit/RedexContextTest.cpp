@@ -0,0 +1,27 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+class RedexContextTest : public RedexTest {};
+
+TEST_F(RedexContextTest, typeClass) {
+  EXPECT_EQ(nullptr, type_class(nullptr));
+
+  auto type = DexType::make_type("LFoo;");
+  EXPECT_EQ(nullptr, type_class(type));
+
+  ClassCreator creator(type);
+  creator.set_super(get_object_type());
+  auto cls = creator.create();
+  EXPECT_EQ(cls, type_class(type));
+}
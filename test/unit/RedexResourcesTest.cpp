@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <map>
 #include <string>
 #include <unordered_map>
@@ -46,3 +48,79 @@ TEST(RedexResources, ReadXmlTagsAndAttributes) {
   auto no_ns_vals = multimap_values_to_set(attribute_values, "onClick");
   EXPECT_EQ(no_ns_vals.size(), 0);
 }
+
+TEST(RedexResources, LayoutCacheRoundTrip) {
+  std::unordered_set<std::string> attributes_to_find;
+  attributes_to_find.emplace("android:onClick");
+
+  std::unordered_set<std::string> classes;
+  std::unordered_multimap<std::string, std::string> attribute_values;
+  collect_layout_classes_and_attributes_for_file(
+    std::getenv("test_layout_path"),
+    attributes_to_find,
+    classes,
+    attribute_values);
+
+  auto cache_path = boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path("layout-cache-%%%%%%%%");
+  save_layout_cache(cache_path.string());
+  load_layout_cache(cache_path.string());
+
+  // This scan is answered from the cache.
+  std::unordered_set<std::string> cached_classes;
+  std::unordered_multimap<std::string, std::string> cached_attribute_values;
+  collect_layout_classes_and_attributes_for_file(
+    std::getenv("test_layout_path"),
+    attributes_to_find,
+    cached_classes,
+    cached_attribute_values);
+  EXPECT_EQ(classes, cached_classes);
+  EXPECT_EQ(multimap_values_to_set(attribute_values, "android:onClick"),
+            multimap_values_to_set(cached_attribute_values,
+                                   "android:onClick"));
+
+  std::ifstream in(cache_path.string());
+  std::string contents((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+  EXPECT_NE(contents.find("Lcom/example/test/CustomButton;"),
+            std::string::npos);
+  boost::filesystem::remove(cache_path);
+}
+
+TEST(RedexResources, RemapXmlReferenceAttributesInParallel) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path("remap-xml-%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  std::vector<std::string> files;
+  for (const auto& name : {"a.xml", "b.xml"}) {
+    auto file = (dir / name).string();
+    boost::filesystem::copy_file(std::getenv("test_layout_path"), file);
+    files.push_back(file);
+  }
+  auto references = get_xml_reference_attributes(files[0]);
+  ASSERT_FALSE(references.empty());
+  uint32_t old_id = *references.begin();
+  uint32_t new_id = 0x7f0c0001;
+
+  // No file mentions this id, so none is parsed.
+  std::map<uint32_t, uint32_t> unused_ids{{0x7f7f7f7f, new_id}};
+  auto stats = remap_xml_reference_attributes(files, unused_ids);
+  EXPECT_EQ(stats.files_scanned, 2);
+  EXPECT_EQ(stats.files_skipped, 2);
+  EXPECT_EQ(stats.files_rewritten, 0);
+
+  std::map<uint32_t, uint32_t> kept_to_remapped_ids{{old_id, new_id}};
+  stats = remap_xml_reference_attributes(files, kept_to_remapped_ids);
+  EXPECT_EQ(stats.files_skipped, 0);
+  EXPECT_EQ(stats.files_rewritten, 2);
+  EXPECT_EQ(stats.bytes_rewritten,
+            2 * boost::filesystem::file_size(files[0]));
+  EXPECT_GT(stats.values_changed, 0);
+  for (const auto& file : files) {
+    auto remapped = get_xml_reference_attributes(file);
+    EXPECT_EQ(remapped.count(old_id), 0);
+    EXPECT_EQ(remapped.count(new_id), 1);
+    EXPECT_FALSE(boost::filesystem::exists(file + ".tmp"));
+  }
+  boost::filesystem::remove_all(dir);
+}
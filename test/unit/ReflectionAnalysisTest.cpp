@@ -227,3 +227,76 @@ IOPCODE_MOVE_RESULT_PSEUDO_OBJECT v3 {2, CLASS{Ljava/lang/Object;(LFoo;)}(REFLEC
 INVOKE_VIRTUAL v2, v3, Ljava/lang/Class;.getField:(Ljava/lang/String;)Ljava/lang/reflect/Field; {2, CLASS{Ljava/lang/Object;(LFoo;)}(REFLECTION)}\n\
 MOVE_RESULT_OBJECT v4 {2, CLASS{Ljava/lang/Object;(LFoo;)}(REFLECTION);4294967294, FIELD{Ljava/lang/Object;(LFoo;):bar}}\n");
 }
+
+TEST_F(ReflectionAnalysisTest, summaries) {
+  auto cls = assembler::method_from_string(R"(
+    (method (public static) "LHelper;.cls:()Ljava/lang/Class;"
+     (
+      (const-class "LFoo;")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  auto name = assembler::method_from_string(R"(
+    (method (public static) "LHelper;.name:()Ljava/lang/String;"
+     (
+      (const-string "bar")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  // The summary of a helper of a helper.
+  auto wrapped_name = assembler::method_from_string(R"(
+    (method (public static) "LHelper;.wrappedName:()Ljava/lang/String;"
+     (
+      (invoke-static () "LHelper;.name:()Ljava/lang/String;")
+      (move-result-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  auto caller = assembler::method_from_string(R"(
+    (method (public static) "LHelper;.caller:()V"
+     (
+      (invoke-static () "LHelper;.cls:()Ljava/lang/Class;")
+      (move-result-object v0)
+      (invoke-static () "LHelper;.wrappedName:()Ljava/lang/String;")
+      (move-result-object v1)
+      (invoke-virtual (v0 v1) "Ljava/lang/Class;.getField:(Ljava/lang/String;)Ljava/lang/reflect/Field;")
+      (move-result-object v2)
+      (return-void)
+     )
+    )
+  )");
+  ClassCreator creator(DexType::make_type("LHelper;"));
+  creator.set_super(get_object_type());
+  for (auto method : {cls, name, wrapped_name, caller}) {
+    creator.add_method(method);
+  }
+  Scope scope{creator.create()};
+
+  auto summaries = compute_summaries(scope);
+  EXPECT_EQ(summaries.size(), 3);
+  auto cls_summary = summaries.at(cls);
+  EXPECT_EQ(cls_summary.first,
+            AbstractObject(CLASS, DexType::make_type("LFoo;")));
+  EXPECT_TRUE(cls_summary.second == REFLECTION);
+  EXPECT_EQ(summaries.at(wrapped_name).first,
+            AbstractObject(DexString::make_string("bar")));
+
+  auto return_void = std::prev(caller->get_code()->end())->insn;
+  ReflectionAnalysis analysis(caller, &summaries);
+  auto field = analysis.get_abstract_object(2, return_void);
+  ASSERT_TRUE(field);
+  EXPECT_EQ(*field,
+            AbstractObject(FIELD, DexType::make_type("LFoo;"),
+                           DexString::make_string("bar")));
+
+  // Without the summaries, the class and the name are unknown.
+  ReflectionAnalysis intraprocedural(caller);
+  field = intraprocedural.get_abstract_object(2, return_void);
+  ASSERT_TRUE(field);
+  EXPECT_EQ(field->obj_kind, OBJECT);
+}
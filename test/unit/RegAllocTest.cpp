@@ -407,6 +407,73 @@ TEST_F(RegAllocTest, Coalesce) {
             assembler::to_s_expr(expected_code.get()));
 }
 
+TEST_F(RegAllocTest, SharedLiveness) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (move v1 v0)
+     (return v1)
+    )
+)");
+  code->set_registers_size(2);
+
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  auto liveness = get_liveness(cfg);
+  // Asking again while nothing changed gives the same result.
+  EXPECT_EQ(get_liveness(cfg), liveness);
+
+  RangeSet range_set;
+  interference::Graph ig = interference::build_graph(
+      *liveness, code.get(), code->get_registers_size(), range_set);
+  graph_coloring::Allocator allocator;
+  allocator.coalesce(&ig, code.get());
+
+  // Coalescing removed the move and renamed v1, without touching the edges.
+  auto recomputed = get_liveness(cfg);
+  EXPECT_NE(recomputed, liveness);
+  EXPECT_EQ(get_liveness(cfg), recomputed);
+  auto block = cfg.entry_block();
+  auto live = recomputed->get_live_out_vars_at(block);
+  recomputed->analyze_instruction(block->get_last_insn()->insn, &live);
+  EXPECT_EQ(live, LivenessDomain(0));
+}
+
+TEST_F(RegAllocTest, SharedLivenessFollowsInstructionContents) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (move v1 v0)
+     (return v1)
+    )
+)");
+  code->set_registers_size(2);
+
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  auto liveness = get_liveness(cfg);
+
+  // Swapping the move for an identical copy leaves the liveness as it was.
+  auto block = cfg.entry_block();
+  auto it = ++ir_list::InstructionIterable(block).begin();
+  std::unique_ptr<IRInstruction> old_insn(it->insn);
+  it->insn = new IRInstruction(*old_insn);
+  EXPECT_EQ(get_liveness(cfg), liveness);
+
+  // Going from a move to a const, with the same dest, is a different record.
+  it->insn->set_opcode(OPCODE_CONST);
+  it->insn->set_arg_word_count(0);
+  it->insn->set_literal(0);
+  auto recomputed = get_liveness(cfg);
+  EXPECT_NE(recomputed, liveness);
+  auto live = recomputed->get_live_out_vars_at(block);
+  recomputed->analyze_instruction(block->get_last_insn()->insn, &live);
+  recomputed->analyze_instruction(it->insn, &live);
+  EXPECT_EQ(live, LivenessDomain());
+}
+
 TEST_F(RegAllocTest, MoveWideCoalesce) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -443,6 +510,33 @@ TEST_F(RegAllocTest, MoveWideCoalesce) {
             assembler::to_s_expr(expected_code.get()));
 }
 
+TEST_F(RegAllocTest, EdgeMatrix) {
+  using interference::impl::EdgeMatrix;
+  EdgeMatrix edges;
+  const reg_t big = EdgeMatrix::kMaxDenseRegs + 1;
+  for (reg_t u : {reg_t(0), reg_t(7), big}) {
+    for (reg_t v : {reg_t(3), reg_t(1000), reg_t(big + 1)}) {
+      EXPECT_FALSE(edges.has(u, v, EdgeMatrix::ADJACENT));
+      edges.set(u, v, EdgeMatrix::ADJACENT);
+      EXPECT_TRUE(edges.has(u, v, EdgeMatrix::ADJACENT));
+      EXPECT_TRUE(edges.has(v, u, EdgeMatrix::ADJACENT));
+      EXPECT_FALSE(edges.has(v, u, EdgeMatrix::NOT_COALESCEABLE));
+
+      edges.set(u, v, EdgeMatrix::contains_flag(u, v));
+      EXPECT_TRUE(edges.has(u, v, EdgeMatrix::contains_flag(u, v)));
+      EXPECT_FALSE(edges.has(v, u, EdgeMatrix::contains_flag(v, u)));
+    }
+  }
+  // Growing the matrix keeps the earlier entries.
+  EXPECT_TRUE(edges.has(0, 3, EdgeMatrix::ADJACENT));
+  EXPECT_FALSE(edges.has(0, 7, EdgeMatrix::ADJACENT));
+  EXPECT_FALSE(edges.has(3, 3, EdgeMatrix::ADJACENT));
+
+  size_t num_containments = 0;
+  edges.for_each_containment([&](reg_t, reg_t) { ++num_containments; });
+  EXPECT_EQ(num_containments, 9);
+}
+
 TEST_F(RegAllocTest, NoCoalesceWide) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -245,3 +245,85 @@ TEST_F(RemoveUnusedArgsTest, multipleBlocksMixedArgs) {
   EXPECT_THAT(live_arg_idxs, ::testing::ElementsAre(0, 1, 2, 3));
   EXPECT_THAT(dead_insns.size(), 0);
 }
+
+// Checks that updating signatures and their callsites goes through, except
+// where a constructor would collide with another one
+TEST_F(RemoveUnusedArgsTest, updateSignaturesAndCallsites) {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  for (auto str : {
+           R"(
+      (method (private constructor) "LFoo;.<init>:(I)V"
+        (
+          (load-param-object v0)
+          (load-param v1)
+          (invoke-direct (v0) "Ljava/lang/Object;.<init>:()V")
+          (return-void)
+        )
+      )
+    )",
+           R"(
+      (method (private constructor) "LFoo;.<init>:(J)V"
+        (
+          (load-param-object v0)
+          (load-param-wide v1)
+          (invoke-direct (v0) "Ljava/lang/Object;.<init>:()V")
+          (return-void)
+        )
+      )
+    )",
+           R"(
+      (method (public static) "LFoo;.bar:(II)I"
+        (
+          (load-param v0)
+          (load-param v1)
+          (return v1)
+        )
+      )
+    )",
+           R"(
+      (method (public static) "LFoo;.caller:()V"
+        (
+          (const v0 0)
+          (const v1 1)
+          (new-instance "LFoo;")
+          (move-result-pseudo-object v2)
+          (invoke-direct (v2 v0) "LFoo;.<init>:(I)V")
+          (invoke-static (v0 v1) "LFoo;.bar:(II)I")
+          (move-result v3)
+          (return-void)
+        )
+      )
+    )"}) {
+    creator.add_method(assembler::method_from_string(str));
+  }
+  Scope scope{creator.create()};
+  remove_unused_args::RemoveArgs remove_args(scope, m_black_list);
+  auto stats = remove_args.run();
+
+  // Only the first constructor gets to drop its argument.
+  EXPECT_EQ(stats.methods_updated_count, 2);
+  EXPECT_EQ(stats.method_params_removed_count, 2);
+  EXPECT_EQ(stats.callsite_args_removed_count, 2);
+  EXPECT_NE(DexMethod::get_method("LFoo;.<init>:()V"), nullptr);
+  EXPECT_NE(DexMethod::get_method("LFoo;.<init>:(J)V"), nullptr);
+  auto bar = DexMethod::get_method("LFoo;.bar:(I)I");
+  ASSERT_NE(bar, nullptr);
+
+  auto caller =
+      static_cast<DexMethod*>(DexMethod::get_method("LFoo;.caller:()V"));
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (const v1 1)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v2)
+      (invoke-direct (v2) "LFoo;.<init>:()V")
+      (invoke-static (v1) "LFoo;.bar:(I)I")
+      (move-result v3)
+      (return-void)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(caller->get_code()),
+            assembler::to_s_expr(expected.get()));
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Resolver.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexContext.h"
+#include "RedexTest.h"
+#include "WorkQueue.h"
+
+class ResolverCacheTest : public RedexTest {
+ public:
+  ResolverCacheTest() {
+    m_a = make_class("LA;", get_object_type());
+    m_b = make_class("LB;", m_a->get_type());
+    m_method_ref = DexMethod::make_method("LB;.m:()V");
+    m_field_ref = DexField::make_field("LB;.f:I");
+  }
+
+  static DexClass* make_class(const char* name, DexType* super) {
+    ClassCreator creator(DexType::make_type(name));
+    creator.set_super(super);
+    return creator.create();
+  }
+
+  DexClass* m_a;
+  DexClass* m_b;
+  DexMethodRef* m_method_ref;
+  DexFieldRef* m_field_ref;
+};
+
+TEST_F(ResolverCacheTest, resultsFollowMemberChanges) {
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Virtual),
+            nullptr);
+  EXPECT_EQ(resolve_field_cached(m_field_ref), nullptr);
+
+  // Adding members to A makes the references resolve to them.
+  auto a_m = static_cast<DexMethod*>(DexMethod::make_method("LA;.m:()V"));
+  a_m->make_concrete(ACC_PUBLIC, /* is_virtual */ true);
+  m_a->add_method(a_m);
+  auto a_f = static_cast<DexField*>(DexField::make_field("LA;.f:I"));
+  a_f->make_concrete(ACC_PUBLIC);
+  m_a->add_field(a_f);
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Virtual), a_m);
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Direct),
+            nullptr);
+  EXPECT_EQ(resolve_field_cached(m_field_ref), a_f);
+
+  // B no longer extends A.
+  m_b->set_super_class(get_object_type());
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Virtual),
+            nullptr);
+  EXPECT_EQ(resolve_field_cached(m_field_ref), nullptr);
+}
+
+TEST_F(ResolverCacheTest, invalidate) {
+  auto a_m = static_cast<DexMethod*>(DexMethod::make_method("LA;.m:()V"));
+  a_m->make_concrete(ACC_PUBLIC, /* is_virtual */ true);
+  m_a->add_method(a_m);
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Virtual), a_m);
+
+  // Editing the member list directly goes unnoticed until the cache is
+  // invalidated.
+  m_a->get_vmethods().clear();
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Virtual), a_m);
+  g_redex->resolver_cache().invalidate();
+  EXPECT_EQ(resolve_method_cached(m_method_ref, MethodSearch::Virtual),
+            nullptr);
+}
+
+TEST_F(ResolverCacheTest, concurrentResolutions) {
+  auto a_m = static_cast<DexMethod*>(DexMethod::make_method("LA;.m:()V"));
+  a_m->make_concrete(ACC_PUBLIC, /* is_virtual */ true);
+  m_a->add_method(a_m);
+  std::atomic<size_t> failures{0};
+  auto wq = workqueue_foreach<int>(
+      [&](int) {
+        if (resolve_method_cached(m_method_ref, MethodSearch::Virtual) !=
+            a_m) {
+          ++failures;
+        }
+      },
+      /* num_threads */ 4);
+  for (int i = 0; i < 1000; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  EXPECT_EQ(failures, 0);
+}
@@ -287,3 +287,46 @@ TEST(ResTable, AppendNewType) {
 
   unmap_and_close(file_descriptor, fp, length);
 }
+
+TEST(ResourceTableView, MatchesResTable) {
+  auto path = std::getenv("test_arsc_path");
+  size_t length;
+  int file_descriptor;
+  auto fp = map_file(path, &file_descriptor, &length);
+  android::ResTable table;
+  ASSERT_EQ(table.add(fp, length), 0);
+  ResourceTableView view(path);
+
+  size_t num_found = 0;
+  for (uint32_t type_id = 0; type_id <= 0x10; type_id++) {
+    for (uint32_t entry_id = 0; entry_id <= 0x20; entry_id++) {
+      uint32_t id = 0x7f000000 | (type_id << 16) | entry_id;
+      android::Vector<android::Res_value> expected;
+      table.getAllValuesForResource(id, expected);
+      std::vector<android::Res_value> actual;
+      view.get_all_values(id, &actual);
+      ASSERT_EQ(expected.size(), actual.size()) << std::hex << id;
+      EXPECT_EQ(view.has_resource(id), !actual.empty()) << std::hex << id;
+      for (size_t i = 0; i < actual.size(); i++) {
+        EXPECT_EQ(expected[i].dataType, actual[i].dataType);
+        EXPECT_EQ(expected[i].data, actual[i].data);
+      }
+      if (actual.empty()) {
+        continue;
+      }
+      num_found++;
+      std::unordered_set<uint32_t> expected_nodes;
+      std::unordered_set<std::string> expected_strings;
+      walk_references_for_resource(table, id, &expected_nodes,
+                                   &expected_strings);
+      std::unordered_set<uint32_t> actual_nodes;
+      std::unordered_set<std::string> actual_strings;
+      walk_references_for_resource(view, id, &actual_nodes, &actual_strings);
+      EXPECT_EQ(expected_nodes, actual_nodes);
+      EXPECT_EQ(expected_strings, actual_strings);
+    }
+  }
+  EXPECT_GT(num_found, 0);
+
+  unmap_and_close(file_descriptor, fp, length);
+}
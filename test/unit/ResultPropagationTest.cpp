@@ -6,10 +6,16 @@
  */
 
 #include <gtest/gtest.h>
+#include <json/json.h>
 
+#include "ConfigFiles.h"
 #include "ControlFlow.h"
+#include "Creators.h"
+#include "DexStore.h"
+#include "DexUtil.h"
 #include "IRAssembler.h"
 #include "IRCode.h"
+#include "PassManager.h"
 #include "ResultPropagation.h"
 
 const DexMethodRef* get_invoked_method(cfg::ControlFlowGraph* cfg) {
@@ -32,8 +38,7 @@ void test_get_return_param_index(const std::string& code_str,
 
   method_override_graph::Graph graph;
   ReturnParamResolver resolver(graph);
-  std::unordered_map<const DexMethod*, ParamIndex>
-      methods_which_return_parameter;
+  ReturnParamSummaries methods_which_return_parameter;
   auto const actual =
       resolver.get_return_param_index(cfg, methods_which_return_parameter);
 
@@ -177,3 +182,69 @@ TEST(CFGInliner, return_receiver_of_framework_method) {
   )";
   test_get_return_param_index(code_str, 0);
 }
+
+TEST(ResultPropagationPass, call_chains) {
+  g_redex = new RedexContext();
+
+  // c calls b calls a; each returns its parameter.
+  auto a = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.a:(I)I"
+     ((load-param v0) (return v0)))
+  )");
+  auto b = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.b:(I)I"
+     ((load-param v0)
+      (invoke-static (v0) "LFoo;.a:(I)I")
+      (move-result v1)
+      (return v1)))
+  )");
+  auto c = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.c:(II)I"
+     ((load-param v0)
+      (load-param v1)
+      (invoke-static (v1) "LFoo;.b:(I)I")
+      (move-result v2)
+      (return v2)))
+  )");
+  auto d = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.d:()I"
+     ((const v0 0)
+      (const v1 1)
+      (invoke-static (v0 v1) "LFoo;.c:(II)I")
+      (move-result v2)
+      (return v2)))
+  )");
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  for (auto m : {a, b, c, d}) {
+    creator.add_method(m);
+  }
+  DexStore store("classes");
+  store.add_classes({creator.create()});
+  std::vector<DexStore> stores;
+  stores.emplace_back(std::move(store));
+
+  ResultPropagationPass pass;
+  Json::Value json;
+  PassManager manager({&pass}, json);
+  ConfigFiles config(json);
+  manager.run_passes(stores, config);
+
+  const auto& metrics = manager.get_pass_info()[0].metrics;
+  EXPECT_EQ(metrics.at("num_methods_which_return_parameters"), 3);
+  EXPECT_EQ(metrics.at("num_methods_which_return_parameters_iterations"), 1);
+  EXPECT_EQ(metrics.at("num_erased_move_results") +
+                metrics.at("num_patched_move_results"),
+            3);
+  auto expected = assembler::ircode_from_string(R"(
+    ((const v0 0)
+     (const v1 1)
+     (invoke-static (v0 v1) "LFoo;.c:(II)I")
+     (move v2 v1)
+     (return v2))
+  )");
+  EXPECT_EQ(assembler::to_s_expr(d->get_code()),
+            assembler::to_s_expr(expected.get()));
+
+  delete g_redex;
+}
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SequenceOutliner.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <numeric>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace sequence_outliner;
+
+namespace {
+
+DexClass* make_class(const std::string& name, const std::string& method) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(get_object_type());
+  creator.set_access(ACC_PUBLIC);
+  creator.add_method(assembler::method_from_string(method));
+  return creator.create();
+}
+
+// A static method that increments its argument `n` times.
+std::string increments(const std::string& cls, size_t n) {
+  std::string method = "(method (public static) \"" + cls + ".f:(I)I\" (";
+  method += "(load-param v0)";
+  for (size_t i = 0; i < n; ++i) {
+    method += "(add-int/lit8 v0 v0 1)";
+  }
+  return method + "(return v0)))";
+}
+
+DexStoresVector make_stores(const Scope& primary, const Scope& secondary) {
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(primary);
+  store.add_classes(secondary);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+} // namespace
+
+class SequenceOutlinerTest : public RedexTest {};
+
+TEST_F(SequenceOutlinerTest, suffixAndLcpArrays) {
+  // b a n a n a
+  std::vector<uint32_t> s{1, 0, 2, 0, 2, 0};
+  auto sa = build_suffix_array(s);
+  std::vector<uint32_t> expected(s.size());
+  std::iota(expected.begin(), expected.end(), 0);
+  std::sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) {
+    return std::lexicographical_compare(s.begin() + a, s.end(), s.begin() + b,
+                                        s.end());
+  });
+  EXPECT_EQ(sa, expected);
+  EXPECT_EQ(sa, std::vector<uint32_t>({5, 3, 1, 0, 4, 2}));
+  EXPECT_EQ(build_lcp_array(s, sa), std::vector<uint32_t>({0, 1, 3, 0, 0, 2}));
+}
+
+TEST_F(SequenceOutlinerTest, repeatedSequencesAreOutlined) {
+  auto primary = make_class("LPrimary;", increments("LPrimary;", 10));
+  Scope secondary;
+  for (auto name : {"LA;", "LB;", "LC;"}) {
+    secondary.push_back(make_class(name, increments(name, 10)));
+  }
+  auto stores = make_stores({primary}, secondary);
+
+  auto stats = outline_sequences(stores, /* include_primary_dex */ false,
+                                 Config());
+  EXPECT_EQ(stats.num_outlined_methods, 1);
+  EXPECT_EQ(stats.num_outlined_sequences, 3);
+  EXPECT_GT(stats.num_code_units_saved, 0);
+
+  auto host =
+      type_class(DexType::get_type("Lcom/facebook/redex/OutlinedCode1;"));
+  ASSERT_NE(host, nullptr);
+  EXPECT_EQ(stores[0].get_dexen()[1].back(), host);
+  ASSERT_EQ(host->get_dmethods().size(), 1);
+  auto helper = host->get_dmethods()[0];
+  EXPECT_EQ(show(helper->get_proto()), "(I)I");
+  auto expected_helper = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (add-int/lit8 v0 v0 1)
+      (return v0)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(helper->get_code()),
+            assembler::to_s_expr(expected_helper.get()));
+
+  for (auto cls : secondary) {
+    auto code = cls->get_dmethods()[0]->get_code();
+    auto expected = assembler::ircode_from_string(
+        "((load-param v0) (invoke-static (v0) \"" + show(helper) +
+        "\") (move-result v0) (return v0))");
+    EXPECT_EQ(assembler::to_s_expr(code), assembler::to_s_expr(expected.get()))
+        << show(cls);
+  }
+  // The primary dex is left alone.
+  EXPECT_EQ(primary->get_dmethods()[0]->get_code()->count_opcodes(), 11);
+}
+
+TEST_F(SequenceOutlinerTest, sequencesThatDontPayOffAreLeftAlone) {
+  Scope secondary;
+  for (auto name : {"LA;", "LB;"}) {
+    secondary.push_back(make_class(name, increments(name, 4)));
+  }
+  auto stores = make_stores({}, secondary);
+
+  auto stats = outline_sequences(stores, /* include_primary_dex */ false,
+                                 Config());
+  EXPECT_EQ(stats.num_outlined_methods, 0);
+  EXPECT_EQ(stores[0].get_dexen()[1].size(), 2);
+  EXPECT_EQ(secondary[0]->get_dmethods()[0]->get_code()->count_opcodes(), 5);
+}
+
+TEST_F(SequenceOutlinerTest, overlappingOccurrencesAreCountedOnce) {
+  // Every run of increments shorter than a whole method also starts at the
+  // next few instructions of every method. Those occurrences overlap, so
+  // only one of them per method can be outlined, and the whole run saves
+  // the most.
+  Scope secondary;
+  for (auto name : {"LA;", "LB;", "LC;", "LD;"}) {
+    secondary.push_back(make_class(name, increments(name, 8)));
+  }
+  auto stores = make_stores({}, secondary);
+
+  auto stats = outline_sequences(stores, /* include_primary_dex */ false,
+                                 Config());
+  EXPECT_EQ(stats.num_outlined_methods, 1);
+  EXPECT_EQ(stats.num_outlined_sequences, 4);
+  EXPECT_EQ(stats.num_code_units_saved, 15);
+  // Each method is left with the invoke, its move-result and the return.
+  for (auto cls : secondary) {
+    EXPECT_EQ(cls->get_dmethods()[0]->get_code()->count_opcodes(), 3)
+        << show(cls);
+  }
+}
@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Sha1.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+
+std::string sha1_hex(const std::string& input, size_t chunk_size) {
+  Sha1Context context;
+  sha1_init(&context);
+  for (size_t i = 0; i < input.size(); i += chunk_size) {
+    sha1_update(&context,
+                reinterpret_cast<const unsigned char*>(input.data()) + i,
+                std::min(chunk_size, input.size() - i));
+  }
+  unsigned char digest[20];
+  sha1_final(digest, &context);
+  std::string hex;
+  for (auto byte : digest) {
+    char buf[3];
+    snprintf(buf, sizeof(buf), "%02x", byte);
+    hex += buf;
+  }
+  return hex;
+}
+
+} // namespace
+
+// Whichever implementation the CPU selects has to produce the FIPS 180
+// test vectors, however the input is split up.
+TEST(Sha1Test, testVectors) {
+  EXPECT_EQ(sha1_hex("abc", 3), "a9993e364706816aba3e25717850c26c9cd0d89d");
+  const std::string two_blocks =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  EXPECT_EQ(sha1_hex(two_blocks, two_blocks.size()),
+            "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+  const std::string million_a(1000000, 'a');
+  for (size_t chunk_size : {1, 63, 64, 777, 1000000}) {
+    EXPECT_EQ(sha1_hex(million_a, chunk_size),
+              "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+  }
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Show.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "DexClass.h"
+#include "IRInstruction.h"
+#include "RedexTest.h"
+
+class ShowTest : public RedexTest {};
+
+TEST_F(ShowTest, showToAppendsWhatShowReturns) {
+  auto method = DexMethod::make_method("LFoo;.bar:(ILjava/lang/String;)V");
+  auto field = DexField::make_field("LFoo;.baz:J");
+  std::string buf = "x";
+  show_to(&buf, method);
+  EXPECT_EQ(buf, "x" + show(method));
+  EXPECT_EQ(show(method), "LFoo;.bar:(ILjava/lang/String;)V");
+
+  buf.clear();
+  show_to(&buf, field);
+  EXPECT_EQ(buf, "LFoo;.baz:J");
+  EXPECT_EQ(show(field), buf);
+
+  buf.clear();
+  show_to(&buf, static_cast<const DexMethodRef*>(nullptr));
+  EXPECT_EQ(buf, "");
+}
+
+TEST_F(ShowTest, instructions) {
+  IRInstruction const_insn(OPCODE_CONST);
+  const_insn.set_dest(3);
+  const_insn.set_literal(-42);
+  EXPECT_EQ(show(&const_insn), "CONST v3, -42");
+
+  IRInstruction str_insn(OPCODE_CONST_STRING);
+  str_insn.set_string(DexString::make_string("a\"b\\c"));
+  EXPECT_EQ(show(&str_insn), "CONST_STRING \"a\\\"b\\\\c\"");
+
+  auto method = DexMethod::make_method("LFoo;.bar:(I)V");
+  IRInstruction invoke(OPCODE_INVOKE_STATIC);
+  invoke.set_method(method);
+  invoke.set_arg_word_count(1);
+  invoke.set_src(0, 1);
+  std::string buf;
+  show_to(&buf, &invoke);
+  EXPECT_EQ(buf, "INVOKE_STATIC v1, LFoo;.bar:(I)V");
+}
+
+TEST_F(ShowTest, lazyShowFormatsWhenStreamed) {
+  auto method = DexMethod::make_method("LFoo;.bar:()V");
+  auto lazy = show_lazy(method);
+  std::ostringstream ss;
+  ss << lazy;
+  EXPECT_EQ(ss.str(), show(method));
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Shrinker.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+using namespace shrinker;
+
+class ShrinkerTest : public RedexTest {};
+
+namespace {
+
+Stats shrink(DexMethod* method, const Config& config) {
+  std::unordered_set<DexMethodRef*> pure_methods;
+  Shrinker shrinker(config, pure_methods);
+  shrinker.shrink(method);
+  return shrinker.get_stats();
+}
+
+constexpr const char* kConstantBranch = R"(
+  (method (public static) "LFoo;.bar:()I"
+   (
+    (const v0 1)
+    (move v1 v0)
+    (if-eqz v1 :dead)
+    (const v2 5)
+    (return v2)
+    (:dead)
+    (const v3 7)
+    (return v3)
+   )
+  )
+)";
+
+} // namespace
+
+TEST_F(ShrinkerTest, stepsRunUntilNothingChanges) {
+  auto method = assembler::method_from_string(kConstantBranch);
+  auto stats = shrink(method, Config());
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (const v2 5)
+      (return v2)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(method->get_code()),
+            assembler::to_s_expr(expected.get()));
+  EXPECT_FALSE(method->get_code()->cfg_built());
+  EXPECT_EQ(stats.methods_shrunk, 1);
+  EXPECT_EQ(stats.methods_without_fixpoint, 0);
+  EXPECT_GE(stats.rounds, 2);
+  EXPECT_EQ(stats.branches_removed, 1);
+  EXPECT_GT(stats.dead_instructions, 0);
+}
+
+TEST_F(ShrinkerTest, roundsAreBounded) {
+  auto method = assembler::method_from_string(kConstantBranch);
+  Config config;
+  config.steps = {parse_step("local_dce")};
+  config.max_rounds = 1;
+  auto stats = shrink(method, config);
+
+  // Without constant propagation, the branch stays, and so does everything
+  // it depends on. Nothing was removed, so one round was enough.
+  EXPECT_EQ(stats.rounds, 1);
+  EXPECT_EQ(stats.methods_without_fixpoint, 0);
+  EXPECT_EQ(stats.dead_instructions, 0);
+  EXPECT_EQ(method->get_code()->count_opcodes(), 7);
+}
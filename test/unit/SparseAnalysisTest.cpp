@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ConstantAbstractDomain.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+#include "SparseAnalysis.h"
+
+using ConstantDomain = sparta::ConstantAbstractDomain<int64_t>;
+
+struct SparseAnalysisTest : public RedexTest {};
+
+namespace {
+
+class ConstantAnalyzer final
+    : public sparse_analysis::SparseAnalyzer<ConstantDomain> {
+ public:
+  using SparseAnalyzer::SparseAnalyzer;
+
+  ConstantDomain analyze_def(
+      const IRInstruction* producer,
+      const std::vector<ConstantDomain>& srcs) const override {
+    for (const auto& src : srcs) {
+      if (src.is_bottom()) {
+        return ConstantDomain::bottom();
+      }
+    }
+    switch (producer->opcode()) {
+    case OPCODE_CONST:
+      return ConstantDomain(producer->get_literal());
+    case OPCODE_MOVE:
+      return srcs[0];
+    case OPCODE_ADD_INT_LIT8: {
+      auto c = srcs[0].get_constant();
+      return c ? ConstantDomain(*c + producer->get_literal())
+               : ConstantDomain::top();
+    }
+    default:
+      return ConstantDomain::top();
+    }
+  }
+};
+
+IRInstruction* find_insn(const cfg::ControlFlowGraph& cfg, IROpcode op) {
+  for (auto* block : cfg.blocks()) {
+    for (const auto& mie : InstructionIterable(block)) {
+      if (mie.insn->opcode() == op) {
+        return mie.insn;
+      }
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST_F(SparseAnalysisTest, constantsAcrossBranches) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v2)
+      (const v0 1)
+      (const v1 10)
+      (if-eqz v2 :else)
+      (add-int/lit8 v0 v0 1)
+      (:else)
+      (move v3 v1)
+      (add-int/lit8 v3 v3 5)
+      (return v0)
+    )
+  )");
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  def_use::DefUseChains chains(cfg);
+  ConstantAnalyzer analyzer(chains);
+  analyzer.run();
+
+  auto* ret = find_insn(cfg, OPCODE_RETURN);
+  EXPECT_EQ(chains.defs_of(ret, 0).size(), 2);
+  // v0 is either 1 or 2 at the return.
+  EXPECT_TRUE(analyzer.get_use_value(ret, 0).is_top());
+
+  auto* add = find_insn(cfg, OPCODE_ADD_INT_LIT8);
+  EXPECT_EQ(analyzer.get_def_value(add), ConstantDomain(2));
+  EXPECT_EQ(chains.uses_of(add).size(), 1);
+
+  bool found = false;
+  for (auto* def : chains.defs()) {
+    if (def->opcode() == OPCODE_MOVE) {
+      EXPECT_EQ(analyzer.get_def_value(def), ConstantDomain(10));
+      found = true;
+    } else if (def->opcode() == OPCODE_ADD_INT_LIT8 && def != add) {
+      EXPECT_EQ(analyzer.get_def_value(def), ConstantDomain(15));
+    }
+  }
+  EXPECT_TRUE(found);
+  code->clear_cfg();
+}
+
+TEST_F(SparseAnalysisTest, loopsAndResults) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (const v1 7)
+      (:loop)
+      (add-int/lit8 v0 v0 1)
+      (if-nez v0 :loop)
+      (const-string "foo")
+      (move-result-pseudo-object v2)
+      (move v3 v1)
+      (return v3)
+    )
+  )");
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  def_use::DefUseChains chains(cfg);
+  ConstantAnalyzer analyzer(chains);
+  analyzer.run();
+
+  // The counter goes through 0, 1, 2, ...
+  auto* add = find_insn(cfg, OPCODE_ADD_INT_LIT8);
+  EXPECT_EQ(chains.defs_of(add, 0).size(), 2);
+  EXPECT_TRUE(analyzer.get_def_value(add).is_top());
+  // The constant flows through the move, around the loop.
+  auto* ret = find_insn(cfg, OPCODE_RETURN);
+  EXPECT_EQ(analyzer.get_use_value(ret, 0), ConstantDomain(7));
+
+  auto* const_string = find_insn(cfg, OPCODE_CONST_STRING);
+  auto* move_result = chains.def_of(const_string);
+  ASSERT_NE(move_result, nullptr);
+  EXPECT_EQ(move_result->opcode(), IOPCODE_MOVE_RESULT_PSEUDO_OBJECT);
+  EXPECT_EQ(chains.producer_of(move_result), const_string);
+  EXPECT_TRUE(analyzer.get_def_value(move_result).is_top());
+  code->clear_cfg();
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <mutex>
+#include <set>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+
+namespace {
+
+// Remembers the stores that each run_pass call got.
+class CountingPass : public Pass {
+ public:
+  CountingPass(const char* name, bool store_local)
+      : Pass(name), m_store_local(store_local) {}
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::set<std::string> names;
+    for (const auto& store : stores) {
+      names.insert(store.get_name());
+    }
+    calls.push_back(names);
+    mgr.incr_metric("classes", build_class_scope(stores).size());
+  }
+
+  bool is_store_local() const override { return m_store_local; }
+
+  std::vector<std::set<std::string>> calls;
+
+ private:
+  bool m_store_local;
+  std::mutex m_lock;
+};
+
+DexStore make_store(const std::string& name, const std::string& cls_name) {
+  ClassCreator creator(DexType::make_type(cls_name.c_str()));
+  creator.set_super(get_object_type());
+  DexMetadata metadata;
+  metadata.set_id(name);
+  DexStore store(metadata);
+  store.add_classes({creator.create()});
+  return store;
+}
+
+} // namespace
+
+struct StoreLocalPassTest : public RedexTest {};
+
+TEST_F(StoreLocalPassTest, storeLocalPassesRunOnEachStore) {
+  std::vector<DexStore> stores;
+  stores.push_back(make_store("classes", "LA;"));
+  stores.push_back(make_store("module1", "LB;"));
+  stores.push_back(make_store("module2", "LC;"));
+
+  CountingPass global("GlobalPass", false);
+  CountingPass local("LocalPass", true);
+  PassManager manager({&global, &local});
+  Json::Value json;
+  ConfigFiles config(json);
+  manager.run_passes(stores, config);
+
+  ASSERT_EQ(global.calls.size(), 1);
+  EXPECT_EQ(global.calls[0].size(), 3);
+
+  std::set<std::string> seen;
+  ASSERT_EQ(local.calls.size(), 3);
+  for (const auto& call : local.calls) {
+    ASSERT_EQ(call.size(), 1);
+    seen.insert(*call.begin());
+  }
+  EXPECT_EQ(seen, std::set<std::string>({"classes", "module1", "module2"}));
+  EXPECT_EQ(manager.get_pass_info()[1].metrics.at("classes"), 3);
+
+  // The stores are back in their order.
+  ASSERT_EQ(stores.size(), 3);
+  EXPECT_EQ(stores[0].get_name(), "classes");
+  EXPECT_EQ(stores[1].get_name(), "module1");
+  EXPECT_EQ(stores[2].get_name(), "module2");
+  EXPECT_EQ(show(stores[2].get_dexen()[0][0]), "LC;");
+}
+
+TEST_F(StoreLocalPassTest, canBeTurnedOff) {
+  std::vector<DexStore> stores;
+  stores.push_back(make_store("classes", "LA;"));
+  stores.push_back(make_store("module1", "LB;"));
+
+  CountingPass local("LocalPass", true);
+  Json::Value json;
+  json["parallel_store_local_passes"] = false;
+  PassManager manager({&local}, json);
+  ConfigFiles config(json);
+  manager.run_passes(stores, config);
+
+  ASSERT_EQ(local.calls.size(), 1);
+  EXPECT_EQ(local.calls[0].size(), 2);
+}
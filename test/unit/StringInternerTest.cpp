@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "StringInterner.h"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "DexClass.h"
+
+TEST(StringInternerTest, hashCoversWholeString) {
+  using string_interner_impl::hash_bytes;
+  std::string a(100, 'x');
+  std::string b = a;
+  b[99] = 'y';
+  std::string c = a;
+  c[0] = 'y';
+  EXPECT_EQ(hash_bytes(a.data(), a.size()), hash_bytes(a.data(), a.size()));
+  EXPECT_NE(hash_bytes(a.data(), a.size()), hash_bytes(b.data(), b.size()));
+  EXPECT_NE(hash_bytes(a.data(), a.size()), hash_bytes(c.data(), c.size()));
+  EXPECT_NE(hash_bytes(a.data(), 0), hash_bytes(a.data(), 1));
+}
+
+TEST(StringInternerTest, internsUniquely) {
+  StringInterner interner;
+  EXPECT_EQ(nullptr, interner.get("foo", 3));
+  auto foo = interner.make("foo", 3, 3);
+  EXPECT_EQ("foo", foo->str());
+  EXPECT_EQ(foo, interner.make("foo", 3, 3));
+  EXPECT_EQ(foo, interner.get("foo", 3));
+  EXPECT_NE(foo, interner.make("fo", 2, 2));
+  EXPECT_NE(foo, interner.make("", 0, 0));
+  EXPECT_EQ(3, interner.get_stats().strings);
+}
+
+TEST(StringInternerTest, inPlaceStringsAreNotCopied) {
+  StringInterner interner;
+  // Stands in for the string data of a mapped dex file.
+  static const char kMapped[] = "Lcom/facebook/Mapped;";
+  std::string copied = "Lcom/facebook/Copied;";
+
+  auto mapped = interner.make(kMapped, strlen(kMapped), strlen(kMapped),
+                              /* in_place */ true);
+  EXPECT_EQ(kMapped, mapped->c_str());
+  auto copy = interner.make(copied.c_str(), copied.size(), copied.size());
+  EXPECT_NE(copied.c_str(), copy->c_str());
+  copied[1] = 'x';
+  EXPECT_STREQ("Lcom/facebook/Copied;", copy->c_str());
+  EXPECT_EQ("Lcom/facebook/Copied;", copy->str());
+
+  // An equal string keeps whichever representation was interned first.
+  std::string again(kMapped);
+  EXPECT_EQ(mapped, interner.make(again.c_str(), again.size(), again.size()));
+  EXPECT_EQ(1, interner.get_stats().in_place);
+
+  // str() materializes one copy and keeps handing it out.
+  EXPECT_EQ(&mapped->str(), &mapped->str());
+  EXPECT_EQ(kMapped, mapped->str());
+}
+
+// Enough strings to make every shard grow a few times.
+TEST(StringInternerTest, concurrentInterning) {
+  constexpr size_t kThreads = 8;
+  constexpr size_t kStrings = 100'000;
+  StringInterner interner;
+  std::vector<std::vector<DexString*>> results(kThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < kStrings; ++i) {
+        // Every thread interns the same strings, in a different order.
+        auto s = "Lcom/facebook/Class" + std::to_string((i * (t + 1)) % kStrings) +
+                 ";";
+        results[t].push_back(interner.make(s.c_str(), s.size(), s.size()));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::unordered_set<DexString*> all;
+  for (auto& r : results) {
+    all.insert(r.begin(), r.end());
+  }
+  EXPECT_EQ(kStrings, all.size());
+  auto stats = interner.get_stats();
+  EXPECT_EQ(kStrings, stats.strings);
+  EXPECT_LE(stats.arenas, kThreads);
+  EXPECT_GE(stats.arena_bytes_used, kStrings * sizeof(DexString));
+  for (auto s : all) {
+    EXPECT_EQ(s, interner.get(s->c_str(), s->size()));
+  }
+}
+
+TEST(StringInternerTest, throughRedexContext) {
+  g_redex = new RedexContext();
+  auto s = DexString::make_string("Ljava/lang/Object;");
+  EXPECT_EQ(s, DexString::get_string("Ljava/lang/Object;"));
+  EXPECT_EQ(nullptr, DexString::get_string("Ljava/lang/Objec"));
+  EXPECT_EQ(1, g_redex->get_string_interning_stats().strings);
+  delete g_redex;
+}
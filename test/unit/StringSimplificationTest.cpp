@@ -10,6 +10,7 @@
 #include "DexAsm.h"
 #include "DexUnitTestRunner.h"
 #include "DexUtil.h"
+#include "IRAssembler.h"
 
 #include "StringSimplification.h"
 
@@ -523,3 +524,31 @@ TEST(StringSimplification, registerAliasingTest) {
     EXPECT_NE(mie.insn->opcode(), OPCODE_INVOKE_VIRTUAL);
   }
 }
+
+// Methods that never call toString() are left alone.
+TEST(StringSimplification, testSkipsMethodsWithoutToString) {
+  DexUnitTestRunner runner;
+  auto parent = runner.create_class("Lcom/redex/Parent7;");
+  auto clinit = parent->get_clinit();
+  const auto* body = R"(
+    (
+      (const-string "ONE")
+      (move-result-pseudo-object v1)
+      (new-instance "Ljava/lang/StringBuilder;")
+      (move-result-pseudo-object v2)
+      (invoke-direct (v2) "Ljava/lang/StringBuilder;.<init>:()V")
+      (invoke-virtual (v2 v1) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (return-void)
+    )
+  )";
+  clinit->set_code(assembler::ircode_from_string(body));
+  auto code = clinit->get_code();
+  EXPECT_FALSE(calls_stringbuilder_tostring(code));
+  runner.run(new StringSimplificationPass());
+
+  if (code->cfg_built()) {
+    code->clear_cfg();
+  }
+  auto expected = assembler::ircode_from_string(body);
+  EXPECT_EQ(assembler::to_s_expr(code), assembler::to_s_expr(expected.get()));
+}
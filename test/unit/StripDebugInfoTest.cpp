@@ -7,8 +7,12 @@
 
 #include <gtest/gtest.h>
 
+#include "ConfigFiles.h"
 #include "Creators.h"
+#include "DexHasher.h"
+#include "DexUtil.h"
 #include "IRAssembler.h"
+#include "PassManager.h"
 #include "RedexTest.h"
 #include "StripDebugInfo.h"
 
@@ -94,3 +98,45 @@ TEST_F(StripDebugInfoTest, dropLineNumbersWithNonThrowing) {
     )
 )");
 }
+
+// A dex is only copied to the output if the hash of its classes didn't change,
+// so the hash has to see what StripDebugInfoPass removes.
+TEST_F(StripDebugInfoTest, strippedDexesHashDifferently) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+      (
+        (return-void)
+      )
+    )
+  )");
+  method->get_code()->set_debug_item(std::make_unique<DexDebugItem>());
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(method);
+  auto cls = creator.create();
+  cls->set_source_file(DexString::make_string("Foo.java"));
+  DexStore store("classes");
+  store.add_classes({cls});
+  std::vector<DexStore> stores;
+  stores.emplace_back(std::move(store));
+
+  auto run_pass = [&](const std::string& option) {
+    auto before = hashing::hash_dex_classes(stores[0].get_dexen()[0]);
+    StripDebugInfoPass pass;
+    Json::Value json;
+    json["redex"]["passes"].append("StripDebugInfoPass");
+    json["StripDebugInfoPass"]["drop_all_dbg_info_if_empty"] = false;
+    json["StripDebugInfoPass"]["drop_src_files"] = false;
+    json["StripDebugInfoPass"][option] = true;
+    PassManager manager({&pass}, json);
+    manager.set_testing_mode();
+    ConfigFiles config(json);
+    manager.run_passes(stores, config);
+    return before != hashing::hash_dex_classes(stores[0].get_dexen()[0]);
+  };
+
+  EXPECT_TRUE(run_pass("drop_all_dbg_info"));
+  EXPECT_EQ(method->get_code()->get_debug_item(), nullptr);
+  EXPECT_TRUE(run_pass("drop_src_files"));
+  EXPECT_EQ(cls->get_source_file(), nullptr);
+}
@@ -71,3 +71,56 @@ TEST(SwitchDispatchTest, create_simple_dispatch) {
 
   delete g_redex;
 }
+
+TEST(SwitchDispatchTest, create_two_level_dispatch) {
+  g_redex = new RedexContext();
+  auto owner = DexType::make_type("Lfoo;");
+  ClassCreator cc(owner);
+  cc.set_super(get_object_type());
+  cc.create();
+  auto type_tag_field =
+      static_cast<DexField*>(DexField::make_field("Lfoo;.$t:I"));
+  type_tag_field->make_concrete(ACC_PUBLIC);
+
+  std::map<SwitchIndices, DexMethod*> indices_to_callee;
+  for (int i = 0; i < 5; ++i) {
+    indices_to_callee[{i}] = make_a_method(
+        "Lfoo;.t" + std::to_string(i) + ":(Lfoo;)I", ACC_PUBLIC | ACC_STATIC);
+  }
+  dispatch::Spec spec{owner,
+                      dispatch::Type::VIRTUAL,
+                      "dispatch",
+                      DexProto::make_proto(get_int_type(),
+                                           DexTypeList::make_type_list({})),
+                      ACC_PUBLIC,
+                      type_tag_field,
+                      nullptr /* overridden_meth */,
+                      2 /* max_num_dispatch_target */,
+                      boost::none /* type_tag_param_idx */,
+                      false /* keep_debug_info */};
+  auto dispatch = dispatch::create_virtual_dispatch(spec, indices_to_callee);
+  ASSERT_EQ(dispatch.sub_dispatches.size(), 3);
+
+  // The top level switch has one case per leaf dispatch, each matching all
+  // the indices of its leaf.
+  size_t num_invokes = 0;
+  size_t num_case_keys = 0;
+  auto code = dispatch.main_dispatch->get_code();
+  for (const auto& mie : *code) {
+    if (mie.type == MFLOW_OPCODE &&
+        mie.insn->opcode() == OPCODE_INVOKE_STATIC) {
+      ++num_invokes;
+    } else if (mie.type == MFLOW_TARGET &&
+               mie.target->type == BRANCH_MULTI) {
+      ++num_case_keys;
+    }
+  }
+  EXPECT_EQ(num_invokes, 3);
+  EXPECT_EQ(num_case_keys, 5);
+  code->build_cfg();
+  // The entry, the three leaf calls, the default and the exit.
+  EXPECT_EQ(code->cfg().num_blocks(), 6);
+  code->clear_cfg();
+
+  delete g_redex;
+}
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TaskGraph.h"
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+TEST(TaskGraphTest, RunsAfterDependencies) {
+  TaskGraph graph;
+  std::mutex lock;
+  std::vector<std::string> order;
+  auto record = [&](const std::string& name) {
+    return [&, name] {
+      std::lock_guard<std::mutex> guard(lock);
+      order.push_back(name);
+    };
+  };
+  auto a = graph.add("a", record("a"));
+  auto b = graph.add("b", record("b"));
+  auto c = graph.add("c", record("c"), {a, b});
+  graph.add("d", record("d"), {c});
+  graph.run();
+
+  ASSERT_EQ(4, order.size());
+  EXPECT_EQ("c", order[2]);
+  EXPECT_EQ("d", order[3]);
+}
+
+TEST(TaskGraphTest, IndependentTasksOverlap) {
+  TaskGraph graph;
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+  auto task = [&] {
+    int now = ++running;
+    int prev = max_running.load();
+    while (now > prev && !max_running.compare_exchange_weak(prev, now)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    --running;
+  };
+  graph.add("a", task);
+  graph.add("b", task);
+  graph.run();
+  EXPECT_EQ(2, max_running.load());
+}
+
+TEST(TaskGraphTest, CriticalPath) {
+  TaskGraph graph;
+  auto sleep = [](int ms) {
+    return [ms] { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); };
+  };
+  auto slow = graph.add("slow", sleep(100));
+  auto fast = graph.add("fast", sleep(1));
+  auto join = graph.add("join", sleep(1), {fast, slow});
+  graph.add("side", sleep(1), {fast});
+  graph.run();
+
+  EXPECT_EQ(std::vector<TaskGraph::TaskId>({slow, join}),
+            graph.critical_path());
+  EXPECT_GE(graph.timing(join).start, graph.timing(slow).duration);
+}
+
+TEST(TaskGraphTest, FailureSkipsDependents) {
+  TaskGraph graph;
+  bool ran_dependent = false;
+  bool ran_other = false;
+  auto failing = graph.add("failing", [] { throw std::runtime_error("boom"); });
+  graph.add("dependent", [&] { ran_dependent = true; }, {failing});
+  graph.add("other", [&] { ran_other = true; });
+  EXPECT_THROW(graph.run(), std::runtime_error);
+  EXPECT_FALSE(ran_dependent);
+  EXPECT_TRUE(ran_other);
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "ScopeHelper.h"
+
+/**
+ * class A {}
+ *   class B extends A implements I {}
+ *   class C extends A {}
+ * interface I {}
+ */
+class TypeHierarchyCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    g_redex = new RedexContext();
+    scope = create_empty_scope();
+    auto obj_t = get_object_type();
+    a_t = DexType::make_type("LA;");
+    b_t = DexType::make_type("LB;");
+    c_t = DexType::make_type("LC;");
+    i_t = DexType::make_type("LI;");
+    scope.push_back(create_internal_class(i_t, obj_t, {},
+                                          ACC_PUBLIC | ACC_INTERFACE));
+    scope.push_back(create_internal_class(a_t, obj_t, {}));
+    scope.push_back(create_internal_class(b_t, a_t, {i_t}));
+    scope.push_back(create_internal_class(c_t, a_t, {}));
+  }
+
+  void TearDown() override { delete g_redex; }
+
+  Scope scope;
+  DexType* a_t;
+  DexType* b_t;
+  DexType* c_t;
+  DexType* i_t;
+};
+
+TEST_F(TypeHierarchyCacheTest, sameAsBuildTypeHierarchy) {
+  auto cached = g_redex->type_hierarchy_cache().type_hierarchy(scope);
+  EXPECT_EQ(build_type_hierarchy(scope), *cached);
+  EXPECT_EQ(TypeSet({b_t, c_t}), get_children(*cached, a_t));
+  EXPECT_EQ(0, cached->count(i_t));
+}
+
+TEST_F(TypeHierarchyCacheTest, extendsOrImplements) {
+  auto cached =
+      g_redex->type_hierarchy_cache().extends_or_implements_hierarchy(scope);
+  EXPECT_EQ(TypeSet({b_t, c_t}), get_children(*cached, a_t));
+  EXPECT_EQ(TypeSet({b_t}), get_children(*cached, i_t));
+  EXPECT_EQ(1, cached->count(c_t));
+}
+
+TEST_F(TypeHierarchyCacheTest, invalidation) {
+  auto& cache = g_redex->type_hierarchy_cache();
+  auto first = cache.type_hierarchy(scope);
+  EXPECT_EQ(first, cache.type_hierarchy(scope));
+
+  // Reparenting a class.
+  type_class(c_t)->set_super_class(b_t);
+  auto second = cache.type_hierarchy(scope);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(TypeSet({b_t}), get_children(*second, a_t));
+  EXPECT_EQ(TypeSet({c_t}), get_children(*second, b_t));
+  // Holders of the old entry still see what they were given.
+  EXPECT_EQ(TypeSet({b_t, c_t}), get_children(*first, a_t));
+
+  // Removing a class.
+  scope.pop_back();
+  auto third = cache.type_hierarchy(scope);
+  EXPECT_NE(second, third);
+  EXPECT_EQ(0, third->count(c_t));
+
+  // Adding an external class.
+  auto d_t = DexType::make_type("LD;");
+  create_external_class(d_t, a_t, {});
+  auto fourth = cache.type_hierarchy(scope);
+  EXPECT_NE(third, fourth);
+  EXPECT_EQ(TypeSet({b_t, d_t}), get_children(*fourth, a_t));
+}
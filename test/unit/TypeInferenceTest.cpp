@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TypeInference.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+struct TypeInferenceTest : public RedexTest {};
+
+TEST_F(TypeInferenceTest, lazyEnvironmentsMatchEagerOnes) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(ILjava/lang/Object;)I"
+     (
+      (load-param v0)
+      (load-param-object v1)
+      (if-eqz v0 :else)
+      (const v2 1)
+      (goto :join)
+      (:else)
+      (move-object v2 v1)
+      (check-cast v2 "Ljava/lang/String;")
+      (move-result-pseudo-object v2)
+      (const v2 2)
+      (:join)
+      (add-int v3 v0 v2)
+      (return v3)
+     )
+    )
+  )");
+  auto* code = method->get_code();
+  code->build_cfg(/* editable */ false);
+  const auto& cfg = code->cfg();
+
+  type_inference::TypeInference eager(cfg);
+  eager.run(method);
+  type_inference::TypeInference lazy(cfg, /* lazy_environments */ true);
+  lazy.run(method);
+
+  // Backwards, so that blocks get evicted and replayed again.
+  std::vector<IRInstruction*> insns;
+  for (auto& mie : InstructionIterable(code)) {
+    insns.push_back(mie.insn);
+  }
+  auto& eager_envs = eager.get_type_environments();
+  for (auto it = insns.rbegin(); it != insns.rend(); ++it) {
+    auto env = lazy.get_type_environment(*it);
+    ASSERT_TRUE(env);
+    EXPECT_TRUE(env->equals(eager_envs.at(*it)));
+    EXPECT_TRUE(eager.get_type_environment(*it)->equals(*env));
+  }
+
+  IRInstruction other(OPCODE_NOP);
+  EXPECT_FALSE(lazy.get_type_environment(&other));
+
+  // Asking for them all still works.
+  auto& lazy_envs = lazy.get_type_environments();
+  EXPECT_EQ(lazy_envs.size(), eager_envs.size());
+  for (auto* insn : insns) {
+    EXPECT_TRUE(lazy_envs.at(insn).equals(eager_envs.at(insn)));
+  }
+  code->clear_cfg();
+}
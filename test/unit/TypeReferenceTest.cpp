@@ -103,3 +103,30 @@ TEST_F(TypeReferenceTest, update_field_type_references) {
   EXPECT_EQ(f_e3->get_type(),
             make_array_type(make_array_type(make_array_type(get_int_type()))));
 }
+
+TEST_F(TypeReferenceTest, batch_chains_mappings) {
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+  auto c = DexType::make_type("LC;");
+  TypeRefUpdateBatch batch;
+  EXPECT_TRUE(batch.empty());
+  batch.add(a, b);
+  batch.add(b, c);
+  const auto& old_to_new = batch.get_old_to_new();
+  EXPECT_EQ(old_to_new.size(), 2);
+  EXPECT_EQ(old_to_new.at(a), c);
+  EXPECT_EQ(old_to_new.at(b), c);
+}
+
+TEST_F(TypeReferenceTest, batch_apply) {
+  auto f_i = make_a_field("f_i", get_int_type());
+  auto f_e1 = make_a_field("f_e1", make_array_type(get_enum_type()));
+  auto f_c = make_a_field("f_c", get_char_type());
+  TypeRefUpdateBatch batch;
+  batch.add(m_old_to_new);
+  batch.apply(m_scope, build_type_hierarchy(m_scope));
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(f_i->get_type(), get_int_type());
+  EXPECT_EQ(f_e1->get_type(), make_array_type(get_int_type()));
+  EXPECT_EQ(f_c->get_type(), get_object_type());
+}
@@ -358,3 +358,46 @@ TEST_F(UpCodeMotionTest, clobbered_two_references) {
   )";
   test(code_str, expected_str, 2, 1, 0, 2);
 }
+
+TEST_F(UpCodeMotionTest, hoistBranchPrefixesFirst) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (if-eqz v0 :true)
+
+      (const v2 7)
+      (const v1 0)
+
+      (:end)
+      (return v1)
+
+      (:true)
+      (const v2 7)
+      (const v1 1)
+      (goto :end)
+    )
+  )");
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (const v2 7)
+      (const v1 1)
+      (if-eqz v0 :end)
+
+      (const v1 0)
+
+      (:end)
+      (return v1)
+    )
+  )");
+
+  bool is_static = true;
+  DexTypeList* args = DexTypeList::make_type_list({});
+  DexType* declaring_type = nullptr;
+  UpCodeMotionPass::Stats stats = UpCodeMotionPass::process_code(
+      is_static, declaring_type, args, code.get(),
+      /* hoist_branch_prefixes */ true);
+  EXPECT_EQ(1, stats.branch_prefix_instructions_hoisted);
+  EXPECT_EQ(1, stats.instructions_moved);
+  EXPECT_EQ(1, stats.branches_moved_over);
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected.get()));
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+struct VisibilityChangesTest : public RedexTest {};
+
+TEST_F(VisibilityChangesTest, gatheredChangesApplyLikeChangeVisibility) {
+  auto callee = assembler::method_from_string(R"(
+    (method (private static) "LBar;.callee:()V"
+     ((return-void)))
+  )");
+  auto field = static_cast<DexField*>(DexField::make_field("LBar;.f:I"));
+  field->make_concrete(ACC_PRIVATE | ACC_STATIC);
+  ClassCreator bar_creator(DexType::make_type("LBar;"));
+  bar_creator.set_super(get_object_type());
+  bar_creator.add_method(callee);
+  bar_creator.add_field(field);
+  auto bar = bar_creator.create();
+
+  auto caller = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.caller:()V"
+     (
+      (invoke-static () "LBar;.callee:()V")
+      (sget "LBar;.f:I")
+      (move-result-pseudo v0)
+      (return-void)
+     )
+    )
+  )");
+  ClassCreator foo_creator(DexType::make_type("LFoo;"));
+  foo_creator.set_super(get_object_type());
+  foo_creator.add_method(caller);
+  foo_creator.create();
+
+  auto changes = get_visibility_changes(caller);
+  EXPECT_EQ(changes.classes, std::unordered_set<DexClass*>{bar});
+  EXPECT_EQ(changes.fields, std::unordered_set<DexField*>{field});
+  EXPECT_EQ(changes.methods, std::unordered_set<DexMethod*>{callee});
+  // Nothing changes before the changes are applied.
+  EXPECT_FALSE(is_public(callee));
+  EXPECT_FALSE(is_public(field));
+
+  changes.apply();
+  EXPECT_TRUE(is_public(bar));
+  EXPECT_TRUE(is_public(field));
+  EXPECT_TRUE(is_public(callee));
+}
@@ -7,9 +7,11 @@
 
 #include "WorkQueue.h"
 
+#include <atomic>
 #include <chrono>
 #include <gtest/gtest.h>
 #include <random>
+#include <thread>
 
 constexpr unsigned int NUM_STRINGS = 100'000;
 constexpr unsigned int NUM_INTS = 1000;
@@ -103,3 +105,207 @@ TEST(WorkQueueTest, checkDynamicallyAddingTasks) {
   // 10 + 9 + ... + 1 + 0 = 55
   EXPECT_EQ(55, result);
 }
+
+TEST(WorkQueueTest, lockingSchedulerTest) {
+  using WorkerState = WorkerState<int, std::nullptr_t, int>;
+  WorkQueue<int, std::nullptr_t, int> wq(
+      [](WorkerState*, int a) { return a; },
+      [](int a, int b) { return a + b; },
+      [](uint) { return nullptr; },
+      4,
+      WorkQueueScheduler::Locking);
+  EXPECT_EQ(WorkQueueScheduler::Locking, wq.scheduler());
+  for (int idx = 0; idx < NUM_INTS; ++idx) {
+    wq.add_item(idx);
+  }
+  EXPECT_EQ(NUM_INTS * (NUM_INTS - 1) / 2, wq.run_all());
+}
+
+// Every task fans out into more tasks from inside the workers; the stealing
+// scheduler must keep all threads around until the last of them is done.
+TEST(WorkQueueTest, workStealingFanOut) {
+  using WorkerState = WorkerState<int, std::nullptr_t, int>;
+  WorkQueue<int, std::nullptr_t, int> wq(
+      [](WorkerState* worker_state, int depth) {
+        if (depth > 0) {
+          worker_state->push_task(depth - 1);
+          worker_state->push_task(depth - 1);
+        }
+        return 1;
+      },
+      [](int a, int b) { return a + b; },
+      [](uint) { return nullptr; },
+      8,
+      WorkQueueScheduler::WorkStealing);
+  wq.add_item(14);
+  // A full binary tree of depth 14 has 2^15 - 1 nodes.
+  EXPECT_EQ((1 << 15) - 1, wq.run_all());
+}
+
+TEST(WorkQueueTest, workStealingUsesAllWorkers) {
+  std::vector<std::atomic<int>> per_worker(4);
+  using WorkerState = WorkerState<int, std::nullptr_t, std::nullptr_t>;
+  WorkQueue<int, std::nullptr_t, std::nullptr_t> wq(
+      [&](WorkerState* worker_state, int) {
+        per_worker[worker_state->worker_id()]++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](uint) { return nullptr; },
+      4,
+      WorkQueueScheduler::WorkStealing);
+  for (int idx = 0; idx < 200; ++idx) {
+    wq.add_item(idx);
+  }
+  wq.run_all();
+  int total = 0;
+  for (auto& count : per_worker) {
+    total += count;
+  }
+  EXPECT_EQ(200, total);
+}
+
+TEST(WorkStealingDequeTest, ownerIsLifoThiefIsFifo) {
+  int values[3] = {0, 1, 2};
+  WorkStealingDeque<int*> deque(/* log_capacity */ 1);
+  for (auto& v : values) {
+    deque.push(&v);
+  }
+  EXPECT_EQ(3, deque.size_approx());
+  EXPECT_EQ(&values[0], deque.steal());
+  EXPECT_EQ(&values[2], deque.pop());
+  EXPECT_EQ(&values[1], deque.pop());
+  EXPECT_EQ(nullptr, deque.pop());
+  EXPECT_EQ(nullptr, deque.steal());
+}
+
+TEST(WorkStealingDequeTest, concurrentStealsSeeEveryItemOnce) {
+  constexpr size_t N = 100'000;
+  std::vector<int> items(N);
+  std::vector<std::atomic<int>> seen(N);
+  WorkStealingDeque<int*> deque;
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (size_t i = 0; i < 3; ++i) {
+    thieves.emplace_back([&]() {
+      while (!done.load() || !deque.empty_approx()) {
+        auto item = deque.steal();
+        if (item != nullptr) {
+          seen[item - items.data()]++;
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < N; ++i) {
+    deque.push(&items[i]);
+    if (i % 3 == 0) {
+      auto item = deque.pop();
+      if (item != nullptr) {
+        seen[item - items.data()]++;
+      }
+    }
+  }
+  done = true;
+  for (auto& t : thieves) {
+    t.join();
+  }
+  while (auto item = deque.pop()) {
+    seen[item - items.data()]++;
+  }
+  for (size_t i = 0; i < N; ++i) {
+    EXPECT_EQ(1, seen[i]) << "item " << i;
+  }
+}
+
+TEST(WorkQueueTest, runsOnThreadPool) {
+  ThreadPool pool(4, /* pin_threads */ false);
+  ThreadPool::set_instance(&pool);
+  for (int round = 0; round < 3; ++round) {
+    auto wq = workqueue_mapreduce<int, int>(
+        [](int a) {
+          EXPECT_TRUE(ThreadPool::on_pool_thread());
+          return a;
+        },
+        [](int a, int b) { return a + b; },
+        4);
+    for (int idx = 0; idx < NUM_INTS; ++idx) {
+      wq.add_item(idx);
+    }
+    EXPECT_EQ(NUM_INTS * (NUM_INTS - 1) / 2, wq.run_all());
+  }
+  ThreadPool::set_instance(nullptr);
+}
+
+// A WorkQueue started from inside a pool thread, or one that wants more
+// threads than the pool has, falls back to spawning its own.
+TEST(WorkQueueTest, threadPoolFallback) {
+  ThreadPool pool(2, /* pin_threads */ false);
+  ThreadPool::set_instance(&pool);
+  auto outer = workqueue_mapreduce<int, int>(
+      [](int a) {
+        auto inner = workqueue_mapreduce<int, int>(
+            [](int b) { return b; }, [](int x, int y) { return x + y; }, 2);
+        inner.add_item(a);
+        inner.add_item(a);
+        return inner.run_all();
+      },
+      [](int a, int b) { return a + b; },
+      2);
+  outer.add_item(1);
+  outer.add_item(2);
+  EXPECT_EQ(6, outer.run_all());
+
+  auto wide = workqueue_mapreduce<int, int>(
+      [](int a) {
+        EXPECT_FALSE(ThreadPool::on_pool_thread());
+        return a;
+      },
+      [](int a, int b) { return a + b; },
+      8);
+  wide.add_item(5);
+  EXPECT_EQ(5, wide.run_all());
+  ThreadPool::set_instance(nullptr);
+}
+
+TEST(WorkQueueTest, shuffledItemsAreAllConsumedOnce) {
+  auto order_of_items = [] {
+    std::vector<int> order;
+    auto wq = workqueue_foreach<int>([&](int a) { order.push_back(a); }, 1);
+    for (int idx = 0; idx < NUM_INTS; ++idx) {
+      wq.add_item(idx);
+    }
+    wq.run_all();
+    return order;
+  };
+  auto unshuffled = order_of_items();
+
+  set_workqueue_shuffle_seed(42);
+  auto shuffled = order_of_items();
+  EXPECT_NE(shuffled, unshuffled);
+  std::sort(shuffled.begin(), shuffled.end());
+  std::vector<int> expected(NUM_INTS);
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(shuffled, expected);
+
+  // The threads are fewer or as many as asked for.
+  std::atomic<int> array[NUM_INTS] = {};
+  auto wq = workqueue_mapreduce<int, size_t>(
+      [&](int a) {
+        array[a]++;
+        return 1;
+      },
+      [](size_t a, size_t b) { return a + b; },
+      4);
+  for (int idx = 0; idx < NUM_INTS; ++idx) {
+    wq.add_item(idx);
+  }
+  EXPECT_EQ(NUM_INTS, wq.run_all());
+  for (int idx = 0; idx < NUM_INTS; ++idx) {
+    ASSERT_EQ(1, array[idx]);
+  }
+  set_workqueue_shuffle_seed(0);
+
+  EXPECT_EQ(order_of_items(), unshuffled);
+}
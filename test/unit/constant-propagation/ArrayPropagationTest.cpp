@@ -47,13 +47,13 @@ TEST_F(ConstantPropagationTest, ConstantArrayOperations) {
     for (uint32_t i = 0; i < arr.length(); ++i) {
       EXPECT_EQ(arr.get(i), SignedConstantDomain(0));
     }
-    // Check that iterating over the bindings works too
-    size_t count = 0;
-    for (auto& pair : arr.bindings()) {
-      EXPECT_EQ(pair.second, SignedConstantDomain(0));
-      ++count;
-    }
-    EXPECT_EQ(count, 10);
+    // The zeros are all represented by the fill value
+    EXPECT_EQ(arr.num_explicit_elements(), 0);
+    arr.set(3, SignedConstantDomain(1));
+    EXPECT_EQ(arr.num_explicit_elements(), 1);
+    EXPECT_EQ(arr.get(3), SignedConstantDomain(1));
+    arr.set(3, SignedConstantDomain(0));
+    EXPECT_EQ(arr.num_explicit_elements(), 0);
   }
 
   {
@@ -75,6 +75,52 @@ TEST_F(ConstantPropagationTest, ConstantArrayOperations) {
     EXPECT_TRUE(arr1.join(arr2).is_top());
     EXPECT_TRUE(arr1.meet(arr2).is_bottom());
   }
+
+  {
+    // Elements are compared index by index, whatever the fill values are
+    ConstantArrayDomain<SignedConstantDomain> arr1(2);
+    arr1.set(0, SignedConstantDomain(1));
+    arr1.set(1, SignedConstantDomain(1));
+    ConstantArrayDomain<SignedConstantDomain> arr2(2);
+    arr2.set(1, SignedConstantDomain(1));
+    arr2.set(0, SignedConstantDomain(1));
+    EXPECT_TRUE(arr1.equals(arr2));
+    arr2.set(1, SignedConstantDomain(2));
+    auto joined = arr1.join(arr2);
+    EXPECT_EQ(joined.get(0), SignedConstantDomain(1));
+    EXPECT_EQ(joined.get(1), SignedConstantDomain(sign_domain::Interval::GTZ));
+    EXPECT_TRUE(arr1.leq(joined));
+    EXPECT_FALSE(joined.leq(arr1));
+    EXPECT_TRUE(arr1.meet(arr2).is_bottom());
+  }
+}
+
+TEST_F(ConstantPropagationTest, LargeConstantArrays) {
+  using Array = ConstantArrayDomain<SignedConstantDomain>;
+  // Creating and joining large arrays doesn't depend on their length
+  Array huge(1 << 30);
+  huge.set(12345, SignedConstantDomain(1));
+  auto joined = huge.join(Array(1 << 30));
+  EXPECT_EQ(joined.num_explicit_elements(), 1);
+  EXPECT_EQ(joined.get(0), SignedConstantDomain(0));
+  EXPECT_EQ(joined.get(12345),
+            SignedConstantDomain(sign_domain::Interval::GEZ));
+
+  // Arrays with too many explicit elements get summarized
+  auto summarized_before = Array::num_summarized();
+  Array table(2 * Array::kMaxExplicitElements);
+  for (uint32_t i = 0; i <= Array::kMaxExplicitElements; ++i) {
+    table.set(i, SignedConstantDomain(1));
+  }
+  EXPECT_EQ(Array::num_summarized(), summarized_before + 1);
+  EXPECT_EQ(table.num_explicit_elements(), 0);
+  EXPECT_EQ(table.length(), 2 * Array::kMaxExplicitElements);
+  EXPECT_EQ(table.get(0), SignedConstantDomain(sign_domain::Interval::GEZ));
+  EXPECT_EQ(table.get(2 * Array::kMaxExplicitElements - 1),
+            SignedConstantDomain(sign_domain::Interval::GEZ));
+  // Writes after the summary are still precise
+  table.set(0, SignedConstantDomain(5));
+  EXPECT_EQ(table.get(0), SignedConstantDomain(5));
 }
 
 using ArrayAnalyzer = InstructionAnalyzerCombiner<cp::LocalArrayAnalyzer,
@@ -9,8 +9,14 @@
 
 #include <gtest/gtest.h>
 
+#include <json/json.h>
+
+#include "ConfigFiles.h"
 #include "ConstantPropagationTestUtil.h"
+#include "Creators.h"
+#include "DexStore.h"
 #include "IRAssembler.h"
+#include "PassManager.h"
 
 TEST(ConstantPropagation, JumpToImmediateNext) {
   auto code = assembler::ircode_from_string(R"(
@@ -109,3 +115,57 @@ TEST(ConstantPropagation, WhiteBox2) {
             SignedConstantDomain(sign_domain::Interval::GEZ));
   EXPECT_EQ(exit_state.get<SignedConstantDomain>(1), SignedConstantDomain(0));
 }
+
+TEST_F(ConstantPropagationTest, unchangedMethodsAreSkipped) {
+  auto folded = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.folded:()V"
+     (
+      (const v0 0)
+      (if-eqz v0 :end)
+      (const v0 1)
+      (:end)
+      (return-void)
+     )
+    )
+  )");
+  auto unchanged = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.unchanged:(I)V"
+     (
+      (load-param v0)
+      (if-eqz v0 :end)
+      (const v0 1)
+      (:end)
+      (return-void)
+     )
+    )
+  )");
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(folded);
+  creator.add_method(unchanged);
+  DexStore store("classes");
+  store.add_classes({creator.create()});
+  std::vector<DexStore> stores;
+  stores.emplace_back(std::move(store));
+
+  ConstantPropagationPass pass;
+  Json::Value json;
+  json["redex"]["passes"].append("ConstantPropagationPass");
+  json["redex"]["passes"].append("ConstantPropagationPass");
+  json["redex"]["passes"].append("ConstantPropagationPass");
+  PassManager manager({&pass}, json);
+  ConfigFiles config(json);
+  manager.run_passes(stores, config);
+
+  const auto& infos = manager.get_pass_info();
+  ASSERT_EQ(infos.size(), 3);
+  auto metric = [&](size_t pass, const char* name) {
+    return infos[pass].metrics.at(name);
+  };
+  EXPECT_EQ(metric(0, "num_branch_propagated"), 1);
+  EXPECT_EQ(metric(0, "num_unchanged_methods_skipped"), 0);
+  // The first run changed `folded`, so the second one analyzes it again.
+  EXPECT_EQ(metric(1, "num_branch_propagated"), 0);
+  EXPECT_EQ(metric(1, "num_unchanged_methods_skipped"), 1);
+  EXPECT_EQ(metric(2, "num_unchanged_methods_skipped"), 2);
+}
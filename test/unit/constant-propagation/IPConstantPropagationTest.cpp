@@ -7,6 +7,7 @@
 
 #include "IPConstantPropagation.h"
 
+#include <boost/algorithm/string/replace.hpp>
 #include <gtest/gtest.h>
 
 #include "ConstantPropagationRuntimeAssert.h"
@@ -1295,3 +1296,91 @@ TEST_F(InterproceduralConstantPropagationTest, whiteBoxReturnValues) {
             SignedConstantDomain::bottom());
   EXPECT_EQ(wps.get_return_value(returns_constant), SignedConstantDomain(1));
 }
+
+TEST_F(InterproceduralConstantPropagationTest, parallelFixpoint) {
+  // Builds the same methods in a class of the given name, and returns their
+  // code once optimized.
+  auto optimize = [](const std::string& cls_name, bool parallel_fixpoint) {
+    auto with_class = [&](std::string str) {
+      boost::replace_all(str, "LFoo;", cls_name);
+      return str;
+    };
+    ClassCreator creator(DexType::make_type(cls_name.c_str()));
+    creator.set_super(get_object_type());
+    auto field = static_cast<DexField*>(
+        DexField::make_field(with_class("LFoo;.f:I").c_str()));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+    creator.add_field(field);
+
+    auto clinit = assembler::method_from_string(with_class(R"(
+      (method (public static) "LFoo;.<clinit>:()V"
+       (
+        (const v0 1)
+        (sput v0 "LFoo;.f:I")
+        (return-void)
+       )
+      )
+    )"));
+    clinit->rstate.set_root();
+    auto main = assembler::method_from_string(with_class(R"(
+      (method (public static) "LFoo;.main:()V"
+       (
+        (const v0 0)
+        (invoke-static (v0) "LFoo;.recurse:(I)V")
+        (sget "LFoo;.f:I")
+        (move-result-pseudo v1)
+        (invoke-static (v1) "LFoo;.use:(I)V")
+        (return-void)
+       )
+      )
+    )"));
+    main->rstate.set_root();
+    // Only ever called with 0, by main() and by itself.
+    auto recurse = assembler::method_from_string(with_class(R"(
+      (method (public static) "LFoo;.recurse:(I)V"
+       (
+        (load-param v0)
+        (if-nez v0 :done)
+        (invoke-static (v0) "LFoo;.recurse:(I)V")
+        (:done)
+        (return-void)
+       )
+      )
+    )"));
+    // Only ever called with Foo.f, which is 1 once the clinit is done.
+    auto use = assembler::method_from_string(with_class(R"(
+      (method (public static) "LFoo;.use:(I)V"
+       (
+        (load-param v0)
+        (if-eqz v0 :zero)
+        (const v0 5)
+        (:zero)
+        (return-void)
+       )
+      )
+    )"));
+    for (auto* method : {clinit, main, recurse, use}) {
+      creator.add_method(method);
+    }
+
+    Scope scope{creator.create()};
+    InterproceduralConstantPropagationPass::Config config;
+    config.max_heap_analysis_iterations = 2;
+    config.parallel_fixpoint = parallel_fixpoint;
+    InterproceduralConstantPropagationPass(config).run(scope);
+
+    std::vector<std::string> result;
+    for (auto* method : {recurse, use}) {
+      auto code = assembler::to_string(method->get_code());
+      boost::replace_all(code, cls_name, "LFoo;");
+      result.push_back(code);
+    }
+    return result;
+  };
+
+  auto sequential = optimize("LSequential;", false);
+  auto parallel = optimize("LParallel;", true);
+  EXPECT_EQ(parallel, sequential);
+  EXPECT_EQ(parallel[0].find("if-nez"), std::string::npos) << parallel[0];
+  EXPECT_EQ(parallel[1].find("if-eqz"), std::string::npos) << parallel[1];
+}
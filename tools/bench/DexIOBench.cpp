@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * Microbenchmarks of reading and writing dexes. Each dex is loaded without
+ * ballooning, ballooned, lowered, synced, and written back out, and each of
+ * these stages reports its throughput over the bytes of the dexes and how
+ * many allocations it made per class. With --insns-only, only the
+ * DexInstructions of the code items are decoded and encoded, which leaves
+ * out the classes, the IR and the layout of the output.
+ */
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <json/json.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ConfigFiles.h"
+#include "DexClass.h"
+#include "DexIdx.h"
+#include "DexInstruction.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
+#include "Walkers.h"
+
+namespace {
+
+std::atomic<uint64_t> s_num_allocations{0};
+std::atomic<uint64_t> s_allocated_bytes{0};
+
+void* counted_alloc(size_t size) {
+  s_num_allocations.fetch_add(1, std::memory_order_relaxed);
+  s_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+} // namespace
+
+// Every allocation of the benchmark goes through these, so that the stages
+// can report how many they made.
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return counted_alloc(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Arguments {
+  std::vector<std::string> dexes;
+  std::string output_dir;
+  size_t repeat{1};
+  bool insns_only{false};
+};
+
+Arguments parse_args(int argc, char* argv[]) {
+  namespace po = boost::program_options;
+  po::options_description desc(
+      "Benchmark loading, ballooning, syncing and writing dexes.\n"
+      "Usage: redex-io-bench [options] classes.dex...");
+  desc.add_options()("help,h", "produce help message");
+  desc.add_options()("output-dir,o", po::value<std::string>(),
+                     "where the dexes are written, a temporary directory "
+                     "by default");
+  desc.add_options()("repeat,r", po::value<size_t>()->default_value(1),
+                     "how many times to encode and decode the instructions "
+                     "with --insns-only");
+  desc.add_options()("insns-only",
+                     "only decode and encode the instructions of the code "
+                     "items");
+  desc.add_options()("dex", po::value<std::vector<std::string>>(),
+                     "dex file");
+  po::positional_options_description positional;
+  positional.add("dex", -1);
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv)
+                .options(desc)
+                .positional(positional)
+                .run(),
+            vm);
+  po::notify(vm);
+
+  if (vm.count("help") || !vm.count("dex")) {
+    desc.print(std::cout);
+    exit(vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  Arguments args;
+  args.dexes = vm["dex"].as<std::vector<std::string>>();
+  if (vm.count("output-dir")) {
+    args.output_dir = vm["output-dir"].as<std::string>();
+  }
+  args.repeat = vm["repeat"].as<size_t>();
+  args.insns_only = vm.count("insns-only") != 0;
+  return args;
+}
+
+/*
+ * Measures the time and the allocations of a stage, and prints them with the
+ * throughput over `bytes` once it is done.
+ */
+class Stage {
+ public:
+  explicit Stage(const std::string& name)
+      : m_name(name),
+        m_start(std::chrono::steady_clock::now()),
+        m_num_allocations(s_num_allocations.load()),
+        m_allocated_bytes(s_allocated_bytes.load()) {}
+
+  void report(uint64_t bytes, size_t num_classes) {
+    auto end = std::chrono::steady_clock::now();
+    auto allocations = s_num_allocations.load() - m_num_allocations;
+    auto allocated = s_allocated_bytes.load() - m_allocated_bytes;
+    double seconds = std::chrono::duration<double>(end - m_start).count();
+    double mb = bytes / (1024.0 * 1024.0);
+    printf("%-12s %10.3f %10.2f %10.2f %14llu %12.1f %12.1f\n",
+           m_name.c_str(), seconds, mb, seconds > 0 ? mb / seconds : 0.0,
+           (unsigned long long)allocations,
+           num_classes ? (double)allocations / num_classes : 0.0,
+           num_classes ? allocated / 1024.0 / num_classes : 0.0);
+  }
+
+  static void print_header() {
+    printf("%-12s %10s %10s %10s %14s %12s %12s\n", "stage", "seconds", "MB",
+           "MB/s", "allocations", "allocs/cls", "KB/cls");
+  }
+
+ private:
+  std::string m_name;
+  std::chrono::steady_clock::time_point m_start;
+  uint64_t m_num_allocations;
+  uint64_t m_allocated_bytes;
+};
+
+uint64_t file_size(const std::string& path) {
+  return boost::filesystem::file_size(path);
+}
+
+void bench_pipeline(const Arguments& args, const std::string& output_dir) {
+  uint64_t input_bytes = 0;
+  for (const auto& dex : args.dexes) {
+    input_bytes += file_size(dex);
+  }
+
+  DexStore store("classes");
+  {
+    Stage stage("load");
+    for (const auto& dex : args.dexes) {
+      store.add_classes(
+          load_classes_from_dex(dex.c_str(), /* balloon */ false));
+    }
+    size_t num_classes = 0;
+    for (const auto& classes : store.get_dexen()) {
+      num_classes += classes.size();
+    }
+    stage.report(input_bytes, num_classes);
+  }
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  auto scope = build_class_scope(stores);
+
+  {
+    Stage stage("balloon");
+    walk::parallel::methods(scope, [](DexMethod* m) {
+      if (m->get_dex_code() != nullptr) {
+        m->balloon();
+      }
+    });
+    stage.report(input_bytes, scope.size());
+  }
+  {
+    Stage stage("lower");
+    instruction_lowering::run(stores);
+    stage.report(input_bytes, scope.size());
+  }
+  {
+    // The write below syncs the methods again, after it has fixed up their
+    // jumbo strings, so the DexCode of this stage is thrown away.
+    Stage stage("sync");
+    walk::parallel::code(scope, [](DexMethod* m, IRCode& code) {
+      code.sync(m);
+    });
+    stage.report(input_bytes, scope.size());
+  }
+
+  Json::Value json_cfg;
+  ConfigFiles conf(json_cfg, output_dir);
+  RedexOptions redex_options;
+  auto& dexen = stores[0].get_dexen();
+  uint64_t output_bytes = 0;
+  Stage stage("write");
+  for (size_t i = 0; i < dexen.size(); ++i) {
+    auto path = output_dir + "/classes" + std::to_string(i) + ".dex";
+    write_classes_to_dex(redex_options, path, &dexen[i], nullptr, false, 0, i,
+                         conf, nullptr, nullptr, nullptr, nullptr,
+                         load_dex_magic_from_dex(args.dexes[i].c_str()));
+    output_bytes += file_size(path);
+  }
+  stage.report(output_bytes, scope.size());
+}
+
+/*
+ * The output index that gives each reference the index that it has in the
+ * dex of `idx`, so that instructions encode to what they were read from.
+ */
+std::unique_ptr<DexOutputIdx> make_output_idx(DexIdx* idx,
+                                              const dex_header* dh) {
+  auto strings = new dexstring_to_idx();
+  for (uint32_t i = 0; i < dh->string_ids_size; ++i) {
+    strings->emplace(idx->get_stringidx(i), i);
+  }
+  auto types = new dextype_to_idx();
+  for (uint32_t i = 0; i < dh->type_ids_size; ++i) {
+    types->emplace(idx->get_typeidx(i), i);
+  }
+  auto protos = new dexproto_to_idx();
+  for (uint32_t i = 0; i < dh->proto_ids_size; ++i) {
+    protos->emplace(idx->get_protoidx(i), i);
+  }
+  auto fields = new dexfield_to_idx();
+  for (uint32_t i = 0; i < dh->field_ids_size; ++i) {
+    fields->emplace(idx->get_fieldidx(i), i);
+  }
+  auto methods = new dexmethod_to_idx();
+  for (uint32_t i = 0; i < dh->method_ids_size; ++i) {
+    methods->emplace(idx->get_methodidx(i), i);
+  }
+  return std::make_unique<DexOutputIdx>(strings, types, protos, fields,
+                                        methods, nullptr);
+}
+
+void bench_insns(const Arguments& args) {
+  size_t num_classes = 0;
+  uint64_t code_bytes = 0;
+  double decode_seconds = 0;
+  double encode_seconds = 0;
+  uint64_t decode_allocations = 0;
+  uint64_t encode_allocations = 0;
+  for (const auto& dex : args.dexes) {
+    auto classes = load_classes_from_dex(dex.c_str(), /* balloon */ false);
+    num_classes += classes.size();
+    boost::iostreams::mapped_file file;
+    file.open(dex, boost::iostreams::mapped_file::readonly);
+    auto dh = reinterpret_cast<const dex_header*>(file.const_data());
+    DexIdx idx(dh);
+    auto dodx = make_output_idx(&idx, dh);
+
+    std::vector<DexCode*> codes;
+    walk::methods(classes, [&](DexMethod* m) {
+      if (m->get_dex_code() != nullptr) {
+        codes.push_back(m->get_dex_code());
+      }
+    });
+    std::vector<std::vector<uint16_t>> buffers(codes.size());
+    for (size_t i = 0; i < codes.size(); ++i) {
+      size_t size = 0;
+      for (auto insn : codes[i]->get_instructions()) {
+        size += insn->size();
+      }
+      buffers[i].resize(size);
+      code_bytes += size * sizeof(uint16_t) * args.repeat;
+    }
+
+    for (size_t r = 0; r < args.repeat; ++r) {
+      auto allocations = s_num_allocations.load();
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < codes.size(); ++i) {
+        uint16_t* out = buffers[i].data();
+        for (auto insn : codes[i]->get_instructions()) {
+          insn->encode(dodx.get(), out);
+        }
+      }
+      encode_seconds += std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      encode_allocations += s_num_allocations.load() - allocations;
+
+      allocations = s_num_allocations.load();
+      start = std::chrono::steady_clock::now();
+      for (const auto& buffer : buffers) {
+        const uint16_t* in = buffer.data();
+        const uint16_t* end = in + buffer.size();
+        while (in < end) {
+          delete DexInstruction::make_instruction(&idx, &in);
+        }
+      }
+      decode_seconds += std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      decode_allocations += s_num_allocations.load() - allocations;
+    }
+  }
+
+  double mb = code_bytes / (1024.0 * 1024.0);
+  auto print = [&](const char* name, double seconds, uint64_t allocations) {
+    printf("%-12s %10.3f %10.2f %10.2f %14llu %12.1f %12s\n", name, seconds,
+           mb, seconds > 0 ? mb / seconds : 0.0,
+           (unsigned long long)allocations,
+           num_classes ? (double)allocations / num_classes : 0.0, "-");
+  };
+  // Each decoded instruction is one allocation and its delete, which is
+  // what loading a dex does too.
+  print("decode", decode_seconds, decode_allocations);
+  print("encode", encode_seconds, encode_allocations);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto args = parse_args(argc, argv);
+  namespace fs = boost::filesystem;
+  g_redex = new RedexContext();
+
+  Stage::print_header();
+  if (args.insns_only) {
+    bench_insns(args);
+  } else {
+    auto output_dir = args.output_dir;
+    bool remove_output = output_dir.empty();
+    if (remove_output) {
+      output_dir = (fs::temp_directory_path() /
+                    fs::unique_path("redex-io-bench-%%%%%%"))
+                       .string();
+    }
+    fs::create_directories(fs::path(output_dir) / "meta");
+    bench_pipeline(args, output_dir);
+    if (remove_output) {
+      fs::remove_all(output_dir);
+    }
+  }
+
+  delete g_redex;
+  return 0;
+}
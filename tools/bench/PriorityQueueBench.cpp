@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * Microbenchmark of the MutablePriorityQueue storages, and of the
+ * IndexedPriorityQueue, on a workload shaped like the one of the
+ * CrossDexRefMinimizer: classes share references drawn from a skewed
+ * distribution, and whenever the front class is taken, every remaining class
+ * that shares a reference with it gets a new priority. As there, priorities
+ * are unique because their low 24 bits are the index of the class.
+ */
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#include "IndexedPriorityQueue.h"
+#include "MutablePriorityQueue.h"
+
+namespace po = boost::program_options;
+
+namespace {
+
+struct Workload {
+  std::vector<std::vector<uint32_t>> class_refs;
+  std::vector<std::vector<uint32_t>> ref_classes;
+};
+
+Workload make_workload(uint32_t num_classes,
+                       uint32_t num_refs,
+                       uint32_t refs_per_class,
+                       uint32_t seed) {
+  std::mt19937 gen(seed);
+  // A few references (e.g. of common framework types) are shared by many
+  // classes, most by only a few.
+  std::vector<double> weights(num_refs);
+  for (uint32_t ref = 0; ref < num_refs; ++ref) {
+    weights[ref] = 1.0 / (ref + 1);
+  }
+  std::discrete_distribution<uint32_t> pick_ref(weights.begin(),
+                                                weights.end());
+  Workload workload;
+  workload.class_refs.resize(num_classes);
+  workload.ref_classes.resize(num_refs);
+  for (uint32_t cls = 0; cls < num_classes; ++cls) {
+    std::unordered_set<uint32_t> refs;
+    while (refs.size() < refs_per_class) {
+      refs.insert(pick_ref(gen));
+    }
+    for (auto ref : refs) {
+      workload.class_refs[cls].push_back(ref);
+      workload.ref_classes[ref].push_back(cls);
+    }
+  }
+  return workload;
+}
+
+// Takes classes in priority order, and bumps the priority of the classes that
+// share a reference with each taken one. Returns the number of updates and
+// a checksum of the order, which all queues have to agree on.
+template <class Queue>
+std::pair<uint64_t, uint64_t> run(const Workload& workload, Queue& queue) {
+  uint32_t num_classes = workload.class_refs.size();
+  std::vector<uint64_t> primary(num_classes, 0);
+  auto priority = [&](uint32_t cls) {
+    return (primary[cls] << 24) | (0xFFFFFF - cls);
+  };
+  for (uint32_t cls = 0; cls < num_classes; ++cls) {
+    queue.insert(cls, priority(cls));
+  }
+  std::vector<bool> taken(num_classes, false);
+  std::vector<bool> ref_seen(workload.ref_classes.size(), false);
+  uint64_t updates = 0;
+  uint64_t checksum = 0;
+  while (!queue.empty()) {
+    uint32_t cls = queue.front();
+    queue.erase(cls);
+    taken[cls] = true;
+    checksum = checksum * 31 + cls;
+    for (auto ref : workload.class_refs[cls]) {
+      if (ref_seen[ref]) {
+        continue;
+      }
+      ref_seen[ref] = true;
+      for (auto other : workload.ref_classes[ref]) {
+        if (!taken[other]) {
+          ++primary[other];
+          queue.update_priority(other, priority(other));
+          ++updates;
+        }
+      }
+    }
+  }
+  return {updates, checksum};
+}
+
+template <class Queue>
+void bench(const char* name, const Workload& workload, size_t repeat) {
+  std::pair<uint64_t, uint64_t> result;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < repeat; ++i) {
+    Queue queue;
+    result = run(workload, queue);
+  }
+  std::chrono::duration<double> seconds =
+      std::chrono::steady_clock::now() - start;
+  printf("%-24s %10.3f %14llu %12.1f %18llx\n", name, seconds.count(),
+         (unsigned long long)result.first,
+         result.first * repeat / seconds.count() / 1e6,
+         (unsigned long long)result.second);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  po::options_description desc("Usage: redex-priority-queue-bench [options]");
+  desc.add_options()("help,h", "print this message");
+  desc.add_options()("classes", po::value<uint32_t>()->default_value(20000),
+                     "number of classes");
+  desc.add_options()("refs", po::value<uint32_t>()->default_value(50000),
+                     "number of distinct references");
+  desc.add_options()("refs-per-class",
+                     po::value<uint32_t>()->default_value(20),
+                     "number of references of each class");
+  desc.add_options()("repeat,r", po::value<size_t>()->default_value(3),
+                     "how many times to run each queue");
+  desc.add_options()("seed", po::value<uint32_t>()->default_value(42),
+                     "seed of the generated workload");
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+  if (vm.count("help")) {
+    desc.print(std::cout);
+    return 0;
+  }
+
+  auto workload = make_workload(
+      vm["classes"].as<uint32_t>(), vm["refs"].as<uint32_t>(),
+      vm["refs-per-class"].as<uint32_t>(), vm["seed"].as<uint32_t>());
+  auto repeat = vm["repeat"].as<size_t>();
+  printf("%-24s %10s %14s %12s %18s\n", "queue", "seconds", "updates",
+         "M updates/s", "order checksum");
+  bench<MutablePriorityQueue<uint32_t, uint64_t>>("ordered map", workload,
+                                                  repeat);
+  bench<MutablePriorityQueue<uint32_t, uint64_t, std::less<uint64_t>,
+                             MutablePriorityQueueStorage::DaryHeap>>(
+      "4-ary heap", workload, repeat);
+  bench<IndexedPriorityQueue<uint64_t>>("indexed binary heap", workload,
+                                        repeat);
+  return 0;
+}
@@ -0,0 +1,317 @@
+#!/usr/bin/env python
+
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""
+Runs a pass list over a set of apps at several thread counts, and reports
+how long each pass took, how much CPU it used, the peak RSS, and how well it
+scaled with the threads. The results can be stored as a baseline, and later
+runs compared against it.
+
+The apps come from a JSON manifest, see apps.json, where each app is either
+an APK checked in next to the manifest, or one to download:
+
+  {"apps": [
+    {"name": "redex-test", "apk": "../../test/instr/redex-test.apk"},
+    {"name": "big-app", "url": "https://...", "sha256": "..."}
+  ]}
+
+The per-pass numbers come from the metrics that PassManager records for each
+pass, and the thread counts are set through REDEX_NUM_THREADS.
+"""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.dirname(
+    os.path.realpath(__file__))))
+sys.path.insert(0, REPO_ROOT)
+
+from pyredex.utils import remove_comments  # noqa: E402
+
+try:
+    from urllib.request import urlopen
+except ImportError:
+    from urllib2 import urlopen
+
+
+def sha256_of(path):
+    digest = hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), b''):
+            digest.update(chunk)
+    return digest.hexdigest()
+
+
+def fetch_app(app, manifest_dir, cache_dir):
+    if 'apk' in app:
+        return os.path.join(manifest_dir, app['apk'])
+    path = os.path.join(cache_dir, app['sha256'] + '.apk')
+    if not os.path.isfile(path) or sha256_of(path) != app['sha256']:
+        print('Downloading %s' % app['url'])
+        if not os.path.isdir(cache_dir):
+            os.makedirs(cache_dir)
+        tmp = path + '.tmp'
+        with open(tmp, 'wb') as out:
+            shutil.copyfileobj(urlopen(app['url']), out)
+        if sha256_of(tmp) != app['sha256']:
+            os.remove(tmp)
+            raise Exception('%s does not have the sha256 of the manifest' %
+                            app['url'])
+        os.rename(tmp, path)
+    return path
+
+
+def load_config(path, passes):
+    with open(path) as f:
+        config = json.loads(remove_comments(f.readlines()))
+    if passes:
+        config.setdefault('redex', {})['passes'] = passes
+    return config
+
+
+def run_once(args, config, apk, num_threads):
+    """
+    Runs redex once, and returns the wall and CPU seconds and the peak RSS of
+    the whole run, and the numbers of each pass.
+    """
+    tmp = tempfile.mkdtemp(prefix='redex-bench-')
+    try:
+        config_path = os.path.join(tmp, 'bench.config')
+        with open(config_path, 'w') as f:
+            json.dump(config, f)
+        cmd = [sys.executable, os.path.join(REPO_ROOT, 'redex.py'),
+               '--redex-binary', args.redex_binary,
+               '-c', config_path,
+               '-o', os.path.join(tmp, 'out.apk')]
+        for jar in args.jarpaths:
+            cmd += ['-j', jar]
+        cmd.append(apk)
+        env = dict(os.environ, REDEX_NUM_THREADS=str(num_threads))
+        with open(os.path.join(tmp, 'redex.log'), 'w') as log:
+            start = time.time()
+            proc = subprocess.Popen(cmd, env=env, stdout=log,
+                                    stderr=subprocess.STDOUT)
+            # The usage of a child includes the children that it waited for,
+            # so this covers redex-all.
+            _, status, usage = os.wait4(proc.pid, 0)
+            wall = time.time() - start
+        if status != 0:
+            with open(os.path.join(tmp, 'redex.log')) as log:
+                sys.stderr.write(log.read())
+            raise Exception('redex failed on %s with %d threads' %
+                            (apk, num_threads))
+        with open(os.path.join(tmp, 'redex-stats.txt')) as f:
+            stats = json.load(f)['output_stats']
+    finally:
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    passes = {}
+    for name, memory in stats.get('pass_memory', {}).items():
+        metrics = stats.get('pass_stats', {}).get(name, {})
+        passes[name] = {
+            'wall_s': metrics.get('~timing~run~wall~ms~', 0) / 1000.0,
+            'cpu_s': metrics.get('~timing~run~cpu~ms~', 0) / 1000.0,
+            'peak_rss_kb': memory['run']['peak_rss_kb'],
+        }
+    total = {
+        'wall_s': wall,
+        'cpu_s': usage.ru_utime + usage.ru_stime,
+        # In kilobytes on Linux.
+        'peak_rss_kb': usage.ru_maxrss,
+    }
+    return total, passes
+
+
+def best_of(runs):
+    """
+    The fastest time and the lowest peak RSS over the repeated runs, which are
+    the least noisy.
+    """
+    return {key: min(run[key] for run in runs) for key in runs[0]}
+
+
+def bench_app(args, config, apk):
+    results = {}
+    for num_threads in args.threads:
+        totals = []
+        passes = {}
+        for _ in range(args.repeat):
+            total, run_passes = run_once(args, config, apk, num_threads)
+            totals.append(total)
+            for name, numbers in run_passes.items():
+                passes.setdefault(name, []).append(numbers)
+        results[str(num_threads)] = {
+            'total': best_of(totals),
+            'passes': {name: best_of(runs) for name, runs in passes.items()},
+        }
+    add_efficiency(results)
+    return results
+
+
+def add_efficiency(results):
+    """
+    The parallel efficiency at n threads is how much faster than with the
+    fewest threads it ran, over how many more threads it had: 1 when it
+    scales perfectly.
+    """
+    counts = sorted(int(n) for n in results)
+    fewest = counts[0]
+
+    def efficiency(base, numbers, n):
+        if numbers['wall_s'] <= 0:
+            return None
+        return (base['wall_s'] * fewest) / (numbers['wall_s'] * n)
+
+    base = results[str(fewest)]
+    for n in counts:
+        result = results[str(n)]
+        result['total']['efficiency'] = efficiency(
+            base['total'], result['total'], n)
+        for name, numbers in result['passes'].items():
+            if name in base['passes']:
+                numbers['efficiency'] = efficiency(
+                    base['passes'][name], numbers, n)
+
+
+def print_results(name, results):
+    print('== %s' % name)
+    print('%-40s %8s %10s %10s %12s %6s' %
+          ('pass', 'threads', 'wall (s)', 'cpu (s)', 'peak rss (mb)', 'eff'))
+    for n in sorted(results, key=int):
+        rows = [('(total)', results[n]['total'])]
+        rows += sorted(results[n]['passes'].items())
+        for pass_name, numbers in rows:
+            eff = numbers.get('efficiency')
+            print('%-40s %8s %10.2f %10.2f %12.1f %6s' %
+                  (pass_name, n, numbers['wall_s'], numbers['cpu_s'],
+                   numbers['peak_rss_kb'] / 1024.0,
+                   '-' if eff is None else '%.2f' % eff))
+
+
+def find_regressions(results, baseline, threshold, min_seconds):
+    regressions = []
+    for app, app_results in results.items():
+        for n, result in app_results.items():
+            base = baseline.get(app, {}).get(n)
+            if base is None:
+                continue
+            rows = [('(total)', result['total'], base['total'])]
+            rows += [(name, numbers, base['passes'][name])
+                     for name, numbers in result['passes'].items()
+                     if name in base['passes']]
+            for pass_name, numbers, base_numbers in rows:
+                for key in ['wall_s', 'cpu_s', 'peak_rss_kb']:
+                    old = base_numbers[key]
+                    new = numbers[key]
+                    # Short times are mostly noise.
+                    if key != 'peak_rss_kb' and old < min_seconds:
+                        continue
+                    if new > old * (1 + threshold):
+                        regressions.append(
+                            '%s, %s threads, %s: %s went from %.2f to %.2f' %
+                            (app, n, pass_name, key, old, new))
+    return regressions
+
+
+def parse_threads(value):
+    return [int(n) for n in value.split(',')]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--redex-binary', required=True,
+                        help='Path to redex-all')
+    parser.add_argument('--apps', required=True,
+                        help='JSON manifest of the apps to run on')
+    parser.add_argument('--config',
+                        default=os.path.join(REPO_ROOT, 'config',
+                                             'default.config'),
+                        help='The redex config to run')
+    parser.add_argument('--passes', default='',
+                        help='Comma-separated passes that replace the ones '
+                        'of the config')
+    parser.add_argument('-j', '--jarpath', dest='jarpaths', action='append',
+                        default=[], help='Library jars, as for redex.py')
+    parser.add_argument('--threads', type=parse_threads, default='1,4,16,64',
+                        help='Comma-separated thread counts')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='Runs per app and thread count, of which the '
+                        'best counts')
+    parser.add_argument('--cache-dir',
+                        default=os.path.join(os.path.expanduser('~'),
+                                             '.cache', 'redex-bench'),
+                        help='Where the downloaded apps are kept')
+    parser.add_argument('--output', default='',
+                        help='Where to write the results as JSON')
+    parser.add_argument('--baseline', default='',
+                        help='Results of an earlier run to compare against')
+    parser.add_argument('--update-baseline', action='store_true',
+                        help='Write the results to --baseline instead of '
+                        'comparing against it')
+    parser.add_argument('--threshold', type=float, default=0.1,
+                        help='How much worse than the baseline a number may '
+                        'get, as a fraction')
+    parser.add_argument('--min-seconds', type=float, default=0.5,
+                        help='Times below this in the baseline are not '
+                        'compared')
+    args = parser.parse_args()
+    if args.repeat < 1:
+        parser.error('--repeat has to be at least 1')
+    if args.update_baseline and not args.baseline:
+        parser.error('--update-baseline needs --baseline')
+
+    with open(args.apps) as f:
+        manifest = json.load(f)
+    manifest_dir = os.path.dirname(os.path.realpath(args.apps))
+    config = load_config(args.config,
+                         [p for p in args.passes.split(',') if p])
+
+    results = {}
+    for app in manifest['apps']:
+        apk = fetch_app(app, manifest_dir, args.cache_dir)
+        results[app['name']] = bench_app(args, config, apk)
+        print_results(app['name'], results[app['name']])
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+    if not args.baseline:
+        return 0
+    if args.update_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+        print('Wrote the baseline %s' % args.baseline)
+        return 0
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions = find_regressions(results, baseline, args.threshold,
+                                   args.min_seconds)
+    for regression in regressions:
+        print('REGRESSION: ' + regression)
+    if regressions:
+        return 1
+    print('No regressions beyond %d%% of %s' %
+          (args.threshold * 100, args.baseline))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -5,17 +5,42 @@
  * LICENSE file in the root directory of this source tree.
  */
 
-#include <boost/scope_exit.hpp>
+#include <algorithm>
+#include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "DexEncoding.h"
 #include "PositionMap.h"
 
-std::unique_ptr<PositionMap> read_map(const char* filename) {
+PositionMap::~PositionMap() {
+  if (m_mapping != nullptr) {
+    munmap(const_cast<uint8_t*>(m_mapping), m_mapping_size);
+  }
+}
+
+PositionItem PositionMap::position(size_t idx) const {
+  PositionItem item;
+  memcpy(&item, m_positions + idx * sizeof(PositionItem), sizeof(item));
+  return item;
+}
+
+std::string PositionMap::string(uint32_t id) const {
+  if (m_string_offsets == nullptr) {
+    return m_string_pool.at(id);
+  }
+  return std::string(m_string_data + m_string_offsets[id],
+                     m_string_offsets[id + 1] - m_string_offsets[id]);
+}
+
+namespace {
+
+const uint8_t* map_file(const char* filename, size_t* size) {
   int fd = open(filename, O_RDONLY);
   if (fd == -1) {
     std::cerr << "open failed for file (" << filename
@@ -26,58 +51,200 @@ std::unique_ptr<PositionMap> read_map(const char* filename) {
   if (fstat(fd, &buf)) {
     std::cerr << "Cannot fstat file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
+    close(fd);
     return nullptr;
   }
-  uint8_t* mapping = (uint8_t*)mmap(
-      nullptr, buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
-  uint32_t magic = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
+  void* mapping =
+      mmap(nullptr, buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+  close(fd);
   if (mapping == MAP_FAILED) {
     std::cerr << "mmap failed for file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  BOOST_SCOPE_EXIT_ALL(=, &buf) {
-    munmap(mapping, buf.st_size);
-  };
+  *size = buf.st_size;
+  return (const uint8_t*)mapping;
+}
+
+/*
+ * Checks the magic number and returns the version.
+ */
+boost::optional<uint32_t> read_header(const uint8_t*& p) {
+  uint32_t magic = *(uint32_t*)p;
+  p += sizeof(uint32_t);
   if (magic != 0xfaceb000) {
     std::cerr << "Magic number mismatch\n";
+    return boost::none;
+  }
+  uint32_t version = *(uint32_t*)p;
+  p += sizeof(uint32_t);
+  return version;
+}
+
+} // namespace
+
+std::unique_ptr<PositionMap> read_map(const char* filename) {
+  size_t size;
+  const uint8_t* mapping = map_file(filename, &size);
+  if (mapping == nullptr) {
     return nullptr;
   }
-  uint32_t version = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  if (version != 2) {
+  std::unique_ptr<PositionMap> map(new PositionMap());
+  map->m_mapping = mapping;
+  map->m_mapping_size = size;
+
+  const uint8_t* p = mapping;
+  auto version = read_header(p);
+  if (!version) {
+    return nullptr;
+  }
+  if (*version != 2 && *version != 3) {
     std::cerr << "Version mismatch\n";
     return nullptr;
   }
 
-  std::unique_ptr<PositionMap> map(new PositionMap());
-  std::vector<std::string> string_pool;
-  uint32_t spool_count = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  for (uint32_t i = 0; i < spool_count; ++i) {
-    uint32_t ssize = *(uint32_t*)mapping;
-    mapping += sizeof(uint32_t);
-    map->string_pool.emplace_back((const char*)mapping, ssize);
-    mapping += ssize;
-  }
-  uint32_t pos_count = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  map->positions.reset(new PositionItem[pos_count]);
-  map->positions_size = pos_count;
-  memcpy(map->positions.get(), mapping, pos_count * sizeof(PositionItem));
+  uint32_t spool_count = *(uint32_t*)p;
+  p += sizeof(uint32_t);
+  if (*version == 3) {
+    map->m_string_offsets = (const uint32_t*)p;
+    p += (spool_count + 1) * sizeof(uint32_t);
+    map->m_string_data = (const char*)p;
+    uint32_t string_data_size = map->m_string_offsets[spool_count];
+    p += (string_data_size + 3) & ~3u;
+  } else {
+    for (uint32_t i = 0; i < spool_count; ++i) {
+      uint32_t ssize = *(uint32_t*)p;
+      p += sizeof(uint32_t);
+      map->m_string_pool.emplace_back((const char*)p, ssize);
+      p += ssize;
+    }
+  }
+  uint32_t pos_count;
+  memcpy(&pos_count, p, sizeof(pos_count));
+  p += sizeof(uint32_t);
+  if (p + pos_count * sizeof(PositionItem) > mapping + size) {
+    std::cerr << "Truncated position map\n";
+    return nullptr;
+  }
+  map->m_positions = p;
+  map->m_positions_size = pos_count;
   return map;
 }
 
 std::vector<Position> get_stack(const PositionMap& map, int64_t idx) {
   std::vector<Position> stack;
-  while (idx >= 0 && (size_t)idx < map.positions_size) {
-    auto pi = map.positions[idx];
-    stack.push_back(Position(map.string_pool[pi.class_id],
-                             map.string_pool[pi.method_id],
-                             map.string_pool[pi.file_id],
+  while (idx >= 0 && (size_t)idx < map.positions_size()) {
+    auto pi = map.position(idx);
+    stack.push_back(Position(map.string(pi.class_id),
+                             map.string(pi.method_id),
+                             map.string(pi.file_id),
                              pi.line));
     idx = (int64_t)pi.parent - 1;
   }
   return stack;
 }
+
+DebugLineMap::~DebugLineMap() {
+  if (m_mapping != nullptr) {
+    munmap(const_cast<uint8_t*>(m_mapping), m_mapping_size);
+  }
+}
+
+DebugLineMap::IndexEntry DebugLineMap::index_entry(size_t i) const {
+  IndexEntry entry;
+  memcpy(&entry, m_index + i * sizeof(IndexEntry), sizeof(entry));
+  return entry;
+}
+
+boost::optional<uint32_t> DebugLineMap::find_line(uint64_t method_id,
+                                                  uint32_t offset) const {
+  size_t lo = 0;
+  size_t hi = m_num_methods;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index_entry(mid).method_id < method_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == m_num_methods || index_entry(lo).method_id != method_id) {
+    return boost::none;
+  }
+  auto entry = index_entry(lo);
+  const uint8_t* p = m_mapping + entry.table_offset;
+  boost::optional<uint32_t> result;
+  if (m_version == 1) {
+    // Skip the method id that starts each table.
+    p += sizeof(uint64_t);
+    size_t count = (entry.table_size - sizeof(uint64_t)) / 8;
+    for (size_t i = 0; i < count; ++i, p += 8) {
+      uint32_t entry_offset, line;
+      memcpy(&entry_offset, p, sizeof(entry_offset));
+      memcpy(&line, p + 4, sizeof(line));
+      if (entry_offset > offset && result) {
+        break;
+      }
+      result = line;
+      if (entry_offset > offset) {
+        break;
+      }
+    }
+    return result;
+  }
+  uint32_t entry_offset = 0;
+  uint32_t line = 0;
+  for (size_t i = 0; i < entry.table_size; ++i) {
+    entry_offset += read_uleb128(&p);
+    line += read_sleb128(&p);
+    if (entry_offset > offset && result) {
+      break;
+    }
+    result = line;
+    if (entry_offset > offset) {
+      break;
+    }
+  }
+  return result;
+}
+
+std::unique_ptr<DebugLineMap> read_debug_line_map(const char* filename) {
+  size_t size;
+  const uint8_t* mapping = map_file(filename, &size);
+  if (mapping == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<DebugLineMap> map(new DebugLineMap());
+  map->m_mapping = mapping;
+  map->m_mapping_size = size;
+
+  const uint8_t* p = mapping;
+  auto version = read_header(p);
+  if (!version) {
+    return nullptr;
+  }
+  if (*version != 1 && *version != 2) {
+    std::cerr << "Version mismatch\n";
+    return nullptr;
+  }
+  map->m_version = *version;
+  uint32_t num_methods = *(uint32_t*)p;
+  p += sizeof(uint32_t);
+  if (p + num_methods * sizeof(DebugLineMap::IndexEntry) > mapping + size) {
+    std::cerr << "Truncated debug line map\n";
+    return nullptr;
+  }
+  map->m_num_methods = num_methods;
+  map->m_index = p;
+  if (*version == 1) {
+    // Version 1 lists the methods in no particular order.
+    map->m_sorted_index.resize(num_methods);
+    memcpy(map->m_sorted_index.data(), p, num_methods * sizeof(DebugLineMap::IndexEntry));
+    std::sort(map->m_sorted_index.begin(), map->m_sorted_index.end(),
+              [](const DebugLineMap::IndexEntry& a, const DebugLineMap::IndexEntry& b) {
+                return a.method_id < b.method_id;
+              });
+    map->m_index = (const uint8_t*)map->m_sorted_index.data();
+  }
+  return map;
+}
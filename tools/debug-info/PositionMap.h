@@ -5,6 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#pragma once
+
+#include <boost/optional.hpp>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -29,11 +33,79 @@ struct Position {
       : cls(cls), method(method), filename(filename), line(line) {}
 };
 
-struct PositionMap {
-  std::vector<std::string> string_pool;
-  std::unique_ptr<PositionItem[]> positions;
-  size_t positions_size;
+/*
+ * A position map as written by RealPositionMapper, read through a mapping of
+ * the file. The positions are looked up in place. So are the strings of a
+ * version 3 map; those of a version 2 map have to be read up front, since
+ * finding one means walking all the ones before it.
+ */
+class PositionMap {
+ public:
+  ~PositionMap();
+
+  size_t positions_size() const { return m_positions_size; }
+  PositionItem position(size_t idx) const;
+  std::string string(uint32_t id) const;
+
+ private:
+  friend std::unique_ptr<PositionMap> read_map(const char* filename);
+
+  PositionMap() = default;
+
+  const uint8_t* m_mapping{nullptr};
+  size_t m_mapping_size{0};
+  // Version 2.
+  std::vector<std::string> m_string_pool;
+  // Version 3.
+  const uint32_t* m_string_offsets{nullptr};
+  const char* m_string_data{nullptr};
+  const uint8_t* m_positions{nullptr};
+  size_t m_positions_size{0};
 };
 
 std::unique_ptr<PositionMap> read_map(const char* filename);
 std::vector<Position> get_stack(const PositionMap& map, int64_t idx);
+
+/*
+ * A debug line map as written by redex-all for the no_positions and IODI
+ * debug info kinds: for each method id, which source line each bytecode
+ * offset maps to. Version 2 maps (compact_symbol_maps) are queried in place
+ * with a binary search over their sorted method index; version 1 maps get an
+ * index built when they are read.
+ */
+class DebugLineMap {
+ public:
+  ~DebugLineMap();
+
+  /*
+   * The line of the last entry at or before `offset` in the method's table,
+   * or of its first entry if there is none. Mirrors the Python symbolicator.
+   */
+  boost::optional<uint32_t> find_line(uint64_t method_id,
+                                      uint32_t offset) const;
+
+ private:
+  friend std::unique_ptr<DebugLineMap> read_debug_line_map(
+      const char* filename);
+
+  struct __attribute__((packed)) IndexEntry {
+    uint64_t method_id;
+    uint32_t table_offset;
+    // Number of entries in version 2, size of the table in bytes in
+    // version 1.
+    uint32_t table_size;
+  };
+
+  DebugLineMap() = default;
+  IndexEntry index_entry(size_t i) const;
+
+  const uint8_t* m_mapping{nullptr};
+  size_t m_mapping_size{0};
+  uint32_t m_version{0};
+  size_t m_num_methods{0};
+  const uint8_t* m_index{nullptr};
+  // Version 1 only: m_index points here, sorted by method id.
+  std::vector<IndexEntry> m_sorted_index;
+};
+
+std::unique_ptr<DebugLineMap> read_debug_line_map(const char* filename);
@@ -6,19 +6,224 @@
  */
 
 #include <boost/regex.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "PositionMap.h"
 
 boost::regex trace_regex(R"/(((\s+at\s+)[^(]*)\(:(\d+)\)\s?)/");
 
+namespace {
+
+void print_usage() {
+  std::cerr
+      << "Usage: cat trace | remap mapping_file\n"
+         "       remap --batch [--cache-size N] [--socket PATH] "
+         "name=mapping_file ...\n"
+         "\n"
+         "In batch mode, each input line is a map name and a trace line,\n"
+         "separated by a tab. An empty line ends a batch; the output of the\n"
+         "batch is flushed and followed by an empty line. With --socket, "
+         "the\n"
+         "same protocol is served over a unix domain socket, one connection\n"
+         "at a time, instead of over stdin.\n";
+}
+
+/*
+ * The stacks of the most recently looked up positions of all the maps.
+ */
+class StackCache {
+ public:
+  using Key = std::pair<size_t, int64_t>;
+
+  explicit StackCache(size_t capacity) : m_capacity(capacity) {}
+
+  const std::vector<Position>& get(size_t map_idx,
+                                   const PositionMap& map,
+                                   int64_t idx) {
+    Key key{map_idx, idx};
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      return it->second->second;
+    }
+    if (m_capacity > 0 && m_entries.size() >= m_capacity) {
+      m_entries.erase(m_lru.back().first);
+      m_lru.pop_back();
+    }
+    m_lru.emplace_front(key, get_stack(map, idx));
+    m_entries.emplace(key, m_lru.begin());
+    return m_lru.front().second;
+  }
+
+ private:
+  using Entry = std::pair<Key, std::vector<Position>>;
+
+  size_t m_capacity;
+  std::list<Entry> m_lru;
+  std::map<Key, std::list<Entry>::iterator> m_entries;
+};
+
+void print_stack(FILE* out,
+                 const std::string& prefix,
+                 const std::vector<Position>& stack) {
+  for (const auto& pos : stack) {
+    fprintf(out, "%s%s.%s(%s:%u)\n", prefix.c_str(), pos.cls.c_str(),
+            pos.method.c_str(), pos.filename.c_str(), pos.line);
+  }
+}
+
+struct BatchServer {
+  std::vector<std::unique_ptr<PositionMap>> maps;
+  std::unordered_map<std::string, size_t> map_idxs;
+  StackCache cache;
+
+  explicit BatchServer(size_t cache_size) : cache(cache_size) {}
+
+  void symbolicate(const std::string& request, FILE* out) {
+    auto tab = request.find('\t');
+    if (tab == std::string::npos) {
+      fprintf(out, "%s\n", request.c_str());
+      return;
+    }
+    auto map_it = map_idxs.find(request.substr(0, tab));
+    std::string line = request.substr(tab + 1);
+    boost::smatch matches;
+    if (map_it == map_idxs.end() ||
+        !boost::regex_match(line, matches, trace_regex)) {
+      fprintf(out, "%s\n", line.c_str());
+      return;
+    }
+    auto idx = std::stoll(matches[3]) - 1;
+    auto map_idx = map_it->second;
+    print_stack(out, matches[2], cache.get(map_idx, *maps[map_idx], idx));
+  }
+
+  void serve(FILE* in, FILE* out) {
+    char* buf = nullptr;
+    size_t buf_size = 0;
+    ssize_t len;
+    while ((len = getline(&buf, &buf_size, in)) != -1) {
+      std::string request(buf, len);
+      if (!request.empty() && request.back() == '\n') {
+        request.pop_back();
+      }
+      if (request.empty()) {
+        fprintf(out, "\n");
+        fflush(out);
+        continue;
+      }
+      symbolicate(request, out);
+    }
+    fflush(out);
+    free(buf);
+  }
+
+  int serve_socket(const char* path) {
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server == -1) {
+      std::cerr << "socket failed: " << strerror(errno) << std::endl;
+      return 1;
+    }
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+      std::cerr << "Socket path too long: " << path << std::endl;
+      return 1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(server, (sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(server, 16) == -1) {
+      std::cerr << "Cannot listen on " << path << ": " << strerror(errno)
+                << std::endl;
+      return 1;
+    }
+    while (true) {
+      int conn = accept(server, nullptr, nullptr);
+      if (conn == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "accept failed: " << strerror(errno) << std::endl;
+        return 1;
+      }
+      FILE* in = fdopen(conn, "r");
+      FILE* out = fdopen(dup(conn), "w");
+      serve(in, out);
+      fclose(out);
+      fclose(in);
+    }
+  }
+};
+
+int run_batch(int argc, char** argv) {
+  size_t cache_size = 1 << 20;
+  const char* socket_path = nullptr;
+  std::vector<std::pair<std::string, std::string>> map_files;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--cache-size" && i + 1 < argc) {
+      cache_size = std::stoull(argv[++i]);
+    } else if (arg == "--socket" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (arg.find('=') != std::string::npos) {
+      auto eq = arg.find('=');
+      map_files.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+  if (map_files.empty()) {
+    print_usage();
+    return 1;
+  }
+
+  BatchServer server(cache_size);
+  for (const auto& p : map_files) {
+    auto map = read_map(p.second.c_str());
+    if (map == nullptr) {
+      return 1;
+    }
+    server.map_idxs[p.first] = server.maps.size();
+    server.maps.push_back(std::move(map));
+  }
+  if (socket_path != nullptr) {
+    return server.serve_socket(socket_path);
+  }
+  server.serve(stdin, stdout);
+  return 0;
+}
+
+} // namespace
+
 int main(int argc, char** argv) {
   if (argc < 2) {
-    std::cerr << "Usage: cat trace | remap mapping_file\n";
+    print_usage();
     abort();
   }
+  if (strcmp(argv[1], "--batch") == 0) {
+    return run_batch(argc, argv);
+  }
   auto map = read_map(argv[1]);
+  if (map == nullptr) {
+    return 1;
+  }
   for (std::string line; std::getline(std::cin, line);) {
     boost::smatch matches;
     if (boost::regex_match(line, matches, trace_regex)) {
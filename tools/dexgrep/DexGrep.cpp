@@ -5,28 +5,179 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <getopt.h>
 #include <regex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "DexCommon.h"
 
 void print_usage() {
-  fprintf(stderr, "Usage: dexgrep <classname> <dexfile 1> <dexfile 2> ...\n");
+  fprintf(stderr,
+          "Usage: dexgrep [-l] [-n] [-F] [-j <jobs>] <classname> "
+          "<dexfile 1> <dexfile 2> ...\n"
+          "  -l  only print the names of dex files with matches\n"
+          "  -n  print the class def index of each match\n"
+          "  -F  match <classname> as a fixed string, not as a regex\n"
+          "  -j  number of dex files to search at the same time\n");
 }
 
+namespace {
+
+bool is_regex_special(char c) {
+  return strchr("\\^$.|?*+()[]{}", c) != nullptr;
+}
+
+bool is_fixed_string(const std::string& pattern) {
+  return std::none_of(pattern.begin(), pattern.end(), is_regex_special);
+}
+
+/*
+ * Returns the longest run of characters that every match of the regex has to
+ * contain, or an empty string if there is none we can be sure of. Only looks
+ * at the top level of the pattern, and gives up on alternations.
+ */
+std::string required_literal(const std::string& pattern) {
+  if (pattern.find('|') != std::string::npos) {
+    return "";
+  }
+  std::string best;
+  std::string run;
+  auto end_run = [&]() {
+    if (run.size() > best.size()) {
+      best = run;
+    }
+    run.clear();
+  };
+  size_t depth = 0;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    char c = pattern[i];
+    if (depth > 0) {
+      if (c == '\\') {
+        i++;
+      } else if (c == '(' || c == '[') {
+        depth++;
+      } else if (c == ')' || c == ']') {
+        depth--;
+      }
+      continue;
+    }
+    bool literal = false;
+    if (c == '\\' && i + 1 < pattern.size() &&
+        is_regex_special(pattern[i + 1])) {
+      c = pattern[++i];
+      literal = true;
+    } else if (!is_regex_special(c)) {
+      literal = true;
+    }
+    if (!literal) {
+      if (c == '(' || c == '[') {
+        depth++;
+      } else if (c == '\\') {
+        // A character class like \d or \w.
+        i++;
+      } else if (c == '?' || c == '*' || c == '{') {
+        // The last character of the run may not be there.
+        if (!run.empty()) {
+          run.pop_back();
+        }
+        if (c == '{') {
+          i = std::min(pattern.find('}', i), pattern.size());
+        }
+      }
+      end_run();
+      continue;
+    }
+    run.push_back(c);
+  }
+  end_run();
+  return best;
+}
+
+struct Matcher {
+  bool fixed_string;
+  std::string literal;
+  std::regex re;
+
+  explicit Matcher(const std::string& pattern, bool fixed)
+      : fixed_string(fixed || is_fixed_string(pattern)),
+        literal(fixed_string ? pattern : required_literal(pattern)) {
+    if (!fixed_string) {
+      re = std::regex(pattern, std::regex::nosubs | std::regex::optimize);
+    }
+  }
+
+  bool matches(const char* name) const {
+    // Most names don't contain the literal, and finding that out is much
+    // cheaper than running the regex on them.
+    if (!literal.empty() && strstr(name, literal.c_str()) == nullptr) {
+      return false;
+    }
+    return fixed_string || std::regex_search(name, re);
+  }
+};
+
+struct Match {
+  uint32_t class_def_idx;
+  const char* name;
+};
+
+std::vector<Match> grep_dex(const char* dexfile, const Matcher& matcher,
+                            bool first_only) {
+  std::vector<Match> matches;
+  ddump_data rd;
+  open_dex_file(dexfile, &rd);
+
+  auto size = rd.dexh->class_defs_size;
+  for (uint32_t j = 0; j < size; j++) {
+    dex_class_def* cls_def = rd.dex_class_defs + j;
+    char* name = dex_string_by_type_idx(&rd, cls_def->typeidx);
+    if (matcher.matches(name)) {
+      matches.push_back({j, name});
+      if (first_only) {
+        break;
+      }
+    }
+  }
+  return matches;
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
   bool files_only = false;
-  char c;
+  bool class_def_idxs = false;
+  bool fixed_string = false;
+  unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+  int c;
   static const struct option options[] = {
       {"files-without-match", no_argument, nullptr, 'l'},
+      {"class-def-index", no_argument, nullptr, 'n'},
+      {"fixed-strings", no_argument, nullptr, 'F'},
+      {"jobs", required_argument, nullptr, 'j'},
+      {nullptr, 0, nullptr, 0},
   };
-  while ((c = getopt_long(argc, argv, "hl", &options[0], nullptr)) != -1) {
+  while ((c = getopt_long(argc, argv, "hlnFj:", &options[0], nullptr)) !=
+         -1) {
     switch (c) {
     case 'l':
       files_only = true;
       break;
+    case 'n':
+      class_def_idxs = true;
+      break;
+    case 'F':
+      fixed_string = true;
+      break;
+    case 'j':
+      jobs = std::max(1, atoi(optarg));
+      break;
     case 'h':
       print_usage();
       return 0;
@@ -43,23 +194,40 @@ int main(int argc, char* argv[]) {
   }
 
   const char* search_str = argv[optind];
-  std::regex re(search_str);
-
-  for (int i = optind + 1; i < argc; ++i) {
-    const char* dexfile = argv[i];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
-
-    auto size = rd.dexh->class_defs_size;
-    for (uint32_t j = 0; j < size; j++) {
-      dex_class_def* cls_def = rd.dex_class_defs + j;
-      char* name = dex_string_by_type_idx(&rd, cls_def->typeidx);
-      if (std::regex_search(name, re)) {
-        if (files_only) {
-          printf("%s\n", dexfile);
-        } else {
-          printf("%s: %s\n", dexfile, name);
-        }
+  Matcher matcher(search_str, fixed_string);
+
+  // Each dex file is searched on its own, and the matches are printed in the
+  // order the files were given in once all of them are searched.
+  std::vector<const char*> dexfiles(argv + optind + 1, argv + argc);
+  std::vector<std::vector<Match>> matches(dexfiles.size());
+  std::atomic<size_t> next_file{0};
+  auto worker = [&]() {
+    for (size_t i = next_file++; i < dexfiles.size(); i = next_file++) {
+      matches[i] = grep_dex(dexfiles[i], matcher, files_only);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min<size_t>(jobs, dexfiles.size()); i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < dexfiles.size(); i++) {
+    const char* dexfile = dexfiles[i];
+    if (files_only) {
+      if (!matches[i].empty()) {
+        printf("%s\n", dexfile);
+      }
+      continue;
+    }
+    for (const auto& match : matches[i]) {
+      if (class_def_idxs) {
+        printf("%s:%u: %s\n", dexfile, match.class_def_idx, match.name);
+      } else {
+        printf("%s: %s\n", dexfile, match.name);
       }
     }
   }
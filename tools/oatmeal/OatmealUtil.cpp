@@ -6,9 +6,13 @@
  */
 
 #include "OatmealUtil.h"
+#include "mmap.h"
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 void write_buf(FileHandle& fh, ConstBuffer buf) {
   CHECK(fh.fwrite(buf.ptr, sizeof(char), buf.len) == buf.len);
@@ -26,6 +30,42 @@ size_t get_filesize(FileHandle& fh) {
   return dex_stat.st_size;
 }
 
+std::unique_ptr<MappedFile> map_file_read_only(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr,
+            "failed to open file %s %s\n",
+            filename.c_str(),
+            std::strerror(errno));
+    return nullptr;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1) {
+    fprintf(stderr,
+            "failed to stat file %s %s\n",
+            filename.c_str(),
+            std::strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  std::string error_msg;
+  std::unique_ptr<MappedFile> map(MappedFile::mmap_file(file_stat.st_size,
+                                                        PROT_READ,
+                                                        MAP_PRIVATE,
+                                                        fd,
+                                                        filename.c_str(),
+                                                        &error_msg));
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (map == nullptr) {
+    fprintf(stderr,
+            "failed to mmap file %s %s\n",
+            filename.c_str(),
+            error_msg.c_str());
+  }
+  return map;
+}
+
 void stream_file(FileHandle& in, FileHandle& out) {
   constexpr int kBufSize = 0x80000;
   std::unique_ptr<char[]> buf(new char[kBufSize]);
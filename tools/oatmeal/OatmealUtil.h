@@ -11,9 +11,12 @@
 #include "DexOpcodeDefs.h"
 #include "file-utils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -46,6 +49,27 @@
 
 #endif
 
+// Runs fn(i) for each i in [0, n), on as many threads as there are cores.
+template <typename L>
+static void parallel_for(size_t n, const L& fn) {
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      fn(i);
+    }
+  };
+  size_t num_threads = std::min<size_t>(
+      n, std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 template <typename T1, typename T2, typename L>
 static void foreach_pair(const T1& t1, const T2& t2, const L& fn) {
   CHECK(t1.size() == t2.size());
@@ -187,6 +211,12 @@ bool is_vdex_file(ConstBuffer buf);
 
 size_t get_filesize(FileHandle& fh);
 
+class MappedFile;
+
+// Maps all of the file read-only. Returns nullptr, after printing why, if
+// it can't be mapped.
+std::unique_ptr<MappedFile> map_file_read_only(const std::string& filename);
+
 std::string read_string(const uint8_t* dstr);
 
 inline uint32_t read_uleb128(char** _ptr) {
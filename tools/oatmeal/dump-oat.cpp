@@ -27,6 +27,7 @@
 #include "dex.h"
 #include "elf-writer.h"
 #include "memory-accounter.h"
+#include "mmap.h"
 #include "vdex.h"
 
 #include <algorithm>
@@ -1307,39 +1308,41 @@ OatClasses_124::OatClasses_124(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
                                ConstBuffer oat_buf,
                                ConstBuffer dex_buf) {
-  foreach_pair(dex_file_listing.dex_files(),
-               dex_files.headers(),
-               [&](const DexFileListing_079::DexFile_079& listing,
-                   const DexFileHeader& header) {
-
-                 auto classes_offset = listing.classes_offset;
-
-                 DexClasses dex_classes;
-                 dex_classes.dex_file = listing.location;
-
-                 DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
-
-                 // classes_offset points to an array of pointers (offsets) to
-                 // ClassInfo
-                 for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-                   ClassInfo info;
-                   uint32_t info_offset;
-                   cur_ma()->memcpyAndMark(
-                       &info_offset,
-                       oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-                       sizeof(uint32_t));
-                   cur_ma()->memcpyAndMark(&info,
-                                           oat_buf.slice(info_offset).ptr,
-                                           sizeof(ClassInfo));
-
-                   // TODO: Handle compiled classes. Need to read method bitmap
-                   // size, and method bitmap.
-                   dex_classes.class_info.push_back(info);
-                   dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-                 }
-                 classes_.push_back(dex_classes);
-               });
+  const auto& listings = dex_file_listing.dex_files();
+  const auto& headers = dex_files.headers();
+  CHECK(listings.size() == headers.size());
+  classes_.resize(listings.size());
+  // The class tables of the dex files are independent of each other.
+  parallel_for(listings.size(), [&](size_t d) {
+    const auto& listing = listings[d];
+    const auto& header = headers[d];
+    auto classes_offset = listing.classes_offset;
+
+    DexClasses& dex_classes = classes_[d];
+    dex_classes.dex_file = listing.location;
+    dex_classes.class_info.reserve(header.class_defs_size);
+    dex_classes.class_names.reserve(header.class_defs_size);
+
+    DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
+
+    // classes_offset points to an array of pointers (offsets) to ClassInfo
+    for (unsigned int i = 0; i < header.class_defs_size; i++) {
+
+      ClassInfo info;
+      uint32_t info_offset;
+      cur_ma()->memcpyAndMark(
+          &info_offset,
+          oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
+          sizeof(uint32_t));
+      cur_ma()->memcpyAndMark(
+          &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
+
+      // TODO: Handle compiled classes. Need to read method bitmap size, and
+      // method bitmap.
+      dex_classes.class_info.push_back(info);
+      dex_classes.class_names.push_back(id_bufs.get_class_name(i));
+    }
+  });
 }
 
 class OatClasses_064 : public OatClasses {
@@ -1363,42 +1366,44 @@ class OatClasses_064 : public OatClasses {
 OatClasses_079::OatClasses_079(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
                                ConstBuffer oat_buf) {
-  foreach_pair(
-      dex_file_listing.dex_files(),
-      dex_files.headers(),
-      [&](const DexFileListing_079::DexFile_079& listing,
-          const DexFileHeader& header) {
-
-        auto classes_offset = listing.classes_offset;
-
-        DexClasses dex_classes;
-        dex_classes.dex_file = listing.location;
-
-        DexIdBufs id_bufs(oat_buf, listing.file_offset, header);
-
-        // classes_offset points to an array of pointers (offsets) to
-        // ClassInfo
-        for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-          ClassInfo info;
-          uint32_t info_offset;
-          cur_ma()->memcpyAndMark(
-              &info_offset,
-              oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-              sizeof(uint32_t));
-          cur_ma()->memcpyAndMark(
-              &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
-
-          // TODO: Handle compiled classes. Need to read method bitmap size,
-          // and method bitmap.
-          CHECK(info.type == static_cast<uint16_t>(Type::kOatClassNoneCompiled),
-                "Parsing for compiled classes not implemented");
-
-          dex_classes.class_info.push_back(info);
-          dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-        }
-        classes_.push_back(dex_classes);
-      });
+  const auto& listings = dex_file_listing.dex_files();
+  const auto& headers = dex_files.headers();
+  CHECK(listings.size() == headers.size());
+  classes_.resize(listings.size());
+  // The class tables of the dex files are independent of each other.
+  parallel_for(listings.size(), [&](size_t d) {
+    const auto& listing = listings[d];
+    const auto& header = headers[d];
+    auto classes_offset = listing.classes_offset;
+
+    DexClasses& dex_classes = classes_[d];
+    dex_classes.dex_file = listing.location;
+    dex_classes.class_info.reserve(header.class_defs_size);
+    dex_classes.class_names.reserve(header.class_defs_size);
+
+    DexIdBufs id_bufs(oat_buf, listing.file_offset, header);
+
+    // classes_offset points to an array of pointers (offsets) to ClassInfo
+    for (unsigned int i = 0; i < header.class_defs_size; i++) {
+
+      ClassInfo info;
+      uint32_t info_offset;
+      cur_ma()->memcpyAndMark(
+          &info_offset,
+          oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
+          sizeof(uint32_t));
+      cur_ma()->memcpyAndMark(
+          &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
+
+      // TODO: Handle compiled classes. Need to read method bitmap size,
+      // and method bitmap.
+      CHECK(info.type == static_cast<uint16_t>(Type::kOatClassNoneCompiled),
+            "Parsing for compiled classes not implemented");
+
+      dex_classes.class_info.push_back(info);
+      dex_classes.class_names.push_back(id_bufs.get_class_name(i));
+    }
+  });
 }
 
 void OatClasses_079::print() {
@@ -2251,53 +2256,41 @@ class OatFile_124 : public OatFile {
     auto rest = buf.slice(header.size() + header.key_value_store_size);
     DexFileListingType dfl(header.dex_file_count, rest);
 
-    auto dex_file_name = dexes[0].filename;
-    auto dex_file = FileHandle(fopen(dex_file_name.c_str(), "r"));
-    if (dex_file.get() == nullptr) {
-      fprintf(stderr,
-              "failed to open dex file %s %s\n",
-              dex_file_name.c_str(),
-              std::strerror(errno));
-      return nullptr;
-    }
-
-    auto dex_file_size = get_filesize(dex_file);
-
-    // We don't run dumping during install on device, so it is allowed to
-    // consume lots of memory.
-    auto dex_file_contents = std::make_unique<char[]>(dex_file_size);
-    auto dexFileBytesRead =
-        fread(dex_file_contents.get(), 1, dex_file_size, dex_file.get());
-    if (dexFileBytesRead != dex_file_size) {
-      fprintf(stderr,
-              "Failed to read dex file %s (%zd)\n",
-              std::strerror(errno),
-              dexFileBytesRead);
+    // The dex files are read in place from a mapping of the vdex file,
+    // which the parsed oat file holds on to since it points into it.
+    auto dex_file_map = map_file_read_only(dexes[0].filename);
+    if (dex_file_map == nullptr) {
       return nullptr;
     }
 
-    ConstBuffer dex_file_buf{dex_file_contents.get(), dex_file_size};
+    ConstBuffer dex_file_buf{
+        reinterpret_cast<const char*>(dex_file_map->begin()),
+        dex_file_map->size()};
     cur_ma()->addBuffer(dex_file_buf);
     DexFiles dex_files(dfl, dex_file_buf);
 
     if (dex_files_only) {
-      return std::unique_ptr<OatFile>(new OatFileType(header,
-                                                      key_value_store,
-                                                      std::move(dfl),
-                                                      std::move(dex_files),
-                                                      oat_offset));
+      std::unique_ptr<OatFile> oat_file(new OatFileType(header,
+                                                        key_value_store,
+                                                        std::move(dfl),
+                                                        std::move(dex_files),
+                                                        oat_offset));
+      oat_file->hold_mapping(std::move(dex_file_map));
+      return oat_file;
     }
 
     LookupTables lookup_tables(dfl, dex_files, buf);
     OatClasses_124 oat_classes(dfl, dex_files, buf, dex_file_buf);
 
-    return std::unique_ptr<OatFile>(new OatFileType(header,
-                                                    key_value_store,
-                                                    std::move(dfl),
-                                                    std::move(dex_files),
-                                                    std::move(lookup_tables),
-                                                    std::move(oat_classes),
-                                                    oat_offset));
+    std::unique_ptr<OatFile> oat_file(new OatFileType(header,
+                                                      key_value_store,
+                                                      std::move(dfl),
+                                                      std::move(dex_files),
+                                                      std::move(lookup_tables),
+                                                      std::move(oat_classes),
+                                                      oat_offset));
+    oat_file->hold_mapping(std::move(dex_file_map));
+    return oat_file;
   }
 
   static std::unique_ptr<OatFile> parse(bool dex_files_only,
@@ -2624,6 +2617,10 @@ class OatFile_Bad : public OatFile {
 
 OatFile::~OatFile() = default;
 
+void OatFile::hold_mapping(std::unique_ptr<MappedFile> mapping) {
+  mappings_.push_back(std::move(mapping));
+}
+
 static std::unique_ptr<OatFile> parse_oatfile_impl(
     bool dex_files_only,
     ConstBuffer oatfile_buffer,
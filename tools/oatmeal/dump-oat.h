@@ -14,6 +14,8 @@
 #include <string>
 #include <vector>
 
+class MappedFile;
+
 constexpr uint32_t kOatMagicNum = 0x0a74616F;
 
 enum class OatVersion : uint32_t {
@@ -102,6 +104,10 @@ class OatFile {
   // Return the location of the art boot image, or null if there is none.
   virtual std::unique_ptr<std::string> get_art_image_loc() const = 0;
 
+  // Keeps a mapped file that the parsed oat file points into alive for as
+  // long as the oat file.
+  void hold_mapping(std::unique_ptr<MappedFile> mapping);
+
   static Status build(const std::vector<std::string>& oat_files,
                       const std::vector<DexInput>& dex_files,
                       const std::string& oat_version,
@@ -110,6 +116,9 @@ class OatFile {
                       const std::string& art_image_location,
                       bool samsung_mode,
                       const std::string& quick_data_location);
+
+ private:
+  std::vector<std::unique_ptr<MappedFile>> mappings_;
 };
 
 enum class InstructionSet {
@@ -15,6 +15,30 @@ from collections import namedtuple
 OffsetLine = namedtuple("OffsetLine", "offset line")
 
 
+def read_uleb128(mapping):
+    result = 0
+    shift = 0
+    while True:
+        byte = ord(mapping.read(1))
+        result |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return result
+
+
+def read_sleb128(mapping):
+    result = 0
+    shift = 0
+    while True:
+        byte = ord(mapping.read(1))
+        result |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            if byte & 0x40:
+                result -= 1 << shift
+            return result
+
+
 class DebugLineMap(object):
     def __init__(self, method_id_map):
         self.method_id_map = method_id_map
@@ -27,9 +51,11 @@ class DebugLineMap(object):
             if magic != 0xFACEB000:
                 raise Exception("Magic number mismatch")
             version = struct.unpack("<L", mapping.read(4))[0]
-            if version != 1:
+            if version not in [1, 2]:
                 raise Exception("Version mismatch")
             method_count = struct.unpack("<L", mapping.read(4))[0]
+            if version == 2:
+                return DebugLineMap.read_compact(mapping, method_count)
             method_data_struct = struct.Struct("<QLL")
             offset_line_struct = struct.Struct("<LL")
             method_datas = []
@@ -58,6 +84,31 @@ class DebugLineMap(object):
             )
             return DebugLineMap(method_id_map)
 
+    @staticmethod
+    def read_compact(mapping, method_count):
+        # Version 2 sorts the index by method id, and delta-encodes each table
+        # as (uleb128 offset delta, sleb128 line delta) pairs.
+        method_data_struct = struct.Struct("<QLL")
+        method_datas = []
+        for _ in range(method_count):
+            method_datas.append(method_data_struct.unpack(mapping.read(16)))
+        method_id_map = {}
+        for method_id, table_offset, count in method_datas:
+            mapping.seek(table_offset)
+            offset = 0
+            line = 0
+            line_mappings = []
+            for _ in range(count):
+                offset += read_uleb128(mapping)
+                line += read_sleb128(mapping)
+                line_mappings.append(OffsetLine(offset, line))
+            if line_mappings:
+                method_id_map[method_id] = line_mappings
+        logging.info(
+            "Unpacked " + str(len(method_id_map)) + " methods from debug line map"
+        )
+        return DebugLineMap(method_id_map)
+
     def find_line_number(self, method_id, line):
         method_id = int(method_id)
         line = int(line)
@@ -29,13 +29,24 @@ class PositionMap(object):
             if magic != 0xfaceb000:
                 raise Exception('Magic number mismatch')
             version = struct.unpack('<L', mapping.read(4))[0]
-            if version not in [1, 2]:
+            if version not in [1, 2, 3]:
                 raise Exception('Version mismatch')
             spool_count = struct.unpack('<L', mapping.read(4))[0]
             pmap = PositionMap()
-            for i in range(0, spool_count):
-                ssize = struct.unpack('<L', mapping.read(4))[0]
-                pmap.string_pool.append(mapping.read(ssize).decode('ascii'))
+            if version == 3:
+                # An offset table, then the string data padded to 4 bytes.
+                offsets = struct.unpack('<%dL' % (spool_count + 1),
+                                        mapping.read(4 * (spool_count + 1)))
+                data = mapping.read(offsets[-1])
+                mapping.read(-offsets[-1] % 4)
+                for i in range(0, spool_count):
+                    pmap.string_pool.append(
+                        data[offsets[i]:offsets[i + 1]].decode('ascii'))
+            else:
+                for i in range(0, spool_count):
+                    ssize = struct.unpack('<L', mapping.read(4))[0]
+                    pmap.string_pool.append(
+                        mapping.read(ssize).decode('ascii'))
             logging.info('Unpacked %d strings from line map', spool_count)
             pos_count = struct.unpack('<L', mapping.read(4))[0]
             # this is pretty slow; it would be much faster in C++ with memcpy
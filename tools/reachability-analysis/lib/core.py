@@ -114,10 +114,16 @@ class ReachableMethod(ReachableObject):
         return ret
 
 
+# The version of the graphs written by IndexedGraphWriter in
+# BinarySerialization.h.
+INDEXED_GRAPH_VERSION = 2
+
+
 class AbstractGraph(object):
     """
     This contains the deserialization counterpart to the graph serialization
-    code in BinarySerialization.h.
+    code in BinarySerialization.h. Both the adjacency list format of
+    GraphWriter and the indexed format of IndexedGraphWriter can be loaded.
     """
 
     def __init__(self):
@@ -129,6 +135,9 @@ class AbstractGraph(object):
     def read_node(self, mapping):
         raise NotImplementedError()
 
+    def make_node(self, kind, label):
+        raise NotImplementedError()
+
     def add_node(self, node):
         raise NotImplementedError()
 
@@ -143,13 +152,38 @@ class AbstractGraph(object):
         if magic != 0xFACEB000:
             raise Exception("Magic number mismatch")
         version = struct.unpack("<L", mapping.read(4))[0]
-        if version != self.expected_version():
+        if version not in (self.expected_version(), INDEXED_GRAPH_VERSION):
             raise Exception("Version mismatch")
+        return version
+
+    def load_indexed(self, mapping):
+        nodes_count, edges_count, strings_size = struct.unpack(
+            "<LLL", mapping.read(12)
+        )
+        node_table = mapping.read(12 * nodes_count)
+        edge_offsets = array.array("I")
+        edge_offsets.frombytes(mapping.read(4 * (nodes_count + 1)))
+        edges = array.array("I")
+        edges.frombytes(mapping.read(4 * edges_count))
+        strings = mapping.read(strings_size)
+
+        nodes = [None] * nodes_count
+        for i in range(nodes_count):
+            offset, size, kind = struct.unpack_from("<LLB", node_table, 12 * i)
+            label = strings[offset:offset + size].decode("ascii")
+            nodes[i] = self.make_node(kind, label)
+            self.add_node(nodes[i])
+
+        for i in range(nodes_count):
+            for target in edges[edge_offsets[i]:edge_offsets[i + 1]]:
+                self.add_edge(nodes[i], nodes[target])
 
     def load(self, fn):
         with open(fn) as f:
             mapping = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
-            self.read_header(mapping)
+            if self.read_header(mapping) == INDEXED_GRAPH_VERSION:
+                self.load_indexed(mapping)
+                return
             nodes_count = struct.unpack("<L", mapping.read(4))[0]
             nodes = [None] * nodes_count
             out_edges = [None] * nodes_count
@@ -180,6 +214,9 @@ class ReachabilityGraph(AbstractGraph):
         node_name = mapping.read(node_name_size).decode("ascii")
         return ReachableObject(node_type, node_name)
 
+    def make_node(self, kind, label):
+        return ReachableObject(kind, label)
+
     def add_node(self, node):
         self.nodes[(node.type, node.name)] = node
 
@@ -234,6 +271,9 @@ class MethodOverrideGraph(AbstractGraph):
         node_name = mapping.read(node_name_size).decode("ascii")
         return self.Node(node_name)
 
+    def make_node(self, kind, label):
+        return self.Node(label)
+
     def add_node(self, node):
         self.nodes[node.name] = node
 
@@ -38,7 +38,8 @@ std::unique_ptr<ReachableObjectGraph> generate_graph() {
 }
 
 int main(int argc, char** argv) {
-  always_assert(argc == 2);
+  // The second file, if any, gets the graph in the indexed format.
+  always_assert(argc == 2 || argc == 3);
   const auto* outfile = argv[1];
 
   g_redex = new RedexContext();
@@ -47,6 +48,10 @@ int main(int argc, char** argv) {
   std::ofstream os;
   os.open(outfile);
   dump_graph(os, *graph);
+  if (argc == 3) {
+    std::ofstream indexed_os(argv[2]);
+    dump_indexed_graph(indexed_os, *graph);
+  }
 
   delete g_redex;
 
@@ -15,7 +15,20 @@ class TestGraphDeserialization(unittest.TestCase):
         Check that we are able to recover the same graph serialized in
         ReachabilityGraphSerialization.cpp.
         """
-        graph_file = os.environ["REACHABILITY_GRAPH_FILE"]
+        self.check_reachability_graph(os.environ["REACHABILITY_GRAPH_FILE"])
+
+    @unittest.skipUnless(
+        "INDEXED_REACHABILITY_GRAPH_FILE" in os.environ,
+        "ReachabilityGraphSerialization.cpp was not given a second file",
+    )
+    def test_indexed_reachability_graph(self):
+        """
+        Check that the graph in the indexed format loads the same way.
+        """
+        self.check_reachability_graph(
+            os.environ["INDEXED_REACHABILITY_GRAPH_FILE"])
+
+    def check_reachability_graph(self, graph_file):
         graph = core.ReachabilityGraph()
         graph.load(graph_file)
 
@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BuildCache.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+
+#include "Debug.h"
+#include "DexHasher.h"
+#include "Sha1.h"
+#include "Trace.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+constexpr const char* FILES_DIR = "files";
+constexpr const char* STATS_FILE = "stats.json";
+
+class KeyBuilder {
+ public:
+  KeyBuilder() { sha1_init(&m_context); }
+
+  void add(const std::string& str) {
+    add_raw(str);
+    // Separate the fields so that ("ab", "c") and ("a", "bc") differ.
+    add_raw(std::string(1, '\0'));
+  }
+
+  void add_file_contents(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    always_assert_log(in, "Could not read %s", path.c_str());
+    char buf[1 << 16];
+    while (in) {
+      in.read(buf, sizeof(buf));
+      sha1_update(&m_context, reinterpret_cast<unsigned char*>(buf),
+                  in.gcount());
+    }
+    add_raw(std::string(1, '\0'));
+  }
+
+  // The contents of files named in the config matter, not where they live:
+  // the unpacked APK, for one, goes to a fresh temporary directory on every
+  // build.
+  void add_config(const Json::Value& value) {
+    if (value.isObject()) {
+      add("{");
+      for (const auto& name : value.getMemberNames()) {
+        add(name);
+        add_config(value[name]);
+      }
+      add("}");
+    } else if (value.isArray()) {
+      add("[");
+      for (const auto& elem : value) {
+        add_config(elem);
+      }
+      add("]");
+    } else if (value.isString()) {
+      const auto& str = value.asString();
+      boost::system::error_code ec;
+      if (!str.empty() && fs::is_regular_file(str, ec)) {
+        add("<file>");
+        add_file_contents(str);
+      } else if (!str.empty() && fs::is_directory(str, ec)) {
+        add("<dir>");
+      } else {
+        add(str);
+      }
+    } else {
+      add(value.toStyledString());
+    }
+  }
+
+  std::string digest() {
+    unsigned char digest[20];
+    sha1_final(digest, &m_context);
+    std::ostringstream ss;
+    for (auto byte : digest) {
+      ss << std::hex << std::setw(2) << std::setfill('0') << unsigned(byte);
+    }
+    return ss.str();
+  }
+
+ private:
+  void add_raw(const std::string& str) {
+    sha1_update(&m_context,
+                reinterpret_cast<const unsigned char*>(str.data()),
+                str.size());
+  }
+
+  Sha1Context m_context;
+};
+
+// Skips the cache directory itself so that one nested in the output
+// directory does not get copied into its own entries.
+void copy_tree(const fs::path& from,
+               const fs::path& to,
+               const fs::path& skip = fs::path()) {
+  fs::create_directories(to);
+  for (fs::recursive_directory_iterator it(from), end; it != end; ++it) {
+    const auto& path = it->path();
+    if (!skip.empty() && fs::equivalent(path, skip)) {
+      it.no_push();
+      continue;
+    }
+    auto target = to / fs::relative(path, from);
+    if (fs::is_directory(path)) {
+      fs::create_directories(target);
+    } else {
+      // Input dexes stay mapped for the whole run, so replace files instead
+      // of overwriting them in place.
+      auto tmp = target;
+      tmp += ".tmp";
+      fs::copy_file(path, tmp, fs::copy_option::overwrite_if_exists);
+      fs::rename(tmp, target);
+    }
+  }
+}
+
+} // namespace
+
+BuildCache::BuildCache(std::string cache_dir, size_t max_entries)
+    : m_cache_dir(std::move(cache_dir)), m_max_entries(max_entries) {
+  fs::create_directories(m_cache_dir);
+}
+
+std::string BuildCache::compute_key(
+    const Scope& input_scope,
+    const Json::Value& config,
+    const Json::Value& serialized_options,
+    const std::vector<std::string>& input_files) {
+  KeyBuilder key;
+  key.add("redex-build-cache-v1");
+
+  // A rebuilt redex-all must not reuse the output of the old one.
+  boost::system::error_code ec;
+  fs::path exe = fs::read_symlink("/proc/self/exe", ec);
+  if (!ec) {
+    key.add(exe.string());
+    key.add(std::to_string(fs::file_size(exe, ec)));
+    key.add(std::to_string(fs::last_write_time(exe, ec)));
+  }
+
+  auto hash = hashing::DexScopeHasher(input_scope).run();
+  key.add(hashing::hash_to_string(hash.registers_hash));
+  key.add(hashing::hash_to_string(hash.code_hash));
+  key.add(hashing::hash_to_string(hash.signature_hash));
+
+  // The layout cache is rewritten by every run, and does not change what the
+  // run produces.
+  Json::Value key_config = config;
+  if (key_config.isObject()) {
+    key_config.removeMember("layout_cache_file");
+  }
+  key.add_config(key_config);
+  key.add_config(serialized_options);
+  for (const auto& file : input_files) {
+    key.add_file_contents(file);
+  }
+  return key.digest();
+}
+
+bool BuildCache::restore(const std::string& key,
+                         const std::string& out_dir,
+                         Json::Value* stats) const {
+  auto entry = fs::path(m_cache_dir) / key;
+  if (!fs::is_directory(entry)) {
+    TRACE(MAIN, 1, "Build cache miss: %s", key.c_str());
+    return false;
+  }
+  TRACE(MAIN, 1, "Build cache hit: %s", key.c_str());
+  copy_tree(entry / FILES_DIR, out_dir);
+  std::ifstream stats_file((entry / STATS_FILE).string());
+  if (stats_file) {
+    stats_file >> *stats;
+  }
+  // Mark the entry as recently used.
+  fs::last_write_time(entry, std::time(nullptr));
+  return true;
+}
+
+void BuildCache::store(const std::string& key,
+                       const std::string& out_dir,
+                       const std::string& stats_path) const {
+  auto entry = fs::path(m_cache_dir) / key;
+  if (fs::exists(entry)) {
+    return;
+  }
+  // Fill in a private directory and rename it into place, so that concurrent
+  // builds never see a partial entry.
+  auto tmp = fs::path(m_cache_dir) /
+             (key + ".tmp." + std::to_string(getpid()));
+  fs::remove_all(tmp);
+  copy_tree(out_dir, tmp / FILES_DIR, m_cache_dir);
+  if (fs::exists(stats_path)) {
+    fs::copy_file(stats_path, tmp / STATS_FILE,
+                  fs::copy_option::overwrite_if_exists);
+  }
+  boost::system::error_code ec;
+  fs::rename(tmp, entry, ec);
+  if (ec) {
+    // Another build stored the same entry first.
+    fs::remove_all(tmp);
+  }
+  evict();
+}
+
+void BuildCache::evict() const {
+  std::vector<std::pair<std::time_t, fs::path>> entries;
+  for (fs::directory_iterator it(m_cache_dir), end; it != end; ++it) {
+    const auto& path = it->path();
+    if (fs::is_directory(path) &&
+        path.filename().string().find(".tmp.") == std::string::npos) {
+      entries.emplace_back(fs::last_write_time(path), path);
+    }
+  }
+  if (entries.size() <= m_max_entries) {
+    return;
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+  for (size_t i = m_max_entries; i < entries.size(); ++i) {
+    TRACE(MAIN, 2, "Evicting build cache entry %s",
+          entries[i].second.string().c_str());
+    fs::remove_all(entries[i].second);
+  }
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <json/json.h>
+#include <string>
+#include <vector>
+
+#include "DexClass.h"
+
+/**
+ * An on-disk cache of whole redex-all runs, for developers who rebuild the
+ * same app over and over.
+ *
+ * An entry is keyed by the DexScopeHasher hashes of the loaded input scope,
+ * the full JSON config (which includes the pass list and every pass's
+ * options), the RedexOptions, the contents of the ProGuard configs and
+ * library jars, and the identity of the redex-all binary. It holds a copy of
+ * everything redex-all left in its output directory, meta files and stats
+ * included. On a hit, redex-all copies the entry back and skips the passes
+ * and the backend altogether.
+ *
+ * Only the output directory is cached: a run whose passes rewrite files in
+ * the unpacked APK directory must not use the cache.
+ */
+class BuildCache {
+ public:
+  BuildCache(std::string cache_dir, size_t max_entries);
+
+  static std::string compute_key(const Scope& input_scope,
+                                 const Json::Value& config,
+                                 const Json::Value& serialized_options,
+                                 const std::vector<std::string>& input_files);
+
+  /*
+   * Copies the entry for `key` into `out_dir` and loads the stats it was
+   * stored with. Returns false on a miss.
+   */
+  bool restore(const std::string& key,
+               const std::string& out_dir,
+               Json::Value* stats) const;
+
+  /*
+   * Copies the contents of `out_dir` into the entry for `key`, then evicts the
+   * least recently used entries beyond `max_entries`. `stats_path` is the
+   * stats file inside `out_dir` that restore() should load.
+   */
+  void store(const std::string& key,
+             const std::string& out_dir,
+             const std::string& stats_path) const;
+
+ private:
+  void evict() const;
+
+  std::string m_cache_dir;
+  size_t m_max_entries;
+};
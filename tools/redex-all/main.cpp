@@ -31,6 +31,8 @@
 #include <boost/program_options.hpp>
 #include <json/json.h>
 
+#include "BinarySerialization.h"
+#include "BuildCache.h"
 #include "CommentFilter.h"
 #include "Debug.h"
 #include "DexClass.h"
@@ -44,16 +46,20 @@
 #include "NoOptimizationsMatcher.h"
 #include "OptData.h"
 #include "PassRegistry.h"
+#include "Profiler.h"
+#include "ProguardConfigCache.h"
 #include "ProguardConfiguration.h" // New ProGuard configuration
 #include "ProguardMatcher.h"
 #include "ProguardParser.h" // New ProGuard Parser
 #include "ReachableClasses.h"
 #include "RedexContext.h"
 #include "RedexResources.h"
+#include "TaskGraph.h"
 #include "Timer.h"
 #include "ToolsCommon.h"
 #include "Walkers.h"
 #include "Warning.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -61,7 +67,10 @@ namespace {
 constexpr const char* LINE_NUMBER_MAP = "redex-line-number-map-v2";
 constexpr const char* DEBUG_LINE_MAP = "redex-debug-line-map-v2";
 constexpr const char* IODI_METADATA = "iodi-metadata";
+// Not a metafile: it sits next to the dexes, for the class loaders.
+constexpr const char* LOCATOR_HASH_INDEX = "locator-index.bin";
 constexpr const char* OPT_DECISIONS = "redex-opt-decisions.json";
+constexpr const char* OPT_DECISIONS_BINARY = "redex-opt-decisions.bin";
 constexpr const char* CLASS_METHOD_INFO_MAP = "redex-class-method-info-map.txt";
 
 const std::string k_usage_header = "usage: redex-all [options...] dex-files...";
@@ -82,6 +91,9 @@ struct Arguments {
   Json::Value entry_data;
   boost::optional<int> stop_pass_idx;
   std::string output_ir_dir;
+  std::string build_cache_dir;
+  uint64_t shuffle_work_seed{0};
+  std::string reference_stats;
   RedexOptions redex_options;
 };
 
@@ -263,6 +275,37 @@ Arguments parse_args(int argc, char* argv[]) {
                    po::bool_switch(&args.redex_options.instrument_pass_enabled)
                        ->default_value(false),
                    "If specified, enables InstrumentPass if any.\n");
+  od.add_options()(
+      "thread-pool-size",
+      po::value<uint32_t>(&args.redex_options.thread_pool_size)
+          ->default_value(0),
+      "Number of threads in the pool shared by all parallel work; 0 means "
+      "one per hardware thread.\n");
+  od.add_options()(
+      "pin-pool-threads",
+      po::bool_switch(&args.redex_options.pin_pool_threads)
+          ->default_value(false),
+      "If specified, pins each thread-pool thread to a CPU.\n");
+  od.add_options()(
+      "build-cache-dir",
+      po::value<std::string>(&args.build_cache_dir),
+      "Directory of cached builds. A build whose inputs, config and redex "
+      "binary match a cached one restores its output instead of running the "
+      "passes.\n");
+  od.add_options()(
+      "shuffle-work-seed",
+      po::value<uint64_t>(&args.shuffle_work_seed)->default_value(0),
+      "If nonzero, every WorkQueue runs with a random number of threads and "
+      "hands out its work in a random order, seeded with this. Use with "
+      "--reference-stats to check that the output doesn't depend on the "
+      "thread scheduling.\n");
+  od.add_options()(
+      "reference-stats",
+      po::value<std::string>(&args.reference_stats),
+      "redex-stats of an earlier run with the same inputs and config, e.g. "
+      "with REDEX_NUM_THREADS=1. The pass hashes of this run are compared to "
+      "it, and the first pass after which they differ is reported as an "
+      "error.\n");
   od.add_options()(",S",
                    po::value<std::vector<std::string>>(), // Accumulation
                    "-Skey=string\n"
@@ -476,6 +519,9 @@ Arguments parse_args(int argc, char* argv[]) {
       std::cerr << "Invalid stop_pass value\n";
       exit(EXIT_FAILURE);
     }
+    // Let redex-opt --resume pick the pipeline up where this run stops.
+    args.entry_data["stop_pass_idx"] = idx;
+    args.entry_data["passes"] = passes_list;
     if (passes_list.size() > (size_t)idx) {
       passes_list.resize(idx);
     }
@@ -532,6 +578,11 @@ Json::Value get_stats(const dex_stats_t& stats) {
 
   val["map_list_num_strings"] = stats.map_list_num_strings;
   val["map_list_strings_bytes"] = stats.map_list_strings_bytes;
+
+  val["num_startup_code_pages"] = stats.num_startup_code_pages;
+  val["num_startup_string_pages"] = stats.num_startup_string_pages;
+  val["num_startup_class_data_pages"] = stats.num_startup_class_data_pages;
+  val["num_startup_pages"] = stats.num_startup_pages;
   return val;
 }
 
@@ -573,10 +624,76 @@ Json::Value get_pass_hashes(const PassManager& mgr) {
   return all;
 }
 
+// The first of "(initial)" and the passes, in the order they ran, after which
+// the scope hash differs from the one in `reference`, the "pass_hashes" of an
+// earlier run. None if they all agree.
+boost::optional<std::string> find_first_diverging_pass(
+    const PassManager& mgr, const Json::Value& reference) {
+  auto hashes = get_pass_hashes(mgr);
+  std::vector<std::string> names{"(initial)"};
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    names.push_back(pass_info.name);
+  }
+  for (const auto& name : names) {
+    for (const char* kind : {"-registers", "-code", "-signature"}) {
+      auto key = name + kind;
+      if (hashes.isMember(key) && hashes[key] != reference[key]) {
+        return name;
+      }
+    }
+  }
+  return boost::none;
+}
+
+Json::Value get_memory_stats(const PassManager::MemoryStats& stats) {
+  Json::Value val;
+  val["peak_rss_kb"] = Json::UInt64(stats.peak_rss_after);
+  val["peak_rss_delta_kb"] =
+      Json::UInt64(stats.peak_rss_after - stats.peak_rss_before);
+  val["rss_kb"] = Json::UInt64(stats.rss_after);
+  val["allocated_kb"] = Json::UInt64(stats.allocated_after);
+  val["allocated_delta_kb"] = Json::Int64(int64_t(stats.allocated_after) -
+                                          int64_t(stats.allocated_before));
+  return val;
+}
+
+Json::Value get_pass_memory(const PassManager& mgr) {
+  Json::Value all(Json::ValueType::objectValue);
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    Json::Value pass;
+    pass["eval"] = get_memory_stats(pass_info.eval_memory);
+    pass["run"] = get_memory_stats(pass_info.run_memory);
+    all[pass_info.name] = pass;
+  }
+  return all;
+}
+
+// The slowest methods of each pass that timed any, see "method_timings".
+Json::Value get_pass_slowest_methods(const PassManager& mgr) {
+  Json::Value all(Json::ValueType::objectValue);
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    if (pass_info.slowest_methods.empty()) {
+      continue;
+    }
+    Json::Value methods(Json::arrayValue);
+    for (const auto& timing : pass_info.slowest_methods) {
+      Json::Value method;
+      method["method"] = timing.method;
+      method["ms"] = std::round(timing.seconds * 10000) / 10.0;
+      method["num_insns"] = Json::UInt64(timing.num_insns);
+      methods.append(method);
+    }
+    all[pass_info.name] = methods;
+  }
+  return all;
+}
+
 Json::Value get_lowering_stats(const instruction_lowering::Stats& stats) {
   Json::Value obj(Json::ValueType::objectValue);
   obj["num_2addr_instructions"] = Json::UInt(stats.to_2addr);
   obj["num_move_added_for_check_cast"] = Json::UInt(stats.move_for_check_cast);
+  obj["num_profile_guided_layouts"] = Json::UInt(stats.profile_guided_layouts);
+  obj["num_block_heat_mismatches"] = Json::UInt(stats.block_heat_mismatches);
   return obj;
 }
 
@@ -617,6 +734,8 @@ Json::Value get_output_stats(
   d["dexes_stats"] = get_detailed_stats(dexes_stats);
   d["pass_stats"] = get_pass_stats(mgr);
   d["pass_hashes"] = get_pass_hashes(mgr);
+  d["pass_memory"] = get_pass_memory(mgr);
+  d["pass_slowest_methods"] = get_pass_slowest_methods(mgr);
   d["lowering_stats"] = get_lowering_stats(instruction_lowering_stats);
   return d;
 }
@@ -688,6 +807,85 @@ void write_debug_line_mapping(
   ofs << line_out.str();
 }
 
+/*
+ * Same data as write_debug_line_mapping(), in a form that a reader can query
+ * straight from a mapping of the file:
+ *
+ * magic number 0xfaceb000 (4 byte)
+ * version number 2 (4 byte)
+ * number (m) of methods that has debug line info (4 byte)
+ * a list (m elements), sorted by method-id, of:
+ *   [ encoded method-id (8 byte), byte offset of the method's line table
+ *     from the start of the file (4 byte), number of entries (4 byte) ]
+ * the line tables, each a list of:
+ *   [ memory offset delta (uleb128), line number delta (sleb128) ]
+ *
+ * The deltas are from the previous entry of the same table, starting from an
+ * offset and line of 0, and the entries are sorted by memory offset.
+ */
+void write_compact_debug_line_mapping(
+    const std::string& debug_line_map_filename,
+    const std::unordered_map<DexMethod*, uint64_t>& method_to_id,
+    const std::unordered_map<DexCode*, std::vector<DebugLineItem>>&
+        code_debug_lines,
+    DexStoresVector& stores) {
+  struct MethodLines {
+    uint64_t method_id;
+    const std::vector<DebugLineItem>* lines;
+  };
+  std::vector<MethodLines> methods;
+  auto scope = build_class_scope(stores);
+  walk::methods(scope, [&](DexMethod* method) {
+    auto dex_code = method->get_dex_code();
+    if (dex_code == nullptr) {
+      return;
+    }
+    auto it = code_debug_lines.find(dex_code);
+    if (it != code_debug_lines.end()) {
+      methods.push_back(MethodLines{method_to_id.at(method), &it->second});
+    }
+  });
+  std::sort(methods.begin(), methods.end(),
+            [](const MethodLines& a, const MethodLines& b) {
+              return a.method_id < b.method_id;
+            });
+
+  std::string tables;
+  std::vector<uint32_t> table_offsets;
+  uint32_t tables_start =
+      3 * sizeof(uint32_t) +
+      methods.size() * (sizeof(uint64_t) + 2 * sizeof(uint32_t));
+  for (const auto& method : methods) {
+    table_offsets.push_back(tables_start + tables.size());
+    auto lines = *method.lines;
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const DebugLineItem& a, const DebugLineItem& b) {
+                       return a.offset < b.offset;
+                     });
+    uint32_t prev_offset = 0;
+    uint32_t prev_line = 0;
+    for (const auto& item : lines) {
+      uint8_t buf[10];
+      uint8_t* end = write_uleb128(buf, item.offset - prev_offset);
+      end = write_sleb128(end, int32_t(item.line - prev_line));
+      tables.append((const char*)buf, end - buf);
+      prev_offset = item.offset;
+      prev_line = item.line;
+    }
+  }
+
+  std::ofstream ofs(debug_line_map_filename.c_str(),
+                    std::ofstream::out | std::ofstream::trunc);
+  binary_serialization::write_header(ofs, /* version */ 2);
+  binary_serialization::write<uint32_t>(ofs, methods.size());
+  for (size_t i = 0; i < methods.size(); ++i) {
+    binary_serialization::write<uint64_t>(ofs, methods[i].method_id);
+    binary_serialization::write<uint32_t>(ofs, table_offsets[i]);
+    binary_serialization::write<uint32_t>(ofs, methods[i].lines->size());
+  }
+  ofs << tables;
+}
+
 const std::string get_dex_magic(std::vector<std::string>& dex_files) {
   always_assert_log(dex_files.size() > 0, "APK contains no dex file\n");
   // Get dex magic from the first dex file since all dex magic
@@ -702,6 +900,17 @@ static void assert_dex_magic_consistency(const std::string& source,
                     source.c_str(), target.c_str());
 }
 
+/*
+ * An input dex as it was loaded, so that reuse_unchanged_dexes can copy it
+ * to the output if its classes come out of the passes untouched.
+ */
+struct InputDex {
+  std::string path;
+  DexClasses classes;
+  dex_stats_t stats;
+  size_t hash{0};
+};
+
 /**
  * Pre processing steps: load dex and configurations
  */
@@ -709,147 +918,279 @@ void redex_frontend(ConfigFiles& conf, /* input */
                     Arguments& args, /* inout */
                     redex::ProguardConfiguration& pg_config,
                     DexStoresVector& stores,
+                    std::vector<InputDex>& input_dexes,
                     Json::Value& stats) {
   Timer redex_frontend_timer("Redex_frontend");
-  for (const auto& pg_config_path : args.proguard_config_paths) {
-    Timer time_pg_parsing("Parsed ProGuard config file");
-    redex::proguard_parser::parse_file(pg_config_path, &pg_config);
-  }
-
-  const auto& pg_libs = pg_config.libraryjars;
-  args.jar_paths.insert(pg_libs.begin(), pg_libs.end());
-
-  std::set<std::string> library_jars;
-  for (const auto& jar_path : args.jar_paths) {
-    std::istringstream jar_stream(jar_path);
-    std::string dependent_jar_path;
-    while (std::getline(jar_stream, dependent_jar_path, ':')) {
-      TRACE(MAIN,
-            2,
-            "Dependent JAR specified on command-line: %s",
-            dependent_jar_path.c_str());
-      library_jars.emplace(dependent_jar_path);
+  // The phases below only wait for what they consume, so that e.g. the dexes
+  // load while the ProGuard configs are parsed. Library jars are only loaded
+  // once the dexes are: a class defined by both must resolve to the dex one.
+  TaskGraph frontend;
+
+  auto parse_pg_config = frontend.add("Parse ProGuard configs", [&] {
+    if (!args.build_cache_dir.empty()) {
+      // Keep the parsed configuration with the cached builds.
+      redex::proguard_parser::parse_files_cached(
+          args.proguard_config_paths,
+          args.build_cache_dir + "/proguard", &pg_config);
+    } else {
+      for (const auto& pg_config_path : args.proguard_config_paths) {
+        Timer time_pg_parsing("Parsed ProGuard config file");
+        redex::proguard_parser::parse_file(pg_config_path, &pg_config);
+      }
     }
-  }
+  });
 
-  DexStore root_store("classes");
-  // Only set dex magic to root DexStore since all dex magic
-  // should be consistent within one APK.
-  root_store.set_dex_magic(get_dex_magic(args.dex_files));
-  stores.emplace_back(std::move(root_store));
+  auto load_dexes = frontend.add("Load classes from dexes", [&] {
+    DexStore root_store("classes");
+    // Only set dex magic to root DexStore since all dex magic
+    // should be consistent within one APK.
+    root_store.set_dex_magic(get_dex_magic(args.dex_files));
+    stores.emplace_back(std::move(root_store));
 
-  {
     Timer t("Load classes from dexes");
-    dex_stats_t input_totals;
-    std::vector<dex_stats_t> input_dexes_stats;
+    // Gather every dex file first, remembering which store it belongs to, so
+    // that they can all be loaded at once.
+    std::vector<std::string> dex_paths;
+    std::vector<size_t> dex_store_idx;
     for (const auto& filename : args.dex_files) {
       if (filename.size() >= 5 &&
           filename.compare(filename.size() - 4, 4, ".dex") == 0) {
         assert_dex_magic_consistency(stores[0].get_dex_magic(),
                                      load_dex_magic_from_dex(filename.c_str()));
-        dex_stats_t dex_stats;
-        DexClasses classes =
-            load_classes_from_dex(filename.c_str(), &dex_stats);
-        input_totals += dex_stats;
-        input_dexes_stats.push_back(dex_stats);
-        stores[0].add_classes(std::move(classes));
+        dex_paths.push_back(filename);
+        dex_store_idx.push_back(0);
       } else {
         DexMetadata store_metadata;
         store_metadata.parse(filename);
-        DexStore store(store_metadata);
+        stores.emplace_back(store_metadata);
         for (const auto& file_path : store_metadata.get_files()) {
           assert_dex_magic_consistency(
               stores[0].get_dex_magic(),
               load_dex_magic_from_dex(file_path.c_str()));
-          dex_stats_t dex_stats;
-          DexClasses classes =
-              load_classes_from_dex(file_path.c_str(), &dex_stats);
-
-          input_totals += dex_stats;
-          input_dexes_stats.push_back(dex_stats);
-          store.add_classes(std::move(classes));
+          dex_paths.push_back(file_path);
+          dex_store_idx.push_back(stores.size() - 1);
         }
-        stores.emplace_back(std::move(store));
       }
     }
-    stats["input_stats"] = get_input_stats(input_totals, input_dexes_stats);
-  }
 
-  Scope external_classes;
-  args.entry_data["jars"] = Json::arrayValue;
-  if (!library_jars.empty()) {
-    Timer t("Load library jars");
-    const JsonWrapper& json_cfg = conf.get_json_config();
-    read_dup_class_whitelist(json_cfg);
-
-    for (const auto& library_jar : library_jars) {
-      TRACE(MAIN, 1, "LIBRARY JAR: %s", library_jar.c_str());
-      if (!load_jar_file(library_jar.c_str(), &external_classes)) {
-        // Try again with the basedir
-        std::string basedir_path =
-            pg_config.basedirectory + "/" + library_jar.c_str();
-        if (!load_jar_file(basedir_path.c_str())) {
-          std::cerr << "error: library jar could not be loaded: " << library_jar
-                    << std::endl;
-          exit(EXIT_FAILURE);
-        }
-        args.entry_data["jars"].append(basedir_path);
-      } else {
-        auto abs_path = boost::filesystem::absolute(library_jar);
-        args.entry_data["jars"].append(abs_path.string());
+    std::vector<dex_stats_t> input_dexes_stats;
+    auto dexen = load_classes_from_dexes(dex_paths, &input_dexes_stats);
+    dex_stats_t input_totals;
+    bool reuse_unchanged_dexes;
+    conf.get_json_config().get("reuse_unchanged_dexes", false,
+                               reuse_unchanged_dexes);
+    for (size_t i = 0; i < dexen.size(); ++i) {
+      input_totals += input_dexes_stats[i];
+      if (reuse_unchanged_dexes) {
+        input_dexes.push_back(
+            InputDex{dex_paths[i], dexen[i], input_dexes_stats[i]});
       }
+      stores[dex_store_idx[i]].add_classes(std::move(dexen[i]));
     }
-  }
+    stats["input_stats"] = get_input_stats(input_totals, input_dexes_stats);
+  });
 
-  {
-    Timer t("Deobfuscating dex elements");
-    for (auto& store : stores) {
-      apply_deobfuscated_names(store.get_dexen(), conf.get_proguard_map());
-    }
-  }
-  DexStoreClassesIterator it(stores);
-  Scope scope = build_class_scope(it);
-  {
-    Timer t("Processing proguard rules");
+  Scope external_classes;
+  auto load_jars = frontend.add(
+      "Load library jars",
+      [&] {
+        const auto& pg_libs = pg_config.libraryjars;
+        args.jar_paths.insert(pg_libs.begin(), pg_libs.end());
+
+        std::set<std::string> library_jars;
+        for (const auto& jar_path : args.jar_paths) {
+          std::istringstream jar_stream(jar_path);
+          std::string dependent_jar_path;
+          while (std::getline(jar_stream, dependent_jar_path, ':')) {
+            TRACE(MAIN,
+                  2,
+                  "Dependent JAR specified on command-line: %s",
+                  dependent_jar_path.c_str());
+            library_jars.emplace(dependent_jar_path);
+          }
+        }
 
-    bool keep_all_annotation_classes;
-    conf.get_json_config().get("keep_all_annotation_classes", true,
+        args.entry_data["jars"] = Json::arrayValue;
+        if (library_jars.empty()) {
+          return;
+        }
+        Timer t("Load library jars");
+        const JsonWrapper& json_cfg = conf.get_json_config();
+        read_dup_class_whitelist(json_cfg);
+
+        std::vector<std::string> jar_files;
+        for (const auto& library_jar : library_jars) {
+          TRACE(MAIN, 1, "LIBRARY JAR: %s", library_jar.c_str());
+          if (boost::filesystem::exists(library_jar)) {
+            auto abs_path = boost::filesystem::absolute(library_jar);
+            jar_files.push_back(library_jar);
+            args.entry_data["jars"].append(abs_path.string());
+          } else {
+            // Try again with the basedir
+            std::string basedir_path =
+                pg_config.basedirectory + "/" + library_jar.c_str();
+            jar_files.push_back(basedir_path);
+            args.entry_data["jars"].append(basedir_path);
+          }
+        }
+        if (!load_jar_files(jar_files, &external_classes)) {
+          std::cerr << "error: library jars could not be loaded" << std::endl;
+          exit(EXIT_FAILURE);
+        }
+      },
+      {parse_pg_config, load_dexes});
+
+  auto deobfuscate = frontend.add(
+      "Deobfuscating dex elements",
+      [&] {
+        Timer t("Deobfuscating dex elements");
+        for (auto& store : stores) {
+          apply_deobfuscated_names(store.get_dexen(), conf.get_proguard_map());
+        }
+      },
+      {load_dexes});
+
+  // Hash the input dexes once their classes carry their deobfuscated names,
+  // since the backend hashes them again with those names.
+  frontend.add(
+      "Hashing input dexes",
+      [&] {
+        if (input_dexes.empty()) {
+          return;
+        }
+        Timer t("Hashing input dexes");
+        auto wq = workqueue_foreach<InputDex*>([](InputDex* dex) {
+          dex->hash = hashing::hash_dex_classes(dex->classes);
+        });
+        for (auto& dex : input_dexes) {
+          wq.add_item(&dex);
+        }
+        wq.run_all();
+      },
+      {deobfuscate});
+
+  Scope scope;
+  auto process_rules = frontend.add(
+      "Processing proguard rules",
+      [&] {
+        DexStoreClassesIterator it(stores);
+        scope = build_class_scope(it);
+        Timer t("Processing proguard rules");
+
+        bool keep_all_annotation_classes;
+        conf.get_json_config().get("keep_all_annotation_classes", true,
+                                   keep_all_annotation_classes);
+        process_proguard_rules(conf.get_proguard_map(), scope,
+                               external_classes, pg_config,
                                keep_all_annotation_classes);
-    process_proguard_rules(conf.get_proguard_map(), scope, external_classes,
-                           pg_config, keep_all_annotation_classes);
-  }
-  {
-    Timer t("No Optimizations Rules");
-    // this will change rstate of methods
-    redex::process_no_optimizations_rules(conf.get_no_optimizations_annos(),
-                                          scope);
+      },
+      {parse_pg_config, load_jars, deobfuscate});
+
+  // The remaining phases all write the rstate of the same classes and
+  // members, so they stay in sequence.
+  auto no_optimizations = frontend.add(
+      "No Optimizations Rules",
+      [&] {
+        Timer t("No Optimizations Rules");
+        // this will change rstate of methods
+        redex::process_no_optimizations_rules(
+            conf.get_no_optimizations_annos(), scope);
+      },
+      {process_rules});
+
+  frontend.add(
+      "Initializing reachable classes",
+      [&] {
+        Timer t("Initializing reachable classes");
+        // init reachable will change rstate of classes, methods and fields
+        init_reachable_classes(scope, conf.get_json_config(),
+                               conf.get_no_optimizations_annos());
+      },
+      {no_optimizations});
+
+  frontend.run();
+
+  auto& frontend_stats = stats["frontend"];
+  for (TaskGraph::TaskId id = 0; id < frontend.size(); ++id) {
+    auto& task_stats = frontend_stats["tasks"][frontend.name(id)];
+    task_stats["start_s"] = frontend.timing(id).start;
+    task_stats["duration_s"] = frontend.timing(id).duration;
   }
-  {
-    Timer t("Initializing reachable classes");
-    // init reachable will change rstate of classes, methods and fields
-    init_reachable_classes(scope, conf.get_json_config(),
-                           conf.get_no_optimizations_annos());
+  double critical_path_s = 0;
+  frontend_stats["critical_path"] = Json::arrayValue;
+  for (auto id : frontend.critical_path()) {
+    frontend_stats["critical_path"].append(frontend.name(id));
+    critical_path_s += frontend.timing(id).duration;
   }
+  frontend_stats["critical_path_s"] = critical_path_s;
 }
 
 /**
  * Post processing steps: write dex and collect stats
  */
+/*
+ * The input dexes whose classes, in order, are exactly those of an output dex
+ * and hash the same as when they were loaded, keyed by that output dex.
+ */
+std::unordered_map<const DexClasses*, const InputDex*> find_unchanged_dexes(
+    DexStoresVector& stores, const std::vector<InputDex>& input_dexes) {
+  std::unordered_map<const DexClass*, const InputDex*> by_first_class;
+  for (const auto& dex : input_dexes) {
+    if (!dex.classes.empty()) {
+      by_first_class.emplace(dex.classes.front(), &dex);
+    }
+  }
+  std::unordered_map<const DexClasses*, const InputDex*> unchanged;
+  for (auto& store : stores) {
+    for (const auto& classes : store.get_dexen()) {
+      if (classes.empty()) {
+        continue;
+      }
+      auto it = by_first_class.find(classes.front());
+      if (it != by_first_class.end() && it->second->classes == classes &&
+          it->second->hash == hashing::hash_dex_classes(classes)) {
+        unchanged.emplace(&classes, it->second);
+      }
+    }
+  }
+  return unchanged;
+}
+
 void redex_backend(const PassManager& manager,
                    const std::string& output_dir,
                    const ConfigFiles& conf,
                    DexStoresVector& stores,
+                   const std::vector<InputDex>& input_dexes,
                    Json::Value& stats) {
   Timer redex_backend_timer("Redex_backend");
   const RedexOptions& redex_options = manager.get_redex_options();
 
+  // A copied input dex has no locator strings and keeps its own line numbers,
+  // and the method and class maps cannot cover it, so only reuse dexes when
+  // none of those are wanted. This has to happen before lowering, which
+  // changes the code that the hashes cover.
+  std::unordered_map<const DexClasses*, const InputDex*> unchanged_dexes;
+  if (!input_dexes.empty() &&
+      redex_options.debug_info_kind == DebugInfoKind::NoCustomSymbolication &&
+      !conf.get_json_config().get("emit_locator_strings", false)) {
+    Timer t("Finding unchanged dexes");
+    unchanged_dexes = find_unchanged_dexes(stores, input_dexes);
+  }
+
   instruction_lowering::Stats instruction_lowering_stats;
   {
     bool lower_with_cfg = true;
     conf.get_json_config().get("lower_with_cfg", true, lower_with_cfg);
+    // Lay out the blocks by the heat of the instrumentation profiles.
+    bool profile_guided_block_layout = false;
+    conf.get_json_config().get("profile_guided_block_layout", false,
+                               profile_guided_block_layout);
+    const auto* block_heat = profile_guided_block_layout
+                                 ? &conf.get_method_to_block_heat()
+                                 : nullptr;
     Timer t("Instruction lowering");
     instruction_lowering_stats =
-        instruction_lowering::run(stores, lower_with_cfg);
+        instruction_lowering::run(stores, lower_with_cfg, block_heat);
   }
 
   TRACE(MAIN, 1, "Writing out new DexClasses...");
@@ -865,6 +1206,11 @@ void redex_backend(const PassManager& manager,
           emit_name_based_locators ? " name-based" : "");
     locator_index =
         new LocatorIndex(make_locator_index(stores, emit_name_based_locators));
+    if (json_cfg.get("emit_locator_hash_index", false)) {
+      Timer t("Writing locator hash index");
+      write_locator_hash_index(*locator_index,
+                               output_dir + "/" + LOCATOR_HASH_INDEX);
+    }
   }
 
   dex_stats_t output_totals;
@@ -882,9 +1228,11 @@ void redex_backend(const PassManager& manager,
   TRACE(IODI, 1, "Attempting to use IODI, enabling overloaded methods: %s",
         iodi_enable_overloaded_methods ? "yes" : "no");
 
+  bool compact_symbol_maps = json_cfg.get("compact_symbol_maps", false);
   std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(
       dik == DebugInfoKind::NoCustomSymbolication ? ""
-                                                  : line_number_map_filename));
+                                                  : line_number_map_filename,
+      compact_symbol_maps));
   std::unordered_map<DexMethod*, uint64_t> method_to_id;
   std::unordered_map<DexCode*, std::vector<DebugLineItem>> code_debug_lines;
   IODIMetadata iodi_metadata(iodi_enable_overloaded_methods);
@@ -892,80 +1240,114 @@ void redex_backend(const PassManager& manager,
     Timer t("Compute initial IODI metadata");
     iodi_metadata.mark_methods(stores);
   }
-  for (size_t store_number = 0; store_number < stores.size(); ++store_number) {
-    auto& store = stores[store_number];
+  {
     Timer t("Writing optimized dexes");
-    for (size_t i = 0; i < store.get_dexen().size(); i++) {
-      std::ostringstream ss;
-      ss << output_dir << "/" << store.get_name();
-      if (store.get_name().compare("classes") == 0) {
-        // primary/secondary dex store, primary has no numeral and secondaries
-        // start at 2
-        if (i > 0) {
-          ss << (i + 1);
+    std::vector<DexOutputSpec> dexes;
+    for (size_t store_number = 0; store_number < stores.size();
+         ++store_number) {
+      auto& store = stores[store_number];
+      for (size_t i = 0; i < store.get_dexen().size(); i++) {
+        std::ostringstream ss;
+        ss << output_dir << "/" << store.get_name();
+        if (store.get_name().compare("classes") == 0) {
+          // primary/secondary dex store, primary has no numeral and
+          // secondaries start at 2
+          if (i > 0) {
+            ss << (i + 1);
+          }
+        } else {
+          // other dex stores do not have a primary,
+          // so it makes sense to start at 2
+          ss << (i + 2);
+        }
+        ss << ".dex";
+        dexes.push_back(
+            DexOutputSpec{ss.str(), &store.get_dexen()[i], store_number, i});
+        auto unchanged = unchanged_dexes.find(&store.get_dexen()[i]);
+        if (unchanged != unchanged_dexes.end()) {
+          dexes.back().reuse_input = unchanged->second->path;
+          dexes.back().reuse_stats = unchanged->second->stats;
         }
-      } else {
-        // other dex stores do not have a primary,
-        // so it makes sense to start at 2
-        ss << (i + 2);
       }
-      ss << ".dex";
-      auto this_dex_stats =
-          write_classes_to_dex(redex_options,
-                               ss.str(),
-                               &store.get_dexen()[i],
-                               locator_index,
-                               emit_name_based_locators,
-                               store_number,
-                               i,
-                               conf,
-                               pos_mapper.get(),
-                               needs_addresses ? &method_to_id : nullptr,
-                               needs_addresses ? &code_debug_lines : nullptr,
-                               is_iodi(dik) ? &iodi_metadata : nullptr,
-                               stores[0].get_dex_magic());
+    }
+    size_t num_threads;
+    json_cfg.get("dex_output_threads",
+                 size_t(redex_parallel::default_num_threads()),
+                 num_threads);
+    output_dexes_stats = write_classes_to_dexes(
+        redex_options,
+        dexes,
+        locator_index,
+        emit_name_based_locators,
+        conf,
+        pos_mapper.get(),
+        needs_addresses ? &method_to_id : nullptr,
+        needs_addresses ? &code_debug_lines : nullptr,
+        is_iodi(dik) ? &iodi_metadata : nullptr,
+        stores[0].get_dex_magic(),
+        num_threads);
+    for (const auto& this_dex_stats : output_dexes_stats) {
       output_totals += this_dex_stats;
-      output_dexes_stats.push_back(this_dex_stats);
     }
   }
 
+  // The remaining metadata files do not depend on each other, so they are
+  // written side by side with the stats being gathered.
+  TaskGraph metadata_writers;
   if (is_iodi(dik)) {
-    Timer t("Compute IODI caller metadata");
-    iodi_metadata.mark_callers();
+    metadata_writers.add("Writing IODI metadata", [&] {
+      Timer t("Writing IODI metadata");
+      iodi_metadata.write(iodi_metadata_filename, method_to_id);
+    });
   }
-
-  {
+  if (needs_addresses) {
+    metadata_writers.add("Writing debug line map", [&] {
+      Timer t("Writing debug line map");
+      if (compact_symbol_maps) {
+        write_compact_debug_line_mapping(debug_line_map_filename,
+                                         method_to_id, code_debug_lines,
+                                         stores);
+      } else {
+        write_debug_line_mapping(debug_line_map_filename, method_to_id,
+                                 code_debug_lines, stores);
+      }
+    });
+  }
+  metadata_writers.add("Writing position map", [&] {
+    Timer t("Writing position map");
+    pos_mapper->write_map();
+  });
+  metadata_writers.add("Writing opt decisions data", [&] {
     Timer t("Writing opt decisions data");
     const Json::Value& opt_decisions_args =
         conf.get_json_config()["opt_decisions"];
-    if (opt_decisions_args.get("enable_logs", false).asBool()) {
+    if (!opt_decisions_args.get("enable_logs", false).asBool()) {
+      return;
+    }
+    auto& opt_data_mapper = opt_metadata::OptDataMapper::get_instance();
+    if (opt_decisions_args.get("format", "json").asString() == "binary") {
+      std::ofstream opt_data_out(conf.metafile(OPT_DECISIONS_BINARY),
+                                 std::ios::binary);
+      opt_data_mapper.serialize_binary(opt_data_out);
+    } else {
       auto opt_decisions_output_path = conf.metafile(OPT_DECISIONS);
-      auto opt_data =
-          opt_metadata::OptDataMapper::get_instance().serialize_sql();
+      auto opt_data = opt_data_mapper.serialize_sql();
       Json::StyledStreamWriter writer;
       {
         std::ofstream opt_data_out(opt_decisions_output_path);
         writer.write(opt_data_out, opt_data);
       }
     }
-  }
-
-  {
+  });
+  metadata_writers.add("Writing stats", [&] {
     Timer t("Writing stats");
-    auto method_move_map =
-        conf.metafile(json_cfg.get("method_move_map", std::string()));
-    if (needs_addresses) {
-      write_debug_line_mapping(debug_line_map_filename, method_to_id,
-                               code_debug_lines, stores);
-    }
-    if (is_iodi(dik)) {
-      iodi_metadata.write(iodi_metadata_filename, method_to_id);
-    }
-    pos_mapper->write_map();
     stats["output_stats"] = get_output_stats(
         output_totals, output_dexes_stats, manager, instruction_lowering_stats);
-    print_warning_summary();
-  }
+    stats["output_stats"]["reused_dexes"] =
+        (Json::UInt64)unchanged_dexes.size();
+  });
+  metadata_writers.run();
+  print_warning_summary();
 }
 
 void dump_class_method_info_map(const std::string file_path,
@@ -1041,8 +1423,21 @@ int main(int argc, char* argv[]) {
   signal(SIGBUS, crash_backtrace_handler);
 #endif
 
+  // Set REDEX_PROFILE_TRACE to a file path to get a Chrome trace_event
+  // profile of the whole run.
+  const char* profile_trace_path = getenv("REDEX_PROFILE_TRACE");
+  if (profile_trace_path != nullptr) {
+    profiler::set_enabled(true);
+  }
+
   std::string stats_output_path;
   Json::Value stats;
+  std::unique_ptr<BuildCache> build_cache;
+  std::string build_cache_key;
+  bool cache_hit{false};
+  // Whether the pass hashes differ from those of --reference-stats.
+  bool diverged{false};
+  std::string out_dir;
   {
     Timer redex_all_main_timer("redex-all main()");
 
@@ -1059,9 +1454,17 @@ int main(int argc, char* argv[]) {
     // TODO: Make the command line -jarpath option like a colon separated
     //       list of library JARS.
     Arguments args = parse_args(argc, argv);
+    out_dir = args.out_dir;
+
+    g_redex->init_thread_pool(args.redex_options.thread_pool_size,
+                              args.redex_options.pin_pool_threads);
+    set_workqueue_shuffle_seed(args.shuffle_work_seed);
 
     RedexContext::set_record_keep_reasons(
         args.config.get("record_keep_reasons", false).asBool());
+    RedexContext::set_record_keep_reasons_only_for_whyareyoukeeping(
+        args.config.get("record_keep_reasons_only_for_whyareyoukeeping", false)
+            .asBool());
 
     auto pg_config = std::make_unique<redex::ProguardConfiguration>();
     DexStoresVector stores;
@@ -1075,27 +1478,65 @@ int main(int argc, char* argv[]) {
       args.redex_options.min_sdk = *maybe_sdk;
     }
 
-    redex_frontend(conf, args, *pg_config, stores, stats);
-
-    auto const& passes = PassRegistry::get().get_passes();
-    PassManager manager(passes, std::move(pg_config), args.config,
-                        args.redex_options);
-    {
-      Timer t("Running optimization passes");
-      manager.run_passes(stores, conf);
+    std::vector<InputDex> input_dexes;
+    redex_frontend(conf, args, *pg_config, stores, input_dexes, stats);
+
+    if (!args.build_cache_dir.empty() && args.stop_pass_idx == boost::none) {
+      Timer t("Build cache lookup");
+      build_cache = std::make_unique<BuildCache>(
+          args.build_cache_dir,
+          args.config.get("build_cache_max_entries", 8).asUInt());
+      Json::Value options;
+      args.redex_options.serialize(options);
+      std::vector<std::string> input_files(args.proguard_config_paths.begin(),
+                                           args.proguard_config_paths.end());
+      for (const auto& jar : args.entry_data["jars"]) {
+        input_files.push_back(jar.asString());
+      }
+      DexStoreClassesIterator it(stores);
+      build_cache_key = BuildCache::compute_key(
+          build_class_scope(it), args.config, options, input_files);
+      cache_hit = build_cache->restore(build_cache_key, args.out_dir, &stats);
+      stats["build_cache"]["key"] = build_cache_key;
+      stats["build_cache"]["hit"] = cache_hit;
     }
 
-    if (args.stop_pass_idx == boost::none) {
-      // Call redex_backend by default
-      redex_backend(manager, args.out_dir, conf, stores, stats);
-      if (args.config.get("emit_class_method_info_map", false).asBool()) {
-        dump_class_method_info_map(conf.metafile(CLASS_METHOD_INFO_MAP),
-                                   stores);
+    if (!cache_hit) {
+      auto const& passes = PassRegistry::get().get_passes();
+      PassManager manager(passes, std::move(pg_config), args.config,
+                          args.redex_options);
+      {
+        Timer t("Running optimization passes");
+        manager.run_passes(stores, conf);
+      }
+
+      if (!args.reference_stats.empty()) {
+        Json::Value reference;
+        std::ifstream in(args.reference_stats);
+        in >> reference;
+        auto diverging_pass = find_first_diverging_pass(
+            manager, reference["output_stats"]["pass_hashes"]);
+        if (diverging_pass) {
+          std::cerr << "error: the scope hash after " << *diverging_pass
+                    << " differs from the one in " << args.reference_stats
+                    << std::endl;
+          stats["first_diverging_pass"] = *diverging_pass;
+          diverged = true;
+        }
+      }
+
+      if (args.stop_pass_idx == boost::none) {
+        // Call redex_backend by default
+        redex_backend(manager, args.out_dir, conf, stores, input_dexes, stats);
+        if (args.config.get("emit_class_method_info_map", false).asBool()) {
+          dump_class_method_info_map(conf.metafile(CLASS_METHOD_INFO_MAP),
+                                     stores);
+        }
+      } else {
+        redex::write_all_intermediate(conf, args.output_ir_dir,
+                                      args.redex_options, stores,
+                                      args.entry_data);
       }
-    } else {
-      redex::write_all_intermediate(conf, args.output_ir_dir,
-                                    args.redex_options, stores,
-                                    args.entry_data);
     }
 
     stats_output_path = conf.metafile(
@@ -1113,6 +1554,15 @@ int main(int argc, char* argv[]) {
     writer.write(out, stats);
   }
 
+  if (build_cache != nullptr && !cache_hit) {
+    Timer t("Build cache store");
+    build_cache->store(build_cache_key, out_dir, stats_output_path);
+  }
+
+  if (profile_trace_path != nullptr) {
+    profiler::write_chrome_trace(profile_trace_path);
+  }
+
   TRACE(MAIN, 1, "Done.");
-  return 0;
+  return diverged ? 1 : 0;
 }
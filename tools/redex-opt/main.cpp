@@ -21,6 +21,7 @@ struct Arguments {
   std::string input_ir_dir;
   std::string output_ir_dir;
   std::vector<std::string> pass_names;
+  bool resume{false};
   RedexOptions redex_options;
 };
 
@@ -36,6 +37,9 @@ Arguments parse_args(int argc, char* argv[]) {
                      "output dex and IR meta directory");
   desc.add_options()("pass-name,p", po::value<std::vector<std::string>>(),
                      "pass name");
+  desc.add_options()("resume,r",
+                     "run the rest of the pipeline that the input was dumped "
+                     "from by redex-all --stop-pass, instead of --pass-name");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -64,6 +68,11 @@ Arguments parse_args(int argc, char* argv[]) {
   if (vm.count("pass-name")) {
     args.pass_names = vm["pass-name"].as<std::vector<std::string>>();
   }
+  args.resume = vm.count("resume") != 0;
+  if (args.resume && !args.pass_names.empty()) {
+    std::cerr << "--resume and --pass-name are exclusive\n";
+    exit(EXIT_FAILURE);
+  }
 
   return args;
 }
@@ -78,6 +87,17 @@ Json::Value process_entry_data(const Json::Value& entry_data,
   // Change passes list in config data.
   config_data["redex"]["passes"] = Json::arrayValue;
   Json::Value& passes_list = config_data["redex"]["passes"];
+  if (args.resume) {
+    if (!entry_data.isMember("stop_pass_idx")) {
+      std::cerr << "The input was not dumped with --stop-pass\n";
+      exit(EXIT_FAILURE);
+    }
+    const auto& all_passes = entry_data["passes"];
+    for (auto i = entry_data["stop_pass_idx"].asUInt(); i < all_passes.size();
+         ++i) {
+      passes_list.append(all_passes[i]);
+    }
+  }
   for (const std::string& pass_name : args.pass_names) {
     passes_list.append(pass_name);
   }
@@ -117,6 +137,11 @@ int main(int argc, char* argv[]) {
   args.redex_options.deserialize(entry_data);
 
   Json::Value config_data = process_entry_data(entry_data, args);
+  if (args.resume) {
+    // The output holds the end of the pipeline; there is nothing left to
+    // resume from it.
+    entry_data.removeMember("stop_pass_idx");
+  }
   ConfigFiles conf(std::move(config_data), args.output_ir_dir);
 
   const auto& passes = PassRegistry::get().get_passes();
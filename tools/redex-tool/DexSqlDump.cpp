@@ -22,6 +22,9 @@ $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 */
 
 #include <boost/algorithm/string/replace.hpp>
+#include <algorithm>
+#include <cstdarg>
+#include <functional>
 #include <queue>
 #include <vector>
 #include <unordered_map>
@@ -34,6 +37,7 @@ $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 #include "Show.h"
 #include "Tool.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -42,128 +46,158 @@ static std::unordered_map<DexMethod*, int> method_ids;
 static std::unordered_map<DexField*, int> field_ids;
 static std::unordered_map<DexString*, int> string_ids;
 
-void dump_field_refs(FILE* fdout, const char* prefix, DexField* field, int field_id) {
-  static int next_string_ref = 0;
+// How many rows go into one INSERT. Older versions of sqlite3 don't take more
+// than 500 rows in a VALUES list.
+constexpr size_t kRowsPerInsert = 500;
+
+// How many classes have their references gathered at a time, to bound how
+// many rows are held in memory before they are written out.
+constexpr size_t kClassesPerChunk = 2000;
+
+std::string format_row(const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  va_list backup;
+  va_copy(backup, ap);
+  size_t size = vsnprintf(nullptr, 0, fmt, ap);
+  va_end(ap);
+  std::string row(size, '\0');
+  vsnprintf(&row[0], size + 1, fmt, backup);
+  va_end(backup);
+  return row;
+}
+
+/**
+ * Writes the rows of a table as multi-row INSERT statements, which sqlite3
+ * imports much faster than one statement per row.
+ */
+class InsertWriter {
+ public:
+  InsertWriter(FILE* fdout, const char* prefix, const char* table)
+      : m_fdout(fdout),
+        m_insert(std::string("INSERT INTO ") + prefix + table + " VALUES\n") {}
+
+  ~InsertWriter() { flush(); }
+
+  void add(const std::string& values) {
+    fputs(m_rows == 0 ? m_insert.c_str() : ",\n", m_fdout);
+    fputc('(', m_fdout);
+    fputs(values.c_str(), m_fdout);
+    fputc(')', m_fdout);
+    if (++m_rows == kRowsPerInsert) {
+      flush();
+    }
+  }
+
+  // For rows whose ids are only handed out as they are written.
+  void add_with_next_id(const std::string& values) {
+    add(std::to_string(m_next_id++) + ", " + values);
+  }
+
+ private:
+  void flush() {
+    if (m_rows > 0) {
+      fputs(";\n", m_fdout);
+      m_rows = 0;
+    }
+  }
+
+  FILE* m_fdout;
+  std::string m_insert;
+  size_t m_rows{0};
+  int m_next_id{0};
+};
+
+// The rows of a table, without their ids.
+using Rows = std::vector<std::string>;
+
+struct MethodRefRows {
+  Rows string_refs;
+  Rows class_refs;
+  Rows field_refs;
+  Rows method_refs;
+};
+
+void dump_field_refs(DexField* field, int field_id, Rows& rows) {
   auto* static_value = field->get_static_value();
   if (!static_value || (static_value->evtype() != DEVT_STRING)) return;
   auto* static_string_value = static_cast<DexEncodedValueString*>(static_value);
-  auto string_id = string_ids[static_string_value->string()];
-  fprintf(
-    fdout,
-    "INSERT INTO %sfield_string_refs VALUES (%d, %d, %d);\n",
-    prefix,
-    next_string_ref++,
-    field_id,
-    string_id);
+  auto it = string_ids.find(static_string_value->string());
+  if (it == string_ids.end()) return;
+  rows.push_back(format_row("%d, %d", field_id, it->second));
 }
 
-void dump_method_refs(FILE* fdout, const char* prefix, DexMethod* method, int method_id) {
+void dump_method_refs(DexMethod* method, int method_id, MethodRefRows& rows) {
   auto code = method->get_code();
   if (!code) return;
 
-  static int next_string_ref = 0;
-  static int next_class_ref = 0;
-  static int next_field_ref = 0;
-  static int next_method_ref = 0;
-
   for (auto& mie : InstructionIterable(code)) {
     auto insn = mie.insn;
     if (insn->has_string()) {
-      if (string_ids.count(insn->get_string())) {
-        auto string_id = string_ids[insn->get_string()];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_string_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_string_ref++,
-          method_id,
-          string_id,
-          insn->opcode());
+      auto it = string_ids.find(insn->get_string());
+      if (it != string_ids.end()) {
+        rows.string_refs.push_back(
+            format_row("%d, %d, %d", method_id, it->second, insn->opcode()));
       }
     }
     if (insn->has_type()) {
       auto cls = type_class(insn->get_type());
-      if (cls && class_ids.count(cls)) {
-        auto class_id = class_ids[cls];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_class_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_class_ref++,
-          method_id,
-          class_id,
-          insn->opcode());
+      auto it = class_ids.find(cls);
+      if (cls && it != class_ids.end()) {
+        rows.class_refs.push_back(
+            format_row("%d, %d, %d", method_id, it->second, insn->opcode()));
       }
     }
     if (insn->has_field()) {
-      auto field = resolve_field(insn->get_field());
-      if (field != nullptr && field_ids.count(field)) {
-        auto field_id = field_ids[field];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_field_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_field_ref++,
-          method_id,
-          field_id,
-          insn->opcode());
+      auto field = resolve_field_cached(insn->get_field());
+      auto it = field_ids.find(field);
+      if (field != nullptr && it != field_ids.end()) {
+        rows.field_refs.push_back(
+            format_row("%d, %d, %d", method_id, it->second, insn->opcode()));
       }
     }
     if (insn->has_method()) {
-      auto meth = resolve_method(insn->get_method(), opcode_to_search(insn));
-      if (meth != nullptr && method_ids.count(meth)) {
-        auto method_ref_id = method_ids[meth];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_method_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_method_ref++,
-          method_id,
-          method_ref_id,
-          insn->opcode());
+      auto meth =
+          resolve_method_cached(insn->get_method(), opcode_to_search(insn));
+      auto it = method_ids.find(meth);
+      if (meth != nullptr && it != method_ids.end()) {
+        rows.method_refs.push_back(
+            format_row("%d, %d, %d", method_id, it->second, insn->opcode()));
       }
     }
   }
 }
 
-void dump_class(FILE* fdout, const char* prefix, const char* dex_id, DexClass* cls, int class_id) {
+std::string dump_class(const char* dex_id, DexClass* cls, int class_id) {
   // TODO: annotations?
   // TODO: inheritance?
   // TODO: string usage
   // TODO: size estimate
   auto deobfuscated_name = cls->get_deobfuscated_name();
-  fprintf(
-    fdout,
-    "INSERT INTO %sclasses VALUES (%d,'%s','%s','%s',%u);\n",
-    prefix,
-    class_id,
-    dex_id,
-    deobfuscated_name.c_str(),
-    cls->get_name()->c_str(),
-    cls->get_access()
-  );
+  return format_row("%d,'%s','%s','%s',%u",
+                    class_id,
+                    dex_id,
+                    deobfuscated_name.c_str(),
+                    cls->get_name()->c_str(),
+                    cls->get_access());
 }
 
-void dump_field(FILE* fdout, const char* prefix, int class_id, DexField* field, int field_id) {
+std::string dump_field(int class_id, DexField* field, int field_id) {
   // TODO: more fixup here on this crapped up name/signature
   // TODO: break down signature
   // TODO: annotations?
   // TODO: string usage (encoded_value for static fields)
   auto deobfuscated_name = field->get_deobfuscated_name();
   auto field_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %sfields VALUES(%d, %d, '%s', '%s', %u);\n",
-    prefix,
-    field_id,
-    class_id,
-    field_name,
-    field->get_name()->c_str(),
-    field->get_access()
-  );
+  return format_row("%d, %d, '%s', '%s', %u",
+                    field_id,
+                    class_id,
+                    field_name,
+                    field->get_name()->c_str(),
+                    field->get_access());
 }
 
-void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* method, int method_id) {
+std::string dump_method(int class_id, DexMethod* method, int method_id) {
   // TODO: more fixup here on this crapped up name/signature
   // TODO: break down signature
   // TODO: throws?
@@ -172,17 +206,30 @@ void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* metho
   // TODO: size estimate
   auto deobfuscated_name = method->get_deobfuscated_name();
   auto method_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %smethods VALUES (%d,%d,'%s','%s',%d,%lu);\n",
-    prefix,
-    method_id,
-    class_id,
-    method_name,
-    method->get_name()->c_str(),
-    method->get_access(),
-    method->get_code() ? method->get_code()->sum_opcode_sizes() : 0
-  );
+  return format_row(
+      "%d,%d,'%s','%s',%d,%lu",
+      method_id,
+      class_id,
+      method_name,
+      method->get_name()->c_str(),
+      method->get_access(),
+      method->get_code() ? method->get_code()->sum_opcode_sizes() : 0);
+}
+
+std::string dump_string(DexString* dexstr, int string_id) {
+  // Escape string before inserting. ' -> ''
+  std::string esc(dexstr->c_str());
+  boost::replace_all(esc, "'", "''");
+  return format_row("%d, '%s'", string_id, esc.c_str());
+}
+
+// Runs the tasks in parallel, the index of each one being its input.
+void run_in_parallel(size_t num_tasks, const std::function<void(size_t)>& f) {
+  auto wq = workqueue_foreach<size_t>(f);
+  for (size_t i = 0; i < num_tasks; i++) {
+    wq.add_item(i);
+  }
+  wq.run_all();
 }
 
 void dump_sql(
@@ -193,6 +240,8 @@ void dump_sql(
   fprintf(
     fdout,
 R"___(
+PRAGMA synchronous = OFF;
+PRAGMA journal_mode = MEMORY;
 DROP TABLE IF EXISTS %1$sfield_string_refs;
 DROP TABLE IF EXISTS %1$smethod_string_refs;
 DROP TABLE IF EXISTS %1$smethod_field_refs;
@@ -271,8 +320,9 @@ CREATE TABLE %1$smethod_string_refs (
   int next_field_id = 0;
   int next_string_id = 0;
 
-  // Dump all dex items
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
+  // Hand out the ids of all dex items, in the order they are dumped in.
+  std::vector<std::pair<DexString*, int>> strings;
+  std::vector<std::pair<std::string, DexClass*>> classes;
   for (auto& store : stores) {
     auto store_name = store.get_name();
     auto& dexen = store.get_dexen();
@@ -280,93 +330,177 @@ CREATE TABLE %1$smethod_string_refs (
     for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
       auto& dex = dexen[dex_idx];
       GatheredTypes gtypes(&dex);
-      auto strings = gtypes.get_cls_order_dexstring_emitlist();
-      for (auto dexstr : strings) {
+      for (auto dexstr : gtypes.get_cls_order_dexstring_emitlist()) {
         int id = next_string_id++;
         string_ids[dexstr] = id;
-        // Escape string before inserting. ' -> ''
-        std::string esc(dexstr->c_str());
-        boost::replace_all(esc, "'", "''");
-        fprintf(fdout, "INSERT INTO %sstrings VALUES(%d, '%s');\n", prefix, id, esc.c_str());
+        strings.emplace_back(dexstr, id);
       }
-      std::string dex_id_str(store_name + "/" + std::to_string(dex_idx));
-      const char* dex_id = dex_id_str.c_str();
+      std::string dex_id(store_name + "/" + std::to_string(dex_idx));
       for (const auto& cls : dex) {
-        int class_id = next_class_id++;
-        dump_class(fdout, prefix, dex_id, cls, class_id);
-        class_ids[cls] = class_id;
+        class_ids[cls] = next_class_id++;
+        classes.emplace_back(dex_id, cls);
         for (auto field : cls->get_ifields()) {
-          int field_id = next_field_id++;
-          field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
+          field_ids[field] = next_field_id++;
         }
         for (auto field : cls->get_sfields()) {
-          int field_id = next_field_id++;
-          field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
+          field_ids[field] = next_field_id++;
         }
         for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = next_method_id++;
-          method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
+          method_ids[meth] = next_method_id++;
         }
         for (auto& meth : cls->get_vmethods()) {
-          int meth_id = next_method_id++;
-          method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
+          method_ids[meth] = next_method_id++;
         }
       }
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
 
-  // Dump references
+  // Everything goes into a single transaction.
   fprintf(fdout, "BEGIN TRANSACTION;\n");
-  for (auto& store : stores) {
-    auto& dexen = store.get_dexen();
-    for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
-      auto& dex = dexen[dex_idx];
-      for (const auto& cls : dex) {
+
+  // Dump all dex items. The rows of each table are made in parallel with
+  // those of the others.
+  Rows string_rows;
+  Rows class_rows;
+  Rows field_rows;
+  Rows method_rows;
+  std::vector<std::function<void()>> item_dumps{
+      [&]() {
+        for (const auto& p : strings) {
+          string_rows.push_back(dump_string(p.first, p.second));
+        }
+      },
+      [&]() {
+        for (const auto& p : classes) {
+          auto cls = p.second;
+          class_rows.push_back(
+              dump_class(p.first.c_str(), cls, class_ids.at(cls)));
+        }
+      },
+      [&]() {
+        for (const auto& p : classes) {
+          auto cls = p.second;
+          int class_id = class_ids.at(cls);
+          for (auto field : cls->get_ifields()) {
+            field_rows.push_back(
+                dump_field(class_id, field, field_ids.at(field)));
+          }
+          for (auto field : cls->get_sfields()) {
+            field_rows.push_back(
+                dump_field(class_id, field, field_ids.at(field)));
+          }
+        }
+      },
+      [&]() {
+        for (const auto& p : classes) {
+          auto cls = p.second;
+          int class_id = class_ids.at(cls);
+          for (const auto& meth : cls->get_dmethods()) {
+            method_rows.push_back(
+                dump_method(class_id, meth, method_ids.at(meth)));
+          }
+          for (auto& meth : cls->get_vmethods()) {
+            method_rows.push_back(
+                dump_method(class_id, meth, method_ids.at(meth)));
+          }
+        }
+      }};
+  run_in_parallel(item_dumps.size(), [&](size_t i) { item_dumps[i](); });
+  {
+    InsertWriter writer(fdout, prefix, "strings");
+    for (const auto& row : string_rows) {
+      writer.add(row);
+    }
+  }
+  {
+    InsertWriter writer(fdout, prefix, "classes");
+    for (const auto& row : class_rows) {
+      writer.add(row);
+    }
+  }
+  {
+    InsertWriter writer(fdout, prefix, "fields");
+    for (const auto& row : field_rows) {
+      writer.add(row);
+    }
+  }
+  {
+    InsertWriter writer(fdout, prefix, "methods");
+    for (const auto& row : method_rows) {
+      writer.add(row);
+    }
+  }
+
+  // Dump references. They are gathered for a chunk of classes at a time in
+  // parallel, then written out in class order, which is when their ids are
+  // handed out.
+  {
+    InsertWriter field_string_refs(fdout, prefix, "field_string_refs");
+    InsertWriter method_string_refs(fdout, prefix, "method_string_refs");
+    InsertWriter method_class_refs(fdout, prefix, "method_class_refs");
+    InsertWriter method_field_refs(fdout, prefix, "method_field_refs");
+    InsertWriter method_method_refs(fdout, prefix, "method_method_refs");
+    for (size_t begin = 0; begin < classes.size(); begin += kClassesPerChunk) {
+      size_t end = std::min(begin + kClassesPerChunk, classes.size());
+      std::vector<MethodRefRows> method_refs(end - begin);
+      std::vector<Rows> field_refs(end - begin);
+      run_in_parallel(end - begin, [&](size_t i) {
+        auto cls = classes[begin + i].second;
         for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
+          dump_method_refs(meth, method_ids.at(meth), method_refs[i]);
         }
         for (auto& meth : cls->get_vmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
+          dump_method_refs(meth, method_ids.at(meth), method_refs[i]);
         }
         for (const auto& field : cls->get_sfields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
+          dump_field_refs(field, field_ids.at(field), field_refs[i]);
         }
         for (const auto& field : cls->get_ifields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
+          dump_field_refs(field, field_ids.at(field), field_refs[i]);
+        }
+      });
+      // The tables are interleaved by chunk, which sqlite3 doesn't mind.
+      for (size_t i = 0; i < end - begin; i++) {
+        for (const auto& row : method_refs[i].string_refs) {
+          method_string_refs.add_with_next_id(row);
+        }
+        for (const auto& row : method_refs[i].class_refs) {
+          method_class_refs.add_with_next_id(row);
+        }
+        for (const auto& row : method_refs[i].field_refs) {
+          method_field_refs.add_with_next_id(row);
+        }
+        for (const auto& row : method_refs[i].method_refs) {
+          method_method_refs.add_with_next_id(row);
+        }
+        for (const auto& row : field_refs[i]) {
+          field_string_refs.add_with_next_id(row);
         }
       }
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
 
   // Dump hierarchy
   auto scope = build_class_scope(stores);
   ClassHierarchy ch = build_type_hierarchy(scope);
-  int next_is_a_id = 0;
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
-  for (auto& cls : scope) {
+  std::vector<Rows> is_a_rows(scope.size());
+  run_in_parallel(scope.size(), [&](size_t i) {
+    auto cls = scope[i];
     TypeSet results;
     get_all_children_or_implementors(ch, scope, cls, results);
     for(auto type : results) {
-      auto type_cls = type_class(type);
-      if (type_cls) {
-        fprintf(
-          fdout,
-          "INSERT INTO %sis_a VALUES(%d, %d, %d);\n",
-          prefix,
-          next_is_a_id++,
-          class_ids[type_cls],
-          class_ids[cls]
-        );
+      auto it = class_ids.find(type_class(type));
+      if (it != class_ids.end()) {
+        is_a_rows[i].push_back(
+            format_row("%d, %d", it->second, class_ids.at(cls)));
+      }
+    }
+  });
+  {
+    InsertWriter writer(fdout, prefix, "is_a");
+    for (const auto& rows : is_a_rows) {
+      for (const auto& row : rows) {
+        writer.add_with_next_id(row);
       }
     }
   }
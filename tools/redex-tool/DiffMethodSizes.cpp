@@ -14,6 +14,7 @@
 #include "ReachableClasses.h"
 #include "Tool.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 #include <algorithm>
 #include <iostream>
@@ -129,46 +130,102 @@ void diff_in_out_jars_from_command_line(const std::string& command_line_path) {
   g_redex = injar_context;
 }
 
-using DexMethodInfoMap =
-    std::unordered_map<std::string, // Method as string
-                       std::tuple<int, int>>; // <code size, register size>
-                                              // or <#move, moves size> if
-                                              // it is storing move info.
+// <code size, register size>, or <#move, moves size> if it is storing move
+// info.
+using MethodSizes = std::tuple<int, int>;
 
-DexMethodInfoMap load_dex_method_info(const std::string& dir) {
+struct MethodInfo {
+  std::string name;
+  size_t name_hash;
+  MethodSizes sizes;
+};
+
+using DexMethodInfos = std::vector<MethodInfo>;
+
+/*
+ * The methods of the two inputs are loaded into different RedexContexts, so
+ * they are matched up by their names. The hashes of the names are computed
+ * while loading, in parallel, and the index only compares the names when the
+ * hashes are equal.
+ */
+struct NameKey {
+  size_t hash;
+  const std::string* name;
+
+  bool operator==(const NameKey& that) const {
+    return hash == that.hash && *name == *that.name;
+  }
+};
+
+struct NameKeyHash {
+  size_t operator()(const NameKey& key) const { return key.hash; }
+};
+
+using MethodIndex =
+    std::unordered_map<NameKey, const MethodInfo*, NameKeyHash>;
+
+MethodIndex index_methods(const DexMethodInfos& infos) {
+  MethodIndex index;
+  index.reserve(infos.size());
+  for (const auto& info : infos) {
+    auto inserted = index.emplace(NameKey{info.name_hash, &info.name}, &info);
+    always_assert(inserted.second);
+  }
+  return index;
+}
+
+/*
+ * Loads the root dexen in the directory, and gets the sizes of each method,
+ * one class at a time in parallel, in scope order.
+ */
+DexMethodInfos load_dex_method_infos(
+    const std::string& dir,
+    const std::function<MethodSizes(const DexCode*)>& get_sizes) {
   DexStore root_store("dex");
   DexStoresVector stores;
 
   // Load root dexen
   load_root_dexen(root_store, dir);
   stores.emplace_back(std::move(root_store));
-  DexMethodInfoMap result;
-
-  walk::methods(build_class_scope(stores), [&result](DexMethod* method) {
-    auto key = show(method);
-    always_assert(result.find(key) == end(result));
-    const auto* code = method->get_dex_code();
-    result.emplace(key,
-                   std::make_tuple((code ? code->size() : 0),
-                                   (code ? code->get_registers_size() : 0)));
+
+  auto scope = build_class_scope(stores);
+  std::vector<DexMethodInfos> class_infos(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto& infos = class_infos[i];
+    auto add_method = [&](DexMethod* method) {
+      auto name = show(method);
+      auto hash = std::hash<std::string>()(name);
+      auto sizes = get_sizes(method->get_dex_code());
+      infos.push_back({std::move(name), hash, sizes});
+    };
+    for (auto* method : scope[i]->get_dmethods()) {
+      add_method(method);
+    }
+    for (auto* method : scope[i]->get_vmethods()) {
+      add_method(method);
+    }
   });
+  for (size_t i = 0; i < scope.size(); i++) {
+    wq.add_item(i);
+  }
+  wq.run_all();
 
+  DexMethodInfos result;
+  for (auto& infos : class_infos) {
+    std::move(infos.begin(), infos.end(), std::back_inserter(result));
+  }
   return result;
 }
 
-DexMethodInfoMap load_dex_method_move_info(const std::string& dir) {
-  DexStore root_store("dex");
-  DexStoresVector stores;
-
-  // Load root dexen
-  load_root_dexen(root_store, dir);
-  stores.emplace_back(std::move(root_store));
-  DexMethodInfoMap result;
+DexMethodInfos load_dex_method_info(const std::string& dir) {
+  return load_dex_method_infos(dir, [](const DexCode* code) {
+    return std::make_tuple((code ? code->size() : 0),
+                           (code ? code->get_registers_size() : 0));
+  });
+}
 
-  walk::methods(build_class_scope(stores), [&result](DexMethod* method) {
-    auto key = show(method);
-    always_assert(result.find(key) == end(result));
-    const auto* code = method->get_dex_code();
+DexMethodInfos load_dex_method_move_info(const std::string& dir) {
+  return load_dex_method_infos(dir, [](const DexCode* code) {
     int num_moves = 0;
     int moves_size = 0;
     if (code) {
@@ -179,10 +236,21 @@ DexMethodInfoMap load_dex_method_move_info(const std::string& dir) {
         }
       }
     }
-    result.emplace(key, std::make_tuple(num_moves, moves_size));
+    return std::make_tuple(num_moves, moves_size);
   });
+}
 
-  return result;
+/*
+ * Returns the package of a method name like "Lcom/foo/Bar;.baz:()V", as
+ * "Lcom/foo/".
+ */
+std::string get_package(const std::string& method_name) {
+  auto cls_end = method_name.find(';');
+  auto pkg_end = method_name.rfind('/', cls_end);
+  if (cls_end == std::string::npos || pkg_end == std::string::npos) {
+    return "<default>";
+  }
+  return method_name.substr(0, pkg_end + 1);
 }
 
 void dump_method_sizes_from_dexen_dir(const std::string& dexen_dir) {
@@ -191,65 +259,125 @@ void dump_method_sizes_from_dexen_dir(const std::string& dexen_dir) {
   auto info = load_dex_method_info(dexen_dir);
   std::cout << "INFO: " << info.size() << " method information loaded"
             << std::endl;
-  for (const auto& pair : info) {
-    std::cout << "SIZE: " << pair.first << " " << std::get<0>(pair.second)
-              << " " << std::get<1>(pair.second) << std::endl;
+  for (const auto& method : info) {
+    std::cout << "SIZE: " << method.name << " " << std::get<0>(method.sizes)
+              << " " << std::get<1>(method.sizes) << "\n";
   }
+  std::cout << std::flush;
 }
 
+/*
+ * Prints the deltas from dir A to dir B, sorted by the first delta, biggest
+ * growth first. With by_package, the deltas are summed up per package, and
+ * the methods that only exist in A or in B count too.
+ */
 void diff_from_two_dexen_dirs(const std::string& dexen_dir_A,
                               const std::string& dexen_dir_B,
-                              bool is_comparing_dex_size) {
+                              bool is_comparing_dex_size,
+                              bool by_package) {
+  auto load = is_comparing_dex_size ? load_dex_method_info
+                                    : load_dex_method_move_info;
   std::cout << "INFO: "
             << "Loading directory " << dexen_dir_A << " ... " << std::endl;
   RedexContext* A_context = g_redex;
-  auto A_info = is_comparing_dex_size ? load_dex_method_info(dexen_dir_A)
-                                      : load_dex_method_move_info(dexen_dir_A);
+  auto A_info = load(dexen_dir_A);
   std::cout << "INFO: " << A_info.size() << " method information loaded"
             << std::endl;
 
+  // g_redex is global, so B can only be loaded once A is done.
   std::cout << "INFO: "
             << "Loading directory " << dexen_dir_B << " ... " << std::endl;
   std::unique_ptr<RedexContext> B_context(new RedexContext());
   g_redex = B_context.get();
-  auto B_info = is_comparing_dex_size ? load_dex_method_info(dexen_dir_B)
-                                      : load_dex_method_move_info(dexen_dir_B);
+  auto B_info = load(dexen_dir_B);
   std::cout << "INFO: " << B_info.size() << " method information loaded"
             << std::endl;
+  g_redex = A_context;
 
   std::cout << "Diffing A and B... " << std::endl;
-  DexMethodInfoMap diff;
+  auto B_index = index_methods(B_info);
+  std::vector<std::pair<const std::string*, MethodSizes>> diff;
+  std::unordered_map<std::string, MethodSizes> package_diff;
+  auto add_to_package = [&](const std::string& name, int delta0, int delta1) {
+    auto& sizes = package_diff[get_package(name)];
+    std::get<0>(sizes) += delta0;
+    std::get<1>(sizes) += delta1;
+  };
   int total_disappear_method_moves = 0;
   int total_disappear_method_move_sizes = 0;
-  for (auto&& pair : A_info) {
-    auto found = B_info.find(pair.first);
-    if (found == end(B_info)) {
+  int total_num_moves = 0;
+  int total_move_sizes = 0;
+  std::unordered_set<const MethodInfo*> matched;
+  for (const auto& A_method : A_info) {
+    auto found = B_index.find(NameKey{A_method.name_hash, &A_method.name});
+    const auto& A_sizes = A_method.sizes;
+    if (found == end(B_index)) {
       if (!is_comparing_dex_size) {
-        total_disappear_method_moves += std::get<0>(pair.second);
-        total_disappear_method_move_sizes += std::get<1>(pair.second);
+        total_disappear_method_moves += std::get<0>(A_sizes);
+        total_disappear_method_move_sizes += std::get<1>(A_sizes);
+      }
+      if (by_package) {
+        add_to_package(
+            A_method.name, -std::get<0>(A_sizes), -std::get<1>(A_sizes));
       }
       continue;
     }
-    const auto& A_sizes = pair.second;
-    const auto& B_sizes = found->second;
+    matched.insert(found->second);
+    const auto& B_sizes = found->second->sizes;
     if (A_sizes == B_sizes) {
       continue;
     }
-
-    diff.emplace(pair.first,
-                 std::make_tuple(std::get<0>(B_sizes) - std::get<0>(A_sizes),
-                                 std::get<1>(B_sizes) - std::get<1>(A_sizes)));
-  }
-  int total_num_moves = 0;
-  int total_move_sizes = 0;
-  for (const auto& pair : diff) {
-    std::cout << "DIFF: " << pair.first << " " << std::get<0>(pair.second)
-              << " " << std::get<1>(pair.second) << std::endl;
+    auto delta0 = std::get<0>(B_sizes) - std::get<0>(A_sizes);
+    auto delta1 = std::get<1>(B_sizes) - std::get<1>(A_sizes);
+    if (by_package) {
+      add_to_package(A_method.name, delta0, delta1);
+    }
     if (!is_comparing_dex_size) {
-      total_num_moves += std::get<0>(pair.second);
-      total_move_sizes += std::get<1>(pair.second);
+      total_num_moves += delta0;
+      total_move_sizes += delta1;
+    }
+    diff.emplace_back(&A_method.name, std::make_tuple(delta0, delta1));
+  }
+  if (by_package) {
+    for (const auto& B_method : B_info) {
+      if (!matched.count(&B_method)) {
+        add_to_package(B_method.name, std::get<0>(B_method.sizes),
+                       std::get<1>(B_method.sizes));
+      }
+    }
+  }
+
+  auto by_delta = [](const auto& a, const auto& b) {
+    if (std::get<0>(a.second) != std::get<0>(b.second)) {
+      return std::get<0>(a.second) > std::get<0>(b.second);
+    }
+    return std::get<1>(a.second) > std::get<1>(b.second);
+  };
+  if (by_package) {
+    std::vector<std::pair<std::string, MethodSizes>> packages(
+        package_diff.begin(), package_diff.end());
+    std::stable_sort(packages.begin(), packages.end(),
+                     [&](const auto& a, const auto& b) {
+                       if (a.second != b.second) {
+                         return by_delta(a, b);
+                       }
+                       return a.first < b.first;
+                     });
+    for (const auto& pair : packages) {
+      std::cout << "PACKAGE DIFF: " << pair.first << " "
+                << std::get<0>(pair.second) << " " << std::get<1>(pair.second)
+                << "\n";
+    }
+  } else {
+    // A is in scope order, and the sort is stable, so methods with the same
+    // deltas stay in that order.
+    std::stable_sort(diff.begin(), diff.end(), by_delta);
+    for (const auto& pair : diff) {
+      std::cout << "DIFF: " << *pair.first << " " << std::get<0>(pair.second)
+                << " " << std::get<1>(pair.second) << "\n";
     }
   }
+  std::cout << std::flush;
   if (!is_comparing_dex_size) {
     std::cout << "DISAPPEARED METHODS: #moves: " << total_disappear_method_moves
               << ", move sizes: " << total_disappear_method_move_sizes
@@ -261,8 +389,6 @@ void diff_from_two_dexen_dirs(const std::string& dexen_dir_A,
         << total_num_moves - total_disappear_method_moves << ", move sizes: "
         << total_move_sizes - total_disappear_method_move_sizes << std::endl;
   }
-
-  g_redex = A_context;
 }
 
 void dump_method_move_info_from_dex_dir(const std::string& dex_dir) {
@@ -271,10 +397,11 @@ void dump_method_move_info_from_dex_dir(const std::string& dex_dir) {
   auto info = load_dex_method_move_info(dex_dir);
   std::cout << "INFO: " << info.size() << " method information loaded"
             << std::endl;
-  for (const auto& pair : info) {
-    std::cout << pair.first << ": #moves = " << std::get<0>(pair.second)
-              << ", size = " << std::get<1>(pair.second) << std::endl;
+  for (const auto& method : info) {
+    std::cout << method.name << ": #moves = " << std::get<0>(method.sizes)
+              << ", size = " << std::get<1>(method.sizes) << "\n";
   }
+  std::cout << std::flush;
 }
 
 class DiffMethodSizes : public Tool {
@@ -293,10 +420,14 @@ class DiffMethodSizes : public Tool {
         "directories are given, compare the method sizes")(
         "show-moves,s",
         po::value<std::vector<std::string>>()->multitoken(),
-        "show number of move code and their size for each methods");
+        "show number of move code and their size for each methods")(
+        "by-package,p",
+        po::bool_switch(),
+        "when comparing two directories, sum up the deltas per package");
   }
 
   void run(const po::variables_map& options) override {
+    bool by_package = options["by-package"].as<bool>();
     if (!options["commandline"].empty()) {
       diff_in_out_jars_from_command_line(
           options["commandline"].as<std::string>());
@@ -309,7 +440,8 @@ class DiffMethodSizes : public Tool {
         break;
       case 2:
         diff_from_two_dexen_dirs(
-            dexen_dirs[0], dexen_dirs[1], true /* is_comparing_dex_size */);
+            dexen_dirs[0], dexen_dirs[1], true /* is_comparing_dex_size */,
+            by_package);
         break;
       default:
         std::cerr << "Only one or two --dexendir can be provided" << std::endl;
@@ -324,7 +456,8 @@ class DiffMethodSizes : public Tool {
         break;
       case 2:
         diff_from_two_dexen_dirs(
-            dex_dirs[0], dex_dirs[1], false /* is_comparing_dex_size */);
+            dex_dirs[0], dex_dirs[1], false /* is_comparing_dex_size */,
+            by_package);
         break;
       default:
         std::cerr << "Only one or two --dexendir can be provided" << std::endl;
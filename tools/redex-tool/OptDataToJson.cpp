@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include <json/json.h>
+
+#include "OptData.h"
+#include "Tool.h"
+
+/*
+ * This tool turns the redex-opt-decisions.bin that redex-all writes with
+ * "opt_decisions": {"format": "binary"} back into the tables of
+ * redex-opt-decisions.json.
+ */
+namespace {
+
+class OptDataToJson : public Tool {
+ public:
+  OptDataToJson()
+      : Tool("opt-data-to-json", "convert binary opt decisions to JSON") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "input,i",
+        po::value<std::string>()->value_name("redex-opt-decisions.bin"),
+        "path to the binary opt decisions")(
+        "output,o",
+        po::value<std::string>()->value_name("redex-opt-decisions.json"),
+        "path to the JSON output (defaults to stdout)");
+  }
+
+  void run(const po::variables_map& options) override {
+    std::ifstream ifs(options["input"].as<std::string>(), std::ios::binary);
+    auto tables = opt_metadata::OptDataTables::read_binary(ifs);
+    Json::StyledStreamWriter writer;
+    if (options.count("output")) {
+      std::ofstream ofs(options["output"].as<std::string>(),
+                        std::ofstream::out | std::ofstream::trunc);
+      writer.write(ofs, tables.to_json());
+    } else {
+      writer.write(std::cout, tables.to_json());
+    }
+  }
+};
+
+static OptDataToJson s_tool;
+
+} // namespace
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "ApkManager.h"
+#include "Timer.h"
+#include "Tool.h"
+
+/*
+ * This tool zips up an unpacked APK with ApkManager::write_apk, which
+ * compresses the entries on all cores. redex.py uses it in place of Python's
+ * zipfile when given --apk-writer, to create the APK that then goes through
+ * zipalign and the signer.
+ *
+ * --stored-entries names a file with the paths in the APK of the entries to
+ * store, one per line; redex.py lists the entries that the input APK stored.
+ */
+namespace {
+
+class PackApk : public Tool {
+ public:
+  PackApk() : Tool("pack-apk", "zip up an unpacked apk in parallel") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "apkdir,a",
+        po::value<std::string>()->value_name("/tmp/apk")->required(),
+        "directory of the unpacked apk")(
+        "out,o",
+        po::value<std::string>()->value_name("unaligned.apk")->required(),
+        "apk to write")(
+        "stored-entries,s",
+        po::value<std::string>()->value_name("stored.txt"),
+        "file listing the entries to store without compression")(
+        "level,l",
+        po::value<int>()->default_value(9),
+        "deflate compression level")(
+        "jobs,j",
+        po::value<size_t>()->default_value(0),
+        "number of compression threads, 0 for one per core");
+  }
+
+  void run(const po::variables_map& options) override {
+    ApkWriteOptions write_options;
+    if (options.count("stored-entries")) {
+      const auto& path = options["stored-entries"].as<std::string>();
+      std::ifstream in(path);
+      if (!in) {
+        std::cerr << "Could not read " << path << std::endl;
+        return;
+      }
+      std::string entry;
+      while (std::getline(in, entry)) {
+        if (!entry.empty()) {
+          write_options.stored_entries.insert(entry);
+        }
+      }
+    }
+    write_options.compression_level = options["level"].as<int>();
+    write_options.num_threads = options["jobs"].as<size_t>();
+
+    Timer t("Writing " + options["out"].as<std::string>());
+    auto apk_dir = options["apkdir"].as<std::string>();
+    ApkManager mgr(std::move(apk_dir));
+    auto count = mgr.write_apk(options["out"].as<std::string>(), write_options);
+    std::cout << "Wrote " << count << " entries" << std::endl;
+  }
+};
+
+} // namespace
+
+static PackApk s_pack_apk;
@@ -0,0 +1,569 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DexCommon.h"
+#include "DexEncoding.h"
+#include "DexInstruction.h"
+#include "ProguardMap.h"
+#include "Tool.h"
+
+/*
+ * This tool replays a method/class access trace against output dexes and
+ * simulates the page faults of the mmap'ed files, so that layouts produced by
+ * different sort modes or InterDex configurations can be compared offline.
+ *
+ * The trace has one access per line, a method or a class followed by an
+ * optional timestamp, the same format as the `method_trace_file` option:
+ *
+ * Lcom/foo/Bar;.onCreate:(Landroid/os/Bundle;)V 12
+ * Lcom/foo/Baz; 15
+ *
+ * Entries are replayed in timestamp order. Running a method touches its
+ * method id, its code item and the id and data of the strings it loads; the
+ * first access to a class touches its class def, class data and annotations
+ * directory. A fault maps in the faulting page and the readahead window that
+ * follows it.
+ *
+ * trace entries: 1000 (998 found)
+ * dex: classes.dex (1234 pages)
+ *   page faults: 57
+ *   pages touched: 190
+ *   working set: 228 pages (912 KiB)
+ *   section         bytes  pages  faults
+ *   code           123456     31      11
+ *   ...
+ */
+namespace {
+
+enum Section {
+  IDS,
+  STRINGS,
+  CODE,
+  CLASS_DATA,
+  ANNOTATIONS,
+  OTHER,
+  NUM_SECTIONS,
+};
+
+const char* section_name(Section section) {
+  switch (section) {
+  case IDS:
+    return "ids";
+  case STRINGS:
+    return "strings";
+  case CODE:
+    return "code";
+  case CLASS_DATA:
+    return "class_data";
+  case ANNOTATIONS:
+    return "annotations";
+  case OTHER:
+  case NUM_SECTIONS:
+    break;
+  }
+  return "other";
+}
+
+Section section_of_map_item(uint16_t type) {
+  switch (type) {
+  case TYPE_HEADER_ITEM:
+  case TYPE_STRING_ID_ITEM:
+  case TYPE_TYPE_ID_ITEM:
+  case TYPE_PROTO_ID_ITEM:
+  case TYPE_FIELD_ID_ITEM:
+  case TYPE_METHOD_ID_ITEM:
+  case TYPE_CLASS_DEF_ITEM:
+    return IDS;
+  case TYPE_STRING_DATA_ITEM:
+    return STRINGS;
+  case TYPE_CODE_ITEM:
+    return CODE;
+  case TYPE_CLASS_DATA_ITEM:
+    return CLASS_DATA;
+  case TYPE_ANNOTATION_SET_REF_LIST:
+  case TYPE_ANNOTATION_SET_ITEM:
+  case TYPE_ANNOTATION_ITEM:
+  case TYPE_ANNOTATIONS_DIR_ITEM:
+    return ANNOTATIONS;
+  default:
+    return OTHER;
+  }
+}
+
+struct SectionStats {
+  size_t bytes{0};
+  size_t pages{0};
+  size_t faults{0};
+};
+
+struct Stats {
+  size_t num_pages{0};
+  size_t faults{0};
+  size_t pages_touched{0};
+  size_t pages_resident{0};
+  SectionStats sections[NUM_SECTIONS];
+
+  Stats& operator+=(const Stats& that) {
+    num_pages += that.num_pages;
+    faults += that.faults;
+    pages_touched += that.pages_touched;
+    pages_resident += that.pages_resident;
+    for (size_t i = 0; i < NUM_SECTIONS; ++i) {
+      sections[i].bytes += that.sections[i].bytes;
+      sections[i].pages += that.sections[i].pages;
+      sections[i].faults += that.sections[i].faults;
+    }
+    return *this;
+  }
+};
+
+/*
+ * The page cache of a single mmap'ed file.
+ */
+class PageCache {
+ public:
+  PageCache(size_t file_size, size_t page_size, size_t readahead_pages)
+      : m_page_size(page_size),
+        m_readahead_pages(std::max<size_t>(readahead_pages, 1)),
+        m_resident((file_size + page_size - 1) / page_size),
+        m_touched(m_resident.size()) {
+    for (auto& touched : m_section_touched) {
+      touched.resize(m_resident.size());
+    }
+    m_stats.num_pages = m_resident.size();
+  }
+
+  void access(uint32_t offset, uint32_t size, Section section) {
+    if (size == 0) {
+      return;
+    }
+    auto& stats = m_stats.sections[section];
+    stats.bytes += size;
+    auto last = std::min<size_t>((offset + size - 1) / m_page_size,
+                                 m_resident.size() - 1);
+    for (size_t page = offset / m_page_size; page <= last; ++page) {
+      if (!m_resident[page]) {
+        ++m_stats.faults;
+        ++stats.faults;
+        auto end = std::min(page + m_readahead_pages, m_resident.size());
+        for (auto p = page; p < end; ++p) {
+          if (!m_resident[p]) {
+            m_resident[p] = true;
+            ++m_stats.pages_resident;
+          }
+        }
+      }
+      if (!m_touched[page]) {
+        m_touched[page] = true;
+        ++m_stats.pages_touched;
+      }
+      if (!m_section_touched[section][page]) {
+        m_section_touched[section][page] = true;
+        ++stats.pages;
+      }
+    }
+  }
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  size_t m_page_size;
+  size_t m_readahead_pages;
+  std::vector<bool> m_resident;
+  std::vector<bool> m_touched;
+  std::vector<bool> m_section_touched[NUM_SECTIONS];
+  Stats m_stats;
+};
+
+/*
+ * The offsets and sizes of the items that the trace can touch, read straight
+ * from the bytes of a dex file.
+ */
+class DexLayout {
+ public:
+  explicit DexLayout(const std::string& path) {
+    memset(&m_rd, 0, sizeof(m_rd));
+    open_dex_file(path.c_str(), &m_rd);
+    m_size = m_rd.dex_size;
+    unsigned count;
+    dex_map_item* items;
+    get_dex_map_items(&m_rd, &count, &items);
+    m_map_items.assign(items, items + count);
+    std::sort(m_map_items.begin(), m_map_items.end(),
+              [](const dex_map_item& a, const dex_map_item& b) {
+                return a.offset < b.offset;
+              });
+    index_classes();
+  }
+
+  size_t size() const { return m_size; }
+
+  bool has_method(const std::string& name) const {
+    return m_methods.count(name);
+  }
+
+  bool has_class(const std::string& name) const {
+    return m_classes.count(name);
+  }
+
+  void access_method(const std::string& name, PageCache& cache) {
+    const auto& method = m_methods.at(name);
+    access_class(method.class_def_idx, cache);
+    access(m_rd.dexh->method_ids_off +
+               method.method_idx * sizeof(dex_method_id),
+           sizeof(dex_method_id),
+           cache);
+    if (method.code_off == 0) {
+      return;
+    }
+    access(method.code_off, code_item_size(method.code_off), cache);
+    auto code = (const dex_code_item*)(m_rd.dexmmap + method.code_off);
+    auto insns = (const uint16_t*)(code + 1);
+    auto end = insns + code->insns_size;
+    while (insns < end) {
+      auto op = *insns & 0xff;
+      if (op == DOPCODE_CONST_STRING) {
+        access_string(insns[1], cache);
+      } else if (op == DOPCODE_CONST_STRING_JUMBO) {
+        access_string(insns[1] | (uint32_t(insns[2]) << 16), cache);
+      }
+      insns += insn_size(insns);
+    }
+  }
+
+  void access_class(const std::string& name, PageCache& cache) {
+    access_class(m_classes.at(name), cache);
+  }
+
+ private:
+  struct MethodInfo {
+    uint32_t class_def_idx;
+    uint32_t method_idx;
+    uint32_t code_off;
+  };
+
+  void index_classes() {
+    auto num_classes = m_rd.dexh->class_defs_size;
+    m_class_accessed.resize(num_classes);
+    for (uint32_t i = 0; i < num_classes; ++i) {
+      const auto& class_def = m_rd.dex_class_defs[i];
+      m_classes.emplace(dex_string_by_type_idx(&m_rd, class_def.typeidx), i);
+      if (class_def.class_data_offset == 0) {
+        continue;
+      }
+      auto ptr = (const uint8_t*)(m_rd.dexmmap + class_def.class_data_offset);
+      auto sfields = read_uleb128(&ptr);
+      auto ifields = read_uleb128(&ptr);
+      auto dmethods = read_uleb128(&ptr);
+      auto vmethods = read_uleb128(&ptr);
+      for (uint32_t f = 0; f < sfields + ifields; ++f) {
+        read_uleb128(&ptr);
+        read_uleb128(&ptr);
+      }
+      for (auto num_methods : {dmethods, vmethods}) {
+        uint32_t method_idx = 0;
+        for (uint32_t m = 0; m < num_methods; ++m) {
+          method_idx += read_uleb128(&ptr);
+          read_uleb128(&ptr);
+          auto code_off = read_uleb128(&ptr);
+          m_methods.emplace(method_name(method_idx),
+                            MethodInfo{i, method_idx, code_off});
+        }
+      }
+    }
+  }
+
+  std::string method_name(uint32_t method_idx) {
+    const auto& method_id = m_rd.dex_method_ids[method_idx];
+    const auto& proto_id = m_rd.dex_proto_ids[method_id.protoidx];
+    std::ostringstream ss;
+    ss << dex_string_by_type_idx(&m_rd, method_id.classidx) << "."
+       << dex_string_by_idx(&m_rd, method_id.nameidx) << ":(";
+    if (proto_id.param_off != 0) {
+      auto list = (const uint32_t*)(m_rd.dexmmap + proto_id.param_off);
+      auto types = (const uint16_t*)(list + 1);
+      for (uint32_t i = 0; i < *list; ++i) {
+        ss << dex_string_by_type_idx(&m_rd, types[i]);
+      }
+    }
+    ss << ")" << dex_string_by_type_idx(&m_rd, proto_id.rtypeidx);
+    return ss.str();
+  }
+
+  void access_class(uint32_t class_def_idx, PageCache& cache) {
+    if (m_class_accessed[class_def_idx]) {
+      return;
+    }
+    m_class_accessed[class_def_idx] = true;
+    const auto& class_def = m_rd.dex_class_defs[class_def_idx];
+    access(m_rd.dexh->class_defs_off + class_def_idx * sizeof(dex_class_def),
+           sizeof(dex_class_def),
+           cache);
+    if (class_def.class_data_offset != 0) {
+      access(class_def.class_data_offset,
+             class_data_size(class_def.class_data_offset),
+             cache);
+    }
+    if (class_def.annotations_off != 0) {
+      auto dir = (const dex_annotations_directory_item*)(m_rd.dexmmap +
+                                                         class_def
+                                                             .annotations_off);
+      access(class_def.annotations_off,
+             sizeof(dex_annotations_directory_item) +
+                 8 * (dir->fields_size + dir->methods_size +
+                      dir->parameters_size),
+             cache);
+    }
+  }
+
+  void access_string(uint32_t string_idx, PageCache& cache) {
+    access(m_rd.dexh->string_ids_off + string_idx * sizeof(dex_string_id),
+           sizeof(dex_string_id),
+           cache);
+    auto data = dex_raw_string_by_idx(&m_rd, string_idx);
+    auto chars = dex_string_by_idx(&m_rd, string_idx);
+    access(m_rd.dex_string_ids[string_idx].offset,
+           (chars - data) + strlen(chars) + 1,
+           cache);
+  }
+
+  // Splits an access along the map items it overlaps, so that each part is
+  // attributed to its own section.
+  void access(uint32_t offset, uint32_t size, PageCache& cache) {
+    auto end = offset + size;
+    auto it = std::upper_bound(m_map_items.begin(), m_map_items.end(), offset,
+                               [](uint32_t off, const dex_map_item& item) {
+                                 return off < item.offset;
+                               });
+    while (offset < end) {
+      auto section = it == m_map_items.begin()
+                         ? OTHER
+                         : section_of_map_item(std::prev(it)->type);
+      auto part_end = it == m_map_items.end() ? end : std::min(end, it->offset);
+      cache.access(offset, part_end - offset, section);
+      offset = part_end;
+      if (it != m_map_items.end()) {
+        ++it;
+      }
+    }
+  }
+
+  uint32_t class_data_size(uint32_t offset) const {
+    auto start = (const uint8_t*)(m_rd.dexmmap + offset);
+    auto ptr = start;
+    auto sfields = read_uleb128(&ptr);
+    auto ifields = read_uleb128(&ptr);
+    auto dmethods = read_uleb128(&ptr);
+    auto vmethods = read_uleb128(&ptr);
+    auto num_ulebs = 2 * (sfields + ifields) + 3 * (dmethods + vmethods);
+    for (uint32_t i = 0; i < num_ulebs; ++i) {
+      read_uleb128(&ptr);
+    }
+    return ptr - start;
+  }
+
+  uint32_t code_item_size(uint32_t offset) const {
+    auto start = (const uint8_t*)(m_rd.dexmmap + offset);
+    auto code = (const dex_code_item*)start;
+    auto ptr = start + sizeof(dex_code_item) + code->insns_size * 2;
+    if (code->tries_size == 0) {
+      return ptr - start;
+    }
+    if (code->insns_size & 1) {
+      ptr += 2;
+    }
+    ptr += code->tries_size * sizeof(dex_tries_item);
+    auto num_handlers = read_uleb128(&ptr);
+    for (uint32_t i = 0; i < num_handlers; ++i) {
+      auto num_catches = read_sleb128(&ptr);
+      for (int32_t c = 0; c < std::abs(num_catches); ++c) {
+        read_uleb128(&ptr);
+        read_uleb128(&ptr);
+      }
+      if (num_catches <= 0) {
+        read_uleb128(&ptr);
+      }
+    }
+    return ptr - start;
+  }
+
+  // The number of code units of an instruction, including payloads.
+  static size_t insn_size(const uint16_t* insns) {
+    switch (*insns) {
+    case FOPCODE_PACKED_SWITCH:
+      return 4 + insns[1] * 2;
+    case FOPCODE_SPARSE_SWITCH:
+      return 2 + insns[1] * 4;
+    case FOPCODE_FILLED_ARRAY: {
+      uint32_t size = insns[2] | (uint32_t(insns[3]) << 16);
+      return 4 + (insns[1] * size + 1) / 2;
+    }
+    default:
+      break;
+    }
+    static std::vector<uint16_t> sizes = [] {
+      std::vector<uint16_t> sizes(256);
+      for (size_t op = 0; op < sizes.size(); ++op) {
+        sizes[op] = DexInstruction(static_cast<DexOpcode>(op)).size();
+      }
+      return sizes;
+    }();
+    return std::max<size_t>(sizes[*insns & 0xff], 1);
+  }
+
+  ddump_data m_rd;
+  size_t m_size;
+  std::vector<dex_map_item> m_map_items;
+  std::unordered_map<std::string, MethodInfo> m_methods;
+  std::unordered_map<std::string, uint32_t> m_classes;
+  std::vector<bool> m_class_accessed;
+};
+
+std::vector<std::string> read_trace(const std::string& path,
+                                    const ProguardMap& pgmap) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open trace file " << path << std::endl;
+    exit(1);
+  }
+  std::vector<std::pair<uint64_t, std::string>> entries;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    std::string symbol;
+    if (!(ss >> symbol)) {
+      continue;
+    }
+    uint64_t timestamp;
+    if (!(ss >> timestamp)) {
+      timestamp = entries.size();
+    }
+    bool is_method = symbol.find(':') != std::string::npos;
+    entries.emplace_back(timestamp,
+                         is_method ? pgmap.translate_method(symbol)
+                                   : pgmap.translate_class(symbol));
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const std::pair<uint64_t, std::string>& a,
+                      const std::pair<uint64_t, std::string>& b) {
+                     return a.first < b.first;
+                   });
+  std::vector<std::string> trace;
+  trace.reserve(entries.size());
+  for (auto& entry : entries) {
+    trace.push_back(std::move(entry.second));
+  }
+  return trace;
+}
+
+void print_stats(std::ostream& out,
+                 const std::string& name,
+                 const Stats& stats,
+                 size_t page_size) {
+  out << "dex: " << name << " (" << stats.num_pages << " pages)\n"
+      << "  page faults: " << stats.faults << "\n"
+      << "  pages touched: " << stats.pages_touched << "\n"
+      << "  working set: " << stats.pages_resident << " pages ("
+      << stats.pages_resident * page_size / 1024 << " KiB)\n"
+      << "  " << std::left << std::setw(12) << "section" << std::right
+      << std::setw(12) << "bytes" << std::setw(8) << "pages" << std::setw(8)
+      << "faults\n";
+  for (size_t i = 0; i < NUM_SECTIONS; ++i) {
+    const auto& section = stats.sections[i];
+    out << "  " << std::left << std::setw(12)
+        << section_name(static_cast<Section>(i)) << std::right << std::setw(12)
+        << section.bytes << std::setw(8) << section.pages << std::setw(8)
+        << section.faults << "\n";
+  }
+}
+
+class PageFaultSimulator : public Tool {
+ public:
+  PageFaultSimulator()
+      : Tool("simulate-page-faults",
+             "replay an access trace against dexes and simulate page faults") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "dex,d",
+        po::value<std::vector<std::string>>()->multitoken()->required(),
+        "path to one or more output dexes")(
+        "trace,t",
+        po::value<std::string>()->value_name("trace.txt")->required(),
+        "path to a method/class access trace")(
+        "rename-map,r",
+        po::value<std::string>()->value_name("redex-rename-map.txt"),
+        "path to a rename map, if the trace has unobfuscated names")(
+        "page-size,p",
+        po::value<size_t>()->default_value(4096),
+        "page size in bytes")(
+        "readahead,a",
+        po::value<size_t>()->default_value(1),
+        "number of pages mapped in by a fault, including the faulting one");
+  }
+
+  void run(const po::variables_map& options) override {
+    ProguardMap pgmap(options.count("rename-map")
+                          ? options["rename-map"].as<std::string>()
+                          : "/dev/null");
+    auto trace = read_trace(options["trace"].as<std::string>(), pgmap);
+    auto page_size = options["page-size"].as<size_t>();
+    auto readahead = options["readahead"].as<size_t>();
+
+    std::vector<std::unique_ptr<DexLayout>> dexes;
+    std::vector<PageCache> caches;
+    for (const auto& path : options["dex"].as<std::vector<std::string>>()) {
+      dexes.emplace_back(new DexLayout(path));
+      caches.emplace_back(dexes.back()->size(), page_size, readahead);
+    }
+
+    size_t found = 0;
+    for (const auto& symbol : trace) {
+      bool is_method = symbol.find(':') != std::string::npos;
+      for (size_t i = 0; i < dexes.size(); ++i) {
+        auto& dex = *dexes[i];
+        if (is_method ? dex.has_method(symbol) : dex.has_class(symbol)) {
+          if (is_method) {
+            dex.access_method(symbol, caches[i]);
+          } else {
+            dex.access_class(symbol, caches[i]);
+          }
+          ++found;
+          break;
+        }
+      }
+    }
+
+    std::cout << "trace entries: " << trace.size() << " (" << found
+              << " found)\n";
+    Stats total;
+    const auto& paths = options["dex"].as<std::vector<std::string>>();
+    for (size_t i = 0; i < dexes.size(); ++i) {
+      const auto& stats = caches[i].get_stats();
+      print_stats(std::cout, paths[i], stats, page_size);
+      total += stats;
+    }
+    if (dexes.size() > 1) {
+      print_stats(std::cout, "total", total, page_size);
+    }
+  }
+};
+
+static PageFaultSimulator s_tool;
+
+} // namespace
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "IndexedGraph.h"
+#include "Reachability.h"
+#include "Timer.h"
+#include "Tool.h"
+
+/*
+ * This tool answers questions about a reachability graph in the indexed
+ * format of reachability::dump_indexed_graph, without loading it into Python:
+ *
+ *   --why-kept prints one of the shortest chains of retainers from a seed to
+ *   the object.
+ *
+ *   --dominators prints the objects that every such chain goes through, from
+ *   the object to the seeds. Removing the reason any of them is kept would
+ *   make the object unreachable.
+ */
+namespace {
+
+namespace bs = binary_serialization;
+using reachability::ReachableObjectType;
+
+const char* kind_name(uint8_t kind) {
+  switch (static_cast<ReachableObjectType>(kind)) {
+  case ReachableObjectType::ANNO:
+    return "ANNO";
+  case ReachableObjectType::CLASS:
+    return "CLASS";
+  case ReachableObjectType::FIELD:
+    return "FIELD";
+  case ReachableObjectType::METHOD:
+    return "METHOD";
+  case ReachableObjectType::SEED:
+    return "SEED";
+  }
+  return "UNKNOWN";
+}
+
+bool is_seed(const bs::IndexedGraph& graph, uint32_t node) {
+  return graph.kind(node) == static_cast<uint8_t>(ReachableObjectType::SEED);
+}
+
+/*
+ * Only classes and annotations can share names, so wanted is only checked
+ * when the node is one of them.
+ */
+bool has_kind(const bs::IndexedGraph& graph,
+              uint32_t node,
+              ReachableObjectType wanted) {
+  auto kind = static_cast<ReachableObjectType>(graph.kind(node));
+  if (kind != ReachableObjectType::ANNO && kind != ReachableObjectType::CLASS) {
+    return true;
+  }
+  return kind == wanted;
+}
+
+void print_node(const bs::IndexedGraph& graph, uint32_t node) {
+  std::cout << kind_name(graph.kind(node)) << ": " << graph.label(node)
+            << std::endl;
+}
+
+void why_kept(const bs::IndexedGraph& graph, uint32_t node) {
+  // The edges go from each object to the objects that retain it.
+  auto path =
+      bs::shortest_path(graph, node, bs::Direction::SUCCESSORS,
+                        [&](uint32_t n) { return is_seed(graph, n); });
+  if (path.empty()) {
+    std::cout << "Not reachable from any seed" << std::endl;
+    return;
+  }
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    print_node(graph, *it);
+  }
+}
+
+void dominators(const bs::IndexedGraph& graph, uint32_t node) {
+  std::vector<uint32_t> seeds;
+  for (uint32_t i = 0; i < graph.size(); ++i) {
+    if (is_seed(graph, i)) {
+      seeds.push_back(i);
+    }
+  }
+  // Walk from the seeds to the objects they retain.
+  auto idoms =
+      bs::immediate_dominators(graph, seeds, bs::Direction::PREDECESSORS);
+  if (idoms[node] == bs::IndexedGraph::NONE) {
+    std::cout << "Not reachable from any seed" << std::endl;
+    return;
+  }
+  for (auto n = node; n != graph.size(); n = idoms[n]) {
+    print_node(graph, n);
+  }
+}
+
+class ReachabilityQuery : public Tool {
+ public:
+  ReachabilityQuery()
+      : Tool("reachability-query", "query an indexed reachability graph") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "graph,g",
+        po::value<std::string>()->required(),
+        "path to a graph written by reachability::dump_indexed_graph")(
+        "why-kept,w",
+        po::value<std::string>(),
+        "print a shortest chain of retainers from a seed to the object")(
+        "dominators,d",
+        po::value<std::string>(),
+        "print the objects that all the chains of retainers from the seeds "
+        "to the object go through")(
+        "annotation,a",
+        po::bool_switch(),
+        "look up an annotation, not the class with the same name");
+  }
+
+  void run(const po::variables_map& options) override {
+    Timer t("Querying reachability graph");
+    auto graph = bs::IndexedGraph::open(options["graph"].as<std::string>());
+    auto query = [&](const std::string& option,
+                     void (*answer)(const bs::IndexedGraph&, uint32_t)) {
+      if (options[option].empty()) {
+        return;
+      }
+      const auto& name = options[option].as<std::string>();
+      auto kind = options["annotation"].as<bool>() ? ReachableObjectType::ANNO
+                                                   : ReachableObjectType::CLASS;
+      for (auto node : graph->find(name)) {
+        if (has_kind(*graph, node, kind)) {
+          answer(*graph, node);
+          return;
+        }
+      }
+      std::cerr << "No object named " << name << " in the graph" << std::endl;
+    };
+    query("why-kept", why_kept);
+    query("dominators", dominators);
+  }
+};
+
+static ReachabilityQuery s_reachability_query;
+
+} // namespace
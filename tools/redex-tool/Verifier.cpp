@@ -11,8 +11,13 @@
 #include "IRInstruction.h"
 #include "DexUtil.h"
 #include "ReachableClasses.h"
+#include "DexHasher.h"
+#include "WorkQueue.h"
 
 #include <algorithm>
+#include <atomic>
+#include <boost/functional/hash.hpp>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <string>
@@ -20,8 +25,6 @@
 #include <unordered_set>
 #include <unordered_map>
 
-using refs_t = std::unordered_map<const DexClass*,
-                                  std::set<DexClass*, dexclasses_comparator>>;
 using class_to_store_map_t = std::unordered_map<const DexClass*, DexStore*>;
 using allowed_store_map_t =
     std::unordered_map<std::string, std::set<std::string>>;
@@ -70,95 +73,169 @@ void build_allowed_stores(
 }
 
 /**
- * Helper function that scans all the opcodes in the application and produces a map of references
- * from the class containing the opcode to the class referenced by the opcode.
- *
- * @param scope all classes we're processing
- * @param dmethod_refs [out] all refs to dmethods in the application
- * @param class_refs [out] all refs to classes in the application
- *
+ * Collects the classes referenced by the opcodes of `cls`.
  */
-void build_refs(
-    const Scope& scope,
-    refs_t& class_refs) {
+std::set<DexClass*, dexclasses_comparator> build_refs(DexClass* cls) {
   // TODO: walk through annotations
+  std::set<DexClass*, dexclasses_comparator> refs;
   walk::opcodes(
-    scope,
+    std::vector<DexClass*>{cls},
     [](const DexMethod*) { return true; },
-    [&](const DexMethod* meth, IRInstruction* insn) {
+    [&](const DexMethod*, IRInstruction* insn) {
+      DexClass* tref = nullptr;
       if (insn->has_type()) {
-        const auto tref = type_class(insn->get_type());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
-      }
-      if (insn->has_field()) {
-        const auto tref = type_class(insn->get_field()->get_class());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
-      }
-      if (insn->has_method()) {
-        // log methods class type, for virtual methods, this may not actually exist and true
-        // verification would require that the binding refers to a class that is valid.
-        const auto mref = type_class(insn->get_method()->get_class());
-        if (mref) class_refs[mref].emplace(type_class(meth->get_class()));
-
-        // don't log return type or types of parameters for now, but this is how you might do it.
-        //const auto proto = insn->get_method()->get_proto();
-        // const auto rref = type_class(proto->get_rtype());
-        // if (rref) class_refs[rref].emplace(type_class(meth->get_class()));
-        // for (const auto arg : proto->get_args()->get_type_list()) {
-        //   const auto aref = type_class(arg);
-        //   if (aref) class_refs[aref].emplace(type_class(meth->get_class()));
-        // }
-
-        return;
+        tref = type_class(insn->get_type());
+      } else if (insn->has_field()) {
+        tref = type_class(insn->get_field()->get_class());
+      } else if (insn->has_method()) {
+        // log methods class type, for virtual methods, this may not actually
+        // exist and true verification would require that the binding refers
+        // to a class that is valid.
+        tref = type_class(insn->get_method()->get_class());
       }
+      if (tref) refs.emplace(tref);
     });
+  return refs;
 }
 
-void verify(DexStoresVector& stores) {
-  // Buld references map and class-to-store map
-  refs_t class_refs;
+size_t class_hash(DexClass* cls) {
+  auto hash = hashing::DexClassHasher(cls).run();
+  size_t seed = 0;
+  boost::hash_combine(seed, hash.signature_hash);
+  boost::hash_combine(seed, hash.code_hash);
+  boost::hash_combine(seed, hash.registers_hash);
+  return seed;
+}
+
+/**
+ * The manifest of a verification run lists every class, with its store and
+ * the hash of the class, one per line:
+ *
+ *   Lcom/foo/Bar; store_name 0123456789abcdef
+ */
+struct ManifestEntry {
+  std::string store;
+  std::string hash;
+};
+using manifest_t = std::unordered_map<std::string, ManifestEntry>;
+
+bool read_manifest(const std::string& path, manifest_t& manifest) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string cls, store, hash;
+  while (in >> cls >> store >> hash) {
+    manifest[cls] = ManifestEntry{store, hash};
+  }
+  return true;
+}
+
+/**
+ * Verifies the classes of all stores, each class in parallel. With
+ * `previous_manifest`, only the classes whose hash changed since that run are
+ * verified: whether a reference is legal only depends on the stores of the
+ * referer and of the referenced class, so the classes that did not change
+ * still have the same references and the same verdicts. That no longer holds
+ * once classes are added, removed or moved to another store, so then all of
+ * them are verified.
+ */
+void verify(DexStoresVector& stores,
+            const std::string& previous_manifest,
+            const std::string& manifest_out) {
+  // Build class-to-store map
+  Scope scope;
   class_to_store_map_t cls_store_map;
   for (auto& store : stores) {
-    auto scope = build_class_scope(store.get_dexen());
-    for (const auto& cls : scope) {
+    for (const auto& cls : build_class_scope(store.get_dexen())) {
       cls_store_map[cls] = &store;
+      scope.push_back(cls);
     }
-    build_refs(scope, class_refs);
-  }
-  int references = 0;
-  for (const auto& refs : class_refs) {
-    references += (int) refs.second.size();
   }
 
   // Build allowed stor (references) map
   allowed_store_map_t allowed_store_map;
   build_allowed_stores(stores, allowed_store_map);
 
-  // Verify references
-  for (const auto& store : stores) {
+  bool incremental = !previous_manifest.empty() || !manifest_out.empty();
+  std::vector<std::string> hashes(scope.size());
+  if (incremental) {
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      hashes[i] = hashing::hash_to_string(class_hash(scope[i]));
+    });
+    for (size_t i = 0; i < scope.size(); i++) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+
+  std::vector<bool> to_verify(scope.size(), true);
+  if (!previous_manifest.empty()) {
+    manifest_t manifest;
+    if (!read_manifest(previous_manifest, manifest)) {
+      fprintf(stderr, "Could not read manifest %s, verifying all classes\n",
+              previous_manifest.c_str());
+    } else {
+      bool same_layout = manifest.size() == scope.size();
+      for (size_t i = 0; i < scope.size() && same_layout; i++) {
+        auto it = manifest.find(scope[i]->get_name()->str());
+        same_layout = it != manifest.end() &&
+                      it->second.store == cls_store_map[scope[i]]->get_name();
+        to_verify[i] = !same_layout || it->second.hash != hashes[i];
+      }
+      if (!same_layout) {
+        fprintf(stderr,
+                "Classes were added, removed or moved between stores since "
+                "%s, verifying all classes\n",
+                previous_manifest.c_str());
+        std::fill(to_verify.begin(), to_verify.end(), true);
+      }
+    }
+  }
+
+  // Verify references. The diagnostics of each class are kept apart, and
+  // printed in scope order once all classes are done.
+  std::vector<std::string> diagnostics(scope.size());
+  std::atomic<size_t> illegal_references{0};
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto referer = scope[i];
+    const auto& referer_store_name = cls_store_map.at(referer)->get_name();
     // Validate that it's legal for each referer to see each reference.
-    for (auto& ref : class_refs) {
-      const auto reference = ref.first;
-      for (const auto& referer : ref.second) {
-        auto reference_store_it = cls_store_map.find(reference);
-        auto referer_store_it = cls_store_map.find(referer);
-        always_assert(referer_store_it != cls_store_map.end());
-        if (reference_store_it != cls_store_map.end()) {
-          std::string referer_store_name = referer_store_it->second->get_name();
-          std::string reference_store_name = reference_store_it->second->get_name();
-          std::set<std::string> allowed_stores = allowed_store_map[reference_store_name];
-          if (allowed_stores.find(referer_store_name) == allowed_stores.end()) {
-            fprintf(stderr,
-              "ILLEGAL REFERENCE from %s %s to %s %s\n",
-              store.get_name().c_str(),
-              referer->get_name()->c_str(),
-              reference_store_name.c_str(),
-              reference->get_name()->c_str());
-          }
-        }
+    for (const auto& reference : build_refs(referer)) {
+      auto reference_store_it = cls_store_map.find(reference);
+      if (reference_store_it == cls_store_map.end()) {
+        continue;
       }
+      const auto& reference_store_name = reference_store_it->second->get_name();
+      const auto& allowed_stores = allowed_store_map.at(reference_store_name);
+      if (allowed_stores.count(referer_store_name) == 0) {
+        diagnostics[i] += "ILLEGAL REFERENCE from " + referer_store_name +
+                          " " + referer->get_name()->str() + " to " +
+                          reference_store_name + " " +
+                          reference->get_name()->str() + "\n";
+        illegal_references++;
+      }
+    }
+  });
+  size_t verified = 0;
+  for (size_t i = 0; i < scope.size(); i++) {
+    if (to_verify[i]) {
+      wq.add_item(i);
+      verified++;
+    }
+  }
+  wq.run_all();
+  for (const auto& class_diagnostics : diagnostics) {
+    fputs(class_diagnostics.c_str(), stderr);
+  }
+  fprintf(stderr, "Verified %zu of %zu classes, %zu illegal references\n",
+          verified, scope.size(), illegal_references.load());
+
+  if (!manifest_out.empty()) {
+    std::ofstream out(manifest_out);
+    for (size_t i = 0; i < scope.size(); i++) {
+      out << scope[i]->get_name()->str() << " "
+          << cls_store_map[scope[i]]->get_name() << " " << hashes[i] << "\n";
     }
   }
 }
@@ -171,6 +248,14 @@ class Verifier : public Tool {
 
   void add_options(po::options_description& options) const override {
     add_standard_options(options);
+    options.add_options()(
+        "manifest,m",
+        po::value<std::string>()->value_name("manifest.txt"),
+        "manifest of a previous run; only verify the classes that changed "
+        "since")(
+        "write-manifest,w",
+        po::value<std::string>()->value_name("manifest.txt"),
+        "write the manifest of this run, for the next --manifest");
   }
 
   void run(const po::variables_map& options) override {
@@ -178,7 +263,11 @@ class Verifier : public Tool {
       options["jars"].as<std::string>(),
       options["apkdir"].as<std::string>(),
       options["dexendir"].as<std::string>());
-    verify(stores);
+    auto option = [&](const char* name) {
+      return options.count(name) ? options[name].as<std::string>()
+                                 : std::string();
+    };
+    verify(stores, option("manifest"), option("write-manifest"));
   }
 
  private:
@@ -765,3 +765,131 @@ void dump_enarr(ddump_data* rd) {
     }
   }
 }
+
+//
+// JSON table dumpers...
+//
+
+static Json::Value json_type_list(ddump_data* rd, uint32_t off) {
+  Json::Value types(Json::arrayValue);
+  if (off) {
+    auto list = (uint32_t*)(rd->dexmmap + off);
+    auto size = *list++;
+    auto type_idxs = (uint16_t*)list;
+    for (uint32_t i = 0; i < size; i++) {
+      types.append(dex_string_by_type_idx(rd, type_idxs[i]));
+    }
+  }
+  return types;
+}
+
+static Json::Value json_proto(ddump_data* rd, uint32_t idx) {
+  dex_proto_id* proto = rd->dex_proto_ids + idx;
+  Json::Value value;
+  value["shorty"] = dex_string_by_idx(rd, proto->shortyidx);
+  value["return_type"] = dex_string_by_type_idx(rd, proto->rtypeidx);
+  value["parameters"] = json_type_list(rd, proto->param_off);
+  return value;
+}
+
+Json::Value json_header(ddump_data* rd) {
+  auto dexh = rd->dexh;
+  Json::Value header;
+  // The magic is "dex\n", followed by the version and a NUL.
+  const char* version = dexh->magic + 4;
+  header["version"] = std::string(version, strnlen(version, 4));
+  header["file_size"] = dexh->file_size;
+  header["string_ids_size"] = dexh->string_ids_size;
+  header["type_ids_size"] = dexh->type_ids_size;
+  header["proto_ids_size"] = dexh->proto_ids_size;
+  header["field_ids_size"] = dexh->field_ids_size;
+  header["method_ids_size"] = dexh->method_ids_size;
+  header["class_defs_size"] = dexh->class_defs_size;
+  header["data_size"] = dexh->data_size;
+  return header;
+}
+
+Json::Value json_strings(ddump_data* rd) {
+  Json::Value strings(Json::arrayValue);
+  for (uint32_t i = 0; i < rd->dexh->string_ids_size; i++) {
+    Json::Value value;
+    value["idx"] = i;
+    value["offset"] = rd->dex_string_ids[i].offset;
+    value["string"] = dex_string_by_idx(rd, i);
+    strings.append(value);
+  }
+  return strings;
+}
+
+Json::Value json_types(ddump_data* rd) {
+  Json::Value types(Json::arrayValue);
+  for (uint32_t i = 0; i < rd->dexh->type_ids_size; i++) {
+    Json::Value value;
+    value["idx"] = i;
+    value["name"] = dex_string_by_type_idx(rd, i);
+    types.append(value);
+  }
+  return types;
+}
+
+Json::Value json_protos(ddump_data* rd) {
+  Json::Value protos(Json::arrayValue);
+  for (uint32_t i = 0; i < rd->dexh->proto_ids_size; i++) {
+    Json::Value value = json_proto(rd, i);
+    value["idx"] = i;
+    protos.append(value);
+  }
+  return protos;
+}
+
+Json::Value json_fields(ddump_data* rd) {
+  Json::Value fields(Json::arrayValue);
+  for (uint32_t i = 0; i < rd->dexh->field_ids_size; i++) {
+    dex_field_id* field = rd->dex_field_ids + i;
+    Json::Value value;
+    value["idx"] = i;
+    value["class"] = dex_string_by_type_idx(rd, field->classidx);
+    value["type"] = dex_string_by_type_idx(rd, field->typeidx);
+    value["name"] = dex_string_by_idx(rd, field->nameidx);
+    fields.append(value);
+  }
+  return fields;
+}
+
+Json::Value json_methods(ddump_data* rd) {
+  Json::Value methods(Json::arrayValue);
+  for (uint32_t i = 0; i < rd->dexh->method_ids_size; i++) {
+    dex_method_id* method = rd->dex_method_ids + i;
+    Json::Value value;
+    value["idx"] = i;
+    value["class"] = dex_string_by_type_idx(rd, method->classidx);
+    value["name"] = dex_string_by_idx(rd, method->nameidx);
+    value["proto"] = json_proto(rd, method->protoidx);
+    methods.append(value);
+  }
+  return methods;
+}
+
+Json::Value json_clsdefs(ddump_data* rd) {
+  Json::Value clsdefs(Json::arrayValue);
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    dex_class_def* cls_def = rd->dex_class_defs + i;
+    Json::Value value;
+    value["idx"] = i;
+    value["name"] = dex_string_by_type_idx(rd, cls_def->typeidx);
+    value["access_flags"] = cls_def->access_flags;
+    value["flags"] = get_flags(cls_def->access_flags);
+    if (cls_def->super_idx != DEX_NO_INDEX) {
+      value["super"] = dex_string_by_type_idx(rd, cls_def->super_idx);
+    }
+    value["interfaces"] = json_type_list(rd, cls_def->interfaces_off);
+    if (cls_def->source_file_idx != DEX_NO_INDEX) {
+      value["source_file"] = dex_string_by_idx(rd, cls_def->source_file_idx);
+    }
+    value["annotations_off"] = cls_def->annotations_off;
+    value["class_data_off"] = cls_def->class_data_offset;
+    value["static_values_off"] = cls_def->static_values_off;
+    clsdefs.append(value);
+  }
+  return clsdefs;
+}
@@ -8,11 +8,19 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 
 extern bool clean;
 extern bool raw;
 extern bool escape;
 
+/*
+ * While set, redump appends what it prints on this thread to the buffer
+ * instead of writing it to stdout. This lets sections be rendered in parallel
+ * and written out in order afterwards.
+ */
+extern thread_local std::string* redump_buffer;
+
 void redump(const char* format, ...);
 void redump(uint32_t off, const char* format, ...);
 void redump(uint32_t pos, uint32_t off, const char* format, ...);
@@ -10,6 +10,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "PrintUtil.h"
 #include "Formatters.h"
@@ -46,8 +52,54 @@ static const char ddump_usage_string[] =
     "--clean: suppress indices and offsets\n"
     "--no-headers: suppress headers\n"
     "--raw: print all bytes, even control characters\n"
+    "--json: print the header and the sections as JSON; the id tables are\n"
+    "        printed as objects, the other sections as lists of lines\n"
+    "-j, --jobs=<count>: number of sections to render at the same time\n"
   ;
 
+namespace {
+
+struct Section {
+  const char* name;
+  bool enabled;
+  std::function<void(ddump_data*)> dump;
+  // Only set for the sections that have a structured JSON form.
+  std::function<Json::Value(ddump_data*)> json;
+};
+
+Json::Value text_lines(const std::string& text) {
+  Json::Value lines(Json::arrayValue);
+  std::istringstream ss(text);
+  for (std::string line; std::getline(ss, line);) {
+    lines.append(line);
+  }
+  return lines;
+}
+
+/*
+ * Calls fn(i) for each i in [0, n), from jobs threads.
+ */
+void parallel_for(size_t n,
+                  unsigned jobs,
+                  const std::function<void(size_t)>& fn) {
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min<size_t>(jobs, n); i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
 
   bool all = false;
@@ -65,6 +117,8 @@ int main(int argc, char* argv[]) {
   bool redexdump_debug = false;
   uint32_t ddebug_offset = 0;
   int no_headers = 0;
+  int json = 0;
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
 
   char c;
   static const struct option options[] = {
@@ -86,6 +140,8 @@ int main(int argc, char* argv[]) {
     { "raw", no_argument, (int*)&raw, 1 },
     { "escape", no_argument, (int*)&escape, 1 },
     { "no-headers", no_argument, &no_headers, 1 },
+    { "json", no_argument, &json, 1 },
+    { "jobs", required_argument, nullptr, 'j' },
     { "help", no_argument, nullptr, 'h' },
     { nullptr, 0, nullptr, 0 },
   };
@@ -93,7 +149,7 @@ int main(int argc, char* argv[]) {
   while ((c = getopt_long(
             argc,
             argv,
-            "asStpfmcCxeAdDh",
+            "asStpfmcCxeAdD:hj:",
             &options[0],
             nullptr)) != -1) {
     switch (c) {
@@ -139,6 +195,9 @@ int main(int argc, char* argv[]) {
       case 'D':
         sscanf(optarg, "%x", &ddebug_offset);
         break;
+      case 'j':
+        jobs = std::max(1, atoi(optarg));
+        break;
       case 'h':
         puts(ddump_usage_string);
         return 0;
@@ -157,51 +216,87 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  while (optind < argc) {
-    const char* dexfile = argv[optind++];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
-    if (!no_headers) {
-      redump(format_map(&rd).c_str());
-    }
-    if (string || all) {
-      dump_strings(&rd, !no_headers);
-    }
-    if (stringdata || all) {
-      dump_stringdata(&rd, !no_headers);
-    }
-    if (type || all) {
-      dump_types(&rd);
-    }
-    if (proto || all) {
-      dump_protos(&rd, !no_headers);
-    }
-    if (field || all) {
-      dump_fields(&rd, !no_headers);
-    }
-    if (meth || all) {
-      dump_methods(&rd, !no_headers);
-    }
-    if (clsdef || all) {
-      dump_clsdefs(&rd, !no_headers);
-    }
-    if (clsdata || all) {
-      dump_clsdata(&rd, !no_headers);
-    }
-    if (code || all) {
-      dump_code(&rd);
-    }
-    if (enarr || all) {
-      dump_enarr(&rd);
+  bool headers = !no_headers;
+  std::vector<Section> sections{
+      {"header", headers && !json,
+       [](ddump_data* rd) { redump(format_map(rd).c_str()); }},
+      {"strings", string || all,
+       [=](ddump_data* rd) { dump_strings(rd, headers); }, json_strings},
+      {"stringdata", stringdata || all,
+       [=](ddump_data* rd) { dump_stringdata(rd, headers); }},
+      {"types", type || all, dump_types, json_types},
+      {"protos", proto || all,
+       [=](ddump_data* rd) { dump_protos(rd, headers); }, json_protos},
+      {"fields", field || all,
+       [=](ddump_data* rd) { dump_fields(rd, headers); }, json_fields},
+      {"methods", meth || all,
+       [=](ddump_data* rd) { dump_methods(rd, headers); }, json_methods},
+      {"clsdefs", clsdef || all,
+       [=](ddump_data* rd) { dump_clsdefs(rd, headers); }, json_clsdefs},
+      {"clsdata", clsdata || all,
+       [=](ddump_data* rd) { dump_clsdata(rd, headers); }},
+      {"code", code || all, dump_code},
+      {"enarr", enarr || all, dump_enarr},
+      {"anno", anno || all, dump_anno},
+      {"debug", redexdump_debug || all, dump_debug},
+      {"ddebug", ddebug_offset != 0,
+       [=](ddump_data* rd) { disassemble_debug(rd, ddebug_offset); }},
+  };
+  sections.erase(std::remove_if(sections.begin(),
+                                sections.end(),
+                                [](const Section& s) { return !s.enabled; }),
+                 sections.end());
+
+  std::vector<ddump_data> rds(argc - optind);
+  for (size_t i = 0; i < rds.size(); i++) {
+    open_dex_file(argv[optind + i], &rds[i]);
+  }
+
+  // Every section of every dex file is rendered on its own, into its own
+  // buffer. The buffers are written out in order once all are rendered.
+  size_t num_sections = sections.size();
+  std::vector<std::string> texts(rds.size() * num_sections);
+  std::vector<Json::Value> values(texts.size());
+  parallel_for(texts.size(), jobs, [&](size_t i) {
+    auto rd = &rds[i / num_sections];
+    const auto& section = sections[i % num_sections];
+    if (json && section.json) {
+      values[i] = section.json(rd);
+      return;
     }
-    if (anno || all) {
-      dump_anno(&rd);
+    redump_buffer = &texts[i];
+    section.dump(rd);
+    redump_buffer = nullptr;
+    if (json) {
+      values[i] = text_lines(texts[i]);
+      texts[i].clear();
     }
-    if (redexdump_debug || all) {
-      dump_debug(&rd);
+  });
+
+  if (json) {
+    Json::Value dex_files(Json::arrayValue);
+    for (size_t i = 0; i < rds.size(); i++) {
+      Json::Value dex_file;
+      dex_file["file"] = rds[i].dex_filename;
+      dex_file["header"] = json_header(&rds[i]);
+      for (size_t j = 0; j < num_sections; j++) {
+        dex_file["sections"][sections[j].name] =
+            std::move(values[i * num_sections + j]);
+      }
+      dex_files.append(std::move(dex_file));
     }
-    if (ddebug_offset != 0) {
-      disassemble_debug(&rd, ddebug_offset);
+    Json::Value root;
+    root["dex_files"] = std::move(dex_files);
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    fprintf(stdout, "%s\n", Json::writeString(builder, root).c_str());
+    return 0;
+  }
+
+  for (size_t i = 0; i < rds.size(); i++) {
+    for (size_t j = 0; j < num_sections; j++) {
+      const auto& text = texts[i * num_sections + j];
+      fwrite(text.data(), 1, text.size(), stdout);
     }
     fprintf(stdout, "\n");
     fflush(stdout);
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <json/json.h>
+
 #include "DexCommon.h"
 
 void dump_strings(ddump_data* rd, bool print_headers);
@@ -22,3 +24,15 @@ void dump_enarr(ddump_data* rd);
 void dump_anno(ddump_data* rd);
 void dump_debug(ddump_data* rd);
 void disassemble_debug(ddump_data* rd, uint32_t offset);
+
+/*
+ * The header and the id tables as JSON, for the --json output mode. The other
+ * sections are only available as text.
+ */
+Json::Value json_header(ddump_data* rd);
+Json::Value json_strings(ddump_data* rd);
+Json::Value json_types(ddump_data* rd);
+Json::Value json_protos(ddump_data* rd);
+Json::Value json_fields(ddump_data* rd);
+Json::Value json_methods(ddump_data* rd);
+Json::Value json_clsdefs(ddump_data* rd);
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "Debug.h"
+
+/*
+ * Like MutablePriorityQueue, but for values that are small, dense unsigned
+ * integers, e.g. indices into a vector owned by the client. The queue is a
+ * binary max-heap; the position of each value in the heap is kept in a
+ * vector indexed by the value, so that updating a priority is a sift up or
+ * down without any hashing or node allocation.
+ *
+ * Limitations:
+ * - The same value cannot be present twice (even with a different priority)
+ * - No two values should be in the queue with the same priority at the same
+ *   time; front() is not deterministic otherwise
+ */
+template <class Priority>
+class IndexedPriorityQueue {
+ public:
+  using Value = uint32_t;
+
+  // Inserts a value with a priority; the value must not be present already.
+  void insert(Value value, const Priority& priority) {
+    if (value >= m_positions.size()) {
+      m_positions.resize(value + 1, kAbsent);
+    }
+    always_assert(m_positions[value] == kAbsent);
+    m_positions[value] = m_heap.size();
+    m_heap.emplace_back(priority, value);
+    sift_up(m_heap.size() - 1);
+  }
+
+  // Erases a value that's currently in the queue.
+  void erase(Value value) {
+    auto pos = position(value);
+    m_positions[value] = kAbsent;
+    auto last = m_heap.size() - 1;
+    if (pos != last) {
+      place(pos, m_heap[last]);
+      m_heap.pop_back();
+      restore(pos);
+    } else {
+      m_heap.pop_back();
+    }
+  }
+
+  // Changes the priority of a value. The value must already be in the queue.
+  void update_priority(Value value, const Priority& priority) {
+    auto pos = position(value);
+    if (m_heap[pos].first == priority) {
+      return;
+    }
+    m_heap[pos].first = priority;
+    restore(pos);
+  }
+
+  bool contains(Value value) const {
+    return value < m_positions.size() && m_positions[value] != kAbsent;
+  }
+
+  const Priority& get_priority(Value value) const {
+    return m_heap[position(value)].first;
+  }
+
+  // Removes all elements.
+  void clear() {
+    m_heap.clear();
+    m_positions.clear();
+  }
+
+  bool empty() const { return m_heap.empty(); }
+
+  size_t size() const { return m_heap.size(); }
+
+  // Returns the value with the highest priority.
+  Value front() const {
+    always_assert(!m_heap.empty());
+    return m_heap.front().second;
+  }
+
+ private:
+  using Entry = std::pair<Priority, Value>;
+  static constexpr size_t kAbsent = std::numeric_limits<size_t>::max();
+
+  size_t position(Value value) const {
+    always_assert(contains(value));
+    return m_positions[value];
+  }
+
+  void place(size_t pos, const Entry& entry) {
+    m_heap[pos] = entry;
+    m_positions[entry.second] = pos;
+  }
+
+  void restore(size_t pos) {
+    if (pos > 0 && m_heap[(pos - 1) / 2].first < m_heap[pos].first) {
+      sift_up(pos);
+    } else {
+      sift_down(pos);
+    }
+  }
+
+  void sift_up(size_t pos) {
+    auto entry = m_heap[pos];
+    while (pos > 0) {
+      auto parent = (pos - 1) / 2;
+      if (!(m_heap[parent].first < entry.first)) {
+        break;
+      }
+      place(pos, m_heap[parent]);
+      pos = parent;
+    }
+    place(pos, entry);
+  }
+
+  void sift_down(size_t pos) {
+    auto entry = m_heap[pos];
+    auto size = m_heap.size();
+    while (true) {
+      auto child = 2 * pos + 1;
+      if (child >= size) {
+        break;
+      }
+      if (child + 1 < size && m_heap[child].first < m_heap[child + 1].first) {
+        ++child;
+      }
+      if (!(entry.first < m_heap[child].first)) {
+        break;
+      }
+      place(pos, m_heap[child]);
+      pos = child;
+    }
+    place(pos, entry);
+  }
+
+  std::vector<Entry> m_heap;
+  std::vector<size_t> m_positions;
+};
+
+template <class Priority>
+constexpr size_t IndexedPriorityQueue<Priority>::kAbsent;
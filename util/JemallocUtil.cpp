@@ -5,6 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "JemallocUtil.h"
+
+#include <string>
+
 #if defined(__unix__) || defined(__APPLE__)
 #include <dlfcn.h>
 #endif
@@ -28,6 +32,26 @@ MallctlFn mallctl = nullptr;
 
 namespace {
 
+// The arena a thread used before bind_thread_to_arena(), if it is bound.
+thread_local bool t_bound = false;
+thread_local unsigned t_previous_arena = 0;
+
+uint64_t get_stat(const char* name) {
+  if (mallctl == nullptr) {
+    return 0;
+  }
+  // jemalloc caches its statistics; bumping the epoch refreshes them.
+  uint64_t epoch = 1;
+  size_t len = sizeof(epoch);
+  mallctl("epoch", &epoch, &len, &epoch, len);
+  size_t value = 0;
+  len = sizeof(value);
+  if (mallctl(name, &value, &len, nullptr, 0) != 0) {
+    return 0;
+  }
+  return value;
+}
+
 void set_profile_active(bool active) {
   if (mallctl == nullptr) {
     return;
@@ -45,4 +69,61 @@ void enable_profiling() { set_profile_active(true); }
 
 void disable_profiling() { set_profile_active(false); }
 
+uint64_t* thread_allocated_counter() {
+  if (mallctl == nullptr) {
+    return nullptr;
+  }
+  uint64_t* counter = nullptr;
+  size_t len = sizeof(counter);
+  if (mallctl("thread.allocatedp", &counter, &len, nullptr, 0) != 0) {
+    return nullptr;
+  }
+  return counter;
+}
+
+uint64_t get_allocated_bytes() { return get_stat("stats.allocated"); }
+
+uint64_t get_resident_bytes() { return get_stat("stats.resident"); }
+
+bool create_arena(unsigned* arena) {
+  if (mallctl == nullptr) {
+    return false;
+  }
+  size_t len = sizeof(*arena);
+  return mallctl("arenas.create", arena, &len, nullptr, 0) == 0;
+}
+
+void bind_thread_to_arena(unsigned arena) {
+  always_assert(!t_bound);
+  if (mallctl == nullptr) {
+    return;
+  }
+  size_t len = sizeof(t_previous_arena);
+  int err = mallctl(
+      "thread.arena", &t_previous_arena, &len, &arena, sizeof(arena));
+  always_assert_log(err == 0, "mallctl failed with: %d", err);
+  t_bound = true;
+}
+
+void unbind_thread_from_arena() {
+  if (!t_bound) {
+    return;
+  }
+  // Fails harmlessly when the thread cache is disabled.
+  mallctl("thread.tcache.flush", nullptr, nullptr, nullptr, 0);
+  int err = mallctl("thread.arena", nullptr, nullptr, &t_previous_arena,
+                    sizeof(t_previous_arena));
+  always_assert_log(err == 0, "mallctl failed with: %d", err);
+  t_bound = false;
+}
+
+void purge_arena(unsigned arena) {
+  if (mallctl == nullptr) {
+    return;
+  }
+  auto name = "arena." + std::to_string(arena) + ".purge";
+  int err = mallctl(name.c_str(), nullptr, nullptr, nullptr, 0);
+  always_assert_log(err == 0, "mallctl failed with: %d", err);
+}
+
 } // namespace jemalloc_util
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstdint>
 #include <cstdio>
 
 namespace jemalloc_util {
@@ -13,6 +14,49 @@ void enable_profiling();
 
 void disable_profiling();
 
+/*
+ * Pointer to jemalloc's running count of bytes allocated by the calling
+ * thread ("thread.allocatedp"), or nullptr when not running under jemalloc.
+ * Reading through the pointer is as cheap as reading any other variable.
+ */
+uint64_t* thread_allocated_counter();
+
+/*
+ * Total bytes currently allocated by the application ("stats.allocated"),
+ * refreshed on every call. Returns 0 when not running under jemalloc.
+ */
+uint64_t get_allocated_bytes();
+
+/*
+ * Bytes of physical memory mapped by jemalloc ("stats.resident"), refreshed
+ * on every call. Returns 0 when not running under jemalloc.
+ */
+uint64_t get_resident_bytes();
+
+/*
+ * Creates a new arena, returning false when not running under jemalloc.
+ */
+bool create_arena(unsigned* arena);
+
+/*
+ * Makes the calling thread allocate from `arena` until the matching
+ * unbind_thread_from_arena(). Bindings don't nest.
+ */
+void bind_thread_to_arena(unsigned arena);
+
+/*
+ * Flushes the calling thread's cache of freed objects and returns it to the
+ * arena it used before bind_thread_to_arena(). Does nothing on a thread that
+ * isn't bound.
+ */
+void unbind_thread_from_arena();
+
+/*
+ * Returns the free pages of `arena` to the OS. Objects still allocated in it
+ * are untouched.
+ */
+void purge_arena(unsigned arena);
+
 class ScopedProfiling final {
  public:
   ScopedProfiling(bool enable) {
@@ -7,6 +7,26 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Debug.h"
+
+/*
+ * How a MutablePriorityQueue keeps its elements.
+ * - OrderedMap: a std::map from priority to value; every insertion and
+ *   priority update allocates a node.
+ * - DaryHeap: a 4-ary max-heap in a vector, with the position of each value
+ *   in a hash map; updating a priority is a sift up or down in place, and
+ *   doesn't allocate once the queue has grown. Prefer it when priorities
+ *   change often, see tools/bench/PriorityQueueBench.cpp.
+ */
+enum class MutablePriorityQueueStorage { OrderedMap, DaryHeap };
+
 /*
  * Collection type that maintains a set of elements with associated
  * priorities, allowing updating priorities, and enabling efficient
@@ -15,11 +35,14 @@
  * Limitations:
  * - The same value cannot be present twice (even with a different priority)
  * - No two values can exist in the queue with the same priority at the same
- *   time
+ *   time (with DaryHeap, this isn't checked, but front() is not deterministic
+ *   otherwise)
  */
 template <class Value,
           class Priority,
-          class PriorityCompare = std::less<Priority>>
+          class PriorityCompare = std::less<Priority>,
+          MutablePriorityQueueStorage Storage =
+              MutablePriorityQueueStorage::OrderedMap>
 class MutablePriorityQueue {
  private:
   std::map<Priority, Value, PriorityCompare> m_values;
@@ -63,3 +86,127 @@ class MutablePriorityQueue {
   // Returns element with highest priority.
   Value front() const { return m_values.rbegin()->second; }
 };
+
+template <class Value, class Priority, class PriorityCompare>
+class MutablePriorityQueue<Value,
+                           Priority,
+                           PriorityCompare,
+                           MutablePriorityQueueStorage::DaryHeap> {
+ public:
+  // Inserts a value with a priority; the value must not be present already.
+  void insert(const Value& value, const Priority& priority) {
+    auto result = m_positions.emplace(value, m_heap.size());
+    always_assert(result.second);
+    m_heap.emplace_back(priority, value);
+    sift_up(m_heap.size() - 1);
+  }
+
+  // Erases a value that's currently in the queue.
+  void erase(const Value& value) {
+    auto it = m_positions.find(value);
+    always_assert(it != m_positions.end());
+    auto pos = it->second;
+    m_positions.erase(it);
+    auto last = m_heap.size() - 1;
+    if (pos != last) {
+      place(pos, std::move(m_heap[last]));
+      m_heap.pop_back();
+      restore(pos);
+    } else {
+      m_heap.pop_back();
+    }
+  }
+
+  // Changes the priority of a value. The value must already be in the queue.
+  void update_priority(const Value& value, const Priority& priority) {
+    auto it = m_positions.find(value);
+    always_assert(it != m_positions.end());
+    auto pos = it->second;
+    m_heap[pos].first = priority;
+    restore(pos);
+  }
+
+  // Removes all elements.
+  void clear() {
+    m_heap.clear();
+    m_positions.clear();
+  }
+
+  // Checks if queue is empty.
+  bool empty() const { return m_heap.empty(); }
+
+  // Returns element with highest priority.
+  Value front() const {
+    always_assert(!m_heap.empty());
+    return m_heap.front().second;
+  }
+
+ private:
+  static constexpr size_t kArity = 4;
+  using Entry = std::pair<Priority, Value>;
+
+  bool less(const Entry& a, const Entry& b) const {
+    return m_compare(a.first, b.first);
+  }
+
+  void place(size_t pos, Entry entry) {
+    m_positions[entry.second] = pos;
+    m_heap[pos] = std::move(entry);
+  }
+
+  void restore(size_t pos) {
+    if (pos > 0 && less(m_heap[(pos - 1) / kArity], m_heap[pos])) {
+      sift_up(pos);
+    } else {
+      sift_down(pos);
+    }
+  }
+
+  void sift_up(size_t pos) {
+    Entry entry = std::move(m_heap[pos]);
+    while (pos > 0) {
+      auto parent = (pos - 1) / kArity;
+      if (!less(m_heap[parent], entry)) {
+        break;
+      }
+      place(pos, std::move(m_heap[parent]));
+      pos = parent;
+    }
+    place(pos, std::move(entry));
+  }
+
+  void sift_down(size_t pos) {
+    Entry entry = std::move(m_heap[pos]);
+    auto size = m_heap.size();
+    while (true) {
+      auto first_child = kArity * pos + 1;
+      if (first_child >= size) {
+        break;
+      }
+      auto end = std::min(first_child + kArity, size);
+      auto max_child = first_child;
+      for (auto child = first_child + 1; child < end; ++child) {
+        if (less(m_heap[max_child], m_heap[child])) {
+          max_child = child;
+        }
+      }
+      if (!less(entry, m_heap[max_child])) {
+        break;
+      }
+      place(pos, std::move(m_heap[max_child]));
+      pos = max_child;
+    }
+    place(pos, std::move(entry));
+  }
+
+  std::vector<Entry> m_heap;
+  std::unordered_map<Value, size_t> m_positions;
+  PriorityCompare m_compare;
+};
+
+template <class Value, class Priority, class PriorityCompare>
+constexpr size_t
+    MutablePriorityQueue<Value,
+                         Priority,
+                         PriorityCompare,
+                         MutablePriorityQueueStorage::DaryHeap>::kArity;
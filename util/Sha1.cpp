@@ -12,8 +12,15 @@
 
 #include "Sha1.h"
 
+#include <cstddef>
 #include <cstring>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA1_HAVE_SHA_NI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 static const unsigned char PADDING[128] = {
   0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -208,6 +215,140 @@ static void sha1_transform(
   memset((unsigned char*) x, 0, sizeof(x));
 }
 
+static void sha1_transform_blocks_portable(
+    unsigned int state[5],
+    const unsigned char* blocks,
+    size_t num_blocks) {
+  for (size_t i = 0; i < num_blocks; i++) {
+    sha1_transform(state, blocks + i * 64);
+  }
+}
+
+#ifdef SHA1_HAVE_SHA_NI
+
+/*
+ * SHA1_NI_ROUNDS(k) runs rounds 4k to 4k+3 with the SHA extensions. msg[k % 4]
+ * holds the words 4k to 4k+3 of the schedule; while it is live, it is also
+ * mixed into the words 4k+4 to 4k+15 that are being computed in the other
+ * three registers.
+ */
+#define SHA1_NI_ROUNDS(k)                                                      \
+  do {                                                                         \
+    __m128i& e_next = e[(k) & 1];                                              \
+    if ((k) == 0) {                                                            \
+      e_next = _mm_add_epi32(e_next, msg[0]);                                  \
+    } else {                                                                   \
+      e_next = _mm_sha1nexte_epu32(e_next, msg[(k) & 3]);                      \
+    }                                                                          \
+    e[((k) + 1) & 1] = abcd;                                                   \
+    if ((k) >= 3 && (k) <= 18) {                                               \
+      msg[((k) + 1) & 3] =                                                     \
+          _mm_sha1msg2_epu32(msg[((k) + 1) & 3], msg[(k) & 3]);                \
+    }                                                                          \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_next, (k) / 5);                         \
+    if ((k) >= 1 && (k) <= 16) {                                               \
+      msg[((k) + 3) & 3] =                                                     \
+          _mm_sha1msg1_epu32(msg[((k) + 3) & 3], msg[(k) & 3]);                \
+    }                                                                          \
+    if ((k) >= 2 && (k) <= 17) {                                               \
+      msg[((k) + 2) & 3] = _mm_xor_si128(msg[((k) + 2) & 3], msg[(k) & 3]);    \
+    }                                                                          \
+  } while (0)
+
+/*
+ * The same transformation as sha1_transform, using the SHA instructions of
+ * recent x86 CPUs, which are several times faster.
+ */
+__attribute__((target("sha,sse4.1,ssse3"))) static void
+sha1_transform_blocks_sha_ni(unsigned int state[5],
+                             const unsigned char* blocks,
+                             size_t num_blocks) {
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+  __m128i e[2];
+  e[0] = _mm_set_epi32(state[4], 0, 0, 0);
+  e[1] = _mm_setzero_si128();
+  __m128i msg[4];
+
+  for (size_t i = 0; i < num_blocks; i++) {
+    const unsigned char* block = blocks + i * 64;
+    const __m128i abcd_save = abcd;
+    const __m128i e_save = e[0];
+    for (int j = 0; j < 4; j++) {
+      msg[j] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + j * 16)),
+          byte_swap);
+    }
+    SHA1_NI_ROUNDS(0);
+    SHA1_NI_ROUNDS(1);
+    SHA1_NI_ROUNDS(2);
+    SHA1_NI_ROUNDS(3);
+    SHA1_NI_ROUNDS(4);
+    SHA1_NI_ROUNDS(5);
+    SHA1_NI_ROUNDS(6);
+    SHA1_NI_ROUNDS(7);
+    SHA1_NI_ROUNDS(8);
+    SHA1_NI_ROUNDS(9);
+    SHA1_NI_ROUNDS(10);
+    SHA1_NI_ROUNDS(11);
+    SHA1_NI_ROUNDS(12);
+    SHA1_NI_ROUNDS(13);
+    SHA1_NI_ROUNDS(14);
+    SHA1_NI_ROUNDS(15);
+    SHA1_NI_ROUNDS(16);
+    SHA1_NI_ROUNDS(17);
+    SHA1_NI_ROUNDS(18);
+    SHA1_NI_ROUNDS(19);
+    e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = _mm_extract_epi32(e[0], 3);
+}
+
+#undef SHA1_NI_ROUNDS
+
+static bool cpu_has_sha_ni() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  const bool has_ssse3 = ecx & (1 << 9);
+  const bool has_sse4_1 = ecx & (1 << 19);
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  const bool has_sha = ebx & (1 << 29);
+  return has_ssse3 && has_sse4_1 && has_sha;
+}
+
+#endif // SHA1_HAVE_SHA_NI
+
+/*
+ * Transforms state based on each of the num_blocks consecutive blocks, with
+ * the fastest implementation the CPU supports.
+ */
+static void sha1_transform_blocks(
+    unsigned int state[5],
+    const unsigned char* blocks,
+    size_t num_blocks) {
+  using TransformBlocks =
+      void (*)(unsigned int*, const unsigned char*, size_t);
+#ifdef SHA1_HAVE_SHA_NI
+  static const TransformBlocks transform_blocks =
+      cpu_has_sha_ni() ? sha1_transform_blocks_sha_ni
+                       : sha1_transform_blocks_portable;
+#else
+  static const TransformBlocks transform_blocks =
+      sha1_transform_blocks_portable;
+#endif
+  transform_blocks(state, blocks, num_blocks);
+}
+
 /*
  * SHA1 initialization. Begins an SHA1 operation, writing a new context.
  */
@@ -248,10 +389,11 @@ void sha1_update(
   if (inputLen >= partLen) {
     memcpy((unsigned char*) & context->buffer[index], (unsigned char*) input,
            partLen);
-    sha1_transform(context->state, context->buffer);
+    sha1_transform_blocks(context->state, context->buffer, 1);
 
-    for (i = partLen; i + 63 < inputLen; i += 64)
-      sha1_transform(context->state, &input[i]);
+    const size_t num_blocks = (inputLen - partLen) / 64;
+    sha1_transform_blocks(context->state, &input[partLen], num_blocks);
+    i = partLen + num_blocks * 64;
 
     index = 0;
   } else